@@ -21,6 +21,60 @@ int32_t distance_to_head(handle_t h, int32_t limit, const HandleGraph* graph);
 /// dist increases by the number of bases of each previous node until you reach the head node
 /// seen is a set that holds the nodes that you have already gotten the distance of, but starts off empty
 int32_t distance_to_head(handle_t h, int32_t limit, int32_t dist, unordered_set<handle_t>& seen, const HandleGraph* graph);
+
+////////////////////////////////////////////////////////////////////////////
+// Template implementations
+////////////////////////////////////////////////////////////////////////////
+
+// These are instantiated on the concrete graph type when called with one, so
+// the recursion doesn't have to go through the vtable at every node.
+
+/// Return true if the given handle has no edges on its left side.
+template<typename Graph>
+bool is_head_node(handle_t h, const Graph* g) {
+    bool no_left_edges = true;
+    h = g->forward(h);
+    g->follow_edges(h, true, [&](const handle_t& ignored) {
+        // We found a left edge!
+        no_left_edges = false;
+        // We only need one
+        return false;
+    });
+    return no_left_edges;
+}
+
+template<typename Graph>
+int32_t distance_to_head(handle_t h, int32_t limit, int32_t dist, unordered_set<handle_t>& seen, const Graph* graph) {
+    if (seen.count(h)) return -1;
+    seen.insert(h);
+    if (limit <= 0) {
+        return -1;
+    }
+    
+    if(is_head_node<Graph>(h, graph)) {
+        return dist;
+    }
+
+    int32_t t = -1; 
+
+    graph->follow_edges(h, true, [&](const handle_t& current) {
+        int32_t l = graph->get_length(current);
+        t = distance_to_head<Graph>(current, limit-l, dist+l, seen, graph);
+        if (t != -1) {
+            return false;
+        }
+        else {
+            return true;
+        }
+    });
+    return t;
+}
+
+template<typename Graph>
+int32_t distance_to_head(handle_t h, int32_t limit, const Graph* graph) {
+    unordered_set<handle_t> seen;
+    return distance_to_head<Graph>(h, limit, 0, seen, graph);
+}
                                                       
 }
 }
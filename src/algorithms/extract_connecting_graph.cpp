@@ -5,6 +5,7 @@
  */
  
 #include "extract_connecting_graph.hpp"
+#include "find_shortest_paths.hpp"
 #include <structures/updateable_priority_queue.hpp>
 
 //#define debug_vg_algorithms
@@ -146,6 +147,17 @@ unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Gr
 #endif
         found_target = (offset(pos_2) - offset(pos_1) <= max_len);
     }
+    else if (find_shortest_path_length(source, source->get_handle(id(pos_1), is_rev(pos_1)),
+                                       source->get_handle(id(pos_2), is_rev(pos_2)),
+                                       forward_max_len - first_traversal_length) < 0) {
+        // searching from both positions at once only has to cover about half the distance
+        // from each, so it is much cheaper to rule out a connection that way than to fill
+        // out the whole forward search first (this is the common case when rescue fails)
+#ifdef debug_vg_algorithms
+        cerr << "FORWARD SEARCH: bidirectional search finds no path under forward max len " << forward_max_len << endl;
+#endif
+        found_target = false;
+    }
     else {
         // search through graph to find the target, or to find cycles involving this node
         
@@ -87,13 +87,17 @@ void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<
     
     unordered_set<pair<handle_t, handle_t>> observed_edges;
     
+    // reused buffer for the neighbors of each traversal
+    vector<handle_t> neighbors;
+    
     while (!queue.empty()) {
         // get the next shortest distance traversal from either the init
         Traversal trav = queue.top();
         queue.pop();
         
-        source->follow_edges(trav.handle, false, [&](const handle_t& next) {
-            // Look locally right from this position
+        // Look locally right from this position
+        source->get_neighbors(trav.handle, false, neighbors);
+        for (const handle_t& next : neighbors) {
             
             // Get the ID of where we're going.
             auto next_id = source->get_id(next);
@@ -115,7 +119,7 @@ void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<
                 // we can add more nodes along same path without going over the max length
                 queue.emplace(next, dist_thru);
             }
-        });
+        }
     }
     
     // add the edges to the graph
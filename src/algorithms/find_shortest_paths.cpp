@@ -7,6 +7,9 @@
 #include "find_shortest_paths.hpp"
 #include <structures/updateable_priority_queue.hpp>
 
+#include <queue>
+#include <limits>
+
 namespace vg {
 namespace algorithms {
 
@@ -82,6 +85,129 @@ unordered_map<handle_t, size_t>  find_shortest_paths(const HandleGraph* g, handl
 
 }
 
+int64_t find_shortest_path_length(const HandleGraph* g, handle_t start, handle_t end, int64_t max_len,
+                                  const function<int64_t(const handle_t&)>& lower_bound) {
+    
+    if (max_len < 0) {
+        return -1;
+    }
+    
+    // Both searches measure distances so that they add up at a meeting
+    // handle. The forward search goes from the end of start to the end of
+    // each handle, and the backward search goes from the end of each handle
+    // to the end of end. So a whole path comes out end's length too long.
+    int64_t end_length = g->get_length(end);
+    int64_t limit = max_len + end_length;
+    int64_t best = numeric_limits<int64_t>::max();
+    
+    using Record = pair<int64_t, handle_t>;
+    struct IsFirstGreater {
+        inline bool operator()(const Record& a, const Record& b) {
+            return a.first > b.first;
+        }
+    };
+    using Queue = priority_queue<Record, vector<Record>, IsFirstGreater>;
+    
+    Queue forward_queue;
+    Queue backward_queue;
+    unordered_map<handle_t, int64_t> forward_dist;
+    unordered_map<handle_t, int64_t> backward_dist;
+    
+    auto relax_forward = [&](const handle_t& handle, int64_t dist) {
+        if (dist > limit || (lower_bound && handle != end && dist + lower_bound(handle) > max_len)) {
+            // Can't be on a short enough path
+            return;
+        }
+        auto found = forward_dist.find(handle);
+        if (found != forward_dist.end() && found->second <= dist) {
+            return;
+        }
+        forward_dist[handle] = dist;
+        forward_queue.emplace(dist, handle);
+        
+        // See if this completes a path
+        if (handle == end) {
+            best = min(best, dist);
+        }
+        auto other = backward_dist.find(handle);
+        if (other != backward_dist.end()) {
+            best = min(best, dist + other->second);
+        }
+    };
+    
+    auto relax_backward = [&](const handle_t& handle, int64_t dist) {
+        if (dist > limit) {
+            return;
+        }
+        auto found = backward_dist.find(handle);
+        if (found != backward_dist.end() && found->second <= dist) {
+            return;
+        }
+        backward_dist[handle] = dist;
+        backward_queue.emplace(dist, handle);
+        
+        if (handle == start) {
+            best = min(best, dist);
+        }
+        auto other = forward_dist.find(handle);
+        if (other != forward_dist.end()) {
+            best = min(best, other->second + dist);
+        }
+    };
+    
+    // Drop queue entries that have since been beaten
+    auto skip_stale = [](Queue& queue, const unordered_map<handle_t, int64_t>& dist) {
+        while (!queue.empty() && dist.at(queue.top().second) < queue.top().first) {
+            queue.pop();
+        }
+    };
+    
+    // Start and end are only the endpoints here. If the searches come back
+    // around to them, they are just ordinary handles on a cycle.
+    g->follow_edges(start, false, [&](const handle_t& next) {
+        relax_forward(next, g->get_length(next));
+    });
+    g->follow_edges(end, true, [&](const handle_t& prev) {
+        relax_backward(prev, end_length);
+    });
+    
+    while (true) {
+        skip_stale(forward_queue, forward_dist);
+        skip_stale(backward_queue, backward_dist);
+        
+        if (forward_queue.empty() || backward_queue.empty()) {
+            // One side has seen everything it can reach, and every edge into
+            // the other endpoint that it crossed has already been counted.
+            break;
+        }
+        
+        int64_t forward_top = forward_queue.top().first;
+        int64_t backward_top = backward_queue.top().first;
+        if (forward_top + backward_top >= min(best, limit + 1)) {
+            // Any path we haven't seen yet is at least this long
+            break;
+        }
+        
+        if (forward_top <= backward_top) {
+            handle_t here = forward_queue.top().second;
+            forward_queue.pop();
+            g->follow_edges(here, false, [&](const handle_t& next) {
+                relax_forward(next, forward_top + g->get_length(next));
+            });
+        }
+        else {
+            handle_t here = backward_queue.top().second;
+            backward_queue.pop();
+            int64_t here_length = g->get_length(here);
+            g->follow_edges(here, true, [&](const handle_t& prev) {
+                relax_backward(prev, backward_top + here_length);
+            });
+        }
+    }
+    
+    return best <= limit ? best - end_length : -1;
+}
+
     
 }
 }
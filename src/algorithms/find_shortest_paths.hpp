@@ -8,6 +8,7 @@
  */
 
 #include <unordered_map>
+#include <functional>
 
 #include "../position.hpp"
 #include "../vg.pb.h"
@@ -21,6 +22,22 @@ namespace algorithms {
     /// leftward to all reachable oriented nodes on a directed walk. Uses
     /// Dijkstra's Algorithm.
     unordered_map<handle_t, size_t>  find_shortest_paths(const HandleGraph* g, handle_t start);
+    
+    /// Finds the length in bases of the shortest oriented path that leaves the
+    /// end of start and arrives at the beginning of end, not counting start or
+    /// end themselves. If they are the same handle, this is the shortest cycle
+    /// back to it. Returns -1 if there is no such path of at most max_len.
+    ///
+    /// Searches rightward from start and leftward from end at the same time,
+    /// always expanding the nearer frontier, and stops as soon as the two
+    /// searches prove the best meeting point, so each only has to cover about
+    /// half the distance.
+    ///
+    /// If given, lower_bound(h) must never overestimate the number of bases
+    /// from the end of h to the beginning of end. It is used to prune the
+    /// rightward search.
+    int64_t find_shortest_path_length(const HandleGraph* g, handle_t start, handle_t end, int64_t max_len,
+                                      const function<int64_t(const handle_t&)>& lower_bound = nullptr);
                                                       
 }
 }
@@ -12,34 +12,37 @@ bool is_directed_acyclic(const HandleGraph* graph) {
     // entries from tips until either we've cleaned up all the nodes or there
     // are only directed cycles left.
 
+    // Get all the handles, so we can measure their degrees in parallel
+    vector<handle_t> handles;
+    handles.reserve(graph->node_size());
+    graph->for_each_handle([&](const handle_t& here) {
+        handles.push_back(here);
+    });
+    
+    vector<pair<int64_t, int64_t>> handle_degrees(handles.size());
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < handles.size(); i++) {
+        handle_degrees[i] = make_pair(graph->get_degree(handles[i], true), graph->get_degree(handles[i], false));
+    }
+
     // Build the degrees map
     unordered_map<id_t, pair<int64_t, int64_t>> degrees;
+    degrees.reserve(handles.size());
     // And also the stack of tips to start at
     vector<handle_t> stack;
-    graph->for_each_handle([&](const handle_t& here) {
-        size_t start_degree = 0;
-        graph->follow_edges(here, true, [&](const handle_t& ignored) {
-            start_degree++;
-        });
+    for (size_t i = 0; i < handles.size(); i++) {
+        const handle_t& here = handles[i];
+        degrees[graph->get_id(here)] = handle_degrees[i];
         
-        size_t end_degree = 0;
-        graph->follow_edges(here, false, [&](const handle_t& ignored) {
-            end_degree++;
-        });
-    
-        degrees[graph->get_id(here)] = make_pair(start_degree, end_degree);
-        
-        if (start_degree == 0) {
+        if (handle_degrees[i].first == 0) {
             // Tip looking forward
             stack.push_back(here);
         }
-        if (end_degree == 0) {
+        if (handle_degrees[i].second == 0) {
             // Tip looking backward
             stack.push_back(graph->flip(here));
         }
-        
-    });
-    
+    }
     
     while (!stack.empty()) {
         handle_t here = stack.back();
@@ -6,19 +6,23 @@ namespace algorithms {
 using namespace std;
 
 void remove_high_degree_nodes(MutableHandleGraph& g, int max_degree) {
-    vector<handle_t> to_remove;
+    // Get all the handles, so we can check their degrees in parallel
+    vector<handle_t> handles;
     g.for_each_handle([&](const handle_t& h) {
-            int edge_count = 0;
-            g.follow_edges(h, false, [&](const handle_t& ignored) {
-                    ++edge_count;
-                });
-            g.follow_edges(h, true, [&](const handle_t& ignored) {
-                    ++edge_count;
-                });
-            if (edge_count > max_degree) {
-                to_remove.push_back(h);
-            }
+            handles.push_back(h);
         });
+    vector<uint8_t> too_high(handles.size(), false);
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < handles.size(); i++) {
+        too_high[i] = (int) (g.get_degree(handles[i], false) + g.get_degree(handles[i], true)) > max_degree;
+    }
+    // Keep the removal order the same as the serial scan
+    vector<handle_t> to_remove;
+    for (size_t i = 0; i < handles.size(); i++) {
+        if (too_high[i]) {
+            to_remove.push_back(handles[i]);
+        }
+    }
     // now destroy the high degree nodes
     for (auto& h : to_remove) {
         g.destroy_handle(h);
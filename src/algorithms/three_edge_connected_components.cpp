@@ -0,0 +1,176 @@
+#include "three_edge_connected_components.hpp"
+
+#include <cstdint>
+#include <limits>
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+vector<size_t> three_edge_connected_components(size_t vertex_count, const vector<pair<size_t, size_t>>& edges) {
+
+    const size_t NONE = numeric_limits<size_t>::max();
+
+    // Adjacency lists of (neighbor, edge number), packed together. Self loops
+    // can't help connect anything, so we leave them out.
+    vector<size_t> adjacency_start(vertex_count + 1, 0);
+    for (auto& edge : edges) {
+        if (edge.first != edge.second) {
+            adjacency_start[edge.first + 1]++;
+            adjacency_start[edge.second + 1]++;
+        }
+    }
+    for (size_t i = 0; i < vertex_count; i++) {
+        adjacency_start[i + 1] += adjacency_start[i];
+    }
+    vector<pair<size_t, size_t>> adjacency(adjacency_start.back());
+    {
+        vector<size_t> cursor(adjacency_start.begin(), adjacency_start.end() - 1);
+        for (size_t i = 0; i < edges.size(); i++) {
+            if (edges[i].first != edges[i].second) {
+                adjacency[cursor[edges[i].first]++] = make_pair(edges[i].second, i);
+                adjacency[cursor[edges[i].second]++] = make_pair(edges[i].first, i);
+            }
+        }
+    }
+
+    // DFS preorder number, lowest preorder number reachable from the
+    // subtree, and number of descendants (including itself) of each vertex
+    vector<size_t> pre(vertex_count, NONE);
+    vector<size_t> lowpt(vertex_count);
+    vector<size_t> descendants(vertex_count);
+    // Edges leaving the group of vertices each vertex has absorbed
+    vector<int64_t> degree(vertex_count);
+    // Each vertex's path goes down the DFS tree through these links
+    vector<size_t> path_next(vertex_count, NONE);
+    // Union-find over the groups, with each group's root the vertex that
+    // absorbed the rest
+    vector<size_t> absorbed_into(vertex_count);
+    for (size_t i = 0; i < vertex_count; i++) {
+        absorbed_into[i] = i;
+    }
+
+    // Absorb x and everything after it on its path into w
+    auto absorb_path = [&](size_t w, size_t x) {
+        while (x != NONE) {
+            degree[w] += degree[x] - 2;
+            absorbed_into[x] = w;
+            x = path_next[x];
+        }
+    };
+
+    struct Frame {
+        size_t vertex;
+        size_t parent_edge;
+        size_t next_adjacency;
+    };
+    vector<Frame> stack;
+    size_t counter = 0;
+
+    auto visit = [&](size_t v, size_t parent_edge) {
+        pre[v] = lowpt[v] = counter++;
+        descendants[v] = 1;
+        degree[v] = 0;
+        stack.push_back(Frame{v, parent_edge, adjacency_start[v]});
+    };
+
+    for (size_t root = 0; root < vertex_count; root++) {
+        if (pre[root] != NONE) {
+            continue;
+        }
+        visit(root, NONE);
+
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            size_t w = frame.vertex;
+
+            if (frame.next_adjacency < adjacency_start[w + 1]) {
+                size_t u = adjacency[frame.next_adjacency].first;
+                size_t edge = adjacency[frame.next_adjacency].second;
+                frame.next_adjacency++;
+
+                degree[w]++;
+                if (edge == frame.parent_edge) {
+                    // the tree edge we came in on
+                    continue;
+                }
+                if (pre[u] == NONE) {
+                    // a new tree edge; the frame reference is invalid after this
+                    visit(u, edge);
+                } else if (pre[u] < pre[w]) {
+                    // a back edge up to an ancestor
+                    if (pre[u] < lowpt[w]) {
+                        absorb_path(w, path_next[w]);
+                        path_next[w] = NONE;
+                        lowpt[w] = pre[u];
+                    }
+                } else {
+                    // A back edge up from a descendant, which connects us to
+                    // everything on our path above it. The edge doesn't
+                    // leave the group any more at either end.
+                    degree[w] -= 2;
+                    size_t x = path_next[w];
+                    while (x != NONE && pre[x] <= pre[u] && pre[u] < pre[x] + descendants[x]) {
+                        degree[w] += degree[x] - 2;
+                        absorbed_into[x] = w;
+                        x = path_next[x];
+                    }
+                    path_next[w] = x;
+                }
+            } else {
+                // We're done with w, so fold it into its parent.
+                stack.pop_back();
+                if (stack.empty()) {
+                    break;
+                }
+                size_t u = w;
+                w = stack.back().vertex;
+                descendants[w] += descendants[u];
+
+                size_t u_path = u;
+                if (degree[u] <= 2) {
+                    // One or two edges separate u's group from everything
+                    // else, so it is a component of its own. If there were
+                    // two, they act as one edge from w from now on.
+                    if (degree[u] == 1) {
+                        degree[w]--;
+                    }
+                    u_path = path_next[u];
+                }
+
+                if (lowpt[w] <= lowpt[u]) {
+                    absorb_path(w, u_path);
+                } else {
+                    lowpt[w] = lowpt[u];
+                    absorb_path(w, path_next[w]);
+                    path_next[w] = u_path;
+                }
+            }
+        }
+    }
+
+    // Number the groups in order of their first vertices
+    vector<size_t> component(vertex_count, NONE);
+    size_t component_count = 0;
+    for (size_t i = 0; i < vertex_count; i++) {
+        size_t group = i;
+        while (absorbed_into[group] != group) {
+            group = absorbed_into[group];
+        }
+        // compress the path for the next lookup
+        for (size_t j = i; absorbed_into[j] != group; ) {
+            size_t next = absorbed_into[j];
+            absorbed_into[j] = group;
+            j = next;
+        }
+        if (component[group] == NONE) {
+            component[group] = component_count++;
+        }
+        component[i] = component[group];
+    }
+    return component;
+}
+
+}
+}
@@ -0,0 +1,32 @@
+#ifndef VG_ALGORITHMS_THREE_EDGE_CONNECTED_COMPONENTS_HPP_INCLUDED
+#define VG_ALGORITHMS_THREE_EDGE_CONNECTED_COMPONENTS_HPP_INCLUDED
+
+/**
+ * \file three_edge_connected_components.hpp
+ *
+ * Defines an algorithm for finding the 3-edge-connected components of an
+ * undirected multigraph, which is the first step in building a cactus graph.
+ */
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+/// Find the 3-edge-connected components of the undirected multigraph with
+/// vertices numbered 0 to vertex_count - 1 and the given edges, which may
+/// include parallel edges and self loops, and need not be connected. Two
+/// vertices are in the same component if no two edges can be removed to
+/// disconnect them. Returns the component number of each vertex, numbered
+/// from 0 in order of each component's first vertex. Uses Tsin's linear-time
+/// one-pass algorithm, with an explicit stack so deep graphs are fine.
+vector<size_t> three_edge_connected_components(size_t vertex_count, const vector<pair<size_t, size_t>>& edges);
+
+}
+}
+
+#endif
@@ -6,257 +6,280 @@ namespace algorithms {
 using namespace std;
 
 vector<handle_t> head_nodes(const HandleGraph* g) {
-    vector<handle_t> to_return;
-    g->for_each_handle([&](const handle_t& found) {
-        // For each (locally forward) node
-        
-        bool no_left_edges = true;
-        g->follow_edges(found, true, [&](const handle_t& ignored) {
-            // We found a left edge!
-            no_left_edges = false;
-            // We only need one
-            return false;
-        });
-        
-        if (no_left_edges) {
-            to_return.push_back(found);
-        }
-    });
-    
-    return to_return;
-    
+    return head_nodes<HandleGraph>(g);
 }
 
 vector<handle_t> tail_nodes(const HandleGraph* g) {
-    vector<handle_t> to_return;
-    g->for_each_handle([&](const handle_t& found) {
-        // For each (locally forward) node
-        
-        bool no_right_edges = true;
-        g->follow_edges(found, false, [&](const handle_t& ignored) {
-            // We found a right edge!
-            no_right_edges = false;
-            // We only need one
-            return false;
-        });
-        
-        if (no_right_edges) {
-            to_return.push_back(found);
-        }
-    });
-    
-    return to_return;
-    
+    return tail_nodes<HandleGraph>(g);
 }
 
 vector<handle_t> topological_sort(const HandleGraph* g) {
-    
-    // Make a vector to hold the ordered and oriented nodes.
+    return topological_sort<HandleGraph>(g);
+}
+
+/// The order in which topological_sort() visits one weakly connected
+/// component, split into the runs that it makes between running out of
+/// oriented nodes.
+struct ComponentOrder {
+    /// The oriented nodes in the order they were emitted
     vector<handle_t> sorted;
-    sorted.reserve(g->node_size());
-    
-    // Instead of actually removing edges, we add them to this set of masked edges.
+    /// Where each run starts in sorted. The first run starts from the
+    /// component's heads, and is empty if it has none.
+    vector<size_t> run_starts;
+    /// For each run but the first, whether it started from a seed (rather
+    /// than an arbitrary node), and the ID of the node it started from
+    vector<pair<bool, id_t>> run_keys;
+};
+
+/// Run the topological_sort() algorithm on just the given component. Its
+/// nodes must be given in ID order, and visited must be set for exactly the
+/// heads, which are indexed by ID - min_id. Different components can be
+/// sorted at the same time, since they touch disjoint parts of visited and
+/// seeded.
+static void sort_component(const HandleGraph* g, const vector<id_t>& nodes, const vector<id_t>& heads,
+                           id_t min_id, vector<uint8_t>& visited, vector<uint8_t>& seeded,
+                           ComponentOrder& order) {
+
+    // Oriented nodes (s) and cycle entry points (seeds), as (ID, is_reverse)
+    // so that the smallest ID comes out first, like the ordered maps in
+    // topological_sort().
+    typedef pair<id_t, bool> oriented_t;
+    priority_queue<oriented_t, vector<oriented_t>, greater<oriented_t>> s, seeds;
     unordered_set<pair<handle_t, handle_t>> masked_edges;
-    
-    // This (s) is our set of oriented nodes.
-    // using a map instead of a set ensures a stable sort across different systems
-    map<id_t, handle_t> s;
 
-    // We find the head and tails, if there are any
-    vector<handle_t> heads{head_nodes(g)};
-    // No need to fetch the tails since we don't use them
+    auto is_unvisited = [&](id_t id) {
+        return !visited[id - min_id];
+    };
+    auto visit = [&](const oriented_t& node) {
+        visited[node.first - min_id] = 1;
+        s.push(node);
+    };
 
-    
-    // Maps from node ID to first orientation we suggested for it.
-    map<id_t, handle_t> seeds;
-    
-    
-    for(handle_t& head : heads) {
-        // Dump all the heads into the oriented set, rather than having them as
-        // seeds. We will only go for cycle-breaking seeds when we run out of
-        // heads. This is bad for contiguity/ordering consistency in cyclic
-        // graphs and reversing graphs, but makes sure we work out to just
-        // topological sort on DAGs. It mimics the effect we used to get when we
-        // joined all the head nodes to a new root head node and seeded that. We
-        // ignore tails since we only orient right from nodes we pick.
-        s[g->get_id(head)] = head;
+    for (id_t head : heads) {
+        s.emplace(head, false);
     }
-
-    // We will use an ordered map handles by ID for nodes we have not visited
-    // yet. This ensures a consistent sort order across systems.
-    map<id_t, handle_t> unvisited;
-    g->for_each_handle([&](const handle_t& found) {
-        if (!s.count(g->get_id(found))) {
-            // Only nodes that aren't yet in s are unvisited.
-            // Nodes in s are visited but just need to be added tot he ordering.
-            unvisited.emplace(g->get_id(found), found);
-        }
-    });
-
-    while(!unvisited.empty() || !s.empty()) {
-
-        // Put something in s. First go through seeds until we can find one
-        // that's not already oriented.
-        while(s.empty() && !seeds.empty()) {
-            // Look at the first seed
-            auto first_seed = (*seeds.begin()).second;
-
-            if(unvisited.count(g->get_id(first_seed))) {
-                // We have an unvisited seed. Use it
-#ifdef debug
-#pragma omp critical (cerr)
-                cerr << "Starting from seed " << g->get_id(first_seed) << " orientation " << g->get_is_reverse(first_seed) << endl;
-#endif
-
-                s[g->get_id(first_seed)] = first_seed;
-                unvisited.erase(g->get_id(first_seed));
+    // Unvisited nodes are found by walking forward through the nodes in ID order
+    size_t unvisited_count = nodes.size() - heads.size();
+    size_t next_unvisited = 0;
+
+    order.sorted.reserve(nodes.size());
+    order.run_starts.push_back(0);
+
+    while (unvisited_count > 0 || !s.empty()) {
+
+        if (s.empty()) {
+            // Start a new run from a seed if there is one left that we haven't
+            // visited, and otherwise from the unvisited node with the smallest ID.
+            while (s.empty() && !seeds.empty()) {
+                oriented_t first_seed = seeds.top();
+                seeds.pop();
+                if (is_unvisited(first_seed.first)) {
+                    visit(first_seed);
+                    unvisited_count--;
+                    order.run_keys.emplace_back(true, first_seed.first);
+                }
             }
-            // Whether we used the seed or not, don't keep it around
-            seeds.erase(seeds.begin());
-        }
-
-        if(s.empty()) {
-            // If we couldn't find a seed, just grab any old node.
-            // Since map order is stable across systems, we can take the first node by id and put it locally forward.
-#ifdef debug
-#pragma omp critical (cerr)
-            cerr << "Starting from arbitrary node " << unvisited.begin()->first << " locally forward" << endl;
-#endif
-
-            s[unvisited.begin()->first] = unvisited.begin()->second;
-            unvisited.erase(unvisited.begin()->first);
+            if (s.empty()) {
+                while (!is_unvisited(nodes[next_unvisited])) {
+                    next_unvisited++;
+                }
+                visit(oriented_t(nodes[next_unvisited], false));
+                unvisited_count--;
+                order.run_keys.emplace_back(false, nodes[next_unvisited]);
+            }
+            order.run_starts.push_back(order.sorted.size());
         }
 
         while (!s.empty()) {
-            // Grab an oriented node
-            auto n = s.begin()->second;
-            s.erase(g->get_id(n));
-            // Emit it
-            sorted.push_back(n);
-#ifdef debug
-#pragma omp critical (cerr)
-            cerr << "Using oriented node " << g->get_id(n) << " orientation " << g->get_is_reverse(n) << endl;
-#endif
+            handle_t n = g->get_handle(s.top().first, s.top().second);
+            s.pop();
+            order.sorted.push_back(n);
 
-            // See if it has an edge from its start to the start of some node
-            // where both were picked as places to break into cycles. A
-            // reversing self loop on a cycle entry point is a special case of
-            // this.
+            // Mask edges from the start of this node to cycle entry points
+            // we have already visited, as topological_sort() does.
             g->follow_edges(n, true, [&](const handle_t& prev_node) {
-                if(!unvisited.count(g->get_id(prev_node))) {
-                    // Look at the edge
-                    auto edge = g->edge_handle(prev_node, n);
-                    if (masked_edges.count(edge)) {
-                        // We removed this edge, so skip it.
-                        return;
-                    }
-                    
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "\tHas left-side edge to cycle entry point " << g->get_id(prev_node)
-                         << " orientation " << g->get_is_reverse(prev_node) << endl;
-#endif
-
-                    // Mask the edge
-                    masked_edges.insert(edge);
-                    
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "\t\tEdge: " << g->get_id(edge.first) << " " << g->get_is_reverse(edge.first)
-                        << " -> " << g->get_id(edge.second) << " " << g->get_is_reverse(edge.second) << endl;
-#endif
+                if (!is_unvisited(g->get_id(prev_node))) {
+                    masked_edges.insert(g->edge_handle(prev_node, n));
                 }
             });
 
-            // All other connections and self loops are handled by looking off the right side.
-
-            // See what all comes next, minus deleted edges.
             g->follow_edges(n, false, [&](const handle_t& next_node) {
-
-                // Look at the edge
                 auto edge = g->edge_handle(n, next_node);
                 if (masked_edges.count(edge)) {
-                    // We removed this edge, so skip it.
                     return;
                 }
-
-#ifdef debug
-#pragma omp critical (cerr)
-                cerr << "\tHas edge to " << g->get_id(next_node) << " orientation " << g->get_is_reverse(next_node) << endl;
-#endif
-
-                // Mask the edge connecting these nodes in this order and
-                // relative orientation, so we can't traverse it again
-
-#ifdef debug
-#pragma omp critical (cerr)
-                cerr << "\t\tEdge: " << g->get_id(edge.first) << " " << g->get_is_reverse(edge.first)
-                    << " -> " << g->get_id(edge.second) << " " << g->get_is_reverse(edge.second) << endl;
-#endif
-
-                // Mask the edge
                 masked_edges.insert(edge);
 
-                if(unvisited.count(g->get_id(next_node))) {
-                    // We haven't already started here as an arbitrary cycle entry point
-
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "\t\tAnd node hasn't been visited yet" << endl;
-#endif
-
+                if (is_unvisited(g->get_id(next_node))) {
                     bool unmasked_incoming_edge = false;
                     g->follow_edges(next_node, true, [&](const handle_t& prev_node) {
-                        // Get a handle for each incoming edge
-                        auto prev_edge = g->edge_handle(prev_node, next_node);
-                        
-                        if (!masked_edges.count(prev_edge)) {
-                            // We found such an edghe and can stop looking
+                        if (!masked_edges.count(g->edge_handle(prev_node, next_node))) {
                             unmasked_incoming_edge = true;
                             return false;
                         }
-                        // Otherwise check all the edges on the left of this handle
                         return true;
                     });
 
-                    if(!unmasked_incoming_edge) {
-
-#ifdef debug
-#pragma omp critical (cerr)
-                        cerr << "\t\t\tIs last incoming edge" << endl;
-#endif
-                        // Keep this orientation and put it here
-                        s[g->get_id(next_node)] = next_node;
-                        // Remember that we've visited and oriented this node, so we
-                        // don't need to use it as a seed.
-                        unvisited.erase(g->get_id(next_node));
-
-                    } else if(!seeds.count(g->get_id(next_node))) {
-                        // We came to this node in this orientation; when we need a
-                        // new node and orientation to start from (i.e. an entry
-                        // point to the node's cycle), we might as well pick this
-                        // one.
-                        // Only take it if we don't already know of an orientation for this node.
-                        seeds[g->get_id(next_node)] = next_node;
-
-#ifdef debug
-#pragma omp critical (cerr)
-                        cerr << "\t\t\tSuggests seed " << g->get_id(next_node) << " orientation " << g->get_is_reverse(next_node) << endl;
-#endif
+                    if (!unmasked_incoming_edge) {
+                        visit(oriented_t(g->get_id(next_node), g->get_is_reverse(next_node)));
+                        unvisited_count--;
+                    } else if (!seeded[g->get_id(next_node) - min_id]) {
+                        // Only the first orientation suggested for a node is kept
+                        seeded[g->get_id(next_node) - min_id] = 1;
+                        seeds.emplace(g->get_id(next_node), g->get_is_reverse(next_node));
                     }
-                } else {
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "\t\tAnd node was already visited (to break a cycle)" << endl;
-#endif
                 }
             });
         }
     }
+}
 
-    // Send away our sorted ordering.
-    return sorted;
+vector<handle_t> parallel_topological_sort(const HandleGraph* g) {
 
+    // Find the ID range, to see if we can index things by ID
+    id_t min_id = numeric_limits<id_t>::max();
+    id_t max_id = numeric_limits<id_t>::min();
+    g->for_each_handle([&](const handle_t& handle) {
+        min_id = min(min_id, g->get_id(handle));
+        max_id = max(max_id, g->get_id(handle));
+    });
+    size_t node_count = g->node_size();
+    if (node_count == 0) {
+        return vector<handle_t>();
+    }
+    if ((size_t)(max_id - min_id) >= 2 * node_count) {
+        // Too sparse to be worth arrays over the whole ID range
+        return topological_sort(g);
+    }
+    size_t id_range = max_id - min_id + 1;
+
+    // Label the weakly connected components, numbered in order of their
+    // smallest IDs. Slots for IDs not in the graph stay unlabeled.
+    const size_t UNLABELED = numeric_limits<size_t>::max();
+    vector<size_t> component_of(id_range, UNLABELED);
+    vector<uint8_t> present(id_range, 0);
+    g->for_each_handle([&](const handle_t& handle) {
+        present[g->get_id(handle) - min_id] = 1;
+    });
+    vector<vector<id_t>> component_nodes;
+    vector<vector<id_t>> component_heads;
+    vector<id_t> stack;
+    for (size_t i = 0; i < id_range; i++) {
+        if (!present[i] || component_of[i] != UNLABELED) {
+            continue;
+        }
+        size_t component = component_nodes.size();
+        component_nodes.emplace_back();
+        component_heads.emplace_back();
+        component_of[i] = component;
+        stack.push_back(min_id + i);
+        while (!stack.empty()) {
+            handle_t handle = g->get_handle(stack.back(), false);
+            stack.pop_back();
+            for (bool go_left : {false, true}) {
+                g->follow_edges(handle, go_left, [&](const handle_t& other) {
+                    size_t& label = component_of[g->get_id(other) - min_id];
+                    if (label == UNLABELED) {
+                        label = component;
+                        stack.push_back(g->get_id(other));
+                    }
+                });
+            }
+        }
+    }
+    vector<uint8_t> visited(id_range, 0);
+    vector<uint8_t> seeded(id_range, 0);
+    for (size_t i = 0; i < id_range; i++) {
+        if (!present[i]) {
+            continue;
+        }
+        id_t id = min_id + i;
+        component_nodes[component_of[i]].push_back(id);
+        bool no_left_edges = true;
+        g->follow_edges(g->get_handle(id, false), true, [&](const handle_t& ignored) {
+            no_left_edges = false;
+            return false;
+        });
+        if (no_left_edges) {
+            component_heads[component_of[i]].push_back(id);
+            visited[i] = 1;
+        }
+    }
+    present.clear();
+    present.shrink_to_fit();
+    component_of.clear();
+    component_of.shrink_to_fit();
+
+    // Sort the components, biggest first so one doesn't hold up the end
+    vector<size_t> by_size(component_nodes.size());
+    for (size_t i = 0; i < by_size.size(); i++) {
+        by_size[i] = i;
+    }
+    std::sort(by_size.begin(), by_size.end(), [&](size_t a, size_t b) {
+        return component_nodes[a].size() > component_nodes[b].size();
+    });
+    vector<ComponentOrder> orders(component_nodes.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < by_size.size(); i++) {
+        size_t component = by_size[i];
+        sort_component(g, component_nodes[component], component_heads[component], min_id, visited, seeded,
+                       orders[component]);
+        vector<id_t>().swap(component_nodes[component]);
+    }
+
+    // Interleave the runs the way topological_sort() would have made them
+    // for the whole graph. The first runs from the heads all happen
+    // together, taking the smallest ID available in any of them each time.
+    vector<handle_t> sorted;
+    sorted.reserve(node_count);
+    auto run_end = [&](size_t component, size_t run) {
+        const ComponentOrder& order = orders[component];
+        return run + 1 < order.run_starts.size() ? order.run_starts[run + 1] : order.sorted.size();
+    };
+    typedef pair<id_t, size_t> next_t;
+    priority_queue<next_t, vector<next_t>, greater<next_t>> next_from_heads;
+    vector<size_t> position(orders.size(), 0);
+    for (size_t component = 0; component < orders.size(); component++) {
+        if (run_end(component, 0) > 0) {
+            next_from_heads.emplace(g->get_id(orders[component].sorted[0]), component);
+        }
+    }
+    while (!next_from_heads.empty()) {
+        size_t component = next_from_heads.top().second;
+        next_from_heads.pop();
+        sorted.push_back(orders[component].sorted[position[component]++]);
+        if (position[component] < run_end(component, 0)) {
+            next_from_heads.emplace(g->get_id(orders[component].sorted[position[component]]), component);
+        }
+    }
+
+    // After that each run is one component's. A new run starts from the
+    // unvisited seed with the smallest ID if there is one anywhere, and
+    // otherwise from the unvisited node with the smallest ID.
+    set<pair<id_t, size_t>> seed_runs, arbitrary_runs;
+    vector<size_t> next_run(orders.size(), 1);
+    auto queue_run = [&](size_t component) {
+        size_t run = next_run[component];
+        if (run < orders[component].run_starts.size()) {
+            const pair<bool, id_t>& key = orders[component].run_keys[run - 1];
+            (key.first ? seed_runs : arbitrary_runs).emplace(key.second, component);
+        }
+    };
+    for (size_t component = 0; component < orders.size(); component++) {
+        queue_run(component);
+    }
+    while (!seed_runs.empty() || !arbitrary_runs.empty()) {
+        auto& runs = seed_runs.empty() ? arbitrary_runs : seed_runs;
+        size_t component = runs.begin()->second;
+        runs.erase(runs.begin());
+        size_t run = next_run[component]++;
+        const ComponentOrder& order = orders[component];
+        sorted.insert(sorted.end(), order.sorted.begin() + order.run_starts[run],
+                      order.sorted.begin() + run_end(component, run));
+        queue_run(component);
+    }
+
+    return sorted;
 }
 
 void sort(MutableHandleGraph* g) {
@@ -268,7 +291,7 @@ void sort(MutableHandleGraph* g) {
     // No need to modify the graph; topological_sort is guaranteed to be stable.
     
     // Topologically sort, which orders and orients all the nodes.
-    vector<handle_t> sorted = topological_sort(g);
+    vector<handle_t> sorted = parallel_topological_sort(g);
     
     size_t index = 0;
     g->for_each_handle([&](const handle_t& at_index) {
@@ -286,7 +309,7 @@ void sort(MutableHandleGraph* g) {
 
 unordered_set<id_t> orient_nodes_forward(MutableHandleGraph* g) {
     // Topologically sort, which orders and orients all the nodes.
-    vector<handle_t> sorted = topological_sort(g);
+    vector<handle_t> sorted = parallel_topological_sort(g);
     
     // Track what we flip
     unordered_set<id_t> flipped;
@@ -1,53 +1,187 @@
 #include "weakly_connected_components.hpp"
 
+#include <atomic>
+#include <limits>
+#include <unordered_map>
+
 namespace vg {
 namespace algorithms {
 
 using namespace std;
 
 vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph) {
-    vector<unordered_set<id_t>> to_return;
-    
-    // This only holds locally forward handles
-    unordered_set<handle_t> traversed;
-    
-    graph->for_each_handle([&](const handle_t& handle) {
-        
-        // Only think about it in the forward orientation
-        auto forward = graph->forward(handle);
-        
-        if (traversed.count(forward)) {
-            // Already have this node, so don't start a search from it.
+    return weakly_connected_components<HandleGraph>(graph);
+}
+
+/// Find the root of a set in a union-find where every parent has a lower
+/// index than its child, halving the path as we go. Safe to run alongside
+/// other finds and unions.
+static size_t concurrent_find(vector<atomic<size_t>>& parent, size_t i) {
+    while (true) {
+        size_t up = parent[i].load();
+        if (up == i) {
+            return i;
+        }
+        size_t up_up = parent[up].load();
+        if (up_up != up) {
+            // Skip a level. If someone else moved it first, that's fine too.
+            parent[i].compare_exchange_weak(up, up_up);
+        }
+        i = up_up;
+    }
+}
+
+/// Merge the sets of two nodes. Roots are always hung under lower-indexed
+/// roots, so no cycles can form even when other threads are also merging.
+static void concurrent_unite(vector<atomic<size_t>>& parent, size_t a, size_t b) {
+    while (true) {
+        a = concurrent_find(parent, a);
+        b = concurrent_find(parent, b);
+        if (a == b) {
             return;
         }
-        
-        // The stack only holds locally forward handles
-        vector<handle_t> stack{forward};
-        to_return.emplace_back();
-        while (!stack.empty()) {
-            handle_t here = stack.back();
-            stack.pop_back();
-            
-            traversed.insert(here);
-            to_return.back().insert(graph->get_id(here));
-            
-            // We have a function to handle all connected handles
-            auto handle_other = [&](const handle_t& other) {
-                // Again, make it forward
-                auto other_forward = graph->forward(other);
-                
-                if (!traversed.count(other_forward)) {
-                    stack.push_back(other_forward);
-                }
-            };
-            
-            // Look at edges in both directions
-            graph->follow_edges(here, false, handle_other);
-            graph->follow_edges(here, true, handle_other);
-            
+        if (a < b) {
+            swap(a, b);
         }
+        size_t expected = a;
+        if (parent[a].compare_exchange_strong(expected, b)) {
+            return;
+        }
+        // a stopped being a root under us; go find the new one
+    }
+}
+
+void weakly_connected_component_ids(const HandleGraph* graph, vector<id_t>& node_ids,
+                                    vector<size_t>& component_ids) {
+    
+    vector<handle_t> handles;
+    graph->for_each_handle([&](const handle_t& handle) {
+        handles.push_back(handle);
     });
-    return to_return;
+    
+    node_ids.resize(handles.size());
+    unordered_map<id_t, size_t> id_to_index;
+    id_to_index.reserve(handles.size());
+    for (size_t i = 0; i < handles.size(); i++) {
+        node_ids[i] = graph->get_id(handles[i]);
+        id_to_index[node_ids[i]] = i;
+    }
+    
+    vector<atomic<size_t>> parent(handles.size());
+    for (size_t i = 0; i < parent.size(); i++) {
+        parent[i].store(i);
+    }
+    
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < handles.size(); i++) {
+        // Look at edges in both directions
+        for (bool go_left : {false, true}) {
+            graph->follow_edges(handles[i], go_left, [&](const handle_t& other) {
+                auto found = id_to_index.find(graph->get_id(other));
+                if (found != id_to_index.end()) {
+                    concurrent_unite(parent, i, found->second);
+                }
+            });
+        }
+    }
+    
+    // Number the components in order of their first node
+    component_ids.resize(handles.size());
+    vector<size_t> root_component(handles.size(), numeric_limits<size_t>::max());
+    size_t next_component = 0;
+    for (size_t i = 0; i < handles.size(); i++) {
+        size_t root = concurrent_find(parent, i);
+        if (root_component[root] == numeric_limits<size_t>::max()) {
+            root_component[root] = next_component++;
+        }
+        component_ids[i] = root_component[root];
+    }
+}
+
+void IncrementalComponents::add_node(id_t id) {
+    index_of(id);
+}
+
+void IncrementalComponents::add_edge(id_t from, id_t to) {
+    size_t a = find(index_of(from));
+    size_t b = find(index_of(to));
+    if (a == b) {
+        return;
+    }
+    // Union by size
+    if (set_size[a] < set_size[b]) {
+        swap(a, b);
+    }
+    parent[b] = a;
+    set_size[a] += set_size[b];
+    components--;
+}
+
+void IncrementalComponents::add_graph(const Graph& chunk) {
+    for (auto& node : chunk.node()) {
+        add_node(node.id());
+    }
+    for (auto& edge : chunk.edge()) {
+        add_edge(edge.from(), edge.to());
+    }
+    for (auto& path : chunk.path()) {
+        for (auto& mapping : path.mapping()) {
+            add_node(mapping.position().node_id());
+        }
+    }
+}
+
+bool IncrementalComponents::has_node(id_t id) const {
+    return id_to_index.count(id);
+}
+
+bool IncrementalComponents::same_component(id_t a, id_t b) {
+    return find(id_to_index.at(a)) == find(id_to_index.at(b));
+}
+
+size_t IncrementalComponents::node_count() const {
+    return index_to_id.size();
+}
+
+size_t IncrementalComponents::component_count() const {
+    return components;
+}
+
+void IncrementalComponents::get_component_ids(vector<id_t>& node_ids, vector<size_t>& component_ids) {
+    node_ids = index_to_id;
+    component_ids.resize(index_to_id.size());
+    vector<size_t> root_component(index_to_id.size(), numeric_limits<size_t>::max());
+    size_t next_component = 0;
+    for (size_t i = 0; i < index_to_id.size(); i++) {
+        size_t root = find(i);
+        if (root_component[root] == numeric_limits<size_t>::max()) {
+            root_component[root] = next_component++;
+        }
+        component_ids[i] = root_component[root];
+    }
+}
+
+size_t IncrementalComponents::index_of(id_t id) {
+    auto found = id_to_index.find(id);
+    if (found != id_to_index.end()) {
+        return found->second;
+    }
+    size_t index = index_to_id.size();
+    id_to_index[id] = index;
+    index_to_id.push_back(id);
+    parent.push_back(index);
+    set_size.push_back(1);
+    components++;
+    return index;
+}
+
+size_t IncrementalComponents::find(size_t index) {
+    while (parent[index] != index) {
+        // Path halving
+        parent[index] = parent[parent[index]];
+        index = parent[index];
+    }
+    return index;
 }
 
 }
@@ -8,6 +8,7 @@
  */
 
 #include "../handle.hpp"
+#include "../hash_map.hpp"
 
 #include <unordered_set>
 #include <vector>
@@ -24,6 +25,109 @@ using namespace std;
 /// connected component is orientation-independent.
 vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph);
 
+/// Template version of weakly_connected_components(), instantiated on the
+/// concrete graph type so handle operations on it need not be virtual calls.
+template<typename Graph>
+vector<unordered_set<id_t>> weakly_connected_components(const Graph* graph) {
+    vector<unordered_set<id_t>> to_return;
+    
+    // This only holds locally forward handles
+    unordered_set<handle_t> traversed;
+    
+    graph->for_each_handle([&](const handle_t& handle) {
+        
+        // Only think about it in the forward orientation
+        auto forward = graph->forward(handle);
+        
+        if (traversed.count(forward)) {
+            // Already have this node, so don't start a search from it.
+            return;
+        }
+        
+        // The stack only holds locally forward handles
+        vector<handle_t> stack{forward};
+        to_return.emplace_back();
+        while (!stack.empty()) {
+            handle_t here = stack.back();
+            stack.pop_back();
+            
+            traversed.insert(here);
+            to_return.back().insert(graph->get_id(here));
+            
+            // We have a function to handle all connected handles
+            auto handle_other = [&](const handle_t& other) {
+                // Again, make it forward
+                auto other_forward = graph->forward(other);
+                
+                if (!traversed.count(other_forward)) {
+                    stack.push_back(other_forward);
+                }
+            };
+            
+            // Look at edges in both directions
+            graph->follow_edges(here, false, handle_other);
+            graph->follow_edges(here, true, handle_other);
+            
+        }
+    });
+    return to_return;
+}
+
+/// Find the same components as weakly_connected_components(), but as compact
+/// parallel arrays instead of hash sets. Fills node_ids with every node ID in
+/// for_each_handle() order, and component_ids with the component number of
+/// each. Components are numbered from 0 in order of their first node. The
+/// edges are merged on all threads with a lock-free union-find.
+void weakly_connected_component_ids(const HandleGraph* graph, vector<id_t>& node_ids,
+                                    vector<size_t>& component_ids);
+
+/**
+ * Keeps track of the weakly connected components of a graph that arrives a
+ * piece at a time, such as a stream of Graph chunks, without holding onto the
+ * graph itself. Nodes and edges can come in any order, and an edge can
+ * mention nodes that haven't been seen yet.
+ */
+class IncrementalComponents {
+public:
+    /// Add a node, if it isn't already known.
+    void add_node(id_t id);
+    
+    /// Add an edge between two nodes, adding the nodes if necessary.
+    void add_edge(id_t from, id_t to);
+    
+    /// Add all the nodes and edges (and path-implied nodes) in a chunk.
+    void add_graph(const Graph& chunk);
+    
+    /// Return true if the node has been seen.
+    bool has_node(id_t id) const;
+    
+    /// Return true if the two nodes, which must have been seen, are in the
+    /// same component.
+    bool same_component(id_t a, id_t b);
+    
+    /// Get the number of nodes seen.
+    size_t node_count() const;
+    
+    /// Get the number of components the nodes seen so far fall into.
+    size_t component_count() const;
+    
+    /// Get the components in the same form as weakly_connected_component_ids(),
+    /// with nodes in the order they were first seen.
+    void get_component_ids(vector<id_t>& node_ids, vector<size_t>& component_ids);
+
+private:
+    /// Get the dense index for a node ID, adding the node if needed.
+    size_t index_of(id_t id);
+    
+    /// Find the root of a node's set by dense index.
+    size_t find(size_t index);
+    
+    hash_map<id_t, size_t> id_to_index;
+    vector<id_t> index_to_id;
+    vector<size_t> parent;
+    vector<size_t> set_size;
+    size_t components = 0;
+};
 
 }
 }
@@ -5,6 +5,88 @@
 
 namespace vg {
 
+/**
+ * Run batches from fill_batch through process_batch in OpenMP tasks. Batches
+ * are filled on a single thread; fill_batch returns the number of items it
+ * put in the batch, and 0 at the end of the input. The calling thread works
+ * on batches itself while too many are outstanding, or until
+ * single_threaded_until_true returns true. Returns the total number of items.
+ */
+template<typename Batch>
+static size_t for_each_batch_parallel(const function<size_t(Batch&)>& fill_batch,
+                                      const function<void(Batch&)>& process_batch,
+                                      const function<bool(void)>& single_threaded_until_true) {
+
+    size_t nLines = 0;
+    Batch* batch = nullptr;
+    // number of batches currently being processed
+    uint64_t batches_outstanding = 0;
+#pragma omp parallel default(none) shared(batches_outstanding, batch, nLines, fill_batch, process_batch, single_threaded_until_true)
+#pragma omp single
+    {
+        
+        // max # of such batches to be holding in memory
+        uint64_t max_batches_outstanding = 1 << 9; // 512
+        // max # we will ever increase the batch buffer to
+        const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
+        
+        // did we find the end of the file yet?
+        bool more_data = true;
+        
+        while (more_data) {
+            // init a new batch
+            batch = new Batch();
+            
+            size_t batch_items = fill_batch(*batch);
+            more_data = batch_items > 0;
+            nLines += batch_items;
+            
+            // did we get a batch?
+            if (more_data) {
+                // how many batch tasks are outstanding currently, including this one?
+                uint64_t current_batches_outstanding;
+#pragma omp atomic capture
+                current_batches_outstanding = ++batches_outstanding;
+                
+                bool do_single_threaded = !single_threaded_until_true();
+                if (current_batches_outstanding >= max_batches_outstanding || do_single_threaded) {
+                    // do this batch in the current thread because we've spawned the maximum number of
+                    // concurrent batch tasks or because we are directed to work in a single thread
+                    process_batch(*batch);
+                    delete batch;
+#pragma omp atomic capture
+                    current_batches_outstanding = --batches_outstanding;
+                    
+                    if (4 * current_batches_outstanding / 3 < max_batches_outstanding
+                        && max_batches_outstanding < max_max_batches_outstanding
+                        && !do_single_threaded) {
+                        // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
+                        // this looks risky, since we want the batch buffer to stay populated the entire time we're
+                        // occupying this thread on compute, so let's increase the batch buffer size
+                        // (skip this adjustment if you're in single-threaded mode and thus expect the buffer to be
+                        // empty)
+                        
+                        max_batches_outstanding *= 2;
+                    }
+                }
+                else {
+                    // spawn a new task to take care of this batch
+#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, process_batch)
+                    {
+                        process_batch(*batch);
+                        delete batch;
+#pragma omp atomic update
+                        batches_outstanding--;
+                    }
+                }
+            } else {
+                delete batch;
+            }
+        }
+    }
+    return nLines;
+}
+
 int hts_for_each(string& filename, function<void(Alignment&)> lambda, xg::XG* xgindex) {
 
     samFile *in = hts_open(filename.c_str(), "r");
@@ -28,38 +110,57 @@ int hts_for_each(string& filename, function<void(Alignment&)> lambda) {
     return hts_for_each(filename, lambda, nullptr);
 }
 
+/// A batch of BAM records read on one thread, to be converted on another.
+struct BamBatch {
+    vector<bam1_t*> records;
+    ~BamBatch() {
+        for (auto& b : records) {
+            bam_destroy1(b);
+        }
+    }
+};
+
 int hts_for_each_parallel(string& filename, function<void(Alignment&)> lambda, xg::XG* xgindex) {
 
     samFile *in = hts_open(filename.c_str(), "r");
     if (in == NULL) return 0;
+    
+    // Let htslib decompress BGZF blocks (or decode CRAM slices) on its own
+    // threads, so the thread reading records only has to unpack them.
+    int thread_count = get_thread_count();
+    if (thread_count > 1) {
+        hts_set_threads(in, thread_count);
+    }
+    
     bam_hdr_t *hdr = sam_hdr_read(in);
     map<string, string> rg_sample;
     parse_rg_sample_map(hdr->text, rg_sample);
-
-    int thread_count = get_thread_count();
-    vector<bam1_t*> bs; bs.resize(thread_count);
-    for (auto& b : bs) {
-        b = bam_init1();
-    }
-
-    bool more_data = true;
-#pragma omp parallel shared(in, hdr, more_data, rg_sample)
-    {
-        int tid = omp_get_thread_num();
-        while (more_data) {
-            bam1_t* b = bs[tid];
-#pragma omp critical (hts_input)
-            if (more_data) {
-                more_data = sam_read1(in, hdr, b) >= 0;
-            }
-            if (more_data) {
-                Alignment a = bam_to_alignment(b, rg_sample, hdr, xgindex);
-                lambda(a);
+    
+    // Records are read in batches on one thread, and converted to Alignments
+    // by the workers.
+    const size_t batch_size = 1 << 9; // 512
+    function<size_t(BamBatch&)> fill_batch = [&](BamBatch& batch) {
+        batch.records.reserve(batch_size);
+        while (batch.records.size() < batch_size) {
+            bam1_t* b = bam_init1();
+            if (sam_read1(in, hdr, b) < 0) {
+                bam_destroy1(b);
+                break;
             }
+            batch.records.push_back(b);
         }
-    }
+        return batch.records.size();
+    };
+    
+    function<void(BamBatch&)> process_batch = [&](BamBatch& batch) {
+        for (auto& b : batch.records) {
+            Alignment a = bam_to_alignment(b, rg_sample, hdr, xgindex);
+            lambda(a);
+        }
+    };
+    
+    for_each_batch_parallel(fill_batch, process_batch, function<bool(void)>([](void) {return true;}));
 
-    for (auto& b : bs) bam_destroy1(b);
     bam_hdr_destroy(hdr);
     hts_close(in);
     return 1;
@@ -85,9 +186,10 @@ bam_hdr_t* hts_file_header(string& filename, string& header) {
 
 bam_hdr_t* hts_string_header(string& header,
                              map<string, int64_t>& path_length,
-                             map<string, string>& rg_sample) {
+                             map<string, string>& rg_sample,
+                             bool coordinate_sorted) {
     stringstream hdr;
-    hdr << "@HD\tVN:1.5\tSO:unknown\n";
+    hdr << "@HD\tVN:1.5\tSO:" << (coordinate_sorted ? "coordinate" : "unknown") << "\n";
     for (auto& p : path_length) {
         hdr << "@SQ\tSN:" << p.first << "\t" << "LN:" << p.second << "\n";
     }
@@ -100,51 +202,87 @@ bam_hdr_t* hts_string_header(string& header,
     samFile *in = sam_open(sam.c_str(), "r");
     bam_hdr_t *h = sam_hdr_read(in);
     sam_close(in);
+    // htslib builds the name lookup table lazily on the first lookup, so do
+    // one now and let threads share the header when making BAM records
+    bam_name2id(h, "*");
     return h;
 }
 
+/// Fill in an alignment from the lines of one FASTQ or FASTA record, without
+/// their line ends. Quality is only used for FASTQ.
+static void alignment_from_fastq_lines(const char* name_line, size_t name_length,
+                                       const char* sequence, size_t sequence_length,
+                                       const char* quality, size_t quality_length,
+                                       bool is_fasta, Alignment& alignment) {
+    alignment.Clear();
+    // trim off leading @ and things after the first whitespace
+    // keep trailing /1 /2
+    const char* space = (const char*) memchr(name_line, ' ', name_length);
+    size_t name_end = space == nullptr ? name_length : (space - name_line) + 1;
+    alignment.set_name(name_line + 1, min(name_end, name_length) - 1);
+    alignment.set_sequence(sequence, sequence_length);
+    if (!is_fasta) {
+        string* qual = alignment.mutable_quality();
+        qual->resize(quality_length);
+        for (size_t i = 0; i < quality_length; i++) {
+            (*qual)[i] = quality[i] - 33;
+        }
+    }
+}
+
+/// Work out whether a record starting with the given character is FASTA.
+static bool record_is_fasta(char delimiter) {
+    if (delimiter == '@') {
+        return false;
+    } else if (delimiter == '>') {
+        return true;
+    }
+    throw runtime_error("Found unexpected delimiter " + string(1, delimiter) + " in fastq/fasta input");
+}
+
+/// Get the length of a line, not counting any line end characters.
+static size_t chomped_length(const char* line, size_t length) {
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+        length--;
+    }
+    return length;
+}
+
 bool get_next_alignment_from_fastq(gzFile fp, char* buffer, size_t len, Alignment& alignment) {
 
     alignment.Clear();
-    bool is_fasta = false;
     // handle name
-    if (0!=gzgets(fp,buffer,len)) {
-        buffer[strlen(buffer)-1] = '\0';
-        string name = buffer;
-        if (name[0] == '@') {
-            is_fasta = false;
-        } else if (name[0] = '>') {
-            is_fasta = true;
-        } else {
-            throw runtime_error("Found unexpected delimiter " + name.substr(0,1) + " in fastq/fasta input");
-        }
-        name = name.substr(1, name.find(' ')); // trim off leading @ and things after the first whitespace
-        // keep trailing /1 /2
-        alignment.set_name(name);
-    } else { return false; }
+    if (0 == gzgets(fp,buffer,len)) {
+        return false;
+    }
+    string name = buffer;
+    name.resize(chomped_length(name.c_str(), name.size()));
+    if (name.empty()) {
+        throw runtime_error("Found empty record name in fastq/fasta input");
+    }
+    bool is_fasta = record_is_fasta(name[0]);
     // handle sequence
-    if (0!=gzgets(fp,buffer,len)) {
-        buffer[strlen(buffer)-1] = '\0';
-        alignment.set_sequence(buffer);
-    } else {
+    if (0 == gzgets(fp,buffer,len)) {
         cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
     }
-    // handle "+" sep
+    string sequence = buffer;
+    sequence.resize(chomped_length(sequence.c_str(), sequence.size()));
+    string quality;
     if (!is_fasta) {
-        if (0!=gzgets(fp,buffer,len)) {
-        } else {
+        // handle "+" sep
+        if (0 == gzgets(fp,buffer,len)) {
             cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
         }
         // handle quality
-        if (0!=gzgets(fp,buffer,len)) {
-            buffer[strlen(buffer)-1] = '\0';
-            string quality = string_quality_char_to_short(buffer);
-            //cerr << string_quality_short_to_char(quality) << endl;
-            alignment.set_quality(quality);
-        } else {
+        if (0 == gzgets(fp,buffer,len)) {
             cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
         }
+        quality = buffer;
+        quality.resize(chomped_length(quality.c_str(), quality.size()));
     }
+    
+    alignment_from_fastq_lines(name.c_str(), name.size(), sequence.c_str(), sequence.size(),
+                               quality.c_str(), quality.size(), is_fasta, alignment);
 
     return true;
 
@@ -158,207 +296,234 @@ bool get_next_alignment_pair_from_fastqs(gzFile fp1, gzFile fp2, char* buffer, s
     return get_next_alignment_from_fastq(fp1, buffer, len, mate1) && get_next_alignment_from_fastq(fp2, buffer, len, mate2);
 }
 
-size_t unpaired_for_each_parallel(function<bool(Alignment&)> get_read_if_available, function<void(Alignment&)> lambda) {
+FastqRecordReader::FastqRecordReader(const string& filename) {
+    fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
+    if (!fp) {
+        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
+    }
+    gzbuffer(fp, block_size);
+    
+    // Decompress in the background, staying a few blocks ahead of the reader.
+    inflater = thread([this, filename]() {
+        while (true) {
+            string data(block_size, '\0');
+            int got = gzread(fp, &data[0], block_size);
+            if (got < 0) {
+                int errnum;
+                cerr << "[vg::alignment.cpp] error reading " << filename << ": "
+                     << gzerror(fp, &errnum) << endl;
+                exit(1);
+            }
+            data.resize(got);
+            
+            unique_lock<mutex> lock(queue_mutex);
+            queue_changed.wait(lock, [&]() {
+                return full_blocks.size() < max_blocks || stopping;
+            });
+            if (stopping) {
+                return;
+            }
+            if (got == 0) {
+                finished = true;
+                queue_changed.notify_all();
+                return;
+            }
+            full_blocks.emplace_back(std::move(data));
+            queue_changed.notify_all();
+        }
+    });
+}
 
-    size_t nLines = 0;
-    vector<Alignment> *batch = nullptr;
-    // number of batches currently being processed
-    uint64_t batches_outstanding = 0;
-#pragma omp parallel default(none) shared(batches_outstanding, batch, nLines, get_read_if_available, lambda)
-#pragma omp single
+FastqRecordReader::~FastqRecordReader() {
     {
-        
-        // number of reads in each batch
-        const uint64_t batch_size = 1 << 9; // 512
-        // max # of such batches to be holding in memory
-        uint64_t max_batches_outstanding = 1 << 9; // 512
-        // max # we will ever increase the batch buffer to
-        const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
-        
-        // alignments to hold the incoming data
-        Alignment aln;
-        // did we find the end of the file yet?
-        bool more_data = true;
-        
-        while (more_data) {
-            // init a new batch
-            batch = new std::vector<Alignment>();
-            batch->reserve(batch_size);
-            
-            // load up to the batch-size number of reads
-            for (int i = 0; i < batch_size; i++) {
-                
-                more_data = get_read_if_available(aln);
-                
-                if (more_data) {
-                    batch->emplace_back(std::move(aln));
-                    nLines++;
-                }
-                else {
-                    break;
-                }
+        lock_guard<mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    inflater.join();
+    gzclose(fp);
+}
+
+bool FastqRecordReader::next_block() {
+    unique_lock<mutex> lock(queue_mutex);
+    queue_changed.wait(lock, [&]() {
+        return !full_blocks.empty() || finished;
+    });
+    if (full_blocks.empty()) {
+        return false;
+    }
+    block = std::move(full_blocks.front());
+    full_blocks.pop_front();
+    block_pos = 0;
+    queue_changed.notify_all();
+    return true;
+}
+
+bool FastqRecordReader::read_line(string& out) {
+    bool got_any = false;
+    while (true) {
+        if (block_pos == block.size() && !next_block()) {
+            if (got_any) {
+                // Give the last line an end, like all the others.
+                out.push_back('\n');
             }
-            
-            // did we get a batch?
-            if (batch->size()) {
-                
-                // how many batch tasks are outstanding currently, including this one?
-                uint64_t current_batches_outstanding;
-#pragma omp atomic capture
-                current_batches_outstanding = ++batches_outstanding;
-                
-                if (current_batches_outstanding >= max_batches_outstanding) {
-                    // do this batch in the current thread because we've spawned the maximum number of
-                    // concurrent batch tasks
-                    for (auto& aln : *batch) {
-                        lambda(aln);
-                    }
-                    delete batch;
-#pragma omp atomic capture
-                    current_batches_outstanding = --batches_outstanding;
-                    
-                    if (4 * current_batches_outstanding / 3 < max_batches_outstanding
-                        && max_batches_outstanding < max_max_batches_outstanding) {
-                        // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
-                        // this looks risky, since we want the batch buffer to stay populated the entire time we're
-                        // occupying this thread on compute, so let's increase the batch buffer size
-                        
-                        max_batches_outstanding *= 2;
-                    }
-                }
-                else {
-                    // spawn a new task to take care of this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
-                    {
-                        for (auto& aln : *batch) {
-                            lambda(aln);
-                        }
-                        delete batch;
-#pragma omp atomic update
-                        batches_outstanding--;
-                    }
-                }
+            return got_any;
+        }
+        const char* start = block.data() + block_pos;
+        size_t available = block.size() - block_pos;
+        const char* line_end = (const char*) memchr(start, '\n', available);
+        if (line_end != nullptr) {
+            size_t taken = line_end - start + 1;
+            out.append(start, taken);
+            block_pos += taken;
+            return true;
+        }
+        // The line continues in the next block
+        out.append(start, available);
+        block_pos += available;
+        got_any = true;
+    }
+}
+
+size_t FastqRecordReader::read_records(size_t count, string& out) {
+    size_t records = 0;
+    while (records < count) {
+        size_t record_start = out.size();
+        if (!read_line(out)) {
+            break;
+        }
+        if (chomped_length(out.data() + record_start, out.size() - record_start) == 0) {
+            // Skip blank lines between records
+            out.resize(record_start);
+            continue;
+        }
+        size_t lines = record_is_fasta(out[record_start]) ? 2 : 4;
+        for (size_t i = 1; i < lines; i++) {
+            if (!read_line(out)) {
+                cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
             }
         }
+        records++;
     }
-    return nLines;
+    return records;
+}
+
+size_t parse_fastq_records(const string& text, vector<Alignment>& alignments) {
+    size_t parsed = 0;
+    const char* here = text.data();
+    const char* text_end = text.data() + text.size();
+    
+    // Get the next line and its length without the line end.
+    auto next_line = [&](size_t& length) -> const char* {
+        const char* line = here;
+        const char* line_end = (const char*) memchr(here, '\n', text_end - here);
+        if (line_end == nullptr) {
+            line_end = text_end;
+        }
+        here = line_end == text_end ? text_end : line_end + 1;
+        length = chomped_length(line, line_end - line);
+        return line;
+    };
+    
+    while (here < text_end) {
+        size_t name_length, sequence_length, quality_length = 0;
+        const char* name = next_line(name_length);
+        if (name_length == 0) {
+            continue;
+        }
+        bool is_fasta = record_is_fasta(name[0]);
+        const char* sequence = next_line(sequence_length);
+        const char* quality = nullptr;
+        if (!is_fasta) {
+            size_t separator_length;
+            next_line(separator_length);
+            quality = next_line(quality_length);
+        }
+        
+        if (parsed == alignments.size()) {
+            alignments.emplace_back();
+        }
+        alignment_from_fastq_lines(name, name_length, sequence, sequence_length,
+                                   quality, quality_length, is_fasta, alignments[parsed]);
+        parsed++;
+    }
+    return parsed;
+}
+
+// number of reads or pairs in each batch
+static const size_t fastq_batch_size = 1 << 9; // 512
+
+size_t unpaired_for_each_parallel(function<bool(Alignment&)> get_read_if_available, function<void(Alignment&)> lambda) {
+    
+    function<size_t(vector<Alignment>&)> fill_batch = [&](vector<Alignment>& batch) {
+        batch.reserve(fastq_batch_size);
+        // alignment to hold the incoming data
+        Alignment aln;
+        // load up to the batch-size number of reads
+        while (batch.size() < fastq_batch_size && get_read_if_available(aln)) {
+            batch.emplace_back(std::move(aln));
+        }
+        return batch.size();
+    };
+    
+    function<void(vector<Alignment>&)> process_batch = [&](vector<Alignment>& batch) {
+        for (auto& aln : batch) {
+            lambda(aln);
+        }
+    };
+    
+    return for_each_batch_parallel(fill_batch, process_batch, function<bool(void)>([](void) {return true;}));
 }
 
 size_t paired_for_each_parallel_after_wait(function<bool(Alignment&, Alignment&)> get_pair_if_available,
                                            function<void(Alignment&, Alignment&)> lambda,
                                            function<bool(void)> single_threaded_until_true) {
     
-    
-    size_t nLines = 0;
-    vector<pair<Alignment, Alignment> > *batch = nullptr;
-    // number of batches currently being processed
-    uint64_t batches_outstanding = 0;
-    
-#pragma omp parallel default(none) shared(batches_outstanding, batch, nLines, get_pair_if_available, single_threaded_until_true, lambda)
-#pragma omp single
-    {
-        
-        // number of pairs in each batch
-        const uint64_t batch_size = 1 << 9; // 512
-        // max # of such batches to be holding in memory
-        uint64_t max_batches_outstanding = 1 << 9; // 512
-        // max # we will ever increase the batch buffer to
-        const uint64_t max_max_batches_outstanding = 1 << 13; // 8192
-        
+    function<size_t(vector<pair<Alignment, Alignment>>&)> fill_batch = [&](vector<pair<Alignment, Alignment>>& batch) {
+        batch.reserve(fastq_batch_size);
         // alignments to hold the incoming data
         Alignment mate1, mate2;
-        // did we find the end of the file yet?
-        bool more_data = true;
-        
-        while (more_data) {
-            // init a new batch
-            batch = new std::vector<pair<Alignment, Alignment>>();
-            batch->reserve(batch_size);
-            
-            // load up to the batch-size number of pairs
-            for (int i = 0; i < batch_size; i++) {
-                
-                more_data = get_pair_if_available(mate1, mate2);
-                
-                if (more_data) {
-                    batch->emplace_back(std::move(mate1), std::move(mate2));
-                    nLines++;
-                }
-                else {
-                    break;
-                }
-            }
-            
-            // did we get a batch?
-            if (batch->size()) {
-                // how many batch tasks are outstanding currently, including this one?
-                uint64_t current_batches_outstanding;
-#pragma omp atomic capture
-                current_batches_outstanding = ++batches_outstanding;
-                
-                bool do_single_threaded = !single_threaded_until_true();
-                if (current_batches_outstanding >= max_batches_outstanding || do_single_threaded) {
-                    // do this batch in the current thread because we've spawned the maximum number of
-                    // concurrent batch tasks or because we are directed to work in a single thread
-                    for (auto& p : *batch) {
-                        lambda(p.first, p.second);
-                    }
-                    delete batch;
-#pragma omp atomic capture
-                    current_batches_outstanding = --batches_outstanding;
-                    
-                    if (4 * current_batches_outstanding / 3 < max_batches_outstanding
-                        && max_batches_outstanding < max_max_batches_outstanding
-                        && !do_single_threaded) {
-                        // we went through at least 1/4 of the batch buffer while we were doing this thread's batch
-                        // this looks risky, since we want the batch buffer to stay populated the entire time we're
-                        // occupying this thread on compute, so let's increase the batch buffer size
-                        // (skip this adjustment if you're in single-threaded mode and thus expect the buffer to be
-                        // empty)
-                        
-                        max_batches_outstanding *= 2;
-                    }
-                }
-                else {
-                    // spawn a new task to take care of this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
-                    {
-                        for (auto& p : *batch) {
-                            lambda(p.first, p.second);
-                        }
-                        delete batch;
-#pragma omp atomic update
-                        batches_outstanding--;
-                    }
-                }
-            }
+        // load up to the batch-size number of pairs
+        while (batch.size() < fastq_batch_size && get_pair_if_available(mate1, mate2)) {
+            batch.emplace_back(std::move(mate1), std::move(mate2));
         }
-    }
+        return batch.size();
+    };
     
-    return nLines;
+    function<void(vector<pair<Alignment, Alignment>>&)> process_batch = [&](vector<pair<Alignment, Alignment>>& batch) {
+        for (auto& p : batch) {
+            lambda(p.first, p.second);
+        }
+    };
+    
+    return for_each_batch_parallel(fill_batch, process_batch, single_threaded_until_true);
+}
+
+/// Parse reads out of FASTQ text in worker threads, into Alignments that each
+/// thread keeps around and reuses for its next batch.
+static vector<Alignment>& parse_into_thread_alignments(const string& text) {
+    static thread_local vector<Alignment> alignments;
+    size_t parsed = parse_fastq_records(text, alignments);
+    alignments.resize(parsed);
+    return alignments;
 }
 
 size_t fastq_unpaired_for_each_parallel(const string& filename, function<void(Alignment&)> lambda) {
     
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    
-    size_t len = 2 << 22; // 4M
-    char* buf = new char[len];
+    FastqRecordReader reader(filename);
     
-    function<bool(Alignment&)> get_read = [&](Alignment& aln) {
-        return get_next_alignment_from_fastq(fp, buf, len, aln);;
+    // The reading thread just finds record boundaries, and the workers parse.
+    function<size_t(string&)> fill_batch = [&](string& text) {
+        return reader.read_records(fastq_batch_size, text);
     };
     
+    function<void(string&)> process_batch = [&](string& text) {
+        for (auto& aln : parse_into_thread_alignments(text)) {
+            lambda(aln);
+        }
+    };
     
-    size_t nLines = unpaired_for_each_parallel(get_read, lambda);
-    
-    delete[] buf;
-    gzclose(fp);
-    return nLines;
-    
+    return for_each_batch_parallel(fill_batch, process_batch, function<bool(void)>([](void) {return true;}));
 }
 
 size_t fastq_paired_interleaved_for_each_parallel(const string& filename, function<void(Alignment&, Alignment&)> lambda) {
@@ -373,51 +538,48 @@ size_t fastq_paired_interleaved_for_each_parallel_after_wait(const string& filen
                                                              function<void(Alignment&, Alignment&)> lambda,
                                                              function<bool(void)> single_threaded_until_true) {
     
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    
-    size_t len = 1 << 18; // 256k
-    char* buf = new char[len];
+    FastqRecordReader reader(filename);
     
-    function<bool(Alignment&, Alignment&)> get_pair = [&](Alignment& mate1, Alignment& mate2) {
-        return get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mate1, mate2);
+    function<size_t(string&)> fill_batch = [&](string& text) {
+        // Mates come one after the other, so we count pairs.
+        return reader.read_records(2 * fastq_batch_size, text) / 2;
     };
     
-    size_t nLines = paired_for_each_parallel_after_wait(get_pair, lambda, single_threaded_until_true);
+    function<void(string&)> process_batch = [&](string& text) {
+        auto& alignments = parse_into_thread_alignments(text);
+        for (size_t i = 0; i + 1 < alignments.size(); i += 2) {
+            lambda(alignments[i], alignments[i + 1]);
+        }
+    };
     
-    delete[] buf;
-    gzclose(fp);
-    return nLines;
+    return for_each_batch_parallel(fill_batch, process_batch, single_threaded_until_true);
 }
     
 size_t fastq_paired_two_files_for_each_parallel_after_wait(const string& file1, const string& file2,
                                                            function<void(Alignment&, Alignment&)> lambda,
                                                            function<bool(void)> single_threaded_until_true) {
     
-    gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp1) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file1 << endl; exit(1);
-    }
-    gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp2) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file2 << endl; exit(1);
-    }
-    
-    size_t len = 1 << 18; // 256k
-    char* buf = new char[len];
+    FastqRecordReader reader1(file1);
+    FastqRecordReader reader2(file2);
     
-    function<bool(Alignment&, Alignment&)> get_pair = [&](Alignment& mate1, Alignment& mate2) {
-        return get_next_alignment_pair_from_fastqs(fp1, fp2, buf, len, mate1, mate2);
+    function<size_t(pair<string, string>&)> fill_batch = [&](pair<string, string>& texts) {
+        size_t read1 = reader1.read_records(fastq_batch_size, texts.first);
+        size_t read2 = reader2.read_records(read1, texts.second);
+        // Stop where either file runs out
+        return min(read1, read2);
     };
     
-    size_t nLines = paired_for_each_parallel_after_wait(get_pair, lambda, single_threaded_until_true);
+    function<void(pair<string, string>&)> process_batch = [&](pair<string, string>& texts) {
+        // Each thread keeps its second mates separately from its first mates.
+        static thread_local vector<Alignment> mates2;
+        auto& mates1 = parse_into_thread_alignments(texts.first);
+        size_t parsed2 = parse_fastq_records(texts.second, mates2);
+        for (size_t i = 0; i < mates1.size() && i < parsed2; i++) {
+            lambda(mates1[i], mates2[i]);
+        }
+    };
     
-    delete[] buf;
-    gzclose(fp1);
-    gzclose(fp2);
-    return nLines;
+    return for_each_batch_parallel(fill_batch, process_batch, single_threaded_until_true);
 }
 
 size_t fastq_unpaired_for_each(const string& filename, function<void(Alignment&)> lambda) {
@@ -730,6 +892,66 @@ bam1_t* alignment_to_bam(const string& sam_header,
 
 }
 
+// Internal conversion function for both paired and unpaired codepaths
+bam1_t* alignment_to_bam_internal(bam_hdr_t* header,
+                                  const Alignment& alignment,
+                                  const string& refseq,
+                                  const int32_t refpos,
+                                  const bool refrev,
+                                  const string& cigar,
+                                  const string& mateseq,
+                                  const int32_t matepos,
+                                  const int32_t tlen,
+                                  bool paired) {
+
+    assert(header != nullptr);
+
+    // Parse the SAM line against the header we already have, instead of
+    // reading the whole header again for every record
+    string sam = alignment_to_sam_internal(alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen, paired);
+    if (!sam.empty() && sam.back() == '\n') {
+        sam.pop_back();
+    }
+    // sam_parse1 tokenizes in place, so it gets our own copy
+    kstring_t line;
+    line.l = sam.size();
+    line.m = sam.size() + 1;
+    line.s = &sam[0];
+    bam1_t *aln = bam_init1();
+    if (sam_parse1(&line, header, aln) >= 0) {
+        return aln;
+    } else {
+        cerr << "[vg::alignment] Failure to parse SAM record" << endl
+             << alignment_to_sam_internal(alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen, paired) << endl;
+        exit(1);
+    }
+}
+
+bam1_t* alignment_to_bam(bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar,
+                         const string& mateseq,
+                         const int32_t matepos,
+                         const int32_t tlen) {
+
+    return alignment_to_bam_internal(header, alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen, true);
+
+}
+
+bam1_t* alignment_to_bam(bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar) {
+
+    return alignment_to_bam_internal(header, alignment, refseq, refpos, refrev, cigar, "", -1, 0, false);
+
+}
+
 string cigar_string(vector<pair<int, char> >& cigar) {
     vector<pair<int, char> > cigar_comp;
     pair<int, char> cur = make_pair(0, '\0');
@@ -1067,6 +1289,33 @@ Alignment strip_from_start(const Alignment& aln, size_t drop) {
     return res;
 }
 
+void strip_from_start_in_place(Alignment* aln, size_t drop) {
+    if (!drop) return;
+    // keep only the fields that strip_from_start does
+    string name, sequence;
+    Path path;
+    bool had_path = aln->has_path();
+    int32_t score = aln->score();
+    name.swap(*aln->mutable_name());
+    sequence.swap(*aln->mutable_sequence());
+    path.Swap(aln->mutable_path());
+    aln->Clear();
+    aln->mutable_name()->swap(name);
+    aln->set_score(score);
+    sequence.erase(0, drop);
+    aln->mutable_sequence()->swap(sequence);
+    if (!had_path) return;
+    cut_path_start_in_place(&path, drop);
+    aln->mutable_path()->Swap(&path);
+    if (alignment_to_length(*aln) != aln->sequence().size()) {
+        cerr << "failed!!! drop from start 轰" << endl;
+        cerr << "drop " << drop << " from start" << endl;
+        cerr << "wanted " << aln->sequence().size() << " got " << alignment_to_length(*aln) << endl;
+        cerr << pb2json(*aln) << endl << endl;
+        assert(false);
+    }
+}
+
 Alignment strip_from_end(const Alignment& aln, size_t drop) {
     if (!drop) return aln;
     Alignment res;
@@ -1087,6 +1336,32 @@ Alignment strip_from_end(const Alignment& aln, size_t drop) {
     return res;
 }
 
+void strip_from_end_in_place(Alignment* aln, size_t drop) {
+    if (!drop) return;
+    // keep only the fields that strip_from_end does
+    string name, sequence;
+    Path path;
+    bool had_path = aln->has_path();
+    int32_t score = aln->score();
+    name.swap(*aln->mutable_name());
+    sequence.swap(*aln->mutable_sequence());
+    path.Swap(aln->mutable_path());
+    aln->Clear();
+    aln->mutable_name()->swap(name);
+    aln->set_score(score);
+    size_t cut_at = sequence.size()-drop;
+    sequence.resize(cut_at);
+    aln->mutable_sequence()->swap(sequence);
+    if (!had_path) return;
+    cut_path_end_in_place(&path, cut_at);
+    aln->mutable_path()->Swap(&path);
+    if (alignment_to_length(*aln) != aln->sequence().size()) {
+        cerr << "failed!!! drop from end 轰" << endl;
+        cerr << pb2json(*aln) << endl << endl;
+        assert(false);
+    }
+}
+
 Alignment trim_alignment(const Alignment& aln, const Position& pos1, const Position& pos2) {
     // cut the alignment into 3 (possibly empty) pieces
     auto p = cut_path(aln.path(), pos1);
@@ -1184,21 +1459,27 @@ Alignment merge_alignments(const vector<Alignment>& alns) {
 
     // get the alignments ready for merge
     for (size_t i = 0; i < alns.size(); ++i) {
-        Alignment aln = alns[i];
-        if (!aln.has_path()) {
-            Mapping m;
-            Edit* e = m.add_edit();
-            e->set_to_length(aln.sequence().size());
-            e->set_sequence(aln.sequence());
-            *aln.mutable_path()->add_mapping() = m;
-        }
+        const Alignment& aln = alns[i];
         if (i == 0) {
             merged = aln;
         } else {
             if (!merged.quality().empty()) merged.mutable_quality()->append(aln.quality());
-            extend_path(*merged.mutable_path(), aln.path());
             merged.mutable_sequence()->append(aln.sequence());
         }
+        if (!aln.has_path()) {
+            // a pathless alignment is merged as a pure insertion
+            Path insertion;
+            Edit* e = insertion.add_mapping()->add_edit();
+            e->set_to_length(aln.sequence().size());
+            e->set_sequence(aln.sequence());
+            if (i == 0) {
+                merged.mutable_path()->Swap(&insertion);
+            } else {
+                extend_path(*merged.mutable_path(), insertion);
+            }
+        } else if (i > 0) {
+            extend_path(*merged.mutable_path(), aln.path());
+        }
     }
     return merged;
 }
@@ -1358,13 +1639,17 @@ const string hash_alignment(const Alignment& aln) {
 
 Alignment simplify(const Alignment& a, bool trim_internal_deletions) {
     auto aln = a;
-    *aln.mutable_path() = simplify(aln.path(), trim_internal_deletions);
-    if (!aln.path().mapping_size()) {
-        aln.clear_path();
-    }
+    simplify_in_place(&aln, trim_internal_deletions);
     return aln;
 }
 
+void simplify_in_place(Alignment* aln, bool trim_internal_deletions) {
+    simplify_in_place(aln->mutable_path(), trim_internal_deletions);
+    if (!aln->path().mapping_size()) {
+        aln->clear_path();
+    }
+}
+
 void write_alignment_to_file(const Alignment& aln, const string& filename) {
     ofstream out(filename);
     vector<Alignment> alnz = { aln };
@@ -1418,6 +1703,28 @@ pair<string, string> signature(const Alignment& aln1, const Alignment& aln2) {
     return make_pair(signature(aln1), signature(aln2));
 }
 
+/// A feature on a path, read from an annotation file
+struct RegionFeature {
+    string path_name;
+    size_t start;
+    size_t end;
+    string name;
+    bool is_reverse;
+};
+
+/// Trace features out along their paths in parallel, keeping them in order
+static void features_to_alignments(const vector<RegionFeature>& features,
+                                   xg::XG* xgindex,
+                                   vector<Alignment>* out_alignments) {
+    out_alignments->resize(features.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < features.size(); i++) {
+        auto& feature = features[i];
+        (*out_alignments)[i] = xgindex->target_alignment(feature.path_name, feature.start, feature.end,
+                                                         feature.name, feature.is_reverse);
+    }
+}
+
 void parse_bed_regions(istream& bedstream,
                        xg::XG* xgindex,
                        vector<Alignment>* out_alignments) {
@@ -1433,6 +1740,7 @@ void parse_bed_regions(istream& bedstream,
     string name;
     size_t score;
     string strand;
+    vector<RegionFeature> features;
 
     for (int line = 1; getline(bedstream, row); ++line) {
         if (row.size() < 2 || row[0] == '#') {
@@ -1461,12 +1769,12 @@ void parse_bed_regions(istream& bedstream,
                 // we go look for positions in it.
                 cerr << "warning: path \"" << seq << "\" not found in index, skipping" << endl;
             } else {
-                Alignment alignment = xgindex->target_alignment(seq, sbuf, ebuf, name, is_reverse);
-
-                out_alignments->push_back(alignment);
+                features.push_back(RegionFeature{seq, sbuf, ebuf, name, is_reverse});
             }
         }
     }
+
+    features_to_alignments(features, xgindex, out_alignments);
 }
 
 void parse_gff_regions(istream& gffstream,
@@ -1489,6 +1797,7 @@ void parse_gff_regions(istream& gffstream,
     string strand;
     string num;
     string annotations;
+    vector<RegionFeature> features;
 
     for (int line = 1; getline(gffstream, row); ++line) {
         if (row.size() < 2 || row[0] == '#') {
@@ -1527,12 +1836,12 @@ void parse_gff_regions(istream& gffstream,
                 // we go look for positions in it.
                 cerr << "warning: path \"" << seq << "\" not found in index, skipping" << endl;
             } else {
-                Alignment alignment = xgindex->target_alignment(seq, sbuf, ebuf, name, is_reverse);
-
-                out_alignments->push_back(alignment);
+                features.push_back(RegionFeature{seq, sbuf, ebuf, name, is_reverse});
             }
         }
     }
+
+    features_to_alignments(features, xgindex, out_alignments);
 }
 
 Position alignment_start(const Alignment& aln) {
@@ -3,6 +3,10 @@
 
 #include <iostream>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <zlib.h>
 #include "utility.hpp"
 #include "path.hpp"
@@ -28,6 +32,58 @@ bool get_next_alignment_from_fastq(gzFile fp, char* buffer, size_t len, Alignmen
 bool get_next_interleaved_alignment_pair_from_fastq(gzFile fp, char* buffer, size_t len, Alignment& mate1, Alignment& mate2);
 bool get_next_alignment_pair_from_fastqs(gzFile fp1, gzFile fp2, char* buffer, size_t len, Alignment& mate1, Alignment& mate2);
 
+/**
+ * Reads the text of whole FASTQ (or single-line FASTA) records out of a
+ * possibly-gzipped file or "-" for standard input. A background thread does
+ * all the decompression, a large block at a time, and hands the blocks over
+ * through a short queue, so the thread asking for records only has to find
+ * line ends. Parse the records with parse_fastq_records().
+ */
+class FastqRecordReader {
+public:
+    FastqRecordReader(const string& filename);
+    ~FastqRecordReader();
+    
+    /// Append the text of up to count records to out, and return the number
+    /// appended. Returns 0 at the end of the file.
+    size_t read_records(size_t count, string& out);
+    
+private:
+    /// Size of the decompressed blocks
+    static const size_t block_size = 1 << 20;
+    /// Number of decompressed blocks to get ahead by
+    static const size_t max_blocks = 8;
+    
+    gzFile fp;
+    thread inflater;
+    
+    /// Protects full_blocks, finished and stopping
+    mutex queue_mutex;
+    condition_variable queue_changed;
+    deque<string> full_blocks;
+    bool finished = false;
+    bool stopping = false;
+    
+    /// The block we are reading lines from, and how far we've got
+    string block;
+    size_t block_pos = 0;
+    
+    /// Take the next decompressed block, returning false at the end of the file.
+    bool next_block();
+    /// Append the next line, with its line end, returning false at the end of
+    /// the file.
+    bool read_line(string& out);
+};
+
+/// Parse the text of FASTQ or FASTA records into the given alignments, reusing
+/// the ones already there and adding more as needed. Returns the number
+/// parsed; alignments past that are left alone.
+size_t parse_fastq_records(const string& text, vector<Alignment>& alignments);
+
+/// Run reads from the given source through the lambda in parallel batches.
+/// Reads are taken from the source on one thread.
+size_t unpaired_for_each_parallel(function<bool(Alignment&)> get_read_if_available, function<void(Alignment&)> lambda);
+
 size_t fastq_unpaired_for_each(const string& filename, function<void(Alignment&)> lambda);
 size_t fastq_paired_interleaved_for_each(const string& filename, function<void(Alignment&, Alignment&)> lambda);
 size_t fastq_paired_two_files_for_each(const string& file1, const string& file2, function<void(Alignment&, Alignment&)> lambda);
@@ -52,7 +108,8 @@ size_t fastq_paired_two_files_for_each_parallel_after_wait(const string& file1,
 bam_hdr_t* hts_file_header(string& filename, string& header);
 bam_hdr_t* hts_string_header(string& header,
                              map<string, int64_t>& path_length,
-                             map<string, string>& rg_sample);
+                             map<string, string>& rg_sample,
+                             bool coordinate_sorted = false);
 void write_alignments(std::ostream& out, vector<Alignment>& buf);
 void write_alignment_to_file(const Alignment& aln, const string& filename);
 
@@ -60,7 +117,7 @@ void mapping_cigar(const Mapping& mapping, vector<pair<int, char> >& cigar);
 string cigar_string(vector<pair<int, char> >& cigar);
 string mapping_string(const string& source, const Mapping& mapping);
 
-void cigar_mapping(const bam1_t *b, Mapping& mapping, xg::XG* xgindex);
+int64_t cigar_mapping(const bam1_t *b, Mapping* mapping, xg::XG* xgindex);
 
 Alignment bam_to_alignment(const bam1_t *b, map<string, string>& rg_sample, const bam_hdr_t *bh, xg::XG* xgindex);
 Alignment bam_to_alignment(const bam1_t *b, map<string, string>& rg_sample);
@@ -99,6 +156,37 @@ bam1_t* alignment_to_bam(const string& sam_header,
                         const bool refrev,
                         const string& cigar);
                          
+/**
+ * Convert a paired Alignment to a BAM record, as above, but against an
+ * already-parsed header from hts_string_header. This is much faster than
+ * going through the header text, and many threads can make records against
+ * the same header at once.
+ *
+ * Remember to clean up with bam_destroy1(b);
+ */
+bam1_t* alignment_to_bam(bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar,
+                         const string& mateseq,
+                         const int32_t matepos,
+                         const int32_t tlen);
+
+/**
+ * Convert an unpaired Alignment to a BAM record against an already-parsed
+ * header from hts_string_header. Safe to call from many threads at once.
+ *
+ * Remember to clean up with bam_destroy1(b);
+ */
+bam1_t* alignment_to_bam(bam_hdr_t* header,
+                         const Alignment& alignment,
+                         const string& refseq,
+                         const int32_t refpos,
+                         const bool refrev,
+                         const string& cigar);
+
 /**
  * Convert a paired Alignment to a SAM record. If the alignment is unmapped,
  * refpos must be -1. Otherwise, refpos must be the position on the reference
@@ -150,6 +238,10 @@ Alignment merge_alignments(const vector<Alignment>& alns);
 Alignment merge_alignments(const Alignment& a1, const Alignment& a2, bool debug=false);
 Alignment strip_from_start(const Alignment& aln, size_t drop);
 Alignment strip_from_end(const Alignment& aln, size_t drop);
+// Strip bases from the start or end of an alignment in place, keeping only the
+// fields that strip_from_start and strip_from_end keep
+void strip_from_start_in_place(Alignment* aln, size_t drop);
+void strip_from_end_in_place(Alignment* aln, size_t drop);
 Alignment trim_alignment(const Alignment& aln, const Position& pos1, const Position& pos2);
 vector<Alignment> alignment_ends(const Alignment& aln, size_t len1, size_t len2);
 Alignment alignment_middle(const Alignment& aln, int len);
@@ -189,6 +281,8 @@ void flip_nodes(Alignment& a, const set<int64_t>& ids, const std::function<size_
 /// the start and end of Mappings, so code that handles simplified Alignments
 /// needs to handle offsets on internal Mappings.
 Alignment simplify(const Alignment& a, bool trim_internal_deletions = true);
+/// Simplifies the Path in the Alignment in place, as simplify().
+void simplify_in_place(Alignment* a, bool trim_internal_deletions = true);
 
 // quality information; a kind of poor man's pileup
 map<id_t, int> alignment_quality_per_node(const Alignment& aln);
@@ -0,0 +1,372 @@
+#include "alignment_predicate.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+/**
+ * \file alignment_predicate.cpp
+ * Implement compiled Alignment predicates over serialized Alignments.
+ */
+
+namespace vg {
+
+using namespace std;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+/// Field numbers in vg.proto that the predicates look at
+static const int ALIGNMENT_PATH = 2;
+static const int ALIGNMENT_NAME = 3;
+static const int ALIGNMENT_MAPPING_QUALITY = 5;
+static const int ALIGNMENT_SCORE = 6;
+static const int ALIGNMENT_IS_SECONDARY = 15;
+static const int ALIGNMENT_IDENTITY = 16;
+static const int PATH_MAPPING = 2;
+static const int MAPPING_POSITION = 1;
+static const int POSITION_NODE_ID = 1;
+
+static void check_parse(bool ok) {
+    if (!ok) {
+        throw runtime_error("[AlignmentPredicate] obsolete, invalid, or corrupt Alignment");
+    }
+}
+
+/// Strip whitespace from both ends of a string
+static string trim(const string& text) {
+    size_t start = text.find_first_not_of(" \t\n");
+    if (start == string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\n");
+    return text.substr(start, end - start + 1);
+}
+
+/// If the next field in the stream is an embedded message, limit the stream
+/// to it, so reading tags stops at its end. Returns false and skips the field
+/// if it isn't a message.
+static bool enter_message(CodedInputStream& in, uint32_t tag, CodedInputStream::Limit& limit) {
+    if (WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+        check_parse(WireFormatLite::SkipField(&in, tag));
+        return false;
+    }
+    ::google::protobuf::uint32 length;
+    check_parse(in.ReadVarint32(&length));
+    limit = in.PushLimit(length);
+    return true;
+}
+
+/// Leave an embedded message entered with enter_message.
+static void leave_message(CodedInputStream& in, CodedInputStream::Limit limit) {
+    check_parse(in.ConsumedEntireMessage());
+    in.PopLimit(limit);
+}
+
+/// Read the node ID of each mapping from a serialized Path, which the stream
+/// has been limited to.
+static void read_path_nodes(CodedInputStream& in, vector<id_t>& nodes) {
+    while (uint32_t tag = in.ReadTag()) {
+        CodedInputStream::Limit mapping_limit;
+        if (WireFormatLite::GetTagFieldNumber(tag) != PATH_MAPPING) {
+            check_parse(WireFormatLite::SkipField(&in, tag));
+        } else if (enter_message(in, tag, mapping_limit)) {
+            // A Mapping with no Position is on node 0, as far as a parsed
+            // Alignment would tell us.
+            id_t node_id = 0;
+            while (uint32_t mapping_tag = in.ReadTag()) {
+                CodedInputStream::Limit position_limit;
+                if (WireFormatLite::GetTagFieldNumber(mapping_tag) != MAPPING_POSITION) {
+                    check_parse(WireFormatLite::SkipField(&in, mapping_tag));
+                } else if (enter_message(in, mapping_tag, position_limit)) {
+                    while (uint32_t position_tag = in.ReadTag()) {
+                        if (WireFormatLite::GetTagFieldNumber(position_tag) == POSITION_NODE_ID &&
+                            WireFormatLite::GetTagWireType(position_tag) == WireFormatLite::WIRETYPE_VARINT) {
+                            ::google::protobuf::uint64 value;
+                            check_parse(in.ReadVarint64(&value));
+                            node_id = (id_t) value;
+                        } else {
+                            check_parse(WireFormatLite::SkipField(&in, position_tag));
+                        }
+                    }
+                    leave_message(in, position_limit);
+                }
+            }
+            leave_message(in, mapping_limit);
+            nodes.push_back(node_id);
+        }
+    }
+}
+
+AlignmentPredicate AlignmentPredicate::parse(const string& query) {
+    AlignmentPredicate predicate;
+
+    size_t clause_start = 0;
+    while (clause_start <= query.size()) {
+        size_t clause_end = query.find("&&", clause_start);
+        if (clause_end == string::npos) {
+            clause_end = query.size();
+        }
+        string clause = trim(query.substr(clause_start, clause_end - clause_start));
+        clause_start = clause_end + 2;
+
+        if (clause.empty()) {
+            throw runtime_error("[AlignmentPredicate] empty clause in query: " + query);
+        }
+        if (clause == "secondary" || clause == "!secondary") {
+            predicate.require_number(SECONDARY, EQUAL, clause == "secondary" ? 1 : 0);
+            continue;
+        }
+
+        // Split the clause into field, comparison, and value
+        size_t op_start = clause.find_first_of("=!<>^");
+        if (op_start == string::npos || op_start == 0) {
+            throw runtime_error("[AlignmentPredicate] no comparison in clause: " + clause);
+        }
+        string field_name = trim(clause.substr(0, op_start));
+        string op = clause.substr(op_start, 2);
+        Comparison comparison;
+        if (op == "==") {
+            comparison = EQUAL;
+        } else if (op == "!=") {
+            comparison = NOT_EQUAL;
+        } else if (op == "<=") {
+            comparison = LESS_EQUAL;
+        } else if (op == ">=") {
+            comparison = GREATER_EQUAL;
+        } else if (op == "^=") {
+            comparison = PREFIX;
+        } else if (op[0] == '<') {
+            comparison = LESS;
+            op = "<";
+        } else if (op[0] == '>') {
+            comparison = GREATER;
+            op = ">";
+        } else {
+            throw runtime_error("[AlignmentPredicate] unknown comparison in clause: " + clause);
+        }
+        string value = trim(clause.substr(op_start + op.size()));
+        if (value.empty()) {
+            throw runtime_error("[AlignmentPredicate] no value in clause: " + clause);
+        }
+
+        if (field_name == "name") {
+            predicate.require_name(comparison, value);
+        } else if (field_name == "node") {
+            vector<id_t> nodes;
+            size_t id_start = 0;
+            while (id_start <= value.size()) {
+                size_t id_end = value.find(',', id_start);
+                if (id_end == string::npos) {
+                    id_end = value.size();
+                }
+                string id_text = trim(value.substr(id_start, id_end - id_start));
+                size_t used = 0;
+                try {
+                    nodes.push_back(stoll(id_text, &used));
+                } catch (const logic_error& e) {
+                    used = 0;
+                }
+                if (used == 0 || used != id_text.size()) {
+                    throw runtime_error("[AlignmentPredicate] bad node ID in clause: " + clause);
+                }
+                id_start = id_end + 1;
+            }
+            predicate.require_nodes(comparison, nodes);
+        } else {
+            Field field;
+            if (field_name == "mapq") {
+                field = MAPQ;
+            } else if (field_name == "score") {
+                field = SCORE;
+            } else if (field_name == "identity") {
+                field = IDENTITY;
+            } else if (field_name == "secondary") {
+                field = SECONDARY;
+            } else {
+                throw runtime_error("[AlignmentPredicate] unknown field in clause: " + clause);
+            }
+            size_t used = 0;
+            double number = 0;
+            try {
+                number = stod(value, &used);
+            } catch (const logic_error& e) {
+                used = 0;
+            }
+            if (used == 0 || used != value.size()) {
+                throw runtime_error("[AlignmentPredicate] bad number in clause: " + clause);
+            }
+            predicate.require_number(field, comparison, number);
+        }
+    }
+
+    return predicate;
+}
+
+void AlignmentPredicate::require_number(Field field, Comparison comparison, double value) {
+    if (field == NAME || field == NODE || comparison == PREFIX) {
+        throw runtime_error("[AlignmentPredicate] field cannot be compared as a number");
+    }
+    clauses.emplace_back();
+    clauses.back().field = field;
+    clauses.back().comparison = comparison;
+    clauses.back().number = value;
+}
+
+void AlignmentPredicate::require_name(Comparison comparison, const string& value) {
+    if (comparison != EQUAL && comparison != NOT_EQUAL && comparison != PREFIX) {
+        throw runtime_error("[AlignmentPredicate] names can only be compared with ==, != or ^=");
+    }
+    clauses.emplace_back();
+    clauses.back().field = NAME;
+    clauses.back().comparison = comparison;
+    clauses.back().text = value;
+    needs_name = true;
+}
+
+void AlignmentPredicate::require_nodes(Comparison comparison, const vector<id_t>& nodes) {
+    if (comparison != EQUAL && comparison != NOT_EQUAL) {
+        throw runtime_error("[AlignmentPredicate] nodes can only be compared with == or !=");
+    }
+    clauses.emplace_back();
+    clauses.back().field = NODE;
+    clauses.back().comparison = comparison;
+    clauses.back().nodes = nodes;
+    sort(clauses.back().nodes.begin(), clauses.back().nodes.end());
+    needs_nodes = true;
+}
+
+bool AlignmentPredicate::empty() const {
+    return clauses.empty();
+}
+
+bool AlignmentPredicate::test(const Values& values) const {
+    for (const Clause& clause : clauses) {
+        bool holds;
+        switch (clause.field) {
+        case NAME:
+            if (clause.comparison == PREFIX) {
+                holds = values.name.compare(0, clause.text.size(), clause.text) == 0;
+            } else {
+                holds = (values.name == clause.text) == (clause.comparison == EQUAL);
+            }
+            break;
+        case NODE:
+            holds = false;
+            for (id_t node_id : values.nodes) {
+                if (binary_search(clause.nodes.begin(), clause.nodes.end(), node_id)) {
+                    holds = true;
+                    break;
+                }
+            }
+            holds = holds == (clause.comparison == EQUAL);
+            break;
+        default:
+            {
+                double value = (clause.field == MAPQ ? values.mapq :
+                                clause.field == SCORE ? values.score :
+                                clause.field == IDENTITY ? values.identity :
+                                values.secondary ? 1 : 0);
+                switch (clause.comparison) {
+                case EQUAL:
+                    holds = value == clause.number;
+                    break;
+                case NOT_EQUAL:
+                    holds = value != clause.number;
+                    break;
+                case LESS:
+                    holds = value < clause.number;
+                    break;
+                case LESS_EQUAL:
+                    holds = value <= clause.number;
+                    break;
+                case GREATER:
+                    holds = value > clause.number;
+                    break;
+                default:
+                    holds = value >= clause.number;
+                    break;
+                }
+            }
+            break;
+        }
+        if (!holds) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AlignmentPredicate::operator()(const Alignment& aln) const {
+    if (clauses.empty()) {
+        return true;
+    }
+    Values values;
+    values.mapq = aln.mapping_quality();
+    values.score = aln.score();
+    values.identity = aln.identity();
+    values.secondary = aln.is_secondary();
+    if (needs_name) {
+        values.name = aln.name();
+    }
+    if (needs_nodes) {
+        for (size_t i = 0; i < aln.path().mapping_size(); i++) {
+            values.nodes.push_back(aln.path().mapping(i).position().node_id());
+        }
+    }
+    return test(values);
+}
+
+bool AlignmentPredicate::operator()(const string& serialized) const {
+    if (clauses.empty()) {
+        return true;
+    }
+
+    Values values;
+    CodedInputStream in((const uint8_t*) serialized.data(), serialized.size());
+    while (uint32_t tag = in.ReadTag()) {
+        int field_number = WireFormatLite::GetTagFieldNumber(tag);
+        WireFormatLite::WireType wire_type = WireFormatLite::GetTagWireType(tag);
+        ::google::protobuf::uint64 value;
+        ::google::protobuf::uint32 length;
+        CodedInputStream::Limit limit;
+
+        if (wire_type == WireFormatLite::WIRETYPE_VARINT &&
+            (field_number == ALIGNMENT_MAPPING_QUALITY || field_number == ALIGNMENT_SCORE ||
+             field_number == ALIGNMENT_IS_SECONDARY)) {
+            check_parse(in.ReadVarint64(&value));
+            if (field_number == ALIGNMENT_MAPPING_QUALITY) {
+                // Negative int32s are sign extended to 64 bits on the wire
+                values.mapq = (int32_t) value;
+            } else if (field_number == ALIGNMENT_SCORE) {
+                values.score = (int32_t) value;
+            } else {
+                values.secondary = value != 0;
+            }
+        } else if (wire_type == WireFormatLite::WIRETYPE_FIXED64 && field_number == ALIGNMENT_IDENTITY) {
+            check_parse(in.ReadLittleEndian64(&value));
+            values.identity = WireFormatLite::DecodeDouble(value);
+        } else if (needs_name && wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED &&
+                   field_number == ALIGNMENT_NAME) {
+            check_parse(in.ReadVarint32(&length));
+            check_parse(in.ReadString(&values.name, length));
+        } else if (needs_nodes && field_number == ALIGNMENT_PATH) {
+            if (enter_message(in, tag, limit)) {
+                // Protobuf merges repeated copies of a message field, so
+                // mappings from all of them count.
+                read_path_nodes(in, values.nodes);
+                leave_message(in, limit);
+            }
+        } else {
+            // Sequences, qualities, and everything else we don't look at get
+            // skipped without being decoded.
+            check_parse(WireFormatLite::SkipField(&in, tag));
+        }
+    }
+    check_parse(in.ConsumedEntireMessage());
+
+    return test(values);
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef VG_ALIGNMENT_PREDICATE_HPP_INCLUDED
+#define VG_ALIGNMENT_PREDICATE_HPP_INCLUDED
+
+/**
+ * \file alignment_predicate.hpp
+ *
+ * A compiled test of simple Alignment properties (mapping quality, score,
+ * identity, secondary flag, name, and visited nodes) that can be evaluated
+ * directly on a serialized Alignment. Only the fields the test needs are
+ * decoded; sequences, qualities, annotations and everything else are skipped
+ * over without being parsed, so selecting reads from a GAM costs little more
+ * than reading it.
+ */
+
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+class AlignmentPredicate {
+public:
+
+    /// The Alignment properties that can be tested
+    enum Field { MAPQ, SCORE, IDENTITY, SECONDARY, NAME, NODE };
+
+    /// The comparisons that can be made against them. PREFIX only applies to
+    /// names. For nodes, EQUAL means "visits one of" and NOT_EQUAL means
+    /// "visits none of".
+    enum Comparison { EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, PREFIX };
+
+    /// Make a predicate that accepts everything
+    AlignmentPredicate() = default;
+
+    /**
+     * Compile a predicate from a query like
+     *
+     *     mapq >= 30 && !secondary && name ^= read1 && node == 5,9,12
+     *
+     * Clauses are joined with "&&" and all have to hold. The numeric fields
+     * are "mapq", "score" and "identity", compared with ==, !=, <, <=, > or
+     * >=. "secondary" and "!secondary" test the secondary flag. "name" can
+     * be compared with ==, != or ^= (has prefix). "node" takes a comma-
+     * separated list of node IDs with == (path visits any of them) or !=
+     * (visits none of them).
+     *
+     * Throws a runtime_error describing the problem if the query can't be
+     * parsed.
+     */
+    static AlignmentPredicate parse(const string& query);
+
+    /// Also require a numeric field (MAPQ, SCORE, IDENTITY or SECONDARY, as
+    /// 0 or 1) to compare to a value in the given way.
+    void require_number(Field field, Comparison comparison, double value);
+
+    /// Also require the name to compare to a string in the given way.
+    void require_name(Comparison comparison, const string& value);
+
+    /// Also require the path to visit (EQUAL) or avoid (NOT_EQUAL) all of the
+    /// given nodes.
+    void require_nodes(Comparison comparison, const vector<id_t>& nodes);
+
+    /// Returns true if the predicate accepts everything
+    bool empty() const;
+
+    /// Test a parsed Alignment
+    bool operator()(const Alignment& aln) const;
+
+    /// Test a serialized Alignment, decoding only the fields that the clauses
+    /// look at. Throws a runtime_error if the message is corrupt.
+    bool operator()(const string& serialized) const;
+
+private:
+
+    struct Clause {
+        Field field;
+        Comparison comparison;
+        double number;
+        string text;
+        /// Sorted node IDs, for NODE clauses
+        vector<id_t> nodes;
+    };
+
+    /// The fields of an Alignment that clauses can look at, decoded
+    struct Values {
+        double mapq = 0;
+        double score = 0;
+        double identity = 0;
+        bool secondary = false;
+        string name;
+        /// Node IDs visited by the path, in path order
+        vector<id_t> nodes;
+    };
+
+    /// See if all the clauses hold for the given values
+    bool test(const Values& values) const;
+
+    vector<Clause> clauses;
+
+    /// Do we need to decode the name, or the path's node IDs?
+    bool needs_name = false;
+    bool needs_nodes = false;
+};
+
+}
+
+#endif
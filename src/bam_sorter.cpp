@@ -0,0 +1,218 @@
+#include "bam_sorter.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+
+namespace vg {
+
+using namespace std;
+
+BAMSorter::BAMSorter(bam_hdr_t* header) : header(header),
+    buffers(omp_get_max_threads()), buffer_bytes(omp_get_max_threads(), 0) {
+}
+
+BAMSorter::~BAMSorter() {
+    for (auto& buffer : buffers) {
+        for (auto b : buffer) {
+            bam_destroy1(b);
+        }
+    }
+    for (auto& run : tmp_filenames) {
+        temp_file::remove(run);
+    }
+}
+
+uint64_t BAMSorter::sort_key(const bam1_t* b) {
+    // reads without a reference have tid -1, which goes last as unsigned
+    return ((uint64_t) (uint32_t) b->core.tid << 32) | ((uint64_t) (uint32_t) (b->core.pos + 1) << 1) | bam_is_rev(b);
+}
+
+void BAMSorter::sort(vector<bam1_t*>& records) {
+    stable_sort(records.begin(), records.end(), [](const bam1_t* a, const bam1_t* b) {
+        return sort_key(a) < sort_key(b);
+    });
+}
+
+void BAMSorter::add(vector<bam1_t*>& records) {
+    int tid = omp_get_thread_num();
+    if (tid >= buffers.size()) {
+        throw runtime_error("[BAMSorter::add] called from more threads than the sorter was made for");
+    }
+    size_t thread_max_bytes = max<size_t>(1, max_memory / buffers.size());
+
+    auto& buffer = buffers[tid];
+    for (auto b : records) {
+        buffer.push_back(b);
+        buffer_bytes[tid] += sizeof(bam1_t) + b->l_data;
+    }
+    records.clear();
+
+    if (buffer_bytes[tid] >= thread_max_bytes) {
+        sort(buffer);
+        write_temp(buffer);
+        buffer_bytes[tid] = 0;
+    }
+}
+
+void BAMSorter::write_temp(vector<bam1_t*>& records) {
+    string t_name;
+#pragma omp critical (bamsort_temp)
+    {
+        // temp_file isn't thread safe
+        t_name = temp_file::create("bamsort");
+        tmp_filenames.push_back(t_name);
+    }
+
+    // runs are read back soon, so compress them lightly
+    samFile* t_file = sam_open(t_name.c_str(), "wb1");
+    if (t_file == nullptr) {
+        throw runtime_error("[BAMSorter::write_temp] could not open temp file " + t_name);
+    }
+    bool ok = sam_hdr_write(t_file, header) == 0;
+    for (auto b : records) {
+        ok = ok && sam_write1(t_file, header, b) >= 0;
+        bam_destroy1(b);
+    }
+    records.clear();
+    ok = sam_close(t_file) == 0 && ok;
+    if (!ok) {
+        throw runtime_error("[BAMSorter::write_temp] could not write temp file " + t_name);
+    }
+}
+
+void BAMSorter::write_sorted(samFile* out) {
+
+    if (tmp_filenames.empty()) {
+        // everything fit in memory, so skip the temp files
+        vector<bam1_t*> all;
+        for (auto& buffer : buffers) {
+            all.insert(all.end(), buffer.begin(), buffer.end());
+            buffer.clear();
+        }
+        sort(all);
+        bool ok = true;
+        for (auto b : all) {
+            ok = ok && sam_write1(out, header, b) >= 0;
+            bam_destroy1(b);
+        }
+        if (!ok) {
+            throw runtime_error("[BAMSorter::write_sorted] could not write sorted records");
+        }
+        return;
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < buffers.size(); i++) {
+        if (!buffers[i].empty()) {
+            sort(buffers[i]);
+            write_temp(buffers[i]);
+        }
+    }
+
+    // Merge groups of runs into longer runs until they can all be merged at once
+    size_t fan_in = max<size_t>(2, max_fan_in);
+    vector<string> runs = tmp_filenames;
+    while (runs.size() > fan_in) {
+        vector<vector<string>> groups;
+        vector<string> merged;
+        for (size_t i = 0; i < runs.size(); i += fan_in) {
+            groups.emplace_back(runs.begin() + i, runs.begin() + min(i + fan_in, runs.size()));
+            merged.push_back(temp_file::create("bamsort"));
+        }
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < groups.size(); i++) {
+            samFile* merged_out = sam_open(merged[i].c_str(), "wb1");
+            if (merged_out == nullptr) {
+                throw runtime_error("[BAMSorter::write_sorted] could not open temp file " + merged[i]);
+            }
+            bool ok = sam_hdr_write(merged_out, header) == 0;
+            merge_runs(groups[i], [&](bam1_t* b) {
+                ok = ok && sam_write1(merged_out, header, b) >= 0;
+            });
+            ok = sam_close(merged_out) == 0 && ok;
+            if (!ok) {
+                throw runtime_error("[BAMSorter::write_sorted] could not write temp file " + merged[i]);
+            }
+        }
+
+        for (auto& run : runs) {
+            temp_file::remove(run);
+        }
+        runs = std::move(merged);
+        tmp_filenames = runs;
+    }
+
+    bool ok = true;
+    merge_runs(runs, [&](bam1_t* b) {
+        ok = ok && sam_write1(out, header, b) >= 0;
+    });
+    if (!ok) {
+        throw runtime_error("[BAMSorter::write_sorted] could not write sorted records");
+    }
+
+    for (auto& run : runs) {
+        temp_file::remove(run);
+    }
+    tmp_filenames.clear();
+}
+
+void BAMSorter::merge_runs(const vector<string>& run_filenames, const function<void(bam1_t*)>& emit) {
+
+    vector<samFile*> run_files;
+    for (auto& filename : run_filenames) {
+        run_files.push_back(sam_open(filename.c_str(), "r"));
+        if (run_files.back() == nullptr) {
+            throw runtime_error("[BAMSorter::merge_runs] could not open temp file " + filename);
+        }
+        // every run has our header, so we don't need its copy
+        bam_hdr_t* run_header = sam_hdr_read(run_files.back());
+        if (run_header == nullptr) {
+            throw runtime_error("[BAMSorter::merge_runs] could not read temp file " + filename);
+        }
+        bam_hdr_destroy(run_header);
+    }
+
+    // A heap of the next record from each run. Ties go to the earlier run,
+    // so that merging is stable.
+    vector<pair<bam1_t*, size_t>> heap;
+    auto heap_order = [](const pair<bam1_t*, size_t>& a, const pair<bam1_t*, size_t>& b) {
+        uint64_t key_a = sort_key(a.first);
+        uint64_t key_b = sort_key(b.first);
+        return key_a != key_b ? key_a > key_b : a.second > b.second;
+    };
+
+    // read the run's next record into b, or free b if the run is done
+    auto refill = [&](bam1_t* b, size_t run) {
+        int r = sam_read1(run_files[run], header, b);
+        if (r >= 0) {
+            heap.emplace_back(b, run);
+            push_heap(heap.begin(), heap.end(), heap_order);
+        } else {
+            bam_destroy1(b);
+            if (r < -1) {
+                throw runtime_error("[BAMSorter::merge_runs] temp file " + run_filenames[run] + " is truncated");
+            }
+        }
+    };
+
+    for (size_t i = 0; i < run_files.size(); i++) {
+        refill(bam_init1(), i);
+    }
+
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), heap_order);
+        auto next = heap.back();
+        heap.pop_back();
+        emit(next.first);
+        refill(next.first, next.second);
+    }
+
+    for (auto run_file : run_files) {
+        sam_close(run_file);
+    }
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef VG_BAM_SORTER_HPP_INCLUDED
+#define VG_BAM_SORTER_HPP_INCLUDED
+
+/**
+ * \file bam_sorter.hpp
+ *
+ * Coordinate sorting for BAM records made by surjection, in bounded memory.
+ * Records are buffered per thread, spilled to temp files as sorted runs when
+ * a thread's share of the memory budget fills up, and merged in the same way
+ * that GAMSorter merges its runs.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "htslib/sam.h"
+
+namespace vg {
+
+using namespace std;
+
+class BAMSorter {
+public:
+
+    /// Make a sorter for records against the given header, which must
+    /// outlive the sorter. Each of up to omp_get_max_threads() threads gets
+    /// its own buffer.
+    BAMSorter(bam_hdr_t* header);
+
+    /// Free any records not yet written and remove the temp files.
+    ~BAMSorter();
+
+    /// Take ownership of the records, in the order they should come out among
+    /// records at the same position. Safe to call from several threads.
+    void add(vector<bam1_t*>& records);
+
+    /// Write every record added so far to out in coordinate order, as
+    /// samtools sort orders them, and free them. The header must already have
+    /// been written to out.
+    void write_sorted(samFile* out);
+
+    /// Approximate size, in bytes, of the records held in memory at once,
+    /// across all threads
+    size_t max_memory = 1024 * 1024 * 1024;
+
+    /// Most temp files merged at once
+    size_t max_fan_in = 64;
+
+private:
+
+    /// Get the key that coordinate order sorts on, with unplaced reads last.
+    static uint64_t sort_key(const bam1_t* b);
+
+    /// Sort a buffer of records in coordinate order, keeping the order of
+    /// records at the same position.
+    static void sort(vector<bam1_t*>& records);
+
+    /// Write sorted records to a new temp file, as one more run to merge, and
+    /// free them. Safe to call from several threads.
+    void write_temp(vector<bam1_t*>& records);
+
+    /// Merge the sorted runs in the given temp files, handing each record to
+    /// emit in sorted order. The record is only valid during the call.
+    void merge_runs(const vector<string>& run_filenames, const function<void(bam1_t*)>& emit);
+
+    bam_hdr_t* header;
+
+    /// Unsorted records held by each thread, and their size in bytes
+    vector<vector<bam1_t*>> buffers;
+    vector<size_t> buffer_bytes;
+
+    vector<string> tmp_filenames;
+};
+
+}
+
+#endif
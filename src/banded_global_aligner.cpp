@@ -6,8 +6,17 @@
 //
 
 #include "banded_global_aligner.hpp"
+#include "banded_global_aligner_kernel.hpp"
+#include "simd_level.hpp"
 #include "json2pb.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#endif
+
 //#define debug_banded_aligner_objects
 //#define debug_banded_aligner_graph_processing
 //#define debug_banded_aligner_fill_matrix
@@ -16,6 +25,328 @@
 
 using namespace vg;
 
+namespace {
+    
+    /*
+     * Fill in a run of match and insert column cells from the column to their left in the rectangularized
+     * band. The left pointers are at the same rows as the match and insert column pointers, so the match
+     * cells come from the same rows and the insert column cells come from one row down. None of these cells
+     * depend on each other, so the 8 and 16 bit versions do a whole vector of them at a time.
+     */
+    template <class IntType>
+    inline void fill_band_column_scalar(const IntType* match_scores, const IntType* left_match,
+                                        const IntType* left_insert_row, const IntType* left_insert_col,
+                                        IntType* match, IntType* insert_col, int64_t length,
+                                        int8_t gap_open, int8_t gap_extend) {
+        for (int64_t k = 0; k < length; k++) {
+            match[k] = match_scores[k] + max(max(left_match[k], left_insert_row[k]), left_insert_col[k]);
+            insert_col[k] = max(max(left_match[k + 1] - gap_open, left_insert_row[k + 1] - gap_open),
+                                left_insert_col[k + 1] - gap_extend);
+        }
+    }
+    
+    template <class IntType>
+    inline void fill_band_column(const IntType* match_scores, const IntType* left_match,
+                                 const IntType* left_insert_row, const IntType* left_insert_col,
+                                 IntType* match, IntType* insert_col, int64_t length,
+                                 int8_t gap_open, int8_t gap_extend) {
+        fill_band_column_scalar<IntType>(match_scores, left_match, left_insert_row, left_insert_col,
+                                         match, insert_col, length, gap_open, gap_extend);
+    }
+    
+#ifdef __SSE2__
+    
+    // the vector versions saturate at the ends of the score range instead of wrapping around, and so
+    // do their scalar tails and the scalar fallback when a lower SIMD level is forced
+    
+    template <class IntType>
+    inline IntType saturate(int64_t score) {
+        return (IntType) max<int64_t>(numeric_limits<IntType>::min(), min<int64_t>(numeric_limits<IntType>::max(), score));
+    }
+    
+    template <class IntType>
+    inline void fill_band_column_saturating(const IntType* match_scores, const IntType* left_match,
+                                            const IntType* left_insert_row, const IntType* left_insert_col,
+                                            IntType* match, IntType* insert_col, int64_t length,
+                                            int8_t gap_open, int8_t gap_extend) {
+        for (int64_t k = 0; k < length; k++) {
+            match[k] = saturate<IntType>(match_scores[k] + max(max(left_match[k], left_insert_row[k]), left_insert_col[k]));
+            insert_col[k] = max(saturate<IntType>(max(left_match[k + 1], left_insert_row[k + 1]) - gap_open),
+                                saturate<IntType>(left_insert_col[k + 1] - gap_extend));
+        }
+    }
+    
+    // fill as many whole vectors as the widest allowed kernel can, and return how many cells that was
+    template <class IntType>
+    inline int64_t fill_band_column_wide(SIMDLevel level, const IntType* match_scores, const IntType* left_match,
+                                         const IntType* left_insert_row, const IntType* left_insert_col,
+                                         IntType* match, IntType* insert_col, int64_t length,
+                                         int8_t gap_open, int8_t gap_extend) {
+        if (level >= SIMD_AVX512) {
+            return fill_band_column_avx512(match_scores, left_match, left_insert_row, left_insert_col,
+                                           match, insert_col, length, gap_open, gap_extend);
+        }
+        if (level >= SIMD_AVX2) {
+            return fill_band_column_avx2(match_scores, left_match, left_insert_row, left_insert_col,
+                                         match, insert_col, length, gap_open, gap_extend);
+        }
+        return 0;
+    }
+    
+    inline __m128i max_epi8(__m128i a, __m128i b) {
+#ifdef __SSE4_1__
+        return _mm_max_epi8(a, b);
+#else
+        // SSE2 only has a signed max for 16 bit lanes
+        __m128i a_greater = _mm_cmpgt_epi8(a, b);
+        return _mm_or_si128(_mm_and_si128(a_greater, a), _mm_andnot_si128(a_greater, b));
+#endif
+    }
+    
+    template <>
+    inline void fill_band_column<int16_t>(const int16_t* match_scores, const int16_t* left_match,
+                                          const int16_t* left_insert_row, const int16_t* left_insert_col,
+                                          int16_t* match, int16_t* insert_col, int64_t length,
+                                          int8_t gap_open, int8_t gap_extend) {
+        SIMDLevel level = simd_level();
+        if (level < SIMD_SSE2) {
+            fill_band_column_saturating<int16_t>(match_scores, left_match, left_insert_row, left_insert_col,
+                                                 match, insert_col, length, gap_open, gap_extend);
+            return;
+        }
+        int64_t k = fill_band_column_wide<int16_t>(level, match_scores, left_match, left_insert_row, left_insert_col,
+                                                   match, insert_col, length, gap_open, gap_extend);
+        const __m128i open = _mm_set1_epi16(gap_open);
+        const __m128i extend = _mm_set1_epi16(gap_extend);
+        for (; k + 8 <= length; k += 8) {
+            __m128i diag = _mm_max_epi16(_mm_max_epi16(_mm_loadu_si128((const __m128i*) (left_match + k)),
+                                                       _mm_loadu_si128((const __m128i*) (left_insert_row + k))),
+                                         _mm_loadu_si128((const __m128i*) (left_insert_col + k)));
+            _mm_storeu_si128((__m128i*) (match + k),
+                             _mm_adds_epi16(_mm_loadu_si128((const __m128i*) (match_scores + k)), diag));
+            
+            __m128i left = _mm_max_epi16(_mm_loadu_si128((const __m128i*) (left_match + k + 1)),
+                                         _mm_loadu_si128((const __m128i*) (left_insert_row + k + 1)));
+            __m128i left_gap = _mm_loadu_si128((const __m128i*) (left_insert_col + k + 1));
+            _mm_storeu_si128((__m128i*) (insert_col + k),
+                             _mm_max_epi16(_mm_subs_epi16(left, open), _mm_subs_epi16(left_gap, extend)));
+        }
+        fill_band_column_saturating<int16_t>(match_scores + k, left_match + k, left_insert_row + k, left_insert_col + k,
+                                             match + k, insert_col + k, length - k, gap_open, gap_extend);
+    }
+    
+    template <>
+    inline void fill_band_column<int8_t>(const int8_t* match_scores, const int8_t* left_match,
+                                         const int8_t* left_insert_row, const int8_t* left_insert_col,
+                                         int8_t* match, int8_t* insert_col, int64_t length,
+                                         int8_t gap_open, int8_t gap_extend) {
+        SIMDLevel level = simd_level();
+        if (level < SIMD_SSE2) {
+            fill_band_column_saturating<int8_t>(match_scores, left_match, left_insert_row, left_insert_col,
+                                                match, insert_col, length, gap_open, gap_extend);
+            return;
+        }
+        int64_t k = fill_band_column_wide<int8_t>(level, match_scores, left_match, left_insert_row, left_insert_col,
+                                                  match, insert_col, length, gap_open, gap_extend);
+        const __m128i open = _mm_set1_epi8(gap_open);
+        const __m128i extend = _mm_set1_epi8(gap_extend);
+        for (; k + 16 <= length; k += 16) {
+            __m128i diag = max_epi8(max_epi8(_mm_loadu_si128((const __m128i*) (left_match + k)),
+                                             _mm_loadu_si128((const __m128i*) (left_insert_row + k))),
+                                    _mm_loadu_si128((const __m128i*) (left_insert_col + k)));
+            _mm_storeu_si128((__m128i*) (match + k),
+                             _mm_adds_epi8(_mm_loadu_si128((const __m128i*) (match_scores + k)), diag));
+            
+            __m128i left = max_epi8(_mm_loadu_si128((const __m128i*) (left_match + k + 1)),
+                                    _mm_loadu_si128((const __m128i*) (left_insert_row + k + 1)));
+            __m128i left_gap = _mm_loadu_si128((const __m128i*) (left_insert_col + k + 1));
+            _mm_storeu_si128((__m128i*) (insert_col + k),
+                             max_epi8(_mm_subs_epi8(left, open), _mm_subs_epi8(left_gap, extend)));
+        }
+        fill_band_column_saturating<int8_t>(match_scores + k, left_match + k, left_insert_row + k, left_insert_col + k,
+                                            match + k, insert_col + k, length - k, gap_open, gap_extend);
+    }
+    
+#endif
+    
+    /*
+     * Scores for filling the band. Each gives the match score of a node base against a read base and the
+     * gap penalties. These two read them from the Aligner's score matrix and penalties at runtime.
+     */
+    struct RuntimeScores {
+        RuntimeScores(const int8_t* score_mat, const int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                      const string& read) :
+            score_mat(score_mat), nt_table(nt_table), open(gap_open), extend(gap_extend), read(read) {}
+        
+        inline int8_t score(char node_char, int64_t read_idx) const {
+            return score_mat[5 * nt_table[node_char] + nt_table[read[read_idx]]];
+        }
+        inline int8_t gap_open() const {
+            return open;
+        }
+        inline int8_t gap_extend() const {
+            return extend;
+        }
+        
+        const int8_t* score_mat;
+        const int8_t* nt_table;
+        int8_t open;
+        int8_t extend;
+        const string& read;
+    };
+    
+    struct QualAdjustedScores : public RuntimeScores {
+        QualAdjustedScores(const int8_t* score_mat, const int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                           const string& read, const string& base_quality) :
+            RuntimeScores(score_mat, nt_table, gap_open, gap_extend, read), base_quality(base_quality) {}
+        
+        inline int8_t score(char node_char, int64_t read_idx) const {
+            return score_mat[25 * base_quality[read_idx] + 5 * nt_table[node_char] + nt_table[read[read_idx]]];
+        }
+        
+        const string& base_quality;
+    };
+    
+    /*
+     * Scores for one of the fixed scoring schemes, as compile-time constants. Only valid when
+     * identify_banded_scoring_scheme has checked that the score matrix matches them.
+     */
+    template <int8_t Match, int8_t Mismatch, int8_t GapOpen, int8_t GapExtend>
+    struct FixedScores {
+        FixedScores(const int8_t* nt_table, const string& read) : nt_table(nt_table), read(read) {}
+        
+        inline int8_t score(char node_char, int64_t read_idx) const {
+            int8_t node_nt = nt_table[node_char];
+            int8_t read_nt = nt_table[read[read_idx]];
+            // N (4) scores 0 against everything
+            return (node_nt == 4 || read_nt == 4) ? 0 : (node_nt == read_nt ? Match : -Mismatch);
+        }
+        inline int8_t gap_open() const {
+            return GapOpen;
+        }
+        inline int8_t gap_extend() const {
+            return GapExtend;
+        }
+        
+        const int8_t* nt_table;
+        const string& read;
+    };
+    
+    typedef FixedScores<1, 4, 6, 1> DefaultScores;
+    typedef FixedScores<2, 8, 12, 2> DoubledDefaultScores;
+    typedef FixedScores<1, 1, 1, 1> UnitScores;
+    
+    /*
+     * Fill in the cells of a column in the rectangularized band strictly between its first and last
+     * rows, which don't need any of the edge cases. column_start is the index of the column's first cell
+     * and read_offset is the read index of its first row. Templated on the scores so the fixed schemes
+     * get their penalties folded in.
+     */
+    template <class IntType, class Scores>
+    inline void fill_band_interior(const Scores& scores, char node_char, int64_t read_offset,
+                                   int64_t column_start, int64_t band_height, int64_t interior_start,
+                                   int64_t interior_stop, IntType* column_scores, IntType* match,
+                                   IntType* insert_row, IntType* insert_col) {
+        
+        for (int64_t i = interior_start; i < interior_stop; i++) {
+            column_scores[i] = scores.score(node_char, read_offset + i);
+        }
+        
+        // the match and insert column cells only depend on the column to the left, so they can be
+        // filled all at once before the insert row cells go down the column
+        int64_t idx = column_start + interior_start;
+        int64_t diag_idx = idx - band_height;
+        fill_band_column<IntType>(column_scores + interior_start, match + diag_idx, insert_row + diag_idx,
+                                  insert_col + diag_idx, match + idx, insert_col + idx,
+                                  interior_stop - interior_start, scores.gap_open(), scores.gap_extend());
+        
+        for (idx = column_start + interior_start; idx < column_start + interior_stop; idx++) {
+            insert_row[idx] = max(max(match[idx - 1] - scores.gap_open(), insert_row[idx - 1] - scores.gap_extend()),
+                                  insert_col[idx - 1] - scores.gap_open());
+        }
+    }
+}
+
+BandedScoringScheme vg::identify_banded_scoring_scheme(const int8_t* score_mat, int8_t gap_open,
+                                                       int8_t gap_extend) {
+    int8_t match = score_mat[0];
+    int8_t mismatch = -score_mat[1];
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 5; j++) {
+            int8_t expected = (i == 4 || j == 4) ? 0 : (i == j ? match : -mismatch);
+            if (score_mat[5 * i + j] != expected) {
+                return RuntimeScoring;
+            }
+        }
+    }
+    
+    if (match == 1 && mismatch == 4 && gap_open == 6 && gap_extend == 1) {
+        return DefaultScoring;
+    }
+    else if (match == 2 && mismatch == 8 && gap_open == 12 && gap_extend == 2) {
+        return DoubledDefaultScoring;
+    }
+    else if (match == 1 && mismatch == 1 && gap_open == 1 && gap_extend == 1) {
+        return UnitScoring;
+    }
+    return RuntimeScoring;
+}
+
+thread_local vector<vector<unique_ptr<char[]>>> BandedMatrixPool::free_blocks;
+
+size_t BandedMatrixPool::size_class(size_t bytes) {
+    size_t exponent = 0;
+    while (((size_t) 1 << exponent) < bytes) {
+        exponent++;
+    }
+    return exponent;
+}
+
+char* BandedMatrixPool::acquire(size_t bytes) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+    size_t exponent = size_class(bytes);
+    if (exponent < free_blocks.size() && !free_blocks[exponent].empty()) {
+        char* block = free_blocks[exponent].back().release();
+        free_blocks[exponent].pop_back();
+        return block;
+    }
+    return new char[(size_t) 1 << exponent];
+}
+
+void BandedMatrixPool::release(char* block, size_t bytes) {
+    if (block == nullptr) {
+        return;
+    }
+    size_t exponent = size_class(bytes);
+    if (((size_t) 1 << exponent) > MAX_POOLED_BYTES) {
+        delete[] block;
+        return;
+    }
+    if (exponent >= free_blocks.size()) {
+        free_blocks.resize(exponent + 1);
+    }
+    if (free_blocks[exponent].size() >= MAX_POOLED_BLOCKS) {
+        delete[] block;
+        return;
+    }
+    free_blocks[exponent].emplace_back(block);
+}
+
+size_t BandedMatrixPool::size() {
+    size_t total = 0;
+    for (auto& size_class_blocks : free_blocks) {
+        total += size_class_blocks.size();
+    }
+    return total;
+}
+
+void BandedMatrixPool::clear() {
+    free_blocks.clear();
+    free_blocks.shrink_to_fit();
+}
+
 template<class IntType>
 BandedGlobalAligner<IntType>::BABuilder::BABuilder(Alignment& alignment) :
                                                    alignment(alignment),
@@ -214,7 +545,8 @@ BandedGlobalAligner<IntType>::BAMatrix::BAMatrix(Alignment& alignment, Node* nod
                                                  cumulative_seq_len(cumulative_seq_len),
                                                  match(nullptr),
                                                  insert_col(nullptr),
-                                                 insert_row(nullptr)
+                                                 insert_row(nullptr),
+                                                 matrix_bytes(0)
 {
     // nothing to do
 #ifdef debug_banded_aligner_objects
@@ -232,15 +564,16 @@ BandedGlobalAligner<IntType>::BAMatrix::~BAMatrix() {
         cerr << "[BAMatrix::~BAMatrix] destructing null matrix" << endl;
     }
 #endif
-    free(match);
-    free(insert_row);
-    free(insert_col);
+    // the other two matrices are in the same block
+    BandedMatrixPool::release((char*) match, matrix_bytes);
     free(seeds);
 }
 
 template <class IntType>
 void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open,
-                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf) {
+                                                         int8_t gap_extend, bool qual_adjusted, IntType min_inf,
+                                                         int64_t xdrop, int64_t& best_score,
+                                                         BandedScoringScheme scoring_scheme) {
     
 #ifdef debug_banded_aligner_fill_matrix
     cerr << "[BAMatrix::fill_matrix] beginning DP on matrix for node " << node->id() << endl;;
@@ -259,9 +592,10 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     const string& read = alignment.sequence();
     const string& base_quality = alignment.quality();
     
-    match = (IntType*) malloc(sizeof(IntType) * band_size);
-    insert_col = (IntType*) malloc(sizeof(IntType) * band_size);
-    insert_row = (IntType*) malloc(sizeof(IntType) * band_size);
+    matrix_bytes = 3 * sizeof(IntType) * band_size;
+    match = (IntType*) BandedMatrixPool::acquire(matrix_bytes);
+    insert_col = match + band_size;
+    insert_row = insert_col + band_size;
     /* these represent a band in a matrix, but we store it as a rectangle with chopped
      * corners
      *
@@ -280,6 +614,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
      * also note that the internal structure of each column is preserved and each row
      * in the rectangularized band corresponds to a diagonal in the original matrix
      *
+     * the rectangle is stored one column after another, so that the cells of a column,
+     * which are filled together, are adjacent in memory
+     *
      * the initial row and column can be reached via an implied row or column insertion
      * that is not represented in the matrix (this requires a number of edge cases)
      */
@@ -296,7 +633,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     
     // initialize with min infs (identity of max function)
     for (int64_t i = iter_start; i < iter_stop; i++) {
-        idx = i * ncols;
+        idx = i;
         match[idx] = min_inf;
         insert_col[idx] = min_inf;
         // can skip insert row since it doesn't cross node boundaries
@@ -304,7 +641,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     
     // make sure this one insert row value is there so we can use it for checking band boundaries
     // later
-    insert_row[iter_start * ncols] = min_inf;
+    insert_row[iter_start] = min_inf;
     
     // we will allow the alignment to treat this node as a source if it has no seeds or if it
     // is connected to a source node by a length 0 path (which we will check later)
@@ -331,6 +668,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
         
         int64_t seed_node_seq_len = seed->node->sequence().length();
+        int64_t seed_band_height = seed->bottom_diag - seed->top_diag + 1;
         
         if (seed_node_seq_len == 0) {
 #ifdef debug_banded_aligner_fill_matrix
@@ -363,7 +701,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         cerr << "[BAMatrix::fill_matrix]: this seed reaches diagonals " << seed_next_top_diag << " to " << seed_next_bottom_diag << " out of matrix range " << top_diag << " to " << bottom_diag << endl;
 #endif
         // special logic for first row
-        idx = (seed_next_top_diag_iter - top_diag) * ncols;
+        idx = seed_next_top_diag_iter - top_diag;
         
         IntType match_score;
         if (qual_adjusted) {
@@ -394,7 +732,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: top cell in match matrix is reachable without a lead gap" << endl;
 #endif
-            diag_idx = (seed_next_top_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            diag_idx = (seed_node_seq_len - 1) * seed_band_height + seed_next_top_diag_iter - seed_next_top_diag;
             
             match[idx] = max<IntType>(match_score + max<IntType>(max<IntType>(seed->match[diag_idx],
                                                                               seed->insert_row[diag_idx]),
@@ -405,7 +743,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: seed band is greater than height 1, can extend column gap into first row" << endl;
 #endif
-            left_idx = (seed_next_top_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+            left_idx = (seed_node_seq_len - 1) * seed_band_height + seed_next_top_diag_iter - seed_next_top_diag + 1;
             insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
                                                                      seed->insert_row[left_idx] - gap_open),
                                                         seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
@@ -413,14 +751,14 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         
         for (int64_t diag = seed_next_top_diag_iter + 1; diag < seed_next_bottom_diag_iter; diag++) {
-            idx = (diag - top_diag) * ncols;
+            idx = diag - top_diag;
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: extending a match and column gap into matrix coord (" << diag << ", 0)" << ", rectangular coord coord (" << diag - top_diag << ", 0)" << endl;
 #endif
             
             // extend a match
-            diag_idx = (diag - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            diag_idx = (seed_node_seq_len - 1) * seed_band_height + diag - seed_next_top_diag;
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[diag] + 5 * nt_table[node_seq[0]] + nt_table[read[diag]]];
             }
@@ -437,7 +775,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
                                                                  seed->insert_col[diag_idx]), match[idx]);
             
             // extend a column gap
-            left_idx = (diag - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+            left_idx = (seed_node_seq_len - 1) * seed_band_height + diag - seed_next_top_diag + 1;
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag + 1 << ", " << seed_node_seq_len - 1 << ")" << ", scores are " << (int) seed->match[left_idx] << " (M), " << (int) seed->insert_row[left_idx] << " (Ir), and " << (int) seed->insert_col[left_idx] << " (Ic), current score is " << (int) insert_col[idx] << endl;
@@ -459,8 +797,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
             
             // may only be able to extend a match on last iteration
-            idx = (seed_next_bottom_diag_iter - top_diag) * ncols;
-            diag_idx = (seed_next_bottom_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            idx = seed_next_bottom_diag_iter - top_diag;
+            diag_idx = (seed_node_seq_len - 1) * seed_band_height + seed_next_bottom_diag_iter - seed_next_top_diag;
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[seed_next_bottom_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_bottom_diag_iter]]];
             }
@@ -480,7 +818,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
                 cerr << "[BAMatrix::fill_matrix]: can also extend a column gap since already reached edge of matrix" << endl;
 #endif
-                left_idx = (seed_next_bottom_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+                left_idx = (seed_node_seq_len - 1) * seed_band_height + seed_next_bottom_diag_iter - seed_next_top_diag + 1;
                 insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
                                                                          seed->insert_row[left_idx] - gap_open),
                                                             seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
@@ -503,7 +841,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // find position of the first cell in the rectangularized band
         int64_t iter_start = -top_diag;
-        idx = iter_start * ncols;
+        idx = iter_start;
         
         // cap stop index if last diagonal is below bottom of matrix
         int64_t iter_stop = bottom_diag > (int64_t) read.length() ? band_height + (int64_t) read.length() - bottom_diag - 1 : band_height;
@@ -525,8 +863,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         insert_col[idx] = max<IntType>(-2 * gap_open, insert_col[idx]);
         
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = idx - ncols;
+            idx = i;
+            up_idx = i - 1;
             // score of a match in this cell
             IntType match_score;
             if (qual_adjusted) {
@@ -555,8 +893,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         // compute the insert row scores without any cases for lead gaps (these can be safely computed after
         // the POA iterations since they do not cross node boundaries)
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = (i - 1) * ncols;
+            idx = i;
+            up_idx = i - 1;
             
             insert_row[idx] = max<IntType>(max<IntType>(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
                                            insert_col[up_idx] - gap_open);
@@ -567,9 +905,26 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     cerr << "[BAMatrix::fill_matrix]: seeding finished, moving to subsequent columns" << endl;
 #endif
     
+    // with X-drop, once a column has nothing left the rest of the band can only be reached from lead gaps
+    bool column_alive = xdrop <= 0 || xdrop_column(0, xdrop, best_score, min_inf);
+    
+    // match scores for the interior of the current column
+    vector<IntType> column_scores(band_height);
+    
     // iterate through the rest of the columns
     for (int64_t j = 1; j < ncols; j++) {
         
+        if (!column_alive && top_diag + j > 0) {
+            // the band is past the top edge of the matrix, so there are no more lead gaps to start from
+#ifdef debug_banded_aligner_fill_matrix
+            cerr << "[BAMatrix::fill_matrix]: X-drop left nothing in column " << j - 1 << ", skipping the rest of the band" << endl;
+#endif
+            fill(match + j * band_height, match + band_size, min_inf);
+            fill(insert_col + j * band_height, insert_col + band_size, min_inf);
+            fill(insert_row + j * band_height, insert_row + band_size, min_inf);
+            break;
+        }
+        
         // are we clipping any diagonals because they are outside the range of the matrix in this column?
         bool bottom_diag_outside = bottom_diag + j >= (int64_t) read.length();
         bool top_diag_outside = top_diag + j < 0;
@@ -578,7 +933,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         int64_t iter_start = top_diag_outside ? -(top_diag + j) : 0;
         int64_t iter_stop = bottom_diag_outside ? band_height + (int64_t) read.length() - bottom_diag - j - 1 : band_height;
         
-        idx = iter_start * ncols + j;
+        idx = j * band_height + iter_start;
         
         IntType match_score;
         if (qual_adjusted) {
@@ -596,7 +951,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
         }
         else {
-            diag_idx = iter_start * ncols + (j - 1);
+            diag_idx = (j - 1) * band_height + iter_start;
             // cells should be present to do normal diagonal iteration
             match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
         }
@@ -612,7 +967,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // normal iteration along row unless band height is 1
         if (band_height != 1) {
-            int64_t left_idx = (iter_start + 1) * ncols + (j - 1);
+            int64_t left_idx = (j - 1) * band_height + iter_start + 1;
             insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
                                   insert_col[left_idx] - gap_extend);
         }
@@ -621,40 +976,56 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         }
         
         
-        for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
-            // indices of the current and previous cells in the rectangularized band
-            idx = i * ncols + j;
-            up_idx = (i - 1) * ncols + j;
-            diag_idx = i * ncols + (j - 1);
-            left_idx = (i + 1) * ncols + (j - 1);
-            
+        // fill the interior of the column with the kernel for the scoring scheme
+        int64_t interior_start = iter_start + 1;
+        int64_t interior_stop = iter_stop - 1;
+        if (interior_stop > interior_start) {
             if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                fill_band_interior<IntType>(QualAdjustedScores(score_mat, nt_table, gap_open, gap_extend, read,
+                                                               base_quality),
+                                            node_seq[j], top_diag + j, j * band_height, band_height, interior_start,
+                                            interior_stop, column_scores.data(), match, insert_row, insert_col);
             }
             else {
-                match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
+                switch (scoring_scheme) {
+                    case DefaultScoring:
+                        fill_band_interior<IntType>(DefaultScores(nt_table, read), node_seq[j], top_diag + j,
+                                                    j * band_height, band_height, interior_start, interior_stop,
+                                                    column_scores.data(), match, insert_row, insert_col);
+                        break;
+                    case DoubledDefaultScoring:
+                        fill_band_interior<IntType>(DoubledDefaultScores(nt_table, read), node_seq[j], top_diag + j,
+                                                    j * band_height, band_height, interior_start, interior_stop,
+                                                    column_scores.data(), match, insert_row, insert_col);
+                        break;
+                    case UnitScoring:
+                        fill_band_interior<IntType>(UnitScores(nt_table, read), node_seq[j], top_diag + j,
+                                                    j * band_height, band_height, interior_start, interior_stop,
+                                                    column_scores.data(), match, insert_row, insert_col);
+                        break;
+                    default:
+                        fill_band_interior<IntType>(RuntimeScores(score_mat, nt_table, gap_open, gap_extend, read),
+                                                    node_seq[j], top_diag + j, j * band_height, band_height,
+                                                    interior_start, interior_stop, column_scores.data(), match,
+                                                    insert_row, insert_col);
+                        break;
+                }
             }
-            
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
-            
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
-            
-            insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                  insert_col[left_idx] - gap_extend);
-            
+        }
+        
 #ifdef debug_banded_aligner_fill_matrix
-            cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << i + top_diag + j << " (" << read[i + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
-#endif
+        for (int64_t i = interior_start; i < interior_stop; i++) {
+            cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << i + top_diag + j << " (" << read[i + top_diag + j] << ") is " << (int) column_scores[i] << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[j * band_height + i] << endl;
         }
+#endif
         
         // stop iteration one cell early to handle logic on bottom edge of band
         
         // skip this step in edge case where read length is 1
         if (iter_stop - 1 > iter_start) {
-            idx = (iter_stop - 1) * ncols + j;
-            up_idx = (iter_stop - 2) * ncols + j;
-            diag_idx = (iter_stop - 1) * ncols + (j - 1);
+            idx = j * band_height + iter_stop - 1;
+            up_idx = j * band_height + iter_stop - 2;
+            diag_idx = (j - 1) * band_height + iter_stop - 1;
             
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[iter_stop + top_diag + j - 1] + 5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
@@ -670,7 +1041,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             
             if (bottom_diag_outside) {
                 // along the bottom edge of the matrix, so the cell to the right is still there
-                left_idx = iter_stop * ncols + (j - 1);
+                left_idx = (j - 1) * band_height + iter_stop;
                 insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
                                       insert_col[left_idx] - gap_extend);
                 
@@ -680,6 +1051,10 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
                 insert_col[idx] = min_inf;
             }
         }
+        
+        if (xdrop > 0) {
+            column_alive = xdrop_column(j, xdrop, best_score, min_inf);
+        }
     }
     
 #ifdef debug_banded_aligner_print_matrices
@@ -688,6 +1063,58 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
 }
 
+template <class IntType>
+bool BandedGlobalAligner<IntType>::BAMatrix::xdrop_column(int64_t j, int64_t xdrop, int64_t& best_score,
+                                                          IntType min_inf) {
+    
+    int64_t band_height = bottom_diag - top_diag + 1;
+    int64_t read_length = alignment.sequence().length();
+    
+    // the rows that fill_matrix fills in this column
+    int64_t iter_start = top_diag + j < 0 ? -(top_diag + j) : 0;
+    int64_t iter_stop = bottom_diag + j >= read_length ? band_height + read_length - bottom_diag - j - 1 : band_height;
+    
+    IntType* col_match = match + j * band_height;
+    IntType* col_insert_col = insert_col + j * band_height;
+    IntType* col_insert_row = insert_row + j * band_height;
+    
+    for (int64_t i = iter_start; i < iter_stop; i++) {
+        best_score = max<int64_t>(best_score, max<IntType>(max<IntType>(col_match[i], col_insert_col[i]),
+                                                           col_insert_row[i]));
+    }
+    
+    // never let a cell sit below min_inf, since the next column subtracts penalties from it
+    IntType threshold = (IntType) max<int64_t>(best_score - xdrop, min_inf);
+    
+    bool alive = false;
+    for (int64_t i = iter_start; i < iter_stop; i++) {
+        if (col_match[i] < threshold) {
+            col_match[i] = min_inf;
+        }
+        else {
+            alive = true;
+        }
+        if (col_insert_col[i] < threshold) {
+            col_insert_col[i] = min_inf;
+        }
+        else {
+            alive = true;
+        }
+        if (col_insert_row[i] < threshold) {
+            col_insert_row[i] = min_inf;
+        }
+        else {
+            alive = true;
+        }
+    }
+    
+#ifdef debug_banded_aligner_fill_matrix
+    cerr << "[BAMatrix::xdrop_column]: best score so far " << best_score << ", column " << j << " of node " << node->id() << (alive ? " has" : " does not have") << " cells within the X-drop" << endl;
+#endif
+    
+    return alive;
+}
+
 template <class IntType>
 void BandedGlobalAligner<IntType>::BAMatrix::traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat,
                                                        int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
@@ -782,7 +1209,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         }
         
         // find optimal traceback
-        idx = i * ncols + j;
+        idx = j * band_height + i;
         bool found_trace = false;
         switch (curr_mat) {
             case Match:
@@ -800,7 +1227,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = match[idx];
-                next_idx = i * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i;
                 
                 IntType match_score;
                 if (qual_adjusted) {
@@ -888,7 +1315,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = insert_row[idx];
-                next_idx = (i - 1) * ncols + j;
+                next_idx = j * band_height + i - 1;
                 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -947,7 +1374,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = insert_col[idx];
-                next_idx = (i + 1) * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i + 1;
 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -1050,6 +1477,11 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         list<BAMatrix*> seed_path;
         for (int64_t k = 0; k < num_seeds; k++) {
             
+            if (!seeds[k]) {
+                // masked seed, which would look like a stack marker below
+                continue;
+            }
+            
             list<BAMatrix*> seed_stack{seeds[k]};
             
             while (!seed_stack.empty()) {
@@ -1071,7 +1503,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                     seed_path.push_back(seed);
                     seed_stack.push_back(nullptr);
                     for (int64_t l = 0; l < seed->num_seeds; l++) {
-                        seed_stack.push_back(seed->seeds[l]);
+                        if (seed->seeds[l]) {
+                            seed_stack.push_back(seed->seeds[l]);
+                        }
                     }
                 }
             }
@@ -1203,7 +1637,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         switch (curr_mat) {
             case Match:
             {
-                curr_score = match[i * ncols];
+                curr_score = match[i];
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[i + top_diag] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag]]];
                 }
@@ -1215,7 +1649,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 
             case InsertCol:
             {
-                curr_score = insert_col[i * ncols];
+                curr_score = insert_col[i];
                 break;
             }
                 
@@ -1294,7 +1728,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
             
             int64_t seed_col = seed_ncols - 1;
             int64_t seed_row = -(seed_extended_top_diag - top_diag) + i + (curr_mat == InsertCol);
-            next_idx = seed_row * seed_ncols + seed_col;
+            next_idx = seed_col * (seed->bottom_diag - seed->top_diag + 1) + seed_row;
             
 #ifdef debug_banded_aligner_traceback
             cerr << "[BAMatrix::traceback_internal] checking seed rectangular coordinates (" << seed_row << ", " << seed_col << "), with indices calculated from current diagonal " << curr_diag << " (top diag " << top_diag << " + offset " << i << "), seed top diagonal " << seed->top_diag << ", seed seq length " << seed_ncols << " with insert column offset " << (curr_mat == InsertCol) << endl;
@@ -1670,6 +2104,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_matrix(matrix_t which_mat) {
     }
     cerr << endl;
     
+    int64_t band_height = bottom_diag - top_diag + 1;
     int64_t ncols = node_seq.length();
     
     for (int64_t i = 0; i < (int64_t) read.length(); i++) {
@@ -1680,7 +2115,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_matrix(matrix_t which_mat) {
                 cerr << "\t.";
             }
             else {
-                cerr << "\t" << (int) band_rect[(diag - top_diag) * ncols + j];
+                cerr << "\t" << (int) band_rect[j * band_height + diag - top_diag];
             }
         }
         cerr << endl;
@@ -1735,7 +2170,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_band(matrix_t which_mat) {
                 cerr << "\t.";
             }
             else {
-                cerr << "\t" << (int) band_rect[i * ncols + j];
+                cerr << "\t" << (int) band_rect[j * band_height + i];
             }
         }
         cerr << endl;
@@ -2223,7 +2658,8 @@ void BandedGlobalAligner<IntType>::shortest_seq_paths(vector<vector<int64_t>>& n
 }
 
 template <class IntType>
-void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
+void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend,
+                                         int32_t xdrop, BandedScoringScheme scoring_scheme) {
     
     // small enough number to never be accepted in alignment but also not trigger underflow
     IntType max_mismatch = numeric_limits<IntType>::max();
@@ -2231,6 +2667,22 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
         max_mismatch = min<IntType>(max_mismatch, score_mat[i]);
     }
     IntType min_inf = numeric_limits<IntType>::min() + max<IntType>((IntType) -max_mismatch, max<IntType>(gap_open, gap_extend));
+    if (xdrop > 0) {
+        // X-drop resets cells to min_inf, and a cell filled from them can pick up both a mismatch and a
+        // gap open before it is reset again, so we need room for both, at any of the read's base qualities
+        if (adjust_for_base_quality) {
+            for (char quality : alignment.quality()) {
+                for (int i = 0; i < 25; i++) {
+                    max_mismatch = min<IntType>(max_mismatch, score_mat[25 * quality + i]);
+                }
+            }
+        }
+        min_inf = numeric_limits<IntType>::min() + 2 * max<IntType>((IntType) -max_mismatch,
+                                                                    max<IntType>(gap_open, gap_extend));
+    }
+    
+    // the best cell filled so far, for X-drop (an empty alignment at the start scores 0)
+    int64_t best_score = 0;
     
     
     // fill each nodes matrix in topological order
@@ -2252,7 +2704,8 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
 #ifdef debug_banded_aligner_fill_matrix
         cerr << "[BandedGlobalAligner::align] node is not masked, filling matrix" << endl;
 #endif
-        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf);
+        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf,
+                                 xdrop, best_score, scoring_scheme);
     }
     
     traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
@@ -2406,7 +2859,7 @@ BandedGlobalAligner<IntType>::AltTracebackStack::AltTracebackStack(int64_t max_m
                 int64_t final_col = ncols - 1;
                 int64_t final_row = band_matrix->bottom_diag + ncols > read_length ? read_length - band_matrix->top_diag - ncols : band_matrix->bottom_diag - band_matrix->top_diag;
                 
-                int64_t final_idx = final_row * ncols + final_col;
+                int64_t final_idx = final_col * (band_matrix->bottom_diag - band_matrix->top_diag + 1) + final_row;
                 
                 if (band_matrix->alignment.sequence().empty()) {
                     // if the read sequence is empty then we can only insert relative to the graph
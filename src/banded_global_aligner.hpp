@@ -15,6 +15,7 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <list>
+#include <memory>
 #include <exception>
 #include "vg.pb.h"
 
@@ -32,6 +33,61 @@ namespace vg {
         static const string message;
     };
     
+    /**
+     * A per-thread pool of the memory blocks that hold the dynamic programming matrices for
+     * banded global alignment. Every alignment fills one matrix per node and throws them all
+     * away at the end, so blocks are binned by power-of-two size and handed back here to be
+     * reused by the next alignment on the same thread instead of going back to the heap.
+     */
+    class BandedMatrixPool {
+    public:
+        /// Get a block with room for at least the given number of bytes, reusing one released
+        /// on this thread if there is one in the same size class. Returns null for 0 bytes.
+        static char* acquire(size_t bytes);
+        
+        /// Give back a block that was acquired for the given number of bytes.
+        static void release(char* block, size_t bytes);
+        
+        /// Get the number of blocks waiting in this thread's pool.
+        static size_t size();
+        
+        /// Free all of the blocks in this thread's pool.
+        static void clear();
+        
+        /// Most blocks of each size class that a thread will hold on to.
+        static const size_t MAX_POOLED_BLOCKS = 256;
+        /// Blocks larger than this are freed rather than pooled, so one very long alignment
+        /// can't pin a lot of memory.
+        static const size_t MAX_POOLED_BYTES = 1 << 24;
+        
+    private:
+        /// The smallest power of two that is at least as big as the number of bytes, as an exponent
+        static size_t size_class(size_t bytes);
+        
+        thread_local static vector<vector<unique_ptr<char[]>>> free_blocks;
+    };
+    
+    /**
+     * Scoring schemes that banded global alignment has DP kernels for with the scores compiled in as
+     * constants, so they can be folded into the inner loops. Anything else, including base quality
+     * adjusted scoring, uses the score matrix and penalties it is handed.
+     */
+    enum BandedScoringScheme {
+        /// Read the scores from the score matrix and penalties
+        RuntimeScoring,
+        /// Match 1, mismatch 4, gap open 6, gap extend 1 (the Aligner defaults)
+        DefaultScoring,
+        /// Match 2, mismatch 8, gap open 12, gap extend 2 (the defaults scaled up by 2)
+        DoubledDefaultScoring,
+        /// Match 1, mismatch 1, gap open 1, gap extend 1
+        UnitScoring
+    };
+    
+    /// Get the fixed scoring scheme that a 5x5 score matrix (in the layout gssw_create_score_matrix
+    /// makes, with 0 for N) and gap penalties amount to, or RuntimeScoring if they aren't one.
+    BandedScoringScheme identify_banded_scoring_scheme(const int8_t* score_mat, int8_t gap_open,
+                                                       int8_t gap_extend);
+    
     /**
      * The outward-facing interface for banded global graph alignment. It computes optimal alignment
      * of a DNA sequence to a DAG with POA. The alignment will start at any source node in the graph and
@@ -89,7 +145,15 @@ namespace vg {
         ///              use QualAdjAligner's scaled penalty)
         ///  gap_extend  gap extension penalty from Algner (if performing base quality adjusted alignment,
         ///              use QualAdjAligner's scaled penalty)
-        void align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend);
+        ///  xdrop       if positive, abandon any cell that scores more than this below the best cell filled
+        ///              so far (X-drop), and stop filling a node once nothing is left; if that cuts off every
+        ///              path to a sink, the alignment is left without a path or score and there are no
+        ///              alternate alignments
+        ///  scoring_scheme  fixed scoring scheme that score_mat and the penalties amount to, if any (see
+        ///                  identify_banded_scoring_scheme), to fill the DP with its compiled-in kernel;
+        ///                  ignored for base quality adjusted alignment
+        void align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, int32_t xdrop = 0,
+                   BandedScoringScheme scoring_scheme = RuntimeScoring);
         
         
     private:
@@ -159,9 +223,11 @@ namespace vg {
                  BAMatrix** seeds, int64_t num_seeds, int64_t cumulative_seq_len);
         ~BAMatrix();
         
-        /// Use DP to fill the band with alignment scores
+        /// Use DP to fill the band with alignment scores. If xdrop is positive, cells more than xdrop below
+        /// best_score are set to min_inf, and best_score is updated with the best cell in this band.
         void fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
-                         IntType min_inf);
+                         IntType min_inf, int64_t xdrop, int64_t& best_score,
+                         BandedScoringScheme scoring_scheme = RuntimeScoring);
         
         /// Traceback through the band after using DP to fill it
         void traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat, int8_t* score_mat,
@@ -195,6 +261,12 @@ namespace vg {
         IntType* insert_col;
         /// DP matrix
         IntType* insert_row;
+        /// Size of the block from BandedMatrixPool that holds all three matrices
+        size_t matrix_bytes;
+        
+        /// Raise best_score to the best cell in column j, then set every cell in the column that is more than
+        /// xdrop below it to min_inf. Returns true if any cell is left.
+        bool xdrop_column(int64_t j, int64_t xdrop, int64_t& best_score, IntType min_inf);
         
         void traceback_internal(BABuilder& builder, AltTracebackStack& traceback_stack, int64_t start_row,
                                 int64_t start_col, matrix_t start_mat, bool in_lead_gap, int8_t* score_mat,
@@ -0,0 +1,90 @@
+/**
+ * \file banded_global_aligner_avx2.cpp
+ *
+ * The 256-bit band column kernels. This file is compiled with -mavx2, so it
+ * must only be entered after checking that the CPU supports AVX2. It only does
+ * whole vectors and uses nothing but intrinsics, so no inline function that
+ * could be shared with the rest of vg is ever compiled with AVX2 here.
+ */
+
+#include "banded_global_aligner_kernel.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace vg {
+
+#ifdef __AVX2__
+
+static inline __m256i load_avx2(const void* from) {
+    return _mm256_loadu_si256((const __m256i*) from);
+}
+
+int64_t fill_band_column_avx2(const int16_t* match_scores, const int16_t* left_match,
+                              const int16_t* left_insert_row, const int16_t* left_insert_col,
+                              int16_t* match, int16_t* insert_col, int64_t length,
+                              int8_t gap_open, int8_t gap_extend) {
+    const __m256i open = _mm256_set1_epi16(gap_open);
+    const __m256i extend = _mm256_set1_epi16(gap_extend);
+    int64_t k = 0;
+    for (; k + 16 <= length; k += 16) {
+        __m256i diag = _mm256_max_epi16(_mm256_max_epi16(load_avx2(left_match + k), load_avx2(left_insert_row + k)),
+                                        load_avx2(left_insert_col + k));
+        _mm256_storeu_si256((__m256i*) (match + k), _mm256_adds_epi16(load_avx2(match_scores + k), diag));
+
+        __m256i left = _mm256_max_epi16(load_avx2(left_match + k + 1), load_avx2(left_insert_row + k + 1));
+        _mm256_storeu_si256((__m256i*) (insert_col + k),
+                            _mm256_max_epi16(_mm256_subs_epi16(left, open),
+                                             _mm256_subs_epi16(load_avx2(left_insert_col + k + 1), extend)));
+    }
+    return k;
+}
+
+int64_t fill_band_column_avx2(const int8_t* match_scores, const int8_t* left_match,
+                              const int8_t* left_insert_row, const int8_t* left_insert_col,
+                              int8_t* match, int8_t* insert_col, int64_t length,
+                              int8_t gap_open, int8_t gap_extend) {
+    const __m256i open = _mm256_set1_epi8(gap_open);
+    const __m256i extend = _mm256_set1_epi8(gap_extend);
+    int64_t k = 0;
+    for (; k + 32 <= length; k += 32) {
+        __m256i diag = _mm256_max_epi8(_mm256_max_epi8(load_avx2(left_match + k), load_avx2(left_insert_row + k)),
+                                       load_avx2(left_insert_col + k));
+        _mm256_storeu_si256((__m256i*) (match + k), _mm256_adds_epi8(load_avx2(match_scores + k), diag));
+
+        __m256i left = _mm256_max_epi8(load_avx2(left_match + k + 1), load_avx2(left_insert_row + k + 1));
+        _mm256_storeu_si256((__m256i*) (insert_col + k),
+                            _mm256_max_epi8(_mm256_subs_epi8(left, open),
+                                            _mm256_subs_epi8(load_avx2(left_insert_col + k + 1), extend)));
+    }
+    return k;
+}
+
+bool fill_band_column_avx2_available() {
+    return true;
+}
+
+#else
+
+int64_t fill_band_column_avx2(const int16_t* match_scores, const int16_t* left_match,
+                              const int16_t* left_insert_row, const int16_t* left_insert_col,
+                              int16_t* match, int16_t* insert_col, int64_t length,
+                              int8_t gap_open, int8_t gap_extend) {
+    return 0;
+}
+
+int64_t fill_band_column_avx2(const int8_t* match_scores, const int8_t* left_match,
+                              const int8_t* left_insert_row, const int8_t* left_insert_col,
+                              int8_t* match, int8_t* insert_col, int64_t length,
+                              int8_t gap_open, int8_t gap_extend) {
+    return 0;
+}
+
+bool fill_band_column_avx2_available() {
+    return false;
+}
+
+#endif
+
+}
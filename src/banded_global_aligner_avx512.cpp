@@ -0,0 +1,89 @@
+/**
+ * \file banded_global_aligner_avx512.cpp
+ *
+ * The 512-bit band column kernels. This file is compiled with -mavx512bw, so
+ * it must only be entered after checking that the CPU supports AVX-512BW. Like
+ * the AVX2 kernels, it only does whole vectors and uses nothing but intrinsics.
+ */
+
+#include "banded_global_aligner_kernel.hpp"
+
+#ifdef __AVX512BW__
+#include <immintrin.h>
+#endif
+
+namespace vg {
+
+#ifdef __AVX512BW__
+
+static inline __m512i load_avx512(const void* from) {
+    return _mm512_loadu_si512(from);
+}
+
+int64_t fill_band_column_avx512(const int16_t* match_scores, const int16_t* left_match,
+                                const int16_t* left_insert_row, const int16_t* left_insert_col,
+                                int16_t* match, int16_t* insert_col, int64_t length,
+                                int8_t gap_open, int8_t gap_extend) {
+    const __m512i open = _mm512_set1_epi16(gap_open);
+    const __m512i extend = _mm512_set1_epi16(gap_extend);
+    int64_t k = 0;
+    for (; k + 32 <= length; k += 32) {
+        __m512i diag = _mm512_max_epi16(_mm512_max_epi16(load_avx512(left_match + k), load_avx512(left_insert_row + k)),
+                                        load_avx512(left_insert_col + k));
+        _mm512_storeu_si512(match + k, _mm512_adds_epi16(load_avx512(match_scores + k), diag));
+
+        __m512i left = _mm512_max_epi16(load_avx512(left_match + k + 1), load_avx512(left_insert_row + k + 1));
+        _mm512_storeu_si512(insert_col + k,
+                            _mm512_max_epi16(_mm512_subs_epi16(left, open),
+                                             _mm512_subs_epi16(load_avx512(left_insert_col + k + 1), extend)));
+    }
+    return k;
+}
+
+int64_t fill_band_column_avx512(const int8_t* match_scores, const int8_t* left_match,
+                                const int8_t* left_insert_row, const int8_t* left_insert_col,
+                                int8_t* match, int8_t* insert_col, int64_t length,
+                                int8_t gap_open, int8_t gap_extend) {
+    const __m512i open = _mm512_set1_epi8(gap_open);
+    const __m512i extend = _mm512_set1_epi8(gap_extend);
+    int64_t k = 0;
+    for (; k + 64 <= length; k += 64) {
+        __m512i diag = _mm512_max_epi8(_mm512_max_epi8(load_avx512(left_match + k), load_avx512(left_insert_row + k)),
+                                       load_avx512(left_insert_col + k));
+        _mm512_storeu_si512(match + k, _mm512_adds_epi8(load_avx512(match_scores + k), diag));
+
+        __m512i left = _mm512_max_epi8(load_avx512(left_match + k + 1), load_avx512(left_insert_row + k + 1));
+        _mm512_storeu_si512(insert_col + k,
+                            _mm512_max_epi8(_mm512_subs_epi8(left, open),
+                                            _mm512_subs_epi8(load_avx512(left_insert_col + k + 1), extend)));
+    }
+    return k;
+}
+
+bool fill_band_column_avx512_available() {
+    return true;
+}
+
+#else
+
+int64_t fill_band_column_avx512(const int16_t* match_scores, const int16_t* left_match,
+                                const int16_t* left_insert_row, const int16_t* left_insert_col,
+                                int16_t* match, int16_t* insert_col, int64_t length,
+                                int8_t gap_open, int8_t gap_extend) {
+    return 0;
+}
+
+int64_t fill_band_column_avx512(const int8_t* match_scores, const int8_t* left_match,
+                                const int8_t* left_insert_row, const int8_t* left_insert_col,
+                                int8_t* match, int8_t* insert_col, int64_t length,
+                                int8_t gap_open, int8_t gap_extend) {
+    return 0;
+}
+
+bool fill_band_column_avx512_available() {
+    return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,59 @@
+#ifndef VG_BANDED_GLOBAL_ALIGNER_KERNEL_HPP_INCLUDED
+#define VG_BANDED_GLOBAL_ALIGNER_KERNEL_HPP_INCLUDED
+
+/**
+ * \file banded_global_aligner_kernel.hpp
+ *
+ * The 256-bit and 512-bit kernels for filling the match and insert column
+ * cells of a column in the banded global aligner. They live in their own
+ * translation units compiled with -mavx2 and -mavx512bw, so this header only
+ * declares plain functions on raw arrays. They saturate at the ends of the
+ * score range like the SSE2 kernels, and only fill whole vectors, leaving the
+ * cells past the last one for the caller.
+ */
+
+#include <cstdint>
+
+namespace vg {
+
+/// Fill a run of match and insert column cells from the column to their left
+/// with AVX2. Returns how many cells from the start of the run were filled,
+/// which is 0 if this build has no AVX2 kernel.
+int64_t fill_band_column_avx2(const int16_t* match_scores, const int16_t* left_match,
+                              const int16_t* left_insert_row, const int16_t* left_insert_col,
+                              int16_t* match, int16_t* insert_col, int64_t length,
+                              int8_t gap_open, int8_t gap_extend);
+
+/// Fill a run of match and insert column cells from the column to their left
+/// with AVX2. Returns how many cells from the start of the run were filled,
+/// which is 0 if this build has no AVX2 kernel.
+int64_t fill_band_column_avx2(const int8_t* match_scores, const int8_t* left_match,
+                              const int8_t* left_insert_row, const int8_t* left_insert_col,
+                              int8_t* match, int8_t* insert_col, int64_t length,
+                              int8_t gap_open, int8_t gap_extend);
+
+/// Return true if this build has an AVX2 kernel.
+bool fill_band_column_avx2_available();
+
+/// Fill a run of match and insert column cells from the column to their left
+/// with AVX-512BW. Returns how many cells from the start of the run were
+/// filled, which is 0 if this build has no AVX-512 kernel.
+int64_t fill_band_column_avx512(const int16_t* match_scores, const int16_t* left_match,
+                                const int16_t* left_insert_row, const int16_t* left_insert_col,
+                                int16_t* match, int16_t* insert_col, int64_t length,
+                                int8_t gap_open, int8_t gap_extend);
+
+/// Fill a run of match and insert column cells from the column to their left
+/// with AVX-512BW. Returns how many cells from the start of the run were
+/// filled, which is 0 if this build has no AVX-512 kernel.
+int64_t fill_band_column_avx512(const int8_t* match_scores, const int8_t* left_match,
+                                const int8_t* left_insert_row, const int8_t* left_insert_col,
+                                int8_t* match, int8_t* insert_col, int64_t length,
+                                int8_t gap_open, int8_t gap_extend);
+
+/// Return true if this build has an AVX-512 kernel.
+bool fill_band_column_avx512_available();
+
+}
+
+#endif
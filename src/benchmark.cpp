@@ -5,6 +5,9 @@
 #include <numeric>
 #include <cmath>
 #include <iomanip>
+#include <limits>
+#include <algorithm>
+#include <sstream>
 
 /**
  * \file benchmark.hpp: implementations of benchmarking functions
@@ -52,8 +55,8 @@ ostream& operator<<(ostream& out, const BenchmarkResult& result) {
     auto initial_precision = out.precision();
     auto initial_flags = out.flags();
     
-    // Set up formatting
-    cout << setprecision(2) << scientific;
+    // Set up formatting, with enough digits to recompute the score when read back
+    out << setprecision(6) << scientific;
     
     out << result.runs;
     out << "\t";
@@ -67,7 +70,7 @@ ostream& operator<<(ostream& out, const BenchmarkResult& result) {
     out << "\t";
     
     // Scores get different formatting
-    cout << fixed;
+    out << setprecision(2) << fixed;
     
     out << result.score();
     out << "\t";
@@ -81,6 +84,45 @@ ostream& operator<<(ostream& out, const BenchmarkResult& result) {
     return out;
 }
 
+bool parse_benchmark_result(const string& line, BenchmarkResult& result) {
+    if (line.empty() || line[0] == '#') {
+        return false;
+    }
+    
+    using frac_secs = chrono::duration<double, std::micro>;
+    
+    stringstream in(line);
+    double test_mean, test_stddev, control_mean, control_stddev, score, score_error;
+    if (!(in >> result.runs >> test_mean >> test_stddev >> control_mean >> control_stddev >> score >> score_error)) {
+        return false;
+    }
+    
+    result.test_mean = chrono::duration_cast<benchtime>(frac_secs(test_mean));
+    result.test_stddev = chrono::duration_cast<benchtime>(frac_secs(test_stddev));
+    result.control_mean = chrono::duration_cast<benchtime>(frac_secs(control_mean));
+    result.control_stddev = chrono::duration_cast<benchtime>(frac_secs(control_stddev));
+    
+    // The name is everything after the last tab, and may have spaces in it
+    size_t name_start = line.rfind('\t');
+    if (name_start == string::npos) {
+        return false;
+    }
+    result.name = line.substr(name_start + 1);
+    
+    return true;
+}
+
+double benchmark_slowdown(const BenchmarkResult& baseline, const BenchmarkResult& result) {
+    // The scores are independent, so their errors add in quadrature
+    double err = sqrt(pow(baseline.score_error(), 2) + pow(result.score_error(), 2));
+    double drop = baseline.score() - result.score();
+    if (err == 0) {
+        // We can't tell how big a difference is significant
+        return drop > 0 ? numeric_limits<double>::infinity() : 0;
+    }
+    return drop / err;
+}
+
 void benchmark_control() {
     // We need to do something that takes time.
     
@@ -116,6 +158,11 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
 
 BenchmarkResult run_benchmark(const string& name, size_t iterations, const function<void(void)>& setup,
     const function<void(void)>& under_test) {
+    return run_benchmark(name, iterations, 0, setup, under_test);
+}
+
+BenchmarkResult run_benchmark(const string& name, size_t iterations, size_t warmup, const function<void(void)>& setup,
+    const function<void(void)>& under_test) {
 
     // We'll fill this in with the results of the benchmark run
     BenchmarkResult to_return;
@@ -132,6 +179,13 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
     test_samples.reserve(iterations);
     control_samples.reserve(iterations);
     
+    for (size_t i = 0; i < warmup; i++) {
+        // Run everything without timing it
+        setup();
+        under_test();
+        benchmark_control();
+    }
+    
     for (size_t i = 0; i < iterations; i++) {
         // For each iteration
         
@@ -187,6 +241,111 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
     
 }
 
+double LatencyResult::per_second() const {
+    return latencies.size() / chrono::duration_cast<chrono::duration<double>>(total).count();
+}
+
+benchtime LatencyResult::mean() const {
+    if (latencies.empty()) {
+        return benchtime::zero();
+    }
+    return total / latencies.size();
+}
+
+benchtime LatencyResult::quantile(double q) const {
+    if (latencies.empty()) {
+        return benchtime::zero();
+    }
+    // Use the nearest rank
+    size_t rank = (size_t) ceil(q * latencies.size());
+    return latencies[rank == 0 ? 0 : min(rank, latencies.size()) - 1];
+}
+
+ostream& operator<<(ostream& out, const LatencyResult& result) {
+    // Dump it as a partial TSV line
+    
+    using frac_secs = chrono::duration<double, std::micro>;
+    
+    auto initial_precision = out.precision();
+    auto initial_flags = out.flags();
+    
+    out << setprecision(2) << fixed;
+    
+    out << result.latencies.size();
+    out << "\t";
+    out << result.per_second();
+    out << "\t";
+    out << chrono::duration_cast<frac_secs>(result.mean()).count();
+    for (double q : {0.5, 0.9, 0.99, 1.0}) {
+        out << "\t";
+        out << chrono::duration_cast<frac_secs>(result.quantile(q)).count();
+    }
+    out << "\t";
+    out << result.name;
+    
+    out.precision(initial_precision);
+    out.flags(initial_flags);
+    
+    return out;
+}
+
+void write_json(ostream& out, const vector<LatencyResult>& results) {
+    using frac_secs = chrono::duration<double, std::micro>;
+    
+    auto initial_precision = out.precision();
+    auto initial_flags = out.flags();
+    
+    out << setprecision(2) << fixed;
+    
+    out << "[";
+    for (size_t i = 0; i < results.size(); i++) {
+        const LatencyResult& result = results[i];
+        
+        // Our names don't have anything in them that needs more than this
+        string name;
+        for (char c : result.name) {
+            if (c == '"' || c == '\\') {
+                name.push_back('\\');
+            }
+            name.push_back(c);
+        }
+        
+        out << (i ? "," : "") << endl;
+        out << "  {\"name\": \"" << name << "\", \"items\": " << result.latencies.size()
+            << ", \"per_second\": " << result.per_second()
+            << ", \"mean_us\": " << chrono::duration_cast<frac_secs>(result.mean()).count()
+            << ", \"p50_us\": " << chrono::duration_cast<frac_secs>(result.quantile(0.5)).count()
+            << ", \"p90_us\": " << chrono::duration_cast<frac_secs>(result.quantile(0.9)).count()
+            << ", \"p99_us\": " << chrono::duration_cast<frac_secs>(result.quantile(0.99)).count()
+            << ", \"max_us\": " << chrono::duration_cast<frac_secs>(result.quantile(1.0)).count() << "}";
+    }
+    out << endl << "]" << endl;
+    
+    out.precision(initial_precision);
+    out.flags(initial_flags);
+}
+
+LatencyResult run_latency_benchmark(const string& name, size_t items, const function<void(size_t)>& under_test) {
+    
+    LatencyResult to_return;
+    to_return.name = name;
+    to_return.latencies.reserve(items);
+    
+    for (size_t i = 0; i < items; i++) {
+        auto test_start = chrono::high_resolution_clock::now();
+        under_test(i);
+        auto test_stop = chrono::high_resolution_clock::now();
+        
+        benchtime latency = chrono::duration_cast<benchtime>(test_stop - test_start);
+        to_return.latencies.push_back(latency);
+        to_return.total += latency;
+    }
+    
+    sort(to_return.latencies.begin(), to_return.latencies.end());
+    
+    return to_return;
+}
+
 }
 
 
@@ -5,6 +5,7 @@
 #include <functional>
 #include <iostream>
 #include <string>
+#include <vector>
 
 /** 
  * \file benchmark.hpp
@@ -47,6 +48,20 @@ struct BenchmarkResult {
  */
 ostream& operator<<(ostream& out, const BenchmarkResult& result);
 
+/**
+ * Read back a benchmark result from a line written by operator<<. Times are
+ * only as precise as they were written. Returns false if the line isn't a
+ * result (like a comment line).
+ */
+bool parse_benchmark_result(const string& line, BenchmarkResult& result);
+
+/**
+ * Compare a benchmark result against a baseline result for the same
+ * benchmark. Returns how many standard errors the score has dropped by, so a
+ * positive number means the benchmark got slower relative to the control.
+ */
+double benchmark_slowdown(const BenchmarkResult& baseline, const BenchmarkResult& result);
+
 /**
  * The benchmark control function, designed to take some amount of time that might vary with CPU load.
  */
@@ -64,6 +79,50 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
  */
 BenchmarkResult run_benchmark(const string& name, size_t iterations, const function<void(void)>&  setup, const function<void(void)>& under_test);
 
+/**
+ * Run a benchmark with a setup function, after the given number of untimed
+ * warm-up runs to fill caches and let the CPU clock settle.
+ */
+BenchmarkResult run_benchmark(const string& name, size_t iterations, size_t warmup, const function<void(void)>&  setup,
+                              const function<void(void)>& under_test);
+
+/**
+ * Represents the results of a macro-benchmark run over real data, like mapping
+ * a sample of reads. Keeps the time taken by each item, so we can report the
+ * throughput and the shape of the latency distribution.
+ */
+struct LatencyResult {
+    /// What was the name of the test being run
+    string name;
+    /// How long each item took, in ascending order
+    vector<benchtime> latencies;
+    /// How long the whole run took
+    benchtime total = benchtime::zero();
+    /// How many items per second did we get through?
+    double per_second() const;
+    /// What was the mean time per item?
+    benchtime mean() const;
+    /// What was the latency at the given quantile (between 0 and 1)?
+    benchtime quantile(double q) const;
+};
+
+/**
+ * Latency results can be output to streams as TSV lines
+ */
+ostream& operator<<(ostream& out, const LatencyResult& result);
+
+/**
+ * Write a collection of latency results as a JSON array of objects, one per
+ * result, with times in microseconds.
+ */
+void write_json(ostream& out, const vector<LatencyResult>& results);
+
+/**
+ * Run the given function once on each of the given number of items, timing
+ * each run, and return a LatencyResult describing its performance.
+ */
+LatencyResult run_latency_benchmark(const string& name, size_t items, const function<void(size_t)>& under_test);
+
 
 }
 
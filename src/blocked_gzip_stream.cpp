@@ -0,0 +1,296 @@
+#include "blocked_gzip_stream.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace stream {
+
+using namespace std;
+
+/// Most uncompressed data we put in a block. Chosen by the BGZF spec so that
+/// even incompressible data fits in a block once deflated.
+static const size_t BGZF_MAX_INPUT = 0xff00;
+/// Largest a whole block, header and footer included, can be.
+static const size_t BGZF_MAX_BLOCK = 0x10000;
+/// Size of the fixed BGZF header we write.
+static const size_t BGZF_HEADER = 18;
+/// Size of the CRC32 and ISIZE footer.
+static const size_t BGZF_FOOTER = 8;
+/// The empty block that marks the end of a BGZF file.
+static const char BGZF_EOF[] = "\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43"
+    "\x02\x00\x1b\x00\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00";
+static const size_t BGZF_EOF_SIZE = 28;
+
+BlockedGzipOutputStream::BlockedGzipOutputStream(ostream& out, int compression_level) :
+    out(out), compression_level(compression_level), buffer(BGZF_MAX_INPUT, '\0') {
+    // Nothing else to do
+}
+
+BlockedGzipOutputStream::~BlockedGzipOutputStream() {
+    try {
+        Flush();
+        out.write(BGZF_EOF, BGZF_EOF_SIZE);
+    } catch (exception& e) {
+        // We can't throw from a destructor; the stream's failbit will tell
+        // anyone who checks.
+    }
+}
+
+bool BlockedGzipOutputStream::Next(void** data, int* size) {
+    if (buffered == buffer.size()) {
+        // The block is full, so send it off
+        write_block();
+    }
+    *data = &buffer[buffered];
+    *size = buffer.size() - buffered;
+    bytes_written += *size;
+    buffered = buffer.size();
+    return true;
+}
+
+void BlockedGzipOutputStream::BackUp(int count) {
+    buffered -= count;
+    bytes_written -= count;
+}
+
+::google::protobuf::int64 BlockedGzipOutputStream::ByteCount() const {
+    return bytes_written;
+}
+
+void BlockedGzipOutputStream::Flush() {
+    while (buffered > 0) {
+        write_block();
+    }
+}
+
+int64_t BlockedGzipOutputStream::Tell() const {
+    return (compressed_offset << 16) | (int64_t) buffered;
+}
+
+size_t BlockedGzipOutputStream::write_block() {
+    size_t input_size = buffered;
+    
+    char block[BGZF_MAX_BLOCK];
+    
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // Negative window bits means raw deflate; we write the gzip wrapper ourselves.
+    if (deflateInit2(&zs, compression_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw runtime_error("[stream::BlockedGzipOutputStream] could not initialize zlib");
+    }
+    zs.next_in = (Bytef*) buffer.data();
+    zs.avail_in = input_size;
+    zs.next_out = (Bytef*) block + BGZF_HEADER;
+    zs.avail_out = BGZF_MAX_BLOCK - BGZF_HEADER - BGZF_FOOTER;
+    int status = deflate(&zs, Z_FINISH);
+    size_t compressed_size = zs.total_out;
+    deflateEnd(&zs);
+    if (status != Z_STREAM_END) {
+        throw runtime_error("[stream::BlockedGzipOutputStream] block did not fit after compression");
+    }
+    
+    size_t block_size = BGZF_HEADER + compressed_size + BGZF_FOOTER;
+    
+    // gzip magic, deflate, FEXTRA, no mtime, no extra flags, unknown OS
+    const unsigned char header[12] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0};
+    memcpy(block, header, 12);
+    // The BC extra subfield holds the total block size minus 1
+    block[12] = 'B';
+    block[13] = 'C';
+    block[14] = 2;
+    block[15] = 0;
+    block[16] = (block_size - 1) & 0xff;
+    block[17] = (block_size - 1) >> 8;
+    
+    uint32_t crc = crc32(crc32(0, nullptr, 0), (const Bytef*) buffer.data(), input_size);
+    char* footer = block + BGZF_HEADER + compressed_size;
+    for (size_t i = 0; i < 4; i++) {
+        footer[i] = (crc >> (8 * i)) & 0xff;
+        footer[4 + i] = (input_size >> (8 * i)) & 0xff;
+    }
+    
+    out.write(block, block_size);
+    if (!out) {
+        throw runtime_error("[stream::BlockedGzipOutputStream] I/O error writing block");
+    }
+    compressed_offset += block_size;
+    
+    // Keep anything we didn't get to
+    memmove(&buffer[0], &buffer[input_size], buffered - input_size);
+    buffered -= input_size;
+    return input_size;
+}
+
+BlockedGzipInputStream::BlockedGzipInputStream(istream& in) : in(in) {
+    auto here = in.tellg();
+    if (here != (istream::pos_type) -1) {
+        stream_origin = here;
+    } else {
+        // We can't seek anyway
+        in.clear();
+    }
+}
+
+bool BlockedGzipInputStream::is_bgzf(istream& in) {
+    auto here = in.tellg();
+    if (here == (istream::pos_type) -1) {
+        in.clear();
+        return false;
+    }
+    unsigned char header[16];
+    in.read((char*) header, sizeof(header));
+    bool matches = in.gcount() == sizeof(header) &&
+        header[0] == 31 && header[1] == 139 && header[2] == 8 && (header[3] & 4) &&
+        (header[10] | (header[11] << 8)) >= 6 &&
+        header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+    in.clear();
+    in.seekg(here);
+    return matches;
+}
+
+bool BlockedGzipInputStream::read_block() {
+    auto malformed = []() {
+        throw runtime_error("[stream::BlockedGzipInputStream] invalid or corrupt BGZF input");
+    };
+    
+    unsigned char header[12];
+    in.read((char*) header, sizeof(header));
+    if (in.gcount() == 0) {
+        // Clean EOF
+        return false;
+    }
+    if (in.gcount() != sizeof(header) || header[0] != 31 || header[1] != 139 ||
+        header[2] != 8 || !(header[3] & 4)) {
+        malformed();
+    }
+    
+    // Find the BC subfield with the block size in the extra field
+    size_t extra_size = header[10] | (header[11] << 8);
+    string extra(extra_size, '\0');
+    in.read(&extra[0], extra_size);
+    if ((size_t) in.gcount() != extra_size) {
+        malformed();
+    }
+    size_t block_size = 0;
+    for (size_t i = 0; i + 4 <= extra_size;) {
+        size_t field_size = (unsigned char) extra[i + 2] | ((unsigned char) extra[i + 3] << 8);
+        if (extra[i] == 'B' && extra[i + 1] == 'C' && field_size == 2 && i + 6 <= extra_size) {
+            block_size = ((unsigned char) extra[i + 4] | ((unsigned char) extra[i + 5] << 8)) + 1;
+        }
+        i += 4 + field_size;
+    }
+    if (block_size < sizeof(header) + extra_size + BGZF_FOOTER) {
+        malformed();
+    }
+    
+    // Read the compressed data and footer
+    string compressed(block_size - sizeof(header) - extra_size, '\0');
+    in.read(&compressed[0], compressed.size());
+    if ((size_t) in.gcount() != compressed.size()) {
+        malformed();
+    }
+    const unsigned char* footer = (const unsigned char*) compressed.data() + compressed.size() - BGZF_FOOTER;
+    uint32_t expected_crc = 0;
+    uint32_t expected_size = 0;
+    for (size_t i = 0; i < 4; i++) {
+        expected_crc |= (uint32_t) footer[i] << (8 * i);
+        expected_size |= (uint32_t) footer[4 + i] << (8 * i);
+    }
+    if (expected_size > BGZF_MAX_BLOCK) {
+        malformed();
+    }
+    
+    block.resize(expected_size);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK) {
+        throw runtime_error("[stream::BlockedGzipInputStream] could not initialize zlib");
+    }
+    zs.next_in = (Bytef*) compressed.data();
+    zs.avail_in = compressed.size() - BGZF_FOOTER;
+    zs.next_out = (Bytef*) &block[0];
+    zs.avail_out = block.size();
+    int status = inflate(&zs, Z_FINISH);
+    size_t inflated_size = zs.total_out;
+    inflateEnd(&zs);
+    if (status != Z_STREAM_END || inflated_size != expected_size ||
+        crc32(crc32(0, nullptr, 0), (const Bytef*) block.data(), block.size()) != expected_crc) {
+        malformed();
+    }
+    
+    block_start = next_block_start;
+    next_block_start += block_size;
+    block_offset = 0;
+    return true;
+}
+
+bool BlockedGzipInputStream::Next(const void** data, int* size) {
+    while (block_offset == block.size()) {
+        // Skip over any empty blocks, like the EOF marker
+        if (!read_block()) {
+            return false;
+        }
+    }
+    *data = block.data() + block_offset;
+    *size = block.size() - block_offset;
+    bytes_read += *size;
+    block_offset = block.size();
+    return true;
+}
+
+void BlockedGzipInputStream::BackUp(int count) {
+    block_offset -= count;
+    bytes_read -= count;
+}
+
+bool BlockedGzipInputStream::Skip(int count) {
+    const void* data;
+    int size;
+    while (count > 0) {
+        if (!Next(&data, &size)) {
+            return false;
+        }
+        if (size > count) {
+            BackUp(size - count);
+            size = count;
+        }
+        count -= size;
+    }
+    return true;
+}
+
+::google::protobuf::int64 BlockedGzipInputStream::ByteCount() const {
+    return bytes_read;
+}
+
+int64_t BlockedGzipInputStream::Tell() const {
+    return (block_start << 16) | (int64_t) block_offset;
+}
+
+bool BlockedGzipInputStream::Seek(int64_t virtual_offset) {
+    int64_t compressed = virtual_offset >> 16;
+    size_t uncompressed = virtual_offset & 0xffff;
+    
+    in.clear();
+    in.seekg(stream_origin + compressed);
+    if (!in) {
+        return false;
+    }
+    next_block_start = compressed;
+    block_start = compressed;
+    block.clear();
+    block_offset = 0;
+    
+    if (!read_block()) {
+        // Seeking to the very end is fine
+        return uncompressed == 0;
+    }
+    if (uncompressed > block.size()) {
+        throw runtime_error("[stream::BlockedGzipInputStream] virtual offset past end of block");
+    }
+    block_offset = uncompressed;
+    return true;
+}
+
+}
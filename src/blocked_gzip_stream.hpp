@@ -0,0 +1,122 @@
+#ifndef VG_BLOCKED_GZIP_STREAM_HPP_INCLUDED
+#define VG_BLOCKED_GZIP_STREAM_HPP_INCLUDED
+
+/**
+ * \file blocked_gzip_stream.hpp
+ *
+ * Protobuf ZeroCopyStreams that read and write BGZF, the blocked gzip format
+ * used by BAM and tabix. A BGZF file is a series of independent gzip members
+ * of at most 64 KiB each, so it is still readable by anything that reads
+ * gzip (including stream::for_each), but it can also be seeked into using
+ * "virtual offsets": the compressed offset of a block in the high 48 bits,
+ * and an offset into the block's uncompressed data in the low 16 bits.
+ *
+ * These work directly on iostreams (including cin and cout), which htslib's
+ * BGZF API can't do, so they talk to zlib themselves. Files written here can
+ * be read by htslib and bgzip, and vice versa.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "google/protobuf/io/zero_copy_stream.h"
+
+namespace stream {
+
+/**
+ * Write BGZF to an ostream. Data is compressed a block at a time as the
+ * buffer fills. The BGZF EOF marker is written on destruction.
+ */
+class BlockedGzipOutputStream : public ::google::protobuf::io::ZeroCopyOutputStream {
+public:
+    /// Start writing BGZF to the given stream, which should be at the
+    /// beginning of the file if virtual offsets are to be meaningful.
+    BlockedGzipOutputStream(std::ostream& out, int compression_level = 6);
+    
+    /// Flush any buffered data and write the EOF marker.
+    ~BlockedGzipOutputStream();
+    
+    BlockedGzipOutputStream(const BlockedGzipOutputStream& other) = delete;
+    BlockedGzipOutputStream& operator=(const BlockedGzipOutputStream& other) = delete;
+    
+    bool Next(void** data, int* size) override;
+    void BackUp(int count) override;
+    ::google::protobuf::int64 ByteCount() const override;
+    
+    /// Compress and write out all buffered data, ending the current block.
+    /// Throws if the underlying stream fails.
+    void Flush();
+    
+    /// Get the virtual offset that the next byte written will have.
+    int64_t Tell() const;
+    
+private:
+    /// Compress and write one block from the front of the buffer. Returns the
+    /// number of buffered bytes that were consumed.
+    size_t write_block();
+    
+    std::ostream& out;
+    int compression_level;
+    /// Uncompressed data waiting to be written.
+    std::string buffer;
+    /// How much of the buffer has actually been filled.
+    size_t buffered = 0;
+    /// Compressed bytes written to the stream so far.
+    int64_t compressed_offset = 0;
+    /// Uncompressed bytes accepted and not backed up.
+    ::google::protobuf::int64 bytes_written = 0;
+};
+
+/**
+ * Read BGZF from an istream, a block at a time. Seeking requires a seekable
+ * stream.
+ */
+class BlockedGzipInputStream : public ::google::protobuf::io::ZeroCopyInputStream {
+public:
+    /// Start reading BGZF from the given stream. Virtual offsets are
+    /// relative to the stream's current position.
+    BlockedGzipInputStream(std::istream& in);
+    
+    BlockedGzipInputStream(const BlockedGzipInputStream& other) = delete;
+    BlockedGzipInputStream& operator=(const BlockedGzipInputStream& other) = delete;
+    
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    ::google::protobuf::int64 ByteCount() const override;
+    
+    /// Get the virtual offset of the next byte to be read.
+    int64_t Tell() const;
+    
+    /// Move to the given virtual offset. Returns false if the stream can't
+    /// seek there. Throws if the data there is not valid BGZF.
+    bool Seek(int64_t virtual_offset);
+    
+    /// Return true if the given seekable stream starts with a BGZF block. The
+    /// stream is left where it was.
+    static bool is_bgzf(std::istream& in);
+    
+private:
+    /// Read and inflate the next block. Returns false at EOF, and throws on
+    /// malformed data.
+    bool read_block();
+    
+    std::istream& in;
+    /// Where virtual offset 0 is in the underlying stream.
+    int64_t stream_origin = 0;
+    /// Compressed offset of the current block.
+    int64_t block_start = 0;
+    /// Compressed offset of the block after the current one.
+    int64_t next_block_start = 0;
+    /// Inflated contents of the current block.
+    std::string block;
+    /// How much of the block has been handed out.
+    size_t block_offset = 0;
+    /// Uncompressed bytes handed out and not backed up.
+    ::google::protobuf::int64 bytes_read = 0;
+};
+
+}
+
+#endif
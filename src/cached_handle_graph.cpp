@@ -0,0 +1,88 @@
+#include "cached_handle_graph.hpp"
+#include "utility.hpp"
+
+/** \file cached_handle_graph.cpp
+ * Implement the CachedHandleGraph view.
+ */
+
+namespace vg {
+
+using namespace std;
+
+CachedHandleGraph::CachedHandleGraph(const HandleGraph* super) : super(super) {
+    // Nothing to do
+}
+
+size_t CachedHandleGraph::cached_node_count() const {
+    return sequences.size();
+}
+
+void CachedHandleGraph::clear() {
+    sequences.clear();
+    right_edges.clear();
+    left_edges.clear();
+}
+
+handle_t CachedHandleGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    return super->get_handle(node_id, is_reverse);
+}
+
+id_t CachedHandleGraph::get_id(const handle_t& handle) const {
+    return super->get_id(handle);
+}
+
+bool CachedHandleGraph::get_is_reverse(const handle_t& handle) const {
+    return super->get_is_reverse(handle);
+}
+
+handle_t CachedHandleGraph::flip(const handle_t& handle) const {
+    return super->flip(handle);
+}
+
+size_t CachedHandleGraph::get_length(const handle_t& handle) const {
+    auto found = sequences.find(super->get_id(handle));
+    if (found != sequences.end()) {
+        return found->second.size();
+    }
+    return super->get_length(handle);
+}
+
+string CachedHandleGraph::get_sequence(const handle_t& handle) const {
+    id_t node_id = super->get_id(handle);
+    auto found = sequences.find(node_id);
+    if (found == sequences.end()) {
+        found = sequences.insert(make_pair(node_id, super->get_sequence(super->forward(handle)))).first;
+    }
+    return super->get_is_reverse(handle) ? reverse_complement(found->second) : found->second;
+}
+
+bool CachedHandleGraph::follow_edges(const handle_t& handle, bool go_left,
+                                     const function<bool(const handle_t&)>& iteratee) const {
+    auto& edges = go_left ? left_edges : right_edges;
+    auto found = edges.find(as_integer(handle));
+    if (found == edges.end()) {
+        vector<handle_t> nexts;
+        super->follow_edges(handle, go_left, [&](const handle_t& next) {
+            nexts.push_back(next);
+        });
+        found = edges.insert(make_pair(as_integer(handle), move(nexts))).first;
+    }
+    // Copy the handles out, since the iteratee may query us and move the table
+    vector<handle_t> nexts = found->second;
+    for (const handle_t& next : nexts) {
+        if (!iteratee(next)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CachedHandleGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    super->for_each_handle(iteratee, parallel);
+}
+
+size_t CachedHandleGraph::node_size() const {
+    return super->node_size();
+}
+
+}
@@ -0,0 +1,95 @@
+#ifndef VG_CACHED_HANDLE_GRAPH_HPP_INCLUDED
+#define VG_CACHED_HANDLE_GRAPH_HPP_INCLUDED
+
+/** \file
+ * cached_handle_graph.hpp: defines a read-only HandleGraph view of another
+ * HandleGraph that keeps every node sequence and adjacency list it has looked
+ * up, so that repeated local extractions from a succinct index only decode
+ * each part of it once.
+ */
+
+#include "handle.hpp"
+#include "hash_map.hpp"
+
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A HandleGraph that answers sequence and edge queries from a backing graph,
+ * remembering the answers. Handles are the backing graph's own handles, so
+ * anything extracted through the view has the same node IDs and orientations
+ * as it would have had from the backing graph directly.
+ *
+ * The caches are not protected by locks, so each thread should have its own
+ * view. The backing graph must outlive the view and must not change under it.
+ */
+class CachedHandleGraph : public HandleGraph {
+public:
+
+    /// Make a view of the given graph with nothing cached
+    CachedHandleGraph(const HandleGraph* super);
+
+    /// Returns the number of nodes whose sequences are cached
+    size_t cached_node_count() const;
+
+    /// Forget everything that has been cached
+    void clear();
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+
+    /// Get the ID from a handle
+    virtual id_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    virtual bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    virtual handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    virtual size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    virtual string get_sequence(const handle_t& handle) const;
+
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+
+    /// Loop over all the nodes in the backing graph. Nothing is cached.
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    /// Return the number of nodes in the backing graph
+    virtual size_t node_size() const;
+
+    using HandleGraph::get_handle;
+    using HandleGraph::follow_edges;
+    using HandleGraph::for_each_handle;
+
+private:
+
+    const HandleGraph* super;
+
+    /// Forward strand sequence of each node that has been looked up
+    mutable hash_map<id_t, string> sequences;
+
+    /// Handles reached by going right or left from each handle that has been
+    /// looked up, keyed by the handle as an integer, in the backing graph's
+    /// order
+    mutable hash_map<int64_t, vector<handle_t>> right_edges;
+    mutable hash_map<int64_t, vector<handle_t>> left_edges;
+};
+
+}
+
+#endif
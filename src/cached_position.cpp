@@ -1,14 +1,12 @@
 #include "cached_position.hpp"
+#include "xg_position.hpp"
 
 namespace vg {
 
-Node xg_cached_node(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
-    pair<Node, bool> cached = node_cache.retrieve(id);
-    if(!cached.second) {
-        cached.first = xgidx->node(id);
-        node_cache.put(id, cached.first);
-    }
-    Node& node = cached.first;
+Node xg_cached_node(id_t id, xg::XG* xgidx, SharedNodeCache& node_cache) {
+    Node node;
+    node.set_id(id);
+    node.set_sequence(*node_cache.get_sequence(id, xgidx));
     return node;
 }
 
@@ -45,24 +43,12 @@ vector<Edge> xg_cached_edges_on_end(id_t id, xg::XG* xgidx, LRUCache<id_t, vecto
     return all_edges;
 }
 
-string xg_cached_node_sequence(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
-    pair<Node, bool> cached = node_cache.retrieve(id);
-    if(!cached.second) {
-        cached.first = xgidx->node(id);
-        node_cache.put(id, cached.first);
-    }
-    Node& node = cached.first;
-    return node.sequence();
+string xg_cached_node_sequence(id_t id, xg::XG* xgidx, SharedNodeCache& node_cache) {
+    return *node_cache.get_sequence(id, xgidx);
 }
 
-size_t xg_cached_node_length(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
-    pair<Node, bool> cached = node_cache.retrieve(id);
-    if(!cached.second) {
-        cached.first = xgidx->node(id);
-        node_cache.put(id, cached.first);
-    }
-    Node& node = cached.first;
-    return node.sequence().size();
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, SharedNodeCache& node_cache) {
+    return node_cache.get_sequence(id, xgidx)->size();
 }
 
 int64_t xg_cached_node_start(id_t id, xg::XG* xgidx, LRUCache<id_t, int64_t>& node_start_cache) {
@@ -74,182 +60,57 @@ int64_t xg_cached_node_start(id_t id, xg::XG* xgidx, LRUCache<id_t, int64_t>& no
     return cached.first;
 }
 
-char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache) {
-    pair<Node, bool> cached = node_cache.retrieve(id(pos));
-    if(!cached.second) {
-        // If it's not in the cache, put it in
-        cached.first = xgidx->node(id(pos));
-        node_cache.put(id(pos), cached.first);
-    }
-    Node& node = cached.first;
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, SharedNodeCache& node_cache) {
+    auto sequence = node_cache.get_sequence(id(pos), xgidx);
     if (is_rev(pos)) {
-        /*
-        cerr << "reversed... " << endl;
-        cerr << "rev pos " << offset(reverse(pos, node.sequence().size())) << endl;
-        cerr << "seq is " << node.sequence() << " and got " <<
-            reverse_complement(node.sequence()[offset(reverse(pos, node.sequence().size()))-1]) << endl;
-        */
-        return reverse_complement(node.sequence()[offset(reverse(pos, node.sequence().size()))-1]);
+        return reverse_complement((*sequence)[offset(reverse(pos, sequence->size()))-1]);
     } else {
-        /*
-        cerr << "forward... " << endl;
-        cerr << "seq is " << node.sequence() << " and got " << node.sequence().at(offset(pos)) << endl;
-        */
-        return node.sequence().at(offset(pos));
+        return sequence->at(offset(pos));
     }
 }
 
-map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, SharedNodeCache& node_cache) {
 
     map<pos_t, char> nexts;
-    // See if the node is cached (did we just visit it?)
-    pair<Node, bool> cached = node_cache.retrieve(id(pos));
-    if(!cached.second) {
-        // If it's not in the cache, put it in
-        cached.first = xgidx->node(id(pos));
-        node_cache.put(id(pos), cached.first);
-    }
-    Node& node = cached.first;
     // if we are still in the node, return the next position and character
-    if (offset(pos) < node.sequence().size()-1) {
+    if (offset(pos) < xg_cached_node_length(id(pos), xgidx, node_cache)-1) {
         ++get_offset(pos);
         nexts[pos] = xg_cached_pos_char(pos, xgidx, node_cache);
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        pair<vector<Edge>, bool> cached = edge_cache.retrieve(id(pos));
-        if(!cached.second) {
-            // If it's not in the cache, put it in
-            for (auto& edge : xgidx->edges_of(id(pos))) {
-                cached.first.push_back(edge);
-            }
-            edge_cache.put(id(pos), cached.first);
-        }
-        auto& edges = cached.first;
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    pos_t p = make_pos_t(nid, is_inverting(edge), 0);
-                    nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    pos_t p = make_pos_t(nid, !is_inverting(edge), 0);
-                    nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
-                }
-            }
-        }
+        // look at the next positions we could reach, straight off the packed
+        // edge records, without building any Edge objects
+        xgidx->follow_edges(xgidx->get_handle(id(pos), is_rev(pos)), false, [&](const handle_t& next) {
+            pos_t p = make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0);
+            nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
+        });
     }
     return nexts;
 }
 
-set<pos_t> xg_cached_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
+set<pos_t> xg_cached_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx, SharedNodeCache& node_cache) {
     set<pos_t> nexts;
-    // See if the node is cached (did we just visit it?)
-    pair<Node, bool> cached = node_cache.retrieve(id(pos));
-    if(!cached.second) {
-        // If it's not in the cache, put it in
-        cached.first = xgidx->node(id(pos));
-        node_cache.put(id(pos), cached.first);
-    }
-    Node& node = cached.first;
     // if we are still in the node, return the next position and character
-    if (!whole_node && offset(pos) < node.sequence().size()-1) {
+    if (!whole_node && offset(pos) < xg_cached_node_length(id(pos), xgidx, node_cache)-1) {
         ++get_offset(pos);
         nexts.insert(pos);
     } else {
-        // helper
-        auto is_inverting = [](const Edge& e) {
-            return !(e.from_start() == e.to_end())
-            && (e.from_start() || e.to_end());
-        };
-        // check our cache
-        pair<vector<Edge>, bool> cached = edge_cache.retrieve(id(pos));
-        if(!cached.second) {
-            // If it's not in the cache, put it in
-            for (auto& edge : xgidx->edges_of(id(pos))) {
-                cached.first.push_back(edge);
-            }
-            edge_cache.put(id(pos), cached.first);
-        }
-        auto& edges = cached.first;
-        // look at the next positions we could reach
-        if (!is_rev(pos)) {
-            // we are on the forward strand, the next things from this node come off the end
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && edge.to_end()) || (edge.from() == id(pos) && !edge.from_start())) {
-                    id_t nid = (edge.from() == id(pos) ?
-                                edge.to()
-                                : edge.from());
-                    nexts.insert(make_pos_t(nid, is_inverting(edge), 0));
-                }
-            }
-        } else {
-            // we are on the reverse strand, the next things from this node come off the start
-            for (auto& edge : edges) {
-                if((edge.to() == id(pos) && !edge.to_end()) || (edge.from() == id(pos) && edge.from_start())) {
-                    id_t nid = (edge.to() == id(pos) ?
-                                edge.from()
-                                : edge.to());
-                    nexts.insert(make_pos_t(nid, !is_inverting(edge), 0));
-                }
-            }
-        }
+        // look at the next positions we could reach, straight off the packed
+        // edge records, without building any Edge objects
+        xgidx->follow_edges(xgidx->get_handle(id(pos), is_rev(pos)), false, [&](const handle_t& next) {
+            nexts.insert(make_pos_t(xgidx->get_id(next), xgidx->get_is_reverse(next), 0));
+        });
     }
     return nexts;
 }
 
-int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
-    //cerr << "distance from " << pos1 << " to " << pos2 << endl;
-    if (pos1 == pos2) return 0;
-    int64_t adj = (offset(pos1) == xg_cached_node_length(id(pos1), xgidx, node_cache) ? 0 : 1);
-    set<pos_t> seen;
-    set<pos_t> nexts = xg_cached_next_pos(pos1, false, xgidx, node_cache, edge_cache);
-    int64_t distance = 0;
-    while (!nexts.empty()) {
-        set<pos_t> todo;
-        for (auto& next : nexts) {
-            if (!seen.count(next)) {
-                seen.insert(next);
-                if (next == pos2) {
-                    return distance+adj;
-                }
-                // handle the edge case that we are looking for the position after the end of this node
-                if (make_pos_t(id(next), is_rev(next), offset(next)+1) == pos2) {
-                    return distance+adj+1;
-                }
-                for (auto& x : xg_cached_next_pos(next, false, xgidx, node_cache, edge_cache)) {
-                    todo.insert(x);
-                }
-            }
-        }
-        if (distance == maximum) {
-            break;
-        }
-        nexts = todo;
-        ++distance;
-    }
-    return numeric_limits<int64_t>::max();
+int64_t xg_cached_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx, SharedNodeCache& node_cache) {
+    // the node search only needs node lengths, which XG has at hand without
+    // going through the sequence cache
+    return xg_distance(pos1, pos2, maximum, xgidx);
 }
 
-set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache, LRUCache<id_t, vector<Edge> >& edge_cache) {
+set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg::XG* xgidx, SharedNodeCache& node_cache) {
     // handle base case
-    //size_t xg_cached_node_length(id_t id, xg::XG* xgidx, LRUCache<id_t, Node>& node_cache);
     if (rev) {
         pos = reverse(pos, xg_cached_node_length(id(pos), xgidx, node_cache));
     }
@@ -259,7 +120,7 @@ set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg
         //return positions;
     } else {
         set<pos_t> seen;
-        set<pos_t> nexts = xg_cached_next_pos(pos, false, xgidx, node_cache, edge_cache);
+        set<pos_t> nexts = xg_cached_next_pos(pos, false, xgidx, node_cache);
         int64_t walked = 0;
         while (!nexts.empty()) {
             if (walked+1 == distance) {
@@ -272,7 +133,7 @@ set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg
             for (auto& next : nexts) {
                 if (!seen.count(next)) {
                     seen.insert(next);
-                    for (auto& x : xg_cached_next_pos(next, false, xgidx, node_cache, edge_cache)) {
+                    for (auto& x : xg_cached_next_pos(next, false, xgidx, node_cache)) {
                         todo.insert(x);
                     }
                 }
@@ -228,4 +228,146 @@ int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids,
 
 }
 
+int64_t PathChunker::extract_gam_for_subgraph(VG& subgraph, const GAMIndex& index, istream& sorted_gam,
+                                              ostream* out_stream,
+                                              bool only_fully_contained,
+                                              bool search_all_positions) {
+
+    vector<vg::id_t> graph_ids;
+    subgraph.for_each_node([&](Node* node) {
+        graph_ids.push_back(node->id());
+    });
+
+    return extract_gam_for_ids(graph_ids, index, sorted_gam, out_stream, false,
+                               only_fully_contained, search_all_positions);
+}
+
+int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids, const GAMIndex& index, istream& sorted_gam,
+                                         ostream* out_stream,
+                                         bool contiguous,
+                                         bool only_fully_contained,
+                                         bool search_all_positions) {
+
+    // Find the runs of consecutive IDs to query
+    vector<pair<vg::id_t, vg::id_t>> ranges;
+    if (contiguous) {
+        ranges.emplace_back(graph_ids.front(), graph_ids.back());
+    } else {
+        vector<vg::id_t> sorted_ids = graph_ids;
+        std::sort(sorted_ids.begin(), sorted_ids.end());
+        for (auto id : sorted_ids) {
+            if (!ranges.empty() && id <= ranges.back().second + 1) {
+                ranges.back().second = max(ranges.back().second, id);
+            } else {
+                ranges.emplace_back(id, id);
+            }
+        }
+    }
+    auto check_id = [&](vg::id_t node_id) {
+        for (auto& range : ranges) {
+            if (node_id >= range.first && node_id <= range.second) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    vector<Alignment> gam_buffer;
+    int64_t gam_count = 0;
+    index.find(sorted_gam, ranges, [&](const Alignment& alignment) {
+        // Everything found touches the ranges. Like the rocksdb index, only
+        // take alignments whose lowest node is in them unless we're
+        // searching all positions.
+        const Path& path = alignment.path();
+        if (!search_all_positions) {
+            vg::id_t min_id = path.mapping(0).position().node_id();
+            for (size_t i = 1; i < path.mapping_size(); i++) {
+                min_id = min(min_id, path.mapping(i).position().node_id());
+            }
+            if (!check_id(min_id)) {
+                return;
+            }
+        }
+        if (only_fully_contained) {
+            for (size_t i = 0; i < path.mapping_size(); i++) {
+                if (!check_id(path.mapping(i).position().node_id())) {
+                    return;
+                }
+            }
+        }
+        gam_buffer.push_back(alignment);
+        ++gam_count;
+        stream::write_buffered(*out_stream, gam_buffer, gam_buffer_size);
+    });
+
+    // flush buffer
+    stream::write_buffered(*out_stream, gam_buffer, 0);
+
+    return gam_count;
+}
+
+vector<Region> PathChunker::snarl_balanced_regions(const Region& region, const SnarlManager& snarls,
+                                                   size_t n_chunks,
+                                                   const function<double(vg::id_t)>& node_work) {
+
+    int64_t end = min(region.end, (int64_t)xg->path_length(region.seq) - 1);
+
+    // walk the path's nodes, remembering where we are allowed to cut and how
+    // much work comes before each of those places
+    vector<int64_t> cut_positions;
+    vector<double> cut_work;
+    double total_work = 0;
+    // the top-level snarl we are inside, and the node that will take us out of it
+    const Snarl* open_snarl = nullptr;
+    vg::id_t exit_node = 0;
+    for (int64_t pos = xg->node_start_at_path_position(region.seq, region.start); pos <= end;) {
+        Mapping mapping = xg->mapping_at_path_position(region.seq, pos);
+        vg::id_t id = mapping.position().node_id();
+        bool is_reverse = mapping.position().is_reverse();
+
+        bool at_exit = open_snarl != nullptr && id == exit_node;
+        if (pos > region.start && (open_snarl == nullptr || at_exit)) {
+            cut_positions.push_back(pos);
+            cut_work.push_back(total_work);
+        }
+        if (at_exit) {
+            open_snarl = nullptr;
+        }
+        if (open_snarl == nullptr) {
+            // a boundary node in a chain closes one snarl and opens the next
+            const Snarl* snarl = snarls.into_which_snarl(id, is_reverse);
+            if (snarl != nullptr && snarls.is_root(snarl)) {
+                open_snarl = snarl;
+                bool in_at_start = snarl->start().node_id() == id && snarl->start().backward() == is_reverse;
+                exit_node = in_at_start ? snarl->end().node_id() : snarl->start().node_id();
+            }
+        }
+
+        total_work += node_work(id);
+        pos += xg->node_length(id);
+    }
+
+    // cut at the allowed places with cumulative work closest to even shares
+    vector<Region> regions;
+    Region chunk = region;
+    chunk.end = end;
+    size_t next_cut = 0;
+    for (size_t k = 1; k < n_chunks && next_cut < cut_positions.size(); ++k) {
+        double target = total_work * k / n_chunks;
+        size_t best = lower_bound(cut_work.begin() + next_cut, cut_work.end(), target) - cut_work.begin();
+        if (best == cut_work.size() ||
+            (best > next_cut && target - cut_work[best - 1] < cut_work[best] - target)) {
+            --best;
+        }
+        Region piece = chunk;
+        piece.end = cut_positions[best] - 1;
+        regions.push_back(piece);
+        chunk.start = cut_positions[best];
+        next_cut = best + 1;
+    }
+    regions.push_back(chunk);
+
+    return regions;
+}
+
 }
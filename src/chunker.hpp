@@ -11,6 +11,8 @@
 #include "json2pb.h"
 #include "region.hpp"
 #include "index.hpp"
+#include "gam_index.hpp"
+#include "snarls.hpp"
 
 namespace vg {
 
@@ -65,6 +67,31 @@ public:
                                 bool only_fully_contained = false,
                                 bool search_all_positions = false,
                                 bool unsorted_index = false);
+
+    /** Like above, but find the alignments in a sorted GAM, read from
+     * sorted_gam, with its GAMIndex. Returns the number of alignments written. */
+    int64_t extract_gam_for_subgraph(VG& subgraph, const GAMIndex& index, istream& sorted_gam,
+                                     ostream* out_stream,
+                                     bool only_fully_contained = false,
+                                     bool search_all_positions = false);
+
+    int64_t extract_gam_for_ids(vector<vg::id_t>& graph_ids, const GAMIndex& index, istream& sorted_gam,
+                                ostream* out_stream,
+                                bool contiguous_id_range = false,
+                                bool only_fully_contained = false,
+                                bool search_all_positions = false);
+
+    /** Split a (0-based inclusive) path region into up to n_chunks regions
+     * of about equal work, where the work of a chunk is the sum of
+     * node_work() over the path's node visits in it. Chunks are only cut at
+     * the start of a node that is not inside a top-level snarl, or at the
+     * start of the node that ends one (the junctions between snarls in a
+     * top-level chain), so no top-level snarl's interior is split between
+     * two chunks. Fewer chunks come back if there are not enough places to
+     * cut. */
+    vector<Region> snarl_balanced_regions(const Region& region, const SnarlManager& snarls,
+                                          size_t n_chunks,
+                                          const function<double(vg::id_t)>& node_work);
     
 };
 
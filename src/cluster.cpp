@@ -2,8 +2,11 @@
 #include <algorithm>
 #include <utility>
 #include <cstring>
+#include <unordered_set>
+#include <limits>
 
 #include "cluster.hpp"
+#include "sub_handle_graph.hpp"
 
 //#define debug_od_clusterer
 
@@ -12,6 +15,53 @@ using namespace structures;
 
 namespace vg {
     
+namespace {
+
+/// A segment tree over a fixed number of slots, which finds the slot with
+/// the greatest value in a range of slots
+class RangeMaxTree {
+public:
+    RangeMaxTree(size_t slots) : leaves(1) {
+        while (leaves < slots) {
+            leaves *= 2;
+        }
+        tree.assign(2 * leaves, empty());
+    }
+    
+    /// Set the value in a slot, or clear it with empty()
+    void set(size_t slot, pair<double, size_t> value) {
+        size_t i = slot + leaves;
+        tree[i] = value;
+        for (i /= 2; i > 0; i /= 2) {
+            tree[i] = max(tree[2 * i], tree[2 * i + 1]);
+        }
+    }
+    
+    /// Get the greatest value, and the slot it is in, among the slots in [begin, end)
+    pair<double, size_t> query(size_t begin, size_t end) const {
+        pair<double, size_t> best = empty();
+        for (size_t lo = begin + leaves, hi = end + leaves; lo < hi; lo /= 2, hi /= 2) {
+            if (lo & 1) {
+                best = max(best, tree[lo++]);
+            }
+            if (hi & 1) {
+                best = max(best, tree[--hi]);
+            }
+        }
+        return best;
+    }
+    
+    static pair<double, size_t> empty() {
+        return make_pair(-numeric_limits<double>::infinity(), numeric_limits<size_t>::max());
+    }
+    
+private:
+    size_t leaves;
+    vector<pair<double, size_t>> tree;
+};
+
+}
+
 MEMChainModel::MEMChainModel(
     const vector<size_t>& aln_lengths,
     const vector<vector<MaximalExactMatch> >& matches,
@@ -21,6 +71,123 @@ MEMChainModel::MEMChainModel(
     int band_width,
     int position_depth,
     int max_connections) {
+    add_vertices(matches, approx_position, path_position, band_width, position_depth);
+    // now build up the model using the positional bandwidth
+    set<pair<vector<MEMChainModelVertex>::iterator, vector<MEMChainModelVertex>::iterator> > seen;
+    for (map<string, map<int64_t, vector<vector<MEMChainModelVertex>::iterator> > >::iterator c = positions.begin(); c != positions.end(); ++c) {
+        for (map<int64_t, vector<vector<MEMChainModelVertex>::iterator> >::iterator p = c->second.begin(); p != c->second.end(); ++p) {
+            for (auto& v1 : p->second) {
+                // For each vertex...
+                if (redundant_vertexes.count(v1)) continue;
+                // ...that isn't redundant
+                auto q = p;
+                while (++q != c->second.end() && abs(p->first - q->first) < band_width) {
+                    for (auto& v2 : q->second) {
+                        // For each other vertex...
+                    
+                        if (redundant_vertexes.count(v2)) continue;
+                        // ...that isn't redudnant
+                    
+                        // if this is an allowable transition, run the weighting function on it
+                        if (!seen.count(make_pair(v1, v2))
+                            && v1->next_cost.size() < max_connections
+                            && v2->prev_cost.size() < max_connections) {
+                            // There are not too many connections yet
+                            seen.insert(make_pair(v1, v2));
+                            if (v1->mem.fragment < v2->mem.fragment
+                                || v1->mem.fragment == v2->mem.fragment && v1->mem.begin < v2->mem.begin) {
+                                // Transition is allowable because the first comes before the second
+                            
+                                double weight = transition_weight(v1->mem, v2->mem);
+                                if (weight > -std::numeric_limits<double>::max()) {
+                                    v1->next_cost.push_back(make_pair(&*v2, weight));
+                                    v2->prev_cost.push_back(make_pair(&*v1, weight));
+                                }
+                            } else if (v1->mem.fragment > v2->mem.fragment
+                                       || v1->mem.fragment == v2->mem.fragment && v1->mem.begin > v2->mem.begin) {
+                                // Really we want to think about the transition going the other way
+                            
+                                double weight = transition_weight(v2->mem, v1->mem);
+                                if (weight > -std::numeric_limits<double>::max()) {
+                                    v2->next_cost.push_back(make_pair(&*v1, weight));
+                                    v1->prev_cost.push_back(make_pair(&*v2, weight));
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+MEMChainModel::MEMChainModel(
+    const vector<size_t>& aln_lengths,
+    const vector<vector<MaximalExactMatch> >& matches,
+    const function<int64_t(pos_t)>& approx_position,
+    const function<map<string, vector<pair<size_t, bool> > >(pos_t)>& path_position,
+    double gap_open,
+    double gap_extension,
+    int band_width,
+    int position_depth) :
+    sparse(true), sparse_gap_open(gap_open), sparse_gap_extension(gap_extension), sparse_band_width(band_width) {
+    add_vertices(matches, approx_position, path_position, band_width, position_depth);
+    
+    // measure read offsets from the first MEM of each fragment
+    map<int, string::const_iterator> fragment_starts;
+    for (auto& v : model) {
+        auto start = fragment_starts.find(v.mem.fragment);
+        if (start == fragment_starts.end()) {
+            fragment_starts[v.mem.fragment] = v.mem.begin;
+        } else if (v.mem.begin < start->second) {
+            start->second = v.mem.begin;
+        }
+    }
+    
+    // group the anchors by fragment and strand, in read order
+    vector<pair<pair<int, bool>, SparseAnchor>> grouped;
+    grouped.reserve(model.size());
+    for (vector<MEMChainModelVertex>::iterator v = model.begin(); v != model.end(); ++v) {
+        if (redundant_vertexes.count(v)) continue;
+        pos_t pos = make_pos_t(v->mem.nodes.front());
+        int64_t read_offset = v->mem.begin - fragment_starts[v->mem.fragment];
+        int64_t graph_position = approx_position(pos);
+        if (is_rev(pos)) {
+            graph_position = -graph_position;
+        }
+        grouped.emplace_back(make_pair(v->mem.fragment, is_rev(pos)),
+                             SparseAnchor{&*v, read_offset, graph_position - read_offset});
+    }
+    std::stable_sort(grouped.begin(), grouped.end(), [](const pair<pair<int, bool>, SparseAnchor>& a,
+                                                        const pair<pair<int, bool>, SparseAnchor>& b) {
+        return a.first < b.first || (a.first == b.first && a.second.read_offset < b.second.read_offset);
+    });
+    for (size_t i = 0; i < grouped.size(); i++) {
+        if (i == 0 || grouped[i].first != grouped[i - 1].first) {
+            sparse_groups.push_back(i);
+        }
+        sparse_anchors.push_back(grouped[i].second);
+    }
+    sparse_groups.push_back(sparse_anchors.size());
+}
+
+void MEMChainModel::add_vertices(const vector<vector<MaximalExactMatch> >& matches,
+                                 const function<int64_t(pos_t)>& approx_position,
+                                 const function<map<string, vector<pair<size_t, bool> > >(pos_t)>& path_position,
+                                 int band_width,
+                                 int position_depth) {
+    // size the model up front so we allocate its vertices all at once
+    size_t total_hits = 0;
+    for (auto& fragment : matches) {
+        for (auto& mem : fragment) {
+            total_hits += mem.nodes.size();
+        }
+    }
+    model.reserve(total_hits);
+    // the positions along paths are only worth their lookup when they can tie
+    // the fragments of a pair together; single reads chain on approximate
+    // positions alone
+    bool use_path_positions = matches.size() > 1;
     // store the MEMs in the model
     int frag_n = 0;
     for (auto& fragment : matches) {
@@ -29,21 +196,21 @@ MEMChainModel::MEMChainModel(
             // copy the MEM for each specific hit in the base graph
             // and add it in as a vertex
             for (auto& node : mem.nodes) {
-                //model.emplace_back();
-                //auto m = model.back();
                 auto pos = make_pos_t(node);
-                MEMChainModelVertex m;
-                m.mem = mem;
+                model.emplace_back();
+                MEMChainModelVertex& m = model.back();
+                // copy everything but the hits, which would be thrown away
+                m.mem = MaximalExactMatch(mem.begin, mem.end, mem.range, mem.match_count);
+                m.mem.primary = mem.primary;
                 m.weight = mem.length();
                 m.prev = nullptr;
                 m.score = 0;
-                m.mem.positions = path_position(pos);
+                if (use_path_positions) {
+                    m.mem.positions = path_position(pos);
+                }
                 m.mem.positions[""].push_back(make_pair(approx_position(pos), is_rev(pos)));
-                m.mem.nodes.clear();
                 m.mem.nodes.push_back(node);
                 m.mem.fragment = frag_n;
-                m.mem.match_count = mem.match_count;
-                model.push_back(m);
             }
         }
     }
@@ -114,56 +281,13 @@ MEMChainModel::MEMChainModel(
             }
         }
     }
-    // now build up the model using the positional bandwidth
-    set<pair<vector<MEMChainModelVertex>::iterator, vector<MEMChainModelVertex>::iterator> > seen;
-    for (map<string, map<int64_t, vector<vector<MEMChainModelVertex>::iterator> > >::iterator c = positions.begin(); c != positions.end(); ++c) {
-        for (map<int64_t, vector<vector<MEMChainModelVertex>::iterator> >::iterator p = c->second.begin(); p != c->second.end(); ++p) {
-            for (auto& v1 : p->second) {
-                // For each vertex...
-                if (redundant_vertexes.count(v1)) continue;
-                // ...that isn't redundant
-                auto q = p;
-                while (++q != c->second.end() && abs(p->first - q->first) < band_width) {
-                    for (auto& v2 : q->second) {
-                        // For each other vertex...
-                    
-                        if (redundant_vertexes.count(v2)) continue;
-                        // ...that isn't redudnant
-                    
-                        // if this is an allowable transition, run the weighting function on it
-                        if (!seen.count(make_pair(v1, v2))
-                            && v1->next_cost.size() < max_connections
-                            && v2->prev_cost.size() < max_connections) {
-                            // There are not too many connections yet
-                            seen.insert(make_pair(v1, v2));
-                            if (v1->mem.fragment < v2->mem.fragment
-                                || v1->mem.fragment == v2->mem.fragment && v1->mem.begin < v2->mem.begin) {
-                                // Transition is allowable because the first comes before the second
-                            
-                                double weight = transition_weight(v1->mem, v2->mem);
-                                if (weight > -std::numeric_limits<double>::max()) {
-                                    v1->next_cost.push_back(make_pair(&*v2, weight));
-                                    v2->prev_cost.push_back(make_pair(&*v1, weight));
-                                }
-                            } else if (v1->mem.fragment > v2->mem.fragment
-                                       || v1->mem.fragment == v2->mem.fragment && v1->mem.begin > v2->mem.begin) {
-                                // Really we want to think about the transition going the other way
-                            
-                                double weight = transition_weight(v2->mem, v1->mem);
-                                if (weight > -std::numeric_limits<double>::max()) {
-                                    v2->next_cost.push_back(make_pair(&*v1, weight));
-                                    v1->prev_cost.push_back(make_pair(&*v2, weight));
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
 }
 
 void MEMChainModel::score(const unordered_set<MEMChainModelVertex*>& exclude) {
+    if (sparse) {
+        score_sparse(exclude);
+        return;
+    }
     // propagate the scores in the model
     for (auto& m : model) {
         // score is equal to the max inbound + mem.weight
@@ -180,6 +304,81 @@ void MEMChainModel::score(const unordered_set<MEMChainModelVertex*>& exclude) {
     }
 }
 
+void MEMChainModel::score_sparse(const unordered_set<MEMChainModelVertex*>& exclude) {
+    for (size_t g = 0; g + 1 < sparse_groups.size(); g++) {
+        size_t group_begin = sparse_groups[g];
+        size_t group_size = sparse_groups[g + 1] - group_begin;
+        const SparseAnchor* anchors = &sparse_anchors[group_begin];
+        
+        // give each anchor a slot in diagonal order
+        vector<size_t> by_diagonal(group_size);
+        for (size_t i = 0; i < group_size; i++) {
+            by_diagonal[i] = i;
+        }
+        std::sort(by_diagonal.begin(), by_diagonal.end(), [&](size_t a, size_t b) {
+            return anchors[a].diagonal < anchors[b].diagonal || (anchors[a].diagonal == anchors[b].diagonal && a < b);
+        });
+        vector<size_t> slot(group_size);
+        vector<int64_t> slot_diagonals(group_size);
+        for (size_t i = 0; i < group_size; i++) {
+            slot[by_diagonal[i]] = i;
+            slot_diagonals[i] = anchors[by_diagonal[i]].diagonal;
+        }
+        
+        // split the gap cost by the direction of the diagonal change: from a
+        // lower diagonal it is score + gap_extension * diagonal, less
+        // gap_extension times our diagonal, and from a higher one it is
+        // score - gap_extension * diagonal, plus gap_extension times ours
+        RangeMaxTree from_below(group_size);
+        RangeMaxTree from_above(group_size);
+        
+        // anchors in [window_begin, window_end) start earlier in the read and
+        // within the band, and are available as predecessors
+        size_t window_begin = 0;
+        size_t window_end = 0;
+        for (size_t i = 0; i < group_size; i++) {
+            const SparseAnchor& anchor = anchors[i];
+            while (window_end < i && anchors[window_end].read_offset < anchor.read_offset) {
+                const SparseAnchor& added = anchors[window_end];
+                if (!exclude.count(added.vertex)) {
+                    from_below.set(slot[window_end], make_pair(added.vertex->score + sparse_gap_extension * added.diagonal, window_end));
+                    from_above.set(slot[window_end], make_pair(added.vertex->score - sparse_gap_extension * added.diagonal, window_end));
+                }
+                window_end++;
+            }
+            while (window_begin < window_end && anchor.read_offset - anchors[window_begin].read_offset > sparse_band_width) {
+                from_below.set(slot[window_begin], RangeMaxTree::empty());
+                from_above.set(slot[window_begin], RangeMaxTree::empty());
+                window_begin++;
+            }
+            
+            if (exclude.count(anchor.vertex)) continue;
+            anchor.vertex->score = anchor.vertex->weight;
+            anchor.vertex->prev = nullptr;
+            
+            // find the slots of the diagonals in the band below, at, and above ours
+            size_t low = lower_bound(slot_diagonals.begin(), slot_diagonals.end(), anchor.diagonal - sparse_band_width) - slot_diagonals.begin();
+            size_t same = lower_bound(slot_diagonals.begin(), slot_diagonals.end(), anchor.diagonal) - slot_diagonals.begin();
+            size_t above = upper_bound(slot_diagonals.begin(), slot_diagonals.end(), anchor.diagonal) - slot_diagonals.begin();
+            size_t high = upper_bound(slot_diagonals.begin(), slot_diagonals.end(), anchor.diagonal + sparse_band_width) - slot_diagonals.begin();
+            
+            double diagonal_cost = sparse_gap_extension * anchor.diagonal;
+            pair<double, size_t> best = from_below.query(same, above);
+            best.first -= diagonal_cost;
+            pair<double, size_t> below = from_below.query(low, same);
+            below.first -= diagonal_cost + sparse_gap_open;
+            pair<double, size_t> over = from_above.query(above, high);
+            over.first += diagonal_cost - sparse_gap_open;
+            best = max(best, max(below, over));
+            
+            if (best.second != numeric_limits<size_t>::max() && best.first > 0) {
+                anchor.vertex->score += best.first;
+                anchor.vertex->prev = anchors[best.second].vertex;
+            }
+        }
+    }
+}
+
 MEMChainModelVertex* MEMChainModel::max_vertex(void) {
     MEMChainModelVertex* maxv = nullptr;
     for (auto& m : model) {
@@ -248,7 +447,8 @@ vector<vector<MaximalExactMatch> > MEMChainModel::traceback(int alt_alns, bool p
         auto& mem_trace = traces.back();
         for (auto v = vertex_trace.rbegin(); v != vertex_trace.rend(); ++v) {
             auto& vertex = **v;
-            if (!paired) exclude.insert(&vertex);
+            // sparse models have no transitions to mask, so don't reuse hits at all
+            if (!paired || sparse) exclude.insert(&vertex);
             if (v != vertex_trace.rbegin()) {
                 auto y = v - 1;
                 MEMChainModelVertex* prev = *y;
@@ -389,11 +589,12 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      size_t max_expected_dist_approx_error,
                                                      size_t min_mem_length,
                                                      bool unstranded,
-                                                     paths_of_node_memo_t* paths_of_node_memo,
-                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) :
+                                                     xg::XGQueryContext* xg_context,
+                                                     bool sweep_clustering,
+                                                     const SnarlDistanceIndex* distance_index) :
     OrientedDistanceClusterer(alignment, mems, nullptr, &aligner, xgindex, max_expected_dist_approx_error,
-                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo) {
+                              min_mem_length, unstranded, xg_context,
+                              sweep_clustering, distance_index) {
     // nothing else to do
 }
 
@@ -404,11 +605,12 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      size_t max_expected_dist_approx_error,
                                                      size_t min_mem_length,
                                                      bool unstranded,
-                                                     paths_of_node_memo_t* paths_of_node_memo,
-                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) :
+                                                     xg::XGQueryContext* xg_context,
+                                                     bool sweep_clustering,
+                                                     const SnarlDistanceIndex* distance_index) :
     OrientedDistanceClusterer(alignment, mems, &aligner, nullptr, xgindex, max_expected_dist_approx_error,
-                              min_mem_length, unstranded, paths_of_node_memo, oriented_occurences_memo, handle_memo) {
+                              min_mem_length, unstranded, xg_context,
+                              sweep_clustering, distance_index) {
     // nothing else to do
 }
 
@@ -420,9 +622,9 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
                                                      size_t max_expected_dist_approx_error,
                                                      size_t min_mem_length,
                                                      bool unstranded,
-                                                     paths_of_node_memo_t* paths_of_node_memo,
-                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                     handle_memo_t* handle_memo) : aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
+                                                     xg::XGQueryContext* xg_context,
+                                                     bool sweep_clustering,
+                                                     const SnarlDistanceIndex* distance_index) : aligner(aligner), qual_adj_aligner(qual_adj_aligner) {
     
     // there generally will be at least as many nodes as MEMs, so we can speed up the reallocation
     nodes.reserve(mems.size());
@@ -455,7 +657,7 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
         cerr << "adding nodes for MEM " << mem << endl;
 #endif
         for (gcsa::node_type mem_hit : mem.nodes) {
-            nodes.emplace_back(mem, make_pos_t(mem_hit), mem_score);
+            nodes.emplace_back(mem, mem_hit, mem_score);
 #ifdef debug_od_clusterer
             cerr << "\t" << nodes.size() - 1 << ": " << make_pos_t(mem_hit) << endl;
 #endif
@@ -466,14 +668,19 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
     // nodes that we know are on a consistent strand.
     unordered_map<pair<size_t, size_t>, int64_t> recorded_finite_dists = get_on_strand_distance_tree(nodes.size(), unstranded, xgindex,
                                                                                                      [&](size_t node_number) {
-                                                                                                         return nodes[node_number].start_pos;
+                                                                                                         return nodes[node_number].start_pos();
                                                                                                      },
                                                                                                      [&](size_t node_number) {
                                                                                                          return 0;
                                                                                                      },
-                                                                                                     paths_of_node_memo,
-                                                                                                     oriented_occurences_memo,
-                                                                                                     handle_memo);
+                                                                                                     xg_context,
+                                                                                                     sweep_clustering,
+                                                                                                     &num_distance_probes,
+                                                                                                     distance_index);
+    
+#ifdef debug_od_clusterer
+    cerr << "measured " << num_distance_probes << " distances between " << nodes.size() << " hits" << endl;
+#endif
     
     // Flatten the trees to maps of relative position by node ID.
     vector<unordered_map<size_t, int64_t>> strand_relative_position = flatten_distance_tree(nodes.size(), recorded_finite_dists);
@@ -636,9 +843,10 @@ OrientedDistanceClusterer::OrientedDistanceClusterer(const Alignment& alignment,
 unordered_map<pair<size_t, size_t>, int64_t> OrientedDistanceClusterer::get_on_strand_distance_tree(size_t num_items, bool unstranded, xg::XG* xgindex,
                                                                                                     const function<pos_t(size_t)>& get_position,
                                                                                                     const function<int64_t(size_t)>& get_offset,
-                                                                                                    paths_of_node_memo_t* paths_of_node_memo,
-                                                                                                    oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                                    handle_memo_t* handle_memo) {
+                                                                                                    xg::XGQueryContext* xg_context,
+                                                                                                    bool sweep,
+                                                                                                    size_t* num_distance_probes,
+                                                                                                    const SnarlDistanceIndex* distance_index) {
     
     // for recording the distance of any pair that we check with a finite distance
     unordered_map<pair<size_t, size_t>, int64_t> recorded_finite_dists;
@@ -654,25 +862,41 @@ unordered_map<pair<size_t, size_t>, int64_t> OrientedDistanceClusterer::get_on_s
     
     int64_t max_failed_distance_probes = 2;
     
+    // count how many distances we estimate, since that's where the time goes
+    size_t probes = 0;
+    
     // an initial pass that only looks at nodes on path
     if (unstranded) {
-        extend_dist_tree_by_path_buckets(max_failed_distance_probes, num_possible_merges_remaining,component_union_find, recorded_finite_dists,
-                                         num_infinite_dists, num_items, xgindex, get_position, get_offset, paths_of_node_memo, oriented_occurences_memo,
-                                         handle_memo);
+        extend_dist_tree_by_path_buckets(max_failed_distance_probes, probes, num_possible_merges_remaining,component_union_find, recorded_finite_dists,
+                                         num_infinite_dists, num_items, xgindex, get_position, get_offset, xg_context);
     }
     else {
-        extend_dist_tree_by_strand_buckets(max_failed_distance_probes, num_possible_merges_remaining,component_union_find, recorded_finite_dists,
-                                           num_infinite_dists, num_items, xgindex, get_position, get_offset, paths_of_node_memo, oriented_occurences_memo,
-                                           handle_memo);
+        extend_dist_tree_by_strand_buckets(max_failed_distance_probes, probes, num_possible_merges_remaining,component_union_find, recorded_finite_dists,
+                                           num_infinite_dists, num_items, xgindex, get_position, get_offset, xg_context, distance_index);
+    }
+    
+    size_t max_permutation_probes = numeric_limits<size_t>::max();
+    if (sweep) {
+        // join up the nearby hits that weren't on a shared path strand using their approximate positions
+        // TODO: magic numbers
+        extend_dist_tree_by_sweep(50, 4, 1000, probes, num_possible_merges_remaining, component_union_find, recorded_finite_dists,
+                                  unstranded, num_items, xgindex, get_position, get_offset, xg_context, distance_index);
+        
+        // only spend about as many probes as there are items on the random pairs
+        max_permutation_probes = num_items;
     }
     
     // TODO: permutations that try to assign singletons
     
     // a second pass that tries fill in the tree by traversing to the nearest shared path
     size_t nlogn = ceil(num_items * log(num_items));
-    extend_dist_tree_by_permutations(max_failed_distance_probes, 50, nlogn, num_possible_merges_remaining, component_union_find,
-                                     recorded_finite_dists, num_infinite_dists, unstranded, num_items, xgindex, get_position, get_offset, paths_of_node_memo,
-                                     oriented_occurences_memo, handle_memo);
+    extend_dist_tree_by_permutations(max_failed_distance_probes, 50, nlogn, max_permutation_probes, probes, num_possible_merges_remaining,
+                                     component_union_find, recorded_finite_dists, num_infinite_dists, unstranded, num_items, xgindex,
+                                     get_position, get_offset, xg_context, distance_index);
+    
+    if (num_distance_probes) {
+        *num_distance_probes = probes;
+    }
     
     return recorded_finite_dists;
 }
@@ -685,7 +909,7 @@ void OrientedDistanceClusterer::exclude_dist_tree_merges_by_components(int64_t m
                                                                        xg::XG* xgindex,
                                                                        const function<pos_t(size_t)>& get_position,
                                                                        const function<int64_t(size_t)>& get_offset,
-                                                                       paths_of_node_memo_t* paths_of_node_memo) {
+                                                                       xg::XGQueryContext* xg_context) {
     
     
 #ifdef debug_od_clusterer
@@ -717,7 +941,7 @@ void OrientedDistanceClusterer::exclude_dist_tree_merges_by_components(int64_t m
         // check if these two hits are on a path that is on a separate component
         if (i_idx < i_group.size()) {
             id_t i_node_id = neighbors_on_paths.count(i_group[i_idx]) ? neighbors_on_paths[i_group[i_idx]] : id(get_position(i_group[i_idx]));
-            size_t i_path = paths_of_node_memo->at(i_node_id).front();
+            size_t i_path = xg_context->paths_of_node(i_node_id).front();
             
             for (size_t j = 0; j < i; j++) {
                 // find the first member of the 'j' group that is on a path or associated with a neighbor on a path
@@ -732,7 +956,7 @@ void OrientedDistanceClusterer::exclude_dist_tree_merges_by_components(int64_t m
                     cerr << "checking for shared component using strand cluster representatives " << get_position(i_group[i_idx]) << " and " << get_position(j_group[j_idx]) << endl;
 #endif
                     size_t j_node_id = neighbors_on_paths.count(j_group[j_idx]) ? neighbors_on_paths[j_group[j_idx]] : id(get_position(j_group[j_idx]));
-                    size_t j_path = paths_of_node_memo->at(j_node_id).front();
+                    size_t j_path = xg_context->paths_of_node(j_node_id).front();
                     
                     if (!xgindex->paths_on_same_component(i_path, j_path)) {
                         // these hits are associated with strands that are on separated components of the graph
@@ -755,7 +979,25 @@ void OrientedDistanceClusterer::exclude_dist_tree_merges_by_components(int64_t m
     }
 }
     
+int64_t OrientedDistanceClusterer::oriented_distance(const pos_t& pos_1, const pos_t& pos_2, int64_t max_search_distance_to_path,
+                                                     xg::XG* xgindex, xg::XGQueryContext* xg_context,
+                                                     const SnarlDistanceIndex* distance_index) {
+    if (distance_index) {
+        // the index measures one way, so look both ways and take the nearer, with the
+        // sign saying which way it was
+        int64_t forward = distance_index->min_distance(pos_1, pos_2);
+        int64_t backward = distance_index->min_distance(pos_2, pos_1);
+        if (forward != SnarlDistanceIndex::UNKNOWN && backward != SnarlDistanceIndex::UNKNOWN) {
+            return forward <= backward ? forward : -backward;
+        }
+    }
+    return xgindex->closest_shared_path_oriented_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
+                                                          id(pos_2), offset(pos_2), is_rev(pos_2), false,
+                                                          max_search_distance_to_path, xg_context);
+}
+
 void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_failed_distance_probes,
+                                                                 size_t& num_distance_probes,
                                                                  size_t& num_possible_merges_remaining,
                                                                  UnionFind& component_union_find,
                                                                  unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
@@ -764,33 +1006,23 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
                                                                  xg::XG* xgindex,
                                                                  const function<pos_t(size_t)>& get_position,
                                                                  const function<int64_t(size_t)>& get_offset,
-                                                                 paths_of_node_memo_t* paths_of_node_memo,
-                                                                 oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                 handle_memo_t* handle_memo) {
+                                                                 xg::XGQueryContext* xg_context) {
     
 #ifdef debug_od_clusterer
     cerr << "using paths to bucket distance comparisons" << endl;
 #endif
     
-    if (!paths_of_node_memo) {
+    if (!xg_context) {
         return;
     }
     
-    // enter which paths occur on the nodes of each hit into the memo
-    for (size_t i = 0; i < num_items; i++) {
-        pos_t pos = get_position(i);
-        if (!paths_of_node_memo->count(id(pos))) {
-            (*paths_of_node_memo)[id(pos)] = xgindex->paths_of_node(id(pos));
-        }
-    }
-    
-    // reverse the memo so that it tells us which hits occur on a strand of a path and identify hits with no paths
+    // reverse the cached paths of the hits' nodes so that it tells us which hits occur on a strand of a path and identify hits with no paths
     unordered_map<size_t, vector<size_t>> items_on_path;
     // record which hits aren't on a path and associate them with their nearest neighbor's node ID
     unordered_map<size_t, id_t> non_path_hits;
     for (size_t i = 0; i < num_items; i++) {
         pos_t pos = get_position(i);
-        vector<size_t>& paths = paths_of_node_memo->at(id(pos));
+        auto paths = xg_context->paths_of_node(id(pos));
         if (paths.empty()) {
             // just add a sentinel for now
             non_path_hits[i] = 0;
@@ -803,21 +1035,20 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
     }
     
     // check the nearest nodes to each singleton to see if we can use it to bucket the item
+    vector<handle_t> neighbors;
     for (pair<const size_t, id_t>& non_path_hit : non_path_hits) {
         pos_t pos = get_position(non_path_hit.first);
-        handle_t handle = xgindex->memoized_get_handle(id(pos), is_rev(pos), handle_memo);
+        handle_t handle = xg_context->get_handle(id(pos), is_rev(pos));
         size_t right_dist = xgindex->get_length(handle) - offset(pos);
         size_t trav_dist = min(offset(pos), right_dist);
         // TODO: magic number (matches the distance used in the permutations step)
         if (trav_dist <= 50) {
             bool go_left = offset(pos) < right_dist;
-            function<bool(const handle_t&)> bucket_using_neighbors = [&](const handle_t& handle) {
-                id_t neighbor_id = xgindex->get_id(handle);
-                bool neighbor_rev = xgindex->get_is_reverse(handle);
-                if (!paths_of_node_memo->count(neighbor_id)) {
-                    (*paths_of_node_memo)[neighbor_id] = xgindex->paths_of_node(neighbor_id);
-                }
-                auto& neighbor_paths = paths_of_node_memo->at(neighbor_id);
+            xgindex->get_neighbors(handle, go_left, neighbors);
+            for (const handle_t& neighbor : neighbors) {
+                id_t neighbor_id = xgindex->get_id(neighbor);
+                bool neighbor_rev = xgindex->get_is_reverse(neighbor);
+                auto neighbor_paths = xg_context->paths_of_node(neighbor_id);
                 for (size_t path : neighbor_paths) {
                     items_on_path[path].push_back(non_path_hit.first);
                 }
@@ -825,9 +1056,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
                 if (!neighbor_paths.empty()) {
                     non_path_hit.second = neighbor_id;
                 }
-                return true;
-            };
-            xgindex->follow_edges(handle, go_left, bucket_using_neighbors);
+            }
         }
     }
     
@@ -877,9 +1106,10 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
             cerr << "measuring distance between " << prev << " at " << pos_prev << " and " << here << " at " << pos_here << endl;
 #endif
             
+            num_distance_probes++;
             int64_t dist = xgindex->closest_shared_path_unstranded_distance(id(pos_prev), offset(pos_prev), is_rev(pos_prev),
                                                                             id(pos_here), offset(pos_here), is_rev(pos_here),
-                                                                            50, paths_of_node_memo, oriented_occurences_memo, handle_memo);
+                                                                            50, xg_context);
             
             
             // did we get a successful estimation?
@@ -905,10 +1135,11 @@ void OrientedDistanceClusterer::extend_dist_tree_by_path_buckets(int64_t max_fai
     }
     
     exclude_dist_tree_merges_by_components(max_failed_distance_probes, num_possible_merges_remaining, component_union_find, num_infinite_dists,
-                                           non_path_hits, xgindex, get_position, get_offset, paths_of_node_memo);
+                                           non_path_hits, xgindex, get_position, get_offset, xg_context);
 }
     
 void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_failed_distance_probes,
+                                                                   size_t& num_distance_probes,
                                                                    size_t& num_possible_merges_remaining,
                                                                    UnionFind& component_union_find,
                                                                    unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
@@ -917,10 +1148,9 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
                                                                    xg::XG* xgindex,
                                                                    const function<pos_t(size_t)>& get_position,
                                                                    const function<int64_t(size_t)>& get_offset,
-                                                                   paths_of_node_memo_t* paths_of_node_memo,
-                                                                   oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                   handle_memo_t* handle_memo) {
-    if (!paths_of_node_memo || !oriented_occurences_memo) {
+                                                                   xg::XGQueryContext* xg_context,
+                                                                   const SnarlDistanceIndex* distance_index) {
+    if (!xg_context) {
         return;
     }
     
@@ -928,47 +1158,20 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
     cerr << "using strands to bucket distance comparisons" << endl;
 #endif
     
-    // enter which paths occur on the nodes of each hit into the memo
-    for (size_t i = 0; i < num_items; i++) {
-        pos_t pos = get_position(i);
-#ifdef debug_od_clusterer
-        cerr << "adding position " << pos << " to memo" << endl;
-#endif
-
-        if (!paths_of_node_memo->count(id(pos))) {
-            (*paths_of_node_memo)[id(pos)] = xgindex->paths_of_node(id(pos));
-        }
-        for (size_t path : paths_of_node_memo->at(id(pos))) {
-            if (!oriented_occurences_memo->count(make_pair(id(pos), path))) {
-                (*oriented_occurences_memo)[make_pair(id(pos), path)] = xgindex->oriented_occurrences_on_path(id(pos), path);
-#ifdef debug_od_clusterer
-                cerr << "node " << id(pos) << " has occurrences on path " << path << ":" << endl;
-                for (auto occurrence : (*oriented_occurences_memo)[make_pair(id(pos), path)]) {
-                    cerr << "\t" << occurrence.first << " " << (occurrence.second ? "rev" : "fwd") << endl;
-                }
-#endif
-            }
-        }
-    }
-    
-#ifdef debug_od_clusterer
-    cerr << "reversing node to strand memo" << endl;
-#endif
-    
-    // reverse the memo so that it tells us which hits occur on a strand of a path and identify hits with no paths
+    // reverse the cached paths of the hits' nodes so that it tells us which hits occur on a strand of a path and identify hits with no paths
     unordered_map<pair<size_t, bool>, vector<size_t>> items_on_path_strand;
     // record which hits aren't on a path and associate them with their nearest neighbor's node ID
     unordered_map<size_t, id_t> non_path_hits;
     for (size_t i = 0; i < num_items; i++) {
         pos_t pos = get_position(i);
-        vector<size_t>& paths = paths_of_node_memo->at(id(pos));
+        auto paths = xg_context->paths_of_node(id(pos));
         if (paths.empty()) {
             // just add a sentinel for now
             non_path_hits[i] = 0;
         }
         else {
             for (size_t path : paths) {
-                for (pair<size_t, bool> oriented_occurrence : oriented_occurences_memo->at(make_pair(id(pos), path))) {
+                for (pair<size_t, bool> oriented_occurrence : xg_context->oriented_occurrences_on_path(id(pos), path)) {
 #ifdef debug_od_clusterer
                     cerr << "position " << pos << " is on strand " << path << (oriented_occurrence.second != is_rev(pos) ? "-" : "+") << endl;
 #endif
@@ -979,23 +1182,22 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
     }
     
     // check the nearest nodes to each singleton to see if we can use it to bucket the item
+    vector<handle_t> neighbors;
     for (pair<const size_t, id_t>& non_path_hit : non_path_hits) {
         pos_t pos = get_position(non_path_hit.first);
-        handle_t handle = xgindex->memoized_get_handle(id(pos), is_rev(pos), handle_memo);
+        handle_t handle = xg_context->get_handle(id(pos), is_rev(pos));
         size_t right_dist = xgindex->get_length(handle) - offset(pos);
         size_t trav_dist = min(offset(pos), right_dist);
         // TODO: magic number (matches the distance used in the permutations step)
         if (trav_dist <= 50) {
             bool go_left = offset(pos) < right_dist;
-            function<bool(const handle_t&)> bucket_using_neighbors = [&](const handle_t& handle) {
-                id_t neighbor_id = xgindex->get_id(handle);
-                bool neighbor_rev = xgindex->get_is_reverse(handle);
-                if (!paths_of_node_memo->count(neighbor_id)) {
-                    (*paths_of_node_memo)[neighbor_id] = xgindex->paths_of_node(neighbor_id);
-                }
-                auto& neighbor_paths = paths_of_node_memo->at(neighbor_id);
+            xgindex->get_neighbors(handle, go_left, neighbors);
+            for (const handle_t& neighbor : neighbors) {
+                id_t neighbor_id = xgindex->get_id(neighbor);
+                bool neighbor_rev = xgindex->get_is_reverse(neighbor);
+                auto neighbor_paths = xg_context->paths_of_node(neighbor_id);
                 for (size_t path : neighbor_paths) {
-                    for (pair<size_t, bool>& node_occurence : xgindex->memoized_oriented_occurrences_on_path(neighbor_id, path, oriented_occurences_memo)) {
+                    for (const pair<size_t, bool>& node_occurence : xg_context->oriented_occurrences_on_path(neighbor_id, path)) {
 #ifdef debug_od_clusterer
                         cerr << "position " << pos << " has neighbor " << neighbor_id << " on strand " << path  << (node_occurence.second != neighbor_rev ? "-" : "+") << endl;
 #endif
@@ -1006,9 +1208,7 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
                 if (!neighbor_paths.empty()) {
                     non_path_hit.second = neighbor_id;
                 }
-                return true;
-            };
-            xgindex->follow_edges(handle, go_left, bucket_using_neighbors);
+            }
         }
     }
     
@@ -1057,9 +1257,8 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
             cerr << "measuring distance between " << prev << " at " << pos_prev << " and " << here << " at " << pos_here << endl;
 #endif
             
-            int64_t dist = xgindex->closest_shared_path_oriented_distance(id(pos_prev), offset(pos_prev), is_rev(pos_prev),
-                                                                          id(pos_here), offset(pos_here), is_rev(pos_here),
-                                                                          false, 50, paths_of_node_memo, oriented_occurences_memo, handle_memo);
+            num_distance_probes++;
+            int64_t dist = oriented_distance(pos_prev, pos_here, 50, xgindex, xg_context, distance_index);
             
             
             // did we get a successful estimation?
@@ -1085,12 +1284,106 @@ void OrientedDistanceClusterer::extend_dist_tree_by_strand_buckets(int64_t max_f
     }
     
     exclude_dist_tree_merges_by_components(max_failed_distance_probes, num_possible_merges_remaining, component_union_find, num_infinite_dists,
-                                           non_path_hits, xgindex, get_position, get_offset, paths_of_node_memo);
+                                           non_path_hits, xgindex, get_position, get_offset, xg_context);
+}
+    
+void OrientedDistanceClusterer::extend_dist_tree_by_sweep(int64_t max_search_distance_to_path,
+                                                          size_t sweep_width,
+                                                          int64_t max_sweep_gap,
+                                                          size_t& num_distance_probes,
+                                                          size_t& num_possible_merges_remaining,
+                                                          UnionFind& component_union_find,
+                                                          unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
+                                                          bool unstranded,
+                                                          size_t num_items,
+                                                          xg::XG* xgindex,
+                                                          const function<pos_t(size_t)>& get_position,
+                                                          const function<int64_t(size_t)>& get_offset,
+                                                          xg::XGQueryContext* xg_context,
+                                                          const SnarlDistanceIndex* distance_index) {
+    
+#ifdef debug_od_clusterer
+    cerr << "using approximate positions to sweep for distance comparisons" << endl;
+#endif
+    
+    // the position of each item in the sequence vector, pushed back to where the start of
+    // the read would be, separated by orientation unless we don't care about strand
+    vector<vector<pair<int64_t, size_t>>> sweep_orders(unstranded ? 1 : 2);
+    for (size_t i = 0; i < num_items; i++) {
+        pos_t pos = get_position(i);
+        int64_t node_start = xgindex->node_start(id(pos));
+        if (is_rev(pos)) {
+            int64_t approx_pos = node_start + xgindex->node_length(id(pos)) - offset(pos) + get_offset(i);
+            sweep_orders[unstranded ? 0 : 1].emplace_back(approx_pos, i);
+        }
+        else {
+            sweep_orders[0].emplace_back(node_start + offset(pos) - get_offset(i), i);
+        }
+    }
+    
+    for (vector<pair<int64_t, size_t>>& sweep_order : sweep_orders) {
+        sort(sweep_order.begin(), sweep_order.end());
+        
+        size_t bucket_end = 0;
+        for (size_t i = 0; i < sweep_order.size(); i++) {
+            // find the end of the bucket this item is in
+            if (bucket_end <= i) {
+                bucket_end = i + 1;
+                while (bucket_end < sweep_order.size()
+                       && sweep_order[bucket_end].first - sweep_order[bucket_end - 1].first <= max_sweep_gap) {
+                    bucket_end++;
+                }
+            }
+            
+            size_t here = sweep_order[i].second;
+            for (size_t j = i + 1; j < bucket_end && j <= i + sweep_width; j++) {
+                size_t next = sweep_order[j].second;
+                
+                // have these items already been identified as on the same strand?
+                if (component_union_find.find_group(here) == component_union_find.find_group(next)) {
+                    continue;
+                }
+                
+                pos_t pos_here = get_position(here);
+                pos_t pos_next = get_position(next);
+                
+                num_distance_probes++;
+                int64_t dist;
+                if (unstranded) {
+                    dist = xgindex->closest_shared_path_unstranded_distance(id(pos_here), offset(pos_here), is_rev(pos_here),
+                                                                            id(pos_next), offset(pos_next), is_rev(pos_next),
+                                                                            max_search_distance_to_path, xg_context);
+                }
+                else {
+                    dist = oriented_distance(pos_here, pos_next, max_search_distance_to_path, xgindex, xg_context, distance_index);
+                }
+                
+#ifdef debug_od_clusterer
+                cerr << "distance between " << pos_here << " and " << pos_next << " estimated at " << dist << endl;
+#endif
+                
+                if (dist == numeric_limits<int64_t>::max()) {
+                    // leave the failures for the permutation pass to count
+                    continue;
+                }
+                
+                // add the fixed offset from the hit position
+                dist += get_offset(next) - get_offset(here);
+                
+                // merge them into a strand cluster
+                recorded_finite_dists[make_pair(here, next)] = dist;
+                num_possible_merges_remaining -= component_union_find.group_size(here) * component_union_find.group_size(next);
+                component_union_find.union_groups(here, next);
+            }
+        }
+    }
 }
     
 void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_failed_distance_probes,
                                                                  int64_t max_search_distance_to_path,
                                                                  size_t decrement_frequency,
+                                                                 size_t max_distance_probes,
+                                                                 size_t& num_distance_probes,
                                                                  size_t& num_possible_merges_remaining,
                                                                  UnionFind& component_union_find,
                                                                  unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
@@ -1100,9 +1393,8 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
                                                                  xg::XG* xgindex,
                                                                  const function<pos_t(size_t)>& get_position,
                                                                  const function<int64_t(size_t)>& get_offset,
-                                                                 paths_of_node_memo_t* paths_of_node_memo,
-                                                                 oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                 handle_memo_t* handle_memo) {
+                                                                 xg::XGQueryContext* xg_context,
+                                                                 const SnarlDistanceIndex* distance_index) {
     
     // We want to run through all possible pairsets of node numbers in a permuted order.
     ShuffledPairs shuffled_pairs(num_items);
@@ -1113,7 +1405,11 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
     // to be connected with probability approaching 1
     size_t current_max_num_probes = max_failed_distance_probes;
     
-    while (num_possible_merges_remaining > 0 && current_pair != shuffled_pairs.end() && current_max_num_probes > 0) {
+    // the number of distances we've estimated in this pass
+    size_t probes_made = 0;
+    
+    while (num_possible_merges_remaining > 0 && current_pair != shuffled_pairs.end() && current_max_num_probes > 0
+           && probes_made < max_distance_probes) {
         // slowly lower the number of distances we need to check before we believe that two clusters are on
         // separate strands
 #ifdef debug_od_clusterer
@@ -1174,18 +1470,17 @@ void OrientedDistanceClusterer::extend_dist_tree_by_permutations(int64_t max_fai
         const pos_t& pos_1 = get_position(node_pair.first);
         const pos_t& pos_2 = get_position(node_pair.second);
         
+        probes_made++;
+        num_distance_probes++;
+        
         int64_t oriented_dist;
         if (unstranded) {
             oriented_dist = xgindex->closest_shared_path_unstranded_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
                                                                              id(pos_2), offset(pos_2), is_rev(pos_2),
-                                                                             max_search_distance_to_path, paths_of_node_memo,
-                                                                             oriented_occurences_memo, handle_memo);
+                                                                             max_search_distance_to_path, xg_context);
         }
         else {
-            oriented_dist = xgindex->closest_shared_path_oriented_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
-                                                                           id(pos_2), offset(pos_2), is_rev(pos_2), false,
-                                                                           max_search_distance_to_path, paths_of_node_memo,
-                                                                           oriented_occurences_memo, handle_memo);
+            oriented_dist = oriented_distance(pos_1, pos_2, max_search_distance_to_path, xgindex, xg_context, distance_index);
         }
         
 #ifdef debug_od_clusterer
@@ -1788,7 +2083,7 @@ vector<OrientedDistanceClusterer::cluster_t> OrientedDistanceClusterer::clusters
         vector<size_t>& component = components[i];
         cerr << "\tcomponent " << i << ":" << endl;
         for (size_t idx : component) {
-            cerr << "\t\t" << idx << " " << nodes[idx].start_pos << " ";
+            cerr << "\t\t" << idx << " " << nodes[idx].start_pos() << " ";
             for (auto iter = nodes[idx].mem->begin; iter != nodes[idx].mem->end; iter++) {
                 cerr << *iter;
             }
@@ -1903,7 +2198,7 @@ vector<OrientedDistanceClusterer::cluster_t> OrientedDistanceClusterer::clusters
         auto& cluster = to_return.back();
         for (size_t traced_idx : stacked) {
             ODNode& node = nodes[traced_idx];
-            cluster.emplace_back(node.mem, node.start_pos);
+            cluster.emplace_back(node.mem, node.start_pos());
         }
         
         // put the cluster in order by read position
@@ -1926,9 +2221,8 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                                                                                      int64_t min_inter_cluster_distance,
                                                                                      int64_t max_inter_cluster_distance,
                                                                                      bool unstranded,
-                                                                                     paths_of_node_memo_t* paths_of_node_memo,
-                                                                                     oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                     handle_memo_t* handle_memo) {
+                                                                                     xg::XGQueryContext* xg_context,
+                                                                                     const SnarlDistanceIndex* distance_index) {
     
 #ifdef debug_od_clusterer
     cerr << "beginning clustering of MEM cluster pairs for " << left_clusters.size() << " left clusters and " << right_clusters.size() << " right clusters" << endl;
@@ -1988,7 +2282,7 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                  return alignment_2.sequence().end() - right_clusters[alt_anchor.first]->at(alt_anchor.second).first->begin;
              }
          },
-         paths_of_node_memo, oriented_occurences_memo, handle_memo);
+         xg_context, false, nullptr, distance_index);
     
     // Flatten the distance tree to a set of linear spaces, one per tree.
     vector<unordered_map<size_t, int64_t>> linear_spaces = flatten_distance_tree(total_cluster_positions, distance_tree);
@@ -2304,7 +2598,7 @@ void OrientedDistanceClusterer::prune_low_scoring_edges(vector<vector<size_t>>&
         strm << "splitting cluster:" << endl;
         for (auto& comp : new_components) {
             for (size_t i : comp) {
-                strm << "\t" << i << " " << nodes[i].mem->sequence() << " " << nodes[i].start_pos << endl;
+                strm << "\t" << i << " " << nodes[i].mem->sequence() << " " << nodes[i].start_pos() << endl;
             }
             strm << endl;
         }
@@ -2534,6 +2828,36 @@ vector<pair<gcsa::node_type, size_t> > mem_node_start_positions(const xg::XG& xg
     return positions;
 }
 
+/// Add the nodes that XG::graph_context_id would reach walking forward from
+/// pos, a layer of next nodes at a time, until it has gone length bases
+static void add_graph_context(const xg::XG& xg, SubHandleGraph& subgraph, const pos_t& pos, int64_t length) {
+    unordered_set<handle_t> seen;
+    vector<handle_t> nexts(1, xg.get_handle(id(pos), is_rev(pos)));
+    // the start is only the same as a later visit to its node at offset 0
+    bool at_start = true;
+    int64_t distance = -offset(pos); // don't count what we won't traverse
+    while (!nexts.empty()) {
+        unordered_set<handle_t> todo;
+        int64_t nextd = 0;
+        for (auto& next : nexts) {
+            if (at_start || seen.insert(next).second) {
+                subgraph.add_handle(next);
+                int64_t node_length = xg.get_length(next);
+                nextd = nextd == 0 ? node_length : min(nextd, node_length);
+                xg.follow_edges(next, false, [&](const handle_t& after) {
+                        todo.insert(after);
+                    });
+            }
+        }
+        at_start = false;
+        distance += nextd;
+        if (distance > length) {
+            break;
+        }
+        nexts.assign(todo.begin(), todo.end());
+    }
+}
+
 Graph cluster_subgraph_walk(const xg::XG& xg, const Alignment& aln, const vector<vg::MaximalExactMatch>& mems, double expansion) {
     assert(mems.size());
     auto& start_mem = mems.front();
@@ -2542,12 +2866,13 @@ Graph cluster_subgraph_walk(const xg::XG& xg, const Alignment& aln, const vector
     // Even if the MEM is right up against the start of the read, it may not be
     // part of the best alignment. Make sure to have some padding.
     // TODO: how much padding?
-    Graph graph;
+    // Collect the nodes over the XG handles and only copy them out once at the end.
+    SubHandleGraph subgraph(&xg);
     int inside_padding = max(1, (int)aln.sequence().size()/16);
     int end_padding = max(8, (int)aln.sequence().size()/8);
     int get_before = end_padding + (int)(expansion * (int)(start_mem.begin - aln.sequence().begin()));
     if (get_before) {
-        graph.MergeFrom(xg.graph_context_id(rev_start_pos, get_before));
+        add_graph_context(xg, subgraph, rev_start_pos, get_before);
     }
     //cerr << "======================================================" << endl;
     for (int i = 0; i < mems.size(); ++i) {
@@ -2559,7 +2884,7 @@ Graph cluster_subgraph_walk(const xg::XG& xg, const Alignment& aln, const vector
             match_positions.push_back(make_pair(mem.nodes.front(), mem.length()));
         }
         for (auto& p : match_positions) {
-            graph.MergeFrom(xg.node_subgraph_id(gcsa::Node::id(p.first)));
+            subgraph.add_handle(xg.get_handle(gcsa::Node::id(p.first), false));
         }
         // extend after the last match node with the expansion
         auto& p = match_positions.back();
@@ -2573,10 +2898,13 @@ Graph cluster_subgraph_walk(const xg::XG& xg, const Alignment& aln, const vector
                :
                inside_padding +
                expansion * ((int)(mems[i+1].begin - mem.end) + mem_remainder));
-        if (get_after > 0) graph.MergeFrom(xg.graph_context_id(make_pos_t(pos), get_after));
+        if (get_after > 0) add_graph_context(xg, subgraph, make_pos_t(pos), get_after);
     }
-    xg.expand_context(graph, 1, false);
-    sort_by_id_dedup_and_clean(graph);
+    // The walks brought in every edge of the nodes they visited, and expanding
+    // that by one step adds the neighbors of the far ends too, so take two steps.
+    subgraph.expand_context(2);
+    Graph graph;
+    subgraph.to_graph(graph);
     return graph;
 }
 
@@ -2588,11 +2916,11 @@ Graph cluster_subgraph(const xg::XG& xg, const Alignment& aln, const vector<vg::
     // Even if the MEM is right up against the start of the read, it may not be
     // part of the best alignment. Make sure to have some padding.
     // TODO: how much padding?
-    Graph graph;
+    SubHandleGraph subgraph(&xg);
     int padding = 1;
     int get_before = padding + (int)(expansion * (int)(start_mem.begin - aln.sequence().begin()));
     if (get_before) {
-        graph.MergeFrom(xg.graph_context_id(rev_start_pos, get_before));
+        add_graph_context(xg, subgraph, rev_start_pos, get_before);
     }
     for (int i = 0; i < mems.size(); ++i) {
         auto& mem = mems[i];
@@ -2600,9 +2928,10 @@ Graph cluster_subgraph(const xg::XG& xg, const Alignment& aln, const vector<vg::
         int get_after = padding + (i+1 == mems.size() ?
                                    expansion * (int)(aln.sequence().end() - mem.begin)
                                    : expansion * max(mem.length(), (int)(mems[i+1].end - mem.begin)));
-        graph.MergeFrom(xg.graph_context_id(pos, get_after));
+        add_graph_context(xg, subgraph, pos, get_after);
     }
-    sort_by_id_dedup_and_clean(graph);
+    Graph graph;
+    subgraph.to_graph(graph);
     return graph;
 }
 
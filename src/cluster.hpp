@@ -10,6 +10,7 @@
 #include "mem.hpp"
 #include "xg.hpp"
 #include "handle.hpp"
+#include "snarl_distance_index.hpp"
 
 #include <functional>
 #include <string>
@@ -142,11 +143,64 @@ public:
         int band_width = 10,
         int position_depth = 1,
         int max_connections = 20);
+    /// Make a model that chains the hits sparsely. Instead of linking every
+    /// pair of hits in the band and weighting each link with a function, each
+    /// hit finds its best predecessor with range maximum queries over the
+    /// diagonals (approximate graph position minus read position) of the hits
+    /// before it in the read, so scoring takes O(n log n) time in the number
+    /// of hits. Hits chain if they are in the same fragment and orientation,
+    /// start within band_width of each other in the read, and lie on diagonals
+    /// within band_width of each other. Changing diagonal costs gap_open plus
+    /// gap_extension per base.
+    MEMChainModel(
+        const vector<size_t>& aln_lengths,
+        const vector<vector<MaximalExactMatch> >& matches,
+        const function<int64_t(pos_t)>& approx_position,
+        const function<map<string, vector<pair<size_t, bool> > >(pos_t)>& path_position,
+        double gap_open,
+        double gap_extension,
+        int band_width = 10,
+        int position_depth = 1);
     void score(const unordered_set<MEMChainModelVertex*>& exclude);
     MEMChainModelVertex* max_vertex(void);
+    /// Get up to alt_alns chains, best first. In a sparse model, hits are
+    /// never reused between chains, whether or not the reads are paired.
     vector<vector<MaximalExactMatch> > traceback(int alt_alns, bool paired, bool debug);
     void display(ostream& out);
     void clear_scores(void);
+    
+private:
+    /// Make a vertex for each hit of each MEM, index them by position, and
+    /// mark the ones that are redundant with a longer MEM's hit. Positions
+    /// along paths are only looked up when there is more than one fragment.
+    void add_vertices(const vector<vector<MaximalExactMatch> >& matches,
+                      const function<int64_t(pos_t)>& approx_position,
+                      const function<map<string, vector<pair<size_t, bool> > >(pos_t)>& path_position,
+                      int band_width,
+                      int position_depth);
+    
+    /// Score the model using range maximum queries instead of links.
+    void score_sparse(const unordered_set<MEMChainModelVertex*>& exclude);
+    
+    /// A hit that a sparse model can chain
+    struct SparseAnchor {
+        MEMChainModelVertex* vertex;
+        /// Where the MEM starts in its read
+        int64_t read_offset;
+        /// Approximate graph position, negated on the reverse strand so that
+        /// it increases along the read, minus the read offset
+        int64_t diagonal;
+    };
+    
+    bool sparse = false;
+    double sparse_gap_open = 0;
+    double sparse_gap_extension = 0;
+    int64_t sparse_band_width = 0;
+    /// The hits that aren't redundant, grouped by fragment and orientation,
+    /// and ordered by read offset within each group
+    vector<SparseAnchor> sparse_anchors;
+    /// Where each group starts in sparse_anchors, with an extra entry for the end
+    vector<size_t> sparse_groups;
 };
     
 class OrientedDistanceClusterer {
@@ -159,16 +213,8 @@ public:
     /// Each cluster is a vector of hits.
     using cluster_t = vector<hit_t>;
     
-    /// A memo for the results of XG::paths_of_node
-    using paths_of_node_memo_t = unordered_map<id_t, vector<size_t>>;
-    
-    /// A memo for the results of XG::oriented_occurrences_on_path
-    using oriented_occurences_memo_t = unordered_map<pair<id_t, size_t>, vector<pair<size_t, bool>>>;
-    
-    /// A memo for the results of XG::get_handle
-    using handle_memo_t = unordered_map<pair<int64_t, bool>, handle_t>;
-    
-    /// Constructor using QualAdjAligner, optionally memoizing succinct data structure operations
+    /// Constructor using QualAdjAligner, optionally caching succinct data structure queries in an XG query context
+    /// and looking distances up in a distance index
     OrientedDistanceClusterer(const Alignment& alignment,
                               const vector<MaximalExactMatch>& mems,
                               const QualAdjAligner& aligner,
@@ -176,11 +222,12 @@ public:
                               size_t max_expected_dist_approx_error = 8,
                               size_t min_mem_length = 1,
                               bool unstranded = false,
-                              paths_of_node_memo_t* paths_of_node_memo = nullptr,
-                              oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                              handle_memo_t* handle_memo = nullptr);
+                              xg::XGQueryContext* xg_context = nullptr,
+                              bool sweep_clustering = false,
+                              const SnarlDistanceIndex* distance_index = nullptr);
     
-    /// Constructor using Aligner, optionally memoizing succinct data structure operations
+    /// Constructor using Aligner, optionally caching succinct data structure queries in an XG query context
+    /// and looking distances up in a distance index
     OrientedDistanceClusterer(const Alignment& alignment,
                               const vector<MaximalExactMatch>& mems,
                               const Aligner& aligner,
@@ -188,9 +235,9 @@ public:
                               size_t max_expected_dist_approx_error = 8,
                               size_t min_mem_length = 1,
                               bool unstranded = false,
-                              paths_of_node_memo_t* paths_of_node_memo = nullptr,
-                              oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                              handle_memo_t* handle_memo = nullptr);
+                              xg::XGQueryContext* xg_context = nullptr,
+                              bool sweep_clustering = false,
+                              const SnarlDistanceIndex* distance_index = nullptr);
     
     /// Returns a vector of clusters. Each cluster is represented a vector of MEM hits. Each hit
     /// contains a pointer to the original MEM and the position of that particular hit in the graph.
@@ -215,9 +262,12 @@ public:
                                                                      int64_t min_inter_cluster_distance,
                                                                      int64_t max_inter_cluster_distance,
                                                                      bool unstranded,
-                                                                     paths_of_node_memo_t* paths_of_node_memo = nullptr,
-                                                                     oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                                                                     handle_memo_t* handle_memo = nullptr);
+                                                                     xg::XGQueryContext* xg_context = nullptr,
+                                                                     const SnarlDistanceIndex* distance_index = nullptr);
+    
+    /// The number of exact distance estimates that were made while clustering the hits,
+    /// which is the bulk of the clustering time on reads with many hits
+    size_t num_distance_probes = 0;
     
     //static size_t PRUNE_COUNTER;
     //static size_t CLUSTER_TOTAL;
@@ -238,9 +288,9 @@ private:
                               size_t max_expected_dist_approx_error,
                               size_t min_mem_length,
                               bool unstranded,
-                              paths_of_node_memo_t* paths_of_node_memo,
-                              oriented_occurences_memo_t* oriented_occurences_memo,
-                              handle_memo_t* handle_memo);
+                              xg::XGQueryContext* xg_context,
+                              bool sweep_clustering,
+                              const SnarlDistanceIndex* distance_index);
     
     /**
      * Given a certain number of items, and a callback to get each item's
@@ -252,6 +302,15 @@ private:
      * the strand they fall on using the oriented distance estimation function
      * in xg.
      *
+     * If sweep is true, the items are also sorted by their approximate
+     * position in the XG's sequence vector and distances are measured between
+     * near neighbors in that order before falling back to a budgeted number of
+     * random pairs. This keeps the cost roughly linear on reads with very many
+     * hits. If num_distance_probes is not null, the number of distances
+     * measured is stored in it. If distance_index is not null, distances
+     * between items on the same strand are looked up in it where it can
+     * answer instead of being measured along the paths.
+     *
      * Returns a map from item pair (lower number first) to distance (which may
      * be negative) from the first to the second along the items' forward
      * strand.
@@ -259,17 +318,21 @@ private:
     static unordered_map<pair<size_t, size_t>, int64_t> get_on_strand_distance_tree(size_t num_items, bool unstranded, xg::XG* xgindex,
                                                                                     const function<pos_t(size_t)>& get_position,
                                                                                     const function<int64_t(size_t)>& get_offset,
-                                                                                    paths_of_node_memo_t* paths_of_node_memo,
-                                                                                    oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                    handle_memo_t* handle_memo);
+                                                                                    xg::XGQueryContext* xg_context,
+                                                                                    bool sweep = false,
+                                                                                    size_t* num_distance_probes = nullptr,
+                                                                                    const SnarlDistanceIndex* distance_index = nullptr);
     
     /**
      * Adds edges into the distance tree by estimating the distance between pairs
-     * generated by a high entropy deterministic permutation
+     * generated by a high entropy deterministic permutation, stopping after at most
+     * max_distance_probes estimates
      */
     static void extend_dist_tree_by_permutations(int64_t max_failed_distance_probes,
                                                  int64_t max_search_distance_to_path,
                                                  size_t decrement_frequency,
+                                                 size_t max_distance_probes,
+                                                 size_t& num_distance_probes,
                                                  size_t& num_possible_merges_remaining,
                                                  UnionFind& component_union_find,
                                                  unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
@@ -279,17 +342,38 @@ private:
                                                  xg::XG* xgindex,
                                                  const function<pos_t(size_t)>& get_position,
                                                  const function<int64_t(size_t)>& get_offset,
-                                                 paths_of_node_memo_t* paths_of_node_memo,
-                                                 oriented_occurences_memo_t* oriented_occurences_memo,
-                                                 handle_memo_t* handle_memo);
+                                                 xg::XGQueryContext* xg_context,
+                                                 const SnarlDistanceIndex* distance_index);
     
+    /**
+     * Adds edges into the distance tree by sorting the items by their approximate linear
+     * position in the XG (separately for each orientation, unless unstranded), splitting
+     * the order into buckets wherever consecutive items are more than max_sweep_gap apart,
+     * and estimating the distance from each item to at most sweep_width of the items
+     * after it in its bucket
+     */
+    static void extend_dist_tree_by_sweep(int64_t max_search_distance_to_path,
+                                          size_t sweep_width,
+                                          int64_t max_sweep_gap,
+                                          size_t& num_distance_probes,
+                                          size_t& num_possible_merges_remaining,
+                                          UnionFind& component_union_find,
+                                          unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
+                                          bool unstranded,
+                                          size_t num_items,
+                                          xg::XG* xgindex,
+                                          const function<pos_t(size_t)>& get_position,
+                                          const function<int64_t(size_t)>& get_offset,
+                                          xg::XGQueryContext* xg_context,
+                                          const SnarlDistanceIndex* distance_index);
     
     /**
      * Adds edges into the distance tree by estimating the distance only between pairs
-     * of items that can be directly inferred to share a strand of a path based on the memo of
+     * of items that can be directly inferred to share a strand of a path based on the cached
      * node occurrences on paths
      */
     static void extend_dist_tree_by_strand_buckets(int64_t max_failed_distance_probes,
+                                                   size_t& num_distance_probes,
                                                    size_t& num_possible_merges_remaining,
                                                    UnionFind& component_union_find,
                                                    unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
@@ -298,14 +382,24 @@ private:
                                                    xg::XG* xgindex,
                                                    const function<pos_t(size_t)>& get_position,
                                                    const function<int64_t(size_t)>& get_offset,
-                                                   paths_of_node_memo_t* paths_of_node_memo,
-                                                   oriented_occurences_memo_t* oriented_occurences_memo,
-                                                   handle_memo_t* handle_memo);
+                                                   xg::XGQueryContext* xg_context,
+                                                   const SnarlDistanceIndex* distance_index);
+    
+    /**
+     * Get the signed distance from one position to another along the strand they share,
+     * from the distance index if there is one and it can answer, or else along the closest
+     * shared path. Returns numeric_limits<int64_t>::max() if no shared strand is found.
+     */
+    static int64_t oriented_distance(const pos_t& pos_1, const pos_t& pos_2, int64_t max_search_distance_to_path,
+                                     xg::XG* xgindex, xg::XGQueryContext* xg_context,
+                                     const SnarlDistanceIndex* distance_index);
+    
     /**
      * Adds edges into the distance tree by estimating the distance only between pairs
-     * of items that can be directly inferred to share a path based on the memo of
+     * of items that can be directly inferred to share a path based on the cached paths of their nodes
      */
     static void extend_dist_tree_by_path_buckets(int64_t max_failed_distance_probes,
+                                                 size_t& num_distance_probes,
                                                  size_t& num_possible_merges_remaining,
                                                  UnionFind& component_union_find,
                                                  unordered_map<pair<size_t, size_t>, int64_t>& recorded_finite_dists,
@@ -314,9 +408,7 @@ private:
                                                  xg::XG* xgindex,
                                                  const function<pos_t(size_t)>& get_position,
                                                  const function<int64_t(size_t)>& get_offset,
-                                                 paths_of_node_memo_t* paths_of_node_memo,
-                                                 oriented_occurences_memo_t* oriented_occurences_memo,
-                                                 handle_memo_t* handle_memo);
+                                                 xg::XGQueryContext* xg_context);
     
     /**
      * Automatically blocks off merges in the distance tree between groups that can be inferred
@@ -330,7 +422,7 @@ private:
                                                        xg::XG* xgindex,
                                                        const function<pos_t(size_t)>& get_position,
                                                        const function<int64_t(size_t)>& get_offset,
-                                                       paths_of_node_memo_t* paths_of_node_memo);
+                                                       xg::XGQueryContext* xg_context);
     
     /**
      * Given a number of nodes, and a map from node pair to signed relative
@@ -382,15 +474,20 @@ private:
 
 class OrientedDistanceClusterer::ODNode {
 public:
-    ODNode(const MaximalExactMatch& mem, pos_t start_pos, int32_t score) :
-    mem(&mem), start_pos(start_pos), score(score) {}
+    ODNode(const MaximalExactMatch& mem, gcsa::node_type start_hit, int32_t score) :
+    mem(&mem), start_hit(start_hit), score(score) {}
     ODNode() = default;
     ~ODNode() = default;
     
     const MaximalExactMatch* mem;
     
-    /// Position of GCSA hit in the graph
-    pos_t start_pos;
+    /// GCSA hit in the graph, packed into 64 bits
+    gcsa::node_type start_hit;
+    
+    /// Position of the GCSA hit in the graph
+    inline pos_t start_pos() const {
+        return make_pos_t(start_hit);
+    }
     
     /// Score of the exact match this node represents
     int32_t score;
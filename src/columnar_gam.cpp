@@ -0,0 +1,463 @@
+#include "columnar_gam.hpp"
+
+#include <omp.h>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+
+/**
+ * \file columnar_gam.cpp
+ * Implement reading and writing the block-columnar alignment container.
+ */
+
+namespace stream {
+
+using namespace std;
+using ::google::protobuf::internal::WireFormatLite;
+
+/// The magic bytes that start a columnar GAM
+static const char COLUMNAR_MAGIC[] = "GAMC";
+static const size_t COLUMNAR_MAGIC_SIZE = 4;
+/// The version of the format that we write
+static const uint64_t COLUMNAR_VERSION = 1;
+/// The number of columns we know about
+static const size_t COLUMN_COUNT = 6;
+
+// The column numbers, which are the bit numbers of the AlignmentColumn flags
+static const size_t NAME = 0;
+static const size_t SEQUENCE = 1;
+static const size_t QUALITY = 2;
+static const size_t PATH = 3;
+static const size_t SCORE = 4;
+static const size_t OTHER = 5;
+
+// The Alignment fields that have columns of their own
+static const int SEQUENCE_FIELD = 1;
+static const int PATH_FIELD = 2;
+static const int NAME_FIELD = 3;
+static const int QUALITY_FIELD = 4;
+static const int MAPPING_QUALITY_FIELD = 5;
+static const int SCORE_FIELD = 6;
+
+static void put_varint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+static void put_bytes(string& out, const string& bytes) {
+    put_varint(out, bytes.size());
+    out.append(bytes);
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/// Code for each upper case base, or -1 for anything that has to be stored
+/// as an exception
+static const vector<int8_t>& base_codes() {
+    static const vector<int8_t> codes = []() {
+        vector<int8_t> codes(256, -1);
+        codes['A'] = 0;
+        codes['C'] = 1;
+        codes['G'] = 2;
+        codes['T'] = 3;
+        return codes;
+    }();
+    return codes;
+}
+
+/// Add a sequence to the sequence column: its length, the characters that
+/// aren't ACGT as (gap, character) pairs, and then 2 bits per base with those
+/// characters packed as A.
+static void put_sequence(string& out, const string& sequence) {
+    auto& codes = base_codes();
+    put_varint(out, sequence.size());
+    size_t exceptions = 0;
+    for (char base : sequence) {
+        exceptions += codes[(uint8_t) base] < 0;
+    }
+    put_varint(out, exceptions);
+    size_t last = 0;
+    for (size_t i = 0; i < sequence.size() && exceptions; i++) {
+        if (codes[(uint8_t) sequence[i]] < 0) {
+            put_varint(out, i - last);
+            out.push_back(sequence[i]);
+            last = i;
+            exceptions--;
+        }
+    }
+    for (size_t i = 0; i < sequence.size(); i += 4) {
+        uint8_t packed = 0;
+        for (size_t j = i; j < i + 4 && j < sequence.size(); j++) {
+            packed |= (uint8_t) max<int8_t>(codes[(uint8_t) sequence[j]], 0) << (2 * (j - i));
+        }
+        out.push_back((char) packed);
+    }
+}
+
+/// Reads values back out of an inflated column
+class ColumnCursor {
+public:
+    ColumnCursor(const string& data) : pos(data.data()), end(data.data() + data.size()) {}
+
+    uint64_t get_varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            need(1);
+            uint8_t byte = (uint8_t) *pos++;
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw runtime_error("[stream::for_each_columnar] bad varint in columnar GAM");
+    }
+
+    /// Get the next length-prefixed run of bytes, and its length.
+    const char* get_bytes(size_t& length) {
+        length = get_varint();
+        need(length);
+        const char* bytes = pos;
+        pos += length;
+        return bytes;
+    }
+
+    void get_sequence(string& sequence) {
+        size_t length = get_varint();
+        sequence.resize(length);
+        size_t exceptions = get_varint();
+        // remember where the exceptions are and fill them in after unpacking
+        const char* exception_start = pos;
+        for (size_t i = 0; i < exceptions; i++) {
+            get_varint();
+            need(1);
+            pos++;
+        }
+        size_t packed_size = (length + 3) / 4;
+        need(packed_size);
+        static const char bases[] = "ACGT";
+        for (size_t i = 0; i < length; i++) {
+            sequence[i] = bases[((uint8_t) pos[i / 4] >> (2 * (i % 4))) & 3];
+        }
+        const char* packed_end = pos + packed_size;
+        pos = exception_start;
+        size_t at = 0;
+        for (size_t i = 0; i < exceptions; i++) {
+            at += get_varint();
+            if (at >= length) {
+                throw runtime_error("[stream::for_each_columnar] bad sequence in columnar GAM");
+            }
+            sequence[at] = *pos++;
+        }
+        pos = packed_end;
+    }
+
+private:
+    void need(size_t bytes) {
+        if (end - pos < (ptrdiff_t) bytes) {
+            throw runtime_error("[stream::for_each_columnar] truncated column in columnar GAM");
+        }
+    }
+
+    const char* pos;
+    const char* end;
+};
+
+/// The compressed columns of one block, as read from the stream
+struct ColumnarBlock {
+    uint64_t count = 0;
+    bool present[COLUMN_COUNT];
+    uint64_t raw_size[COLUMN_COUNT];
+    string data[COLUMN_COUNT];
+};
+
+/// Read a varint from the stream. Returns false if the stream ends before it.
+static bool read_varint(istream& in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) {
+            if (shift) {
+                throw runtime_error("[stream::for_each_columnar] truncated columnar GAM");
+            }
+            return false;
+        }
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    throw runtime_error("[stream::for_each_columnar] bad varint in columnar GAM");
+}
+
+static uint64_t read_required_varint(istream& in) {
+    uint64_t value;
+    if (!read_varint(in, value)) {
+        throw runtime_error("[stream::for_each_columnar] truncated columnar GAM");
+    }
+    return value;
+}
+
+static void read_header(istream& in) {
+    char magic[COLUMNAR_MAGIC_SIZE];
+    if (!in.read(magic, COLUMNAR_MAGIC_SIZE) || !equal(magic, magic + COLUMNAR_MAGIC_SIZE, COLUMNAR_MAGIC)) {
+        throw runtime_error("[stream::for_each_columnar] input is not a columnar GAM");
+    }
+    uint64_t version = read_required_varint(in);
+    if (version > COLUMNAR_VERSION) {
+        throw runtime_error("[stream::for_each_columnar] columnar GAM version " + to_string(version)
+                            + " is newer than this reader");
+    }
+}
+
+/// Read the next block from the stream, keeping only the wanted columns.
+/// Returns false at the end of the stream.
+static bool read_block(istream& in, ColumnarBlock& block, uint32_t columns) {
+    if (!read_varint(in, block.count)) {
+        return false;
+    }
+    fill(block.present, block.present + COLUMN_COUNT, false);
+    uint64_t column_count = read_required_varint(in);
+    for (uint64_t i = 0; i < column_count; i++) {
+        int column = in.get();
+        uint64_t raw_size = read_required_varint(in);
+        uint64_t compressed_size = read_required_varint(in);
+        if (column == EOF) {
+            throw runtime_error("[stream::for_each_columnar] truncated columnar GAM");
+        }
+        if (column < (int) COLUMN_COUNT && (columns & (1 << column))) {
+            block.present[column] = true;
+            block.raw_size[column] = raw_size;
+            block.data[column].resize(compressed_size);
+            in.read(&block.data[column][0], compressed_size);
+        } else {
+            // skip the columns we don't want, and any we don't know about
+            in.ignore(compressed_size);
+        }
+        if (!in) {
+            throw runtime_error("[stream::for_each_columnar] truncated columnar GAM");
+        }
+    }
+    return true;
+}
+
+/// Inflate the columns of a block, and call the lambda on each alignment.
+static void decode_block(ColumnarBlock& block, const function<void(vg::Alignment&)>& lambda) {
+    string raw[COLUMN_COUNT];
+    for (size_t i = 0; i < COLUMN_COUNT; i++) {
+        if (!block.present[i]) {
+            continue;
+        }
+        raw[i].resize(block.raw_size[i]);
+        uLongf raw_size = raw[i].size();
+        if (uncompress((Bytef*) &raw[i][0], &raw_size, (const Bytef*) block.data[i].data(),
+                       block.data[i].size()) != Z_OK || raw_size != raw[i].size()) {
+            throw runtime_error("[stream::for_each_columnar] could not inflate column of columnar GAM");
+        }
+    }
+    vector<ColumnCursor> cursors;
+    for (size_t i = 0; i < COLUMN_COUNT; i++) {
+        cursors.emplace_back(raw[i]);
+    }
+    size_t length;
+    for (uint64_t i = 0; i < block.count; i++) {
+        vg::Alignment aln;
+        if (block.present[OTHER]) {
+            // this has to come first, because parsing clears the message
+            const char* bytes = cursors[OTHER].get_bytes(length);
+            if (!aln.ParseFromArray(bytes, length)) {
+                throw runtime_error("[stream::for_each_columnar] could not parse alignment in columnar GAM");
+            }
+        }
+        if (block.present[NAME]) {
+            const char* bytes = cursors[NAME].get_bytes(length);
+            aln.set_name(bytes, length);
+        }
+        if (block.present[SEQUENCE]) {
+            cursors[SEQUENCE].get_sequence(*aln.mutable_sequence());
+        }
+        if (block.present[QUALITY]) {
+            const char* bytes = cursors[QUALITY].get_bytes(length);
+            aln.set_quality(bytes, length);
+        }
+        if (block.present[PATH]) {
+            const char* bytes = cursors[PATH].get_bytes(length);
+            // a path is stored one byte longer so that a missing path is empty
+            if (length && !aln.mutable_path()->ParseFromArray(bytes + 1, length - 1)) {
+                throw runtime_error("[stream::for_each_columnar] could not parse path in columnar GAM");
+            }
+        }
+        if (block.present[SCORE]) {
+            aln.set_score(unzigzag(cursors[SCORE].get_varint()));
+            aln.set_mapping_quality(unzigzag(cursors[SCORE].get_varint()));
+        }
+        lambda(aln);
+    }
+}
+
+bool is_columnar_gam(istream& in) {
+    streampos start = in.tellg();
+    if (start == streampos(-1)) {
+        in.clear();
+        return false;
+    }
+    char magic[COLUMNAR_MAGIC_SIZE];
+    bool columnar = in.read(magic, COLUMNAR_MAGIC_SIZE)
+        && equal(magic, magic + COLUMNAR_MAGIC_SIZE, COLUMNAR_MAGIC);
+    in.clear();
+    in.seekg(start);
+    return columnar;
+}
+
+ColumnarAlignmentWriter::ColumnarAlignmentWriter(ostream& out, size_t block_alignments, int compression_level) :
+    out(out), block_alignments(max<size_t>(block_alignments, 1)), compression_level(compression_level) {
+    string header(COLUMNAR_MAGIC, COLUMNAR_MAGIC_SIZE);
+    put_varint(header, COLUMNAR_VERSION);
+    out.write(header.data(), header.size());
+}
+
+ColumnarAlignmentWriter::~ColumnarAlignmentWriter() {
+    try {
+        flush();
+    } catch (exception& e) {
+        // We can't throw from a destructor; the stream's failbit will tell
+        // anyone who checks.
+    }
+}
+
+void ColumnarAlignmentWriter::write(const vg::Alignment& aln) {
+    // Serialize once and sort the fields into their columns, so the path
+    // bytes go in as they are and everything else lands in the other column
+    aln.SerializeToString(&serialized);
+    ::google::protobuf::io::CodedInputStream input((const uint8_t*) serialized.data(), serialized.size());
+    other_fields.clear();
+    sequence.clear();
+    path.clear();
+    name.clear();
+    quality.clear();
+    bool has_path = false;
+    int32_t mapping_quality = 0;
+    int32_t score = 0;
+    {
+        ::google::protobuf::io::StringOutputStream other_stream(&other_fields);
+        ::google::protobuf::io::CodedOutputStream other_out(&other_stream);
+        while (uint32_t tag = input.ReadTag()) {
+            bool delimited = WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED;
+            bool varint = WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_VARINT;
+            uint32_t length;
+            uint64_t value;
+            bool ok = true;
+            switch (WireFormatLite::GetTagFieldNumber(tag)) {
+            case SEQUENCE_FIELD:
+                ok = delimited && input.ReadVarint32(&length) && input.ReadString(&sequence, length);
+                break;
+            case PATH_FIELD:
+                ok = delimited && input.ReadVarint32(&length) && input.ReadString(&path, length);
+                has_path = true;
+                break;
+            case NAME_FIELD:
+                ok = delimited && input.ReadVarint32(&length) && input.ReadString(&name, length);
+                break;
+            case QUALITY_FIELD:
+                ok = delimited && input.ReadVarint32(&length) && input.ReadString(&quality, length);
+                break;
+            case MAPPING_QUALITY_FIELD:
+                ok = varint && input.ReadVarint64(&value);
+                mapping_quality = (int32_t) value;
+                break;
+            case SCORE_FIELD:
+                ok = varint && input.ReadVarint64(&value);
+                score = (int32_t) value;
+                break;
+            default:
+                ok = WireFormatLite::SkipField(&input, tag, &other_out);
+                break;
+            }
+            if (!ok) {
+                throw runtime_error("[stream::ColumnarAlignmentWriter] could not split alignment into columns");
+            }
+        }
+    }
+    put_bytes(columns[NAME], name);
+    put_sequence(columns[SEQUENCE], sequence);
+    put_bytes(columns[QUALITY], quality);
+    put_varint(columns[PATH], has_path ? path.size() + 1 : 0);
+    if (has_path) {
+        columns[PATH].push_back('\0');
+        columns[PATH].append(path);
+    }
+    put_varint(columns[SCORE], zigzag(score));
+    put_varint(columns[SCORE], zigzag(mapping_quality));
+    put_bytes(columns[OTHER], other_fields);
+    buffered++;
+    if (buffered >= block_alignments) {
+        flush();
+    }
+}
+
+void ColumnarAlignmentWriter::flush() {
+    if (!buffered) {
+        return;
+    }
+    string block;
+    put_varint(block, buffered);
+    put_varint(block, COLUMN_COUNT);
+    string compressed;
+    for (size_t i = 0; i < COLUMN_COUNT; i++) {
+        uLongf compressed_size = compressBound(columns[i].size());
+        compressed.resize(compressed_size);
+        if (compress2((Bytef*) &compressed[0], &compressed_size, (const Bytef*) columns[i].data(),
+                      columns[i].size(), compression_level) != Z_OK) {
+            throw runtime_error("[stream::ColumnarAlignmentWriter] could not compress column");
+        }
+        block.push_back((char) i);
+        put_varint(block, columns[i].size());
+        put_varint(block, compressed_size);
+        block.append(compressed.data(), compressed_size);
+        columns[i].clear();
+    }
+    out.write(block.data(), block.size());
+    if (!out) {
+        throw runtime_error("[stream::ColumnarAlignmentWriter] I/O error writing columnar GAM");
+    }
+    buffered = 0;
+}
+
+void for_each_columnar(istream& in, const function<void(vg::Alignment&)>& lambda, uint32_t columns) {
+    read_header(in);
+    ColumnarBlock block;
+    while (read_block(in, block, columns)) {
+        decode_block(block, lambda);
+    }
+}
+
+void for_each_columnar_parallel(istream& in, const function<void(vg::Alignment&)>& lambda, uint32_t columns) {
+    read_header(in);
+    // read a few blocks for each thread, and then decode them all at once
+    vector<ColumnarBlock> blocks(2 * omp_get_max_threads());
+    bool more = true;
+    while (more) {
+        size_t filled = 0;
+        while (filled < blocks.size() && (more = read_block(in, blocks[filled], columns))) {
+            filled++;
+        }
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < filled; i++) {
+            decode_block(blocks[i], lambda);
+        }
+    }
+}
+
+}
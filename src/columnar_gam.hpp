@@ -0,0 +1,95 @@
+#ifndef VG_COLUMNAR_GAM_HPP_INCLUDED
+#define VG_COLUMNAR_GAM_HPP_INCLUDED
+
+/**
+ * \file columnar_gam.hpp
+ *
+ * A block-columnar container for Alignments, as an alternative to GAM for
+ * consumers that only look at some of each read. Alignments are stored in
+ * blocks, and each block keeps names, sequences (2 bits per base), qualities,
+ * paths, scores and mapping qualities, and everything else, in separately
+ * compressed columns. A reader only inflates and decodes the columns it asks
+ * for, and skips over the bytes of the rest.
+ *
+ * The file starts with the magic bytes "GAMC" and a varint version. Each
+ * block is a varint alignment count and a varint column count, and then for
+ * each column a one byte column number, the varint sizes of its data before
+ * and after compression, and the zlib-compressed data.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "vg.pb.h"
+
+namespace stream {
+
+/// The columns of a columnar GAM. Or them together to say which ones to read.
+enum AlignmentColumn : uint32_t {
+    COLUMN_NAME = 1 << 0,
+    COLUMN_SEQUENCE = 1 << 1,
+    COLUMN_QUALITY = 1 << 2,
+    COLUMN_PATH = 1 << 3,
+    /// The score and the mapping quality
+    COLUMN_SCORE = 1 << 4,
+    /// All the fields of the Alignment that don't have columns of their own
+    COLUMN_OTHER = 1 << 5,
+    ALL_COLUMNS = (1 << 6) - 1
+};
+
+/// Check whether a stream holds a columnar GAM, without consuming any of it.
+/// Streams that can't seek back are never taken to be columnar GAM.
+bool is_columnar_gam(std::istream& in);
+
+/**
+ * Write Alignments to an ostream as a columnar GAM. Alignments are buffered
+ * into columns until a block is full, and the last block is written on
+ * destruction.
+ */
+class ColumnarAlignmentWriter {
+public:
+    /// Start writing a columnar GAM to the given stream, with up to the given
+    /// number of alignments in each block.
+    ColumnarAlignmentWriter(std::ostream& out, size_t block_alignments = 10000, int compression_level = 6);
+
+    /// Write out anything still buffered.
+    ~ColumnarAlignmentWriter();
+
+    ColumnarAlignmentWriter(const ColumnarAlignmentWriter& other) = delete;
+    ColumnarAlignmentWriter& operator=(const ColumnarAlignmentWriter& other) = delete;
+
+    /// Add an alignment to the current block, writing the block if it is full.
+    void write(const vg::Alignment& aln);
+
+    /// Write out the alignments buffered so far as a block. Throws if the
+    /// underlying stream fails.
+    void flush();
+
+private:
+    std::ostream& out;
+    size_t block_alignments;
+    int compression_level;
+    /// Encoded column data of the block being built, indexed by column number
+    std::string columns[6];
+    /// Number of alignments in the block being built
+    size_t buffered = 0;
+    /// Scratch space for splitting an alignment into its columns
+    std::string serialized, other_fields, sequence, path, name, quality;
+};
+
+/// Call the lambda on every alignment in a columnar GAM. Only the given
+/// columns are decoded, and the fields that come from the others are left
+/// empty.
+void for_each_columnar(std::istream& in, const std::function<void(vg::Alignment&)>& lambda,
+                       uint32_t columns = ALL_COLUMNS);
+
+/// Like for_each_columnar, but decode blocks and call the lambda on many
+/// threads, in no particular order.
+void for_each_columnar_parallel(std::istream& in, const std::function<void(vg::Alignment&)>& lambda,
+                                uint32_t columns = ALL_COLUMNS);
+
+}
+
+#endif
@@ -12,7 +12,9 @@
 #include <tuple>
 #include <list>
 #include <algorithm>
+#include <cctype>
 #include <memory>
+#include <omp.h>
 
 //#define debug
 
@@ -189,10 +191,17 @@ namespace vg {
         cerr << "constructing chunk " << reference_path_name << ":" << chunk_offset << " length " << reference_sequence.size() << endl;
         #endif
         
-        // Make sure the input sequence is upper-case
-        string uppercase_sequence = toUppercase(reference_sequence);
+        // Make sure the input sequence is upper-case. We do it in place, since
+        // the chunk can be long when it spans a big deletion.
+        bool had_lowercase = false;
+        for (auto& base : reference_sequence) {
+            if (islower((unsigned char) base)) {
+                base = toupper((unsigned char) base);
+                had_lowercase = true;
+            }
+        }
         
-        if (uppercase_sequence != reference_sequence && warn_on_lowercase) {
+        if (had_lowercase && warn_on_lowercase) {
             #pragma omp critical (cerr)
             {
                 // Note that the pragma also protects this mutable map that we update
@@ -204,7 +213,6 @@ namespace vg {
                 }    
             }
         }
-        swap(reference_sequence, uppercase_sequence);
 
         // Construct a chunk for this sequence with these variants.
         ConstructedChunk to_return;
@@ -1484,6 +1492,69 @@ namespace vg {
             callback(chunk.graph);
         };
 
+        // Chunks are independent until they are wired, so we build a batch of
+        // them at a time in parallel. Each chunk's reference sequence is read
+        // through the FASTA index as it is queued, so we never hold a whole
+        // contig. Reading the FASTA and wiring and emitting
+        // stay serial and in order, so IDs come out just as they would if we
+        // built one chunk at a time.
+        struct PendingChunk {
+            string reference_sequence;
+            vector<vcflib::Variant> variants;
+            size_t start;
+            size_t end;
+        };
+        vector<PendingChunk> pending_chunks;
+        // Keep a couple of chunks per thread in flight, so one slow chunk
+        // doesn't idle everyone else for long.
+        size_t chunks_per_batch = 2 * omp_get_max_threads();
+        // Chunks spanning big deletions can be much longer than
+        // bases_per_chunk, so we also cap the reference sequence held for the
+        // batch, to keep a contig's memory bounded however big its SVs are.
+        size_t bases_per_batch = chunks_per_batch * bases_per_chunk;
+        size_t pending_bases = 0;
+
+        // Construct, wire up, and emit all the pending chunks.
+        auto flush_chunks = [&]() {
+            vector<ConstructedChunk> results(pending_chunks.size());
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < pending_chunks.size(); i++) {
+                auto& pending = pending_chunks[i];
+                // the chunk's sequence and variants aren't needed again, so
+                // don't hold a second copy of them
+                results[i] = construct_chunk(std::move(pending.reference_sequence), reference_contig,
+                                             std::move(pending.variants), pending.start);
+            }
+
+            for (size_t i = 0; i < results.size(); i++) {
+                // Wire up and emit the chunk graph
+                wire_and_emit(results[i]);
+
+                // Say we've completed the chunk
+                update_progress(pending_chunks[i].end - leading_offset);
+            }
+            pending_chunks.clear();
+            pending_bases = 0;
+        };
+
+        // Take the chunk from chunk_start to chunk_end, with the variants in
+        // chunk_variants, and queue it up to be constructed. Leaves
+        // chunk_variants in an unspecified state.
+        auto queue_chunk = [&]() {
+            PendingChunk pending;
+            // Get the ref sequence we need
+            pending.reference_sequence = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
+            pending.variants = std::move(chunk_variants);
+            pending.start = chunk_start;
+            pending.end = chunk_end;
+            pending_bases += pending.reference_sequence.size();
+            pending_chunks.push_back(std::move(pending));
+
+            if (pending_chunks.size() >= chunks_per_batch || pending_bases >= bases_per_batch) {
+                flush_chunks();
+            }
+        };
+
         bool do_external_insertions = false;
         FastaReference* insertion_fasta;
 
@@ -1615,17 +1686,8 @@ namespace vg {
                             min((size_t) reference_end,
                                 (size_t) (chunk_start + bases_per_chunk))));
 
-                // Get the ref sequence we need
-                auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-                // Call the construction
-                auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-                // Wire up and emit the chunk graph
-                wire_and_emit(result);
-
-                // Say we've completed the chunk
-                update_progress(chunk_end - leading_offset);
+                // Queue the chunk up to be constructed with its batch
+                queue_chunk();
 
                 // Set up a new chunk
                 chunk_start = chunk_end;
@@ -1647,17 +1709,8 @@ namespace vg {
                     min((size_t) reference_end,
                         (size_t) (chunk_start + bases_per_chunk)));
 
-            // Get the ref sequence we need
-            auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-            // Call the construction
-            auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-            // Wire up and emit the chunk graph
-            wire_and_emit(result);
-
-            // Say we've completed the chunk
-            update_progress(chunk_end - leading_offset);
+            // Queue the chunk up to be constructed with its batch
+            queue_chunk();
 
             // Set up a new chunk
             chunk_start = chunk_end;
@@ -1665,6 +1718,9 @@ namespace vg {
             chunk_variants.clear();
         }
 
+        // Build and emit whatever is left in the last batch
+        flush_chunks();
+
         // All the chunks have been wired and emitted.
         
         if (last_node_buffer.id() != 0) {
@@ -1709,6 +1765,11 @@ namespace vg {
 
             // These will all get destructed when the vector goes away.
             buffers.emplace_back(new VcfBuffer(vcf));
+            
+            // We only look at the sites, so don't bother with the genotypes,
+            // and parse the sites while we build the graph.
+            buffers.back()->set_parse_samples(false);
+            buffers.back()->start_read_ahead();
         }
 
         if (!allowed_vcf_names.empty()) {
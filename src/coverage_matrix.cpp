@@ -0,0 +1,349 @@
+#include "coverage_matrix.hpp"
+#include "packer.hpp"
+#include "position.hpp"
+#include "utility.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <zlib.h>
+
+/**
+ * \file coverage_matrix.cpp
+ * Implementations for the multi-sample coverage matrix.
+ */
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[] = "VGCOVMAT";
+const size_t MAGIC_LENGTH = 8;
+const uint64_t VERSION = 1;
+
+void put_varint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char) ((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+void write_u64(ostream& out, uint64_t value) {
+    char bytes[8];
+    for (size_t i = 0; i < 8; i++) {
+        bytes[i] = (char) ((value >> (8 * i)) & 0xff);
+    }
+    out.write(bytes, 8);
+}
+
+uint64_t read_u64(const char* data) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= ((uint64_t) (unsigned char) data[i]) << (8 * i);
+    }
+    return value;
+}
+
+// coverage is mostly smooth along the graph, so we store the differences
+// between rows, zigzagged so that small drops stay small too
+inline uint64_t zigzag(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+}
+
+void CoverageMatrix::build(const vector<string>& pack_file_names, const string& out_file_name,
+                           size_t bin_size, size_t rows_per_block) {
+    if (pack_file_names.empty()) {
+        throw runtime_error("[CoverageMatrix::build] no packs to build a coverage matrix from");
+    }
+    bin_size = max<size_t>(bin_size, 1);
+    rows_per_block = max<size_t>(rows_per_block, 1);
+
+    // check the packs up front, so we don't fail part way through
+    for (auto& pack_file_name : pack_file_names) {
+        ifstream in(pack_file_name);
+        if (!in) {
+            throw runtime_error("[CoverageMatrix::build] could not open pack " + pack_file_name);
+        }
+    }
+
+    // each sample's blocks go to a temporary file of their own, so we only
+    // need as many packs in memory as we have threads
+    vector<string> temp_file_names;
+    for (size_t i = 0; i < pack_file_names.size(); i++) {
+        temp_file_names.push_back(temp_file::create("covmat"));
+    }
+    vector<size_t> lengths(pack_file_names.size());
+    vector<vector<uint64_t>> block_sizes(pack_file_names.size());
+    atomic<bool> compressed_all(true);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < pack_file_names.size(); i++) {
+        Packer packer;
+        packer.load_from_file(pack_file_names[i]);
+        size_t length = packer.graph_length();
+        size_t n_rows = (length + bin_size - 1) / bin_size;
+        lengths[i] = length;
+
+        ofstream out(temp_file_names[i], ios_base::binary);
+        string encoded;
+        string compressed;
+        for (size_t block_start = 0; block_start < n_rows; block_start += rows_per_block) {
+            encoded.clear();
+            int64_t prev = 0;
+            for (size_t row = block_start; row < min(n_rows, block_start + rows_per_block); row++) {
+                uint64_t sum = 0;
+                for (size_t pos = row * bin_size; pos < min(length, (row + 1) * bin_size); pos++) {
+                    sum += packer.coverage_at_position(pos);
+                }
+                int64_t value = min<uint64_t>(sum, UINT32_MAX);
+                put_varint(encoded, zigzag(value - prev));
+                prev = value;
+            }
+            uLongf compressed_size = compressBound(encoded.size());
+            compressed.resize(compressed_size);
+            if (compress2((Bytef*) &compressed[0], &compressed_size, (const Bytef*) encoded.data(),
+                          encoded.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+                compressed_all.store(false);
+                compressed_size = 0;
+            }
+            out.write(compressed.data(), compressed_size);
+            block_sizes[i].push_back(compressed_size);
+        }
+    }
+
+    auto remove_temp_files = [&]() {
+        for (auto& temp_file_name : temp_file_names) {
+            temp_file::remove(temp_file_name);
+        }
+    };
+    if (!compressed_all.load()) {
+        remove_temp_files();
+        throw runtime_error("[CoverageMatrix::build] could not compress coverage");
+    }
+    for (size_t i = 1; i < lengths.size(); i++) {
+        if (lengths[i] != lengths[0]) {
+            remove_temp_files();
+            throw runtime_error("[CoverageMatrix::build] packs " + pack_file_names[0] + " and " + pack_file_names[i]
+                                + " are for graphs of different lengths");
+        }
+    }
+
+    ofstream out(out_file_name, ios_base::binary);
+    if (!out) {
+        remove_temp_files();
+        throw runtime_error("[CoverageMatrix::build] could not write " + out_file_name);
+    }
+    size_t n_rows = (lengths[0] + bin_size - 1) / bin_size;
+    out.write(MAGIC, MAGIC_LENGTH);
+    write_u64(out, VERSION);
+    write_u64(out, pack_file_names.size());
+    write_u64(out, lengths[0]);
+    write_u64(out, bin_size);
+    write_u64(out, rows_per_block);
+    write_u64(out, n_rows);
+    write_u64(out, block_sizes[0].size());
+    for (auto& pack_file_name : pack_file_names) {
+        write_u64(out, pack_file_name.size());
+        out.write(pack_file_name.data(), pack_file_name.size());
+    }
+    uint64_t offset = 0;
+    for (auto& sizes : block_sizes) {
+        for (auto& size : sizes) {
+            write_u64(out, offset);
+            offset += size;
+        }
+    }
+    write_u64(out, offset);
+    for (auto& temp_file_name : temp_file_names) {
+        ifstream in(temp_file_name, ios_base::binary);
+        out << in.rdbuf();
+    }
+    remove_temp_files();
+    if (!out) {
+        throw runtime_error("[CoverageMatrix::build] could not write " + out_file_name);
+    }
+}
+
+CoverageMatrix::CoverageMatrix(const string& file_name) : file(file_name) {
+    if (!file.is_open()) {
+        throw runtime_error("[CoverageMatrix] could not map " + file_name);
+    }
+    const char* data = file.data();
+    const char* data_end = data + file.size();
+    auto need = [&](size_t bytes) {
+        if ((size_t) (data_end - data) < bytes) {
+            throw runtime_error("[CoverageMatrix] " + file_name + " is truncated");
+        }
+    };
+
+    need(MAGIC_LENGTH + 7 * 8);
+    if (memcmp(data, MAGIC, MAGIC_LENGTH) != 0) {
+        throw runtime_error("[CoverageMatrix] " + file_name + " is not a coverage matrix");
+    }
+    data += MAGIC_LENGTH;
+    uint64_t version = read_u64(data);
+    if (version != VERSION) {
+        throw runtime_error("[CoverageMatrix] " + file_name + " has unsupported version " + to_string(version));
+    }
+    size_t n_samples = read_u64(data + 8);
+    length = read_u64(data + 16);
+    bin = read_u64(data + 24);
+    block_rows = read_u64(data + 32);
+    rows = read_u64(data + 40);
+    blocks = read_u64(data + 48);
+    data += 56;
+    if (bin == 0 || block_rows == 0 || rows != (length + bin - 1) / bin
+        || blocks != (rows + block_rows - 1) / block_rows) {
+        throw runtime_error("[CoverageMatrix] " + file_name + " has an inconsistent header");
+    }
+
+    for (size_t i = 0; i < n_samples; i++) {
+        need(8);
+        size_t name_length = read_u64(data);
+        data += 8;
+        need(name_length);
+        names.emplace_back(data, name_length);
+        data += name_length;
+    }
+
+    size_t n_offsets = n_samples * blocks + 1;
+    need(8 * n_offsets);
+    offsets = data;
+    block_data = data + 8 * n_offsets;
+    data = block_data;
+    need(read_u64(offsets + 8 * (n_offsets - 1)));
+}
+
+size_t CoverageMatrix::sample_count() const {
+    return names.size();
+}
+
+const string& CoverageMatrix::sample_name(size_t sample) const {
+    return names.at(sample);
+}
+
+size_t CoverageMatrix::graph_length() const {
+    return length;
+}
+
+size_t CoverageMatrix::bin_size() const {
+    return bin;
+}
+
+size_t CoverageMatrix::row_count() const {
+    return rows;
+}
+
+size_t CoverageMatrix::row_of(size_t position) const {
+    return position / bin;
+}
+
+void CoverageMatrix::load_block(size_t block, vector<uint32_t>& block_values) const {
+    size_t first_row = block * block_rows;
+    size_t n_rows = min(rows, first_row + block_rows) - first_row;
+    size_t n_samples = names.size();
+    block_values.resize(n_rows * n_samples);
+
+    // a row's varint takes at most 5 bytes
+    string encoded(n_rows * 5, '\0');
+    for (size_t sample = 0; sample < n_samples; sample++) {
+        size_t index = sample * blocks + block;
+        uint64_t begin = read_u64(offsets + 8 * index);
+        uint64_t end = read_u64(offsets + 8 * (index + 1));
+        uLongf encoded_size = encoded.size();
+        if (end < begin || uncompress((Bytef*) &encoded[0], &encoded_size, (const Bytef*) (block_data + begin),
+                                      end - begin) != Z_OK) {
+            throw runtime_error("[CoverageMatrix] could not inflate block " + to_string(block)
+                                + " of sample " + names[sample]);
+        }
+
+        const unsigned char* here = (const unsigned char*) encoded.data();
+        const unsigned char* encoded_end = here + encoded_size;
+        int64_t value = 0;
+        for (size_t row = 0; row < n_rows; row++) {
+            uint64_t delta = 0;
+            for (size_t shift = 0; ; shift += 7) {
+                if (here == encoded_end || shift > 63) {
+                    throw runtime_error("[CoverageMatrix] block " + to_string(block) + " of sample "
+                                        + names[sample] + " is corrupt");
+                }
+                delta |= ((uint64_t) (*here & 0x7f)) << shift;
+                if (!(*here++ & 0x80)) {
+                    break;
+                }
+            }
+            value += unzigzag(delta);
+            block_values[row * n_samples + sample] = (uint32_t) value;
+        }
+    }
+}
+
+void CoverageMatrix::for_each_row(size_t start, size_t end,
+                                  const function<void(size_t row, const vector<uint32_t>& coverage)>& lambda) const {
+    end = min(end, length);
+    if (start >= end) {
+        return;
+    }
+    size_t n_samples = names.size();
+    vector<uint32_t> block_values;
+    vector<uint32_t> coverage(n_samples);
+    size_t last_row = row_of(end - 1);
+    for (size_t row = row_of(start); row <= last_row; ) {
+        size_t block = row / block_rows;
+        load_block(block, block_values);
+        size_t block_end = min(last_row + 1, (block + 1) * block_rows);
+        for (; row < block_end; row++) {
+            auto row_values = block_values.begin() + (row - block * block_rows) * n_samples;
+            copy(row_values, row_values + n_samples, coverage.begin());
+            lambda(row, coverage);
+        }
+    }
+}
+
+void CoverageMatrix::for_each_path_position(const xg::XG& xg_index, const string& path_name, size_t start, size_t end,
+                                            const function<void(size_t offset, size_t row,
+                                                                const vector<uint32_t>& coverage)>& lambda) const {
+    if (xg_index.path_rank(path_name) == 0) {
+        throw runtime_error("[CoverageMatrix] path " + path_name + " is not in the index");
+    }
+    end = min(end, xg_index.path_length(path_name));
+
+    size_t n_samples = names.size();
+    vector<uint32_t> block_values;
+    size_t loaded_block = blocks;
+    vector<uint32_t> coverage(n_samples);
+    for (size_t offset = start; offset < end; ) {
+        // walk the rest of this node visit
+        pos_t pos = xg_index.graph_pos_at_path_position(path_name, offset);
+        size_t node_length = xg_index.node_length(id(pos));
+        size_t node_start = xg_index.node_start(id(pos));
+        size_t visit_end = min(end, offset - vg::offset(pos) + node_length);
+        for (size_t node_offset = vg::offset(pos); offset < visit_end; offset++, node_offset++) {
+            size_t graph_position = node_start + (is_rev(pos) ? node_length - node_offset - 1 : node_offset);
+            size_t row = row_of(graph_position);
+            if (row >= rows) {
+                throw runtime_error("[CoverageMatrix] path " + path_name + " leaves the graph the coverage is for");
+            }
+            size_t block = row / block_rows;
+            if (block != loaded_block) {
+                load_block(block, block_values);
+                loaded_block = block;
+            }
+            auto row_values = block_values.begin() + (row - block * block_rows) * n_samples;
+            copy(row_values, row_values + n_samples, coverage.begin());
+            lambda(offset, row, coverage);
+        }
+    }
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef VG_COVERAGE_MATRIX_HPP_INCLUDED
+#define VG_COVERAGE_MATRIX_HPP_INCLUDED
+
+/**
+ * \file coverage_matrix.hpp
+ *
+ * A merged store of graph coverage for many samples, built once from their
+ * Packer files, so coverage can be compared across a population without
+ * loading every pack.
+ *
+ * The graph's sequence positions are grouped into rows of bin_size bases,
+ * and each row holds the summed coverage of each sample. Rows are stored in
+ * blocks, and each block of each sample is stored as zlib-compressed varints
+ * of the differences between successive rows. The file is memory-mapped for
+ * reading, and a query only inflates the blocks it touches.
+ *
+ * The file starts with the magic bytes "VGCOVMAT", and then, all as
+ * little-endian 64-bit integers: the version, the sample count, the graph
+ * length, the bin size, the rows per block, the row count and the block
+ * count. After those come the sample names, each as a 64-bit length and its
+ * bytes, and then the offsets of every sample's blocks, sample by sample,
+ * measured from the end of the offsets, with one more offset to mark the end
+ * of the last block.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "xg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class CoverageMatrix {
+public:
+
+    /// The default number of rows in a block
+    static const size_t DEFAULT_ROWS_PER_BLOCK = 4096;
+
+    /// Build a matrix file out of the given Packer files, one sample each,
+    /// named after their files. The packs are read in parallel, and must
+    /// all be for the same graph. Throws runtime_error if a pack can't be
+    /// read, or the packs disagree about the graph length.
+    static void build(const vector<string>& pack_file_names, const string& out_file_name,
+                      size_t bin_size = 1, size_t rows_per_block = DEFAULT_ROWS_PER_BLOCK);
+
+    /// Open a matrix file for queries. Throws runtime_error if the file can't
+    /// be mapped or isn't a coverage matrix.
+    CoverageMatrix(const string& file_name);
+
+    // We hold a mapping, so we can't be copied.
+    CoverageMatrix(const CoverageMatrix& other) = delete;
+    CoverageMatrix& operator=(const CoverageMatrix& other) = delete;
+
+    /// Get the number of samples
+    size_t sample_count() const;
+
+    /// Get the name of the sample in the given column
+    const string& sample_name(size_t sample) const;
+
+    /// Get the number of graph sequence positions covered
+    size_t graph_length() const;
+
+    /// Get the number of graph sequence positions summed into each row
+    size_t bin_size() const;
+
+    /// Get the number of rows
+    size_t row_count() const;
+
+    /// Get the row holding a graph sequence position, as Packer numbers them
+    size_t row_of(size_t position) const;
+
+    /// Call the callback with the row number and the coverage of each sample,
+    /// for each row holding any of the graph sequence positions from start to
+    /// before end. Safe to call from many threads at once.
+    void for_each_row(size_t start, size_t end,
+                      const function<void(size_t row, const vector<uint32_t>& coverage)>& lambda) const;
+
+    /// Call the callback with the path offset, the row of the graph position
+    /// there, and the coverage of each sample in that row, for each path
+    /// offset from start to before end. With bins of more than one base, each
+    /// offset reports the coverage of its whole bin. Throws runtime_error if
+    /// the path isn't in the index.
+    void for_each_path_position(const xg::XG& xg_index, const string& path_name, size_t start, size_t end,
+                                const function<void(size_t offset, size_t row,
+                                                    const vector<uint32_t>& coverage)>& lambda) const;
+
+private:
+
+    /// Inflate one block of every sample, row by row, with a column for each
+    /// sample.
+    void load_block(size_t block, vector<uint32_t>& rows) const;
+
+    MappedFileBuffer file;
+    vector<string> names;
+    size_t length = 0;
+    size_t bin = 1;
+    size_t block_rows = DEFAULT_ROWS_PER_BLOCK;
+    size_t rows = 0;
+    size_t blocks = 0;
+    /// Where the block offsets are in the file
+    const char* offsets = nullptr;
+    /// Where the blocks start in the file
+    const char* block_data = nullptr;
+};
+
+}
+
+#endif
@@ -26,14 +26,16 @@ namespace vg {
 
         bool normalize_indels = false;
 
-        // Check if we have a PathIndex for this path
-        bool path_indexed = pindexes.find(refpath) != pindexes.end();
+        // Check if we have a PathIndex for this path. This may run on several
+        // threads at once, so we must not insert into any maps.
+        auto pindex = pindexes.find(refpath);
+        bool path_indexed = pindex != pindexes.end();
         for (auto t : travs){
             stringstream t_allele;
 
             // Get ref path index
             if (path_indexed){
-                PathIndex* pind = pindexes[refpath];
+                PathIndex* pind = pindex->second;
                 // Check nodes of traversals Visits
                 // if they're all on the ref path,
                 // then this Snarltraversal is the ref allele.
@@ -102,8 +104,12 @@ namespace vg {
                     SnarlTraversal t = ordered_traversals[i];
                     id_t start_id = t.visit(0).node_id();
                     id_t end_id = t.visit(t.visit_size() - 1).node_id();
-                    pair<size_t, bool> pos_orientation_start = pindexes[refpath]->by_id[start_id];
-                    pair<size_t, bool> pos_orientation_end = pindexes[refpath]->by_id[end_id];
+                    auto start_found = pindex->second->by_id.find(start_id);
+                    auto end_found = pindex->second->by_id.find(end_id);
+                    pair<size_t, bool> pos_orientation_start = start_found == pindex->second->by_id.end() ?
+                        make_pair((size_t) 0, false) : start_found->second;
+                    pair<size_t, bool> pos_orientation_end = end_found == pindex->second->by_id.end() ?
+                        make_pair((size_t) 0, false) : end_found->second;
                     bool use_start = pos_orientation_start.first < pos_orientation_end.first;
                     bool rev = use_start ? pos_orientation_start.second : pos_orientation_end.second;
                     string pre_node_seq = use_start ? graph->get_node(start_id)->sequence() :
@@ -116,7 +122,7 @@ namespace vg {
 
     }
 
-    void Deconstructor::deconstruct(string refpath, vg::VG* graph){
+    void Deconstructor::deconstruct(string refpath, vg::VG* graph, SnarlManager* snarl_manager){
         
      
 
@@ -124,6 +130,12 @@ namespace vg {
         if (pindexes.find(refpath) == pindexes.end()){
             pindexes[refpath] = new PathIndex(*graph, refpath, false);
         }
+        // The workers only read the index, so look it up once here
+        PathIndex* pind = pindexes[refpath];
+        auto path_position = [&](id_t node_id) {
+            auto found = pind->by_id.find(node_id);
+            return found == pind->by_id.end() ? make_pair((size_t) 0, false) : found->second;
+        };
 
         // Spit header
         // Set contig to refpath
@@ -145,18 +157,29 @@ namespace vg {
             this->headered = true;
         }
 
-        // Find snarls
+        // Find snarls, unless we were given them
         // Snarls are variant sites ("bubbles")
-        SnarlFinder* snarl_finder = new CactusSnarlFinder(*graph, refpath);
-        SnarlManager snarl_manager = snarl_finder->find_snarls();
-        vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
-        TraversalFinder* trav_finder = new ExhaustiveTraversalFinder(*graph, snarl_manager);
-        for (const Snarl* snarl: snarl_roots){
+        SnarlManager found_snarls;
+        if (snarl_manager == nullptr) {
+            CactusSnarlFinder snarl_finder(*graph, refpath);
+            found_snarls = snarl_finder.find_snarls();
+            snarl_manager = &found_snarls;
+        }
+        vector<const Snarl*> snarl_roots = snarl_manager->top_level_snarls();
+        ExhaustiveTraversalFinder trav_finder(*graph, *snarl_manager);
+
+        // Each top level snarl's VCF record and position, in snarl order. Empty
+        // records are for skipped snarls.
+        vector<pair<size_t, string>> records(snarl_roots.size());
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t snarl_num = 0; snarl_num < snarl_roots.size(); snarl_num++){
             // For each top level snarl
+            const Snarl* snarl = snarl_roots[snarl_num];
             
             // Except the trivial ones
             if (snarl->type() == ULTRABUBBLE) {
-                auto contents = snarl_manager.shallow_contents(snarl, *graph, false);
+                auto contents = snarl_manager->shallow_contents(snarl, *graph, false);
                 if (contents.first.empty()) {
                     // Nothing but the boundary nodes in this snarl
                     continue;
@@ -165,12 +188,12 @@ namespace vg {
             
             vcflib::Variant v;
             // SnarlTraversals are the (possible) alleles of our variant site.
-            vector<SnarlTraversal> travs = trav_finder->find_traversals(*snarl);
+            vector<SnarlTraversal> travs = trav_finder.find_traversals(*snarl);
             // write variant's sequenceName (VCF contig)
             v.sequenceName = refpath;
             // Set position based on the lowest position in the snarl.
-            pair<size_t, bool> pos_orientation_start = pindexes[refpath]->by_id[snarl->start().node_id()];
-            pair<size_t, bool> pos_orientation_end = pindexes[refpath]->by_id[snarl->end().node_id()];
+            pair<size_t, bool> pos_orientation_start = path_position(snarl->start().node_id());
+            pair<size_t, bool> pos_orientation_end = path_position(snarl->end().node_id());
             bool use_start = pos_orientation_start.first < pos_orientation_end.first;
             size_t node_pos = (use_start ? pos_orientation_start.first : pos_orientation_end.first);
             v.position = node_pos +(use_start ? graph->get_node(snarl->start().node_id())->sequence().length() : graph->get_node(snarl->end().node_id())->sequence().length());
@@ -184,6 +207,7 @@ namespace vg {
                 }
             }
             else{
+#pragma omp critical (cerr)
                 cerr << "NO REFERENCE ALLELE FOUND" << endl;
                 v.alleles.insert(v.alleles.begin(), ".");
                 for (int i = 0; i < t_alleles.second.size(); i++){
@@ -192,20 +216,30 @@ namespace vg {
                 }
             }
             v.updateAlleleIndexes();
-            cout << v << endl;
+            stringstream record;
+            record << v;
+            records[snarl_num] = make_pair((size_t) v.position, record.str());
+        }
 
+        // Emit the records sorted by position along the reference
+        stable_sort(records.begin(), records.end(), [](const pair<size_t, string>& a, const pair<size_t, string>& b) {
+            return a.first < b.first;
+        });
+        for (auto& record : records){
+            if (!record.second.empty()){
+                cout << record.second << endl;
+            }
         }
-        
 
     }
 
     /**
     * Convenience wrapper function for deconstruction of multiple paths.
     */
-    void Deconstructor::deconstruct(vector<string> ref_paths, vg::VG* graph){
+    void Deconstructor::deconstruct(vector<string> ref_paths, vg::VG* graph, SnarlManager* snarl_manager){
 
         for (auto path : ref_paths){
-            deconstruct(path, graph);
+            deconstruct(path, graph, snarl_manager);
         }
 
     }
@@ -34,8 +34,11 @@ namespace vg{
             ~Deconstructor();
             pair<bool, vector<string> > get_alleles(vector<SnarlTraversal> travs, string refpath, vg::VG* graph);
 
-            void deconstruct(string refpath, vg::VG* graph);
-            void deconstruct(vector<string> refpaths, vg::VG* graph); 
+            /// Write VCF records for the top level snarls, sorted by position on
+            /// the reference path. Snarls are processed on all OMP threads.
+            /// If no snarls are given, they are found with Cactus.
+            void deconstruct(string refpath, vg::VG* graph, SnarlManager* snarl_manager = nullptr);
+            void deconstruct(vector<string> refpaths, vg::VG* graph, SnarlManager* snarl_manager = nullptr);
             map<string, PathIndex*> pindexes;
 
         private:
@@ -6,6 +6,8 @@
 
 #include <map>
 #include <cmath>
+#include <random>
+#include <vector>
 
 #include "utility.hpp"
 
@@ -466,6 +468,88 @@ real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const
     return logprob_sum(case_logprobs);
 }
 
+/**
+ * Draws indexes in proportion to a set of nonnegative weights in constant
+ * time per draw, using Vose's alias method. Building the table takes time
+ * linear in the number of weights, after which sampling cost does not depend
+ * on how many there are. Like std::discrete_distribution, an empty or all-zero
+ * set of weights samples uniformly (and an empty one always gives 0).
+ */
+class AliasTable {
+public:
+    
+    /// Make a table that always draws 0
+    AliasTable() : probability{1.0}, alias{0} {
+        // Nothing to do
+    }
+    
+    /// Make a table for the weights in the given range
+    template<typename Iter>
+    AliasTable(Iter begin, Iter end) {
+        vector<double> scaled(begin, end);
+        if (scaled.empty()) {
+            scaled.push_back(1.0);
+        }
+        size_t n = scaled.size();
+        double total = 0.0;
+        for (double weight : scaled) {
+            total += weight;
+        }
+        for (double& weight : scaled) {
+            // Scale so that the average weight is 1
+            weight = total > 0.0 ? weight * n / total : 1.0;
+        }
+        
+        probability.resize(n);
+        alias.resize(n);
+        vector<size_t> small;
+        vector<size_t> large;
+        for (size_t i = 0; i < n; i++) {
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            // Fill out the column of an under-weight index with an over-weight one
+            size_t under = small.back();
+            small.pop_back();
+            size_t over = large.back();
+            probability[under] = scaled[under];
+            alias[under] = over;
+            scaled[over] -= 1.0 - scaled[under];
+            if (scaled[over] < 1.0) {
+                large.pop_back();
+                small.push_back(over);
+            }
+        }
+        // Whatever is left is full, up to rounding error
+        for (size_t i : large) {
+            probability[i] = 1.0;
+            alias[i] = i;
+        }
+        for (size_t i : small) {
+            probability[i] = 1.0;
+            alias[i] = i;
+        }
+    }
+    
+    /// Get the number of indexes that can be drawn
+    size_t size() const {
+        return probability.size();
+    }
+    
+    /// Draw an index using the given random number generator
+    template<typename Generator>
+    size_t operator()(Generator& generator) const {
+        size_t column = uniform_int_distribution<size_t>(0, probability.size() - 1)(generator);
+        return uniform_real_distribution<double>(0.0, 1.0)(generator) < probability[column] ? column : alias[column];
+    }
+    
+private:
+    /// The chance of keeping each column's own index
+    vector<double> probability;
+    /// The index each column gives otherwise
+    vector<size_t> alias;
+};
+
 }
 
 #endif
@@ -9,18 +9,99 @@ double entropy(const string& st) {
 }
 
 double entropy(const char* st, size_t len) {
-    map<char, int> freqs;
+    array<size_t, 256> freqs;
+    freqs.fill(0);
     for (size_t i = 0; i < len; ++i) {
-        ++freqs[st[i]];
+        ++freqs[(unsigned char) st[i]];
     }
     double ent = 0;
     double ln2 = log(2);
     for (auto& f : freqs) {
-        double freq = (double)f.second/len;
+        if (f == 0) {
+            continue;
+        }
+        double freq = (double)f/len;
         ent += freq * log(freq)/ln2;
     }
     ent = -ent;
     return ent;
 }
 
+SlidingWindowEntropy::SlidingWindowEntropy(size_t max_window_size) : count_log_table(max_window_size + 1, 0.0) {
+    counts.fill(0);
+    for (size_t i = 2; i <= max_window_size; i++) {
+        count_log_table[i] = i * log2((double) i);
+    }
+}
+
+void SlidingWindowEntropy::add(char c) {
+    size_t& count = counts[(unsigned char) c];
+    count_log_sum += count_log_table[count + 1] - count_log_table[count];
+    ++count;
+    ++window_size;
+}
+
+void SlidingWindowEntropy::remove(char c) {
+    size_t& count = counts[(unsigned char) c];
+    count_log_sum += count_log_table[count - 1] - count_log_table[count];
+    --count;
+    --window_size;
+}
+
+size_t SlidingWindowEntropy::size() const {
+    return window_size;
+}
+
+double SlidingWindowEntropy::entropy() const {
+    if (window_size == 0) {
+        return 0;
+    }
+    // -sum(c/n * log2(c/n)) = log2(n) - sum(c * log2(c)) / n
+    // Rounding error in the running sum can make this a hair negative.
+    return max(0.0, log2((double) window_size) - count_log_sum / window_size);
+}
+
+vector<double> window_entropies(const char* seq, size_t len, size_t window) {
+    window = min(window, len);
+    vector<double> entropies;
+    if (window == 0) {
+        return entropies;
+    }
+    entropies.reserve(len - window + 1);
+    SlidingWindowEntropy tracker(window);
+    for (size_t i = 0; i < window; i++) {
+        tracker.add(seq[i]);
+    }
+    entropies.push_back(tracker.entropy());
+    for (size_t i = window; i < len; i++) {
+        tracker.remove(seq[i - window]);
+        tracker.add(seq[i]);
+        entropies.push_back(tracker.entropy());
+    }
+    return entropies;
+}
+
+vector<bool> low_complexity_mask(const char* seq, size_t len, size_t window, double min_entropy) {
+    vector<bool> mask(len, false);
+    window = min(window, len);
+    vector<double> entropies = window_entropies(seq, len, window);
+    // Windows are visited in order, so we only need to know how far the
+    // masking already reaches to mark each base once.
+    size_t masked_to = 0;
+    for (size_t i = 0; i < entropies.size(); i++) {
+        if (entropies[i] < min_entropy) {
+            for (size_t j = max(i, masked_to); j < i + window; j++) {
+                mask[j] = true;
+            }
+            masked_to = i + window;
+        }
+    }
+    return mask;
+}
+
+size_t low_complexity_length(const string& seq, size_t window, double min_entropy) {
+    vector<bool> mask = low_complexity_mask(seq.c_str(), seq.size(), window, min_entropy);
+    return count(mask.begin(), mask.end(), true);
+}
+
 }
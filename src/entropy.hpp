@@ -7,6 +7,8 @@
 #include <string>
 #include <cmath>
 #include <map>
+#include <array>
+#include <algorithm>
 
 namespace vg {
 
@@ -15,6 +17,59 @@ using namespace std;
 double entropy(const string& st);
 double entropy(const char* st, size_t len);
 
+/**
+ * Tracks the Shannon entropy, in bits, of a window of characters as
+ * characters enter and leave it, in constant time per character, instead of
+ * recounting the whole window each time it moves.
+ */
+class SlidingWindowEntropy {
+public:
+    /// Make a tracker for windows of up to the given number of characters.
+    SlidingWindowEntropy(size_t max_window_size);
+
+    /// Add a character to the window.
+    void add(char c);
+
+    /// Remove a character, which must be in the window, from it.
+    void remove(char c);
+
+    /// Get the number of characters in the window.
+    size_t size() const;
+
+    /// Get the entropy of the characters in the window. An empty window has
+    /// entropy 0.
+    double entropy() const;
+
+private:
+    /// How many of each character are in the window
+    array<size_t, 256> counts;
+    /// The number of characters in the window
+    size_t window_size = 0;
+    /// The sum of count * log2(count) over all characters
+    double count_log_sum = 0;
+    /// count * log2(count) for each count up to the maximum window size
+    vector<double> count_log_table;
+};
+
+/**
+ * Get the entropy of each window of the given size along a sequence, in
+ * order of start position. If the sequence is shorter than the window, the
+ * entropy of the whole sequence is returned. Takes O(n) time.
+ */
+vector<double> window_entropies(const char* seq, size_t len, size_t window);
+
+/**
+ * Mark each base of a sequence that falls in at least one window of the given
+ * size with entropy below min_entropy. If the sequence is shorter than the
+ * window, the whole sequence is judged as one window. Takes O(n) time.
+ */
+vector<bool> low_complexity_mask(const char* seq, size_t len, size_t window, double min_entropy);
+
+/**
+ * Count the bases of a sequence that low_complexity_mask() would mark.
+ */
+size_t low_complexity_length(const string& seq, size_t window, double min_entropy);
+
 }
 
 #endif
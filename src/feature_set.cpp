@@ -1,6 +1,8 @@
 #include "feature_set.hpp"
 
 #include <sstream>
+#include <algorithm>
+#include <limits>
 
 namespace vg {
 
@@ -34,7 +36,7 @@ void FeatureSet::load_bed(istream& in) {
         
         // TODO: extra data
         
-        features[feature.path_name].push_back(feature);
+        features[feature.path_name].add(feature);
         
     }
 }
@@ -42,115 +44,347 @@ void FeatureSet::load_bed(istream& in) {
 void FeatureSet::save_bed(ostream& out) const {
     for (auto& kv : features) {
         // For all the contigs
-        for (auto& feature : kv.second) {
+        for (auto& feature : kv.second.get()) {
             // For all the features, dump each one
             out << feature.path_name << "\t" << feature.first << "\t" << feature.last << "\t" << feature.feature_name << endl;
         }
     }
 }
 
-void FeatureSet::on_path_edit(const string& path, size_t start, size_t old_length, size_t new_length) {
-#ifdef debug
-    cerr << "Edit at " << path << " " << start << " from length " << old_length << " to length " << new_length << endl;
-#endif
-
-    // Grab the path vector so we can erase if necessary
-    auto& path_features = features[path];
-    bool erase = false;
-    for (auto i = path_features.begin(); i != path_features.end(); i = (erase ? path_features.erase(i) : ++i)) {
-        // Go through all the features on the path
-        auto& feature = *i;
-        
-        // Set to true to erase the feature we are on
-        erase = false;
-        
-        if (feature.last < start) {
-            // If the feature ends before the start of the edit, do nothing
-            continue;
-        }
-        
-        if (feature.first <= start) {
-            // Else if it starts at or before the start of the edit
+/// Update a single feature for an edit, as described for
+/// FeatureSet::on_path_edit(). Returns false if the feature should be deleted.
+static bool update_feature(FeatureSet::Feature& feature, size_t start, size_t old_length, size_t new_length) {
+    if (feature.last < start) {
+        // If the feature ends before the start of the edit, do nothing
+        return true;
+    }
+    
+    if (feature.first <= start) {
+        // Else if it starts at or before the start of the edit
+    
         
+    
+        if (feature.last + 1 < start + old_length) {
+            // If it ends before the end of the edit
             
-        
-            if (feature.last + 1 < start + old_length) {
-                // If it ends before the end of the edit
-                
-                if (feature.first < start) {
-                    // And actually started before the edit
-                    
-                    // Do some weird interpolation on its end
-                    // TODO: interpolate end
-                    // Clip for now
-                    feature.last = start - 1;
+            if (feature.first < start) {
+                // And actually started before the edit
                 
+                // Do some weird interpolation on its end
+                // TODO: interpolate end
+                // Clip for now
+                feature.last = start - 1;
+            
 #ifdef debug
-                    cerr << "\tRight clip feature " << feature.feature_name << " to "
-                        << feature.first << " - " << feature.last << endl;
-#endif
-                } else {
-                    // It ends before the edit ends but started at the start of
-                    // the edit. We ought to still interpolate, but we're just
-                    // going to delete it. TODO: interpolate end.
-                    
-#ifdef debug
-                    cerr << "\tDelete feature " << feature.feature_name << endl;
+                cerr << "\tRight clip feature " << feature.feature_name << " to "
+                    << feature.first << " - " << feature.last << endl;
 #endif
-                    erase = true;
-                    continue;
-                }
             } else {
-                // If it ends at or after the end of the edit, shift its end up or down by the length difference
-                feature.last += ((int64_t) new_length - (int64_t) old_length);
+                // It ends before the edit ends but started at the start of
+                // the edit. We ought to still interpolate, but we're just
+                // going to delete it. TODO: interpolate end.
                 
 #ifdef debug
-                cerr << "\tShift end of feature " << feature.feature_name << " by "
-                    << ((int64_t) new_length - (int64_t) old_length) << endl;
+                cerr << "\tDelete feature " << feature.feature_name << endl;
 #endif
+                return false;
             }
+        } else {
+            // If it ends at or after the end of the edit, shift its end up or down by the length difference
+            feature.last += ((int64_t) new_length - (int64_t) old_length);
             
-        } else if (feature.first < start + old_length) {
-            // Else if it starts after the start of the edit and before or at the end of the edit
-            
-            if (feature.last + 1 >= start + old_length) {
-                // If it ends after the end of the edit, do some weird
-                // interpolation on the start, and shift the end up or down by
-                // the length difference. TODO: interpolate start
-                
-                // Clip for now
-                feature.first = start + new_length;
-                
-                // Adjust end
-                feature.last += ((int64_t) new_length - (int64_t) old_length);
-                
 #ifdef debug
-                cerr << "\tLeft clip and shift feature " << feature.feature_name << " to "
-                    << feature.first << " - " << feature.last << endl;
+            cerr << "\tShift end of feature " << feature.feature_name << " by "
+                << ((int64_t) new_length - (int64_t) old_length) << endl;
 #endif
-            } else {
-                // If it ends at or before the end of the edit, do weird interpolation on the start and end (or just delete it)
-                // TODO: interpolate start and end
-                // Clip for now
+        }
+        
+    } else if (feature.first < start + old_length) {
+        // Else if it starts after the start of the edit and before or at the end of the edit
+        
+        if (feature.last + 1 >= start + old_length) {
+            // If it ends after the end of the edit, do some weird
+            // interpolation on the start, and shift the end up or down by
+            // the length difference. TODO: interpolate start
+            
+            // Clip for now
+            feature.first = start + new_length;
+            
+            // Adjust end
+            feature.last += ((int64_t) new_length - (int64_t) old_length);
+            
 #ifdef debug
-                cerr << "\tDelete feature " << feature.feature_name << endl;
+            cerr << "\tLeft clip and shift feature " << feature.feature_name << " to "
+                << feature.first << " - " << feature.last << endl;
 #endif
-                erase = true;
-                continue;
-            }
         } else {
-            feature.first += ((int64_t) new_length - (int64_t) old_length);
-            feature.last += ((int64_t) new_length - (int64_t) old_length);
+            // If it ends at or before the end of the edit, do weird interpolation on the start and end (or just delete it)
+            // TODO: interpolate start and end
+            // Clip for now
 #ifdef debug
-            // Else if it starts after the end of the edit, shift its start and end up or down by the length difference
-            cerr << "\tShift feature " << feature.feature_name << " by " << ((int64_t) new_length - (int64_t) old_length) << endl;
+            cerr << "\tDelete feature " << feature.feature_name << endl;
 #endif
+            return false;
         }
+    } else {
+        feature.first += ((int64_t) new_length - (int64_t) old_length);
+        feature.last += ((int64_t) new_length - (int64_t) old_length);
+#ifdef debug
+        // Else if it starts after the end of the edit, shift its start and end up or down by the length difference
+        cerr << "\tShift feature " << feature.feature_name << " by " << ((int64_t) new_length - (int64_t) old_length) << endl;
+#endif
+    }
+    return true;
+}
+
+void FeatureSet::on_path_edit(const string& path, size_t start, size_t old_length, size_t new_length) {
+#ifdef debug
+    cerr << "Edit at " << path << " " << start << " from length " << old_length << " to length " << new_length << endl;
+#endif
+
+    auto found = features.find(path);
+    if (found != features.end()) {
+        found->second.edit(start, old_length, new_length);
     }
 }
 
 const vector<FeatureSet::Feature>& FeatureSet::get_features(const string& path) const {
-    return features.at(path);
+    return features.at(path).get();
+}
+
+bool FeatureSet::has_features(const string& path) const {
+    auto found = features.find(path);
+    return found != features.end() && !found->second.empty();
+}
+
+const int64_t FeatureSet::PathFeatures::DELETED = numeric_limits<int64_t>::min() / 4;
+
+void FeatureSet::PathFeatures::add(const Feature& feature) {
+    if (built) {
+        flatten();
+    }
+    features.push_back(feature);
+    deleted.push_back(false);
+    live_count++;
+    live_stale = true;
+}
+
+bool FeatureSet::PathFeatures::empty() const {
+    return live_count == 0;
+}
+
+const vector<FeatureSet::Feature>& FeatureSet::PathFeatures::get() const {
+    if (live_stale) {
+        if (built) {
+            sync(1, 0, order.size(), 0);
+        }
+        live.clear();
+        for (size_t i = 0; i < features.size(); i++) {
+            if (!deleted[i]) {
+                live.push_back(features[i]);
+            }
+        }
+        live_stale = false;
+    }
+    return live;
+}
+
+void FeatureSet::PathFeatures::edit(size_t start, size_t old_length, size_t new_length) {
+    if (live_count == 0) {
+        return;
+    }
+    if (!built) {
+        build();
+    }
+    
+    // Features that start after the edited region (and, for pure insertions,
+    // after its start) just move. Everything before them that reaches the
+    // edit needs to be looked at on its own.
+    size_t count = order.size();
+    size_t first_after = first_starting_at(max(start + old_length, start + 1));
+    for_each_overlapping(1, 0, count, first_after, start, [&](size_t i) {
+        Feature& feature = features[order[i]];
+        feature.first = leaf_start[i];
+        feature.last = leaf_end[i];
+        if (update_feature(feature, start, old_length, new_length)) {
+            leaf_start[i] = feature.first;
+            leaf_end[i] = feature.last;
+        } else {
+            deleted[order[i]] = true;
+            live_count--;
+            leaf_end[i] = DELETED;
+            // Keep the start where a clipped feature would have gone, so
+            // starts stay sorted.
+            if (leaf_start[i] > (int64_t) start) {
+                leaf_start[i] = start + new_length;
+            }
+        }
+    });
+    
+    int64_t delta = (int64_t) new_length - (int64_t) old_length;
+    if (delta != 0) {
+        shift_range(1, 0, count, first_after, count, delta);
+    }
+    live_stale = true;
+}
+
+void FeatureSet::PathFeatures::build() {
+    size_t count = features.size();
+    order.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return features[a].first < features[b].first;
+    });
+    
+    leaf_start.resize(count);
+    leaf_end.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        leaf_start[i] = features[order[i]].first;
+        leaf_end[i] = deleted[order[i]] ? DELETED : (int64_t) features[order[i]].last;
+    }
+    
+    max_end.assign(4 * count, DELETED);
+    shift.assign(4 * count, 0);
+    function<void(size_t, size_t, size_t)> fill = [&](size_t node, size_t low, size_t high) {
+        if (high - low == 1) {
+            max_end[node] = leaf_end[low];
+            return;
+        }
+        size_t mid = (low + high) / 2;
+        fill(2 * node, low, mid);
+        fill(2 * node + 1, mid, high);
+        max_end[node] = max(max_end[2 * node], max_end[2 * node + 1]);
+    };
+    fill(1, 0, count);
+    
+    built = true;
+}
+
+void FeatureSet::PathFeatures::sync(size_t node, size_t low, size_t high, int64_t pending) const {
+    if (high - low == 1) {
+        Feature& feature = features[order[low]];
+        feature.first = leaf_start[low] + pending;
+        if (!deleted[order[low]]) {
+            feature.last = leaf_end[low] + pending;
+        }
+        return;
+    }
+    size_t mid = (low + high) / 2;
+    sync(2 * node, low, mid, pending + shift[node]);
+    sync(2 * node + 1, mid, high, pending + shift[node]);
+}
+
+void FeatureSet::PathFeatures::flatten() {
+    sync(1, 0, order.size(), 0);
+    
+    // Drop the deleted features, keeping the load order
+    size_t kept = 0;
+    for (size_t i = 0; i < features.size(); i++) {
+        if (!deleted[i]) {
+            features[kept++] = move(features[i]);
+        }
+    }
+    features.resize(kept);
+    deleted.assign(kept, false);
+    
+    order.clear();
+    leaf_start.clear();
+    leaf_end.clear();
+    max_end.clear();
+    shift.clear();
+    built = false;
+}
+
+int64_t FeatureSet::PathFeatures::start_at(size_t i) const {
+    int64_t pending = 0;
+    size_t node = 1;
+    size_t low = 0;
+    size_t high = order.size();
+    while (high - low > 1) {
+        pending += shift[node];
+        size_t mid = (low + high) / 2;
+        if (i < mid) {
+            node = 2 * node;
+            high = mid;
+        } else {
+            node = 2 * node + 1;
+            low = mid;
+        }
+    }
+    return leaf_start[i] + pending;
+}
+
+size_t FeatureSet::PathFeatures::first_starting_at(int64_t position) const {
+    // Starts are sorted, so we can binary search.
+    size_t low = 0;
+    size_t high = order.size();
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (start_at(mid) < position) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void FeatureSet::PathFeatures::apply_shift(size_t node, size_t low, size_t high, int64_t amount) {
+    if (high - low == 1) {
+        leaf_start[low] += amount;
+        if (!deleted[order[low]]) {
+            leaf_end[low] += amount;
+            max_end[node] = leaf_end[low];
+        }
+    } else {
+        shift[node] += amount;
+        max_end[node] += amount;
+    }
+}
+
+void FeatureSet::PathFeatures::push(size_t node, size_t low, size_t high) {
+    if (shift[node] != 0) {
+        size_t mid = (low + high) / 2;
+        apply_shift(2 * node, low, mid, shift[node]);
+        apply_shift(2 * node + 1, mid, high, shift[node]);
+        shift[node] = 0;
+    }
+}
+
+void FeatureSet::PathFeatures::shift_range(size_t node, size_t low, size_t high, size_t left, size_t right,
+                                           int64_t amount) {
+    if (right <= low || high <= left) {
+        return;
+    }
+    if (left <= low && high <= right) {
+        apply_shift(node, low, high, amount);
+        return;
+    }
+    push(node, low, high);
+    size_t mid = (low + high) / 2;
+    shift_range(2 * node, low, mid, left, right, amount);
+    shift_range(2 * node + 1, mid, high, left, right, amount);
+    max_end[node] = max(max_end[2 * node], max_end[2 * node + 1]);
+}
+
+void FeatureSet::PathFeatures::for_each_overlapping(size_t node, size_t low, size_t high, size_t right,
+                                                    int64_t min_end, const function<void(size_t)>& iteratee) {
+    // All our ancestors have been pushed, so max_end is true here.
+    if (low >= right || max_end[node] < min_end) {
+        return;
+    }
+    if (high - low == 1) {
+        iteratee(low);
+        max_end[node] = leaf_end[low];
+        return;
+    }
+    push(node, low, high);
+    size_t mid = (low + high) / 2;
+    for_each_overlapping(2 * node, low, mid, right, min_end, iteratee);
+    for_each_overlapping(2 * node + 1, mid, high, right, min_end, iteratee);
+    max_end[node] = max(max_end[2 * node], max_end[2 * node + 1]);
 }
 
 }
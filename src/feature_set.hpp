@@ -11,6 +11,7 @@
 #include <vector>
 #include <map>
 #include <iostream>
+#include <functional>
  
 namespace vg {
 
@@ -69,20 +70,108 @@ public:
      *
      * Updates the contained features that need to change.
      *
-     * Note that this is currently O(n) in features on the path. TODO: come up
-     * with a truly efficient algorithm to back this using some kind of skip
-     * list or rope or something.
+     * Takes O((k + 1) log n) time for n features on the path, k of which
+     * overlap the edit. Features after the edit are shifted lazily.
      */
     void on_path_edit(const string& path, size_t start, size_t old_length, size_t new_length);
     
     /**
-     * Get the features on a path. Generally used for testing.
+     * Get the features on a path, in the order they were loaded. Generally
+     * used for testing. Takes O(n) time the first time it is called after an
+     * edit.
      */
     const vector<Feature>& get_features(const string& path) const;
+    
+    /**
+     * Return true if there are any features on the given path, and false
+     * otherwise.
+     */
+    bool has_features(const string& path) const;
 
 private:
+
+    /**
+     * Holds the features on one path. Once edits start coming in, the
+     * features are kept in a segment tree in order of their start positions
+     * (which edits never reorder), with each tree node knowing the greatest
+     * end position under it. That lets us find just the features overlapping
+     * an edit, and shift everything after it with one lazy range update.
+     */
+    class PathFeatures {
+    public:
+        /// Add a feature at the end of the load order.
+        void add(const Feature& feature);
+        
+        /// Apply an edit, as described for on_path_edit().
+        void edit(size_t start, size_t old_length, size_t new_length);
+        
+        /// Get the surviving features, with up to date positions, in load
+        /// order.
+        const vector<Feature>& get() const;
+        
+        /// Return true if no features survive.
+        bool empty() const;
+        
+    private:
+        /// Stand-in end for deleted features, so they never overlap an edit.
+        static const int64_t DELETED;
+    
+        /// All the features ever added, in load order. Positions are only up
+        /// to date when the tree is not built.
+        mutable vector<Feature> features;
+        /// Whether each feature has been deleted by an edit.
+        vector<bool> deleted;
+        /// Number of features not deleted.
+        size_t live_count = 0;
+        
+        /// Is the tree built? If not, positions in features are current.
+        bool built = false;
+        /// Feature indexes, in order of start position. Leaf i of the tree is
+        /// feature order[i].
+        vector<size_t> order;
+        /// Start and end positions at the leaves, with any lazy shifts still
+        /// pending in their ancestors not applied.
+        vector<int64_t> leaf_start;
+        vector<int64_t> leaf_end;
+        /// Greatest end under each tree node, including that node's pending
+        /// shift, but not those of its ancestors.
+        vector<int64_t> max_end;
+        /// Shift pending for everything under each internal tree node.
+        vector<int64_t> shift;
+        
+        /// Surviving features in load order, as handed out by get().
+        mutable vector<Feature> live;
+        /// Is live out of date?
+        mutable bool live_stale = true;
+        
+        /// Build the tree from the positions in features.
+        void build();
+        /// Write the true positions from the tree back into features.
+        void sync(size_t node, size_t low, size_t high, int64_t pending) const;
+        /// Drop the tree and the deleted features, so more features can be
+        /// added.
+        void flatten();
+        
+        /// Find the true start position of leaf i.
+        int64_t start_at(size_t i) const;
+        /// Find the first leaf with true start at or after the given position.
+        size_t first_starting_at(int64_t position) const;
+        
+        /// Shift everything under a tree node.
+        void apply_shift(size_t node, size_t low, size_t high, int64_t amount);
+        /// Pass a tree node's pending shift down to its children.
+        void push(size_t node, size_t low, size_t high);
+        /// Shift all leaves in [left, right).
+        void shift_range(size_t node, size_t low, size_t high, size_t left, size_t right, int64_t amount);
+        /// Call the given function on each leaf before right with an end at or
+        /// after min_end. It may change the leaf's start and end (without
+        /// reordering it) or delete it.
+        void for_each_overlapping(size_t node, size_t low, size_t high, size_t right, int64_t min_end,
+                                  const function<void(size_t)>& iteratee);
+    };
+
     /// Stores all the loaded features by path name
-    map<string, vector<Feature>> features;
+    map<string, PathFeatures> features;
 
 };
 
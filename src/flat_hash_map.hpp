@@ -0,0 +1,784 @@
+#ifndef VG_FLAT_HASH_MAP_HPP_INCLUDED
+#define VG_FLAT_HASH_MAP_HPP_INCLUDED
+
+/**
+ * \file flat_hash_map.hpp
+ *
+ * Open-addressed hash tables in the style of Swiss tables. Each slot has a
+ * control byte that is either empty, deleted, or 7 bits of the key's hash,
+ * and lookups compare a whole group of 16 control bytes against the hash at
+ * once (with SSE2 where we have it), so they usually touch only one key.
+ *
+ * Erasing never moves entries, so iterators to other entries stay valid, but
+ * inserting can move everything.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace vg {
+
+using namespace std;
+
+namespace flat_hash {
+
+/// Control bytes are EMPTY, DELETED, SENTINEL (which marks the end of the
+/// slots), or the low 7 bits of the hash of the key in a full slot.
+typedef int8_t ctrl_t;
+const ctrl_t EMPTY = -128;
+const ctrl_t DELETED = -2;
+const ctrl_t SENTINEL = -1;
+
+/// How many control bytes we look at at once
+const size_t GROUP_WIDTH = 16;
+
+/// Get a group of control bytes for tables that have no slots yet. Lookups
+/// in it find nothing, and iteration ends right away.
+inline ctrl_t* empty_group() {
+    alignas(16) static ctrl_t group[GROUP_WIDTH] = {SENTINEL, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+                                                    EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY};
+    return group;
+}
+
+inline size_t trailing_zeros(uint32_t mask) {
+    return mask ? __builtin_ctz(mask) : GROUP_WIDTH;
+}
+
+inline size_t leading_zeros(uint32_t mask) {
+    // masks only use the low GROUP_WIDTH bits
+    return mask ? __builtin_clz(mask) - (32 - GROUP_WIDTH) : GROUP_WIDTH;
+}
+
+/**
+ * A group of control bytes, starting anywhere in the control array. Each
+ * match gives a bit mask with a bit set for each byte that matched.
+ */
+class Group {
+public:
+#ifdef __SSE2__
+    explicit Group(const ctrl_t* position) : bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(position))) {}
+
+    uint32_t match(ctrl_t hash) const {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(hash), bytes));
+    }
+
+    uint32_t match_empty() const {
+        return match(EMPTY);
+    }
+
+    uint32_t match_empty_or_deleted() const {
+        return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(SENTINEL), bytes));
+    }
+private:
+    __m128i bytes;
+#else
+    explicit Group(const ctrl_t* position) {
+        memcpy(bytes, position, GROUP_WIDTH);
+    }
+
+    uint32_t match(ctrl_t hash) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; i++) {
+            mask |= (uint32_t) (bytes[i] == hash) << i;
+        }
+        return mask;
+    }
+
+    uint32_t match_empty() const {
+        return match(EMPTY);
+    }
+
+    uint32_t match_empty_or_deleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; i++) {
+            mask |= (uint32_t) (bytes[i] < SENTINEL) << i;
+        }
+        return mask;
+    }
+private:
+    ctrl_t bytes[GROUP_WIDTH];
+#endif
+};
+
+/**
+ * The sequence of groups to look in for a hash. It moves on by one more group
+ * each time, which visits every group when the mask is one less than a power
+ * of two.
+ */
+class ProbeSequence {
+public:
+    ProbeSequence(size_t hash, size_t mask) : mask(mask), position(hash & mask) {}
+
+    /// Where the group we're looking in starts
+    size_t offset() const {
+        return position;
+    }
+
+    /// Where the given byte of the group we're looking in is
+    size_t offset(size_t i) const {
+        return (position + i) & mask;
+    }
+
+    void next() {
+        stride += GROUP_WIDTH;
+        position = (position + stride) & mask;
+    }
+private:
+    size_t mask;
+    size_t position;
+    size_t stride = 0;
+};
+
+/// Get the key of a map entry
+template<typename Key, typename Value>
+struct MapKey {
+    static const Key& get(const pair<const Key, Value>& entry) {
+        return entry.first;
+    }
+};
+
+/// Get the key of a set entry
+template<typename Key>
+struct SetKey {
+    static const Key& get(const Key& entry) {
+        return entry;
+    }
+};
+
+/**
+ * The table behind FlatHashMap and FlatHashSet, holding Values that are found
+ * by the Key that KeyOf gets from them.
+ *
+ * The number of slots is always one less than a power of two, so it doubles
+ * as the mask for positions. After the slots' control bytes comes a
+ * SENTINEL, and then copies of the first GROUP_WIDTH - 1 control bytes, so a
+ * group can be loaded starting at any slot.
+ */
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename Equal>
+class FlatHashTable {
+public:
+
+    template<bool IsConst>
+    class Iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = Value;
+        using difference_type = ptrdiff_t;
+        using reference = typename conditional<IsConst, const Value&, Value&>::type;
+        using pointer = typename conditional<IsConst, const Value*, Value*>::type;
+
+        Iterator() = default;
+
+        /// Iterators convert to const iterators
+        template<bool WasConst, typename = typename enable_if<IsConst && !WasConst>::type>
+        Iterator(const Iterator<WasConst>& other) : ctrl(other.ctrl), slot(other.slot) {}
+
+        reference operator*() const {
+            return *slot;
+        }
+
+        pointer operator->() const {
+            return slot;
+        }
+
+        Iterator& operator++() {
+            ++ctrl;
+            ++slot;
+            skip_empty_slots();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++(*this);
+            return copy;
+        }
+
+        template<bool OtherConst>
+        bool operator==(const Iterator<OtherConst>& other) const {
+            return ctrl == other.ctrl;
+        }
+
+        template<bool OtherConst>
+        bool operator!=(const Iterator<OtherConst>& other) const {
+            return ctrl != other.ctrl;
+        }
+
+    private:
+        friend class FlatHashTable;
+        template<bool> friend class Iterator;
+
+        Iterator(ctrl_t* ctrl, Value* slot) : ctrl(ctrl), slot(slot) {}
+
+        /// Move up to the next full slot, or the SENTINEL at the end
+        void skip_empty_slots() {
+            while (*ctrl < SENTINEL) {
+                // the SENTINEL isn't empty or deleted, so this never goes past it
+                size_t skip = trailing_zeros(~Group(ctrl).match_empty_or_deleted() & ((1u << GROUP_WIDTH) - 1));
+                ctrl += skip;
+                slot += skip;
+            }
+        }
+
+        ctrl_t* ctrl = nullptr;
+        Value* slot = nullptr;
+    };
+
+    using key_type = Key;
+    using value_type = Value;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using hasher = Hash;
+    using key_equal = Equal;
+    using reference = Value&;
+    using const_reference = const Value&;
+    using pointer = Value*;
+    using const_pointer = const Value*;
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashTable() = default;
+
+    FlatHashTable(const FlatHashTable& other) : key_hasher(other.key_hasher), key_equal_to(other.key_equal_to) {
+        reserve(other.size());
+        for (const Value& entry : other) {
+            size_t h = key_hasher(KeyOf::get(entry));
+            size_t i = prepare_insert(h);
+            construct_at(i, entry);
+        }
+    }
+
+    FlatHashTable(FlatHashTable&& other) : FlatHashTable() {
+        swap(other);
+    }
+
+    FlatHashTable& operator=(const FlatHashTable& other) {
+        if (this != &other) {
+            FlatHashTable copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    FlatHashTable& operator=(FlatHashTable&& other) {
+        swap(other);
+        return *this;
+    }
+
+    ~FlatHashTable() {
+        destroy_slots();
+        deallocate();
+    }
+
+    iterator begin() {
+        iterator it(ctrl, slots);
+        it.skip_empty_slots();
+        return it;
+    }
+
+    iterator end() {
+        return iterator(ctrl + capacity, slots + capacity);
+    }
+
+    const_iterator begin() const {
+        return const_cast<FlatHashTable*>(this)->begin();
+    }
+
+    const_iterator end() const {
+        return const_cast<FlatHashTable*>(this)->end();
+    }
+
+    const_iterator cbegin() const {
+        return begin();
+    }
+
+    const_iterator cend() const {
+        return end();
+    }
+
+    size_t size() const {
+        return filled;
+    }
+
+    bool empty() const {
+        return filled == 0;
+    }
+
+    size_t bucket_count() const {
+        return capacity;
+    }
+
+    double load_factor() const {
+        return capacity ? (double) filled / capacity : 0.0;
+    }
+
+    iterator find(const Key& key) {
+        size_t i = find_index(key, key_hasher(key));
+        return i == NOT_FOUND ? end() : iterator_at(i);
+    }
+
+    const_iterator find(const Key& key) const {
+        return const_cast<FlatHashTable*>(this)->find(key);
+    }
+
+    size_t count(const Key& key) const {
+        return find_index(key, key_hasher(key)) == NOT_FOUND ? 0 : 1;
+    }
+
+    pair<iterator, iterator> equal_range(const Key& key) {
+        iterator found = find(key);
+        if (found == end()) {
+            return make_pair(found, found);
+        }
+        iterator next = found;
+        return make_pair(found, ++next);
+    }
+
+    pair<iterator, bool> insert(const Value& entry) {
+        return emplace(entry);
+    }
+
+    pair<iterator, bool> insert(Value&& entry) {
+        return emplace(std::move(entry));
+    }
+
+    iterator insert(const_iterator hint, const Value& entry) {
+        return insert(entry).first;
+    }
+
+    template<typename InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        for (; first != last; ++first) {
+            emplace(*first);
+        }
+    }
+
+    void insert(initializer_list<Value> entries) {
+        insert(entries.begin(), entries.end());
+    }
+
+    /// Make an entry from the arguments, and add it if its key isn't there.
+    template<typename... Args>
+    pair<iterator, bool> emplace(Args&&... args) {
+        Value entry(std::forward<Args>(args)...);
+        const Key& key = KeyOf::get(entry);
+        size_t h = key_hasher(key);
+        size_t i = find_index(key, h);
+        if (i != NOT_FOUND) {
+            return make_pair(iterator_at(i), false);
+        }
+        i = prepare_insert(h);
+        construct_at(i, std::move(entry));
+        return make_pair(iterator_at(i), true);
+    }
+
+    template<typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args) {
+        return emplace(std::forward<Args>(args)...).first;
+    }
+
+    size_t erase(const Key& key) {
+        size_t i = find_index(key, key_hasher(key));
+        if (i == NOT_FOUND) {
+            return 0;
+        }
+        erase_at(i);
+        return 1;
+    }
+
+    /// Erase an entry, and get the one after it
+    iterator erase(const_iterator position) {
+        iterator next(position.ctrl, position.slot);
+        ++next;
+        erase_at(position.ctrl - ctrl);
+        return next;
+    }
+
+    iterator erase(iterator position) {
+        return erase(const_iterator(position));
+    }
+
+    iterator erase(const_iterator first, const_iterator last) {
+        while (first != last) {
+            first = erase(first);
+        }
+        return iterator(last.ctrl, last.slot);
+    }
+
+    /// Remove all the entries, keeping the slots for reuse.
+    void clear() {
+        destroy_slots();
+        if (capacity) {
+            reset_ctrl();
+        }
+        filled = 0;
+        growth_left = max_entries(capacity);
+    }
+
+    /// The same as clear(), for code written against dense_hash_map.
+    void clear_no_resize() {
+        clear();
+    }
+
+    /// Make room for at least this many entries without growing.
+    void reserve(size_t entries) {
+        if (entries > max_entries(capacity)) {
+            size_t new_capacity = MIN_CAPACITY;
+            while (max_entries(new_capacity) < entries) {
+                new_capacity = new_capacity * 2 + 1;
+            }
+            resize_slots(new_capacity);
+        }
+    }
+
+    /// The same as reserve(), for code written against sparse_hash_map.
+    void resize(size_t entries) {
+        reserve(entries);
+    }
+
+    void rehash(size_t entries) {
+        reserve(entries);
+    }
+
+    void swap(FlatHashTable& other) {
+        std::swap(ctrl, other.ctrl);
+        std::swap(slots, other.slots);
+        std::swap(capacity, other.capacity);
+        std::swap(filled, other.filled);
+        std::swap(growth_left, other.growth_left);
+        std::swap(key_hasher, other.key_hasher);
+        std::swap(key_equal_to, other.key_equal_to);
+    }
+
+    hasher hash_function() const {
+        return key_hasher;
+    }
+
+    key_equal key_eq() const {
+        return key_equal_to;
+    }
+
+protected:
+
+    static const size_t NOT_FOUND = (size_t) -1;
+    static const size_t MIN_CAPACITY = GROUP_WIDTH - 1;
+
+    /// Where a hash starts looking
+    static size_t h1(size_t h) {
+        return h >> 7;
+    }
+
+    /// What a hash puts in its control byte
+    static ctrl_t h2(size_t h) {
+        return h & 0x7F;
+    }
+
+    /// How many entries (counting deleted ones) we allow in this many slots
+    static size_t max_entries(size_t slot_count) {
+        return slot_count - slot_count / 8;
+    }
+
+    iterator iterator_at(size_t i) {
+        return iterator(ctrl + i, slots + i);
+    }
+
+    /// Get the slot holding the key, or NOT_FOUND.
+    size_t find_index(const Key& key, size_t h) const {
+        ProbeSequence probe(h1(h), capacity);
+        ctrl_t tag = h2(h);
+        while (true) {
+            Group group(ctrl + probe.offset());
+            for (uint32_t matches = group.match(tag); matches; matches &= matches - 1) {
+                size_t i = probe.offset(__builtin_ctz(matches));
+                if (key_equal_to(KeyOf::get(slots[i]), key)) {
+                    return i;
+                }
+            }
+            if (group.match_empty()) {
+                return NOT_FOUND;
+            }
+            probe.next();
+        }
+    }
+
+    /// Get the first empty or deleted slot where a hash could go
+    size_t find_first_non_full(size_t h) const {
+        ProbeSequence probe(h1(h), capacity);
+        while (true) {
+            uint32_t available = Group(ctrl + probe.offset()).match_empty_or_deleted();
+            if (available) {
+                return probe.offset(__builtin_ctz(available));
+            }
+            probe.next();
+        }
+    }
+
+    /// Claim a slot for a new entry with a hash that isn't there, growing if
+    /// we need to, and get the slot for the caller to construct the entry in.
+    size_t prepare_insert(size_t h) {
+        size_t i = find_first_non_full(h);
+        if (growth_left == 0 && ctrl[i] != DELETED) {
+            if (capacity == 0) {
+                resize_slots(MIN_CAPACITY);
+            } else if (filled <= max_entries(capacity) / 2) {
+                // mostly deleted entries, so just clean them out
+                resize_slots(capacity);
+            } else {
+                resize_slots(capacity * 2 + 1);
+            }
+            i = find_first_non_full(h);
+        }
+        growth_left -= (ctrl[i] == EMPTY);
+        set_ctrl(i, h2(h));
+        filled++;
+        return i;
+    }
+
+    /// Construct an entry in a slot from prepare_insert(), giving the slot
+    /// back if that fails.
+    template<typename... Args>
+    void construct_at(size_t i, Args&&... args) {
+        try {
+            new (slots + i) Value(std::forward<Args>(args)...);
+        } catch (...) {
+            set_ctrl(i, DELETED);
+            filled--;
+            throw;
+        }
+    }
+
+    void erase_at(size_t i) {
+        slots[i].~Value();
+        filled--;
+        // If there was never a full group around this slot, no lookup could
+        // have gone past it, so it can be empty instead of deleted.
+        size_t before = (i - GROUP_WIDTH) & capacity;
+        uint32_t empty_after = Group(ctrl + i).match_empty();
+        uint32_t empty_before = Group(ctrl + before).match_empty();
+        if (empty_before && empty_after && trailing_zeros(empty_after) + leading_zeros(empty_before) < GROUP_WIDTH) {
+            set_ctrl(i, EMPTY);
+            growth_left++;
+        } else {
+            set_ctrl(i, DELETED);
+        }
+    }
+
+    /// Set a control byte and its copy after the SENTINEL
+    void set_ctrl(size_t i, ctrl_t value) {
+        ctrl[i] = value;
+        ctrl[((i - (GROUP_WIDTH - 1)) & capacity) + (GROUP_WIDTH - 1)] = value;
+    }
+
+    /// Make all the slots empty
+    void reset_ctrl() {
+        memset(ctrl, EMPTY, capacity + GROUP_WIDTH);
+        ctrl[capacity] = SENTINEL;
+    }
+
+    /// Move all the entries into a new array of slots
+    void resize_slots(size_t new_capacity) {
+        ctrl_t* old_ctrl = ctrl;
+        Value* old_slots = slots;
+        size_t old_capacity = capacity;
+
+        ctrl = new ctrl_t[new_capacity + GROUP_WIDTH];
+        slots = static_cast<Value*>(::operator new(new_capacity * sizeof(Value)));
+        capacity = new_capacity;
+        reset_ctrl();
+        growth_left = max_entries(capacity) - filled;
+
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_ctrl[i] >= 0) {
+                size_t h = key_hasher(KeyOf::get(old_slots[i]));
+                size_t j = find_first_non_full(h);
+                set_ctrl(j, h2(h));
+                new (slots + j) Value(std::move(old_slots[i]));
+                old_slots[i].~Value();
+            }
+        }
+
+        if (old_capacity) {
+            delete[] old_ctrl;
+            ::operator delete(old_slots);
+        }
+    }
+
+    void destroy_slots() {
+        if (!is_trivially_destructible<Value>::value) {
+            for (size_t i = 0; i < capacity; i++) {
+                if (ctrl[i] >= 0) {
+                    slots[i].~Value();
+                }
+            }
+        }
+    }
+
+    void deallocate() {
+        if (capacity) {
+            delete[] ctrl;
+            ::operator delete(slots);
+        }
+    }
+
+    ctrl_t* ctrl = empty_group();
+    Value* slots = nullptr;
+    size_t capacity = 0;
+    size_t filled = 0;
+    size_t growth_left = 0;
+    Hash key_hasher;
+    Equal key_equal_to;
+};
+
+}
+
+/**
+ * A drop-in replacement for std::unordered_map on top of a flat Swiss-style
+ * table. Unlike std::unordered_map, inserting can move the entries.
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+class FlatHashMap : public flat_hash::FlatHashTable<Key, pair<const Key, Value>, flat_hash::MapKey<Key, Value>, Hash, Equal> {
+private:
+    using Table = flat_hash::FlatHashTable<Key, pair<const Key, Value>, flat_hash::MapKey<Key, Value>, Hash, Equal>;
+public:
+    using mapped_type = Value;
+    using typename Table::iterator;
+    using typename Table::const_iterator;
+    using typename Table::value_type;
+
+    FlatHashMap() = default;
+
+    FlatHashMap(initializer_list<value_type> entries) {
+        this->reserve(entries.size());
+        this->insert(entries);
+    }
+
+    template<typename InputIterator>
+    FlatHashMap(InputIterator first, InputIterator last) {
+        this->insert(first, last);
+    }
+
+    using Table::insert;
+
+    /// Add anything an entry can be made from, like a pair of other types
+    template<typename P, typename = typename enable_if<is_constructible<value_type, P&&>::value>::type>
+    pair<iterator, bool> insert(P&& entry) {
+        return this->emplace(std::forward<P>(entry));
+    }
+
+    Value& operator[](const Key& key) {
+        return try_emplace(key).first->second;
+    }
+
+    Value& operator[](Key&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    Value& at(const Key& key) {
+        iterator found = this->find(key);
+        if (found == this->end()) {
+            throw out_of_range("[vg::FlatHashMap] key not found");
+        }
+        return found->second;
+    }
+
+    const Value& at(const Key& key) const {
+        const_iterator found = this->find(key);
+        if (found == this->end()) {
+            throw out_of_range("[vg::FlatHashMap] key not found");
+        }
+        return found->second;
+    }
+
+    /// Add an entry for the key with a value made from the arguments, unless
+    /// the key is already there, in which case nothing is constructed.
+    template<typename K, typename... Args>
+    pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        size_t h = this->key_hasher(key);
+        size_t i = this->find_index(key, h);
+        if (i != Table::NOT_FOUND) {
+            return make_pair(this->iterator_at(i), false);
+        }
+        i = this->prepare_insert(h);
+        this->construct_at(i, piecewise_construct, forward_as_tuple(std::forward<K>(key)),
+                           forward_as_tuple(std::forward<Args>(args)...));
+        return make_pair(this->iterator_at(i), true);
+    }
+};
+
+/**
+ * A drop-in replacement for std::unordered_set on top of a flat Swiss-style
+ * table. Unlike std::unordered_set, inserting can move the entries.
+ */
+template<typename Key, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+class FlatHashSet : public flat_hash::FlatHashTable<Key, Key, flat_hash::SetKey<Key>, Hash, Equal> {
+private:
+    using Table = flat_hash::FlatHashTable<Key, Key, flat_hash::SetKey<Key>, Hash, Equal>;
+public:
+    // entries in a set can't be changed in place
+    using iterator = typename Table::const_iterator;
+    using const_iterator = typename Table::const_iterator;
+
+    FlatHashSet() = default;
+
+    FlatHashSet(initializer_list<Key> entries) {
+        this->reserve(entries.size());
+        this->insert(entries);
+    }
+
+    template<typename InputIterator>
+    FlatHashSet(InputIterator first, InputIterator last) {
+        this->insert(first, last);
+    }
+
+    iterator begin() const {
+        return Table::begin();
+    }
+
+    iterator end() const {
+        return Table::end();
+    }
+
+    iterator find(const Key& key) const {
+        return Table::find(key);
+    }
+
+    pair<iterator, bool> insert(const Key& key) {
+        return Table::insert(key);
+    }
+
+    pair<iterator, bool> insert(Key&& key) {
+        return Table::insert(std::move(key));
+    }
+
+    template<typename InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+        Table::insert(first, last);
+    }
+
+    void insert(initializer_list<Key> entries) {
+        Table::insert(entries);
+    }
+
+    template<typename... Args>
+    pair<iterator, bool> emplace(Args&&... args) {
+        return Table::emplace(std::forward<Args>(args)...);
+    }
+};
+
+}
+
+#endif
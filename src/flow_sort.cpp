@@ -676,15 +676,17 @@ void FlowSort::find_in_out_web(list<NodeTraversal>& sorted_nodes,
     EdgeMapping& edges_in_nodes = w_graph.edges_in_nodes;
     map<Edge*, int>& edge_weight = w_graph.edge_weight;
 
-    //add source and sink nodes
-    id_t source = vg.graph.node_size() + 1;
+    //min cut reports edges into the sink with this id
     id_t sink = vg.graph.node_size() + 2;
-    id_t graph_size = sink + 1;
 
     set<Edge*> out_joins;
     set<Edge*> in_joins;
 
-    map<id_t, map<id_t, int>> weighted_sub_graph;
+    FlowNetwork network;
+    for (auto const &node : nodes) 
+    {
+        network.add_node(node);
+    }
 
     //determine max outgoing weight
     int max_weight = 0;
@@ -693,7 +695,6 @@ void FlowSort::find_in_out_web(list<NodeTraversal>& sorted_nodes,
         int current_weight = 0;
         for (auto const &edge : edges_out_nodes[node]) 
         {
-            weighted_sub_graph[edge->from()][edge->to()] = 0;
             if (!nodes.count(edge->to())) 
             {
                 continue;
@@ -713,7 +714,8 @@ void FlowSort::find_in_out_web(list<NodeTraversal>& sorted_nodes,
                 in_joins.insert(edge);
                 continue;
             }
-            weighted_sub_graph[edge->from()][edge->to()] = edge_weight[edge];
+            network.set_capacity(network.rank[edge->from()], network.rank[edge->to()],
+                                 edge_weight[edge]);
         }
 
         if (current_weight > max_weight) 
@@ -724,17 +726,16 @@ void FlowSort::find_in_out_web(list<NodeTraversal>& sorted_nodes,
     //set weight for source edges
     for (auto const &edge : out_joins) 
     {
-        weighted_sub_graph[source][edge->from()] = max_weight + 1;
+        network.set_capacity(FlowNetwork::SOURCE, network.rank[edge->from()], max_weight + 1);
     }
     //set weight for sink edges
     for (auto const &edge : in_joins) 
     {
-        weighted_sub_graph[edge->from()][sink] = edge_weight[edge];
+        network.set_capacity(network.rank[edge->from()], FlowNetwork::SINK, edge_weight[edge]);
     }
 
     //find min-cut edges
-    vector<pair<id_t,id_t>> cut = min_cut(weighted_sub_graph, nodes, source,
-                                                    sink, edges_out_nodes, in_joins);
+    vector<pair<id_t,id_t>> cut = min_cut(network, nodes, sink, edges_out_nodes, in_joins);
     //remove min cut edges
     for(auto const &edge : cut) 
     {
@@ -976,65 +977,85 @@ void FlowSort::mark_dfs(EdgeMapping& edges_to_nodes, id_t s,
 
 }
 
-/* Returns true if there is a path from source 's' to sink 't' in
-   residual graph. Also fills parent[] to store the path */
-bool FlowSort::bfs(set<id_t>& nodes, map<id_t, map<id_t, int>>& edge_weight, id_t s,
-            id_t t, map<id_t, id_t>& parent) 
+size_t FlowSort::FlowNetwork::add_node(id_t id)
 {
-    // Create a visited array and mark all vertices as not visited
-    set<id_t> visited;
+    auto inserted = rank.insert(make_pair(id, out_arcs.size()));
+    if (inserted.second) 
+    {
+        out_arcs.emplace_back();
+    }
+    return inserted.first->second;
+}
 
-    // Create a queue, enqueue source vertex and mark source vertex
-    // as visited
-    std::queue<id_t> q({ s });
-    visited.insert(s);
-    parent[s] = -1;
+void FlowSort::FlowNetwork::set_capacity(size_t from, size_t to, int capacity)
+{
+    for (auto const &arc : out_arcs[from]) 
+    {
+        // only even arcs are real edges, odd ones are residual reverses
+        if (arc % 2 == 0 && arcs[arc].to == to) 
+        {
+            arcs[arc].capacity = capacity;
+            return;
+        }
+    }
+    out_arcs[from].push_back(arcs.size());
+    arcs.push_back(Arc{to, capacity});
+    out_arcs[to].push_back(arcs.size());
+    arcs.push_back(Arc{from, 0});
+}
+
+/* Returns true if there is a path from the source to the sink in the
+   residual network. Also fills parent_arc[] to store the path */
+bool FlowSort::bfs(FlowNetwork& network, vector<size_t>& parent_arc) 
+{
+    // Every node is unvisited until it gets a parent arc
+    size_t unvisited = numeric_limits<size_t>::max();
+    parent_arc.assign(network.out_arcs.size(), unvisited);
+
+    std::queue<size_t> q({ FlowNetwork::SOURCE });
+    parent_arc[FlowNetwork::SOURCE] = network.arcs.size();
 
     // Standard BFS Loop
     while (!q.empty())
     {
-        id_t u = q.front();
+        size_t u = q.front();
         q.pop();
-        for (auto const &weight : edge_weight[u])
+        for (auto const &arc : network.out_arcs[u])
         {
-            if (weight.second <= 0)
+            if (network.arcs[arc].capacity <= 0)
             {
                 continue;
             }
-            id_t v = weight.first;
-            if (!visited.count(v)) 
+            size_t v = network.arcs[arc].to;
+            if (parent_arc[v] == unvisited) 
             {
                 q.push(v);
-                parent[v] = u;
-                visited.insert(v);
-                  if (v == t) 
+                parent_arc[v] = arc;
+                if (v == FlowNetwork::SINK) 
                 {
                     return true;
                 }
             }
         }
     }
-    // If we reached sink in BFS starting from source, then return
-    // true, else false
-    return (visited.count(t) != 0);
-
+    return false;
 }
 
 
-void FlowSort::dfs(set<id_t>& nodes, id_t s, set<id_t>& visited, 
-        map<id_t, map<id_t, int>>& edge_weight) 
+void FlowSort::dfs(FlowNetwork& network, vector<bool>& visited) 
 {
-    visited.insert(s);
-    std::stack<id_t> q({ s });
+    visited.assign(network.out_arcs.size(), false);
+    visited[FlowNetwork::SOURCE] = true;
+    std::stack<size_t> q({ FlowNetwork::SOURCE });
     while (!q.empty()) {
-        s = q.top();
+        size_t s = q.top();
         q.pop();
-        for (auto const &weight : edge_weight[s]) 
+        for (auto const &arc : network.out_arcs[s]) 
         {
-            id_t to = weight.first;
-            if (weight.second && !visited.count(to)) 
+            size_t to = network.arcs[arc].to;
+            if (network.arcs[arc].capacity > 0 && !visited[to]) 
             {
-                visited.insert(to);
+                visited[to] = true;
                 q.push(to);
             }
         }
@@ -1042,62 +1063,50 @@ void FlowSort::dfs(set<id_t>& nodes, id_t s, set<id_t>& visited,
 }
 
 // Returns the minimum s-t cut
-vector<pair<id_t,id_t>> FlowSort::min_cut(map<id_t, map<id_t, int>>& graph_weight,
+vector<pair<id_t,id_t>> FlowSort::min_cut(FlowNetwork& network,
                 set<id_t>& nodes,
-                id_t s, id_t t,
+                id_t t,
                 EdgeMapping& edges_out_nodes,
                 set<Edge*>& in_joins) 
 {
-    id_t u, v;
-    nodes.insert(s);
-    nodes.insert(t);
-    map<id_t, id_t> parent_map;
+    vector<size_t> parent_arc;
 
     // Augment the flow while there is path from source to sink
-    while (bfs(nodes, graph_weight, s, t, parent_map)) 
+    while (bfs(network, parent_arc)) 
     {
         // Find minimum residual capacity of the edges along the
         // path filled by BFS. Or we can say find the maximum flow
         // through the path found.
         int path_flow = numeric_limits<int>::max();
-        for (v = t; v != s; v = parent_map[v]) 
+        for (size_t v = FlowNetwork::SINK; v != FlowNetwork::SOURCE; ) 
         {
-            u = parent_map[v];
-            if (!graph_weight.count(u) || !graph_weight[u].count(v)) 
-            {
-                graph_weight[u][v] = 0;
-            }
-            path_flow = min(path_flow, graph_weight[u][v]);
+            size_t arc = parent_arc[v];
+            path_flow = min(path_flow, network.arcs[arc].capacity);
+            v = network.arcs[arc ^ 1].to;
         }
         // update residual capacities of the edges and reverse edges
         // along the path
-        for (v = t; v != s; v = parent_map[v]) 
+        for (size_t v = FlowNetwork::SINK; v != FlowNetwork::SOURCE; ) 
         {
-            u = parent_map[v];
-            if (!graph_weight.count(u) || !graph_weight[u].count(v)) 
-            {
-                graph_weight[u][v] = 0;
-            }
-             if (!graph_weight.count(v) || !graph_weight[v].count(u)) 
-            {
-                graph_weight[v][u] = 0;
-            }
-            graph_weight[u][v] -= path_flow;
-            graph_weight[v][u] += path_flow;
+            size_t arc = parent_arc[v];
+            network.arcs[arc].capacity -= path_flow;
+            network.arcs[arc ^ 1].capacity += path_flow;
+            v = network.arcs[arc ^ 1].to;
         }
     }
 
-    // Flow is maximum now, find vertices reachable from s
-
-    set<id_t> visited_set;
-    dfs(nodes, s, visited_set, graph_weight);
+    // Flow is maximum now, find vertices reachable from s.
+    // The set is the same whichever maximum flow we found.
+    vector<bool> visited;
+    dfs(network, visited);
     vector<pair<id_t,id_t>> min_cut;
 
-    nodes.erase(s);
-    nodes.erase(t);
-
     for(auto const node_id : nodes) 
     {
+        if (!visited[network.rank[node_id]]) 
+        {
+            continue;
+        }
         for (auto const &edge : edges_out_nodes[node_id])
         {
             id_t to = edge->to();
@@ -1108,9 +1117,9 @@ vector<pair<id_t,id_t>> FlowSort::min_cut(map<id_t, map<id_t, int>>& graph_weigh
 
             if (in_joins.count(edge)) 
             {
-                 to = t;
+                 min_cut.push_back(pair<id_t, id_t>(node_id, t));
             }
-            if (visited_set.count(node_id) && !visited_set.count(to))
+            else if (!visited[network.rank[to]])
             {
                 min_cut.push_back(pair<id_t, id_t>(node_id, to));
             }
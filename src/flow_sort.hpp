@@ -81,8 +81,33 @@ public:
                                          id_t node);
     id_t find_max_node(std::vector<std::set<id_t>> nodes_degree);
 
-    bool bfs(set<id_t>& nodes, map<id_t, map<id_t, int>>& edge_weight, id_t s, id_t t, map<id_t, id_t>& parent);
-    void dfs(set<id_t>& nodes, id_t s, set<id_t>& visited, map<id_t, map<id_t, int>>& edge_weight);
+    /*
+     * Residual network for the min-cut step. Nodes are numbered densely with
+     * the source as 0 and the sink as 1, and arc i ^ 1 is the residual
+     * reverse of arc i, so a cut costs a few flat arrays instead of nested
+     * maps keyed by node id.
+     */
+    struct FlowNetwork {
+        static const size_t SOURCE = 0;
+        static const size_t SINK = 1;
+
+        struct Arc {
+            size_t to;
+            int capacity;
+        };
+        vector<Arc> arcs;
+        vector<vector<size_t>> out_arcs;
+        unordered_map<id_t, size_t> rank;
+
+        FlowNetwork() : out_arcs(2) {}
+        // dense number of the node, adding it if it is new
+        size_t add_node(id_t id);
+        // set the capacity from -> to, replacing any earlier one
+        void set_capacity(size_t from, size_t to, int capacity);
+    };
+
+    bool bfs(FlowNetwork& network, vector<size_t>& parent_arc);
+    void dfs(FlowNetwork& network, vector<bool>& visited);
     void find_in_out_web(   list<NodeTraversal>& sorted_nodes, 
                             Growth& in_out_growth,
                             WeightedGraph& weighted_graph,
@@ -99,7 +124,7 @@ public:
                                 bool in_out, int count);
     void mark_dfs(EdgeMapping& graph_matrix, id_t s, set<id_t>& new_nodes, 
                 set<id_t>& visited, bool reverse, set<id_t>& nodes, set<id_t>& backbone);
-    vector<pair<id_t,id_t>> min_cut(map<id_t, map<id_t, int>>& graph_weight, set<id_t>& nodes, id_t s, id_t t, 
+    vector<pair<id_t,id_t>> min_cut(FlowNetwork& network, set<id_t>& nodes, id_t t,
                 EdgeMapping& edges_out_nodes, set<Edge*>& in_joins);
     void remove_edge(EdgeMapping& nodes_to_edges, id_t node, id_t to, bool reverse);
     
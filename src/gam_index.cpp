@@ -0,0 +1,245 @@
+#include "gam_index.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// Marks the start of a saved GAMIndex
+const char GAM_INDEX_MAGIC[8] = {'V', 'G', 'G', 'A', 'M', 'I', 'D', 'X'};
+const uint32_t GAM_INDEX_VERSION = 1;
+
+template<typename T>
+void write_value(ostream& out, const T& value) {
+    out.write((const char*) &value, sizeof(T));
+}
+
+template<typename T>
+T read_value(istream& in) {
+    T value;
+    in.read((char*) &value, sizeof(T));
+    if (!in) {
+        throw runtime_error("[GAMIndex::load] index is truncated");
+    }
+    return value;
+}
+
+/// Return true if the read visits a node in any of the ranges
+bool touches(const Alignment& aln, const vector<pair<id_t, id_t>>& ranges) {
+    for (size_t i = 0; i < aln.path().mapping_size(); i++) {
+        id_t node_id = aln.path().mapping(i).position().node_id();
+        for (auto& range : ranges) {
+            if (node_id >= range.first && node_id <= range.second) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+}
+
+GAMIndex::bin_t GAMIndex::common_bin(id_t a, id_t b) {
+    uint64_t differing = (uint64_t) a ^ (uint64_t) b;
+    uint64_t shift = differing ? 64 - __builtin_clzll(differing) : 0;
+    // shifting a 64 bit value by 64 is undefined
+    return bin_t(shift, shift == 64 ? 0 : (uint64_t) a >> shift);
+}
+
+void GAMIndex::add_alignment(const Alignment& aln, int64_t group_offset) {
+    if (group_offset < last_group) {
+        throw runtime_error("[GAMIndex::add_alignment] reads must be added in file order");
+    }
+    last_group = group_offset;
+
+    const Path& path = aln.path();
+    if (path.mapping_size() == 0) {
+        // unmapped reads are never found by node ID
+        return;
+    }
+
+    id_t min_id = path.mapping(0).position().node_id();
+    id_t max_id = min_id;
+    for (size_t i = 1; i < path.mapping_size(); i++) {
+        id_t node_id = path.mapping(i).position().node_id();
+        min_id = min(min_id, node_id);
+        max_id = max(max_id, node_id);
+    }
+
+    auto& groups = bin_groups[common_bin(min_id, max_id)];
+    if (groups.empty() || groups.back() != group_offset) {
+        groups.push_back(group_offset);
+    }
+
+    // groups come in file order, so the first one seen for a window is the earliest
+    for (uint64_t window = (uint64_t) min_id >> WINDOW_SHIFT; window <= (uint64_t) max_id >> WINDOW_SHIFT; window++) {
+        window_starts.emplace(window, group_offset);
+    }
+}
+
+void GAMIndex::index(istream& gam) {
+    if (!stream::BlockedGzipInputStream::is_bgzf(gam)) {
+        throw runtime_error("[GAMIndex::index] GAM is not BGZF and cannot be indexed");
+    }
+    stream::BlockedGzipInputStream bgzf_in(gam);
+    function<void(int64_t, Alignment&)> add = [&](int64_t group_offset, Alignment& aln) {
+        add_alignment(aln, group_offset);
+    };
+    stream::for_each_with_group_offset(bgzf_in, add);
+}
+
+vector<int64_t> GAMIndex::find_groups(const vector<pair<id_t, id_t>>& ranges) const {
+    vector<int64_t> found;
+
+    for (auto& range : ranges) {
+        uint64_t low = (uint64_t) min(range.first, range.second);
+        uint64_t high = (uint64_t) max(range.first, range.second);
+
+        // every read here touches one of these windows, so it can't be in a group before the first of them
+        auto window = window_starts.lower_bound(low >> WINDOW_SHIFT);
+        auto window_end = window_starts.upper_bound(high >> WINDOW_SHIFT);
+        if (window == window_end) {
+            continue;
+        }
+        int64_t min_offset = window->second;
+        for (; window != window_end; ++window) {
+            min_offset = min(min_offset, window->second);
+        }
+
+        // the bins at each level that overlap the range
+        for (uint64_t shift = 0; shift <= 64; shift++) {
+            uint64_t low_prefix = shift == 64 ? 0 : low >> shift;
+            uint64_t high_prefix = shift == 64 ? 0 : high >> shift;
+            for (auto bin = bin_groups.lower_bound(bin_t(shift, low_prefix));
+                 bin != bin_groups.end() && bin->first <= bin_t(shift, high_prefix); ++bin) {
+                auto& groups = bin->second;
+                found.insert(found.end(), lower_bound(groups.begin(), groups.end(), min_offset), groups.end());
+            }
+        }
+    }
+
+    sort(found.begin(), found.end());
+    found.erase(unique(found.begin(), found.end()), found.end());
+    return found;
+}
+
+void GAMIndex::find(istream& gam, const vector<pair<id_t, id_t>>& ranges,
+                    const function<void(const Alignment&)>& iteratee) const {
+
+    vector<int64_t> groups = find_groups(ranges);
+    if (groups.empty()) {
+        return;
+    }
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw runtime_error("[GAMIndex::find] obsolete, invalid, or corrupt protobuf input");
+        }
+    };
+
+    stream::BlockedGzipInputStream bgzf_in(gam);
+    for (int64_t group_offset : groups) {
+        // groups that follow one another don't need a seek
+        if (bgzf_in.Tell() != group_offset && !bgzf_in.Seek(group_offset)) {
+            throw runtime_error("[GAMIndex::find] could not seek to virtual offset " + to_string(group_offset));
+        }
+
+        uint64_t count;
+        {
+            ::google::protobuf::io::CodedInputStream coded_in(&bgzf_in);
+            handle(coded_in.ReadVarint64((::google::protobuf::uint64*) &count));
+        }
+
+        string s;
+        for (uint64_t i = 0; i < count; i++) {
+            ::google::protobuf::io::CodedInputStream coded_in(&bgzf_in);
+            coded_in.SetTotalBytesLimit(stream::MAX_PROTOBUF_SIZE * 2, stream::MAX_PROTOBUF_SIZE * 2);
+
+            uint32_t msg_size = 0;
+            handle(coded_in.ReadVarint32(&msg_size));
+            if (msg_size > stream::MAX_PROTOBUF_SIZE) {
+                throw runtime_error("[GAMIndex::find] protobuf message of " + to_string(msg_size) + " bytes is too long");
+            }
+
+            if (msg_size) {
+                handle(coded_in.ReadString(&s, msg_size));
+                Alignment aln;
+                handle(aln.ParseFromString(s));
+                if (touches(aln, ranges)) {
+                    iteratee(aln);
+                }
+            }
+        }
+    }
+}
+
+void GAMIndex::find(istream& gam, id_t min_id, id_t max_id,
+                    const function<void(const Alignment&)>& iteratee) const {
+    find(gam, vector<pair<id_t, id_t>>{make_pair(min_id, max_id)}, iteratee);
+}
+
+void GAMIndex::save(ostream& out) const {
+    out.write(GAM_INDEX_MAGIC, sizeof(GAM_INDEX_MAGIC));
+    write_value<uint32_t>(out, GAM_INDEX_VERSION);
+
+    write_value<uint64_t>(out, bin_groups.size());
+    for (auto& bin : bin_groups) {
+        write_value<uint64_t>(out, bin.first.first);
+        write_value<uint64_t>(out, bin.first.second);
+        write_value<uint64_t>(out, bin.second.size());
+        for (int64_t group_offset : bin.second) {
+            write_value<int64_t>(out, group_offset);
+        }
+    }
+
+    write_value<uint64_t>(out, window_starts.size());
+    for (auto& window : window_starts) {
+        write_value<uint64_t>(out, window.first);
+        write_value<int64_t>(out, window.second);
+    }
+
+    if (!out) {
+        throw runtime_error("[GAMIndex::save] I/O error writing index");
+    }
+}
+
+void GAMIndex::load(istream& in) {
+    char magic[sizeof(GAM_INDEX_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in || !equal(magic, magic + sizeof(magic), GAM_INDEX_MAGIC)) {
+        throw runtime_error("[GAMIndex::load] not a GAM index");
+    }
+    uint32_t version = read_value<uint32_t>(in);
+    if (version != GAM_INDEX_VERSION) {
+        throw runtime_error("[GAMIndex::load] unsupported GAM index version " + to_string(version));
+    }
+
+    bin_groups.clear();
+    window_starts.clear();
+    last_group = -1;
+
+    uint64_t bin_count = read_value<uint64_t>(in);
+    for (uint64_t i = 0; i < bin_count; i++) {
+        uint64_t shift = read_value<uint64_t>(in);
+        uint64_t prefix = read_value<uint64_t>(in);
+        auto& groups = bin_groups[bin_t(shift, prefix)];
+        groups.resize(read_value<uint64_t>(in));
+        for (auto& group_offset : groups) {
+            group_offset = read_value<int64_t>(in);
+            last_group = max(last_group, group_offset);
+        }
+    }
+
+    uint64_t window_count = read_value<uint64_t>(in);
+    for (uint64_t i = 0; i < window_count; i++) {
+        uint64_t window = read_value<uint64_t>(in);
+        window_starts[window] = read_value<int64_t>(in);
+    }
+}
+
+}
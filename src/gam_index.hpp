@@ -0,0 +1,88 @@
+#ifndef VG_GAM_INDEX_HPP_INCLUDED
+#define VG_GAM_INDEX_HPP_INCLUDED
+
+/**
+ * \file gam_index.hpp
+ *
+ * A tabix/CSI-style index over a sorted, BGZF-compressed GAM, which finds the
+ * reads that touch a range of node IDs with a few seeks. Each read goes into
+ * the smallest bin of a binary hierarchy over node IDs that holds every node
+ * it visits, and each bin lists the virtual offsets of the groups holding its
+ * reads. A linear index of the first group touching each window of node IDs
+ * lets a query skip the parts of the coarse bins that come before its range.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class GAMIndex {
+public:
+
+    /// Index every read in a BGZF GAM, as written by GAMSorter. The GAM
+    /// doesn't have to be sorted, but queries on it will be slow if it isn't.
+    /// Throws if the GAM isn't BGZF.
+    void index(istream& gam);
+
+    /// Add a read from the group that starts at the given virtual offset.
+    /// Reads must be added in file order.
+    void add_alignment(const Alignment& aln, int64_t group_offset);
+
+    /// Get the virtual offsets of all the groups that could hold reads
+    /// visiting a node in any of the given inclusive ranges of node IDs, in
+    /// file order.
+    vector<int64_t> find_groups(const vector<pair<id_t, id_t>>& ranges) const;
+
+    /// Call the iteratee, in file order, on each read in the indexed GAM that
+    /// visits a node in any of the given inclusive ranges of node IDs.
+    void find(istream& gam, const vector<pair<id_t, id_t>>& ranges,
+              const function<void(const Alignment&)>& iteratee) const;
+
+    /// Call the iteratee, in file order, on each read in the indexed GAM that
+    /// visits a node with ID from min_id to max_id inclusive.
+    void find(istream& gam, id_t min_id, id_t max_id,
+              const function<void(const Alignment&)>& iteratee) const;
+
+    /// Write the index to a stream.
+    void save(ostream& out) const;
+
+    /// Replace this index with one read from a stream. Throws if the stream
+    /// doesn't hold an index.
+    void load(istream& in);
+
+    /// The linear index has an entry for each run of 2^WINDOW_SHIFT node IDs.
+    static const int WINDOW_SHIFT = 8;
+
+private:
+
+    /// A bin is the number of low bits of the node ID that it ignores,
+    /// together with the high bits that all of its node IDs share.
+    typedef pair<uint64_t, uint64_t> bin_t;
+
+    /// Get the smallest bin that holds both node IDs.
+    static bin_t common_bin(id_t a, id_t b);
+
+    /// Group start offsets of the reads in each bin, in file order without
+    /// duplicates
+    map<bin_t, vector<int64_t>> bin_groups;
+
+    /// Offset of the first group with a read touching each window
+    map<uint64_t, int64_t> window_starts;
+
+    /// The last group offset seen, to check that reads come in file order
+    int64_t last_group = -1;
+};
+
+}
+
+#endif
@@ -1,4 +1,8 @@
 #include "gamsorter.hpp"
+#include "utility.hpp"
+
+#include <memory>
+#include <omp.h>
 /*
 *  GAMSorter: sort a gam by position and offset
 *  dumbly store unmapped reads at the end.
@@ -81,7 +85,7 @@ struct custom_pos_sort_key
 
 struct custom_aln_sort_key
 {
-    bool operator()(const Alignment a_one, const Alignment a_two)
+    bool operator()(const Alignment& a_one, const Alignment& a_two) const
     {
         int xf_size = a_one.path().mapping_size();
         int xb_size = a_two.path().mapping_size();
@@ -130,9 +134,19 @@ struct custom_aln_sort_key
     }
 } alnsortkey;
 
+bool GAMSorter::less(const Alignment& a, const Alignment& b) const
+{
+    if (by_name) {
+        return a.name() < b.name();
+    }
+    return alnsortkey(a, b);
+}
+
 void GAMSorter::sort(vector<Alignment> &alns)
 {
-    std::sort(alns.begin(), alns.end(), alnsortkey);
+    std::stable_sort(alns.begin(), alns.end(), [&](const Alignment& a, const Alignment& b) {
+        return less(a, b);
+    });
 }
 
 void GAMSorter::paired_sort(string gamfile)
@@ -181,10 +195,18 @@ void GAMSorter::paired_sort(string gamfile)
 
 void GAMSorter::write_temp(vector<Alignment>& alns)
 {
-    string t_name = "tmp_sort_" + std::to_string(tmp_filenames.size());
-    tmp_filenames.push_back(t_name);
+    string t_name;
+#pragma omp critical (gamsort_temp)
+    {
+        // temp_file isn't thread safe
+        t_name = temp_file::create("gamsort");
+        tmp_filenames.push_back(t_name);
+    }
     ofstream t_file;
     t_file.open(t_name);
+    if (!t_file) {
+        throw runtime_error("[GAMSorter::write_temp] could not open temp file " + t_name);
+    }
     stream::write_buffered(t_file, alns, 0);
     t_file.close();
 }
@@ -209,181 +231,181 @@ void GAMSorter::dumb_sort(string gamfile)
 
     ofstream outfi;
     outfi.open(gamfile + ".sorted.gam");
-    stream::write_buffered(outfi, buf, buf.size());
+    // Write BGZF so the sorted GAM can be indexed by virtual offset
+    stream::BlockedGzipOutputStream bgzf_out(outfi);
+    stream::write_buffered(bgzf_out, buf, buf.size());
 }
 
 void GAMSorter::stream_sort(string gamfile){
 
-    std::vector<Alignment> buffer;
-    buffer.reserve(1000);
-    std::function<void(Alignment&)> firstpass_bufsort = [&](Alignment& a){
-        #pragma omp critical
-        buffer.push_back(a);
-        if (buffer.size() == max_buf_size){
-                sort(buffer);
-                write_temp(buffer);
-                buffer.clear();
-        }
-    };
-
-    
-
-
     ifstream gammy;
     gammy.open(gamfile);
-    stream::for_each(gammy, firstpass_bufsort);
-
-    sort(buffer);
-    write_temp(buffer);
-    buffer.clear();
-
-
-
-   
-    int num_valid = tmp_filenames.size();
-    vector<bool> still_valid(tmp_filenames.size());
-    vector<uint64_t> curr_file_count (tmp_filenames.size());
-    typedef priority_queue<Alignment,std::vector<Alignment>, AlnSorter> AlnHeap;
-    
-
-    for (int i = 0; i < tmp_filenames.size(); ++i){
-        ifstream tfile;
-        tfile.open(tmp_filenames[i]);
-        tmp_files.emplace_back(&tfile);
+    if (!gammy) {
+        throw runtime_error("[GAMSorter::stream_sort] could not open " + gamfile);
     }
 
-
-    
-
-    vector<::google::protobuf::io::CodedInputStream*> protostreams;
-    vector<::google::protobuf::io::GzipInputStream*> zipstreams;
-
-    for (auto x : tmp_files){
-        ::google::protobuf::io::ZeroCopyInputStream *raw_in =
-          new ::google::protobuf::io::IstreamInputStream(x);
-        ::google::protobuf::io::GzipInputStream *gzip_in =
-          new ::google::protobuf::io::GzipInputStream(raw_in);
-        ::google::protobuf::io::CodedInputStream *pstream =
-          new ::google::protobuf::io::CodedInputStream(gzip_in);
-
-        protostreams.push_back(pstream);
-        zipstreams.push_back(gzip_in);
+    // Our output stream
+    string outname = gamfile + ".sorted.gam";
+    ofstream ofile;
+    ofile.open(outname);
+    if (!ofile) {
+        throw runtime_error("[GAMSorter::stream_sort] could not open " + outname);
     }
 
-    std::function<bool(int)> handle_count_line = [&](int tmp_index){
-        uint64_t count;
-        protostreams[tmp_index]->ReadVarint64((::google::protobuf::uint64*) &count);
-        curr_file_count[tmp_index] = count;
-        cerr << std::to_string(count) << endl;
-        if (!count){
-            return false;
+    stream_sort(gammy, ofile);
+}
+
+void GAMSorter::stream_sort(istream& gam_in, ostream& sorted_out){
+
+    // Each thread fills its own buffer up to its share of the memory budget,
+    // then sorts it and writes it out as a run, compressing on that thread.
+    int thread_count = omp_get_max_threads();
+    size_t thread_max_bytes = max<size_t>(1, max_memory / thread_count);
+    vector<vector<Alignment>> buffers(thread_count);
+    vector<size_t> buffer_bytes(thread_count, 0);
+
+    std::function<void(Alignment&)> make_runs = [&](Alignment& aln) {
+        int tid = omp_get_thread_num();
+        auto& buffer = buffers[tid];
+        buffer_bytes[tid] += aln.ByteSize();
+        buffer.emplace_back();
+        buffer.back().Swap(&aln);
+        if (buffer_bytes[tid] >= thread_max_bytes) {
+            sort(buffer);
+            write_temp(buffer);
+            buffer.clear();
+            buffer_bytes[tid] = 0;
         }
-        return true;
     };
 
-    for (int i = 0; i < protostreams.size(); i++){
-        handle_count_line(i);
-    }
+    stream::for_each_parallel(gam_in, make_runs);
 
-    
-    
-    std::function<bool(int, Alignment&)> read_dat_buf = [&](int tmp_index, Alignment& ret){
+    for (auto& buffer : buffers) {
+        if (!buffer.empty()) {
+            sort(buffer);
+            write_temp(buffer);
+            buffer.clear();
+        }
+    }
+    buffers.clear();
+
+    // Merge groups of runs into longer runs until they can all be merged at once
+    size_t fan_in = max<size_t>(2, max_fan_in);
+    vector<string> runs = tmp_filenames;
+    tmp_filenames.clear();
+    while (runs.size() > fan_in) {
+        vector<vector<string>> groups;
+        vector<string> merged;
+        for (size_t i = 0; i < runs.size(); i += fan_in) {
+            groups.emplace_back(runs.begin() + i, runs.begin() + min(i + fan_in, runs.size()));
+            merged.push_back(temp_file::create("gamsort"));
+        }
 
-        // Read our message of size count.
-        std::string s;
-        //for (uint64_t i = 0; i < count; ++i) {
-            (curr_file_count[tmp_index])--;
-            if (curr_file_count[tmp_index] <= 0){
-                return handle_count_line(tmp_index);
-            }
-            uint32_t msgSize = 0;
-            delete (protostreams[tmp_index]);
-            (protostreams[tmp_index]) = new ::google::protobuf::io::CodedInputStream( (zipstreams[tmp_index]));
-            // the messages are prefixed by their size
-            (protostreams[tmp_index])->ReadVarint32(&msgSize);
-            if ((msgSize > 0) &&
-                (protostreams[tmp_index]->ReadString(&s, msgSize))) {
-                ret.ParseFromString(s);
-                return true;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < groups.size(); i++) {
+            ofstream merged_out;
+            merged_out.open(merged[i]);
+            if (!merged_out) {
+                throw runtime_error("[GAMSorter::stream_sort] could not open temp file " + merged[i]);
             }
-        //}
-        
-        return false;
-     };
-
+            vector<Alignment> out_buf;
+            merge_runs(groups[i], [&](Alignment& aln) {
+                out_buf.emplace_back();
+                out_buf.back().Swap(&aln);
+                stream::write_buffered(merged_out, out_buf, 1000);
+            });
+            stream::write_buffered(merged_out, out_buf, 0);
+        }
 
-    // Heap of size (tmp_files.size())
-    AlnHeap lil_heap;
-    for(int i = 0; i < tmp_files.size(); i++){
-        Alignment a;
-        read_dat_buf(i, a);
-        lil_heap.push( a );
+        for (auto& run : runs) {
+            temp_file::remove(run);
+        }
+        runs = std::move(merged);
     }
 
-    
-    // Rotating index within the tmp_files array,
-    // for accessing the ifstream and associated Proto readers/writers
-    int tmp_file_index = 0;
-
-    // This is just an output buffer.
-    vector<Alignment> sorted_out_buf;
-    sorted_out_buf.reserve(1000);
+    {
+        // Write BGZF so the sorted GAM can be indexed by virtual offset
+        stream::BlockedGzipOutputStream bgzf_out(sorted_out);
+        vector<Alignment> sorted_out_buf;
+        merge_runs(runs, [&](Alignment& aln) {
+            sorted_out_buf.emplace_back();
+            sorted_out_buf.back().Swap(&aln);
+            stream::write_buffered(bgzf_out, sorted_out_buf, 1000);
+        });
+        // write any remaining records in our buffer
+        stream::write_buffered(bgzf_out, sorted_out_buf, 0);
+    }
 
-    // Our output stream
-    string outname = gamfile + ".sorted.gam";
-    ofstream ofile;
-    ofile.open(outname);
+    for (auto& run : runs) {
+        temp_file::remove(run);
+    }
+}
 
-    cerr << "in the loop" << endl;
+void GAMSorter::merge_runs(const vector<string>& run_filenames, const function<void(Alignment&)>& emit) {
 
-    while(!lil_heap.empty()){
+    vector<unique_ptr<ifstream>> run_files;
+    vector<unique_ptr<stream::ProtobufIterator<Alignment>>> run_iters;
+    for (auto& filename : run_filenames) {
+        run_files.emplace_back(new ifstream(filename));
+        if (!*run_files.back()) {
+            throw runtime_error("[GAMSorter::merge_runs] could not open temp file " + filename);
+        }
+        run_iters.emplace_back(new stream::ProtobufIterator<Alignment>(*run_files.back()));
+    }
 
-        Alignment a;
-        bool valid = read_dat_buf(tmp_file_index, a);
-        if (valid){
-            lil_heap.push(a);
+    // A heap of the next alignment from each run. Ties go to the earlier run,
+    // so that merging is stable.
+    vector<pair<Alignment, size_t>> heap;
+    auto heap_order = [&](const pair<Alignment, size_t>& a, const pair<Alignment, size_t>& b) {
+        if (less(b.first, a.first)) {
+            return true;
         }
-        else{
-            //handle_count_line(tmp_file_index);
+        if (less(a.first, b.first)) {
+            return false;
         }
-        
+        return a.second > b.second;
+    };
 
-        
-        sorted_out_buf.push_back(lil_heap.top());
-        cerr << "writing " << lil_heap.top().name() << endl;
-        if (sorted_out_buf.size() % 100 == 0){
-            cerr << "Done " << sorted_out_buf.size() << " records" << endl;
+    auto refill = [&](size_t run) {
+        if (run_iters[run]->has_next()) {
+            heap.emplace_back(**run_iters[run], run);
+            run_iters[run]->get_next();
+            push_heap(heap.begin(), heap.end(), heap_order);
         }
-        lil_heap.pop();
-        stream::write_buffered(ofile, sorted_out_buf, 1000);
-        tmp_file_index = (tmp_file_index + 1) % tmp_files.size();
+    };
 
+    for (size_t i = 0; i < run_iters.size(); i++) {
+        refill(i);
     }
-    cerr << "out the loop" << endl;
-
-    // write any remaining records in our buffer
-    stream::write_buffered(ofile, sorted_out_buf, 0);
 
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), heap_order);
+        size_t run = heap.back().second;
+        emit(heap.back().first);
+        heap.pop_back();
+        refill(run);
+    }
 }
 
 void GAMSorter::write_index(string gamfile, string outfile, bool isSorted)
 {
+    ifstream gammy;
+    gammy.open(gamfile);
+    if (!gammy || !stream::BlockedGzipInputStream::is_bgzf(gammy))
+    {
+        throw runtime_error("[GAMSorter::write_index] " + gamfile + " is not a BGZF GAM and cannot be indexed");
+    }
 
-    map<int64_t, vector<string>> node_to_alns;
+    GAMIndex index;
+    index.index(gammy);
 
-    std::function<void(Alignment &)> node_grabber = [&](Alignment &aln) {
-        vector<int64_t> ret;
-        Path p = aln.path();
-        for (int i = 0; i < p.mapping_size(); i++)
-        {
-            Mapping m = p.mapping(i);
-            ret.push_back(m.position().node_id());
-        }
-        for (auto x : ret)
-        {
-            node_to_alns[x].push_back(aln.name());
-        }
-    };
+    ofstream index_out;
+    index_out.open(outfile);
+    if (!index_out)
+    {
+        throw runtime_error("[GAMSorter::write_index] could not open " + outfile);
+    }
+    index.save(index_out);
 }
 
 bool GAMSorter::min_aln_first(Alignment &a, Alignment &b)
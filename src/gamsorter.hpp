@@ -3,6 +3,7 @@
 
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "gam_index.hpp"
 #include <string>
 #include <queue>
 #include <sstream>
@@ -42,10 +43,19 @@ class GAMSorter
 
     void paired_sort(string gamfile);
 
+    /// Write the (sorted) alignments to a new temp file, as one more run to
+    /// merge. Safe to call from several threads.
     void write_temp(vector<Alignment>& alns);
 
+    /// Sort a GAM into gamfile.sorted.gam, as BGZF, in bounded memory. Sorted
+    /// runs of at most about max_memory bytes of alignments in all are made in
+    /// parallel and written to temp files, and then merged max_fan_in at a time
+    /// until one sorted GAM is left.
     void stream_sort(string gamfile);
 
+    /// Sort the GAM read from gam_in onto sorted_out in the same way.
+    void stream_sort(istream& gam_in, ostream& sorted_out);
+
     void dumb_sort(string gamfile);
 
     // vector<Alignment> split(vector<Alignment> a, int s);
@@ -56,6 +66,8 @@ class GAMSorter
 
     Position get_min_position(Path p);
 
+    /// Write a GAMIndex of the BGZF GAM to outfile, so that the reads touching
+    /// a range of node IDs can be found without reading the whole GAM
     void write_index(string gamfile, string outfile, bool isSorted = false);
 
     bool equal_to(Position a, Position b);
@@ -64,11 +76,26 @@ class GAMSorter
 
     bool greater_than(Position a, Position b);
 
+    /// Approximate serialized size, in bytes, of the alignments held in memory
+    /// at once by stream_sort, across all threads
+    size_t max_memory = 1024 * 1024 * 1024;
+
+    /// Most temp files stream_sort merges at once
+    size_t max_fan_in = 64;
+
+    /// Sort alignments by read name instead of by position, so that two GAMs
+    /// can be joined on read name without holding either in memory
+    bool by_name = false;
+
   private:
-    map<int, int> split_to_split_size;
+    /// Compare two alignments in the order we are sorting in
+    bool less(const Alignment& a, const Alignment& b) const;
+
+    /// Merge the sorted runs in the given temp files, handing each alignment
+    /// to emit in sorted order
+    void merge_runs(const vector<string>& run_filenames, const function<void(Alignment&)>& emit);
+
     vector<string> tmp_filenames;
-    vector<ifstream*> tmp_files;
-    int max_buf_size = 20000;
     /**
     * We want to keep pairs together, with the lowest-coordinate pair coming first.
     * If one read is unmapped, it follows its partner in the sorted GAM file.
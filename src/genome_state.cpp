@@ -18,9 +18,10 @@ size_t SnarlState::size() const {
 void SnarlState::dump() const {
     // First dump the haplotypes
     for (size_t i = 0; i < haplotypes.size(); i++) {
-        cerr << "Haplotype " << i << ":";
+        cerr << "Haplotype " << i << " at visit " << haplotypes.at(i).first << ":";
         
-        for (auto& record : haplotypes.at(i)) {
+        for (size_t j = 0; j < haplotypes.at(i).second; j++) {
+            auto& record = visits.at(haplotypes.at(i).first + j);
             cerr << " " << graph->get_id(record.first) << " " << graph->get_is_reverse(record.first)
                 << " at lane " << record.second << ",";
         }
@@ -34,18 +35,76 @@ void SnarlState::dump() const {
         cerr << "Net node " << graph->get_id(kv.first) << " " << graph->get_is_reverse(kv.first) << " lanes:" << endl;
         
         for (size_t i = 0; i < kv.second.size(); i++) {
-            cerr << "\tLane " << i << ": " << graph->get_id(kv.second.at(i)->first)
-                << " " << graph->get_is_reverse(kv.second.at(i)->first)
-                << " at lane " << kv.second.at(i)->second << endl;
+            auto& record = visits.at(kv.second.at(i));
+            cerr << "\tLane " << i << ": " << graph->get_id(record.first)
+                << " " << graph->get_is_reverse(record.first)
+                << " at lane " << record.second << endl;
         }
         
     }
     
 }
 
+size_t SnarlState::claim_range(size_t length) {
+    auto found = free_ranges.find(length);
+    if (found != free_ranges.end() && !found->second.empty()) {
+        // Reuse a range that fits exactly
+        size_t start = found->second.back();
+        found->second.pop_back();
+        free_visits -= length;
+        return start;
+    }
+    
+    if (free_visits > visits.size() / 2) {
+        // Mostly holes; pack everything down before growing
+        compact();
+    }
+    
+    // Make a new range at the end
+    size_t start = visits.size();
+    visits.resize(start + length);
+    return start;
+}
+
+void SnarlState::compact() {
+    // Work out where each live visit goes
+    vector<size_t> new_index(visits.size());
+    vector<pair<handle_t, size_t>> packed;
+    packed.reserve(visits.size() - free_visits);
+    for (auto& range : haplotypes) {
+        size_t new_start = packed.size();
+        for (size_t i = 0; i < range.second; i++) {
+            new_index[range.first + i] = new_start + i;
+            packed.push_back(visits[range.first + i]);
+        }
+        range.first = new_start;
+    }
+    
+    // Point all the lanes at the new places
+    for (auto& kv : net_node_lanes) {
+        for (auto& index : kv.second) {
+            index = new_index[index];
+        }
+    }
+    
+    visits = std::move(packed);
+    free_ranges.clear();
+    free_visits = 0;
+}
+
+void SnarlState::shift_lanes(vector<size_t>& node_lanes, size_t first_lane, int64_t delta) {
+    for (size_t i = first_lane; i < node_lanes.size(); i++) {
+        // Update all the records in that net node's lane list from here on
+        // and bump their internal lane assignments
+        visits[node_lanes[i]].second += delta;
+    }
+}
+
 void SnarlState::trace(size_t overall_lane, bool backward, const function<void(const handle_t&, size_t)>& iteratee) const {
     // Get the haplotype we want to loop over
-    auto& haplotype = haplotypes.at(overall_lane);
+    auto& range = haplotypes.at(overall_lane);
+    auto begin = visits.begin() + range.first;
+    auto end = begin + range.second;
     
     auto process_traversal = [&](const pair<handle_t, size_t>& handle_and_lane) {
         // For every handle in the haplotype, yield it either forward or
@@ -56,10 +115,10 @@ void SnarlState::trace(size_t overall_lane, bool backward, const function<void(c
     if (backward) {
         // If we're going backward, go in reverse order.
         // See <https://stackoverflow.com/a/23094303>
-        for_each(haplotype.rbegin(), haplotype.rend(), process_traversal);
+        for_each(make_reverse_iterator(end), make_reverse_iterator(begin), process_traversal);
     } else {
         // Otherwise go in forward order
-        for_each(haplotype.begin(), haplotype.end(), process_traversal);
+        for_each(begin, end, process_traversal);
     }
 }
 
@@ -89,34 +148,27 @@ void SnarlState::insert(const vector<pair<handle_t, size_t>>& haplotype) {
 
     // TODO: all these inserts at indexes are O(N).
 
-    // Insert the whole traversal into haplotypes at the appropriate index for the overall lane
+    // Store the whole traversal and put its range at the appropriate index for the overall lane
     size_t overall_lane = haplotype.front().second;
     assert(overall_lane == haplotype.back().second);
-    auto inserted = haplotypes.emplace(haplotypes.begin() + overall_lane, haplotype);
+    size_t start = claim_range(haplotype.size());
+    copy(haplotype.begin(), haplotype.end(), visits.begin() + start);
+    haplotypes.emplace(haplotypes.begin() + overall_lane, start, haplotype.size());
     
-    for (auto it = inserted->begin(); it != inserted->end(); ++it) {
+    for (size_t i = 0; i < haplotype.size(); i++) {
         // For each handle visit
-        auto& handle_visit = *it;
+        auto& handle_visit = haplotype[i];
         
-        // Insert the iterator record at the right place in net_node_lanes
+        // Insert the reference record at the right place in net_node_lanes
         auto& node_lanes = net_node_lanes[graph->forward(handle_visit.first)];
-        auto lane_iterator = node_lanes.emplace(node_lanes.begin() + handle_visit.second, it);
+        node_lanes.insert(node_lanes.begin() + handle_visit.second, start + i);
     
-        // Look at whatever is after the lane we just inserted
-        ++lane_iterator;
-        while (lane_iterator != node_lanes.end()) {
-            // Update all the subsequent records in that net node's lane list and bump up their internal lane assignments
-            
-            // First dereference to get the iterator that points to the actual
-            // record, then dereference that, and increment the lane number.
-            (*(*lane_iterator)).second++;
-            
-            ++lane_iterator;
-        }
+        // Bump up whatever is after the lane we just inserted
+        shift_lanes(node_lanes, handle_visit.second + 1, 1);
     }
 }
 
-const vector<pair<handle_t, size_t>>& SnarlState::append(const vector<handle_t>& haplotype, bool backward) {
+vector<pair<handle_t, size_t>> SnarlState::append(const vector<handle_t>& haplotype, bool backward) {
     assert(!haplotype.empty());
     
     if (backward) {
@@ -131,9 +183,9 @@ const vector<pair<handle_t, size_t>>& SnarlState::append(const vector<handle_t>&
         }
     }
     
-    // Make a new haplotype at the end of our haplotypes vector that's big enough.
-    haplotypes.emplace_back(haplotype.size());
-    auto& inserted = haplotypes.back();
+    // Make a new haplotype in the last lane that's big enough.
+    size_t start = claim_range(haplotype.size());
+    haplotypes.emplace_back(start, haplotype.size());
     
     for (size_t i = backward ? (haplotype.size() - 1) : 0;
         backward ? (i != (size_t) -1) : i < haplotype.size();
@@ -151,30 +203,30 @@ const vector<pair<handle_t, size_t>>& SnarlState::append(const vector<handle_t>&
         
         // Work out where we are putting it. We should insert left to right when
         // going forward, and right to left when going backward.
-        auto inserted_iterator = inserted.begin() + (backward ? haplotype.size() - 1 - i : i);
+        size_t visit = start + (backward ? haplotype.size() - 1 - i : i);
         
         // Save the handle
-        inserted_iterator->first = handle;
+        visits[visit].first = handle;
         
         // Find the appropriate node lanes collection
         auto& node_lanes = net_node_lanes[graph->forward(handle)];
         // Save the local lane assignment
-        inserted_iterator->second = node_lanes.size();
+        visits[visit].second = node_lanes.size();
         // And do the insert
-        node_lanes.emplace_back(inserted_iterator);
+        node_lanes.push_back(visit);
         
 #ifdef debug
         cerr << "At haplotype position " << i << "/" << haplotype.size()
             << " inserted " << graph->get_id(handle) << " " << graph->get_is_reverse(handle)
-            << " at lane " << inserted_iterator->second << "/" << node_lanes.size() << endl;
+            << " at lane " << visits[visit].second << "/" << node_lanes.size() << endl;
 #endif
     }
     
     // Return the completed vector with the lane annotations.
-    return inserted;
+    return vector<pair<handle_t, size_t>>(visits.begin() + start, visits.begin() + start + haplotype.size());
 }
 
-const vector<pair<handle_t, size_t>>& SnarlState::insert(size_t overall_lane, const vector<handle_t>& haplotype, bool backward) {
+vector<pair<handle_t, size_t>> SnarlState::insert(size_t overall_lane, const vector<handle_t>& haplotype, bool backward) {
     assert(!haplotype.empty());
     
     if (backward) {
@@ -189,8 +241,9 @@ const vector<pair<handle_t, size_t>>& SnarlState::insert(size_t overall_lane, co
         }
     }
     
-    // Insert a haplotype record at the specified overall lane that's big enough.
-    auto& inserted = *haplotypes.emplace(haplotypes.begin() + overall_lane, haplotype.size());
+    // Put a haplotype record that's big enough at the specified overall lane.
+    size_t start = claim_range(haplotype.size());
+    haplotypes.emplace(haplotypes.begin() + overall_lane, start, haplotype.size());
     
     for (size_t i = backward ? (haplotype.size() - 1) : 0;
         backward ? (i != (size_t) -1) : i < haplotype.size();
@@ -208,73 +261,58 @@ const vector<pair<handle_t, size_t>>& SnarlState::insert(size_t overall_lane, co
         
         // Work out where we are putting it. We should insert left to right when
         // going forward, and right to left when going backward.
-        auto inserted_iterator = inserted.begin() + + (backward ? haplotype.size() - 1 - i : i);
+        size_t visit = start + (backward ? haplotype.size() - 1 - i : i);
         
         // Save the handle
-        inserted_iterator->first = handle;
+        visits[visit].first = handle;
         
         // Find the appropriate node lanes collection
         auto& node_lanes = net_node_lanes[graph->forward(handle)];
         
-        if (inserted_iterator == inserted.begin() || inserted_iterator + 1 == inserted.end()) {
+        if (visit == start || visit + 1 == start + haplotype.size()) {
             // Start and end visits get placed at the predetermined overall_lane
-            inserted_iterator->second = overall_lane;
+            visits[visit].second = overall_lane;
             
             // Insert at the correct offset
-            auto lane_iterator = node_lanes.emplace(node_lanes.begin() + overall_lane, inserted_iterator);
+            node_lanes.insert(node_lanes.begin() + overall_lane, visit);
             
-            // Look at whatever is after the lane we just inserted
-            ++lane_iterator;
-            while (lane_iterator != node_lanes.end()) {
-                // Update all the subsequent records in that net node's lane list and bump up their internal lane assignments
-                
-                // First dereference to get the iterator that points to the actual
-                // record, then dereference that, and increment the lane number.
-                (*(*lane_iterator)).second++;
-                
-                ++lane_iterator;
-            }
+            // Bump up whatever is after the lane we just inserted
+            shift_lanes(node_lanes, overall_lane + 1, 1);
                 
         } else {
             // Interior visits just get appended, which is simplest. No need to bump anything up.
             
             // Save the local lane assignment
-            inserted_iterator->second = node_lanes.size();
+            visits[visit].second = node_lanes.size();
             // And do the insert
-            node_lanes.emplace_back(inserted_iterator);
+            node_lanes.push_back(visit);
         }
-        
-        // Insert the next handle in the next slot in the haplotype
-        ++inserted_iterator;
     } 
     
     // Return the annotated haplotype.
-    return inserted;
+    return vector<pair<handle_t, size_t>>(visits.begin() + start, visits.begin() + start + haplotype.size());
 }
 
 vector<pair<handle_t, size_t>> SnarlState::erase(size_t overall_lane) {
+    auto range = haplotypes.at(overall_lane);
+    
     // Copy what we're erasing
-    auto copy = haplotypes.at(overall_lane);
+    vector<pair<handle_t, size_t>> copy(visits.begin() + range.first, visits.begin() + range.first + range.second);
     
     for (auto it = copy.rbegin(); it != copy.rend(); ++it) {
         // Trace from end to start and remove from the net node lanes collections.
         // We have to do it backward so we can handle duplicate visits properly.
         auto& node_lanes = net_node_lanes[graph->forward(it->first)];
-        auto lane_iterator = node_lanes.erase(node_lanes.begin() + it->second);
+        node_lanes.erase(node_lanes.begin() + it->second);
         
-        while (lane_iterator != node_lanes.end()) {
-            // Update all the subsequent records in that net node's lane list and bump down their internal lane assignments
-            
-            // First dereference to get the iterator that points to the actual
-            // record, then dereference that, and decrement the lane number.
-            (*(*lane_iterator)).second--;
-            
-            ++lane_iterator;
-        }
+        // Bump down the lane assignments of everything that was after it
+        shift_lanes(node_lanes, it->second, -1);
     }
 
-    // Drop the actual haplotype
+    // Drop the actual haplotype, keeping its range of visits for reuse
     haplotypes.erase(haplotypes.begin() + overall_lane);
+    free_ranges[range.second].push_back(range.first);
+    free_visits += range.second;
     
     // Return the copy
     return copy;
@@ -282,9 +320,12 @@ vector<pair<handle_t, size_t>> SnarlState::erase(size_t overall_lane) {
 
 void SnarlState::swap(size_t lane1, size_t lane2) {
     
+    auto& range1 = haplotypes.at(lane1);
+    auto& range2 = haplotypes.at(lane2);
+    
     // Swap the start and end annotation values
-    std::swap(haplotypes.at(lane1).front().second, haplotypes.at(lane2).front().second);
-    std::swap(haplotypes.at(lane1).back().second, haplotypes.at(lane2).back().second);
+    std::swap(visits.at(range1.first).second, visits.at(range2.first).second);
+    std::swap(visits.at(range1.first + range1.second - 1).second, visits.at(range2.first + range2.second - 1).second);
     
     // Swap the start net node index entries
     auto& start_node_lanes = net_node_lanes[graph->forward(graph->get_start())];
@@ -294,7 +335,7 @@ void SnarlState::swap(size_t lane1, size_t lane2) {
     auto& end_node_lanes = net_node_lanes[graph->forward(graph->get_end())];
     std::swap(end_node_lanes.at(lane1), end_node_lanes.at(lane2));
     
-    // Swap the actual haplotype vectors
+    // Swap which ranges are in the lanes
     std::swap(haplotypes.at(lane1), haplotypes.at(lane2));
 }
 
@@ -832,7 +873,7 @@ void GenomeState::insert_handles(const vector<handle_t>& to_add,
             // Add in its haplotype, and get the resulting lane assignments.
             // Make sure to insert at the right lane if we are the last thing on
             // the stack (i.e. the top level snarl) and have a particular lane.
-            auto& embedded = (stack.size() == 1 && top_lane != numeric_limits<size_t>::max()) ?
+            auto embedded = (stack.size() == 1 && top_lane != numeric_limits<size_t>::max()) ?
                 snarl_state.insert(top_lane, stack.front().second, backward) :
                 snarl_state.append(stack.front().second, backward);
             
@@ -38,21 +38,47 @@ class SnarlState {
 
 protected:
     
-    // This stores, for each overall lane, the traversal in that lane, annotated with its internal lane assignments
-    vector<vector<pair<handle_t, size_t>>> haplotypes;
+    // This stores the visits of all the haplotype traversals, each annotated
+    // with its internal lane assignment, back to back in one array. A
+    // haplotype's range of visits stays put when other haplotypes are
+    // inserted or erased, so visits can be referred to by index.
+    vector<pair<handle_t, size_t>> visits;
+    
+    // This stores, for each overall lane, the start and length of the range
+    // of visits holding the haplotype in that lane.
+    vector<pair<size_t, size_t>> haplotypes;
+    
+    // These ranges of visits belonged to erased haplotypes. They are kept by
+    // length, to be reused by the next haplotypes of the same length, so
+    // undoing an erase doesn't need new space.
+    unordered_map<size_t, vector<size_t>> free_ranges;
+    
+    // This is how many visits are in free ranges.
+    size_t free_visits = 0;
     
     // This stores, for each forward handle, a vector of all the lanes in order.
-    // Each lane is holding an iterator to the entry in the haplotyope that
+    // Each lane is holding the index of the visit in the haplotype that
     // occupies that lane. When we insert into or delete out of the vectors in
-    // this map, we update the lane numbers where all the iterators point. TODO:
+    // this map, we update the lane numbers of all the visits after it. TODO:
     // really we need to hold skip lists or something; we need efficient insert
     // at index. But since we still need to pay O(N) fixing up stuff after the
     // insert, it might not be worth it.
-    unordered_map<handle_t, vector<decltype(haplotypes)::value_type::iterator>> net_node_lanes;
+    unordered_map<handle_t, vector<size_t>> net_node_lanes;
     
     /// We need to keep track of the net graph, because we may need to traverse
     /// haplotypes forward or reverse and we need to flip things.
     const NetGraph* graph;
+    
+    /// Get the start of a range of visits of the given length to store a new
+    /// haplotype in. May move the visits of existing haplotypes.
+    size_t claim_range(size_t length);
+    
+    /// Pack the visits of all the haplotypes together, dropping free ranges.
+    void compact();
+    
+    /// Increment (or decrement) the lane assignments of all the visits in the
+    /// given lanes and after.
+    void shift_lanes(vector<size_t>& node_lanes, size_t first_lane, int64_t delta);
 
 public:
     
@@ -84,7 +110,7 @@ public:
     /// handle to the next available lane. Returns the haplotype annotated with
     /// lane assignments. If handles to the same node or child snarl appear more
     /// than once, their lane numbers will be strictly increasing.
-    const vector<pair<handle_t, size_t>>& append(const vector<handle_t>& haplotype, bool backward = false);
+    vector<pair<handle_t, size_t>> append(const vector<handle_t>& haplotype, bool backward = false);
     
     /// Insert the given traversal of this snarl from start to end or end to
     /// start (as determined by the backward flag), assigning it to the given
@@ -94,7 +120,7 @@ public:
     /// at the right lanes. If handles to the same node or child snarl appear
     /// more than once, their assigned lane numbers will be strictly increasing.
     /// Returns the haplotype annotated with lane assignments.
-    const vector<pair<handle_t, size_t>>& insert(size_t overall_lane, const vector<handle_t>& haplotype, bool backward = false);
+    vector<pair<handle_t, size_t>> insert(size_t overall_lane, const vector<handle_t>& haplotype, bool backward = false);
     
     // TODO: can we do an efficient replace? Or should we just drop and add.
     
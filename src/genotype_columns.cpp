@@ -0,0 +1,80 @@
+#include "genotype_columns.hpp"
+
+#include <cstring>
+
+namespace vg {
+
+using namespace std;
+
+void GenotypeColumns::index(const string& line) {
+    line_data = line.data();
+    gt_starts.clear();
+    gt_lengths.clear();
+
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+
+    // get the end of the field that starts at start, within [start, limit)
+    auto field_end = [](const char* start, const char* limit, char separator) {
+        const char* found = (const char*) memchr(start, separator, limit - start);
+        return found == nullptr ? limit : found;
+    };
+
+    // skip CHROM through INFO
+    const char* column = begin;
+    for (size_t i = 0; i < 8; i++) {
+        column = field_end(column, end, '\t');
+        if (column == end) {
+            // no FORMAT, so no samples
+            return;
+        }
+        column++;
+    }
+
+    // find which FORMAT field is GT
+    const char* format_end = field_end(column, end, '\t');
+    size_t gt_field = 0;
+    bool has_gt = false;
+    for (const char* field = column; field < format_end; gt_field++) {
+        const char* next = field_end(field, format_end, ':');
+        if (next - field == 2 && field[0] == 'G' && field[1] == 'T') {
+            has_gt = true;
+            break;
+        }
+        field = next + 1;
+    }
+
+    for (column = format_end; column < end; ) {
+        // step over the tab in front of the sample
+        column++;
+        const char* column_end = field_end(column, end, '\t');
+
+        const char* gt = column;
+        for (size_t i = 0; i < gt_field && gt < column_end; i++) {
+            gt = field_end(gt, column_end, ':') + 1;
+        }
+        if (has_gt && gt < column_end) {
+            gt_starts.push_back(gt - begin);
+            gt_lengths.push_back(field_end(gt, column_end, ':') - gt);
+        } else {
+            gt_starts.push_back(0);
+            gt_lengths.push_back(0);
+        }
+
+        column = column_end;
+    }
+}
+
+size_t GenotypeColumns::size() const {
+    return gt_starts.size();
+}
+
+void GenotypeColumns::get(size_t sample, string& gt) const {
+    if (sample >= gt_starts.size()) {
+        gt.clear();
+        return;
+    }
+    gt.assign(line_data + gt_starts[sample], gt_lengths[sample]);
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef VG_GENOTYPE_COLUMNS_HPP_INCLUDED
+#define VG_GENOTYPE_COLUMNS_HPP_INCLUDED
+
+/**
+ * \file genotype_columns.hpp
+ *
+ * Finds the GT value of each sample in a raw VCF data line, without parsing
+ * the other FORMAT fields into strings. Reading haplotypes out of a VCF with
+ * thousands of samples only needs the genotypes, and vcflib's sample parsing
+ * can then be turned off.
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+class GenotypeColumns {
+public:
+
+    /// Find the genotypes in a tab-separated VCF data line, replacing any
+    /// found before. The line must not change or go away while genotypes are
+    /// being read from it. If the line has no GT field, every sample will have
+    /// an empty genotype.
+    void index(const string& line);
+
+    /// Get the number of sample columns found.
+    size_t size() const;
+
+    /// Copy the GT value of the sample with the given index into gt, which
+    /// can be reused between calls to avoid allocating. The GT value is empty
+    /// if the sample or its GT field is missing, as in
+    /// vcflib::Variant::getGenotype().
+    void get(size_t sample, string& gt) const;
+
+private:
+
+    /// The line being read
+    const char* line_data = nullptr;
+
+    /// Offset and length of each sample's GT value in the line
+    vector<size_t> gt_starts;
+    vector<size_t> gt_lengths;
+};
+
+}
+
+#endif
@@ -293,6 +293,45 @@ void AugmentedGraph::write_translations(ostream& out_file) {
     stream::write_buffered(out_file, translator.translations, 0);
 }
 
+void SupportColumns::resize(size_t count) {
+    forward.resize(count);
+    reverse.resize(count);
+    quality.resize(count);
+    present.resize(count);
+}
+
+Support SupportColumns::get(size_t rank) const {
+    Support support;
+    if (has(rank)) {
+        support.set_forward(forward[rank]);
+        support.set_reverse(reverse[rank]);
+        support.set_quality(quality[rank]);
+    }
+    return support;
+}
+
+void SupportColumns::set(size_t rank, double forward_support, double reverse_support, double support_quality) {
+    if (rank >= present.size()) {
+        // Grow geometrically when elements are annotated as they are made
+        resize(max(rank + 1, present.size() * 2));
+    }
+    if (!present[rank]) {
+        present[rank] = true;
+        count++;
+    }
+    forward[rank] = forward_support;
+    reverse[rank] = reverse_support;
+    quality[rank] = support_quality;
+}
+
+void SupportColumns::set(size_t rank, const Support& support) {
+    set(rank, support.forward(), support.reverse(), support.quality());
+}
+
+void SupportColumns::clear() {
+    *this = SupportColumns();
+}
+
 void SupportAugmentedGraph::clear() {
     // Reset to default state
     *this = SupportAugmentedGraph();
@@ -303,23 +342,67 @@ bool SupportAugmentedGraph::has_supports() const {
 }
 
 Support SupportAugmentedGraph::get_support(Node* node) {
-    return node_supports.count(node) ? node_supports.at(node) : Support();
+    auto found = graph.node_index.find(node);
+    return found != graph.node_index.end() ? node_supports.get(found->second) : Support();
 }
 
 Support SupportAugmentedGraph::get_support(Edge* edge) {
-    return edge_supports.count(edge) ? edge_supports.at(edge) : Support();
+    auto found = graph.edge_index.find(edge);
+    return found != graph.edge_index.end() ? edge_supports.get(found->second) : Support();
+}
+
+bool SupportAugmentedGraph::has_support(Node* node) const {
+    auto found = graph.node_index.find(node);
+    return found != graph.node_index.end() && node_supports.has(found->second);
+}
+
+bool SupportAugmentedGraph::has_support(Edge* edge) const {
+    auto found = graph.edge_index.find(edge);
+    return found != graph.edge_index.end() && edge_supports.has(found->second);
+}
+
+void SupportAugmentedGraph::set_support(Node* node, const Support& support) {
+    node_supports.set(graph.node_index.at(node), support);
+}
+
+void SupportAugmentedGraph::set_support(Edge* edge, const Support& support) {
+    edge_supports.set(graph.edge_index.at(edge), support);
+}
+
+void SupportAugmentedGraph::for_each_node_support(const function<void(Node*, const Support&)>& lambda) {
+    size_t ranks = min(node_supports.capacity(), (size_t) graph.graph.node_size());
+    for (size_t i = 0; i < ranks; i++) {
+        if (node_supports.has(i)) {
+            lambda(graph.graph.mutable_node(i), node_supports.get(i));
+        }
+    }
+}
+
+void SupportAugmentedGraph::for_each_edge_support(const function<void(Edge*, const Support&)>& lambda) {
+    size_t ranks = min(edge_supports.capacity(), (size_t) graph.graph.edge_size());
+    for (size_t i = 0; i < ranks; i++) {
+        if (edge_supports.has(i)) {
+            lambda(graph.graph.mutable_edge(i), edge_supports.get(i));
+        }
+    }
 }
 
 void SupportAugmentedGraph::load_supports(istream& in_file) {
     node_supports.clear();
     edge_supports.clear();
+    // Size the columns for the whole graph up front
+    node_supports.resize(graph.graph.node_size());
+    edge_supports.resize(graph.graph.edge_size());
     function<void(LocationSupport&)> lambda = [&](LocationSupport& location_support) {
         if (location_support.oneof_location_case() == LocationSupport::kNodeId) {
-            node_supports[graph.get_node(location_support.node_id())] = location_support.support();
+            set_support(graph.get_node(location_support.node_id()), location_support.support());
         } else {
             const Edge& edge = location_support.edge();
-            edge_supports[graph.get_edge(NodeSide(edge.from(), !edge.from_start()),
-                                         NodeSide(edge.to(), edge.to_end()))] = location_support.support();
+            Edge* graph_edge = graph.get_edge(NodeSide(edge.from(), !edge.from_start()),
+                                              NodeSide(edge.to(), edge.to_end()));
+            if (graph_edge != nullptr) {
+                set_support(graph_edge, location_support.support());
+            }
         }
     };
     stream::for_each(in_file, lambda);    
@@ -327,20 +410,20 @@ void SupportAugmentedGraph::load_supports(istream& in_file) {
 
 void SupportAugmentedGraph::write_supports(ostream& out_file) {
     vector<LocationSupport> buffer;
-    for (auto& node_support : node_supports) {
+    for_each_node_support([&](Node* node, const Support& support) {
         LocationSupport location_support;
-        *location_support.mutable_support() = node_support.second;
-        location_support.set_node_id(node_support.first->id());
+        *location_support.mutable_support() = support;
+        location_support.set_node_id(node->id());
         buffer.push_back(location_support);
         stream::write_buffered(out_file, buffer, 500);
-    }
-    for (auto& edge_support : edge_supports) {
+    });
+    for_each_edge_support([&](Edge* edge, const Support& support) {
         LocationSupport location_support;
-        *location_support.mutable_support() = edge_support.second;        
-        *location_support.mutable_edge() = *edge_support.first;
+        *location_support.mutable_support() = support;        
+        *location_support.mutable_edge() = *edge;
         buffer.push_back(location_support);
         stream::write_buffered(out_file, buffer, 500);
-    }
+    });
     stream::write_buffered(out_file, buffer, 0);
 }
 
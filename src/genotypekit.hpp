@@ -257,15 +257,65 @@ protected:
     pair_hash_map<pair<NodeSide, NodeSide>, vector<Alignment*>> alignments_by_edge;
 };
 
+/**
+ * Supports for a set of graph elements, stored a column per field and indexed
+ * by the elements' ranks, instead of as a Support object per element. Only the
+ * quality and the strand counts are kept.
+ */
+class SupportColumns {
+public:
+    /// Make room for supports for all elements with ranks below the given
+    /// count, so that setting them doesn't have to grow the columns.
+    void resize(size_t count);
+    
+    /// Is there a support for the element with the given rank?
+    inline bool has(size_t rank) const {
+        return rank < present.size() && present[rank];
+    }
+    
+    /// Get the support for the element with the given rank, or an empty
+    /// Support if it has none.
+    Support get(size_t rank) const;
+    
+    /// Set the support for the element with the given rank.
+    void set(size_t rank, double forward, double reverse, double quality);
+    void set(size_t rank, const Support& support);
+    
+    /// Get the number of elements with supports.
+    inline size_t size() const {
+        return count;
+    }
+    
+    inline bool empty() const {
+        return count == 0;
+    }
+    
+    /// Get the number of ranks the columns have room for.
+    inline size_t capacity() const {
+        return present.size();
+    }
+    
+    void clear();
+    
+private:
+    vector<double> forward;
+    vector<double> reverse;
+    vector<double> quality;
+    vector<bool> present;
+    size_t count = 0;
+};
+
 /// Augmented Graph that holds some Support annotation data specific to vg call
 struct SupportAugmentedGraph : public AugmentedGraph {
         
-    // This holds support info for nodes. Note that we discard the "os" other
-    // support field from StrandSupport.
-    // Supports for nodes are minimum distinct reads that use the node.
-    map<Node*, Support> node_supports;
+    // This holds support info for nodes, indexed by rank in the graph's Graph
+    // object. Note that we discard the "os" other support field from
+    // StrandSupport. Supports for nodes are minimum distinct reads that use
+    // the node. Since ranks change when nodes or edges are removed, supports
+    // must be set once the graph is done being edited.
+    SupportColumns node_supports;
     // And for edges
-    map<Edge*, Support> edge_supports;
+    SupportColumns edge_supports;
     
     /**
      * Return true if we have support information, and false otherwise.
@@ -282,6 +332,38 @@ struct SupportAugmentedGraph : public AugmentedGraph {
      */
     virtual Support get_support(Edge* edge);    
     
+    /**
+     * Return true if the given Node has a recorded support.
+     */
+    bool has_support(Node* node) const;
+    
+    /**
+     * Return true if the given Edge has a recorded support.
+     */
+    bool has_support(Edge* edge) const;
+    
+    /**
+     * Record the Support for a Node in the graph.
+     */
+    void set_support(Node* node, const Support& support);
+    
+    /**
+     * Record the Support for an Edge in the graph.
+     */
+    void set_support(Edge* edge, const Support& support);
+    
+    /**
+     * Call the given function on every Node with a recorded support, in rank
+     * order.
+     */
+    void for_each_node_support(const function<void(Node*, const Support&)>& lambda);
+    
+    /**
+     * Call the given function on every Edge with a recorded support, in rank
+     * order.
+     */
+    void for_each_edge_support(const function<void(Edge*, const Support&)>& lambda);
+    
     /**
      * Clear the contents.
      */
@@ -1,4 +1,5 @@
 #include <cstdint>
+#include <limits>
 #include "genotyper.hpp"
 #include "algorithms/topological_sort.hpp"
 #include "traversal_finder.hpp"
@@ -109,10 +110,8 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
     // We're going to count up all the affinities we compute
     size_t total_affinities = 0;
 
-    // We need a buffer for output
-    vector<vector<Locus>> buffer;
-    int thread_count = get_thread_count();
-    buffer.resize(thread_count);
+    // We need a buffer for protobuf output
+    vector<Locus> buffer;
 
     // If we're doing VCF output we need a VCF header
     vcflib::VariantCallFile* vcf = nullptr;
@@ -127,13 +126,46 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
         vcf = start_vcf(cout, *reference_index, sample_name, contig_name, length_override);
     }
 
-    manager.for_each_snarl_parallel([&](const Snarl* snarl) {
-        // For each snarl in parallel
+    // We only work on ultrabubbles right now, so collect them all
+    vector<const Snarl*> ultrabubbles;
+    manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+        if (snarl->type() == ULTRABUBBLE) {
+            ultrabubbles.push_back(snarl);
+        }
+    });
 
-        if (snarl->type() != ULTRABUBBLE) {
-            // We only work on ultrabubbles right now
-            return;
+    if (reference_index != nullptr) {
+        // Put the ultrabubbles in reference order, so their variants come out
+        // sorted. Snarls off the reference go at the end, in preorder.
+        vector<size_t> reference_start(ultrabubbles.size(), numeric_limits<size_t>::max());
+        for (size_t i = 0; i < ultrabubbles.size(); i++) {
+            for (id_t boundary : {ultrabubbles[i]->start().node_id(), ultrabubbles[i]->end().node_id()}) {
+                auto found = reference_index->by_id.find(boundary);
+                if (found != reference_index->by_id.end()) {
+                    reference_start[i] = min(reference_start[i], found->second.first);
+                }
+            }
         }
+        vector<size_t> order(ultrabubbles.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return reference_start[a] < reference_start[b];
+        });
+        vector<const Snarl*> sorted;
+        sorted.reserve(order.size());
+        for (size_t i : order) {
+            sorted.push_back(ultrabubbles[i]);
+        }
+        ultrabubbles = std::move(sorted);
+    }
+
+    // Genotype one ultrabubble, putting any variants or locus it produces in
+    // the given vectors. Only touches shared state under critical sections, so
+    // it can run on many snarls at once.
+    auto genotype_ultrabubble = [&](const Snarl* snarl, vector<vcflib::Variant>& variants_out,
+                                    vector<Locus>& loci_out) {
 
         // Get the contents
         pair<unordered_set<Node*>, unordered_set<Edge*> > snarl_contents =
@@ -156,8 +188,6 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
         // Report the snarl to our statistics code
         report_snarl(snarl, manager, reference_index, graph, reference_index);
 
-        int tid = omp_get_thread_num();
-
         // Get the traverals
         vector<SnarlTraversal> paths = get_snarl_traversals(augmented_graph, manager, reads_by_name,
                                                             snarl, snarl_contents, reference_index,
@@ -229,8 +259,7 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
                 }
                 variant.position += variant_offset;
 
-#pragma omp critical(cout)
-                cout << variant << endl;
+                variants_out.push_back(variant);
             }
         } else {
             // project into original graph (only need to do if we augmented with edit)
@@ -248,23 +277,56 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
                                    .position());
             }
             genotyped.set_name(name.str());
-            if (output_json) {
-                // Dump in JSON
-#pragma omp critical (cout)
-                cout << pb2json(genotyped) << endl;
-            } else {
-                // Write out in Protobuf
-                buffer[tid].push_back(genotyped);
-                stream::write_buffered(cout, buffer[tid], 100);
+            loci_out.push_back(genotyped);
+        }
+    };
+
+    // Genotype the ultrabubbles in batches on all threads, and then write
+    // each batch out in order, so the output doesn't depend on scheduling.
+    size_t batch_size = 64 * get_thread_count();
+    for (size_t batch_start = 0; batch_start < ultrabubbles.size(); batch_start += batch_size) {
+        size_t batch_end = min(batch_start + batch_size, ultrabubbles.size());
+        vector<vector<vcflib::Variant>> batch_variants(batch_end - batch_start);
+        vector<vector<Locus>> batch_loci(batch_end - batch_start);
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch_start; i < batch_end; i++) {
+            genotype_ultrabubble(ultrabubbles[i], batch_variants[i - batch_start], batch_loci[i - batch_start]);
+        }
+
+        if (output_vcf) {
+            // Nested and overlapping sites can still come out of order
+            // within a batch.
+            vector<vcflib::Variant*> sorted;
+            for (auto& variants : batch_variants) {
+                for (auto& variant : variants) {
+                    sorted.push_back(&variant);
+                }
+            }
+            stable_sort(sorted.begin(), sorted.end(), [](const vcflib::Variant* a, const vcflib::Variant* b) {
+                return a->position < b->position;
+            });
+            for (auto variant : sorted) {
+                cout << *variant << endl;
             }
         }
-    });
+        for (auto& loci : batch_loci) {
+            for (auto& locus : loci) {
+                if (output_json) {
+                    // Dump in JSON
+                    cout << pb2json(locus) << endl;
+                } else {
+                    // Write out in Protobuf
+                    buffer.push_back(locus);
+                    stream::write_buffered(cout, buffer, 100);
+                }
+            }
+        }
+    }
 
     if(!output_json && !output_vcf) {
-        // Flush the protobuf output buffers
-        for(int i = 0; i < buffer.size(); i++) {
-            stream::write_buffered(cout, buffer[i], 0);
-        }
+        // Flush the protobuf output buffer
+        stream::write_buffered(cout, buffer, 0);
     } 
 
 
@@ -713,10 +775,13 @@ map<const Alignment*, vector<Genotyper::Affinity>>
         surrounding.add_edges(aug.graph.edges_of(aug.graph.get_node(id)));
     }
 
-    for(auto& path : snarl_paths) {
-        // Now for each snarl path, make a copy of that graph with it in
-        VG allele_graph(surrounding);
+    // We need a way to get graph node sizes to reverse alignments
+    auto get_node_size = [&](id_t id) {
+        return aug.graph.get_node(id)->sequence().size();
+    };
 
+    // Add the nodes on a snarl path, and the edges between them, to a graph
+    auto add_path_to_graph = [&](const SnarlTraversal& path, VG& allele_graph) {
         for (size_t i = 0; i < path.visit_size(); i++) {
             // Add in every node on the path to the new allele graph
             allele_graph.add_node(*aug.graph.get_node(path.visit(i).node_id()));
@@ -740,6 +805,97 @@ map<const Alignment*, vector<Genotyper::Affinity>>
                 allele_graph.add_edge(path_edge);
             }
         }
+    };
+
+    // Which orientations we need to align each read in. Which reads are
+    // informative doesn't depend on the allele, so we work it out, and
+    // reverse complement the reads, just once.
+    struct ReadToAlign {
+        const Alignment* read;
+        Alignment reversed;
+        bool quality_adjusted;
+        bool try_forward;
+        bool try_reverse;
+    };
+    vector<ReadToAlign> reads_to_align;
+    for(auto& name : relevant_read_names) {
+        // For every read that touched the ultrabubble, grab its original
+        // Alignment pointer.
+        const Alignment* read = reads_by_name.at(name);
+
+        // Look to make sure it touches more than one node actually in the
+        // ultrabubble, or a non-start, non-end node. If it just touches the
+        // start or just touches the end, it can't be informative.
+        set<id_t> touched_set;
+        // Will this read be informative?
+        bool informative = false;            
+        for(size_t i = 0; i < read->path().mapping_size(); i++) {
+            // Look at every node the read touches
+            id_t touched = read->path().mapping(i).position().node_id();
+            if(contents.first.count(aug.graph.get_node(touched))) {
+                // If it's in the ultrabubble, keep it
+                touched_set.insert(touched);
+            }
+        }
+
+        if(touched_set.size() >= 2) {
+            // We touch both the start and end, or an internal node.
+            informative = true;
+        } else {
+            // Throw out the start and end nodes, if we touched them.
+            touched_set.erase(snarl->start().node_id());
+            touched_set.erase(snarl->end().node_id());
+            if(!touched_set.empty()) {
+                // We touch an internal node
+                informative = true;
+            }
+        }
+
+        if(!informative) {
+            // We only touch one of the start and end nodes, and can say nothing about the ultrabubble. Try the next read.
+            // TODO: mark these as ambiguous/consistent with everything (but strand?)
+            continue;
+        }
+
+        reads_to_align.push_back(ReadToAlign{read, reverse_complement_alignment(*read, get_node_size),
+            read->sequence().size() == read->quality().size(), true, true});
+    }
+
+    // Align a read in one orientation to a graph. If we have the right number
+    // of quality scores, we use quality-adjusted alignment.
+    auto align_read = [&](const ReadToAlign& to_align, bool reverse, VG& target) -> Alignment {
+        if(to_align.quality_adjusted) {
+            QualAdjAligner qa_aligner;
+            return reverse ? target.align(to_align.reversed, &qa_aligner) :
+                target.align_qual_adjusted(*to_align.read, &qa_aligner);
+        } else {
+            return target.align(reverse ? to_align.reversed : *to_align.read);
+        }
+    };
+
+    if(snarl_paths.size() > 2 && !reads_to_align.empty()) {
+        // Align each read in both orientations once, to the union of all the
+        // allele graphs, and then only align it in the orientation that won
+        // to each allele, instead of trying both against every allele. Ties
+        // still try both. With only two alleles this doesn't save anything.
+        VG union_graph(surrounding);
+        for(auto& path : snarl_paths) {
+            add_path_to_graph(path, union_graph);
+        }
+        union_graph.remove_orphan_edges();
+
+        for(auto& to_align : reads_to_align) {
+            int64_t forward_score = align_read(to_align, false, union_graph).score();
+            int64_t reverse_score = align_read(to_align, true, union_graph).score();
+            to_align.try_forward = forward_score >= reverse_score;
+            to_align.try_reverse = reverse_score >= forward_score;
+        }
+    }
+
+    for(auto& path : snarl_paths) {
+        // Now for each snarl path, make a copy of that graph with it in
+        VG allele_graph(surrounding);
+        add_path_to_graph(path, allele_graph);
 
         // Get rid of dangling edges
         allele_graph.remove_orphan_edges();
@@ -754,65 +910,24 @@ map<const Alignment*, vector<Genotyper::Affinity>>
         // read.
         auto path_seq = traversal_to_string(aug.graph, path);
 
-        for(auto& name : relevant_read_names) {
-            // For every read that touched the ultrabubble, grab its original
-            // Alignment pointer.
-            const Alignment* read = reads_by_name.at(name);
-
-            // Look to make sure it touches more than one node actually in the
-            // ultrabubble, or a non-start, non-end node. If it just touches the
-            // start or just touches the end, it can't be informative.
-            set<id_t> touched_set;
-            // Will this read be informative?
-            bool informative = false;            
-            for(size_t i = 0; i < read->path().mapping_size(); i++) {
-                // Look at every node the read touches
-                id_t touched = read->path().mapping(i).position().node_id();
-                if(contents.first.count(aug.graph.get_node(touched))) {
-                    // If it's in the ultrabubble, keep it
-                    touched_set.insert(touched);
-                }
-            }
-
-            if(touched_set.size() >= 2) {
-                // We touch both the start and end, or an internal node.
-                informative = true;
-            } else {
-                // Throw out the start and end nodes, if we touched them.
-                touched_set.erase(snarl->start().node_id());
-                touched_set.erase(snarl->end().node_id());
-                if(!touched_set.empty()) {
-                    // We touch an internal node
-                    informative = true;
-                }
-            }
-
-            if(!informative) {
-                // We only touch one of the start and end nodes, and can say nothing about the ultrabubble. Try the next read.
-                // TODO: mark these as ambiguous/consistent with everything (but strand?)
-                continue;
-            }
-
+        for(auto& to_align : reads_to_align) {
             // If we get here, we know this read is informative as to the internal status of this ultrabubble.
+            const Alignment* read = to_align.read;
+            
+            // Re-align a copy to this graph in each orientation we need
             Alignment aligned_fwd;
             Alignment aligned_rev;
-            // We need a way to get graph node sizes to reverse these alignments
-            auto get_node_size = [&](id_t id) {
-                return aug.graph.get_node(id)->sequence().size();
-            };
-
-            if(read->sequence().size() == read->quality().size()) {
-                // Re-align a copy to this graph (using quality-adjusted alignment).
-                QualAdjAligner qa_aligner;
-                aligned_fwd = allele_graph.align_qual_adjusted(*read, &qa_aligner);
-                aligned_rev = allele_graph.align(reverse_complement_alignment(*read, get_node_size), &qa_aligner);
-            } else {
-                // If we don't have the right number of quality scores, use un-adjusted alignment instead.
-                aligned_fwd = allele_graph.align(*read);
-                aligned_rev = allele_graph.align(reverse_complement_alignment(*read, get_node_size));
+            if(to_align.try_forward) {
+                aligned_fwd = align_read(to_align, false, allele_graph);
             }
+            if(to_align.try_reverse) {
+                aligned_rev = align_read(to_align, true, allele_graph);
+            }
+            bool use_reverse = !to_align.try_forward ||
+                (to_align.try_reverse && aligned_rev.score() > aligned_fwd.score());
+            
             // Pick the best alignment, and emit in original orientation
-            Alignment aligned = (aligned_rev.score() > aligned_fwd.score()) ? reverse_complement_alignment(aligned_rev, get_node_size) : aligned_fwd;
+            Alignment aligned = use_reverse ? reverse_complement_alignment(aligned_rev, get_node_size) : aligned_fwd;
 
 #ifdef debug
 #pragma omp critical (cerr)
@@ -831,7 +946,7 @@ map<const Alignment*, vector<Genotyper::Affinity>>
 
             // Save the score (normed per read base) and orientation
             // We'll normalize the affinities later to enforce the max of 1.0.
-            Affinity affinity(score_per_base, aligned_rev.score() > aligned_fwd.score());
+            Affinity affinity(score_per_base, use_reverse);
 
             // Compute the unnormalized likelihood of the read given the allele graph.
             if(read->sequence().size() == read->quality().size()) {
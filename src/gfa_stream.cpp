@@ -0,0 +1,166 @@
+#include "gfa_stream.hpp"
+
+#include <cctype>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdexcept>
+
+#include "types.hpp"
+
+/**
+ * \file gfa_stream.cpp
+ * Implement chunked, streaming GFA import.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/// Split a GFA line into its tab-separated fields.
+static void split_fields(const string& line, vector<string>& fields) {
+    fields.clear();
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find('\t', start);
+        fields.push_back(line.substr(start, end == string::npos ? string::npos : end - start));
+        if (end == string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+/// Parse a GFA orientation field.
+static bool is_reverse_orientation(const string& orientation, const string& line) {
+    if (orientation == "+") {
+        return false;
+    } else if (orientation == "-") {
+        return true;
+    }
+    throw runtime_error("[vg::gfa_for_each_chunk] bad orientation in GFA line: " + line);
+}
+
+/// Returns true if the CIGAR string from a link describes no overlap.
+static bool is_blunt(const string& cigar) {
+    if (cigar.empty() || cigar == "*") {
+        return true;
+    }
+    // Any number of zero-length operations is still blunt
+    for (char c : cigar) {
+        if (isdigit(c) && c != '0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+void gfa_for_each_chunk(istream& in, const function<void(Graph&)>& lambda,
+                        size_t max_chunk_elements) {
+
+    // IDs assigned to segments with names that aren't numbers. Only these
+    // names have to be remembered.
+    unordered_map<string, id_t> id_names;
+    id_t next_id = 1;
+    auto get_id = [&](const string& name) -> id_t {
+        if (!name.empty() && name.find_first_not_of("0123456789") == string::npos) {
+            return stoll(name);
+        }
+        auto found = id_names.find(name);
+        if (found == id_names.end()) {
+            found = id_names.emplace(name, next_id++).first;
+        }
+        return found->second;
+    };
+
+    Graph chunk;
+    size_t chunk_elements = 0;
+    auto emit_if_full = [&]() {
+        if (chunk_elements >= max_chunk_elements) {
+            lambda(chunk);
+            chunk.Clear();
+            chunk_elements = 0;
+        }
+    };
+
+    string line;
+    vector<string> fields;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.size() < 2 || line[1] != '\t') {
+            // Not a record type we read; skip blank and header lines too
+            continue;
+        }
+
+        if (line[0] == 'S') {
+            split_fields(line, fields);
+            if (fields.size() < 3) {
+                throw runtime_error("[vg::gfa_for_each_chunk] too few fields in GFA segment: " + line);
+            }
+            Node* node = chunk.add_node();
+            node->set_id(get_id(fields[1]));
+            node->set_name(fields[1]);
+            if (fields[2] != "*") {
+                node->set_sequence(fields[2]);
+            }
+            chunk_elements++;
+            emit_if_full();
+        } else if (line[0] == 'L') {
+            split_fields(line, fields);
+            if (fields.size() < 5) {
+                throw runtime_error("[vg::gfa_for_each_chunk] too few fields in GFA link: " + line);
+            }
+            if (fields.size() > 5 && !is_blunt(fields[5])) {
+                throw runtime_error("[vg::gfa_for_each_chunk] GFA link has an overlap, which needs the "
+                                    "whole graph to resolve: " + line);
+            }
+            Edge* edge = chunk.add_edge();
+            edge->set_from(get_id(fields[1]));
+            edge->set_from_start(is_reverse_orientation(fields[2], line));
+            edge->set_to(get_id(fields[3]));
+            edge->set_to_end(is_reverse_orientation(fields[4], line));
+            chunk_elements++;
+            emit_if_full();
+        } else if (line[0] == 'P') {
+            split_fields(line, fields);
+            if (fields.size() < 3) {
+                throw runtime_error("[vg::gfa_for_each_chunk] too few fields in GFA path: " + line);
+            }
+            Path* path = nullptr;
+            int64_t rank = 1;
+            size_t step_start = 0;
+            while (step_start < fields[2].size()) {
+                size_t step_end = fields[2].find(',', step_start);
+                if (step_end == string::npos) {
+                    step_end = fields[2].size();
+                }
+                if (step_end - step_start < 2) {
+                    throw runtime_error("[vg::gfa_for_each_chunk] bad step in GFA path: " + line);
+                }
+                if (path == nullptr) {
+                    // Start (or continue) the path in the current chunk
+                    path = chunk.add_path();
+                    path->set_name(fields[1]);
+                }
+                Mapping* mapping = path->add_mapping();
+                mapping->mutable_position()->set_node_id(get_id(fields[2].substr(step_start, step_end - step_start - 1)));
+                mapping->mutable_position()->set_is_reverse(is_reverse_orientation(fields[2].substr(step_end - 1, 1), line));
+                mapping->set_rank(rank++);
+                chunk_elements++;
+                if (chunk_elements >= max_chunk_elements) {
+                    emit_if_full();
+                    path = nullptr;
+                }
+                step_start = step_end + 1;
+            }
+        }
+    }
+
+    if (chunk_elements > 0) {
+        lambda(chunk);
+    }
+}
+
+}
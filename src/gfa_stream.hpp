@@ -0,0 +1,44 @@
+#ifndef VG_GFA_STREAM_HPP_INCLUDED
+#define VG_GFA_STREAM_HPP_INCLUDED
+
+/**
+ * \file gfa_stream.hpp
+ *
+ * Read a GFA file as a stream of Graph chunks, without ever holding the whole
+ * graph, so that big GFAs can be converted to .vg or indexed in memory
+ * proportional to a chunk.
+ */
+
+#include <functional>
+#include <istream>
+
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Read GFA 1 segments, links and paths from the given stream and hand them to
+ * the given function in Graph chunks of about max_chunk_elements nodes,
+ * edges and path mappings each. Elements come out in the order they appear in
+ * the file, and a path may be split over several chunks, with its mappings
+ * carrying their ranks.
+ *
+ * Segments named with numbers keep them as node IDs. Other segments get IDs
+ * from 1 up in order of first mention, like in VG::from_gfa. Nodes keep their
+ * GFA names.
+ *
+ * Edges may reference nodes that are in later chunks, which is fine for
+ * XG::from_callback and for the .vg format.
+ *
+ * Only blunt links ("*" or "0M" overlaps) can be streamed, since resolving
+ * overlaps needs the whole graph. Throws a runtime_error on a link with an
+ * overlap, or on a malformed line. Header and other lines are skipped.
+ */
+void gfa_for_each_chunk(istream& in, const function<void(Graph&)>& lambda,
+                        size_t max_chunk_elements = 1000);
+
+}
+
+#endif
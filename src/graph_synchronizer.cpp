@@ -7,45 +7,88 @@ namespace vg {
 
 using namespace std;
 
-GraphSynchronizer::GraphSynchronizer(VG& graph) : graph(graph) {
+GraphSynchronizer::GraphSynchronizer(VG& graph) : graph(graph), regions_locked(0),
+    region_waits(0), graph_waits(0), index_waits(0) {
     // Nothing to do!
 }
 
+GraphSynchronizer::PathIndexShard::PathIndexShard(VG& graph, const string& path_name) :
+    index(graph, path_name, true) {
+    // Nothing to do!
+}
+
+unique_lock<mutex> GraphSynchronizer::lock_counted(mutex& to_lock, atomic<size_t>& waits) {
+    unique_lock<mutex> guard(to_lock, try_to_lock);
+    if (!guard.owns_lock()) {
+        // Someone else has it, so we have to wait.
+        waits++;
+        guard.lock();
+    }
+    return guard;
+}
+
+GraphSynchronizer::ContentionStats GraphSynchronizer::get_contention_stats() const {
+    ContentionStats stats;
+    stats.regions_locked = regions_locked;
+    stats.region_waits = region_waits;
+    stats.graph_waits = graph_waits;
+    stats.index_waits = index_waits;
+    return stats;
+}
+
 void GraphSynchronizer::with_path_index(const string& path_name, const function<void(const PathIndex&)>& to_run) {
-    // Get a reader lock on the graph
-    std::lock_guard<std::mutex> guard(whole_graph_lock);
-    to_run(get_path_index(path_name));
+    PathIndexShard* shard;
+    {
+        // We only need the graph if we have to make the index
+        auto graph_guard = lock_counted(graph_lock, graph_waits);
+        shard = &get_path_index(path_name);
+    }
+    // Get exclusive use of just this index
+    auto index_guard = lock_counted(shard->lock, index_waits);
+    to_run(shard->index);
 }
 
 const string& GraphSynchronizer::get_path_sequence(const string& path_name) {
-    // Lock the whole graph
-    std::lock_guard<std::mutex> guard(whole_graph_lock);
+    // Lock the graph in case we have to make the index
+    auto graph_guard = lock_counted(graph_lock, graph_waits);
     
     // Get (and possibly generate from the graph) the index, and return its
     // sequence string (which won't change)
-    return get_path_index(path_name).sequence;
+    return get_path_index(path_name).index.sequence;
 }
 
     
 // We need a function to grab the index for a path
-PathIndex& GraphSynchronizer::get_path_index(const string& path_name) {
-
-    if (!indexes.count(path_name)) {
+GraphSynchronizer::PathIndexShard& GraphSynchronizer::get_path_index(const string& path_name) {
+    std::lock_guard<std::mutex> guard(indexes_lock);
+    
+    auto found = indexes.find(path_name);
+    if (found == indexes.end()) {
         // Not already made. Generate it.
-        indexes.emplace(piecewise_construct,
-            forward_as_tuple(path_name), // Make the key
-            forward_as_tuple(graph, path_name, true)); // Make the PathIndex
+        found = indexes.emplace(path_name, unique_ptr<PathIndexShard>(new PathIndexShard(graph, path_name))).first;
     }
-    return indexes.at(path_name);
+    return *found->second;
 }
 
 void GraphSynchronizer::update_path_indexes(const vector<Translation>& translations) {
-    for (auto& kv : indexes) {
+    // Grab all the shards, so we don't hold the map lock while we update them
+    vector<PathIndexShard*> shards;
+    {
+        std::lock_guard<std::mutex> guard(indexes_lock);
+        for (auto& kv : indexes) {
+            shards.push_back(kv.second.get());
+        }
+    }
+    
+    for (auto* shard : shards) {
         // We need to touch every index (IN PLACE!)
+        auto index_guard = lock_counted(shard->lock, index_waits);
         
         // Feed each index all the translations, which it will parse into node-
-        // partitioning translations and then apply.
-        kv.second.apply_translations(translations);
+        // partitioning translations and then apply. Translations from other
+        // threads are on other nodes, so the order they arrive in doesn't
+        // matter.
+        shard->index.apply_translations(translations);
     }
 }
 
@@ -71,17 +114,19 @@ void GraphSynchronizer::Lock::lock() {
         return;
     }
     
-    // What we do is, we lock the graph and wait on the condition variable, with
-    // the check code being that we find the subgraph and immediate neighbors
-    // and verify none of its nodes are locked
+    // What we do is, we lock the graph, find the subgraph and immediate
+    // neighbors, and then check under the region lock that none of its nodes
+    // are locked. If some are, we let go of the graph and wait on the
+    // condition variable for someone to unlock something, and try again.
     
-    // Lock the whole graph
-    std::unique_lock<std::mutex> lk(synchronizer.whole_graph_lock);
-    synchronizer.wait_for_region.wait(lk, [&]{
-        // Now we have exclusive use of the graph and indexes, and we need to
-        // see if anyone else is using any nodes we need.
-        
+    while (true) {
+        // Lock the graph so nobody changes it while we look at it
+        auto graph_guard = lock_counted(synchronizer.graph_lock, synchronizer.graph_waits);
         
+        // Get the index we are locking along, and hold it while we use it
+        auto& shard = synchronizer.get_path_index(path_name);
+        auto index_guard = lock_counted(shard.lock, synchronizer.index_waits);
+        auto& index = shard.index;
         
         // Extract the context around that node
         VG context;
@@ -93,8 +138,8 @@ void GraphSynchronizer::Lock::lock() {
             Graph context_graph;
             
             // Find the outer ends of this range
-            NodeSide start_left = synchronizer.get_path_index(path_name).at_position(start);
-            NodeSide end_right = synchronizer.get_path_index(path_name).at_position(past_end == 0 ? 0 : past_end - 1).flip();
+            NodeSide start_left = index.at_position(start);
+            NodeSide end_right = index.at_position(past_end == 0 ? 0 : past_end - 1).flip();
             
             // Fill in the endpoints pair
             endpoints = make_pair(start_left, end_right);
@@ -104,12 +149,12 @@ void GraphSynchronizer::Lock::lock() {
             
             // Trace the path in the index to say what should be found
             cerr << "Path: " << endl;
-            auto it = synchronizer.get_path_index(path_name).find_position(start);
-            while(it != synchronizer.get_path_index(path_name).end() && it->second.flip() != end_right) {
+            auto it = index.find_position(start);
+            while(it != index.end() && it->second.flip() != end_right) {
                 cerr << "\tVisit " << it->second;
                 auto it2 = it;
                 ++it2;
-                if (it2 != synchronizer.get_path_index(path_name).end()) {
+                if (it2 != index.end()) {
                     // Make sure we have an edge from this node to the next on the path
                     assert(synchronizer.graph.has_edge(it->second.flip(), it2->second));
                     cerr << " " << pb2json(*synchronizer.graph.get_edge(it->second.flip(), it2->second));
@@ -157,41 +202,24 @@ void GraphSynchronizer::Lock::lock() {
             // We want to extract a radius
             
             // Find the center node, at the position we want to lock out from
-            NodeSide center = synchronizer.get_path_index(path_name).at_position(path_offset);
+            NodeSide center = index.at_position(path_offset);
             
             synchronizer.graph.nonoverlapping_node_context_without_paths(synchronizer.graph.get_node(center.node), context);
             synchronizer.graph.expand_context_by_length(context, context_bases, false, reflect);
         }
         
+        index_guard.unlock();
+        
         // Also remember all the nodes connected to but not in the context,
         // which also need to be locked.
         periphery.clear();
         peripheral_attachments.clear();
         
-        // We set this to false if a node we want is taken
-        bool nodes_available = true;
-        
         context.for_each_node([&](Node* node) {
             // For every node in the graph
-            
-            if (synchronizer.locked_nodes.count(node->id())) {
-                // Someone else already has this node. So our condition is false
-                // and we need to wait.
-                nodes_available = false;
-                return;
-            }
-            
             for (auto* edge : synchronizer.graph.edges_from(node)) {
                 if (!context.has_node(edge->to())) {
                     // This is connected but not in the actual context graph. So it's on the periphery.
-                    
-                    if (synchronizer.locked_nodes.count(edge->to())) {
-                        // Someone else already has this node. So our condition
-                        // is false and we need to wait.
-                        nodes_available = false;
-                        return;
-                    }
-                    
                     // The destination of the edge is in the periphery
                     periphery.insert(edge->to());
                     // And you get to it from this side of this graph node.
@@ -202,14 +230,6 @@ void GraphSynchronizer::Lock::lock() {
             for (auto* edge : synchronizer.graph.edges_to(node)) {
                 if (!context.has_node(edge->from())) {
                     // This is connected but not in the actual context graph. So it's on the periphery.
-                    
-                    if (synchronizer.locked_nodes.count(edge->from())) {
-                        // Someone else already has this node. So our condition
-                        // is false and we need to wait.
-                        nodes_available = false;
-                        return;
-                    }
-                    
                     // The source of the edge is in the periphery
                     periphery.insert(edge->from());
                     // And you get to it from this side of this graph node.
@@ -219,44 +239,66 @@ void GraphSynchronizer::Lock::lock() {
             }
         });
         
+        // Now we need to see if anyone else is using any nodes we need.
+        std::unique_lock<std::mutex> region_guard(synchronizer.region_lock);
+        
+        // We set this to false if a node we want is taken
+        bool nodes_available = true;
+        for (id_t id : periphery) {
+            if (synchronizer.locked_nodes.count(id)) {
+                nodes_available = false;
+                break;
+            }
+        }
+        context.for_each_node([&](Node* node) {
+            if (nodes_available && synchronizer.locked_nodes.count(node->id())) {
+                nodes_available = false;
+            }
+        });
+        
         if (nodes_available) {
-            // We can have the nodes we need. Remember what they are.
+            // We can have the nodes we need. Record them as locked.
             subgraph = std::move(context);
+            
+            for(id_t id : periphery) {
+                // Mark the periphery
+                synchronizer.locked_nodes.insert(id);
+                locked_nodes.insert(id);
+            }
+            
+            subgraph.for_each_node([&](Node* node) {
+                // Mark the actual graph
+                synchronizer.locked_nodes.insert(node->id());
+                locked_nodes.insert(node->id());
+            });
+            
+            synchronizer.regions_locked++;
+            break;
         }
         
-        // Return whether we were successful
-        return nodes_available;
-    });
-
-    // Once we get here, we have a lock on the whole graph, and nobody else has
-    // claimed our nodes. Our graph and periphery have been filled in, so we
-    // just have to record our nodes as locked.
-    
-    for(id_t id : periphery) {
-        // Mark the periphery
-        synchronizer.locked_nodes.insert(id);
-        locked_nodes.insert(id);
+        // Someone else already has some of our nodes. Let go of the graph so
+        // they can edit it, and wait for them to unlock something.
+        size_t seen_generation = synchronizer.region_generation;
+        graph_guard.unlock();
+        synchronizer.region_waits++;
+        synchronizer.wait_for_region.wait(region_guard, [&]{
+            return synchronizer.region_generation != seen_generation;
+        });
     }
     
-    subgraph.for_each_node([&](Node* node) {
-        // Mark the actual graph
-        synchronizer.locked_nodes.insert(node->id());
-        locked_nodes.insert(node->id());
-    });
-    
     // We should have actually grabbed something.
     if (locked_nodes.empty()) {
         cerr << "error:[vg::GraphSynchronizer] No nodes locked for " << path_name << ":" << start << "-" << past_end << endl;
         throw runtime_error("No nodes locked!");
     }
     
-    // Now we know nobody else can touch those nodes and we can safely release
-    // our lock on the main graph by letting it leave scope.
+    // Now we know nobody else can touch those nodes, and our locks on the
+    // graph and the set of locked nodes are released as they leave scope.
 }
 
 void GraphSynchronizer::Lock::unlock() {
-    // Get the main graph lock
-    std::unique_lock<std::mutex> lk(synchronizer.whole_graph_lock);
+    // Get the lock on the set of locked nodes
+    std::unique_lock<std::mutex> lk(synchronizer.region_lock);
     
     // Release all the nodes
     for (id_t locked : locked_nodes) {
@@ -267,6 +309,7 @@ void GraphSynchronizer::Lock::unlock() {
     locked_nodes.clear();
     
     // Notify anyone waiting, so they can all check to see if now they can go.
+    synchronizer.region_generation++;
     lk.unlock();
     synchronizer.wait_for_region.notify_all();
 }
@@ -311,10 +354,6 @@ vector<Translation> GraphSynchronizer::Lock::apply_edit(const Path& path) {
 }
 
 vector<Translation> GraphSynchronizer::Lock::apply_edit(const Path& path, set<NodeSide>& dangling) {
-    // Make sure we have exclusive ownership of the graph itself since we're
-    // going to be modifying its data structures.
-    std::lock_guard<std::mutex> guard(synchronizer.whole_graph_lock);
-    
     for (size_t i = 0; i < path.mapping_size(); i++) {
         // Check each Mapping to make sure it's on a locked node
         auto node_id = path.mapping(i).position().node_id();
@@ -323,28 +362,38 @@ vector<Translation> GraphSynchronizer::Lock::apply_edit(const Path& path, set<No
         }
     }
     
-    // Make all the edits, passing along the dangling node set.
-    vector<Translation> translations = synchronizer.graph.edit_fast(path, dangling);
-    
-    // Lock all the nodes that result from the translations. They're guaranteed
-    // to either be nodes we already have or novel nodes with fresh IDs.
-    for (auto& translation : translations) {
-        // For every translation's to path
-        auto& new_path = translation.to();
+    vector<Translation> translations;
+    {
+        // Make sure we have exclusive ownership of the graph itself since we're
+        // going to be modifying its data structures.
+        auto graph_guard = lock_counted(synchronizer.graph_lock, synchronizer.graph_waits);
+        
+        // Make all the edits, passing along the dangling node set.
+        translations = synchronizer.graph.edit_fast(path, dangling);
         
-        for (size_t i = 0; i < new_path.mapping_size(); i++) {
-            // For every mapping to a node on that path
-            auto node_id = new_path.mapping(i).position().node_id();
+        // Lock all the nodes that result from the translations before anyone
+        // else can see them. They're guaranteed to either be nodes we already
+        // have or novel nodes with fresh IDs.
+        std::lock_guard<std::mutex> region_guard(synchronizer.region_lock);
+        for (auto& translation : translations) {
+            // For every translation's to path
+            auto& new_path = translation.to();
             
-            if (!locked_nodes.count(i)) {
-                // If it's not already locked, lock it.
-                locked_nodes.insert(i);
-                synchronizer.locked_nodes.insert(i);
+            for (size_t i = 0; i < new_path.mapping_size(); i++) {
+                // For every mapping to a node on that path
+                auto node_id = new_path.mapping(i).position().node_id();
+                
+                if (!locked_nodes.count(node_id)) {
+                    // If it's not already locked, lock it.
+                    locked_nodes.insert(node_id);
+                    synchronizer.locked_nodes.insert(node_id);
+                }
             }
         }
     }
     
-    // Apply the edits to the path indexes
+    // Apply the edits to the path indexes. We don't need the graph for this,
+    // so other threads can be editing it while we do.
     synchronizer.update_path_indexes(translations);
     
     // Spit out the translations to the caller. Maybe they can use them on their subgraph or something?
@@ -367,7 +416,7 @@ vector<Translation> GraphSynchronizer::Lock::apply_full_length_edit(const Path&
     auto right_periphery = get_peripheral_attachments(ends.second);
     
     // Get ownership of the graph because we're making edges
-    std::lock_guard<std::mutex> guard(synchronizer.whole_graph_lock);
+    auto graph_guard = lock_counted(synchronizer.graph_lock, synchronizer.graph_waits);
     
     for (const NodeSide& dangled : dangling) {
         // For every dangling NodeSide
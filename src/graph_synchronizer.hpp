@@ -12,6 +12,8 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <memory>
 
 namespace vg {
 
@@ -49,6 +51,26 @@ public:
      */
     void with_path_index(const string& path_name, const function<void(const PathIndex&)>& to_run);
     
+    /**
+     * Counts of how often threads have had to wait on each other, for tuning
+     * how work is divided up.
+     */
+    struct ContentionStats {
+        /// Regions successfully locked
+        size_t regions_locked = 0;
+        /// Times a thread found nodes it wanted already locked and had to wait
+        size_t region_waits = 0;
+        /// Times a thread had to wait for someone else to be done with the graph
+        size_t graph_waits = 0;
+        /// Times a thread had to wait for someone else to be done with a path index
+        size_t index_waits = 0;
+    };
+    
+    /**
+     * Get the contention counts accumulated so far.
+     */
+    ContentionStats get_contention_stats() const;
+    
     /**
      * This represents a request to lock a particular context on a particular
      * GraphSynchronizer. It fulfils the BasicLockable concept requirements, so
@@ -182,40 +204,75 @@ protected:
     /// The graph we manage
     VG& graph;
     
-    /// We use this to lock the whole graph, for when we're exploring and trying
-    /// to lock a context, or for when we're making an edit, or for when we're
-    /// trying to lock a context, or for when we're working with the
-    /// PathIndexes. It's only ever held during functions in this class or
+    /// We use this to lock the VG itself, while we are reading it to extract a
+    /// context or changing it to make an edit. Nothing else is done under it,
+    /// so edits in different regions only queue up for the graph changes
+    /// themselves. It's only ever held during functions in this class or
     /// internal classes (monitor-style), so we don't need it to be a recursive
-    /// mutex.
-    mutex whole_graph_lock;
+    /// mutex. When held together with other locks, it must be taken first.
+    mutex graph_lock;
+    
+    /// We use this to protect the set of locked nodes, and the region
+    /// generation count.
+    mutex region_lock;
     
     /// We have one condition variable where we have blocked all the threads
     /// that are waiting to lock subgraphs but couldn't the first time because
-    /// we ran into already locked nodes. When nodes get unlocked, we wake them
-    /// all up, and they each grab the mutex and check, one at a time, to see if
-    /// they can have all their nodes this time.
+    /// we ran into already locked nodes. When nodes get unlocked, we bump the
+    /// generation and wake them all up, and they each go back and check to see
+    /// if they can have all their nodes this time.
     condition_variable wait_for_region;
     
+    /// This counts how many times nodes have been unlocked, so waiting threads
+    /// can tell if anything has changed since they last looked.
+    size_t region_generation = 0;
+    
+    /**
+     * A PathIndex with its own lock, so updates to different paths' indexes
+     * don't wait on each other or on the graph.
+     */
+    struct PathIndexShard {
+        PathIndexShard(VG& graph, const string& path_name);
+        PathIndex index;
+        mutex lock;
+    };
+    
     /// We need indexes of all the paths that someone might want to use as a
-    /// basis for locking. This holds a PathIndex for each path we touch by path
-    /// name.
-    map<string, PathIndex> indexes;
+    /// basis for locking. This holds a PathIndexShard for each path we touch
+    /// by path name. Shards are never removed once made.
+    map<string, unique_ptr<PathIndexShard>> indexes;
+    
+    /// This protects the map of indexes, but not the indexes themselves.
+    mutex indexes_lock;
     
     /**
-     * Get the index for the given path name. Lock on the indexes and graph must
-     * be held already.
+     * Get the index shard for the given path name, making it if necessary.
+     * Lock on the graph must be held already, in case it has to be made. Lock
+     * on the shard is not taken.
      */
-    PathIndex& get_path_index(const string& path_name);
+    PathIndexShard& get_path_index(const string& path_name);
     
     /**
-     * Update all the path indexes according to the given translations. Lock on
-     * the indexes and graph must be held already.
+     * Update all the path indexes according to the given translations, taking
+     * each shard's lock in turn. Lock on the graph need not be held, since
+     * translations only ever touch nodes locked by the caller.
      */
     void update_path_indexes(const vector<Translation>& translations);
     
+    /**
+     * Take the given mutex, counting it in the given counter if we have to
+     * wait for it. Returns a guard holding the mutex.
+     */
+    static unique_lock<mutex> lock_counted(mutex& to_lock, atomic<size_t>& waits);
+    
     /// This holds all the node IDs that are currently locked by someone
     set<id_t> locked_nodes;
+    
+    /// These count how often threads have waited on each other.
+    atomic<size_t> regions_locked;
+    atomic<size_t> region_waits;
+    atomic<size_t> graph_waits;
+    atomic<size_t> index_waits;
 
 
 };
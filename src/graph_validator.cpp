@@ -0,0 +1,206 @@
+#include "graph_validator.hpp"
+
+#include <sstream>
+
+#include "stream.hpp"
+#include "path.hpp"
+
+/**
+ * \file graph_validator.cpp
+ * Implement parallel validation of XG-indexed graphs and alignments.
+ */
+
+namespace vg {
+
+using namespace std;
+
+GraphValidator::GraphValidator(const xg::XG& index, size_t max_errors) :
+    index(index), max_errors(max_errors), errors_found(0) {
+    // Nothing to do
+}
+
+size_t GraphValidator::error_count() const {
+    return errors_found;
+}
+
+const vector<string>& GraphValidator::get_errors() const {
+    return errors;
+}
+
+bool GraphValidator::full() const {
+    return max_errors != 0 && errors_found >= max_errors;
+}
+
+void GraphValidator::report(const string& error) {
+    if (errors_found++ < max_errors || max_errors == 0) {
+        #pragma omp critical (validator_errors)
+        {
+            errors.push_back(error);
+            if (print_errors) {
+                cerr << error << endl;
+            }
+        }
+    }
+}
+
+bool GraphValidator::has_edge_between(const handle_t& from, const handle_t& to) const {
+    // The iteration stops (and returns false) when we find it.
+    return !index.follow_edges(from, false, [&](const handle_t& next) {
+        return next != to;
+    });
+}
+
+bool GraphValidator::check_edges() {
+    size_t errors_before = errors_found;
+    index.for_each_handle([&](const handle_t& handle) {
+        if (full()) {
+            return;
+        }
+        for (bool go_left : {false, true}) {
+            index.follow_edges(handle, go_left, [&](const handle_t& other) {
+                if (!index.has_node(index.get_id(other))) {
+                    stringstream error;
+                    error << "graph invalid: edge from node " << index.get_id(handle)
+                        << " to non-existent node " << index.get_id(other);
+                    report(error.str());
+                    return false;
+                }
+                // We have to be able to see the edge from the other end too.
+                bool found = !index.follow_edges(other, !go_left, [&](const handle_t& back) {
+                    return back != handle;
+                });
+                if (!found) {
+                    stringstream error;
+                    error << "graph invalid: edge between " << index.get_id(handle)
+                        << " and " << index.get_id(other) << " is only indexed on one side";
+                    report(error.str());
+                    return false;
+                }
+                return true;
+            });
+        }
+    }, true);
+    return errors_found == errors_before;
+}
+
+bool GraphValidator::check_orphans() {
+    if (index.node_size() <= 1) {
+        // A lone node can't have anyone to connect to.
+        return true;
+    }
+    size_t errors_before = errors_found;
+    index.for_each_handle([&](const handle_t& handle) {
+        if (full()) {
+            return;
+        }
+        if (index.get_degree(handle, false) == 0 && index.get_degree(handle, true) == 0) {
+            report("graph invalid: orphan node " + to_string(index.get_id(handle)));
+        }
+    }, true);
+    return errors_found == errors_before;
+}
+
+bool GraphValidator::check_paths() {
+    size_t errors_before = errors_found;
+    size_t path_count = index.max_path_rank();
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t rank = 1; rank <= path_count; rank++) {
+        if (full()) {
+            continue;
+        }
+        string path_name = index.path_name(rank);
+        auto& path = index.get_path(path_name);
+        size_t visits = path.size();
+        for (size_t i = 1; i < visits && !full(); i++) {
+            id_t prev_id = path.node(i - 1);
+            id_t here_id = path.node(i);
+            handle_t prev = index.get_handle(prev_id, path.is_reverse(i - 1));
+            handle_t here = index.get_handle(here_id, path.is_reverse(i));
+            if (!has_edge_between(prev, here)) {
+                stringstream error;
+                error << "graph path '" << path_name << "' invalid: no edge from "
+                    << prev_id << (path.is_reverse(i - 1) ? "-" : "+") << " to "
+                    << here_id << (path.is_reverse(i) ? "-" : "+") << " at visit " << i;
+                report(error.str());
+            }
+        }
+    }
+    return errors_found == errors_before;
+}
+
+string GraphValidator::check_alignment(const Alignment& aln) const {
+    auto& path = aln.path();
+    size_t to_bases = 0;
+
+    for (size_t i = 0; i < path.mapping_size(); i++) {
+        auto& mapping = path.mapping(i);
+        auto& position = mapping.position();
+
+        if (!index.has_node(position.node_id())) {
+            return "alignment " + aln.name() + " invalid: mapping " + to_string(i) +
+                " is on non-existent node " + to_string(position.node_id());
+        }
+
+        size_t node_length = index.node_length(position.node_id());
+        size_t from_bases = 0;
+        for (auto& edit : mapping.edit()) {
+            from_bases += edit.from_length();
+            to_bases += edit.to_length();
+        }
+        if (position.offset() + from_bases > node_length) {
+            return "alignment " + aln.name() + " invalid: mapping " + to_string(i) +
+                " runs off the end of node " + to_string(position.node_id());
+        }
+
+        if (i == 0) {
+            continue;
+        }
+
+        // Make sure we got here from the last mapping.
+        auto& prev_mapping = path.mapping(i - 1);
+        auto& prev_position = prev_mapping.position();
+        size_t prev_end = prev_position.offset() + mapping_from_length(prev_mapping);
+        if (prev_position.node_id() == position.node_id() &&
+            prev_position.is_reverse() == position.is_reverse() &&
+            prev_end == position.offset()) {
+            // We just continue along the same node.
+            continue;
+        }
+        if (prev_end != index.node_length(prev_position.node_id()) || position.offset() != 0) {
+            return "alignment " + aln.name() + " invalid: mapping " + to_string(i) +
+                " does not start where mapping " + to_string(i - 1) + " leaves off";
+        }
+        handle_t prev = index.get_handle(prev_position.node_id(), prev_position.is_reverse());
+        handle_t here = index.get_handle(position.node_id(), position.is_reverse());
+        if (!has_edge_between(prev, here)) {
+            return "alignment " + aln.name() + " invalid: no edge from mapping " +
+                to_string(i - 1) + " on node " + to_string(prev_position.node_id()) +
+                " to mapping " + to_string(i) + " on node " + to_string(position.node_id());
+        }
+    }
+
+    if (!aln.sequence().empty() && path.mapping_size() > 0 && to_bases != aln.sequence().size()) {
+        return "alignment " + aln.name() + " invalid: path has " + to_string(to_bases) +
+            " read bases but the sequence has " + to_string(aln.sequence().size());
+    }
+
+    return "";
+}
+
+bool GraphValidator::check_alignments(istream& gam_stream) {
+    size_t errors_before = errors_found;
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        if (full()) {
+            // Just drain the rest of the stream
+            return;
+        }
+        string error = check_alignment(aln);
+        if (!error.empty()) {
+            report(error);
+        }
+    };
+    stream::for_each_parallel(gam_stream, lambda);
+    return errors_found == errors_before;
+}
+
+}
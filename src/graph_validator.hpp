@@ -0,0 +1,82 @@
+#ifndef VG_GRAPH_VALIDATOR_HPP_INCLUDED
+#define VG_GRAPH_VALIDATOR_HPP_INCLUDED
+
+/**
+ * \file graph_validator.hpp
+ *
+ * Check an XG-indexed graph, and alignments against it, using all threads,
+ * without loading the graph as a VG.
+ */
+
+#include <atomic>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "vg.pb.h"
+#include "xg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Validates an XG index and streams of alignments to it in parallel. Every
+ * problem found is counted, but only the first max_errors are kept (and
+ * printed, if requested), and checks stop early once that many have been
+ * found.
+ */
+class GraphValidator {
+public:
+    /// Make a validator for the given index. It must outlive the validator.
+    GraphValidator(const xg::XG& index, size_t max_errors = 10);
+
+    /// Print errors to standard error as they are found?
+    bool print_errors = true;
+
+    /// Check that every edge leads to a node that exists. Returns true if no
+    /// problems were found.
+    bool check_edges();
+
+    /// Check that every node has at least one edge, unless it is the only node.
+    bool check_orphans();
+
+    /// Check that every pair of consecutive visits along each path is joined
+    /// by an edge in the right orientation.
+    bool check_paths();
+
+    /// Check all the alignments in a GAM stream. Returns true if they were all
+    /// valid.
+    bool check_alignments(istream& gam_stream);
+
+    /// Check a single alignment against the graph. Returns an empty string if
+    /// it is valid, or a description of the first problem otherwise.
+    string check_alignment(const Alignment& aln) const;
+
+    /// Get the number of problems found so far, including those not kept.
+    size_t error_count() const;
+
+    /// Get the descriptions of the first problems found.
+    const vector<string>& get_errors() const;
+
+private:
+    const xg::XG& index;
+    size_t max_errors;
+
+    atomic<size_t> errors_found;
+    vector<string> errors;
+
+    /// Record a problem. Thread safe.
+    void report(const string& error);
+
+    /// Have we found as many problems as we care to?
+    bool full() const;
+
+    /// Is there an edge from the end of the first handle to the start of the
+    /// second?
+    bool has_edge_between(const handle_t& from, const handle_t& to) const;
+};
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "gssw_aligner.hpp"
 #include "json2pb.h"
+#include "log_sum_exp.hpp"
 
 static const double quality_scale_factor = 10.0 / log(10.0);
 static const double exp_overflow_limit = log(std::numeric_limits<double>::max());
@@ -12,18 +13,46 @@ BaseAligner::~BaseAligner(void) {
     free(score_matrix);
 }
 
-gssw_graph* BaseAligner::create_gssw_graph(Graph& g) {
+thread_local unordered_map<int64_t, gssw_node*> BaseAligner::gssw_nodes_by_id;
+thread_local string BaseAligner::gssw_scratch_sequence;
+
+gssw_graph* BaseAligner::create_gssw_graph(Graph& g, bool reversed) {
     
     // add a dummy sink node if we're pinning
     gssw_graph* graph = gssw_graph_create(g.node_size());
-    unordered_map<int64_t, gssw_node*> nodes;
+    // reuse this thread's lookup table so its buckets don't get reallocated for every graph
+    unordered_map<int64_t, gssw_node*>& nodes = gssw_nodes_by_id;
+    nodes.clear();
+    // and its scratch sequence, for nodes whose sequence gssw can't take as is
+    string& scratch_seq = gssw_scratch_sequence;
     
     for (int i = 0; i < g.node_size(); ++i) {
-        Node* n = g.mutable_node(i);
-        // switch any non-ATGCN characters from the node sequence to N
-        auto cleaned_seq = nonATGCNtoN(n->sequence());
+        // reversed nodes go in in reverse order (Graphs come in topologically
+        // sorted and gssw depends on this fact)
+        Node* n = g.mutable_node(reversed ? g.node_size() - 1 - i : i);
+        const string& seq = n->sequence();
+        // switch any non-ATGCN characters from the node sequence to N, only copying the
+        // sequence if there are any or we need it backward (gssw makes its own copy either way)
+        bool clean = all_of(seq.begin(), seq.end(), [](char b) {
+            return b == 'A' || b == 'T' || b == 'G' || b == 'C' || b == 'N';
+        });
+        if (reversed) {
+            scratch_seq.assign(seq.rbegin(), seq.rend());
+        } else if (!clean) {
+            scratch_seq = seq;
+        }
+        if (!clean) {
+            for (auto& b : scratch_seq) {
+                if (b != 'A' && b != 'T' && b != 'G' && b != 'C') {
+                    b = 'N';
+                }
+            }
+        }
+        // the gssw node keeps pointing at the original, forward node, so
+        // traceback reads reference-relative sequence once the mapping has
+        // been unreversed
         gssw_node* node = (gssw_node*)gssw_node_create(n, n->id(),
-                                                       cleaned_seq.c_str(),
+                                                       clean && !reversed ? seq.c_str() : scratch_seq.c_str(),
                                                        nt_table,
                                                        score_matrix);
         nodes[n->id()] = node;
@@ -33,14 +62,18 @@ gssw_graph* BaseAligner::create_gssw_graph(Graph& g) {
     for (int i = 0; i < g.edge_size(); ++i) {
         // Convert all the edges
         Edge* e = g.mutable_edge(i);
+        // Reversing the sequences turns every edge around, which swaps its
+        // ends but keeps whether it is reversing
+        int64_t from = reversed ? e->to() : e->from();
+        int64_t to = reversed ? e->from() : e->to();
         if(!e->from_start() && !e->to_end()) {
             // This is a normal end to start edge.
-            gssw_nodes_add_edge(nodes[e->from()], nodes[e->to()]);
+            gssw_nodes_add_edge(nodes[from], nodes[to]);
         } else if(e->from_start() && e->to_end()) {
             // This is a start to end edge, but isn't reversing and can be converted to a normal end to start edge.
             
             // Flip the start and end
-            gssw_nodes_add_edge(nodes[e->to()], nodes[e->from()]);
+            gssw_nodes_add_edge(nodes[to], nodes[from]);
         } else {
             // TODO: It's a reversing edge, which gssw doesn't support yet. What
             // we should really do is do a topological sort to break cycles, and
@@ -83,6 +116,7 @@ void BaseAligner::load_scoring_matrix(istream& matrix_stream) {
       }
       score_matrix[i] = score;
     }
+    banded_scoring = identify_banded_scoring_scheme(score_matrix, gap_open, gap_extension);
 }
 
 void BaseAligner::gssw_mapping_to_alignment(gssw_graph* graph,
@@ -210,57 +244,6 @@ void BaseAligner::gssw_mapping_to_alignment(gssw_graph* graph,
     alignment.set_identity(identity(alignment.path()));
 }
 
-void BaseAligner::reverse_graph(Graph& g, Graph& reversed_graph_out) {
-    if (reversed_graph_out.node_size()) {
-        cerr << "error:[Aligner::reverse_graph] output graph is not empty" << endl;
-        exit(EXIT_FAILURE);
-    }
-    
-    // add reversed nodes in reverse order (Graphs come in topologically sorted and gssw
-    // depends on this fact)
-    for (int64_t i = g.node_size() - 1; i >= 0; i--) {
-        const Node& original_node = g.node(i);
-        
-        Node* reversed_node = reversed_graph_out.add_node();
-        
-        // reverse the sequence
-        string* reversed_node_seq = reversed_node->mutable_sequence();
-        reversed_node_seq->resize(original_node.sequence().length());
-        reverse_copy(original_node.sequence().begin(), original_node.sequence().end(), reversed_node_seq->begin());
-        
-        // preserve ids for easier translation
-        reversed_node->set_id(original_node.id());
-    }
-    
-    // add reversed edges
-    for (int64_t i = 0; i < g.edge_size(); i++) {
-        const Edge& original_edge = g.edge(i);
-        
-        Edge* reversed_edge = reversed_graph_out.add_edge();
-        
-        // reverse edge orientation
-        reversed_edge->set_from(original_edge.to());
-        reversed_edge->set_to(original_edge.from());
-        
-        // we will swap the 5'/3' labels of the node ends after reversing the sequence so that
-        // an edge leaving an end now enters a beginning and an edge entering a beginning now
-        // leaves an end
-        reversed_edge->set_from_start(original_edge.to_end());
-        reversed_edge->set_to_end(original_edge.from_start());
-    }
-    
-}
-
-void BaseAligner::unreverse_graph(Graph& graph) {
-    // this is only for getting correct reference-relative edits, so we can get away with only
-    // reversing the sequences and not paying attention to the edges
-    for (int64_t i = 0; i < graph.node_size(); i++) {
-        Node* node = graph.mutable_node(i);
-        string* node_seq = node->mutable_sequence();
-        reverse(node_seq->begin(), node_seq->end());
-    }
-}
-
 void BaseAligner::unreverse_graph_mapping(gssw_graph_mapping* gm) {
     
     gssw_graph_cigar* graph_cigar = &(gm->cigar);
@@ -350,23 +333,27 @@ double BaseAligner::maximum_mapping_quality_exact(vector<double>& scaled_scores,
         padded = true;
     }
     
-    // work in log transformed values to avoid risk of overflow
-    double log_sum_exp = numeric_limits<double>::lowest();
-    double max_score = numeric_limits<double>::lowest();
-    // go in reverse order because this has fewer numerical problems when the scores are sorted (as usual)
-    for (int64_t i = scaled_scores.size() - 1; i >= 0; i--) {
-        log_sum_exp = add_log(log_sum_exp, scaled_scores[i]);
-        if (scaled_scores[i] >= max_score) {
-            // Since we are going in reverse order, make sure to break ties in favor of the earlier item.
-            *max_idx_out = i;
-            max_score = scaled_scores[i];
+    // find the maximum, breaking ties in favor of the earlier item
+    size_t max_idx = 0;
+    for (size_t i = 1; i < scaled_scores.size(); i++) {
+        if (scaled_scores[i] > scaled_scores[max_idx]) {
+            max_idx = i;
         }
     }
+    *max_idx_out = max_idx;
     
     // We should never try to return an injected 0 score as the winner.
-    assert(!(padded && *max_idx_out == 1));
+    assert(!(padded && max_idx == 1));
+    
+    // sum the likelihoods of the other alignments relative to the max, leaving the max itself out
+    // so that we don't have to subtract it back off and lose the small terms
+    double max_score = scaled_scores[max_idx];
+    scaled_scores[max_idx] = numeric_limits<double>::lowest();
+    double others = sum_exp(scaled_scores.data(), scaled_scores.size(), max_score);
+    scaled_scores[max_idx] = max_score;
     
-    double direct_mapq = -quality_scale_factor * subtract_log(0.0, max_score - log_sum_exp);
+    // the probability of the max is 1 / (1 + others), and of everything else others / (1 + others)
+    double direct_mapq = quality_scale_factor * (log1p(others) - log(others));
     return std::isinf(direct_mapq) ? (double) numeric_limits<int32_t>::max() : direct_mapq;
 }
 
@@ -459,22 +446,24 @@ double BaseAligner::group_mapping_quality_exact(vector<double>& scaled_scores, v
         scaled_scores.push_back(0.0);
     }
     
-    // work in log transformed values to avoid risk of overflow
-    double total_log_sum_exp = numeric_limits<double>::lowest();
-    double non_group_log_sum_exp = numeric_limits<double>::lowest();
-    
-    // go in reverse order because this has fewer numerical problems when the scores are sorted (as usual)
-    int64_t group_idx = group.size() - 1;
-    for (int64_t i = scaled_scores.size() - 1; i >= 0; i--) {
-        total_log_sum_exp = add_log(total_log_sum_exp, scaled_scores[i]);
-        if (group_idx >= 0 ? i == group[group_idx] : false) {
-            group_idx--;
+    // pull out the scores that aren't in the group
+    vector<double> non_group_scores;
+    non_group_scores.reserve(scaled_scores.size());
+    size_t group_idx = 0;
+    for (size_t i = 0; i < scaled_scores.size(); i++) {
+        if (group_idx < group.size() && i == group[group_idx]) {
+            group_idx++;
         }
         else {
-            non_group_log_sum_exp = add_log(non_group_log_sum_exp, scaled_scores[i]);
+            non_group_scores.push_back(scaled_scores[i]);
         }
     }
-    double direct_mapq = quality_scale_factor * (total_log_sum_exp - non_group_log_sum_exp);
+    
+    // sum likelihoods relative to the max to avoid overflow
+    double max_score = *max_element(scaled_scores.begin(), scaled_scores.end());
+    double total_sum = sum_exp(scaled_scores.data(), scaled_scores.size(), max_score);
+    double non_group_sum = sum_exp(non_group_scores.data(), non_group_scores.size(), max_score);
+    double direct_mapq = quality_scale_factor * (log(total_sum) - log(non_group_sum));
     return (std::isinf(direct_mapq) || direct_mapq > numeric_limits<int32_t>::max()) ?
            (double) numeric_limits<int32_t>::max() : direct_mapq;
 }
@@ -724,6 +713,38 @@ size_t BaseAligner::longest_detectable_gap(const Alignment& alignment) const {
     
 }
 
+int32_t BaseAligner::xdrop() const {
+    if (!use_xdrop) {
+        return 0;
+    }
+    // the score can fall this far across an indel we still want to align through, and any
+    // region where it falls further is treated as too divergent to be worth filling
+    return gap_open + (default_xdrop_gap_length - 1) * gap_extension;
+}
+
+void BaseAligner::align_global_banded_batch(vector<BandedAlignmentProblem>& problems) {
+    vector<bool> solved;
+    if (banded_backend && !problems.empty()) {
+        solved = banded_backend->align_global_banded_batch(*this, problems);
+        if (solved.size() != problems.size()) {
+            throw runtime_error("[BaseAligner::align_global_banded_batch] backend reported on "
+                                + to_string(solved.size()) + " of " + to_string(problems.size()) + " problems");
+        }
+    }
+    for (size_t i = 0; i < problems.size(); i++) {
+        if (!solved.empty() && solved[i]) {
+            continue;
+        }
+        BandedAlignmentProblem& problem = problems[i];
+        if (problem.alt_alignments) {
+            align_global_banded_multi(*problem.alignment, *problem.alt_alignments, *problem.graph,
+                                      problem.max_alt_alns, problem.band_padding, problem.permissive_banding);
+        } else {
+            align_global_banded(*problem.alignment, *problem.graph, problem.band_padding, problem.permissive_banding);
+        }
+    }
+}
+
 int32_t BaseAligner::score_gappy_alignment(const Alignment& aln, const function<size_t(pos_t, pos_t, size_t)>& estimate_distance,
     bool strip_bonuses) const {
     
@@ -838,6 +859,7 @@ Aligner::Aligner(int8_t _match,
     // these are used when setting up the nodes
     nt_table = gssw_create_nt_table();
     score_matrix = gssw_create_score_matrix(match, mismatch);
+    banded_scoring = identify_banded_scoring_scheme(score_matrix, gap_open, gap_extension);
     BaseAligner::init_mapping_quality(gc_content);
 }
 
@@ -863,23 +885,15 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
     // alignment pinning algorithm is based on pinning in bottom right corner, if pinning in top
     // left we need to reverse all the sequences first and translate the alignment back later
     
-    // create reversed graph if necessary
-    Graph reversed_graph;
-    if (pin_left) {
-        reverse_graph(g, reversed_graph);
-    }
-
     // choose forward or reversed objects
     // note: have to make a copy of the sequence because we will modify it to add a pinning point
-    Graph* align_graph = &g;
     string align_sequence = alignment.sequence();
     if (pin_left) {
-        align_graph = &reversed_graph;
         reverse(align_sequence.begin(), align_sequence.end());
     }
     
-    // convert into gssw graph
-    gssw_graph* graph = create_gssw_graph(*align_graph);
+    // convert into gssw graph, reversing it as we go if necessary
+    gssw_graph* graph = create_gssw_graph(g, pin_left);
     
     // perform dynamic programming
     gssw_graph_fill_pinned(graph, align_sequence.c_str(),
@@ -904,8 +918,7 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
                                                                            0);
         
             if (pin_left) {
-                // translate graph and mappings into original node space
-                unreverse_graph(reversed_graph);
+                // translate mappings into original node space
                 for (int32_t i = 0; i < max_alt_alns; i++) {
                     unreverse_graph_mapping(gms[i]);
                 }
@@ -1054,7 +1067,7 @@ void Aligner::align_global_banded(Alignment& alignment, Graph& g,
                                                permissive_banding,
                                                false);
         
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop(), banded_scoring);
     } else if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()) {
         // We'll fit in int16
         BandedGlobalAligner<int16_t> band_graph(alignment,
@@ -1063,7 +1076,7 @@ void Aligner::align_global_banded(Alignment& alignment, Graph& g,
                                                 permissive_banding,
                                                 false);
         
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop(), banded_scoring);
     } else if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()) {
         // We'll fit in int32
         BandedGlobalAligner<int32_t> band_graph(alignment,
@@ -1072,7 +1085,7 @@ void Aligner::align_global_banded(Alignment& alignment, Graph& g,
                                                 permissive_banding,
                                                 false);
         
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop(), banded_scoring);
     } else {
         // Fall back to int64
         BandedGlobalAligner<int64_t> band_graph(alignment,
@@ -1081,7 +1094,7 @@ void Aligner::align_global_banded(Alignment& alignment, Graph& g,
                                                 permissive_banding,
                                                 false);
         
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop(), banded_scoring);
     }
 
 }
@@ -1108,7 +1121,7 @@ void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>&
                                                permissive_banding,
                                                false);
         
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop(), banded_scoring);
     } else if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()) {
         // We'll fit in int16
         BandedGlobalAligner<int16_t> band_graph(alignment,
@@ -1119,7 +1132,7 @@ void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>&
                                                 permissive_banding,
                                                 false);
         
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop(), banded_scoring);
     } else if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()) {
         // We'll fit in int32
         BandedGlobalAligner<int32_t> band_graph(alignment,
@@ -1130,7 +1143,7 @@ void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>&
                                                 permissive_banding,
                                                 false);
         
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop(), banded_scoring);
     } else {
         // Fall back to int64
         BandedGlobalAligner<int64_t> band_graph(alignment,
@@ -1141,7 +1154,7 @@ void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>&
                                                 permissive_banding,
                                                 false);
         
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop(), banded_scoring);
     }
 }
 
@@ -1246,6 +1259,13 @@ QualAdjAligner::QualAdjAligner(int8_t _match,
     mismatch *= scale_factor;
     full_length_bonus *= scale_factor;
     
+    qual_match_scores.resize(5 * ((size_t) max_qual_score + 1));
+    for (size_t qual = 0; qual <= max_qual_score; qual++) {
+        for (size_t base = 0; base < 5; base++) {
+            qual_match_scores[5 * qual + base] = score_matrix[25 * qual + 6 * base];
+        }
+    }
+    
     BaseAligner::init_mapping_quality(gc_content);
 }
 
@@ -1269,19 +1289,11 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
     // alignment pinning algorithm is based on pinning in bottom right corner, if pinning in top
     // left we need to reverse all the sequences first and translate the alignment back later
     
-    // create reversed graph if necessary
-    Graph reversed_graph;
-    if (pin_left) {
-        reverse_graph(g, reversed_graph);
-    }
-    
     // choose forward or reversed objects
     // note: have to make copies of the strings because we will modify them to add a pinning point
-    Graph* align_graph = &g;
     string align_sequence = alignment.sequence();
     string align_quality = alignment.quality();
     if (pin_left) {
-        align_graph = &reversed_graph;
         reverse(align_sequence.begin(), align_sequence.end());
         reverse(align_quality.begin(), align_quality.end());
     }
@@ -1291,8 +1303,8 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
         exit(EXIT_FAILURE);
     }
     
-    // convert into gssw graph and get dummy pinned node (if pinning)
-    gssw_graph* graph = create_gssw_graph(*align_graph);
+    // convert into gssw graph, reversing it as we go if necessary
+    gssw_graph* graph = create_gssw_graph(g, pin_left);
     
     // perform dynamic programming
     // offer a full length bonus on each end, or only on the left if the right end is pinned.
@@ -1319,8 +1331,7 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
                                                                                     0);
         
             if (pin_left) {
-                // translate graph and mappings into original node space
-                unreverse_graph(reversed_graph);
+                // translate mappings into original node space
                 for (int32_t i = 0; i < max_alt_alns; i++) {
                     unreverse_graph_mapping(gms[i]);
                 }
@@ -1452,7 +1463,7 @@ void QualAdjAligner::align_global_banded(Alignment& alignment, Graph& g,
                                                                            permissive_banding,
                                                                            true);
     
-    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop());
 }
 
 void QualAdjAligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
@@ -1466,42 +1477,41 @@ void QualAdjAligner::align_global_banded_multi(Alignment& alignment, vector<Alig
                                                                            permissive_banding,
                                                                            true);
     
-    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    band_graph.align(score_matrix, nt_table, gap_open, gap_extension, xdrop());
+}
+
+int32_t QualAdjAligner::score_match_run(const char* sequence, const char* base_quality, size_t length) const {
+    const int8_t* table = qual_match_scores.data();
+    // independent sums so that consecutive lookups don't wait on each other
+    int32_t score_0 = 0, score_1 = 0, score_2 = 0, score_3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        score_0 += table[5 * (uint8_t) base_quality[i] + nt_table[(uint8_t) sequence[i]]];
+        score_1 += table[5 * (uint8_t) base_quality[i + 1] + nt_table[(uint8_t) sequence[i + 1]]];
+        score_2 += table[5 * (uint8_t) base_quality[i + 2] + nt_table[(uint8_t) sequence[i + 2]]];
+        score_3 += table[5 * (uint8_t) base_quality[i + 3] + nt_table[(uint8_t) sequence[i + 3]]];
+    }
+    for (; i < length; i++) {
+        score_0 += table[5 * (uint8_t) base_quality[i] + nt_table[(uint8_t) sequence[i]]];
+    }
+    return score_0 + score_1 + score_2 + score_3;
 }
 
 int32_t QualAdjAligner::score_exact_match(const Alignment& aln, size_t read_offset, size_t length) const {
-    auto& sequence = aln.sequence();
-    auto& base_quality = aln.quality();
-    int32_t score = 0;
-    for (int32_t i = 0; i < length; i++) {
-        // index 5 x 5 score matrices (ACGTN)
-        // always have match so that row and column index are same and can combine algebraically
-        score += score_matrix[25 * base_quality[read_offset + i] + 6 * nt_table[sequence[read_offset + i]]];
-    }
-    return score;
+    return score_match_run(aln.sequence().data() + read_offset, aln.quality().data() + read_offset, length);
 }
 
 int32_t QualAdjAligner::score_exact_match(const string& sequence, const string& base_quality) const {
-    int32_t score = 0;
-    for (int32_t i = 0; i < sequence.length(); i++) {
-        // index 5 x 5 score matrices (ACGTN)
-        // always have match so that row and column index are same and can combine algebraically
-        score += score_matrix[25 * base_quality[i] + 6 * nt_table[sequence[i]]];
-    }
-    return score;
+    return score_match_run(sequence.data(), base_quality.data(), sequence.size());
 }
 
 
 int32_t QualAdjAligner::score_exact_match(string::const_iterator seq_begin, string::const_iterator seq_end,
                                           string::const_iterator base_qual_begin) const {
-    int32_t score = 0;
-    for (auto seq_iter = seq_begin, qual_iter = base_qual_begin; seq_iter != seq_end; seq_iter++) {
-        // index 5 x 5 score matrices (ACGTN)
-        // always have match so that row and column index are same and can combine algebraically
-        score += score_matrix[25 * (*qual_iter) + 6 * nt_table[*seq_iter]];
-        qual_iter++;
+    if (seq_begin == seq_end) {
+        return 0;
     }
-    return score;
+    return score_match_run(&(*seq_begin), &(*base_qual_begin), seq_end - seq_begin);
 }
 
 int32_t QualAdjAligner::score_partial_alignment(const Alignment& alignment, VG& graph, const Path& path,
@@ -1530,9 +1540,15 @@ int32_t QualAdjAligner::score_partial_alignment(const Alignment& alignment, VG&
             if (edit.from_length() > 0) {
                 if (edit.to_length() > 0) {
                     
-                    for (auto siter = read_pos, riter = ref_pos, qiter = qual_pos;
-                         siter != read_pos + edit.from_length(); siter++, qiter++, riter++) {
-                        score += score_matrix[25 * (*qiter) + 5 * nt_table[*riter] + nt_table[*siter]];
+                    if (edit.sequence().empty()) {
+                        // match, which only needs the read side
+                        score += score_match_run(&(*read_pos), &(*qual_pos), edit.from_length());
+                    }
+                    else {
+                        for (auto siter = read_pos, riter = ref_pos, qiter = qual_pos;
+                             siter != read_pos + edit.from_length(); siter++, qiter++, riter++) {
+                            score += score_matrix[25 * (*qiter) + 5 * nt_table[*riter] + nt_table[*siter]];
+                        }
                     }
                     
                     // apply full length bonus
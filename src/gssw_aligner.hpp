@@ -26,10 +26,41 @@ namespace vg {
     static const int8_t default_max_scaled_score = 32;
     static const uint8_t default_max_qual_score = 255;
     static const double default_gc_content = 0.5;
+    static const int32_t default_xdrop_gap_length = 100;
     
     
     
     class VG; // forward declaration
+    class BaseAligner;
+    
+    /**
+     * One banded global alignment problem in a batch: a read, the small DAG to
+     * align it to, and how to band it.
+     */
+    struct BandedAlignmentProblem {
+        Alignment* alignment = nullptr;
+        Graph* graph = nullptr;
+        /// If set, the top scoring alignments go here, as in align_global_banded_multi()
+        vector<Alignment>* alt_alignments = nullptr;
+        int32_t max_alt_alns = 1;
+        int32_t band_padding = 0;
+        bool permissive_banding = true;
+    };
+    
+    /**
+     * Something that can solve batches of banded global alignment problems
+     * somewhere other than the aligner's own thread, such as on an accelerator.
+     */
+    class BandedAlignmentBackend {
+    public:
+        virtual ~BandedAlignmentBackend() = default;
+        
+        /// Solve any of the problems that can be solved here, with the aligner's scoring parameters,
+        /// filling them in exactly as the aligner's align_global_banded() or align_global_banded_multi()
+        /// would. Returns whether each problem was solved; the aligner solves the rest itself.
+        virtual vector<bool> align_global_banded_batch(const BaseAligner& aligner,
+                                                       vector<BandedAlignmentProblem>& problems) = 0;
+    };
 
     /**
      * The interface that any Aligner should implement, with some default implementations.
@@ -41,16 +72,19 @@ namespace vg {
         
         // for construction
         // needed when constructing an alignable graph from the nodes
-        gssw_graph* create_gssw_graph(Graph& g);
+        // if reversed, the node sequences and edges are reversed for left-pinned alignment,
+        // but the nodes still point to the original Nodes for translating the traceback
+        gssw_graph* create_gssw_graph(Graph& g, bool reversed = false);
+        /// Scratch table from node ID to gssw node for create_gssw_graph, kept per thread
+        /// since aligners can be shared between threads
+        thread_local static unordered_map<int64_t, gssw_node*> gssw_nodes_by_id;
+        /// Scratch buffer for sequences create_gssw_graph has to rewrite, kept per thread
+        thread_local static string gssw_scratch_sequence;
         void visit_node(gssw_node* node,
                         list<gssw_node*>& sorted_nodes,
                         set<gssw_node*>& unmarked_nodes,
                         set<gssw_node*>& temporary_marks);
         
-        // create a reversed graph for left-pinned alignment
-        void reverse_graph(Graph& g, Graph& reversed_graph_out);
-        // reverse all node sequences (other aspects of graph object not unreversed)
-        void unreverse_graph(Graph& graph);
         // convert graph mapping back into unreversed node positions
         void unreverse_graph_mapping(gssw_graph_mapping* gm);
         
@@ -126,6 +160,10 @@ namespace vg {
         virtual void align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments,
                                                Graph& g, int32_t max_alt_alns, int32_t band_padding = 0,
                                                bool permissive_banding = true) = 0;
+        
+        /// Solve a batch of independent banded global alignment problems, handing them to the
+        /// banded_backend if there is one, and solving whatever it doesn't take one at a time.
+        void align_global_banded_batch(vector<BandedAlignmentProblem>& problems);
                         
         /// Compute the score of an exact match in the given alignment, from the
         /// given offset, of the given length.
@@ -192,6 +230,10 @@ namespace vg {
         /// The longest gap detectable from any read position without soft-clipping
         size_t longest_detectable_gap(const Alignment& alignment) const;
         
+        /// The X-drop that banded global alignment should use: 0 unless use_xdrop is set, and
+        /// otherwise the penalty of a default_xdrop_gap_length gap under this aligner's scores
+        int32_t xdrop() const;
+        
         /// Use the score values in the aligner to score the given alignment,
         /// scoring gaps caused by jumping between between nodes using a custom
         /// gap length estimation function (which takes the from position, the
@@ -221,12 +263,22 @@ namespace vg {
         // members
         int8_t* nt_table = nullptr;
         int8_t* score_matrix = nullptr;
+        /// Fixed scoring scheme that score_matrix and the gap penalties amount to, if any, so banded
+        /// global alignment can use a kernel with the scores compiled in
+        BandedScoringScheme banded_scoring = RuntimeScoring;
         int8_t match;
         int8_t mismatch;
         int8_t gap_open;
         int8_t gap_extension;
         int8_t full_length_bonus;
         
+        /// Should banded global alignment give up on the parts of the DP that fall too far
+        /// below the best score so far? See xdrop().
+        bool use_xdrop = false;
+        
+        /// If set, batches of banded global alignments are offered to this first. Not owned.
+        BandedAlignmentBackend* banded_backend = nullptr;
+        
         // log of the base of the logarithm underlying the log-odds interpretation of the scores
         double log_base = 0.0;
         
@@ -352,6 +404,13 @@ namespace vg {
                             bool traceback_aln,
                             bool print_score_matrices);
         
+        /// Sum the quality adjusted match scores of a run of bases
+        int32_t score_match_run(const char* sequence, const char* base_quality, size_t length) const;
+        
+        /// The match score of each base (ACGTN) at each quality, 5 entries per quality. These are
+        /// the diagonals of the 25 entry blocks in score_matrix, packed together so that the few
+        /// qualities a (binned) read uses sit in a couple of cache lines.
+        vector<int8_t> qual_match_scores;
 
     };
 } // end namespace vg
@@ -45,6 +45,35 @@ pair<handle_t, handle_t> HandleGraph::edge_handle(const handle_t& left, const ha
     }
 }
 
+void HandleGraph::get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& dest) const {
+    dest.clear();
+    follow_edges(handle, go_left, [&](const handle_t& next) {
+        dest.push_back(next);
+    });
+}
+
+size_t HandleGraph::get_degree(const handle_t& handle, bool go_left) const {
+    size_t degree = 0;
+    follow_edges(handle, go_left, [&](const handle_t& ignored) {
+        degree++;
+    });
+    return degree;
+}
+
+void HandleGraph::get_lengths(const vector<handle_t>& handles, vector<size_t>& dest) const {
+    dest.resize(handles.size());
+    for (size_t i = 0; i < handles.size(); i++) {
+        dest[i] = get_length(handles[i]);
+    }
+}
+
+void HandleGraph::get_sequences(const vector<handle_t>& handles, vector<string>& dest) const {
+    dest.resize(handles.size());
+    for (size_t i = 0; i < handles.size(); i++) {
+        dest[i] = get_sequence(handles[i]);
+    }
+}
+
 }
 
 
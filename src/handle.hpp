@@ -211,6 +211,30 @@ public:
     // A pair of handles can be used as an edge. When so used, the handles have a
     // cannonical order and orientation.
     edge_t edge_handle(const handle_t& left, const handle_t& right) const;
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Bulk accessors
+    ////////////////////////////////////////////////////////////////////////////
+    
+    // These have default implementations in terms of the interface above, but
+    // graphs can override them to answer in one call rather than one virtual
+    // call (or one callback) per handle.
+    
+    /// Get all the handles to next/previous (right/left) nodes, in the order
+    /// that follow_edges() would visit them. Replaces the contents of dest, so
+    /// the same buffer can be reused across calls.
+    virtual void get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& dest) const;
+    
+    /// Count the edges off the left or right side of an oriented node.
+    virtual size_t get_degree(const handle_t& handle, bool go_left) const;
+    
+    /// Get the lengths of all of the given nodes, in order. Replaces the
+    /// contents of dest.
+    virtual void get_lengths(const vector<handle_t>& handles, vector<size_t>& dest) const;
+    
+    /// Get the sequences of all of the given nodes, in order, each in its
+    /// handle's local forward orientation. Replaces the contents of dest.
+    virtual void get_sequences(const vector<handle_t>& handles, vector<string>& dest) const;
 };
 
 /**
@@ -15,6 +15,10 @@ void trace_haplotypes_and_paths(xg::XG& index, const gbwt::GBWT* haplotype_datab
                                 bool expand_graph) {
   // get our haplotypes
   xg::XG::ThreadMapping n = {start_node, false};
+  if (haplotype_database == nullptr) {
+    // Use the GBWT the index delegates to, if any.
+    haplotype_database = index.get_haplotype_database();
+  }
   vector<pair<thread_t,int> > haplotypes = haplotype_database ?
     list_haplotypes(index, *haplotype_database, n, extend_distance) :
     list_haplotypes(index, n, extend_distance);
@@ -220,83 +224,112 @@ vector<pair<thread_t,int> > list_haplotypes(xg::XG& index, const gbwt::GBWT& hap
   cerr << "Extracting haplotypes from GBWT" << endl;
 #endif
 
-  vector<pair<thread_t,gbwt::SearchState> > search_intermediates;
+  // The search is a tree of partial haplotypes, each of which is its parent
+  // extended by one node, so haplotypes with a common prefix share it and
+  // only the ones we report get spelled out.
+  struct SearchNode {
+    size_t parent;
+    xg::XG::ThreadMapping mapping;
+    gbwt::SearchState state;
+    int length;
+  };
+  vector<SearchNode> tree;
   vector<pair<thread_t,int> > search_results;
-  // We still keep our data as thread_ts full of xg ThreadMappings and convert on the fly.
-  thread_t first_thread = {start_node};
-  auto first_node = gbwt::Node::encode(start_node.node_id, start_node.is_reverse);
-  gbwt::SearchState first_state = haplotype_database.find(first_node);
-#ifdef debug
-  cerr << "Start with state " << first_state << " for node " << gbwt::Node::id(first_node) << endl;
-#endif
-  vector<Edge> edges = start_node.is_reverse ?
-            index.edges_on_start(start_node.node_id) :
-            index.edges_on_end(start_node.node_id);
 
-  // TODO: this is just most of the loop body repeated!
-  for(int i = 0; i < edges.size(); i++) {
-    xg::XG::ThreadMapping next_node;
-    next_node.node_id = edges[i].to();
-    next_node.is_reverse = edges[i].to_end();
-    auto extend_node = gbwt::Node::encode(next_node.node_id, next_node.is_reverse);
-    auto new_state = haplotype_database.extend(first_state, extend_node);
-#ifdef debug
-    cerr << "Extend state " << first_state << " to " << new_state << " with " << gbwt::Node::id(extend_node) << endl;
-#endif
-    thread_t new_thread = first_thread;
-    new_thread.push_back(next_node);
-    if(!new_state.empty()) {
-#ifdef debug
-      cerr << "\tGot " << new_state.size() << " results; extending more" << endl;
-#endif
-      search_intermediates.push_back(make_pair(new_thread,new_state));
+  auto emit = [&](size_t i) {
+    thread_t t(tree[i].length);
+    for (size_t j = i, k = t.size(); k > 0; j = tree[j].parent) {
+      t[--k] = tree[j].mapping;
     }
-  }
-  while(search_intermediates.size() > 0) {
-    pair<thread_t,gbwt::SearchState> last = search_intermediates.back();
-    search_intermediates.pop_back();
-    int check_size = search_intermediates.size();
-    vector<Edge> edges = last.first.back().is_reverse ?
-              index.edges_on_start(last.first.back().node_id) :
-              index.edges_on_end(last.first.back().node_id);
-    if(edges.size() == 0) {
+    search_results.push_back(make_pair(move(t), (int) tree[i].state.size()));
+  };
+
+  // Extend a partial haplotype by each node its haplotypes go to next,
+  // following the GBWT's own edges. Calls the lambda with each non-empty
+  // extension, and returns whether the GBWT went anywhere.
+  auto extend = [&](size_t i, const function<void(size_t)>& lambda) {
+    bool any_successors = false;
+    gbwt::node_type from = gbwt::Node::encode(tree[i].mapping.node_id, tree[i].mapping.is_reverse);
+    for (const gbwt::edge_type& edge : haplotype_database.edges(from)) {
+      if (edge.first == gbwt::ENDMARKER) {
+        continue;
+      }
+      any_successors = true;
+      auto new_state = haplotype_database.extend(tree[i].state, edge.first);
 #ifdef debug
-      cerr << "Hit end of graph on state " << last.second << endl;
+      cerr << "Extend state " << tree[i].state << " to " << new_state << " with " << gbwt::Node::id(edge.first) << endl;
 #endif
-      search_results.push_back(make_pair(last.first,last.second.size()));
-    } else {
-      for(int i = 0; i < edges.size(); i++) {
+      if (!new_state.empty()) {
         xg::XG::ThreadMapping next_node;
-        next_node.node_id = edges[i].to();
-        next_node.is_reverse = edges[i].to_end();
-        auto extend_node = gbwt::Node::encode(next_node.node_id, next_node.is_reverse);
-        auto new_state = haplotype_database.extend(last.second, extend_node);
-#ifdef debug
-        cerr << "Extend state " << last.second << " to " << new_state << " with " << gbwt::Node::id(extend_node) << endl;
-#endif
-        thread_t new_thread = last.first;
-        new_thread.push_back(next_node);
-        if(!new_state.empty()) {
-          if(new_thread.size() >= extend_distance) {
+        next_node.node_id = gbwt::Node::id(edge.first);
+        next_node.is_reverse = gbwt::Node::is_reverse(edge.first);
+        tree.push_back({i, next_node, new_state, tree[i].length + 1});
+        lambda(tree.size() - 1);
+      }
+    }
+    return any_successors;
+  };
+
+  auto first_node = gbwt::Node::encode(start_node.node_id, start_node.is_reverse);
+  tree.push_back({0, start_node, haplotype_database.find(first_node), 1});
 #ifdef debug
-            cerr << "\tGot " << new_state.size() << " results at limit; emitting" << endl;
+  cerr << "Start with state " << tree.front().state << " for node " << gbwt::Node::id(first_node) << endl;
 #endif
-            search_results.push_back(make_pair(new_thread,new_state.size()));
-          } else {
+  vector<size_t> frontier;
+  if (!tree.front().state.empty()) {
+    extend(0, [&](size_t child) {
+      frontier.push_back(child);
+    });
+  }
+
+  // Go breadth first, one node further along each time
+  vector<size_t> next_frontier;
+  while (!frontier.empty()) {
+    for (size_t i : frontier) {
+      bool extended = false;
+      bool any_successors = extend(i, [&](size_t child) {
+        if (tree[child].length >= extend_distance) {
+          emit(child);
+        } else {
+          next_frontier.push_back(child);
+          extended = true;
+        }
+      });
+      if (!extended) {
+        // The haplotypes all end here. We report them if the graph ends here
+        // too, or if we haven't gotten most of the way along.
+        bool graph_ends = !any_successors &&
+          (tree[i].mapping.is_reverse ?
+           index.edges_on_start(tree[i].mapping.node_id) :
+           index.edges_on_end(tree[i].mapping.node_id)).empty();
+        if (graph_ends || tree[i].length < extend_distance - 1) {
 #ifdef debug
-            cerr << "\tGot " << new_state.size() << " results; extending more" << endl;
+          cerr << "Haplotypes end on state " << tree[i].state << endl;
 #endif
-            search_intermediates.push_back(make_pair(new_thread,new_state));
-          }
+          emit(i);
         }
       }
-      if(check_size == search_intermediates.size() &&
-                last.first.size() < extend_distance - 1) {
-        search_results.push_back(make_pair(last.first,last.second.size()));
-      }
     }
+    frontier.swap(next_frontier);
+    next_frontier.clear();
   }
   return search_results;
 }
 
+void trace_haplotypes_and_paths(xg::XG& index, const gbwt::GBWT* haplotype_database,
+                                const vector<vg::id_t>& start_nodes, int extend_distance,
+                                vector<Graph>& out_graphs,
+                                vector<map<string, int>>& out_thread_frequencies,
+                                bool expand_graph) {
+  out_graphs.clear();
+  out_graphs.resize(start_nodes.size());
+  out_thread_frequencies.clear();
+  out_thread_frequencies.resize(start_nodes.size());
+#pragma omp parallel for schedule(dynamic, 1)
+  for (size_t i = 0; i < start_nodes.size(); i++) {
+    trace_haplotypes_and_paths(index, haplotype_database, start_nodes[i], extend_distance,
+                               out_graphs[i], out_thread_frequencies[i], expand_graph);
+  }
+}
+
 }
@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <map>
 #include <vector>
 
 #include <gbwt/gbwt.h>
@@ -21,14 +22,23 @@ using thread_t = vector<xg::XG::ThreadMapping>;
 // subgraph search for all the paths too.  Haplotype thread i will be embedded
 // as Paths a path with name thread_i.  Each path name (including threads) is
 // mapped to a frequency in out_thread_frequencies.  Haplotypes will be pulled
-// from the xg index's gPBWT if haplotype_database is null, and from the given
-// GBWT index otherwise.
+// from the given GBWT index if set, otherwise from the GBWT the xg index
+// delegates its haplotype queries to, and otherwise from the xg's gPBWT.
 void trace_haplotypes_and_paths(xg::XG& index, const gbwt::GBWT* haplotype_database,
                                 vg::id_t start_node, int extend_distance,
                                 Graph& out_graph,
                                 map<string, int>& out_thread_frequencies,
                                 bool expand_graph = true);
 
+// Trace haplotypes and paths as above, from each of the given start nodes, in
+// parallel. The graph and frequencies for each start node are in the same
+// place in out_graphs and out_thread_frequencies as it is in start_nodes.
+void trace_haplotypes_and_paths(xg::XG& index, const gbwt::GBWT* haplotype_database,
+                                const vector<vg::id_t>& start_nodes, int extend_distance,
+                                vector<Graph>& out_graphs,
+                                vector<map<string, int>>& out_thread_frequencies,
+                                bool expand_graph = true);
+
 // Turns an (xg-based) thread_t into a (vg-based) Path
 Path path_from_thread_t(thread_t& t, xg::XG& index);
 
@@ -42,7 +52,9 @@ vector<pair<thread_t,int> > list_haplotypes(xg::XG& index,
 // Lists all the sub-haplotypes of length extend_distance nodes starting at
 // node start_node from the set of haplotypes embedded in the geven GBWT
 // haplotype database.  Records, for each thread_t t the number of haplotypes
-// of which t is a subhaplotype
+// of which t is a subhaplotype.  The search is breadth first and follows the
+// GBWT's edges, so sub-haplotypes come out in order of length, and those with
+// a common prefix share it while they're being searched.
 vector<pair<thread_t,int> > list_haplotypes(xg::XG& index, const gbwt::GBWT& haplotype_database,
             xg::XG::ThreadMapping start_node, int extend_distance);
 
@@ -2,6 +2,8 @@
 #include "path.hpp"
 #include "position.hpp"
 
+#include <cstring>
+
 namespace haplo {
 
 // By default, should we warn when haplotype scoring fails?
@@ -256,6 +258,25 @@ int_itvl_t int_itvl_t::intersection(const int_itvl_t& A, const int_itvl_t& B) {
 haplo_DP_column
 *******************************************************************************/
 
+haplo_DP_column::haplo_DP_column(const haplo_DP_column& other) {
+  *this = other;
+}
+
+haplo_DP_column& haplo_DP_column::operator=(const haplo_DP_column& other) {
+  if (this != &other) {
+    previous_values = other.previous_values;
+    previous_sizes = other.previous_sizes;
+    previous_sum = other.previous_sum;
+    sum = other.sum;
+    length = other.length;
+    entries.clear();
+    for (auto& rectangle : other.entries) {
+      entries.push_back(make_shared<haplo_DP_rectangle>(*rectangle));
+    }
+  }
+  return *this;
+}
+
 haplo_DP_column::~haplo_DP_column() {
 }
 
@@ -295,37 +316,30 @@ void haplo_DP_column::update_score_vector(haploMath::RRMemo& memo) {
   } else {
     previous_sum = sum;
     int64_t offset = (int64_t)(entries.at(0)->is_new());
-    // TODO optimize by using arrays
-    vector<double> continuing_Rs(entries.size() - offset);
-    vector<int64_t> continuing_counts(entries.size() - offset);
+    haploMath::logsum_accumulator continuing;
     for(size_t i = offset; i < entries.size(); i++) {
-      continuing_Rs.at(i - offset) = previous_values[entries[i]->prev_idx()];
-      continuing_counts.at(i - offset) = entries[i]->I();
+      continuing.add(previous_values[entries[i]->prev_idx()] + log(entries[i]->I()));
     }
     
     double logpS1S2RRS = previous_sum + 
                          memo.log_recombination_penalty() + 
                          memo.logS(r_0->interval_size(), length);
-    double logS1 = haploMath::int_weighted_sum(continuing_Rs, continuing_counts);
+    double logS1 = continuing.sum();
     double logS1RRD = logS1 + memo.logRRDiff(r_0->interval_size(), length);
     size_t i = 0;
     if(r_0->prev_idx() == -1) {
       r_0->R = logpS1S2RRS;
       i = 1;
     }
-    if(length == 1) {
-      for(i; i < entries.size(); i++) {
-        double logLHS = memo.logT_base +
-                        previous_R(i) +
-                        memo.logT(length);
-        entries[i]->R = haploMath::logsum(logLHS, logpS1S2RRS);
-      }
-    } else {
-      for(i; i < entries.size(); i++) {
-        double logLHS = memo.logT_base +
-                        haploMath::logsum(logS1RRD, previous_R(i) + memo.logT(length));
-        entries[i]->R = haploMath::logsum(logLHS, logpS1S2RRS);
-      }
+    // Every rectangle's R is log(e^c + e^(d + previous R)) for constants c
+    // and d of the column, so only the last logsum depends on the rectangle
+    double logT_step = memo.logT_base + memo.logT(length);
+    double log_constant = logpS1S2RRS;
+    if(length != 1) {
+      log_constant = haploMath::logsum(memo.logT_base + logS1RRD, logpS1S2RRS);
+    }
+    for(; i < entries.size(); i++) {
+      entries[i]->R = haploMath::logsum(log_constant, previous_R(i) + logT_step);
     }
   }
   previous_values = get_scores();
@@ -371,6 +385,77 @@ bool haplo_DP_column::is_empty() const {
   return entries.size() == 0;
 }
 
+/*******************************************************************************
+haplo_DP_prefix_cache
+*******************************************************************************/
+
+haplo_DP_prefix_cache::haplo_DP_prefix_cache(size_t max_entries) : max_entries(max_entries) {
+  
+}
+
+vector<uint64_t> haplo_DP_prefix_cache::prefix_keys(const gbwt_thread_t& thread, haploMath::RRMemo& memo) const {
+  // FNV-1a style mixing of the memo's parameters, then each node and length
+  const uint64_t prime = 0x100000001b3ull;
+  uint64_t key = 0xcbf29ce484222325ull;
+  auto mix = [&](uint64_t value) {
+    key = (key ^ value) * prime;
+  };
+  double parameters[2] = {memo.log_population_size(), memo.log_recombination_penalty()};
+  uint64_t bits[2];
+  memcpy(bits, parameters, sizeof(bits));
+  mix(bits[0]);
+  mix(bits[1]);
+  
+  vector<uint64_t> keys(thread.size());
+  for (size_t i = 0; i < thread.size(); i++) {
+    mix(thread[i]);
+    mix(thread.nodelength(i));
+    keys[i] = key;
+  }
+  return keys;
+}
+
+size_t haplo_DP_prefix_cache::longest_prefix(const gbwt_thread_t& thread, const vector<uint64_t>& keys,
+                                             haploMath::RRMemo& memo, unique_ptr<haplo_DP_column>& column) {
+  for (size_t length = thread.size(); length > 0; length--) {
+    auto found = entries.find(keys[length - 1]);
+    if (found == entries.end()) {
+      continue;
+    }
+    entry_t& entry = found->second;
+    if (entry.length != length || entry.last_node != thread[length - 1] ||
+        entry.last_node_length != thread.nodelength(length - 1) ||
+        entry.log_population_size != memo.log_population_size() ||
+        entry.log_recombination_penalty != memo.log_recombination_penalty()) {
+      // a collision; treat it as a miss
+      continue;
+    }
+    recency.splice(recency.begin(), recency, entry.recency);
+    column.reset(new haplo_DP_column(entry.column));
+    return length;
+  }
+  return 0;
+}
+
+void haplo_DP_prefix_cache::insert(const gbwt_thread_t& thread, const vector<uint64_t>& keys, size_t length,
+                                   haploMath::RRMemo& memo, const haplo_DP_column& column) {
+  if (max_entries == 0 || entries.count(keys[length - 1])) {
+    return;
+  }
+  if (entries.size() >= max_entries) {
+    entries.erase(recency.back());
+    recency.pop_back();
+  }
+  recency.push_front(keys[length - 1]);
+  entries.emplace(keys[length - 1], entry_t{length, thread[length - 1], thread.nodelength(length - 1),
+                                            memo.log_population_size(), memo.log_recombination_penalty(),
+                                            column, recency.begin()});
+}
+
+size_t haplo_DP_prefix_cache::size() const {
+  return entries.size();
+}
+
 /*******************************************************************************
 haplo_DP
 *******************************************************************************/
@@ -818,6 +903,10 @@ XGScoreProvider::XGScoreProvider(xg::XG& index) : index(index) {
 }
 
 pair<double, bool> XGScoreProvider::score(const vg::Path& path, haploMath::RRMemo& memo) {
+  if (index.get_haplotype_database() != nullptr) {
+    // The XG delegates its haplotype queries to a GBWT, so score against that directly.
+    return haplo_DP::score(path, *index.get_haplotype_database(), memo);
+  }
   return haplo_DP::score(path, index, memo);
 }
 
@@ -897,56 +986,19 @@ double logsum(double a, double b) {
 }
 
 double int_weighted_sum(double* values, int64_t* counts, size_t n_values) {
-  if(n_values == 0) {
-    return 0;
-  } else if(n_values == 1) {
-    return values[0] + log(counts[0]);
-  } else {
-    double max_summand = values[0] + log(counts[0]);
-    int max_index = 0;
-    vector<double> summands;
-    for(int i = 0; i < n_values; i++){
-      summands.push_back(values[i] + log(counts[i]));
-      if(summands.back() > max_summand) {
-        max_summand = summands.back();
-        max_index = i;
-      }
-    }
-    double sum = 0;
-    for(int i = 0; i < summands.size(); i++) {
-      if(i != max_index) {
-        sum += exp(summands[i]-max_summand);
-      }
-    }
-    return max_summand + log1p(sum);
+  logsum_accumulator accumulator;
+  for(size_t i = 0; i < n_values; i++) {
+    accumulator.add(values[i] + log(counts[i]));
   }
+  return accumulator.sum();
 }
 
-
-double int_weighted_sum(vector<double> values, vector<int64_t> counts) {
-  if(values.size() == 0) {
-    return 0;
-  } else if(values.size() == 1) {
-    return values[0] + log(counts[0]);
-  } else {
-    double max_summand = values[0] + log(counts[0]);
-    int max_index = 0;
-    vector<double> summands;
-    for(int i = 0; i < values.size(); i++){
-      summands.push_back(values[i] + log(counts[i]));
-      if(summands.back() > max_summand) {
-        max_summand = summands.back();
-        max_index = i;
-      }
-    }
-    double sum = 0;
-    for(int i = 0; i < summands.size(); i++) {
-      if(i != max_index) {
-        sum += exp(summands[i]-max_summand);
-      }
-    }
-    return max_summand + log1p(sum);
+double int_weighted_sum(const vector<double>& values, const vector<int64_t>& counts) {
+  logsum_accumulator accumulator;
+  for(size_t i = 0; i < values.size(); i++) {
+    accumulator.add(values[i] + log(counts[i]));
   }
+  return accumulator.sum();
 }
 
 double RRMemo::logT(int width) {
@@ -4,6 +4,10 @@
 #include <cmath>
 #include <vector>
 #include <iostream>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <atomic>
 
 #include "vg.pb.h"
 #include "xg.hpp"
@@ -67,8 +71,31 @@ using thread_t = vector<xg::XG::ThreadMapping>;
 namespace haploMath{
   double logsum(double a, double b);
   double logdiff(double a, double b);
-  double int_weighted_sum(vector<double> values, vector<int64_t> counts);
+  double int_weighted_sum(const vector<double>& values, const vector<int64_t>& counts);
   double int_weighted_sum(double* values, int64_t* counts, size_t n_entries);
+  
+  // Sums log-space values in one pass, keeping the running maximum apart, so
+  // there is one exp per term and no buffer of terms
+  struct logsum_accumulator {
+    bool empty = true;
+    double max_summand = 0;
+    double rest = 0;
+    inline void add(double summand) {
+      if (empty) {
+        max_summand = summand;
+        empty = false;
+      } else if (summand > max_summand) {
+        rest = (rest + 1.0) * exp(max_summand - summand);
+        max_summand = summand;
+      } else {
+        rest += exp(summand - max_summand);
+      }
+    }
+    // 0 if nothing was added, like int_weighted_sum
+    inline double sum() const {
+      return empty ? 0 : max_summand + log1p(rest);
+    }
+  };
 
   // ---------------------------------------------------------------------------
   //  RRMemo
@@ -271,6 +298,9 @@ private:
 public:
   template<class accessorType>
   haplo_DP_column(accessorType& ga);
+  // copies get their own rectangles, since extending a column modifies them
+  haplo_DP_column(const haplo_DP_column& other);
+  haplo_DP_column& operator=(const haplo_DP_column& other);
   ~haplo_DP_column();
   template<class accessorType>
   void extend(accessorType& ga);
@@ -281,6 +311,45 @@ public:
   bool is_empty() const;
 };
 
+// -----------------------------------------------------------------------------
+
+// Bounded LRU cache of DP columns for prefixes of GBWT threads, so scoring
+// threads that share a prefix (multimappings, overlapping candidates) only
+// needs to extend the DP past the shared part. The column after a prefix
+// depends only on the prefix and the memo's parameters, so this gives the
+// same scores as computing from scratch. Not thread safe; use one per thread.
+class haplo_DP_prefix_cache {
+public:
+  haplo_DP_prefix_cache(size_t max_entries);
+  
+  // keys for each prefix of the thread under the memo's parameters; element i
+  // is the key for the first i + 1 entries
+  vector<uint64_t> prefix_keys(const gbwt_thread_t& thread, haploMath::RRMemo& memo) const;
+  // find the longest cached prefix of the thread, put a copy of its column in
+  // column, and return its length (0 if no prefix is cached)
+  size_t longest_prefix(const gbwt_thread_t& thread, const vector<uint64_t>& keys,
+                        haploMath::RRMemo& memo, unique_ptr<haplo_DP_column>& column);
+  // remember the column after the first length entries of the thread
+  void insert(const gbwt_thread_t& thread, const vector<uint64_t>& keys, size_t length,
+              haploMath::RRMemo& memo, const haplo_DP_column& column);
+  size_t size() const;
+private:
+  struct entry_t {
+    // enough of the prefix and parameters to catch key collisions
+    size_t length;
+    gbwt::node_type last_node;
+    size_t last_node_length;
+    double log_population_size;
+    double log_recombination_penalty;
+    haplo_DP_column column;
+    list<uint64_t>::iterator recency;
+  };
+  size_t max_entries;
+  unordered_map<uint64_t, entry_t> entries;
+  // keys from most to least recently used
+  list<uint64_t> recency;
+};
+
 thread_t path_to_thread_t(const vg::Path& path);
 
 //------------------------------------------------------------------------------
@@ -309,8 +378,11 @@ public:
   haplo_DP(accessorType& ga);
   haplo_DP_column* get_current_column();
   static haplo_score_type score(const thread_t& thread, xg::XG& graph, haploMath::RRMemo& memo);
+  // if a cache is given, resume from the longest cached prefix of the thread
+  // and remember the columns for the rest of it
   template<class GBWTType>
-  static haplo_score_type score(const gbwt_thread_t& thread, GBWTType& graph, haploMath::RRMemo& memo);
+  static haplo_score_type score(const gbwt_thread_t& thread, GBWTType& graph, haploMath::RRMemo& memo,
+                                haplo_DP_prefix_cache* cache = nullptr);
 };
 
 //------------------------------------------------------------------------------
@@ -380,6 +452,12 @@ public:
 class ScoreProvider {
 public:
   virtual pair<double, bool> score(const vg::Path&, haploMath::RRMemo& memo) = 0;
+  /// Return false if we know that no haplotype visits the given oriented
+  /// node IDs in order, taking at most max_steps steps from each to the
+  /// next. Providers that can't check cheaply just return true.
+  virtual bool has_consistent_haplotype(const vector<pair<int64_t, bool>>& nodes, size_t max_steps) {
+    return true;
+  }
   virtual ~ScoreProvider() = default;
 };
 
@@ -393,13 +471,26 @@ private:
 };
 
 /// Score haplotypes using a GBWT haplotype database (normal or dynamic)
+/// Each thread keeps DP columns for up to cache_entries recently scored path
+/// prefixes, so candidates that share a prefix share the work (0 disables
+/// the cache).
 template<class GBWTType>
 class GBWTScoreProvider : public ScoreProvider {
 public:
-  GBWTScoreProvider(GBWTType& index);
+  GBWTScoreProvider(GBWTType& index, size_t cache_entries = 4096);
   pair<double, bool> score(const vg::Path&, haploMath::RRMemo& memo);
+  /// Search the GBWT from each node to the next. Gives up and returns true
+  /// after max_search_work extensions, since then we can't be sure.
+  bool has_consistent_haplotype(const vector<pair<int64_t, bool>>& nodes, size_t max_steps);
+  size_t max_search_work = 4096;
 private:
   GBWTType& index;
+  size_t cache_entries;
+  // distinguishes this provider's caches from those of any earlier provider
+  // that lived at the same address
+  size_t provider_id;
+  static atomic<size_t> next_provider_id;
+  haplo_DP_prefix_cache& get_cache();
 };
 
 /// Score haplotypes using a linear_haplo_structure
@@ -558,34 +649,49 @@ haplo_score_type haplo_DP::score(const vg::Path& path, GBWTType& graph, haploMat
 }
 
 template<class GBWTType>
-haplo_score_type haplo_DP::score(const gbwt_thread_t& thread, GBWTType& graph, haploMath::RRMemo& memo) {
-  if (!graph.contains(thread[0])) {
-    // We start on a node that has no haplotype index entry
-    if (warn_on_score_fail) {
-      cerr << "[WARNING] Path starts outside of haplotype index and cannot be scored" << endl;
-      cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
-    }
-    return pair<double, bool>(nan(""), false);
+haplo_score_type haplo_DP::score(const gbwt_thread_t& thread, GBWTType& graph, haploMath::RRMemo& memo,
+                                 haplo_DP_prefix_cache* cache) {
+  vector<uint64_t> keys;
+  unique_ptr<haplo_DP_column> column;
+  size_t start = 0;
+  if (cache != nullptr) {
+    keys = cache->prefix_keys(thread, memo);
+    start = cache->longest_prefix(thread, keys, memo, column);
   }
   
-  hDP_gbwt_graph_accessor<GBWTType> ga_i(graph, thread[0], thread.nodelength(0), memo);
-  haplo_DP hdp(ga_i);
-  if(ga_i.new_height() == 0) {
-    if (warn_on_score_fail) {
-      cerr << "[WARNING] Initial node in path is visited by 0 reference haplotypes" << endl;
-      cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
-      ga_i.print(cerr);
+  if (start == 0) {
+    if (!graph.contains(thread[0])) {
+      // We start on a node that has no haplotype index entry
+      if (warn_on_score_fail) {
+        cerr << "[WARNING] Path starts outside of haplotype index and cannot be scored" << endl;
+        cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+      }
+      return pair<double, bool>(nan(""), false);
+    }
+    
+    hDP_gbwt_graph_accessor<GBWTType> ga_i(graph, thread[0], thread.nodelength(0), memo);
+    column.reset(new haplo_DP_column(ga_i));
+    if(ga_i.new_height() == 0) {
+      if (warn_on_score_fail) {
+        cerr << "[WARNING] Initial node in path is visited by 0 reference haplotypes" << endl;
+        cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+        ga_i.print(cerr);
+      }
+      return pair<double, bool>(nan(""), false);
     }
-    return pair<double, bool>(nan(""), false);
-  }
 #ifdef debug
-  cerr << "After entry 0 (" << gbwt::Node::id(thread[0]) << ") height: " << ga_i.new_height() << " intervals: ";
-  for (auto& interval : hdp.DP_column.get_sizes()) {
-    cerr << interval << " ";
-  }
-  cerr << "score: " << hdp.DP_column.current_sum() << endl;
+    cerr << "After entry 0 (" << gbwt::Node::id(thread[0]) << ") height: " << ga_i.new_height() << " intervals: ";
+    for (auto& interval : column->get_sizes()) {
+      cerr << interval << " ";
+    }
+    cerr << "score: " << column->current_sum() << endl;
 #endif
-  for(size_t i = 1; i < thread.size(); i++) {
+    if (cache != nullptr) {
+      cache->insert(thread, keys, 1, memo, *column);
+    }
+    start = 1;
+  }
+  for(size_t i = start; i < thread.size(); i++) {
     if (!graph.contains(thread[i])) {
       if (warn_on_score_fail) { 
         cerr << "[WARNING] Node " << i + 1 << " in path leaves haplotype index and cannot be scored" << endl;
@@ -603,30 +709,100 @@ haplo_score_type haplo_DP::score(const gbwt_thread_t& thread, GBWTType& graph, h
       }
       return pair<double, bool>(nan(""), false);
     } else {
-      hdp.DP_column.extend(ga);
+      column->extend(ga);
     }
 #ifdef debug
     cerr << "After entry " << i << " (" << gbwt::Node::id(thread[i]) << ") height: " << ga.new_height() << " intervals: ";
-    for (auto& interval : hdp.DP_column.get_sizes()) {
+    for (auto& interval : column->get_sizes()) {
       cerr << interval << " ";
     }
-    cerr << "score: " << hdp.DP_column.current_sum() << endl;
+    cerr << "score: " << column->current_sum() << endl;
 #endif
+    if (cache != nullptr) {
+      cache->insert(thread, keys, i + 1, memo, *column);
+    }
   }
-  return pair<double, bool>(hdp.DP_column.current_sum(), true);
+  return pair<double, bool>(column->current_sum(), true);
 }
 
 
 //------------------------------------------------------------------------------
 
 template<class GBWTType>
-GBWTScoreProvider<GBWTType>::GBWTScoreProvider(GBWTType& index) : index(index) {
+atomic<size_t> GBWTScoreProvider<GBWTType>::next_provider_id(0);
+
+template<class GBWTType>
+GBWTScoreProvider<GBWTType>::GBWTScoreProvider(GBWTType& index, size_t cache_entries) :
+  index(index), cache_entries(cache_entries), provider_id(next_provider_id++) {
   // Nothing to do!
 }
 
+template<class GBWTType>
+haplo_DP_prefix_cache& GBWTScoreProvider<GBWTType>::get_cache() {
+  thread_local unordered_map<size_t, haplo_DP_prefix_cache> caches;
+  auto found = caches.find(provider_id);
+  if (found == caches.end()) {
+    found = caches.emplace(provider_id, haplo_DP_prefix_cache(cache_entries)).first;
+  }
+  return found->second;
+}
+
 template<class GBWTType>
 pair<double, bool> GBWTScoreProvider<GBWTType>::score(const vg::Path& path, haploMath::RRMemo& memo) {
-  return haplo_DP::score(path, index, memo);
+  if (cache_entries == 0 || path.mapping_size() == 0) {
+    return haplo_DP::score(path, index, memo);
+  }
+  return haplo_DP::score(path_to_gbwt_thread_t(path), index, memo, &get_cache());
+}
+
+template<class GBWTType>
+bool GBWTScoreProvider<GBWTType>::has_consistent_haplotype(const vector<pair<int64_t, bool>>& nodes,
+                                                           size_t max_steps) {
+  if (nodes.empty()) {
+    return true;
+  }
+  gbwt::node_type start = gbwt::Node::encode(nodes.front().first, nodes.front().second);
+  if (!index.contains(start)) {
+    return false;
+  }
+  // the haplotypes that have visited every node so far, split by the way they came
+  vector<gbwt::SearchState> reached(1, index.find(start));
+  if (reached.front().empty()) {
+    return false;
+  }
+  size_t work = 0;
+  for (size_t i = 1; i < nodes.size(); i++) {
+    gbwt::node_type target = gbwt::Node::encode(nodes[i].first, nodes[i].second);
+    if (!index.contains(target)) {
+      return false;
+    }
+    vector<gbwt::SearchState> frontier = std::move(reached);
+    reached.clear();
+    for (size_t step = 0; step < max_steps && !frontier.empty(); step++) {
+      vector<gbwt::SearchState> next;
+      for (auto& state : frontier) {
+        for (auto& edge : index.edges(state.node)) {
+          if (edge.first == gbwt::ENDMARKER) {
+            continue;
+          }
+          if (++work > max_search_work) {
+            return true;
+          }
+          gbwt::SearchState extended = index.extend(state, edge.first);
+          if (extended.empty()) {
+            continue;
+          }
+          // haplotypes that reach the target stop there, to be extended to the next node
+          (extended.node == target ? reached : next).push_back(extended);
+        }
+      }
+      frontier = std::move(next);
+    }
+    if (reached.empty()) {
+      return false;
+    }
+  }
+  return true;
 }
 
 
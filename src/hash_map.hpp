@@ -9,7 +9,15 @@
 // dense_hash_map and dense_hash_set.
 //#define USE_DENSE_HASH
 
-#ifdef USE_DENSE_HASH
+// Uncomment (or build with -DUSE_FLAT_HASH) to use the flat Swiss-style
+// tables from flat_hash_map.hpp instead of either. "vg benchmark -x" compares
+// them all on a real graph.
+//#define USE_FLAT_HASH
+
+#ifdef USE_FLAT_HASH
+#undef USE_DENSE_HASH
+#include "flat_hash_map.hpp"
+#elif defined(USE_DENSE_HASH)
 #include <sparsehash/dense_hash_map>
 #include <sparsehash/dense_hash_set>
 #else
@@ -137,6 +145,31 @@ struct wang_hash<std::pair<A, B>> {
 };
 
 
+#ifdef USE_FLAT_HASH
+
+// Replacements for std::unordered_map and std::unordered_set. The flat tables
+// don't need an empty key.
+
+template<typename K, typename V>
+class hash_map : public FlatHashMap<K, V, wang_hash<K>> {};
+
+template<typename K, typename V>
+class string_hash_map : public FlatHashMap<K, V> {};
+
+template<typename K, typename V>
+class pair_hash_map : public FlatHashMap<K, V, wang_hash<K>> {};
+
+template<typename K>
+class hash_set : public FlatHashSet<K, wang_hash<K>> {};
+
+template<typename K>
+class string_hash_set : public FlatHashSet<K> {};
+
+template<typename K>
+class pair_hash_set : public FlatHashSet<K, wang_hash<K>> {};
+
+#else
+
 // Replacements for std::unordered_map.
 
 template<typename K, typename V>
@@ -262,6 +295,8 @@ public:
 #endif
 };
 
+#endif
+
 
 }   // namespace vg
 
@@ -1,5 +1,8 @@
 #include "homogenizer.hpp"
 
+#include <omp.h>
+#include <memory>
+
 using namespace std;
 using namespace vg;
 
@@ -43,13 +46,21 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
 
     /* Generate edges/nodes to add to graph */
     //vector<MaximalExactMatch> find_smems(const string& seq);
-    Mapper* mapper;
-    mapper= new Mapper(xindex, gcsa_index, lcp_index);
+    // Mappers aren't safe to share between threads, but they can share the
+    // indexes, so each thread gets its own.
+    vector<unique_ptr<Mapper>> mappers(get_thread_count());
+    for (auto& mapper : mappers) {
+        mapper = unique_ptr<Mapper>(new Mapper(xindex, gcsa_index, lcp_index));
+    }
 
-    map<vg::id_t, vector<MaximalExactMatch> > matches;
-    map<vg::id_t, string> ref_node_to_clip;
-    vector<string> seqs;
+    // Look at the tips in a fixed order, so the same graph gets the same
+    // candidates however many threads there are.
+    sort(tips.begin(), tips.end());
+    // The reference node near each tip that might get a new edge, or -1
+    vector<vg::id_t> tip_ref_nodes(tips.size(), -1);
+#pragma omp parallel for schedule(dynamic, 1)
     for (int i = 0; i < tips.size(); i++){
+        Mapper* mapper = mappers[omp_get_thread_num()].get();
         Node* n = o_graph->get_node(tips[i]);
         if (n->sequence().length() < 4 || (o_graph->paths).has_node_mapping(n->id())){
             continue;
@@ -60,8 +71,8 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
                                                                mapper->min_mem_length);
         // Why >1? Because we need to match the node AND somewhere else in the graph.
         if (m.size() > 1){
+#pragma omp critical (cerr)
             cerr << "POTENTIAL NEW EDGE" << endl;
-            matches[tips[i]] = m;
             // map<id_t, map<string, set<Mapping*>>> node_mapping;
             // Get paths of tip
             set<string> paths_of_tip = cached_paths.of_node(tips[i]);
@@ -69,7 +80,6 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
             vg::id_t ref_node = -1;
 
             for (auto m : paths_of_tip){
-                cerr << m << endl;
                 Path path_of_tip = cached_paths.path(m);
                 if (m == ref_path){
                     continue;     
@@ -94,9 +104,14 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
                     }
                 }
             }
-            if (ref_node != -1){
-                ref_node_to_clip[ref_node] = n->sequence();
-            }
+            tip_ref_nodes[i] = ref_node;
+        }
+    }
+
+    map<vg::id_t, string> ref_node_to_clip;
+    for (int i = 0; i < tips.size(); i++){
+        if (tip_ref_nodes[i] != -1){
+            ref_node_to_clip[tip_ref_nodes[i]] = o_graph->get_node(tips[i])->sequence();
         }
     }
 
@@ -105,11 +120,19 @@ void Homogenizer::homogenize(vg::VG* o_graph, xg::XG* xindex, gcsa::GCSA* gcsa_i
     //need to remove the tips sequences first.
     //cut_tips(tips, o_graph);
 
+    // Align the clipped sequences in parallel, and keep the good alignments
+    // in the order of their reference nodes.
+    vector<pair<vg::id_t, string>> clips(ref_node_to_clip.begin(), ref_node_to_clip.end());
+    vector<Alignment> clip_alns(clips.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < clips.size(); i++){
+        clip_alns[i] = mappers[omp_get_thread_num()]->align(clips[i].second);
+    }
+
     vector<Path> new_p_vec;
-    for (auto x : ref_node_to_clip){
-        Alignment clip_aln;
-        cerr << "Length of softclip: " << x.second.size() << endl;
-        clip_aln = mapper->align(x.second);
+    for (int i = 0; i < clips.size(); i++){
+        Alignment& clip_aln = clip_alns[i];
+        cerr << "Length of softclip: " << clips[i].second.size() << endl;
         if (clip_aln.score() < 30){
             continue;
         }
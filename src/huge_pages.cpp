@@ -0,0 +1,118 @@
+#include "huge_pages.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include <sdsl/memory_management.hpp>
+
+/**
+ * \file huge_pages.cpp
+ * Implement huge page backing for loaded indexes.
+ */
+
+namespace vg {
+
+using namespace std;
+
+// Transparent huge pages are 2 MB on the platforms that have them
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+#ifdef __linux__
+#ifndef MADV_COLLAPSE
+// Only in newer kernel headers; older kernels reject it, which is fine
+#define MADV_COLLAPSE 25
+#endif
+#endif
+
+HugePageMode parse_huge_page_mode(const string& name) {
+    if (name == "off") {
+        return HugePageMode::OFF;
+    } else if (name == "transparent") {
+        return HugePageMode::TRANSPARENT;
+    } else if (name == "hugetlb") {
+        return HugePageMode::HUGETLB;
+    }
+    throw runtime_error("[vg::huge_pages] unknown huge page mode: " + name);
+}
+
+const char* huge_page_mode_name(HugePageMode mode) {
+    switch (mode) {
+    case HugePageMode::TRANSPARENT:
+        return "transparent";
+    case HugePageMode::HUGETLB:
+        return "hugetlb";
+    default:
+        return "off";
+    }
+}
+
+size_t total_file_size(const vector<string>& file_names) {
+    size_t total = 0;
+    for (auto& file_name : file_names) {
+        struct stat file_stats;
+        if (stat(file_name.c_str(), &file_stats) == 0) {
+            total += file_stats.st_size;
+        }
+    }
+    return total;
+}
+
+bool prepare_huge_pages(HugePageMode mode, size_t pool_bytes) {
+    if (mode != HugePageMode::HUGETLB) {
+        return true;
+    }
+    // Round up to whole pages, with some slack for the allocator's headers
+    size_t bytes = pool_bytes + pool_bytes / 16 + HUGE_PAGE_SIZE;
+    bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    try {
+        sdsl::memory_manager::use_hugepages(bytes);
+    } catch (exception& e) {
+        // The mmap of the pool fails if not enough pages are reserved
+        return false;
+    }
+    return true;
+}
+
+size_t finish_huge_pages(HugePageMode mode, size_t min_mapping_bytes) {
+    size_t advised = 0;
+#ifdef __linux__
+    if (mode != HugePageMode::TRANSPARENT) {
+        return advised;
+    }
+    // Heap arrays this big come from their own anonymous mappings
+    ifstream maps("/proc/self/maps");
+    string line;
+    while (getline(maps, line)) {
+        stringstream fields(line);
+        string range, perms, offset, device, inode, path;
+        fields >> range >> perms >> offset >> device >> inode >> path;
+        if (perms != "rw-p" || inode != "0" || !(path.empty() || path == "[heap]")) {
+            continue;
+        }
+        size_t dash = range.find('-');
+        uintptr_t start = stoull(range.substr(0, dash), nullptr, 16);
+        uintptr_t end = stoull(range.substr(dash + 1), nullptr, 16);
+        // Only whole huge pages inside the mapping can be backed
+        start = (start + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        end = end / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        if (end <= start || end - start < min_mapping_bytes) {
+            continue;
+        }
+        if (madvise((void*) start, end - start, MADV_HUGEPAGE) == 0) {
+            advised += end - start;
+            // Without this, khugepaged gets to the pages in its own time
+            madvise((void*) start, end - start, MADV_COLLAPSE);
+        }
+    }
+#endif
+    return advised;
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef VG_HUGE_PAGES_HPP_INCLUDED
+#define VG_HUGE_PAGES_HPP_INCLUDED
+
+/**
+ * \file huge_pages.hpp
+ *
+ * Back the big, randomly accessed index arrays of the mappers with huge pages,
+ * to cut down on TLB misses in MEM finding and XG queries.
+ */
+
+#include <string>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/// How the index arrays loaded for mapping are backed
+enum class HugePageMode {
+    /// Normal pages, or whatever the system's transparent huge page setting gives
+    OFF = 0,
+    /// Ask the kernel to use transparent huge pages for the loaded indexes
+    TRANSPARENT,
+    /// Allocate SDSL vectors out of a pool of reserved hugetlbfs pages
+    HUGETLB
+};
+
+/// Parse a mode name ("off", "transparent" or "hugetlb"). Throws a
+/// runtime_error on anything else.
+HugePageMode parse_huge_page_mode(const string& name);
+
+/// Get the name of a mode.
+const char* huge_page_mode_name(HugePageMode mode);
+
+/// Get the total size in bytes of the given files, skipping any that don't
+/// exist, for sizing a huge page pool.
+size_t total_file_size(const vector<string>& file_names);
+
+/// Get ready to load indexes in the given mode. For HUGETLB, this sets aside
+/// a pool of at least the given number of bytes of reserved huge pages, and
+/// makes SDSL allocate its vectors from it from now on; the pages must have
+/// been reserved by the administrator (vm.nr_hugepages). Does nothing for the
+/// other modes. Returns false if the pool could not be set up.
+bool prepare_huge_pages(HugePageMode mode, size_t pool_bytes);
+
+/// Finish up after the indexes are loaded. For TRANSPARENT, this advises the
+/// kernel to back every anonymous mapping of at least min_mapping_bytes (where
+/// the large arrays live) with transparent huge pages, and collapses them
+/// right away if the kernel can. Does nothing for the other modes. Returns the
+/// number of bytes advised.
+size_t finish_huge_pages(HugePageMode mode, size_t min_mapping_bytes = 64 * 1024 * 1024);
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "id_remapper.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include "stream.hpp"
+#include "utility.hpp"
+#include "position.hpp"
+
+/**
+ * \file id_remapper.cpp
+ * Implement two-pass streaming node renumbering.
+ */
+
+namespace vg {
+
+using namespace std;
+
+void IDRemapper::scan(istream& in) {
+    // Collect the IDs in the order they appear
+    vector<id_t> order;
+    id_t min_id = numeric_limits<id_t>::max();
+    id_t max_id = 0;
+    function<void(Graph&)> lambda = [&](Graph& chunk) {
+        for (auto& node : chunk.node()) {
+            order.push_back(node.id());
+            min_id = min(min_id, node.id());
+            max_id = max(max_id, node.id());
+        }
+    };
+    stream::for_each(in, lambda);
+
+    GraphIDs ids;
+    ids.offset = (join && !graphs.empty()) ? graphs.back().new_max_id : increment;
+    if (order.empty()) {
+        // Nothing to renumber
+        ids.new_max_id = ids.offset;
+    } else if (compact) {
+        ids.min_id = min_id;
+        ids.ranks.resize(max_id - min_id + 1, 0);
+        id_t next_rank = 1;
+        for (id_t id : order) {
+            id_t& rank = ids.ranks[id - min_id];
+            if (rank == 0) {
+                // Repeated nodes keep their first rank
+                rank = next_rank++;
+            }
+        }
+        ids.new_max_id = ids.offset + next_rank - 1;
+    } else {
+        ids.min_id = min_id;
+        ids.new_max_id = max_id + ids.offset;
+    }
+    graphs.push_back(std::move(ids));
+}
+
+id_t IDRemapper::translate(size_t graph_number, id_t id) const {
+    auto& ids = graphs.at(graph_number);
+    if (!compact) {
+        return id + ids.offset;
+    }
+    if (id < ids.min_id || id - ids.min_id >= (id_t) ids.ranks.size() || ids.ranks[id - ids.min_id] == 0) {
+        return 0;
+    }
+    return ids.ranks[id - ids.min_id] + ids.offset;
+}
+
+id_t IDRemapper::max_id() const {
+    id_t max_id = 0;
+    for (auto& ids : graphs) {
+        max_id = max(max_id, ids.new_max_id);
+    }
+    return max_id;
+}
+
+size_t IDRemapper::graph_count() const {
+    return graphs.size();
+}
+
+void IDRemapper::rewrite_chunk(size_t graph_number, Graph& chunk, vector<Translation>* translations) const {
+    for (auto& node : *chunk.mutable_node()) {
+        id_t new_id = translate(graph_number, node.id());
+        if (translations != nullptr) {
+            // Say where the whole node went, in the format VG::edit() uses
+            translations->emplace_back();
+            Translation& translation = translations->back();
+            Mapping* from_mapping = translation.mutable_from()->add_mapping();
+            *from_mapping->mutable_position() = make_position(node.id(), false, 0);
+            Edit* from_edit = from_mapping->add_edit();
+            from_edit->set_from_length(node.sequence().size());
+            from_edit->set_to_length(node.sequence().size());
+            Mapping* to_mapping = translation.mutable_to()->add_mapping();
+            *to_mapping->mutable_position() = make_position(new_id, false, 0);
+            *to_mapping->add_edit() = *from_edit;
+        }
+        node.set_id(new_id);
+    }
+    for (auto& edge : *chunk.mutable_edge()) {
+        edge.set_from(translate(graph_number, edge.from()));
+        edge.set_to(translate(graph_number, edge.to()));
+    }
+    for (auto& path : *chunk.mutable_path()) {
+        for (auto& mapping : *path.mutable_mapping()) {
+            mapping.mutable_position()->set_node_id(translate(graph_number, mapping.position().node_id()));
+        }
+    }
+}
+
+void IDRemapper::rewrite(size_t graph_number, istream& in, ostream& out, ostream* translation_out) const {
+    // Read a chunk per thread, rewrite them all at once, and write them back
+    // out in the order they came in.
+    size_t batch_size = get_thread_count();
+    vector<Graph> batch;
+    vector<vector<Translation>> translations;
+
+    auto flush = [&]() {
+        translations.resize(batch.size());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch.size(); i++) {
+            rewrite_chunk(graph_number, batch[i], translation_out == nullptr ? nullptr : &translations[i]);
+        }
+        stream::write_buffered(out, batch, 0);
+        if (translation_out != nullptr) {
+            for (auto& chunk_translations : translations) {
+                if (!chunk_translations.empty()) {
+                    stream::write_buffered(*translation_out, chunk_translations, 0);
+                }
+            }
+        }
+        translations.clear();
+    };
+
+    function<void(Graph&)> lambda = [&](Graph& chunk) {
+        batch.emplace_back(std::move(chunk));
+        if (batch.size() >= batch_size) {
+            flush();
+        }
+    };
+    stream::for_each(in, lambda);
+    if (!batch.empty()) {
+        flush();
+    }
+}
+
+}
@@ -0,0 +1,89 @@
+#ifndef VG_ID_REMAPPER_HPP_INCLUDED
+#define VG_ID_REMAPPER_HPP_INCLUDED
+
+/**
+ * \file id_remapper.hpp
+ *
+ * Renumber the nodes of .vg graph streams without loading them as VGs.
+ */
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Renumbers node IDs in one or more .vg streams in two passes. First each
+ * graph is scanned, in order, to find the IDs it uses, and its new IDs are
+ * planned. Then each graph is streamed through again and its chunks are
+ * rewritten on all threads, with each ID looked up in a dense array (when
+ * compacting) or just shifted.
+ *
+ * Compacted IDs are handed out from 1 in the order nodes appear, like
+ * VG::compact_ids(). Joined graphs each start after the largest ID of the
+ * graph before, like VGset::merge_id_space() used to do.
+ */
+class IDRemapper {
+public:
+    /// Number each graph's nodes 1 to n, in order of appearance, instead of
+    /// keeping their IDs.
+    bool compact = false;
+
+    /// Put each graph's new IDs after the largest new ID of the graph before.
+    bool join = false;
+
+    /// Shift the first graph's new IDs (or every graph's, when not joining) by
+    /// this much. May be negative.
+    int64_t increment = 0;
+
+    /// Scan the next graph and plan its new IDs. Graphs are numbered from 0 in
+    /// the order they are scanned. Settings must not change once a graph has
+    /// been scanned.
+    void scan(istream& in);
+
+    /// Stream through the given graph again, writing it to out with its new
+    /// IDs. If translation_out is set, write a stream of Translations from old
+    /// to new nodes to it as well, one per node, for updating alignments.
+    void rewrite(size_t graph_number, istream& in, ostream& out, ostream* translation_out = nullptr) const;
+
+    /// Get the new ID for an old ID in the given graph. When compacting, IDs
+    /// the graph has no node for get 0.
+    id_t translate(size_t graph_number, id_t id) const;
+
+    /// Get the largest new ID over all the graphs scanned so far.
+    id_t max_id() const;
+
+    /// Get the number of graphs scanned so far.
+    size_t graph_count() const;
+
+private:
+
+    /// What we know about one scanned graph
+    struct GraphIDs {
+        /// Smallest ID used in the graph
+        id_t min_id = 0;
+        /// Added to an old ID (or compacted rank) to get its new ID
+        int64_t offset = 0;
+        /// When compacting, the 1-based rank of each ID from min_id up, or 0
+        /// if the graph has no such node.
+        vector<id_t> ranks;
+        /// Largest new ID in the graph
+        id_t new_max_id = 0;
+    };
+
+    vector<GraphIDs> graphs;
+
+    /// Rewrite the IDs in one chunk of the given graph, in place, filling in
+    /// translations for its nodes if asked.
+    void rewrite_chunk(size_t graph_number, Graph& chunk, vector<Translation>* translations) const;
+};
+
+}
+
+#endif
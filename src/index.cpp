@@ -1,4 +1,8 @@
 #include "index.hpp"
+#include "utility.hpp"
+
+#include <fstream>
+#include <memory>
 
 namespace vg {
 
@@ -7,6 +11,49 @@ using namespace std;
 // convenience macro for RocksDB error handling
 #define S(x) { rocksdb::Status __s = (x); if (!__s.ok()) throw std::runtime_error("RocksDB operation failed: " + __s.ToString()); }
 
+namespace {
+
+/// Length of the prefix shared by the keys of one entity: the separated key
+/// type byte and the big-endian ID it is keyed on
+const size_t ENTITY_PREFIX_LENGTH = 3 + sizeof(int64_t);
+
+/// Extracts the entity prefix of the keys that are looked up by ID, so that
+/// RocksDB can keep bloom filters on them and skip files and memtable entries
+/// that have nothing for a node or path. Kmer and metadata keys have no fixed
+/// ID and are left out of the domain.
+class EntityPrefixTransform : public rocksdb::SliceTransform {
+public:
+    const char* Name() const {
+        // RocksDB records this in each table, and only uses prefix filters
+        // from tables made with the same transform
+        return "vg.EntityPrefixTransform.1";
+    }
+    rocksdb::Slice Transform(const rocksdb::Slice& key) const {
+        return rocksdb::Slice(key.data(), ENTITY_PREFIX_LENGTH);
+    }
+    bool InDomain(const rocksdb::Slice& key) const {
+        if (key.size() < ENTITY_PREFIX_LENGTH) {
+            return false;
+        }
+        switch (key[1]) {
+        case 'g': // graph elements, by node
+        case 'p': // path positions, by path
+        case 's': // mappings, by node
+        case 'a': // alignments, by lowest node
+        case 'b': // base alignments, by alignment
+        case 't': // traversals, by node
+            return true;
+        default:
+            return false;
+        }
+    }
+    bool InRange(const rocksdb::Slice& dst) const {
+        return dst.size() == ENTITY_PREFIX_LENGTH;
+    }
+};
+
+}
+
 Index::Index(void) {
 
     start_sep = '\x00';
@@ -24,6 +71,8 @@ Index::Index(void) {
         threads = omp_get_num_threads();
     }
 
+    staged.resize(omp_get_max_threads());
+    staged_bytes.resize(omp_get_max_threads(), 0);
 }
 
 rocksdb::Options Index::GetOptions(bool read_only) {
@@ -50,8 +99,16 @@ rocksdb::Options Index::GetOptions(bool read_only) {
     topt.format_version = 2;
     topt.block_size = 4 << 20;
     topt.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+    // keep whole-key filters for point lookups of nodes, edges and metadata,
+    // and add prefix filters for the scans over one node's entries
+    topt.whole_key_filtering = true;
     topt.block_cache = rocksdb::NewLRUCache(block_cache_bytes);
     options.table_factory.reset(NewBlockBasedTableFactory(topt));
+    // Indexes made before this have no prefix filters in their tables, which
+    // RocksDB notices and reads them as before. Compacting them (vg index -C)
+    // rewrites their tables with the filters.
+    options.prefix_extractor.reset(new EntityPrefixTransform());
+    options.memtable_prefix_bloom_size_ratio = 0.02;
 
     // set up concurrency
     options.IncreaseParallelism(threads);
@@ -799,7 +856,9 @@ string Index::traversal_entry_to_string(const string& key, const string& value)
 }
 
 void Index::dump(ostream& out) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = true;
+    rocksdb::Iterator* it = db->NewIterator(read_options);
     for (it->SeekToFirst(); it->Valid(); it->Next()) {
         out << entry_to_string(it->key().ToString(), it->value().ToString()) << endl;
     }
@@ -938,6 +997,234 @@ void Index::cross_alignment(int64_t aln_id, const Alignment& alignment) {
     }
 }
 
+namespace {
+
+/// How many entries of a staged run go by between samples
+const size_t STAGED_SAMPLE_INTERVAL = 1024;
+
+void write_staged_string(ostream& out, const string& s) {
+    uint32_t length = s.size();
+    out.write((const char*) &length, sizeof(length));
+    out.write(s.data(), s.size());
+}
+
+bool read_staged_string(istream& in, string& s) {
+    uint32_t length;
+    if (!in.read((char*) &length, sizeof(length))) {
+        return false;
+    }
+    s.resize(length);
+    return (bool) in.read(&s[0], length);
+}
+
+/// Reads the entries of a staged run in order
+struct StagedRunReader {
+    ifstream in;
+    string key;
+    string value;
+
+    /// Read the next entry, returning false at the end of the run
+    bool next() {
+        if (!read_staged_string(in, key)) {
+            return false;
+        }
+        if (!read_staged_string(in, value)) {
+            throw runtime_error("[Index::ingest_staged] staged run is truncated");
+        }
+        return true;
+    }
+};
+
+}
+
+void Index::stage(const string& key, const string& value) {
+    int tid = omp_get_thread_num();
+    if (tid >= staged.size()) {
+        throw runtime_error("[Index::stage] called from more threads than the index was made for");
+    }
+    staged[tid].emplace_back(key, value);
+    staged_bytes[tid] += key.size() + value.size() + 2 * sizeof(string);
+    if (staged_bytes[tid] >= max<size_t>(1, staging_memory / staged.size())) {
+        spill_staged(staged[tid]);
+        staged_bytes[tid] = 0;
+    }
+}
+
+void Index::stage_alignment(const Alignment& alignment) {
+    string data;
+    alignment.SerializeToString(&data);
+    stage(key_for_alignment(alignment), data);
+}
+
+void Index::stage_cross_alignment(int64_t aln_id, const Alignment& alignment) {
+    string data;
+    alignment.SerializeToString(&data);
+    stage(key_for_base(aln_id), data);
+    if (alignment.has_path()) {
+        auto& path = alignment.path();
+        for (int i = 0; i < path.mapping_size(); ++i) {
+            stage(key_for_traversal(aln_id, path.mapping(i)), "");
+        }
+    }
+}
+
+void Index::spill_staged(vector<pair<string, string>>& entries) {
+    // stable, so that of entries with the same key the first staged is kept
+    stable_sort(entries.begin(), entries.end(), [](const pair<string, string>& a, const pair<string, string>& b) {
+        return a.first < b.first;
+    });
+
+    StagedRun run;
+#pragma omp critical (index_staging)
+    run.filename = temp_file::create("index-staged");
+
+    ofstream out(run.filename, ios::binary);
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (i % STAGED_SAMPLE_INTERVAL == 0) {
+            run.samples.emplace_back(entries[i].first, (uint64_t) out.tellp());
+        }
+        write_staged_string(out, entries[i].first);
+        write_staged_string(out, entries[i].second);
+    }
+    out.close();
+    if (!out) {
+        throw runtime_error("[Index::spill_staged] could not write staged run " + run.filename);
+    }
+    entries.clear();
+
+#pragma omp critical (index_staging)
+    staged_runs.push_back(std::move(run));
+}
+
+bool Index::write_staged_sst(const string& lower, const string& upper, const string& sst_filename) {
+
+    vector<unique_ptr<StagedRunReader>> readers;
+    // a min-heap of the next entry of each run, with ties going to the earlier run
+    vector<size_t> heap;
+    auto heap_order = [&](size_t a, size_t b) {
+        return readers[a]->key != readers[b]->key ? readers[a]->key > readers[b]->key : a > b;
+    };
+
+    for (auto& run : staged_runs) {
+        readers.emplace_back(new StagedRunReader());
+        StagedRunReader& reader = *readers.back();
+        reader.in.open(run.filename, ios::binary);
+        if (!reader.in) {
+            throw runtime_error("[Index::ingest_staged] could not open staged run " + run.filename);
+        }
+        // start from the last sample before the range
+        auto sample = lower_bound(run.samples.begin(), run.samples.end(), make_pair(lower, (uint64_t) 0));
+        if (sample != run.samples.begin()) {
+            --sample;
+            reader.in.seekg(sample->second);
+        }
+        bool has_next;
+        while ((has_next = reader.next()) && reader.key < lower) {
+            // skip up to the range
+        }
+        if (has_next && (upper.empty() || reader.key < upper)) {
+            heap.push_back(readers.size() - 1);
+            push_heap(heap.begin(), heap.end(), heap_order);
+        }
+    }
+
+    if (heap.empty()) {
+        return false;
+    }
+
+    rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), db_options);
+    S(writer.Open(sst_filename));
+    string last_key;
+    bool wrote = false;
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), heap_order);
+        size_t run = heap.back();
+        heap.pop_back();
+
+        StagedRunReader& reader = *readers[run];
+        // keys must increase strictly in an SST, and a repeated key is the same entry
+        if (!wrote || reader.key != last_key) {
+            S(writer.Put(reader.key, reader.value));
+            last_key = reader.key;
+            wrote = true;
+        }
+
+        if (reader.next() && (upper.empty() || reader.key < upper)) {
+            heap.push_back(run);
+            push_heap(heap.begin(), heap.end(), heap_order);
+        }
+    }
+    S(writer.Finish());
+    return true;
+}
+
+void Index::ingest_staged(void) {
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < staged.size(); i++) {
+        if (!staged[i].empty()) {
+            spill_staged(staged[i]);
+            staged_bytes[i] = 0;
+        }
+    }
+
+    if (staged_runs.empty()) {
+        return;
+    }
+
+    // split the key space at sampled keys into ranges of about the same size,
+    // each of which becomes its own SST
+    vector<string> sampled_keys;
+    for (auto& run : staged_runs) {
+        for (auto& sample : run.samples) {
+            sampled_keys.push_back(sample.first);
+        }
+    }
+    sort(sampled_keys.begin(), sampled_keys.end());
+    size_t partitions = min<size_t>(max(threads, 1) * 4, sampled_keys.size());
+    vector<string> bounds(1, "");
+    for (size_t i = 1; i < partitions; i++) {
+        const string& bound = sampled_keys[i * sampled_keys.size() / partitions];
+        if (bound != bounds.back()) {
+            bounds.push_back(bound);
+        }
+    }
+    // the last range runs to the end
+    bounds.push_back("");
+
+    vector<string> sst_filenames(bounds.size() - 1);
+    vector<char> sst_written(bounds.size() - 1, false);
+    for (auto& sst_filename : sst_filenames) {
+        sst_filename = temp_file::create("index-ingest");
+    }
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < sst_filenames.size(); i++) {
+        sst_written[i] = write_staged_sst(bounds[i], bounds[i + 1], sst_filenames[i]);
+    }
+
+    // the ranges are disjoint and in order, so the files can go in together
+    vector<string> to_ingest;
+    for (size_t i = 0; i < sst_filenames.size(); i++) {
+        if (sst_written[i]) {
+            to_ingest.push_back(sst_filenames[i]);
+        }
+    }
+    if (!to_ingest.empty()) {
+        rocksdb::IngestExternalFileOptions ingest_options;
+        ingest_options.move_files = true;
+        S(db->IngestExternalFile(to_ingest, ingest_options));
+    }
+
+    for (auto& sst_filename : sst_filenames) {
+        temp_file::remove(sst_filename);
+    }
+    for (auto& run : staged_runs) {
+        temp_file::remove(run.filename);
+    }
+    staged_runs.clear();
+}
+
 void Index::load_graph(VG& graph) {
     // a bit of a hack--- the logging only works with for_each_*parallel
     // also the high parallelism may be causing issues
@@ -1517,7 +1804,9 @@ map<string, int64_t> Index::paths_by_id(void) {
 pair<int64_t, bool> Index::path_first_node(int64_t path_id) {
     string k = key_for_path_position(path_id, 0, false, 0);
     k = k.substr(0, 4 + sizeof(int64_t));
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = true;
+    rocksdb::Iterator* it = db->NewIterator(read_options);
     rocksdb::Slice start = rocksdb::Slice(k);
     rocksdb::Slice end = rocksdb::Slice(k+end_sep);
     int64_t node_id = 0;
@@ -1537,7 +1826,9 @@ pair<int64_t, bool> Index::path_last_node(int64_t path_id, int64_t& path_length)
     // we aim to seek to the first item in the next path, then step back
     string key_start = key_for_path_position(path_id, 0, false, 0);
     string key_end = key_for_path_position(path_id+1, 0, false, 0);
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = true;
+    rocksdb::Iterator* it = db->NewIterator(read_options);
     //rocksdb::Slice start = rocksdb::Slice(key_start);
     rocksdb::Slice end = rocksdb::Slice(key_end);
     int64_t node_id = 0;
@@ -1633,11 +1924,11 @@ void Index::get_connected_nodes(VG& graph) {
 }
 
 void Index::get_context(int64_t id, VG& graph) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_for_node(id).substr(0,3+sizeof(int64_t));
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
     rocksdb::Slice end = rocksdb::Slice(key_end);
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(key_start, key_end));
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
          it->Next()) {
@@ -1810,11 +2101,11 @@ void Index::get_edges_of(int64_t node, vector<Edge>& edges) {
 }
 
 void Index::get_edges_on_start(int64_t node_id, vector<Edge>& edges) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_prefix_for_edges_on_node_start(node_id);
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
     rocksdb::Slice end = rocksdb::Slice(key_end);
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(key_start, key_end));
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
          it->Next()) {
@@ -1867,11 +2158,11 @@ void Index::get_edges_on_start(int64_t node_id, vector<Edge>& edges) {
 }
 
 void Index::get_edges_on_end(int64_t node_id, vector<Edge>& edges) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_prefix_for_edges_on_node_end(node_id);
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
     rocksdb::Slice end = rocksdb::Slice(key_end);
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(key_start, key_end));
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
          it->Next()) {
@@ -2057,9 +2348,23 @@ void Index::for_all(std::function<void(string&, string&)> lambda) {
     for_range(start, end, lambda);
 }
 
+rocksdb::ReadOptions Index::read_options_for_range(const string& key_start, const string& key_end) {
+    rocksdb::ReadOptions read_options;
+    const rocksdb::SliceTransform* prefix = db_options.prefix_extractor.get();
+    if (prefix != nullptr && prefix->InDomain(key_start) && prefix->InDomain(key_end)
+        && prefix->Transform(key_start) == prefix->Transform(key_end)) {
+        // every key in the range has the same prefix, so the prefix filters apply
+        read_options.prefix_same_as_start = true;
+    } else {
+        // the range crosses prefixes, so the iterator has to see every key in order
+        read_options.total_order_seek = true;
+    }
+    return read_options;
+}
+
 void Index::for_range(string& key_start, string& key_end,
                       std::function<void(string&, string&)> lambda) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(key_start, key_end));
     rocksdb::Slice start = rocksdb::Slice(key_start);
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
@@ -16,6 +16,7 @@
 #include "rocksdb/slice_transform.h"
 #include "rocksdb/table.h"
 #include "rocksdb/filter_policy.h"
+#include "rocksdb/sst_file_writer.h"
 
 #include "json2pb.h"
 #include "vg.hpp"
@@ -119,6 +120,9 @@ public:
     void for_all(std::function<void(string&, string&)> lambda);
     void for_range(string& key_start, string& key_end,
                    std::function<void(string&, string&)> lambda);
+    // Get read options for iterating from key_start up to key_end, which use
+    // the prefix filters when the whole range shares one entity prefix.
+    rocksdb::ReadOptions read_options_for_range(const string& key_start, const string& key_end);
 
     void put_node(const Node* node);
     void put_edge(const Edge* edge);
@@ -146,6 +150,17 @@ public:
     // cross-index alignment by aln_id and record its traversals
     void cross_alignment(int64_t aln_id, const Alignment& alignment);
 
+    // Bulk loading: stage entries instead of putting them, then sort them
+    // externally and ingest them as SST files, which skips the memtable and
+    // compaction. Staging is safe to call from several threads.
+    void stage(const string& key, const string& value);
+    void stage_alignment(const Alignment& alignment);
+    void stage_cross_alignment(int64_t aln_id, const Alignment& alignment);
+    // Write everything staged so far into the index and forget it.
+    void ingest_staged(void);
+    // Approximate bytes of staged entries held in memory, across all threads
+    size_t staging_memory = 1024 * 1024 * 1024;
+
     rocksdb::Status get_node(int64_t id, Node& node);
     // Takes the nodes and orientations and gets the Edge object with any associated edge data.
     rocksdb::Status get_edge(int64_t from, bool from_start, int64_t to, bool to_end, Edge& edge);
@@ -331,6 +346,25 @@ public:
     // what table is the key in
     char graph_key_type(const string& key);
 
+private:
+
+    // A sorted run of staged entries in a temp file, with the key and file
+    // offset of every so many entries, so that merging can start partway in
+    struct StagedRun {
+        string filename;
+        vector<pair<string, uint64_t>> samples;
+    };
+
+    // sort a thread's staged entries and write them out as a run
+    void spill_staged(vector<pair<string, string>>& entries);
+    // merge the runs' entries from lower (inclusive) up to upper (exclusive,
+    // or the end if empty) into a new SST file, returning false if there were none
+    bool write_staged_sst(const string& lower, const string& upper, const string& sst_filename);
+
+    vector<vector<pair<string, string>>> staged;
+    vector<size_t> staged_bytes;
+    vector<StagedRun> staged_runs;
+
 };
 
 class indexOpenException: public exception
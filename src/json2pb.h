@@ -16,6 +16,8 @@
 
 #include <string>
 #include <cstdio>
+#include <cctype>
+#include <stdexcept>
 #include <functional>
 #include <vector>
 #include <stream.hpp>
@@ -32,6 +34,16 @@ void json2pb(google::protobuf::Message &msg, FILE* file);
 void json2pb(google::protobuf::Message &msg, const char *buf, size_t size);
 std::string pb2json(const google::protobuf::Message &msg);
 
+// Parse a batch of JSON texts into objects of the same index, on all OMP
+// threads. Throws the first parse error, if any.
+template <class T>
+void json2pb_parallel(std::vector<T>& objects, const std::vector<std::string>& texts);
+
+// Convert a batch of objects to JSON on all OMP threads, and write them to
+// out in order, one per line.
+template <class T>
+void write_json_parallel(std::ostream& out, const std::vector<T>& objects);
+
 // It's handy to be able to stream in JSON via vg view for testing.
 // This helper class takes this functionality from vg view -J and
 // makes it more generic, so it can be used for other types than Graph.
@@ -47,8 +59,14 @@ public:
     std::function<bool(T&)> get_read_fn();
     // read json stream (using above fn), and directly write to out in either
     // protobuf or json format. 
+    // Records are split out of the stream on this thread, but parsed (and
+    // converted back to JSON) a buffer at a time on all OMP threads.
     int64_t write(std::ostream& out, bool json_out = false, int64_t buf_size = 1000);
 private:
+    // read the text of the next JSON object from the stream, without parsing
+    // it. Returns false at the end of the stream.
+    bool read_record(std::string& text);
+
     FILE* _fp;
 };
 
@@ -107,29 +125,78 @@ inline std::function<bool(T&)> JSONStreamHelper<T>::get_read_fn() {
     };
 }
 
+template <class T>
+inline bool JSONStreamHelper<T>::read_record(std::string& text) {
+    text.clear();
+    
+    // Skip whitespace between records
+    int c;
+    do {
+        c = getc_unlocked(_fp);
+        if (c == EOF) {
+            return false;
+        }
+    } while (isspace(c));
+    
+    if (c != '{') {
+        throw std::runtime_error("Malformed JSON: not an object");
+    }
+    
+    // Copy out characters until the brackets balance, ignoring any in strings
+    size_t depth = 0;
+    bool in_string = false;
+    bool escaped = false;
+    while (true) {
+        text.push_back((char) c);
+        if (in_string) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                in_string = false;
+            }
+        } else if (c == '"') {
+            in_string = true;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            depth--;
+            if (depth == 0) {
+                return true;
+            }
+        }
+        
+        c = getc_unlocked(_fp);
+        if (c == EOF) {
+            throw std::runtime_error("Load failed: JSON object is cut off");
+        }
+    }
+}
+
 template<class T>
 inline int64_t JSONStreamHelper<T>::write(std::ostream& out, bool json_out,
-                                          int64_t buf_size) {    
-    std::function<bool(T&)> reader = get_read_fn();        
+                                          int64_t buf_size) {
+    std::vector<std::string> texts;
     std::vector<T> buf;
     int64_t total = 0;
     bool good = true;
     std::function<T(uint64_t)> lambda = [&](uint64_t i) -> T {return buf[i];};
     while (good) {
-        T obj;
-        good = reader(obj);
-        if (good) {
-            buf.push_back(obj);
+        texts.emplace_back();
+        good = read_record(texts.back());
+        if (!good) {
+            texts.pop_back();
         }
-        if (!good || buf.size() >= buf_size) {
+        if (!good || texts.size() >= buf_size) {
+            json2pb_parallel(buf, texts);
             if (!json_out) {
                 stream::write(out, buf.size(), lambda);
             } else {
-                for (int i = 0; i < buf.size(); ++i) {
-                    out << pb2json(buf[i]);
-                }
+                write_json_parallel(out, buf);
             }
             total += buf.size();
+            texts.clear();
             buf.clear();
         }
     }
@@ -137,5 +204,54 @@ inline int64_t JSONStreamHelper<T>::write(std::ostream& out, bool json_out,
     return total;
 }
 
+template <class T>
+void json2pb_parallel(std::vector<T>& objects, const std::vector<std::string>& texts) {
+    objects.clear();
+    objects.resize(texts.size());
+    // Exceptions can't leave an OMP loop, so keep the first one for later
+    std::string error;
+#pragma omp parallel for schedule(dynamic, 16)
+    for (size_t i = 0; i < texts.size(); ++i) {
+        try {
+            json2pb(objects[i], texts[i]);
+        } catch (const std::exception& e) {
+#pragma omp critical (json2pb_parallel_error)
+            {
+                if (error.empty()) {
+                    error = e.what();
+                }
+            }
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+template <class T>
+void write_json_parallel(std::ostream& out, const std::vector<T>& objects) {
+    std::vector<std::string> json(objects.size());
+    std::string error;
+#pragma omp parallel for schedule(dynamic, 16)
+    for (size_t i = 0; i < objects.size(); ++i) {
+        try {
+            json[i] = pb2json(objects[i]);
+        } catch (const std::exception& e) {
+#pragma omp critical (write_json_parallel_error)
+            {
+                if (error.empty()) {
+                    error = e.what();
+                }
+            }
+        }
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    for (auto& line : json) {
+        out << line << "\n";
+    }
+}
+
 
 #endif//VG_JSON2PB_H_INCLUDED
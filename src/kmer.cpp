@@ -1,173 +1,198 @@
 #include "kmer.hpp"
 
+#include <algorithm>
+#include <tuple>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+#include "utility.hpp"
+
 namespace vg {
 
 void for_each_kmer(const HandleGraph& graph, size_t k,
                    const function<void(const kmer_t&)>& lambda,
                    id_t head_id, id_t tail_id) {
     // for each position on the forward and reverse of the graph
-    // TODO -- add parallel interface in handlegraph
     bool using_head_tail = head_id + tail_id > 0;
+    // The number of kmers starting on a strand grows with the branching just
+    // past it, so strands in dense regions are the long-running work items.
+    // Give them out first, one strand at a time, so that a tangle found late
+    // doesn't leave one thread working through it alone.
+    vector<pair<size_t, handle_t>> work;
     graph.for_each_handle([&](const handle_t& h) {
-            // for the forward and reverse of this handle
-            // walk k bases from the end, so that any kmer starting on the node will be represented in the tree we build
-            for (auto handle_is_rev : { false, true }) {
-                //cerr << "###########################################" << endl;
-                handle_t handle = handle_is_rev ? graph.flip(h) : h;
-                list<kmer_t> kmers;
-                // for each position in the node, set up a kmer with that start position and the node end or kmer length as the end position
-                // determine next positions
-                id_t handle_id = graph.get_id(handle);
-                size_t handle_length = graph.get_length(handle);
-                string handle_seq = graph.get_sequence(handle);
-                for (size_t i = 0; i < handle_length;  ++i) {
-                    pos_t begin = make_pos_t(handle_id, handle_is_rev, i);
-                    pos_t end = make_pos_t(handle_id, handle_is_rev, min(handle_length, i+k));
-                    kmer_t kmer = kmer_t(handle_seq.substr(offset(begin), offset(end)-offset(begin)), begin, end, handle);
-                    // determine previous context
-                    // if we are running with head/tail nodes, we'll need to do some trickery to eliminate the reverse complement versions of both
-                    if (i == 0) {
-                        // look at the previous nodes
-                        graph.follow_edges(handle, true, [&](const handle_t& prev) {
-                                size_t prev_length = graph.get_length(prev);
-                                kmer.prev_pos.emplace_back(graph.get_id(prev), graph.get_is_reverse(prev), prev_length-1);
-                                kmer.prev_char.emplace_back(graph.get_sequence(prev).substr(prev_length-1, 1)[0]);
+            for (auto handle : { h, graph.flip(h) }) {
+                size_t branching = 1;
+                graph.follow_edges(handle, false, [&](const handle_t& next) {
+                        branching++;
+                        graph.follow_edges(next, false, [&](const handle_t& after) {
+                                branching++;
                             });
-                        // if we're on the forward head or reverse tail, we need to point to the end of the opposite node
-                        if (kmer.prev_pos.empty() && using_head_tail) {
-                            if (id(begin) == head_id) {
-                                kmer.prev_pos.emplace_back(tail_id, false, 0);
-                                kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, false))[0]);
-                            } else if (id(begin) == tail_id) {
-                                kmer.prev_pos.emplace_back(head_id, true, 0);
-                                kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, true))[0]);
+                    });
+                work.emplace_back(branching, handle);
+            }
+        });
+    stable_sort(work.begin(), work.end(), [](const pair<size_t, handle_t>& a, const pair<size_t, handle_t>& b) {
+            return a.first > b.first;
+        });
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t w = 0; w < work.size(); ++w) {
+        // walk k bases from the end, so that any kmer starting on the node will be represented in the tree we build
+        handle_t handle = work[w].second;
+        bool handle_is_rev = graph.get_is_reverse(handle);
+        list<kmer_t> kmers;
+        // for each position in the node, set up a kmer with that start position and the node end or kmer length as the end position
+        // determine next positions
+        id_t handle_id = graph.get_id(handle);
+        size_t handle_length = graph.get_length(handle);
+        string handle_seq = graph.get_sequence(handle);
+        for (size_t i = 0; i < handle_length;  ++i) {
+            pos_t begin = make_pos_t(handle_id, handle_is_rev, i);
+            pos_t end = make_pos_t(handle_id, handle_is_rev, min(handle_length, i+k));
+            kmer_t kmer = kmer_t(handle_seq.substr(offset(begin), offset(end)-offset(begin)), begin, end, handle);
+            // determine previous context
+            // if we are running with head/tail nodes, we'll need to do some trickery to eliminate the reverse complement versions of both
+            if (i == 0) {
+                // look at the previous nodes
+                graph.follow_edges(handle, true, [&](const handle_t& prev) {
+                        size_t prev_length = graph.get_length(prev);
+                        kmer.prev_pos.emplace_back(graph.get_id(prev), graph.get_is_reverse(prev), prev_length-1);
+                        kmer.prev_char.emplace_back(graph.get_sequence(prev).substr(prev_length-1, 1)[0]);
+                    });
+                // if we're on the forward head or reverse tail, we need to point to the end of the opposite node
+                if (kmer.prev_pos.empty() && using_head_tail) {
+                    if (id(begin) == head_id) {
+                        kmer.prev_pos.emplace_back(tail_id, false, 0);
+                        kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, false))[0]);
+                    } else if (id(begin) == tail_id) {
+                        kmer.prev_pos.emplace_back(head_id, true, 0);
+                        kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, true))[0]);
+                    }
+                }
+            } else {
+                // the previous is in this node
+                kmer.prev_pos.emplace_back(handle_id, handle_is_rev, i-1);
+                kmer.prev_char.emplace_back(handle_seq[i-1]);
+            }
+            if (kmer.seq.size() < k) {
+                kmer.seq.reserve(k); // may reduce allocation costs
+                // follow edges if we haven't completed the kmer here
+                graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
+                        kmers.push_back(kmer);
+                        auto& todo = kmers.back();
+                        todo.curr = next;
+                    });
+            } else {
+                kmers.push_back(kmer);
+            }
+        }
+
+        // now expand the kmers until they reach k
+        while (!kmers.empty()) {
+            // first we check which ones have reached length k in the current handle; for each of these we run lambda and remove them from our list
+            auto kmers_end = kmers.end();
+            for (list<kmer_t>::iterator q = kmers.begin(); q != kmers_end; ++q) {
+                auto& kmer = *q;
+                // did we reach our target length?
+                if (kmer.seq.size() == k) {
+                    // TODO here check if we are at the beginning of the reverse head or the beginning of the forward tail and would need special handling
+                    // establish the context
+                    handle_t end_handle = graph.get_handle(id(kmer.end), is_rev(kmer.end));
+                    size_t end_length = graph.get_length(end_handle);
+                    if (offset(kmer.end) == end_length) {
+                        // have to check which nodes are next
+                        graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
+                                kmer.next_pos.emplace_back(graph.get_id(next), graph.get_is_reverse(next), 0);
+                                kmer.next_char.emplace_back(graph.get_sequence(next)[0]);
+                            });
+                        if (kmer.next_pos.empty() && using_head_tail) {
+                            if (id(kmer.begin) == head_id) {
+                                kmer.next_pos.emplace_back(tail_id, true, 0);
+                                kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, true))[0]);
+                            } else if (id(kmer.begin) == tail_id) {
+                                kmer.next_pos.emplace_back(head_id, false, 0);
+                                kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, false))[0]);
+                            }
+                            //cerr << "done head or tail" << endl;
+                        }
+                    } else {
+                        // on node
+                        kmer.next_pos.push_back(kmer.end);
+                        kmer.next_char.push_back(graph.get_sequence(end_handle)[offset(kmer.end)]);
+                    }
+                    // if we have head and tail ids set, iterate through our positions and do the flip
+                    if (using_head_tail) {
+                        // flip the beginning
+                        if (id(kmer.begin) == head_id && is_rev(kmer.begin)) {
+                            get_id(kmer.begin) = tail_id;
+                            get_is_rev(kmer.begin) = false;
+                        } else if (id(kmer.begin) == tail_id && is_rev(kmer.begin)) {
+                            get_id(kmer.begin) = head_id;
+                            get_is_rev(kmer.begin) = false;
+                        }
+                        // flip the nexts
+                        for (auto& pos : kmer.next_pos) {
+                            if (id(pos) == head_id && is_rev(pos)) {
+                                get_id(pos) = tail_id;
+                                get_is_rev(pos) = false;
+                            } else if (id(pos) == tail_id && is_rev(pos)) {
+                                get_id(pos) = head_id;
+                                get_is_rev(pos) = false;
                             }
                         }
+                        // if we aren't both from and to a head/tail node, emit
+                        /*
+                        if (!((offset(kmer.begin) == 0
+                               && id(kmer.begin) == head_id
+                               && kmer.next_pos.size() == 1
+                               && id(kmer.next_pos.front()) == tail_id)
+                              || (offset(kmer.begin) == 0
+                                  && id(kmer.begin) == tail_id
+                                  && kmer.next_pos.size() == 1
+                                  && id(kmer.next_pos.front()) == head_id))) {
+                            lambda(kmer);
+                        }
+                        */
+                        if (kmer.prev_pos.size() == 1 && kmer.next_pos.size() == 1
+                            && (offset(kmer.begin) == 0)
+                            && (id(kmer.begin) == head_id || id(kmer.begin) == tail_id)
+                            && (id(kmer.prev_pos.front()) == head_id || id(kmer.prev_pos.front()) == tail_id)
+                            && (id(kmer.next_pos.front()) == head_id || id(kmer.next_pos.front()) == tail_id)) {
+                            // skip
+                        } else {
+                            lambda(kmer);
+                        }
                     } else {
-                        // the previous is in this node
-                        kmer.prev_pos.emplace_back(handle_id, handle_is_rev, i-1);
-                        kmer.prev_char.emplace_back(handle_seq[i-1]);
+                        // now pass the kmer and its context to our callback
+                        lambda(kmer);
                     }
+                    q = kmers.erase(q);
+                } else {
+                    // do we finish in the current node?
+                    id_t curr_id = graph.get_id(kmer.curr);
+                    size_t curr_length = graph.get_length(kmer.curr);
+                    bool curr_is_rev = graph.get_is_reverse(kmer.curr);
+                    string curr_seq = graph.get_sequence(kmer.curr);
+                    size_t take = min(curr_length, k-kmer.seq.size());
+                    kmer.end = make_pos_t(curr_id, curr_is_rev, take);
+                    kmer.seq.append(curr_seq.substr(0,take));
                     if (kmer.seq.size() < k) {
-                        kmer.seq.reserve(k); // may reduce allocation costs
-                        // follow edges if we haven't completed the kmer here
+                        // if not, we need to expand through the node then follow on
                         graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
                                 kmers.push_back(kmer);
                                 auto& todo = kmers.back();
                                 todo.curr = next;
                             });
+                        q = kmers.erase(q);
                     } else {
-                        kmers.push_back(kmer);
-                    }
-                }
-
-                // now expand the kmers until they reach k
-                while (!kmers.empty()) {
-                    // first we check which ones have reached length k in the current handle; for each of these we run lambda and remove them from our list
-                    auto kmers_end = kmers.end();
-                    for (list<kmer_t>::iterator q = kmers.begin(); q != kmers_end; ++q) {
-                        auto& kmer = *q;
-                        // did we reach our target length?
-                        if (kmer.seq.size() == k) {
-                            // TODO here check if we are at the beginning of the reverse head or the beginning of the forward tail and would need special handling
-                            // establish the context
-                            handle_t end_handle = graph.get_handle(id(kmer.end), is_rev(kmer.end));
-                            size_t end_length = graph.get_length(end_handle);
-                            if (offset(kmer.end) == end_length) {
-                                // have to check which nodes are next
-                                graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
-                                        kmer.next_pos.emplace_back(graph.get_id(next), graph.get_is_reverse(next), 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(next)[0]);
-                                    });
-                                if (kmer.next_pos.empty() && using_head_tail) {
-                                    if (id(kmer.begin) == head_id) {
-                                        kmer.next_pos.emplace_back(tail_id, true, 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, true))[0]);
-                                    } else if (id(kmer.begin) == tail_id) {
-                                        kmer.next_pos.emplace_back(head_id, false, 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, false))[0]);
-                                    }
-                                    //cerr << "done head or tail" << endl;
-                                }
-                            } else {
-                                // on node
-                                kmer.next_pos.push_back(kmer.end);
-                                kmer.next_char.push_back(graph.get_sequence(end_handle)[offset(kmer.end)]);
-                            }
-                            // if we have head and tail ids set, iterate through our positions and do the flip
-                            if (using_head_tail) {
-                                // flip the beginning
-                                if (id(kmer.begin) == head_id && is_rev(kmer.begin)) {
-                                    get_id(kmer.begin) = tail_id;
-                                    get_is_rev(kmer.begin) = false;
-                                } else if (id(kmer.begin) == tail_id && is_rev(kmer.begin)) {
-                                    get_id(kmer.begin) = head_id;
-                                    get_is_rev(kmer.begin) = false;
-                                }
-                                // flip the nexts
-                                for (auto& pos : kmer.next_pos) {
-                                    if (id(pos) == head_id && is_rev(pos)) {
-                                        get_id(pos) = tail_id;
-                                        get_is_rev(pos) = false;
-                                    } else if (id(pos) == tail_id && is_rev(pos)) {
-                                        get_id(pos) = head_id;
-                                        get_is_rev(pos) = false;
-                                    }
-                                }
-                                // if we aren't both from and to a head/tail node, emit
-                                /*
-                                if (!((offset(kmer.begin) == 0
-                                       && id(kmer.begin) == head_id
-                                       && kmer.next_pos.size() == 1
-                                       && id(kmer.next_pos.front()) == tail_id)
-                                      || (offset(kmer.begin) == 0
-                                          && id(kmer.begin) == tail_id
-                                          && kmer.next_pos.size() == 1
-                                          && id(kmer.next_pos.front()) == head_id))) {
-                                    lambda(kmer);
-                                }
-                                */
-                                if (kmer.prev_pos.size() == 1 && kmer.next_pos.size() == 1
-                                    && (offset(kmer.begin) == 0)
-                                    && (id(kmer.begin) == head_id || id(kmer.begin) == tail_id)
-                                    && (id(kmer.prev_pos.front()) == head_id || id(kmer.prev_pos.front()) == tail_id)
-                                    && (id(kmer.next_pos.front()) == head_id || id(kmer.next_pos.front()) == tail_id)) {
-                                    // skip
-                                } else {
-                                    lambda(kmer);
-                                }
-                            } else {
-                                // now pass the kmer and its context to our callback
-                                lambda(kmer);
-                            }
-                            q = kmers.erase(q);
-                        } else {
-                            // do we finish in the current node?
-                            id_t curr_id = graph.get_id(kmer.curr);
-                            size_t curr_length = graph.get_length(kmer.curr);
-                            bool curr_is_rev = graph.get_is_reverse(kmer.curr);
-                            string curr_seq = graph.get_sequence(kmer.curr);
-                            size_t take = min(curr_length, k-kmer.seq.size());
-                            kmer.end = make_pos_t(curr_id, curr_is_rev, take);
-                            kmer.seq.append(curr_seq.substr(0,take));
-                            if (kmer.seq.size() < k) {
-                                // if not, we need to expand through the node then follow on
-                                graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
-                                        kmers.push_back(kmer);
-                                        auto& todo = kmers.back();
-                                        todo.curr = next;
-                                    });
-                                q = kmers.erase(q);
-                            } else {
-                                if (kmer.seq.size() > k) {
-                                    assert(kmer.seq.size() <= k);
-                                }
-                            }
+                        if (kmer.seq.size() > k) {
+                            assert(kmer.seq.size() <= k);
                         }
                     }
                 }
             }
-        }, true);
+        }
+    }
 }
 
 ostream& operator<<(ostream& out, const kmer_t& kmer) {
@@ -219,55 +244,142 @@ gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& al
     return val;
 }
 
+void dedup_gcsa_kmers(vector<gcsa::KMer>& kmers) {
+    sort(kmers.begin(), kmers.end(), [](const gcsa::KMer& a, const gcsa::KMer& b) {
+            return make_tuple(a.key, a.from, a.to) < make_tuple(b.key, b.from, b.to);
+        });
+    kmers.erase(unique(kmers.begin(), kmers.end(), [](const gcsa::KMer& a, const gcsa::KMer& b) {
+                return a.key == b.key && a.from == b.from && a.to == b.to;
+            }), kmers.end());
+}
+
+void merge_gcsa_kmers(vector<gcsa::KMer>& kmers) {
+    sort(kmers.begin(), kmers.end(), [](const gcsa::KMer& a, const gcsa::KMer& b) {
+            return make_tuple(gcsa::Key::label(a.key), a.from, a.to) < make_tuple(gcsa::Key::label(b.key), b.from, b.to);
+        });
+    size_t kept = 0;
+    for (size_t i = 0; i < kmers.size(); ++i) {
+        if (kept > 0
+            && gcsa::Key::label(kmers[kept - 1].key) == gcsa::Key::label(kmers[i].key)
+            && kmers[kept - 1].from == kmers[i].from
+            && kmers[kept - 1].to == kmers[i].to) {
+            kmers[kept - 1].key = gcsa::Key::merge(kmers[kept - 1].key, kmers[i].key);
+        } else {
+            kmers[kept++] = kmers[i];
+        }
+    }
+    kmers.resize(kept);
+}
+
+/// How many bits of label hash pick the bucket a kmer is sorted out into
+static const size_t gcsa_kmer_bucket_bits = 6;
+
+/// Pick the bucket for a kmer, so that all copies of a kmer meet in one bucket
+static inline size_t gcsa_kmer_bucket(const gcsa::KMer& kmer) {
+    // Mix the label so buckets don't just follow its last few characters
+    return (gcsa::Key::label(kmer.key) * 0x9E3779B97F4A7C15ull) >> (64 - gcsa_kmer_bucket_bits);
+}
+
 void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id) {
 
     // We need an alphabet to parse the internal string format
     const gcsa::Alphabet alpha;
-    // Each thread is going to make its own KMers, then we'll concatenate these all together at the end.
-    vector<vector<gcsa::KMer> > thread_outputs;
-#pragma omp parallel
-    {
-#pragma omp single
-        {
-            // Set up our write buffers at the given parallelism we expect
-            thread_outputs.resize(omp_get_num_threads());
+    
+    // Set up the bucket files that all the threads sort kmers out into
+    size_t bucket_count = size_t(1) << gcsa_kmer_bucket_bits;
+    vector<string> bucket_names(bucket_count);
+    vector<unique_ptr<ofstream>> bucket_files(bucket_count);
+    vector<mutex> bucket_locks(bucket_count);
+    for (size_t i = 0; i < bucket_count; ++i) {
+        bucket_names[i] = temp_file::create("vg-kmer-bucket-");
+        bucket_files[i].reset(new ofstream(bucket_names[i], ios::binary));
+        if (!*bucket_files[i]) {
+            cerr << "error: [write_gcsa_kmers()] could not open temp file " << bucket_names[i] << endl;
+            exit(EXIT_FAILURE);
         }
     }
-    // This handles the buffered writing for each thread
-    size_t buffer_limit = 1e5; // max 100k kmers per buffer
-    size_t total_bytes = 0;
-    auto handle_kmers = [&](vector<gcsa::KMer>& kmers, bool more) {
-        if (!more || kmers.size() > buffer_limit) {
-            size_t bytes_required = kmers.size() * sizeof(gcsa::KMer) + sizeof(gcsa::GraphFileHeader);
-#pragma omp critical (gcsa_kmer_out)
-            {
-                if (total_bytes + bytes_required > size_limit) {
-                    cerr << "error: [write_gcsa_kmers()] size limit exceeded" << endl;
-                    exit(EXIT_FAILURE);
-                }
-                gcsa::writeBinary(out, kmers, kmer_size);
-                total_bytes += bytes_required;
-            }
-            kmers.clear();
-        }
+    
+    // Each thread keeps a buffer per bucket, and merges it before appending
+    // it to the bucket's file
+    size_t buffer_limit = 1 << 12;
+    vector<vector<vector<gcsa::KMer>>> thread_buffers(get_thread_count(), vector<vector<gcsa::KMer>>(bucket_count));
+    auto spill = [&](size_t bucket, vector<gcsa::KMer>& kmers) {
+        merge_gcsa_kmers(kmers);
+        lock_guard<mutex> guard(bucket_locks[bucket]);
+        bucket_files[bucket]->write((const char*) kmers.data(), kmers.size() * sizeof(gcsa::KMer));
+        kmers.clear();
     };
     // Here we convert our kmer_t to gcsa::KMer
-    auto convert_kmer = [&thread_outputs, &alpha, &head_id, &tail_id, &handle_kmers](const kmer_t& kmer) {
-        // Convert this KmerPosition to several gcsa::KMers, and save them in thread_outputs
-        vector<gcsa::KMer>& thread_output = thread_outputs[omp_get_thread_num()];
-        kmer_to_gcsa_kmers(kmer, alpha, [&thread_output](const gcsa::KMer& k) { thread_output.push_back(k); });
-        // Handle kmer buffered writes, indicating we're not yet done
-        handle_kmers(thread_output, true);
+    auto convert_kmer = [&](const kmer_t& kmer) {
+        auto& buffers = thread_buffers[omp_get_thread_num()];
+        kmer_to_gcsa_kmers(kmer, alpha, [&](const gcsa::KMer& k) {
+                size_t bucket = gcsa_kmer_bucket(k);
+                buffers[bucket].push_back(k);
+                if (buffers[bucket].size() >= buffer_limit) {
+                    spill(bucket, buffers[bucket]);
+                }
+            });
     };
     // Run on each KmerPosition. This populates start_end_id, if it was 0, before calling convert_kmer.
     for_each_kmer(graph, kmer_size, convert_kmer, head_id, tail_id);
-    for(auto& thread_output : thread_outputs) {
-        // Flush our buffers
-        handle_kmers(thread_output, false);
+    
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+        for (auto& buffers : thread_buffers) {
+            if (!buffers[bucket].empty()) {
+                spill(bucket, buffers[bucket]);
+            }
+        }
+        bucket_files[bucket]->close();
+    }
+    thread_buffers.clear();
+    
+    // Now every copy of each kmer is in the same bucket, so we can merge the
+    // buckets independently
+    size_t total_bytes = 0;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+        vector<gcsa::KMer> kmers;
+        {
+            ifstream bucket_in(bucket_names[bucket], ios::binary | ios::ate);
+            size_t bucket_bytes = bucket_in.tellg();
+            kmers.resize(bucket_bytes / sizeof(gcsa::KMer));
+            bucket_in.seekg(0);
+            bucket_in.read((char*) kmers.data(), kmers.size() * sizeof(gcsa::KMer));
+        }
+        merge_gcsa_kmers(kmers);
+        if (kmers.empty()) {
+            continue;
+        }
+        size_t bytes_required = kmers.size() * sizeof(gcsa::KMer) + sizeof(gcsa::GraphFileHeader);
+#pragma omp critical (gcsa_kmer_out)
+        {
+            if (total_bytes + bytes_required > size_limit) {
+                cerr << "error: [write_gcsa_kmers()] size limit exceeded" << endl;
+                exit(EXIT_FAILURE);
+            }
+            gcsa::writeBinary(out, kmers, kmer_size);
+            total_bytes += bytes_required;
+        }
+    }
+    // temp_file isn't thread safe
+    for (auto& name : bucket_names) {
+        temp_file::remove(name);
     }
     size_limit = total_bytes;
 }
 
+size_t estimate_gcsa_temp_bytes(size_t kmer_bytes, size_t doubling_steps) {
+    // Each kmer starts out as a path. A path's label is one kmer rank per
+    // step of doubling, and it also carries its from and to nodes. The
+    // paths of the step being read and the step being written are both on
+    // disk at once.
+    size_t paths = kmer_bytes / sizeof(gcsa::KMer);
+    size_t label_words = size_t(1) << doubling_steps;
+    size_t path_bytes = 2 * sizeof(gcsa::node_type) + label_words * sizeof(uint32_t);
+    return 2 * paths * path_bytes;
+}
+
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, size_t& size_limit, id_t head_id, id_t tail_id,
                                    const string& base_file_name) {
     // open a temporary file for the kmers
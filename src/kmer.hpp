@@ -54,13 +54,32 @@ void kmer_to_gcsa_kmers(const kmer_t& kmer, const gcsa::Alphabet& alpha, const f
 /// Encode the chars into the gcsa2 byte
 gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& alpha);
 
+/// Sort a buffer of gcsa2 binary kmers and remove exact duplicates
+void dedup_gcsa_kmers(vector<gcsa::KMer>& kmers);
+
+/// Sort a buffer of gcsa2 binary kmers, and combine kmers with the same label,
+/// start and next position into one, with the union of their predecessor and
+/// successor characters. GCSA2 would otherwise merge them itself, on disk.
+void merge_gcsa_kmers(vector<gcsa::KMer>& kmers);
+
 /**
  * Write GCSA2 formatted binary KMers to the given ostream.
  * size_limit is the maximum size of the kmer file in bytes. When the function
  * returns, size_limit is the size of the kmer file in bytes.
+ *
+ * Kmers are first partitioned by label across temporary bucket files by all
+ * threads, and then each bucket is merged with merge_gcsa_kmers() in
+ * parallel, so each distinct kmer is written only once. Only the final output
+ * counts against size_limit.
  */
 void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, size_t& size_limit, id_t head_id, id_t tail_id);
 
+/// Estimate how much temporary disk GCSA2 will need to build an index from
+/// kmer files totalling kmer_bytes with the given number of doubling steps.
+/// This assumes the number of paths does not grow as they are doubled, so a
+/// graph with many complex regions will need more.
+size_t estimate_gcsa_temp_bytes(size_t kmer_bytes, size_t doubling_steps);
+
 /// Open a tempfile and write the kmers to it. The calling context should remove it
 /// with temp_file::remove().
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, size_t& size_limit, id_t head_id, id_t tail_id,
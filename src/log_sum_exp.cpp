@@ -0,0 +1,75 @@
+#include "log_sum_exp.hpp"
+#include "log_sum_exp_kernel.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * \file log_sum_exp.cpp
+ * Implement the table and the scalar kernel for sums of exponentials, and
+ * pick a kernel for the SIMD level.
+ */
+
+namespace vg {
+
+using namespace std;
+
+const double* exp_table() {
+    static const vector<double> table = []() {
+        vector<double> powers(EXP_TABLE_SIZE);
+        for (int j = 0; j < EXP_TABLE_SIZE; j++) {
+            powers[j] = exp2((double) j / EXP_TABLE_SIZE);
+        }
+        return powers;
+    }();
+    return table.data();
+}
+
+/// Compute exp(d) for EXP_MIN_ARGUMENT <= d <= 0 from the table
+static inline double table_exp(double d, const double* table) {
+    double k = floor(d * EXP_SCALE);
+    double r = d - k * EXP_UNSCALE;
+    int64_t k_int = (int64_t) k;
+    // k is negative, so this is floor division and a positive remainder
+    int64_t power = k_int >> EXP_TABLE_BITS;
+    uint64_t bits = (uint64_t) (power + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    double polynomial = 1.0 + r * (1.0 + r * (0.5 + r * (1.0 / 6.0)));
+    return table[k_int & (EXP_TABLE_SIZE - 1)] * polynomial * scale;
+}
+
+double tabulated_exp(double x) {
+    if (!(x >= EXP_MIN_ARGUMENT)) {
+        return 0.0;
+    }
+    return table_exp(x, exp_table());
+}
+
+double sum_exp(const double* values, size_t count, double shift) {
+    return sum_exp(values, count, shift, simd_level());
+}
+
+double sum_exp(const double* values, size_t count, double shift, SIMDLevel level) {
+    if (level > simd_level_supported()) {
+        throw runtime_error("error:[sum_exp] SIMD level " + simd_level_name(level) + " is not supported here");
+    }
+    const double* table = exp_table();
+    double sum = 0.0;
+    // there's no gather below AVX2, so the narrower levels use the scalar kernel
+    if (level >= SIMD_AVX2 && sum_exp_avx2(values, count, shift, table, sum)) {
+        return sum;
+    }
+    for (size_t i = 0; i < count; i++) {
+        double d = values[i] - shift;
+        if (d >= EXP_MIN_ARGUMENT) {
+            sum += table_exp(d, table);
+        }
+    }
+    return sum;
+}
+
+}
@@ -0,0 +1,94 @@
+/**
+ * \file log_sum_exp_avx2.cpp
+ *
+ * The 256-bit tabulated exp kernel. This file is compiled with -mavx2, so it
+ * must only be entered after checking that the CPU supports AVX2.
+ */
+
+#include "log_sum_exp_kernel.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace vg {
+
+#ifdef __AVX2__
+
+bool sum_exp_avx2(const double* values, size_t count, double shift, const double* table, double& sum_out) {
+    const __m256d shifts = _mm256_set1_pd(shift);
+    const __m256d min_argument = _mm256_set1_pd(EXP_MIN_ARGUMENT);
+    const __m256d scale = _mm256_set1_pd(EXP_SCALE);
+    const __m256d unscale = _mm256_set1_pd(EXP_UNSCALE);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d sixth = _mm256_set1_pd(1.0 / 6.0);
+    const __m128i index_mask = _mm_set1_epi32(EXP_TABLE_SIZE - 1);
+    const __m256i exponent_bias = _mm256_set1_epi64x(1023);
+
+    __m256d sums = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(values + i), shifts);
+        // lanes that underflow are computed at the minimum and then zeroed
+        __m256d keep = _mm256_cmp_pd(d, min_argument, _CMP_GE_OQ);
+        d = _mm256_max_pd(d, min_argument);
+
+        __m256d k = _mm256_floor_pd(_mm256_mul_pd(d, scale));
+        __m256d r = _mm256_sub_pd(d, _mm256_mul_pd(k, unscale));
+        __m128i k_int = _mm256_cvtpd_epi32(k);
+
+        __m256d powers = _mm256_i32gather_pd(table, _mm_and_si128(k_int, index_mask), 8);
+        __m256i exponents = _mm256_cvtepi32_epi64(_mm_srai_epi32(k_int, EXP_TABLE_BITS));
+        __m256d scales = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(exponents, exponent_bias), 52));
+
+        __m256d polynomial = _mm256_add_pd(half, _mm256_mul_pd(r, sixth));
+        polynomial = _mm256_add_pd(one, _mm256_mul_pd(r, polynomial));
+        polynomial = _mm256_add_pd(one, _mm256_mul_pd(r, polynomial));
+
+        __m256d exps = _mm256_mul_pd(_mm256_mul_pd(powers, polynomial), scales);
+        sums = _mm256_add_pd(sums, _mm256_and_pd(exps, keep));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sums);
+    double sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+
+    for (; i < count; i++) {
+        double d = values[i] - shift;
+        if (d >= EXP_MIN_ARGUMENT) {
+            double k = floor(d * EXP_SCALE);
+            double r = d - k * EXP_UNSCALE;
+            int64_t k_int = (int64_t) k;
+            uint64_t bits = (uint64_t) ((k_int >> EXP_TABLE_BITS) + 1023) << 52;
+            double power_scale;
+            memcpy(&power_scale, &bits, sizeof(power_scale));
+            sum += table[k_int & (EXP_TABLE_SIZE - 1)] * (1.0 + r * (1.0 + r * (0.5 + r * (1.0 / 6.0)))) * power_scale;
+        }
+    }
+
+    sum_out = sum;
+    return true;
+}
+
+bool sum_exp_avx2_available() {
+    return true;
+}
+
+#else
+
+bool sum_exp_avx2(const double* values, size_t count, double shift, const double* table, double& sum_out) {
+    return false;
+}
+
+bool sum_exp_avx2_available() {
+    return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,43 @@
+#ifndef VG_LOG_SUM_EXP_KERNEL_HPP_INCLUDED
+#define VG_LOG_SUM_EXP_KERNEL_HPP_INCLUDED
+
+/**
+ * \file log_sum_exp_kernel.hpp
+ *
+ * The constants shared by the tabulated exp kernels behind sum_exp(). The
+ * AVX2 kernel lives in its own translation unit compiled with -mavx2, so this
+ * header only declares plain functions on raw arrays.
+ *
+ * exp(x) is computed as 2^(k / TABLE_SIZE) * exp(r), where k is x scaled by
+ * TABLE_SIZE / ln 2 and rounded down, and r is the remainder, which is below
+ * ln 2 / TABLE_SIZE. The power of two is a table entry times a power of two
+ * made directly in the exponent bits, and exp(r) is a cubic whose error is
+ * below r^4 / 24, around 1e-15.
+ */
+
+#include <cstddef>
+
+namespace vg {
+
+/// log2 of the number of table entries
+static const int EXP_TABLE_BITS = 11;
+static const int EXP_TABLE_SIZE = 1 << EXP_TABLE_BITS;
+/// Below this, exponentials are no longer normal doubles
+static const double EXP_MIN_ARGUMENT = -708.0;
+/// TABLE_SIZE / ln 2 and its reciprocal
+static const double EXP_SCALE = EXP_TABLE_SIZE / 0.69314718055994530942;
+static const double EXP_UNSCALE = 0.69314718055994530942 / EXP_TABLE_SIZE;
+
+/// Get the table of 2^(j / TABLE_SIZE) for j in [0, TABLE_SIZE).
+const double* exp_table();
+
+/// Sum exp(values[i] - shift) with AVX2. Returns false, and does nothing, if
+/// this build has no AVX2 kernel.
+bool sum_exp_avx2(const double* values, size_t count, double shift, const double* table, double& sum_out);
+
+/// Return true if this build has an AVX2 kernel.
+bool sum_exp_avx2_available();
+
+}
+
+#endif
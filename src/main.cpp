@@ -13,6 +13,7 @@
 #include "version.hpp"
 #include "utility.hpp"
 #include "crash.hpp"
+#include "metrics_reporter.hpp"
 
 // New subcommand system provides all the subcommands that used to live here
 #include "subcommand/subcommand.hpp"
@@ -57,8 +58,12 @@ int main(int argc, char *argv[])
     
     auto* subcommand = vg::subcommand::Subcommand::get(argc, argv);
     if (subcommand != nullptr) {
+        // Report progress to whatever is orchestrating us, if it asked
+        MetricsReporter::start_from_environment(subcommand->get_name());
         // We found a matching subcommand, so run it
-        return (*subcommand)(argc, argv);
+        int result = (*subcommand)(argc, argv);
+        MetricsReporter::stop();
+        return result;
     } else {
         // No subcommand found
         string command = argv[1];
@@ -0,0 +1,105 @@
+#include "mapped_file.hpp"
+
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace vg {
+
+using namespace std;
+
+MappedFileBuffer::MappedFileBuffer(const string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    
+    struct stat file_stats;
+    if (fstat(fd, &file_stats) == -1 || !S_ISREG(file_stats.st_mode) || file_stats.st_size == 0) {
+        // We can only map nonempty regular files
+        close(fd);
+        return;
+    }
+    
+    length = file_stats.st_size;
+    void* result = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping holds its own reference to the file
+    close(fd);
+    
+    if (result == MAP_FAILED) {
+        length = 0;
+        return;
+    }
+    
+    mapping = (char*) result;
+    mapped = true;
+    
+    // The whole file is the get area
+    setg(mapping, mapping, mapping + length);
+}
+
+MappedFileBuffer::~MappedFileBuffer() {
+    if (mapped) {
+        munmap(mapping, length);
+    }
+}
+
+bool MappedFileBuffer::is_open() const {
+    return mapped;
+}
+
+const char* MappedFileBuffer::data() const {
+    return mapping;
+}
+
+size_t MappedFileBuffer::size() const {
+    return length;
+}
+
+MappedFileBuffer::pos_type MappedFileBuffer::seekoff(off_type off, ios_base::seekdir dir,
+                                                     ios_base::openmode which) {
+    if (!mapped || !(which & ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+    
+    off_type target;
+    switch (dir) {
+    case ios_base::beg:
+        target = off;
+        break;
+    case ios_base::cur:
+        target = (gptr() - eback()) + off;
+        break;
+    case ios_base::end:
+        target = length + off;
+        break;
+    default:
+        return pos_type(off_type(-1));
+    }
+    
+    if (target < 0 || target > (off_type) length) {
+        return pos_type(off_type(-1));
+    }
+    
+    setg(mapping, mapping + target, mapping + length);
+    return pos_type(target);
+}
+
+MappedFileBuffer::pos_type MappedFileBuffer::seekpos(pos_type pos, ios_base::openmode which) {
+    return seekoff(off_type(pos), ios_base::beg, which);
+}
+
+streamsize MappedFileBuffer::xsgetn(char* s, streamsize n) {
+    // Copy straight out of the mapping in one go instead of character by character.
+    streamsize available = egptr() - gptr();
+    streamsize to_copy = min(n, available);
+    if (to_copy > 0) {
+        memcpy(s, gptr(), to_copy);
+        gbump(to_copy);
+    }
+    return to_copy;
+}
+
+}
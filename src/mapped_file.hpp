@@ -0,0 +1,62 @@
+#ifndef VG_MAPPED_FILE_HPP_INCLUDED
+#define VG_MAPPED_FILE_HPP_INCLUDED
+
+/**
+ * \file mapped_file.hpp
+ *
+ * Read-only memory-mapped file access for index formats that are laid out to
+ * be used in place, like the coverage matrix and the snarl tree index. Those
+ * readers work directly on data() and keep no copy of their own, so processes
+ * on a host that open the same file use the same page cache pages. Formats
+ * that are deserialized into their own structures, like XG, gain nothing from
+ * being mapped and should be read with an ordinary ifstream.
+ */
+
+#include <istream>
+#include <streambuf>
+#include <string>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A read-only, shared memory mapping of an entire file. It is also a streambuf
+ * over the mapping, supporting sequential reads, putback and seeking, for
+ * reading headers before working on the data in place.
+ */
+class MappedFileBuffer : public streambuf {
+public:
+    /// Map the given file. Check is_open() to see if it worked; mapping fails
+    /// for things that aren't regular files, like pipes.
+    MappedFileBuffer(const string& filename);
+    ~MappedFileBuffer();
+
+    // We own a mapping, so we can't be copied.
+    MappedFileBuffer(const MappedFileBuffer& other) = delete;
+    MappedFileBuffer& operator=(const MappedFileBuffer& other) = delete;
+
+    /// Return true if the file is mapped and can be read.
+    bool is_open() const;
+
+    /// Get the start of the mapped file data.
+    const char* data() const;
+
+    /// Get the length of the mapped file in bytes.
+    size_t size() const;
+
+protected:
+    pos_type seekoff(off_type off, ios_base::seekdir dir,
+                     ios_base::openmode which = ios_base::in) override;
+    pos_type seekpos(pos_type pos, ios_base::openmode which = ios_base::in) override;
+    streamsize xsgetn(char* s, streamsize n) override;
+
+private:
+    char* mapping = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include <unordered_set>
+#include <thread>
 #include "mapper.hpp"
 #include "haplotypes.hpp"
 #include "algorithms/extract_containing_graph.hpp"
@@ -9,6 +10,7 @@ namespace vg {
 
 // init the static memo
 thread_local vector<size_t> BaseMapper::adaptive_reseed_length_memo;
+thread_local BaseMapper::ReadWork BaseMapper::read_work;
 
 BaseMapper::BaseMapper(xg::XG* xidex,
                        gcsa::GCSA* g,
@@ -37,6 +39,8 @@ BaseMapper::BaseMapper(xg::XG* xidex,
     init_aligner(default_match, default_mismatch, default_gap_open,
                  default_gap_extension, default_full_length_bonus);
     
+    build_mem_kmer_table();
+    
     // TODO: removing these consistency checks because we seem to have violated them pretty wontonly in
     // the code base already by changing the members directly when they were still public
     
@@ -71,7 +75,151 @@ BaseMapper::~BaseMapper(void) {
     clear_aligners();
     
 }
+
+void BaseMapper::start_read_work() const {
+    read_work = ReadWork();
+    if (slow_read_log) {
+        read_work.start = chrono::steady_clock::now();
+        StageStats::start_read();
+    }
+}
+
+void BaseMapper::log_slow_read(const Alignment& read) const {
+    if (slow_read_log) {
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - read_work.start;
+        slow_read_log->log({&read}, elapsed.count(), read_work.lf_steps, read_work.cluster_probes,
+                           read_work.dp_cells);
+    }
+}
+
+void BaseMapper::log_slow_read(const Alignment& read1, const Alignment& read2) const {
+    if (slow_read_log) {
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - read_work.start;
+        slow_read_log->log({&read1, &read2}, elapsed.count(), read_work.lf_steps, read_work.cluster_probes,
+                           read_work.dp_cells);
+    }
+}
+
+bool BaseMapper::lf_budget_spent() const {
+    if (max_lf_steps_per_read && read_work.lf_steps >= max_lf_steps_per_read) {
+        read_work.limited = true;
+        return true;
+    }
+    return false;
+}
+
+bool BaseMapper::alignment_budget_spent() const {
+    if ((max_cluster_probes_per_read && read_work.cluster_probes >= max_cluster_probes_per_read)
+        || (max_dp_cells_per_read && read_work.dp_cells >= max_dp_cells_per_read)) {
+        read_work.limited = true;
+        return true;
+    }
+    return false;
+}
+
+void BaseMapper::count_dp_cells(const string& sequence, const Graph& graph) const {
+    size_t graph_length = 0;
+    for (size_t i = 0; i < graph.node_size(); i++) {
+        graph_length += graph.node(i).sequence().size();
+    }
+    read_work.dp_cells += sequence.size() * graph_length;
+}
+    
+void BaseMapper::build_mem_kmer_table(int length) {
+    mem_kmer_ranges.clear();
+    mem_kmer_table_length = 0;
+    mem_kmer_table_gcsa = nullptr;
+    
+    if (!gcsa || length <= 0 || length > gcsa->order() || gcsa->size() == 0) {
+        return;
+    }
+    
+    // Extend every (k-1)-mer to the left by each base, one level at a time,
+    // so each table entry costs a single LF step.
+    const char bases[4] = {'A', 'C', 'G', 'T'};
+    const gcsa::range_type empty_range(1, 0);
+    vector<gcsa::range_type> level(1, gcsa::range_type(0, gcsa->size() - 1));
+    for (int len = 1; len <= length; len++) {
+        size_t suffixes = level.size();
+        vector<gcsa::range_type> next_level(suffixes * 4, empty_range);
+        for (size_t b = 0; b < 4; b++) {
+            auto comp = gcsa->alpha.char2comp[bases[b]];
+            for (size_t suffix = 0; suffix < suffixes; suffix++) {
+                if (!gcsa::Range::empty(level[suffix])) {
+                    next_level[b * suffixes + suffix] = gcsa->LF(level[suffix], comp);
+                }
+            }
+        }
+        level = std::move(next_level);
+    }
+    
+    mem_kmer_ranges = std::move(level);
+    mem_kmer_table_length = length;
+    mem_kmer_table_gcsa = gcsa;
+}
+
+bool BaseMapper::jump_mem_kmer(string::const_iterator seq_begin, string::const_iterator& cursor,
+                               gcsa::range_type& range) const {
+    if (mem_kmer_table_gcsa != gcsa || mem_kmer_table_length == 0
+        || cursor - seq_begin + 1 < mem_kmer_table_length) {
+        return false;
+    }
+    
+    size_t code = 0;
+    for (auto it = cursor - (mem_kmer_table_length - 1); it <= cursor; ++it) {
+        switch (*it) {
+        case 'A': code = code * 4; break;
+        case 'C': code = code * 4 + 1; break;
+        case 'G': code = code * 4 + 2; break;
+        case 'T': code = code * 4 + 3; break;
+        default:
+            // Non-ACGT bases get their own handling in the search loops
+            return false;
+        }
+    }
+    
+    const gcsa::range_type& kmer_range = mem_kmer_ranges[code];
+    if (gcsa::Range::empty(kmer_range)) {
+        // The search stops somewhere inside the k-mer, so take it one base at a time
+        return false;
+    }
+    range = kmer_range;
+    cursor -= mem_kmer_table_length;
+    return true;
+}
+
+int BaseMapper::seed_order() const {
+    return gcsa ? gcsa->order() : minimizer_index->k();
+}
+
+vector<MaximalExactMatch>
+BaseMapper::find_minimizer_seeds(string::const_iterator seq_begin,
+                                 string::const_iterator seq_end) {
+    
+    vector<MaximalExactMatch> mems;
+    for (auto& minimizer : minimizer_index->minimizers(seq_begin, seq_end)) {
+        // there is no GCSA range behind these, so give them an empty one
+        mems.emplace_back(seq_begin + minimizer.offset, seq_begin + minimizer.offset + minimizer_index->k(),
+                          gcsa::range_type(1, 0), minimizer_index->count(minimizer.key));
+        MaximalExactMatch& mem = mems.back();
+        mem.nodes = MEMHitPool::acquire();
+        if (!hit_max || mem.match_count <= (size_t) hit_max) {
+            minimizer_index->find(minimizer.key, mem.nodes);
+        }
+    }
     
+#ifdef debug_mapper
+#pragma omp critical
+    {
+        for (auto& mem : mems) {
+            cerr << "minimizer " << mem.sequence() << " has " << mem.match_count << " hits" << endl;
+        }
+    }
+#endif
+    
+    return mems;
+}
+
 // Use the GCSA2 index to find super-maximal exact matches.
 vector<MaximalExactMatch>
 BaseMapper::find_mems_simple(string::const_iterator seq_begin,
@@ -80,6 +228,10 @@ BaseMapper::find_mems_simple(string::const_iterator seq_begin,
                              int min_mem_length,
                              int reseed_length) {
     
+    if (minimizer_index) {
+        return find_minimizer_seeds(seq_begin, seq_end);
+    }
+    
     if (!gcsa) {
         cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
         exit(1);
@@ -116,10 +268,18 @@ BaseMapper::find_mems_simple(string::const_iterator seq_begin,
     gcsa::range_type last_range = match.range;
     --cursor; // start off looking at the last character in the query
     while (cursor >= seq_begin) {
+        if (match.range == full_range && match.end == cursor + 1
+            && (!max_mem_length || mem_kmer_table_length <= max_mem_length)
+            && jump_mem_kmer(seq_begin, cursor, match.range)) {
+            // we matched the whole k-mer in one lookup
+            match.begin = cursor + 1;
+            continue;
+        }
         // hold onto our previous range
         last_range = match.range;
         // execute one step of LF mapping
         match.range = gcsa->LF(match.range, gcsa->alpha.char2comp[*cursor]);
+        read_work.lf_steps++;
         if (gcsa::Range::empty(match.range)
             || max_mem_length && match.end-cursor > max_mem_length
             || match.end-cursor > gcsa->order()) {
@@ -200,6 +360,8 @@ BaseMapper::find_mems_simple(string::const_iterator seq_begin,
     for (auto& mem : mems) {
         if (mem.length() >= min_mem_length) {
             mem.match_count = gcsa->count(mem.range);
+            // reuse a hit buffer from an earlier read on this thread
+            mem.nodes = MEMHitPool::acquire();
             if (hit_max) {
                 gcsa->locate(mem.range, hit_max, mem.nodes);
             } else {
@@ -270,6 +432,8 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                                                      bool include_parent_in_sub_mem_count,
                                                      bool record_max_lcp,
                                                      int reseed_below) {
+    StageStats::Timer timer(stage_stats, StageStats::MEMS);
+    
 #ifdef debug_mapper
 #pragma omp critical
     {
@@ -282,6 +446,19 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     }
 #endif
 
+    if (minimizer_index) {
+        vector<MaximalExactMatch> mems = find_minimizer_seeds(seq_begin, seq_end);
+        size_t total_hits = 0;
+        size_t filtered_hits = 0;
+        for (auto& mem : mems) {
+            total_hits += mem.match_count;
+            filtered_hits += mem.match_count - mem.nodes.size();
+        }
+        lcp_avg = 0;
+        fraction_filtered = total_hits ? (double) filtered_hits / (double) total_hits : 0;
+        return mems;
+    }
+
     if (!gcsa) {
         cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
         exit(1);
@@ -379,11 +556,23 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
             continue;
         }
         
+        if (!record_max_lcp && match.range == full_range && match.end == cursor + 1
+            && (!max_mem_length || mem_kmer_table_length <= max_mem_length)) {
+            // we won't need the LCP at each step, so try to match a whole k-mer in one lookup
+            string::const_iterator before_jump = cursor;
+            if (jump_mem_kmer(seq_begin, cursor, match.range)) {
+                mem_length += before_jump - cursor;
+                prev_iter_jumped_lcp = false;
+                continue;
+            }
+        }
+        
         // hold onto our previous range
         last_range = match.range;
         
         // execute one step of LF mapping
         match.range = gcsa->LF(match.range, gcsa->alpha.char2comp[*cursor]);
+        read_work.lf_steps++;
         
         if (gcsa::Range::empty(match.range)
             || (max_mem_length && match.end - cursor > max_mem_length)
@@ -540,7 +729,8 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                     mem.length() > min_sub_mem_length &&
                     (use_lcp_reseed_heuristic && record_max_lcp
                      && i < lcp_maxima.size() ? lcp_maxima[i] : mem.length()) >= reseed_length &&
-                    (reseed_below == 0 || mem.match_count <= reseed_below)){
+                    (reseed_below == 0 || mem.match_count <= reseed_below) &&
+                    !lf_budget_spent()) {
                     
                     // where should we start looking for sub-MEMs to ensure that we find independent hits
                     // from adjacent MEMs that might overlap this one?
@@ -551,14 +741,21 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                     
                     // reseed using the technique indicated by the mapper's parameters
                     vector<pair<MaximalExactMatch, vector<size_t>>> sub_mems;
-                    if (fast_reseed) {
-                        find_sub_mems_fast(mems, layer_begin, layer_end, i,
-                                           possible_containment_boundary, seed_boundary,
-                                           min_sub_mem_length, sub_mems);
-                    }
-                    else {
-                        find_sub_mems(mems, layer_begin, layer_end, i, seed_boundary,
-                                      min_sub_mem_length, sub_mems);
+                    {
+                        StageStats::Timer reseed_timer(stage_stats, StageStats::RESEED);
+                        if (lcp_reseed) {
+                            find_sub_mems_lcp(mems, layer_begin, layer_end, i, seed_boundary,
+                                              min_sub_mem_length, sub_mems);
+                        }
+                        else if (fast_reseed) {
+                            find_sub_mems_fast(mems, layer_begin, layer_end, i,
+                                               possible_containment_boundary, seed_boundary,
+                                               min_sub_mem_length, sub_mems);
+                        }
+                        else {
+                            find_sub_mems(mems, layer_begin, layer_end, i, seed_boundary,
+                                          min_sub_mem_length, sub_mems);
+                        }
                     }
                     
                     for (pair<MaximalExactMatch, vector<size_t>>& sub_mem_and_parents : sub_mems) {
@@ -596,6 +793,8 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         }
         
         if (mem.match_count > 0) {
+            // reuse a hit buffer from an earlier read on this thread
+            mem.nodes = MEMHitPool::acquire();
             if (hit_max) {
                 gcsa->locate(mem.range, hit_max, mem.nodes);
             } else {
@@ -630,6 +829,20 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                               { return mem.begin < seq_begin || mem.end > seq_end; }),
                mems.end());
 
+    // remove MEMs made only of low-complexity sequence, which hit all over
+    // the graph without saying much about where the read belongs
+    if (min_mem_entropy > 0 && seq_begin != seq_end) {
+        vector<bool> low_complexity = low_complexity_mask(&*seq_begin, seq_end - seq_begin,
+                                                          mem_entropy_window, min_mem_entropy);
+        mems.erase(std::remove_if(mems.begin(), mems.end(),
+                                  [&](const MaximalExactMatch& mem) {
+                                      return std::all_of(low_complexity.begin() + (mem.begin - seq_begin),
+                                                         low_complexity.begin() + (mem.end - seq_begin),
+                                                         [](bool masked) { return masked; });
+                                  }),
+                   mems.end());
+    }
+
     // return the MEMs in lexicographic order by the read interval
     std::sort(mems.begin(), mems.end(), [](const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
         return m1.begin < m2.begin || (m1.begin == m2.begin && m1.end < m2.end);
@@ -697,6 +910,7 @@ void BaseMapper::find_sub_mems(const vector<MaximalExactMatch>& mems,
         gcsa::range_type last_range = range;
         // execute one step of LF mapping
         range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+        read_work.lf_steps++;
         
         if (gcsa->count(range) <= parent_count) {
             // there are no more hits outside of parent MEM hits, record the previous
@@ -807,6 +1021,158 @@ void BaseMapper::find_sub_mems(const vector<MaximalExactMatch>& mems,
     }
 }
 
+void BaseMapper::find_sub_mems_lcp(const vector<MaximalExactMatch>& mems,
+                                   int parent_layer_begin,
+                                   int parent_layer_end,
+                                   int mem_idx,
+                                   string::const_iterator next_mem_end,
+                                   int min_sub_mem_length,
+                                   vector<pair<MaximalExactMatch, vector<size_t>>>& sub_mems_out) {
+    
+    // get the most recently added MEM
+    const MaximalExactMatch& mem = mems[mem_idx];
+    
+#ifdef debug_mapper
+#pragma omp critical
+    {
+        cerr << "find_sub_mems_lcp: sequence ";
+        for (auto iter = mem.begin; iter != mem.end; iter++) {
+            cerr << *iter;
+        }
+        cerr << ", min mem length " << min_sub_mem_length << endl;
+    }
+#endif
+    
+    // how many times does the parent MEM occur in the index?
+    size_t parent_count = gcsa->count(mem.range);
+    
+    // does a range have hits outside of the parent MEM's hits? the range length bounds the
+    // count from above, so we only need to call count when the range is large
+    auto has_outside_hits = [&](const gcsa::range_type& range) {
+        return !gcsa::Range::empty(range) && gcsa::Range::length(range) > parent_count
+            && gcsa->count(range) > parent_count;
+    };
+    
+    // the righthand end of the sub-MEM we are building
+    string::const_iterator sub_mem_end = mem.end;
+    
+    // the leftmost base of the suffix that the current search has matched so far
+    string::const_iterator search_begin = mem.end;
+    
+    // ranges[k] matches the suffix search_begin-k:sub_mem_end, so we can go back to any earlier
+    // step of this search without redoing its LF steps
+    vector<gcsa::range_type> ranges(1, gcsa::range_type(0, gcsa->size() - 1));
+    
+    // did the last search start from an LCP jump?
+    bool jumped_lcp = false;
+    
+    // look for matches that are contained in this MEM and not contained in the next MEM
+    while (sub_mem_end > next_mem_end) {
+        
+        // extend to the left, only checking counts at exponentially spaced steps since the
+        // count can only drop as we extend
+        size_t extended = 0;   // the longest step known to have outside hits
+        size_t exhausted = 0;  // the shortest step known to have no outside hits, 0 if none
+        size_t next_check = 1;
+        while (search_begin - mem.begin >= (int64_t) ranges.size()) {
+            size_t k = ranges.size();
+            ranges.push_back(gcsa->LF(ranges.back(), gcsa->alpha.char2comp[*(search_begin - k)]));
+            read_work.lf_steps++;
+            if (gcsa::Range::empty(ranges[k])) {
+                // no need to keep stepping until the next check
+                exhausted = k;
+                break;
+            }
+            if (k == next_check) {
+                if (has_outside_hits(ranges[k])) {
+                    extended = k;
+                    next_check *= 2;
+                }
+                else {
+                    exhausted = k;
+                    break;
+                }
+            }
+        }
+        if (!exhausted && ranges.size() - 1 > extended) {
+            // we ran into the start of the MEM between checks
+            if (has_outside_hits(ranges.back())) {
+                extended = ranges.size() - 1;
+            }
+            else {
+                exhausted = ranges.size() - 1;
+            }
+        }
+        
+        if (!exhausted) {
+            // we reached the start of the parent MEM with hits to spare, so add a final sub MEM
+            // unless we haven't moved since jumping up the suffix tree
+            if ((extended > 0 || !jumped_lcp) && sub_mem_end - mem.begin >= min_mem_length) {
+                sub_mems_out.emplace_back(MaximalExactMatch(mem.begin, sub_mem_end, ranges[extended]),
+                                          vector<size_t>(1, mem_idx));
+                // note: this sub MEM is at the far left side of the parent MEM, so we don't need to
+                // check whether earlier MEMs contain it as well
+            }
+            break;
+        }
+        
+        // binary search between the checks for the first step without outside hits
+        while (exhausted - extended > 1) {
+            size_t middle = extended + (exhausted - extended) / 2;
+            if (has_outside_hits(ranges[middle])) {
+                extended = middle;
+            }
+            else {
+                exhausted = middle;
+            }
+        }
+        
+        // the longest extension with outside hits is a sub-MEM, unless we haven't moved
+        // since jumping up the suffix tree (then it's contained in one we already found)
+        string::const_iterator sub_mem_begin = search_begin - extended;
+        if (sub_mem_end - sub_mem_begin >= min_sub_mem_length && (extended > 0 || !jumped_lcp)) {
+            sub_mems_out.emplace_back(MaximalExactMatch(sub_mem_begin, sub_mem_end, ranges[extended]),
+                                      vector<size_t>(1, mem_idx));
+#ifdef debug_mapper
+#pragma omp critical
+            {
+                cerr << "adding sub-MEM ";
+                for (auto iter = sub_mem_begin; iter != sub_mem_end; iter++) {
+                    cerr << *iter;
+                }
+                cerr << endl;
+            }
+#endif
+            // identify all previous MEMs that also contain this sub-MEM
+            for (int64_t i = mem_idx - 1; i >= parent_layer_begin; --i) {
+                if (sub_mem_begin >= mems[i].begin) {
+                    sub_mems_out.back().second.push_back(i);
+                }
+                else {
+                    break;
+                }
+            }
+        }
+        
+        // jump to the parent suffix tree node to drop the end of the match, and continue the
+        // search from where we left off instead of starting over at the new end
+        gcsa::STNode parent = lcp->parent(ranges[extended]);
+        sub_mem_end = sub_mem_begin + parent.lcp();
+        search_begin = sub_mem_begin;
+        ranges.clear();
+        ranges.push_back(parent.range());
+        jumped_lcp = true;
+    }
+    
+    // annotate the MEMs
+    for (pair<MaximalExactMatch, vector<size_t>>& sub_mem_and_parents : sub_mems_out) {
+        // count in entire range, including parents
+        sub_mem_and_parents.first.match_count = gcsa->count(sub_mem_and_parents.first.range);
+        // mark this is a sub-MEM
+        sub_mem_and_parents.first.primary = false;
+    }
+}
+
 // TODO: rewrite roughly as follows
 // //// idea is to check all the possible sub mems starting from the same position so we obviate the need to call count for every LF step
 // initally take the range of the MEM, then do parent operation to find the next-longest match with a long range
@@ -869,6 +1235,7 @@ void BaseMapper::find_sub_mems_fast(const vector<MaximalExactMatch>& mems,
         while (cursor >= probe_string_begin) {
             
             range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+            read_work.lf_steps++;
             
             // do a count operation if we've reached the beginning of the probe string or at invervals of the thinning parameter
             // past the burn-in parameter
@@ -897,6 +1264,7 @@ void BaseMapper::find_sub_mems_fast(const vector<MaximalExactMatch>& mems,
                 while (cursor >= leftmost_extension_bound) {
                     gcsa::range_type last_range = range;
                     range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+                    read_work.lf_steps++;
                     
                     if ((use_approx_sub_mem_count ? gcsa::Range::length(range) : gcsa->count(range)) <= parent_range_count) {
                         range = last_range;
@@ -945,6 +1313,7 @@ void BaseMapper::find_sub_mems_fast(const vector<MaximalExactMatch>& mems,
                 while (cursor >= probe_string_begin) {
                     
                     range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+                    read_work.lf_steps++;
                     
                     // do count operations on the final index and on intervals of the thinning parameter once we pass the
                     // burn in parameter
@@ -998,6 +1367,7 @@ void BaseMapper::find_sub_mems_fast(const vector<MaximalExactMatch>& mems,
                 bool contained_in_independent_match = true;
                 while (cursor >= probe_string_begin) {
                     range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+                    read_work.lf_steps++;
                     int64_t relative_idx = right_search_bound - cursor + 1;
                     if (cursor == probe_string_begin ||
                         (relative_idx >= sub_mem_thinning_burn_in && (relative_idx - sub_mem_thinning_burn_in) % sub_mem_count_thinning == 0)) {
@@ -1282,6 +1652,12 @@ void BaseMapper::precollapse_order_length_runs(string::const_iterator seq_begin,
 void BaseMapper::rescue_high_count_order_length_mems(vector<MaximalExactMatch>& mems,
                                                      size_t max_rescue_hit_count) {
     
+    if (!gcsa) {
+        // minimizer seeds have no GCSA range to find more hits in, and
+        // aren't cut at the GCSA's order anyway
+        return;
+    }
+    
     vector<pair<size_t, size_t>> unfilled_mem_ranges;
     
     // identify the ranges of MEMs that are unfilled
@@ -1339,25 +1715,24 @@ size_t BaseMapper::get_adaptive_min_reseed_length(size_t parent_mem_length) {
 }
 
 void BaseMapper::first_hit_positions_by_index(MaximalExactMatch& mem,
-                                              vector<set<pos_t>>& positions_by_index_out) {
+                                              vector<unordered_set<gcsa::node_type>>& positions_by_index_out) {
     // find the hit to the first index in the parent MEM's range
     vector<gcsa::node_type> all_first_hits;
     gcsa->locate(mem.range.first, all_first_hits, true, false);
     
     // find where in the graph the first hit of the parent MEM is at each index
-    mem_positions_by_index(mem, make_pos_t(all_first_hits[0]), positions_by_index_out);
+    mem_positions_by_index(mem, all_first_hits[0], positions_by_index_out);
     
     // in case the first hit occurs in more than one place, accumulate all the hits
     if (all_first_hits.size() > 1) {
         for (size_t i = 1; i < all_first_hits.size(); i++) {
-            vector<set<pos_t>> temp_positions_by_index;
-            mem_positions_by_index(mem, make_pos_t(all_first_hits[i]),
+            vector<unordered_set<gcsa::node_type>> temp_positions_by_index;
+            mem_positions_by_index(mem, all_first_hits[i],
                                    temp_positions_by_index);
             
             for (size_t i = 0; i < positions_by_index_out.size(); i++) {
-                for (const pos_t& pos : temp_positions_by_index[i]) {
-                    positions_by_index_out[i].insert(pos);
-                }
+                positions_by_index_out[i].insert(temp_positions_by_index[i].begin(),
+                                                 temp_positions_by_index[i].end());
             }
         }
     }
@@ -1369,7 +1744,7 @@ void BaseMapper::fill_nonredundant_sub_mem_nodes(vector<MaximalExactMatch>& pare
     
     
     // for each MEM, a vector of the positions that it touches at each index along the MEM
-    vector<vector<set<pos_t>>> positions_by_index(parent_mems.size());
+    vector<vector<unordered_set<gcsa::node_type>>> positions_by_index(parent_mems.size());
     
     for (auto iter = sub_mem_records_begin; iter != sub_mem_records_end; iter++) {
         
@@ -1381,7 +1756,7 @@ void BaseMapper::fill_nonredundant_sub_mem_nodes(vector<MaximalExactMatch>& pare
         // how many total hits does each parent MEM have?
         vector<size_t> num_parent_hits;
         // positions their first hits of the parent MEM takes at the start position of the sub-MEM
-        vector<set<pos_t>*> first_parent_mem_hit_positions;
+        vector<unordered_set<gcsa::node_type>*> first_parent_mem_hit_positions;
         for (size_t parent_idx : parent_idxs) {
             // get the parent MEM
             MaximalExactMatch& parent_mem = parent_mems[parent_idx];
@@ -1412,7 +1787,7 @@ void BaseMapper::fill_nonredundant_sub_mem_nodes(vector<MaximalExactMatch>& pare
             for (gcsa::node_type node : hits) {
                 // look for the hit in each parent MEM
                 for (size_t j = 0; j < first_parent_mem_hit_positions.size(); j++) {
-                    if (first_parent_mem_hit_positions[j]->count(make_pos_t(node))) {
+                    if (first_parent_mem_hit_positions[j]->count(node)) {
                         // this hit is also a node on a path of the first occurrence of the parent MEM
                         // that means that this is the first index of the sub-range that corresponds
                         // to the parent MEM's hits
@@ -1442,8 +1817,8 @@ void BaseMapper::fill_nonredundant_sub_mem_nodes(vector<MaximalExactMatch>& pare
     }
 }
 
-void BaseMapper::mem_positions_by_index(MaximalExactMatch& mem, pos_t hit_pos,
-                                        vector<set<pos_t>>& positions_by_index_out) {
+void BaseMapper::mem_positions_by_index(MaximalExactMatch& mem, gcsa::node_type hit,
+                                        vector<unordered_set<gcsa::node_type>>& positions_by_index_out) {
     
     // this is a specialized DFS that keeps track of both the distance along the MEM
     // and the position(s) in the graph in the stack by adding all of the next reachable
@@ -1459,12 +1834,12 @@ void BaseMapper::mem_positions_by_index(MaximalExactMatch& mem, pos_t hit_pos,
     positions_by_index_out.resize(mem_length);
     
     // indicates a pairing of this graph position and this MEM index could not be extended to a full match
-    vector<set<pos_t>> false_pos_by_mem_index(mem_length);
+    vector<unordered_set<gcsa::node_type>> false_pos_by_mem_index(mem_length);
     
     // each record indicates the next edge index to traverse, the number of edges that
     // cannot reach a MEM end, and the positions along each edge out
     vector<pair<pair<size_t, size_t>, vector<pos_t> > > pos_stack;
-    pos_stack.push_back(make_pair(make_pair((size_t) 0 , (size_t) 0), vector<pos_t>{hit_pos}));
+    pos_stack.push_back(make_pair(make_pair((size_t) 0 , (size_t) 0), vector<pos_t>{make_pos_t(hit)}));
     
     while (!pos_stack.empty()) {
         size_t mem_idx = pos_stack.size() - 1;
@@ -1486,11 +1861,11 @@ void BaseMapper::mem_positions_by_index(MaximalExactMatch& mem, pos_t hit_pos,
                 // all of the edges out failed to reach the end of a MEM, this position is a dead end
                 
                 // get the position that traversed into the layer we just popped off
-                pos_t prev_graph_pos = pos_stack.back().second[pos_stack.back().first.first - 1];
+                gcsa::node_type prev_graph_hit = make_gcsa_node(pos_stack.back().second[pos_stack.back().first.first - 1]);
                 
                 // unlabel this node as a potential hit and instead mark it as a miss
-                positions_by_index_out[mem_idx].erase(prev_graph_pos);
-                false_pos_by_mem_index[mem_idx].insert(prev_graph_pos);
+                positions_by_index_out[mem_idx].erase(prev_graph_hit);
+                false_pos_by_mem_index[mem_idx].insert(prev_graph_hit);
                 
                 // increase the count of misses in this layer
                 pos_stack.back().first.second++;
@@ -1504,16 +1879,16 @@ void BaseMapper::mem_positions_by_index(MaximalExactMatch& mem, pos_t hit_pos,
         pos_stack.back().first.first++;
         
         pos_t graph_pos = pos_stack.back().second[next_idx];
-        
+        gcsa::node_type graph_hit = make_gcsa_node(graph_pos);
         
         // did we already find a MEM through this position?
-        if (positions_by_index_out[mem_idx].count(graph_pos)) {
+        if (positions_by_index_out[mem_idx].count(graph_hit)) {
             // we don't need to check the same MEM suffix again
             continue;
         }
         
         // did we already determine that you can't reach a MEM through this position?
-        if (false_pos_by_mem_index[mem_idx].count(graph_pos)) {
+        if (false_pos_by_mem_index[mem_idx].count(graph_hit)) {
             // increase the count of misses in this layer
             pos_stack.back().first.second++;
             
@@ -1524,14 +1899,14 @@ void BaseMapper::mem_positions_by_index(MaximalExactMatch& mem, pos_t hit_pos,
         // does this graph position match the MEM?
         if (*(mem.begin + mem_idx) != xg_pos_char(graph_pos, xindex)) {
             // mark this node as a miss
-            false_pos_by_mem_index[mem_idx].insert(graph_pos);
+            false_pos_by_mem_index[mem_idx].insert(graph_hit);
             
             // increase the count of misses in this layer
             pos_stack.back().first.second++;
         }
         else {
             // mark this node as a potential hit
-            positions_by_index_out[mem_idx].insert(graph_pos);
+            positions_by_index_out[mem_idx].insert(graph_hit);
             
             // are we finished with the MEM?
             if (mem_idx < mem_length - 1) {
@@ -1610,6 +1985,14 @@ void BaseMapper::init_aligner(int8_t match, int8_t mismatch, int8_t gap_open, in
     qual_adj_aligner = new QualAdjAligner(match, mismatch, gap_open, gap_extend, full_length_bonus,
                                           max_score, 255, gc_content);
     regular_aligner = new Aligner(match, mismatch, gap_open, gap_extend, full_length_bonus);
+    qual_adj_aligner->use_xdrop = use_xdrop;
+    regular_aligner->use_xdrop = use_xdrop;
+}
+
+void BaseMapper::set_xdrop(bool use_xdrop) {
+    this->use_xdrop = use_xdrop;
+    if (qual_adj_aligner) qual_adj_aligner->use_xdrop = use_xdrop;
+    if (regular_aligner) regular_aligner->use_xdrop = use_xdrop;
 }
 
 void BaseMapper::load_scoring_matrix(std::ifstream& matrix_stream){
@@ -1723,8 +2106,16 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
     }
 }
     
+void BaseMapper::set_calibration(const MapperCalibration& calibration) {
+    this->calibration = calibration;
+}
+    
 double BaseMapper::estimate_gc_content(void) {
     
+    if (calibration.gc_content >= 0) {
+        return calibration.gc_content;
+    }
+    
     uint64_t at = 0, gc = 0;
     
     if (gcsa) {
@@ -1800,10 +2191,14 @@ Mapper::Mapper(xg::XG* xidex,
     , min_banded_mq(0)
     , max_band_jump(0)
     , patch_alignments(false)
+    , chain_long_reads(false)
+    , sparse_chaining(false)
     , identity_weight(2)
     , pair_rescue_hang_threshold(0.7)
     , pair_rescue_retry_threshold(0.5)
+    , rescue_prefilter_kmer(0)
     , include_full_length_bonuses(true)
+    , score_before_traceback(false)
 {
     
 }
@@ -1817,6 +2212,9 @@ Mapper::~Mapper(void) {
 }
 
 double Mapper::graph_entropy(void) {
+    if (calibration.graph_entropy >= 0) {
+        return calibration.graph_entropy;
+    }
     const size_t seq_bytes = xindex->sequence_bit_size() / 8;
     char* seq = (char*) xindex->sequence_data();
     return entropy(seq, seq_bytes);
@@ -1832,6 +2230,7 @@ Alignment Mapper::align_to_graph(const Alignment& aln,
                                  bool pin_left,
                                  bool banded_global,
                                  bool keep_bonuses) {
+    count_dp_cells(aln.sequence(), graph);
     // check if we need to make a vg graph to handle this graph
     Alignment aligned;
     if (!acyclic_and_sorted) { //!is_id_sortable(graph) || has_inversion(graph)) {
@@ -2014,6 +2413,7 @@ vector<pos_t> Mapper::likely_mate_positions(const Alignment& aln, bool is_first_
 pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
                                      bool& tried1, bool& tried2,
                                      int match_score, int full_length_bonus, bool traceback) {
+    StageStats::Timer timer(stage_stats, StageStats::RESCUE);
     auto pair_sig = signature(mate1, mate2);
     // bail out if we can't figure out how far to go
     bool rescued1 = false;
@@ -2058,8 +2458,8 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
         return make_pair(false, false);
     }
     if (mate_positions.empty()) return make_pair(false, false); // can't rescue because the selected mate is unaligned
-    Graph graph;
     set<bool> orientations;
+    vector<id_t> mate_nodes;
 #ifdef debug_rescue
     if (debug) cerr << "got " << mate_positions.size() << " mate positions" << endl;
 #endif
@@ -2068,19 +2468,49 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
         if (debug) cerr << "aiming for " << mate_pos << endl;
 #endif
         orientations.insert(is_rev(mate_pos));
-        int get_at_least = (!frag_stats.cached_fragment_length_mean ? frag_stats.fragment_max
-                            : min(frag_stats.fragment_max/2,
-                                  (int64_t)max((double)frag_stats.cached_fragment_length_stdev * 10.0,
-                                               mate1.sequence().size() * 3.0)));
-        //cerr << "Getting at least " << get_at_least << endl;
-        graph.MergeFrom(xindex->graph_context_id(mate_pos, get_at_least/2));
-        graph.MergeFrom(xindex->graph_context_id(reverse(mate_pos, get_node_length(id(mate_pos))), get_at_least/2));
-        //if (debug) cerr << "rescue got graph " << pb2json(graph) << endl;
-        // if we're reversed, align the reverse sequence and flip it back
-        // align against it
+        mate_nodes.push_back(id(mate_pos));
+    }
+    sort(mate_nodes.begin(), mate_nodes.end());
+    mate_nodes.erase(unique(mate_nodes.begin(), mate_nodes.end()), mate_nodes.end());
+    int get_at_least = (!frag_stats.cached_fragment_length_mean ? frag_stats.fragment_max
+                        : min(frag_stats.fragment_max/2,
+                              (int64_t)max((double)frag_stats.cached_fragment_length_stdev * 10.0,
+                                           mate1.sequence().size() * 3.0)));
+    // get the window around the mate nodes, which pairs anchored nearby share
+    bool window_cached = false;
+    shared_ptr<RescueWindow> window = rescue_windows.get(mate_nodes, get_at_least, [&](void) {
+        auto made = make_shared<RescueWindow>();
+        size_t window_bases = 0;
+        for (id_t node_id : mate_nodes) {
+            // take enough context from both ends of the node to cover any offset on it
+            int64_t context = get_at_least/2 + get_node_length(node_id);
+            made->graph.MergeFrom(xindex->graph_context_id(make_pos_t(node_id, false, 0), context));
+            made->graph.MergeFrom(xindex->graph_context_id(make_pos_t(node_id, true, 0), context));
+        }
+        sort_by_id_dedup_and_clean(made->graph);
+        made->acyclic_and_sorted = is_id_sortable(made->graph) && !has_inversion(made->graph);
+        if (rescue_prefilter_kmer > 0) {
+            for (auto& node : made->graph.node()) {
+                window_bases += node.sequence().size();
+            }
+            // give up on indexing where it would cost more than aligning
+            made->index_kmers(rescue_prefilter_kmer, 64 * window_bases);
+        }
+        return made;
+    }, window_cached);
+    if (window_cached && stage_stats) {
+        stage_stats->count(StageStats::RESCUE_WINDOWS_CACHED);
+    }
+    Graph& graph = window->graph;
+    bool acyclic_and_sorted = window->acyclic_and_sorted;
+    // skip the alignment if the mate can't match anything here
+    if (!window->may_align(rescue_off_first ? mate2.sequence() : mate1.sequence())) {
+        (rescue_off_first ? tried2 : tried1) = true;
+        if (stage_stats) {
+            stage_stats->count(StageStats::RESCUES_PREFILTERED);
+        }
+        return make_pair(false, false);
     }
-    sort_by_id_dedup_and_clean(graph);
-    bool acyclic_and_sorted = is_id_sortable(graph) && !has_inversion(graph);
     //VG g; g.extend(graph);string h = g.hash();
     //g.serialize_to_file("rescue-" + h + ".vg");
     int max_mate1_score = mate1.score();
@@ -2089,6 +2519,9 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
         if (rescue_off_first) {
             Alignment aln2 = align_maybe_flip(mate2, graph, orientation, traceback, acyclic_and_sorted);
             tried2 = true;
+            if (stage_stats) {
+                stage_stats->count(StageStats::RESCUES_ATTEMPTED);
+            }
             //write_alignment_to_file(aln2, "rescue-" + h + ".gam");
 #ifdef debug_rescue
             if (debug) cerr << "aln2 score/ident vs " << aln2.score() << "/" << aln2.identity()
@@ -2109,6 +2542,9 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
         } else if (rescue_off_second) {
             Alignment aln1 = align_maybe_flip(mate1, graph, orientation, traceback, acyclic_and_sorted);
             tried1 = true;
+            if (stage_stats) {
+                stage_stats->count(StageStats::RESCUES_ATTEMPTED);
+            }
             //write_alignment_to_file(aln1, "rescue-" + h + ".gam");
 #ifdef debug_rescue
             if (debug) cerr << "aln1 score/ident vs " << aln1.score() << "/" << aln1.identity()
@@ -2128,6 +2564,9 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2,
             }
         }
     }
+    if (stage_stats && (rescued1 || rescued2)) {
+        stage_stats->count(StageStats::RESCUES_SUCCEEDED);
+    }
     // if the new alignment is better
     // set the old alignment to it
     return make_pair(rescued1, rescued2);
@@ -2249,6 +2688,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     bool retrying) {
 
     chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+    start_read_work();
 
     Alignment read1;
     read1.set_name(first_mate.name());
@@ -2318,7 +2758,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     double mem_read_ratio1 = min(1.0, (double)total_mem_length1 / (double)read1.sequence().size());
     double mem_read_ratio2 = min(1.0, (double)total_mem_length2 / (double)read2.sequence().size());
 
-    int basis_length = min((int)read1.sequence().size(), (int)gcsa->order());
+    int basis_length = min((int)read1.sequence().size(), seed_order());
     double max_possible_mq = max_possible_mapping_quality(basis_length);
 
     int mem_max_length1 = 0;
@@ -2355,6 +2795,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     if (debug) cerr << "mems for read 2 " << mems_to_json(mems2) << endl;
 
     auto transition_weight = [&](const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
+        read_work.cluster_probes++;
 
 #ifdef debug_mapper
 #pragma omp critical
@@ -2492,6 +2933,13 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
 
     auto to_drop1 = clusters_to_drop(clusters1);
     auto to_drop2 = clusters_to_drop(clusters2);
+    if (filter_haplotype_inconsistent_clusters) {
+        // the mate clusters are matched by index, so we can't move them around
+        auto inconsistent1 = haplotype_inconsistent_clusters(clusters1, read1.sequence().size());
+        to_drop1.insert(inconsistent1.begin(), inconsistent1.end());
+        auto inconsistent2 = haplotype_inconsistent_clusters(clusters2, read2.sequence().size());
+        to_drop2.insert(inconsistent2.begin(), inconsistent2.end());
+    }
     vector<pair<Alignment, Alignment> > alns;
     vector<pair<vector<MaximalExactMatch>*, vector<MaximalExactMatch>*> > cluster_ptrs;
     for (int i = 0; i < clusters1.size(); ++i) {
@@ -2556,7 +3004,9 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
         auto& cluster2 = *cluster_ptr.second;
         alns.emplace_back();
         auto& p = alns.back();
-        if (cluster1.size()
+        // a pair that has used up its work budget only gets its best cluster aligned
+        bool budget_spent = (filled1 || filled2) && alignment_budget_spent();
+        if (cluster1.size() && !budget_spent
             && (filled1 < min_multimaps
                 || !to_drop1.count(&cluster1))) {
             p.first = align_cluster(read1, cluster1, true);
@@ -2568,7 +3018,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
             p.first.clear_path();
         }
 
-        if (cluster2.size()
+        if (cluster2.size() && !budget_spent
             && (filled2 < min_multimaps
                 || !to_drop2.count(&cluster2))) {
             p.second = align_cluster(read2, cluster2, true);
@@ -2927,6 +3377,9 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     // if we have references, annotate the alignments with their reference positions
     annotate_with_initial_path_positions(results.first);
     annotate_with_initial_path_positions(results.second);
+    annotate_budget_limited(results.first);
+    annotate_budget_limited(results.second);
+    log_slow_read(first_mate, second_mate);
 
     chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
     auto used_time = chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
@@ -2938,7 +3391,8 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
 }
 
 void Mapper::annotate_with_initial_path_positions(vector<Alignment>& alns) {
-    for (auto& aln : alns) annotate_with_initial_path_positions(aln);
+    // look up the whole batch at once
+    xg_annotate_with_initial_path_positions(alns, true, false, xindex);
 }
 
 void Mapper::annotate_with_initial_path_positions(Alignment& aln) {
@@ -3004,6 +3458,9 @@ double Mapper::compute_cluster_mapping_quality(const vector<vector<MaximalExactM
 
 double
 Mapper::average_node_length(void) {
+    if (calibration.average_node_length >= 0) {
+        return calibration.average_node_length;
+    }
     return (double) xindex->seq_length / (double) xindex->node_count;
 }
 
@@ -3059,6 +3516,41 @@ set<const vector<MaximalExactMatch>* > Mapper::clusters_to_drop(const vector<vec
     return to_drop;
 }
 
+set<const vector<MaximalExactMatch>* > Mapper::haplotype_inconsistent_clusters(const vector<vector<MaximalExactMatch> >& clusters,
+                                                                               size_t read_length) {
+    set<const vector<MaximalExactMatch>* > inconsistent;
+    if (haplo_score_provider == nullptr) {
+        return inconsistent;
+    }
+    for (auto& cluster : clusters) {
+        // the nodes the anchors start on, in read order
+        vector<const MaximalExactMatch*> anchors;
+        for (auto& mem : cluster) {
+            if (!mem.nodes.empty()) {
+                anchors.push_back(&mem);
+            }
+        }
+        std::sort(anchors.begin(), anchors.end(), [](const MaximalExactMatch* a, const MaximalExactMatch* b) {
+                return a->begin < b->begin;
+            });
+        vector<pair<int64_t, bool> > nodes;
+        for (auto mem : anchors) {
+            pair<int64_t, bool> node(gcsa::Node::id(mem->nodes.front()), gcsa::Node::rc(mem->nodes.front()));
+            if (nodes.empty() || nodes.back() != node) {
+                nodes.push_back(node);
+            }
+        }
+        // a node is at least a base long, so no gap between anchors can take more steps than the read
+        if (!haplo_score_provider->has_consistent_haplotype(nodes, read_length)) {
+            inconsistent.insert(&cluster);
+        }
+    }
+    if (inconsistent.size() == clusters.size()) {
+        inconsistent.clear();
+    }
+    return inconsistent;
+}
+
 vector<Alignment>
 Mapper::align_mem_multi(const Alignment& aln,
                         vector<MaximalExactMatch>& mems,
@@ -3082,7 +3574,7 @@ Mapper::align_mem_multi(const Alignment& aln,
     int total_mem_length = 0;
     for (auto& mem : mems) total_mem_length += mem.length(); // * mem.nodes.size();
     double mem_read_ratio = min(1.0, (double)total_mem_length / (double)aln.sequence().size());
-    int basis_length = min((int)aln.sequence().size(), (int)gcsa->order());
+    int basis_length = min((int)aln.sequence().size(), seed_order());
     double max_possible_mq = max_possible_mapping_quality(basis_length);
 
     // Estimate the maximum mapping quality we can get if the alignments based on the good MEMs are the best ones.
@@ -3109,6 +3601,7 @@ Mapper::align_mem_multi(const Alignment& aln,
     // build the clustering model
     // find the alignments that are the best-scoring walks through it
     auto transition_weight = [&](const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
+        read_work.cluster_probes++;
         pos_t m1_pos = make_pos_t(m1.nodes.front());
         pos_t m2_pos = make_pos_t(m2.nodes.front());
         int64_t max_length = aln.sequence().size();
@@ -3131,16 +3624,22 @@ Mapper::align_mem_multi(const Alignment& aln,
     // establish the chains
     vector<vector<MaximalExactMatch> > clusters;
     if (total_multimaps) {
-        MEMChainModel chainer({ aln.sequence().size() }, { mems },
-                              [&](pos_t n) {
-                                  return approx_position(n);
-                              },
-                              [&](pos_t n) -> map<string, vector<pair<size_t, bool> > > {
-                                  return xindex->offsets_in_paths(n);
-                              },
-                              transition_weight,
-                              aln.sequence().size());
-        clusters = chainer.traceback(total_multimaps, false, debug);
+        StageStats::Timer timer(stage_stats, StageStats::CLUSTER);
+        auto position = [&](pos_t n) {
+            return approx_position(n);
+        };
+        auto path_position = [&](pos_t n) -> map<string, vector<pair<size_t, bool> > > {
+            return xindex->offsets_in_paths(n);
+        };
+        unique_ptr<MEMChainModel> chainer;
+        if (sparse_chaining) {
+            chainer = unique_ptr<MEMChainModel>(new MEMChainModel({ aln.sequence().size() }, { mems }, position, path_position,
+                                                                  gap_open, gap_extension, aln.sequence().size()));
+        } else {
+            chainer = unique_ptr<MEMChainModel>(new MEMChainModel({ aln.sequence().size() }, { mems }, position, path_position,
+                                                                  transition_weight, aln.sequence().size()));
+        }
+        clusters = chainer->traceback(total_multimaps, false, debug);
     }
     
     /*
@@ -3196,7 +3695,31 @@ Mapper::align_mem_multi(const Alignment& aln,
         }
     }
 #endif
+    size_t consistent_clusters = clusters.size();
+    if (filter_haplotype_inconsistent_clusters) {
+        auto inconsistent = haplotype_inconsistent_clusters(clusters, aln.sequence().size());
+        if (!inconsistent.empty()) {
+            // align the clusters that some haplotype agrees with first
+            vector<vector<MaximalExactMatch> > reordered;
+            reordered.reserve(clusters.size());
+            for (auto& cluster : clusters) {
+                if (!inconsistent.count(&cluster)) {
+                    reordered.emplace_back(std::move(cluster));
+                }
+            }
+            consistent_clusters = reordered.size();
+            for (auto& cluster : clusters) {
+                if (inconsistent.count(&cluster)) {
+                    reordered.emplace_back(std::move(cluster));
+                }
+            }
+            clusters = std::move(reordered);
+        }
+    }
     auto to_drop = clusters_to_drop(clusters);
+    for (size_t i = consistent_clusters; i < clusters.size(); ++i) {
+        to_drop.insert(&clusters[i]);
+    }
 
     // for up to our required number of multimaps
     // make the perfect-match alignment for the SMEM cluster
@@ -3206,8 +3729,16 @@ Mapper::align_mem_multi(const Alignment& aln,
     set<string> seen_alignments;
     int multimaps = 0;
     int filled = 0;
+    // Scores without traceback only stand in for the final scores when nothing
+    // rescores the alignments after their paths are known.
+    bool score_first = score_before_traceback
+        && include_full_length_bonuses
+        && !strip_bonuses
+        && haplo_score_provider == nullptr;
     for (auto& cluster : clusters) {
         if (alns.size() >= total_multimaps) { break; }
+        // a read that has used up its work budget only gets its best cluster aligned
+        if (filled > 0 && alignment_budget_spent()) { break; }
         // skip if we've filtered the cluster
         if (to_drop.count(&cluster) && filled >= min_multimaps) {
             alns.push_back(aln);
@@ -3215,6 +3746,12 @@ Mapper::align_mem_multi(const Alignment& aln,
             continue;
         }
         ++filled;
+        if (score_first) {
+            // we can't tell duplicates apart until we have their paths
+            alns.push_back(align_cluster(aln, cluster, false));
+            used_clusters.push_back(&cluster);
+            continue;
+        }
         Alignment candidate = align_cluster(aln, cluster, true);
         string sig = signature(candidate);
 
@@ -3235,6 +3772,48 @@ Mapper::align_mem_multi(const Alignment& aln,
         }
     }
     
+    if (score_first) {
+        // Trace back from the best score down until we have enough distinct
+        // alignments to report, and past that for as long as a duplicate could
+        // still pull the mapping quality below the cap. The rest keep their
+        // scores for the mapping quality and are dropped afterward.
+        vector<size_t> order(alns.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+            return alns[i].score() > alns[j].score();
+        });
+        int32_t min_traced_score = order.empty() ? 0 :
+            alns[order.front()].score() - (int32_t) aligner->mapping_quality_score_diff(mq_cap);
+        vector<bool> duplicate(alns.size(), false);
+        int traced = 0;
+        for (size_t i : order) {
+            if (alns[i].score() == 0 || (traced >= keep_multimaps && alns[i].score() < min_traced_score)
+                || (traced > 0 && alignment_budget_spent())) {
+                break;
+            }
+            alns[i] = align_cluster(aln, *used_clusters[i], true);
+            string sig = signature(alns[i]);
+            if (seen_alignments.count(sig)) {
+                duplicate[i] = true;
+            } else {
+                seen_alignments.insert(sig);
+                ++traced;
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < alns.size(); i++) {
+            if (!duplicate[i]) {
+                alns[kept] = alns[i];
+                used_clusters[kept] = used_clusters[i];
+                ++kept;
+            }
+        }
+        alns.resize(kept);
+        used_clusters.resize(kept);
+    }
+    
     assert(alns.size() == used_clusters.size());
 #ifdef debug_mapper
 #pragma omp critical
@@ -3242,7 +3821,7 @@ Mapper::align_mem_multi(const Alignment& aln,
         cerr << "alignments" << endl;
         for (auto& aln : alns) {
             cerr << aln.score();
-            if (aln.score()) cerr << " pos1 " << aln.path().mapping(0).position().node_id() << " ";
+            if (aln.path().mapping_size()) cerr << " pos1 " << aln.path().mapping(0).position().node_id() << " ";
             cerr << endl;
         }
     }
@@ -3274,8 +3853,9 @@ Mapper::align_mem_multi(const Alignment& aln,
                 return
                     aln1->score() == aln2->score()
                     && (aln1->score() == 0
-                        || make_pos_t(aln1->path().mapping(0).position())
-                        == make_pos_t(aln2->path().mapping(0).position()));
+                        || (aln1->path().mapping_size() && aln2->path().mapping_size()
+                            && make_pos_t(aln1->path().mapping(0).position())
+                            == make_pos_t(aln2->path().mapping(0).position())));
             }),
         aln_ptrs.end());
     if (aln_ptrs.size()) {
@@ -3293,6 +3873,13 @@ Mapper::align_mem_multi(const Alignment& aln,
     // compute the mapping quality
     compute_mapping_qualities(alns, cluster_mq, maybe_mq, mq_cap);
 
+    if (score_first) {
+        // alignments we only scored have done their part and have no path to report
+        alns.erase(remove_if(alns.begin(), alns.end(), [](const Alignment& a) {
+                    return a.score() > 0 && a.path().mapping_size() == 0;
+                }), alns.end());
+    }
+
     // final filter step
     filter_and_process_multimaps(alns, keep_multimaps);
 
@@ -3305,10 +3892,14 @@ Mapper::align_mem_multi(const Alignment& aln,
         unaligned.clear_identity();
     }
 
+    // the clusters' hit buffers can serve the next read on this thread
+    MEMHitPool::release(clusters);
+
     return alns;
 }
 
 Alignment Mapper::align_maybe_flip(const Alignment& base, Graph& graph, bool flip, bool traceback, bool acyclic_and_sorted, bool banded_global) {
+    StageStats::Timer timer(stage_stats, StageStats::ALIGN);
     Alignment aln = base;
     map<id_t, int64_t> node_length;
     if (flip) {
@@ -3392,7 +3983,12 @@ Alignment Mapper::align_cluster(const Alignment& aln, const vector<MaximalExactM
         }
     }
     // get the graph with cluster.hpp's cluster_subgraph
-    Graph graph = cluster_subgraph_walk(*xindex, aln, mems, 1);
+    Graph graph;
+    {
+        StageStats::Timer timer(stage_stats, StageStats::SUBGRAPH);
+        Graph walked = cluster_subgraph_walk(*xindex, aln, mems, 1);
+        graph.Swap(&walked);
+    }
     bool acyclic_and_sorted = is_id_sortable(graph) && !has_inversion(graph);
     // and test each direction for which we have MEM hits
     Alignment aln_fwd;
@@ -3918,16 +4514,16 @@ vector<Alignment> Mapper::align_banded(const Alignment& read, int kmer_size, int
             bool above_threshold = false;
             if (aln.score() > 0) {
                 // strip overlaps and re-score the part of the alignment we keep
-                aln = strip_from_start(aln, to_strip[i].first);
-                aln = strip_from_end(aln, to_strip[i].second);
+                strip_from_start_in_place(&aln, to_strip[i].first);
+                strip_from_end_in_place(&aln, to_strip[i].second);
                 aln.set_identity(identity(aln.path()));
                 above_threshold = aln.identity() >= min_identity && mapqual >= min_banded_mq;
             }
             if (!above_threshold) {
                 // treat as unmapped
                 aln = bands[i];
-                aln = strip_from_start(aln, to_strip[i].first);
-                aln = strip_from_end(aln, to_strip[i].second);
+                strip_from_start_in_place(&aln, to_strip[i].first);
+                strip_from_end_in_place(&aln, to_strip[i].second);
             }
         }
     };
@@ -4009,6 +4605,98 @@ vector<Alignment> Mapper::align_banded(const Alignment& read, int kmer_size, int
     return alignments;
 }
 
+vector<Alignment> Mapper::align_chained(const Alignment& read, int max_mem_length, int band_width) {
+
+    auto aligner = get_aligner(!read.quality().empty());
+    int8_t gap_extension = aligner->gap_extension;
+    int8_t gap_open = aligner->gap_open;
+
+    chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+
+    // seed across the whole read at once, rather than band by band
+    double longest_lcp, fraction_filtered;
+    vector<MaximalExactMatch> mems = find_mems_deep(read.sequence().begin(),
+                                                    read.sequence().end(),
+                                                    longest_lcp,
+                                                    fraction_filtered,
+                                                    max_mem_length,
+                                                    min_mem_length,
+                                                    mem_reseed_length,
+                                                    false, true, true, false);
+
+    // chain the MEM hits collinearly in both the read and the graph
+    // gaps that disagree between the two are charged as indels, so long
+    // reads with dispersed errors still chain through
+    auto transition_weight = [&](const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
+        int64_t max_length = read.sequence().size();
+        double overlap_length = mems_overlap_length(m1, m2);
+        int64_t dist_fwd = mem_min_oriented_distances(m1, m2).first;
+        if (dist_fwd > max_length) {
+            return -std::numeric_limits<double>::max();
+        }
+        int read_dist = m2.begin - m1.begin;
+        double jump_fwd = abs(read_dist - dist_fwd);
+        return (double) -(gap_open*(jump_fwd>0) + jump_fwd*gap_extension) - overlap_length;
+    };
+
+    vector<vector<MaximalExactMatch> > chains;
+    {
+        StageStats::Timer timer(stage_stats, StageStats::CLUSTER);
+        auto position = [&](pos_t n) {
+            return approx_position(n);
+        };
+        auto path_position = [&](pos_t n) -> map<string, vector<pair<size_t, bool> > > {
+            return xindex->offsets_in_paths(n);
+        };
+        unique_ptr<MEMChainModel> chainer;
+        if (sparse_chaining) {
+            chainer = unique_ptr<MEMChainModel>(new MEMChainModel({ read.sequence().size() }, { mems }, position, path_position,
+                                                                  gap_open, gap_extension, read.sequence().size()));
+        } else {
+            chainer = unique_ptr<MEMChainModel>(new MEMChainModel({ read.sequence().size() }, { mems }, position, path_position,
+                                                                  transition_weight, read.sequence().size()));
+        }
+        chains = chainer->traceback(max(max_multimaps, band_multimaps), false, debug);
+    }
+    MEMHitPool::release(mems);
+
+    // lay each chain's anchors down as exact matches, then fill in only the
+    // unaligned gaps between them with local DP against the graph around the
+    // flanking anchors, so memory scales with the gaps and not the read
+    vector<Alignment> alignments;
+    set<string> seen_alignments;
+    for (auto& chain : chains) {
+        if (chain.empty()) continue;
+        sort(chain.begin(), chain.end(), [](const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
+                return m1.begin < m2.begin || (m1.begin == m2.begin && m1.end > m2.end);
+            });
+        Alignment aln = patch_alignment(mems_to_alignment(read, chain), band_width);
+        string sig = signature(aln);
+        if (!seen_alignments.count(sig)) {
+            alignments.push_back(aln);
+            seen_alignments.insert(sig);
+        }
+    }
+
+    std::sort(alignments.begin(), alignments.end(), [](const Alignment& aln1, const Alignment& aln2) { return aln1.score() > aln2.score(); });
+    if (alignments.empty()) {
+        alignments.push_back(read);
+        auto& aln = alignments.back();
+        aln.clear_score();
+        aln.clear_path();
+        aln.clear_identity();
+        aln.clear_mapping_quality();
+    } else if (alignments.size() == 1) {
+        alignments.front().set_mapping_quality(max_mapping_quality);
+    } else {
+        compute_mapping_qualities(alignments, 0, max_mapping_quality, max_mapping_quality);
+        filter_and_process_multimaps(alignments, max_multimaps);
+    }
+    chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+    alignments.front().set_time_used(chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count());
+    return alignments;
+}
+
 bool Mapper::adjacent_positions(const Position& pos1, const Position& pos2) {
     // are they the same id, with offset differing by 1?
     if (pos1.node_id() == pos2.node_id()
@@ -4034,6 +4722,7 @@ bool Mapper::adjacent_positions(const Position& pos1, const Position& pos2) {
 }
 
 void Mapper::compute_mapping_qualities(vector<Alignment>& alns, double cluster_mq, double mq_estimate, double mq_cap) {
+    StageStats::Timer timer(stage_stats, StageStats::MAPQ);
     if (alns.empty()) return;
     double max_mq = min(mq_cap, (double)max_mapping_quality);
     BaseAligner* aligner = get_aligner();
@@ -4051,6 +4740,7 @@ void Mapper::compute_mapping_qualities(vector<Alignment>& alns, double cluster_m
 }
     
 void Mapper::compute_mapping_qualities(pair<vector<Alignment>, vector<Alignment>>& pair_alns, double cluster_mq, double mq_estimate1, double mq_estimate2, double mq_cap1, double mq_cap2) {
+    StageStats::Timer timer(stage_stats, StageStats::MAPQ);
     if (pair_alns.first.empty() || pair_alns.second.empty()) return;
     double max_mq1 = min(mq_cap1, (double)max_mapping_quality);
     double max_mq2 = min(mq_cap2, (double)max_mapping_quality);
@@ -4149,13 +4839,150 @@ void Mapper::filter_and_process_multimaps(vector<Alignment>& sorted_unique_align
 }
     
 vector<Alignment> Mapper::align_multi(const Alignment& aln, int kmer_size, int stride, int max_mem_length, int band_width, int band_overlap) {
+    string cache_key;
+    if (result_cache) {
+        cache_key = result_cache_key(aln, kmer_size, stride, max_mem_length, band_width, band_overlap);
+        vector<Alignment> cached;
+        if (result_cache->lookup(cache_key, cached)) {
+            adopt_cached_results(aln, cached);
+            return cached;
+        }
+    }
+    start_read_work();
     double cluster_mq = 0;
     Alignment clean_aln;
     clean_aln.set_name(aln.name());
     clean_aln.set_sequence(aln.sequence());
     clean_aln.set_quality(aln.quality());
     clean_aln.clear_refpos();
-    return align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, band_overlap, cluster_mq, max_multimaps, extra_multimaps, nullptr);
+    vector<Alignment> results = align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, band_overlap, cluster_mq, max_multimaps, extra_multimaps, nullptr);
+    annotate_budget_limited(results);
+    log_slow_read(aln);
+    if (result_cache) {
+        result_cache->store(cache_key, results);
+    }
+    return results;
+}
+
+string Mapper::result_cache_key(const Alignment& aln, int kmer_size, int stride, int max_mem_length,
+                                int band_width, int band_overlap) const {
+    // the qualities only change the result if we align with them
+    return result_cache->key(aln.sequence(), adjust_alignments_for_base_quality ? aln.quality() : string(),
+                             {kmer_size, stride, max_mem_length, band_width, band_overlap,
+                              max_multimaps, extra_multimaps});
+}
+
+void Mapper::adopt_cached_results(const Alignment& aln, vector<Alignment>& results) const {
+    for (Alignment& result : results) {
+        result.set_name(aln.name());
+        result.set_quality(aln.quality());
+    }
+    if (!results.empty()) {
+        // we spent no time mapping this copy of the read
+        results.front().set_time_used(0);
+    }
+}
+    
+vector<vector<Alignment>> Mapper::align_multi_batch(const vector<Alignment>& alns, int kmer_size, int stride, int max_mem_length, int band_width, int band_overlap) {
+    
+    vector<vector<Alignment>> results(alns.size());
+    
+    // strip down to what align_multi would look at
+    vector<Alignment> clean_alns(alns.size());
+    for (size_t i = 0; i < alns.size(); i++) {
+        clean_alns[i].set_name(alns[i].name());
+        clean_alns[i].set_sequence(alns[i].sequence());
+        clean_alns[i].set_quality(alns[i].quality());
+    }
+    
+    // take the reads we've already mapped a duplicate of out of the batch (align_multi
+    // checks the cache itself for reads too long to batch)
+    vector<string> cache_keys;
+    vector<bool> cached(alns.size(), false);
+    if (result_cache) {
+        cache_keys.resize(alns.size());
+        for (size_t i = 0; i < alns.size(); i++) {
+            if (clean_alns[i].sequence().size() > band_width) {
+                continue;
+            }
+            cache_keys[i] = result_cache_key(clean_alns[i], kmer_size, stride, max_mem_length, band_width, band_overlap);
+            if (result_cache->lookup(cache_keys[i], results[i])) {
+                adopt_cached_results(clean_alns[i], results[i]);
+                cached[i] = true;
+            }
+        }
+    }
+    
+    // stage 1: find the MEMs for every read that isn't going to be banded
+    vector<vector<MaximalExactMatch>> mems(alns.size());
+    // which reads skipped reseeding to stay in their work budget
+    vector<bool> seeding_limited(alns.size(), false);
+    vector<double> longest_lcp(alns.size(), 0);
+    vector<double> fraction_filtered(alns.size(), 0);
+    vector<chrono::high_resolution_clock::duration> read_time(alns.size());
+    chrono::high_resolution_clock::time_point stage_start = chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < clean_alns.size(); i++) {
+        const string& seq = clean_alns[i].sequence();
+        if (cached[i] || seq.size() > band_width) {
+            continue;
+        }
+        chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+        start_read_work();
+        mems[i] = find_mems_deep(seq.begin(),
+                                 seq.end(),
+                                 longest_lcp[i],
+                                 fraction_filtered[i],
+                                 max_mem_length,
+                                 min_mem_length,
+                                 mem_reseed_length,
+                                 false, true, true, false);
+        seeding_limited[i] = read_work.limited;
+        read_time[i] = chrono::high_resolution_clock::now() - t1;
+    }
+    chrono::high_resolution_clock::time_point stage_end = chrono::high_resolution_clock::now();
+    batch_timing.seed_seconds += chrono::duration<double>(stage_end - stage_start).count();
+    
+    // stage 2: cluster, align, and compute mapping qualities
+    stage_start = stage_end;
+    int additional_multimaps_for_quality = multimaps_for_quality(extra_multimaps);
+    for (size_t i = 0; i < clean_alns.size(); i++) {
+        if (cached[i]) {
+            continue;
+        }
+        if (clean_alns[i].sequence().size() > band_width) {
+            results[i] = align_multi(clean_alns[i], kmer_size, stride, max_mem_length, band_width, band_overlap);
+            continue;
+        }
+        chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+        start_read_work();
+        read_work.limited = seeding_limited[i];
+        double cluster_mq = 0;
+        results[i] = align_mem_multi(clean_alns[i], mems[i], cluster_mq, longest_lcp[i], fraction_filtered[i],
+                                     max_mem_length, max_multimaps, additional_multimaps_for_quality);
+        annotate_with_initial_path_positions(results[i]);
+        annotate_budget_limited(results[i]);
+        read_time[i] += chrono::high_resolution_clock::now() - t1;
+        results[i].front().set_time_used(chrono::duration_cast<chrono::microseconds>(read_time[i]).count());
+        // hand the hit buffers back for the next batch
+        MEMHitPool::release(mems[i]);
+        if (result_cache) {
+            result_cache->store(cache_keys[i], results[i]);
+        }
+    }
+    batch_timing.align_seconds += chrono::duration<double>(chrono::high_resolution_clock::now() - stage_start).count();
+    
+    batch_timing.batches++;
+    batch_timing.reads += alns.size();
+    
+    return results;
+}
+
+int Mapper::multimaps_for_quality(int additional_multimaps) const {
+    // try to get at least 2 multimaps so that we can calculate mapping quality
+    if (additional_multimaps == 0 && max_multimaps == 1 && mapping_quality_method != None) {
+        return 1;
+    }
+    return additional_multimaps;
 }
     
 vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality,
@@ -4197,19 +5024,15 @@ vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality,
 #pragma omp critical
         if (debug) cerr << "switching to banded alignment" << endl;
 #endif
+        if (chain_long_reads) {
+            return align_chained(aln, max_mem_length, band_width);
+        }
         return vector<Alignment>{align_banded(aln, kmer_size, stride, max_mem_length, band_width, band_overlap)};
     }
 
     chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
 
-    // try to get at least 2 multimaps so that we can calculate mapping quality
-    int additional_multimaps_for_quality;
-    if (additional_multimaps == 0 && max_multimaps == 1 && mapping_quality_method != None) {
-        additional_multimaps_for_quality = 1;
-    }
-    else {
-        additional_multimaps_for_quality = additional_multimaps;
-    }
+    int additional_multimaps_for_quality = multimaps_for_quality(additional_multimaps);
 
     double longest_lcp, fraction_filtered;
     vector<Alignment> alignments;
@@ -4230,6 +5053,8 @@ vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality,
                                                         false, true, true, false);
         // query mem hits
         alignments = align_mem_multi(aln, mems, cluster_mq, longest_lcp, fraction_filtered, max_mem_length, keep_multimaps, additional_multimaps_for_quality);
+        // hand the hit buffers back for the next read on this thread
+        MEMHitPool::release(mems);
     }
 
 #ifdef debug_mapper
@@ -4285,6 +5110,13 @@ set<pos_t> gcsa_nodes_to_positions(const vector<gcsa::node_type>& nodes) {
 
 
 int64_t Mapper::graph_distance(pos_t pos1, pos_t pos2, int64_t maximum) {
+    if (distance_index) {
+        int64_t distance = distance_index->min_distance(pos1, pos2);
+        if (distance != SnarlDistanceIndex::UNKNOWN) {
+            // cut off where xg_distance would have given up
+            return distance <= maximum + 1 ? distance : numeric_limits<int64_t>::max();
+        }
+    }
     return xg_distance(pos1, pos2, maximum, xindex);
 }
 
@@ -4617,9 +5449,9 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length, bo
                     }
 #endif
                     assert(band.sequence().size() > to_strip[k].first + to_strip[k].second);
-                    band = strip_from_start(band, to_strip[k].first);
-                    band = strip_from_end(band, to_strip[k].second);
-                    band = simplify(band);
+                    strip_from_start_in_place(&band, to_strip[k].first);
+                    strip_from_end_in_place(&band, to_strip[k].second);
+                    simplify_in_place(&band);
                     band.set_identity(identity(band.path()));
                     // update the reference end position
                     if (band.has_path()) {
@@ -4690,7 +5522,8 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length, bo
                     cerr << "band: " << pb2json(band) << endl;
                 }
                 */
-                patch = simplify(merge_alignments(bands));
+                patch = merge_alignments(bands);
+                simplify_in_place(&patch);
                 if (patch.sequence() != edit.sequence()) {
                     cerr << "sequence mismatch" << endl;
                     cerr << "seq_expect: " << edit.sequence() << endl;
@@ -4741,7 +5574,7 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length, bo
         }
     };
     clear_positions(patched);
-    patched = simplify(patched, trim_internal_deletions);
+    simplify_in_place(&patched, trim_internal_deletions);
     // set the identity
     patched.set_identity(identity(patched.path()));
     // recompute the score
@@ -4810,7 +5643,7 @@ Alignment Mapper::mems_to_alignment(const Alignment& aln, const vector<MaximalEx
             // use the end of the last mem we touched (we may have skipped several)
             int overlap = last_end - mem.begin;
             if (overlap > 0) {
-                aln = strip_from_start(aln, overlap);
+                strip_from_start_in_place(&aln, overlap);
             }
         }
         alns.push_back(aln);
@@ -4823,7 +5656,8 @@ Alignment Mapper::mems_to_alignment(const Alignment& aln, const vector<MaximalEx
     alns.emplace_back();
     alns.back().set_sequence(aln.sequence().substr(start, length));
 
-    auto alnm = simplify(merge_alignments(alns));
+    auto alnm = merge_alignments(alns);
+    simplify_in_place(&alnm);
     *alnm.mutable_quality() = aln.quality();
     alnm.set_name(aln.name());
     alnm.set_score(score_alignment(alnm));
@@ -5019,7 +5853,8 @@ vector<Alignment> AlignmentChainModel::traceback(const Alignment& read, int alt_
     for (auto& trace : traces) {
         alns.emplace_back();
         Alignment& merged = alns.back();
-        merged = simplify(merge_alignments(trace));
+        merged = merge_alignments(trace);
+        simplify_in_place(&merged);
         merged.set_identity(identity(merged.path()));
         merged.set_quality(read.quality());
         merged.set_name(read.name());
@@ -5049,14 +5884,26 @@ void AlignmentChainModel::display(ostream& out) {
     }
 }
 
+const int64_t FragmentLengthDistribution::NO_SAMPLE = numeric_limits<int64_t>::min();
+
 FragmentLengthDistribution::FragmentLengthDistribution(size_t maximum_sample_size,
                                                        size_t reestimation_frequency,
                                                        double robust_estimation_fraction) :
+    samples(new atomic<int64_t>[maximum_sample_size]),
+    num_claimed(0),
+    is_fixed(false),
+    robust_estimation_fraction(robust_estimation_fraction),
     maximum_sample_size(maximum_sample_size),
     reestimation_frequency(reestimation_frequency),
-    robust_estimation_fraction(robust_estimation_fraction)
+    mu(0.0),
+    sigma(1.0),
+    version(0),
+    estimated_count(0)
 {
     assert(0.0 < robust_estimation_fraction && robust_estimation_fraction < 1.0);
+    for (size_t i = 0; i < maximum_sample_size; i++) {
+        samples[i].store(NO_SAMPLE, memory_order_relaxed);
+    }
 }
 
 FragmentLengthDistribution::FragmentLengthDistribution() : FragmentLengthDistribution(0, 1, 0.5)
@@ -5068,73 +5915,148 @@ FragmentLengthDistribution::~FragmentLengthDistribution() {
     
 }
 
+FragmentLengthDistribution::FragmentLengthDistribution(const FragmentLengthDistribution& other) :
+    FragmentLengthDistribution(other.maximum_sample_size, other.reestimation_frequency,
+                               other.robust_estimation_fraction)
+{
+    *this = other;
+}
+
+FragmentLengthDistribution& FragmentLengthDistribution::operator=(const FragmentLengthDistribution& other) {
+    if (this != &other) {
+        if (maximum_sample_size != other.maximum_sample_size) {
+            samples.reset(new atomic<int64_t>[other.maximum_sample_size]);
+        }
+        maximum_sample_size = other.maximum_sample_size;
+        reestimation_frequency = other.reestimation_frequency;
+        robust_estimation_fraction = other.robust_estimation_fraction;
+        for (size_t i = 0; i < maximum_sample_size; i++) {
+            samples[i].store(other.samples[i].load());
+        }
+        num_claimed.store(other.num_claimed.load());
+        is_fixed.store(other.is_fixed.load());
+        auto other_parameters = other.parameters();
+        mu.store(other_parameters.first);
+        sigma.store(other_parameters.second);
+        estimated_count = other.estimated_count;
+    }
+    return *this;
+}
+
 void FragmentLengthDistribution::force_parameters(double mean, double stddev) {
-    mu = mean;
-    sigma = stddev;
-    is_fixed = true;
+    // nothing estimated later may replace these
+    publish(mean, stddev, numeric_limits<size_t>::max());
+    is_fixed.store(true);
+}
+
+void FragmentLengthDistribution::publish(double mean, double stddev, size_t count) {
+    lock_guard<mutex> lock(estimate_mutex);
+    if (count < estimated_count) {
+        // a thread with more measurements got here first
+        return;
+    }
+    estimated_count = count;
+    // bracket the stores with an odd version so readers never mix two estimates
+    size_t start = version.load(memory_order_relaxed);
+    version.store(start + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    mu.store(mean, memory_order_relaxed);
+    sigma.store(stddev, memory_order_relaxed);
+    version.store(start + 2, memory_order_release);
 }
 
 void FragmentLengthDistribution::register_fragment_length(int64_t length) {
-    // allow this function to operate fully in parallel once the distribution is
-    // fixed (and hence threadsafe)
-    if (is_fixed) {
+    // allow this function to return right away once the distribution is fixed
+    if (is_fixed.load(memory_order_acquire)) {
         return;
     }
-#pragma omp critical
-    {
-        // in case the distribution became fixed while this thread was waiting
-        // to execute the critical block
-        if (!is_fixed) {
-            lengths.insert((double) length);
-            if (lengths.size() == maximum_sample_size) {
-                // we've reached the maximum sample we wanted, so fix the estimation
-                estimate_distribution();
-                is_fixed = true;
-            }
-            else if (lengths.size() % reestimation_frequency == 0) {
-                estimate_distribution();
+    size_t slot = num_claimed.fetch_add(1, memory_order_relaxed);
+    if (slot >= maximum_sample_size) {
+        // other threads filled the sample while we were measuring
+        return;
+    }
+    samples[slot].store(length, memory_order_release);
+    
+    if (slot + 1 == maximum_sample_size) {
+        // we've claimed the last slot, so wait for the other threads to finish
+        // writing theirs and fix the estimation
+        for (size_t i = 0; i < maximum_sample_size; i++) {
+            while (samples[i].load(memory_order_acquire) == NO_SAMPLE) {
+                this_thread::yield();
             }
         }
+        estimate_distribution(maximum_sample_size);
+        is_fixed.store(true, memory_order_release);
+    }
+    else if (reestimation_frequency > 0 && (slot + 1) % reestimation_frequency == 0) {
+        estimate_distribution(slot + 1);
     }
 }
     
-void FragmentLengthDistribution::estimate_distribution() {
-    // remove the tails from the estimation
+void FragmentLengthDistribution::estimate_distribution(size_t count) {
+    vector<double> lengths;
+    lengths.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        int64_t length = samples[i].load(memory_order_acquire);
+        if (length != NO_SAMPLE) {
+            lengths.push_back(length);
+        }
+    }
+    if (lengths.empty()) {
+        return;
+    }
+    
+    // remove the tails from the estimation, by partitioning the measurements
+    // that are kept into the middle
     size_t to_skip = (size_t) (lengths.size() * (1.0 - robust_estimation_fraction) * 0.5);
-    auto begin = lengths.begin();
-    auto end = lengths.end();
-    for (size_t i = 0; i < to_skip; i++) {
-        begin++;
-        end--;
-        
+    auto begin = lengths.begin() + to_skip;
+    auto end = lengths.end() - to_skip;
+    if (to_skip > 0) {
+        nth_element(lengths.begin(), begin, lengths.end());
+        nth_element(begin, end, lengths.end());
     }
     // compute cumulants
-    double count = 0.0;
+    double num = 0.0;
     double sum = 0.0;
     double sum_of_sqs = 0.0;
     for (auto iter = begin; iter != end; iter++) {
-        count += 1.0;
+        num += 1.0;
         sum += *iter;
         sum_of_sqs += (*iter) * (*iter);
     }
     // use cumulants to compute moments
-    mu = sum / count;
-    double raw_var = sum_of_sqs / count - mu * mu;
+    double mean = sum / num;
+    double raw_var = sum_of_sqs / num - mean * mean;
     // apply method of moments estimation using the appropriate truncated normal distribution
     double a = normal_inverse_cdf(1.0 - 0.5 * (1.0 - robust_estimation_fraction));
-    sigma = sqrt(raw_var / (1.0 - 2.0 * a * normal_pdf(a, 0.0, 1.0)));
+    publish(mean, sqrt(raw_var / (1.0 - 2.0 * a * normal_pdf(a, 0.0, 1.0))), count);
 }
     
 double FragmentLengthDistribution::mean() const {
-    return mu;
+    return parameters().first;
 }
 
 double FragmentLengthDistribution::stdev() const {
-    return sigma;
+    return parameters().second;
+}
+
+pair<double, double> FragmentLengthDistribution::parameters() const {
+    while (true) {
+        size_t start = version.load(memory_order_acquire);
+        if (start % 2 == 0) {
+            double mean = mu.load(memory_order_relaxed);
+            double stddev = sigma.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (version.load(memory_order_relaxed) == start) {
+                return make_pair(mean, stddev);
+            }
+        }
+        this_thread::yield();
+    }
 }
 
 bool FragmentLengthDistribution::is_finalized() const {
-    return is_fixed;
+    return is_fixed.load(memory_order_acquire);
 }
     
 size_t FragmentLengthDistribution::max_sample_size() const {
@@ -5142,14 +6064,18 @@ size_t FragmentLengthDistribution::max_sample_size() const {
 }
     
 size_t FragmentLengthDistribution::curr_sample_size() const {
-    return lengths.size();
+    return min(num_claimed.load(memory_order_relaxed), maximum_sample_size);
 }
     
-multiset<double>::const_iterator FragmentLengthDistribution::measurements_begin() const {
-    return lengths.begin();
-}
-
-multiset<double>::const_iterator FragmentLengthDistribution::measurements_end() const {
-    return lengths.end();
+vector<double> FragmentLengthDistribution::measurements() const {
+    vector<double> lengths;
+    for (size_t i = 0; i < curr_sample_size(); i++) {
+        int64_t length = samples[i].load();
+        if (length != NO_SAMPLE) {
+            lengths.push_back(length);
+        }
+    }
+    sort(lengths.begin(), lengths.end());
+    return lengths;
 }
 }
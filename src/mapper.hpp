@@ -5,6 +5,9 @@
 #include <map>
 #include <chrono>
 #include <ctime>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include "omp.h"
 #include "vg.hpp"
 #include "xg.hpp"
@@ -13,6 +16,7 @@
 #include <gcsa/lcp.h>
 #include <gbwt/gbwt.h>
 #include "alignment.hpp"
+#include "annotation.hpp"
 #include "path.hpp"
 #include "position.hpp"
 #include "xg_position.hpp"
@@ -26,6 +30,13 @@
 #include "translator.hpp"
 // TODO: pull out ScoreProvider into its own file
 #include "haplotypes.hpp"
+#include "stage_stats.hpp"
+#include "mapper_calibration.hpp"
+#include "rescue_window.hpp"
+#include "minimizer_index.hpp"
+#include "snarl_distance_index.hpp"
+#include "read_result_cache.hpp"
+#include "slow_read_log.hpp"
 #include "algorithms/topological_sort.hpp"
 
 namespace vg {
@@ -83,6 +94,14 @@ public:
 /*
  * A class that keeps a running estimation of a fragment length distribution
  * using a robust estimation formula in order to be insensitive to outliers.
+ *
+ * Measurements can be registered from many threads at once without locking.
+ * Each one claims the next slot of a preallocated sample array with an atomic
+ * counter. The thread that fills a reestimation point reestimates from the
+ * measurements written so far, and the thread that fills the last slot
+ * finalizes the estimate. Estimates are published one at a time, and one
+ * made from fewer measurements than the last published one is dropped, so
+ * a slow reestimate can't replace the final one.
  */
 class FragmentLengthDistribution {
 public:
@@ -99,11 +118,15 @@ public:
     FragmentLengthDistribution(void);
     ~FragmentLengthDistribution();
     
+    /// Copy a distribution. Must not race with registering measurements.
+    FragmentLengthDistribution(const FragmentLengthDistribution& other);
+    FragmentLengthDistribution& operator=(const FragmentLengthDistribution& other);
+    
     
     /// Instead of estimating anything, just use these parameters.
     void force_parameters(double mean, double stddev);
     
-    /// Record an observed fragment length
+    /// Record an observed fragment length. Safe to call from multiple threads.
     void register_fragment_length(int64_t length);
 
     /// Robust mean of the distribution observed so far
@@ -112,6 +135,9 @@ public:
     /// Robust standard deviation of the distribution observed so far
     double stdev() const;
     
+    /// Robust mean and standard deviation, both from the same estimate
+    pair<double, double> parameters() const;
+    
     /// Returns true if the maximum sample size has been reached, which finalizes the
     /// distribution estimate
     bool is_finalized() const;
@@ -123,26 +149,39 @@ public:
     /// Returns the number of samples that have been collected so far
     size_t curr_sample_size() const;
     
-    /// Begin iterator to the measurements that the distribution has used to estimate the
-    /// parameters
-    multiset<double>::const_iterator measurements_begin() const;
-    
-    /// End iterator to the measurements that the distribution has used to estimate the
-    /// parameters
-    multiset<double>::const_iterator measurements_end() const;
+    /// The measurements that the distribution has used to estimate the parameters, in
+    /// sorted order. Must not race with registering measurements.
+    vector<double> measurements() const;
     
 private:
-    multiset<double> lengths;
-    bool is_fixed = false;
+    /// Marks a sample slot that no thread has filled yet
+    static const int64_t NO_SAMPLE;
+    
+    /// One slot per measurement up to the maximum sample size
+    unique_ptr<atomic<int64_t>[]> samples;
+    /// Slots handed out so far, which keeps counting past the maximum sample size
+    atomic<size_t> num_claimed;
+    atomic<bool> is_fixed;
     
     double robust_estimation_fraction;
     size_t maximum_sample_size;
     size_t reestimation_frequency;
     
-    double mu = 0.0;
-    double sigma = 1.0;
+    atomic<double> mu;
+    atomic<double> sigma;
+    /// Odd while mu and sigma are being replaced, so readers can retry
+    atomic<size_t> version;
     
-    void estimate_distribution();
+    /// Held while publishing an estimate
+    mutex estimate_mutex;
+    /// Measurements the published estimate was made from
+    size_t estimated_count;
+    
+    /// Estimate the parameters from the filled slots among the first count
+    void estimate_distribution(size_t count);
+    
+    /// Replace mu and sigma, unless they already come from more measurements
+    void publish(double mean, double stddev, size_t count);
 };
     
 class BaseMapper : public Progressive {
@@ -157,6 +196,11 @@ public:
     
     double estimate_gc_content(void);
     
+    /// Use precomputed graph statistics instead of working them out from the
+    /// indexes wherever they are available. Must be called before the
+    /// alignment scores are set for the GC content to be used.
+    void set_calibration(const MapperCalibration& calibration);
+    
     int random_match_length(double chance_random);
    
     void load_scoring_matrix(std::ifstream& matrix_stream);
@@ -164,6 +208,10 @@ public:
     void set_alignment_scores(int8_t match, int8_t mismatch, int8_t gap_open, int8_t gap_extend, int8_t full_length_bonus,
         double haplotype_consistency_exponent = 1);
     
+    /// Set whether banded global alignments stop filling the DP where the score drops too far
+    /// (see BaseAligner::xdrop). Survives the aligners being recreated.
+    void set_xdrop(bool use_xdrop);
+    
     // TODO: setting alignment threads could mess up the internal memory for how many threads to reset to
     void set_fragment_length_distr_params(size_t maximum_sample_size = 1000, size_t reestimation_frequency = 1000,
                                           double robust_estimation_fraction = 0.95);
@@ -211,6 +259,20 @@ public:
                      int min_mem_length = 1,
                      int reseed_length = 0);
     
+    /// Use the minimizer index to find seeds, as MEMs of length k with the
+    /// minimizers' graph positions as hits. As with GCSA MEMs, seeds with
+    /// more than hit_max hits keep their count but are left unfilled.
+    vector<MaximalExactMatch>
+    find_minimizer_seeds(string::const_iterator seq_begin,
+                         string::const_iterator seq_end);
+    
+    /// Precompute the GCSA ranges of every k-mer of the given length over ACGT,
+    /// so the MEM finders can replace the first length dependent LF steps of
+    /// each search that restarts from the whole index with one table lookup.
+    /// Called with the default length by the constructor; 0 disables the
+    /// table. Must be called again if gcsa is replaced.
+    void build_mem_kmer_table(int length = 8);
+    
     /// identifies tracts of order-length MEMs that were unfilled because their hit count was above the max
     /// and fills one MEM in the tract (the one with the smallest hit count), assumes MEMs are lexicographically
     /// ordered by read index
@@ -232,6 +294,7 @@ public:
     int min_mem_length; // a mem must be >= this length
     int mem_reseed_length; // the length above which we reseed MEMs to get potentially missed hits
     bool fast_reseed = true; // use the fast reseed algorithm
+    bool lcp_reseed = false; // use the single-pass LCP reseed algorithm (takes precedence over fast_reseed)
     double fast_reseed_length_diff = 0.45; // how much smaller than its parent a sub-MEM can be in the fast reseed algorithm
     bool adaptive_reseed_diff = true; // use an adaptive length difference algorithm in reseed algorithm
     double adaptive_diff_exponent = 0.065; // exponent that describes limiting behavior of adaptive diff algorithm
@@ -241,6 +304,18 @@ public:
     int max_sub_mem_recursion_depth = 2;
     int unpaired_penalty = 17;
     bool precollapse_order_length_hits = true;
+    double min_mem_entropy = 0; // drop MEMs lying entirely in windows with less entropy (bits) than this
+    int mem_entropy_window = 16; // the window size for the MEM entropy filter
+    
+    /// If set, the MEM finders take their seeds from the minimizers of this
+    /// index instead of searching the GCSA. Each seed is a single k-long
+    /// minimizer hit, so there are no sub-MEMs, and the GCSA is not needed.
+    MinimizerIndex* minimizer_index = nullptr;
+    
+    /// If set, graph distances and the clusterer's strand distances are
+    /// looked up in this index, falling back on searching the XG for the
+    /// queries it can't answer.
+    SnarlDistanceIndex* distance_index = nullptr;
     
     // Remove any bonuses used by the aligners from the final reported scores.
     // Does NOT (yet) remove the haplotype consistency bonus.
@@ -254,7 +329,72 @@ public:
     /// Set to enable debugging messages to cerr from the mapper, so a user can understand why a read maps the way it does.
     bool debug = false;
     
+    /// If set, time spent in each stage of mapping is added to these totals
+    StageStats* stage_stats = nullptr;
+    
+    /// Limits on the work spent mapping one read (or pair), so a few
+    /// pathological reads can't hold up the rest. Work is counted, not timed,
+    /// so a read maps the same way every time. 0 means no limit. Past the LF
+    /// step limit, MEMs are no longer reseeded; past the distance probe or DP
+    /// cell limit, only the best cluster is aligned. Reads that were cut short
+    /// get a "budget_limited" annotation.
+    size_t max_lf_steps_per_read = 0;
+    size_t max_cluster_probes_per_read = 0;
+    size_t max_dp_cells_per_read = 0;
+    
+    /// If set, reads that take too long to map are written here, with their
+    /// stage times and work counts.
+    SlowReadLog* slow_read_log = nullptr;
+    
 protected:
+    
+    /// The work done so far on the read this thread is mapping
+    struct ReadWork {
+        /// LF steps taken in MEM finding and reseeding
+        size_t lf_steps = 0;
+        /// Distances between hits probed in clustering
+        size_t cluster_probes = 0;
+        /// Dynamic programming cells filled in alignment
+        size_t dp_cells = 0;
+        /// Did we skip any work because the budget was spent?
+        bool limited = false;
+        /// When we started mapping the read
+        chrono::steady_clock::time_point start;
+    };
+    
+    thread_local static ReadWork read_work;
+    
+    /// Start counting work for a new read on this thread.
+    void start_read_work() const;
+    
+    /// If we have a slow read log, offer it the read we just finished.
+    void log_slow_read(const Alignment& read) const;
+    
+    /// If we have a slow read log, offer it the pair we just finished.
+    void log_slow_read(const Alignment& read1, const Alignment& read2) const;
+    
+    /// Has the read used up its LF steps? Marks the read as limited if so,
+    /// since the caller is about to skip work.
+    bool lf_budget_spent() const;
+    
+    /// Has the read used up its distance probes or DP cells? Marks the read
+    /// as limited if so, since the caller is about to skip work.
+    bool alignment_budget_spent() const;
+    
+    /// Add the DP cells of aligning a read to a graph to the read's work.
+    void count_dp_cells(const string& sequence, const Graph& graph) const;
+    
+    /// If the read was cut short, say so on its alignments and count it.
+    template<typename Annotated>
+    void annotate_budget_limited(vector<Annotated>& alns) const;
+    
+    /// If the read pair was cut short, say so on both mates and count it.
+    template<typename Annotated>
+    void annotate_budget_limited(vector<pair<Annotated, Annotated>>& aln_pairs) const;
+    
+    /// Precomputed graph statistics, where we have them
+    MapperCalibration calibration;
+    
     /// Locate the sub-MEMs contained in the last MEM of the mems vector that have ending positions
     /// before the end the next SMEM, label each of the sub-MEMs with the indices of all of the SMEMs
     /// that contain it
@@ -278,21 +418,33 @@ protected:
                             int min_sub_mem_length,
                             vector<pair<MaximalExactMatch, vector<size_t>>>& sub_mems_out);
     
+    /// Provides same semantics as find_sub_mems, but makes a single right-to-left pass over the parent
+    /// MEM. After each sub-MEM, the LCP array's parent interval is used to continue the search from
+    /// where it stopped, and counts are only checked at doubling steps and then binary searched over
+    /// the saved ranges, so no LF step is repeated.
+    void find_sub_mems_lcp(const vector<MaximalExactMatch>& mems,
+                           int parent_layer_begin,
+                           int parent_layer_end,
+                           int mem_idx,
+                           string::const_iterator next_mem_end,
+                           int min_sub_mem_length,
+                           vector<pair<MaximalExactMatch, vector<size_t>>>& sub_mems_out);
+    
     /// finds the nodes of sub MEMs that do not occur inside parent MEMs, each sub MEM should be associated
     /// with a vector of the indices of the SMEMs that contain it in the parent MEMs vector
     void fill_nonredundant_sub_mem_nodes(vector<MaximalExactMatch>& parent_mems,
                                          vector<pair<MaximalExactMatch, vector<size_t> > >::iterator sub_mem_records_begin,
                                          vector<pair<MaximalExactMatch, vector<size_t> > >::iterator sub_mem_records_end);
     
-    /// fills a vector where each element contains the set of positions in the graph that the
-    /// MEM touches at that index for the first MEM hit in the GCSA array
+    /// fills a vector where each element contains the set of positions in the graph (packed
+    /// as GCSA nodes) that the MEM touches at that index for the first MEM hit in the GCSA array
     void first_hit_positions_by_index(MaximalExactMatch& mem,
-                                      vector<set<pos_t>>& positions_by_index_out);
+                                      vector<unordered_set<gcsa::node_type>>& positions_by_index_out);
     
-    /// fills a vector where each element contains the set of positions in the graph that the
-    /// MEM touches at that index starting at a given hit
-    void mem_positions_by_index(MaximalExactMatch& mem, pos_t hit_pos,
-                                vector<set<pos_t>>& positions_by_index_out);
+    /// fills a vector where each element contains the set of positions in the graph (packed
+    /// as GCSA nodes) that the MEM touches at that index starting at a given hit
+    void mem_positions_by_index(MaximalExactMatch& mem, gcsa::node_type hit,
+                                vector<unordered_set<gcsa::node_type>>& positions_by_index_out);
     
     // use the xg index to get a character at a particular position (rc or foward)
     char pos_char(pos_t pos);
@@ -331,6 +483,25 @@ protected:
     gcsa::GCSA* gcsa = nullptr;
     gcsa::LCPArray* lcp = nullptr;
     
+    // GCSA ranges for all k-mers of length mem_kmer_table_length, indexed by
+    // their 2-bit encoding (first base most significant), for the GCSA at
+    // mem_kmer_table_gcsa
+    vector<gcsa::range_type> mem_kmer_ranges;
+    int mem_kmer_table_length = 0;
+    const gcsa::GCSA* mem_kmer_table_gcsa = nullptr;
+    
+    /// If the search for seq up to cursor is starting over from the whole
+    /// index, and the next mem_kmer_table_length bases back from cursor are
+    /// all ACGT and occur in the index, set range to their range, move cursor
+    /// past them and return true. Otherwise leave everything alone and return
+    /// false.
+    bool jump_mem_kmer(string::const_iterator seq_begin, string::const_iterator& cursor,
+                       gcsa::range_type& range) const;
+    
+    /// Get the longest a seed can be before the index cuts it short: the
+    /// GCSA's order, or the minimizer length when seeding with minimizers.
+    int seed_order() const;
+    
     // Haplotype score provider, if any, for determining haplotype concordance
     haplo::ScoreProvider* haplo_score_provider = nullptr;
     
@@ -359,6 +530,8 @@ private:
     // GSSW aligners
     QualAdjAligner* qual_adj_aligner = nullptr;
     Aligner* regular_aligner = nullptr;    
+    // passed on to the aligners whenever they are made
+    bool use_xdrop = false;
 
 };
 
@@ -427,6 +600,16 @@ private:
                                            int keep_multimaps = 0,
                                            int additional_multimaps = 0,
                                            vector<MaximalExactMatch>* restricted_mems = nullptr);
+    // how many extra multimaps to look for so that we can compute a mapping quality
+    int multimaps_for_quality(int additional_multimaps) const;
+    
+    // get the key under which the results of align_multi for this read are cached
+    string result_cache_key(const Alignment& aln, int kmer_size, int stride, int max_mem_length,
+                            int band_width, int band_overlap) const;
+    
+    // give cached results the name and base qualities of the read they are reused for
+    void adopt_cached_results(const Alignment& aln, vector<Alignment>& results) const;
+    
     void compute_mapping_qualities(vector<Alignment>& alns, double cluster_mq, double mq_estimate, double mq_cap);
     void compute_mapping_qualities(pair<vector<Alignment>, vector<Alignment>>& pair_alns, double cluster_mq, double mq_estmate1, double mq_estimate2, double mq_cap1, double mq_cap2);
     vector<Alignment> score_sort_and_deduplicate_alignments(vector<Alignment>& all_alns, const Alignment& original_alignment);
@@ -438,6 +621,11 @@ private:
                                    int max_mem_length = 0,
                                    int band_width = 1000,
                                    int band_overlap = 500);
+    // Chain MEMs across the whole read and align only the gaps between the
+    // chained anchors. Used in place of align_banded when chain_long_reads is set.
+    vector<Alignment> align_chained(const Alignment& read,
+                                    int max_mem_length = 0,
+                                    int band_width = 1000);
     // alignment based on the MEM approach
 //    vector<Alignment> align_mem_multi(const Alignment& alignment, vector<MaximalExactMatch>& mems, double& cluster_mq, double lcp_avg, int max_mem_length, int additional_multimaps = 0);
     // uses approximate-positional clustering based on embedded paths in the xg index to find and align against alignment targets
@@ -507,6 +695,11 @@ public:
     // use mapper parameters to determine which clusters we should drop
     set<const vector<MaximalExactMatch>* > clusters_to_drop(const vector<vector<MaximalExactMatch> >& clusters);
 
+    // find the clusters whose anchors no haplotype visits in read order, or
+    // nothing if that holds for every cluster and the haplotypes can't choose
+    set<const vector<MaximalExactMatch>* > haplotype_inconsistent_clusters(const vector<vector<MaximalExactMatch> >& clusters,
+                                                                           size_t read_length);
+
     // takes the input alignment (with seq, etc) so we have reference to the base sequence
     // for reconstruction the alignments from the SMEMs
     Alignment mems_to_alignment(const Alignment& aln, const vector<MaximalExactMatch>& mems);
@@ -566,6 +759,30 @@ public:
                                   int band_width = 1000,
                                   int band_overlap = 500);
     
+    // Align a batch of reads with multi-mapping, one stage at a time: MEMs are
+    // found for every read in the batch before any read is clustered and
+    // aligned, so each stage keeps its part of the indexes hot in cache.
+    // Returns what align_multi would return for each read, in input order.
+    // Reads longer than the band_width go through align_multi on their own.
+    // Time spent in each stage is added to batch_timing.
+    vector<vector<Alignment>> align_multi_batch(const vector<Alignment>& alns,
+                                                int kmer_size = 0,
+                                                int stride = 0,
+                                                int max_mem_length = 0,
+                                                int band_width = 1000,
+                                                int band_overlap = 500);
+    
+    // Running totals for the stages of align_multi_batch, for tuning the batch size
+    struct BatchTiming {
+        size_t batches = 0;
+        size_t reads = 0;
+        // seconds spent finding MEMs
+        double seed_seconds = 0;
+        // seconds spent clustering, aligning, and computing mapping qualities
+        double align_seconds = 0;
+    };
+    BatchTiming batch_timing;
+    
     // paired-end based
     
     // Both vectors of alignments will be sorted in order of increasing score.
@@ -645,6 +862,11 @@ public:
     int min_multimaps; // Minimum number of multimappings
     int band_multimaps; // the number of multimaps for to attempt for each band in a banded alignment
     bool patch_alignments; // should we attempt alignment patching to resolve unaligned regions in banded alignment
+    bool chain_long_reads; // align long reads by chaining MEMs over the whole read instead of by bands
+    bool sparse_chaining; // chain single-end MEM hits with range maximum queries instead of linking every pair in the band
+    // if set, align_multi and align_multi_batch reuse the results of earlier
+    // reads with the same sequence; only share it between identically configured mappers
+    ReadResultCache<Alignment>* result_cache = nullptr;
     
     double maybe_mq_threshold; // quality below which we let the estimated mq kick in
     int max_cluster_mapping_quality; // the cap for cluster mapping quality
@@ -653,6 +875,12 @@ public:
 
     bool always_rescue; // Should rescue be attempted for all imperfect alignments?
     bool include_full_length_bonuses;
+    // score every cluster without traceback first, and only trace back the
+    // alignments that can be reported or can change the mapping quality
+    bool score_before_traceback;
+    // check cluster anchors against the haplotypes before alignment, and only
+    // align clusters no haplotype agrees with if min_multimaps needs them
+    bool filter_haplotype_inconsistent_clusters = false;
     
     bool simultaneous_pair_alignment;
     int max_band_jump; // the maximum length edit we can detect via banded alignment
@@ -662,6 +890,10 @@ public:
 
     double pair_rescue_hang_threshold;
     double pair_rescue_retry_threshold;
+    // skip rescuing a mate that shares no k-mers of this length with the rescue window (0 to always align)
+    int rescue_prefilter_kmer;
+    // rescue windows reused by pairs anchored in the same place
+    RescueWindowCache rescue_windows;
     
     // Keep track of fragment length distribution statistics
     FragmentLengthStatistics frag_stats;
@@ -675,6 +907,33 @@ set<pos_t> gcsa_nodes_to_positions(const vector<gcsa::node_type>& nodes);
 
 int sub_overlaps_of_first_aln(const vector<Alignment>& alns, float overlap_fraction);
 
+template<typename Annotated>
+void BaseMapper::annotate_budget_limited(vector<Annotated>& alns) const {
+    if (!read_work.limited) {
+        return;
+    }
+    for (Annotated& aln : alns) {
+        set_annotation(&aln, "budget_limited", true);
+    }
+    if (stage_stats) {
+        stage_stats->count(StageStats::BUDGET_LIMITED_READS);
+    }
+}
+
+template<typename Annotated>
+void BaseMapper::annotate_budget_limited(vector<pair<Annotated, Annotated>>& aln_pairs) const {
+    if (!read_work.limited) {
+        return;
+    }
+    for (pair<Annotated, Annotated>& aln_pair : aln_pairs) {
+        set_annotation(&aln_pair.first, "budget_limited", true);
+        set_annotation(&aln_pair.second, "budget_limited", true);
+    }
+    if (stage_stats) {
+        stage_stats->count(StageStats::BUDGET_LIMITED_READS);
+    }
+}
+
 }
 
 #endif
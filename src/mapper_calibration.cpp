@@ -0,0 +1,86 @@
+#include "mapper_calibration.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * \file mapper_calibration.cpp
+ * Implement loading and saving mapper calibration sidecars.
+ */
+
+namespace vg {
+
+using namespace std;
+
+// The first line of every calibration file
+static const string CALIBRATION_HEADER = "#vg-calibration\t1";
+
+bool MapperCalibration::has_mismapping_calibration(size_t num_simulations, size_t read_length) const {
+    return pseudo_length_multiplier > 0 && calibration_simulations == num_simulations &&
+        calibration_read_length == read_length;
+}
+
+void MapperCalibration::load(istream& in) {
+    string line;
+    if (!getline(in, line) || line != CALIBRATION_HEADER) {
+        throw runtime_error("[vg::MapperCalibration] not a mapper calibration file");
+    }
+    while (getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        size_t tab = line.find('\t');
+        if (tab == string::npos) {
+            throw runtime_error("[vg::MapperCalibration] malformed calibration line: " + line);
+        }
+        string key = line.substr(0, tab);
+        stringstream value(line.substr(tab + 1));
+        if (key == "gc_content") {
+            value >> gc_content;
+        } else if (key == "graph_entropy") {
+            value >> graph_entropy;
+        } else if (key == "average_node_length") {
+            value >> average_node_length;
+        } else if (key == "pseudo_length_multiplier") {
+            value >> pseudo_length_multiplier;
+        } else if (key == "calibration_simulations") {
+            value >> calibration_simulations;
+        } else if (key == "calibration_read_length") {
+            value >> calibration_read_length;
+        } else {
+            // Written by something newer than us
+            continue;
+        }
+        if (!value) {
+            throw runtime_error("[vg::MapperCalibration] bad value in calibration line: " + line);
+        }
+    }
+}
+
+void MapperCalibration::save(ostream& out) const {
+    // Write enough digits that a load gives back the same doubles
+    out.precision(17);
+    out << CALIBRATION_HEADER << endl;
+    out << "gc_content\t" << gc_content << endl;
+    out << "graph_entropy\t" << graph_entropy << endl;
+    out << "average_node_length\t" << average_node_length << endl;
+    out << "pseudo_length_multiplier\t" << pseudo_length_multiplier << endl;
+    out << "calibration_simulations\t" << calibration_simulations << endl;
+    out << "calibration_read_length\t" << calibration_read_length << endl;
+}
+
+string MapperCalibration::sidecar_name(const string& xg_name) {
+    return xg_name + ".calib";
+}
+
+bool MapperCalibration::load_sidecar(const string& xg_name) {
+    ifstream in(sidecar_name(xg_name));
+    if (!in) {
+        return false;
+    }
+    load(in);
+    return true;
+}
+
+}
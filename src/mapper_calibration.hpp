@@ -0,0 +1,59 @@
+#ifndef VG_MAPPER_CALIBRATION_HPP_INCLUDED
+#define VG_MAPPER_CALIBRATION_HPP_INCLUDED
+
+/**
+ * \file mapper_calibration.hpp
+ *
+ * Graph statistics that the mappers would otherwise work out at startup,
+ * computed once by "vg calibrate" and stored in a sidecar file next to the XG.
+ */
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Precomputed per-index statistics for the mappers. Values that are missing
+ * are negative (or, for the mismapping calibration, have a 0 read length),
+ * and the mappers compute them themselves as usual.
+ */
+struct MapperCalibration {
+    /// Fraction of G and C bases in the GCSA
+    double gc_content = -1.0;
+    /// Entropy of the packed XG sequence
+    double graph_entropy = -1.0;
+    /// Mean node length in the XG
+    double average_node_length = -1.0;
+
+    /// Pseudo length multiplier fit by MultipathMapper's mismapping detection
+    /// calibration, with the number of simulated reads and their length.
+    double pseudo_length_multiplier = -1.0;
+    size_t calibration_simulations = 0;
+    size_t calibration_read_length = 0;
+
+    /// Do we have a mismapping calibration made with the given settings?
+    bool has_mismapping_calibration(size_t num_simulations, size_t read_length) const;
+
+    /// Read a calibration written by save(). Unknown keys are ignored, so
+    /// newer files can be read by older code. Throws a runtime_error on a
+    /// malformed file.
+    void load(istream& in);
+
+    /// Write the calibration as tab-separated key-value lines.
+    void save(ostream& out) const;
+
+    /// Get the name of the calibration sidecar for the given XG file.
+    static string sidecar_name(const string& xg_name);
+
+    /// Load the calibration sidecar for the given XG file, if there is one.
+    /// Returns true if it was found and loaded.
+    bool load_sidecar(const string& xg_name);
+};
+
+}
+
+#endif
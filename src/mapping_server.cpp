@@ -0,0 +1,120 @@
+#include "mapping_server.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * \file mapping_server.cpp
+ * Implement the Unix socket mapping server.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/// Make an error message ending with the reason in errno
+static string system_error_message(const string& message) {
+    return "[vg::MappingServer] " + message + ": " + strerror(errno);
+}
+
+MappingServer::MappingServer(const string& socket_path) : socket_path(socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        throw runtime_error("[vg::MappingServer] socket path must be between 1 and " +
+                            to_string(sizeof(address.sun_path) - 1) + " characters: " + socket_path);
+    }
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        throw runtime_error(system_error_message("could not create socket"));
+    }
+
+    // A server that was killed leaves its socket file behind
+    unlink(socket_path.c_str());
+    if (::bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        close(listen_fd);
+        throw runtime_error(system_error_message("could not bind socket " + socket_path));
+    }
+    if (listen(listen_fd, SOMAXCONN) == -1) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        throw runtime_error(system_error_message("could not listen on socket " + socket_path));
+    }
+}
+
+MappingServer::~MappingServer() {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+}
+
+void MappingServer::serve(const function<size_t(void)>& handle_request, const string& log_prefix,
+                          size_t max_requests) {
+    // A client that hangs up early should only end its own request
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t served = 0;
+    while (max_requests == 0 || served < max_requests) {
+        int connection = accept(listen_fd, nullptr, nullptr);
+        if (connection == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error(system_error_message("could not accept connection"));
+        }
+        served++;
+        requests_served++;
+        auto start = chrono::steady_clock::now();
+
+        // Swap the connection in for stdin and stdout, keeping the real ones
+        cout.flush();
+        fflush(stdout);
+        int saved_stdin = dup(STDIN_FILENO);
+        int saved_stdout = dup(STDOUT_FILENO);
+        dup2(connection, STDIN_FILENO);
+        dup2(connection, STDOUT_FILENO);
+        close(connection);
+        clearerr(stdin);
+        cin.clear();
+
+        size_t num_reads = 0;
+        bool failed = false;
+        try {
+            num_reads = handle_request();
+        } catch (exception& e) {
+            cerr << log_prefix << "request " << requests_served << " failed: " << e.what() << endl;
+            failed = true;
+        }
+
+        // Send the rest of the output, then drop our last references to the
+        // connection so the client sees the end of it
+        cout.flush();
+        fflush(stdout);
+        dup2(saved_stdin, STDIN_FILENO);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdin);
+        close(saved_stdout);
+        clearerr(stdin);
+        clearerr(stdout);
+        cin.clear();
+        cout.clear();
+
+        if (!failed) {
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cerr << log_prefix << "request " << requests_served << ": mapped " << num_reads << " reads in "
+                 << seconds << " s (" << (seconds > 0 ? num_reads / seconds : 0.0) << " reads/s)" << endl;
+        }
+    }
+}
+
+}
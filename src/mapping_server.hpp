@@ -0,0 +1,58 @@
+#ifndef VG_MAPPING_SERVER_HPP_INCLUDED
+#define VG_MAPPING_SERVER_HPP_INCLUDED
+
+/**
+ * \file mapping_server.hpp
+ *
+ * Serve mapping requests over a Unix domain socket from a process that keeps
+ * its mapper and indexes loaded between requests.
+ */
+
+#include <functional>
+#include <string>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Listens on a Unix domain socket and runs a request handler once per
+ * connection. A client connects, sends its reads, shuts down its writing
+ * side, and reads back the mapped output until the server closes the
+ * connection.
+ *
+ * While a request is running the connection takes the place of stdin and
+ * stdout, so the handler can read "-" and write to cout exactly as a mapper
+ * run from the command line does. Requests are handled one at a time, each
+ * with all the mapping threads; connections that arrive in the meantime wait
+ * in the socket's listen queue and are served in the order they arrived.
+ */
+class MappingServer {
+public:
+    /// Listen on a socket at the given path, replacing any stale socket file
+    /// left there. Throws a runtime_error if the socket can't be set up.
+    MappingServer(const string& socket_path);
+
+    /// Stop listening and remove the socket file.
+    ~MappingServer();
+
+    MappingServer(const MappingServer& other) = delete;
+    MappingServer& operator=(const MappingServer& other) = delete;
+
+    /// Serve requests with the given handler, which maps everything on stdin
+    /// to stdout and returns the number of reads it mapped. After each
+    /// request, a line with its read count and time is written to stderr,
+    /// starting with log_prefix. Serves forever if max_requests is 0.
+    void serve(const function<size_t(void)>& handle_request, const string& log_prefix = "",
+               size_t max_requests = 0);
+
+private:
+
+    string socket_path;
+    int listen_fd = -1;
+    size_t requests_served = 0;
+};
+
+}
+
+#endif
@@ -67,6 +67,51 @@ ostream& operator<<(ostream& out, const MaximalExactMatch& mem) {
     return out;
 }
 
+thread_local vector<vector<gcsa::node_type>> MEMHitPool::free_buffers;
+
+vector<gcsa::node_type> MEMHitPool::acquire() {
+    vector<gcsa::node_type> hits;
+    if (!free_buffers.empty()) {
+        hits = std::move(free_buffers.back());
+        free_buffers.pop_back();
+    }
+    return hits;
+}
+
+void MEMHitPool::release(vector<gcsa::node_type>& hits) {
+    if (hits.capacity() == 0 || hits.capacity() > MAX_POOLED_CAPACITY
+        || free_buffers.size() >= MAX_POOLED_BUFFERS) {
+        // not worth keeping, so free it now
+        vector<gcsa::node_type>().swap(hits);
+        return;
+    }
+    hits.clear();
+    free_buffers.emplace_back(std::move(hits));
+    // moved-from vectors are valid but unspecified, so make sure it's empty
+    hits.clear();
+}
+
+void MEMHitPool::release(vector<MaximalExactMatch>& mems) {
+    for (auto& mem : mems) {
+        release(mem.nodes);
+    }
+}
+
+void MEMHitPool::release(vector<vector<MaximalExactMatch>>& clusters) {
+    for (auto& cluster : clusters) {
+        release(cluster);
+    }
+}
+
+size_t MEMHitPool::size() {
+    return free_buffers.size();
+}
+
+void MEMHitPool::clear() {
+    free_buffers.clear();
+    free_buffers.shrink_to_fit();
+}
+
 const string mems_to_json(const vector<MaximalExactMatch>& mems) {
     stringstream s;
     s << "[";
@@ -63,6 +63,45 @@ public:
     //virtual ~MaximalExactMatch() { }                     // Destructor
 };
 
+/**
+ * A per-thread pool of MEM hit buffers. The mapper finds, clusters and throws
+ * away thousands of MEMs per read, each with its own vector of hits; handing
+ * the buffers back here between reads lets the next read on the same thread
+ * reuse their storage instead of going back to the (shared) heap.
+ */
+class MEMHitPool {
+public:
+    /// Get an empty hit buffer, reusing one released on this thread if there
+    /// is one available.
+    static vector<gcsa::node_type> acquire();
+    
+    /// Give the hit buffers of all of the MEMs back to this thread's pool,
+    /// leaving the MEMs without hits.
+    static void release(vector<MaximalExactMatch>& mems);
+    
+    /// Give the hit buffers of all of the MEMs in all of the clusters back to
+    /// this thread's pool.
+    static void release(vector<vector<MaximalExactMatch>>& clusters);
+    
+    /// Get the number of buffers waiting in this thread's pool.
+    static size_t size();
+    
+    /// Drop all of the buffers in this thread's pool.
+    static void clear();
+    
+    /// Most buffers that a thread will hold on to.
+    static const size_t MAX_POOLED_BUFFERS = 4096;
+    /// Buffers that grew larger than this many hits are freed rather than
+    /// pooled, so one repetitive read can't pin a lot of memory.
+    static const size_t MAX_POOLED_CAPACITY = 1024;
+    
+private:
+    /// Put one buffer in the pool, if it is worth keeping.
+    static void release(vector<gcsa::node_type>& hits);
+    
+    thread_local static vector<vector<gcsa::node_type>> free_buffers;
+};
+
 const string mems_to_json(const vector<MaximalExactMatch>& mems);
 
 // helpers for computing the number of bases in the query covered by a cluster
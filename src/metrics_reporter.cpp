@@ -0,0 +1,438 @@
+#include "metrics_reporter.hpp"
+#include "utility.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * \file metrics_reporter.cpp
+ * Implementations for the periodic metrics reporter.
+ */
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// Seconds between reports when the environment doesn't say
+const double DEFAULT_INTERVAL_SECONDS = 10.0;
+
+/// Everything the reporter keeps between reports
+struct ReporterState {
+    string command;
+    int fd = -1;
+    bool is_socket = false;
+    chrono::duration<double> interval;
+
+    thread reporter;
+    mutex stop_lock;
+    condition_variable stop_signal;
+    bool stopping = false;
+
+    atomic<uint64_t> messages_in{0};
+    atomic<uint64_t> bytes_in{0};
+    atomic<uint64_t> messages_out{0};
+    atomic<uint64_t> bytes_out{0};
+
+    mutex task_lock;
+    string task_name;
+    atomic<long> task_total{0};
+    atomic<long> task_done{0};
+
+    // Only touched by whoever is writing a record
+    chrono::steady_clock::time_point start_time;
+    chrono::steady_clock::time_point last_time;
+    uint64_t last_messages_in = 0;
+    uint64_t last_messages_out = 0;
+    long last_task_done = 0;
+    double last_cpu_seconds = 0.0;
+    map<long, uint64_t> last_thread_ticks;
+};
+
+/// The one reporter. Never deleted, so it outlives anything that might still
+/// feed it while the process exits.
+ReporterState* state = nullptr;
+
+/// Serializes starting, stopping and writing records
+mutex control_lock;
+
+/// Quote a string for JSON
+string json_string(const string& value) {
+    stringstream quoted;
+    quoted << '"';
+    for (char c : value) {
+        switch (c) {
+        case '"':
+            quoted << "\\\"";
+            break;
+        case '\\':
+            quoted << "\\\\";
+            break;
+        case '\n':
+            quoted << "\\n";
+            break;
+        case '\t':
+            quoted << "\\t";
+            break;
+        default:
+            if ((unsigned char) c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int) (unsigned char) c);
+                quoted << escaped;
+            } else {
+                quoted << c;
+            }
+        }
+    }
+    quoted << '"';
+    return quoted.str();
+}
+
+/// Get the CPU time this process has used, in seconds
+double process_cpu_seconds() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+        + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/// Get the current resident set size, in bytes, falling back on the peak
+/// where we can't see the current one
+size_t current_rss_bytes() {
+#ifdef __linux__
+    ifstream statm("/proc/self/statm");
+    size_t total_pages, resident_pages;
+    if (statm >> total_pages >> resident_pages) {
+        return resident_pages * sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return get_peak_rss_bytes();
+}
+
+/// Get the user and system clock ticks used by each thread of this process
+/// other than the calling one, by thread ID. Empty where the kernel doesn't
+/// tell us.
+map<long, uint64_t> thread_cpu_ticks() {
+    map<long, uint64_t> ticks;
+#ifdef __linux__
+    long self = syscall(SYS_gettid);
+    DIR* tasks = opendir("/proc/self/task");
+    if (tasks == nullptr) {
+        return ticks;
+    }
+    while (struct dirent* entry = readdir(tasks)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        long tid = atol(entry->d_name);
+        if (tid == self) {
+            continue;
+        }
+        ifstream stat_file(string("/proc/self/task/") + entry->d_name + "/stat");
+        string stat_line;
+        if (!getline(stat_file, stat_line)) {
+            // the thread finished while we were looking
+            continue;
+        }
+        // the thread name can hold anything, so skip to after it, where the
+        // state is field 3 and utime and stime are fields 14 and 15
+        size_t name_end = stat_line.rfind(')');
+        if (name_end == string::npos) {
+            continue;
+        }
+        stringstream fields(stat_line.substr(name_end + 1));
+        string field;
+        uint64_t utime = 0, stime = 0;
+        for (size_t i = 3; i <= 15 && fields >> field; i++) {
+            if (i == 14) {
+                utime = strtoull(field.c_str(), nullptr, 10);
+            } else if (i == 15) {
+                stime = strtoull(field.c_str(), nullptr, 10);
+            }
+        }
+        ticks[tid] = utime + stime;
+    }
+    closedir(tasks);
+#endif
+    return ticks;
+}
+
+/// Send a line to the destination, giving up on the destination if it fails.
+void write_line(const string& line) {
+    size_t written = 0;
+    while (state->fd != -1 && written < line.size()) {
+        ssize_t result;
+        if (state->is_socket) {
+            // don't let a closed socket SIGPIPE the whole job
+            result = send(state->fd, line.data() + written, line.size() - written, MSG_NOSIGNAL);
+        } else {
+            result = write(state->fd, line.data() + written, line.size() - written);
+        }
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "warning:[vg] could not write metrics, so reporting stops: " << strerror(errno) << endl;
+            close(state->fd);
+            state->fd = -1;
+        } else {
+            written += result;
+        }
+    }
+}
+
+/// Write a record about the time since the last one. Call with the control
+/// lock held.
+void write_record(bool final) {
+    auto now = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(now - state->start_time).count();
+    double since_last = chrono::duration<double>(now - state->last_time).count();
+    auto per_second = [&](double amount) {
+        return since_last > 0 ? amount / since_last : 0.0;
+    };
+
+    uint64_t messages_in = state->messages_in.load();
+    uint64_t messages_out = state->messages_out.load();
+    long task_done = state->task_done.load();
+    string task_name;
+    {
+        lock_guard<mutex> guard(state->task_lock);
+        task_name = state->task_name;
+    }
+    double cpu_seconds = process_cpu_seconds();
+    map<long, uint64_t> thread_ticks = thread_cpu_ticks();
+
+    stringstream record;
+    record << "{\"command\":" << json_string(state->command)
+           << ",\"elapsed_seconds\":" << elapsed
+           << ",\"final\":" << (final ? "true" : "false")
+           << ",\"task\":" << json_string(task_name)
+           << ",\"task_done\":" << task_done
+           << ",\"task_total\":" << state->task_total.load()
+           << ",\"task_items_per_second\":" << per_second(max<long>(task_done - state->last_task_done, 0))
+           << ",\"messages_in\":" << messages_in
+           << ",\"bytes_in\":" << state->bytes_in.load()
+           << ",\"messages_in_per_second\":" << per_second(messages_in - state->last_messages_in)
+           << ",\"messages_out\":" << messages_out
+           << ",\"bytes_out\":" << state->bytes_out.load()
+           << ",\"messages_out_per_second\":" << per_second(messages_out - state->last_messages_out)
+           << ",\"rss_bytes\":" << current_rss_bytes()
+           << ",\"peak_rss_bytes\":" << get_peak_rss_bytes()
+           << ",\"cpu_utilization\":" << per_second(cpu_seconds - state->last_cpu_seconds)
+           << ",\"thread_utilization\":[";
+    // threads that started since the last record are measured from their start
+    double ticks_per_second = sysconf(_SC_CLK_TCK);
+    bool first = true;
+    for (auto& thread_tick : thread_ticks) {
+        auto last = state->last_thread_ticks.find(thread_tick.first);
+        uint64_t used = thread_tick.second - (last == state->last_thread_ticks.end() ? 0 : last->second);
+        record << (first ? "" : ",") << per_second(used / ticks_per_second);
+        first = false;
+    }
+    record << "]}\n";
+
+    write_line(record.str());
+
+    state->last_time = now;
+    state->last_messages_in = messages_in;
+    state->last_messages_out = messages_out;
+    state->last_task_done = task_done;
+    state->last_cpu_seconds = cpu_seconds;
+    state->last_thread_ticks = move(thread_ticks);
+}
+
+}
+
+const char* MetricsReporter::DESTINATION_VARIABLE = "VG_METRICS";
+const char* MetricsReporter::INTERVAL_VARIABLE = "VG_METRICS_INTERVAL";
+
+atomic<bool> MetricsReporter::is_enabled(false);
+
+void MetricsReporter::start(const string& destination, double interval_seconds, const string& command) {
+    lock_guard<mutex> guard(control_lock);
+    if (enabled()) {
+        throw runtime_error("[MetricsReporter::start] metrics are already being reported");
+    }
+    if (interval_seconds <= 0) {
+        throw runtime_error("[MetricsReporter::start] report interval must be positive");
+    }
+
+    int fd;
+    bool is_socket = destination.compare(0, 5, "unix:") == 0;
+    if (is_socket) {
+        string socket_path = destination.substr(5);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+            throw runtime_error("[MetricsReporter::start] socket path must be between 1 and " +
+                                to_string(sizeof(address.sun_path) - 1) + " characters: " + socket_path);
+        }
+        strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            throw runtime_error(string("[MetricsReporter::start] could not create socket: ") + strerror(errno));
+        }
+        if (connect(fd, (struct sockaddr*) &address, sizeof(address)) == -1) {
+            int error = errno;
+            close(fd);
+            throw runtime_error("[MetricsReporter::start] could not connect to " + socket_path + ": " + strerror(error));
+        }
+    } else {
+        fd = open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            throw runtime_error("[MetricsReporter::start] could not open " + destination + ": " + strerror(errno));
+        }
+    }
+
+    if (state == nullptr) {
+        state = new ReporterState();
+        // report the end of commands that exit() instead of returning
+        atexit([]() {
+            MetricsReporter::stop();
+        });
+    }
+    state->command = command;
+    state->fd = fd;
+    state->is_socket = is_socket;
+    state->interval = chrono::duration<double>(interval_seconds);
+    state->stopping = false;
+    state->start_time = chrono::steady_clock::now();
+    state->last_time = state->start_time;
+    state->last_messages_in = state->messages_in.load();
+    state->last_messages_out = state->messages_out.load();
+    state->last_task_done = state->task_done.load();
+    state->last_cpu_seconds = process_cpu_seconds();
+    state->last_thread_ticks = thread_cpu_ticks();
+
+    is_enabled.store(true);
+
+    state->reporter = thread([]() {
+        unique_lock<mutex> stop_guard(state->stop_lock);
+        while (!state->stop_signal.wait_for(stop_guard, state->interval, []() { return state->stopping; })) {
+            lock_guard<mutex> guard(control_lock);
+            write_record(false);
+        }
+    });
+}
+
+void MetricsReporter::start_from_environment(const string& command) {
+    const char* destination = getenv(DESTINATION_VARIABLE);
+    if (destination == nullptr || destination[0] == '\0') {
+        return;
+    }
+    double interval_seconds = DEFAULT_INTERVAL_SECONDS;
+    const char* interval = getenv(INTERVAL_VARIABLE);
+    if (interval != nullptr) {
+        interval_seconds = atof(interval);
+        if (interval_seconds <= 0) {
+            cerr << "warning:[vg] ignoring " << INTERVAL_VARIABLE << " " << interval
+                 << " that isn't a positive number of seconds" << endl;
+            interval_seconds = DEFAULT_INTERVAL_SECONDS;
+        }
+    }
+    try {
+        start(destination, interval_seconds, command);
+    } catch (const runtime_error& e) {
+        cerr << "warning:[vg] not reporting metrics: " << e.what() << endl;
+    }
+}
+
+void MetricsReporter::stop() {
+    if (!enabled()) {
+        return;
+    }
+    {
+        lock_guard<mutex> stop_guard(state->stop_lock);
+        state->stopping = true;
+    }
+    state->stop_signal.notify_all();
+    if (state->reporter.joinable()) {
+        state->reporter.join();
+    }
+
+    lock_guard<mutex> guard(control_lock);
+    if (!enabled()) {
+        // someone else stopped us while we waited
+        return;
+    }
+    write_record(true);
+    if (state->fd != -1) {
+        close(state->fd);
+        state->fd = -1;
+    }
+    is_enabled.store(false);
+}
+
+void MetricsReporter::count_input(uint64_t messages, uint64_t bytes) {
+    if (enabled()) {
+        state->messages_in.fetch_add(messages, memory_order_relaxed);
+        state->bytes_in.fetch_add(bytes, memory_order_relaxed);
+    }
+}
+
+void MetricsReporter::count_output(uint64_t messages, uint64_t bytes) {
+    if (enabled()) {
+        state->messages_out.fetch_add(messages, memory_order_relaxed);
+        state->bytes_out.fetch_add(bytes, memory_order_relaxed);
+    }
+}
+
+void MetricsReporter::begin_task(const string& name, long total) {
+    if (enabled()) {
+        lock_guard<mutex> guard(state->task_lock);
+        // progress bar messages are padded out with spaces
+        state->task_name = name.substr(0, name.find_last_not_of(' ') + 1);
+        state->task_total.store(total);
+        state->task_done.store(0);
+    }
+}
+
+void MetricsReporter::set_task_progress(long done) {
+    if (enabled()) {
+        // updates and increments can interleave, so progress only goes forward
+        long seen = state->task_done.load(memory_order_relaxed);
+        while (seen < done && !state->task_done.compare_exchange_weak(seen, done, memory_order_relaxed)) {
+            // seen has been reloaded
+        }
+    }
+}
+
+void MetricsReporter::advance_task(long items) {
+    if (enabled()) {
+        state->task_done.fetch_add(items, memory_order_relaxed);
+    }
+}
+
+void MetricsReporter::end_task() {
+    if (enabled()) {
+        lock_guard<mutex> guard(state->task_lock);
+        state->task_done.store(state->task_total.load());
+    }
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef VG_METRICS_REPORTER_HPP_INCLUDED
+#define VG_METRICS_REPORTER_HPP_INCLUDED
+
+/**
+ * \file metrics_reporter.hpp
+ *
+ * Periodic machine-readable progress reports for long-running commands, so
+ * whatever is orchestrating a vg job can tell a job that is slow from one that
+ * has stalled.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Process-wide reporter that writes one JSON object per line, every few
+ * seconds, to a file or a Unix socket. Each record has the command, the time
+ * since reporting started, the current Progressive task and how far along it
+ * is, the protobuf messages and bytes read and written through the stream
+ * functions, their rates since the last record, the resident set size, and
+ * the CPU utilization of the process and of each of its threads.
+ *
+ * Everything is static, so Progressive and the stream functions can feed it
+ * without being handed an object. While reporting is off, feeding it costs
+ * one relaxed atomic load.
+ */
+class MetricsReporter {
+public:
+
+    /// Environment variable naming where to report: a file, or unix:PATH
+    static const char* DESTINATION_VARIABLE;
+    /// Environment variable giving the seconds between reports
+    static const char* INTERVAL_VARIABLE;
+
+    /// Start reporting every interval_seconds to the given destination, a file
+    /// path or "unix:" and the path of a listening Unix socket. The command is
+    /// noted in every record. A final record is written when stop() is called
+    /// or the process exits. Throws runtime_error if the destination can't be
+    /// opened or reporting has already started.
+    static void start(const string& destination, double interval_seconds, const string& command);
+
+    /// Start reporting if the destination environment variable is set. Warns
+    /// and carries on without reporting if the destination can't be opened.
+    static void start_from_environment(const string& command);
+
+    /// Write a final record and stop reporting. Does nothing if reporting
+    /// isn't on.
+    static void stop();
+
+    /// Is reporting on?
+    inline static bool enabled() {
+        return is_enabled.load(memory_order_relaxed);
+    }
+
+    /// Note protobuf messages, and their serialized bytes, read from a stream
+    static void count_input(uint64_t messages, uint64_t bytes);
+
+    /// Note protobuf messages, and their serialized bytes, written to a stream
+    static void count_output(uint64_t messages, uint64_t bytes);
+
+    /// Note that a task with the given number of items has started
+    static void begin_task(const string& name, long total);
+
+    /// Note that at least the given number of items of the task are done
+    static void set_task_progress(long done);
+
+    /// Note that the given number of further items of the task are done
+    static void advance_task(long items);
+
+    /// Note that the task is finished
+    static void end_task();
+
+private:
+
+    static atomic<bool> is_enabled;
+};
+
+}
+
+#endif
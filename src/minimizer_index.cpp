@@ -0,0 +1,322 @@
+#include "minimizer_index.hpp"
+#include "hash_map.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+#include <omp.h>
+
+namespace vg {
+
+using namespace std;
+
+namespace {
+
+/// Marks the start of a saved MinimizerIndex
+const char MINIMIZER_INDEX_MAGIC[8] = {'V', 'G', 'M', 'I', 'N', 'I', 'D', 'X'};
+const uint32_t MINIMIZER_INDEX_VERSION = 1;
+
+template<typename T>
+void write_value(ostream& out, const T& value) {
+    out.write((const char*) &value, sizeof(T));
+}
+
+template<typename T>
+T read_value(istream& in) {
+    T value;
+    in.read((char*) &value, sizeof(T));
+    if (!in) {
+        throw runtime_error("[MinimizerIndex::load] index is truncated");
+    }
+    return value;
+}
+
+template<typename T>
+void write_vector(ostream& out, const vector<T>& values) {
+    write_value<uint64_t>(out, values.size());
+    out.write((const char*) values.data(), values.size() * sizeof(T));
+}
+
+template<typename T>
+void read_vector(istream& in, vector<T>& values) {
+    values.resize(read_value<uint64_t>(in));
+    in.read((char*) values.data(), values.size() * sizeof(T));
+    if (!in) {
+        throw runtime_error("[MinimizerIndex::load] index is truncated");
+    }
+}
+
+/// Get the 2-bit code of a base, or -1 if it isn't ACGT
+inline int base_code(char base) {
+    switch (base) {
+    case 'A': case 'a':
+        return 0;
+    case 'C': case 'c':
+        return 1;
+    case 'G': case 'g':
+        return 2;
+    case 'T': case 't':
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+}
+
+const string MinimizerIndex::EXTENSION = ".min";
+
+MinimizerIndex::MinimizerIndex(size_t k, size_t w) : kmer_length(k), window_length(w) {
+    if (k == 0 || k > 31) {
+        throw runtime_error("[MinimizerIndex] k-mer length must be between 1 and 31");
+    }
+    if (w == 0) {
+        throw runtime_error("[MinimizerIndex] window must hold at least one k-mer");
+    }
+    hit_starts.push_back(0);
+}
+
+template<typename Iteratee>
+void MinimizerIndex::for_each_minimizer(const string& sequence, size_t first_window, size_t last_window,
+                                        const Iteratee& iteratee) const {
+    size_t span = kmer_length + window_length - 1;
+    if (sequence.size() < span || first_window > sequence.size() - span) {
+        return;
+    }
+    last_window = min(last_window, sequence.size() - span);
+
+    // encode and hash the k-mers that the windows cover
+    size_t kmer_count = last_window - first_window + window_length;
+    vector<uint64_t> kmer_keys(kmer_count);
+    vector<uint64_t> kmer_hashes(kmer_count);
+    vector<bool> kmer_valid(kmer_count, false);
+    uint64_t mask = (uint64_t(1) << (2 * kmer_length)) - 1;
+    uint64_t key = 0;
+    size_t valid_run = 0;
+    for (size_t i = first_window; i < first_window + kmer_count + kmer_length - 1; i++) {
+        int code = base_code(sequence[i]);
+        if (code < 0) {
+            key = 0;
+            valid_run = 0;
+        } else {
+            key = ((key << 2) | code) & mask;
+            valid_run++;
+        }
+        if (valid_run >= kmer_length) {
+            size_t kmer = i + 1 - kmer_length - first_window;
+            kmer_keys[kmer] = key;
+            kmer_hashes[kmer] = wang_hash_64(key);
+            kmer_valid[kmer] = true;
+        }
+    }
+
+    // take the k-mer with the smallest hash in each window, leftmost on ties
+    size_t last_minimizer = numeric_limits<size_t>::max();
+    for (size_t window = 0; window + window_length <= kmer_count; window++) {
+        size_t best = kmer_count;
+        for (size_t kmer = window; kmer < window + window_length; kmer++) {
+            if (kmer_valid[kmer] && (best == kmer_count || kmer_hashes[kmer] < kmer_hashes[best])) {
+                best = kmer;
+            }
+        }
+        if (best != kmer_count && best != last_minimizer) {
+            iteratee(kmer_keys[best], first_window + best);
+            last_minimizer = best;
+        }
+    }
+}
+
+void MinimizerIndex::build(const HandleGraph& graph, const gbwt::GBWT* haplotypes, size_t max_walks) {
+
+    graph.for_each_handle([&](const handle_t& handle) {
+        if (graph.get_length(handle) > gcsa::Node::OFFSET_MASK + 1) {
+            throw runtime_error("[MinimizerIndex::build] node " + to_string(graph.get_id(handle))
+                                + " is longer than " + to_string(gcsa::Node::OFFSET_MASK + 1) + " bp");
+        }
+    });
+
+    size_t span = kmer_length + window_length - 1;
+    vector<vector<pair<uint64_t, gcsa::node_type>>> thread_entries(get_thread_count());
+
+    graph.for_each_handle([&](const handle_t& forward) {
+        auto& entries = thread_entries[omp_get_thread_num()];
+
+        for (handle_t start : {forward, graph.flip(forward)}) {
+            gbwt::SearchState start_state;
+            if (haplotypes) {
+                gbwt::node_type start_node = gbwt::Node::encode(graph.get_id(start), graph.get_is_reverse(start));
+                if (!haplotypes->contains(start_node)) {
+                    continue;
+                }
+                start_state = haplotypes->find(start_node);
+                if (start_state.empty()) {
+                    continue;
+                }
+            }
+
+            // walk far enough that a window can start at the start node's last base
+            size_t start_length = graph.get_length(start);
+            size_t needed_length = start_length + span - 1;
+            vector<handle_t> walk{start};
+            vector<size_t> walk_offsets{0};
+            string sequence = graph.get_sequence(start);
+            size_t walks = 0;
+
+            // record the minimizers of the windows that start in the start node
+            auto record_walk = [&]() {
+                walks++;
+                for_each_minimizer(sequence, 0, start_length - 1, [&](uint64_t key, size_t offset) {
+                    size_t i = upper_bound(walk_offsets.begin(), walk_offsets.end(), offset) - walk_offsets.begin() - 1;
+                    entries.emplace_back(key, gcsa::Node::encode(graph.get_id(walk[i]), offset - walk_offsets[i],
+                                                                 graph.get_is_reverse(walk[i])));
+                });
+            };
+
+            function<void(const gbwt::SearchState&)> extend = [&](const gbwt::SearchState& state) {
+                if (sequence.size() >= needed_length) {
+                    record_walk();
+                    return;
+                }
+                bool extended = false;
+                graph.follow_edges(walk.back(), false, [&](const handle_t& next) {
+                    if (walks >= max_walks) {
+                        return false;
+                    }
+                    gbwt::SearchState next_state;
+                    if (haplotypes) {
+                        gbwt::node_type node = gbwt::Node::encode(graph.get_id(next), graph.get_is_reverse(next));
+                        if (!haplotypes->contains(node)) {
+                            return true;
+                        }
+                        next_state = haplotypes->extend(state, node);
+                        if (next_state.empty()) {
+                            return true;
+                        }
+                    }
+                    extended = true;
+                    walk.push_back(next);
+                    walk_offsets.push_back(sequence.size());
+                    sequence += graph.get_sequence(next);
+                    extend(next_state);
+                    sequence.resize(walk_offsets.back());
+                    walk_offsets.pop_back();
+                    walk.pop_back();
+                    return true;
+                });
+                if (!extended && walks < max_walks) {
+                    // the graph or the haplotypes end here
+                    record_walk();
+                }
+            };
+            extend(start_state);
+        }
+    }, true);
+
+    vector<pair<uint64_t, gcsa::node_type>> entries;
+    for (auto& thread_entry : thread_entries) {
+        entries.insert(entries.end(), thread_entry.begin(), thread_entry.end());
+        vector<pair<uint64_t, gcsa::node_type>>().swap(thread_entry);
+    }
+    sort(entries.begin(), entries.end());
+    entries.erase(unique(entries.begin(), entries.end()), entries.end());
+
+    keys.clear();
+    hit_starts.clear();
+    hits.clear();
+    hits.reserve(entries.size());
+    for (auto& entry : entries) {
+        if (keys.empty() || keys.back() != entry.first) {
+            keys.push_back(entry.first);
+            hit_starts.push_back(hits.size());
+        }
+        hits.push_back(entry.second);
+    }
+    hit_starts.push_back(hits.size());
+}
+
+vector<MinimizerIndex::Minimizer> MinimizerIndex::minimizers(string::const_iterator begin,
+                                                             string::const_iterator end) const {
+    vector<Minimizer> found;
+    string sequence(begin, end);
+    for_each_minimizer(sequence, 0, sequence.size(), [&](uint64_t key, size_t offset) {
+        found.push_back(Minimizer{key, offset});
+    });
+    return found;
+}
+
+size_t MinimizerIndex::count(uint64_t key) const {
+    auto found = lower_bound(keys.begin(), keys.end(), key);
+    if (found == keys.end() || *found != key) {
+        return 0;
+    }
+    size_t i = found - keys.begin();
+    return hit_starts[i + 1] - hit_starts[i];
+}
+
+size_t MinimizerIndex::find(uint64_t key, vector<gcsa::node_type>& found_hits) const {
+    auto found = lower_bound(keys.begin(), keys.end(), key);
+    if (found == keys.end() || *found != key) {
+        return 0;
+    }
+    size_t i = found - keys.begin();
+    found_hits.insert(found_hits.end(), hits.begin() + hit_starts[i], hits.begin() + hit_starts[i + 1]);
+    return hit_starts[i + 1] - hit_starts[i];
+}
+
+size_t MinimizerIndex::k() const {
+    return kmer_length;
+}
+
+size_t MinimizerIndex::w() const {
+    return window_length;
+}
+
+size_t MinimizerIndex::size() const {
+    return keys.size();
+}
+
+size_t MinimizerIndex::hit_count() const {
+    return hits.size();
+}
+
+void MinimizerIndex::save(ostream& out) const {
+    out.write(MINIMIZER_INDEX_MAGIC, sizeof(MINIMIZER_INDEX_MAGIC));
+    write_value<uint32_t>(out, MINIMIZER_INDEX_VERSION);
+    write_value<uint64_t>(out, kmer_length);
+    write_value<uint64_t>(out, window_length);
+    write_vector(out, keys);
+    write_vector(out, hit_starts);
+    write_vector(out, hits);
+
+    if (!out) {
+        throw runtime_error("[MinimizerIndex::save] I/O error writing index");
+    }
+}
+
+void MinimizerIndex::load(istream& in) {
+    char magic[sizeof(MINIMIZER_INDEX_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in || !equal(magic, magic + sizeof(magic), MINIMIZER_INDEX_MAGIC)) {
+        throw runtime_error("[MinimizerIndex::load] not a minimizer index");
+    }
+    uint32_t version = read_value<uint32_t>(in);
+    if (version != MINIMIZER_INDEX_VERSION) {
+        throw runtime_error("[MinimizerIndex::load] unsupported minimizer index version " + to_string(version));
+    }
+
+    kmer_length = read_value<uint64_t>(in);
+    window_length = read_value<uint64_t>(in);
+    read_vector(in, keys);
+    read_vector(in, hit_starts);
+    read_vector(in, hits);
+
+    if (kmer_length == 0 || kmer_length > 31 || window_length == 0 || hit_starts.size() != keys.size() + 1
+        || hit_starts.back() != hits.size()) {
+        throw runtime_error("[MinimizerIndex::load] index is corrupt");
+    }
+}
+
+}
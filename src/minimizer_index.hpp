@@ -0,0 +1,111 @@
+#ifndef VG_MINIMIZER_INDEX_HPP_INCLUDED
+#define VG_MINIMIZER_INDEX_HPP_INCLUDED
+
+/**
+ * \file minimizer_index.hpp
+ *
+ * A (w, k) minimizer index over a graph, as a small and cheap to build
+ * alternative to the GCSA2 for finding seeds. Every window of w consecutive
+ * k-mers on a walk through the graph (or only on the walks that haplotypes in
+ * a GBWT take) contributes its minimizer, which is the k-mer with the
+ * smallest hash, and the index stores the graph positions of each minimizer.
+ * A read's minimizers are found the same way, so any window of the read that
+ * matches a walk in the graph exactly finds its minimizer's position there.
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gcsa/gcsa.h>
+#include <gbwt/gbwt.h>
+
+#include "handle.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class MinimizerIndex {
+public:
+
+    /// Make an empty index of k-mers of length k (at most 31), sampled from
+    /// windows of w k-mers.
+    MinimizerIndex(size_t k = 21, size_t w = 11);
+
+    /// A minimizer of a sequence
+    struct Minimizer {
+        /// The 2-bit encoding of the k-mer, first base most significant
+        uint64_t key;
+        /// Where the k-mer starts in the sequence
+        size_t offset;
+    };
+
+    /// Replace the contents of the index with the minimizers of the graph, in
+    /// both orientations. If haplotypes are given, only windows on walks that
+    /// some haplotype takes are indexed. At most max_walks walks are followed
+    /// out of any one node, so very dense variation is only partly indexed.
+    /// Throws if a node is too long for its offsets to fit in a GCSA node,
+    /// which chopping the graph as for GCSA2 indexing avoids.
+    void build(const HandleGraph& graph, const gbwt::GBWT* haplotypes = nullptr, size_t max_walks = 256);
+
+    /// Get the minimizers of every window of w k-mers in the sequence, in
+    /// order, with each one only listed once. K-mers that contain anything
+    /// other than ACGT are never minimizers, and sequences shorter than a
+    /// window have none.
+    vector<Minimizer> minimizers(string::const_iterator begin, string::const_iterator end) const;
+
+    /// Get how many graph positions a minimizer occurs at.
+    size_t count(uint64_t key) const;
+
+    /// Append the graph positions a minimizer occurs at to hits, as GCSA
+    /// nodes, and return how many there were.
+    size_t find(uint64_t key, vector<gcsa::node_type>& hits) const;
+
+    /// The length of the indexed k-mers
+    size_t k() const;
+
+    /// The number of k-mers in each window
+    size_t w() const;
+
+    /// The number of distinct minimizers in the index
+    size_t size() const;
+
+    /// The number of graph positions stored for all minimizers together
+    size_t hit_count() const;
+
+    /// Write the index to a stream.
+    void save(ostream& out) const;
+
+    /// Replace this index with one read from a stream. Throws if the stream
+    /// doesn't hold an index.
+    void load(istream& in);
+
+    /// The file extension that minimizer indexes are saved with
+    static const string EXTENSION;
+
+private:
+
+    /// Call the iteratee on the minimizer of each window of w k-mers that
+    /// starts at an offset in [first_window, last_window] and lies entirely
+    /// within the sequence, skipping repeats of the previous minimizer.
+    template<typename Iteratee>
+    void for_each_minimizer(const string& sequence, size_t first_window, size_t last_window,
+                            const Iteratee& iteratee) const;
+
+    size_t kmer_length;
+    size_t window_length;
+
+    /// The distinct minimizers, in sorted order
+    vector<uint64_t> keys;
+    /// Where the hits of each minimizer start in hits, with an extra entry
+    /// for the end
+    vector<uint64_t> hit_starts;
+    /// The graph positions of all the minimizers, grouped by minimizer
+    vector<gcsa::node_type> hits;
+};
+
+}
+
+#endif
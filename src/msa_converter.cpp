@@ -190,9 +190,6 @@ using namespace std;
     
     VG MSAConverter::make_graph(bool keep_paths, size_t max_node_length) {
         
-        
-        unordered_set<char> alphabet{'A', 'C', 'T', 'G', 'N', '-'};
-        
         VG graph;
         
         // detect sequences with duplicate names and determine the size of the conversion
@@ -234,170 +231,291 @@ using namespace std;
             }
         }
         
-        for (const unordered_map<string, string>& alignment : alignments) {
-            
-            // the node that each input sequence is extending
-            unordered_map<string, Node*> current_node;
+        // convert the blocks into their own graphs in parallel, each numbered from 1
+        vector<Graph> block_graphs(alignments.size());
+        vector<id_t> block_ids_used(alignments.size(), 0);
+        vector<char> block_ok(alignments.size(), true);
+        size_t converted_size = 0;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < alignments.size(); i++) {
+            VG block_graph;
+            block_ok[i] = convert_block(alignments[i], keep_paths, max_node_length, block_graph);
+            // the dummy node we started on used up an ID too
+            block_ids_used[i] = block_graph.current_id - 1;
+            std::swap(block_graphs[i], block_graph.graph);
             
-            // the path we're building for each aligned sequence
-            unordered_map<string, Path*> aln_path;
-            
-            // start all of the alignments on a dummy node
-            Node* dummy_node = graph.create_node("N");
-            for (const auto& seq : alignment) {
-                current_node[seq.first] = dummy_node;
-                
-                if (keep_paths) {
-                    Path* path = graph.graph.add_path();
-                    aln_path[seq.first] = path;
-                    path->set_name(seq.first);
+            size_t block_size = 0;
+            for (const auto& sequence : alignments[i]) {
+                block_size += sequence.second.size();
+            }
+#pragma omp critical (msa_progress)
+            {
+                converted_size += block_size;
+                update_progress(converted_size);
+            }
+        }
+        
+        if (!all_of(block_ok.begin(), block_ok.end(), [](char ok) { return ok; })) {
+            cerr << "error:[MSAConverter] MSA contains non-nucleotide characters" << endl;
+            exit(1);
+        }
+        
+        // give the blocks consecutive ranges of IDs, in the order they came in
+        vector<id_t> block_offsets(alignments.size(), 0);
+        id_t next_id = 1;
+        for (size_t i = 0; i < alignments.size(); i++) {
+            block_offsets[i] = next_id - 1;
+            next_id += block_ids_used[i];
+        }
+        
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < block_graphs.size(); i++) {
+            id_t offset = block_offsets[i];
+            if (offset == 0) {
+                continue;
+            }
+            Graph& block_graph = block_graphs[i];
+            for (size_t j = 0; j < block_graph.node_size(); j++) {
+                Node* node = block_graph.mutable_node(j);
+                node->set_id(node->id() + offset);
+            }
+            for (size_t j = 0; j < block_graph.edge_size(); j++) {
+                Edge* edge = block_graph.mutable_edge(j);
+                edge->set_from(edge->from() + offset);
+                edge->set_to(edge->to() + offset);
+            }
+            for (size_t j = 0; j < block_graph.path_size(); j++) {
+                Path* path = block_graph.mutable_path(j);
+                for (size_t k = 0; k < path->mapping_size(); k++) {
+                    Position* position = path->mutable_mapping(k)->mutable_position();
+                    position->set_node_id(position->node_id() + offset);
                 }
             }
+        }
+        
+        // stitch the blocks together in order, moving rather than copying
+        for (Graph& block_graph : block_graphs) {
+            vector<Node*> nodes(block_graph.node_size());
+            if (!nodes.empty()) {
+                block_graph.mutable_node()->ExtractSubrange(0, nodes.size(), nodes.data());
+            }
+            for (Node* node : nodes) {
+                graph.graph.mutable_node()->AddAllocated(node);
+            }
+            vector<Edge*> edges(block_graph.edge_size());
+            if (!edges.empty()) {
+                block_graph.mutable_edge()->ExtractSubrange(0, edges.size(), edges.data());
+            }
+            for (Edge* edge : edges) {
+                graph.graph.mutable_edge()->AddAllocated(edge);
+            }
+            vector<Path*> paths(block_graph.path_size());
+            if (!paths.empty()) {
+                block_graph.mutable_path()->ExtractSubrange(0, paths.size(), paths.data());
+            }
+            for (Path* path : paths) {
+                graph.graph.mutable_path()->AddAllocated(path);
+            }
+            block_graph.Clear();
+        }
+        graph.build_indexes_dropping_duplicates();
+        graph.current_id = next_id;
+        
+        destroy_progress();
+        
+        return graph;
+    }
+    
+    bool MSAConverter::convert_block(const unordered_map<string, string>& alignment, bool keep_paths,
+                                     size_t max_node_length, VG& graph) const {
+        
+        // the characters we can see other than gaps, in the order we handle them in each column
+        static const string alphabet = "ACGTN";
+        
+        if (alignment.empty()) {
+            return true;
+        }
+        
+        // look sequences up by their index rather than their name as we go along the columns
+        vector<const string*> names;
+        vector<const string*> sequences;
+        for (const auto& seq : alignment) {
+            names.push_back(&seq.first);
+            sequences.push_back(&seq.second);
+        }
+        
+        // the node that each input sequence is extending
+        vector<Node*> current_node(sequences.size());
+        
+        // the path we're building for each aligned sequence
+        vector<Path*> aln_path(sequences.size(), nullptr);
+        
+        // the column where each sequence's current run of gaps ends, until which
+        // there is nothing to do for it
+        vector<size_t> gap_end(sequences.size(), 0);
+        
+        // start all of the alignments on a dummy node
+        Node* dummy_node = graph.create_node("N");
+        for (size_t j = 0; j < sequences.size(); j++) {
+            current_node[j] = dummy_node;
             
-            // nodes that we don't want to extend any more
-            // (we never want to extend the dummy node)
-            unordered_set<Node*> completed_nodes{dummy_node};
-            
-            size_t aln_len = alignment.begin()->second.size();
-            for (size_t i = 0; i < aln_len; i++) {
+            if (keep_paths) {
+                aln_path[j] = graph.graph.add_path();
+                aln_path[j]->set_name(*names[j]);
+            }
+        }
+        
+        // nodes that we don't want to extend any more
+        // (we never want to extend the dummy node)
+        unordered_set<Node*> completed_nodes{dummy_node};
+        
+        // for each character, the nodes and sequences that move onto it in the current column
+        vector<vector<Node*>> transition_nodes(alphabet.size());
+        vector<vector<size_t>> transition_seqs(alphabet.size());
+        unordered_map<Node*, char> forward_transitions;
+        
+        size_t aln_len = sequences.front()->size();
+        for (size_t i = 0; i < aln_len; i++) {
 #ifdef debug_msa_converter
-                cerr << "## beginning column " << i << endl;
+            cerr << "## beginning column " << i << endl;
 #endif
-                unordered_map<Node*, char> forward_transitions;
-                unordered_map<char, pair<unordered_set<Node*>, vector<string>>> transitions;
-                for (const auto& seq : alignment) {
-                    char aln_char = toupper(seq.second[i]);
-                    
-                    if (!alphabet.count(aln_char)) {
-                        cerr << "error:[MSAConverter] MSA contains non-nucleotide characters" << endl;
-                        exit(1);
-                        
-                    }
-                    
-                    Node* node_here = current_node[seq.first];
+            forward_transitions.clear();
+            for (size_t j = 0; j < sequences.size(); j++) {
+                if (i < gap_end[j]) {
+                    // still in a run of gaps, which we dealt with at its start
+                    continue;
+                }
+                
+                char aln_char = toupper((*sequences[j])[i]);
+                Node* node_here = current_node[j];
+                
+                if (aln_char == '-') {
+                    // this alignment isn't transitioning anywhere until the gaps end
                     
-                    if (aln_char != '-') {
-                        // this alignment is transitioning to a new aligned character
-                        transitions[aln_char].first.insert(node_here);
-                        transitions[aln_char].second.push_back(seq.first);
-                        
-                        auto iter = forward_transitions.find(node_here);
-                        if (iter != forward_transitions.end()) {
-                            if (iter->second != aln_char) {
-                                // this node splits in the current column, so don't extend it anymore
-                                completed_nodes.insert(node_here);
-                            }
-                        }
-                        else {
-                            forward_transitions[node_here] = aln_char;
-                        }
-                    }
-                    else {
-                        // this alignment isn't transitioning anywhere yet
-                        
-                        // we don't want to extend nodes where we'll need to attach a gap edge later
+                    // we don't want to extend nodes where we'll need to attach a gap edge later
+                    completed_nodes.insert(node_here);
+                    gap_end[j] = sequences[j]->find_first_not_of('-', i);
+                    continue;
+                }
+                
+                size_t char_idx = alphabet.find(aln_char);
+                if (char_idx == string::npos) {
+                    return false;
+                }
+                
+                // this alignment is transitioning to a new aligned character
+                transition_nodes[char_idx].push_back(node_here);
+                transition_seqs[char_idx].push_back(j);
+                
+                auto iter = forward_transitions.find(node_here);
+                if (iter != forward_transitions.end()) {
+                    if (iter->second != aln_char) {
+                        // this node splits in the current column, so don't extend it anymore
                         completed_nodes.insert(node_here);
                     }
                 }
+                else {
+                    forward_transitions[node_here] = aln_char;
+                }
+            }
+            
+            for (size_t char_idx = 0; char_idx < alphabet.size(); char_idx++) {
+                vector<size_t>& seqs_here = transition_seqs[char_idx];
+                if (seqs_here.empty()) {
+                    continue;
+                }
                 
-                for (const auto& transition : transitions) {
-#ifdef debug_msa_converter
-                    cerr << "transition to " << transition.first << endl;
-                    cerr << "from nodes:" << endl;
-                    for (const Node* n : transition.second.first) {
-                        cerr << "\t" << n->id() << ": " << n->sequence() << endl;
-                    }
-                    cerr << "on sequences:" << endl;
-                    for (const string& s : transition.second.second) {
-                        cerr << "\t" << s << endl;
+                // deduplicate the nodes we're coming from, in a consistent order
+                vector<Node*>& from_nodes = transition_nodes[char_idx];
+                sort(from_nodes.begin(), from_nodes.end(), [](const Node* a, const Node* b) {
+                    return a->id() < b->id();
+                });
+                from_nodes.erase(unique(from_nodes.begin(), from_nodes.end()), from_nodes.end());
+                
+                Node* at_node;
+                
+                if (from_nodes.size() > 1) {
+                    Node* new_node = graph.create_node(string(1, alphabet[char_idx]));
+                    
+                    for (Node* attaching_node : from_nodes) {
+                        graph.create_edge(attaching_node, new_node);
+                        // we don't want to extend nodes that already have edges out of their ends
+                        completed_nodes.insert(attaching_node);
                     }
-#endif
-                    Node* at_node;
                     
-                    if (transition.second.first.size() > 1) {
-                        Node* new_node = graph.create_node(string(1, transition.first));
+                    // keep track of the fact that now we are on the new node
+                    at_node = new_node;
+                    
+                }
+                else {
+                    // there's only one node that wants to transition to this
+                    // character, so we might be able to just extend the node
+                    at_node = from_nodes.front();
+                    
+                    if (at_node->sequence().size() >= max_node_length ||
+                        completed_nodes.count(at_node)) {
+                        // we either want to split this node just because of length or because
+                        // we've already marked it as unextendable
                         
-                        for (Node* attaching_node : transition.second.first) {
-                            graph.create_edge(attaching_node, new_node);
-                            // we don't want to extend nodes that already have edges out of their ends
-                            completed_nodes.insert(attaching_node);
-                        }
+                        Node* new_node = graph.create_node(string(1, alphabet[char_idx]));
+                        
+                        graph.create_edge(at_node, new_node);
+                        completed_nodes.insert(at_node);
                         
                         // keep track of the fact that now we are on the new node
                         at_node = new_node;
-                        
                     }
                     else {
-                        // there's only one node that wants to transition to this
-                        // character, so we might be able to just extend the node
-                        at_node = *transition.second.first.begin();
-                        
-                        if (at_node->sequence().size() >= max_node_length ||
-                            completed_nodes.count(at_node)) {
-                            // we either want to split this node just because of length or because
-                            // we've already marked it as unextendable
-                            
-                            Node* new_node = graph.create_node(string(1, transition.first));
-                            
-                            graph.create_edge(at_node, new_node);
-                            completed_nodes.insert(at_node);
-                            
-                            // keep track of the fact that now we are on the new node
-                            at_node = new_node;
-                        }
-                        else {
-                            at_node->mutable_sequence()->append(1, transition.first);
-                        }
+                        at_node->mutable_sequence()->append(1, alphabet[char_idx]);
                     }
+                }
+                
+                // update which node the paths are currently extending
+                for (size_t j : seqs_here) {
+                    current_node[j] = at_node;
                     
-                    // update which node the paths are currently extending
-                    for (const string& name : transition.second.second) {
-                        current_node[name] = at_node;
-                        
-                        if (keep_paths) {
-                            Path* path = aln_path[name];
-                            if (path->mapping_size() == 0 ? true :
-                                at_node->id() != path->mapping(path->mapping_size() - 1).position().node_id()) {
-                                Mapping* mapping = path->add_mapping();
-                                mapping->mutable_position()->set_node_id(at_node->id());
-                                mapping->set_rank(path->mapping_size());
-                            }
+                    if (keep_paths) {
+                        Path* path = aln_path[j];
+                        if (path->mapping_size() == 0 ? true :
+                            at_node->id() != path->mapping(path->mapping_size() - 1).position().node_id()) {
+                            Mapping* mapping = path->add_mapping();
+                            mapping->mutable_position()->set_node_id(at_node->id());
+                            mapping->set_rank(path->mapping_size());
                         }
                     }
                 }
                 
-                update_progress(alignment.size());
-                
+                from_nodes.clear();
+                seqs_here.clear();
+            }
+            
 #ifdef debug_msa_converter
-                cerr << "graph: " << pb2json(graph.graph) << endl;
-                cerr << "node locations of sequences:" << endl;
-                for (const auto& curr : current_node) {
-                    cerr << "\t" << curr.first << " " << curr.second->id() << endl;
-                }
+            cerr << "graph: " << pb2json(graph.graph) << endl;
+            cerr << "node locations of sequences:" << endl;
+            for (size_t j = 0; j < sequences.size(); j++) {
+                cerr << "\t" << *names[j] << " " << current_node[j]->id() << endl;
+            }
 #endif
+        }
+        
+        for (Path* path : aln_path) {
+            if (!path) {
+                continue;
             }
-            
-            for (pair<const string, Path*> path_record : aln_path) {
-                Path* path = path_record.second;
-                for (size_t i = 0; i < path->mapping_size(); i++) {
-                    Mapping* mapping = path->mutable_mapping(i);
-                    assert(mapping->edit_size() == 0);
-                    Edit* edit = mapping->add_edit();
-                    
-                    size_t node_length = graph.get_node(mapping->position().node_id())->sequence().size();
-                    edit->set_from_length(node_length);
-                    edit->set_to_length(node_length);
-                }
+            for (size_t i = 0; i < path->mapping_size(); i++) {
+                Mapping* mapping = path->mutable_mapping(i);
+                assert(mapping->edit_size() == 0);
+                Edit* edit = mapping->add_edit();
+                
+                size_t node_length = graph.get_node(mapping->position().node_id())->sequence().size();
+                edit->set_from_length(node_length);
+                edit->set_to_length(node_length);
             }
-            
-            graph.destroy_node(dummy_node);
         }
         
-        destroy_progress();
+        graph.destroy_node(dummy_node);
         
-        return graph;
+        return true;
     }
 
 }
-
-
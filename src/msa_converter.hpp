@@ -32,6 +32,12 @@ using namespace std;
         
     private:
         
+        /// Build the graph for one alignment block into an empty VG, with
+        /// node IDs starting from 1. Returns false if the block has a
+        /// character that isn't a nucleotide or a gap.
+        bool convert_block(const unordered_map<string, string>& alignment, bool keep_paths,
+                           size_t max_node_length, VG& graph) const;
+        
         vector<unordered_map<string, string>> alignments;
         
     };
@@ -72,10 +72,12 @@ namespace vg {
             multipath_aln.set_start(i, index[multipath_aln.start(i)]);
         }
         
-        // in place permutation according to the topological order
+        // in place permutation according to the topological order, swapping the pointers to the subpaths
+        // rather than the subpaths themselves
+        auto subpaths = multipath_aln.mutable_subpath();
         for (size_t i = 0; i < multipath_aln.subpath_size(); i++) {
             while (index[i] != i) {
-                std::swap(*multipath_aln.mutable_subpath(i), *multipath_aln.mutable_subpath(index[i]));
+                subpaths->SwapElements(i, index[i]);
                 std::swap(index[i], index[index[i]]);
             }
         }
@@ -334,211 +336,215 @@ namespace vg {
         return optimal_alignment_internal(multipath_aln, nullptr);
     }
     
-    vector<Alignment> optimal_alignments(const MultipathAlignment& multipath_aln, size_t count) {
-        
-#ifdef debug_multiple_tracebacks
-        cerr << "Computing top " << count << " alignments" << endl;
-#endif
-        
-        // Keep a list of what we're going to emit.
-        vector<Alignment> to_return;
+    MultipathAlignmentEnumerator::MultipathAlignmentEnumerator(const MultipathAlignment& multipath_aln) :
+        multipath_aln(multipath_aln), traceback_heaps(multipath_aln.subpath_size(), -2) {
         
         // Fill out the dynamic programming problem
         auto dp_result = run_multipath_dp(multipath_aln);
-        // Get the filled DP problem
-        MultipathProblem& problem = get<0>(dp_result);
-        // And the optimal final subpath
-        int64_t& opt_subpath = get<1>(dp_result);
-        // And the optimal score
-        int32_t& opt_score = get<2>(dp_result);
-        
-        // Keep lists of DP steps, which are subpath numbers to visit.
-        // Even going to the end subpath (where prefix length + subpath length = read length) is a DP step
-        // We never deal with empty lists; we always seed with the traceback start node.
-        using step_list_t = ImmutableList<int64_t>;
-        
-        // Put them in a size-limited priority queue by score difference (positive) from optimal
-        MinMaxHeap<pair<int32_t, step_list_t>> queue;
-        
-        // We define a function to put stuff in the queue and limit its size to
-        // the (count - to_return.size()) items with lowest penalty.
-        auto try_enqueue = [&](const pair<int32_t, step_list_t>& item) {
-            auto max_size = count - to_return.size();
-            if (queue.size() < max_size || item < queue.max()) {
-                // The item belongs in the queue because it fits or it beats
-                // the current worst thing.
-                queue.push(item);
-            } else {
-#ifdef debug_multiple_tracebacks
-                cerr << "Rejected! Queue is full!" << endl;
-#endif
-            }
-            
-            while(queue.size() > max_size) {
-                // We have more possibilities than we need to consider to emit
-                // the top count alignments. Get rid of the worst one.
-                queue.pop_max();
-#ifdef debug_multiple_tracebacks
-                cerr << "Existing item displaced!" << endl;
-#endif
-            }
-        };
-        
-        // Also, subpaths only keep track of their nexts, so we need to invert
-        // that so we can get all valid prev subpaths.
-        vector<vector<int64_t>> prev_subpaths;
-        
-        // We want to be able to start the traceback only from places where we
-        // won't get shorter versions of same- or higher-scoring alignments.
-        // This means that we want exactly the subpaths that have no successors
-        // with nonnegative subpath score.
-        
-        // So we go through all the subpaths, check all their successors, and
-        // add starting points for all satisfactory subpaths to the queue.
-        // Sinks in the graphs will always be in here, as will the starting
-        // point for tracing back the optimal alignment.
-        
-        // We know what the penalty from optimal is for each, because we know
-        // the optimal score overall and the score we would get for the optimal
-        // alignment ending at each.
+        problem = unique_ptr<MultipathProblem>(new MultipathProblem(move(get<0>(dp_result))));
+        opt_score = get<2>(dp_result);
         
+        // Subpaths only keep track of their nexts, so we need to invert that to get the sidetracks.
+        // At the same time, find the subpaths that tracebacks can start from: the ones that have no
+        // successors with nonnegative subpath score, since otherwise we would get shorter versions of
+        // same- or higher-scoring alignments.
         prev_subpaths.resize(multipath_aln.subpath_size());
+        int64_t end_heap = -1;
         for (int64_t i = 0; i < multipath_aln.subpath_size(); i++) {
-            // For each subpath
-            
-            // If it has no successors, we can start a traceback here
             bool valid_traceback_start = true;
-            
             for (auto& next_subpath : multipath_aln.subpath(i).next()) {
-                // For each next subpath it lists
-                
-                // Register this subpath as a predecessor of the next
                 prev_subpaths[next_subpath].push_back(i);
-                
                 if (multipath_aln.subpath(next_subpath).score() >= 0) {
-                    // This successor has a nonnegative score, so taking it
-                    // after us would generate a longer, same- or
-                    // higher-scoring alignment. So we shouldn't start a
-                    // traceback from subpath i.
                     valid_traceback_start = false;
                 }
             }
             
             if (valid_traceback_start) {
-                // We can start a traceback here.
-                
-                // The score penalty for starting here is the optimal score minus the optimal score starting here
-                auto penalty = opt_score - (problem.prefix_score[i] + multipath_aln.subpath(i).score());
-                
-                // The path is just to be here
-                step_list_t starting_path{i};
+                // The penalty for ending here is the optimal score minus the optimal score ending here
+                int32_t penalty = opt_score - (problem->prefix_score[i] + multipath_aln.subpath(i).score());
                 
 #ifdef debug_multiple_tracebacks
                 cerr << "Could end at subpath " << i << " with penalty " << penalty << endl;
 #endif
                 
-                try_enqueue(make_pair(penalty, starting_path));
+                end_heap = meld(end_heap, make_heap_node(penalty, -1, i));
             }
         }
         
-        while (!queue.empty() && to_return.size() < count) {
-            // Each iteration
-            
-            // Grab the best list as our basis
-            int32_t basis_score_difference;
-            step_list_t basis;
-            tie(basis_score_difference, basis) = queue.min();
-            queue.pop_min();
-            
-            assert(!basis.empty());
-            
-#ifdef debug_multiple_tracebacks
-            size_t basis_size = 0;
-            for (auto& i : basis) {
-                basis_size++;
+        if (end_heap >= 0) {
+            // Choosing the best end, and no sidetracks, is the optimal alignment
+            queue.emplace(heap_nodes[end_heap].penalty, end_heap, -1);
+        }
+    }
+    
+    MultipathAlignmentEnumerator::~MultipathAlignmentEnumerator() {
+        // Nothing to do, but MultipathProblem is complete here
+    }
+    
+    int64_t MultipathAlignmentEnumerator::make_heap_node(int32_t penalty, int64_t subpath_idx, int64_t prev_idx) {
+        heap_nodes.emplace_back();
+        SidetrackHeapNode& node = heap_nodes.back();
+        node.penalty = penalty;
+        node.subpath_idx = subpath_idx;
+        node.prev_idx = prev_idx;
+        node.left = -1;
+        node.right = -1;
+        node.rank = 1;
+        return heap_nodes.size() - 1;
+    }
+    
+    int64_t MultipathAlignmentEnumerator::meld(int64_t heap_1, int64_t heap_2) {
+        if (heap_1 < 0) {
+            return heap_2;
+        }
+        if (heap_2 < 0) {
+            return heap_1;
+        }
+        if (heap_nodes[heap_2].penalty < heap_nodes[heap_1].penalty) {
+            std::swap(heap_1, heap_2);
+        }
+        
+        // copy the root rather than modifying it, so that heap_1 is still intact for anything else
+        // that shares it
+        SidetrackHeapNode root = heap_nodes[heap_1];
+        root.right = meld(root.right, heap_2);
+        int64_t left_rank = root.left >= 0 ? heap_nodes[root.left].rank : 0;
+        int64_t right_rank = heap_nodes[root.right].rank;
+        if (left_rank < right_rank) {
+            std::swap(root.left, root.right);
+            std::swap(left_rank, right_rank);
+        }
+        root.rank = right_rank + 1;
+        
+        heap_nodes.push_back(root);
+        return heap_nodes.size() - 1;
+    }
+    
+    int64_t MultipathAlignmentEnumerator::traceback_heap(int64_t subpath_idx) {
+        
+        // find the subpaths along the optimal traceback whose heaps we still need to make
+        vector<int64_t> to_make;
+        for (int64_t curr = subpath_idx; curr >= 0 && traceback_heaps[curr] == -2; curr = problem->prev_subpath[curr]) {
+            to_make.push_back(curr);
+        }
+        
+        // make them from the start of the traceback onward, since each one is the sidetracks from its own
+        // subpath melded onto the heap of its optimal predecessor
+        for (auto iter = to_make.rbegin(); iter != to_make.rend(); ++iter) {
+            int64_t curr = *iter;
+            int64_t prev = problem->prev_subpath[curr];
+            if (prev < 0) {
+                // this subpath is optimal as a start, so the traceback always ends here
+                traceback_heaps[curr] = -1;
+                continue;
             }
-            cerr << "Consider " << basis_size << " element traceback to " << basis.front() << " with penalty "
-                 << basis_score_difference << endl;
-            cerr << "\t" << pb2json(multipath_aln.subpath(basis.front()).path()) << endl;
-#endif
             
-            if (problem.prev_subpath[basis.front()] == -1) {
-                // If it leads all the way to a subpath that is optimal as a start
-                
-                // Make an Alignment to emit it in
-                to_return.emplace_back();
-                Alignment& aln_out = to_return.back();
-                
-                // Set up read info and MAPQ
-                // TODO: MAPQ on secondaries?
-                transfer_read_metadata(multipath_aln, aln_out);
-                aln_out.set_mapping_quality(multipath_aln.mapping_quality());
-                
-                // Populate path
-                populate_path_from_traceback(multipath_aln, problem, basis.begin(), basis.end(), aln_out.mutable_path());
-                
-                // Set score
-                aln_out.set_score(opt_score - basis_score_difference);
-                
+            int64_t heap = traceback_heaps[prev];
+            bool skipped_optimal = false;
+            for (int64_t sidetrack : prev_subpaths[curr]) {
+                if (sidetrack == prev && !skipped_optimal) {
+                    // this is the optimal traceback, not a sidetrack
+                    skipped_optimal = true;
+                    continue;
+                }
+                int32_t penalty = problem->prefix_score[curr] - (problem->prefix_score[sidetrack]
+                                                                 + multipath_aln.subpath(sidetrack).score());
+                heap = meld(heap, make_heap_node(penalty, curr, sidetrack));
+            }
+            traceback_heaps[curr] = heap;
+        }
+        
+        return traceback_heaps[subpath_idx];
+    }
+    
+    bool MultipathAlignmentEnumerator::next(Alignment& aln_out) {
+        
+        if (queue.empty()) {
+            return false;
+        }
+        
+        int32_t penalty;
+        int64_t heap_node;
+        int64_t prev_sidetracks;
+        tie(penalty, heap_node, prev_sidetracks) = queue.top();
+        queue.pop();
+        
+        sidetrack_lists.emplace_back(heap_node, prev_sidetracks);
+        int64_t sidetracks = sidetrack_lists.size() - 1;
+        
+        // the same sidetracks, with this one swapped for the next best ones in its heap
+        for (int64_t child : {heap_nodes[heap_node].left, heap_nodes[heap_node].right}) {
+            if (child >= 0) {
+                queue.emplace(penalty - heap_nodes[heap_node].penalty + heap_nodes[child].penalty,
+                              child, prev_sidetracks);
+            }
+        }
+        // these sidetracks, followed by the best one further along the traceback
+        int64_t further = traceback_heap(heap_nodes[heap_node].prev_idx);
+        if (further >= 0) {
+            queue.emplace(penalty + heap_nodes[further].penalty, further, sidetracks);
+        }
+        
+        // get the sidetracks in the order the traceback takes them, starting with the end subpath
+        vector<int64_t> sidetrack_order;
+        for (int64_t i = sidetracks; i >= 0; i = sidetrack_lists[i].second) {
+            sidetrack_order.push_back(sidetrack_lists[i].first);
+        }
+        
+        // follow the optimal traceback between them
+        vector<int64_t> traceback;
+        int64_t curr = -1;
+        for (auto iter = sidetrack_order.rbegin(); iter != sidetrack_order.rend(); ++iter) {
+            const SidetrackHeapNode& sidetrack = heap_nodes[*iter];
+            if (sidetrack.subpath_idx >= 0) {
+                while (curr != sidetrack.subpath_idx) {
+                    assert(curr >= 0);
+                    traceback.push_back(curr);
+                    curr = problem->prev_subpath[curr];
+                }
+                traceback.push_back(curr);
+            }
+            curr = sidetrack.prev_idx;
+        }
+        while (curr >= 0) {
+            traceback.push_back(curr);
+            curr = problem->prev_subpath[curr];
+        }
+        
+        // make the alignment
+        aln_out.Clear();
+        // TODO: MAPQ on secondaries?
+        transfer_read_metadata(multipath_aln, aln_out);
+        aln_out.set_mapping_quality(multipath_aln.mapping_quality());
+        populate_path_from_traceback(multipath_aln, *problem, traceback.rbegin(), traceback.rend(),
+                                     aln_out.mutable_path());
+        aln_out.set_score(opt_score - penalty);
+        
 #ifdef debug_multiple_tracebacks
-                cerr << "Traceback reaches start; emit with score " << aln_out.score() << endl;
+        cerr << "Emit alignment through " << traceback.size() << " subpaths with penalty " << penalty << endl;
 #endif
-                
-            } else {
-                // The path does not lead all the way to a source
-                
-                // Find out all the places we can come from, and the score
-                // penalties, relative to the optimal score for an alignment
-                // visiting the basis's lead subpath, that we would take if we
-                // came from each.
-                // Note that we will only do this once per subpath, when we are
-                // working on the optimal alignment going through that subpath.
-                list<pair<int64_t, int32_t>> destinations;
-                
-                // The destinations will be all places we could have arrived here from
-                auto& here = basis.front();
-                
-                // To compute the additional score difference, we need to know what our optimal prefix score was.
-                auto& best_prefix_score = problem.prefix_score[here];
-                
-                for (auto& prev : prev_subpaths[here]) {
-                    // For each, compute the score of the optimal alignment ending at that predecessor
-                    auto prev_opt_score = problem.prefix_score[prev] + multipath_aln.subpath(prev).score();
-                    
-                    // What's the difference we would take if we went with this predecessor?
-                    auto additional_penalty = best_prefix_score - prev_opt_score;
-                    
-                    destinations.emplace_back(prev, additional_penalty);
-                }
-                
-                // TODO: unify loops!
-                
-                for (auto& destination : destinations) {
-                    // Prepend each of the things that can be prepended
-                    
-                    // Unpack
-                    auto& prev = destination.first;
-                    auto& additional_penalty = destination.second;
-                    
-                    // Make an extended path
-                    auto extended_path = basis.push_front(prev);
-                    
-                    // Calculate the score differences from optimal
-                    auto total_penalty = basis_score_difference + additional_penalty;
-                    
+        
+        return true;
+    }
+    
+    vector<Alignment> optimal_alignments(const MultipathAlignment& multipath_aln, size_t count) {
+        
 #ifdef debug_multiple_tracebacks
-                    cerr << "\tAugment with " << prev << " to penalty " << total_penalty << endl;
+        cerr << "Computing top " << count << " alignments" << endl;
 #endif
-                    
-                    // Put them in the priority queue
-                    try_enqueue(make_pair(total_penalty, extended_path));
-                }
-                
+        
+        vector<Alignment> to_return;
+        
+        MultipathAlignmentEnumerator enumerator(multipath_aln);
+        while (to_return.size() < count) {
+            to_return.emplace_back();
+            if (!enumerator.next(to_return.back())) {
+                to_return.pop_back();
+                break;
             }
         }
         
         return to_return;
-        
     }
     
     vector<Alignment> optimal_alignments_with_disjoint_subpaths(const MultipathAlignment& multipath_aln, size_t count) {
@@ -914,7 +920,7 @@ namespace vg {
             reverse_complement_path_in_place(subpath_2->mutable_path(), node_length);
             
             // swap their positions (to maintain topological ordering)
-            std::swap(*subpath_1, *subpath_2);
+            multipath_aln->mutable_subpath()->SwapElements(i, j);
         }
         
         // repeat process for the middle subpath if there is an odd number
@@ -935,7 +941,7 @@ namespace vg {
         
         // add reversed edges
         for (int64_t i = 0, j = last; i < multipath_aln->subpath_size(); i++, j--) {
-            vector<int64_t> edges = reverse_edge_lists[j];
+            const vector<int64_t>& edges = reverse_edge_lists[j];
             Subpath* subpath = multipath_aln->mutable_subpath(i);
             for (int64_t k : edges) {
                 subpath->add_next(last - k);
@@ -1066,7 +1072,8 @@ namespace vg {
         transfer_read_metadata(multipath_aln, sub_multipath_aln);
         
         // create subpaths for each of the ones we're retaining and record the translation
-        unordered_map<int64_t, int64_t> new_index;
+        vector<int64_t> new_index(multipath_aln.subpath_size(), -1);
+        sub_multipath_aln.mutable_subpath()->Reserve(subpath_indexes.size());
         for (int64_t i = 0; i < subpath_indexes.size(); i++) {
             int64_t old_idx = subpath_indexes[i];
             const Subpath& old_subpath = multipath_aln.subpath(old_idx);
@@ -1083,7 +1090,7 @@ namespace vg {
             const Subpath& old_subpath = multipath_aln.subpath(subpath_indexes[i]);
             Subpath* new_subpath = sub_multipath_aln.mutable_subpath(i);
             for (int64_t j = 0; j < old_subpath.next_size(); j++) {
-                if (new_index.count(old_subpath.next(j))) {
+                if (new_index[old_subpath.next(j)] >= 0) {
                     new_subpath->add_next(new_index[old_subpath.next(j)]);
                 }
             }
@@ -12,6 +12,8 @@
 #include <list>
 #include <unordered_map>
 #include <algorithm>
+#include <memory>
+#include <queue>
 #include "vg.pb.h"
 #include "path.hpp"
 #include "alignment.hpp"
@@ -80,6 +82,76 @@ namespace vg {
     ///
     vector<Alignment> optimal_alignments_with_disjoint_subpaths(const MultipathAlignment& multipath_aln, size_t count);
     
+    struct MultipathProblem;
+    
+    /// Lazily enumerates the alignments contained in a MultipathAlignment, from the highest scoring
+    /// down: the same ones optimal_alignments() returns, for as long as the caller wants them. The
+    /// dynamic programming is run once, up front. Every alignment is the optimal traceback from some
+    /// end subpath with a series of detours ("sidetracks") into subpaths from other than their optimal
+    /// predecessor, so as in Eppstein's k shortest paths algorithm the sidetracks available from each
+    /// subpath are kept in persistent heaps, and each next alignment takes a few heap operations plus
+    /// the time to spell it out.
+    ///
+    /// Note: Assumes that each subpath's Path object uses one Mapping per node and that
+    /// start subpaths have been identified. The MultipathAlignment must outlive the enumerator.
+    class MultipathAlignmentEnumerator {
+    public:
+        MultipathAlignmentEnumerator(const MultipathAlignment& multipath_aln);
+        ~MultipathAlignmentEnumerator();
+        
+        /// Store the next best alignment in aln_out (overwriting it) and return true, or return false
+        /// if there are no more.
+        bool next(Alignment& aln_out);
+        
+    private:
+        
+        /// A node in a persistent leftist min-heap of sidetracks, keyed by how much the sidetrack
+        /// costs compared to following the optimal traceback
+        struct SidetrackHeapNode {
+            int32_t penalty;
+            /// The subpath the sidetrack leaves from, or -1 if this is the choice of end subpath
+            int64_t subpath_idx;
+            /// The predecessor (or end subpath) the traceback continues from
+            int64_t prev_idx;
+            int64_t left;
+            int64_t right;
+            /// Length of the path to the nearest missing child
+            int64_t rank;
+        };
+        
+        /// Add a heap node and return its index
+        int64_t make_heap_node(int32_t penalty, int64_t subpath_idx, int64_t prev_idx);
+        
+        /// Meld two heaps without modifying either one and return the root of the result, or -1 if
+        /// both are empty
+        int64_t meld(int64_t heap_1, int64_t heap_2);
+        
+        /// Get the heap of every sidetrack available from the optimal traceback from a subpath,
+        /// making it if it hasn't been made yet
+        int64_t traceback_heap(int64_t subpath_idx);
+        
+        const MultipathAlignment& multipath_aln;
+        /// The filled dynamic programming problem
+        unique_ptr<MultipathProblem> problem;
+        /// The optimal score
+        int32_t opt_score;
+        /// The predecessors of each subpath
+        vector<vector<int64_t>> prev_subpaths;
+        
+        /// Storage for all of the heaps
+        vector<SidetrackHeapNode> heap_nodes;
+        /// The root of each subpath's traceback heap, -1 if it is empty, or -2 if it hasn't been made
+        vector<int64_t> traceback_heaps;
+        
+        /// Sidetracks taken so far by queued alignments, as a persistent list of heap nodes and the
+        /// index of the sidetrack before them (or -1)
+        vector<pair<int64_t, int64_t>> sidetrack_lists;
+        /// Alignments that might come next: penalty from the optimal score, the heap node of their
+        /// last sidetrack, and the sidetrack list before it
+        priority_queue<tuple<int32_t, int64_t, int64_t>, vector<tuple<int32_t, int64_t, int64_t>>,
+                       greater<tuple<int32_t, int64_t, int64_t>>> queue;
+    };
+    
     /// Stores the reverse complement of a MultipathAlignment in another MultipathAlignment
     ///
     ///  Args:
@@ -48,7 +48,7 @@ namespace vg {
     MultipathAlignmentGraph::MultipathAlignmentGraph(VG& vg, const MultipathMapper::memcluster_t& hits,
                                                      const unordered_map<id_t, pair<id_t, bool>>& projection_trans,
                                                      const unordered_multimap<id_t, pair<id_t, bool>>& injection_trans,
-                                                     gcsa::GCSA* gcsa) {
+                                                     gcsa::GCSA* gcsa, size_t max_anchors) {
         
         // initialize the match nodes
         create_match_nodes(vg, hits, projection_trans, injection_trans);
@@ -58,6 +58,11 @@ namespace vg {
             collapse_order_length_runs(vg, gcsa);
         }
         
+        if (max_anchors) {
+            // reachability gets expensive with very many anchors, which only happens in repeats
+            cap_anchors(max_anchors);
+        }
+        
 #ifdef debug_multipath_alignment
         cerr << "nodes after adding and collapsing:" << endl;
         for (size_t i = 0; i < path_nodes.size(); i++) {
@@ -76,9 +81,10 @@ namespace vg {
     
     MultipathAlignmentGraph::MultipathAlignmentGraph(VG& vg, const MultipathMapper::memcluster_t& hits,
                                                      const unordered_map<id_t, pair<id_t, bool>>& projection_trans,
-                                                     gcsa::GCSA* gcsa) : 
+                                                     gcsa::GCSA* gcsa, size_t max_anchors) : 
                                                      MultipathAlignmentGraph(vg, hits, projection_trans, 
-                                                                             create_injection_trans(projection_trans), gcsa) {
+                                                                             create_injection_trans(projection_trans), gcsa,
+                                                                             max_anchors) {
         // Nothing to do
         
     }
@@ -808,6 +814,79 @@ namespace vg {
         
     }
     
+    void MultipathAlignmentGraph::cap_anchors(size_t max_anchors) {
+        if (path_nodes.size() <= max_anchors) {
+            return;
+        }
+        
+#ifdef debug_multipath_alignment
+        cerr << "capping " << path_nodes.size() << " match nodes at " << max_anchors << endl;
+#endif
+        
+        // consider the longest anchors first
+        vector<size_t> by_length(path_nodes.size());
+        for (size_t i = 0; i < by_length.size(); i++) {
+            by_length[i] = i;
+        }
+        std::stable_sort(by_length.begin(), by_length.end(), [&](const size_t i, const size_t j) {
+            return path_nodes[i].end - path_nodes[i].begin > path_nodes[j].end - path_nodes[j].begin;
+        });
+        
+        string::const_iterator read_begin = path_nodes.front().begin;
+        string::const_iterator read_end = path_nodes.front().end;
+        for (const PathNode& path_node : path_nodes) {
+            read_begin = std::min(read_begin, path_node.begin);
+            read_end = std::max(read_end, path_node.end);
+        }
+        vector<bool> covered(read_end - read_begin, false);
+        
+        vector<bool> keep(path_nodes.size(), false);
+        size_t num_kept = 0;
+        
+        // first keep the anchors that reach parts of the read that no longer anchor does, so that
+        // we don't lose track of any part of the read that was anchored
+        for (size_t i : by_length) {
+            if (num_kept == max_anchors) {
+                break;
+            }
+            PathNode& path_node = path_nodes[i];
+            bool covers_more = false;
+            for (auto iter = path_node.begin; iter != path_node.end && !covers_more; iter++) {
+                covers_more = !covered[iter - read_begin];
+            }
+            if (covers_more) {
+                keep[i] = true;
+                num_kept++;
+                for (auto iter = path_node.begin; iter != path_node.end; iter++) {
+                    covered[iter - read_begin] = true;
+                }
+            }
+        }
+        
+        // then fill up with the longest of the rest
+        for (size_t i : by_length) {
+            if (num_kept == max_anchors) {
+                break;
+            }
+            if (!keep[i]) {
+                keep[i] = true;
+                num_kept++;
+            }
+        }
+        
+        // remove the others, keeping the order of the ones we keep
+        size_t next = 0;
+        for (size_t i = 0; i < path_nodes.size(); i++) {
+            if (keep[i]) {
+                if (i != next) {
+                    path_nodes[next] = std::move(path_nodes[i]);
+                }
+                next++;
+            }
+        }
+        path_nodes.resize(next);
+    }
+    
     void MultipathAlignmentGraph::resect_snarls_from_paths(SnarlManager* cutting_snarls,
                                                            const unordered_map<id_t, pair<id_t, bool>>& projection_trans,
                                                            int64_t max_snarl_cut_size) {
@@ -2415,53 +2494,46 @@ namespace vg {
         // traverse a path that reveals an edge as transitive before actually traversing the transitive edge
         reorder_adjacency_lists(topological_order);
         
-        for (size_t i : topological_order) {
+        // the position of each node in the topological order
+        vector<size_t> order_position(path_nodes.size());
+        for (size_t i = 0; i < topological_order.size(); i++) {
+            order_position[topological_order[i]] = i;
+        }
+        
+        // for each node, a bitset over topological positions of the nodes that it can reach, including
+        // itself, filled in from the back of the order to the front so that a node's successors are done
+        // before it is
+        size_t num_words = (path_nodes.size() + 63) / 64;
+        vector<uint64_t> reachable(path_nodes.size() * num_words, 0);
+        
+        for (auto iter = topological_order.rbegin(); iter != topological_order.rend(); iter++) {
+            size_t i = *iter;
             vector<pair<size_t, size_t>>& edges = path_nodes[i].edges;
+            uint64_t* reachable_here = reachable.data() + i * num_words;
             
-            // if there is only one edge out of a node, that edge can never be transitive
-            // (this optimization covers most cases)
-            if (edges.size() <= 1) {
-                continue;
-            }
-            
-            vector<bool> keep(edges.size(), true);
-            unordered_set<size_t> traversed;
-            
+            // the edges are in topological order, so if a target can be reached by another path, it is
+            // reached through a target that comes before it
+            size_t next_idx = 0;
             for (size_t j = 0; j < edges.size(); j++) {
-                const pair<size_t, size_t>& edge = edges[j];
-                if (traversed.count(edge.first)) {
+                size_t position = order_position[edges[j].first];
+                if (reachable_here[position / 64] & (uint64_t(1) << (position % 64))) {
                     // we can reach the target of this edge by another path, so it is transitive
-                    keep[j] = false;
                     continue;
                 }
                 
-                // DFS to mark all reachable nodes from this edge
-                vector<size_t> stack{edge.first};
-                traversed.insert(edge.first);
-                while (!stack.empty()) {
-                    size_t idx = stack.back();
-                    stack.pop_back();
-                    for (const pair<size_t, size_t>& edge_from : path_nodes[idx].edges) {
-                        if (!traversed.count(edge_from.first)) {
-                            stack.push_back(edge_from.first);
-                            traversed.insert(edge_from.first);
-                        }
-                    }
-                }
-            }
-            
-            // remove the transitive edges we found
-            size_t next_idx = 0;
-            for (size_t j = 0; j < edges.size(); j++) {
-                if (keep[j] && j != next_idx) {
-                    edges[next_idx] = edges[j];
-                    next_idx++;
-                }
-                else if (keep[j]) {
-                    next_idx++;
+                // nodes can only reach nodes after them in the order, so we can skip the earlier words
+                const uint64_t* reachable_there = reachable.data() + edges[j].first * num_words;
+                for (size_t k = position / 64; k < num_words; k++) {
+                    reachable_here[k] |= reachable_there[k];
                 }
+                
+                edges[next_idx] = edges[j];
+                next_idx++;
             }
             edges.resize(next_idx);
+            
+            size_t position = order_position[i];
+            reachable_here[position / 64] |= uint64_t(1) << (position % 64);
         }
         
         
@@ -2663,7 +2735,22 @@ namespace vg {
         cerr << "doing DP between MEMs" << endl;
 #endif
         
-        // perform alignment in the intervening sections
+        // the alignment problems between the end of one match and the start of the next
+        struct InterveningProblem {
+            size_t from;
+            pair<size_t, size_t> edge;
+            pos_t src_pos;
+            Graph connecting_graph;
+            unordered_map<id_t, id_t> connect_trans;
+            Alignment intervening_sequence;
+            vector<Alignment> alt_alignments;
+        };
+        vector<InterveningProblem> intervening_problems;
+        
+        // the edges whose matches turned out not to be connectable
+        vector<unordered_set<pair<size_t, size_t>>> edges_for_removal(path_nodes.size());
+        
+        // extract the intervening sections
         for (int64_t j = 0; j < path_nodes.size(); j++) {
 #ifdef debug_multipath_alignment
             cerr << "checking for intervening alignments from match node " << j << " with path " << pb2json(path_nodes[j].path) << " and sequence ";
@@ -2674,9 +2761,7 @@ namespace vg {
 #endif
             
             PathNode& src_path_node = path_nodes[j];
-            Subpath* src_subpath = multipath_aln_out.mutable_subpath(j);
-            
-            const Path& path = src_subpath->path();
+            const Path& path = multipath_aln_out.subpath(j).path();
             const Mapping& final_mapping = path.mapping(path.mapping_size() - 1);
             const Position& final_mapping_position = final_mapping.position();
             // make a pos_t that points to the final base in the match
@@ -2687,8 +2772,6 @@ namespace vg {
             // the longest gap that could be detected at this position in the read
             size_t src_max_gap = aligner->longest_detectable_gap(alignment, src_path_node.end);
             
-            unordered_set<pair<size_t, size_t>> edges_for_removal;
-            
             for (const pair<size_t, size_t>& edge : src_path_node.edges) {
                 PathNode& dest_path_node = path_nodes[edge.first];
                 pos_t dest_pos = make_pos_t(multipath_aln_out.subpath(edge.first).path().mapping(0).position());
@@ -2706,129 +2789,152 @@ namespace vg {
 #endif
                 
                 // extract the graph between the matches
-                Graph connecting_graph;
-                unordered_map<id_t, id_t> connect_trans = algorithms::extract_connecting_graph(&align_graph,     // DAG with split strands
-                                                                                               connecting_graph, // graph to extract into
-                                                                                               max_dist,         // longest distance necessary
-                                                                                               src_pos,          // end of earlier match
-                                                                                               dest_pos,         // beginning of later match
-                                                                                               false,            // do not extract the end positions in the matches
-                                                                                               false,            // do not bother finding all cycles (it's a DAG)
-                                                                                               true,             // remove tips
-                                                                                               true,             // only include nodes on connecting paths
-                                                                                               true);            // enforce max distance strictly
-                
-                
-                if (connecting_graph.node_size() == 0) {
+                intervening_problems.emplace_back();
+                InterveningProblem& problem = intervening_problems.back();
+                problem.connect_trans = algorithms::extract_connecting_graph(&align_graph,             // DAG with split strands
+                                                                             problem.connecting_graph, // graph to extract into
+                                                                             max_dist,                 // longest distance necessary
+                                                                             src_pos,                  // end of earlier match
+                                                                             dest_pos,                 // beginning of later match
+                                                                             false,                    // do not extract the end positions in the matches
+                                                                             false,                    // do not bother finding all cycles (it's a DAG)
+                                                                             true,                     // remove tips
+                                                                             true,                     // only include nodes on connecting paths
+                                                                             true);                    // enforce max distance strictly
+                
+                
+                if (problem.connecting_graph.node_size() == 0) {
                     // the MEMs weren't connectable with a positive score after all, mark the edge for removal
-                    edges_for_removal.insert(edge);
+                    edges_for_removal[j].insert(edge);
+                    intervening_problems.pop_back();
                     continue;
                 }
                 
+                problem.from = j;
+                problem.edge = edge;
+                problem.src_pos = src_pos;
+                
                 // transfer the substring between the matches to a new alignment
-                Alignment intervening_sequence;
-                intervening_sequence.set_sequence(alignment.sequence().substr(src_path_node.end - alignment.sequence().begin(),
-                                                                              dest_path_node.begin - src_path_node.end));
+                problem.intervening_sequence.set_sequence(alignment.sequence().substr(src_path_node.end - alignment.sequence().begin(),
+                                                                                      dest_path_node.begin - src_path_node.end));
                 if (!alignment.quality().empty()) {
-                    intervening_sequence.set_quality(alignment.quality().substr(src_path_node.end - alignment.sequence().begin(),
-                                                                                dest_path_node.begin - src_path_node.end));
+                    problem.intervening_sequence.set_quality(alignment.quality().substr(src_path_node.end - alignment.sequence().begin(),
+                                                                                        dest_path_node.begin - src_path_node.end));
                 }
-                
+            }
+        }
+        
+        // align all of the intervening sections in one batch, so the aligner can hand them off together
+        // TODO a better way of choosing the number of alternate alignments
+        // TODO alternate alignments restricted only to distinct node paths?
+        vector<BandedAlignmentProblem> banded_problems(intervening_problems.size());
+        for (size_t i = 0; i < intervening_problems.size(); i++) {
+            InterveningProblem& problem = intervening_problems[i];
+#ifdef debug_multipath_alignment
+            cerr << "aligning sequence " << problem.intervening_sequence.sequence() << " to connecting graph: " << pb2json(problem.connecting_graph) << endl;
+#endif
+            banded_problems[i].alignment = &problem.intervening_sequence;
+            banded_problems[i].graph = &problem.connecting_graph;
+            banded_problems[i].alt_alignments = &problem.alt_alignments;
+            banded_problems[i].max_alt_alns = num_alt_alns;
+            banded_problems[i].band_padding = band_padding;
+            banded_problems[i].permissive_banding = true;
+        }
+        aligner->align_global_banded_batch(banded_problems);
+        
+        // add the intervening alignments as subpaths, in the order we found them
+        for (size_t i = 0; i < intervening_problems.size(); i++) {
+            InterveningProblem& problem = intervening_problems[i];
+            const pair<size_t, size_t>& edge = problem.edge;
+            bool added_direct_connection = false;
+            
+            for (Alignment& connecting_alignment : problem.alt_alignments) {
 #ifdef debug_multipath_alignment
-                cerr << "aligning sequence " << intervening_sequence.sequence() << " to connecting graph: " << pb2json(connecting_graph) << endl;
+                cerr << "translating connecting alignment: " << pb2json(connecting_alignment) << endl;
 #endif
                 
-                bool added_direct_connection = false;
-                // TODO a better way of choosing the number of alternate alignments
-                // TODO alternate alignments restricted only to distinct node paths?
-                vector<Alignment> alt_alignments;
-                aligner->align_global_banded_multi(intervening_sequence, alt_alignments, connecting_graph, num_alt_alns, band_padding, true);
+                const Path& aligned_path = connecting_alignment.path();
+                const Mapping& first_mapping = aligned_path.mapping(0);
+                const Mapping& last_mapping = aligned_path.mapping(aligned_path.mapping_size() - 1);
                 
-                for (Alignment& connecting_alignment : alt_alignments) {
-#ifdef debug_multipath_alignment
-                    cerr << "translating connecting alignment: " << pb2json(connecting_alignment) << endl;
-#endif
-                    
-                    const Path& aligned_path = connecting_alignment.path();
-                    const Mapping& first_mapping = aligned_path.mapping(0);
-                    const Mapping& last_mapping = aligned_path.mapping(aligned_path.mapping_size() - 1);
-                    
-                    bool add_first_mapping = mapping_from_length(first_mapping) != 0 || mapping_to_length(first_mapping) != 0;
-                    bool add_last_mapping = ((mapping_from_length(last_mapping) != 0 || mapping_to_length(last_mapping) != 0)
-                                             && aligned_path.mapping_size() > 1);
-                    
-                    if (!(add_first_mapping || add_last_mapping) && aligned_path.mapping_size() <= 2) {
-                        if (!added_direct_connection) {
-                            // edge case where there is a simple split but other non-simple edges intersect the target
-                            // at the same place (so it passes the previous filter)
-                            // it actually doesn't need an alignment, just a connecting edge
-                            src_subpath->add_next(edge.first);
-                            added_direct_connection = true;
-                        }
-                        continue;
+                bool add_first_mapping = mapping_from_length(first_mapping) != 0 || mapping_to_length(first_mapping) != 0;
+                bool add_last_mapping = ((mapping_from_length(last_mapping) != 0 || mapping_to_length(last_mapping) != 0)
+                                         && aligned_path.mapping_size() > 1);
+                
+                if (!(add_first_mapping || add_last_mapping) && aligned_path.mapping_size() <= 2) {
+                    if (!added_direct_connection) {
+                        // edge case where there is a simple split but other non-simple edges intersect the target
+                        // at the same place (so it passes the previous filter)
+                        // it actually doesn't need an alignment, just a connecting edge
+                        multipath_aln_out.mutable_subpath(problem.from)->add_next(edge.first);
+                        added_direct_connection = true;
                     }
-                    
-                    // create a subpath between the matches for this alignment
-                    Subpath* connecting_subpath = multipath_aln_out.add_subpath();
-                    connecting_subpath->set_score(connecting_alignment.score());
-                    Path* subpath_path = connecting_subpath->mutable_path();
-                    
-                    int32_t rank = 1;
-                    
-                    // check to make sure the first is not an empty anchoring mapping
-                    if (add_first_mapping) {
-                        Mapping* mapping = subpath_path->add_mapping();
-                        *mapping = first_mapping;
-                        mapping->set_rank(rank);
+                    continue;
+                }
+                
+                // create a subpath between the matches for this alignment
+                Subpath* connecting_subpath = multipath_aln_out.add_subpath();
+                connecting_subpath->set_score(connecting_alignment.score());
+                Path* subpath_path = connecting_subpath->mutable_path();
+                
+                int32_t rank = 1;
+                
+                // check to make sure the first is not an empty anchoring mapping
+                if (add_first_mapping) {
+                    Mapping* mapping = subpath_path->add_mapping();
+                    *mapping = first_mapping;
+                    mapping->set_rank(rank);
 #ifdef debug_multipath_alignment
-                        cerr << "first mapping is not empty, formed mapping: " << pb2json(*mapping) << endl;
+                    cerr << "first mapping is not empty, formed mapping: " << pb2json(*mapping) << endl;
 #endif
-                        rank++;
-                    }
-                    // add all mapping in between the ends
-                    for (size_t j = 1; j < aligned_path.mapping_size() - 1; j++) {
-                        Mapping* mapping = subpath_path->add_mapping();
-                        *mapping = aligned_path.mapping(j);
-                        mapping->set_rank(rank);
+                    rank++;
+                }
+                // add all mapping in between the ends
+                for (size_t j = 1; j < aligned_path.mapping_size() - 1; j++) {
+                    Mapping* mapping = subpath_path->add_mapping();
+                    *mapping = aligned_path.mapping(j);
+                    mapping->set_rank(rank);
 #ifdef debug_multipath_alignment
-                        cerr << "added middle mapping: " << pb2json(*mapping) << endl;
+                    cerr << "added middle mapping: " << pb2json(*mapping) << endl;
 #endif
-                        rank++;
-                    }
-                    // check to make sure the last is not an empty anchoring mapping or the same as the first
-                    if (add_last_mapping) {
-                        Mapping* mapping = subpath_path->add_mapping();
-                        *mapping = last_mapping;
-                        mapping->set_rank(rank);
+                    rank++;
+                }
+                // check to make sure the last is not an empty anchoring mapping or the same as the first
+                if (add_last_mapping) {
+                    Mapping* mapping = subpath_path->add_mapping();
+                    *mapping = last_mapping;
+                    mapping->set_rank(rank);
 #ifdef debug_multipath_alignment
-                        cerr << "final mapping is not empty, formed mapping: " << pb2json(*mapping) << endl;
+                    cerr << "final mapping is not empty, formed mapping: " << pb2json(*mapping) << endl;
 #endif
+                }
+                
+                // add the appropriate connections
+                multipath_aln_out.mutable_subpath(problem.from)->add_next(multipath_aln_out.subpath_size() - 1);
+                connecting_subpath->add_next(edge.first);
+                
+                // translate the path into the space of the main graph unless the path is null
+                if (connecting_subpath->path().mapping_size() != 0) {
+                    translate_node_ids(*connecting_subpath->mutable_path(), problem.connect_trans);
+                    Mapping* first_subpath_mapping = connecting_subpath->mutable_path()->mutable_mapping(0);
+                    if (first_subpath_mapping->position().node_id() == id(problem.src_pos)) {
+                        first_subpath_mapping->mutable_position()->set_offset(offset(problem.src_pos) + 1);
                     }
-                    
-                    // add the appropriate connections
-                    src_subpath->add_next(multipath_aln_out.subpath_size() - 1);
-                    connecting_subpath->add_next(edge.first);
-                    
-                    // translate the path into the space of the main graph unless the path is null
-                    if (connecting_subpath->path().mapping_size() != 0) {
-                        translate_node_ids(*connecting_subpath->mutable_path(), connect_trans);
-                        Mapping* first_subpath_mapping = connecting_subpath->mutable_path()->mutable_mapping(0);
-                        if (first_subpath_mapping->position().node_id() == final_mapping.position().node_id()) {
-                            first_subpath_mapping->mutable_position()->set_offset(offset(src_pos) + 1);
-                        }
-                    }
-                    
+                }
+                
 #ifdef debug_multipath_alignment
-                    cerr << "subpath from " << j << " to " << edge.first << ":" << endl;
-                    cerr << pb2json(*connecting_subpath) << endl;
+                cerr << "subpath from " << problem.from << " to " << edge.first << ":" << endl;
+                cerr << pb2json(*connecting_subpath) << endl;
 #endif
-                }
             }
-            
-            if (!edges_for_removal.empty()) {
+        }
+        
+        for (size_t j = 0; j < path_nodes.size(); j++) {
+            if (!edges_for_removal[j].empty()) {
+                PathNode& src_path_node = path_nodes[j];
                 auto new_end = std::remove_if(src_path_node.edges.begin(), src_path_node.edges.end(),
                                               [&](const pair<size_t, size_t>& edge) {
-                                                  return edges_for_removal.count(edge);
+                                                  return edges_for_removal[j].count(edge);
                                               });
                 src_path_node.edges.resize(new_end - src_path_node.edges.begin());
             }
@@ -45,18 +45,20 @@ namespace vg {
         /// Construct a graph of the reachability between MEMs in a DAG-ified
         /// graph. If a GCSA is specified, use it to collapse MEMs whose
         /// lengths bump up against the GCSA's order limit on MEM length.
-        /// Produces a graph with reachability edges. Assumes that the cluster
-        /// is sorted by primarily length and secondarily lexicographically by
-        /// read interval.
+        /// If max_anchors is nonzero, keep at most that many MEMs, preferring
+        /// ones that anchor parts of the read no longer MEM does. Produces a
+        /// graph with reachability edges. Assumes that the cluster is sorted
+        /// by primarily length and secondarily lexicographically by read
+        /// interval.
         MultipathAlignmentGraph(VG& vg, const MultipathMapper::memcluster_t& hits,
                                 const unordered_map<id_t, pair<id_t, bool>>& projection_trans,
                                 const unordered_multimap<id_t, pair<id_t, bool>>& injection_trans,
-                                gcsa::GCSA* gcsa = nullptr);
+                                gcsa::GCSA* gcsa = nullptr, size_t max_anchors = 0);
                                 
         /// Same as the previous constructor, but construct injection_trans implicitly and temporarily.
         MultipathAlignmentGraph(VG& vg, const MultipathMapper::memcluster_t& hits,
                                 const unordered_map<id_t, pair<id_t, bool>>& projection_trans,
-                                gcsa::GCSA* gcsa = nullptr);
+                                gcsa::GCSA* gcsa = nullptr, size_t max_anchors = 0);
         
         /// Construct a graph of the reachability between MEMs in a linearized
         /// path graph. Produces a graph with reachability edges.
@@ -143,6 +145,11 @@ namespace vg {
         /// then lexicographically by read interval, does not update edges
         void collapse_order_length_runs(VG& vg, gcsa::GCSA* gcsa);
         
+        /// Removes match nodes until there are at most max_anchors of them. First keeps the
+        /// longest nodes that cover some part of the read that no longer kept node does, then
+        /// fills up with the longest of the rest. Does not update edges.
+        void cap_anchors(size_t max_anchors);
+        
         /// Reorders adjacency list representation of edges so that they follow the indicated
         /// ordering of their target nodes
         void reorder_adjacency_lists(const vector<size_t>& order);
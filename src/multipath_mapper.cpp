@@ -35,7 +35,29 @@ namespace vg {
     void MultipathMapper::multipath_map(const Alignment& alignment,
                                         vector<MultipathAlignment>& multipath_alns_out,
                                         size_t max_alt_mappings) {
+        string cache_key;
+        if (result_cache) {
+            // the qualities only change the result if we align with them
+            cache_key = result_cache->key(alignment.sequence(),
+                                          adjust_alignments_for_base_quality ? alignment.quality() : string(),
+                                          {(int64_t) max_alt_mappings});
+            if (result_cache->lookup(cache_key, multipath_alns_out)) {
+                for (MultipathAlignment& multipath_aln : multipath_alns_out) {
+                    multipath_aln.set_name(alignment.name());
+                    multipath_aln.set_quality(alignment.quality());
+                }
+                return;
+            }
+        }
+        
+        start_read_work();
         multipath_map_internal(alignment, mapping_quality_method, multipath_alns_out, max_alt_mappings);
+        annotate_budget_limited(multipath_alns_out);
+        log_slow_read(alignment);
+        
+        if (result_cache) {
+            result_cache->store(cache_key, multipath_alns_out);
+        }
     }
     
     void MultipathMapper::multipath_map_internal(const Alignment& alignment,
@@ -66,23 +88,12 @@ namespace vg {
         
         // cluster the MEMs
         vector<memcluster_t> clusters;
-        // memos for the results of expensive succinct operations that we may need to do multiple times
-        OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
-        OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
-        OrientedDistanceClusterer::handle_memo_t handle_memo;
-        // TODO: Making OrientedDistanceClusterers is the only place we actually
-        // need to distinguish between regular_aligner and qual_adj_aligner
-        if (adjust_alignments_for_base_quality) {
-            OrientedDistanceClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
-                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-            clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-        }
-        else {
-            OrientedDistanceClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
-                                                min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-            clusters = clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-        }
+        // cache the results of expensive succinct operations that we may need to do multiple times
+        xg_query_context.reset(xindex);
+        clusters = cluster_mems(alignment, mems, &xg_query_context);
         
+        // the parts of the XG we decode for one cluster graph are often needed for others
+        CachedHandleGraph xg_cache(xindex);
         
 #ifdef debug_multipath_mapper
         cerr << "obtained clusters:" << endl;
@@ -96,7 +107,7 @@ namespace vg {
 #endif
         
         // extract graphs around the clusters
-        auto cluster_graphs = query_cluster_graphs(alignment, mems, clusters);
+        auto cluster_graphs = query_cluster_graphs(alignment, mems, clusters, &xg_cache);
         
         // actually perform the alignments and post-process to meeth MultipathAlignment invariants
         align_to_cluster_graphs(alignment, mapq_method, cluster_graphs, multipath_alns_out, num_mapping_attempts);
@@ -142,7 +153,8 @@ namespace vg {
                                                   vector<clustergraph_t>& cluster_graphs,
                                                   vector<MultipathAlignment>& multipath_alns_out,
                                                   size_t num_mapping_attempts,
-                                                  vector<size_t>* cluster_idxs) {
+                                                  vector<size_t>* cluster_idxs,
+                                                  cluster_aln_memo_t* cluster_aln_memo) {
         
         
 #ifdef debug_multipath_mapper
@@ -157,9 +169,13 @@ namespace vg {
 //#pragma omp atomic
 //        SUBGRAPH_TOTAL += cluster_graphs.size();
         
+        // the best score among the alignments so far, for pruning dominated clusters
+        int32_t best_score = numeric_limits<int32_t>::min();
+        
         // align to each cluster subgraph
         size_t num_mappings = 0;
-        for (auto& cluster_graph : cluster_graphs) {
+        for (size_t i = 0; i < cluster_graphs.size(); i++) {
+            auto& cluster_graph = cluster_graphs[i];
             // if we have a cluster graph with small enough MEM coverage compared to the best one or we've made
             // the maximum number of alignments we stop producing alternate alignments
             if (get<2>(cluster_graph) < mem_coverage_min_ratio * get<2>(cluster_graphs[0])
@@ -173,12 +189,41 @@ namespace vg {
                 break;
             }
             
+            if (prune_dominated_clusters && num_mappings > 0) {
+                size_t num_dominated = count_dominated_clusters(cluster_graphs, i, best_score,
+                                                                num_mappings_to_compute - num_mappings);
+                if (num_dominated) {
+#ifdef debug_multipath_mapper
+                    cerr << "halting further alignments because the " << num_dominated << " remaining clusters cannot change the mapping quality of score " << best_score << endl;
+#endif
+                    if (stage_stats) {
+                        stage_stats->count(StageStats::CLUSTERS_PRUNED, num_dominated);
+                    }
+                    break;
+                }
+            }
+            
+            if (num_mappings > 0 && alignment_budget_spent()) {
+                // the read has used up its work budget, so we keep what we have
+                break;
+            }
+            
 #ifdef debug_multipath_mapper_alignment
             cerr << "performing alignment to subgraph " << pb2json(get<0>(cluster_graph)->graph) << endl;
 #endif
             
+            count_dp_cells(alignment.sequence(), get<0>(cluster_graph)->graph);
             multipath_alns_out.emplace_back();
-            multipath_align(alignment, get<0>(cluster_graph), get<1>(cluster_graph), multipath_alns_out.back());
+            multipath_align(alignment, get<0>(cluster_graph), get<1>(cluster_graph), multipath_alns_out.back(), cluster_aln_memo);
+            if (stage_stats) {
+                stage_stats->count(StageStats::CLUSTERS_ALIGNED);
+            }
+            
+            if (prune_dominated_clusters) {
+                // scoring needs the subpaths in order, which is needed later anyway
+                topologically_order_subpaths(multipath_alns_out.back());
+                best_score = max(best_score, optimal_alignment_score(multipath_alns_out.back()));
+            }
             
             num_mappings++;
         }
@@ -317,21 +362,46 @@ namespace vg {
                 cerr << "\t" << aln_pair.first.name() << ", " << aln_pair.second.name() << endl;
             }
             cerr << "distance measurements:" << endl;
-            auto iter = fragment_length_distr.measurements_begin();
-            if (iter != fragment_length_distr.measurements_end()) {
-                cerr << *iter;
-                iter++;
-            }
-            for (; iter != fragment_length_distr.measurements_end(); iter++) {
-                cerr << ", " << *iter;
+            vector<double> measurements = fragment_length_distr.measurements();
+            for (size_t i = 0; i < measurements.size(); i++) {
+                cerr << (i ? ", " : "") << measurements[i];
             }
             cerr << endl;
         }
 #endif
     }
     
+    size_t MultipathMapper::count_dominated_clusters(const vector<clustergraph_t>& cluster_graphs, size_t next_idx,
+                                                     int32_t best_score, size_t max_remaining) const {
+        
+        // the clusters we would otherwise go on to align
+        size_t num_remaining = 0;
+        for (size_t i = next_idx; i < cluster_graphs.size() && num_remaining < max_remaining; i++) {
+            if (get<2>(cluster_graphs[i]) < mem_coverage_min_ratio * get<2>(cluster_graphs[0])) {
+                break;
+            }
+            num_remaining++;
+        }
+        if (num_remaining == 0) {
+            return 0;
+        }
+        
+        // the clusters are sorted by coverage, so the first remaining one has the highest estimate
+        const BaseAligner* aligner = get_aligner();
+        int32_t score_estimate = aligner->match * (int32_t) get<2>(cluster_graphs[next_idx]) + 2 * aligner->full_length_bonus;
+        
+        // even if all of them scored as well as this, would they move the mapping quality off the cap by
+        // more than the tolerance?
+        double min_score_diff = aligner->mapping_quality_score_diff(max(0.0, max_mapping_quality - dominated_cluster_mapq_tolerance))
+                                + log(num_remaining) / aligner->log_base;
+        
+        return best_score - score_estimate >= min_score_diff ? num_remaining : 0;
+    }
+    
     bool MultipathMapper::attempt_rescue(const MultipathAlignment& multipath_aln, const Alignment& other_aln,
-                                         bool rescue_forward, MultipathAlignment& rescue_multipath_aln) {
+                                         bool rescue_forward, MultipathAlignment& rescue_multipath_aln,
+                                         CachedHandleGraph* xg_cache) {
+        StageStats::Timer timer(stage_stats, StageStats::RESCUE);
         
 #ifdef debug_multipath_mapper
         cerr << "attemping pair rescue in " << (rescue_forward ? "forward" : "backward") << " direction from " << pb2json(multipath_aln) << endl;
@@ -341,7 +411,8 @@ namespace vg {
         Alignment opt_anchoring_aln;
         optimal_alignment(multipath_aln, opt_anchoring_aln);
         pos_t pos_from = rescue_forward ? initial_position(opt_anchoring_aln.path()) : final_position(opt_anchoring_aln.path());
-        int64_t jump_dist = rescue_forward ? fragment_length_distr.mean() - other_aln.sequence().size() : -fragment_length_distr.mean();
+        auto parameters = fragment_length_distr.parameters();
+        int64_t jump_dist = rescue_forward ? parameters.first - other_aln.sequence().size() : -parameters.first;
         
         // get the seed position(s) for the rescue by jumping along paths
         vector<pos_t> jump_positions = xindex->jump_along_closest_path(id(pos_from), is_rev(pos_from), offset(pos_from), jump_dist, 250);
@@ -358,9 +429,10 @@ namespace vg {
         
         // pull out the graph around the position(s) we jumped to
         VG rescue_graph;
-        vector<size_t> backward_dist(jump_positions.size(), 6 * fragment_length_distr.stdev());
-        vector<size_t> forward_dist(jump_positions.size(), 6 * fragment_length_distr.stdev() + other_aln.sequence().size());
-        algorithms::extract_containing_graph(xindex, rescue_graph.graph, jump_positions, backward_dist, forward_dist);
+        vector<size_t> backward_dist(jump_positions.size(), 6 * parameters.second);
+        vector<size_t> forward_dist(jump_positions.size(), 6 * parameters.second + other_aln.sequence().size());
+        algorithms::extract_containing_graph(xg_cache ? (const HandleGraph*) xg_cache : xindex, rescue_graph.graph,
+                                             jump_positions, backward_dist, forward_dist);
         rescue_graph.build_indexes();
         
 #ifdef debug_multipath_mapper
@@ -473,6 +545,7 @@ namespace vg {
     
     // make the memo live in this .o file
     thread_local unordered_map<pair<size_t, size_t>, double> MultipathMapper::p_value_memo;
+    thread_local xg::XGQueryContext MultipathMapper::xg_query_context;
     
     double MultipathMapper::random_match_p_value(size_t match_length, size_t read_length) {
         // memoized to avoid transcendental functions (at least in cases where read lengths don't vary too much)
@@ -490,6 +563,12 @@ namespace vg {
     }
     
     void MultipathMapper::calibrate_mismapping_detection(size_t num_simulations, size_t simulated_read_length) {
+        if (calibration.has_mismapping_calibration(num_simulations, simulated_read_length)) {
+            // Someone already did the simulations for us
+            pseudo_length_multiplier = calibration.pseudo_length_multiplier;
+            return;
+        }
+        
         // we don't want to do base quality adjusted alignments for this stage since we are just simulating random sequences
         // with no base qualities
         bool reset_quality_adjustments = adjust_alignments_for_base_quality;
@@ -505,7 +584,8 @@ namespace vg {
             Alignment alignment;
             alignment.set_sequence(random_sequence(simulated_read_length));
             vector<MultipathAlignment> multipath_alns;
-            multipath_map(alignment, multipath_alns, 1);
+            // go around the result cache, these aren't real reads
+            multipath_map_internal(alignment, mapping_quality_method, multipath_alns, 1);
             
             if (!multipath_alns.empty()) {
                 lengths[i] = pseudo_length(multipath_alns.front());
@@ -603,8 +683,9 @@ namespace vg {
     }
     
     bool MultipathMapper::is_consistent(int64_t distance) const {
-        return (distance < fragment_length_distr.mean() + 10.0 * fragment_length_distr.stdev()
-                && distance > fragment_length_distr.mean() - 10.0 * fragment_length_distr.stdev());
+        auto parameters = fragment_length_distr.parameters();
+        return (distance < parameters.first + 10.0 * parameters.second
+                && distance > parameters.first - 10.0 * parameters.second);
     }
     
     bool MultipathMapper::are_consistent(const MultipathAlignment& multipath_aln_1,
@@ -654,15 +735,14 @@ namespace vg {
     
     void MultipathMapper::establish_strand_consistency(vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs,
                                                        vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs,
-                                                       OrientedDistanceClusterer::paths_of_node_memo_t* paths_of_node_memo,
-                                                       OrientedDistanceClusterer::oriented_occurences_memo_t* oriented_occurences_memo,
-                                                       OrientedDistanceClusterer::handle_memo_t* handle_memo) {
+                                                       xg::XGQueryContext* xg_context) {
         
 #ifdef debug_multipath_mapper
         cerr << "establishing consistency between mapped pairs" << endl;
 #endif
         
-        int64_t search_dist = 0.5 * fragment_length_distr.mean() + 5.0 * fragment_length_distr.stdev();
+        auto parameters = fragment_length_distr.parameters();
+        int64_t search_dist = 0.5 * parameters.first + 5.0 * parameters.second;
         vector<pair<bool, bool>> strand_assignments;
         strand_assignments.reserve(multipath_aln_pairs.size());
         for (const pair<MultipathAlignment, MultipathAlignment>& multipath_aln_pair : multipath_aln_pairs) {
@@ -674,8 +754,7 @@ namespace vg {
             
             strand_assignments.push_back(xindex->validate_strand_consistency(id(pos_1), offset(pos_1), is_rev(pos_1),
                                                                              id(pos_2), offset(pos_2), is_rev(pos_2),
-                                                                             search_dist, paths_of_node_memo,
-                                                                             oriented_occurences_memo, handle_memo));
+                                                                             search_dist, xg_context));
             
 #ifdef debug_multipath_mapper
             cerr << "pair has initial positions " << pos_1 << " and " << pos_2 << " on strands " << (strand_assignments.back().first ? "-" : "+") << " and " << (strand_assignments.back().second ? "-" : "+") << endl;
@@ -726,7 +805,9 @@ namespace vg {
                                                               bool block_rescue_from_1, bool block_rescue_from_2,
                                                               vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
                                                               vector<pair<pair<size_t, size_t>, int64_t>>& pair_distances,
-                                                              size_t max_alt_mappings) {
+                                                              size_t max_alt_mappings,
+                                                              cluster_aln_memo_t* cluster_aln_memo,
+                                                              CachedHandleGraph* xg_cache) {
         
         vector<MultipathAlignment> multipath_alns_1, multipath_alns_2;
         vector<size_t> cluster_idxs_1, cluster_idxs_2;
@@ -736,7 +817,8 @@ namespace vg {
                 cluster_idxs_1[i] = i;
             }
             align_to_cluster_graphs(alignment1, mapping_quality_method == None ? Approx : mapping_quality_method,
-                                    cluster_graphs1, multipath_alns_1, max_single_end_mappings_for_rescue, &cluster_idxs_1);
+                                    cluster_graphs1, multipath_alns_1, max_single_end_mappings_for_rescue, &cluster_idxs_1,
+                                    cluster_aln_memo);
         }
         if (!block_rescue_from_2) {
             cluster_idxs_2.resize(cluster_graphs2.size());
@@ -744,7 +826,8 @@ namespace vg {
                 cluster_idxs_2[i] = i;
             }
             align_to_cluster_graphs(alignment2, mapping_quality_method == None ? Approx : mapping_quality_method,
-                                    cluster_graphs2, multipath_alns_2, max_single_end_mappings_for_rescue, &cluster_idxs_2);
+                                    cluster_graphs2, multipath_alns_2, max_single_end_mappings_for_rescue, &cluster_idxs_2,
+                                    cluster_aln_memo);
         }
         
         if (multipath_alns_1.empty() || multipath_alns_2.empty() ? false :
@@ -794,7 +877,7 @@ namespace vg {
         
         for (size_t i = 0; i < num_rescuable_alns_1; i++) {
             MultipathAlignment rescue_multipath_aln;
-            if (attempt_rescue(multipath_alns_1[i], alignment2, true, rescue_multipath_aln)) {
+            if (attempt_rescue(multipath_alns_1[i], alignment2, true, rescue_multipath_aln, xg_cache)) {
                 rescued_from_1.insert(i);
                 rescue_multipath_alns_2[i] = move(rescue_multipath_aln);
             }
@@ -802,7 +885,7 @@ namespace vg {
         
         for (size_t i = 0; i < num_rescuable_alns_2; i++) {
             MultipathAlignment rescue_multipath_aln;
-            if (attempt_rescue(multipath_alns_2[i], alignment1, false, rescue_multipath_aln)) {
+            if (attempt_rescue(multipath_alns_2[i], alignment1, false, rescue_multipath_aln, xg_cache)) {
                 rescued_from_2.insert(i);
                 rescue_multipath_alns_1[i] = move(rescue_multipath_aln);
             }
@@ -976,7 +1059,9 @@ namespace vg {
                                                          vector<clustergraph_t>& cluster_graphs1,
                                                          vector<clustergraph_t>& cluster_graphs2,
                                                          vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
-                                                         vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs) {
+                                                         vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs,
+                                                         cluster_aln_memo_t* cluster_aln_memo,
+                                                         CachedHandleGraph* xg_cache) {
         
 #ifdef debug_multipath_mapper
         cerr << "using rescue to find secondary mappings" << endl;
@@ -1035,7 +1120,8 @@ namespace vg {
                 // make the alignment
                 vector<MultipathAlignment> cluster_multipath_alns;
                 cluster_multipath_alns.emplace_back();
-                multipath_align(anchor_aln, get<0>(cluster_graphs[i]), get<1>(cluster_graphs[i]), cluster_multipath_alns.back());
+                multipath_align(anchor_aln, get<0>(cluster_graphs[i]), get<1>(cluster_graphs[i]), cluster_multipath_alns.back(),
+                                cluster_aln_memo);
                 
                 // split it up if it turns out to be multiple components
                 split_multicomponent_alignments(cluster_multipath_alns);
@@ -1053,7 +1139,8 @@ namespace vg {
                 // rescue from the alignment
                 MultipathAlignment rescue_multipath_aln;
                 if (!likely_mismapping(cluster_multipath_alns.front())) {
-                    bool rescued = attempt_rescue(cluster_multipath_alns.front(), rescue_aln, anchor_is_read_1, rescue_multipath_aln);
+                    bool rescued = attempt_rescue(cluster_multipath_alns.front(), rescue_aln, anchor_is_read_1, rescue_multipath_aln,
+                                                  xg_cache);
 #ifdef debug_multipath_mapper
                     cerr << "rescued alignment is " << pb2json(rescue_multipath_aln) << endl;
 #endif
@@ -1160,6 +1247,8 @@ namespace vg {
         // empty the output vector (just for safety)
         multipath_aln_pairs_out.clear();
         
+        start_read_work();
+        
         if (!fragment_length_distr.is_finalized()) {
             // we have not estimated a fragment length distribution yet, so we revert to single ended mode and look
             // for unambiguous pairings
@@ -1169,6 +1258,8 @@ namespace vg {
 #endif
             
             attempt_unpaired_multipath_map_of_pair(alignment1, alignment2, multipath_aln_pairs_out, ambiguous_pair_buffer);
+            annotate_budget_limited(multipath_aln_pairs_out);
+            log_slow_read(alignment1, alignment2);
             
             return;
         }
@@ -1208,10 +1299,14 @@ namespace vg {
         vector<clustergraph_t> cluster_graphs1, cluster_graphs2;
         vector<pair<pair<size_t, size_t>, int64_t>> cluster_pairs;
         
-        // intialize memos for the results of expensive succinct operations that we may need to do multiple times
-        OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
-        OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
-        OrientedDistanceClusterer::handle_memo_t handle_memo;
+        // clear the cache for the results of expensive succinct operations that we may need to do multiple times
+        xg_query_context.reset(xindex);
+        
+        // the alignments to cluster graphs, which several of the passes below may revisit
+        cluster_aln_memo_t cluster_aln_memo;
+        
+        // the parts of the XG around both reads, which subgraph extractions for clusters and rescue share
+        CachedHandleGraph xg_cache(xindex);
         
         // do we want to try to only cluster one read end and rescue the other?
         bool do_repeat_rescue_from_1 = min_match_count_2 > rescue_only_min && min_match_count_1 <= rescue_only_anchor_max;
@@ -1240,7 +1335,8 @@ namespace vg {
             
             attempt_rescue_of_repeat_from_non_repeat(alignment1, alignment2, mems1, mems2, do_repeat_rescue_from_1, do_repeat_rescue_from_2,
                                                      clusters1, clusters2, cluster_graphs1, cluster_graphs2, multipath_aln_pairs_out,
-                                                     cluster_pairs, max_alt_mappings, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                     cluster_pairs, max_alt_mappings, &xg_query_context,
+                                                     &cluster_aln_memo, &xg_cache);
             
             if (multipath_aln_pairs_out.empty() && do_repeat_rescue_from_1 && !do_repeat_rescue_from_2) {
                 // we've clustered and extracted read 1, but rescue failed, so do the same for read 2 to prepare for the
@@ -1257,18 +1353,9 @@ namespace vg {
                 }
                 
                 // do the clustering
-                if (adjust_alignments_for_base_quality) {
-                    OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                    clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                }
-                else {
-                    OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                    clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                }
+                clusters2 = cluster_mems(alignment2, mems2, &xg_query_context);
                 
-                cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2);
+                cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2, &xg_cache);
             }
             
             if (multipath_aln_pairs_out.empty() && do_repeat_rescue_from_2 && !do_repeat_rescue_from_1) {
@@ -1286,18 +1373,9 @@ namespace vg {
                 }
                 
                 // do the clustering
-                if (adjust_alignments_for_base_quality) {
-                    OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                    clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                }
-                else {
-                    OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                         unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                    clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                }
+                clusters1 = cluster_mems(alignment1, mems1, &xg_query_context);
                 
-                cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
+                cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1, &xg_cache);
             }
         }
         else {
@@ -1319,26 +1397,12 @@ namespace vg {
             }
             
             // do the clustering
-            if (adjust_alignments_for_base_quality) {
-                OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
-            else {
-                OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-                OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
-                clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
+            clusters1 = cluster_mems(alignment1, mems1, &xg_query_context);
+            clusters2 = cluster_mems(alignment2, mems2, &xg_query_context);
             
             // extract graphs around the clusters and get the assignments of MEMs to these graphs
-            cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
-            cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2);
+            cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1, &xg_cache);
+            cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2, &xg_cache);
         }
         
 #ifdef debug_multipath_mapper
@@ -1375,13 +1439,14 @@ namespace vg {
             // Chebyshev bound for 99% of all fragments regardless of distribution
             // TODO: I don't love having this internal aspect of the stranded/unstranded clustering outside the clusterer...
             int64_t max_separation, min_separation;
+            auto parameters = fragment_length_distr.parameters();
             if (unstranded_clustering) {
-                max_separation = (int64_t) ceil(abs(fragment_length_distr.mean()) + 10.0 * fragment_length_distr.stdev());
+                max_separation = (int64_t) ceil(abs(parameters.first) + 10.0 * parameters.second);
                 min_separation = -max_separation;
             }
             else {
-                max_separation = (int64_t) ceil(fragment_length_distr.mean() + 10.0 * fragment_length_distr.stdev());
-                min_separation = (int64_t) fragment_length_distr.mean() - 10.0 * fragment_length_distr.stdev();
+                max_separation = (int64_t) ceil(parameters.first + 10.0 * parameters.second);
+                min_separation = (int64_t) parameters.first - 10.0 * parameters.second;
             }
             
             // Find the clusters that have a tie for the longest MEM, and create alternate anchor points for those clusters
@@ -1416,7 +1481,8 @@ namespace vg {
                                                                      xindex,
                                                                      min_separation, max_separation,
                                                                      unstranded_clustering,
-                                                                     &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                                                     &xg_query_context,
+                                                                     distance_index);
 #ifdef debug_multipath_mapper
             cerr << "obtained cluster pairs:" << endl;
             for (int i = 0; i < cluster_pairs.size(); i++) {
@@ -1437,7 +1503,8 @@ namespace vg {
                 // only perform the mappings that satisfy the expectations on distance
                 
                 align_to_cluster_graph_pairs(alignment1, alignment2, cluster_graphs1, cluster_graphs2, cluster_pairs,
-                                             multipath_aln_pairs_out, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
+                                             multipath_aln_pairs_out, &xg_query_context,
+                                             &cluster_aln_memo);
                 
                 // do we produce at least one good looking pair alignments from the clustered clusters?
                 if (multipath_aln_pairs_out.empty() ? true : (likely_mismapping(multipath_aln_pairs_out.front().first) ||
@@ -1453,7 +1520,8 @@ namespace vg {
                     vector<pair<pair<size_t, size_t>, int64_t>> rescue_distances;
                     bool rescued = align_to_cluster_graphs_with_rescue(alignment1, alignment2, cluster_graphs1, cluster_graphs2,
                                                                        do_repeat_rescue_from_1, do_repeat_rescue_from_2,
-                                                                       rescue_aln_pairs, rescue_distances, max_alt_mappings);
+                                                                       rescue_aln_pairs, rescue_distances, max_alt_mappings,
+                                                                       &cluster_aln_memo, &xg_cache);
                     
                     // if we find consistent pairs by rescue, merge the two lists
                     if (rescued) {
@@ -1487,7 +1555,7 @@ namespace vg {
                     // we're very confident about this pair, but it might be because we over-pruned at the clustering stage
                     // so we use this routine to use rescue on other very good looking independent end clusters
                     attempt_rescue_for_secondaries(alignment1, alignment2, cluster_graphs1, cluster_graphs2,
-                                                   multipath_aln_pairs_out, cluster_pairs);
+                                                   multipath_aln_pairs_out, cluster_pairs, &cluster_aln_memo, &xg_cache);
                     
                     // also account for the possiblity that we selected the wrong ends to rescue with
                     cap_mapping_quality_by_rescue_probability(multipath_aln_pairs_out, cluster_pairs,
@@ -1501,7 +1569,8 @@ namespace vg {
                 cerr << "could not find a consistent pair, reverting to single ended mapping" << endl;
 #endif
                 bool rescued = align_to_cluster_graphs_with_rescue(alignment1, alignment2, cluster_graphs1, cluster_graphs2, do_repeat_rescue_from_1,
-                                                                   do_repeat_rescue_from_2, multipath_aln_pairs_out, cluster_pairs, max_alt_mappings);
+                                                                   do_repeat_rescue_from_2, multipath_aln_pairs_out, cluster_pairs, max_alt_mappings,
+                                                                   &cluster_aln_memo, &xg_cache);
                 
                 if (rescued) {
                     // also account for the possiblity that we selected the wrong ends to rescue with
@@ -1541,7 +1610,8 @@ namespace vg {
         
         // Compute the fragment length distribution.
         // TODO: make this machine-readable instead of a copy-able string.
-        string distribution = "-I " + to_string(fragment_length_distr.mean()) + " -D " + to_string(fragment_length_distr.stdev());
+        auto parameters = fragment_length_distr.parameters();
+        string distribution = "-I " + to_string(parameters.first) + " -D " + to_string(parameters.second);
         
         for (pair<MultipathAlignment, MultipathAlignment>& multipath_aln_pair : multipath_aln_pairs_out) {
             // add pair names to connect the paired reads
@@ -1552,6 +1622,8 @@ namespace vg {
             set_annotation(&multipath_aln_pair.first, "fragment_length_distribution", distribution);
             set_annotation(&multipath_aln_pair.second, "fragment_length_distribution", distribution);
         }
+        annotate_budget_limited(multipath_aln_pairs_out);
+        log_slow_read(alignment1, alignment2);
         
         // clean up the VG objects on the heap
         for (auto cluster_graph : cluster_graphs1) {
@@ -1683,7 +1755,7 @@ namespace vg {
                 // put the first component into the original location
                 MultipathAlignment last_component;
                 extract_sub_multipath_alignment(multipath_alns_out[i], comps[0], last_component);
-                multipath_alns_out[i] = last_component;
+                multipath_alns_out[i].Swap(&last_component);
             }
         }
     }
@@ -1695,9 +1767,9 @@ namespace vg {
                                                                    vector<clustergraph_t>& cluster_graphs1, vector<clustergraph_t>& cluster_graphs2,
                                                                    vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
                                                                    vector<pair<pair<size_t, size_t>, int64_t>>& pair_distances, size_t max_alt_mappings,
-                                                                   OrientedDistanceClusterer::paths_of_node_memo_t* paths_of_node_memo,
-                                                                   OrientedDistanceClusterer::oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                   OrientedDistanceClusterer::handle_memo_t* handle_memo) {
+                                                                   xg::XGQueryContext* xg_context,
+                                                                   cluster_aln_memo_t* cluster_aln_memo,
+                                                                   CachedHandleGraph* xg_cache) {
         
         bool rescue_succeeded_from_1 = false, rescue_succeeded_from_2 = false;
         
@@ -1708,25 +1780,17 @@ namespace vg {
 #endif
             
             // get the clusters for the non repeat
-            if (adjust_alignments_for_base_quality) {
-                OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
-                clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
-            else {
-                OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
-                clusters1 = clusterer1.clusters(alignment1, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
+            clusters1 = cluster_mems(alignment1, mems1, xg_context);
             
             // extract the graphs around the clusters
-            cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
+            cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1, xg_cache);
             
             // attempt rescue from these graphs
             vector<pair<MultipathAlignment, MultipathAlignment>> rescued_pairs;
             vector<pair<pair<size_t, size_t>, int64_t>> rescued_distances;
             rescue_succeeded_from_1 = align_to_cluster_graphs_with_rescue(alignment1, alignment2, cluster_graphs1, cluster_graphs2,
-                                                                          false, true, rescued_pairs, pair_distances, max_alt_mappings);
+                                                                          false, true, rescued_pairs, pair_distances, max_alt_mappings,
+                                                                          cluster_aln_memo, xg_cache);
             
             // move the rescued pairs to the output vectors
             if (rescue_succeeded_from_1) {
@@ -1752,25 +1816,17 @@ namespace vg {
 #endif
             
             // get the clusters for the non repeat
-            if (adjust_alignments_for_base_quality) {
-                OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
-                clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
-            else {
-                OrientedDistanceClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
-                                                     unstranded_clustering, paths_of_node_memo, oriented_occurences_memo, handle_memo);
-                clusters2 = clusterer2.clusters(alignment2, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
-            }
+            clusters2 = cluster_mems(alignment2, mems2, xg_context);
             
             // extract the graphs around the clusters
-            cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2);
+            cluster_graphs2 = query_cluster_graphs(alignment2, mems2, clusters2, xg_cache);
             
             // attempt rescue from these graphs
             vector<pair<MultipathAlignment, MultipathAlignment>> rescued_pairs;
             vector<pair<pair<size_t, size_t>, int64_t>> rescued_distances;
             rescue_succeeded_from_2 = align_to_cluster_graphs_with_rescue(alignment1, alignment2, cluster_graphs1, cluster_graphs2,
-                                                                          true, false, rescued_pairs, pair_distances, max_alt_mappings);
+                                                                          true, false, rescued_pairs, pair_distances, max_alt_mappings,
+                                                                          cluster_aln_memo, xg_cache);
             
             // move the rescued pairs to the output vectors
             if (rescue_succeeded_from_2) {
@@ -2036,9 +2092,8 @@ namespace vg {
                                                        vector<clustergraph_t>& cluster_graphs2,
                                                        vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs,
                                                        vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
-                                                       OrientedDistanceClusterer::paths_of_node_memo_t* paths_of_node_memo,
-                                                       OrientedDistanceClusterer::oriented_occurences_memo_t* oriented_occurences_memo,
-                                                       OrientedDistanceClusterer::handle_memo_t* handle_memo) {
+                                                       xg::XGQueryContext* xg_context,
+                                                       cluster_aln_memo_t* cluster_aln_memo) {
         
         assert(multipath_aln_pairs_out.empty());
         
@@ -2067,6 +2122,12 @@ namespace vg {
         // TODO: some cluster pairs will produce redundant subgraph pairs.
         // We'll end up with redundant pairs being output.
         
+        // a cluster graph can be in several pairs, but we only need to align to it once
+        cluster_aln_memo_t local_cluster_aln_memo;
+        if (!cluster_aln_memo) {
+            cluster_aln_memo = &local_cluster_aln_memo;
+        }
+        
         // align to each cluster pair
         multipath_aln_pairs_out.reserve(min(num_mappings_to_compute, cluster_pairs.size()));
         size_t num_mappings = 0;
@@ -2087,6 +2148,12 @@ namespace vg {
                 break;
             }
             
+            if (num_mappings > 0 && alignment_budget_spent()) {
+                // the pair has used up its work budget, so we keep what we have
+                cluster_pairs.resize(i);
+                break;
+            }
+            
             VG* vg1 = get<0>(cluster_graphs1[cluster_pair.first.first]);
             VG* vg2 = get<0>(cluster_graphs2[cluster_pair.first.second]);
             
@@ -2099,9 +2166,11 @@ namespace vg {
 #endif
             
             // Do the two alignments
+            count_dp_cells(alignment1.sequence(), vg1->graph);
+            count_dp_cells(alignment2.sequence(), vg2->graph);
             multipath_aln_pairs_out.emplace_back();
-            multipath_align(alignment1, vg1, graph_mems1, multipath_aln_pairs_out.back().first);
-            multipath_align(alignment2, vg2, graph_mems2, multipath_aln_pairs_out.back().second);
+            multipath_align(alignment1, vg1, graph_mems1, multipath_aln_pairs_out.back().first, cluster_aln_memo);
+            multipath_align(alignment2, vg2, graph_mems2, multipath_aln_pairs_out.back().second, cluster_aln_memo);
             
             num_mappings++;
         }
@@ -2118,7 +2187,7 @@ namespace vg {
         
         // if we haven't been checking strand consistency, enforce it now at the end
         if (unstranded_clustering) {
-            establish_strand_consistency(multipath_aln_pairs_out, cluster_pairs, paths_of_node_memo, oriented_occurences_memo, handle_memo);
+            establish_strand_consistency(multipath_aln_pairs_out, cluster_pairs, xg_context);
         }
         
         // put pairs in score sorted order and compute mapping quality of best pair using the score
@@ -2144,9 +2213,41 @@ namespace vg {
         
     }
     
+    vector<MultipathMapper::memcluster_t> MultipathMapper::cluster_mems(const Alignment& alignment,
+                                                                        const vector<MaximalExactMatch>& mems,
+                                                                        xg::XGQueryContext* xg_context) {
+        
+        StageStats::Timer timer(stage_stats, StageStats::CLUSTER);
+        
+        // TODO: Making OrientedDistanceClusterers is the only place we actually
+        // need to distinguish between regular_aligner and qual_adj_aligner
+        if (adjust_alignments_for_base_quality) {
+            OrientedDistanceClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
+                                                min_clustering_mem_length, unstranded_clustering, xg_context,
+                                                sweep_clustering, distance_index);
+#ifdef debug_multipath_mapper
+            cerr << "clustering made " << clusterer.num_distance_probes << " distance probes" << endl;
+#endif
+            read_work.cluster_probes += clusterer.num_distance_probes;
+            return clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
+        }
+        else {
+            OrientedDistanceClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
+                                                min_clustering_mem_length, unstranded_clustering, xg_context,
+                                                sweep_clustering, distance_index);
+#ifdef debug_multipath_mapper
+            cerr << "clustering made " << clusterer.num_distance_probes << " distance probes" << endl;
+#endif
+            read_work.cluster_probes += clusterer.num_distance_probes;
+            return clusterer.clusters(alignment, max_mapping_quality, log_likelihood_approx_factor, min_median_mem_coverage_for_split);
+        }
+    }
+    
     auto MultipathMapper::query_cluster_graphs(const Alignment& alignment,
                                                const vector<MaximalExactMatch>& mems,
-                                               const vector<memcluster_t>& clusters) -> vector<clustergraph_t> {
+                                               const vector<memcluster_t>& clusters,
+                                               CachedHandleGraph* xg_cache) -> vector<clustergraph_t> {
+        StageStats::Timer timer(stage_stats, StageStats::SUBGRAPH);
         
         // Figure out the aligner to use
         BaseAligner* aligner = get_aligner();
@@ -2201,8 +2302,8 @@ namespace vg {
             Graph& graph = cluster_graph->graph;
             
             // extract the protobuf Graph in place in the VG
-            algorithms::extract_containing_graph(xindex, graph, positions, forward_max_dist,
-                                                 backward_max_dist);
+            algorithms::extract_containing_graph(xg_cache ? (const HandleGraph*) xg_cache : xindex, graph, positions,
+                                                 forward_max_dist, backward_max_dist);
                                                  
             // check if this subgraph overlaps with any previous subgraph (indicates a probable clustering failure where
             // one cluster was split into multiple clusters)
@@ -2468,7 +2569,21 @@ namespace vg {
     
     void MultipathMapper::multipath_align(const Alignment& alignment, VG* vg,
                                           memcluster_t& graph_mems,
-                                          MultipathAlignment& multipath_aln_out) const {
+                                          MultipathAlignment& multipath_aln_out,
+                                          cluster_aln_memo_t* cluster_aln_memo) const {
+        
+        if (cluster_aln_memo) {
+            auto iter = cluster_aln_memo->find(vg);
+            if (iter != cluster_aln_memo->end()) {
+#ifdef debug_multipath_mapper_alignment
+                cerr << "reusing memoized alignment to cluster graph" << endl;
+#endif
+                multipath_aln_out = iter->second;
+                return;
+            }
+        }
+        
+        StageStats::Timer timer(stage_stats, StageStats::ALIGN);
 
 #ifdef debug_multipath_mapper_alignment
         cerr << "constructing alignment graph" << endl;
@@ -2526,7 +2641,8 @@ namespace vg {
         // construct a graph that summarizes reachability between MEMs
         // First we need to reverse node_trans
         auto node_inj = MultipathAlignmentGraph::create_injection_trans(node_trans);
-        MultipathAlignmentGraph multi_aln_graph(align_graph, graph_mems, node_trans, node_inj, gcsa);
+        MultipathAlignmentGraph multi_aln_graph(align_graph, graph_mems, node_trans, node_inj, gcsa,
+                                                max_multipath_anchors);
         
         {
             // Compute a topological order over the graph
@@ -2572,6 +2688,10 @@ namespace vg {
             translate_oriented_node_ids(*multipath_aln_out.mutable_subpath(j)->mutable_path(), node_trans);
         }
         
+        if (cluster_aln_memo) {
+            (*cluster_aln_memo)[vg] = multipath_aln_out;
+        }
+        
 #ifdef debug_multipath_mapper_alignment
         cerr << "completed multipath alignment: " << pb2json(multipath_aln_out) << endl;
 #endif
@@ -2684,6 +2804,7 @@ namespace vg {
     void MultipathMapper::sort_and_compute_mapping_quality(vector<MultipathAlignment>& multipath_alns,
                                                            MappingQualityMethod mapq_method,
                                                            vector<size_t>* cluster_idxs) const {
+        StageStats::Timer timer(stage_stats, StageStats::MAPQ);
         if (multipath_alns.empty()) {
             return;
         }
@@ -2822,7 +2943,7 @@ namespace vg {
         for (size_t i = 0; i < multipath_alns.size(); i++) {
             while (index[i] != i) {
                 std::swap(scores[index[i]], scores[i]);
-                std::swap(multipath_alns[index[i]], multipath_alns[i]);
+                multipath_alns[index[i]].Swap(&multipath_alns[i]);
                 if (cluster_idxs) {
                     std::swap((*cluster_idxs)[index[i]], (*cluster_idxs)[i]);
                 }
@@ -2851,6 +2972,7 @@ namespace vg {
     // TODO: pretty duplicative with the unpaired version
     void MultipathMapper::sort_and_compute_mapping_quality(vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs,
                                                            vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs) const {
+        StageStats::Timer timer(stage_stats, StageStats::MAPQ);
         
 #ifdef debug_multipath_mapper
         cerr << "Sorting and computing mapping qualities for paired reads" << endl;
@@ -3114,8 +3236,9 @@ namespace vg {
     }
             
     double MultipathMapper::fragment_length_log_likelihood(int64_t length) const {
-        double dev = length - fragment_length_distr.mean();
-        return -dev * dev / (2.0 * fragment_length_distr.stdev() * fragment_length_distr.stdev());
+        auto parameters = fragment_length_distr.parameters();
+        double dev = length - parameters.first;
+        return -dev * dev / (2.0 * parameters.second * parameters.second);
     }
     
     void MultipathMapper::set_automatic_min_clustering_length(double random_mem_probability) {
@@ -20,6 +20,7 @@
 #include "edit.hpp"
 #include "snarls.hpp"
 #include "haplotypes.hpp"
+#include "cached_handle_graph.hpp"
 
 #include "algorithms/extract_containing_graph.hpp"
 #include "algorithms/extract_connecting_graph.hpp"
@@ -49,7 +50,8 @@ namespace vg {
                         haplo::ScoreProvider* haplo_score_provider = nullptr, SnarlManager* snarl_manager = nullptr);
         ~MultipathMapper();
         
-        /// Map read in alignment to graph and make multipath alignments.
+        /// Map read in alignment to graph and make multipath alignments. If there is a
+        /// result cache, results for a read with the same sequence are reused.
         void multipath_map(const Alignment& alignment,
                            vector<MultipathAlignment>& multipath_alns_out,
                            size_t max_alt_mappings);
@@ -75,7 +77,8 @@ namespace vg {
         void set_automatic_min_clustering_length(double random_mem_probability = 0.5);
         
         /// Map random sequences against the graph to calibrate a parameterized distribution that detects
-        /// when mappings are likely to have occurred by chance
+        /// when mappings are likely to have occurred by chance. Uses the result from the calibration
+        /// set with set_calibration() instead, if it was made with the same settings.
         void calibrate_mismapping_detection(size_t num_simulations = 1000, size_t simulated_read_length = 150);
         
         // parameters
@@ -93,6 +96,11 @@ namespace vg {
         double pseudo_length_multiplier = 1.65;
         double max_mapping_p_value = 0.00001;
         bool unstranded_clustering = true;
+        bool sweep_clustering = false;
+        // Stop aligning to clusters once the rest can't move the mapping quality of the best alignment
+        // so far by more than dominated_cluster_mapq_tolerance, judging by their MEM coverage
+        bool prune_dominated_clusters = false;
+        double dominated_cluster_mapq_tolerance = 0.0;
         size_t max_single_end_mappings_for_rescue = 64;
         size_t max_rescue_attempts = 32;
         size_t plausible_rescue_cluster_coverage_diff = 5;
@@ -101,6 +109,9 @@ namespace vg {
         double mapq_scaling_factor = 1.0 / 4.0;
         // There must be a ScoreProvider provided, and a positive population_max_paths, if this is true
         bool use_population_mapqs = false;
+        // If set, multipath_map reuses the results of earlier reads with the same
+        // sequence. Only share it between identically configured mappers.
+        ReadResultCache<MultipathAlignment>* result_cache = nullptr;
         size_t population_max_paths = 10;
         // Note that, like the haplotype scoring code, we work with recombiantion penalties in exponent form.
         double recombination_penalty = 9 * 2.3;
@@ -111,6 +122,8 @@ namespace vg {
         size_t min_median_mem_coverage_for_split = 0;
         bool suppress_cluster_merging = false;
         size_t alt_anchor_max_length_diff = 5;
+        // Keep at most this many MEMs when building the graph for one cluster (0 for no limit)
+        size_t max_multipath_anchors = 500;
         
         //static size_t PRUNE_COUNTER;
         //static size_t SUBGRAPH_TOTAL;
@@ -124,6 +137,12 @@ namespace vg {
         /// as a priority).
         using clustergraph_t = tuple<VG*, memcluster_t, size_t>;
         
+        /// The multipath alignments already made against each cluster graph of a read or
+        /// read pair, so that the passes over the same cluster graphs (paired, independent
+        /// end and secondary rescue) align to each of them only once. Only valid while the
+        /// cluster graphs it is keyed on are alive.
+        using cluster_aln_memo_t = unordered_map<const VG*, MultipathAlignment>;
+        
     protected:
         
         /// Wrapped internal function that allows some code paths to circumvent the current
@@ -144,9 +163,11 @@ namespace vg {
         /// distribution and attempts to align the other paired read to it. If rescuing forward, assumes the
         /// provided MultipathAlignment is the first read and vice versa if rescuing backward. Rescue constructs
         /// a conventional local alignment with gssw and converts the Alignment to a MultipathAlignment. The
-        /// MultipathAlignment will be stored in the object passed by reference as an argument.
+        /// MultipathAlignment will be stored in the object passed by reference as an argument. If a
+        /// cached view of the XG is provided, the rescue graph is extracted through it.
         bool attempt_rescue(const MultipathAlignment& multipath_aln, const Alignment& other_aln,
-                            bool rescue_forward, MultipathAlignment& rescue_multipath_aln);
+                            bool rescue_forward, MultipathAlignment& rescue_multipath_aln,
+                            CachedHandleGraph* xg_cache = nullptr);
         
         
         /// After clustering MEMs, extracting graphs, and assigning hits to cluster graphs, perform
@@ -156,7 +177,15 @@ namespace vg {
                                      vector<clustergraph_t>& cluster_graphs,
                                      vector<MultipathAlignment>& multipath_alns_out,
                                      size_t num_mapping_attempts,
-                                     vector<size_t>* cluster_idxs = nullptr);
+                                     vector<size_t>* cluster_idxs = nullptr,
+                                     cluster_aln_memo_t* cluster_aln_memo = nullptr);
+        
+        /// Returns the number of cluster graphs from next_idx on, up to max_remaining, that would be aligned
+        /// to next, if they are all too far below the best score so far to affect its mapping quality, or 0
+        /// otherwise. Scores are estimated from MEM coverage, as if every covered base matched and both
+        /// full length bonuses were earned.
+        size_t count_dominated_clusters(const vector<clustergraph_t>& cluster_graphs, size_t next_idx,
+                                        int32_t best_score, size_t max_remaining) const;
         
         /// After clustering MEMs, extracting graphs, assigning hits to cluster graphs, and determining
         /// which cluster graph pairs meet the fragment length distance constraints, perform multipath
@@ -166,9 +195,8 @@ namespace vg {
                                           vector<clustergraph_t>& cluster_graphs2,
                                           vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs,
                                           vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
-                                          OrientedDistanceClusterer::paths_of_node_memo_t* paths_of_node_memo = nullptr,
-                                          OrientedDistanceClusterer::oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                                          OrientedDistanceClusterer::handle_memo_t* handle_memo = nullptr);
+                                          xg::XGQueryContext* xg_context = nullptr,
+                                          cluster_aln_memo_t* cluster_aln_memo = nullptr);
         
         /// Align the read ends independently, but also try to form rescue alignments for each from
         /// the other. Return true if output obeys pair consistency and false otherwise.
@@ -178,14 +206,18 @@ namespace vg {
                                                  bool block_rescue_from_1, bool block_rescue_from_2,
                                                  vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
                                                  vector<pair<pair<size_t, size_t>, int64_t>>& pair_distances,
-                                                 size_t max_alt_mappings);
+                                                 size_t max_alt_mappings,
+                                                 cluster_aln_memo_t* cluster_aln_memo = nullptr,
+                                                 CachedHandleGraph* xg_cache = nullptr);
         
         /// Use the rescue routine on strong suboptimal clusters to see if we can find a good secondary
         void attempt_rescue_for_secondaries(const Alignment& alignment1, const Alignment& alignment2,
                                             vector<clustergraph_t>& cluster_graphs1,
                                             vector<clustergraph_t>& cluster_graphs2,
                                             vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
-                                            vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs);
+                                            vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs,
+                                            cluster_aln_memo_t* cluster_aln_memo = nullptr,
+                                            CachedHandleGraph* xg_cache = nullptr);
         
         /// Cluster and extract subgraphs for (possibly) only one end, meant to be a non-repeat, and use them to rescue
         /// an alignment for the other end, meant to be a repeat
@@ -196,9 +228,9 @@ namespace vg {
                                                       vector<clustergraph_t>& cluster_graphs1, vector<clustergraph_t>& cluster_graphs2,
                                                       vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
                                                       vector<pair<pair<size_t, size_t>, int64_t>>& pair_distances, size_t max_alt_mappings,
-                                                      OrientedDistanceClusterer::paths_of_node_memo_t* paths_of_node_memo = nullptr,
-                                                      OrientedDistanceClusterer::oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                                                      OrientedDistanceClusterer::handle_memo_t* handle_memo = nullptr);
+                                                      xg::XGQueryContext* xg_context = nullptr,
+                                                      cluster_aln_memo_t* cluster_aln_memo = nullptr,
+                                                      CachedHandleGraph* xg_cache = nullptr);
         
         /// Merge the rescued mappings into the output vector and deduplicate pairs
         void merge_rescued_mappings(vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
@@ -214,16 +246,26 @@ namespace vg {
                                                        vector<clustergraph_t>& cluster_graphs2,
                                                        bool from_secondary_rescue) const;
         
+        /// Clusters the MEMs of a read with an OrientedDistanceClusterer, using the
+        /// aligner that matches whether we adjust for base quality
+        vector<memcluster_t> cluster_mems(const Alignment& alignment,
+                                          const vector<MaximalExactMatch>& mems,
+                                          xg::XGQueryContext* xg_context = nullptr);
+        
         /// Extracts a subgraph around each cluster of MEMs that encompasses any
         /// graph position reachable (according to the Mapper's aligner) with
         /// local alignment anchored at the MEMs. If any subgraphs overlap, they
         /// are merged into one subgraph. Returns a vector of all the merged
         /// cluster subgraphs, their MEMs assigned from the mems vector
         /// according to the MEMs' hits, and their read coverages in bp. The
-        /// caller must delete the VG objects produced!
+        /// caller must delete the VG objects produced! If a cached view of
+        /// the XG is provided, the subgraphs are extracted through it, so that
+        /// the parts of the XG shared between clusters and between the reads
+        /// of a pair are only decoded once.
         vector<clustergraph_t> query_cluster_graphs(const Alignment& alignment,
                                                     const vector<MaximalExactMatch>& mems,
-                                                    const vector<memcluster_t>& clusters);
+                                                    const vector<memcluster_t>& clusters,
+                                                    CachedHandleGraph* xg_cache = nullptr);
         
         /// If there are any MultipathAlignments with multiple connected components, split them
         /// up and add them to the return vector
@@ -238,10 +280,12 @@ namespace vg {
         
         
         /// Make a multipath alignment of the read against the indicated graph and add it to
-        /// the list of multimappings.
+        /// the list of multimappings. If a memo is provided, a graph that was already aligned
+        /// to is not aligned again, and the memoized alignment is copied instead.
         void multipath_align(const Alignment& alignment, VG* vg,
                              memcluster_t& graph_mems,
-                             MultipathAlignment& multipath_aln_out) const;
+                             MultipathAlignment& multipath_aln_out,
+                             cluster_aln_memo_t* cluster_aln_memo = nullptr) const;
         
         /// Remove the full length bonus from all source or sink subpaths that received it
         void strip_full_length_bonuses(MultipathAlignment& mulipath_aln) const;
@@ -299,9 +343,7 @@ namespace vg {
         /// inverts the distances in the cluster pairs vector according to the strand
         void establish_strand_consistency(vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs,
                                           vector<pair<pair<size_t, size_t>, int64_t>>& cluster_pairs,
-                                          OrientedDistanceClusterer::paths_of_node_memo_t* paths_of_node_memo = nullptr,
-                                          OrientedDistanceClusterer::oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                                          OrientedDistanceClusterer::handle_memo_t* handle_memo = nullptr);
+                                          xg::XGQueryContext* xg_context = nullptr);
         
         SnarlManager* snarl_manager;
         
@@ -310,6 +352,9 @@ namespace vg {
         
         // a memo for the transcendental p-value function (thread local to maintain threadsafety)
         static thread_local unordered_map<pair<size_t, size_t>, double> p_value_memo;
+        
+        // a cache of XG queries, cleared for each read and reused so that its memory is only allocated once per thread
+        static thread_local xg::XGQueryContext xg_query_context;
     };
         
 }
@@ -3,6 +3,8 @@
 
 #include "nested_traversal_finder.hpp"
 
+#include <deque>
+
 namespace vg {
 
 using namespace std;
@@ -20,6 +22,10 @@ vector<SnarlTraversal> NestedTraversalFinder::find_traversals(const Snarl& site)
     // We will populate this
     set<SnarlTraversal> to_return;
     
+    // Forget the searches for any other site
+    searched_site = &site;
+    left_searches.clear();
+    
     // We need a function to check supports and convert things to
     // SnarlTraversals
     auto emit_path = [&](const pair<Support, vector<Visit>>& bubble) {
@@ -133,37 +139,36 @@ pair<Support, vector<Visit>> NestedTraversalFinder::find_bubble(Node* node, Edge
     
     // Find paths on both sides, anchored into the outside of our snarl. Returns
     // path lengths (in visits) and paths in pairs in a set.
-    auto left_paths = search_left(left_visit, site);
-    auto right_paths = search_right(right_visit, site);
+    const vector<Visit>& left_path = search_left(left_visit, site);
+    if (left_path.empty()) {
+        // There's no path to combine. Return the zero value.
+        return pair<Support, vector<Visit>>();
+    }
+    vector<Visit> right_path = search_right(right_visit, site);
+    if (right_path.empty()) {
+        return pair<Support, vector<Visit>>();
+    }
     
     // Now splice the paths together to get max support.
     
     // TODO: implement that. For now just get any path with nonzero support.
     
-    for (auto& left : left_paths) {
-        for (auto& right : right_paths) {
-            // Splice together the first path from each set
-            
-            // Start witht he whole left path
-            vector<Visit> spliced_path {left.second.begin(), left.second.end()};
-            
-            auto it = right.second.begin();
-            if (it != right.second.end() && !spliced_path.empty() && *it == spliced_path.back()) {
-                // If the right path starts with the same visit the left path ended with, skip it.
-                ++it;
-            }
-            
-            // Copy over the rest of the right side path
-            copy(it, right.second.end(), back_inserter(spliced_path));
-            
-            // Return this spliced-together path with its support
-            return make_pair(min_support_in_path(spliced_path), spliced_path);
-            
-        }
+    // Start with the whole left path
+    vector<Visit> spliced_path;
+    spliced_path.reserve(left_path.size() + right_path.size());
+    spliced_path.insert(spliced_path.end(), left_path.begin(), left_path.end());
+    
+    auto it = right_path.begin();
+    if (*it == spliced_path.back()) {
+        // If the right path starts with the same visit the left path ended with, skip it.
+        ++it;
     }
     
-    // If we get here there's no pair of paths to combine. Return the zero value.
-    return pair<Support, vector<Visit>>();
+    // Copy over the rest of the right side path
+    spliced_path.insert(spliced_path.end(), it, right_path.end());
+    
+    // Return this spliced-together path with its support
+    return make_pair(min_support_in_path(spliced_path), spliced_path);
     
 }
 
@@ -184,8 +189,8 @@ Support NestedTraversalFinder::min_support_in_path(const vector<Visit>& path) {
             // This is a node visit
             Node* node = augmented.graph.get_node(v.node_id());
             
-            // Return the support for it, or 0 if it's not in the map.
-            return augmented.node_supports.count(node) ? augmented.node_supports.at(node) : Support();
+            // Return the support for it, or 0 if it has none.
+            return augmented.get_support(node);
         } else {
             // It's a snarl visit. We assume it goes in one side and out the
             // other.
@@ -207,22 +212,34 @@ Support NestedTraversalFinder::min_support_in_path(const vector<Visit>& path) {
         // check the edge support
         Edge* edge = augmented.graph.get_edge(to_left_side(*cur), to_right_side(*next));
         assert(edge != NULL);
-        Support edge_support = augmented.edge_supports.count(edge) ? augmented.edge_supports.at(edge) : Support();
+        Support edge_support = augmented.get_support(edge);
         min_support = support_min(min_support, edge_support);
     }
 
     return min_support;
 }
 
-set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_left(const Visit& root, const Snarl& site) {
+const vector<Visit>& NestedTraversalFinder::search_left(const Visit& root, const Snarl& site) {
     
     // Find paths left from the given visit to the start or end of the given
     // ultrabubble.
     
     // Right now just finds the shortest path in nodes.
+    
+    if (searched_site != &site) {
+        // We were called on a site find_traversals() isn't working on.
+        searched_site = &site;
+        left_searches.clear();
+    }
+    
+    auto found = left_searches.find(root);
+    if (found != left_searches.end()) {
+        // We already searched from here
+        return found->second;
+    }
 
-    // Holds partial paths we want to return, with their lengths in visits.
-    set<pair<size_t, list<Visit>>> to_return;
+    // Holds the path we want to return, which stays empty if we find nothing.
+    vector<Visit>& to_return = left_searches[root];
     
     // Do a BFS
     
@@ -231,13 +248,25 @@ set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_left(const Visit& r
     map<Visit, Visit> parents;
     
     // This holds all the visits we need to look at.
-    list<Visit> queue {root};
+    deque<Visit> queue {root};
+    
+    // This counts the visits we looked at, against the search budget
+    size_t visits_searched = 0;
     
     const Snarl* managed_site = snarl_manager.manage(site);
     
     while(!queue.empty()) {
         // Keep going until we've emptied the queue
         
+        if (max_search_visits && visits_searched++ >= max_search_visits) {
+            // We ran out of budget, so give up on finding anything.
+            if (verbose) {
+                cerr << "Gave up searching left from " << pb2json(root) << " after "
+                    << max_search_visits << " visits" << endl;
+            }
+            break;
+        }
+        
         // Dequeue a visit to continue from.
         Visit to_extend_from = queue.front();
         queue.pop_front();
@@ -245,23 +274,17 @@ set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_left(const Visit& r
         if (to_extend_from == site.start() || to_extend_from == site.end()) {
             // We're done! Do a trace back.
             
-            // Fill in this path
-            list<Visit> path;           
-            
             // With this cursor
             Visit v = to_extend_from;
             
             while (v != root) {
                 // Until we get to the root, put this node on the path and get
                 // its parent.
-                path.push_back(v);
+                to_return.push_back(v);
                 v = parents.at(v);
             }
             // We hit the root so add it to the path too.
-            path.push_back(v);
-            
-            // Add the path and its length to the list to return
-            to_return.insert(make_pair(path.size(), path));
+            to_return.push_back(v);
             
             // And go ahead and return it right now (since it's maximally short)
             break;
@@ -281,7 +304,7 @@ set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_left(const Visit& r
                 // Check the edge to it to make sure it has coverage
                 Edge* edge = augmented.graph.get_edge(to_right_side(extension), to_left_side(to_extend_from));
                 
-                if (!augmented.edge_supports.count(edge) || total(augmented.edge_supports.at(edge)) == 0) {
+                if (!augmented.has_support(edge) || total(augmented.get_support(edge)) == 0) {
                     // This edge is not supported, so don't explore this extension.
                     continue;
                 }
@@ -291,7 +314,7 @@ set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_left(const Visit& r
                 // sure it has coverage.
                 Node* node = augmented.graph.get_node(to_right_side(extension).node);
                 
-                if (!augmented.node_supports.count(node) || total(augmented.node_supports.at(node)) == 0) {
+                if (!augmented.has_support(node) || total(augmented.get_support(node)) == 0) {
                     // This node is not supported, so don't explore this extension.
                     continue;
                 }
@@ -306,31 +329,23 @@ set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_left(const Visit& r
     }
     
     // If we get here, either we broke out of search or no path with any support was found.
-    // Return the shortest path or our still-empty set.
+    // Return the shortest path or our still-empty path.
     return to_return;
 }
 
-set<pair<size_t, list<Visit>>> NestedTraversalFinder::search_right(const Visit& root, const Snarl& site) {
+vector<Visit> NestedTraversalFinder::search_right(const Visit& root, const Snarl& site) {
 
     // Make a backwards version of the root
     Visit root_rev = root;
     root_rev.set_backward(!root_rev.backward());
 
-    // Look left from the backward version of the root
-    auto to_convert = search_left(root_rev, site);
-    
-    // Since we can't modify set records in place, we need to do a copy
-    set<pair<size_t, list<Visit>>> to_return;
-    
-    for(auto length_and_path : to_convert) {
-        // Flip every path to run the other way
-        length_and_path.second.reverse();
-        for(auto& visit : length_and_path.second) {
-            // And invert the orientation of every visit in the path in place.
-            visit.set_backward(!visit.backward());
-        }
-        // Stick it in the new set
-        to_return.emplace(move(length_and_path));
+    // Look left from the backward version of the root, and flip the path to
+    // run the other way
+    const vector<Visit>& to_convert = search_left(root_rev, site);
+    vector<Visit> to_return(to_convert.rbegin(), to_convert.rend());
+    for(auto& visit : to_return) {
+        // And invert the orientation of every visit in the path in place.
+        visit.set_backward(!visit.backward());
     }
     
     return to_return;
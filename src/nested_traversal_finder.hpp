@@ -49,27 +49,27 @@ protected:
         
     /**
      * Do a breadth-first search left from the given node traversal, and return
-     * lengths (in visits) and paths starting at the given node and ending on
-     * the given indexed path. Refuses to visit nodes with no support.
+     * the shortest path (in visits) that ends at the given node and starts at
+     * the start or end of the site. Refuses to visit nodes with no support.
+     * Returns an empty path if there is no such path, or if the search budget
+     * runs out.
      *
-     * Lengths are included so that shorter paths sort first.
+     * Searches are remembered for the site being worked on, since the same
+     * visit is searched from for every node and edge it is next to.
      */
-    set<pair<size_t, list<Visit>>> search_left(const Visit& root, const Snarl& site);
+    const vector<Visit>& search_left(const Visit& root, const Snarl& site);
         
     /**
      * Do a breadth-first search right from the given node traversal, and return
-     * lengths (in visits) and paths starting at the given node and ending on
-     * the given indexed path.
-     *
-     * Lengths are included so that shorter paths sort first.
-     */
-    set<pair<size_t, list<Visit>>> search_right(const Visit& root, const Snarl& site);
-        
-    /**
-     * Get the length of a path through nodes and child sites, in base pairs.
-     * Ignores any bases inside child sites.
+     * the shortest path (in visits) starting at the given node and ending at
+     * the start or end of the site, or an empty path.
      */
-    size_t bp_length(const list<Visit>& path);
+    vector<Visit> search_right(const Visit& root, const Snarl& site);
+    
+    /// The site that left_searches are for
+    const Snarl* searched_site = nullptr;
+    /// The path found searching left from each visit in searched_site
+    map<Visit, vector<Visit>> left_searches;
     
 public:
 
@@ -78,6 +78,10 @@ public:
     /// Should we emit verbose debugging info?
     bool verbose = false;
     
+    /// Give up on a search after looking at this many visits, or 0 to
+    /// search the whole site.
+    size_t max_search_visits = 0;
+    
     virtual ~NestedTraversalFinder() = default;
     
     /**
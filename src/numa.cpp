@@ -0,0 +1,175 @@
+#include "numa.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <omp.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+/**
+ * \file numa.cpp
+ * Implement NUMA thread pinning and allocation policies with raw Linux system
+ * calls, so we don't need libnuma.
+ */
+
+namespace vg {
+
+using namespace std;
+
+NUMATopology::Mode NUMATopology::parse_mode(const string& name) {
+    if (name == "off") {
+        return OFF;
+    } else if (name == "interleave") {
+        return INTERLEAVE;
+    } else if (name == "replicate") {
+        return REPLICATE;
+    }
+    throw runtime_error("[vg::NUMATopology] unknown NUMA mode: " + name);
+}
+
+const char* NUMATopology::mode_name(Mode mode) {
+    switch (mode) {
+    case INTERLEAVE:
+        return "interleave";
+    case REPLICATE:
+        return "replicate";
+    default:
+        return "off";
+    }
+}
+
+/// Parse a sysfs CPU list like "0-15,32-47"
+static vector<int> parse_cpu_list(const string& list) {
+    vector<int> cpus;
+    stringstream ranges(list);
+    string range;
+    while (getline(ranges, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = stoi(range.substr(0, dash));
+        int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+NUMATopology::NUMATopology() {
+#ifdef __linux__
+    const string node_dir = "/sys/devices/system/node";
+    DIR* dir = opendir(node_dir.c_str());
+    if (dir != nullptr) {
+        vector<int> ids;
+        while (struct dirent* entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                all_of(name.begin() + 4, name.end(), ::isdigit)) {
+                ids.push_back(stoi(name.substr(4)));
+            }
+        }
+        closedir(dir);
+        sort(ids.begin(), ids.end());
+
+        for (int id : ids) {
+            ifstream cpulist(node_dir + "/node" + to_string(id) + "/cpulist");
+            string list;
+            getline(cpulist, list);
+            vector<int> cpus = parse_cpu_list(list);
+            if (!cpus.empty()) {
+                // Memory-only nodes can't run threads
+                node_ids.push_back(id);
+                node_cpus.push_back(cpus);
+            }
+        }
+    }
+#endif
+    if (node_cpus.empty()) {
+        node_ids.push_back(0);
+        node_cpus.emplace_back();
+    }
+}
+
+size_t NUMATopology::node_count() const {
+    return node_cpus.size();
+}
+
+size_t NUMATopology::node_of_thread(size_t thread_number, size_t thread_count) const {
+    if (thread_count == 0) {
+        return 0;
+    }
+    return min(thread_number * node_count() / thread_count, node_count() - 1);
+}
+
+bool NUMATopology::pin_threads(size_t thread_count) const {
+#ifdef __linux__
+    if (node_count() < 2) {
+        return true;
+    }
+    bool pinned = true;
+#pragma omp parallel num_threads(thread_count) reduction(&&:pinned)
+    {
+        size_t node = node_of_thread(omp_get_thread_num(), omp_get_num_threads());
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : node_cpus[node]) {
+            CPU_SET(cpu, &cpus);
+        }
+        pinned = sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+    }
+    return pinned;
+#else
+    return node_count() < 2;
+#endif
+}
+
+#ifdef __linux__
+/// Set the calling thread's memory policy over the given kernel node numbers
+static bool set_policy(int mode, const vector<int>& ids) {
+    const size_t bits = 8 * sizeof(unsigned long);
+    int max_id = ids.empty() ? 0 : *max_element(ids.begin(), ids.end());
+    vector<unsigned long> mask(max_id / bits + 1, 0);
+    for (int id : ids) {
+        mask[id / bits] |= 1UL << (id % bits);
+    }
+    // The kernel wants one more than the number of bits to look at
+    return syscall(SYS_set_mempolicy, mode, ids.empty() ? nullptr : mask.data(),
+                   ids.empty() ? 0 : mask.size() * bits + 1) == 0;
+}
+#endif
+
+bool NUMATopology::interleave_allocations() const {
+#ifdef __linux__
+    return node_count() < 2 || set_policy(MPOL_INTERLEAVE, node_ids);
+#else
+    return node_count() < 2;
+#endif
+}
+
+bool NUMATopology::prefer_node(size_t node) const {
+#ifdef __linux__
+    return node_count() < 2 || set_policy(MPOL_PREFERRED, vector<int>{node_ids.at(node)});
+#else
+    return node_count() < 2;
+#endif
+}
+
+bool NUMATopology::reset_allocations() const {
+#ifdef __linux__
+    return node_count() < 2 || set_policy(MPOL_DEFAULT, vector<int>());
+#else
+    return true;
+#endif
+}
+
+}
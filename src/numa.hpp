@@ -0,0 +1,80 @@
+#ifndef VG_NUMA_HPP_INCLUDED
+#define VG_NUMA_HPP_INCLUDED
+
+/**
+ * \file numa.hpp
+ *
+ * Thread placement and index memory placement for mapping on machines with
+ * more than one NUMA node (usually one per socket).
+ */
+
+#include <string>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * The NUMA nodes of the machine and the CPUs on each. On systems we can't
+ * read the layout of, there is one node with no CPUs listed, and everything
+ * here does nothing.
+ */
+class NUMATopology {
+public:
+
+    /// How mappers should place their threads and indexes
+    enum Mode {
+        /// Leave it to the OS
+        OFF = 0,
+        /// Pin threads to nodes, and spread the index pages over all nodes
+        INTERLEAVE,
+        /// Pin threads to nodes, and give each node its own copy of the indexes
+        REPLICATE
+    };
+
+    /// Parse a mode name ("off", "interleave" or "replicate"). Throws a
+    /// runtime_error on anything else.
+    static Mode parse_mode(const string& name);
+
+    /// Get the name of a mode.
+    static const char* mode_name(Mode mode);
+
+    /// Read the layout of the machine from sysfs.
+    NUMATopology();
+
+    /// Get the number of NUMA nodes.
+    size_t node_count() const;
+
+    /// Get the node that the given thread of a team of the given size is
+    /// placed on. Threads are split into contiguous blocks, one per node, so
+    /// that thread 0 and the next few share a node.
+    size_t node_of_thread(size_t thread_number, size_t thread_count) const;
+
+    /// Pin each of the given number of OpenMP worker threads to the CPUs of
+    /// its node, following node_of_thread(). OpenMP keeps its workers around
+    /// between parallel regions, so later regions of the same size run on the
+    /// same nodes. Returns false if any thread could not be pinned.
+    bool pin_threads(size_t thread_count) const;
+
+    /// Have this thread's new memory spread page by page over all nodes.
+    /// Pages of memory-mapped files first touched by this thread count too.
+    bool interleave_allocations() const;
+
+    /// Have this thread's new memory come from the given node when possible.
+    bool prefer_node(size_t node) const;
+
+    /// Go back to allocating this thread's memory on the node it runs on.
+    bool reset_allocations() const;
+
+private:
+
+    /// The CPUs on each node, in node order
+    vector<vector<int>> node_cpus;
+    /// The kernel's number for each node, which may skip some
+    vector<int> node_ids;
+};
+
+}
+
+#endif
@@ -0,0 +1,536 @@
+#include "packed_graph.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace vg {
+
+using namespace std;
+
+const uint64_t PackedGraph::NONE = numeric_limits<uint64_t>::max();
+
+PackedGraph::PackedGraph() {
+    // Nothing to do
+}
+
+PackedGraph::PackedGraph(istream& in) {
+    // Edges can mention nodes from later chunks, so hold those until the end
+    vector<Edge> deferred;
+    function<void(Graph&)> lambda = [&](Graph& chunk) {
+        for (size_t i = 0; i < chunk.node_size(); i++) {
+            const Node& node = chunk.node(i);
+            if (!has_node(node.id())) {
+                create_handle(node.sequence(), node.id());
+            }
+        }
+        for (size_t i = 0; i < chunk.edge_size(); i++) {
+            const Edge& edge = chunk.edge(i);
+            if (has_node(edge.from()) && has_node(edge.to())) {
+                create_edge(get_handle(edge.from(), edge.from_start()), get_handle(edge.to(), edge.to_end()));
+            } else {
+                deferred.push_back(edge);
+            }
+        }
+    };
+    stream::for_each(in, lambda);
+
+    for (auto& edge : deferred) {
+        if (!has_node(edge.from()) || !has_node(edge.to())) {
+            throw runtime_error("[PackedGraph] edge between " + to_string(edge.from()) + " and " +
+                                to_string(edge.to()) + " refers to a node that is not in the graph");
+        }
+        create_edge(get_handle(edge.from(), edge.from_start()), get_handle(edge.to(), edge.to_end()));
+    }
+}
+
+PackedGraph::PackedGraph(const HandleGraph& other) {
+    other.for_each_handle([&](const handle_t& handle) {
+        create_handle(other.get_sequence(handle), other.get_id(handle));
+    });
+    other.for_each_handle([&](const handle_t& handle) {
+        handle_t here = get_handle(other.get_id(handle));
+        other.follow_edges(handle, false, [&](const handle_t& next) {
+            create_edge(here, get_handle(other.get_id(next), other.get_is_reverse(next)));
+        });
+        other.follow_edges(handle, true, [&](const handle_t& prev) {
+            create_edge(get_handle(other.get_id(prev), other.get_is_reverse(prev)), here);
+        });
+    });
+}
+
+void PackedGraph::serialize_to_ostream(ostream& out, size_t chunk_size) const {
+    vector<Graph> buffer;
+    Graph chunk;
+
+    for_each_handle([&](const handle_t& handle) {
+        Node* node = chunk.add_node();
+        node->set_id(get_id(handle));
+        node->set_sequence(get_sequence(handle));
+
+        // Write each edge with the node its canonical form starts on. Self
+        // loops can come up from both sides, so deduplicate those.
+        vector<edge_t> written;
+        for (auto& edge : edges_of(rank_of(handle))) {
+            edge_t canonical = edge_handle(edge.first, edge.second);
+            if (get_id(canonical.first) != get_id(handle) ||
+                find(written.begin(), written.end(), canonical) != written.end()) {
+                continue;
+            }
+            written.push_back(canonical);
+            Edge* e = chunk.add_edge();
+            e->set_from(get_id(canonical.first));
+            e->set_from_start(get_is_reverse(canonical.first));
+            e->set_to(get_id(canonical.second));
+            e->set_to_end(get_is_reverse(canonical.second));
+        }
+
+        if (chunk.node_size() >= chunk_size) {
+            buffer.emplace_back();
+            buffer.back().Swap(&chunk);
+            stream::write_buffered(out, buffer, 10);
+        }
+    });
+
+    if (chunk.node_size() > 0 || buffer.empty()) {
+        buffer.emplace_back();
+        buffer.back().Swap(&chunk);
+    }
+    stream::write_buffered(out, buffer, 0);
+}
+
+handle_t PackedGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    if (!has_node(node_id)) {
+        throw runtime_error("[PackedGraph] node " + to_string(node_id) + " is not in the graph");
+    }
+    return handle_of(rank_of_id[node_id - min_id], is_reverse);
+}
+
+id_t PackedGraph::get_id(const handle_t& handle) const {
+    return node_ids[rank_of(handle)];
+}
+
+bool PackedGraph::get_is_reverse(const handle_t& handle) const {
+    return as_integer(handle) & 1;
+}
+
+handle_t PackedGraph::flip(const handle_t& handle) const {
+    return as_handle(as_integer(handle) ^ 1);
+}
+
+size_t PackedGraph::get_length(const handle_t& handle) const {
+    return sequence_lengths[rank_of(handle)];
+}
+
+string PackedGraph::get_sequence(const handle_t& handle) const {
+    uint64_t rank = rank_of(handle);
+    string sequence(sequence_lengths[rank], 'N');
+    for (size_t i = 0; i < sequence.size(); i++) {
+        sequence[i] = get_base(sequence_starts[rank] + i);
+    }
+    return get_is_reverse(handle) ? reverse_complement(sequence) : sequence;
+}
+
+bool PackedGraph::follow_edges(const handle_t& handle, bool go_left,
+                               const function<bool(const handle_t&)>& iteratee) const {
+    // Going right on the forward strand, or left on the reverse strand, means
+    // leaving the end of the node. Lists hold what we reach going forward, so
+    // on the reverse strand everything we reach is flipped.
+    bool is_reverse = get_is_reverse(handle);
+    for (uint64_t slot = edge_list(rank_of(handle), is_reverse == go_left); slot != NONE; slot = edge_nexts[slot]) {
+        handle_t target = as_handle((int64_t) edge_targets[slot]);
+        if (!iteratee(is_reverse ? flip(target) : target)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PackedGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    if (parallel) {
+#pragma omp parallel for schedule(dynamic, 512)
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i] != NONE) {
+                // We can't stop early in parallel
+                iteratee(handle_of(order[i], false));
+            }
+        }
+    } else {
+        for (size_t i = 0; i < order.size(); i++) {
+            if (order[i] != NONE && !iteratee(handle_of(order[i], false))) {
+                return;
+            }
+        }
+    }
+}
+
+size_t PackedGraph::node_size() const {
+    return live_nodes;
+}
+
+handle_t PackedGraph::create_handle(const string& sequence) {
+    return create_handle(sequence, max_id + 1);
+}
+
+handle_t PackedGraph::create_handle(const string& sequence, const id_t& id) {
+    if (id <= 0) {
+        throw runtime_error("[PackedGraph] node IDs must be positive, not " + to_string(id));
+    }
+    if (has_node(id)) {
+        throw runtime_error("[PackedGraph] node " + to_string(id) + " is already in the graph");
+    }
+    if (sequence.size() > numeric_limits<uint32_t>::max()) {
+        throw runtime_error("[PackedGraph] node sequence is too long");
+    }
+    return append_node(id, append_sequence(sequence), sequence.size());
+}
+
+handle_t PackedGraph::append_node(id_t id, uint64_t sequence_start, uint32_t sequence_length) {
+    // Make room for the ID in the index
+    if (rank_of_id.empty()) {
+        min_id = id;
+    } else if (id < min_id) {
+        rank_of_id.insert(rank_of_id.begin(), min_id - id, NONE);
+        min_id = id;
+    }
+    if (id - min_id >= rank_of_id.size()) {
+        rank_of_id.resize(id - min_id + 1, NONE);
+    }
+    max_id = max(max_id, id);
+
+    uint64_t rank = node_ids.size();
+    rank_of_id[id - min_id] = rank;
+    node_ids.push_back(id);
+    sequence_starts.push_back(sequence_start);
+    sequence_lengths.push_back(sequence_length);
+    start_edges.push_back(NONE);
+    end_edges.push_back(NONE);
+    order_positions.push_back(order.size());
+    order.push_back(rank);
+    live_nodes++;
+    return handle_of(rank, false);
+}
+
+void PackedGraph::destroy_handle(const handle_t& handle) {
+    uint64_t rank = rank_of(handle);
+    for (auto& edge : edges_of(rank)) {
+        destroy_edge(edge.first, edge.second);
+    }
+
+    rank_of_id[node_ids[rank] - min_id] = NONE;
+    node_ids[rank] = 0;
+    dead_bases += sequence_lengths[rank];
+    sequence_lengths[rank] = 0;
+    order[order_positions[rank]] = NONE;
+    order_positions[rank] = NONE;
+    live_nodes--;
+
+    if (dead_bases > 1024 && dead_bases > base_count / 2) {
+        compact_sequences();
+    }
+    if (order.size() > 1024 && live_nodes < order.size() / 2) {
+        compact_order();
+    }
+}
+
+void PackedGraph::edge_entries(const handle_t& left, const handle_t& right,
+                               uint64_t& out_rank, bool& out_end, handle_t& out_target,
+                               uint64_t& in_rank, bool& in_end, handle_t& in_target) const {
+    // Going forward out of left reaches right, and going backward out of
+    // right reaches left. On the reverse strand of a node that is the other
+    // side, with the target flipped.
+    out_rank = rank_of(left);
+    out_end = !get_is_reverse(left);
+    out_target = get_is_reverse(left) ? flip(right) : right;
+    in_rank = rank_of(right);
+    in_end = get_is_reverse(right);
+    in_target = get_is_reverse(right) ? flip(left) : left;
+}
+
+bool PackedGraph::list_contains(uint64_t head, const handle_t& target) const {
+    for (uint64_t slot = head; slot != NONE; slot = edge_nexts[slot]) {
+        if (edge_targets[slot] == (uint64_t) as_integer(target)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PackedGraph::list_add(uint64_t& head, const handle_t& target) {
+    uint64_t slot;
+    if (!free_edges.empty()) {
+        slot = free_edges.back();
+        free_edges.pop_back();
+    } else {
+        slot = edge_targets.size();
+        edge_targets.push_back(0);
+        edge_nexts.push_back(NONE);
+    }
+    edge_targets[slot] = as_integer(target);
+    edge_nexts[slot] = head;
+    head = slot;
+}
+
+bool PackedGraph::list_remove(uint64_t& head, const handle_t& target) {
+    for (uint64_t* link = &head; *link != NONE; link = &edge_nexts[*link]) {
+        if (edge_targets[*link] == (uint64_t) as_integer(target)) {
+            uint64_t slot = *link;
+            *link = edge_nexts[slot];
+            free_edges.push_back(slot);
+            return true;
+        }
+    }
+    return false;
+}
+
+void PackedGraph::create_edge(const handle_t& left, const handle_t& right) {
+    uint64_t out_rank, in_rank;
+    bool out_end, in_end;
+    handle_t out_target, in_target;
+    edge_entries(left, right, out_rank, out_end, out_target, in_rank, in_end, in_target);
+
+    if (list_contains(edge_list(out_rank, out_end), out_target)) {
+        return;
+    }
+    list_add(edge_list(out_rank, out_end), out_target);
+    // A self loop that reverses strand on one side is a single entry
+    if (in_rank != out_rank || in_end != out_end || in_target != out_target) {
+        list_add(edge_list(in_rank, in_end), in_target);
+    }
+    edges++;
+}
+
+void PackedGraph::destroy_edge(const handle_t& left, const handle_t& right) {
+    uint64_t out_rank, in_rank;
+    bool out_end, in_end;
+    handle_t out_target, in_target;
+    edge_entries(left, right, out_rank, out_end, out_target, in_rank, in_end, in_target);
+
+    if (!list_remove(edge_list(out_rank, out_end), out_target)) {
+        return;
+    }
+    if (in_rank != out_rank || in_end != out_end || in_target != out_target) {
+        list_remove(edge_list(in_rank, in_end), in_target);
+    }
+    edges--;
+}
+
+bool PackedGraph::has_edge(const handle_t& left, const handle_t& right) const {
+    uint64_t out_rank, in_rank;
+    bool out_end, in_end;
+    handle_t out_target, in_target;
+    edge_entries(left, right, out_rank, out_end, out_target, in_rank, in_end, in_target);
+    return list_contains(edge_list(out_rank, out_end), out_target);
+}
+
+vector<edge_t> PackedGraph::edges_of(uint64_t rank) const {
+    vector<edge_t> found;
+    handle_t handle = handle_of(rank, false);
+    follow_edges(handle, true, [&](const handle_t& prev) {
+        found.emplace_back(prev, handle);
+    });
+    follow_edges(handle, false, [&](const handle_t& next) {
+        found.emplace_back(handle, next);
+    });
+    return found;
+}
+
+void PackedGraph::swap_handles(const handle_t& a, const handle_t& b) {
+    uint64_t rank_a = rank_of(a);
+    uint64_t rank_b = rank_of(b);
+    swap(order[order_positions[rank_a]], order[order_positions[rank_b]]);
+    swap(order_positions[rank_a], order_positions[rank_b]);
+}
+
+handle_t PackedGraph::apply_orientation(const handle_t& handle) {
+    if (!get_is_reverse(handle)) {
+        return handle;
+    }
+    uint64_t rank = rank_of(handle);
+
+    // Take the edges off, turn the node around, and put them back on with
+    // this node's orientation swapped everywhere
+    vector<edge_t> node_edges = edges_of(rank);
+    for (auto& edge : node_edges) {
+        destroy_edge(edge.first, edge.second);
+    }
+
+    string reversed = get_sequence(handle);
+    for (size_t i = 0; i < reversed.size(); i++) {
+        set_base(sequence_starts[rank] + i, reversed[i]);
+    }
+
+    auto swap_orientation = [&](const handle_t& h) {
+        return rank_of(h) == rank ? flip(h) : h;
+    };
+    for (auto& edge : node_edges) {
+        create_edge(swap_orientation(edge.first), swap_orientation(edge.second));
+    }
+    return handle_of(rank, false);
+}
+
+vector<handle_t> PackedGraph::divide_handle(const handle_t& handle, const vector<size_t>& offsets) {
+    uint64_t rank = rank_of(handle);
+    size_t length = sequence_lengths[rank];
+
+    // Work out where to cut on the forward strand
+    vector<size_t> forward_offsets = offsets;
+    if (get_is_reverse(handle)) {
+        for (auto& offset : forward_offsets) {
+            offset = length - offset;
+        }
+        reverse(forward_offsets.begin(), forward_offsets.end());
+    }
+    for (size_t i = 0; i < forward_offsets.size(); i++) {
+        if (forward_offsets[i] > length || (i > 0 && forward_offsets[i] < forward_offsets[i - 1])) {
+            throw runtime_error("[PackedGraph] cannot divide node " + to_string(node_ids[rank]) +
+                                " at out of order or out of range offsets");
+        }
+    }
+
+    // The edges on the end move to the last part
+    vector<handle_t> end_targets;
+    follow_edges(handle_of(rank, false), false, [&](const handle_t& next) {
+        end_targets.push_back(next);
+    });
+    for (auto& next : end_targets) {
+        destroy_edge(handle_of(rank, false), next);
+    }
+
+    // The parts share the node's stretch of bases. The first keeps the node.
+    vector<handle_t> parts{handle_of(rank, false)};
+    uint64_t start = sequence_starts[rank];
+    forward_offsets.push_back(length);
+    sequence_lengths[rank] = forward_offsets.front();
+    for (size_t i = 1; i < forward_offsets.size(); i++) {
+        parts.push_back(append_node(max_id + 1, start + forward_offsets[i - 1],
+                                    forward_offsets[i] - forward_offsets[i - 1]));
+        create_edge(parts[parts.size() - 2], parts.back());
+    }
+
+    for (auto& next : end_targets) {
+        // Reaching this node's start now means the first part, and reaching
+        // its end means the last part
+        handle_t target = next;
+        if (rank_of(next) == rank) {
+            target = get_is_reverse(next) ? flip(parts.back()) : parts.front();
+        }
+        create_edge(parts.back(), target);
+    }
+
+    if (get_is_reverse(handle)) {
+        reverse(parts.begin(), parts.end());
+        for (auto& part : parts) {
+            part = flip(part);
+        }
+    }
+    return parts;
+}
+
+bool PackedGraph::has_node(id_t node_id) const {
+    return node_id >= min_id && node_id - min_id < (id_t) rank_of_id.size() && rank_of_id[node_id - min_id] != NONE;
+}
+
+size_t PackedGraph::edge_count() const {
+    return edges;
+}
+
+id_t PackedGraph::max_node_id() const {
+    return max_id;
+}
+
+uint64_t PackedGraph::append_sequence(const string& sequence) {
+    uint64_t start = base_count;
+    base_count += sequence.size();
+    packed_bases.resize((base_count + 31) / 32, 0);
+    for (size_t i = 0; i < sequence.size(); i++) {
+        set_base(start + i, sequence[i]);
+    }
+    return start;
+}
+
+char PackedGraph::get_base(uint64_t offset) const {
+    if (!unusual_bases.empty()) {
+        auto found = unusual_bases.find(offset);
+        if (found != unusual_bases.end()) {
+            return found->second;
+        }
+    }
+    return "ACGT"[(packed_bases[offset / 32] >> (2 * (offset % 32))) & 3];
+}
+
+void PackedGraph::set_base(uint64_t offset, char base) {
+    uint64_t code;
+    switch (base) {
+    case 'A': code = 0; break;
+    case 'C': code = 1; break;
+    case 'G': code = 2; break;
+    case 'T': code = 3; break;
+    default:
+        code = 0;
+        unusual_bases[offset] = base;
+    }
+    if (code != 0 || base == 'A') {
+        unusual_bases.erase(offset);
+    }
+    uint64_t& word = packed_bases[offset / 32];
+    word = (word & ~(uint64_t(3) << (2 * (offset % 32)))) | (code << (2 * (offset % 32)));
+}
+
+void PackedGraph::compact_sequences() {
+    vector<uint64_t> old_bases;
+    old_bases.swap(packed_bases);
+    unordered_map<uint64_t, char> old_unusual;
+    old_unusual.swap(unusual_bases);
+    size_t old_count = base_count;
+    base_count = 0;
+
+    auto old_base = [&](uint64_t offset) -> char {
+        auto found = old_unusual.find(offset);
+        if (found != old_unusual.end()) {
+            return found->second;
+        }
+        return "ACGT"[(old_bases[offset / 32] >> (2 * (offset % 32))) & 3];
+    };
+
+    // Copy the live nodes' bases down in the order they were laid out, so
+    // this doesn't need any more than the live bases of new space
+    vector<uint64_t> ranks;
+    for (uint64_t rank = 0; rank < node_ids.size(); rank++) {
+        if (node_ids[rank] != 0) {
+            ranks.push_back(rank);
+        }
+    }
+    sort(ranks.begin(), ranks.end(), [&](uint64_t a, uint64_t b) {
+        return sequence_starts[a] < sequence_starts[b];
+    });
+    packed_bases.resize((old_count - dead_bases + 31) / 32, 0);
+    for (auto rank : ranks) {
+        uint64_t start = base_count;
+        for (size_t i = 0; i < sequence_lengths[rank]; i++) {
+            set_base(start + i, old_base(sequence_starts[rank] + i));
+        }
+        sequence_starts[rank] = start;
+        base_count += sequence_lengths[rank];
+    }
+    packed_bases.resize((base_count + 31) / 32);
+    packed_bases.shrink_to_fit();
+    dead_bases = 0;
+}
+
+void PackedGraph::compact_order() {
+    size_t kept = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        if (order[i] != NONE) {
+            order_positions[order[i]] = kept;
+            order[kept++] = order[i];
+        }
+    }
+    order.resize(kept);
+    order.shrink_to_fit();
+}
+
+}
@@ -0,0 +1,236 @@
+#ifndef VG_PACKED_GRAPH_HPP_INCLUDED
+#define VG_PACKED_GRAPH_HPP_INCLUDED
+
+/** \file
+ * packed_graph.hpp: defines a compact MutableHandleGraph implementation that
+ * keeps nodes, sequences and edges in flat integer arrays rather than in
+ * Protobuf objects indexed by hash tables of pointers.
+ */
+
+#include "handle.hpp"
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A MutableHandleGraph with no per-node objects. Each node is a rank into
+ * parallel arrays of IDs, sequence ranges and edge list heads. Sequences are
+ * packed 2 bits per base (with anything but upper case ACGT kept on the side),
+ * and each side of each node has a singly linked list of its edges in one
+ * shared pair of arrays. Node IDs are looked up through an array over the ID
+ * range, so IDs are expected to be dense, as vg ids -c makes them.
+ *
+ * Handles are a node's rank and orientation, so they stay valid until their
+ * own node is destroyed. There are no paths; loading a graph with paths drops
+ * them.
+ */
+class PackedGraph : public MutableHandleGraph {
+public:
+
+    /// Make an empty graph
+    PackedGraph();
+
+    /// Load the nodes and edges from a stream of vg Graph chunks, as written
+    /// by VG::serialize_to_ostream, one chunk at a time
+    PackedGraph(istream& in);
+
+    /// Copy the nodes and edges of any other handle graph
+    PackedGraph(const HandleGraph& other);
+
+    /// Write the graph as a stream of vg Graph chunks with about chunk_size
+    /// nodes each, which can be read by VG or by PackedGraph
+    void serialize_to_ostream(ostream& out, size_t chunk_size = 1000) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+
+    /// Get the ID from a handle
+    virtual id_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    virtual bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    virtual handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    virtual size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    virtual string get_sequence(const handle_t& handle) const;
+
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, in their internal stored order. Stop if the iteratee returns false.
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    /// Return the number of nodes in the graph
+    virtual size_t node_size() const;
+
+    // We need to expose the templated versions of these, or they get hidden
+    using HandleGraph::follow_edges;
+    using HandleGraph::for_each_handle;
+    using HandleGraph::get_handle;
+
+    /// Create a new node with the given sequence and return the handle.
+    virtual handle_t create_handle(const string& sequence);
+
+    /// Create a new node with the given id and sequence, then return the handle.
+    virtual handle_t create_handle(const string& sequence, const id_t& id);
+
+    /// Remove the node belonging to the given handle and all of its edges.
+    virtual void destroy_handle(const handle_t& handle);
+
+    /// Create an edge connecting the given handles in the given order and orientations.
+    /// Ignores existing edges.
+    virtual void create_edge(const handle_t& left, const handle_t& right);
+
+    /// Remove the edge connecting the given handles in the given order and orientations.
+    /// Ignores nonexistent edges.
+    virtual void destroy_edge(const handle_t& left, const handle_t& right);
+
+    /// Swap the nodes corresponding to the given handles, in the ordering used
+    /// by for_each_handle when looping over the graph.
+    virtual void swap_handles(const handle_t& a, const handle_t& b);
+
+    /// Make the orientation indicated by the handle the node's local forward
+    /// orientation. The node keeps its ID, so only handles to it in the other
+    /// orientation change meaning.
+    virtual handle_t apply_orientation(const handle_t& handle);
+
+    /// Split a handle's underlying node at the given offsets in the handle's
+    /// orientation. The first part keeps the node's ID and the rest get new
+    /// IDs. There are no stored paths to update.
+    virtual vector<handle_t> divide_handle(const handle_t& handle, const vector<size_t>& offsets);
+
+    // Expose the single offset version too
+    using MutableHandleGraph::divide_handle;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Other queries
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Return true if a node with the given ID is in the graph
+    bool has_node(id_t node_id) const;
+
+    /// Return true if the given edge is in the graph
+    bool has_edge(const handle_t& left, const handle_t& right) const;
+
+    /// Return the number of edges in the graph
+    size_t edge_count() const;
+
+    /// Get the largest node ID in use (or ever used), or 0 if there are none
+    id_t max_node_id() const;
+
+private:
+
+    /// Marks an empty edge list or ID slot
+    static const uint64_t NONE;
+
+    // Per-node arrays, indexed by rank. Ranks are never reused.
+
+    /// ID of each node, or 0 once it is destroyed
+    vector<id_t> node_ids;
+    /// Where each node's sequence starts in the packed bases
+    vector<uint64_t> sequence_starts;
+    /// Length of each node's sequence
+    vector<uint32_t> sequence_lengths;
+    /// Head of the list of edges on the start of each node, as an edge slot
+    vector<uint64_t> start_edges;
+    /// Head of the list of edges on the end of each node
+    vector<uint64_t> end_edges;
+    /// Where each node is in the iteration order
+    vector<uint64_t> order_positions;
+
+    /// Ranks in iteration order, with NONE for destroyed nodes
+    vector<uint64_t> order;
+    /// How many nodes are in the graph
+    size_t live_nodes = 0;
+
+    /// Rank of each node ID from min_id on, or NONE
+    vector<uint64_t> rank_of_id;
+    id_t min_id = 0;
+    id_t max_id = 0;
+
+    /// Bases packed 32 to a word
+    vector<uint64_t> packed_bases;
+    size_t base_count = 0;
+    /// Bases that aren't upper case ACGT, by offset
+    unordered_map<uint64_t, char> unusual_bases;
+    /// Bases belonging to no node any more
+    size_t dead_bases = 0;
+
+    /// Edge list entries. Each list belongs to one side of one node, and holds
+    /// as handles the nodes that follow_edges finds from that side when
+    /// traversing the node forward.
+    vector<uint64_t> edge_targets;
+    /// Next entry in the same list, or NONE
+    vector<uint64_t> edge_nexts;
+    /// Entries free for reuse
+    vector<uint64_t> free_edges;
+    /// How many edges are in the graph
+    size_t edges = 0;
+
+    /// Get the rank of a handle
+    inline uint64_t rank_of(const handle_t& handle) const {
+        return uint64_t(as_integer(handle)) >> 1;
+    }
+
+    /// Make a handle from a rank and orientation
+    inline handle_t handle_of(uint64_t rank, bool is_reverse) const {
+        return as_handle(int64_t((rank << 1) | uint64_t(is_reverse)));
+    }
+
+    /// Get the list head for the end (or start) of a node
+    inline uint64_t& edge_list(uint64_t rank, bool end) {
+        return end ? end_edges[rank] : start_edges[rank];
+    }
+    inline const uint64_t& edge_list(uint64_t rank, bool end) const {
+        return end ? end_edges[rank] : start_edges[rank];
+    }
+
+    /// Find where the edge from left to right is recorded on left's outgoing
+    /// side, and on right's incoming side, as (rank, end, target) triples
+    void edge_entries(const handle_t& left, const handle_t& right,
+                      uint64_t& out_rank, bool& out_end, handle_t& out_target,
+                      uint64_t& in_rank, bool& in_end, handle_t& in_target) const;
+
+    bool list_contains(uint64_t head, const handle_t& target) const;
+    void list_add(uint64_t& head, const handle_t& target);
+    bool list_remove(uint64_t& head, const handle_t& target);
+
+    /// Get every edge on the node, as (left, right) pairs. Self loops on both
+    /// sides come up twice.
+    vector<edge_t> edges_of(uint64_t rank) const;
+
+    /// Append a node with the given ID and sequence range
+    handle_t append_node(id_t id, uint64_t sequence_start, uint32_t sequence_length);
+
+    /// Append bases to the packed sequence, returning where they start
+    uint64_t append_sequence(const string& sequence);
+    char get_base(uint64_t offset) const;
+    void set_base(uint64_t offset, char base);
+
+    /// Drop bases and order slots that belong to destroyed nodes
+    void compact_sequences();
+    void compact_order();
+};
+
+}
+
+#endif
@@ -1,12 +1,46 @@
 #include "packer.hpp"
+#include "read_ahead_stream.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 namespace vg {
 
+/// Coverage and edits for a Packer that many threads add to at once. Counts
+/// are one byte per base, with the rare counts that don't fit kept in
+/// lock-striped overflow maps, so the whole thing is about the size of one
+/// CounterArray no matter how many threads use it.
+struct Packer::SharedState {
+    SharedState(size_t length, size_t n_bins) : length(length), low_counts(new atomic<uint8_t>[length]()),
+        edits(n_bins), edit_locks(new mutex[n_bins]) {
+        // Nothing to do!
+    }
+    
+    /// Largest count kept in low_counts
+    static const uint8_t LOW_MAX = 255;
+    /// Number of overflow maps
+    static const size_t OVERFLOW_STRIPES = 256;
+    
+    size_t length;
+    unique_ptr<atomic<uint8_t>[]> low_counts;
+    mutex overflow_locks[OVERFLOW_STRIPES];
+    unordered_map<size_t, size_t> overflow[OVERFLOW_STRIPES];
+    
+    /// Serialized edits in each bin, and the locks that protect them
+    vector<string> edits;
+    unique_ptr<mutex[]> edit_locks;
+};
+
 Packer::Packer(void) : xgidx(nullptr) { }
 
-Packer::Packer(xg::XG* xidx, size_t binsz) : xgidx(xidx), bin_size(binsz) {
-    coverage_dynamic = gcsa::CounterArray(xgidx->seq_length, 8);
+Packer::Packer(xg::XG* xidx, size_t binsz, bool thread_safe) : xgidx(xidx), bin_size(binsz) {
     if (binsz) n_bins = xgidx->seq_length / bin_size + 1;
+    if (thread_safe) {
+        shared = make_shared<SharedState>(xgidx->seq_length, n_bins);
+    } else {
+        coverage_dynamic = gcsa::CounterArray(xgidx->seq_length, 8);
+    }
 }
 
 Packer::~Packer(void) {
@@ -15,7 +49,7 @@ Packer::~Packer(void) {
 }
 
 void Packer::load_from_file(const string& file_name) {
-    ifstream in(file_name);
+    ReadAheadFileStream in(file_name);
     load(in);
 }
 
@@ -45,7 +79,7 @@ void Packer::merge_from_files(const vector<string>& file_names) {
     bool first = true;
     for (auto& file_name : file_names) {
         Packer c;
-        ifstream f(file_name);
+        ReadAheadFileStream f(file_name);
         c.load(f);
         // take bin size and counts from the first, assume they are all the same
         if (first) {
@@ -108,6 +142,9 @@ void Packer::write_edits(vector<ofstream*>& out) const {
 void Packer::write_edits(ostream& out, size_t bin) const {
     if (is_compacted) {
         out << extract(edit_csas[bin], 0, edit_csas[bin].size()-2) << delim1; // chomp trailing null, add back delim        
+    } else if (shared) {
+        // uncompacted and in memory
+        out << shared->edits[bin] << delim1;
     } else {
         // uncompacted, so just cat the edit file for this bin onto out
         if (edit_tmpfile_names.size()) {
@@ -121,7 +158,56 @@ void Packer::collect_coverage(const Packer& c) {
     // assume the same basis vector
     assert(!is_compacted);
     for (size_t i = 0; i < c.graph_length(); ++i) {
-        coverage_dynamic.increment(i, c.coverage_at_position(i));
+        increment_coverage(i, c.coverage_at_position(i));
+    }
+}
+
+void Packer::increment_coverage(size_t i, size_t count) {
+    if (!shared) {
+        coverage_dynamic.increment(i, count);
+        return;
+    }
+    // add as much as fits to the byte counter
+    atomic<uint8_t>& low_count = shared->low_counts[i];
+    uint8_t seen = low_count.load(memory_order_relaxed);
+    while (count > 0 && seen < SharedState::LOW_MAX) {
+        uint8_t added = min<size_t>(count, SharedState::LOW_MAX - seen);
+        if (low_count.compare_exchange_weak(seen, seen + added, memory_order_relaxed)) {
+            count -= added;
+            seen += added;
+        }
+    }
+    if (count > 0) {
+        // and overflow the rest
+        size_t stripe = i % SharedState::OVERFLOW_STRIPES;
+        lock_guard<mutex> guard(shared->overflow_locks[stripe]);
+        shared->overflow[stripe][i] += count;
+    }
+}
+
+size_t Packer::dynamic_coverage_at_position(size_t i) const {
+    if (!shared) {
+        return coverage_dynamic[i];
+    }
+    size_t count = shared->low_counts[i].load(memory_order_relaxed);
+    if (count == SharedState::LOW_MAX) {
+        size_t stripe = i % SharedState::OVERFLOW_STRIPES;
+        lock_guard<mutex> guard(shared->overflow_locks[stripe]);
+        auto found = shared->overflow[stripe].find(i);
+        if (found != shared->overflow[stripe].end()) {
+            count += found->second;
+        }
+    }
+    return count;
+}
+
+void Packer::record_edit(size_t bin, const string& pos_repr, const string& edit_repr) {
+    if (shared) {
+        lock_guard<mutex> guard(shared->edit_locks[bin]);
+        shared->edits[bin].append(pos_repr);
+        shared->edits[bin].append(edit_repr);
+    } else {
+        *tmpfstreams[bin] << pos_repr << edit_repr;
     }
 }
 
@@ -156,18 +242,29 @@ void Packer::make_compact(void) {
     // sync edit file
     close_edit_tmpfiles();
     // temporaries for construction
-    size_t basis_length = coverage_dynamic.size();
+    size_t basis_length = graph_length();
     int_vector<> coverage_iv;
     util::assign(coverage_iv, int_vector<>(basis_length));
-    for (size_t i = 0; i < coverage_dynamic.size(); ++i) {
-        coverage_iv[i] = coverage_dynamic[i];
+    for (size_t i = 0; i < basis_length; ++i) {
+        coverage_iv[i] = dynamic_coverage_at_position(i);
     }
-    edit_csas.resize(edit_tmpfile_names.size());
     util::assign(coverage_civ, coverage_iv);
     construct_config::byte_algo_sa = SE_SAIS;
+    if (shared) {
+        // build straight from the edits in memory, padded like the files
+        edit_csas.resize(shared->edits.size());
+#pragma omp parallel for
+        for (size_t i = 0; i < shared->edits.size(); ++i) {
+            shared->edits[i].push_back(delim1);
+            construct_im(edit_csas[i], shared->edits[i], 1);
+        }
+        shared.reset();
+    } else {
+        edit_csas.resize(edit_tmpfile_names.size());
 #pragma omp parallel for
-    for (size_t i = 0; i < edit_tmpfile_names.size(); ++i) {
-        construct(edit_csas[i], edit_tmpfile_names[i], 1);
+        for (size_t i = 0; i < edit_tmpfile_names.size(); ++i) {
+            construct(edit_csas[i], edit_tmpfile_names[i], 1);
+        }
     }
     // construct the record marker bitvector
     remove_edit_tmpfiles();
@@ -224,7 +321,9 @@ void Packer::remove_edit_tmpfiles(void) {
 
 void Packer::add(const Alignment& aln, bool record_edits) {
     // open tmpfile if needed
-    ensure_edit_tmpfiles_open();
+    if (!shared) {
+        ensure_edit_tmpfiles_open();
+    }
     // count the nodes, edges, and edits
     for (auto& mapping : aln.path().mapping()) {
         if (!mapping.has_position()) {
@@ -245,11 +344,11 @@ void Packer::add(const Alignment& aln, bool record_edits) {
 #endif
                 if (mapping.position().is_reverse()) {
                     for (size_t j = 0; j < edit.from_length(); ++j) {
-                        coverage_dynamic.increment(i-j);
+                        increment_coverage(i-j);
                     }
                 } else {
                     for (size_t j = 0; j < edit.from_length(); ++j) {
-                        coverage_dynamic.increment(i+j);
+                        increment_coverage(i+j);
                     }
                 }
             } else if (record_edits) {
@@ -257,7 +356,7 @@ void Packer::add(const Alignment& aln, bool record_edits) {
                 string pos_repr = pos_key(i);
                 string edit_repr = edit_value(edit, mapping.position().is_reverse());
                 size_t bin = bin_for_position(i);
-                *tmpfstreams[bin] << pos_repr << edit_repr;
+                record_edit(bin, pos_repr, edit_repr);
             }
             if (mapping.position().is_reverse()) {
                 i -= edit.from_length();
@@ -338,6 +437,8 @@ string Packer::unescape_delim(const string& s, char d) const {
 size_t Packer::graph_length(void) const {
     if (is_compacted) {
         return coverage_civ.size();
+    } else if (shared) {
+        return shared->length;
     } else {
         return coverage_dynamic.size();
     }
@@ -347,7 +448,7 @@ size_t Packer::coverage_at_position(size_t i) const {
     if (is_compacted) {
         return coverage_civ[i];
     } else {
-        return coverage_dynamic[i];
+        return dynamic_coverage_at_position(i);
     }
 }
 
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <chrono>
 #include <ctime>
 #include "omp.h"
@@ -23,7 +24,10 @@ using namespace sdsl;
 class Packer {
 public:
     Packer(void);
-    Packer(xg::XG* xidx, size_t bin_size = 0);
+    /// Make a packer for the given graph. If thread_safe is set, add() can be
+    /// called from many threads at once, coverage is kept in one shared set
+    /// of atomic counters, and edits are accumulated in memory by bin.
+    Packer(xg::XG* xidx, size_t bin_size = 0, bool thread_safe = false);
     ~Packer(void);
     xg::XG* xgidx;
     void merge_from_files(const vector<string>& file_names);
@@ -56,9 +60,18 @@ private:
     void ensure_edit_tmpfiles_open(void);
     void close_edit_tmpfiles(void);
     void remove_edit_tmpfiles(void);
+    // add to or read the dynamic coverage, in whichever model we are using
+    void increment_coverage(size_t i, size_t count = 1);
+    size_t dynamic_coverage_at_position(size_t i) const;
+    // record an edit in the given bin, in whichever model we are using
+    void record_edit(size_t bin, const string& pos_repr, const string& edit_repr);
     bool is_compacted = false;
     // dynamic model
     gcsa::CounterArray coverage_dynamic;
+    // thread-safe dynamic model, used instead of coverage_dynamic and the
+    // edit temp files when we are shared between threads
+    struct SharedState;
+    shared_ptr<SharedState> shared;
     vector<string> edit_tmpfile_names;
     vector<ofstream*> tmpfstreams;
     // which bin should we use
@@ -1053,28 +1053,24 @@ Path& extend_path(Path& path1, const Path& path2) {
 
     // check if we have to splice the last mapping together
     if (!path2_front.has_position() || !path1_back.has_position()) {
-        // we build up the last mapping
-        auto mapping = path1_back;
+        // we build up the last mapping where it is
+        Mapping* mapping = path1.mutable_mapping(path1.mapping_size()-1);
         // adapt unmapped paths (which look like insertions here)
         if (!path2_front.has_position() && path1_back.has_position()) {
             // If one mapping has no position, it can't reference reference sequence
             assert(mapping_from_length(path2_front) == 0);
-            *mapping.mutable_position() = path1_back.position();
-            // Copy the reverse flag
-            mapping.mutable_position()->set_is_reverse(path1_back.position().is_reverse());
+            // The last mapping already has its own position and reverse flag
         } else if (!path1_back.has_position() && path2_front.has_position()) {
             // If one mapping has no position, it can't reference reference sequence
             assert(mapping_from_length(path1_back) == 0);
-            *mapping.mutable_position() = path2_front.position();
+            *mapping->mutable_position() = path2_front.position();
             // Copy the reverse flag
-            mapping.mutable_position()->set_is_reverse(path2_front.position().is_reverse());
+            mapping->mutable_position()->set_is_reverse(path2_front.position().is_reverse());
         }
         // merge the edits from the second onto the last mapping
         for (size_t i = 0; i < path2_front.edit_size(); ++i) {
-            *mapping.add_edit() = path2_front.edit(i);
+            *mapping->add_edit() = path2_front.edit(i);
         }
-        // replace the last mapping with the merged one
-        *path1.mutable_mapping(path1.mapping_size()-1) = mapping;
     } else {
         // just tack it on, it's on the next node
         *path1.add_mapping() = path2_front;
@@ -1163,16 +1159,24 @@ Path concat_paths(const Path& path1, const Path& path2) {
 }
 
 Path simplify(const Path& p, bool trim_internal_deletions) {
-    Path s;
-    s.set_name(p.name());
-    //cerr << "simplifying " << pb2json(p) << endl;
+    Path s = p;
+    simplify_in_place(&s, trim_internal_deletions);
+    return s;
+}
+
+void simplify_in_place(Path* p, bool trim_internal_deletions) {
+    // Mappings are moved down over the ones we drop or merge, and the ones
+    // left over at the end are deleted, so no mapping is copied.
+    auto& mappings = *p->mutable_mapping();
+    //cerr << "simplifying " << pb2json(*p) << endl;
     // loop over the mappings in the path, doing a few things
     // exclude mappings that are total deletions
     // when possible, merge a mapping with the previous mapping
     // push inserted sequences to the left
-    for (size_t i = 0; i < p.mapping_size(); ++i) {
-        auto m = simplify(p.mapping(i), trim_internal_deletions);
-        // remove empty mappings as these are redundant
+    size_t kept = 0;
+    for (size_t i = 0; i < mappings.size(); ++i) {
+        Mapping& m = *mappings.Mutable(i);
+        simplify_in_place(&m, trim_internal_deletions);
         if (trim_internal_deletions) {
             // remove wholly-deleted or empty mappings as these are redundant
             if ((m.edit_size() == 1 && edit_is_deletion(m.edit(0)))
@@ -1181,11 +1185,10 @@ Path simplify(const Path& p, bool trim_internal_deletions) {
             // remove empty mappings as these are redundant
             if (m.edit_size() == 0) continue;
         }
-        if (s.mapping_size()) {
-            //&& m.position().is_reverse() == s.mapping(s.mapping_size()-1).position().is_reverse()) {
+        if (kept) {
             // if this isn't the first mapping
             // refer to the last mapping
-            Mapping* l = s.mutable_mapping(s.mapping_size()-1);
+            Mapping* l = mappings.Mutable(kept - 1);
             // split off any insertions from the start
             // and push them to the last mapping
             size_t ins_at_start = 0;
@@ -1196,16 +1199,13 @@ Path simplify(const Path& p, bool trim_internal_deletions) {
             }
             // if there are insertions at the start, move them left
             if (ins_at_start) {
-                auto p = cut_mapping(m, ins_at_start);
-                auto& ins = p.first;
-                // cerr << "insertion " << pb2json(ins) << endl;
+                auto cut = cut_mapping(m, ins_at_start);
+                auto& ins = cut.first;
                 // take the position from the original mapping
-                m = p.second;
+                m = cut.second;
                 *m.mutable_position() = ins.position();
-                // cerr << "before and after " << pb2json(ins) << " and " << pb2json(m) << endl;
                 for (size_t j = 0; j < ins.edit_size(); ++j) {
-                    auto& e = ins.edit(j);
-                    *l->add_edit() = e;
+                    *l->add_edit() = ins.edit(j);
                 }
             }
             // if our last mapping has no position, but we do, merge
@@ -1215,7 +1215,7 @@ Path simplify(const Path& p, bool trim_internal_deletions) {
                 // if our last mapping has a position, and we don't, merge
             } else if ((!m.has_position() || m.position().node_id() == 0)
                        && (l->has_position() && l->position().node_id() != 0)) {
-                *m.mutable_position() = *l->mutable_position();
+                *m.mutable_position() = l->position();
                 m.mutable_position()->set_offset(from_length(*l));
             }
             // if we end at exactly the start position of the next mapping, we can merge
@@ -1226,135 +1226,156 @@ Path simplify(const Path& p, bool trim_internal_deletions) {
                  && l->position().node_id() == m.position().node_id()
                  && l->position().offset() + mapping_from_length(*l) == m.position().offset())) {
                 // we can merge the current mapping onto the old one
-                *l = concat_mappings(*l, m, trim_internal_deletions);
-            } else {
-                if (from_length(m) || to_length(m)) {
-                    *s.add_mapping() = m;
-                }
+                concat_mappings_in_place(l, m, trim_internal_deletions);
+            } else if (from_length(m) || to_length(m)) {
+                mappings.SwapElements(kept++, i);
             }
         } else {
-            *s.add_mapping() = m;
+            mappings.SwapElements(kept++, i);
         }
     }
-    // we will return this path after a final cleanup
-    Path r;
-    r.set_name(p.name());
     // remove any edit-less mappings that may have resulted from left-shifting indels
-    for (size_t i = 0; i < s.mapping_size(); ++i) {
-        auto& m = s.mapping(i);
-        if (!m.edit_size()) continue; // skips empty mappings
-        *r.add_mapping() = m;
-        // remove position if it's empty
-        auto& l = *r.mutable_mapping(r.mapping_size()-1);
-        if (l.has_position() && l.position().node_id()==0) {
-            l.clear_position();
-        }
+    size_t with_edits = 0;
+    for (size_t i = 0; i < kept; ++i) {
+        if (!mappings.Get(i).edit_size()) continue; // skips empty mappings
+        mappings.SwapElements(with_edits++, i);
     }
-    Path q;
+    mappings.DeleteSubrange(with_edits, mappings.size() - with_edits);
+
     // remove leading and trailing deletions (these might result from global alignment)
-    int total_to_length = path_to_length(r);
+    // and then set ranks and clear empty positions and edits
+    int total_to_length = path_to_length(*p);
     int seen_to_length = 0;
-    for (size_t i = 0; i < r.mapping_size(); ++i) {
-        auto& m = r.mapping(i);
+    kept = 0;
+    for (size_t i = 0; i < mappings.size(); ++i) {
+        Mapping& m = *mappings.Mutable(i);
         int curr_to_length = mapping_to_length(m);
         // skip bits at the beginning and end
         if (!seen_to_length && !curr_to_length
             || seen_to_length == total_to_length) continue;
-        Mapping n;
-        *n.mutable_position() = m.position();
+        auto& edits = *m.mutable_edit();
         if (seen_to_length) {
             if (seen_to_length + curr_to_length == total_to_length) {
                 // this is the last mapping before we should trim
                 // so trim any dels from the end of the mapping
-                size_t j = m.edit_size()-1;
-                for ( ; j >= 0; --j) {
-                    if (!edit_is_deletion(m.edit(j))) {
-                        ++j; // pointer to end
-                        break;
-                    }
+                size_t j = edits.size();
+                while (j > 0 && edit_is_deletion(edits.Get(j - 1))) {
+                    --j;
                 }
-                for (size_t h = 0; h < j; ++h) {
-                    *n.add_edit() = m.edit(h);
-                }
-            } else {
-                // internal segment
-                n = m;
+                edits.DeleteSubrange(j, edits.size() - j);
             }
         } else {
             // our first matching mapping
-            if (mapping_to_length(m)) {
-                size_t j = 0;
-                size_t seen = 0;
-                for ( ; j < m.edit_size(); ++j) {
-                    if (!edit_is_deletion(m.edit(j))) {
-                        break;
-                    } else {
-                        seen += m.edit(j).from_length();
-                    }
-                }
-                // adjust position
-                n.mutable_position()->set_offset(n.position().offset()+seen);
-                for ( ; j < m.edit_size(); ++j) {
-                    *n.add_edit() = m.edit(j);
+            size_t j = 0;
+            size_t seen = 0;
+            for ( ; j < edits.size(); ++j) {
+                if (!edit_is_deletion(edits.Get(j))) {
+                    break;
+                } else {
+                    seen += edits.Get(j).from_length();
                 }
             }
+            // adjust position
+            m.mutable_position()->set_offset(m.position().offset()+seen);
+            edits.DeleteSubrange(0, j);
         }
-        *q.add_mapping() = n;
-        seen_to_length += mapping_to_length(n);
-    }
-    q.set_name(r.name());
-    assert(path_to_length(q) == path_to_length(r));
-
-    // now set ranks and clear empty positions and edits
-    for (size_t i = 0; i < q.mapping_size(); ++i) {
-        auto& m = q.mapping(i);
-        Mapping n;
-        //auto* m = q.mutable_mapping(i);
-        n.set_rank(i+1);
-        if (m.position().node_id() != 0) {
+        seen_to_length += mapping_to_length(m);
+
+        m.set_rank(kept + 1);
+        if (m.position().node_id() == 0) {
             // this is an empty position, so let's remove it
-            *n.mutable_position() = m.position();
+            m.clear_position();
         }
-        for (auto& e : m.edit()) {
-            if (!edit_is_empty(e)) {
-                *n.add_edit() = e;
+        size_t nonempty = 0;
+        for (size_t j = 0; j < edits.size(); ++j) {
+            if (!edit_is_empty(edits.Get(j))) {
+                edits.SwapElements(nonempty++, j);
             }
         }
-        *q.mutable_mapping(i) = n;
+        edits.DeleteSubrange(nonempty, edits.size() - nonempty);
+        mappings.SwapElements(kept++, i);
     }
-
-    return q;
+    mappings.DeleteSubrange(kept, mappings.size() - kept);
+    assert(path_to_length(*p) == total_to_length);
+    // only the name and the mappings survive simplification
+    p->set_is_circular(false);
+    p->set_length(0);
 }
 
 // simple merge
 Mapping concat_mappings(const Mapping& m, const Mapping& n, bool trim_internal_deletions) {
     Mapping c = m;
+    concat_mappings_in_place(&c, n, trim_internal_deletions);
+    return c;
+}
+
+void concat_mappings_in_place(Mapping* m, const Mapping& n, bool trim_internal_deletions) {
     // add the edits on
     for (size_t i = 0; i < n.edit_size(); ++i) {
-        *c.add_edit() = n.edit(i);
+        *m->add_edit() = n.edit(i);
     }
     // merge anything that's identical
-    return simplify(c, trim_internal_deletions);
+    simplify_in_place(m, trim_internal_deletions);
 }
 
 Mapping simplify(const Mapping& m, bool trim_internal_deletions) {
-    Mapping n;
-    if (m.rank()) n.set_rank(m.rank());
-    // take the old position (which may be empty)
-    if (m.has_position()) {
-        *n.mutable_position() = m.position();
+    Mapping n = m;
+    simplify_in_place(&n, trim_internal_deletions);
+    return n;
+}
+
+/// Merge runs of edits of the same type in a Mapping, starting from the given
+/// edit and dropping the ones before it. Empty edits after the first are
+/// dropped if skip_empty is set, and a final deletion if trim_final_deletion
+/// is set. The edits that are kept are moved down rather than copied.
+static void merge_edits_in_place(Mapping* m, size_t first, bool skip_empty, bool trim_final_deletion) {
+    auto& edits = *m->mutable_edit();
+    if (first >= edits.size()) {
+        edits.Clear();
+        return;
+    }
+    // e is the edit we are merging into, which is the last one we keep
+    size_t kept = 0;
+    edits.SwapElements(kept, first);
+    Edit* e = edits.Mutable(kept);
+    for (size_t j = first + 1; j < edits.size(); ++j) {
+        const Edit& f = edits.Get(j);
+        // if the edit types are the same, merge them
+        if (skip_empty && edit_is_empty(f)) {
+            continue;
+        } else if ((edit_is_match(*e) && edit_is_match(f))
+            || (edit_is_sub(*e) && edit_is_sub(f))
+            || (edit_is_deletion(*e) && edit_is_deletion(f))
+            || (edit_is_insertion(*e) && edit_is_insertion(f))) {
+            // will be 0 for insertions, and + for the rest
+            e->set_from_length(e->from_length()+f.from_length());
+            // will be 0 for deletions, and + for the rest
+            e->set_to_length(e->to_length()+f.to_length());
+            // will be empty for both or have sequence for both
+            e->mutable_sequence()->append(f.sequence());
+        } else {
+            // mismatched types are just put on
+            edits.SwapElements(++kept, j);
+            e = edits.Mutable(kept);
+        }
     }
+    if (!(trim_final_deletion && edit_is_deletion(*e))) {
+        ++kept;
+    }
+    edits.DeleteSubrange(kept, edits.size() - kept);
+}
 
+void simplify_in_place(Mapping* m, bool trim_internal_deletions) {
     size_t j = 0;
     if (trim_internal_deletions) {
         // to simplify, we skip deletions at the very start of the node
         // these are implied by jumps in the path from other nodes
-        if (m.position().offset() == 0) {
-            for ( ; j < m.edit_size(); ++j) {
-                if (!edit_is_deletion(m.edit(j))) {
+        if (m->position().offset() == 0) {
+            for ( ; j < m->edit_size(); ++j) {
+                if (!edit_is_deletion(m->edit(j))) {
                     break;
                 } else {
-                    if (n.position().node_id() == 0) {
+                    if (m->position().node_id() == 0) {
                         // Complain if a Mapping has no position *and* has edit-initial
                         // deletions, which we need to remove but can't.
                         throw runtime_error(
@@ -1362,85 +1383,26 @@ Mapping simplify(const Mapping& m, bool trim_internal_deletions) {
                     }
                     
                     // Adjust the offset by the size of the deletion.
-                    n.mutable_position()->set_offset(n.position().offset()
-                                                     + m.edit(j).from_length());
+                    m->mutable_position()->set_offset(m->position().offset()
+                                                      + m->edit(j).from_length());
                 }
             }
         }
     }
     
     // go through the rest of the edits and see if we can merge them
-    if (j < m.edit_size()) {
-        Edit e = m.edit(j++);
-        for ( ; j < m.edit_size(); ++j) {
-            auto& f = m.edit(j);
-            // if the edit types are the same, merge them
-            if (edit_is_empty(f)) {
-                continue;
-            } else if ((edit_is_match(e) && edit_is_match(f))
-                || (edit_is_sub(e) && edit_is_sub(f))
-                || (edit_is_deletion(e) && edit_is_deletion(f))
-                || (edit_is_insertion(e) && edit_is_insertion(f))) {
-                // will be 0 for insertions, and + for the rest
-                e.set_from_length(e.from_length()+f.from_length());
-                // will be 0 for deletions, and + for the rest
-                e.set_to_length(e.to_length()+f.to_length());
-                // will be empty for both or have sequence for both
-                e.set_sequence(e.sequence() + f.sequence());
-            } else {
-                // mismatched types are just put on
-                *n.add_edit() = e;
-                e = f;
-            }
-        }
-        if (trim_internal_deletions) {
-            if (!edit_is_deletion(e)) *n.add_edit() = e;
-        } else {
-            *n.add_edit() = e;
-        }
-    }
-    return n;
+    merge_edits_in_place(m, j, true, trim_internal_deletions);
 }
 
 Mapping merge_adjacent_edits(const Mapping& m) {
-
-    Mapping n;
-    if (m.rank()) n.set_rank(m.rank());
-    // get the position
-    if (m.has_position()) {
-        // take the old position
-        *n.mutable_position() = m.position();
-    }
-
-    // This tracks what edit we're merging into
-    size_t j = 0;
-    // Go through the edits and see if we can merge them
-    if (j < m.edit_size()) {
-        Edit e = m.edit(j++);
-        for ( ; j < m.edit_size(); ++j) {
-            auto& f = m.edit(j);
-            // if the edit types are the same, merge them
-            if ((edit_is_match(e) && edit_is_match(f))
-                || (edit_is_sub(e) && edit_is_sub(f))
-                || (edit_is_deletion(e) && edit_is_deletion(f))
-                || (edit_is_insertion(e) && edit_is_insertion(f))) {
-                // will be 0 for insertions, and + for the rest
-                e.set_from_length(e.from_length()+f.from_length());
-                // will be 0 for deletions, and + for the rest
-                e.set_to_length(e.to_length()+f.to_length());
-                // will be empty for both or have sequence for both
-                e.set_sequence(e.sequence() + f.sequence());
-            } else {
-                // mismatched types are just put on
-                *n.add_edit() = e;
-                e = f;
-            }
-        }
-        // Keep the last edit
-        *n.add_edit() = e;
-    }
+    Mapping n = m;
+    merge_adjacent_edits_in_place(&n);
     return n;
+}
 
+void merge_adjacent_edits_in_place(Mapping* m) {
+    // Go through the edits and see if we can merge them, keeping the last one
+    merge_edits_in_place(m, 0, false, false);
 }
 
 Path trim_hanging_ends(const Path& p) {
@@ -2018,6 +1980,60 @@ pair<Path, Path> cut_path(const Path& path, size_t offset) {
     return make_pair(p1, p2);
 }
 
+/// Find where cut_path would divide the path at the given offset: the index
+/// of the first mapping that doesn't go wholly to the left, and the offset
+/// within that mapping to divide it at, which is 0 if it goes to the right.
+static pair<size_t, size_t> find_path_cut(const Path& path, size_t offset) {
+    size_t seen = 0;
+    size_t i = 0;
+    for ( ; i < path.mapping_size() && seen < offset; ++i) {
+        size_t length = mapping_to_length(path.mapping(i));
+        if (seen + length > offset) {
+            return make_pair(i, offset - seen);
+        }
+        seen += length;
+    }
+    assert(seen >= offset);
+    return make_pair(i, (size_t) 0);
+}
+
+void cut_path_start_in_place(Path* path, size_t offset) {
+    if (!path->mapping_size()) {
+        return;
+    }
+    auto cut = find_path_cut(*path, offset);
+    auto& mappings = *path->mutable_mapping();
+    if (cut.second) {
+        // keep the right side of the mapping we cut through
+        Mapping right = cut_mapping(mappings.Get(cut.first), cut.second).second;
+        mappings.Mutable(cut.first)->Swap(&right);
+    }
+    mappings.DeleteSubrange(0, cut.first);
+    // like cut_path, the pieces don't keep the path's annotations
+    path->clear_name();
+    path->set_is_circular(false);
+    path->set_length(0);
+}
+
+void cut_path_end_in_place(Path* path, size_t offset) {
+    if (!path->mapping_size()) {
+        return;
+    }
+    auto cut = find_path_cut(*path, offset);
+    auto& mappings = *path->mutable_mapping();
+    size_t keep = cut.first;
+    if (cut.second) {
+        // keep the left side of the mapping we cut through
+        Mapping left = cut_mapping(mappings.Get(cut.first), cut.second).first;
+        mappings.Mutable(cut.first)->Swap(&left);
+        keep++;
+    }
+    mappings.DeleteSubrange(keep, mappings.size() - keep);
+    path->clear_name();
+    path->set_is_circular(false);
+    path->set_length(0);
+}
+
 bool maps_to_node(const Path& p, id_t id) {
     for (size_t i = 0; i < p.mapping_size(); ++i) {
         if (p.mapping(i).position().node_id() == id) return true;
@@ -266,15 +266,23 @@ Path simplify(const Path& p, bool trim_internal_deletions = true);
 /// edits (while updating positions if necessary), and makes sure position is
 /// actually set.
 Mapping simplify(const Mapping& m, bool trim_internal_deletions = true);
+/// Simplify a Path in place, as simplify(), without copying its Mappings.
+void simplify_in_place(Path* p, bool trim_internal_deletions = true);
+/// Simplify a Mapping in place, as simplify(), without copying its Edits.
+void simplify_in_place(Mapping* m, bool trim_internal_deletions = true);
 
 /// Merge adjacent edits of the same type
 Path merge_adjacent_edits(const Path& m);
 /// Merge adjacent edits of the same type
 Mapping merge_adjacent_edits(const Mapping& m);
+/// Merge adjacent edits of the same type in place
+void merge_adjacent_edits_in_place(Mapping* m);
 // trim path so it starts and begins with a match (or is empty)
 Path trim_hanging_ends(const Path& p);
 // make a new mapping that concatenates the mappings
 Mapping concat_mappings(const Mapping& m, const Mapping& n, bool trim_internal_deletions = true);
+// append the edits of the second mapping onto the first, and simplify it in place
+void concat_mappings_in_place(Mapping* m, const Mapping& n, bool trim_internal_deletions = true);
 // make a new path that concatenates the two given paths
 Path concat_paths(const Path& path1, const Path& path2);
 // extend the first path by the second, avoiding copy operations
@@ -292,6 +300,10 @@ pair<mapping_t, mapping_t> cut_mapping(const mapping_t& m, size_t offset);
 pair<Path, Path> cut_path(const Path& path, const Position& pos);
 // divide the path at a path-relative offset as measured in to_length from start
 pair<Path, Path> cut_path(const Path& path, size_t offset);
+// keep only the part of the path after the offset, as cut_path(path, offset).second
+void cut_path_start_in_place(Path* path, size_t offset);
+// keep only the part of the path before the offset, as cut_path(path, offset).first
+void cut_path_end_in_place(Path* path, size_t offset);
 bool maps_to_node(const Path& p, id_t id);
 // the position that starts just after the path ends
 Position path_start(const Path& path);
@@ -1,5 +1,8 @@
 #include "path_index.hpp"
 
+#include <mutex>
+#include <tuple>
+
 namespace vg {
 
 PathIndex::PathIndex(const Path& path) {
@@ -8,32 +11,29 @@ PathIndex::PathIndex(const Path& path) {
     // What base are we at in the path?
     size_t path_base = 0;
     
-    // What was the last rank? Ranks must always go up.
-    int64_t last_rank = -1;
+    // Collect every visit's node ID, position and orientation, and sort them
+    // out at the end, keeping the first visit to each node.
+    vector<pair<int64_t, pair<size_t, bool>>> id_entries;
+    id_entries.reserve(path.mapping_size());
+    by_start.reserve(path.mapping_size());
     
     for (size_t i = 0; i < path.mapping_size(); i++) {
         // For every mapping
         auto& mapping = path.mapping(i);
     
-        if (!by_id.count(mapping.position().node_id())) {
-            // This is the first time we have visited this node in the path.
-            
-            // Add in a mapping.
-            by_id[mapping.position().node_id()] = 
-                std::make_pair(path_base, mapping.position().is_reverse());
-        }
+        id_entries.emplace_back(mapping.position().node_id(),
+            std::make_pair(path_base, mapping.position().is_reverse()));
         
         // Say that this node appears here along the reference in this
         // orientation.
         by_start[path_base] = NodeSide(mapping.position().node_id(), mapping.position().is_reverse());
         
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.position().node_id()].push_back(by_start.find(path_base));
-        
         // Just advance and don't grab sequence.
         path_base += mapping_from_length(mapping);
     }
     
+    by_id.build(std::move(id_entries));
+    
     // Record the length of the last mapping, since there's no next mapping to work it out from
     last_node_length = path.mapping_size() > 0 ? mapping_from_length(path.mapping(path.mapping_size() - 1)) : 0;
 
@@ -57,14 +57,18 @@ PathIndex::PathIndex(const list<mapping_t>& mappings, VG& vg) {
     // What was the last rank? Ranks must always go up.
     int64_t last_rank = -1;
     
+    // Which nodes have we visited already? We sort out by_id at the end.
+    unordered_set<id_t> seen;
+    vector<pair<int64_t, pair<size_t, bool>>> id_entries;
+    
     for (auto& mapping : mappings) {
     
-        if (!by_id.count(mapping.node_id())) {
+        if (seen.insert(mapping.node_id()).second) {
             // This is the first time we have visited this node in the path.
             
             // Add in a mapping.
-            by_id[mapping.node_id()] = 
-                std::make_pair(path_base, mapping.is_reverse());
+            id_entries.emplace_back(mapping.node_id(),
+                std::make_pair(path_base, mapping.is_reverse()));
 #ifdef debug
             #pragma omp critical (cerr)
             std::cerr << "Node " << mapping.node_id() << " rank " << mapping.rank()
@@ -82,9 +86,6 @@ PathIndex::PathIndex(const list<mapping_t>& mappings, VG& vg) {
         // orientation.
         by_start[path_base] = NodeSide(mapping.node_id(), mapping.is_reverse());
     
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.node_id()].push_back(by_start.find(path_base));
-    
         // Say this Mapping happens at this base along the path
         mapping_positions[&mapping] = path_base;
     
@@ -126,6 +127,8 @@ PathIndex::PathIndex(const list<mapping_t>& mappings, VG& vg) {
         // TODO: handle leading bogus characters in calls on the first node.
     }
     
+    by_id.build(std::move(id_entries));
+    
     // Record the length of the last mapping's node, since there's no next mapping to work it out from
     last_node_length = mappings.empty() ?
         0 : 
@@ -161,15 +164,19 @@ PathIndex::PathIndex(const Path& path, const xg::XG& index) {
     // What was the last rank? Ranks must always go up.
     int64_t last_rank = -1;
     
+    // Which nodes have we visited already? We sort out by_id at the end.
+    unordered_set<id_t> seen;
+    vector<pair<int64_t, pair<size_t, bool>>> id_entries;
+    
     for (size_t i = 0; i < path.mapping_size(); i++) {
         auto& mapping = path.mapping(i);
     
-        if (!by_id.count(mapping.position().node_id())) {
+        if (seen.insert(mapping.position().node_id()).second) {
             // This is the first time we have visited this node in the path.
             
             // Add in a mapping.
-            by_id[mapping.position().node_id()] = 
-                std::make_pair(path_base, mapping.position().is_reverse());
+            id_entries.emplace_back(mapping.position().node_id(),
+                std::make_pair(path_base, mapping.position().is_reverse()));
 #ifdef debug
             #pragma omp critical (cerr)
             std::cerr << "Node " << mapping.position().node_id() << " rank " << mapping.rank()
@@ -187,9 +194,6 @@ PathIndex::PathIndex(const Path& path, const xg::XG& index) {
         // orientation.
         by_start[path_base] = NodeSide(mapping.position().node_id(), mapping.position().is_reverse());
     
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.position().node_id()].push_back(by_start.find(path_base));
-    
         // Find the node's sequence
         std::string node_sequence = index.node_sequence(mapping.position().node_id());
     
@@ -228,6 +232,8 @@ PathIndex::PathIndex(const Path& path, const xg::XG& index) {
         // TODO: handle leading bogus characters in calls on the first node.
     }
     
+    by_id.build(std::move(id_entries));
+    
     // Record the length of the last mapping's node, since there's no next mapping to work it out from
     last_node_length = path.mapping_size() > 0 ?
         index.node_length(path.mapping(path.mapping_size() - 1).position().node_id()) :
@@ -266,14 +272,87 @@ PathIndex::PathIndex(const xg::XG& index, const string& path_name, bool extract_
     // Make sure the path is present
     assert(index.path_rank(path_name) != 0);
     
+    // Walk the XG's own path structure, so we never build the whole path as
+    // Mappings.
+    const xg::XGPath& xgpath = index.get_path(path_name);
+    size_t total_visits = xgpath.size();
+    
+    std::stringstream seq_stream;
+    size_t path_base = 0;
+    
+    vector<pair<int64_t, pair<size_t, bool>>> id_entries;
+    id_entries.reserve(total_visits);
+    by_start.reserve(total_visits);
+    
+    last_node_length = 0;
+    
+    for (size_t i = 0; i < total_visits; i++) {
+        id_t node_id = xgpath.node(i);
+        bool is_reverse = xgpath.is_reverse(i);
+        
+        id_entries.emplace_back(node_id, std::make_pair(path_base, is_reverse));
+        by_start[path_base] = NodeSide(node_id, is_reverse);
+        
+        size_t visit_length;
+        if (extract_sequence) {
+            std::string node_sequence = index.node_sequence(node_id);
+            
+            while(path_base == 0 && node_sequence.size() > 0 &&
+                (node_sequence[0] != 'A' && node_sequence[0] != 'T' && node_sequence[0] != 'C' &&
+                node_sequence[0] != 'G' && node_sequence[0] != 'N')) {
+                
+                // Drop leading invalid characters, as when indexing a Path.
+                #pragma omp critical (cerr)
+                std::cerr << "Warning: dropping invalid leading character "
+                    << node_sequence[0] << " from node " << node_id
+                    << std::endl;
+                    
+                node_sequence.erase(node_sequence.begin());
+            }
+            
+            seq_stream << (is_reverse ? reverse_complement(node_sequence) : node_sequence);
+            visit_length = node_sequence.size();
+        } else {
+            visit_length = index.node_length(node_id);
+        }
+        
+        path_base += visit_length;
+        
+        if (i + 1 == total_visits) {
+            // Record the length of the last node, since there's no next visit
+            // to work it out from
+            last_node_length = extract_sequence ? index.node_length(node_id) : visit_length;
+        }
+    }
+    
+    by_id.build(std::move(id_entries));
+    
     if (extract_sequence) {
-        // Constructor dispatch hack
-        *this = PathIndex(index.path(path_name), index);
-    } else {
-        *this = PathIndex(index.path(path_name));
+        sequence = seq_stream.str();
     }
 }
 
+shared_ptr<const PathIndex> PathIndex::get_shared(const xg::XG& index, const string& path_name,
+    bool extract_sequence) {
+    
+    // Indexes that are still held by someone, by graph, path, and whether they
+    // have the sequence.
+    static map<tuple<const xg::XG*, string, bool>, weak_ptr<const PathIndex>> cache;
+    static mutex cache_mutex;
+    
+    auto key = make_tuple(&index, path_name, extract_sequence);
+    
+    lock_guard<mutex> lock(cache_mutex);
+    
+    shared_ptr<const PathIndex> shared = cache[key].lock();
+    if (!shared) {
+        // Nobody has it any more (or ever did), so build it.
+        shared = make_shared<const PathIndex>(index, path_name, extract_sequence);
+        cache[key] = shared;
+    }
+    return shared;
+}
+
 void PathIndex::update_mapping_positions(VG& vg, const string& path_name) {
     // Brute force recalculate mapping positions.
     // Ignores bad characters...
@@ -296,7 +375,7 @@ void PathIndex::update_mapping_positions(VG& vg, const string& path_name) {
     }
 }
 
-bool PathIndex::path_contains_node(int64_t node_id){
+bool PathIndex::path_contains_node(int64_t node_id) const {
     if (by_id.find(node_id) != by_id.end()){
         return true;
     }
@@ -451,37 +530,8 @@ map<id_t, vector<Mapping>> PathIndex::parse_translation(const Translation& trans
 void PathIndex::apply_translation(const Translation& translation) {
     
     // Parse the translation, to get a map form old node ID to vector of
-    // replacement mappings.
-    auto old_node_to_new_nodes = parse_translation(translation);
-    
-    
-    // TODO: we would like to update mapping_positions efficiently, but we
-    // can't, because it's full of potentially invalidated pointers.
-    mapping_positions.clear();
-    
-    for (auto kv : old_node_to_new_nodes) {
-        // For every node that needs to be replaced with other nodes
-        auto& old_id = kv.first;
-        auto& replacements = kv.second;
-        
-        // Pull out all the occurrences of the old node.
-        vector<iterator> occurrences{std::move(node_occurrences[old_id])};
-        node_occurrences.erase(old_id);
-        
-        for (auto& occurrence : occurrences) {
-            // Each time the old node appeared, replace it (and log occurrences
-            // of the new nodes that partition it, one of which may re-use the
-            // ID)
-            replace_occurrence(occurrence, replacements);
-        }
-        
-#ifdef debug
-        cerr << "by_start is now: " << endl;
-        for (auto kv2 : by_start) {
-            cerr << "\t" << kv2.first << ": " << kv2.second << endl;
-        }
-#endif
-    }
+    // replacement mappings, and swap them all in at once.
+    replace_nodes(parse_translation(translation));
 }
 
 void PathIndex::apply_translations(const vector<Translation>& translations) {
@@ -514,6 +564,10 @@ void PathIndex::apply_translations(const vector<Translation>& translations) {
         collated[t.from().mapping(0).position().node_id()].push_back(make_pair(t.from().mapping(0), t.to().mapping(0)));
     }
     
+    // We collect the replacements for all the nodes and apply them together,
+    // so the index only gets rebuilt once.
+    map<id_t, vector<Mapping>> old_node_to_new_nodes;
+    
     for (auto& kv : collated) {
         // For every original node and its replacement nodes
         
@@ -539,87 +593,106 @@ void PathIndex::apply_translations(const vector<Translation>& translations) {
         from_edit->set_from_length(path_from_length(covering.to()));
         from_edit->set_to_length(from_edit->from_length());
         
-        // Apply this (single node) translation.
-        // TODO: batch up a bit?
-        apply_translation(covering);
+        // Work out how this (single node) translation partitions the node.
+        for (auto& partition : parse_translation(covering)) {
+            old_node_to_new_nodes[partition.first] = std::move(partition.second);
+        }
     }
+    
+    replace_nodes(old_node_to_new_nodes);
 }
 
-void PathIndex::replace_occurrence(iterator to_replace, const vector<Mapping>& replacements) {
-    // Grab the node ID
-    auto node_id = to_replace->second.node;
-    
-    // Grab it's start
-    auto start = to_replace->first;
-    
-    // Determine if we want to insert replacement nodes forward or backward
-    bool reverse = to_replace->second.is_end;
-    
-    // Peek ahead at whatever's next (so we know if we're replacing the last
-    // node in the path).
-    auto comes_next = to_replace;
-    comes_next++;
-    
-    if (by_id.count(node_id) && by_id.at(node_id).first == start) {
-        // We're removing the first occurrence of this node, so we need to
-        // clean up by_id. But since we're removing all occurreences of this
-        // node we don't have to point it at the second occurrence.
-        by_id.erase(node_id);
+void PathIndex::replace_nodes(const map<id_t, vector<Mapping>>& old_node_to_new_nodes) {
+    
+    // TODO: we would like to update mapping_positions efficiently, but we
+    // can't, because it's full of potentially invalidated pointers.
+    mapping_positions.clear();
+    
+    if (old_node_to_new_nodes.empty()) {
+        return;
     }
     
-    for (int64_t i = reverse ? (replacements.size() - 1) : 0;
-        i != (reverse ? -1 : replacements.size());
-        i += (reverse ? -1 : 1)) {
-        
-        // For each replacement mapping in the appropriate order
-        auto& mapping = replacements.at(i);
-        
-        // What ID do we put?
-        auto new_id = mapping.position().node_id();
+    // Copy over by_start, expanding each replaced occurrence as we go.
+    SortedVectorMap<size_t, NodeSide> new_by_start;
+    new_by_start.reserve(by_start.size());
+    
+    // Where each new node first appears. Since we go along the path in order,
+    // the first time we see a node is its first appearance.
+    map<int64_t, pair<size_t, bool>> new_firsts;
+    
+    for (auto here = by_start.begin(); here != by_start.end(); ++here) {
+        auto found = old_node_to_new_nodes.find(here->second.node);
+        if (found == old_node_to_new_nodes.end()) {
+            // This node stays
+            new_by_start[here->first] = here->second;
+            continue;
+        }
+        auto& replacements = found->second;
         
-        // What orientation doies it go in?
-        auto new_orientation = mapping.position().is_reverse() != reverse;
+        // Grab its start
+        auto start = here->first;
         
-        // Stick the replacements in the map
-        by_start[start] = NodeSide(new_id, new_orientation);
+        // Determine if we want to insert replacement nodes forward or backward
+        bool reverse = here->second.is_end;
         
-        // Remember that occurrence by node ID.
-        node_occurrences[new_id].push_back(by_start.find(start));
+        // Are we replacing the last node in the path?
+        bool is_last = (here + 1) == by_start.end();
         
-        if (!by_id.count(new_id) || by_id.at(new_id).first > start) {
-            // We've created a new first mapping to this new node.
-            // Record it.
-            by_id[new_id] = make_pair(start, new_orientation);
+        for (int64_t i = reverse ? (replacements.size() - 1) : 0;
+            i != (reverse ? -1 : replacements.size());
+            i += (reverse ? -1 : 1)) {
+            
+            // For each replacement mapping in the appropriate order
+            auto& mapping = replacements.at(i);
+            
+            // What ID do we put?
+            auto new_id = mapping.position().node_id();
+            
+            // What orientation does it go in?
+            auto new_orientation = mapping.position().is_reverse() != reverse;
+            
+            // Stick the replacements in the new index
+            new_by_start[start] = NodeSide(new_id, new_orientation);
+            new_firsts.emplace(new_id, make_pair(start, new_orientation));
+            
+            // Budge start up so the next mapping gets inserted after this one.
+            start += mapping_from_length(mapping);
+            
+            if (is_last && i == (reverse ? 0 : replacements.size() - 1)) {
+                // We just added the last mapping replacing what the old last
+                // mapping was. So update the length of the last node to reflect
+                // this new last node.
+                last_node_length = mapping_from_length(mapping);
+            }
         }
-        
-        // Budge start up so the next mapping gets inserted after this one.
-        start += mapping_from_length(mapping);
-        
-        if (comes_next == by_start.end() && i == (reverse ? 0 : replacements.size() - 1)) {
-            // We just added the last mapping replacing what the old last
-            // mapping was. So update the length of the last node to reflect
-            // this new last node.
-            last_node_length = mapping_from_length(mapping);
+    }
+    
+    by_start = std::move(new_by_start);
+    
+    // Now by_id is everything we didn't replace, plus the first appearances of
+    // the new nodes (one of which may re-use a replaced ID). Both are sorted,
+    // so we can merge them.
+    vector<pair<int64_t, pair<size_t, bool>>> kept;
+    kept.reserve(by_id.size());
+    for (auto& entry : by_id) {
+        if (!old_node_to_new_nodes.count(entry.first)) {
+            kept.push_back(entry);
         }
     }
+    vector<pair<int64_t, pair<size_t, bool>>> merged;
+    merged.reserve(kept.size() + new_firsts.size());
+    std::merge(kept.begin(), kept.end(), new_firsts.begin(), new_firsts.end(), back_inserter(merged),
+        [](const pair<int64_t, pair<size_t, bool>>& a, const pair<int64_t, pair<size_t, bool>>& b) {
+        return a.first < b.first;
+    });
+    by_id.build(std::move(merged));
+    
+#ifdef debug
+    cerr << "by_start is now: " << endl;
+    for (auto& kv : by_start) {
+        cerr << "\t" << kv.first << ": " << kv.second << endl;
+    }
+#endif
 }
 
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
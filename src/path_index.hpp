@@ -10,8 +10,12 @@
  */
  
 #include <map>
+#include <memory>
 #include <utility>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
 
 #include "vg.hpp"
 #include "xg.hpp"
@@ -20,6 +24,127 @@ namespace vg {
 
 using namespace std;
 
+/**
+ * A read-mostly map from keys to values, kept as a vector of pairs sorted by
+ * key. Lookups are binary searches over contiguous memory, and iteration is
+ * in key order like a std::map. Inserting at the end is cheap; inserting in
+ * the middle shifts everything after it, so bulk changes should go through
+ * build().
+ *
+ * Non-const iterators may be used to change values, but not keys.
+ */
+template<typename Key, typename Value>
+class SortedVectorMap {
+public:
+    using value_type = pair<Key, Value>;
+    using iterator = typename vector<value_type>::iterator;
+    using const_iterator = typename vector<value_type>::const_iterator;
+    
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+    
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    void clear() { entries.clear(); }
+    void reserve(size_t count) { entries.reserve(count); }
+    
+    /// Find the first entry with a key not less than the given key.
+    iterator lower_bound(const Key& key) {
+        return std::lower_bound(entries.begin(), entries.end(), key, key_less);
+    }
+    const_iterator lower_bound(const Key& key) const {
+        return std::lower_bound(entries.begin(), entries.end(), key, key_less);
+    }
+    
+    /// Find the first entry with a key greater than the given key.
+    iterator upper_bound(const Key& key) {
+        return std::upper_bound(entries.begin(), entries.end(), key, less_key);
+    }
+    const_iterator upper_bound(const Key& key) const {
+        return std::upper_bound(entries.begin(), entries.end(), key, less_key);
+    }
+    
+    iterator find(const Key& key) {
+        auto found = lower_bound(key);
+        return (found != entries.end() && found->first == key) ? found : entries.end();
+    }
+    const_iterator find(const Key& key) const {
+        auto found = lower_bound(key);
+        return (found != entries.end() && found->first == key) ? found : entries.end();
+    }
+    
+    size_t count(const Key& key) const {
+        return find(key) != entries.end();
+    }
+    
+    /// Get the value for a key, which must be present.
+    Value& at(const Key& key) {
+        auto found = find(key);
+        if (found == entries.end()) {
+            throw out_of_range("SortedVectorMap::at: key not present");
+        }
+        return found->second;
+    }
+    const Value& at(const Key& key) const {
+        auto found = find(key);
+        if (found == entries.end()) {
+            throw out_of_range("SortedVectorMap::at: key not present");
+        }
+        return found->second;
+    }
+    
+    /// Get the value for a key, inserting a default value if it is absent.
+    /// Keys that sort after everything present are appended in constant time.
+    Value& operator[](const Key& key) {
+        if (entries.empty() || entries.back().first < key) {
+            entries.emplace_back(key, Value());
+            return entries.back().second;
+        }
+        auto found = lower_bound(key);
+        if (found == entries.end() || found->first != key) {
+            found = entries.emplace(found, key, Value());
+        }
+        return found->second;
+    }
+    
+    /// Remove the entry for a key, if present. Returns the number removed.
+    size_t erase(const Key& key) {
+        auto found = find(key);
+        if (found == entries.end()) {
+            return 0;
+        }
+        entries.erase(found);
+        return 1;
+    }
+    
+    /// Replace the contents with the given entries, which need not be sorted.
+    /// Where a key appears more than once, the earliest entry for it wins.
+    void build(vector<value_type>&& new_entries) {
+        entries = std::move(new_entries);
+        if (!std::is_sorted(entries.begin(), entries.end(), entry_less)) {
+            std::stable_sort(entries.begin(), entries.end(), entry_less);
+        }
+        entries.erase(std::unique(entries.begin(), entries.end(), [](const value_type& a, const value_type& b) {
+            return a.first == b.first;
+        }), entries.end());
+    }
+    
+private:
+    vector<value_type> entries;
+    
+    static bool key_less(const value_type& entry, const Key& key) {
+        return entry.first < key;
+    }
+    static bool less_key(const Key& key, const value_type& entry) {
+        return key < entry.first;
+    }
+    static bool entry_less(const value_type& a, const value_type& b) {
+        return a.first < b.first;
+    }
+};
+
 /**
  * Holds indexes of the reference in a graph: position to node, node to position
  * and orientation, and the full reference string. Also knows about the lengths
@@ -28,12 +153,12 @@ using namespace std;
 struct PathIndex {
     /// Index from node ID to first position on the reference string and
     /// orientation it occurs there.
-    map<int64_t, pair<size_t, bool>> by_id;
+    SortedVectorMap<int64_t, pair<size_t, bool>> by_id;
     
     /// Index from start position on the reference to the side of the node that
     /// begins there. If it is a right side, the node occurs on the path in a
     /// reverse orientation.
-    map<size_t, NodeSide> by_start;
+    SortedVectorMap<size_t, NodeSide> by_start;
     
     /// The actual sequence of the path, if desired.
     std::string sequence;
@@ -59,9 +184,17 @@ struct PathIndex {
     /// Make a PathIndex from a path in a graph
     PathIndex(VG& vg, const string& path_name, bool extract_sequence = false);
     
-    /// Make a PathIndex from a path in an indexed graph
+    /// Make a PathIndex from a path in an indexed graph. Reads the XG's own
+    /// path structures rather than extracting the path as a Path first.
     PathIndex(const xg::XG& index, const string& path_name, bool extract_sequence = false);
     
+    /// Get a read-only PathIndex for a path in an indexed graph, building it
+    /// only if nobody else is already holding one for the same XG, path and
+    /// sequence setting. Safe to call from multiple threads; the returned
+    /// index must not outlive the XG.
+    static shared_ptr<const PathIndex> get_shared(const xg::XG& index, const string& path_name,
+        bool extract_sequence = false);
+    
     /// Rebuild the mapping positions map by tracing all the paths in the given
     /// graph. TODO: We ought to move this functionality to the Paths object and
     /// make it use a good datastructure instead of brute force.
@@ -72,10 +205,10 @@ struct PathIndex {
     NodeSide at_position(size_t position) const;
 
     // Check whether a node is on the reference path.
-    bool path_contains_node(int64_t node_id);
+    bool path_contains_node(int64_t node_id) const;
     
     /// We keep iterators to node occurrences along the ref path.
-    using iterator = map<size_t, vg::NodeSide>::const_iterator;
+    using iterator = SortedVectorMap<size_t, vg::NodeSide>::const_iterator;
     
     /// Get the iterator to the first node occurrence on the indexed path.
     iterator begin() const;
@@ -123,20 +256,15 @@ protected:
     /// indexed path.
     size_t last_node_length;
     
-    /// This holds all the places that a particular node occurs, in order.
-    /// TODO: use this to replace by_id
-    map<id_t, vector<iterator>> node_occurrences;
-    
     /// Convert a Translation that partitions old nodes into a map from old node
     /// ID to the Mappings that replace it in its forward orientation.
     map<id_t, vector<Mapping>> parse_translation(const Translation& translation);
     
-    /// Given an iterator into by_start, replace the occurrence of the node
-    /// there with occurrences of the nodes given in the vector of mappings,
-    /// which partition the forward strand of the node being replaced.
-    void replace_occurrence(iterator to_replace, const vector<Mapping>& replacements);
-    
-    
+    /// Replace every occurrence of each old node in the map with occurrences of
+    /// the nodes given in its vector of mappings, which partition the forward
+    /// strand of the node being replaced. Rebuilds by_start and by_id in a
+    /// single pass.
+    void replace_nodes(const map<id_t, vector<Mapping>>& old_node_to_new_nodes);
     
 };
 
@@ -15,11 +15,24 @@ PhaseUnfolder::PhaseUnfolder(const xg::XG& xg_index, const gbwt::GBWT& gbwt_inde
 
 void PhaseUnfolder::unfold(VG& graph, bool show_progress) {
     std::list<VG> components = this->complement_components(graph, show_progress);
+    std::vector<VG*> component_list;
+    for (VG& component : components) {
+        component_list.push_back(&component);
+    }
 
+    // Unfold the components in parallel. Each component numbers its
+    // duplicates from the end of the mapping on, and they get their final ids
+    // in component order, so the result does not depend on the threads.
+    std::vector<UnfoldState> states(component_list.size(), UnfoldState(this->mapping.end()));
     size_t haplotype_paths = 0;
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:haplotype_paths)
+    for (size_t i = 0; i < component_list.size(); i++) {
+        haplotype_paths += this->unfold_component(*(component_list[i]), graph, states[i]);
+    }
+
     VG unfolded;
-    for (VG& component : components) {
-        haplotype_paths += this->unfold_component(component, graph, unfolded);
+    for (UnfoldState& state : states) {
+        this->insert_component(state, unfolded);
     }
     if (show_progress) {
         std::cerr << "Unfolded graph: "
@@ -34,12 +47,12 @@ void PhaseUnfolder::restore_paths(VG& graph, bool show_progress) const {
 
     for (size_t path_rank = 1; path_rank <= this->xg_index.max_path_rank(); path_rank++) {
         const xg::XGPath& path = this->xg_index.get_path(this->xg_index.path_name(path_rank));
-        if (path.ids.size() == 0) {
+        if (path.size() == 0) {
             continue;
         }
 
         gbwt::node_type prev = gbwt::Node::encode(path.node(0), path.is_reverse(0));
-        for (size_t i = 1; i < path.ids.size(); i++) {
+        for (size_t i = 1; i < path.size(); i++) {
             gbwt::node_type curr = gbwt::Node::encode(path.node(i), path.is_reverse(i));
             Edge candidate = make_edge(prev, curr);
             if (!graph.has_edge(candidate)) {
@@ -57,7 +70,7 @@ void PhaseUnfolder::restore_paths(VG& graph, bool show_progress) const {
 }
 
 size_t path_size(const xg::XGPath& path) {
-    return path.ids.size();
+    return path.size();
 }
 
 size_t path_size(const gbwt::vector_type& path) {
@@ -260,11 +273,11 @@ std::list<VG> PhaseUnfolder::complement_components(VG& graph, bool show_progress
     // Add missing edges supported by XG paths.
     for (size_t path_rank = 1; path_rank <= this->xg_index.max_path_rank(); path_rank++) {
         const xg::XGPath& path = this->xg_index.get_path(this->xg_index.path_name(path_rank));
-        if (path.ids.size() == 0) {
+        if (path.size() == 0) {
             continue;
         }
         gbwt::node_type prev = gbwt::Node::encode(path.node(0), path.is_reverse(0));
-        for (size_t i = 1; i < path.ids.size(); i++) {
+        for (size_t i = 1; i < path.size(); i++) {
             gbwt::node_type curr = gbwt::Node::encode(path.node(i), path.is_reverse(i));
             Edge candidate = make_edge(prev, curr);
             if (!graph.has_edge(candidate)) {
@@ -303,24 +316,43 @@ std::list<VG> PhaseUnfolder::complement_components(VG& graph, bool show_progress
     return components;
 }
 
-size_t PhaseUnfolder::unfold_component(VG& component, VG& graph, VG& unfolded) {
+size_t PhaseUnfolder::unfold_component(VG& component, VG& graph, UnfoldState& state) const {
     // Find the border nodes shared between the component and the graph.
     component.for_each_node([&](Node* node) {
        if (graph.has_node(node->id())) {
-           this->border.insert(node->id());
+           state.border.insert(node->id());
        }
     });
 
     // Generate the paths starting from each border node.
-    for (vg::id_t start_node : this->border) {
-        this->generate_paths(component, start_node);
+    for (vg::id_t start_node : state.border) {
+        this->generate_paths(component, start_node, state);
     }
 
     // Generate the threads for each node.
     component.for_each_node([&](Node* node) {
-        this->generate_threads(component, node->id());
+        this->generate_threads(component, node->id(), state);
     });
 
+    // Only the tries and the duplicates are needed from here on.
+    state.border.clear();
+    state.reference_paths.clear();
+    return state.crossing_edges.size();
+}
+
+void PhaseUnfolder::insert_component(UnfoldState& state, VG& unfolded) {
+    // Give the duplicates their final ids.
+    gbwt::size_type offset = this->mapping.end() - state.first_duplicate;
+    for (vg::id_t original : state.duplicates) {
+        this->mapping.insert(original);
+    }
+    auto final_node = [&](gbwt::node_type node) -> gbwt::node_type {
+        if (node != gbwt::ENDMARKER && gbwt::Node::id(node) >= state.first_duplicate) {
+            return gbwt::Node::encode(gbwt::Node::id(node) + offset, gbwt::Node::is_reverse(node));
+        }
+        return node;
+    };
+
     auto insert_node = [&](gbwt::node_type node) {
         Node temp = this->xg_index.node(this->get_mapping(gbwt::Node::id(node)));
         temp.set_id(gbwt::Node::id(node));
@@ -328,8 +360,8 @@ size_t PhaseUnfolder::unfold_component(VG& component, VG& graph, VG& unfolded) {
     };
 
     // Create the unfolded component from the tries.
-    for (auto mapping : this->prefixes) {
-        gbwt::node_type from = mapping.first.first, to = mapping.second;
+    for (auto mapping : state.prefixes) {
+        gbwt::node_type from = final_node(mapping.first.first), to = final_node(mapping.second);
         if (from != gbwt::ENDMARKER) {
             insert_node(from);
         }
@@ -338,30 +370,28 @@ size_t PhaseUnfolder::unfold_component(VG& component, VG& graph, VG& unfolded) {
             unfolded.add_edge(make_edge(from, to));
         }
     }
-    for (auto mapping : this->suffixes) {
-        gbwt::node_type from = mapping.second, to = mapping.first.second;
+    for (auto mapping : state.suffixes) {
+        gbwt::node_type from = final_node(mapping.second), to = final_node(mapping.first.second);
         insert_node(from);
         if (to != gbwt::ENDMARKER) {
             insert_node(to);
             unfolded.add_edge(make_edge(from, to));
         }
     }
-    for (auto edge : this->crossing_edges) {
-        insert_node(edge.first);
-        insert_node(edge.second);
-        unfolded.add_edge(make_edge(edge.first, edge.second));
+    for (auto edge : state.crossing_edges) {
+        gbwt::node_type from = final_node(edge.first), to = final_node(edge.second);
+        insert_node(from);
+        insert_node(to);
+        unfolded.add_edge(make_edge(from, to));
     }
 
-    size_t haplotype_paths = this->crossing_edges.size();
-    this->border.clear();
-    this->reference_paths.clear();
-    this->prefixes.clear();
-    this->suffixes.clear();
-    this->crossing_edges.clear();
-    return haplotype_paths;
+    state.prefixes.clear();
+    state.suffixes.clear();
+    state.crossing_edges.clear();
+    state.duplicates.clear();
 }
 
-void PhaseUnfolder::generate_paths(VG& component, vg::id_t from) {
+void PhaseUnfolder::generate_paths(VG& component, vg::id_t from, UnfoldState& state) const {
 
     for (size_t path_rank = 1; path_rank <= this->xg_index.max_path_rank(); path_rank++) {
         const xg::XGPath& path = this->xg_index.get_path(this->xg_index.path_name(path_rank));
@@ -372,21 +402,21 @@ void PhaseUnfolder::generate_paths(VG& component, vg::id_t from) {
             {
                 gbwt::node_type prev = gbwt::Node::encode(path.node(occurrence), path.is_reverse(occurrence));
                 path_type buffer(1, prev);
-                for (size_t i = occurrence + 1; i < path.ids.size(); i++) {
+                for (size_t i = occurrence + 1; i < path.size(); i++) {
                     gbwt::node_type curr = gbwt::Node::encode(path.node(i), path.is_reverse(i));
                     Edge candidate = make_edge(prev, curr);
                     if (!component.has_edge(candidate)) {
                         break;  // Found a maximal path.
                     }
                     buffer.push_back(curr);
-                    if (this->border.find(gbwt::Node::id(curr)) != this->border.end()) {
+                    if (state.border.find(gbwt::Node::id(curr)) != state.border.end()) {
                         break;  // Found a border-to-border path.
                     }
                     prev = curr;
                 }
-                bool to_border = (this->border.find(gbwt::Node::id(buffer.back())) != this->border.end());
-                this->reference_paths.push_back(buffer);
-                this->insert_path(buffer, true, to_border);
+                bool to_border = (state.border.find(gbwt::Node::id(buffer.back())) != state.border.end());
+                state.reference_paths.push_back(buffer);
+                this->insert_path(buffer, true, to_border, state);
             }
 
             // Backward.
@@ -400,33 +430,33 @@ void PhaseUnfolder::generate_paths(VG& component, vg::id_t from) {
                         break;  // Found a maximal path.
                     }
                     buffer.push_back(curr);
-                    if (this->border.find(gbwt::Node::id(curr)) != this->border.end()) {
+                    if (state.border.find(gbwt::Node::id(curr)) != state.border.end()) {
                         break;  // Found a border-to-border path.
                     }
                     prev = curr;
                 }
-                bool to_border = (this->border.find(gbwt::Node::id(buffer.back())) != this->border.end());
-                this->reference_paths.push_back(buffer);
-                this->insert_path(buffer, true, to_border);
+                bool to_border = (state.border.find(gbwt::Node::id(buffer.back())) != state.border.end());
+                state.reference_paths.push_back(buffer);
+                this->insert_path(buffer, true, to_border, state);
             }
         }
     }
 }
 
-void PhaseUnfolder::generate_threads(VG& component, vg::id_t from) {
+void PhaseUnfolder::generate_threads(VG& component, vg::id_t from, UnfoldState& state) const {
 
-    bool is_internal = (this->border.find(from) == this->border.end());
-    this->create_state(from, false, is_internal);
-    this->create_state(from, true, is_internal);
+    bool is_internal = (state.border.find(from) == state.border.end());
+    this->create_state(from, false, is_internal, state);
+    this->create_state(from, true, is_internal, state);
 
-    while (!this->states.empty()) {
-        state_type state = this->states.top(); this->states.pop();
-        vg::id_t node = gbwt::Node::id(state.first.node);
-        bool is_reverse = gbwt::Node::is_reverse(state.first.node);
+    while (!state.states.empty()) {
+        state_type search_state = state.states.top(); state.states.pop();
+        vg::id_t node = gbwt::Node::id(search_state.first.node);
+        bool is_reverse = gbwt::Node::is_reverse(search_state.first.node);
 
-        if (state.second.size() >= 2 && this->border.find(node) != this->border.end()) {
+        if (search_state.second.size() >= 2 && state.border.find(node) != state.border.end()) {
             if (!is_internal) {
-                this->extend_path(state.second);
+                this->extend_path(search_state.second, state);
             }
             continue;   // The path reached a border.
         }
@@ -435,35 +465,35 @@ void PhaseUnfolder::generate_threads(VG& component, vg::id_t from) {
         bool was_extended = false;
         for (Edge* edge : edges) {
             if (edge->from() == node && edge->from_start() == is_reverse) {
-                was_extended |= this->extend_state(state, edge->to(), edge->to_end());
+                was_extended |= this->extend_state(search_state, edge->to(), edge->to_end(), state);
             }
             else if (edge->to() == node && edge->to_end() != is_reverse) {
-                was_extended |= this->extend_state(state, edge->from(), !edge->from_start());
+                was_extended |= this->extend_state(search_state, edge->from(), !edge->from_start(), state);
             }
         }
 
         if (!was_extended) {
-            this->extend_path(state.second);    // Maximal path.
+            this->extend_path(search_state.second, state);    // Maximal path.
         }
     }
 }
 
-void PhaseUnfolder::create_state(vg::id_t node, bool is_reverse, bool starting) {
+void PhaseUnfolder::create_state(vg::id_t node, bool is_reverse, bool starting, UnfoldState& state) const {
     gbwt::node_type gbwt_node = gbwt::Node::encode(node, is_reverse);
     search_type search = (starting ? this->gbwt_index.prefix(gbwt_node) : this->gbwt_index.find(gbwt_node));
     if (search.empty()) {
         return;
     }
-    this->states.push(std::make_pair(search, path_type(1, search.node)));
+    state.states.push(std::make_pair(search, path_type(1, search.node)));
 }
 
-bool PhaseUnfolder::extend_state(state_type state, vg::id_t node, bool is_reverse) {
-    state.first = this->gbwt_index.extend(state.first, gbwt::Node::encode(node, is_reverse));
-    if (state.first.empty()) {
+bool PhaseUnfolder::extend_state(state_type search_state, vg::id_t node, bool is_reverse, UnfoldState& state) const {
+    search_state.first = this->gbwt_index.extend(search_state.first, gbwt::Node::encode(node, is_reverse));
+    if (search_state.first.empty()) {
         return false;
     }
-    state.second.push_back(state.first.node);
-    this->states.push(state);
+    search_state.second.push_back(search_state.first.node);
+    state.states.push(search_state);
     return true;
 }
 
@@ -479,15 +509,15 @@ PhaseUnfolder::path_type canonical_orientation(const PhaseUnfolder::path_type& p
     return path;
 }
 
-void PhaseUnfolder::extend_path(const path_type& path) {
+void PhaseUnfolder::extend_path(const path_type& path, UnfoldState& state) const {
 
     if (path.size() < 2) {
         return;
     }
-    bool from_border = (this->border.find(gbwt::Node::id(path.front())) != this->border.end());
-    bool to_border = (this->border.find(gbwt::Node::id(path.back())) != this->border.end());
+    bool from_border = (state.border.find(gbwt::Node::id(path.front())) != state.border.end());
+    bool to_border = (state.border.find(gbwt::Node::id(path.back())) != state.border.end());
     if (from_border && to_border) {
-        this->insert_path(path, from_border, to_border);
+        this->insert_path(path, from_border, to_border, state);
         return;
     }
 
@@ -499,8 +529,8 @@ void PhaseUnfolder::extend_path(const path_type& path) {
     // Note that the reverse complement of a reference path is also a
     // reference path.
     if (!from_border) {
-        for (size_t ref = 0; ref < this->reference_paths.size(); ref++) {
-            const path_type& reference = this->reference_paths[ref];
+        for (size_t ref = 0; ref < state.reference_paths.size(); ref++) {
+            const path_type& reference = state.reference_paths[ref];
             bool found = false;
             for (size_t i = 0; i < reference.size(); i++) {
                 Edge candidate = make_edge(reference[i], to_extend.front());
@@ -519,8 +549,8 @@ void PhaseUnfolder::extend_path(const path_type& path) {
 
     // Try adding a suffix of a reference path to the end of the path.
     if (!to_border) {
-        for (size_t ref = 0; ref < this->reference_paths.size(); ref++) {
-            const path_type& reference = this->reference_paths[ref];
+        for (size_t ref = 0; ref < state.reference_paths.size(); ref++) {
+            const path_type& reference = state.reference_paths[ref];
             bool found = false;
             for (size_t i = 0; i < reference.size(); i++) {
                 Edge candidate = make_edge(to_extend.back(), reference[i]);
@@ -537,10 +567,10 @@ void PhaseUnfolder::extend_path(const path_type& path) {
         }
     }
 
-    this->insert_path(to_extend, from_border, to_border);
+    this->insert_path(to_extend, from_border, to_border, state);
 }
 
-void PhaseUnfolder::insert_path(const path_type& path, bool from_border, bool to_border) {
+void PhaseUnfolder::insert_path(const path_type& path, bool from_border, bool to_border, UnfoldState& state) const {
 
     if (path.size() < 2) {
         return;
@@ -557,42 +587,46 @@ void PhaseUnfolder::insert_path(const path_type& path, bool from_border, bool to
     // Prefixes.
     gbwt::node_type from = to_insert.front();
     if (!from_border) {
-        from = this->get_prefix(gbwt::ENDMARKER, from);
+        from = this->get_prefix(gbwt::ENDMARKER, from, state);
     }
     for (size_t i = 1; i < (to_insert.size() + 1) / 2; i++) {
-        from = this->get_prefix(from, to_insert[i]);
+        from = this->get_prefix(from, to_insert[i], state);
     }
 
     // Suffixes.
     gbwt::node_type to = to_insert.back();
     if (!to_border) {
-        to = this->get_suffix(to, gbwt::ENDMARKER);
+        to = this->get_suffix(to, gbwt::ENDMARKER, state);
     }
     for (size_t i = to_insert.size() - 2; i >= (to_insert.size() + 1) / 2; i--) {
-        to = this->get_suffix(to_insert[i], to);
+        to = this->get_suffix(to_insert[i], to, state);
     }
 
     // Crossing edge.
-    this->crossing_edges.insert(std::make_pair(from, to));
+    state.crossing_edges.insert(std::make_pair(from, to));
 }
 
 
-gbwt::node_type PhaseUnfolder::get_prefix(gbwt::node_type from, gbwt::node_type node) {
+gbwt::node_type PhaseUnfolder::get_prefix(gbwt::node_type from, gbwt::node_type node, UnfoldState& state) const {
     std::pair<gbwt::node_type, gbwt::node_type> key(from, node);
-    if (this->prefixes.find(key) == this->prefixes.end()) {
-        gbwt::size_type new_id = this->mapping.insert(gbwt::Node::id(node));
-        this->prefixes[key] = gbwt::Node::encode(new_id, gbwt::Node::is_reverse(node));
+    if (state.prefixes.find(key) == state.prefixes.end()) {
+        state.prefixes[key] = this->make_duplicate(node, state);
     }
-    return this->prefixes[key];
+    return state.prefixes[key];
 }
 
-gbwt::node_type PhaseUnfolder::get_suffix(gbwt::node_type node, gbwt::node_type to) {
+gbwt::node_type PhaseUnfolder::get_suffix(gbwt::node_type node, gbwt::node_type to, UnfoldState& state) const {
     std::pair<gbwt::node_type, gbwt::node_type> key(node, to);
-    if (this->suffixes.find(key) == this->suffixes.end()) {
-        gbwt::size_type new_id = this->mapping.insert(gbwt::Node::id(node));
-        this->suffixes[key] = gbwt::Node::encode(new_id, gbwt::Node::is_reverse(node));
+    if (state.suffixes.find(key) == state.suffixes.end()) {
+        state.suffixes[key] = this->make_duplicate(node, state);
     }
-    return this->suffixes[key];
+    return state.suffixes[key];
+}
+
+gbwt::node_type PhaseUnfolder::make_duplicate(gbwt::node_type node, UnfoldState& state) const {
+    gbwt::size_type new_id = state.first_duplicate + state.duplicates.size();
+    state.duplicates.push_back(gbwt::Node::id(node));
+    return gbwt::Node::encode(new_id, gbwt::Node::is_reverse(node));
 }
 
-} 
+}
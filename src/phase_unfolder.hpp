@@ -100,6 +100,30 @@ public:
     }
 
 private:
+    /**
+     * Working data for unfolding one component. Components are unfolded
+     * concurrently, so each one gets its own. The duplicate nodes created
+     * for the component get temporary ids from first_duplicate on, and are
+     * given their final ids when the component is added to the graph.
+     */
+    struct UnfoldState {
+        explicit UnfoldState(gbwt::size_type first_duplicate) : first_duplicate(first_duplicate) {}
+
+        hash_set<vg::id_t>     border;
+        std::stack<state_type> states;
+        std::vector<path_type> reference_paths;
+
+        /// Tries for the unfolded prefixes and reverse suffixes.
+        /// prefixes[(from, to)] is the mapping for to, and
+        /// suffixes[(from, to)] is the mapping for from.
+        pair_hash_map<std::pair<gbwt::node_type, gbwt::node_type>, gbwt::node_type> prefixes, suffixes;
+        pair_hash_set<std::pair<gbwt::node_type, gbwt::node_type>> crossing_edges;
+
+        /// Original ids of the duplicates in the order they were created.
+        std::vector<vg::id_t> duplicates;
+        gbwt::size_type       first_duplicate;
+    };
+
     /**
      * Generate a complement graph consisting of the edges that are in the
      * GBWT index but not in the input graph. Split the complement into
@@ -111,8 +135,16 @@ private:
      * Generate all border-to-border paths in the component supported by the
      * indexes. Unfold the paths by duplicating the inner nodes so that the
      * paths become disjoint, except for their shared prefixes/suffixes.
+     * Returns the number of haplotype paths. Safe to call concurrently for
+     * different components.
      */
-    size_t unfold_component(VG& component, VG& graph, VG& unfolded);
+    size_t unfold_component(VG& component, VG& graph, UnfoldState& state) const;
+
+    /**
+     * Give the duplicate nodes of an unfolded component their final ids and
+     * add the component to the unfolded graph.
+     */
+    void insert_component(UnfoldState& state, VG& unfolded);
 
     /**
      * Generate all paths supported by the XG index passing through the given
@@ -120,7 +152,7 @@ private:
      * paths into the set in the canonical orientation, and use them as
      * reference paths for extending threads.
      */
-    void generate_paths(VG& component, vg::id_t from);
+    void generate_paths(VG& component, vg::id_t from, UnfoldState& state) const;
 
    /**
     * Generate all paths supported by the GBWT index from the given node until
@@ -129,32 +161,35 @@ private:
     * passing through it. Otherwise consider only the threads starting from
     * it, and do not output threads reaching a border.
     */
-    void generate_threads(VG& component, vg::id_t from);
+    void generate_threads(VG& component, vg::id_t from, UnfoldState& state) const;
 
     /**
-     * Create or extend the state with the given node orientation, and insert
-     * it into the stack if it is supported by the GBWT index. Use 'starting'
-     * to determine whether the initial state is for the threads starting at
-     * the node or for the threads passing through the node.
+     * Create or extend the search state with the given node orientation, and
+     * insert it into the stack if it is supported by the GBWT index. Use
+     * 'starting' to determine whether the initial state is for the threads
+     * starting at the node or for the threads passing through the node.
      */
-    void create_state(vg::id_t node, bool is_reverse, bool starting);
-    bool extend_state(state_type state, vg::id_t node, bool is_reverse);
+    void create_state(vg::id_t node, bool is_reverse, bool starting, UnfoldState& state) const;
+    bool extend_state(state_type search_state, vg::id_t node, bool is_reverse, UnfoldState& state) const;
 
     /**
      * Try to extend the path at both ends until the border by using the
      * reference paths. Insert the extended path into the set in the canonical
      * orientation.
      */
-    void extend_path(const path_type& path);
+    void extend_path(const path_type& path, UnfoldState& state) const;
 
     /// Insert the path into the set in the canonical orientation.
-    void insert_path(const path_type& path, bool from_border, bool to_border);
+    void insert_path(const path_type& path, bool from_border, bool to_border, UnfoldState& state) const;
 
     /// Get the id for the duplicate of 'node' after 'from'.
-    gbwt::node_type get_prefix(gbwt::node_type from, gbwt::node_type node);
+    gbwt::node_type get_prefix(gbwt::node_type from, gbwt::node_type node, UnfoldState& state) const;
 
     /// Get the id for the duplicate of 'node' before 'to'.
-    gbwt::node_type get_suffix(gbwt::node_type node, gbwt::node_type to);
+    gbwt::node_type get_suffix(gbwt::node_type node, gbwt::node_type to, UnfoldState& state) const;
+
+    /// Make a new temporary duplicate of 'node'.
+    gbwt::node_type make_duplicate(gbwt::node_type node, UnfoldState& state) const;
 
     /// XG and GBWT indexes for the original graph.
     const xg::XG&     xg_index;
@@ -162,17 +197,6 @@ private:
 
     /// Mapping from duplicated nodes to original ids.
     gcsa::NodeMapping mapping;
-
-    /// Internal data structures for the current component.
-    hash_set<vg::id_t>     border;
-    std::stack<state_type> states;
-    std::vector<path_type> reference_paths;
-
-    /// Tries for the unfolded prefixes and reverse suffixes.
-    /// prefixes[(from, to)] is the mapping for to, and
-    /// suffixes[(from, to)] is the mapping for from.
-    pair_hash_map<std::pair<gbwt::node_type, gbwt::node_type>, gbwt::node_type> prefixes, suffixes;
-    pair_hash_set<std::pair<gbwt::node_type, gbwt::node_type>> crossing_edges;
 };
 
 }
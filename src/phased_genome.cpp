@@ -237,6 +237,10 @@ namespace vg {
         cerr << "[PhasedGenome::swap_alleles]: swapping allele at site " << site.start().node_id() << "->" << site.end().node_id() << " between chromosomes " << haplotype_1 << " and " << haplotype_2 << " with haplotype nodes " << haplo_nodes_1.first << "->" << haplo_nodes_1.second << " and " << haplo_nodes_2.first << "->" << haplo_nodes_2.second << endl;
 #endif
         
+        // reads on either allele may be aligned differently after the swap
+        invalidate_tracked_reads(haplo_nodes_1.first, haplo_nodes_1.second);
+        invalidate_tracked_reads(haplo_nodes_2.first, haplo_nodes_2.second);
+        
         bool is_deletion_1 = (haplo_nodes_1.first->next == haplo_nodes_1.second);
         bool is_deletion_2 = (haplo_nodes_2.first->next == haplo_nodes_2.second);
         
@@ -417,6 +421,87 @@ namespace vg {
         return optimal_score;
     }
     
+    size_t PhasedGenome::track_read(const MultipathAlignment& multipath_aln, VG& graph) {
+        
+        size_t read_id = tracked_reads.size();
+        int32_t score = optimal_score_on_genome(multipath_aln, graph);
+        tracked_reads.push_back(TrackedRead{&multipath_aln, &graph, score, false});
+        tracked_score_sum += score;
+        
+        // index the read by each node it visits, once
+        unordered_set<int64_t> visited;
+        for (const Subpath& subpath : multipath_aln.subpath()) {
+            for (const Mapping& mapping : subpath.path().mapping()) {
+                int64_t node_id = mapping.position().node_id();
+                if (visited.insert(node_id).second) {
+                    tracked_read_nodes[node_id].push_back(read_id);
+                }
+            }
+        }
+        
+        return read_id;
+    }
+    
+    int32_t PhasedGenome::tracked_read_score(size_t read_id) {
+        if (tracked_reads[read_id].stale) {
+            rescore_tracked_read(read_id);
+        }
+        return tracked_reads[read_id].score;
+    }
+    
+    int64_t PhasedGenome::total_tracked_score() {
+        for (size_t read_id : stale_tracked_reads) {
+            if (tracked_reads[read_id].stale) {
+                rescore_tracked_read(read_id);
+            }
+        }
+        stale_tracked_reads.clear();
+        return tracked_score_sum;
+    }
+    
+    size_t PhasedGenome::num_stale_tracked_reads() const {
+        return num_stale;
+    }
+    
+    void PhasedGenome::clear_tracked_reads() {
+        tracked_reads.clear();
+        tracked_read_nodes.clear();
+        stale_tracked_reads.clear();
+        num_stale = 0;
+        tracked_score_sum = 0;
+    }
+    
+    void PhasedGenome::invalidate_tracked_reads(HaplotypeNode* left, HaplotypeNode* right) {
+        if (tracked_reads.empty()) {
+            return;
+        }
+        
+        for (HaplotypeNode* haplo_node = left; ; haplo_node = haplo_node->next) {
+            auto iter = tracked_read_nodes.find(haplo_node->node_traversal.node->id());
+            if (iter != tracked_read_nodes.end()) {
+                for (size_t read_id : iter->second) {
+                    if (!tracked_reads[read_id].stale) {
+                        tracked_reads[read_id].stale = true;
+                        stale_tracked_reads.push_back(read_id);
+                        num_stale++;
+                    }
+                }
+            }
+            if (haplo_node == right) {
+                break;
+            }
+        }
+    }
+    
+    void PhasedGenome::rescore_tracked_read(size_t read_id) {
+        TrackedRead& tracked_read = tracked_reads[read_id];
+        int32_t score = optimal_score_on_genome(*tracked_read.multipath_aln, *tracked_read.graph);
+        tracked_score_sum += score - tracked_read.score;
+        tracked_read.score = score;
+        tracked_read.stale = false;
+        num_stale--;
+    }
+    
     
     PhasedGenome::iterator::iterator() : rank(0), haplotype_number(-1), haplo_node(nullptr) {
     
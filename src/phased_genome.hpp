@@ -112,6 +112,28 @@ namespace vg {
         /// Note: assumes that MultipathAlignment has 'start' field filled in
         int32_t optimal_score_on_genome(const MultipathAlignment& multipath_aln, VG& graph);
         
+        /// Start keeping the optimal score of a multipath alignment on the genome (as from
+        /// optimal_score_on_genome) up to date through allele edits. After an edit, only the
+        /// tracked reads that visit a node of the old or new allele are rescored, and not until
+        /// their scores are next asked for. Returns an ID for the read.
+        ///
+        /// Note: indices must already be built, and the alignment and graph must outlive the
+        /// PhasedGenome or the next call to clear_tracked_reads
+        size_t track_read(const MultipathAlignment& multipath_aln, VG& graph);
+        
+        /// Returns the current optimal score on the genome of a read from track_read.
+        int32_t tracked_read_score(size_t read_id);
+        
+        /// Returns the sum of the current optimal scores of all tracked reads.
+        int64_t total_tracked_score();
+        
+        /// Returns the number of tracked reads that will need to be rescored before their
+        /// scores are next reported.
+        size_t num_stale_tracked_reads() const;
+        
+        /// Stop tracking all reads.
+        void clear_tracked_reads();
+        
         // TODO: make a local subalignment optimal score function (main obstacle is scoring partial subpaths)
         
     private:
@@ -134,9 +156,41 @@ namespace vg {
         // note: sufficient for these purposes to maintain only node ids instead of node sides
         // since the path must go through the site either before or after entering here
         
+        /// A read whose optimal score on the genome is cached
+        struct TrackedRead {
+            const MultipathAlignment* multipath_aln;
+            VG* graph;
+            int32_t score;
+            /// Has the genome changed under the read since it was scored?
+            bool stale;
+        };
+        
+        /// All reads being tracked, by ID
+        vector<TrackedRead> tracked_reads;
+        
+        /// Index of which tracked reads visit each node from the graph
+        unordered_map<int64_t, vector<size_t>> tracked_read_nodes;
+        
+        /// The tracked reads that have been marked stale (may also include reads that have
+        /// been rescored since)
+        vector<size_t> stale_tracked_reads;
+        
+        /// Number of tracked reads that are currently stale
+        size_t num_stale = 0;
+        
+        /// Sum of the cached scores of all tracked reads
+        int64_t tracked_score_sum = 0;
+        
         // Helper function
         void build_site_indices_internal(const Snarl* snarl);
         
+        /// Mark stale all the tracked reads that visit a node of the haplotype from the left to
+        /// the right haplotype node, inclusive
+        void invalidate_tracked_reads(HaplotypeNode* left, HaplotypeNode* right);
+        
+        /// Bring the cached score of a tracked read up to date
+        void rescore_tracked_read(size_t read_id);
+        
         // Editing methods:
         // note: no safety checks that the adjacent nodes aren't null (should only be used in interior
         // of haplotype) these operations maintain the node location indices but no others
@@ -334,6 +388,9 @@ namespace vg {
         
         pair<HaplotypeNode*, HaplotypeNode*> haplo_site = haplotype.sites[&site];
         
+        // reads on the old allele may have lost their best alignment
+        invalidate_tracked_reads(haplo_site.first, haplo_site.second);
+        
 #ifdef debug_phased_genome
         cerr << "[PhasedGenome::set_allele]: deleting allele at site " << haplo_site.first->node_traversal.node->id() << "->" << haplo_site.second->node_traversal.node->id() << endl;
 #endif
@@ -447,6 +504,9 @@ namespace vg {
                 }
             }
         }
+        
+        // reads on the new allele may have gained a better alignment
+        invalidate_tracked_reads(haplo_site.first, haplo_site.second);
     }
     
     template <typename NodeTraversalIterator>
@@ -95,6 +95,37 @@ void Pileups::for_each_edge_pileup(const function<void(EdgePileup&)>& lambda) {
     }
 }
 
+void Pileups::flush_before(int64_t node_id, const function<void(NodePileup&)>& node_lambda,
+                           const function<void(EdgePileup&)>& edge_lambda) {
+    vector<int64_t> node_ids;
+    for (auto& p : _node_pileups) {
+        if (p.first < node_id) {
+            node_ids.push_back(p.first);
+        }
+    }
+    sort(node_ids.begin(), node_ids.end());
+    for (auto id : node_ids) {
+        auto found = _node_pileups.find(id);
+        node_lambda(*found->second);
+        delete found->second;
+        _node_pileups.erase(found);
+    }
+
+    vector<pair<NodeSide, NodeSide>> edge_sides;
+    for (auto& p : _edge_pileups) {
+        if (min(p.first.first.node, p.first.second.node) < node_id) {
+            edge_sides.push_back(p.first);
+        }
+    }
+    sort(edge_sides.begin(), edge_sides.end());
+    for (auto& sides : edge_sides) {
+        auto found = _edge_pileups.find(sides);
+        edge_lambda(*found->second);
+        delete found->second;
+        _edge_pileups.erase(found);
+    }
+}
+
 EdgePileup* Pileups::get_edge_pileup(pair<NodeSide, NodeSide> sides) {
     if (sides.second < sides.first) {
         std::swap(sides.first, sides.second);
@@ -158,6 +158,14 @@ public:
 
     void for_each_edge_pileup(const function<void(EdgePileup&)>& lambda);
 
+    /// Hand every node pileup with ID below node_id, and every edge pileup
+    /// touching such a node, to the given functions in ID order, then drop
+    /// them from the table.  For sorted input, where no later alignment
+    /// reaches back below node_id, these pileups are complete, so this bounds
+    /// memory to a window of the graph.
+    void flush_before(int64_t node_id, const function<void(NodePileup&)>& node_lambda,
+                      const function<void(EdgePileup&)>& edge_lambda);
+
     /// search hash table for edge id
     EdgePileup* get_edge_pileup(pair<NodeSide, NodeSide> sides);
             
@@ -54,41 +54,78 @@ void PileupAugmenter::write_augmented_graph(ostream& out, bool json) {
 
 void PileupAugmenter::call_node_pileup(const NodePileup& pileup) {
 
-    _node = _graph->get_node(pileup.node_id());
-    assert(_node != NULL);
-    assert(_node->sequence().length() == pileup.base_pileup_size());
-    
-    _node_calls.clear();
-    _insert_calls.clear();
-    string def_char = "-";
-    _node_calls.assign(_node->sequence().length(), Genotype(def_char, def_char));
-    _insert_calls.assign(_node->sequence().length(), Genotype(def_char, def_char));
-    _node_supports.clear();
-    _node_supports.assign(_node->sequence().length(), make_pair(
-                              StrandSupport(), StrandSupport()));
-    _insert_supports.clear();
-    _insert_supports.assign(_node->sequence().length(), make_pair(
-                                StrandSupport(), StrandSupport()));
+    const Node* node = _graph->get_node(pileup.node_id());
+    assert(node != NULL);
+    assert(node->sequence().length() == pileup.base_pileup_size());
+
+    NodeCalls calls;
+    init_node_calls(node, calls);
 
     // process each base in pileup individually
     #pragma omp parallel for
     for (int i = 0; i < pileup.base_pileup_size(); ++i) {
-        int num_inserts = 0;
-        for (auto b : pileup.base_pileup(i).bases()) {
-            if (b == '+') {
-                ++num_inserts;
-            }
+        call_base(pileup, i, calls);
+    }
+
+    add_node_calls(pileup, calls);
+}
+
+void PileupAugmenter::call_node_pileups(const vector<const NodePileup*>& pileups) {
+
+    // Most nodes are too short to split over threads, so give each thread
+    // whole nodes instead
+    vector<NodeCalls> calls(pileups.size());
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < pileups.size(); ++i) {
+        const Node* node = _graph->get_node(pileups[i]->node_id());
+        assert(node != NULL);
+        assert(node->sequence().length() == pileups[i]->base_pileup_size());
+        init_node_calls(node, calls[i]);
+        for (int j = 0; j < pileups[i]->base_pileup_size(); ++j) {
+            call_base(*pileups[i], j, calls[i]);
         }
-        int pileup_depth = max(num_inserts, pileup.base_pileup(i).num_bases() - num_inserts);
-        if (pileup_depth >= 1) {
-            call_base_pileup(pileup, i, false);
-            call_base_pileup(pileup, i, true);
+    }
+
+    // Making new nodes takes IDs in order, so this part has to be serial
+    for (size_t i = 0; i < pileups.size(); ++i) {
+        add_node_calls(*pileups[i], calls[i]);
+    }
+}
+
+void PileupAugmenter::init_node_calls(const Node* node, NodeCalls& calls) {
+    string def_char = "-";
+    calls.node_calls.assign(node->sequence().length(), Genotype(def_char, def_char));
+    calls.insert_calls.assign(node->sequence().length(), Genotype(def_char, def_char));
+    calls.node_supports.assign(node->sequence().length(), make_pair(
+                                   StrandSupport(), StrandSupport()));
+    calls.insert_supports.assign(node->sequence().length(), make_pair(
+                                     StrandSupport(), StrandSupport()));
+}
+
+void PileupAugmenter::call_base(const NodePileup& np, int64_t offset, NodeCalls& calls) {
+    int num_inserts = 0;
+    for (auto b : np.base_pileup(offset).bases()) {
+        if (b == '+') {
+            ++num_inserts;
         }
     }
+    int pileup_depth = max(num_inserts, np.base_pileup(offset).num_bases() - num_inserts);
+    if (pileup_depth >= 1) {
+        call_base_pileup(np, offset, false, calls);
+        call_base_pileup(np, offset, true, calls);
+    }
+}
+
+void PileupAugmenter::add_node_calls(const NodePileup& np, NodeCalls& calls) {
+    _node = _graph->get_node(np.node_id());
+    swap(_node_calls, calls.node_calls);
+    swap(_insert_calls, calls.insert_calls);
+    swap(_node_supports, calls.node_supports);
+    swap(_insert_supports, calls.insert_supports);
 
     // add nodes and edges created when making calls to the output graph
     // (_side_map gets updated)
-    create_node_calls(pileup);
+    create_node_calls(np);
 
     _visited_nodes.insert(_node->id());
 }
@@ -451,7 +488,7 @@ void PileupAugmenter::create_augmented_edge(Node* node1, int from_offset, bool l
     }
 }
 
-void PileupAugmenter::call_base_pileup(const NodePileup& np, int64_t offset, bool insertion) {
+void PileupAugmenter::call_base_pileup(const NodePileup& np, int64_t offset, bool insertion, NodeCalls& calls) {
     const BasePileup& bp = np.base_pileup(offset);
 
     // parse the pilueup structure
@@ -474,8 +511,8 @@ void PileupAugmenter::call_base_pileup(const NodePileup& np, int64_t offset, boo
     string ref_base = string(1, ::toupper(bp.ref_base()));
 
     // get references to node-level members we want to update
-    Genotype& base_call = insertion ? _insert_calls[offset] : _node_calls[offset];
-    pair<StrandSupport, StrandSupport>& support = insertion ? _insert_supports[offset] : _node_supports[offset];
+    Genotype& base_call = insertion ? calls.insert_calls[offset] : calls.node_calls[offset];
+    pair<StrandSupport, StrandSupport>& support = insertion ? calls.insert_supports[offset] : calls.node_supports[offset];
 
     if (top_count >= _min_aug_support || (top_base == ref_base && top_count > 0)) {
         base_call.first = top_base != ref_base ? top_base : ".";
@@ -899,9 +936,11 @@ void PileupAugmenter::create_node_calls(const NodePileup& np) {
 
 void PileupAugmenter::annotate_augmented_node(Node* node, char call, StrandSupport support, int64_t orig_id, int orig_offset)
 {
-    _augmented_graph.node_supports[node].set_forward(support.fs);
-    _augmented_graph.node_supports[node].set_reverse(support.rs);
-    _augmented_graph.node_supports[node].set_quality(support.qual);
+    Support node_support;
+    node_support.set_forward(support.fs);
+    node_support.set_reverse(support.rs);
+    node_support.set_quality(support.qual);
+    _augmented_graph.set_support(node, node_support);
     
     if (orig_id != 0 && call != 'S' && call != 'I') {
         // Add translations for preserved parts
@@ -924,9 +963,11 @@ void PileupAugmenter::annotate_augmented_node(Node* node, char call, StrandSuppo
 
 void PileupAugmenter::annotate_augmented_edge(Edge* edge, char call, StrandSupport support)
 {
-    _augmented_graph.edge_supports[edge].set_forward(support.fs);
-    _augmented_graph.edge_supports[edge].set_reverse(support.rs);
-    _augmented_graph.edge_supports[edge].set_quality(support.qual);
+    Support edge_support;
+    edge_support.set_forward(support.fs);
+    edge_support.set_reverse(support.rs);
+    edge_support.set_quality(support.qual);
+    _augmented_graph.set_support(edge, edge_support);
 }
 
 void PileupAugmenter::annotate_augmented_nodes()
@@ -233,6 +233,11 @@ public:
     // call every position in the node pileup
     void call_node_pileup(const NodePileup& pileup);
 
+    // call a batch of node pileups, calling the bases of different nodes in
+    // parallel, and adding their calls to the augmented graph in order (so the
+    // result is identical to calling them one at a time)
+    void call_node_pileups(const vector<const NodePileup*>& pileups);
+
     // call an edge.  remembering it in a table for the whole graph
     void call_edge_pileup(const EdgePileup& pileup);
 
@@ -257,9 +262,26 @@ public:
     // make sure mapped paths generate same strings as input paths
     void verify_path(const Path& in_path, const list<mapping_t>& call_path);
     
+    // per-base calls and supports for one node, before they go into the graph
+    struct NodeCalls {
+        vector<Genotype> node_calls;
+        vector<pair<StrandSupport, StrandSupport> > node_supports;
+        vector<Genotype> insert_calls;
+        vector<pair<StrandSupport, StrandSupport> > insert_supports;
+    };
+
+    // size calls for the node and set them all to missing
+    void init_node_calls(const Node* node, NodeCalls& calls);
+
+    // call the base (and the insertion after it) at offset, if it has coverage
+    void call_base(const NodePileup& np, int64_t offset, NodeCalls& calls);
+
+    // make calls the current node's, and add them to the augmented graph
+    void add_node_calls(const NodePileup& np, NodeCalls& calls);
+    
     // call position at given base
     // if insertion flag set to true, call insertion between base and next base
-    void call_base_pileup(const NodePileup& np, int64_t offset, bool insertions);
+    void call_base_pileup(const NodePileup& np, int64_t offset, bool insertions, NodeCalls& calls);
     
     // Find the top-two bases in a pileup, along with their counts
     // Last param toggles whether we consider only inserts or everything else
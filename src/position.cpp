@@ -13,6 +13,10 @@ pos_t make_pos_t(id_t id, bool is_rev, off_t off) {
 pos_t make_pos_t(gcsa::node_type node) {
     return make_tuple(gcsa::Node::id(node), gcsa::Node::rc(node), gcsa::Node::offset(node));
 }
+
+gcsa::node_type make_gcsa_node(const pos_t& pos) {
+    return gcsa::Node::encode(id(pos), offset(pos), is_rev(pos));
+}
     
 Position make_position(const pos_t& pos) {
     Position p;
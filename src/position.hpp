@@ -42,6 +42,8 @@ pos_t make_pos_t(const Position& pos);
 pos_t make_pos_t(id_t id, bool is_rev, off_t off);
 /// Create a pos_t from a gcsa node
 pos_t make_pos_t(gcsa::node_type node);
+/// Pack a pos_t into a gcsa node. The offset must fit in a gcsa node's offset.
+gcsa::node_type make_gcsa_node(const pos_t& pos);
 /// Convert a pos_t to a Position.
 Position make_position(const pos_t& pos);
 /// Create a Position from a Node ID, an orientation flag, and an offset.
@@ -0,0 +1,116 @@
+#include "prefetch_stream.hpp"
+
+namespace stream {
+
+using namespace std;
+
+PrefetchInputStream::PrefetchInputStream(::google::protobuf::io::ZeroCopyInputStream* source,
+                                         size_t block_size, size_t max_blocks) :
+    source(source), block_size(block_size), max_blocks(max(max_blocks, (size_t) 1)) {
+    
+    // Start the reader only once everything it uses is initialized
+    reader = thread(&PrefetchInputStream::fill, this);
+}
+
+PrefetchInputStream::~PrefetchInputStream() {
+    {
+        lock_guard<mutex> guard(queue_lock);
+        stopping = true;
+    }
+    queue_not_full.notify_all();
+    reader.join();
+}
+
+void PrefetchInputStream::fill() {
+    try {
+        string block;
+        block.reserve(block_size);
+        
+        const void* data;
+        int size;
+        bool more = true;
+        while (more) {
+            more = source->Next(&data, &size);
+            if (more) {
+                block.append((const char*) data, size);
+            }
+            
+            if (block.size() >= block_size || (!more && !block.empty())) {
+                // Hand off the block, waiting for room if the consumer is behind
+                unique_lock<mutex> guard(queue_lock);
+                queue_not_full.wait(guard, [&]() { return stopping || ready_blocks.size() < max_blocks; });
+                if (stopping) {
+                    return;
+                }
+                ready_blocks.emplace_back(move(block));
+                guard.unlock();
+                queue_not_empty.notify_one();
+                
+                block = string();
+                block.reserve(block_size);
+            }
+        }
+    } catch (...) {
+        lock_guard<mutex> guard(queue_lock);
+        reader_error = current_exception();
+    }
+    
+    {
+        lock_guard<mutex> guard(queue_lock);
+        source_done = true;
+    }
+    queue_not_empty.notify_one();
+}
+
+bool PrefetchInputStream::Next(const void** data, int* size) {
+    if (current_offset == current_block.size()) {
+        // We need a new block
+        unique_lock<mutex> guard(queue_lock);
+        queue_not_empty.wait(guard, [&]() { return source_done || !ready_blocks.empty(); });
+        if (ready_blocks.empty()) {
+            // The source is exhausted
+            if (reader_error) {
+                rethrow_exception(reader_error);
+            }
+            return false;
+        }
+        current_block = move(ready_blocks.front());
+        ready_blocks.pop_front();
+        current_offset = 0;
+        guard.unlock();
+        queue_not_full.notify_one();
+    }
+    
+    *data = current_block.data() + current_offset;
+    *size = current_block.size() - current_offset;
+    bytes_read += *size;
+    current_offset = current_block.size();
+    return true;
+}
+
+void PrefetchInputStream::BackUp(int count) {
+    current_offset -= count;
+    bytes_read -= count;
+}
+
+bool PrefetchInputStream::Skip(int count) {
+    const void* data;
+    int size;
+    while (count > 0) {
+        if (!Next(&data, &size)) {
+            return false;
+        }
+        if (size > count) {
+            BackUp(size - count);
+            size = count;
+        }
+        count -= size;
+    }
+    return true;
+}
+
+::google::protobuf::int64 PrefetchInputStream::ByteCount() const {
+    return bytes_read;
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef VG_PREFETCH_STREAM_HPP_INCLUDED
+#define VG_PREFETCH_STREAM_HPP_INCLUDED
+
+/**
+ * \file prefetch_stream.hpp
+ *
+ * A ZeroCopyInputStream that pulls data from another ZeroCopyInputStream on a
+ * background thread, so that expensive work done by the source (like
+ * inflating gzip data) overlaps with whatever the consumer does with the
+ * bytes (like splitting and parsing Protobuf messages).
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "google/protobuf/io/zero_copy_stream.h"
+
+namespace stream {
+
+class PrefetchInputStream : public ::google::protobuf::io::ZeroCopyInputStream {
+public:
+    /// Start reading ahead from the given source, which must not be used by
+    /// anyone else until this object is destroyed. Data is handed over in
+    /// blocks of about block_size bytes, and at most max_blocks blocks are
+    /// buffered ahead of the consumer.
+    PrefetchInputStream(::google::protobuf::io::ZeroCopyInputStream* source,
+                        size_t block_size = 1 << 20, size_t max_blocks = 16);
+    
+    /// Stop the background reader and wait for it to finish.
+    ~PrefetchInputStream();
+    
+    // We own a thread, so we can't be copied.
+    PrefetchInputStream(const PrefetchInputStream& other) = delete;
+    PrefetchInputStream& operator=(const PrefetchInputStream& other) = delete;
+    
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    ::google::protobuf::int64 ByteCount() const override;
+    
+private:
+    /// Body of the background thread: read blocks from the source into the
+    /// queue until the source runs out or we are told to stop.
+    void fill();
+    
+    ::google::protobuf::io::ZeroCopyInputStream* source;
+    size_t block_size;
+    size_t max_blocks;
+    
+    /// Protects everything that is shared with the background thread.
+    std::mutex queue_lock;
+    /// Signaled when a block is added or the source runs out.
+    std::condition_variable queue_not_empty;
+    /// Signaled when a block is removed or we want the reader to stop.
+    std::condition_variable queue_not_full;
+    std::deque<std::string> ready_blocks;
+    bool source_done = false;
+    bool stopping = false;
+    /// Set if the background thread hit an exception, to be rethrown to the
+    /// consumer.
+    std::exception_ptr reader_error;
+    
+    /// The block the consumer is currently looking at.
+    std::string current_block;
+    /// How much of current_block has been handed out.
+    size_t current_offset = 0;
+    /// Total bytes handed out and not backed up.
+    ::google::protobuf::int64 bytes_read = 0;
+    
+    std::thread reader;
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "progressive.hpp"
+#include "metrics_reporter.hpp"
 
 #include <iostream>
 
@@ -7,13 +8,14 @@ namespace vg {
 using namespace std;
 
 void Progressive::create_progress(const string& message, long count) {
-    if (show_progress) {
+    if (show_progress || MetricsReporter::enabled()) {
         progress_message = message;
         create_progress(count);
     }
 }
 
 void Progressive::create_progress(long count) {
+    MetricsReporter::begin_task(progress_message, count);
     if (show_progress) {
         progress_count = count;
         last_progress = 0;
@@ -29,7 +31,7 @@ void Progressive::create_progress(long count) {
 }
 
 void Progressive::preload_progress(const string& message) {
-    if (show_progress && !progress) {
+    if ((show_progress || MetricsReporter::enabled()) && !progress) {
         // Set the message. We can't change it if a progress bar exists
         // currently because that progress bar has a pointer to the old
         // message's data.
@@ -38,6 +40,7 @@ void Progressive::preload_progress(const string& message) {
 }
 
 void Progressive::update_progress(long i) {
+    MetricsReporter::set_task_progress(i);
     if (show_progress && progress) {
         if ((i <= progress_count
              && (long double) (i - last_progress) / (long double) progress_count >= 0.001)
@@ -57,6 +60,7 @@ void Progressive::update_progress(long i) {
 }
 
 void Progressive::increment_progress() {
+    MetricsReporter::advance_task(1);
 #pragma omp critical (increment_progress)
     {
         // Only one increment can happen at a time, so we don't get lower values
@@ -83,6 +87,7 @@ void Progressive::increment_progress() {
 }
 
 void Progressive::destroy_progress(void) {
+    MetricsReporter::end_task();
     if (show_progress && progress) {
         update_progress(progress_count);
         cerr << endl;
@@ -17,6 +17,9 @@ using namespace std;
  * update_progress(), and destroy_progress() methods, and a public show_progress
  * field that can be toggled on and off.
  *
+ * Tasks and their progress are also fed to the MetricsReporter, whether or
+ * not progress bars are shown.
+ *
  * Must not be destroyed while a progress bar is active.
  */
 class Progressive {
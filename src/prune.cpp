@@ -1,4 +1,7 @@
 #include "prune.hpp"
+#include "algorithms/weakly_connected_components.hpp"
+
+#include <stack>
 
 namespace vg {
 
@@ -7,24 +10,78 @@ vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t ed
     //unordered_set<edge_t> edges_to_prune;
     vector<vector<edge_t> > edges_to_prune;
     edges_to_prune.resize(get_thread_count());
+    // Walks multiply at every fork, so strands in dense regions take by far
+    // the longest. Hand them out first, one strand at a time.
+    vector<pair<size_t, handle_t>> work;
     graph.for_each_handle([&](const handle_t& h) {
-            // for the forward and reverse of this handle
-            // walk k bases from the end, so that any kmer starting on the node will be represented in the tree we build
-            for (auto handle_is_rev : { false, true }) {
-                //cerr << "###########################################" << endl;
-                handle_t handle = handle_is_rev ? graph.flip(h) : h;
-                list<walk_t> walks;
-                // for each position in the node, set up a kmer with that start position and the node end or kmer length as the end position
-                // determine next positions
-                id_t handle_id = graph.get_id(handle);
-                size_t handle_length = graph.get_length(handle);
-                string handle_seq = graph.get_sequence(handle);
-                for (size_t i = 0; i < handle_length;  ++i) {
-                    pos_t begin = make_pos_t(handle_id, handle_is_rev, handle_length);
-                    pos_t end = make_pos_t(handle_id, handle_is_rev, min(handle_length, i+k));
-                    walk_t walk = walk_t(offset(end)-offset(begin), begin, end, handle, 0);
+            for (auto handle : { h, graph.flip(h) }) {
+                size_t branching = 1;
+                graph.follow_edges(handle, false, [&](const handle_t& next) {
+                        branching++;
+                        graph.follow_edges(next, false, [&](const handle_t& after) {
+                                branching++;
+                            });
+                    });
+                work.emplace_back(branching, handle);
+            }
+        });
+    stable_sort(work.begin(), work.end(), [](const pair<size_t, handle_t>& a, const pair<size_t, handle_t>& b) {
+            return a.first > b.first;
+        });
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t w = 0; w < work.size(); ++w) {
+        // walk k bases from the end, so that any kmer starting on the node will be represented in the tree we build
+        handle_t handle = work[w].second;
+        bool handle_is_rev = graph.get_is_reverse(handle);
+        list<walk_t> walks;
+        // for each position in the node, set up a kmer with that start position and the node end or kmer length as the end position
+        // determine next positions
+        id_t handle_id = graph.get_id(handle);
+        size_t handle_length = graph.get_length(handle);
+        string handle_seq = graph.get_sequence(handle);
+        for (size_t i = 0; i < handle_length;  ++i) {
+            pos_t begin = make_pos_t(handle_id, handle_is_rev, handle_length);
+            pos_t end = make_pos_t(handle_id, handle_is_rev, min(handle_length, i+k));
+            walk_t walk = walk_t(offset(end)-offset(begin), begin, end, handle, 0);
+            if (walk.length < k) {
+                // are we branching over more than one edge?
+                size_t next_count = 0;
+                graph.follow_edges(walk.curr, false, [&](const handle_t& next) { ++next_count; });
+                graph.follow_edges(walk.curr, false, [&](const handle_t& next) {
+                        if (next_count > 1 && edge_max == walk.forks) { // our next step takes us over the max
+                            int tid = omp_get_thread_num();
+                            edges_to_prune[tid].push_back(graph.edge_handle(walk.curr, next));
+                        } else {
+                            walks.push_back(walk);
+                            auto& todo = walks.back();
+                            todo.curr = next;
+                            if (next_count > 1) {
+                                ++todo.forks;
+                            }
+                        }
+                    });
+            } else {
+                walks.push_back(walk);
+            }
+        }
+        // now expand the kmers until they reach k
+        while (!walks.empty()) {
+            // first we check which ones have reached length k in the current handle; for each of these we run lambda and remove them from our list
+            auto walks_end = walks.end();
+            for (list<walk_t>::iterator q = walks.begin(); q != walks_end; ++q) {
+                auto& walk = *q;
+                // did we reach our target length?
+                if (walk.length >= k) {
+                    q = walks.erase(q);
+                } else {
+                    id_t curr_id = graph.get_id(walk.curr);
+                    size_t curr_length = graph.get_length(walk.curr);
+                    bool curr_is_rev = graph.get_is_reverse(walk.curr);
+                    size_t take = min(curr_length, k-walk.length);
+                    walk.end = make_pos_t(curr_id, curr_is_rev, take);
+                    walk.length += take;
                     if (walk.length < k) {
-                        // are we branching over more than one edge?
+                        // if not, we need to expand through the node then follow on
                         size_t next_count = 0;
                         graph.follow_edges(walk.curr, false, [&](const handle_t& next) { ++next_count; });
                         graph.follow_edges(walk.curr, false, [&](const handle_t& next) {
@@ -40,52 +97,14 @@ vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t ed
                                     }
                                 }
                             });
+                        q = walks.erase(q);
                     } else {
-                        walks.push_back(walk);
-                    }
-                }
-                // now expand the kmers until they reach k
-                while (!walks.empty()) {
-                    // first we check which ones have reached length k in the current handle; for each of these we run lambda and remove them from our list
-                    auto walks_end = walks.end();
-                    for (list<walk_t>::iterator q = walks.begin(); q != walks_end; ++q) {
-                        auto& walk = *q;
-                        // did we reach our target length?
-                        if (walk.length >= k) {
-                            q = walks.erase(q);
-                        } else {
-                            id_t curr_id = graph.get_id(walk.curr);
-                            size_t curr_length = graph.get_length(walk.curr);
-                            bool curr_is_rev = graph.get_is_reverse(walk.curr);
-                            size_t take = min(curr_length, k-walk.length);
-                            walk.end = make_pos_t(curr_id, curr_is_rev, take);
-                            walk.length += take;
-                            if (walk.length < k) {
-                                // if not, we need to expand through the node then follow on
-                                size_t next_count = 0;
-                                graph.follow_edges(walk.curr, false, [&](const handle_t& next) { ++next_count; });
-                                graph.follow_edges(walk.curr, false, [&](const handle_t& next) {
-                                        if (next_count > 1 && edge_max == walk.forks) { // our next step takes us over the max
-                                            int tid = omp_get_thread_num();
-                                            edges_to_prune[tid].push_back(graph.edge_handle(walk.curr, next));
-                                        } else {
-                                            walks.push_back(walk);
-                                            auto& todo = walks.back();
-                                            todo.curr = next;
-                                            if (next_count > 1) {
-                                                ++todo.forks;
-                                            }
-                                        }
-                                    });
-                                q = walks.erase(q);
-                            } else {
-                                // nothing, we'll remove it next time around
-                            }
-                        }
+                        // nothing, we'll remove it next time around
                     }
                 }
             }
-        }, true);
+        }
+    }
     uint64_t total_edges = 0;
     for (auto& v : edges_to_prune) total_edges += v.size();
     vector<edge_t> merged; merged.reserve(total_edges);
@@ -96,5 +115,106 @@ vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t ed
     return merged;
 }
 
+void prune_complex_with_head_tail(MutableHandleGraph& graph, size_t k, size_t edge_max) {
+    // Find the ends before we add the markers, so they don't count as ends
+    id_t max_id = 0;
+    vector<handle_t> heads, tails;
+    unordered_set<id_t> attached;
+    graph.for_each_handle([&](const handle_t& handle) {
+        max_id = max(max_id, graph.get_id(handle));
+        if (graph.get_degree(handle, true) == 0) {
+            heads.push_back(handle);
+            attached.insert(graph.get_id(handle));
+        }
+        if (graph.get_degree(handle, false) == 0) {
+            tails.push_back(handle);
+            attached.insert(graph.get_id(handle));
+        }
+    });
+    
+    // Components with no ends would have no way in, so break each one open at
+    // its lowest node ID. That node's predecessors lead to the end marker instead.
+    vector<handle_t> breaks;
+    for (auto& component : algorithms::weakly_connected_components(&graph)) {
+        bool has_end = false;
+        id_t lowest = numeric_limits<id_t>::max();
+        for (id_t id : component) {
+            has_end = has_end || attached.count(id);
+            lowest = min(lowest, id);
+        }
+        if (!has_end) {
+            breaks.push_back(graph.get_handle(lowest));
+        }
+    }
+    
+    handle_t head_marker = graph.create_handle(string(k, '#'), max_id + 1);
+    handle_t tail_marker = graph.create_handle(string(k, '$'), max_id + 2);
+    for (const handle_t& head : heads) {
+        graph.create_edge(head_marker, head);
+    }
+    for (const handle_t& tail : tails) {
+        graph.create_edge(tail, tail_marker);
+    }
+    for (const handle_t& to_break : breaks) {
+        vector<handle_t> predecessors;
+        graph.get_neighbors(to_break, true, predecessors);
+        graph.create_edge(head_marker, to_break);
+        for (const handle_t& predecessor : predecessors) {
+            graph.create_edge(predecessor, tail_marker);
+        }
+    }
+    
+    for (auto& edge : find_edges_to_prune(graph, k, edge_max)) {
+        graph.destroy_edge(edge.first, edge.second);
+    }
+    
+    graph.destroy_handle(head_marker);
+    graph.destroy_handle(tail_marker);
+}
+
+void prune_short_subgraphs(MutableHandleGraph& graph, size_t min_size) {
+    
+    // Find the head nodes.
+    vector<id_t> heads;
+    graph.for_each_handle([&](const handle_t& handle) {
+        if (graph.get_degree(handle, true) == 0) {
+            heads.push_back(graph.get_id(handle));
+        }
+    });
+    
+    // Nodes we have already destroyed, as the graph may not be able to tell us
+    unordered_set<id_t> destroyed;
+    for (id_t head : heads) {
+        if (destroyed.count(head)) {
+            continue;   // Already pruned.
+        }
+        
+        // Explore the neighborhood until the component is too large.
+        handle_t head_handle = graph.get_handle(head);
+        size_t subgraph_size = graph.get_length(head_handle);
+        stack<handle_t> to_check; to_check.push(head_handle);
+        unordered_set<id_t> subgraph { head };
+        while (subgraph_size < min_size && !to_check.empty()) {
+            handle_t curr = to_check.top(); to_check.pop();
+            for (bool go_left : {false, true}) {
+                graph.follow_edges(curr, go_left, [&](const handle_t& next) {
+                    if (!subgraph.count(graph.get_id(next))) {
+                        subgraph_size += graph.get_length(next);
+                        subgraph.insert(graph.get_id(next));
+                        to_check.push(graph.forward(next));
+                    }
+                });
+            }
+        }
+        
+        // Destroy the component if it was small enough.
+        if (subgraph_size < min_size) {
+            for (id_t node : subgraph) {
+                graph.destroy_handle(graph.get_handle(node));
+                destroyed.insert(node);
+            }
+        }
+    }
+}
 
 }
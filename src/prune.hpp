@@ -34,6 +34,15 @@ struct walk_t {
 /// Iterate over all the walks up to length k, adding edges which 
 vector<edge_t> find_edges_to_prune(const HandleGraph& graph, size_t k, size_t edge_max);
 
+/// Remove the edges found by find_edges_to_prune(). First the heads and tails
+/// of the graph, and a node in each component that has neither, are attached
+/// to temporary k-base start and end nodes, so that the walks off the ends of
+/// the graph are counted too. The temporary nodes are removed afterward.
+void prune_complex_with_head_tail(MutableHandleGraph& graph, size_t k, size_t edge_max);
+
+/// Remove the components with fewer than min_size bases that have a head node.
+void prune_short_subgraphs(MutableHandleGraph& graph, size_t min_size);
+
 }
 
 #endif
@@ -0,0 +1,274 @@
+#include "read_ahead_stream.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * \file read_ahead_stream.cpp
+ * Implementations for read-ahead file input.
+ */
+
+namespace vg {
+
+using namespace std;
+
+const char* ReadAheadBuffer::BLOCK_SIZE_VARIABLE = "VG_READ_AHEAD_BLOCK_SIZE";
+const char* ReadAheadBuffer::DEPTH_VARIABLE = "VG_READ_AHEAD_DEPTH";
+
+/// Get a positive number from an environment variable, or the default
+static size_t size_from_environment(const char* variable, size_t default_value) {
+    const char* value = getenv(variable);
+    if (value != nullptr && atoll(value) > 0) {
+        return atoll(value);
+    }
+    return default_value;
+}
+
+size_t ReadAheadBuffer::default_block_size() {
+    static size_t block_size = size_from_environment(BLOCK_SIZE_VARIABLE, 4 * 1024 * 1024);
+    return block_size;
+}
+
+size_t ReadAheadBuffer::default_depth() {
+    static size_t depth = size_from_environment(DEPTH_VARIABLE, 4);
+    return depth;
+}
+
+ReadAheadBuffer::ReadAheadBuffer(const string& filename, size_t block_size, size_t depth) :
+    depth(max<size_t>(depth, 1)) {
+
+    // Whole pages keep every read aligned
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    this->block_size = max<size_t>((block_size + page_size - 1) / page_size, 1) * page_size;
+
+    fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+    // A hint only, so it doesn't matter if the file can't take it
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    start(0);
+}
+
+ReadAheadBuffer::~ReadAheadBuffer() {
+    if (fd != -1) {
+        stop();
+        close(fd);
+    }
+}
+
+bool ReadAheadBuffer::is_open() const {
+    return fd != -1;
+}
+
+void ReadAheadBuffer::start(size_t offset) {
+    current_offset = offset - offset % block_size;
+    pending_skip = offset - current_offset;
+    next_read_offset = current_offset;
+    reader_done = false;
+    stopping = false;
+    reader_error = nullptr;
+    reader = thread(&ReadAheadBuffer::read_ahead, this);
+}
+
+void ReadAheadBuffer::stop() {
+    {
+        lock_guard<mutex> guard(queue_lock);
+        stopping = true;
+    }
+    queue_not_full.notify_all();
+    reader.join();
+
+    // Keep the memory of everything we drop, for when we start again
+    for (auto& block : ready_blocks) {
+        free_blocks.emplace_back(move(block));
+    }
+    ready_blocks.clear();
+    if (current_block.capacity() > 0) {
+        free_blocks.emplace_back(move(current_block));
+        current_block = vector<char>();
+    }
+    setg(nullptr, nullptr, nullptr);
+}
+
+void ReadAheadBuffer::read_ahead() {
+    try {
+        while (true) {
+            vector<char> block;
+            size_t offset;
+            {
+                // Wait for room to read another block
+                unique_lock<mutex> guard(queue_lock);
+                queue_not_full.wait(guard, [&]() { return stopping || ready_blocks.size() < depth; });
+                if (stopping) {
+                    return;
+                }
+                if (!free_blocks.empty()) {
+                    block = move(free_blocks.back());
+                    free_blocks.pop_back();
+                }
+                offset = next_read_offset;
+                next_read_offset += block_size;
+            }
+
+            // Ask the kernel to start on the blocks after this one
+            posix_fadvise(fd, offset + block_size, block_size * depth, POSIX_FADV_WILLNEED);
+
+            block.resize(block_size);
+            size_t filled = 0;
+            while (filled < block_size) {
+                ssize_t got = pread(fd, block.data() + filled, block_size - filled, offset + filled);
+                if (got < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw runtime_error("[ReadAheadBuffer] could not read file: " + string(strerror(errno)));
+                }
+                if (got == 0) {
+                    break;
+                }
+                filled += got;
+            }
+            block.resize(filled);
+            // A short block means we hit the end of the file
+            bool last = filled < block_size;
+
+            {
+                lock_guard<mutex> guard(queue_lock);
+                if (stopping) {
+                    return;
+                }
+                if (filled > 0) {
+                    ready_blocks.emplace_back(move(block));
+                }
+                reader_done = last;
+            }
+            queue_not_empty.notify_one();
+            if (last) {
+                return;
+            }
+        }
+    } catch (...) {
+        {
+            lock_guard<mutex> guard(queue_lock);
+            reader_error = current_exception();
+            reader_done = true;
+        }
+        queue_not_empty.notify_one();
+    }
+}
+
+ReadAheadBuffer::int_type ReadAheadBuffer::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (fd == -1) {
+        return traits_type::eof();
+    }
+
+    unique_lock<mutex> guard(queue_lock);
+    while (true) {
+        if (eback() != nullptr) {
+            // We're done with the current block
+            current_offset += current_block.size();
+            free_blocks.emplace_back(move(current_block));
+            current_block = vector<char>();
+            setg(nullptr, nullptr, nullptr);
+        }
+
+        queue_not_empty.wait(guard, [&]() { return reader_done || !ready_blocks.empty(); });
+        if (ready_blocks.empty()) {
+            // The reader has finished
+            if (reader_error) {
+                rethrow_exception(reader_error);
+            }
+            return traits_type::eof();
+        }
+        current_block = move(ready_blocks.front());
+        ready_blocks.pop_front();
+        queue_not_full.notify_one();
+
+        char* data = current_block.data();
+        size_t skip = min(pending_skip, current_block.size());
+        pending_skip -= skip;
+        setg(data, data + skip, data + current_block.size());
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        // We seeked past the end of this block, so try the next one
+    }
+}
+
+ReadAheadBuffer::pos_type ReadAheadBuffer::seekoff(off_type off, ios_base::seekdir dir,
+                                                   ios_base::openmode which) {
+    if (fd == -1 || !(which & ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+
+    off_type position = current_offset + (eback() != nullptr ? gptr() - eback() : pending_skip);
+    off_type target;
+    switch (dir) {
+    case ios_base::beg:
+        target = off;
+        break;
+    case ios_base::cur:
+        target = position + off;
+        break;
+    case ios_base::end:
+        {
+            struct stat file_stats;
+            if (fstat(fd, &file_stats) == -1) {
+                return pos_type(off_type(-1));
+            }
+            target = file_stats.st_size + off;
+        }
+        break;
+    default:
+        return pos_type(off_type(-1));
+    }
+
+    if (target < 0) {
+        return pos_type(off_type(-1));
+    }
+    if (target == position) {
+        // Nothing to do, which is what tellg() asks for
+        return pos_type(target);
+    }
+    if (eback() != nullptr && target >= (off_type) current_offset
+        && target <= (off_type) (current_offset + (egptr() - eback()))) {
+        // Move around in the block we have
+        setg(eback(), eback() + (target - current_offset), egptr());
+        return pos_type(target);
+    }
+
+    // Start reading ahead again from the new place
+    stop();
+    start(target);
+    return pos_type(target);
+}
+
+ReadAheadBuffer::pos_type ReadAheadBuffer::seekpos(pos_type pos, ios_base::openmode which) {
+    return seekoff(off_type(pos), ios_base::beg, which);
+}
+
+ReadAheadFileStream::ReadAheadFileStream(const string& filename, size_t block_size, size_t depth) :
+    istream(nullptr), buffer(filename, block_size, depth) {
+    if (buffer.is_open()) {
+        rdbuf(&buffer);
+    } else {
+        // Behave like an ifstream that failed to open
+        setstate(ios_base::failbit);
+    }
+}
+
+bool ReadAheadFileStream::is_open() const {
+    return buffer.is_open();
+}
+
+}
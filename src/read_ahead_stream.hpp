@@ -0,0 +1,135 @@
+#ifndef VG_READ_AHEAD_STREAM_HPP_INCLUDED
+#define VG_READ_AHEAD_STREAM_HPP_INCLUDED
+
+/**
+ * \file read_ahead_stream.hpp
+ *
+ * Asynchronous read-ahead file input for streaming consumers. A background
+ * thread reads the file in large, block-aligned pieces a few blocks ahead of
+ * the reader, and tells the kernel the file will be read sequentially. On
+ * filesystems where every small synchronous read costs a round trip, like
+ * network filesystems, this keeps GAM, VG and pack streaming near the
+ * bandwidth the storage can deliver. The stream still looks like any other
+ * istream, so protobuf's IstreamInputStream can read from it unchanged.
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A streambuf over a file that is read ahead on a background thread. Reads
+ * are made with pread() at multiples of the block size. Seeking within the
+ * current block is free, and seeking anywhere else restarts the read-ahead
+ * from there.
+ */
+class ReadAheadBuffer : public streambuf {
+public:
+
+    /// Environment variable giving the bytes to read at a time
+    static const char* BLOCK_SIZE_VARIABLE;
+    /// Environment variable giving the number of blocks to read ahead
+    static const char* DEPTH_VARIABLE;
+
+    /// Get the block size to use when none is given: the value of the block
+    /// size environment variable, or 4 MB.
+    static size_t default_block_size();
+
+    /// Get the read-ahead depth to use when none is given: the value of the
+    /// depth environment variable, or 4.
+    static size_t default_depth();
+
+    /// Open the given file and start reading ahead up to depth blocks of
+    /// block_size bytes, rounded up to a whole number of pages. Check
+    /// is_open() to see if it worked.
+    ReadAheadBuffer(const string& filename, size_t block_size = default_block_size(),
+                    size_t depth = default_depth());
+
+    /// Stop the background reader and close the file.
+    ~ReadAheadBuffer();
+
+    // We own a thread and a file, so we can't be copied.
+    ReadAheadBuffer(const ReadAheadBuffer& other) = delete;
+    ReadAheadBuffer& operator=(const ReadAheadBuffer& other) = delete;
+
+    /// Return true if the file was opened.
+    bool is_open() const;
+
+protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, ios_base::seekdir dir,
+                     ios_base::openmode which = ios_base::in) override;
+    pos_type seekpos(pos_type pos, ios_base::openmode which = ios_base::in) override;
+
+private:
+
+    /// Start the background reader at the block holding the given offset.
+    void start(size_t offset);
+
+    /// Stop the background reader and drop everything it read.
+    void stop();
+
+    /// Body of the background thread: read blocks from next_read_offset
+    /// until the end of the file, staying at most depth blocks ahead.
+    void read_ahead();
+
+    int fd = -1;
+    size_t block_size;
+    size_t depth;
+
+    /// Protects everything shared with the background thread.
+    mutex queue_lock;
+    /// Signaled when a block is ready or the reader is done.
+    condition_variable queue_not_empty;
+    /// Signaled when a block is used up or the reader should stop.
+    condition_variable queue_not_full;
+    deque<vector<char>> ready_blocks;
+    /// Used up blocks, kept to be filled again without reallocating.
+    vector<vector<char>> free_blocks;
+    size_t next_read_offset = 0;
+    bool reader_done = false;
+    bool stopping = false;
+    /// Set if the background thread failed to read, to be rethrown to the
+    /// consumer.
+    exception_ptr reader_error;
+    thread reader;
+
+    /// The block the get area is in.
+    vector<char> current_block;
+    /// File offset of the start of current_block, or of the block we are
+    /// waiting for.
+    size_t current_offset = 0;
+    /// Bytes to skip at the start of the next block, after a seek into the
+    /// middle of it.
+    size_t pending_skip = 0;
+};
+
+/**
+ * An istream that reads a file through a ReadAheadBuffer. Can be used
+ * anywhere an ifstream is used for reading.
+ */
+class ReadAheadFileStream : public istream {
+public:
+    ReadAheadFileStream(const string& filename, size_t block_size = ReadAheadBuffer::default_block_size(),
+                        size_t depth = ReadAheadBuffer::default_depth());
+
+    /// Return true if the file was opened.
+    bool is_open() const;
+
+private:
+    ReadAheadBuffer buffer;
+};
+
+}
+
+#endif
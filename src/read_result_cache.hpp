@@ -0,0 +1,188 @@
+#ifndef VG_READ_RESULT_CACHE_HPP_INCLUDED
+#define VG_READ_RESULT_CACHE_HPP_INCLUDED
+
+/**
+ * \file read_result_cache.hpp
+ *
+ * A cache of mapping results by read sequence that can be shared by all the
+ * threads in a process, so reads that are exact duplicates of each other
+ * (PCR and optical duplicates, or copies of a highly expressed transcript)
+ * are only mapped once. Like the SharedNodeCache, it is split into
+ * independently locked LRU shards.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Results of mapping reads, keyed by the read's sequence, its binned base
+ * qualities and the parameters it was mapped with. Result is the type of one
+ * alignment the mapper produces. The cache knows nothing about the settings
+ * of the mappers that use it, so it should only be shared by mappers that are
+ * configured the same way.
+ */
+template<typename Result>
+class ReadResultCache {
+public:
+    /// Make a cache holding the results of about capacity reads in total,
+    /// spread over up to the given number of independently locked shards.
+    /// Base qualities are compared in bins of the given width, so a width of
+    /// 1 only reuses results for reads with identical qualities.
+    ReadResultCache(size_t capacity, size_t quality_bin_width = 1, size_t shard_count = 64);
+
+    // We hold mutexes, so we can't be copied.
+    ReadResultCache(const ReadResultCache& other) = delete;
+    ReadResultCache& operator=(const ReadResultCache& other) = delete;
+
+    /// Make the key for a read with the given sequence and base qualities,
+    /// mapped with the given parameters. Pass empty qualities if the mapper
+    /// doesn't look at them.
+    string key(const string& sequence, const string& quality, const vector<int64_t>& params) const;
+
+    /// Copy the cached results for a key into results_out and return true,
+    /// or return false if there are none.
+    bool lookup(const string& key, vector<Result>& results_out);
+
+    /// Remember the results for a key, evicting the least recently used
+    /// results in its shard if it is full.
+    void store(const string& key, const vector<Result>& results);
+
+    /// Get the number of lookups that found results.
+    size_t hits() const;
+
+    /// Get the number of lookups that didn't.
+    size_t misses() const;
+
+    /// Print hit and miss counts to the given stream, for logging.
+    void report(ostream& out, const string& prefix = "") const;
+
+private:
+
+    typedef list<pair<string, shared_ptr<const vector<Result>>>> recency_list_t;
+
+    /// One independently locked LRU cache. Most recently used entries are at
+    /// the front of the recency list.
+    struct Shard {
+        mutex lock;
+        recency_list_t recency;
+        unordered_map<string, typename recency_list_t::iterator> entries;
+    };
+
+    /// Find the shard responsible for a key.
+    Shard& shard_for(const string& key);
+
+    vector<Shard> shards;
+    size_t shard_capacity;
+    size_t quality_bin_width;
+    atomic<size_t> hit_count;
+    atomic<size_t> miss_count;
+};
+
+template<typename Result>
+ReadResultCache<Result>::ReadResultCache(size_t capacity, size_t quality_bin_width, size_t shard_count) :
+    shards(max<size_t>(min(shard_count, capacity), 1)), quality_bin_width(max<size_t>(quality_bin_width, 1)),
+    hit_count(0), miss_count(0) {
+    // Round up so we always hold at least one entry per shard
+    shard_capacity = max<size_t>((capacity + shards.size() - 1) / shards.size(), 1);
+}
+
+template<typename Result>
+string ReadResultCache<Result>::key(const string& sequence, const string& quality,
+                                    const vector<int64_t>& params) const {
+    string made;
+    made.reserve(params.size() * sizeof(int64_t) + sequence.size() + quality.size() + 1);
+    for (int64_t param : params) {
+        made.append((const char*) &param, sizeof(int64_t));
+    }
+    made += sequence;
+    // Sequences are never binary, so this separates reads with qualities from
+    // reads without, and the sequence from the qualities
+    made.push_back('\0');
+    for (char base_quality : quality) {
+        made.push_back((char) ((uint8_t) base_quality / quality_bin_width));
+    }
+    return made;
+}
+
+template<typename Result>
+typename ReadResultCache<Result>::Shard& ReadResultCache<Result>::shard_for(const string& key) {
+    return shards[hash<string>()(key) % shards.size()];
+}
+
+template<typename Result>
+bool ReadResultCache<Result>::lookup(const string& key, vector<Result>& results_out) {
+    Shard& shard = shard_for(key);
+    shared_ptr<const vector<Result>> found_results;
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto found = shard.entries.find(key);
+        if (found == shard.entries.end()) {
+            miss_count.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        // Move the entry to the front, since it is now the most recently used
+        shard.recency.splice(shard.recency.begin(), shard.recency, found->second);
+        found_results = found->second->second;
+    }
+    hit_count.fetch_add(1, memory_order_relaxed);
+    // Copy outside the lock; the results stay valid even if evicted meanwhile
+    results_out = *found_results;
+    return true;
+}
+
+template<typename Result>
+void ReadResultCache<Result>::store(const string& key, const vector<Result>& results) {
+    // Copy before taking the lock, so other threads can use the shard
+    auto stored = make_shared<const vector<Result>>(results);
+
+    Shard& shard = shard_for(key);
+    lock_guard<mutex> guard(shard.lock);
+    if (shard.entries.count(key)) {
+        // Another copy of the read was mapped at the same time; keep theirs.
+        return;
+    }
+    shard.recency.emplace_front(key, stored);
+    shard.entries[key] = shard.recency.begin();
+    if (shard.recency.size() > shard_capacity) {
+        // Evict the least recently used entry
+        shard.entries.erase(shard.recency.back().first);
+        shard.recency.pop_back();
+    }
+}
+
+template<typename Result>
+size_t ReadResultCache<Result>::hits() const {
+    return hit_count.load();
+}
+
+template<typename Result>
+size_t ReadResultCache<Result>::misses() const {
+    return miss_count.load();
+}
+
+template<typename Result>
+void ReadResultCache<Result>::report(ostream& out, const string& prefix) const {
+    size_t total = hits() + misses();
+    out << prefix << "duplicate read cache: " << hits() << " hits, " << misses() << " misses";
+    if (total) {
+        out << " (" << (100.0 * hits() / total) << "% hit rate)";
+    }
+    out << endl;
+}
+
+}
+
+#endif
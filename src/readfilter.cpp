@@ -1,6 +1,8 @@
 #include "readfilter.hpp"
+#include "entropy.hpp"
 #include "IntervalTree.h"
 
+#include <cstring>
 #include <fstream>
 #include <sstream>
 
@@ -124,7 +126,7 @@ bool ReadFilter::trim_ambiguous_end(xg::XG* index, Alignment& alignment, int k)
     for(size_t i = root_mapping; i < alignment.path().mapping_size(); i++) {
         // Collect the appropriately oriented from sequence from each mapping
         auto& mapping = alignment.path().mapping(i);
-        string sequence = index->node_sequence(mapping.position().node_id());
+        string sequence = node_sequence(index, mapping.position().node_id());
         if(mapping.position().is_reverse()) {
             // Have it in the right orientation
             sequence = reverse_complement(sequence);
@@ -174,7 +176,7 @@ bool ReadFilter::trim_ambiguous_end(xg::XG* index, Alignment& alignment, int k)
         ++dfs_visit_count;
       
         // Grab the node sequence and match more of the target sequence.
-        string node_sequence = index->node_sequence(node_id);
+        string node_sequence = this->node_sequence(index, node_id);
         if(is_reverse) {
             node_sequence = reverse_complement(node_sequence);
         }
@@ -372,33 +374,91 @@ bool ReadFilter::trim_ambiguous_end(xg::XG* index, Alignment& alignment, int k)
     return true;
 }
 
+/// Count how many bytes, from the start, are the same in the two given ranges.
+/// Compares a word at a time, so it is fast on long periodic runs.
+static size_t matching_prefix_length(const char* a, const char* b, size_t max_length) {
+    size_t matched = 0;
+    while (matched + sizeof(uint64_t) <= max_length) {
+        uint64_t a_word, b_word;
+        memcpy(&a_word, a + matched, sizeof(uint64_t));
+        memcpy(&b_word, b + matched, sizeof(uint64_t));
+        if (a_word != b_word) {
+            // The mismatch is in this word; find it below.
+            break;
+        }
+        matched += sizeof(uint64_t);
+    }
+    while (matched < max_length && a[matched] == b[matched]) {
+        matched++;
+    }
+    return matched;
+}
+
+/// Count how many bytes, from the end backward, are the same in the two given
+/// ranges, which each end just before the given pointers.
+static size_t matching_suffix_length(const char* a_end, const char* b_end, size_t max_length) {
+    size_t matched = 0;
+    while (matched + sizeof(uint64_t) <= max_length) {
+        uint64_t a_word, b_word;
+        memcpy(&a_word, a_end - matched - sizeof(uint64_t), sizeof(uint64_t));
+        memcpy(&b_word, b_end - matched - sizeof(uint64_t), sizeof(uint64_t));
+        if (a_word != b_word) {
+            break;
+        }
+        matched += sizeof(uint64_t);
+    }
+    while (matched < max_length && *(a_end - matched - 1) == *(b_end - matched - 1)) {
+        matched++;
+    }
+    return matched;
+}
+
 // quick and dirty filter to see if removing reads that can slip around
 // and still map perfectly helps vg call.  returns true if at either
 // end of read sequence, at least k bases are repetitive, checking repeats
 // of up to size 2k
-bool ReadFilter::has_repeat(Alignment& aln, int k) {
+bool ReadFilter::has_repeat(const Alignment& aln, int k) const {
     if (k == 0) {
         return false;
     }
     const string& s = aln.sequence();
-    for (int i = 1; i <= 2 * k; ++i) {
-        int covered = 0;
-        bool ffound = true;
-        bool bfound = true;
-        for (int j = 1; (ffound || bfound) && (j + 1) * i < s.length(); ++j) {
-            ffound = ffound && s.substr(0, i) == s.substr(j * i, i);
-            bfound = bfound && s.substr(s.length() - i, i) == s.substr(s.length() - i - j * i, i);
-            if (ffound || bfound) {
-                covered += i;
-            }
+    size_t length = s.size();
+    for (size_t i = 1; i <= 2 * (size_t) k; ++i) {
+        if (2 * i >= length) {
+            // There is no room for a whole copy of the unit after the first
+            break;
         }
-        if (covered >= k) {
+        // Repeating the first (or last) i bases j times is the same as the
+        // sequence being i-periodic for j * i bases after the first copy (or
+        // before the last one), so one word-at-a-time scan per end finds how
+        // many copies there are. Only whole copies that leave at least one
+        // more copy's worth of sequence behind them count.
+        size_t max_copies = (length - 1) / i - 1;
+        size_t front_copies = matching_prefix_length(s.data() + i, s.data(), length - i) / i;
+        size_t back_copies = matching_suffix_length(s.data() + length - i, s.data() + length, length - i) / i;
+        size_t covered = i * min(max(front_copies, back_copies), max_copies);
+        if (covered >= (size_t) k) {
             return true;
         }
     }
     return false;
 }
 
+bool ReadFilter::is_low_complexity(const Alignment& aln) const {
+    if (min_entropy <= 0 || aln.sequence().empty()) {
+        return false;
+    }
+    size_t masked = low_complexity_length(aln.sequence(), entropy_window, min_entropy);
+    return masked * 2 > aln.sequence().size();
+}
+
+string ReadFilter::node_sequence(xg::XG* index, id_t node_id) {
+    if (node_cache) {
+        return *node_cache->get_sequence(node_id, index);
+    }
+    return index->node_sequence(node_id);
+}
+
 bool ReadFilter::is_split(xg::XG* index, Alignment& alignment) {
     if(index == nullptr) {
         // Can't tell if the read is split.
@@ -716,14 +776,20 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
             }
         }
         
-        if ((keep || verbose) && drop_split && is_split(xindex, aln)) {
-            ++counts.split[co];
-            keep = false;
-        }
+        // the repeat check only looks at the read, so do it before anything
+        // that has to go to the index
         if ((keep || verbose) && has_repeat(aln, repeat_size)) {
             ++counts.repeat[co];
             keep = false;
         }
+        if ((keep || verbose) && is_low_complexity(aln)) {
+            ++counts.low_complexity[co];
+            keep = false;
+        }
+        if ((keep || verbose) && drop_split && is_split(xindex, aln)) {
+            ++counts.split[co];
+            keep = false;
+        }
         if ((keep || verbose) && defray_length && trim_ambiguous_ends(xindex, aln, defray_length)) {
             ++counts.defray[co];
             // We keep these, because the alignments get modified.
@@ -737,7 +803,41 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
             update_buffers(tid, aln, aln_chunks);
         }
     };
-    stream::for_each_parallel(*alignment_stream, lambda);
+    
+    if (defray_length > 0 && node_cache_size > 0) {
+        // Reads near each other in the graph search the same nodes, so share
+        // their sequences between reads and threads.
+        node_cache.reset(new SharedNodeCache(node_cache_size));
+    }
+    
+    // Push the filters that only look at cheap fields down to the serialized
+    // reads, unless we need to count everything we drop
+    AlignmentPredicate pushed_down = where;
+    if (!verbose) {
+        if (min_mapq > 0) {
+            pushed_down.require_number(AlignmentPredicate::MAPQ, AlignmentPredicate::GREATER_EQUAL, min_mapq);
+        }
+        if (!name_prefix.empty()) {
+            pushed_down.require_name(AlignmentPredicate::PREFIX, name_prefix);
+        }
+    }
+    
+    // Decompression happens on its own thread, so the workers only filter
+    if (pushed_down.empty()) {
+        stream::for_each_parallel(*alignment_stream, lambda);
+    } else {
+        function<bool(const string&)> keep_serialized = [&pushed_down](const string& serialized) {
+            return pushed_down(serialized);
+        };
+        stream::for_each_parallel_filtered(*alignment_stream, keep_serialized, lambda);
+    }
+    
+    if (node_cache) {
+        if (verbose) {
+            node_cache->report(cerr);
+        }
+        node_cache.reset();
+    }
 
     for (int tid = 0; tid < buffer.size(); ++tid) {
         for (int chunk = 0; chunk < buffer[tid].size(); ++chunk) {
@@ -772,6 +872,8 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
              << "Split Read Filter (secondary):     " << counts.split[1] << endl
              << "Repeat Ends Filter (primary):      " << counts.repeat[0] << endl
              << "Repeat Ends Filter (secondary):    " << counts.repeat[1] << endl
+             << "Low Complexity Filter (primary):   " << counts.low_complexity[0] << endl
+             << "Low Complexity Filter (secondary): " << counts.low_complexity[1] << endl
              << "Min Quality Filter (primary):      " << counts.min_mapq[0] << endl
              << "Min Quality  Filter (secondary):   " << counts.min_mapq[1] << endl
                         
@@ -5,9 +5,12 @@
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <memory>
 #include "vg.hpp"
 #include "xg.hpp"
 #include "vg.pb.h"
+#include "shared_node_cache.hpp"
+#include "alignment_predicate.hpp"
 
 /** \file
  * Provides a way to filter and transform reads, implementing the bulk of the
@@ -36,6 +39,10 @@ public:
     bool verbose = false;
     double min_mapq = 0.;
     int repeat_size = 0;
+    // Drop reads with more than half their bases in windows of
+    // entropy_window bases with less than this much entropy, in bits
+    double min_entropy = 0.;
+    size_t entropy_window = 16;
     // How far in from the end should we look for ambiguous end alignment to
     // clip off?
     int defray_length = 0;
@@ -45,6 +52,12 @@ public:
     bool drop_split = false;
     // default to 1 thread (as opposed to all)
     int threads = 1;
+    // Only look at reads this accepts. It is tested on the serialized reads,
+    // so reads it rejects are never parsed (or counted in verbose mode).
+    AlignmentPredicate where;
+    // How many node sequences should the defray search keep cached across
+    // reads and threads? 0 disables the cache.
+    size_t node_cache_size = 10000;
 
     // Keep some basic counts for when verbose mode is enabled
     struct Counts {
@@ -57,10 +70,11 @@ public:
         vector<size_t> min_mapq;
         vector<size_t> split;
         vector<size_t> repeat;
+        vector<size_t> low_complexity;
         vector<size_t> defray;
         Counts() : read(2, 0), filtered(2, 0), wrong_name(2, 0), min_score(2, 0),
                    max_overhang(2, 0), min_end_matches(2, 0), min_mapq(2, 0),
-                   split(2, 0), repeat(2, 0), defray(2, 0) {}
+                   split(2, 0), repeat(2, 0), low_complexity(2, 0), defray(2, 0) {}
         Counts& operator+=(const Counts& other) {
             for (int i = 0; i < 2; ++i) {
                 read[i] += other.read[i];
@@ -72,6 +86,7 @@ public:
                 min_mapq[i] += other.min_mapq[i];
                 split[i] += other.split[i];
                 repeat[i] += other.repeat[i];
+                low_complexity[i] += other.low_complexity[i];
                 defray[i] += other.defray[i];
             }
             return *this;
@@ -111,15 +126,30 @@ public:
      */
     bool trim_ambiguous_ends(xg::XG* index, Alignment& alignment, int k);
     
-private:
-
     /**
-     * quick and dirty filter to see if removing reads that can slip around
+     * quick and dirty filter to see if removing reads that can slip around
      * and still map perfectly helps vg call.  returns true if at either
      * end of read sequence, at least k bases are repetitive, checking repeats
      * of up to size 2k
      */
-    bool has_repeat(Alignment& aln, int k);
+    bool has_repeat(const Alignment& aln, int k) const;
+    
+    /**
+     * Returns true if more than half of the read's bases lie in windows of
+     * entropy_window bases with entropy below min_entropy.
+     */
+    bool is_low_complexity(const Alignment& aln) const;
+    
+private:
+
+    /// Node sequences shared by the defray searches of all threads, while
+    /// filter() is running.
+    unique_ptr<SharedNodeCache> node_cache;
+    
+    /**
+     * Get the sequence of a node, through the cache if there is one.
+     */
+    string node_sequence(xg::XG* index, id_t node_id);
     
     /**
      * Trim only the end of the given alignment, leaving the start alone. Two
@@ -0,0 +1,163 @@
+#include "rescue_window.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+#include "utility.hpp"
+
+/**
+ * \file rescue_window.cpp
+ * Implement rescue window k-mer indexing and caching.
+ */
+
+namespace vg {
+
+using namespace std;
+
+/// Get the 2-bit code for a base, or -1 if it isn't ACGT
+static inline int base_code(char base) {
+    switch (base) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return -1;
+    }
+}
+
+void RescueWindow::index_kmers(size_t k, size_t max_steps) {
+    kmers.clear();
+    kmer_size = min<size_t>(k, 32);
+    kmers_complete = false;
+    if (kmer_size == 0) {
+        return;
+    }
+    const uint64_t mask = kmer_size == 32 ? numeric_limits<uint64_t>::max() : (uint64_t(1) << (2 * kmer_size)) - 1;
+
+    // Number the node sides: 2 * rank for forward, plus 1 for reverse
+    unordered_map<id_t, size_t> rank_of;
+    for (size_t i = 0; i < graph.node_size(); i++) {
+        rank_of[graph.node(i).id()] = i;
+    }
+    vector<string> sequences(2 * graph.node_size());
+    for (size_t i = 0; i < graph.node_size(); i++) {
+        sequences[2 * i] = graph.node(i).sequence();
+        sequences[2 * i + 1] = reverse_complement(graph.node(i).sequence());
+    }
+    vector<vector<size_t>> next(2 * graph.node_size());
+    for (auto& edge : graph.edge()) {
+        auto from = rank_of.find(edge.from());
+        auto to = rank_of.find(edge.to());
+        if (from == rank_of.end() || to == rank_of.end()) {
+            continue;
+        }
+        next[2 * from->second + edge.from_start()].push_back(2 * to->second + edge.to_end());
+        next[2 * to->second + !edge.to_end()].push_back(2 * from->second + !edge.from_start());
+    }
+
+    size_t steps = 0;
+    // Spell onward from a position, with the k-mer so far, returning false if
+    // we ran out of steps
+    function<bool(size_t, size_t, uint64_t, size_t)> extend = [&](size_t side, size_t offset,
+                                                                 uint64_t kmer, size_t length) {
+        const string& sequence = sequences[side];
+        for (; offset < sequence.size(); offset++) {
+            if (++steps > max_steps) {
+                return false;
+            }
+            int code = base_code(sequence[offset]);
+            if (code < 0) {
+                return true;
+            }
+            kmer = ((kmer << 2) | code) & mask;
+            if (++length == kmer_size) {
+                kmers.insert(kmer);
+                return true;
+            }
+        }
+        for (size_t following : next[side]) {
+            if (!extend(following, 0, kmer, length)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for (size_t side = 0; side < sequences.size(); side++) {
+        for (size_t offset = 0; offset < sequences[side].size(); offset++) {
+            if (!extend(side, offset, 0, 0)) {
+                kmers.clear();
+                return;
+            }
+        }
+    }
+    kmers_complete = true;
+}
+
+bool RescueWindow::may_align(const string& sequence) const {
+    if (!kmers_complete || sequence.size() < kmer_size) {
+        return true;
+    }
+    const uint64_t mask = kmer_size == 32 ? numeric_limits<uint64_t>::max() : (uint64_t(1) << (2 * kmer_size)) - 1;
+    uint64_t kmer = 0;
+    size_t length = 0;
+    for (char base : sequence) {
+        int code = base_code(base);
+        if (code < 0) {
+            length = 0;
+            continue;
+        }
+        kmer = ((kmer << 2) | code) & mask;
+        if (++length >= kmer_size && kmers.count(kmer)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+RescueWindowCache::RescueWindowCache(size_t capacity) : capacity(capacity) {
+    // Nothing to do
+}
+
+shared_ptr<RescueWindow> RescueWindowCache::get(const vector<id_t>& node_ids, int64_t context_length,
+                                                const function<shared_ptr<RescueWindow>(void)>& make_window,
+                                                bool& was_cached) {
+    vector<id_t> sorted_ids = node_ids;
+    sort(sorted_ids.begin(), sorted_ids.end());
+    sorted_ids.erase(unique(sorted_ids.begin(), sorted_ids.end()), sorted_ids.end());
+    stringstream key_stream;
+    key_stream << context_length;
+    for (id_t id : sorted_ids) {
+        key_stream << ":" << id;
+    }
+    string key = key_stream.str();
+
+    auto found = windows.find(key);
+    if (found != windows.end()) {
+        // Move it to the front
+        recency.splice(recency.begin(), recency, found->second.second);
+        was_cached = true;
+        return found->second.first;
+    }
+
+    was_cached = false;
+    shared_ptr<RescueWindow> window = make_window();
+    if (capacity == 0) {
+        return window;
+    }
+    if (windows.size() >= capacity) {
+        windows.erase(recency.back());
+        recency.pop_back();
+    }
+    recency.push_front(key);
+    windows[key] = make_pair(window, recency.begin());
+    return window;
+}
+
+void RescueWindowCache::clear() {
+    recency.clear();
+    windows.clear();
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef VG_RESCUE_WINDOW_HPP_INCLUDED
+#define VG_RESCUE_WINDOW_HPP_INCLUDED
+
+/**
+ * \file rescue_window.hpp
+ *
+ * Graph windows around likely mate positions, for rescuing unaligned mates,
+ * with a cache so pairs anchored in the same place share one window.
+ */
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A subgraph that a mate is realigned to during pair rescue, along with what
+ * the aligner needs to know about it and an optional index of its k-mers for
+ * skipping hopeless alignments.
+ */
+struct RescueWindow {
+    Graph graph;
+    /// Can the graph be aligned to without unrolling or DAGifying it?
+    bool acyclic_and_sorted = false;
+
+    /// Length of the indexed k-mers, or 0 if they haven't been indexed
+    size_t kmer_size = 0;
+    /// Were all the k-mers of the window indexed?
+    bool kmers_complete = false;
+    /// The 2-bit packed k-mers spelled along walks on either strand of the
+    /// window
+    unordered_set<uint64_t> kmers;
+
+    /// Index the k-mers, of length up to 32, spelled along the window's
+    /// walks. Gives up, leaving kmers_complete false, after walking max_steps
+    /// bases, so dense variation can't make this slower than aligning.
+    void index_kmers(size_t k, size_t max_steps);
+
+    /// Could the sequence have a good alignment here? Returns false only if
+    /// the k-mers are indexed and the sequence shares none of them with the
+    /// window.
+    bool may_align(const string& sequence) const;
+};
+
+/**
+ * A least recently used cache of rescue windows, keyed by the nodes they were
+ * extracted around and how much context was taken. Not thread safe; each
+ * mapping thread keeps its own.
+ */
+class RescueWindowCache {
+public:
+    RescueWindowCache(size_t capacity = 64);
+
+    /// Get the window around the given nodes with the given context length,
+    /// making it with make_window if it isn't cached. Sets was_cached to say
+    /// which happened.
+    shared_ptr<RescueWindow> get(const vector<id_t>& node_ids, int64_t context_length,
+                                 const function<shared_ptr<RescueWindow>(void)>& make_window,
+                                 bool& was_cached);
+
+    /// Forget all the windows.
+    void clear();
+
+private:
+    size_t capacity;
+    /// Keys from most to least recently used
+    list<string> recency;
+    unordered_map<string, pair<shared_ptr<RescueWindow>, list<string>::iterator>> windows;
+};
+
+}
+
+#endif
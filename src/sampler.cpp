@@ -12,12 +12,24 @@ void Sampler::set_source_paths(const vector<string>& source_paths) {
         for (auto& source_path : source_paths) {
             path_lengths.push_back(xgidx->path_length(source_path));
         }
-        path_sampler = discrete_distribution<>(path_lengths.begin(), path_lengths.end());
+        path_sampler = AliasTable(path_lengths.begin(), path_lengths.end());
     } else {
-        path_sampler = discrete_distribution<>();
+        path_sampler = AliasTable();
     }
 }
 
+size_t split_seed(size_t seed, size_t stream) {
+    seed_seq seq{(uint32_t) seed, (uint32_t) (seed >> 32), (uint32_t) stream, (uint32_t) (stream >> 32)};
+    uint32_t words[2];
+    seq.generate(words, words + 2);
+    return ((size_t) words[0] << 32) | words[1];
+}
+
+void Sampler::set_stream(size_t stream, size_t first_read) {
+    rng.seed(split_seed(seed, stream));
+    nonce = first_read;
+}
+
 /// We have a helper function to convert path positions and orientations to
 /// pos_t values.
 pos_t position_at(xg::XG* xgidx, const string& path_name, const size_t& path_offset, bool is_reverse) {
@@ -505,15 +517,15 @@ Alignment Sampler::alignment_with_error(size_t length,
 }
 
 size_t Sampler::node_length(id_t id) {
-    return xg_cached_node_length(id, xgidx, node_cache);
+    return xg_cached_node_length(id, xgidx, *node_cache);
 }
 
 char Sampler::pos_char(pos_t pos) {
-    return xg_cached_pos_char(pos, xgidx, node_cache);
+    return xg_cached_pos_char(pos, xgidx, *node_cache);
 }
 
 map<pos_t, char> Sampler::next_pos_chars(pos_t pos) {
-    return xg_cached_next_pos_chars(pos, xgidx, node_cache, edge_cache);
+    return xg_cached_next_pos_chars(pos, xgidx, *node_cache);
 }
 
 bool Sampler::is_valid(const Alignment& aln) {
@@ -561,8 +573,7 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
                            bool retry_on_Ns,
                            size_t seed) :
       xg_index(xg_index)
-    , node_cache(100)
-    , edge_cache(100)
+    , node_cache(make_shared<SharedNodeCache>(10000))
     , sub_poly_rate(substition_polymorphism_rate)
     , indel_poly_rate(indel_polymorphism_rate)
     , indel_error_prop(indel_error_proportion)
@@ -587,7 +598,7 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
             path_sizes.push_back(xg_index.path_length(source_path));
             start_pos_samplers.emplace_back(0, path_sizes.back() - 1);
         }
-        path_sampler = discrete_distribution<>(path_sizes.begin(), path_sizes.end());
+        path_sampler = AliasTable(path_sizes.begin(), path_sizes.end());
     }
     
     if (substition_polymorphism_rate < 0.0 || substition_polymorphism_rate > 1.0
@@ -815,13 +826,13 @@ void NGSSimulator::sample_read_internal(Alignment& aln, size_t& offset, bool& is
                                         const string& source_path) {
    
     // Make sure we are starting inside the node
-    auto first_node_length = xg_cached_node_length(id(curr_pos), &xg_index, node_cache);
+    auto first_node_length = xg_cached_node_length(id(curr_pos), &xg_index, *node_cache);
     assert(vg::offset(curr_pos) < first_node_length);
    
     aln.clear_path();
     aln.clear_sequence();
     
-    char graph_char = xg_cached_pos_char(curr_pos, &xg_index, node_cache);
+    char graph_char = xg_cached_pos_char(curr_pos, &xg_index, *node_cache);
     bool hit_end = false;
     
     // walk a path and generate a read sequence at the same time
@@ -935,8 +946,7 @@ bool NGSSimulator::advance_on_graph(pos_t& pos, char& graph_char) {
     // choose a next position at random
     map<pos_t, char> next_pos_chars = xg_cached_next_pos_chars(pos,
                                                                &xg_index,
-                                                               node_cache,
-                                                               edge_cache);
+                                                               *node_cache);
     if (next_pos_chars.empty()) {
         return true;
     }
@@ -975,7 +985,7 @@ bool NGSSimulator::advance_on_path(size_t& offset, bool& is_reverse, pos_t& pos,
     pos = position_at(&xg_index, source_path, offset, is_reverse);
     
     // And look up the character
-    graph_char = xg_cached_pos_char(pos, &xg_index, node_cache);
+    graph_char = xg_cached_pos_char(pos, &xg_index, *node_cache);
     
     return false;
 }
@@ -995,21 +1005,21 @@ bool NGSSimulator::advance_on_graph_by_distance(pos_t& pos, size_t distance) {
     int64_t node_length = xg_index.node_length(id(pos)) - offset(pos);
     while (remaining >= node_length) {
         remaining -= node_length;
-        vector<Edge> edges = is_rev(pos) ? xg_index.edges_on_start(id(pos)) : xg_index.edges_on_end(id(pos));
-        if (edges.empty()) {
+        handle_t handle = xg_index.get_handle(id(pos), is_rev(pos));
+        size_t degree = xg_index.get_degree(handle, false);
+        if (degree == 0) {
             return true;
         }
-        size_t choice = uniform_int_distribution<size_t>(0, edges.size() - 1)(prng);
-        Edge& edge = edges[choice];
-        if (id(pos) == edge.from() && is_rev(pos) == edge.from_start()) {
-            get_id(pos) = edge.to();
-            get_is_rev(pos) = edge.to_end();
-        }
-        else {
-            get_id(pos) = edge.from();
-            get_is_rev(pos) = !edge.from_start();
-        }
-        get_offset(pos) = 0;
+        size_t choice = uniform_int_distribution<size_t>(0, degree - 1)(prng);
+        // walk out to the chosen edge without materializing any of them
+        xg_index.follow_edges(handle, false, [&](const handle_t& next) {
+            if (choice == 0) {
+                pos = make_pos_t(xg_index.get_id(next), xg_index.get_is_reverse(next), 0);
+                return false;
+            }
+            choice--;
+            return true;
+        });
         node_length = xg_index.node_length(id(pos));
     }
     
@@ -1108,7 +1118,7 @@ pos_t NGSSimulator::walk_backwards(const Path& path, size_t distance) {
     }
     
     // Get the length of the node we landed on
-    auto node_length = xg_cached_node_length(mapping_pos.node_id(), &xg_index, node_cache);
+    auto node_length = xg_cached_node_length(mapping_pos.node_id(), &xg_index, *node_cache);
     // The position we pick should not be past the end of the node.
     if (offset >= node_length) {
         cerr << pb2json(path) << endl;
@@ -1298,6 +1308,20 @@ tuple<size_t, bool, pos_t, string> NGSSimulator::sample_start_path_pos() {
     return make_tuple(offset, rev, pos, source_path);
 }
 
+void NGSSimulator::set_stream(size_t stream, size_t first_read) {
+    prng.seed(split_seed(seed ? seed : random_device()(), stream));
+    insert_sampler.reset();
+    // give each of the quality models its own seed from the stream
+    for (MarkovDistribution<uint8_t, uint8_t>& markov_distr : transition_distrs_1) {
+        markov_distr.reseed(prng());
+    }
+    for (MarkovDistribution<uint8_t, uint8_t>& markov_distr : transition_distrs_2) {
+        markov_distr.reseed(prng());
+    }
+    joint_initial_distr.reseed(prng());
+    sample_counter = first_read;
+}
+
 string NGSSimulator::get_read_name() {
     stringstream sstrm;
     sstrm << "seed_" << seed << "_fragment_" << sample_counter;
@@ -1373,6 +1397,11 @@ NGSSimulator::MarkovDistribution<From, To>::MarkovDistribution(size_t seed) : pr
     // nothing to do
 }
 
+template<class From, class To>
+void NGSSimulator::MarkovDistribution<From, To>::reseed(size_t seed) {
+    prng.seed(seed);
+}
+
 template<class From, class To>
 void NGSSimulator::MarkovDistribution<From, To>::record_transition(From from, To to) {
     if (!cond_distrs.count(from)) {
@@ -1393,42 +1422,19 @@ void NGSSimulator::MarkovDistribution<From, To>::record_transition(From from, To
 template<class From, class To>
 void NGSSimulator::MarkovDistribution<From, To>::finalize() {
     for (pair<const From, vector<size_t>>& cond_distr : cond_distrs) {
-        for (size_t i = 1; i < cond_distr.second.size(); i++) {
-            cond_distr.second[i] += cond_distr.second[i - 1];
-        }
-        
-        samplers[cond_distr.first] = uniform_int_distribution<size_t>(0, cond_distr.second.back() - 1);
+        samplers[cond_distr.first] = AliasTable(cond_distr.second.begin(), cond_distr.second.end());
     }
 }
 
 template<class From, class To>
 To NGSSimulator::MarkovDistribution<From, To>::sample_transition(From from) {
+    auto sampler = samplers.find(from);
     // return randomly if a transition has never been observed
-    if (!cond_distrs.count(from)) {
+    if (sampler == samplers.end()) {
         return value_at[uniform_int_distribution<size_t>(0, value_at.size() - 1)(prng)];
     }
     
-    size_t sample_val = samplers[from](prng);
-    
-    vector<size_t>& cdf = cond_distrs[from];
-    
-    if (sample_val <= cdf[0]) {
-        return value_at[0];
-    }
-    
-    size_t low = 0;
-    size_t hi = cdf.size() - 1;
-    while (hi > low + 1) {
-        int64_t mid = (hi + low) / 2;
-        
-        if (sample_val <= cdf[mid]) {
-            hi = mid;
-        }
-        else {
-            low = mid;
-        }
-    }
-    return value_at[hi];
+    return value_at[sampler->second(prng)];
 }
 
 }
@@ -17,6 +17,7 @@
 #include "cached_position.hpp"
 #include "xg_position.hpp"
 #include "lru_cache.h"
+#include "distributions.hpp"
 #include "json2pb.h"
 
 namespace vg {
@@ -29,6 +30,11 @@ using namespace std;
 /// forward version of the path.
 pos_t position_at(xg::XG* xgidx, const string& path_name, const size_t& path_offset, bool is_reverse);
 
+/// Derive the seed for one of several independent streams of random numbers
+/// from a base seed, so that streams simulated on different threads are
+/// uncorrelated but the whole simulation is reproducible.
+size_t split_seed(size_t seed, size_t stream);
+
 /**
  * Generate Alignments (with or without mutations, and in pairs or alone) from
  * an XG index.
@@ -39,11 +45,12 @@ public:
 
     xg::XG* xgidx;
     // We need this so we don't re-load the node for every character we visit in
-    // it.
-    LRUCache<id_t, Node> node_cache;
-    LRUCache<id_t, vector<Edge> > edge_cache;
+    // it. Copies of the Sampler share it.
+    shared_ptr<SharedNodeCache> node_cache;
     mt19937 rng;
     int64_t nonce;
+    // The seed that rng was seeded with, for splitting into streams
+    int seed;
     // If set, only sample positions/start reads on the forward strands of their
     // nodes.
     bool forward_only;
@@ -51,15 +58,14 @@ public:
     bool no_Ns;
     // A vector which, if nonempty, gives the names of the paths to restrict simulated reads to.
     vector<string> source_paths;
-    discrete_distribution<> path_sampler; // draw an index in source_paths
+    AliasTable path_sampler; // draw an index in source_paths
     inline Sampler(xg::XG* x,
             int seed = 0,
             bool forward_only = false,
             bool allow_Ns = false,
             const vector<string>& source_paths = {})
         : xgidx(x),
-          node_cache(100),
-          edge_cache(100),
+          node_cache(make_shared<SharedNodeCache>(10000)),
           forward_only(forward_only),
           no_Ns(!allow_Ns),
           nonce(0),
@@ -67,12 +73,18 @@ public:
         if (!seed) {
             seed = time(NULL);
         }
+        this->seed = seed;
         rng.seed(seed);
         set_source_paths(source_paths);
     }
 
     void set_source_paths(const vector<string>& source_paths);
 
+    /// Switch to the given independent stream of reads, numbering reads from
+    /// first_read. Each thread can sample from a copy of the Sampler, and the
+    /// reads of a stream do not depend on which thread samples them.
+    void set_stream(size_t stream, size_t first_read);
+
     pos_t position(void);
     string sequence(size_t length);
     
@@ -155,12 +167,24 @@ public:
     /// Sample a pair of reads an alignments
     pair<Alignment, Alignment> sample_read_pair();
     
+    /// Copies share the index, the node cache and the trained error model,
+    /// but not random state, so they can sample on different threads.
+    NGSSimulator(const NGSSimulator& other) = default;
+    
+    /// Switch to the given independent stream of reads, naming reads (or
+    /// pairs) from first_read. Reads of a stream do not depend on which copy
+    /// of the simulator samples them.
+    void set_stream(size_t stream, size_t first_read);
+    
 private:
     template<class From, class To>
     class MarkovDistribution {
     public:
         MarkovDistribution(size_t seed);
         
+        /// restart the random number generator from a new seed
+        void reseed(size_t seed);
+        
         /// record a transition from the input data
         void record_transition(From from, To to);
         /// indicate that there is no more data and prepare for sampling
@@ -171,10 +195,12 @@ private:
     private:
         
         default_random_engine prng;
-        unordered_map<From, uniform_int_distribution<size_t>> samplers;
+        /// Draws a column of value_at for each From, in constant time
+        unordered_map<From, AliasTable> samplers;
         
         unordered_map<To, size_t> column_of;
         vector<To> value_at;
+        /// Transition counts from each From to each column of value_at
         unordered_map<From, vector<size_t>> cond_distrs;
         
     };
@@ -267,11 +293,10 @@ private:
     
     xg::XG& xg_index;
     
-    LRUCache<id_t, Node> node_cache;
-    LRUCache<id_t, vector<Edge> > edge_cache;
+    shared_ptr<SharedNodeCache> node_cache;
     
     default_random_engine prng;
-    discrete_distribution<> path_sampler;
+    AliasTable path_sampler;
     vector<uniform_int_distribution<size_t> > start_pos_samplers;
     uniform_int_distribution<uint8_t> strand_sampler;
     uniform_int_distribution<size_t> background_sampler;
@@ -0,0 +1,69 @@
+#include "shared_node_cache.hpp"
+
+namespace vg {
+
+using namespace std;
+
+SharedNodeCache::SharedNodeCache(size_t capacity, size_t shard_count) :
+    shards(max<size_t>(min(shard_count, capacity), 1)), hit_count(0), miss_count(0) {
+    // Round up so we always hold at least one entry per shard
+    shard_capacity = max<size_t>((capacity + shards.size() - 1) / shards.size(), 1);
+}
+
+SharedNodeCache::Shard& SharedNodeCache::shard_for(id_t id) {
+    // IDs are usually dense, so adjacent nodes land in different shards.
+    return shards[(size_t) id % shards.size()];
+}
+
+shared_ptr<const string> SharedNodeCache::get_sequence(id_t id, const xg::XG* xgidx) {
+    Shard& shard = shard_for(id);
+
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto found = shard.entries.find(id);
+        if (found != shard.entries.end()) {
+            // Move the entry to the front, since it is now the most recently used
+            shard.recency.splice(shard.recency.begin(), shard.recency, found->second);
+            hit_count.fetch_add(1, memory_order_relaxed);
+            return found->second->second;
+        }
+    }
+
+    // Decode the sequence without holding the lock, so other threads can
+    // use the shard in the meantime.
+    miss_count.fetch_add(1, memory_order_relaxed);
+    auto sequence = make_shared<const string>(xgidx->node_sequence(id));
+
+    lock_guard<mutex> guard(shard.lock);
+    if (shard.entries.count(id)) {
+        // Someone else loaded it while we were decoding; keep theirs.
+        return shard.entries[id]->second;
+    }
+    shard.recency.emplace_front(id, sequence);
+    shard.entries[id] = shard.recency.begin();
+    if (shard.recency.size() > shard_capacity) {
+        // Evict the least recently used entry
+        shard.entries.erase(shard.recency.back().first);
+        shard.recency.pop_back();
+    }
+    return sequence;
+}
+
+size_t SharedNodeCache::hits() const {
+    return hit_count.load();
+}
+
+size_t SharedNodeCache::misses() const {
+    return miss_count.load();
+}
+
+void SharedNodeCache::report(ostream& out) const {
+    size_t total = hits() + misses();
+    out << "node cache: " << hits() << " hits, " << misses() << " misses";
+    if (total) {
+        out << " (" << (100.0 * hits() / total) << "% hit rate)";
+    }
+    out << endl;
+}
+
+}
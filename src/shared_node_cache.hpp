@@ -0,0 +1,74 @@
+#ifndef VG_SHARED_NODE_CACHE_HPP_INCLUDED
+#define VG_SHARED_NODE_CACHE_HPP_INCLUDED
+
+/**
+ * \file shared_node_cache.hpp
+ *
+ * A node sequence cache over an xg::XG index that can be shared by all the
+ * threads in a process. It is split into independently locked LRU shards, so
+ * threads looking up different nodes rarely contend, and it stores only node
+ * sequences rather than whole protobuf Nodes.
+ */
+
+#include <atomic>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.hpp"
+#include "xg.hpp"
+
+namespace vg {
+
+using namespace std;
+
+class SharedNodeCache {
+public:
+    /// Make a cache holding about capacity node sequences in total, spread
+    /// over up to the given number of independently locked shards.
+    SharedNodeCache(size_t capacity, size_t shard_count = 64);
+
+    // We hold mutexes, so we can't be copied.
+    SharedNodeCache(const SharedNodeCache& other) = delete;
+    SharedNodeCache& operator=(const SharedNodeCache& other) = delete;
+
+    /// Get the forward sequence of the node with the given ID, loading it
+    /// from the index if it isn't cached. The returned sequence stays valid
+    /// even if it is evicted while the caller is using it.
+    shared_ptr<const string> get_sequence(id_t id, const xg::XG* xgidx);
+
+    /// Get the number of lookups that were answered from the cache.
+    size_t hits() const;
+
+    /// Get the number of lookups that had to go to the index.
+    size_t misses() const;
+
+    /// Print hit and miss counts to the given stream, for logging.
+    void report(ostream& out) const;
+
+private:
+
+    /// One independently locked LRU cache. Most recently used entries are at
+    /// the front of the recency list.
+    struct Shard {
+        mutex lock;
+        list<pair<id_t, shared_ptr<const string>>> recency;
+        unordered_map<id_t, list<pair<id_t, shared_ptr<const string>>>::iterator> entries;
+    };
+
+    /// Find the shard responsible for a node.
+    Shard& shard_for(id_t id);
+
+    vector<Shard> shards;
+    size_t shard_capacity;
+    atomic<size_t> hit_count;
+    atomic<size_t> miss_count;
+};
+
+}
+
+#endif
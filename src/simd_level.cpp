@@ -0,0 +1,85 @@
+#include "simd_level.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+
+#include "log_sum_exp_kernel.hpp"
+#include "banded_global_aligner_kernel.hpp"
+
+namespace vg {
+
+using namespace std;
+
+// -1 means nobody has chosen a level yet
+static atomic<int> chosen_level(-1);
+
+SIMDLevel simd_level_supported() {
+    static const SIMDLevel supported = []() {
+        SIMDLevel level = SIMD_SCALAR;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+#ifdef __SSE2__
+        level = SIMD_SSE2;
+#endif
+        // the wider kernels are only in the build if the compiler could make
+        // them, and every CPU with AVX-512BW also has AVX2
+        if ((sum_exp_avx2_available() || fill_band_column_avx2_available()) && __builtin_cpu_supports("avx2")) {
+            level = SIMD_AVX2;
+            if (fill_band_column_avx512_available() && __builtin_cpu_supports("avx512bw")) {
+                level = SIMD_AVX512;
+            }
+        }
+#endif
+        return level;
+    }();
+    return supported;
+}
+
+SIMDLevel simd_level() {
+    int level = chosen_level.load();
+    if (level < 0) {
+        SIMDLevel from_environment = simd_level_supported();
+        const char* requested = getenv("VG_SIMD_LEVEL");
+        if (requested != nullptr && !parse_simd_level(requested, from_environment)) {
+            cerr << "warning:[vg] ignoring unrecognized VG_SIMD_LEVEL " << requested << endl;
+            from_environment = simd_level_supported();
+        }
+        int expected = -1;
+        // if another thread got here first, its choice is as good as ours
+        chosen_level.compare_exchange_strong(expected, min<int>(from_environment, simd_level_supported()));
+        level = chosen_level.load();
+    }
+    return (SIMDLevel) level;
+}
+
+SIMDLevel set_simd_level(SIMDLevel level) {
+    chosen_level.store(min<int>(level, simd_level_supported()));
+    return (SIMDLevel) chosen_level.load();
+}
+
+string simd_level_name(SIMDLevel level) {
+    switch (level) {
+    case SIMD_SCALAR:
+        return "scalar";
+    case SIMD_SSE2:
+        return "sse2";
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_AVX512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+bool parse_simd_level(const string& name, SIMDLevel& level_out) {
+    for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level++) {
+        if (name == simd_level_name((SIMDLevel) level)) {
+            level_out = (SIMDLevel) level;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef VG_SIMD_LEVEL_HPP_INCLUDED
+#define VG_SIMD_LEVEL_HPP_INCLUDED
+
+/**
+ * \file simd_level.hpp
+ *
+ * Runtime selection of the widest SIMD instruction set that our vectorized
+ * kernels can use on this CPU, so one vg binary can run the 256-bit and 512-bit
+ * kernels where they are available and fall back everywhere else. The level
+ * can be forced lower (for reproducible benchmarking across different
+ * machines) with the VG_SIMD_LEVEL environment variable or set_simd_level().
+ */
+
+#include <string>
+
+namespace vg {
+
+using namespace std;
+
+/// The instruction sets kernels can be written for, in increasing order of
+/// width. Kernels without a version at some level use the next level down, so
+/// at SIMD_AVX512 only the banded global aligner is 512 bits wide.
+enum SIMDLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2,
+    SIMD_AVX512 = 3
+};
+
+/// Get the widest level that both this CPU and this build support.
+SIMDLevel simd_level_supported();
+
+/// Get the level kernels should use. This is the supported level, unless it
+/// has been lowered by set_simd_level() or by setting VG_SIMD_LEVEL to
+/// "scalar", "sse2", "avx2" or "avx512" in the environment.
+SIMDLevel simd_level();
+
+/// Force kernels to use at most the given level. Levels above what is
+/// supported are clamped down to it. Returns the level actually in effect.
+SIMDLevel set_simd_level(SIMDLevel level);
+
+/// Get the name of a level, as used by VG_SIMD_LEVEL.
+string simd_level_name(SIMDLevel level);
+
+/// Parse a level name. Returns false if the name isn't recognized.
+bool parse_simd_level(const string& name, SIMDLevel& level_out);
+
+}
+
+#endif
@@ -65,37 +65,48 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         cerr << "Found " << leaves.size() << " leaves" << endl;
     }
     
-    // Index all the graph paths
+    // Index the graph paths that carry features. Paths without features
+    // don't need positions, and keeping an index up to date means retracing
+    // the path after every site it passes through.
     map<string, unique_ptr<PathIndex>> path_indexes;
     graph.paths.for_each_name([&](const string& name) {
-        // For every path name, go index it and put it in this collection
-        path_indexes.insert(make_pair(name, move(unique_ptr<PathIndex>(new PathIndex(graph, name)))));
+        if (features.has_features(name)) {
+            // For every path name with features, go index it and put it in this collection
+            path_indexes.insert(make_pair(name, move(unique_ptr<PathIndex>(new PathIndex(graph, name)))));
+        }
     });
     
     // Now we have a list of all the leaf sites.
     create_progress("simplifying leaves", leaves.size());
     
+    // Leaves don't overlap, so we can work out what to do with each of them
+    // independently, in parallel. Then we apply the changes one leaf at a
+    // time, since they all touch the graph's paths.
+    vector<const Snarl*> leaf_order(leaves.begin(), leaves.end());
+    
     // We can't use the SnarlManager after we modify the graph, so we load the
     // contents of all the leaves we're going to modify first.
-    map<const Snarl*, pair<unordered_set<Node*>, unordered_set<Edge*>>> leaf_contents;
+    vector<pair<unordered_set<Node*>, unordered_set<Edge*>>> leaf_contents(leaf_order.size());
     
     // How big is each leaf in bp
-    map<const Snarl*, size_t> leaf_sizes;
+    vector<size_t> leaf_sizes(leaf_order.size(), 0);
     
     // We also need to pre-calculate the traversals for the snarls that are the
     // right size, since the traversal finder uses the snarl manager amd might
     // not work if we modify the graph.
-    map<const Snarl*, vector<SnarlTraversal>> leaf_traversals;
+    vector<vector<SnarlTraversal>> leaf_traversals(leaf_order.size());
     
-    for (const Snarl* leaf : leaves) {
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t leaf_number = 0; leaf_number < leaf_order.size(); leaf_number++) {
         // Look at all the leaves
+        const Snarl* leaf = leaf_order[leaf_number];
         
         // Get the contents of the bubble, excluding the boundary nodes
-        leaf_contents[leaf] = site_manager.deep_contents(leaf, graph, false);
+        leaf_contents[leaf_number] = site_manager.deep_contents(leaf, graph, false);
         
         // For each leaf, calculate its total size.
-        unordered_set<Node*>& nodes = leaf_contents[leaf].first;
-        size_t& total_size = leaf_sizes[leaf];
+        unordered_set<Node*>& nodes = leaf_contents[leaf_number].first;
+        size_t& total_size = leaf_sizes[leaf_number];
         for (Node* node : nodes) {
             // For each node include it in the size figure
             total_size += node->sequence().size();
@@ -114,19 +125,19 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         
         // Identify the replacement traversal for the bubble if it's the right size.
         // We can't necessarily do this after we've modified the graph.
-        vector<SnarlTraversal>& traversals = leaf_traversals[leaf];
-        traversals = traversal_finder.find_traversals(*leaf);
+        leaf_traversals[leaf_number] = traversal_finder.find_traversals(*leaf);
     }
     
-    for (const Snarl* leaf : leaves) {
+    for (size_t leaf_number = 0; leaf_number < leaf_order.size(); leaf_number++) {
         // Look at all the leaves
+        const Snarl* leaf = leaf_order[leaf_number];
         
         // Get the contents of the bubble, excluding the boundary nodes
-        unordered_set<Node*>& nodes = leaf_contents[leaf].first;
-        unordered_set<Edge*>& edges = leaf_contents[leaf].second;
+        unordered_set<Node*>& nodes = leaf_contents[leaf_number].first;
+        unordered_set<Edge*>& edges = leaf_contents[leaf_number].second;
         
         // For each leaf, grab its total size.
-        size_t& total_size = leaf_sizes[leaf];
+        size_t& total_size = leaf_sizes[leaf_number];
         
         if (total_size == 0) {
             // This site is just the start and end nodes, so it doesn't make
@@ -149,7 +160,7 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         // Otherwise we want to simplify this site away
         
         // Grab the replacement traversal for the bubble
-        vector<SnarlTraversal>& traversals = leaf_traversals[leaf];
+        vector<SnarlTraversal>& traversals = leaf_traversals[leaf_number];
         
         if (traversals.empty()) {
             // We couldn't find any paths through the site.
@@ -461,36 +472,39 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
                     existing_mappings.reverse();
                 }
                 
-                // Where does the variable region of the site start for this
-                // traversal of the path? If there are no existing mappings,
-                // it's the start mapping's position if we traverse the site
-                // backwards and the end mapping's position if we traverse
-                // the site forwards. If there are existing mappings, it's
-                // the first existing mapping's position in the path. TODO:
-                // This is super ugly. Can we view the site in path
-                // coordinates or something?
-                PathIndex& path_index = *path_indexes.at(path_name).get();
-                mapping_t* mapping_after_first = existing_mappings.empty() ?
-                    (backward ? start_mapping : end_mapping) : existing_mappings.front();
-                assert(path_index.mapping_positions.count(mapping_after_first));
-                size_t variable_start = path_index.mapping_positions.at(mapping_after_first); 
-                
-                
-                
-                // Determine the total length of the old traversal of the site
-                size_t old_site_length = 0;
-                for (auto* mapping : existing_mappings) {
-                    // Add in the lengths of all the mappings that will get
-                    // removed.
-                    old_site_length += mapping->length;
-                }
+                // Only paths with features are indexed, and only they need
+                // to know where the edit is.
+                auto path_index_found = path_indexes.find(path_name);
+                if (path_index_found != path_indexes.end()) {
+                    // Where does the variable region of the site start for this
+                    // traversal of the path? If there are no existing mappings,
+                    // it's the start mapping's position if we traverse the site
+                    // backwards and the end mapping's position if we traverse
+                    // the site forwards. If there are existing mappings, it's
+                    // the first existing mapping's position in the path. TODO:
+                    // This is super ugly. Can we view the site in path
+                    // coordinates or something?
+                    PathIndex& path_index = *path_index_found->second.get();
+                    mapping_t* mapping_after_first = existing_mappings.empty() ?
+                        (backward ? start_mapping : end_mapping) : existing_mappings.front();
+                    assert(path_index.mapping_positions.count(mapping_after_first));
+                    size_t variable_start = path_index.mapping_positions.at(mapping_after_first); 
+                    
+                    // Determine the total length of the old traversal of the site
+                    size_t old_site_length = 0;
+                    for (auto* mapping : existing_mappings) {
+                        // Add in the lengths of all the mappings that will get
+                        // removed.
+                        old_site_length += mapping->length;
+                    }
 #ifdef debug
-                cerr << "Replacing " << old_site_length << " bp at " << variable_start
-                    << " with " << new_site_length << " bp" << endl;
+                    cerr << "Replacing " << old_site_length << " bp at " << variable_start
+                        << " with " << new_site_length << " bp" << endl;
 #endif
 
-                // Actually update any BED features
-                features.on_path_edit(path_name, variable_start, old_site_length, new_site_length);
+                    // Actually update any BED features
+                    features.on_path_edit(path_name, variable_start, old_site_length, new_site_length);
+                }
                 
                 // Where will we insert the new site traversal into the path?
                 list<mapping_t>::iterator insert_position;
@@ -557,9 +571,11 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
                     
                 }
                 
-                // Now we've corrected this site on this path. Update its index.
-                // TODO: right now this means retracing the entire path.
-                path_indexes[path_name].get()->update_mapping_positions(graph, path_name);
+                if (path_index_found != path_indexes.end()) {
+                    // Now we've corrected this site on this path. Update its index.
+                    // TODO: right now this means retracing the entire path.
+                    path_index_found->second->update_mapping_positions(graph, path_name);
+                }
             }
             
             if (kill_path) {
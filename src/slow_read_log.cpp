@@ -0,0 +1,75 @@
+#include "slow_read_log.hpp"
+#include "annotation.hpp"
+#include "stage_stats.hpp"
+#include "stream.hpp"
+
+/**
+ * \file slow_read_log.cpp
+ * Implementations for the log of slow reads.
+ */
+
+namespace vg {
+
+using namespace std;
+
+SlowReadLog::SlowReadLog(ostream& out, double threshold_seconds, const string& parameters) :
+    out(out), threshold_seconds(threshold_seconds), parameters(parameters), logged_count(0) {
+    // Nothing to do
+}
+
+SlowReadLog::~SlowReadLog() {
+    flush();
+}
+
+void SlowReadLog::log(const vector<const Alignment*>& reads, double seconds, size_t lf_steps,
+                      size_t cluster_probes, size_t dp_cells) {
+    if (seconds < threshold_seconds) {
+        return;
+    }
+
+    // annotate copies of the input reads, leaving out anything the mapper
+    // filled in, so they map the same way again
+    vector<Alignment> slow_reads;
+    for (const Alignment* read : reads) {
+        slow_reads.emplace_back();
+        Alignment& slow_read = slow_reads.back();
+        slow_read.set_name(read->name());
+        slow_read.set_sequence(read->sequence());
+        slow_read.set_quality(read->quality());
+
+        set_annotation(&slow_read, "slow_read_seconds", seconds);
+        for (size_t i = 0; i < StageStats::NUM_STAGES; i++) {
+            StageStats::Stage stage = (StageStats::Stage) i;
+            set_annotation(&slow_read, string("slow_read_seconds_") + StageStats::stage_name(stage),
+                           StageStats::read_seconds(stage));
+        }
+        set_annotation(&slow_read, "slow_read_lf_steps", (double) lf_steps);
+        set_annotation(&slow_read, "slow_read_cluster_probes", (double) cluster_probes);
+        set_annotation(&slow_read, "slow_read_dp_cells", (double) dp_cells);
+        set_annotation(&slow_read, "slow_read_parameters", parameters);
+    }
+    logged_count.fetch_add(slow_reads.size(), memory_order_relaxed);
+
+    lock_guard<mutex> guard(buffer_lock);
+    // keep the mates of a pair next to each other
+    for (Alignment& slow_read : slow_reads) {
+        buffer.emplace_back(move(slow_read));
+    }
+    stream::write_buffered(out, buffer, BUFFER_SIZE);
+}
+
+void SlowReadLog::flush() {
+    lock_guard<mutex> guard(buffer_lock);
+    stream::write_buffered(out, buffer, 0);
+    out.flush();
+}
+
+size_t SlowReadLog::logged() const {
+    return logged_count.load();
+}
+
+double SlowReadLog::threshold() const {
+    return threshold_seconds;
+}
+
+}
@@ -0,0 +1,76 @@
+#ifndef VG_SLOW_READ_LOG_HPP_INCLUDED
+#define VG_SLOW_READ_LOG_HPP_INCLUDED
+
+/**
+ * \file slow_read_log.hpp
+ *
+ * A side output for the reads that took the mappers longest, so the reads
+ * behind a drop in throughput can be found, mapped again on their own, and
+ * reported.
+ */
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Writes the input reads that took at least a threshold time to map to a GAM
+ * stream, so they can be mapped again with vg map -G. Each logged read is
+ * annotated with how long it took, the time it spent in each mapping stage
+ * (if the mapper was keeping StageStats), the work the mapper counted for it,
+ * and the parameters it was mapped with. Can be shared by all the threads and
+ * mappers in a process.
+ */
+class SlowReadLog {
+public:
+    /// Log reads that take at least threshold_seconds to map to out. The
+    /// parameters (usually the command line) are noted on every read.
+    SlowReadLog(ostream& out, double threshold_seconds, const string& parameters);
+
+    /// Write out any reads still buffered
+    ~SlowReadLog();
+
+    // We hold a mutex, so we can't be copied.
+    SlowReadLog(const SlowReadLog& other) = delete;
+    SlowReadLog& operator=(const SlowReadLog& other) = delete;
+
+    /// Log a read, or both mates of a pair, that took the given time to map
+    /// on this thread, if that is past the threshold. The stage times come
+    /// from StageStats::read_seconds().
+    void log(const vector<const Alignment*>& reads, double seconds, size_t lf_steps, size_t cluster_probes,
+             size_t dp_cells);
+
+    /// Write out any reads still buffered.
+    void flush();
+
+    /// Get the number of reads logged so far, counting each mate.
+    size_t logged() const;
+
+    /// Get the time a read has to take to be logged.
+    double threshold() const;
+
+private:
+
+    /// Logged reads are written out in groups of this many
+    static const size_t BUFFER_SIZE = 100;
+
+    ostream& out;
+    double threshold_seconds;
+    string parameters;
+
+    mutex buffer_lock;
+    vector<Alignment> buffer;
+    atomic<size_t> logged_count;
+};
+
+}
+
+#endif
@@ -0,0 +1,945 @@
+#include "snarl_distance_index.hpp"
+#include "position.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace vg {
+
+using namespace std;
+
+const int64_t SnarlDistanceIndex::UNKNOWN = -1;
+
+namespace {
+
+/// Marks the start of a serialized index, and its format version
+const char DISTANCE_INDEX_MAGIC[8] = {'V', 'G', 'D', 'I', 'S', 'T', 'X', '1'};
+
+/// Missing ranks in the 32-bit arrays
+const uint32_t NONE_32 = numeric_limits<uint32_t>::max();
+
+/// Distance between things that aren't connected
+const int64_t INFINITE = numeric_limits<int64_t>::max();
+
+/// Net graphs with more sides than this are searched at query time rather
+/// than storing all their distances
+const size_t MAX_MATRIX_SIDES = 256;
+
+/// Side key for a side that doesn't touch anything in its net graph
+const uint64_t NO_SIDE = numeric_limits<uint64_t>::max();
+
+/// Count fields in the header, after the magic
+enum HeaderField {
+    MIN_ID,
+    NODES,
+    NETS,
+    CHAINS,
+    SIDES,
+    EDGES,
+    MATRIX,
+    COLUMNS,
+    HEADER_FIELDS
+};
+
+/// Flags for chains
+const uint8_t UNARY_CHAIN = 1;
+const uint8_t CIRCULAR_CHAIN = 2;
+
+/// Things that happen at a chain's boundary nodes, read in the chain's
+/// orientation: arriving at the node from the snarl on its left or its
+/// right, and leaving it into the snarl on its left or its right. Events are
+/// numbered column * 4 + kind.
+enum ChainEvent {
+    IN_LEFT,
+    IN_RIGHT,
+    OUT_LEFT,
+    OUT_RIGHT
+};
+
+uint32_t event(size_t column, ChainEvent kind) {
+    return column * 4 + kind;
+}
+
+/// Add distances, staying infinite
+int64_t add_distance(int64_t a, int64_t b) {
+    return (a == INFINITE || b == INFINITE) ? INFINITE : a + b;
+}
+
+/// Round a byte count up so the next array is 8-byte aligned
+size_t padded(size_t bytes) {
+    return (bytes + 7) / 8 * 8;
+}
+
+/// Append an array to the serialized data, padded to 8 bytes
+template<typename T>
+void append_array(vector<char>& data, const vector<T>& array) {
+    size_t bytes = array.size() * sizeof(T);
+    size_t start = data.size();
+    data.resize(start + padded(bytes), 0);
+    if (bytes != 0) {
+        memcpy(data.data() + start, array.data(), bytes);
+    }
+}
+
+uint64_t encode(id_t id, bool backward) {
+    return ((uint64_t) id << 1) | (backward ? 1 : 0);
+}
+
+/// Key for the left or right side of a node
+uint64_t side_key(id_t id, bool right) {
+    return ((uint64_t) id << 1) | (right ? 1 : 0);
+}
+
+}
+
+/**
+ * Works out the net graphs and chains bottom up, and then lays them out in
+ * the order the file has them.
+ */
+class SnarlDistanceIndex::Builder {
+public:
+
+    Builder(const HandleGraph& graph, const SnarlManager& manager);
+
+    /// Lay the index out the way a file would be
+    void write(vector<char>& data) const;
+
+private:
+
+    struct Net {
+        size_t ports = 0;
+        uint32_t chain = NONE_32;
+        uint32_t column = 0;
+        bool backward = false;
+        /// Chains directly inside
+        vector<uint32_t> children;
+        /// Node side each side is on, or NO_SIDE
+        vector<uint64_t> sides;
+        vector<uint64_t> edge_start;
+        vector<uint32_t> edges;
+        vector<int64_t> through;
+        vector<int64_t> matrix;
+
+        NetView view() const {
+            NetView view;
+            view.sides = sides.size();
+            view.ports = ports;
+            view.edge_start = edge_start.data();
+            view.edges = edges.data();
+            view.through = through.data();
+            view.matrix = matrix.empty() ? nullptr : matrix.data();
+            return view;
+        }
+    };
+
+    struct ChainRecord {
+        /// Net graph of the snarl it is in, or NONE_32 at the top level
+        uint32_t parent = NONE_32;
+        /// Net graphs of its snarls, in order
+        vector<uint32_t> snarls;
+        vector<uint64_t> nodes;
+        vector<int64_t> lengths;
+        vector<int64_t> prefix;
+        vector<uint32_t> blocks;
+        vector<int64_t> loop_forward;
+        vector<int64_t> loop_backward;
+        uint8_t flags = 0;
+        /// Where it is placed in a net graph
+        uint32_t net = NONE_32;
+        uint32_t rank = NONE_32;
+
+        ChainView view() const {
+            ChainView view;
+            view.columns = nodes.size();
+            view.lengths = lengths.data();
+            view.prefix = prefix.data();
+            view.blocks = blocks.data();
+            view.loop_forward = loop_forward.data();
+            view.loop_backward = loop_backward.data();
+            return view;
+        }
+    };
+
+    /// Record the chains under a snarl, or the top-level chains
+    void add_chains(const SnarlManager& manager, const Snarl* parent, uint32_t parent_net);
+
+    /// Work out a chain and everything in it
+    void build_chain(uint32_t chain);
+
+    /// Work out a snarl's net graph and everything in it
+    void build_snarl(uint32_t net);
+
+    /// Find the sides and edges of a net graph, starting from its ports and
+    /// the given chains and node
+    void fill_net(uint32_t net, const vector<uint32_t>& start_chains, id_t start_node);
+
+    /// Get the index of a node in the node arrays, checking that it is in
+    /// the graph's ID range
+    size_t slot(id_t id) const;
+
+    const HandleGraph& graph;
+    vector<Net> nets;
+    vector<ChainRecord> chains;
+
+    id_t min_id = 0;
+    /// Chain each node is a boundary of, net graph it is in otherwise, and
+    /// its column or rank there
+    vector<uint32_t> node_chain;
+    vector<uint32_t> node_net;
+    vector<uint32_t> node_rank;
+};
+
+SnarlDistanceIndex::Builder::Builder(const HandleGraph& graph, const SnarlManager& manager) : graph(graph) {
+
+    // Find the ID range
+    vector<id_t> ids;
+    graph.for_each_handle([&](const handle_t& handle) {
+        ids.push_back(graph.get_id(handle));
+    });
+    sort(ids.begin(), ids.end());
+    if (!ids.empty()) {
+        min_id = ids.front();
+        node_chain.resize(ids.back() - min_id + 1, NONE_32);
+        node_net.resize(node_chain.size(), NONE_32);
+        node_rank.resize(node_chain.size(), NONE_32);
+    }
+
+    add_chains(manager, nullptr, NONE_32);
+
+    // Claim the chain boundary nodes
+    for (uint32_t c = 0; c < chains.size(); c++) {
+        ChainRecord& chain = chains[c];
+        for (uint32_t column = 0; column < chain.nodes.size(); column++) {
+            id_t id = chain.nodes[column] >> 1;
+            size_t s = slot(id);
+            if (node_chain[s] == NONE_32) {
+                node_chain[s] = c;
+                node_rank[s] = column;
+            } else if (node_chain[s] != c) {
+                throw runtime_error("[SnarlDistanceIndex] node " + to_string(id) + " bounds two chains");
+            } else if (chain.nodes.size() == 2 && chain.nodes[1] == (chain.nodes[0] ^ 1)) {
+                // A unary snarl ends on its start node, read backward.
+                chain.flags |= UNARY_CHAIN;
+            } else {
+                chain.flags |= CIRCULAR_CHAIN;
+            }
+            chain.lengths.push_back(graph.get_length(graph.get_handle(id, false)));
+        }
+    }
+
+    for (uint32_t c = 0; c < chains.size(); c++) {
+        if (chains[c].parent == NONE_32) {
+            build_chain(c);
+        }
+    }
+
+    // Whatever isn't in a snarl makes up the top level, one net graph per
+    // connected component
+    for (id_t id : ids) {
+        size_t s = slot(id);
+        if (node_chain[s] != NONE_32) {
+            uint32_t c = node_chain[s];
+            if (chains[c].parent == NONE_32 && chains[c].net == NONE_32) {
+                nets.emplace_back();
+                fill_net(nets.size() - 1, vector<uint32_t>{c}, 0);
+            }
+        } else if (node_net[s] == NONE_32) {
+            nets.emplace_back();
+            fill_net(nets.size() - 1, vector<uint32_t>(), id);
+        }
+    }
+}
+
+size_t SnarlDistanceIndex::Builder::slot(id_t id) const {
+    if (id < min_id || id - min_id >= (id_t) node_chain.size()) {
+        throw runtime_error("[SnarlDistanceIndex] node " + to_string(id) + " is not in the graph");
+    }
+    return id - min_id;
+}
+
+void SnarlDistanceIndex::Builder::add_chains(const SnarlManager& manager, const Snarl* parent, uint32_t parent_net) {
+    for (const Chain& chain : manager.chains_of(parent)) {
+        if (chain.empty()) {
+            continue;
+        }
+        uint32_t c = chains.size();
+        chains.emplace_back();
+        chains[c].parent = parent_net;
+        if (parent_net != NONE_32) {
+            nets[parent_net].children.push_back(c);
+        }
+
+        vector<const Snarl*> members;
+        for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
+            const Snarl* snarl = it->first;
+            bool backward = it->second;
+            if (members.empty()) {
+                // The left boundary of the first snarl starts the chain
+                const Visit& left = backward ? snarl->end() : snarl->start();
+                chains[c].nodes.push_back(encode(left.node_id(), left.backward() != backward));
+            }
+            const Visit& right = backward ? snarl->start() : snarl->end();
+            chains[c].nodes.push_back(encode(right.node_id(), right.backward() != backward));
+
+            uint32_t n = nets.size();
+            nets.emplace_back();
+            nets[n].chain = c;
+            nets[n].column = chains[c].nodes.size() - 1;
+            nets[n].backward = backward;
+            chains[c].snarls.push_back(n);
+            members.push_back(snarl);
+        }
+
+        for (size_t i = 0; i < members.size(); i++) {
+            add_chains(manager, members[i], chains[c].snarls[i]);
+        }
+    }
+}
+
+void SnarlDistanceIndex::Builder::build_chain(uint32_t c) {
+    for (uint32_t net : chains[c].snarls) {
+        build_snarl(net);
+    }
+
+    ChainRecord& chain = chains[c];
+    size_t columns = chain.nodes.size();
+    size_t last = columns - 1;
+    chain.prefix.assign(columns, 0);
+    chain.blocks.assign(columns, 0);
+    chain.loop_forward.assign(columns, INFINITE);
+    chain.loop_backward.assign(columns, INFINITE);
+    if (chain.flags & CIRCULAR_CHAIN) {
+        // Queries through circular chains aren't answered.
+        return;
+    }
+
+    // Crossing each snarl left to right, and turning back inside it at
+    // either end
+    vector<int64_t> across(columns, INFINITE);
+    vector<int64_t> turn_left(columns, INFINITE);
+    vector<int64_t> turn_right(columns, INFINITE);
+    vector<int64_t> arrivals;
+    for (size_t i = 1; i <= last; i++) {
+        const Net& net = nets[chain.snarls[i - 1]];
+        uint32_t left_port = (net.ports == 1 || !net.backward) ? 0 : 1;
+        uint32_t right_port = net.ports == 1 ? 0 : 1 - left_port;
+        net_arrivals(net.view(), vector<pair<uint32_t, int64_t>>{make_pair(left_port, 0)}, arrivals);
+        across[i] = arrivals[right_port];
+        turn_left[i] = arrivals[left_port];
+        net_arrivals(net.view(), vector<pair<uint32_t, int64_t>>{make_pair(right_port, 0)}, arrivals);
+        turn_right[i] = arrivals[right_port];
+    }
+
+    chain.prefix[0] = chain.lengths[0];
+    for (size_t i = 1; i <= last; i++) {
+        bool blocked = across[i] == INFINITE;
+        chain.blocks[i] = chain.blocks[i - 1] + (blocked ? 1 : 0);
+        chain.prefix[i] = chain.prefix[i - 1] + (blocked ? 0 : across[i]) + chain.lengths[i];
+    }
+    for (size_t i = last; i-- > 0;) {
+        // Turn in the next snarl, or go past it and come back
+        int64_t further = add_distance(add_distance(across[i + 1], chain.lengths[i + 1]), chain.loop_forward[i + 1]);
+        chain.loop_forward[i] = min(turn_left[i + 1], add_distance(further, add_distance(chain.lengths[i + 1], across[i + 1])));
+    }
+    for (size_t i = 1; i <= last; i++) {
+        int64_t further = add_distance(add_distance(across[i], chain.lengths[i - 1]), chain.loop_backward[i - 1]);
+        chain.loop_backward[i] = min(turn_right[i], add_distance(further, add_distance(chain.lengths[i - 1], across[i])));
+    }
+}
+
+void SnarlDistanceIndex::Builder::build_snarl(uint32_t n) {
+    for (uint32_t child : nets[n].children) {
+        build_chain(child);
+    }
+    fill_net(n, nets[n].children, 0);
+}
+
+void SnarlDistanceIndex::Builder::fill_net(uint32_t n, const vector<uint32_t>& start_chains, id_t start_node) {
+    vector<uint64_t>& sides = nets[n].sides;
+    vector<int64_t>& through = nets[n].through;
+    unordered_map<uint64_t, uint32_t> local;
+    vector<vector<uint32_t>> adjacency;
+    vector<uint32_t> to_explore;
+
+    auto add_side = [&](uint64_t key, int64_t to_left, int64_t to_right) {
+        uint32_t side = sides.size();
+        sides.push_back(key);
+        through.push_back(to_left);
+        through.push_back(to_right);
+        adjacency.emplace_back();
+        if (key != NO_SIDE) {
+            local[key] = side;
+            to_explore.push_back(side);
+        }
+    };
+
+    // The snarl's boundary nodes, facing in
+    if (nets[n].chain != NONE_32) {
+        const ChainRecord& chain = chains[nets[n].chain];
+        uint64_t left = chain.nodes[nets[n].column - 1];
+        uint64_t right = chain.nodes[nets[n].column];
+        uint64_t left_key = side_key(left >> 1, !(left & 1));
+        uint64_t right_key = side_key(right >> 1, right & 1);
+        // Ports are numbered by the snarl's own start and end.
+        uint64_t start_key = nets[n].backward ? right_key : left_key;
+        uint64_t end_key = nets[n].backward ? left_key : right_key;
+        add_side(start_key, INFINITE, INFINITE);
+        if (end_key != start_key) {
+            add_side(end_key, INFINITE, INFINITE);
+        }
+        nets[n].ports = sides.size();
+    }
+
+    auto add_chain = [&](uint32_t c) {
+        ChainRecord& chain = chains[c];
+        chain.net = n;
+        chain.rank = (sides.size() - nets[n].ports) / 2;
+        size_t last = chain.nodes.size() - 1;
+        ChainView view = chain.view();
+        int64_t left_left = INFINITE, left_right = INFINITE, right_left = INFINITE, right_right = INFINITE;
+        if (!(chain.flags & CIRCULAR_CHAIN)) {
+            left_left = chain_distance(view, event(0, IN_LEFT), event(0, OUT_LEFT));
+            left_right = chain_distance(view, event(0, IN_LEFT), event(last, OUT_RIGHT));
+            right_left = chain_distance(view, event(last, IN_RIGHT), event(0, OUT_LEFT));
+            right_right = chain_distance(view, event(last, IN_RIGHT), event(last, OUT_RIGHT));
+        }
+        uint64_t left_key = side_key(chain.nodes[0] >> 1, chain.nodes[0] & 1);
+        uint64_t right_key = side_key(chain.nodes[last] >> 1, !(chain.nodes[last] & 1));
+        if (chain.flags & CIRCULAR_CHAIN) {
+            // Both ends face into its own snarls.
+            add_side(NO_SIDE, INFINITE, INFINITE);
+            add_side(NO_SIDE, INFINITE, INFINITE);
+        } else if (chain.flags & UNARY_CHAIN) {
+            // Both ends are the same side of the same node.
+            int64_t best = min(min(left_left, left_right), min(right_left, right_right));
+            add_side(left_key, best, INFINITE);
+            add_side(NO_SIDE, INFINITE, INFINITE);
+        } else {
+            add_side(left_key, left_left, left_right);
+            add_side(right_key, right_left, right_right);
+        }
+    };
+
+    auto add_node = [&](id_t id) {
+        size_t s = slot(id);
+        node_net[s] = n;
+        node_rank[s] = (sides.size() - nets[n].ports) / 2;
+        int64_t length = graph.get_length(graph.get_handle(id, false));
+        add_side(side_key(id, false), INFINITE, length);
+        add_side(side_key(id, true), length, INFINITE);
+    };
+
+    for (uint32_t c : start_chains) {
+        if (chains[c].net == NONE_32) {
+            add_chain(c);
+        }
+    }
+    if (start_node != 0) {
+        add_node(start_node);
+    }
+
+    // Follow edges out of every side we find, adding what is on the other
+    // end
+    while (!to_explore.empty()) {
+        uint32_t side = to_explore.back();
+        to_explore.pop_back();
+        uint64_t key = sides[side];
+        handle_t leaving = graph.get_handle(key >> 1, !(key & 1));
+        graph.follow_edges(leaving, false, [&](const handle_t& next) {
+            id_t id = graph.get_id(next);
+            uint64_t next_key = side_key(id, graph.get_is_reverse(next));
+            auto found = local.find(next_key);
+            if (found == local.end()) {
+                size_t s = slot(id);
+                if (node_chain[s] != NONE_32 && chains[node_chain[s]].parent == (nets[n].chain == NONE_32 ? NONE_32 : n)
+                    && chains[node_chain[s]].net == NONE_32) {
+                    add_chain(node_chain[s]);
+                } else if (node_chain[s] == NONE_32 && node_net[s] == NONE_32) {
+                    add_node(id);
+                }
+                found = local.find(next_key);
+                if (found == local.end()) {
+                    throw runtime_error("[SnarlDistanceIndex] snarls do not match the graph at node " + to_string(id));
+                }
+            }
+            adjacency[side].push_back(found->second);
+        });
+    }
+
+    Net& net = nets[n];
+    net.edge_start.push_back(0);
+    for (auto& targets : adjacency) {
+        net.edges.insert(net.edges.end(), targets.begin(), targets.end());
+        net.edge_start.push_back(net.edges.size());
+    }
+    if (net.sides.size() <= MAX_MATRIX_SIDES) {
+        vector<int64_t> matrix;
+        vector<int64_t> arrivals;
+        for (uint32_t side = 0; side < net.sides.size(); side++) {
+            net_arrivals(net.view(), vector<pair<uint32_t, int64_t>>{make_pair(side, 0)}, arrivals);
+            matrix.insert(matrix.end(), arrivals.begin(), arrivals.end());
+        }
+        net.matrix = move(matrix);
+    }
+}
+
+void SnarlDistanceIndex::Builder::write(vector<char>& data) const {
+    vector<uint32_t> node_owner_array(node_chain.size(), NONE_32);
+    for (size_t s = 0; s < node_chain.size(); s++) {
+        if (node_chain[s] != NONE_32) {
+            node_owner_array[s] = nets.size() + node_chain[s];
+        } else {
+            node_owner_array[s] = node_net[s];
+        }
+    }
+
+    vector<uint64_t> net_side_array{0};
+    vector<uint64_t> net_matrix_array{0};
+    vector<uint32_t> net_chain_array;
+    vector<uint32_t> net_column_array;
+    vector<uint8_t> net_port_array;
+    vector<uint8_t> net_backward_array;
+    vector<uint64_t> side_edge_array{0};
+    vector<uint32_t> edge_array;
+    vector<int64_t> through_array;
+    vector<int64_t> matrix_array;
+    for (const Net& net : nets) {
+        for (size_t side = 0; side < net.sides.size(); side++) {
+            side_edge_array.push_back(edge_array.size() + net.edge_start[side + 1]);
+        }
+        edge_array.insert(edge_array.end(), net.edges.begin(), net.edges.end());
+        through_array.insert(through_array.end(), net.through.begin(), net.through.end());
+        matrix_array.insert(matrix_array.end(), net.matrix.begin(), net.matrix.end());
+        net_side_array.push_back(net_side_array.back() + net.sides.size());
+        net_matrix_array.push_back(matrix_array.size());
+        net_chain_array.push_back(net.chain);
+        net_column_array.push_back(net.column);
+        net_port_array.push_back(net.ports);
+        net_backward_array.push_back(net.backward);
+    }
+
+    vector<uint64_t> chain_column_array{0};
+    vector<uint32_t> chain_net_array;
+    vector<uint32_t> chain_rank_array;
+    vector<uint8_t> chain_flag_array;
+    vector<uint64_t> column_node_array;
+    vector<int64_t> column_length_array;
+    vector<int64_t> column_prefix_array;
+    vector<uint32_t> column_block_array;
+    vector<int64_t> column_forward_array;
+    vector<int64_t> column_backward_array;
+    for (const ChainRecord& chain : chains) {
+        column_node_array.insert(column_node_array.end(), chain.nodes.begin(), chain.nodes.end());
+        column_length_array.insert(column_length_array.end(), chain.lengths.begin(), chain.lengths.end());
+        column_prefix_array.insert(column_prefix_array.end(), chain.prefix.begin(), chain.prefix.end());
+        column_block_array.insert(column_block_array.end(), chain.blocks.begin(), chain.blocks.end());
+        column_forward_array.insert(column_forward_array.end(), chain.loop_forward.begin(), chain.loop_forward.end());
+        column_backward_array.insert(column_backward_array.end(), chain.loop_backward.begin(), chain.loop_backward.end());
+        chain_column_array.push_back(column_node_array.size());
+        chain_net_array.push_back(chain.net);
+        chain_rank_array.push_back(chain.rank);
+        chain_flag_array.push_back(chain.flags);
+    }
+
+    vector<uint64_t> header(HEADER_FIELDS);
+    header[MIN_ID] = min_id;
+    header[NODES] = node_chain.size();
+    header[NETS] = nets.size();
+    header[CHAINS] = chains.size();
+    header[SIDES] = net_side_array.back();
+    header[EDGES] = edge_array.size();
+    header[MATRIX] = matrix_array.size();
+    header[COLUMNS] = column_node_array.size();
+    data.assign(DISTANCE_INDEX_MAGIC, DISTANCE_INDEX_MAGIC + sizeof(DISTANCE_INDEX_MAGIC));
+    append_array(data, header);
+    append_array(data, node_owner_array);
+    append_array(data, node_rank);
+    append_array(data, net_side_array);
+    append_array(data, net_matrix_array);
+    append_array(data, net_chain_array);
+    append_array(data, net_column_array);
+    append_array(data, side_edge_array);
+    append_array(data, edge_array);
+    append_array(data, through_array);
+    append_array(data, matrix_array);
+    append_array(data, chain_column_array);
+    append_array(data, chain_net_array);
+    append_array(data, chain_rank_array);
+    append_array(data, column_node_array);
+    append_array(data, column_length_array);
+    append_array(data, column_prefix_array);
+    append_array(data, column_block_array);
+    append_array(data, column_forward_array);
+    append_array(data, column_backward_array);
+    append_array(data, net_port_array);
+    append_array(data, net_backward_array);
+    append_array(data, chain_flag_array);
+}
+
+SnarlDistanceIndex::SnarlDistanceIndex(const HandleGraph& graph, const SnarlManager& manager) {
+    Builder(graph, manager).write(owned);
+    attach(owned.data(), owned.size());
+}
+
+SnarlDistanceIndex::SnarlDistanceIndex(const string& filename) : mapping(new MappedFileBuffer(filename)) {
+    if (mapping->is_open()) {
+        attach(mapping->data(), mapping->size());
+    } else {
+        // Can't be mapped, so read it in as a normal file.
+        mapping.reset();
+        ifstream in(filename, ios_base::in | ios_base::binary);
+        if (!in) {
+            throw runtime_error("[SnarlDistanceIndex] could not open " + filename);
+        }
+        owned.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        attach(owned.data(), owned.size());
+    }
+}
+
+SnarlDistanceIndex::SnarlDistanceIndex(istream& in) {
+    owned.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    attach(owned.data(), owned.size());
+}
+
+void SnarlDistanceIndex::attach(const char* data, size_t length) {
+    const size_t header_bytes = sizeof(DISTANCE_INDEX_MAGIC) + HEADER_FIELDS * sizeof(uint64_t);
+    if ((((uintptr_t) data) & 7) != 0) {
+        throw runtime_error("[SnarlDistanceIndex] index data is not aligned");
+    }
+    if (length < header_bytes || memcmp(data, DISTANCE_INDEX_MAGIC, sizeof(DISTANCE_INDEX_MAGIC)) != 0) {
+        throw runtime_error("[SnarlDistanceIndex] not a distance index");
+    }
+    const uint64_t* header = (const uint64_t*) (data + sizeof(DISTANCE_INDEX_MAGIC));
+    min_id = header[MIN_ID];
+    nodes = header[NODES];
+    nets = header[NETS];
+    chains = header[CHAINS];
+    size_t sides = header[SIDES];
+    size_t edge_count = header[EDGES];
+    size_t matrix_count = header[MATRIX];
+    size_t columns = header[COLUMNS];
+
+    // Walk through the arrays in file order, checking that each one fits.
+    size_t cursor = header_bytes;
+    auto next_array = [&](size_t count, size_t item_bytes) {
+        const char* start = data + cursor;
+        size_t bytes = padded(count * item_bytes);
+        if (bytes > length - cursor) {
+            throw runtime_error("[SnarlDistanceIndex] index is truncated");
+        }
+        cursor += bytes;
+        return start;
+    };
+    node_owners = (const uint32_t*) next_array(nodes, sizeof(uint32_t));
+    node_ranks = (const uint32_t*) next_array(nodes, sizeof(uint32_t));
+    net_side_start = (const uint64_t*) next_array(nets + 1, sizeof(uint64_t));
+    net_matrix_start = (const uint64_t*) next_array(nets + 1, sizeof(uint64_t));
+    net_chains = (const uint32_t*) next_array(nets, sizeof(uint32_t));
+    net_columns = (const uint32_t*) next_array(nets, sizeof(uint32_t));
+    side_edge_start = (const uint64_t*) next_array(sides + 1, sizeof(uint64_t));
+    edges = (const uint32_t*) next_array(edge_count, sizeof(uint32_t));
+    through = (const int64_t*) next_array(2 * sides, sizeof(int64_t));
+    matrices = (const int64_t*) next_array(matrix_count, sizeof(int64_t));
+    chain_column_start = (const uint64_t*) next_array(chains + 1, sizeof(uint64_t));
+    chain_nets = (const uint32_t*) next_array(chains, sizeof(uint32_t));
+    chain_ranks = (const uint32_t*) next_array(chains, sizeof(uint32_t));
+    column_nodes = (const uint64_t*) next_array(columns, sizeof(uint64_t));
+    column_lengths = (const int64_t*) next_array(columns, sizeof(int64_t));
+    column_prefix = (const int64_t*) next_array(columns, sizeof(int64_t));
+    column_blocks = (const uint32_t*) next_array(columns, sizeof(uint32_t));
+    column_loop_forward = (const int64_t*) next_array(columns, sizeof(int64_t));
+    column_loop_backward = (const int64_t*) next_array(columns, sizeof(int64_t));
+    net_ports = (const uint8_t*) next_array(nets, sizeof(uint8_t));
+    net_backward = (const uint8_t*) next_array(nets, sizeof(uint8_t));
+    chain_flags = (const uint8_t*) next_array(chains, sizeof(uint8_t));
+}
+
+void SnarlDistanceIndex::serialize(ostream& out) const {
+    if (mapping) {
+        out.write(mapping->data(), mapping->size());
+    } else {
+        out.write(owned.data(), owned.size());
+    }
+}
+
+SnarlDistanceIndex::NetView SnarlDistanceIndex::net_view(size_t net) const {
+    NetView view;
+    size_t start = net_side_start[net];
+    view.sides = net_side_start[net + 1] - start;
+    view.ports = net_ports[net];
+    view.edge_start = side_edge_start + start;
+    view.edges = edges;
+    view.through = through + 2 * start;
+    view.matrix = net_matrix_start[net + 1] == net_matrix_start[net] ? nullptr : matrices + net_matrix_start[net];
+    return view;
+}
+
+SnarlDistanceIndex::ChainView SnarlDistanceIndex::chain_view(size_t chain) const {
+    ChainView view;
+    size_t start = chain_column_start[chain];
+    view.columns = chain_column_start[chain + 1] - start;
+    view.lengths = column_lengths + start;
+    view.prefix = column_prefix + start;
+    view.blocks = column_blocks + start;
+    view.loop_forward = column_loop_forward + start;
+    view.loop_backward = column_loop_backward + start;
+    return view;
+}
+
+void SnarlDistanceIndex::net_arrivals(const NetView& net, const vector<pair<uint32_t, int64_t>>& sources,
+                                      vector<int64_t>& arrivals) {
+    arrivals.assign(net.sides, INFINITE);
+    if (net.matrix != nullptr) {
+        for (auto& source : sources) {
+            const int64_t* row = net.matrix + source.first * net.sides;
+            for (size_t side = 0; side < net.sides; side++) {
+                arrivals[side] = min(arrivals[side], add_distance(source.second, row[side]));
+            }
+        }
+        return;
+    }
+
+    // Nearest first over arrivals at sides. Ports end the search, and
+    // anything else can be gone through and left by either of its sides.
+    priority_queue<pair<int64_t, uint32_t>, vector<pair<int64_t, uint32_t>>, greater<pair<int64_t, uint32_t>>> queue;
+    auto leave = [&](uint32_t side, int64_t distance) {
+        for (uint64_t i = net.edge_start[side]; i < net.edge_start[side + 1]; i++) {
+            queue.emplace(distance, net.edges[i]);
+        }
+    };
+    for (auto& source : sources) {
+        if (source.second != INFINITE) {
+            leave(source.first, source.second);
+        }
+    }
+    while (!queue.empty()) {
+        int64_t distance = queue.top().first;
+        uint32_t side = queue.top().second;
+        queue.pop();
+        if (arrivals[side] != INFINITE) {
+            continue;
+        }
+        arrivals[side] = distance;
+        if (side < net.ports) {
+            continue;
+        }
+        uint32_t left = side - (side - net.ports) % 2;
+        for (uint32_t out = 0; out < 2; out++) {
+            int64_t cost = net.through[2 * side + out];
+            if (cost != INFINITE) {
+                leave(left + out, distance + cost);
+            }
+        }
+    }
+}
+
+int64_t SnarlDistanceIndex::chain_distance(const ChainView& chain, uint32_t from, uint32_t to) {
+    if (from == to) {
+        return 0;
+    }
+    size_t i = from / 4;
+    size_t j = to / 4;
+    ChainEvent from_kind = (ChainEvent) (from % 4);
+    ChainEvent to_kind = (ChainEvent) (to % 4);
+
+    // Arriving at a node means going through it next, and leaving one means
+    // arriving at it and going through it first.
+    if (from_kind == IN_LEFT) {
+        return add_distance(chain.lengths[i], chain_distance(chain, event(i, OUT_RIGHT), to));
+    }
+    if (from_kind == IN_RIGHT) {
+        return add_distance(chain.lengths[i], chain_distance(chain, event(i, OUT_LEFT), to));
+    }
+    if (to_kind == OUT_LEFT) {
+        return add_distance(chain_distance(chain, from, event(j, IN_RIGHT)), chain.lengths[j]);
+    }
+    if (to_kind == OUT_RIGHT) {
+        return add_distance(chain_distance(chain, from, event(j, IN_LEFT)), chain.lengths[j]);
+    }
+
+    // From leaving a node to arriving at one. Going straight between two
+    // columns needs every snarl between them to be crossable; going the
+    // other way needs turning around first.
+    if (chain.blocks[min(i, j)] != chain.blocks[max(i, j)]) {
+        return INFINITE;
+    }
+    const int64_t* prefix = chain.prefix;
+    auto arrive = [&](size_t column) {
+        // Distance from entering the chain to arriving at a column from the left
+        return prefix[column] - chain.lengths[column];
+    };
+    if (from_kind == OUT_RIGHT) {
+        if (to_kind == IN_LEFT) {
+            if (j > i) {
+                return arrive(j) - prefix[i];
+            }
+            return add_distance(add_distance(chain.loop_forward[i], prefix[i] - arrive(j)), chain.loop_backward[j]);
+        }
+        if (j >= i) {
+            return add_distance(prefix[j] - prefix[i], chain.loop_forward[j]);
+        }
+        return add_distance(chain.loop_forward[i], prefix[i] - prefix[j]);
+    }
+    if (to_kind == IN_RIGHT) {
+        if (j < i) {
+            return arrive(i) - prefix[j];
+        }
+        return add_distance(add_distance(chain.loop_backward[i], prefix[j] - arrive(i)), chain.loop_forward[j]);
+    }
+    if (j <= i) {
+        return add_distance(arrive(i) - arrive(j), chain.loop_backward[j]);
+    }
+    return add_distance(chain.loop_backward[i], arrive(j) - arrive(i));
+}
+
+bool SnarlDistanceIndex::climb(const pos_t& pos, bool from, vector<Level>& levels) const {
+    levels.clear();
+    if (id(pos) < min_id || id(pos) - min_id >= (id_t) nodes) {
+        return false;
+    }
+    size_t slot = id(pos) - min_id;
+    if (node_owners[slot] == NONE_32) {
+        return false;
+    }
+
+    // Start from the node: leaving it forward, or arriving at it
+    Level level;
+    level.tree = node_owners[slot];
+    size_t rank = node_ranks[slot];
+    if (level.tree < nets) {
+        NetView net = net_view(level.tree);
+        uint32_t left = net.ports + 2 * rank;
+        int64_t length = net.through[2 * left + 1];
+        if (from) {
+            level.items.emplace_back(is_rev(pos) ? left : left + 1, length - offset(pos));
+        } else {
+            level.items.emplace_back(is_rev(pos) ? left + 1 : left, offset(pos));
+        }
+    } else {
+        size_t start = chain_column_start[level.tree - nets];
+        int64_t length = column_lengths[start + rank];
+        bool along = is_rev(pos) == (bool) (column_nodes[start + rank] & 1);
+        if (from) {
+            level.items.emplace_back(event(rank, along ? OUT_RIGHT : OUT_LEFT), length - offset(pos));
+        } else {
+            level.items.emplace_back(event(rank, along ? IN_LEFT : IN_RIGHT), offset(pos));
+        }
+    }
+    levels.push_back(level);
+
+    vector<int64_t> arrivals;
+    while (true) {
+        size_t tree = levels.back().tree;
+        Level up;
+        if (tree < nets) {
+            size_t ports = net_ports[tree];
+            if (ports == 0) {
+                // At the top
+                break;
+            }
+            // Out of the snarl, or into it, at the boundary nodes. Distances
+            // are the same both ways, so arrivals work for either.
+            net_arrivals(net_view(tree), levels.back().items, arrivals);
+            size_t column = net_columns[tree];
+            up.tree = nets + net_chains[tree];
+            for (size_t port = 0; port < ports; port++) {
+                if (arrivals[port] == INFINITE) {
+                    continue;
+                }
+                bool at_left = ports == 1 || (port == 0) != (bool) net_backward[tree];
+                if (at_left) {
+                    up.items.emplace_back(event(column - 1, from ? IN_RIGHT : OUT_RIGHT), arrivals[port]);
+                } else {
+                    up.items.emplace_back(event(column, from ? IN_LEFT : OUT_LEFT), arrivals[port]);
+                }
+            }
+        } else {
+            size_t chain = tree - nets;
+            if (chain_flags[chain] & CIRCULAR_CHAIN) {
+                return false;
+            }
+            ChainView view = chain_view(chain);
+            size_t last = view.columns - 1;
+            int64_t to_left = INFINITE;
+            int64_t to_right = INFINITE;
+            for (auto& item : levels.back().items) {
+                if (from) {
+                    to_left = min(to_left, add_distance(item.second, chain_distance(view, item.first, event(0, OUT_LEFT))));
+                    to_right = min(to_right, add_distance(item.second, chain_distance(view, item.first, event(last, OUT_RIGHT))));
+                } else {
+                    to_left = min(to_left, add_distance(chain_distance(view, event(0, IN_LEFT), item.first), item.second));
+                    to_right = min(to_right, add_distance(chain_distance(view, event(last, IN_RIGHT), item.first), item.second));
+                }
+            }
+            if (chain_flags[chain] & UNARY_CHAIN) {
+                // Both ends are the same side.
+                to_left = min(to_left, to_right);
+                to_right = INFINITE;
+            }
+            up.tree = chain_nets[chain];
+            uint32_t left = net_ports[up.tree] + 2 * chain_ranks[chain];
+            if (to_left != INFINITE) {
+                up.items.emplace_back(left, to_left);
+            }
+            if (to_right != INFINITE) {
+                up.items.emplace_back(left + 1, to_right);
+            }
+        }
+        levels.push_back(move(up));
+    }
+    return true;
+}
+
+int64_t SnarlDistanceIndex::join(const Level& from, const Level& to) const {
+    int64_t best = INFINITE;
+    if (from.tree < nets) {
+        vector<int64_t> arrivals;
+        net_arrivals(net_view(from.tree), from.items, arrivals);
+        for (auto& item : to.items) {
+            best = min(best, add_distance(arrivals[item.first], item.second));
+        }
+    } else {
+        ChainView view = chain_view(from.tree - nets);
+        for (auto& source : from.items) {
+            for (auto& target : to.items) {
+                best = min(best, add_distance(add_distance(source.second, chain_distance(view, source.first, target.first)),
+                                              target.second));
+            }
+        }
+    }
+    return best;
+}
+
+int64_t SnarlDistanceIndex::min_distance(const pos_t& pos1, const pos_t& pos2) const {
+    if (pos1 == pos2) {
+        return 0;
+    }
+    vector<Level> from;
+    vector<Level> to;
+    if (!climb(pos1, true, from) || !climb(pos2, false, to)) {
+        return UNKNOWN;
+    }
+    int64_t best = INFINITE;
+    if (id(pos1) == id(pos2) && is_rev(pos1) == is_rev(pos2) && offset(pos2) > offset(pos1)) {
+        // straight along the node
+        best = offset(pos2) - offset(pos1);
+    }
+    // The paths between the positions can go as high as the top of the tree,
+    // but no lower than where their ancestors meet.
+    auto a = from.rbegin();
+    auto b = to.rbegin();
+    while (a != from.rend() && b != to.rend() && a->tree == b->tree) {
+        best = min(best, join(*a, *b));
+        ++a;
+        ++b;
+    }
+    return best;
+}
+
+}
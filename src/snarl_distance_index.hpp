@@ -0,0 +1,196 @@
+#ifndef VG_SNARL_DISTANCE_INDEX_HPP_INCLUDED
+#define VG_SNARL_DISTANCE_INDEX_HPP_INCLUDED
+
+/**
+ * \file snarl_distance_index.hpp
+ *
+ * A precomputed minimum distance index over a snarl tree, for answering the
+ * exact distance queries that the mappers otherwise answer by searching the
+ * graph. It is laid out like the snarl tree index, as flat arrays that can be
+ * memory-mapped from disk.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "types.hpp"
+#include "handle.hpp"
+#include "snarls.hpp"
+#include "mapped_file.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Each snarl is stored as its net graph: its boundary sides (the ports), and
+ * two sides for each node and child chain inside it, with the edges between
+ * them. Small net graphs also keep the distance from every side to every
+ * other side; bigger ones are searched when queried. Each chain keeps prefix
+ * sums of the distances across its snarls, and the shortest way to turn
+ * around to either side of each boundary node, so distances along a chain
+ * take a few lookups however long it is. The nodes and chains outside of all
+ * snarls form one more net graph, without ports, for each of their connected
+ * components.
+ *
+ * A query climbs the tree from both positions, working out the distances to
+ * the sides of each enclosing snarl and chain, and takes the best way of
+ * joining the two at their lowest common ancestor or any ancestor above it.
+ */
+class SnarlDistanceIndex {
+public:
+
+    /// Returned by queries the index can't answer
+    static const int64_t UNKNOWN;
+
+    /// Index the minimum distances in a graph, using the snarls in a
+    /// SnarlManager that was made for it
+    SnarlDistanceIndex(const HandleGraph& graph, const SnarlManager& manager);
+
+    /// Load an index from a file, memory-mapping it if possible
+    SnarlDistanceIndex(const string& filename);
+
+    /// Load an index from a stream, copying it into memory
+    SnarlDistanceIndex(istream& in);
+
+    // We point into our own storage, so we can't be copied.
+    SnarlDistanceIndex(const SnarlDistanceIndex& other) = delete;
+    SnarlDistanceIndex& operator=(const SnarlDistanceIndex& other) = delete;
+
+    /// Write the index in the format the loading constructors read
+    void serialize(ostream& out) const;
+
+    /// Get the minimum distance from one position to another, measured the
+    /// way xg_distance measures it: along the node if the second position is
+    /// ahead on the same strand, and otherwise the rest of the first node,
+    /// plus the nodes in between, plus the offset into the last node. Returns
+    /// numeric_limits<int64_t>::max() if the second position can't be
+    /// reached, and UNKNOWN if a node isn't in the index or the distance
+    /// would need a circular chain.
+    int64_t min_distance(const pos_t& pos1, const pos_t& pos2) const;
+
+private:
+
+    class Builder;
+
+    /// The distances from one position to the sides of one snarl tree
+    /// structure or the other way around: sides of a net graph, or events in
+    /// a chain
+    struct Level {
+        /// Net graph number, or chain number plus the net graph count
+        size_t tree;
+        vector<pair<uint32_t, int64_t>> items;
+    };
+
+    /// Where a net graph's parts are in the arrays
+    struct NetView {
+        size_t sides;
+        size_t ports;
+        /// Where each side's edges start in edges
+        const uint64_t* edge_start;
+        /// Sides each side has an edge to, numbered within the net graph
+        const uint32_t* edges;
+        /// Cost of going through each side's node or chain, out of its left
+        /// and right sides
+        const int64_t* through;
+        /// Distances from every side to every side, if stored
+        const int64_t* matrix;
+    };
+
+    /// Where a chain's parts are in the arrays
+    struct ChainView {
+        size_t columns;
+        const int64_t* lengths;
+        const int64_t* prefix;
+        const uint32_t* blocks;
+        const int64_t* loop_forward;
+        const int64_t* loop_backward;
+    };
+
+    /// Get the distances to all sides of a net graph, given the costs to
+    /// leave it from some of its sides
+    static void net_arrivals(const NetView& net, const vector<pair<uint32_t, int64_t>>& sources,
+                             vector<int64_t>& arrivals);
+
+    /// Get the distance between two events in a chain
+    static int64_t chain_distance(const ChainView& chain, uint32_t from, uint32_t to);
+
+    NetView net_view(size_t net) const;
+    ChainView chain_view(size_t chain) const;
+
+    /// Find the distances from a position to its ancestors' sides, or to the
+    /// position from them, lowest first. Returns false if the index can't
+    /// tell.
+    bool climb(const pos_t& pos, bool from, vector<Level>& levels) const;
+
+    /// Get the shortest distance joining a position's distances to the
+    /// sides of a structure with another's distances from them
+    int64_t join(const Level& from, const Level& to) const;
+
+    /// Point the array views into the given serialized data
+    void attach(const char* data, size_t length);
+
+    /// Serialized data when we own it
+    vector<char> owned;
+    /// Mapping of the serialized data when we load from a file
+    unique_ptr<MappedFileBuffer> mapping;
+
+    // Views of the arrays, in file order
+
+    /// Net graph or chain each node is in, numbered like Level::tree
+    const uint32_t* node_owners = nullptr;
+    /// Node or chain number of each node in its net graph, or column in
+    /// its chain
+    const uint32_t* node_ranks = nullptr;
+    /// Where each net graph's sides start in the side arrays
+    const uint64_t* net_side_start = nullptr;
+    /// Where each net graph's distance matrix starts in matrices
+    const uint64_t* net_matrix_start = nullptr;
+    /// Chain each snarl's net graph is in, and the column it ends at
+    const uint32_t* net_chains = nullptr;
+    const uint32_t* net_columns = nullptr;
+    /// Where each side's edges start in edges
+    const uint64_t* side_edge_start = nullptr;
+    const uint32_t* edges = nullptr;
+    /// Two costs of going through for each side
+    const int64_t* through = nullptr;
+    const int64_t* matrices = nullptr;
+    /// Where each chain's columns start in the column arrays
+    const uint64_t* chain_column_start = nullptr;
+    /// Net graph each chain is in, and its node or chain number there
+    const uint32_t* chain_nets = nullptr;
+    const uint32_t* chain_ranks = nullptr;
+    /// Boundary node of each column, as (ID << 1 | backward)
+    const uint64_t* column_nodes = nullptr;
+    const int64_t* column_lengths = nullptr;
+    /// Distance from entering the chain to leaving each column rightward,
+    /// skipping snarls that can't be crossed
+    const int64_t* column_prefix = nullptr;
+    /// Snarls that can't be crossed up to each column
+    const uint32_t* column_blocks = nullptr;
+    /// Shortest way back to each column after leaving it rightward, and
+    /// after leaving it leftward
+    const int64_t* column_loop_forward = nullptr;
+    const int64_t* column_loop_backward = nullptr;
+    /// Ports of each net graph: 2 for a snarl, 1 for a unary snarl, 0 for a
+    /// component outside all snarls
+    const uint8_t* net_ports = nullptr;
+    /// Whether each snarl is backward in its chain
+    const uint8_t* net_backward = nullptr;
+    /// Whether each chain is unary or circular
+    const uint8_t* chain_flags = nullptr;
+
+    id_t min_id = 0;
+    size_t nodes = 0;
+    size_t nets = 0;
+    size_t chains = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include "snarl_tree_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace vg {
+
+using namespace std;
+
+const size_t SnarlTreeIndex::NONE = numeric_limits<size_t>::max();
+
+namespace {
+
+/// Marks the start of a serialized index, and its format version
+const char SNARL_TREE_MAGIC[8] = {'V', 'G', 'S', 'N', 'T', 'R', 'E', '1'};
+
+/// Missing ranks in the 32-bit arrays
+const uint32_t NONE_32 = numeric_limits<uint32_t>::max();
+
+/// Count fields in the header, after the magic
+enum HeaderField {
+    SNARLS,
+    CHAINS,
+    MEMBERS,
+    INTO,
+    HEADER_FIELDS
+};
+
+/// Round a byte count up so the next array is 8-byte aligned
+size_t padded(size_t bytes) {
+    return (bytes + 7) / 8 * 8;
+}
+
+/// Append an array to the serialized data, padded to 8 bytes
+template<typename T>
+void append_array(vector<char>& data, const vector<T>& array) {
+    size_t bytes = array.size() * sizeof(T);
+    size_t start = data.size();
+    data.resize(start + padded(bytes), 0);
+    if (bytes != 0) {
+        memcpy(data.data() + start, array.data(), bytes);
+    }
+}
+
+uint64_t encode(id_t id, bool backward) {
+    return ((uint64_t) id << 1) | (backward ? 1 : 0);
+}
+
+}
+
+SnarlTreeIndex::SnarlTreeIndex(const SnarlManager& manager) {
+
+    // Number the snarls in preorder
+    vector<const Snarl*> preorder;
+    unordered_map<const Snarl*, uint32_t> rank;
+    {
+        const vector<const Snarl*>& roots = manager.children_of(nullptr);
+        vector<const Snarl*> stack(roots.rbegin(), roots.rend());
+        while (!stack.empty()) {
+            const Snarl* snarl = stack.back();
+            stack.pop_back();
+            if (preorder.size() >= NONE_32) {
+                throw runtime_error("[SnarlTreeIndex] too many snarls to index");
+            }
+            rank[snarl] = preorder.size();
+            preorder.push_back(snarl);
+            const vector<const Snarl*>& kids = manager.children_of(snarl);
+            stack.insert(stack.end(), kids.rbegin(), kids.rend());
+        }
+    }
+    size_t snarl_total = preorder.size();
+
+    vector<uint64_t> boundary_array(2 * snarl_total);
+    vector<uint8_t> type_array(snarl_total);
+    vector<uint32_t> parent_array(snarl_total, NONE_32);
+    vector<uint32_t> child_offset_array{0};
+    vector<uint32_t> child_array;
+    vector<uint32_t> snarl_chain_array(snarl_total, NONE_32);
+    vector<uint32_t> chain_offset_array{0};
+    vector<uint32_t> member_offset_array{0};
+    vector<uint32_t> member_array;
+    vector<pair<uint64_t, uint32_t>> into;
+
+    // Fill in the children and chains of each slot: the top level, and then
+    // each snarl in order.
+    for (size_t slot = 0; slot <= snarl_total; slot++) {
+        const Snarl* snarl = slot == 0 ? nullptr : preorder[slot - 1];
+        for (const Snarl* kid : manager.children_of(snarl)) {
+            child_array.push_back(rank.at(kid));
+            if (snarl != nullptr) {
+                parent_array[rank.at(kid)] = slot - 1;
+            }
+        }
+        child_offset_array.push_back(child_array.size());
+
+        for (const Chain& chain : manager.chains_of(snarl)) {
+            for (const Snarl* member : chain) {
+                snarl_chain_array[rank.at(member)] = member_offset_array.size() - 1;
+                member_array.push_back(rank.at(member));
+            }
+            member_offset_array.push_back(member_array.size());
+        }
+        chain_offset_array.push_back(member_offset_array.size() - 1);
+    }
+
+    for (size_t i = 0; i < snarl_total; i++) {
+        const Snarl* snarl = preorder[i];
+        boundary_array[2 * i] = encode(snarl->start().node_id(), snarl->start().backward());
+        boundary_array[2 * i + 1] = encode(snarl->end().node_id(), snarl->end().backward());
+        type_array[i] = snarl->type();
+        into.emplace_back(encode(snarl->start().node_id(), snarl->start().backward()), i);
+        into.emplace_back(encode(snarl->end().node_id(), !snarl->end().backward()), i);
+    }
+
+    // Sort the boundary lookup, keeping one snarl per key the way
+    // SnarlManager does for unary snarls
+    stable_sort(into.begin(), into.end(), [](const pair<uint64_t, uint32_t>& a, const pair<uint64_t, uint32_t>& b) {
+        return a.first < b.first;
+    });
+    into.erase(unique(into.begin(), into.end(), [](const pair<uint64_t, uint32_t>& a, const pair<uint64_t, uint32_t>& b) {
+        return a.first == b.first;
+    }), into.end());
+    vector<uint64_t> into_key_array;
+    vector<uint32_t> into_snarl_array;
+    for (auto& entry : into) {
+        into_key_array.push_back(entry.first);
+        into_snarl_array.push_back(entry.second);
+    }
+
+    // Lay everything out the same way a file would be
+    vector<uint64_t> header(HEADER_FIELDS);
+    header[SNARLS] = snarl_total;
+    header[CHAINS] = member_offset_array.size() - 1;
+    header[MEMBERS] = member_array.size();
+    header[INTO] = into_key_array.size();
+    owned.assign(SNARL_TREE_MAGIC, SNARL_TREE_MAGIC + sizeof(SNARL_TREE_MAGIC));
+    append_array(owned, header);
+    append_array(owned, boundary_array);
+    append_array(owned, into_key_array);
+    append_array(owned, child_offset_array);
+    append_array(owned, child_array);
+    append_array(owned, parent_array);
+    append_array(owned, snarl_chain_array);
+    append_array(owned, chain_offset_array);
+    append_array(owned, member_offset_array);
+    append_array(owned, member_array);
+    append_array(owned, into_snarl_array);
+    append_array(owned, type_array);
+
+    attach(owned.data(), owned.size());
+}
+
+SnarlTreeIndex::SnarlTreeIndex(const string& filename) : mapping(new MappedFileBuffer(filename)) {
+    if (mapping->is_open()) {
+        attach(mapping->data(), mapping->size());
+    } else {
+        // Can't be mapped, so read it in as a normal file.
+        mapping.reset();
+        ifstream in(filename, ios_base::in | ios_base::binary);
+        if (!in) {
+            throw runtime_error("[SnarlTreeIndex] could not open " + filename);
+        }
+        owned.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        attach(owned.data(), owned.size());
+    }
+}
+
+SnarlTreeIndex::SnarlTreeIndex(istream& in) {
+    owned.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    attach(owned.data(), owned.size());
+}
+
+void SnarlTreeIndex::attach(const char* data, size_t length) {
+    const size_t header_bytes = sizeof(SNARL_TREE_MAGIC) + HEADER_FIELDS * sizeof(uint64_t);
+    if ((((uintptr_t) data) & 7) != 0) {
+        throw runtime_error("[SnarlTreeIndex] index data is not aligned");
+    }
+    if (length < header_bytes || memcmp(data, SNARL_TREE_MAGIC, sizeof(SNARL_TREE_MAGIC)) != 0) {
+        throw runtime_error("[SnarlTreeIndex] not a snarl tree index");
+    }
+    const uint64_t* header = (const uint64_t*) (data + sizeof(SNARL_TREE_MAGIC));
+    snarls = header[SNARLS];
+    chains = header[CHAINS];
+    into_count = header[INTO];
+    size_t members = header[MEMBERS];
+
+    // Walk through the arrays in file order, checking that each one fits.
+    size_t cursor = header_bytes;
+    auto next_array = [&](size_t count, size_t item_bytes) {
+        const char* start = data + cursor;
+        size_t bytes = padded(count * item_bytes);
+        if (bytes > length - cursor) {
+            throw runtime_error("[SnarlTreeIndex] index is truncated");
+        }
+        cursor += bytes;
+        return start;
+    };
+    boundaries = (const uint64_t*) next_array(2 * snarls, sizeof(uint64_t));
+    into_keys = (const uint64_t*) next_array(into_count, sizeof(uint64_t));
+    child_offsets = (const uint32_t*) next_array(snarls + 2, sizeof(uint32_t));
+    children = (const uint32_t*) next_array(snarls, sizeof(uint32_t));
+    parents = (const uint32_t*) next_array(snarls, sizeof(uint32_t));
+    snarl_chains = (const uint32_t*) next_array(snarls, sizeof(uint32_t));
+    chain_offsets = (const uint32_t*) next_array(snarls + 2, sizeof(uint32_t));
+    member_offsets = (const uint32_t*) next_array(chains + 1, sizeof(uint32_t));
+    chain_members = (const uint32_t*) next_array(members, sizeof(uint32_t));
+    into_snarls = (const uint32_t*) next_array(into_count, sizeof(uint32_t));
+    types = (const uint8_t*) next_array(snarls, sizeof(uint8_t));
+}
+
+void SnarlTreeIndex::serialize(ostream& out) const {
+    if (mapping) {
+        out.write(mapping->data(), mapping->size());
+    } else {
+        out.write(owned.data(), owned.size());
+    }
+}
+
+size_t SnarlTreeIndex::snarl_count() const {
+    return snarls;
+}
+
+size_t SnarlTreeIndex::chain_count() const {
+    return chains;
+}
+
+pair<id_t, bool> SnarlTreeIndex::start(size_t snarl) const {
+    return make_pair((id_t) (boundaries[2 * snarl] >> 1), (bool) (boundaries[2 * snarl] & 1));
+}
+
+pair<id_t, bool> SnarlTreeIndex::end(size_t snarl) const {
+    return make_pair((id_t) (boundaries[2 * snarl + 1] >> 1), (bool) (boundaries[2 * snarl + 1] & 1));
+}
+
+SnarlType SnarlTreeIndex::type(size_t snarl) const {
+    return (SnarlType) types[snarl];
+}
+
+size_t SnarlTreeIndex::parent(size_t snarl) const {
+    return parents[snarl] == NONE_32 ? NONE : parents[snarl];
+}
+
+size_t SnarlTreeIndex::child_count(size_t snarl) const {
+    size_t slot = snarl + 1;
+    return child_offsets[slot + 1] - child_offsets[slot];
+}
+
+size_t SnarlTreeIndex::child(size_t snarl, size_t i) const {
+    // NONE + 1 wraps around to the top-level slot.
+    return children[child_offsets[snarl + 1] + i];
+}
+
+pair<size_t, size_t> SnarlTreeIndex::chains_of(size_t snarl) const {
+    size_t slot = snarl + 1;
+    return make_pair(chain_offsets[slot], chain_offsets[slot + 1]);
+}
+
+size_t SnarlTreeIndex::chain_of(size_t snarl) const {
+    return snarl_chains[snarl] == NONE_32 ? NONE : snarl_chains[snarl];
+}
+
+size_t SnarlTreeIndex::chain_size(size_t chain) const {
+    return member_offsets[chain + 1] - member_offsets[chain];
+}
+
+size_t SnarlTreeIndex::chain_member(size_t chain, size_t i) const {
+    return chain_members[member_offsets[chain] + i];
+}
+
+bool SnarlTreeIndex::in_nontrivial_chain(size_t snarl) const {
+    size_t chain = chain_of(snarl);
+    return chain != NONE && chain_size(chain) > 1;
+}
+
+size_t SnarlTreeIndex::into_which_snarl(id_t id, bool reverse) const {
+    uint64_t key = encode(id, reverse);
+    const uint64_t* found = lower_bound(into_keys, into_keys + into_count, key);
+    if (found == into_keys + into_count || *found != key) {
+        return NONE;
+    }
+    return into_snarls[found - into_keys];
+}
+
+Snarl SnarlTreeIndex::to_snarl(size_t snarl) const {
+    Snarl result;
+    auto boundary = start(snarl);
+    result.mutable_start()->set_node_id(boundary.first);
+    result.mutable_start()->set_backward(boundary.second);
+    boundary = end(snarl);
+    result.mutable_end()->set_node_id(boundary.first);
+    result.mutable_end()->set_backward(boundary.second);
+    result.set_type(type(snarl));
+    size_t parent_rank = parent(snarl);
+    if (parent_rank != NONE) {
+        boundary = start(parent_rank);
+        result.mutable_parent()->mutable_start()->set_node_id(boundary.first);
+        result.mutable_parent()->mutable_start()->set_backward(boundary.second);
+        boundary = end(parent_rank);
+        result.mutable_parent()->mutable_end()->set_node_id(boundary.first);
+        result.mutable_parent()->mutable_end()->set_backward(boundary.second);
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,146 @@
+#ifndef VG_SNARL_TREE_INDEX_HPP_INCLUDED
+#define VG_SNARL_TREE_INDEX_HPP_INCLUDED
+
+/**
+ * \file snarl_tree_index.hpp
+ *
+ * A compact, read-only index of a snarl tree that can be memory-mapped from
+ * disk. It answers the tree and boundary queries that SnarlManager answers,
+ * but refers to snarls by rank and never builds Snarl protobufs or hash
+ * tables, so loading it costs no more than mapping the file.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "snarls.hpp"
+#include "mapped_file.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Snarls are numbered in preorder, so a snarl's descendants directly follow
+ * it. Chains are numbered in order of their parents, with the top-level
+ * chains first. The file is a series of flat arrays, and queries read
+ * straight out of them.
+ */
+class SnarlTreeIndex {
+public:
+
+    /// Rank returned for a missing snarl or chain
+    static const size_t NONE;
+
+    /// Index the snarl tree in a SnarlManager
+    SnarlTreeIndex(const SnarlManager& manager);
+
+    /// Load an index from a file, memory-mapping it if possible
+    SnarlTreeIndex(const string& filename);
+
+    /// Load an index from a stream, copying it into memory
+    SnarlTreeIndex(istream& in);
+
+    // We point into our own storage, so we can't be copied.
+    SnarlTreeIndex(const SnarlTreeIndex& other) = delete;
+    SnarlTreeIndex& operator=(const SnarlTreeIndex& other) = delete;
+
+    /// Write the index in the format the loading constructors read
+    void serialize(ostream& out) const;
+
+    /// Get the number of snarls
+    size_t snarl_count() const;
+
+    /// Get the number of chains, including trivial chains
+    size_t chain_count() const;
+
+    /// Get the start boundary of a snarl, as a node ID and orientation
+    pair<id_t, bool> start(size_t snarl) const;
+
+    /// Get the end boundary of a snarl, as a node ID and orientation
+    pair<id_t, bool> end(size_t snarl) const;
+
+    /// Get the type of a snarl
+    SnarlType type(size_t snarl) const;
+
+    /// Get the parent of a snarl, or NONE for a top-level snarl
+    size_t parent(size_t snarl) const;
+
+    /// Get the number of children of a snarl, or of top-level snarls if
+    /// given NONE
+    size_t child_count(size_t snarl) const;
+
+    /// Get the given child of a snarl, or top-level snarl if given NONE
+    size_t child(size_t snarl, size_t i) const;
+
+    /// Get the range of chain ranks for the chains in a snarl, or the
+    /// top-level chains if given NONE
+    pair<size_t, size_t> chains_of(size_t snarl) const;
+
+    /// Get the chain a snarl is in
+    size_t chain_of(size_t snarl) const;
+
+    /// Get the number of snarls in a chain
+    size_t chain_size(size_t chain) const;
+
+    /// Get the given snarl in a chain, in chain order
+    size_t chain_member(size_t chain, size_t i) const;
+
+    /// Return true if a snarl is in a chain of more than one snarl
+    bool in_nontrivial_chain(size_t snarl) const;
+
+    /// Get the snarl that reading the given node in the given orientation
+    /// points into, or NONE if there is none. Like
+    /// SnarlManager::into_which_snarl, end boundaries must be reversed.
+    size_t into_which_snarl(id_t id, bool reverse) const;
+
+    /// Make a Snarl protobuf for a snarl, for code that needs one
+    Snarl to_snarl(size_t snarl) const;
+
+private:
+
+    /// Point the array views into the given serialized data
+    void attach(const char* data, size_t length);
+
+    /// Serialized data when we own it
+    vector<char> owned;
+    /// Mapping of the serialized data when we load from a file
+    unique_ptr<MappedFileBuffer> mapping;
+
+    // Views of the arrays, in file order
+
+    /// Start and end boundaries of each snarl, as (ID << 1 | backward)
+    const uint64_t* boundaries = nullptr;
+    /// Where each snarl's children begin in children, with the top-level
+    /// snarls first at slot 0, so snarl i's are in slot i + 1
+    const uint32_t* child_offsets = nullptr;
+    const uint32_t* children = nullptr;
+    /// Parent of each snarl
+    const uint32_t* parents = nullptr;
+    /// Chain of each snarl
+    const uint32_t* snarl_chains = nullptr;
+    /// First chain in each slot, slotted like child_offsets
+    const uint32_t* chain_offsets = nullptr;
+    /// Where each chain's members begin in chain_members
+    const uint32_t* member_offsets = nullptr;
+    const uint32_t* chain_members = nullptr;
+    /// Sorted (ID << 1 | reverse) keys pointing into snarls
+    const uint64_t* into_keys = nullptr;
+    /// The snarl each key points into
+    const uint32_t* into_snarls = nullptr;
+    /// Type of each snarl
+    const uint8_t* types = nullptr;
+
+    size_t snarls = 0;
+    size_t chains = 0;
+    size_t into_count = 0;
+};
+
+}
+
+#endif
@@ -9,9 +9,200 @@
 #include "json2pb.h"
 #include "algorithms/topological_sort.hpp"
 #include "algorithms/is_directed_acyclic.hpp"
+#include "algorithms/weakly_connected_components.hpp"
+#include "algorithms/three_edge_connected_components.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <limits>
 
 namespace vg {
 
+/**
+ * Fill in the connectivity and type of a snarl, which must have its start and
+ * end set, from the given child chains and the graph the snarls come from.
+ */
+static void fill_in_snarl_type(Snarl& snarl, const vector<Chain>& child_chains, const HandleGraph* graph) {
+
+    const Visit& start = snarl.start();
+    const Visit& end = snarl.end();
+
+    // First determine connectivity
+    {
+
+        // Make a net graph for the snarl that uses internal connectivity
+        NetGraph connectivity_net_graph(start, end, child_chains, graph, true);
+        
+        // Evaluate connectivity
+        // A snarl is minimal, so we know out start and end will be normal nodes.
+        handle_t start_handle = connectivity_net_graph.get_handle(start.node_id(), start.backward());
+        handle_t end_handle = connectivity_net_graph.get_handle(end.node_id(), end.backward());
+        
+        // Start out by assuming we aren't connected
+        bool connected_start_start = false;
+        bool connected_end_end = false;
+        bool connected_start_end = false;
+        
+        // We do a couple of direcred walk searches to test connectivity.
+        list<handle_t> queue{start_handle};
+        unordered_set<handle_t> queued{start_handle};
+        auto handle_edge = [&](const handle_t& other) {
+#ifdef debug
+            cerr << "\tCan reach " << connectivity_net_graph.get_id(other)
+            << " " << connectivity_net_graph.get_is_reverse(other) << endl;
+#endif
+            
+            // Whenever we see a new node orientation, queue it.
+            if (!queued.count(other)) {
+                queue.push_back(other);
+                queued.insert(other);
+            }
+        };
+        
+#ifdef debug
+        cerr << "Looking for start-start turnarounds and through connections from "
+             << connectivity_net_graph.get_id(start_handle) << " " <<
+            connectivity_net_graph.get_is_reverse(start_handle) << endl;
+#endif
+        
+        while (!queue.empty()) {
+            handle_t here = queue.front();
+            queue.pop_front();
+            
+            if (here == end_handle) {
+                // Start can reach the end
+                connected_start_end = true;
+            }
+            
+            if (here == connectivity_net_graph.flip(start_handle)) {
+                // Start can reach itself the other way around
+                connected_start_start = true;
+            }
+            
+            if (connected_start_end && connected_start_start) {
+                // No more searching needed
+                break;
+            }
+            
+            // Look at everything reachable on a proper rightward directed walk.
+            connectivity_net_graph.follow_edges(here, false, handle_edge);
+        }
+        
+        auto end_inward = connectivity_net_graph.flip(end_handle);
+        
+#ifdef debug
+        cerr << "Looking for end-end turnarounds from " << connectivity_net_graph.get_id(end_inward)
+             << " " << connectivity_net_graph.get_is_reverse(end_inward) << endl;
+#endif
+        
+        // Reset and search the other way from the end to see if it can find itself.
+        queue = {end_inward};
+        queued = {end_inward};
+        while (!queue.empty()) {
+            handle_t here = queue.front();
+            queue.pop_front();
+            
+#ifdef debug
+            cerr << "Got to " << connectivity_net_graph.get_id(here) << " "
+                 << connectivity_net_graph.get_is_reverse(here) << endl;
+#endif
+            
+            if (here == end_handle) {
+                // End can reach itself the other way around
+                connected_end_end = true;
+                break;
+            }
+            
+            // Look at everything reachable on a proper rightward directed walk.
+            connectivity_net_graph.follow_edges(here, false, handle_edge);
+        }
+        
+        // Save the connectivity info. TODO: should the connectivity flags be
+        // calculated based on just the net graph, or based on actual connectivity
+        // within child snarls.
+        snarl.set_start_self_reachable(connected_start_start);
+        snarl.set_end_self_reachable(connected_end_end);
+        snarl.set_start_end_reachable(connected_start_end);
+
+#ifdef debug
+        cerr << "Connectivity: " << connected_start_start << " " << connected_end_end << " " << connected_start_end << endl;
+#endif
+        
+    
+    }
+    
+    {
+        // Determine cyclicity/acyclicity
+    
+        // Make a net graph that just pretends child snarls/chains are ordinary nodes
+        NetGraph flat_net_graph(start, end, child_chains, graph);
+        
+        // This definitely should be calculated based on the internal-connectivity-ignoring net graph.
+        snarl.set_directed_acyclic_net_graph(algorithms::is_directed_acyclic(&flat_net_graph));
+    }
+
+    // Now we need to work out if the snarl can be a unary snarl or an ultrabubble or what.
+    if (start.node_id() == end.node_id()) {
+        // Snarl has the same start and end (or no start or end, in which case we don't care).
+        snarl.set_type(UNARY);
+#ifdef debug
+        cerr << "Snarl is UNARY" << endl;
+#endif
+    } else if (!snarl.start_end_reachable()) {
+        // Can't be an ultrabubble if we're not connected through.
+        snarl.set_type(UNCLASSIFIED);
+#ifdef debug
+        cerr << "Snarl is UNCLASSIFIED because it doesn't connect through" << endl;
+#endif
+    } else if (snarl.start_self_reachable() || snarl.end_self_reachable()) {
+        // Can't be an ultrabubble if we have these cycles
+        snarl.set_type(UNCLASSIFIED);
+        
+#ifdef debug
+        cerr << "Snarl is UNCLASSIFIED because it allows turning around, creating a directed cycle" << endl;
+#endif
+
+    } else {
+        // See if we have all ultrabubble children
+        bool all_ultrabubble_children = true;
+        for (auto& chain : child_chains) {
+            for (auto& child : chain) {
+                if (child->type() != ULTRABUBBLE) {
+                    all_ultrabubble_children = false;
+                    break;
+                }
+            }
+            if (!all_ultrabubble_children) {
+                break;
+            }
+        }
+        
+        // Note that ultrabubbles *can* loop back on their start or end.
+        
+        if (!all_ultrabubble_children) {
+            // If we have non-ultrabubble children, we can't be an ultrabubble.
+            snarl.set_type(UNCLASSIFIED);
+#ifdef debug
+            cerr << "Snarl is UNCLASSIFIED because it has non-ultrabubble children" << endl;
+#endif
+        } else if (!snarl.directed_acyclic_net_graph()) {
+            // If all our children are ultrabubbles but we ourselves are cyclic, we can't be an ultrabubble
+            snarl.set_type(UNCLASSIFIED);
+            
+#ifdef debug
+            cerr << "Snarl is UNCLASSIFIED because it is not directed-acyclic" << endl;
+#endif
+        } else {
+            // We have only ultrabubble children and are acyclic.
+            // We're an ultrabubble.
+            snarl.set_type(ULTRABUBBLE);
+#ifdef debug
+            cerr << "Snarl is an ULTRABUBBLE" << endl;
+#endif
+        }
+    }
+}
+
 CactusSnarlFinder::CactusSnarlFinder(VG& graph) :
     graph(graph) {
     // Make sure the graph is sorted.
@@ -33,6 +224,19 @@ SnarlManager CactusSnarlFinder::find_snarls() {
         // No snarls here!
         return SnarlManager();
     }
+    
+    // Components are decomposed on their own, so the pinch and cactus graphs
+    // only ever have to hold a few components at once
+    vector<id_t> node_ids;
+    vector<size_t> component_ids;
+    algorithms::weakly_connected_component_ids(&graph, node_ids, component_ids);
+    size_t component_count = *max_element(component_ids.begin(), component_ids.end()) + 1;
+    if (component_count > 1 && get_thread_count() > 1) {
+        return find_component_snarls(node_ids, component_ids, component_count);
+    }
+    node_ids.clear();
+    component_ids.clear();
+    
     // convert to cactus
     pair<stCactusGraph*, stList*> cac_pair = vg_to_cactus(graph, hint_paths);
     stCactusGraph* cactus_graph = cac_pair.first;
@@ -68,6 +272,112 @@ SnarlManager CactusSnarlFinder::find_snarls() {
     
 }
 
+SnarlManager CactusSnarlFinder::find_component_snarls(const vector<id_t>& node_ids,
+                                                      const vector<size_t>& component_ids,
+                                                      size_t component_count) {
+    
+    hash_map<id_t, size_t> component_of;
+    component_of.reserve(node_ids.size());
+    vector<size_t> component_sizes(component_count, 0);
+    for (size_t i = 0; i < node_ids.size(); i++) {
+        component_of[node_ids[i]] = component_ids[i];
+        component_sizes[component_ids[i]]++;
+    }
+    for (size_t size : component_sizes) {
+        if (size == 1) {
+            // If we feed this through to Cactus it will crash.
+            throw runtime_error("Cactus does not currently support finding snarls in a single-node connected component");
+        }
+    }
+    
+    // Sort out the nodes, edges and paths of each component, keeping the
+    // nodes in the graph's sorted order
+    vector<vector<const Node*>> component_nodes(component_count);
+    for (auto& node : graph.graph.node()) {
+        component_nodes[component_of.at(node.id())].push_back(&node);
+    }
+    vector<vector<const Edge*>> component_edges(component_count);
+    for (auto& edge : graph.graph.edge()) {
+        // An edge to a missing node goes with the node it has
+        auto found = component_of.find(edge.from());
+        if (found == component_of.end()) {
+            found = component_of.find(edge.to());
+        }
+        if (found != component_of.end()) {
+            component_edges[found->second].push_back(&edge);
+        }
+    }
+    vector<vector<string>> component_paths(component_count);
+    graph.paths.for_each_name([&](const string& name) {
+        auto& mappings = graph.paths.get_path(name);
+        if (mappings.empty()) {
+            return;
+        }
+        auto first = component_of.find(mappings.front().node_id());
+        size_t component = first == component_of.end() ? component_count : first->second;
+        for (auto& mapping : mappings) {
+            auto found = component_of.find(mapping.node_id());
+            if (found == component_of.end() || found->second != component) {
+                // If we use a path like this to pick telomeres we will segfault Cactus.
+                throw runtime_error("Path " + name + " spans multiple connected components!");
+            }
+        }
+        component_paths[component].push_back(name);
+    });
+    component_of.clear();
+    
+    SnarlManager snarl_manager;
+    exception_ptr error;
+    
+    // Convert and decompose the components in parallel, and fill in the
+    // SnarlManager from each in order, freeing its Cactus structures as soon
+    // as its snarls are in.
+#pragma omp parallel for ordered schedule(dynamic, 1)
+    for (size_t i = 0; i < component_count; i++) {
+        try {
+            Graph component_graph;
+            for (const Node* node : component_nodes[i]) {
+                *component_graph.add_node() = *node;
+            }
+            for (const Edge* edge : component_edges[i]) {
+                *component_graph.add_edge() = *edge;
+            }
+            for (auto& name : component_paths[i]) {
+                *component_graph.add_path() = graph.paths.path(name);
+            }
+            VG component;
+            component.append_unindexed(component_graph);
+            component_graph.Clear();
+            component.build_indexes_dropping_duplicates();
+            component.paths.sort_by_mapping_rank();
+            component.paths.rebuild_mapping_aux();
+            
+            pair<stCactusGraph*, stList*> cac_pair = vg_to_cactus(component, hint_paths);
+            stSnarlDecomposition *snarls = stCactusGraph_getSnarlDecomposition(cac_pair.first, cac_pair.second);
+            
+#pragma omp ordered
+            {
+                recursively_emit_snarls(Visit(), Visit(), Visit(), Visit(), snarls->topLevelChains,
+                                        snarls->topLevelUnarySnarls, snarl_manager);
+            }
+            
+            stSnarlDecomposition_destruct(snarls);
+            stList_destruct(cac_pair.second);
+            stCactusGraph_destruct(cac_pair.first);
+        } catch (...) {
+#pragma omp critical (cactus_error)
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    
+    return snarl_manager;
+}
+
 const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, const Visit& end,
                                                         const Visit& parent_start, const Visit& parent_end,
                                                         stList* chains_list, stList* unary_snarls_list, SnarlManager& destination) {
@@ -183,195 +493,463 @@ const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, cons
 
     if (snarl.start().node_id() != 0 || snarl.end().node_id() != 0) {
         // This snarl is real, we care about type and connectivity.
+        fill_in_snarl_type(snarl, child_chains, &graph);
 
-        // First determine connectivity
-        {
+        // Now we know enough aboiut the snarl to actually put it in the SnarlManager
+        managed = destination.add_snarl(snarl);
+        
+    }
+    
+    // Now add all the child chains as children of the snarl we just added (or
+    // as root chains if we didn't just add a snarl)
+    for (auto& chain : child_chains) {
+        destination.add_chain(chain, managed);
+    }
 
-            // Make a net graph for the snarl that uses internal connectivity
-            NetGraph connectivity_net_graph(start, end, child_chains, &graph, true);
-            
-            // Evaluate connectivity
-            // A snarl is minimal, so we know out start and end will be normal nodes.
-            handle_t start_handle = connectivity_net_graph.get_handle(start.node_id(), start.backward());
-            handle_t end_handle = connectivity_net_graph.get_handle(end.node_id(), end.backward());
-            
-            // Start out by assuming we aren't connected
-            bool connected_start_start = false;
-            bool connected_end_end = false;
-            bool connected_start_end = false;
-            
-            // We do a couple of direcred walk searches to test connectivity.
-            list<handle_t> queue{start_handle};
-            unordered_set<handle_t> queued{start_handle};
-            auto handle_edge = [&](const handle_t& other) {
-#ifdef debug
-                cerr << "\tCan reach " << connectivity_net_graph.get_id(other)
-                << " " << connectivity_net_graph.get_is_reverse(other) << endl;
-#endif
-                
-                // Whenever we see a new node orientation, queue it.
-                if (!queued.count(other)) {
-                    queue.push_back(other);
-                    queued.insert(other);
-                }
+    // Return a pointer to the managed snarl.
+    return managed;
+}
+
+namespace {
+
+/// A snarl found by IntegratedSnarlFinder, before it goes into a SnarlManager
+struct FoundSnarl {
+    Visit start;
+    Visit end;
+    /// Index of the parent snarl, or numeric_limits<size_t>::max() for none
+    size_t parent;
+    /// Indexes of the snarls in each child chain, with unary snarls in chains
+    /// of their own
+    vector<vector<size_t>> child_chains;
+};
+
+/// The snarls found in one weakly connected component
+struct ComponentSnarls {
+    /// Every snarl, with parents before their children
+    vector<FoundSnarl> snarls;
+    /// Indexes of the snarls in each top-level chain
+    vector<vector<size_t>> root_chains;
+};
+
+/**
+ * Find the snarls in the weakly connected component of the graph made of the
+ * given nodes, in ID order.
+ */
+ComponentSnarls find_component_snarls(const HandleGraph& graph, const vector<id_t>& node_ids) {
+
+    const size_t NONE = numeric_limits<size_t>::max();
+    size_t node_count = node_ids.size();
+
+    unordered_map<id_t, size_t> rank;
+    rank.reserve(node_count);
+    for (size_t i = 0; i < node_count; i++) {
+        rank[node_ids[i]] = i;
+    }
+
+    // Side 2 * i is the start of node i, and side 2 * i + 1 is its end. The
+    // sides that a handle's edges attach to on its left and right:
+    auto left_side = [&](const handle_t& handle) {
+        return 2 * rank.at(graph.get_id(handle)) + (graph.get_is_reverse(handle) ? 1 : 0);
+    };
+    auto right_side = [&](const handle_t& handle) {
+        return 2 * rank.at(graph.get_id(handle)) + (graph.get_is_reverse(handle) ? 0 : 1);
+    };
+
+    // Sides joined by edges make up adjacency components, which we find with
+    // union-find.
+    vector<size_t> side_group(2 * node_count);
+    for (size_t i = 0; i < side_group.size(); i++) {
+        side_group[i] = i;
+    }
+    auto find_group = [&](size_t side) {
+        while (side_group[side] != side) {
+            side_group[side] = side_group[side_group[side]];
+            side = side_group[side];
+        }
+        return side;
+    };
+    auto join_sides = [&](size_t a, size_t b) {
+        side_group[find_group(a)] = find_group(b);
+    };
+
+    // Tips are kept as inward-facing handles.
+    vector<handle_t> tips;
+    for (size_t i = 0; i < node_count; i++) {
+        handle_t handle = graph.get_handle(node_ids[i], false);
+        bool has_left = false;
+        bool has_right = false;
+        graph.follow_edges(handle, false, [&](const handle_t& next) {
+            has_right = true;
+            join_sides(2 * i + 1, left_side(next));
+        });
+        graph.follow_edges(handle, true, [&](const handle_t& prev) {
+            has_left = true;
+            join_sides(2 * i, right_side(prev));
+        });
+        if (!has_left) {
+            tips.push_back(handle);
+        }
+        if (!has_right) {
+            tips.push_back(graph.flip(handle));
+        }
+    }
+
+    // Number the adjacency components. They are the vertices of a multigraph
+    // with an edge for each node, between the components of its two sides.
+    vector<size_t> side_vertex(2 * node_count, NONE);
+    size_t vertex_count = 0;
+    {
+        vector<size_t> group_vertex(2 * node_count, NONE);
+        for (size_t i = 0; i < side_vertex.size(); i++) {
+            size_t group = find_group(i);
+            if (group_vertex[group] == NONE) {
+                group_vertex[group] = vertex_count++;
+            }
+            side_vertex[i] = group_vertex[group];
+        }
+    }
+    vector<pair<size_t, size_t>> edges(node_count);
+    for (size_t i = 0; i < node_count; i++) {
+        edges[i] = make_pair(side_vertex[2 * i], side_vertex[2 * i + 1]);
+    }
+
+    // If there are tips, we pick two far-apart ones as telomeres to root the
+    // decomposition on, and join their outer sides with an extra edge. The
+    // bridges between them then form a cycle, which is the top-level chain.
+    size_t root_edge = NONE;
+    size_t root_vertex = side_vertex[0];
+    if (!tips.empty()) {
+        // Find the tip furthest, in nodes, from the given handle, following
+        // edges either way or only along walks reading out of the handle.
+        // Returns NONE if no tip is reached.
+        auto furthest_tip = [&](const handle_t& from, bool directed) {
+            // Directed walks need to keep track of orientation.
+            auto key = [&](const handle_t& handle) {
+                return directed ? left_side(handle) : left_side(graph.forward(handle));
             };
-            
-#ifdef debug
-            cerr << "Looking for start-start turnarounds and through connections from "
-                 << connectivity_net_graph.get_id(start_handle) << " " <<
-                connectivity_net_graph.get_is_reverse(start_handle) << endl;
-#endif
-            
-            while (!queue.empty()) {
-                handle_t here = queue.front();
-                queue.pop_front();
-                
-                if (here == end_handle) {
-                    // Start can reach the end
-                    connected_start_end = true;
-                }
-                
-                if (here == connectivity_net_graph.flip(start_handle)) {
-                    // Start can reach itself the other way around
-                    connected_start_start = true;
-                }
-                
-                if (connected_start_end && connected_start_start) {
-                    // No more searching needed
-                    break;
+            vector<size_t> distance(2 * node_count, NONE);
+            vector<handle_t> queue{from};
+            distance[key(from)] = 0;
+            for (size_t i = 0; i < queue.size(); i++) {
+                size_t next_distance = distance[key(queue[i])] + 1;
+                auto enqueue = [&](const handle_t& next) {
+                    if (distance[key(next)] == NONE) {
+                        distance[key(next)] = next_distance;
+                        queue.push_back(next);
+                    }
+                };
+                graph.follow_edges(queue[i], false, enqueue);
+                if (!directed) {
+                    graph.follow_edges(queue[i], true, enqueue);
                 }
-                
-                // Look at everything reachable on a proper rightward directed walk.
-                connectivity_net_graph.follow_edges(here, false, handle_edge);
             }
-            
-            auto end_inward = connectivity_net_graph.flip(end_handle);
-            
-#ifdef debug
-            cerr << "Looking for end-end turnarounds from " << connectivity_net_graph.get_id(end_inward)
-                 << " " << connectivity_net_graph.get_is_reverse(end_inward) << endl;
-#endif
-            
-            // Reset and search the other way from the end to see if it can find itself.
-            queue = {end_inward};
-            queued = {end_inward};
-            while (!queue.empty()) {
-                handle_t here = queue.front();
-                queue.pop_front();
-                
-#ifdef debug
-                cerr << "Got to " << connectivity_net_graph.get_id(here) << " "
-                     << connectivity_net_graph.get_is_reverse(here) << endl;
-#endif
-                
-                if (here == end_handle) {
-                    // End can reach itself the other way around
-                    connected_end_end = true;
-                    break;
+
+            size_t best = NONE;
+            size_t best_distance = 0;
+            for (size_t i = 0; i < tips.size(); i++) {
+                // A walk leaves through a tip reading it outward.
+                size_t tip_distance = distance[key(directed ? graph.flip(tips[i]) : tips[i])];
+                if (tip_distance != NONE && (best == NONE || tip_distance > best_distance)) {
+                    best = i;
+                    best_distance = tip_distance;
                 }
-                
-                // Look at everything reachable on a proper rightward directed walk.
-                connectivity_net_graph.follow_edges(here, false, handle_edge);
             }
-            
-            // Save the connectivity info. TODO: should the connectivity flags be
-            // calculated based on just the net graph, or based on actual connectivity
-            // within child snarls.
-            snarl.set_start_self_reachable(connected_start_start);
-            snarl.set_end_self_reachable(connected_end_end);
-            snarl.set_start_end_reachable(connected_start_end);
+            return best;
+        };
 
-#ifdef debug
-            cerr << "Connectivity: " << connected_start_start << " " << connected_end_end << " " << connected_start_end << endl;
-#endif
-            
-        
+        // One sweep to get to the edge of the graph, and one more to find the
+        // tip furthest from there that a walk can reach.
+        handle_t first = tips[furthest_tip(tips.front(), false)];
+        size_t second = furthest_tip(first, true);
+        if (second == NONE) {
+            // Nothing can be reached along a walk, so just use the tip
+            // furthest away.
+            second = furthest_tip(first, false);
         }
-        
-        {
-            // Determine cyclicity/acyclicity
-        
-            // Make a net graph that just pretends child snarls/chains are ordinary nodes
-            NetGraph flat_net_graph(start, end, child_chains, &graph);
-            
-            // This definitely should be calculated based on the internal-connectivity-ignoring net graph.
-            snarl.set_directed_acyclic_net_graph(algorithms::is_directed_acyclic(&flat_net_graph));
+        handle_t last = tips[second];
+        if (left_side(last) < left_side(first)) {
+            // Read the top-level chain forward along the node order.
+            swap(first, last);
         }
 
-        // Now we need to work out if the snarl can be a unary snarl or an ultrabubble or what.
-        if (start.node_id() == end.node_id()) {
-            // Snarl has the same start and end (or no start or end, in which case we don't care).
-            snarl.set_type(UNARY);
-#ifdef debug
-            cerr << "Snarl is UNARY" << endl;
-#endif
-        } else if (!snarl.start_end_reachable()) {
-            // Can't be an ultrabubble if we're not connected through.
-            snarl.set_type(UNCLASSIFIED);
-#ifdef debug
-            cerr << "Snarl is UNCLASSIFIED because it doesn't connect through" << endl;
-#endif
-        } else if (snarl.start_self_reachable() || snarl.end_self_reachable()) {
-            // Can't be an ultrabubble if we have these cycles
-            snarl.set_type(UNCLASSIFIED);
-            
-#ifdef debug
-            cerr << "Snarl is UNCLASSIFIED because it allows turning around, creating a directed cycle" << endl;
-#endif
+        root_vertex = side_vertex[left_side(first)];
+        root_edge = edges.size();
+        edges.emplace_back(root_vertex, side_vertex[left_side(last)]);
+    }
 
+    // Merging the 3-edge-connected components makes the multigraph into a
+    // cactus graph, where each edge is in at most one cycle.
+    vector<size_t> cactus_vertex = algorithms::three_edge_connected_components(vertex_count, edges);
+    size_t cactus_size = 0;
+    for (auto& edge : edges) {
+        edge.first = cactus_vertex[edge.first];
+        edge.second = cactus_vertex[edge.second];
+        cactus_size = max(cactus_size, max(edge.first, edge.second) + 1);
+    }
+    root_vertex = cactus_vertex[root_vertex];
+
+    // Nodes with both sides in one cactus vertex are just part of its
+    // contents. Everything else goes in adjacency lists.
+    vector<size_t> self_loops(cactus_size, 0);
+    vector<size_t> adjacency_start(cactus_size + 1, 0);
+    for (size_t i = 0; i < edges.size(); i++) {
+        if (edges[i].first == edges[i].second) {
+            if (i != root_edge) {
+                self_loops[edges[i].first]++;
+            }
         } else {
-            // See if we have all ultrabubble children
-            bool all_ultrabubble_children = true;
-            for (auto& chain : child_chains) {
-                for (auto& child : chain) {
-                    if (child->type() != ULTRABUBBLE) {
-                        all_ultrabubble_children = false;
-                        break;
-                    }
+            adjacency_start[edges[i].first + 1]++;
+            adjacency_start[edges[i].second + 1]++;
+        }
+    }
+    for (size_t i = 0; i < cactus_size; i++) {
+        adjacency_start[i + 1] += adjacency_start[i];
+    }
+    vector<size_t> adjacency(adjacency_start.back());
+    {
+        // The root edge is last, so it is the last edge we follow, and closes
+        // the top-level cycle instead of starting it.
+        vector<size_t> cursor(adjacency_start.begin(), adjacency_start.end() - 1);
+        for (size_t i = 0; i < edges.size(); i++) {
+            if (edges[i].first != edges[i].second) {
+                adjacency[cursor[edges[i].first]++] = i;
+                adjacency[cursor[edges[i].second]++] = i;
+            }
+        }
+    }
+    auto other_end = [&](size_t edge, size_t vertex) {
+        return edges[edge].first == vertex ? edges[edge].second : edges[edge].first;
+    };
+
+    // A cycle hangs off of its top vertex, and the chain along it has a
+    // snarl at each of its other vertices, between the edges into and out
+    // of the vertex.
+    struct Cycle {
+        vector<size_t> vertices;
+        vector<size_t> in_edges;
+        vector<size_t> out_edges;
+    };
+    vector<Cycle> cycles;
+    vector<vector<size_t>> cycles_from(cactus_size);
+    vector<size_t> edge_cycle(edges.size(), NONE);
+    // Tree edges down from each vertex, in DFS order
+    vector<vector<size_t>> tree_edges_from(cactus_size);
+
+    // DFS the cactus graph. Each back edge closes a cycle with the tree edges
+    // from its top end down to its bottom end.
+    {
+        vector<size_t> pre(cactus_size, NONE);
+        vector<size_t> parent_edge(cactus_size, NONE);
+        vector<pair<size_t, size_t>> stack{make_pair(root_vertex, adjacency_start[root_vertex])};
+        size_t counter = 0;
+        pre[root_vertex] = counter++;
+        while (!stack.empty()) {
+            size_t vertex = stack.back().first;
+            if (stack.back().second == adjacency_start[vertex + 1]) {
+                stack.pop_back();
+                continue;
+            }
+            size_t edge = adjacency[stack.back().second++];
+            if (edge == parent_edge[vertex]) {
+                continue;
+            }
+            size_t other = other_end(edge, vertex);
+            if (pre[other] == NONE) {
+                pre[other] = counter++;
+                parent_edge[other] = edge;
+                tree_edges_from[vertex].push_back(edge);
+                stack.emplace_back(other, adjacency_start[other]);
+            } else if (pre[other] < pre[vertex]) {
+                // Walk up the tree to the top of the cycle
+                Cycle cycle;
+                cycle.out_edges.push_back(edge);
+                for (size_t here = vertex; here != other; here = other_end(parent_edge[here], here)) {
+                    cycle.vertices.push_back(here);
+                    cycle.in_edges.push_back(parent_edge[here]);
+                    edge_cycle[parent_edge[here]] = cycles.size();
                 }
-                if (!all_ultrabubble_children) {
-                    break;
+                for (size_t i = 1; i < cycle.in_edges.size(); i++) {
+                    cycle.out_edges.push_back(cycle.in_edges[i - 1]);
                 }
+                reverse(cycle.vertices.begin(), cycle.vertices.end());
+                reverse(cycle.in_edges.begin(), cycle.in_edges.end());
+                reverse(cycle.out_edges.begin(), cycle.out_edges.end());
+                edge_cycle[edge] = cycles.size();
+                cycles_from[other].push_back(cycles.size());
+                cycles.push_back(std::move(cycle));
             }
-            
-            // Note that ultrabubbles *can* loop back on their start or end.
-            
-            if (!all_ultrabubble_children) {
-                // If we have non-ultrabubble children, we can't be an ultrabubble.
-                snarl.set_type(UNCLASSIFIED);
-#ifdef debug
-                cerr << "Snarl is UNCLASSIFIED because it has non-ultrabubble children" << endl;
-#endif
-            } else if (!snarl.directed_acyclic_net_graph()) {
-                // If all our children are ultrabubbles but we ourselves are cyclic, we can't be an ultrabubble
-                snarl.set_type(UNCLASSIFIED);
-                
-#ifdef debug
-                cerr << "Snarl is UNCLASSIFIED because it is not directed-acyclic" << endl;
-#endif
-            } else {
-                // We have only ultrabubble children and are acyclic.
-                // We're an ultrabubble.
-                snarl.set_type(ULTRABUBBLE);
-#ifdef debug
-                cerr << "Snarl is an ULTRABUBBLE" << endl;
-#endif
+            // Otherwise this is a back edge we already saw from below.
+        }
+    }
+
+    // Tree edges in no cycle are bridges.
+    vector<vector<size_t>> bridges_from(cactus_size);
+    for (size_t i = 0; i < cactus_size; i++) {
+        for (size_t edge : tree_edges_from[i]) {
+            if (edge_cycle[edge] == NONE) {
+                bridges_from[i].push_back(edge);
             }
         }
-        
-        // Now we know enough aboiut the snarl to actually put it in the SnarlManager
-        managed = destination.add_snarl(snarl);
-        
     }
-    
-    // Now add all the child chains as children of the snarl we just added (or
-    // as root chains if we didn't just add a snarl)
-    for (auto& chain : child_chains) {
-        destination.add_chain(chain, managed);
+
+    // The bounding visits for an edge read into or out of a cactus vertex
+    auto visit_into = [&](size_t edge, size_t vertex) {
+        Visit visit;
+        visit.set_node_id(node_ids[edge]);
+        visit.set_backward(edges[edge].second != vertex);
+        return visit;
+    };
+    auto visit_out_of = [&](size_t edge, size_t vertex) {
+        Visit visit;
+        visit.set_node_id(node_ids[edge]);
+        visit.set_backward(edges[edge].first != vertex);
+        return visit;
+    };
+
+    ComponentSnarls found;
+    auto add_snarl = [&](const Visit& start, const Visit& end, size_t parent) {
+        found.snarls.emplace_back();
+        found.snarls.back().start = start;
+        found.snarls.back().end = end;
+        found.snarls.back().parent = parent;
+        return found.snarls.size() - 1;
+    };
+    auto add_chain = [&](const vector<size_t>& chain, size_t parent) {
+        (parent == NONE ? found.root_chains : found.snarls[parent].child_chains).push_back(chain);
+    };
+
+    // Go down the cactus, filling in the children of each snarl (or the root)
+    // from what hangs off of its vertex. A snarl along a path of bridges
+    // doesn't count the bridge that continues the path.
+    struct Task {
+        size_t vertex;
+        size_t snarl;
+        size_t continuing_bridge;
+    };
+    vector<Task> tasks{Task{root_vertex, NONE, NONE}};
+    while (!tasks.empty()) {
+        Task task = tasks.back();
+        tasks.pop_back();
+
+        for (size_t cycle_number : cycles_from[task.vertex]) {
+            const Cycle& cycle = cycles[cycle_number];
+            vector<size_t> chain;
+            for (size_t i = 0; i < cycle.vertices.size(); i++) {
+                if (cycle.in_edges[i] == root_edge || cycle.out_edges[i] == root_edge) {
+                    // The root edge isn't a real node to bound a snarl.
+                    continue;
+                }
+                size_t vertex = cycle.vertices[i];
+                size_t snarl = add_snarl(visit_into(cycle.in_edges[i], vertex),
+                                         visit_out_of(cycle.out_edges[i], vertex), task.snarl);
+                chain.push_back(snarl);
+                tasks.push_back(Task{vertex, snarl, NONE});
+            }
+            if (!chain.empty()) {
+                add_chain(chain, task.snarl);
+            }
+        }
+
+        for (size_t bridge : bridges_from[task.vertex]) {
+            if (bridge == task.continuing_bridge) {
+                continue;
+            }
+            // Follow the path of bridges down as far as it goes, making a
+            // chain with a snarl at each vertex along it.
+            vector<size_t> chain;
+            size_t vertex = other_end(bridge, task.vertex);
+            while (!bridges_from[vertex].empty()) {
+                size_t next = bridges_from[vertex].front();
+                size_t snarl = add_snarl(visit_into(bridge, vertex), visit_out_of(next, vertex), task.snarl);
+                chain.push_back(snarl);
+                tasks.push_back(Task{vertex, snarl, next});
+                bridge = next;
+                vertex = other_end(bridge, vertex);
+            }
+            if (!chain.empty()) {
+                add_chain(chain, task.snarl);
+            }
+            if (!cycles_from[vertex].empty() || self_loops[vertex] != 0) {
+                // Something hangs off the end of the path, so it goes in a
+                // unary snarl that reads in and back out of the last bridge.
+                Visit into = visit_into(bridge, vertex);
+                Visit back = into;
+                back.set_backward(!into.backward());
+                size_t snarl = add_snarl(into, back, task.snarl);
+                add_chain(vector<size_t>{snarl}, task.snarl);
+                tasks.push_back(Task{vertex, snarl, NONE});
+            }
+        }
     }
 
-    // Return a pointer to the managed snarl.
-    return managed;
+    return found;
+}
+
+}
+
+IntegratedSnarlFinder::IntegratedSnarlFinder(const HandleGraph& graph) : graph(graph) {
+    // Nothing to do!
+}
+
+SnarlManager IntegratedSnarlFinder::find_snarls() {
+
+    // Put the components in a fixed order so the output doesn't depend on
+    // hash table order.
+    vector<vector<id_t>> components;
+    for (auto& component : algorithms::weakly_connected_components(&graph)) {
+        components.emplace_back(component.begin(), component.end());
+        sort(components.back().begin(), components.back().end());
+    }
+    sort(components.begin(), components.end());
+
+    vector<ComponentSnarls> found(components.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < components.size(); i++) {
+        found[i] = find_component_snarls(graph, components[i]);
+    }
+
+    // Children have to be in the SnarlManager before their parents can be
+    // classified, so go from the last snarl found back to the first.
+    SnarlManager snarl_manager;
+    for (auto& component : found) {
+        vector<const Snarl*> managed(component.snarls.size(), nullptr);
+        for (size_t i = component.snarls.size(); i-- > 0; ) {
+            FoundSnarl& record = component.snarls[i];
+
+            Snarl snarl;
+            *snarl.mutable_start() = record.start;
+            *snarl.mutable_end() = record.end;
+            if (record.parent != numeric_limits<size_t>::max()) {
+                *snarl.mutable_parent()->mutable_start() = component.snarls[record.parent].start;
+                *snarl.mutable_parent()->mutable_end() = component.snarls[record.parent].end;
+            }
+
+            vector<Chain> child_chains;
+            for (auto& chain : record.child_chains) {
+                child_chains.emplace_back();
+                for (size_t child : chain) {
+                    child_chains.back().push_back(managed[child]);
+                }
+            }
+
+            fill_in_snarl_type(snarl, child_chains, &graph);
+            managed[i] = snarl_manager.add_snarl(snarl);
+
+            for (auto& chain : child_chains) {
+                snarl_manager.add_chain(chain, managed[i]);
+            }
+        }
+
+        for (auto& chain : component.root_chains) {
+            Chain root_chain;
+            for (size_t snarl : chain) {
+                root_chain.push_back(managed[snarl]);
+            }
+            snarl_manager.add_chain(root_chain, nullptr);
+        }
+    }
+
+    return snarl_manager;
 }
 
 bool start_backward(const Chain& chain) {
@@ -566,6 +1144,70 @@ ChainIterator chain_end_from(const Chain& chain, const Snarl* start_snarl, bool
     }
 } 
 
+tuple<bool, bool, bool> get_chain_connectivity(const Chain& chain) {
+    // Determine child snarl connectivity.
+    bool connected_left_left = false;
+    bool connected_right_right = false;
+    bool connected_left_right = true;
+        
+    for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
+        // Go through the oriented child snarls from left to right
+        const Snarl* child = it->first;
+        bool backward = it->second;
+            
+        // Unpack the child's connectivity
+        bool start_self_reachable = child->start_self_reachable();
+        bool end_self_reachable = child->end_self_reachable();
+        bool start_end_reachable = child->start_end_reachable();
+            
+        if (backward) {
+            // Look at the connectivity in reverse
+            std::swap(start_self_reachable, end_self_reachable);
+        }
+            
+        if (start_self_reachable) {
+            // We found a turnaround from the left
+            connected_left_left = true;
+        }
+            
+        if (!start_end_reachable) {
+            // There's an impediment to getting through.
+            connected_left_right = false;
+            // Don't keep looking for turnarounds
+            break;
+        }
+    }
+        
+    for (auto it = chain_rbegin(chain); it != chain_rend(chain); ++it) {
+        // Go through the oriented child snarls from left to right
+        const Snarl* child = it->first;
+        bool backward = it->second;
+            
+        // Unpack the child's connectivity
+        bool start_self_reachable = child->start_self_reachable();
+        bool end_self_reachable = child->end_self_reachable();
+        bool start_end_reachable = child->start_end_reachable();
+            
+        if (backward) {
+            // Look at the connectivity in reverse
+            std::swap(start_self_reachable, end_self_reachable);
+        }
+            
+        if (end_self_reachable) {
+            // We found a turnaround from the right
+            connected_right_right = true;
+            break;
+        }
+            
+        if (!start_end_reachable) {
+            // Don't keep looking for turnarounds
+            break;
+        }
+    }
+        
+    return make_tuple(connected_left_left, connected_right_right, connected_left_right);
+}
+    
 // TODO: this is duplicative with the other constructor, but protobuf won't let me make
 // a deserialization iterator to match its signature because its internal file streams
 // disallow copy constructors
@@ -660,10 +1302,23 @@ const deque<Chain>& SnarlManager::chains_of(const Snarl* snarl) const {
     return child_chains.at(key_form(snarl));
 }
     
+const tuple<bool, bool, bool>& SnarlManager::chain_connectivity(const Chain* chain) const {
+    return chain_connectivities.at(chain);
+}
+    
 NetGraph SnarlManager::net_graph_of(const Snarl* snarl, const HandleGraph* graph, bool use_internal_connectivity) const {
-    // Just get the chains and forward them on to the NetGraph.
-    // TODO: The NetGraph ends up computing its own indexes.
-    return NetGraph(snarl->start(), snarl->end(), chains_of(snarl), graph, use_internal_connectivity);
+    // Index the children ourselves, so the NetGraph can use the chain
+    // connectivity we already have instead of walking every chain again.
+    NetGraph net_graph(snarl->start(), snarl->end(), graph, use_internal_connectivity);
+    for (const Chain& chain : chains_of(snarl)) {
+        if (chain.size() == 1 && chain.front()->type() == UNARY) {
+            // This is a unary snarl wrapped in a chain
+            net_graph.add_unary_child(chain.front());
+        } else {
+            net_graph.add_chain_child(chain, chain_connectivities.at(&chain));
+        }
+    }
+    return net_graph;
 }
     
 bool SnarlManager::is_leaf(const Snarl* snarl) const {
@@ -762,6 +1417,12 @@ void SnarlManager::flip(const Snarl* snarl) {
     // Update self index
     self[key_form(snarl)] = std::move(self[old_key]);
     self.erase(old_key);
+    
+    // The chain may see the snarl differently now
+    auto chain_found = parent_chain.find(key_form(snarl));
+    if (chain_found != parent_chain.end() && chain_found->second != nullptr) {
+        chain_connectivities[chain_found->second] = get_chain_connectivity(*chain_found->second);
+    }
         
     // note: snarl_into index is invariant to flipping
 }
@@ -804,6 +1465,7 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
             
         // Save a copy of the chain as a root chain
         root_chains.push_back(new_chain);
+        chain_connectivities[&root_chains.back()] = get_chain_connectivity(root_chains.back());
             
         for (const Snarl* child : new_chain) {
             // Save it as a root snarl
@@ -832,6 +1494,8 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
         
         // Save a copy of the chain as a child chain
         child_chains[key_form(chain_parent)].push_back(new_chain);
+        chain_connectivities[&child_chains[key_form(chain_parent)].back()] =
+            get_chain_connectivity(child_chains[key_form(chain_parent)].back());
             
         for (const Snarl* child : new_chain) {
             // Save it as a child of the parent
@@ -963,6 +1627,7 @@ void SnarlManager::build_indexes() {
             for (const Snarl* snarl : chain) {
                 parent_chain.emplace(key_form(snarl), &chain);
             }
+            chain_connectivities[&chain] = get_chain_connectivity(chain);
         }
         
         for (auto& kv : children) {
@@ -980,6 +1645,7 @@ void SnarlManager::build_indexes() {
                 for (const Snarl* snarl : chain) {
                     parent_chain.emplace(key_form(snarl), &chain);
                 }
+                chain_connectivities[&chain] = get_chain_connectivity(chain);
             }
                 
         }
@@ -1511,6 +2177,15 @@ void NetGraph::add_unary_child(const Snarl* unary) {
 }
     
 void NetGraph::add_chain_child(const Chain& chain) {
+    if (use_internal_connectivity) {
+        add_chain_child(chain, get_chain_connectivity(chain));
+    } else {
+        // The connectivity won't be used
+        add_chain_child(chain, make_tuple(false, false, true));
+    }
+}
+    
+void NetGraph::add_chain_child(const Chain& chain, const tuple<bool, bool, bool>& chain_connectivity) {
     // For every chain, get its bounding handles in the base graph
     handle_t chain_start_handle = graph->get_handle(get_start_of(chain));
     handle_t chain_end_handle = graph->get_handle(get_end_of(chain));
@@ -1520,70 +2195,8 @@ void NetGraph::add_chain_child(const Chain& chain) {
     chain_end_rewrites[graph->flip(chain_end_handle)] = graph->flip(chain_start_handle);
         
     if (use_internal_connectivity) {
-        
-        // Determine child snarl connectivity.
-        bool connected_left_left = false;
-        bool connected_right_right = false;
-        bool connected_left_right = true;
-            
-        for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
-            // Go through the oriented child snarls from left to right
-            const Snarl* child = it->first;
-            bool backward = it->second;
-                
-            // Unpack the child's connectivity
-            bool start_self_reachable = child->start_self_reachable();
-            bool end_self_reachable = child->end_self_reachable();
-            bool start_end_reachable = child->start_end_reachable();
-                
-            if (backward) {
-                // Look at the connectivity in reverse
-                std::swap(start_self_reachable, end_self_reachable);
-            }
-                
-            if (start_self_reachable) {
-                // We found a turnaround from the left
-                connected_left_left = true;
-            }
-                
-            if (!start_end_reachable) {
-                // There's an impediment to getting through.
-                connected_left_right = false;
-                // Don't keep looking for turnarounds
-                break;
-            }
-        }
-            
-        for (auto it = chain_rbegin(chain); it != chain_rend(chain); ++it) {
-            // Go through the oriented child snarls from left to right
-            const Snarl* child = it->first;
-            bool backward = it->second;
-                
-            // Unpack the child's connectivity
-            bool start_self_reachable = child->start_self_reachable();
-            bool end_self_reachable = child->end_self_reachable();
-            bool start_end_reachable = child->start_end_reachable();
-                
-            if (backward) {
-                // Look at the connectivity in reverse
-                std::swap(start_self_reachable, end_self_reachable);
-            }
-                
-            if (end_self_reachable) {
-                // We found a turnaround from the right
-                connected_right_right = true;
-                break;
-            }
-                
-            if (!start_end_reachable) {
-                // Don't keep looking for turnarounds
-                break;
-            }
-        }
-            
         // Save the connectivity
-        connectivity[graph->get_id(chain_start_handle)] = tie(connected_left_left,
-                                                              connected_right_right, connected_left_right);
+        connectivity[graph->get_id(chain_start_handle)] = chain_connectivity;
     } else {
         // Act like a normal connected-through node.
         connectivity[graph->get_id(chain_start_handle)] = make_tuple(false, false, true);
@@ -1641,29 +2254,31 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
     auto handle_edge = [&](const handle_t& other) -> bool {
             
         handle_t real_handle = other;
-        if (chain_end_rewrites.count(other)) {
+        auto rewrite = chain_end_rewrites.find(other);
+        if (rewrite != chain_end_rewrites.end()) {
             // We're reading into the end of a chain.
             // Warp to the start.
-            real_handle = chain_end_rewrites.at(other);
-        } else if (chain_end_rewrites.count(graph->flip(other))) {
+            real_handle = rewrite->second;
+        } else if ((rewrite = chain_end_rewrites.find(graph->flip(other))) != chain_end_rewrites.end()) {
             // We're backing into the end of a chain.
             // Warp to the start.
-            real_handle = graph->flip(chain_end_rewrites.at(graph->flip(other)));
+            real_handle = graph->flip(rewrite->second);
         }
             
 #ifdef debug
         cerr << "Found edge " << (go_left ? "from " : "to ") << graph->get_id(other) << " " << graph->get_is_reverse(other) << endl;
 #endif
             
-        if (!seen.count(real_handle)) {
-            seen.insert(real_handle);
+        if (seen.insert(real_handle).second) {
 #ifdef debug
             cerr << "Report as " << graph->get_id(real_handle) << " " << graph->get_is_reverse(real_handle) << endl;
 #endif
                 
             return iteratee(real_handle);
         } else {
+#ifdef debug
             cerr << "Edge has been seen" << endl;
+#endif
             return true;
         }
     };
@@ -1672,14 +2287,15 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
     auto flip_and_handle_edge = [&](const handle_t& other) -> bool {
             
         handle_t real_handle = other;
-        if (chain_end_rewrites.count(other)) {
+        auto rewrite = chain_end_rewrites.find(other);
+        if (rewrite != chain_end_rewrites.end()) {
             // We're reading into the end of a chain.
             // Warp to the start.
-            real_handle = chain_end_rewrites.at(other);
-        } else if (chain_end_rewrites.count(graph->flip(other))) {
+            real_handle = rewrite->second;
+        } else if ((rewrite = chain_end_rewrites.find(graph->flip(other))) != chain_end_rewrites.end()) {
             // We're backing into the end of a chain.
             // Warp to the start.
-            real_handle = graph->flip(chain_end_rewrites.at(graph->flip(other)));
+            real_handle = graph->flip(rewrite->second);
         }
             
         real_handle = graph->flip(real_handle);
@@ -1688,15 +2304,16 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
         cerr << "Found edge " << (go_left ? "from " : "to ") << graph->get_id(other) << " " << graph->get_is_reverse(other) << endl;
 #endif
             
-        if (!seen.count(real_handle)) {
-            seen.insert(real_handle);
+        if (seen.insert(real_handle).second) {
 #ifdef debug
             cerr << "Report as " << graph->get_id(real_handle) << " " << graph->get_is_reverse(real_handle) << endl;
 #endif
                 
             return iteratee(real_handle);
         } else {
+#ifdef debug
             cerr << "Edge has been seen" << endl;
+#endif
             return true;
         }
     };
@@ -1713,7 +2330,12 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
         return true;
     }
         
-    if (chain_ends_by_start.count(handle) || chain_ends_by_start.count(graph->flip(handle))) {
+    // Find the chain, if any, that we are reading into the start of, or out of the start of
+    auto forward_chain = chain_ends_by_start.find(handle);
+    auto reverse_chain = forward_chain == chain_ends_by_start.end() ?
+        chain_ends_by_start.find(graph->flip(handle)) : chain_ends_by_start.end();
+        
+    if (forward_chain != chain_ends_by_start.end() || reverse_chain != chain_ends_by_start.end()) {
         // If we have an associated chain end for this start, we have to use chain connectivity to decide what to do.
             
 #ifdef debug
@@ -1729,7 +2351,7 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
         cerr << "Connectivity: " << connected_start_start << " " << connected_end_end << " " << connected_start_end << endl;
 #endif
             
-        if (chain_ends_by_start.count(handle)) {
+        if (forward_chain != chain_ends_by_start.end()) {
             // We visit the chain in its forward orientation
                 
 #ifdef debug
@@ -1752,7 +2374,7 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
                     
                     // Anything after us but in its reverse orientation could be our predecessor
                     // But a thing after us may be a chain, in which case we need to find its head before flipping.
-                    if (!graph->follow_edges(chain_ends_by_start.at(handle), false, flip_and_handle_edge)) {
+                    if (!graph->follow_edges(forward_chain->second, false, flip_and_handle_edge)) {
                         // Iteratee is done
                         return false;
                     }
@@ -1799,7 +2421,7 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
 #endif
                     
                     // Look right out of the end of the chain (which is the handle we really are on)
-                    if (!graph->follow_edges(chain_ends_by_start.at(handle), false, handle_edge)) {
+                    if (!graph->follow_edges(forward_chain->second, false, handle_edge)) {
                         // Iteratee is done
                         return false;
                     }
@@ -1840,7 +2462,7 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
                     cerr << "We can continue through and go out the end" << endl;
 #endif
                     
-                    if (!graph->follow_edges(chain_ends_by_start.at(graph->flip(handle)), false, flip_and_handle_edge)) {
+                    if (!graph->follow_edges(reverse_chain->second, false, flip_and_handle_edge)) {
                         // Iteratee is done
                         return false;
                     }
@@ -1859,7 +2481,7 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
                     cerr << "We can reverse and go back out the end" << endl;
 #endif
                     
-                    if (!graph->follow_edges(chain_ends_by_start.at(graph->flip(handle)), false, handle_edge)) {
+                    if (!graph->follow_edges(reverse_chain->second, false, handle_edge)) {
                         // Iteratee is done
                         return false;
                     }
@@ -1964,6 +2586,22 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
 }
     
 void NetGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    if (parallel) {
+        // The traversal that finds our handles has to be serial, so collect
+        // them all first and then split them statically over the threads.
+        vector<handle_t> handles;
+        for_each_handle([&](const handle_t& here) {
+            handles.push_back(here);
+            return true;
+        }, false);
+        
+#pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < handles.size(); i++) {
+            iteratee(handles[i]);
+        }
+        return;
+    }
+    
     // Find all the handles by a traversal.
         
     // We have to do the traversal on the underlying backing graph, because
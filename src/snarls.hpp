@@ -67,6 +67,13 @@ class CactusSnarlFinder : public SnarlFinder {
         const Visit& parent_start, const Visit& parent_end,
         stList* chains_list, stList* unary_snarls_list, SnarlManager& destination);
     
+    /// Find the snarls in each weakly connected component of the graph on its
+    /// own, in parallel, given the components from
+    /// weakly_connected_component_ids(). Each component's Cactus graph is
+    /// freed as soon as its snarls are in the SnarlManager.
+    SnarlManager find_component_snarls(const vector<id_t>& node_ids, const vector<size_t>& component_ids,
+                                       size_t component_count);
+    
 public:
     /**
      * Make a new CactusSnarlFinder to find snarls in the given graph.
@@ -89,6 +96,35 @@ public:
     
 };
 
+/**
+ * Class for finding all snarls in any HandleGraph without going through
+ * Cactus. Builds the cactus graph itself, from the 3-edge-connected components
+ * of the graph's adjacency components, and reads the chains and snarls off of
+ * its cycles and bridges. Weakly connected components are decomposed in
+ * parallel, and everything takes close to linear time.
+ *
+ * Each component is rooted at a pair of far-apart tips, which the top-level
+ * chain runs between, or at an arbitrary node if it has no tips.
+ */
+class IntegratedSnarlFinder : public SnarlFinder {
+
+    /// Holds the graph we are looking for sites in.
+    const HandleGraph& graph;
+
+public:
+    /**
+     * Make a new IntegratedSnarlFinder to find snarls in the given graph.
+     * The graph is not modified.
+     */
+    IntegratedSnarlFinder(const HandleGraph& graph);
+
+    /**
+     * Find all the snarls, and put them into a SnarlManager.
+     */
+    virtual SnarlManager find_snarls();
+
+};
+
 /**
  * Snarls are defined at the Protobuf level, but here is how we define
  * chains as real objects.
@@ -183,6 +219,14 @@ ChainIterator chain_begin_from(const Chain& chain, const Snarl* start_snarl, boo
 /// And the end iterator for the chain (forward or reverse complement)
 /// viewed from a given snarl in the given inward orientation
 ChainIterator chain_end_from(const Chain& chain, const Snarl* start_snarl, bool snarl_orientation);
+
+/**
+ * Work out whether a chain, in its forward orientation, can be entered at its
+ * start and left back out of its start, entered at its end and left back out
+ * of its end, and crossed from start to end, going through the contents of
+ * its snarls. Returned in that order.
+ */
+tuple<bool, bool, bool> get_chain_connectivity(const Chain& chain);
     
 /**
  * Allow traversing a graph of nodes and child snarl chains within a snarl
@@ -221,7 +265,7 @@ ChainIterator chain_end_from(const Chain& chain, const Snarl* start_snarl, bool
  * inward-facing ending handles of child chains).
  * 
  */
-class NetGraph : public HandleGraph {
+class NetGraph final : public HandleGraph {
 public:
         
     /// Make a new NetGraph for the given snarl in the given backing graph,
@@ -343,6 +387,13 @@ protected:
     /// Add a chain of one or more non-unary snarls to the index.
     void add_chain_child(const Chain& chain);
     
+    /// Add a chain of one or more non-unary snarls to the index, with its
+    /// connectivity already worked out by get_chain_connectivity().
+    void add_chain_child(const Chain& chain, const tuple<bool, bool, bool>& chain_connectivity);
+    
+    // The SnarlManager builds net graphs from the connectivity it already has.
+    friend class SnarlManager;
+    
     // Save the backing graph
     const HandleGraph* graph;
         
@@ -437,6 +488,10 @@ public:
     /// Snarls are not necessarily oriented appropriately given their ordering in the chain.
     /// Useful for making a net graph.
     const deque<Chain>& chains_of(const Snarl* snarl) const;
+    
+    /// Get the connectivity of one of the chains from chains_of(), as
+    /// get_chain_connectivity() would compute it. Looked up, not computed.
+    const tuple<bool, bool, bool>& chain_connectivity(const Chain* chain) const;
         
     /// Get the net graph of the given Snarl's contents, using the given
     /// backing HandleGraph. If use_internal_connectivity is false, each
@@ -547,6 +602,10 @@ private:
         
     /// Map of node traversals to the snarls they point into
     unordered_map<pair<int64_t, bool>, const Snarl*> snarl_into;
+    
+    /// Connectivity of every chain, so net graphs don't need to walk them.
+    /// Relies on the chains never moving.
+    unordered_map<const Chain*, tuple<bool, bool, bool>> chain_connectivities;
         
     /// Converts Snarl to the form used as keys in internal data structures
     inline key_t key_form(const Snarl* snarl) const;
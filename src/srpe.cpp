@@ -1,4 +1,11 @@
 #include "srpe.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
 
 using namespace std;
 namespace vg{
@@ -11,69 +18,269 @@ namespace vg{
         throw runtime_error("Unimplemented!");
     }
 
-    void SRPE::call_svs_paired_end(vg::VG* graph, ifstream& gamstream, vector<BREAKPOINT>& bps, string refpath){
-        
-    }
-
-    void SRPE::call_svs_split_read(vg::VG* graph, ifstream& gamstream, vector<BREAKPOINT>& bps, string refpath){
-        // We're going to do a bunch of split-read mappings now,
-        // then decide if our orientations support an inversion, an insertion,
-        // or a deletion.
-    }
-
-
-    void SRPE::call_svs(string graphfile, string gamfile, string refpath){
-        vg::VG* graph;
-        if (!graphfile.empty()){
-            ifstream in(graphfile);
-            graph = new VG(in, false);
-        }
-        ifstream gamstream;
-        gamstream.open(gamfile);
-        // Set up path index
-        ff.set_my_vg(graph);
-        ff.soft_clip_limit = 20;
-        ff.fill_node_to_position(refpath);
-    
-        std::function<vector<BREAKPOINT> (vector<BREAKPOINT>)> merge_breakpoints = [](vector<BREAKPOINT> bps){
-        vector<BREAKPOINT> ret;
-        BREAKPOINT sent;
-        sent.start = -100;
-        ret.push_back(sent);
-        for (int i = 0; i < bps.size(); i++){
-            BREAKPOINT a = bps[i];
-            bool merged = false;
-            for (int j = 0; j < ret.size(); j++){
-                if (ret[j].overlap(a, 20)){
-                    ret[j].other_supports += 1;
-                    merged = true;
+    /// Find where a position falls on the reference path. Returns false if it
+    /// isn't on the path.
+    static bool ref_offset(xg::XG* xindex, const string& refpath, const pos_t& pos,
+                           int64_t& offset, bool& is_rev){
+        auto offsets = xindex->offsets_in_paths(pos);
+        auto found = offsets.find(refpath);
+        if (found == offsets.end() || found->second.empty()){
+            return false;
+        }
+        offset = found->second.front().first;
+        is_rev = found->second.front().second;
+        return true;
+    }
+
+    /// Get the last base an alignment covers in the graph.
+    static pos_t alignment_last_pos(const Alignment& aln){
+        auto& last = aln.path().mapping(aln.path().mapping_size() - 1);
+        pos_t pos = make_pos_t(last.position());
+        size_t len = mapping_from_length(last);
+        if (len > 0){
+            get_offset(pos) += len - 1;
+        }
+        return pos;
+    }
+
+    /// Make a breakpoint at the given graph position on the reference.
+    static BREAKPOINT make_breakpoint(const Alignment& aln, const string& refpath, const pos_t& pos,
+                                      int64_t offset, bool is_forward, int sv_type){
+        BREAKPOINT bp;
+        bp.name = aln.name();
+        bp.position = make_position(pos);
+        bp.contig = refpath;
+        bp.start = offset;
+        bp.isForward = is_forward;
+        bp.SV_TYPE = sv_type;
+        return bp;
+    }
+
+    void SRPE::paired_end_breakpoints(const Alignment& aln1, const Alignment& aln2,
+                                      const string& refpath, vector<BREAKPOINT>& bps){
+        if (aln1.path().mapping_size() == 0 || aln2.path().mapping_size() == 0){
+            return;
+        }
+        pos_t start1 = make_pos_t(aln1.path().mapping(0).position());
+        pos_t start2 = make_pos_t(aln2.path().mapping(0).position());
+        int64_t offset1, offset2;
+        bool rev1, rev2;
+        if (!ref_offset(xindex, refpath, start1, offset1, rev1) ||
+            !ref_offset(xindex, refpath, start2, offset2, rev2)){
+            return;
+        }
+
+        // Put the leftmost mate first
+        const Alignment* left = &aln1;
+        const Alignment* right = &aln2;
+        if (offset2 < offset1){
+            swap(left, right);
+            swap(offset1, offset2);
+            swap(rev1, rev2);
+        }
+
+        int sv_type;
+        if (rev1 == rev2){
+            // Both mates read the same strand: an inversion
+            sv_type = 3;
+        }
+        else if (rev1 && !rev2){
+            // The mates face away from each other: a tandem duplication
+            sv_type = 4;
+        }
+        else if (offset2 - offset1 > max_frag_len){
+            // The mates are too far apart: a deletion
+            sv_type = 2;
+        }
+        else {
+            // Concordant
+            return;
+        }
+
+        // The breakpoints are past the inner ends of the mates
+        pos_t left_end = alignment_last_pos(*left);
+        int64_t left_offset;
+        bool left_rev;
+        if (!ref_offset(xindex, refpath, left_end, left_offset, left_rev)){
+            left_offset = offset1;
+        }
+        BREAKPOINT bp = make_breakpoint(*left, refpath, left_end, left_offset, true, sv_type);
+        bp.fragl_supports = 1;
+        BREAKPOINT mate = make_breakpoint(*right, refpath, make_pos_t(right->path().mapping(0).position()),
+                                          offset2, false, sv_type);
+        mate.fragl_supports = 1;
+        bp.mates.push_back(mate);
+        bps.push_back(bp);
+    }
+
+    void SRPE::split_read_breakpoints(const Alignment& aln, const string& refpath,
+                                      vector<BREAKPOINT>& bps){
+        // We're going to look for reads that only align in part, which
+        // is where they run over an inversion, an insertion, or a deletion.
+        if (aln.path().mapping_size() == 0){
+            return;
+        }
+        if (softclip_start(aln) >= min_soft_clip){
+            pos_t pos = make_pos_t(aln.path().mapping(0).position());
+            int64_t offset;
+            bool is_rev;
+            if (ref_offset(xindex, refpath, pos, offset, is_rev)){
+                BREAKPOINT bp = make_breakpoint(aln, refpath, pos, offset, false, 0);
+                bp.split_supports = 1;
+                bps.push_back(bp);
+            }
+        }
+        if (softclip_end(aln) >= min_soft_clip){
+            pos_t pos = alignment_last_pos(aln);
+            int64_t offset;
+            bool is_rev;
+            if (ref_offset(xindex, refpath, pos, offset, is_rev)){
+                BREAKPOINT bp = make_breakpoint(aln, refpath, pos, offset, true, 0);
+                bp.split_supports = 1;
+                bps.push_back(bp);
+            }
+        }
+    }
+
+    vector<BREAKPOINT> SRPE::merge_breakpoints(vector<vector<BREAKPOINT>>& buffers){
+        auto breakpoint_less = [](const BREAKPOINT& a, const BREAKPOINT& b){
+            return a.contig < b.contig || (a.contig == b.contig && a.start < b.start);
+        };
+
+        // Sort each thread's buffer, then merge them all together pairwise
+        #pragma omp parallel for
+        for (size_t i = 0; i < buffers.size(); i++){
+            std::sort(buffers[i].begin(), buffers[i].end(), breakpoint_less);
+        }
+        vector<BREAKPOINT> sorted;
+        for (auto& buffer : buffers){
+            size_t middle = sorted.size();
+            sorted.insert(sorted.end(), std::make_move_iterator(buffer.begin()),
+                          std::make_move_iterator(buffer.end()));
+            std::inplace_merge(sorted.begin(), sorted.begin() + middle, sorted.end(), breakpoint_less);
+            buffer.clear();
+        }
+
+        // Sweep along, folding each breakpoint into an earlier one of the same
+        // type and direction that it's close enough to
+        vector<BREAKPOINT> merged;
+        size_t window_start = 0;
+        for (auto& bp : sorted){
+            while (window_start < merged.size() &&
+                   (merged[window_start].contig != bp.contig ||
+                    bp.start - merged[window_start].start >= merge_distance)){
+                window_start++;
+            }
+            bool was_merged = false;
+            for (size_t j = window_start; j < merged.size(); j++){
+                auto& other = merged[j];
+                if (other.SV_TYPE == bp.SV_TYPE && other.isForward == bp.isForward && other.overlap(bp, merge_distance)){
+                    other.fragl_supports += bp.fragl_supports;
+                    other.split_supports += bp.split_supports;
+                    other.other_supports += bp.other_supports;
+                    other.mates.insert(other.mates.end(), bp.mates.begin(), bp.mates.end());
+                    was_merged = true;
+                    break;
                 }
             }
-            if (!merged){
-                ret.push_back(a);
+            if (!was_merged){
+                merged.push_back(std::move(bp));
             }
         }
-        return ret;
-    };
+        return merged;
+    }
 
-    vector<BREAKPOINT> pe_bps;
-    vector<BREAKPOINT> sr_bps;
+    /// Stream a GAM of interleaved pairs (or of single reads, if we don't
+    /// want paired-end evidence) through the given caller, with one buffer of
+    /// breakpoints per thread.
+    static void stream_breakpoints(istream& gamstream, bool paired,
+                                   const function<void(Alignment&, vector<BREAKPOINT>&)>& per_read,
+                                   const function<void(Alignment&, Alignment&, vector<BREAKPOINT>&)>& per_pair,
+                                   vector<vector<BREAKPOINT>>& buffers){
+        buffers.clear();
+        buffers.resize(get_thread_count());
+        if (paired){
+            function<void(Alignment&, Alignment&)> lambda = [&](Alignment& aln1, Alignment& aln2){
+                auto& buffer = buffers[omp_get_thread_num()];
+                per_read(aln1, buffer);
+                per_read(aln2, buffer);
+                per_pair(aln1, aln2, buffer);
+            };
+            stream::for_each_interleaved_pair_parallel(gamstream, lambda);
+        }
+        else {
+            function<void(Alignment&)> lambda = [&](Alignment& aln){
+                per_read(aln, buffers[omp_get_thread_num()]);
+            };
+            stream::for_each_parallel(gamstream, lambda);
+        }
+    }
+
+    void SRPE::call_svs_paired_end(istream& gamstream, vector<BREAKPOINT>& bps, const string& refpath){
+        vector<vector<BREAKPOINT>> buffers;
+        stream_breakpoints(gamstream, true,
+            [&](Alignment& aln, vector<BREAKPOINT>& buffer){
+                if (add_coverage && packer != nullptr){
+                    packer->add(aln, false);
+                }
+            },
+            [&](Alignment& aln1, Alignment& aln2, vector<BREAKPOINT>& buffer){
+                paired_end_breakpoints(aln1, aln2, refpath, buffer);
+            }, buffers);
+        bps = merge_breakpoints(buffers);
+    }
 
-    call_svs_paired_end(graph, gamstream, pe_bps, refpath);
-    call_svs_split_read(graph, gamstream, sr_bps, refpath);
-    vector<BREAKPOINT> pe_merged = merge_breakpoints(pe_bps);
-    vector<BREAKPOINT> sr_merged = merge_breakpoints(sr_bps);
-    vector<BREAKPOINT> merged;
-    merged.insert(merged.begin(), pe_merged.begin(), pe_merged.end());
-    merged.insert(merged.begin(), sr_merged.begin(), sr_merged.end());
-    merged = merge_breakpoints(merged);
+    void SRPE::call_svs_split_read(istream& gamstream, vector<BREAKPOINT>& bps, const string& refpath){
+        vector<vector<BREAKPOINT>> buffers;
+        stream_breakpoints(gamstream, false,
+            [&](Alignment& aln, vector<BREAKPOINT>& buffer){
+                if (add_coverage && packer != nullptr){
+                    packer->add(aln, false);
+                }
+                split_read_breakpoints(aln, refpath, buffer);
+            },
+            [&](Alignment& aln1, Alignment& aln2, vector<BREAKPOINT>& buffer){
+            }, buffers);
+        bps = merge_breakpoints(buffers);
+    }
+
+    void SRPE::call_svs(istream& gamstream, vector<BREAKPOINT>& bps, const string& refpath){
+        vector<vector<BREAKPOINT>> buffers;
+        stream_breakpoints(gamstream, true,
+            [&](Alignment& aln, vector<BREAKPOINT>& buffer){
+                if (add_coverage && packer != nullptr){
+                    packer->add(aln, false);
+                }
+                split_read_breakpoints(aln, refpath, buffer);
+            },
+            [&](Alignment& aln1, Alignment& aln2, vector<BREAKPOINT>& buffer){
+                paired_end_breakpoints(aln1, aln2, refpath, buffer);
+            }, buffers);
+        bps = merge_breakpoints(buffers);
 
+        if (packer != nullptr){
+            // Now that all the reads are in, look up the depth at each breakpoint
+            #pragma omp parallel for
+            for (size_t i = 0; i < bps.size(); i++){
+                bps[i].depth = packer->coverage_at_position(packer->position_in_basis(bps[i].position));
+            }
+        }
     }
 
-    void SRPE::aln_to_bseq(Alignment& a, bseq1_t* read){
-        read->seq = (char*) a.sequence().c_str();
-        read->qual = (char*) a.quality().c_str();
+    void SRPE::aln_to_bseq(const Alignment& a, bseq1_t* read){
         read->l_seq = a.sequence().length();
+        read->seq = strdup(a.sequence().c_str());
+        if (a.quality().empty()){
+            read->qual = nullptr;
+        }
+        else {
+            // Fermi-lite wants Phred+33 characters, and we store raw scores
+            read->qual = (char*) malloc(a.quality().size() + 1);
+            for (size_t i = 0; i < a.quality().size(); i++){
+                read->qual[i] = (char) (a.quality()[i] + 33);
+            }
+            read->qual[a.quality().size()] = '\0';
+        }
     }
 
     /*
@@ -90,29 +297,107 @@ namespace vg{
     /**
     * function assemble
     * inputs: a vector of Alignments to be assembled (based on their sequences)
-    * outputs: 
+    * outputs: the unitigs, copied out before fermi-lite's are destroyed
     */
-    void SRPE::assemble(vector<Alignment> alns, vector<fml_utg_t>& unitigs){
-        int n_seqs, n_utgs;
-        n_seqs = alns.size();
-        bseq1_t* mr_bseqs = new bseq1_t [alns.size()];
+    void SRPE::assemble(const vector<Alignment>& alns, vector<Unitig>& unitigs){
+        int n_seqs = min(alns.size(), (size_t) max_reads);
+        if (n_seqs == 0){
+            return;
+        }
+        // Fermi-lite takes ownership of the reads and frees them
+        bseq1_t* mr_bseqs = (bseq1_t*) calloc(n_seqs, sizeof(bseq1_t));
         for (int i = 0; i < n_seqs; ++i){
             aln_to_bseq( alns[i], mr_bseqs + i );
         }
-        fml_utg_t *utgs;
         fml_opt_t opt;
         fml_opt_init(&opt);
-        utgs = fml_assemble(&opt, n_seqs, mr_bseqs, &n_utgs);
+        // Assemblies run side by side, so each should stick to its own thread
+        opt.n_threads = 1;
+        int n_utgs;
+        fml_utg_t* utgs = fml_assemble(&opt, n_seqs, mr_bseqs, &n_utgs);
         for (int i = 0; i < n_utgs; ++i){
-            unitigs.push_back( *(utgs + i) );
+            unitigs.emplace_back();
+            unitigs.back().sequence.assign(utgs[i].seq, utgs[i].len);
+            unitigs.back().coverage.assign(utgs[i].cov, utgs[i].len);
+            unitigs.back().supporting_reads = utgs[i].nsr;
         }
 
         fml_utg_destroy(n_utgs, utgs);
     }
 
-    void SRPE::assemble(string refpath, int64_t start_pos, int64_t end_pos, vector<fml_utg_t>& unitigs){
+    void SRPE::assemble(string refpath, int64_t start_pos, int64_t end_pos, vector<Unitig>& unitigs){
         // Get all alignments on <refpath> from <startpos> to <endpos>
     }
+
+    vector<AssemblyRegion> SRPE::assembly_regions(const vector<BREAKPOINT>& bps){
+        vector<AssemblyRegion> regions;
+        for (auto& bp : bps){
+            int64_t start = max((int64_t) 0, bp.start - assembly_flank);
+            int64_t end = bp.start + assembly_flank;
+            if (!regions.empty() && regions.back().contig == bp.contig && regions.back().end >= start){
+                // Grow the last region to cover this breakpoint too
+                regions.back().end = max(regions.back().end, end);
+            }
+            else {
+                regions.emplace_back();
+                regions.back().contig = bp.contig;
+                regions.back().start = start;
+                regions.back().end = end;
+            }
+        }
+        return regions;
+    }
+
+    void SRPE::collect_assembly_reads(istream& gamstream, vector<AssemblyRegion>& regions, const string& refpath){
+        // Only regions on our path can get reads
+        vector<size_t> path_regions;
+        for (size_t i = 0; i < regions.size(); i++){
+            if (regions[i].contig == refpath){
+                path_regions.push_back(i);
+            }
+        }
+        if (path_regions.empty()){
+            return;
+        }
+        function<void(Alignment&)> lambda = [&](Alignment& aln){
+            if (aln.path().mapping_size() == 0){
+                return;
+            }
+            int64_t offset;
+            bool is_rev;
+            if (!ref_offset(xindex, refpath, make_pos_t(aln.path().mapping(0).position()), offset, is_rev)){
+                return;
+            }
+            // Find the last region starting at or before the read
+            auto found = std::upper_bound(path_regions.begin(), path_regions.end(), offset,
+                                          [&](int64_t off, size_t i){ return off < regions[i].start; });
+            if (found == path_regions.begin()){
+                return;
+            }
+            auto& region = regions[*(found - 1)];
+            if (offset >= region.end){
+                return;
+            }
+            #pragma omp critical (srpe_assembly_reads)
+            {
+                if (region.reads.size() < (size_t) max_reads){
+                    region.reads.push_back(aln);
+                }
+            }
+        };
+        stream::for_each_parallel(gamstream, lambda);
+    }
+
+    void SRPE::assemble_regions(vector<AssemblyRegion>& regions){
+        // Each region is its own job, and big ones take longer, so hand them
+        // out one at a time
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < regions.size(); i++){
+            regions[i].unitigs.clear();
+            assemble(regions[i].reads, regions[i].unitigs);
+        }
+    }
+
     void SRPE::assemble(int64_t node_id, int64_t pos, int window_size){
 
     }
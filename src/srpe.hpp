@@ -13,6 +13,8 @@
 #include <gcsa/gcsa.h>
 #include "alignment.hpp"
 #include "genotypekit.hpp"
+#include "packer.hpp"
+#include "xg.hpp"
 using namespace std;
 namespace vg{
 
@@ -41,6 +43,9 @@ namespace vg{
         int split_supports = 0;
         int other_supports = 0;
 
+        // Read depth at the breakpoint, from the coverage index
+        size_t depth = 0;
+
         inline int total_supports(){
             return fragl_supports + split_supports + other_supports;
         }
@@ -68,6 +73,24 @@ namespace vg{
     };
 
 
+    // A unitig from a local assembly, copied out of fermi-lite's memory
+    struct Unitig{
+        string sequence;
+        // cov[i]-33 gives the per-base coverage at i
+        string coverage;
+        // Number of reads supporting the unitig
+        int supporting_reads = 0;
+    };
+
+    // A stretch of a reference path to assemble, with the reads that were
+    // found there and the unitigs they assembled into
+    struct AssemblyRegion{
+        string contig;
+        int64_t start = 0;
+        int64_t end = 0;
+        vector<Alignment> reads;
+        vector<Unitig> unitigs;
+    };
 
 /**
  * Overview:
@@ -89,11 +112,11 @@ class DepthMap {
     *  Map <SnarlTraversal : support count>
     */
 public:
-  int8_t* depths;
-  uint64_t size;
+  int8_t* depths = nullptr;
+  uint64_t size = 0;
   map<int64_t, uint64_t> node_pos;
-  vg::VG* g_graph;
-  inline DepthMap(int64_t sz) { depths = new int8_t[sz]; };
+  vg::VG* g_graph = nullptr;
+  inline DepthMap(int64_t sz) { size = sz; depths = new int8_t[sz](); };
   inline DepthMap() {};
   inline DepthMap(vg::VG* graph){
     g_graph = graph;
@@ -107,13 +130,19 @@ public:
     };
     graph->for_each_node(count_size);
     size = tot_size;
-    depths = new int8_t(size);
+    depths = new int8_t[size]();
   };
-  inline int8_t get_depth(int64_t node_id, int64_t offset) { return depths[node_id + offset]; };
-  inline void set_depth(int64_t node_id, int64_t offset, int8_t d) { depths[node_id + offset] = d; };
+  inline ~DepthMap() { delete[] depths; };
+  DepthMap(const DepthMap& other) = delete;
+  DepthMap& operator=(const DepthMap& other) = delete;
+  inline int8_t get_depth(int64_t node_id, int64_t offset) { return depths[node_pos[node_id] + offset]; };
+  inline void set_depth(int64_t node_id, int64_t offset, int8_t d) { depths[node_pos[node_id] + offset] = d; };
   inline void increment_depth(int64_t node_id, int64_t offset) {
-    
-    depths[node_pos [node_id] + offset] += 1;
+    // Saturate rather than wrapping around
+    int8_t& d = depths[node_pos [node_id] + offset];
+    if (d < INT8_MAX) {
+        d += 1;
+    }
 };
   inline void fill_depth(const vg::Path& p){
     for (int i = 0; i < p.mapping_size(); i++){
@@ -145,26 +174,57 @@ public:
 
             vector<pair<int, int> > intervals;
 
-            void call_svs_paired_end(vg::VG* graph, ifstream& gamstream, vector<BREAKPOINT>& bps, string refpath="");
-            void call_svs_split_read(vg::VG* graph, ifstream& gamstream, vector<BREAKPOINT>& bps, string refpath="");
-            void call_svs(string graphfile, string gamfile, string refpath);
+            // Find breakpoints supported by discordant read pairs in a GAM of
+            // interleaved pairs, against the reference path in the XG index.
+            // Breakpoints near each other are merged, and come out sorted.
+            void call_svs_paired_end(istream& gamstream, vector<BREAKPOINT>& bps, const string& refpath);
+            // Find breakpoints supported by soft clipped reads.
+            void call_svs_split_read(istream& gamstream, vector<BREAKPOINT>& bps, const string& refpath);
+            // Find breakpoints of both kinds in one pass over a GAM of
+            // interleaved pairs, merge them, and annotate them with depth.
+            void call_svs(istream& gamstream, vector<BREAKPOINT>& bps, const string& refpath);
+
+            // Find the breakpoints a single read pair or read supports.
+            void paired_end_breakpoints(const Alignment& aln1, const Alignment& aln2,
+                                        const string& refpath, vector<BREAKPOINT>& bps);
+            void split_read_breakpoints(const Alignment& aln, const string& refpath,
+                                        vector<BREAKPOINT>& bps);
+
+            // Sort per-thread breakpoint buffers, merge them together, and
+            // merge breakpoints of the same type within merge_distance.
+            vector<BREAKPOINT> merge_breakpoints(vector<vector<BREAKPOINT>>& buffers);
 
             // Calculate a proxy for discordance between a set of Alginments
             // and a subgraph (e.g. one that's been modified with a candidate variant)
             // Useful for deciding which variant is closest to what's represented in reads
             double discordance_score(vector<Alignment> alns, VG* subgraph);
 
-            // Convert Alignments to the read-like objects Fermi-lite uses in assembly
-            void aln_to_bseq(Alignment& a, bseq1_t* read);
+            // Convert Alignments to the read-like objects Fermi-lite uses in assembly.
+            // The strings are copied into malloc'd memory, since fermi-lite frees them.
+            void aln_to_bseq(const Alignment& a, bseq1_t* read);
 
             // Assemble a set of alignments into a set of unitigs
             // UNITIGS ARE GRAPH ELEMENTS - you could make them subgraphs.
             // Alignments need not map to the graph (e.g. they could be unmapped reads)
-            void assemble(vector<Alignment> alns, vector<fml_utg_t>& unitigs);
+            // At most max_reads of the alignments are used.
+            void assemble(const vector<Alignment>& alns, vector<Unitig>& unitigs);
 
             // Assemble a set of Alignments that map along <refpath> between <startpos> and <endpos>,
             // which are reference-relative coordinates (a.k.a your standard, linear ref coordinates)
-            void assemble(string refpath, int64_t start_pos, int64_t end_pos, vector<fml_utg_t>& unitigs);
+            void assemble(string refpath, int64_t start_pos, int64_t end_pos, vector<Unitig>& unitigs);
+
+            // Make a region to assemble around each breakpoint, reaching
+            // assembly_flank bases to either side, merging regions that overlap.
+            // Breakpoints must be sorted, as they come from call_svs.
+            vector<AssemblyRegion> assembly_regions(const vector<BREAKPOINT>& bps);
+
+            // Stream through a GAM and give each region the reads that start in
+            // it on the reference path, up to max_reads per region. Regions must
+            // be sorted and nonoverlapping.
+            void collect_assembly_reads(istream& gamstream, vector<AssemblyRegion>& regions, const string& refpath);
+
+            // Assemble all the regions concurrently, filling in their unitigs.
+            void assemble_regions(vector<AssemblyRegion>& regions);
 
             // Assemble all reads that overlap a given position (within window_size bp)
             void assemble(int64_t node_id, int64_t offset, int window_size);
@@ -172,8 +232,20 @@ public:
             // Are multiple references present in the same subgraph?
             bool overlapping_refs = false;
 
-            // Maps from node-id to read depth
-            DepthMap depth;
+            // The index of the graph the reads are aligned to
+            xg::XG* xindex = nullptr;
+
+            // Coverage index for the reads. If it is thread safe and
+            // add_coverage is set, reads are added to it as they stream by.
+            Packer* packer = nullptr;
+            bool add_coverage = false;
+
+            // Read pairs further apart than this on the reference are discordant
+            int max_frag_len = 10000;
+            // Soft clips at least this long mark a split read
+            int min_soft_clip = 20;
+            // Breakpoints of the same type this close together are merged
+            int merge_distance = 20;
 
             // Every SRPE gets its own filter
             vg::Filter ff;
@@ -189,9 +261,13 @@ public:
             // gcsa::GCSA* gindex;
             // gcsa::LCPArray * lcp_ind;
 
-            // Cap the total coverage at a given position
+            // Cap the total coverage at a given position, and the number of
+            // reads assembled per region
             int max_reads = 125;
 
+            // How far to either side of a breakpoint to assemble
+            int64_t assembly_flank = 500;
+
 
 
 };
@@ -0,0 +1,156 @@
+#include "stage_stats.hpp"
+
+#include <omp.h>
+#include <iomanip>
+
+/**
+ * \file stage_stats.cpp
+ * Implementations for the mapping stage timers.
+ */
+
+namespace vg {
+
+using namespace std;
+
+thread_local uint64_t StageStats::read_nanos[StageStats::NUM_STAGES];
+
+const char* StageStats::stage_name(Stage stage) {
+    switch (stage) {
+    case MEMS:
+        return "mems";
+    case RESEED:
+        return "reseed";
+    case CLUSTER:
+        return "cluster";
+    case SUBGRAPH:
+        return "subgraph";
+    case ALIGN:
+        return "align";
+    case MAPQ:
+        return "mapq";
+    case RESCUE:
+        return "rescue";
+    default:
+        return "unknown";
+    }
+}
+
+const char* StageStats::event_name(Event event) {
+    switch (event) {
+    case CLUSTERS_ALIGNED:
+        return "clusters-aligned";
+    case CLUSTERS_PRUNED:
+        return "clusters-pruned";
+    case RESCUES_ATTEMPTED:
+        return "rescues-attempted";
+    case RESCUES_SUCCEEDED:
+        return "rescues-succeeded";
+    case RESCUES_PREFILTERED:
+        return "rescues-prefiltered";
+    case RESCUE_WINDOWS_CACHED:
+        return "rescue-windows-cached";
+    case BUDGET_LIMITED_READS:
+        return "budget-limited-reads";
+    default:
+        return "unknown";
+    }
+}
+
+StageStats::StageStats(size_t num_threads) : num_slots(num_threads ? num_threads : omp_get_max_threads()),
+    slots(new Slot[num_slots]) {
+    
+    for (size_t i = 0; i < num_slots; i++) {
+        for (size_t j = 0; j < NUM_STAGES; j++) {
+            slots[i].nanos[j] = 0;
+            slots[i].calls[j] = 0;
+        }
+        for (size_t j = 0; j < NUM_EVENTS; j++) {
+            slots[i].events[j] = 0;
+        }
+    }
+}
+
+void StageStats::record(Stage stage, chrono::nanoseconds elapsed) {
+    // Threads in nested parallel regions can share a number, so the slots
+    // still need to be atomic, but normally nobody else touches them.
+    Slot& slot = slots[omp_get_thread_num() % num_slots];
+    slot.nanos[stage].fetch_add(elapsed.count(), memory_order_relaxed);
+    slot.calls[stage].fetch_add(1, memory_order_relaxed);
+    read_nanos[stage] += elapsed.count();
+}
+
+uint64_t StageStats::calls(Stage stage) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < num_slots; i++) {
+        total += slots[i].calls[stage].load(memory_order_relaxed);
+    }
+    return total;
+}
+
+double StageStats::seconds(Stage stage) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < num_slots; i++) {
+        total += slots[i].nanos[stage].load(memory_order_relaxed);
+    }
+    return total / 1e9;
+}
+
+void StageStats::count(Event event, uint64_t times) {
+    Slot& slot = slots[omp_get_thread_num() % num_slots];
+    slot.events[event].fetch_add(times, memory_order_relaxed);
+}
+
+uint64_t StageStats::occurrences(Event event) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < num_slots; i++) {
+        total += slots[i].events[event].load(memory_order_relaxed);
+    }
+    return total;
+}
+
+void StageStats::report(ostream& out, const string& prefix) const {
+    auto initial_precision = out.precision();
+    auto initial_flags = out.flags();
+    
+    out << setprecision(3) << fixed;
+    out << prefix << "stage\tcalls\tseconds\tmean(us)" << endl;
+    for (size_t i = 0; i < NUM_STAGES; i++) {
+        Stage stage = (Stage) i;
+        uint64_t stage_calls = calls(stage);
+        double stage_seconds = seconds(stage);
+        out << prefix << stage_name(stage) << "\t" << stage_calls << "\t" << stage_seconds << "\t"
+            << (stage_calls ? stage_seconds * 1e6 / stage_calls : 0.0) << endl;
+    }
+    out << prefix << "event\tcount" << endl;
+    for (size_t i = 0; i < NUM_EVENTS; i++) {
+        Event event = (Event) i;
+        out << prefix << event_name(event) << "\t" << occurrences(event) << endl;
+    }
+    
+    out.precision(initial_precision);
+    out.flags(initial_flags);
+}
+
+void StageStats::start_read() {
+    for (size_t i = 0; i < NUM_STAGES; i++) {
+        read_nanos[i] = 0;
+    }
+}
+
+double StageStats::read_seconds(Stage stage) {
+    return read_nanos[stage] / 1e9;
+}
+
+StageStats::Timer::Timer(StageStats* stats, Stage stage) : stats(stats), stage(stage) {
+    if (stats) {
+        start = chrono::high_resolution_clock::now();
+    }
+}
+
+StageStats::Timer::~Timer() {
+    if (stats) {
+        stats->record(stage, chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - start));
+    }
+}
+
+}
@@ -0,0 +1,143 @@
+#ifndef VG_STAGE_STATS_HPP_INCLUDED
+#define VG_STAGE_STATS_HPP_INCLUDED
+
+/**
+ * \file stage_stats.hpp
+ *
+ * Cumulative timers and call counters for the stages of read mapping, so we
+ * can see where the time goes inside the mappers on a real workload without
+ * attaching a profiler, and counters for work the mappers decided to skip.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Running totals of the time spent in and the number of entries into each
+ * stage of mapping. Totals are kept in one slot per OpenMP thread, so threads
+ * don't fight over cache lines, and summed when reported. Stages can nest
+ * (sub-MEM reseeding happens inside MEM finding), so the totals of different
+ * stages shouldn't be added up.
+ *
+ * One StageStats can be shared by any number of mappers.
+ */
+class StageStats {
+public:
+    
+    /// The stages we keep time for
+    enum Stage {
+        /// Finding MEMs, including reseeding
+        MEMS = 0,
+        /// Reseeding sub-MEMs inside MEMs
+        RESEED,
+        /// Clustering MEM hits
+        CLUSTER,
+        /// Extracting subgraphs around clusters
+        SUBGRAPH,
+        /// Dynamic programming alignment, fill and traceback
+        ALIGN,
+        /// Computing mapping qualities
+        MAPQ,
+        /// Rescuing mates
+        RESCUE,
+        NUM_STAGES
+    };
+    
+    /// The events we count that aren't stages
+    enum Event {
+        /// Cluster subgraphs aligned to
+        CLUSTERS_ALIGNED = 0,
+        /// Cluster subgraphs skipped because they couldn't change the result
+        CLUSTERS_PRUNED,
+        /// Mates realigned to a rescue window
+        RESCUES_ATTEMPTED,
+        /// Mates whose rescue alignment was accepted
+        RESCUES_SUCCEEDED,
+        /// Mates not realigned because they share no k-mers with the window
+        RESCUES_PREFILTERED,
+        /// Rescue windows reused from the cache instead of extracted
+        RESCUE_WINDOWS_CACHED,
+        /// Reads that hit a limit of the mapper's per-read work budget
+        BUDGET_LIMITED_READS,
+        NUM_EVENTS
+    };
+    
+    /// Get a short name for a stage
+    static const char* stage_name(Stage stage);
+    
+    /// Get a short name for an event
+    static const char* event_name(Event event);
+    
+    /// Make totals for up to the given number of threads (default: as many as
+    /// OpenMP could use)
+    StageStats(size_t num_threads = 0);
+    
+    /// Add an entry into a stage that took the given time on this thread
+    void record(Stage stage, chrono::nanoseconds elapsed);
+    
+    /// Get the number of entries into a stage over all threads
+    uint64_t calls(Stage stage) const;
+    
+    /// Get the time spent in a stage over all threads
+    double seconds(Stage stage) const;
+    
+    /// Add the given number of occurrences of an event on this thread
+    void count(Event event, uint64_t times = 1);
+    
+    /// Get the number of occurrences of an event over all threads
+    uint64_t occurrences(Event event) const;
+    
+    /// Write a table of the totals to a stream, one line per stage and then
+    /// one per event, each starting with the given prefix
+    void report(ostream& out, const string& prefix = "") const;
+    
+    /// Start keeping the stage times of a new read on this thread, for
+    /// read_seconds(). Times recorded in any StageStats count toward it.
+    static void start_read();
+    
+    /// Get the time this thread has spent in a stage since start_read()
+    static double read_seconds(Stage stage);
+    
+    /**
+     * Times a stage from its construction to its destruction. Does nothing if
+     * given a null StageStats, so mappers can leave timing off for free.
+     */
+    class Timer {
+    public:
+        Timer(StageStats* stats, Stage stage);
+        ~Timer();
+        
+    private:
+        StageStats* stats;
+        Stage stage;
+        chrono::high_resolution_clock::time_point start;
+    };
+    
+private:
+    
+    /// The totals for one thread, padded out to their own cache lines
+    struct Slot {
+        atomic<uint64_t> nanos[NUM_STAGES];
+        atomic<uint64_t> calls[NUM_STAGES];
+        atomic<uint64_t> events[NUM_EVENTS];
+        char padding[64];
+    };
+    
+    size_t num_slots;
+    unique_ptr<Slot[]> slots;
+    
+    /// The time this thread has spent in each stage on its current read
+    thread_local static uint64_t read_nanos[NUM_STAGES];
+};
+
+}
+
+#endif
@@ -11,11 +11,17 @@
 #include <functional>
 #include <vector>
 #include <list>
+#include <memory>
 #include "google/protobuf/stubs/common.h"
+#include "google/protobuf/arena.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/coded_stream.h"
+#include "prefetch_stream.hpp"
+#include "blocked_gzip_stream.hpp"
+#include "stream_codec.hpp"
+#include "metrics_reporter.hpp"
 
 namespace stream {
 
@@ -41,7 +47,7 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
     size_t serialized = 0;
     
     ::google::protobuf::io::OstreamOutputStream raw_out(&out);
-    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
+    CodecOutputStream gzip_out(&raw_out);
     ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
 
     auto handle = [](bool ok) {
@@ -80,6 +86,7 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
             handle(!coded_out.HadError());
             coded_out.WriteRaw(chunk_data.data(), chunk_data.size());
             handle(!coded_out.HadError());
+            vg::MetricsReporter::count_output(1, chunk_data.size());
             
             // Remember how far we've serialized now
             serialized += chunk_elements;
@@ -99,17 +106,15 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
 
 }
 
-// write objects
+// write a group of objects to an already-compressing stream
 // count should be equal to the number of objects to write
 // count is written before the objects, but if it is 0, it is not written
 // if not all objects are written, return false, otherwise true
 template <typename T>
-bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
+bool write_group(::google::protobuf::io::ZeroCopyOutputStream& compressed_out, uint64_t count,
+                 const std::function<T(uint64_t)>& lambda) {
 
-    // Make all our streams on the stack, in case of error.
-    ::google::protobuf::io::OstreamOutputStream raw_out(&out);
-    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
-    ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&compressed_out);
 
     auto handle = [](bool ok) {
         if (!ok) {
@@ -125,6 +130,7 @@ bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>&
 
     std::string s;
     uint64_t written = 0;
+    uint64_t written_bytes = 0;
     for (uint64_t n = 0; n < count; ++n, ++written) {
         handle(lambda(n).SerializeToString(&s));
         if (s.size() > MAX_PROTOBUF_SIZE) {
@@ -135,18 +141,163 @@ bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>&
         handle(!coded_out.HadError());
         coded_out.WriteRaw(s.data(), s.size());
         handle(!coded_out.HadError());
+        written_bytes += s.size();
     }
+    vg::MetricsReporter::count_output(written, written_bytes);
 
     return !count || written == count;
 }
 
+// write objects as their own gzip member
+// count should be equal to the number of objects to write
+// count is written before the objects, but if it is 0, it is not written
+// if not all objects are written, return false, otherwise true
+template <typename T>
+bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
+
+    // Make all our streams on the stack, in case of error.
+    ::google::protobuf::io::OstreamOutputStream raw_out(&out);
+    CodecOutputStream gzip_out(&raw_out);
+    return write_group(gzip_out, count, lambda);
+}
+
+// write objects into a BGZF stream, so that the group starts at the virtual
+// offset out.Tell() had beforehand
+template <typename T>
+bool write(BlockedGzipOutputStream& out, uint64_t count, const std::function<T(uint64_t)>& lambda) {
+    return write_group(out, count, lambda);
+}
+
+/// A buffer of messages waiting to be written, which are allocated on a
+/// protobuf Arena instead of one at a time on the heap. Clearing the buffer
+/// resets the arena but keeps a block big enough for the biggest batch so far,
+/// so once the buffer has grown to fit a batch, refilling it doesn't allocate.
+template <typename T>
+class ArenaBuffer {
+public:
+    ArenaBuffer() {
+        reset_arena(0);
+    }
+
+    /// Add a new empty message to the end of the buffer, and return it.
+    T* add() {
+        messages.push_back(::google::protobuf::Arena::CreateMessage<T>(arena.get()));
+        return messages.back();
+    }
+
+    /// Copy a message onto the end of the buffer.
+    void push_back(const T& message) {
+        add()->CopyFrom(message);
+    }
+
+    size_t size() const {
+        return messages.size();
+    }
+
+    bool empty() const {
+        return messages.empty();
+    }
+
+    const T& at(size_t i) const {
+        return *messages.at(i);
+    }
+
+    T& back() {
+        return *messages.back();
+    }
+
+    /// Drop all the messages in the buffer.
+    void clear() {
+        messages.clear();
+        size_t used = arena->SpaceAllocated();
+        if (used > initial_block.size()) {
+            // leave some room so a slightly bigger batch doesn't grow it again
+            reset_arena(used + used / 2);
+        } else {
+            arena->Reset();
+        }
+    }
+
+private:
+
+    /// Replace the arena with one that starts out in a block of the given size.
+    void reset_arena(size_t block_size) {
+        // the old arena may be using the old block, so it has to go first
+        arena.reset();
+        messages.clear();
+        std::vector<char>(block_size).swap(initial_block);
+        ::google::protobuf::ArenaOptions options;
+        if (block_size) {
+            options.initial_block = initial_block.data();
+            options.initial_block_size = initial_block.size();
+        }
+        arena.reset(new ::google::protobuf::Arena(options));
+    }
+
+    std::vector<char> initial_block;
+    std::unique_ptr<::google::protobuf::Arena> arena;
+    std::vector<T*> messages;
+};
+
+// serialize and compress a group of objects in this thread, into a complete
+// gzip member of our own, and write it out, so that the only thing threads
+// have to take turns on is copying the finished bytes to the output
+template <typename T>
+bool write_member(std::ostream& out, uint64_t count, const std::function<const T&(uint64_t)>& lambda) {
+    bool wrote = false;
+    std::string compressed;
+    {
+        ::google::protobuf::io::StringOutputStream string_out(&compressed);
+        CodecOutputStream gzip_out(&string_out);
+        wrote = write_group<const T&>(gzip_out, count, lambda);
+        if (!gzip_out.Close()) {
+            throw std::runtime_error("stream::write_buffered: error compressing protobuf");
+        }
+    }
+#pragma omp critical (stream_out)
+    {
+        out.write(compressed.data(), compressed.size());
+    }
+    if (!out) {
+        throw std::runtime_error("stream::write_buffered: I/O error writing protobuf");
+    }
+    return wrote;
+}
+
+// write the buffer as a group if it has reached buffer_limit objects, and
+// clear it. Safe to call from many threads on the same stream; each thread's
+// groups come out in the order that thread wrote them.
 template <typename T>
 bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_limit) {
     bool wrote = false;
     if (buffer.size() >= buffer_limit) {
-        std::function<T(uint64_t)> lambda = [&buffer](uint64_t n) { return buffer.at(n); };
+        std::function<const T&(uint64_t)> lambda = [&buffer](uint64_t n) -> const T& { return buffer.at(n); };
+        wrote = write_member<T>(out, buffer.size(), lambda);
+        buffer.clear();
+    }
+    return wrote;
+}
+
+// write an arena-backed buffer in the same way, serializing the messages
+// where they are
+template <typename T>
+bool write_buffered(std::ostream& out, ArenaBuffer<T>& buffer, uint64_t buffer_limit) {
+    bool wrote = false;
+    if (buffer.size() >= buffer_limit) {
+        std::function<const T&(uint64_t)> lambda = [&buffer](uint64_t n) -> const T& { return buffer.at(n); };
+        wrote = write_member<T>(out, buffer.size(), lambda);
+        buffer.clear();
+    }
+    return wrote;
+}
+
+template <typename T>
+bool write_buffered(BlockedGzipOutputStream& out, std::vector<T>& buffer, uint64_t buffer_limit) {
+    bool wrote = false;
+    if (buffer.size() >= buffer_limit) {
+        std::function<const T&(uint64_t)> lambda = [&buffer](uint64_t n) -> const T& { return buffer.at(n); };
 #pragma omp critical (stream_out)
-        wrote = write(out, buffer.size(), lambda);
+        wrote = write<const T&>(out, buffer.size(), lambda);
         buffer.clear();
     }
     return wrote;
@@ -162,7 +313,7 @@ void for_each(std::istream& in,
               const std::function<void(uint64_t)>& handle_count) {
 
     ::google::protobuf::io::IstreamInputStream raw_in(&in);
-    ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
+    CodecInputStream gzip_in(&raw_in);
     ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
 
     auto handle = [](bool ok) {
@@ -199,6 +350,7 @@ void for_each(std::istream& in,
             
             if (msgSize) {
                 handle(coded_in.ReadString(&s, msgSize));
+                vg::MetricsReporter::count_input(1, msgSize);
                 T object;
                 handle(object.ParseFromString(s));
                 lambda(object);
@@ -216,19 +368,149 @@ void for_each(std::istream& in,
     for_each(in, lambda, noop);
 }
 
+// deserialize the input stream into the objects, like for_each, but parse
+// them on all threads, up to batch_size at a time. lambda is still called on
+// one object at a time, in the order the objects appear in the stream.
+template <typename T>
+void for_each_ordered_parallel(std::istream& in,
+                               const std::function<void(T&)>& lambda,
+                               const std::function<void(uint64_t)>& handle_count,
+                               size_t batch_size = 256) {
+
+    // Inflate on a background thread, so that this thread only has to split
+    // out messages and hand them to the workers.
+    ::google::protobuf::io::IstreamInputStream raw_in(&in);
+    CodecInputStream gzip_in(&raw_in);
+    PrefetchInputStream inflated_in(&gzip_in);
+    ::google::protobuf::io::CodedInputStream coded_in(&inflated_in);
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw std::runtime_error("[stream::for_each_ordered_parallel] obsolete, invalid, or corrupt protobuf input");
+        }
+    };
+
+    std::vector<std::string> batch;
+    batch.reserve(batch_size);
+    auto process_batch = [&]() {
+        std::vector<T> objects(batch.size());
+        // Exceptions can't leave an OMP loop, so collect the failures
+        std::vector<char> parsed(batch.size());
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch.size(); ++i) {
+            parsed[i] = objects[i].ParseFromString(batch[i]);
+            std::string().swap(batch[i]);
+        }
+        for (size_t i = 0; i < objects.size(); ++i) {
+            handle(parsed[i]);
+            lambda(objects[i]);
+        }
+        batch.clear();
+    };
+
+    uint64_t count;
+    // this loop handles a chunked file with many pieces
+    // such as we might write in a multithreaded process
+    while (coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+
+        handle_count(count);
+
+        for (uint64_t i = 0; i < count; ++i) {
+            uint32_t msgSize = 0;
+            // Reconstruct the CodedInputStream in place to reset its maximum-
+            // bytes-ever-read counter, because it thinks it's reading a single
+            // message.
+            coded_in.~CodedInputStream();
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&inflated_in);
+            // Alot space for size, and for reading next chunk's length
+            coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+
+            // the messages are prefixed by their size
+            handle(coded_in.ReadVarint32(&msgSize));
+
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each_ordered_parallel] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+
+            if (msgSize) {
+                std::string s;
+                handle(coded_in.ReadString(&s, msgSize));
+                vg::MetricsReporter::count_input(1, msgSize);
+                batch.push_back(std::move(s));
+                if (batch.size() == batch_size) {
+                    process_batch();
+                }
+            }
+        }
+    }
+    process_batch();
+}
+
+// deserialize a BGZF stream into the objects, also passing the virtual offset
+// of the group each object came from, which can be handed to in.Seek() to get
+// back to that group
+template <typename T>
+void for_each_with_group_offset(BlockedGzipInputStream& in,
+                                const std::function<void(int64_t, T&)>& lambda) {
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw std::runtime_error("[stream::for_each_with_group_offset] obsolete, invalid, or corrupt protobuf input");
+        }
+    };
+
+    while (true) {
+        // The last CodedInputStream gave back anything it read ahead when it
+        // was destroyed, so this is exact.
+        int64_t group_offset = in.Tell();
+        uint64_t count;
+        {
+            ::google::protobuf::io::CodedInputStream coded_in(&in);
+            if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                break;
+            }
+        }
+
+        std::string s;
+        for (uint64_t i = 0; i < count; ++i) {
+            ::google::protobuf::io::CodedInputStream coded_in(&in);
+            coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+
+            uint32_t msgSize = 0;
+            handle(coded_in.ReadVarint32(&msgSize));
+
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each_with_group_offset] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+
+            if (msgSize) {
+                handle(coded_in.ReadString(&s, msgSize));
+                vg::MetricsReporter::count_input(1, msgSize);
+                T object;
+                handle(object.ParseFromString(s));
+                lambda(group_offset, object);
+            }
+        }
+    }
+}
+
 // Parallelized versions of for_each
 
 // First, an internal implementation underlying several variants below.
 // lambda2 is invoked on interleaved pairs of elements from the stream. The
 // elements of each pair are in order, but the overall order in which lambda2
 // is invoked on pairs is undefined (concurrent). lambda1 is invoked on an odd
-// last element of the stream, if any.
+// last element of the stream, if any. If keep_serialized is set, elements
+// whose serialized bytes it rejects are dropped without being parsed.
 template <typename T>
 void for_each_parallel_impl(std::istream& in,
                             const std::function<void(T&,T&)>& lambda2,
                             const std::function<void(T&)>& lambda1,
                             const std::function<void(uint64_t)>& handle_count,
-                            const std::function<bool(void)>& single_threaded_until_true) {
+                            const std::function<bool(void)>& single_threaded_until_true,
+                            const std::function<bool(const std::string&)>& keep_serialized = nullptr) {
 
     // objects will be handed off to worker threads in batches of this many
     const uint64_t batch_size = 256;
@@ -242,16 +524,19 @@ void for_each_parallel_impl(std::istream& in,
 
     // this loop handles a chunked file with many pieces
     // such as we might write in a multithreaded process
-    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, batches_outstanding, max_batches_outstanding, single_threaded_until_true)
+    #pragma omp parallel default(none) shared(in, lambda1, lambda2, handle_count, batches_outstanding, max_batches_outstanding, single_threaded_until_true, keep_serialized)
     #pragma omp single
     {
         auto handle = [](bool retval) -> void {
             if (!retval) throw std::runtime_error("obsolete, invalid, or corrupt protobuf input");
         };
 
+        // Inflate on a background thread, so that this thread only has to
+        // split out messages and hand them to the workers.
         ::google::protobuf::io::IstreamInputStream raw_in(&in);
-        ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
-        ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+        CodecInputStream gzip_in(&raw_in);
+        PrefetchInputStream inflated_in(&gzip_in);
+        ::google::protobuf::io::CodedInputStream coded_in(&inflated_in);
 
         std::vector<std::string> *batch = nullptr;
         
@@ -269,7 +554,7 @@ void for_each_parallel_impl(std::istream& in,
                 // bytes-ever-read counter, because it thinks it's reading a single
                 // message.
                 coded_in.~CodedInputStream();
-                new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+                new (&coded_in) ::google::protobuf::io::CodedInputStream(&inflated_in);
                 // Allot space for size, and for reading next chunk's length
                 coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
                 
@@ -286,7 +571,10 @@ void for_each_parallel_impl(std::istream& in,
                     // pick off the message (serialized protobuf object)
                     std::string s;
                     handle(coded_in.ReadString(&s, msgSize));
-                    batch->push_back(std::move(s));
+                    vg::MetricsReporter::count_input(1, msgSize);
+                    if (!keep_serialized || keep_serialized(s)) {
+                        batch->push_back(std::move(s));
+                    }
                 }
 
                 if (batch->size() == batch_size) {
@@ -349,6 +637,11 @@ void for_each_parallel_impl(std::istream& in,
         }
 
         #pragma omp taskwait
+        if (batch && batch->empty()) {
+            // everything since the last full batch was empty or dropped
+            delete batch;
+            batch = nullptr;
+        }
         // process final batch
         if (batch) {
             {
@@ -384,12 +677,20 @@ void for_each_interleaved_pair_parallel(std::istream& in,
 template <typename T>
 void for_each_interleaved_pair_parallel_after_wait(std::istream& in,
                                                    const std::function<void(T&,T&)>& lambda2,
-                                                   const std::function<bool(void)>& single_threaded_until_true) {
+                                                   const std::function<bool(void)>& single_threaded_until_true,
+                                                   const std::function<void(uint64_t)>& handle_count) {
     std::function<void(T&)> err1 = [](T&){
         throw std::runtime_error("stream::for_each_interleaved_pair_parallel: expected input stream of interleaved pairs, but it had odd number of elements");
     };
+    for_each_parallel_impl(in, lambda2, err1, handle_count, single_threaded_until_true);
+}
+
+template <typename T>
+void for_each_interleaved_pair_parallel_after_wait(std::istream& in,
+                                                   const std::function<void(T&,T&)>& lambda2,
+                                                   const std::function<bool(void)>& single_threaded_until_true) {
     std::function<void(uint64_t)> no_count = [](uint64_t i) {};
-    for_each_parallel_impl(in, lambda2, err1, no_count, single_threaded_until_true);
+    for_each_interleaved_pair_parallel_after_wait(in, lambda2, single_threaded_until_true, no_count);
 }
 
 // parallelized for each individual element
@@ -409,6 +710,18 @@ void for_each_parallel(std::istream& in,
     for_each_parallel(in, lambda, noop);
 }
 
+
+// parallelized for each individual element, skipping without parsing any
+// element whose serialized bytes keep_serialized rejects
+template <typename T>
+void for_each_parallel_filtered(std::istream& in,
+                                const std::function<bool(const std::string&)>& keep_serialized,
+                                const std::function<void(T&)>& lambda1) {
+    std::function<void(T&,T&)> lambda2 = [&lambda1](T& o1, T& o2) { lambda1(o1); lambda1(o2); };
+    std::function<void(uint64_t)> no_count = [](uint64_t) { };
+    std::function<bool(void)> no_wait = [](void) {return true;};
+    for_each_parallel_impl(in, lambda2, lambda1, no_count, no_wait, keep_serialized);
+}
     
 /*
  * Refactored stream::for_each function that follows the unidirectional iterator interface
@@ -478,6 +791,7 @@ public:
         if (msgSize) {
             value.Clear();
             handle(coded_in.ReadString(&s, msgSize));
+            vg::MetricsReporter::count_input(1, msgSize);
             handle(value.ParseFromString(s));
         }
         else {
@@ -509,7 +823,7 @@ private:
     uint64_t chunk_idx;
     
     ::google::protobuf::io::IstreamInputStream raw_in;
-    ::google::protobuf::io::GzipInputStream gzip_in;
+    CodecInputStream gzip_in;
     ::google::protobuf::io::CodedInputStream coded_in;
     
     void handle(bool ok) {
@@ -0,0 +1,312 @@
+#include "stream_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <lz4.h>
+#include <snappy.h>
+
+/**
+ * \file stream_codec.cpp
+ * Implement the compressing and decompressing streams.
+ */
+
+namespace stream {
+
+using namespace std;
+
+/// The bytes that start every frame, before the codec byte
+static const char FRAME_MAGIC[] = "VGC";
+static const size_t FRAME_MAGIC_SIZE = 3;
+/// Magic, codec, uncompressed size and compressed size
+static const size_t FRAME_HEADER_SIZE = FRAME_MAGIC_SIZE + 1 + 4 + 4;
+/// Most uncompressed data we put in one frame
+static const size_t FRAME_SIZE = 1 << 20;
+/// How much we buffer at first, so small writes don't pay for a whole frame
+static const size_t INITIAL_BUFFER_SIZE = 1 << 16;
+/// Most uncompressed data we believe a frame can have when reading
+static const size_t MAX_FRAME_SIZE = 1 << 26;
+
+/// The codec to write with when none is given
+static Codec default_codec = Codec::GZIP;
+
+Codec parse_codec(const string& name) {
+    if (name == "gzip") {
+        return Codec::GZIP;
+    } else if (name == "snappy") {
+        return Codec::SNAPPY;
+    } else if (name == "lz4") {
+        return Codec::LZ4;
+    }
+    throw invalid_argument("unknown compression codec \"" + name + "\" (choose gzip, snappy or lz4)");
+}
+
+string codec_name(Codec codec) {
+    switch (codec) {
+    case Codec::GZIP:
+        return "gzip";
+    case Codec::SNAPPY:
+        return "snappy";
+    case Codec::LZ4:
+        return "lz4";
+    }
+    return "unknown";
+}
+
+void set_default_codec(Codec codec) {
+    default_codec = codec;
+}
+
+Codec get_default_codec() {
+    return default_codec;
+}
+
+static void put_uint32(char* dest, uint32_t value) {
+    for (size_t i = 0; i < 4; i++) {
+        dest[i] = (char) (value >> (8 * i));
+    }
+}
+
+static uint32_t get_uint32(const char* source) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        value |= (uint32_t) (uint8_t) source[i] << (8 * i);
+    }
+    return value;
+}
+
+CodecOutputStream::CodecOutputStream(::google::protobuf::io::ZeroCopyOutputStream* raw, Codec codec) :
+    raw(raw), codec(codec) {
+    if (codec == Codec::GZIP) {
+        gzip = unique_ptr<::google::protobuf::io::GzipOutputStream>(new ::google::protobuf::io::GzipOutputStream(raw));
+    } else {
+        buffer.resize(INITIAL_BUFFER_SIZE);
+    }
+}
+
+CodecOutputStream::~CodecOutputStream() {
+    Close();
+}
+
+bool CodecOutputStream::Next(void** data, int* size) {
+    if (gzip) {
+        return gzip->Next(data, size);
+    }
+    if (buffered == buffer.size()) {
+        if (buffer.size() < FRAME_SIZE) {
+            buffer.resize(min(buffer.size() * 2, FRAME_SIZE));
+        } else if (!write_frame()) {
+            return false;
+        }
+    }
+    *data = &buffer[buffered];
+    *size = buffer.size() - buffered;
+    bytes_written += *size;
+    buffered = buffer.size();
+    return true;
+}
+
+void CodecOutputStream::BackUp(int count) {
+    if (gzip) {
+        gzip->BackUp(count);
+        return;
+    }
+    buffered -= count;
+    bytes_written -= count;
+}
+
+::google::protobuf::int64 CodecOutputStream::ByteCount() const {
+    return gzip ? gzip->ByteCount() : bytes_written;
+}
+
+bool CodecOutputStream::Close() {
+    if (closed) {
+        return true;
+    }
+    closed = true;
+    return gzip ? gzip->Close() : write_frame();
+}
+
+bool CodecOutputStream::write_frame() {
+    if (!buffered) {
+        return true;
+    }
+    size_t compressed_size;
+    if (codec == Codec::SNAPPY) {
+        compressed.resize(FRAME_HEADER_SIZE + snappy::MaxCompressedLength(buffered));
+        snappy::RawCompress(buffer.data(), buffered, &compressed[FRAME_HEADER_SIZE], &compressed_size);
+    } else {
+        compressed.resize(FRAME_HEADER_SIZE + LZ4_compressBound(buffered));
+        int lz4_size = LZ4_compress_default(buffer.data(), &compressed[FRAME_HEADER_SIZE], buffered,
+                                            compressed.size() - FRAME_HEADER_SIZE);
+        if (lz4_size <= 0) {
+            throw runtime_error("[stream::CodecOutputStream] could not compress with LZ4");
+        }
+        compressed_size = lz4_size;
+    }
+    memcpy(&compressed[0], FRAME_MAGIC, FRAME_MAGIC_SIZE);
+    compressed[FRAME_MAGIC_SIZE] = (char) codec;
+    put_uint32(&compressed[FRAME_MAGIC_SIZE + 1], buffered);
+    put_uint32(&compressed[FRAME_MAGIC_SIZE + 5], compressed_size);
+    buffered = 0;
+
+    // copy the frame into the underlying stream's buffers
+    const char* data = compressed.data();
+    size_t remaining = FRAME_HEADER_SIZE + compressed_size;
+    while (remaining) {
+        void* dest;
+        int dest_size;
+        if (!raw->Next(&dest, &dest_size)) {
+            return false;
+        }
+        size_t copied = min(remaining, (size_t) dest_size);
+        memcpy(dest, data, copied);
+        data += copied;
+        remaining -= copied;
+        if (copied < (size_t) dest_size) {
+            raw->BackUp(dest_size - copied);
+        }
+    }
+    return true;
+}
+
+CodecInputStream::CodecInputStream(::google::protobuf::io::ZeroCopyInputStream* raw) : raw(raw) {
+    // Nothing to do
+}
+
+void CodecInputStream::detect() {
+    detected = true;
+    const void* data;
+    int size = 0;
+    while (size == 0) {
+        if (!raw->Next(&data, &size)) {
+            // An empty stream reads the same whatever it is
+            size = 0;
+            break;
+        }
+    }
+    char first = 0;
+    if (size) {
+        first = *(const char*) data;
+        raw->BackUp(size);
+    }
+    // Gzip starts with 0x1f, and zlib with a byte whose low nibble is 8, so
+    // neither can start with a frame's magic
+    if (first != FRAME_MAGIC[0]) {
+        gzip = unique_ptr<::google::protobuf::io::GzipInputStream>(new ::google::protobuf::io::GzipInputStream(raw));
+    }
+}
+
+bool CodecInputStream::read_raw(char* dest, size_t size) {
+    while (size) {
+        const void* data;
+        int data_size;
+        if (!raw->Next(&data, &data_size)) {
+            return false;
+        }
+        size_t copied = min(size, (size_t) data_size);
+        memcpy(dest, data, copied);
+        dest += copied;
+        size -= copied;
+        if (copied < (size_t) data_size) {
+            raw->BackUp(data_size - copied);
+        }
+    }
+    return true;
+}
+
+bool CodecInputStream::read_frame() {
+    char header[FRAME_HEADER_SIZE];
+    const void* data;
+    int data_size = 0;
+    // check for the end of the stream without failing on it
+    while (data_size == 0) {
+        if (!raw->Next(&data, &data_size)) {
+            return false;
+        }
+    }
+    raw->BackUp(data_size);
+    if (!read_raw(header, FRAME_HEADER_SIZE) || memcmp(header, FRAME_MAGIC, FRAME_MAGIC_SIZE) != 0) {
+        throw runtime_error("[stream::CodecInputStream] corrupt or truncated compressed frame");
+    }
+    Codec frame_codec = (Codec) header[FRAME_MAGIC_SIZE];
+    size_t uncompressed_size = get_uint32(header + FRAME_MAGIC_SIZE + 1);
+    size_t compressed_size = get_uint32(header + FRAME_MAGIC_SIZE + 5);
+    if (uncompressed_size > MAX_FRAME_SIZE || compressed_size > 2 * MAX_FRAME_SIZE) {
+        throw runtime_error("[stream::CodecInputStream] corrupt compressed frame");
+    }
+    compressed.resize(compressed_size);
+    if (!read_raw(&compressed[0], compressed_size)) {
+        throw runtime_error("[stream::CodecInputStream] truncated compressed frame");
+    }
+    if (buffer.size() < uncompressed_size) {
+        buffer.resize(uncompressed_size);
+    }
+    bool ok = false;
+    if (frame_codec == Codec::SNAPPY) {
+        size_t snappy_size;
+        ok = snappy::GetUncompressedLength(compressed.data(), compressed_size, &snappy_size)
+            && snappy_size == uncompressed_size
+            && snappy::RawUncompress(compressed.data(), compressed_size, &buffer[0]);
+    } else if (frame_codec == Codec::LZ4) {
+        ok = LZ4_decompress_safe(compressed.data(), &buffer[0], compressed_size, uncompressed_size)
+            == (int) uncompressed_size;
+    }
+    if (!ok) {
+        throw runtime_error("[stream::CodecInputStream] could not decompress " + codec_name(frame_codec) + " frame");
+    }
+    frame_size = uncompressed_size;
+    position = 0;
+    return true;
+}
+
+bool CodecInputStream::Next(const void** data, int* size) {
+    if (!detected) {
+        detect();
+    }
+    if (gzip) {
+        return gzip->Next(data, size);
+    }
+    while (position == frame_size) {
+        if (!read_frame()) {
+            return false;
+        }
+    }
+    *data = buffer.data() + position;
+    *size = frame_size - position;
+    bytes_read += *size;
+    position = frame_size;
+    return true;
+}
+
+void CodecInputStream::BackUp(int count) {
+    if (gzip) {
+        gzip->BackUp(count);
+        return;
+    }
+    position -= count;
+    bytes_read -= count;
+}
+
+bool CodecInputStream::Skip(int count) {
+    const void* data;
+    int size;
+    while (count > 0) {
+        if (!Next(&data, &size)) {
+            return false;
+        }
+        if (size > count) {
+            BackUp(size - count);
+            size = count;
+        }
+        count -= size;
+    }
+    return true;
+}
+
+::google::protobuf::int64 CodecInputStream::ByteCount() const {
+    return gzip ? gzip->ByteCount() : bytes_read;
+}
+
+}
@@ -0,0 +1,136 @@
+#ifndef VG_STREAM_CODEC_HPP_INCLUDED
+#define VG_STREAM_CODEC_HPP_INCLUDED
+
+/**
+ * \file stream_codec.hpp
+ *
+ * Protobuf ZeroCopyStreams that compress and decompress vg's length-prefixed
+ * protobuf streams with a choice of codec. Gzip is the default and is what
+ * everything else reads. Snappy and LZ4 are much faster to write and read,
+ * which makes them a better fit for intermediate files.
+ *
+ * Snappy and LZ4 data is written in frames, each of which is the magic bytes
+ * "VGC", a codec byte, the little-endian 32-bit sizes of the frame's data
+ * before and after compression, and the compressed data. A frame can never
+ * be mistaken for the start of a gzip or zlib stream, so readers look at the
+ * first byte of a stream to tell which kind it is.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "google/protobuf/io/gzip_stream.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+
+namespace stream {
+
+/// The codecs that a stream can be compressed with
+enum class Codec : uint8_t {
+    GZIP = 0,
+    SNAPPY = 1,
+    LZ4 = 2
+};
+
+/// Get the codec with the given name ("gzip", "snappy" or "lz4"). Throws
+/// std::invalid_argument if there isn't one.
+Codec parse_codec(const std::string& name);
+
+/// Get the name of a codec.
+std::string codec_name(Codec codec);
+
+/// Set the codec that streams are written with when none is given. This
+/// should be set before any threads start writing.
+void set_default_codec(Codec codec);
+
+/// Get the codec that streams are written with when none is given.
+Codec get_default_codec();
+
+/**
+ * Compress data onto another ZeroCopyOutputStream with a codec. Everything
+ * written is flushed when the stream is closed or destroyed.
+ */
+class CodecOutputStream : public ::google::protobuf::io::ZeroCopyOutputStream {
+public:
+    /// Start compressing onto the given stream, which must outlive this one.
+    CodecOutputStream(::google::protobuf::io::ZeroCopyOutputStream* raw, Codec codec = get_default_codec());
+
+    /// Close the stream if it isn't closed already.
+    ~CodecOutputStream();
+
+    CodecOutputStream(const CodecOutputStream& other) = delete;
+    CodecOutputStream& operator=(const CodecOutputStream& other) = delete;
+
+    bool Next(void** data, int* size) override;
+    void BackUp(int count) override;
+    ::google::protobuf::int64 ByteCount() const override;
+
+    /// Compress and write out everything buffered, and finish the stream.
+    /// Returns false if the underlying stream fails.
+    bool Close();
+
+private:
+    /// Compress and write out the buffer as a frame.
+    bool write_frame();
+
+    ::google::protobuf::io::ZeroCopyOutputStream* raw;
+    Codec codec;
+    /// Does the work when we're using gzip
+    std::unique_ptr<::google::protobuf::io::GzipOutputStream> gzip;
+    /// Uncompressed data waiting to go in a frame
+    std::string buffer;
+    /// How much of the buffer has actually been filled
+    size_t buffered = 0;
+    /// Space to compress a frame into
+    std::string compressed;
+    ::google::protobuf::int64 bytes_written = 0;
+    bool closed = false;
+};
+
+/**
+ * Decompress data from another ZeroCopyInputStream, which may have been
+ * written with any codec.
+ */
+class CodecInputStream : public ::google::protobuf::io::ZeroCopyInputStream {
+public:
+    /// Start decompressing from the given stream, which must outlive this one.
+    CodecInputStream(::google::protobuf::io::ZeroCopyInputStream* raw);
+
+    CodecInputStream(const CodecInputStream& other) = delete;
+    CodecInputStream& operator=(const CodecInputStream& other) = delete;
+
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    ::google::protobuf::int64 ByteCount() const override;
+
+private:
+    /// Look at the start of the stream to see which codec it uses.
+    void detect();
+
+    /// Read and decompress the next frame into the buffer. Returns false at
+    /// the end of the stream, and throws if the frame is bad.
+    bool read_frame();
+
+    /// Copy exactly the given number of bytes from the underlying stream.
+    /// Returns false if it ends first.
+    bool read_raw(char* dest, size_t size);
+
+    ::google::protobuf::io::ZeroCopyInputStream* raw;
+    bool detected = false;
+    /// Does the work when the stream is gzip
+    std::unique_ptr<::google::protobuf::io::GzipInputStream> gzip;
+    /// The decompressed data of the current frame
+    std::string buffer;
+    /// How much of the current frame's data there is
+    size_t frame_size = 0;
+    /// How much of the current frame's data has been handed out
+    size_t position = 0;
+    /// Space to read a frame's compressed data into
+    std::string compressed;
+    ::google::protobuf::int64 bytes_read = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+#include "sub_handle_graph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+/** \file sub_handle_graph.cpp
+ * Implement the SubHandleGraph view.
+ */
+
+namespace vg {
+
+using namespace std;
+
+SubHandleGraph::SubHandleGraph(const HandleGraph* super) : super(super) {
+    // Nothing to do
+}
+
+bool SubHandleGraph::add_handle(const handle_t& handle) {
+    handle_t forward = super->forward(handle);
+    id_t node_id = super->get_id(forward);
+    if (local_id.count(node_id)) {
+        return false;
+    }
+    local_id[node_id] = contents.size();
+    contents.push_back(forward);
+    return true;
+}
+
+bool SubHandleGraph::has_node(id_t node_id) const {
+    return local_id.count(node_id);
+}
+
+void SubHandleGraph::expand_context(size_t steps) {
+    // Only the nodes added on the last step can have neighbors outside
+    size_t frontier = 0;
+    for (size_t i = 0; i < steps; i++) {
+        size_t added = contents.size();
+        for (size_t j = frontier; j < added; j++) {
+            for (bool go_left : {false, true}) {
+                super->follow_edges(contents[j], go_left, [&](const handle_t& next) {
+                    add_handle(next);
+                });
+            }
+        }
+        frontier = added;
+    }
+}
+
+void SubHandleGraph::to_graph(Graph& graph) const {
+    vector<handle_t> sorted(contents);
+    sort(sorted.begin(), sorted.end(), [&](const handle_t& a, const handle_t& b) {
+        return super->get_id(a) < super->get_id(b);
+    });
+
+    vector<tuple<id_t, id_t, bool, bool>> edges;
+    for (auto& handle : sorted) {
+        Node* node = graph.add_node();
+        node->set_id(super->get_id(handle));
+        node->set_sequence(super->get_sequence(handle));
+
+        for (bool go_left : {false, true}) {
+            follow_edges(handle, go_left, [&](const handle_t& other) {
+                handle_t left = go_left ? other : handle;
+                handle_t right = go_left ? handle : other;
+                // The same edge read the other way around
+                handle_t flipped_left = super->flip(right);
+                handle_t flipped_right = super->flip(left);
+                auto as_written = make_tuple(super->get_id(left), super->get_id(right),
+                                             super->get_is_reverse(left), super->get_is_reverse(right));
+                auto as_flipped = make_tuple(super->get_id(flipped_left), super->get_id(flipped_right),
+                                             super->get_is_reverse(flipped_left), super->get_is_reverse(flipped_right));
+                int written_flags = get<2>(as_written) + get<3>(as_written);
+                int flipped_flags = get<2>(as_flipped) + get<3>(as_flipped);
+                if (flipped_flags < written_flags ||
+                    (flipped_flags == written_flags && as_flipped < as_written)) {
+                    edges.push_back(as_flipped);
+                } else {
+                    edges.push_back(as_written);
+                }
+            });
+        }
+    }
+    // Every edge comes up from both of its ends
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+    for (auto& edge : edges) {
+        Edge* e = graph.add_edge();
+        e->set_from(get<0>(edge));
+        e->set_to(get<1>(edge));
+        e->set_from_start(get<2>(edge));
+        e->set_to_end(get<3>(edge));
+    }
+}
+
+handle_t SubHandleGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    auto found = local_id.find(node_id);
+    if (found == local_id.end()) {
+        throw runtime_error("[SubHandleGraph] node " + to_string(node_id) + " is not in the subgraph");
+    }
+    handle_t handle = contents[found->second];
+    return is_reverse ? super->flip(handle) : handle;
+}
+
+id_t SubHandleGraph::get_id(const handle_t& handle) const {
+    return super->get_id(handle);
+}
+
+bool SubHandleGraph::get_is_reverse(const handle_t& handle) const {
+    return super->get_is_reverse(handle);
+}
+
+handle_t SubHandleGraph::flip(const handle_t& handle) const {
+    return super->flip(handle);
+}
+
+size_t SubHandleGraph::get_length(const handle_t& handle) const {
+    return super->get_length(handle);
+}
+
+string SubHandleGraph::get_sequence(const handle_t& handle) const {
+    return super->get_sequence(handle);
+}
+
+bool SubHandleGraph::follow_edges(const handle_t& handle, bool go_left,
+                                  const function<bool(const handle_t&)>& iteratee) const {
+    return super->follow_edges(handle, go_left, [&](const handle_t& next) {
+        // Skip edges that leave the subgraph
+        return !has_node(super->get_id(next)) || iteratee(next);
+    });
+}
+
+void SubHandleGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    if (parallel) {
+#pragma omp parallel for schedule(dynamic, 512)
+        for (size_t i = 0; i < contents.size(); i++) {
+            // We can't stop early in parallel
+            iteratee(contents[i]);
+        }
+    } else {
+        for (size_t i = 0; i < contents.size(); i++) {
+            if (!iteratee(contents[i])) {
+                return;
+            }
+        }
+    }
+}
+
+size_t SubHandleGraph::node_size() const {
+    return contents.size();
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef VG_SUB_HANDLE_GRAPH_HPP_INCLUDED
+#define VG_SUB_HANDLE_GRAPH_HPP_INCLUDED
+
+/** \file
+ * sub_handle_graph.hpp: defines a read-only HandleGraph view of some of the
+ * nodes of another HandleGraph, so that a local region of a big index can be
+ * collected without copying it into Protobuf objects piece by piece.
+ */
+
+#include "handle.hpp"
+#include "hash_map.hpp"
+
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A HandleGraph made of a set of nodes of a backing graph and all the backing
+ * graph's edges between them. Handles are the backing graph's own handles, so
+ * nothing is copied but the handles themselves and a small map from node ID to
+ * its local number.
+ *
+ * The backing graph must outlive the subgraph and must not change under it.
+ */
+class SubHandleGraph : public HandleGraph {
+public:
+
+    /// Make an empty subgraph of the given graph
+    SubHandleGraph(const HandleGraph* super);
+
+    /// Add the node of a handle of the backing graph, in either orientation.
+    /// Returns false if it was in the subgraph already.
+    bool add_handle(const handle_t& handle);
+
+    /// Returns true if the node with the given ID is in the subgraph
+    bool has_node(id_t node_id) const;
+
+    /// Add every node of the backing graph that is adjacent to a node of the
+    /// subgraph, repeated the given number of times
+    void expand_context(size_t steps);
+
+    /// Write the nodes, in ID order, and the edges between them, each once,
+    /// into a Graph. Edges are written without reversing flags where they can
+    /// be, and otherwise from the smaller ID.
+    void to_graph(Graph& graph) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+
+    /// Get the ID from a handle
+    virtual id_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    virtual bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    virtual handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    virtual size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    virtual string get_sequence(const handle_t& handle) const;
+
+    /// Loop over all the handles to next/previous (right/left) nodes in the
+    /// subgraph. Passes them to a callback which returns false to stop
+    /// iterating and true to continue. Returns true if we finished and false
+    /// if we stopped early.
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+
+    /// Loop over all the nodes in the subgraph in their local forward
+    /// orientations, in the order they were added.
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    /// Return the number of nodes in the subgraph
+    virtual size_t node_size() const;
+
+    using HandleGraph::get_handle;
+    using HandleGraph::follow_edges;
+    using HandleGraph::for_each_handle;
+
+private:
+
+    const HandleGraph* super;
+
+    /// Forward handles of the nodes, in the order they were added
+    vector<handle_t> contents;
+
+    /// Local number of each node, which is its index in contents
+    hash_map<id_t, size_t> local_id;
+};
+
+}
+
+#endif
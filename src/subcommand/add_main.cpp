@@ -30,6 +30,7 @@ void help_add(char** argv) {
          << "    -i, --ignore-missing   ignore contigs in the VCF not found in the graph" << endl
          << "    -r, --variant-range N  range in which to look for nearby variants to make a haplotype" << endl
          << "    -f, --flank-range N    extra flanking sequence to use outside of found variants" << endl
+         << "    -b, --budget N         align variants alone when their window has over N bp of haplotypes [0=off]" << endl
          << "    -p, --progress         show progress" << endl
          << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl;
 }
@@ -50,6 +51,7 @@ int main_add(int argc, char** argv) {
     bool ignore_missing = false;
     int variant_range = -1;
     int flank_range = -1;
+    size_t haplotype_budget = 0;
     
     // TODO: make variant_adder not hold on to its graph so tightly, so we can
     // set its settings as we parse the options;
@@ -64,6 +66,7 @@ int main_add(int argc, char** argv) {
                 {"ignore-missing", no_argument, 0, 'i'},
                 {"variant-range", required_argument, 0, 'r'},
                 {"flank-range", required_argument, 0, 'f'},
+                {"budget", required_argument, 0, 'b'},
                 {"progress",  no_argument, 0, 'p'},
                 {"threads", required_argument, 0, 't'},
                 {"help", no_argument, 0, 'h'},
@@ -71,7 +74,7 @@ int main_add(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "v:n:r:f:ipt:h?",
+        c = getopt_long (argc, argv, "v:n:r:f:b:ipt:h?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -114,6 +117,10 @@ int main_add(int argc, char** argv) {
             flank_range = atoi(optarg);
             break;
 
+        case 'b':
+            haplotype_budget = atoll(optarg);
+            break;
+
         case 'p':
             show_progress = true;
             break;
@@ -188,6 +195,7 @@ int main_add(int argc, char** argv) {
         if (flank_range != -1) {
             adder.flank_range = flank_range;
         }
+        adder.max_window_haplotype_bases = haplotype_budget;
         
         for (auto& rename : renames) {
             // Set up all the VCF contig renames from the command line
@@ -5,12 +5,16 @@
 #include "../stream.hpp"
 #include "../alignment.hpp"
 
+#include <omp.h>
 #include <unistd.h>
 #include <getopt.h>
 
 using namespace vg;
 using namespace vg::subcommand;
 
+/// How many alignments to read for each thread before annotating them all
+const size_t ANNOTATE_BATCH_PER_THREAD = 1000;
+
 void help_annotate(char** argv) {
     cerr << "usage: " << argv[0] << " annotate [options] >output.{gam,vg}" << endl
          << "    -x, --xg-name FILE     an xg index describing a graph" << endl
@@ -21,7 +25,8 @@ void help_annotate(char** argv) {
          << "    -g, --gcsa FILE        a GCSA2 index file base name" << endl
          << "    -a, --gam FILE         alignments to annotate" << endl
          << "    -p, --positions        annotate alignments with reference positions" << endl
-         << "    -n, --novelty          table for each read: name, bp not in xg, nodes not in xg" << endl;
+         << "    -n, --novelty          table for each read: name, bp not in xg, nodes not in xg" << endl
+         << "    -t, --threads N        number of threads to use" << endl;
 }
 
 int main_annotate(int argc, char** argv) {
@@ -55,11 +60,12 @@ int main_annotate(int argc, char** argv) {
             {"gff-name", required_argument, 0, 'f'},
             {"db-name", required_argument, 0, 'd'},
             {"novelty", no_argument, 0, 'n'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:d:v:g:a:pb:f:n",
+        c = getopt_long (argc, argv, "hx:d:v:g:a:pb:f:nt:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -104,6 +110,10 @@ int main_annotate(int argc, char** argv) {
             novelty = true;
             break;
 
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'h':
         case '?':
             help_annotate(argv);
@@ -126,54 +136,94 @@ int main_annotate(int argc, char** argv) {
     Mapper mapper(xg_index, nullptr, nullptr);
     
     if (!gam_name.empty()) {
-        vector<Alignment> buffer;
+        // Alignments are read in batches, annotated in parallel with each
+        // thread taking a slice of the batch, and written out in the order
+        // they came in
+        size_t thread_count = get_thread_count();
+        size_t batch_size = ANNOTATE_BATCH_PER_THREAD * thread_count;
+        vector<Alignment> batch;
+        batch.reserve(batch_size);
+        
+        function<void(void)> process_batch;
         if (add_positions) {
-            //map<string, double> Mapper::alignment_mean_path_positions(const Alignment& aln, bool first_hit_only);
-            function<void(Alignment&)> lambda = [&](Alignment& aln) {
-                aln.clear_refpos();
-                mapper.annotate_with_initial_path_positions(aln);
-                buffer.push_back(aln);
-                stream::write_buffered(cout, buffer, 100);
+            process_batch = [&]() {
+                size_t slice_size = (batch.size() + thread_count - 1) / thread_count;
+#pragma omp parallel for schedule(dynamic, 1)
+                for (size_t slice = 0; slice < thread_count; slice++) {
+                    size_t begin = min(batch.size(), slice * slice_size);
+                    size_t end = min(batch.size(), begin + slice_size);
+                    // look up this slice's positions in one pass
+                    vector<Alignment> alns(make_move_iterator(batch.begin() + begin),
+                                           make_move_iterator(batch.begin() + end));
+                    for (auto& aln : alns) {
+                        aln.clear_refpos();
+                    }
+                    mapper.annotate_with_initial_path_positions(alns);
+                    move(alns.begin(), alns.end(), batch.begin() + begin);
+                }
+                stream::write_buffered(cout, batch, 0);
             };
-            get_input_file(gam_name, [&](istream& in) {
-                    stream::for_each(in, lambda);
-                });
-            stream::write_buffered(cout, buffer, 0); // flush
         } else if (novelty) {
             cout << "name\tlength.bp\tunaligned.bp\tknown.nodes\tknown.bp\tnovel.nodes\tnovel.bp" << endl;
-            function<void(Alignment&)> lambda = [&](Alignment& aln) {
-                // count the number of positions in the alignment that aren't in the graph
-                int total_bp = aln.sequence().size();
-                int unaligned_bp = 0;
-                int known_nodes = 0;
-                int known_bp = 0;
-                int novel_nodes = 0;
-                int novel_bp = 0;
-                for (auto& mapping : aln.path().mapping()) {
-                    if (mapping.has_position()) {
-                        auto& pos = mapping.position();
-                        if (xg_index->has_node(pos.node_id())) {
-                            ++known_nodes;
-                            known_bp += mapping_to_length(mapping);
+            vector<string> rows;
+            process_batch = [&]() {
+                rows.resize(batch.size());
+#pragma omp parallel for schedule(dynamic, 100)
+                for (size_t i = 0; i < batch.size(); i++) {
+                    Alignment& aln = batch[i];
+                    // count the number of positions in the alignment that aren't in the graph
+                    int total_bp = aln.sequence().size();
+                    int unaligned_bp = 0;
+                    int known_nodes = 0;
+                    int known_bp = 0;
+                    int novel_nodes = 0;
+                    int novel_bp = 0;
+                    for (auto& mapping : aln.path().mapping()) {
+                        if (mapping.has_position()) {
+                            auto& pos = mapping.position();
+                            if (xg_index->has_node(pos.node_id())) {
+                                ++known_nodes;
+                                known_bp += mapping_to_length(mapping);
+                            } else {
+                                ++novel_nodes;
+                                novel_bp += mapping_to_length(mapping);
+                            }
                         } else {
-                            ++novel_nodes;
-                            novel_bp += mapping_to_length(mapping);
+                            unaligned_bp += mapping_to_length(mapping);
                         }
-                    } else {
-                        unaligned_bp += mapping_to_length(mapping);
                     }
+                    stringstream row;
+                    row << aln.name() << "\t"
+                    << total_bp << "\t"
+                    << unaligned_bp << "\t"
+                    << known_nodes << "\t"
+                    << known_bp << "\t"
+                    << novel_nodes << "\t"
+                    << novel_bp << "\n";
+                    rows[i] = row.str();
+                }
+                for (auto& row : rows) {
+                    cout << row;
+                }
+                rows.clear();
+                batch.clear();
+            };
+        }
+        
+        if (process_batch) {
+            function<void(Alignment&)> lambda = [&](Alignment& aln) {
+                batch.emplace_back();
+                batch.back().Swap(&aln);
+                if (batch.size() == batch_size) {
+                    process_batch();
                 }
-                cout << aln.name() << "\t"
-                << total_bp << "\t"
-                << unaligned_bp << "\t"
-                << known_nodes << "\t"
-                << known_bp << "\t"
-                << novel_nodes << "\t"
-                << novel_bp << endl;
             };
+            function<void(uint64_t)> no_count = [](uint64_t count) { };
             get_input_file(gam_name, [&](istream& in) {
-                    stream::for_each(in, lambda);
+                    stream::for_each_ordered_parallel(in, lambda, no_count);
                 });
+            process_batch(); // flush
+            cout.flush();
         }
     } else if (!bed_name.empty()) {
         vector<Alignment> buffer;
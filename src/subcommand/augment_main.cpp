@@ -19,6 +19,7 @@
 
 #include <list>
 #include <fstream>
+#include <limits>
 
 #include "subcommand.hpp"
 
@@ -41,6 +42,12 @@ static Pileups* compute_pileups(VG* graph, const string& gam_file_name, int thre
 static void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
                                  bool show_progress);
 
+// stream a sorted gam through a sliding window of pileups, augmenting as nodes complete
+static void augment_with_sorted_gam(PileupAugmenter& augmenter, VG* graph, const string& gam_file_name,
+                                    int thread_count, int min_quality, int max_mismatches, int window_size,
+                                    int max_depth, bool use_mapq, bool expect_subgraph,
+                                    ostream* pileup_out, bool show_progress);
+
 void help_augment(char** argv, ConfigurableParser& parser) {
     cerr << "usage: " << argv[0] << " augment [options] <graph.vg> <alignment.gam> > augmented_graph.vg" << endl
          << "Embed GAM alignments into a graph to facilitate variant calling" << endl
@@ -59,6 +66,8 @@ void help_augment(char** argv, ConfigurableParser& parser) {
          << "    -g, --min-aug-support N     minimum support to augment graph ["
          << PileupAugmenter::Default_min_aug_support << "]" << endl
          << "    -U, --subgraph              expect a subgraph and ignore extra pileup entries outside it" << endl
+         << "    -s, --sorted-gam            alignments are sorted (vg gamsort), so only keep pileups for a window" << endl
+         << "                                of nodes in memory at a time" << endl
          << "    -q, --min-quality N         ignore bases with PHRED quality < N (default=10)" << endl
          << "    -m, --max-mismatches N      ignore bases with > N mismatches within window centered on read (default=1)" << endl
          << "    -w, --window-size N         size of window to apply -m option (default=0)" << endl
@@ -82,6 +91,9 @@ int main_augment(int argc, char** argv) {
     // Should we expect a subgraph and ignore pileups for missing nodes/edges?
     bool expect_subgraph = false;
 
+    // Is the GAM sorted, so we can stream pileups through a window of nodes?
+    bool sorted_gam = false;
+
     // Write the translations (as protobuf) to this path
     string translation_file_name;
 
@@ -139,9 +151,10 @@ int main_augment(int argc, char** argv) {
         {"ignore-mapq", no_argument, 0, 'M'},
         {"min-aug-support", required_argument, 0, 'g'},
         {"subgraph", no_argument, 0, 'U'},
+        {"sorted-gam", no_argument, 0, 's'},
         {0, 0, 0, 0}
     };
-    static const char* short_options = "a:Z:A:hpvt:P:S:q:m:w:Mg:U";
+    static const char* short_options = "a:Z:A:hpvt:P:S:q:m:w:Mg:Us";
     optind = 2; // force optind past command positional arguments
 
     // This is our command-line parser
@@ -200,6 +213,9 @@ int main_augment(int argc, char** argv) {
         case 'U':
             expect_subgraph = true;
             break;
+        case 's':
+            sorted_gam = true;
+            break;
             
         default:
           abort ();
@@ -254,8 +270,11 @@ int main_augment(int argc, char** argv) {
     
     
     Pileups* pileups = nullptr;
+
+    // In sorted mode, pileups are computed and used a window at a time below
+    bool stream_pileups = sorted_gam && augmentation_mode == "pileup";
     
-    if (!pileup_file_name.empty() || augmentation_mode == "pileup") {
+    if (!stream_pileups && (!pileup_file_name.empty() || augmentation_mode == "pileup")) {
         // We will need the computed pileups
         
         // compute the pileups from the graph and gam
@@ -263,7 +282,7 @@ int main_augment(int argc, char** argv) {
                                   window_size, max_depth, use_mapq, show_progress);
     }
         
-    if (!pileup_file_name.empty()) {
+    if (!pileup_file_name.empty() && !stream_pileups) {
         // We want to write out pileups.
         if (show_progress) {
             cerr << "Writing pileups" << endl;
@@ -370,12 +389,27 @@ int main_augment(int argc, char** argv) {
         // The PileupAugmenter object will take care of all augmentation
         PileupAugmenter augmenter(graph, PileupAugmenter::Default_default_quality, min_aug_support);    
 
-        // compute the augmented graph from the pileup
-        // Note: we can save a fair bit of memory by clearing pileups, and re-reading off of
-        //       pileup_file_name
-        augment_with_pileups(augmenter, *pileups, expect_subgraph, show_progress);
-        delete pileups;
-        pileups = nullptr;
+        if (stream_pileups) {
+            // compute the augmented graph from pileups over a window of the sorted gam
+            ofstream pileup_file;
+            if (!pileup_file_name.empty()) {
+                pileup_file.open(pileup_file_name);
+                if (!pileup_file) {
+                    cerr << "[vg augment] error: unable to open output pileup file: " << pileup_file_name << endl;
+                    exit(1);
+                }
+            }
+            augment_with_sorted_gam(augmenter, graph, gam_in_file_name, thread_count, min_quality,
+                                    max_mismatches, window_size, max_depth, use_mapq, expect_subgraph,
+                                    pileup_file_name.empty() ? nullptr : &pileup_file, show_progress);
+        } else {
+            // compute the augmented graph from the pileup
+            // Note: we can save a fair bit of memory by clearing pileups, and re-reading off of
+            //       pileup_file_name
+            augment_with_pileups(augmenter, *pileups, expect_subgraph, show_progress);
+            delete pileups;
+            pileups = nullptr;
+        }
 
         // write the augmented graph
         if (show_progress) {
@@ -486,6 +520,58 @@ Pileups* compute_pileups(VG* graph, const string& gam_file_name, int thread_coun
     return pileups[0];
 }
 
+// How many node pileups to call in parallel at once
+static const size_t node_pileup_batch_size = 10000;
+
+// Send a batch of node pileups to the augmenter, skipping any that don't belong in the graph
+static void call_node_pileups(PileupAugmenter& augmenter, const vector<const NodePileup*>& node_pileups,
+                              bool expect_subgraph) {
+    vector<const NodePileup*> approved;
+    approved.reserve(node_pileups.size());
+    for (auto* node_pileup : node_pileups) {
+        if (!augmenter._graph->has_node(node_pileup->node_id())) {
+            // This pileup doesn't belong in this graph
+            if(!expect_subgraph) {
+                throw runtime_error("Found pileup for nonexistent node " + to_string(node_pileup->node_id()));
+            }
+            // If that's expected, just skip it
+            continue;
+        }
+        approved.push_back(node_pileup);
+    }
+    // Send approved pileups to the augmenter
+    augmenter.call_node_pileups(approved);
+}
+
+// Send an edge pileup to the augmenter, if it belongs in the graph
+static void call_edge_pileup(PileupAugmenter& augmenter, const EdgePileup& edge_pileup, bool expect_subgraph) {
+    if (!augmenter._graph->has_edge(edge_pileup.edge())) {
+        // This pileup doesn't belong in this graph
+        if(!expect_subgraph) {
+            throw runtime_error("Found pileup for nonexistent edge " + pb2json(edge_pileup.edge()));
+        }
+        // If that's expected, just skip it
+        return;
+    }
+    // Send approved pileups to the augmenter
+    augmenter.call_edge_pileup(edge_pileup);
+}
+
+// Once every pileup has been called, finish off the augmented graph
+static void finish_augmented_graph(PileupAugmenter& augmenter, bool show_progress) {
+    // map the edges from original graph
+    if (show_progress) {
+        cerr << "Mapping edges into augmented graph" << endl;
+    }
+    augmenter.update_augmented_graph();
+
+    // map the paths from the original graph
+    if (show_progress) {
+        cerr << "Mapping paths into augmented graph" << endl;
+    }
+    augmenter.map_paths();
+}
+
 void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
                           bool show_progress) {
     
@@ -493,44 +579,142 @@ void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool exp
         cerr << "Computing augmented graph from the pileup" << endl;
     }
 
+    vector<const NodePileup*> batch;
     pileups.for_each_node_pileup([&](const NodePileup& node_pileup) {
-            if (!augmenter._graph->has_node(node_pileup.node_id())) {
-                // This pileup doesn't belong in this graph
-                if(!expect_subgraph) {
-                    throw runtime_error("Found pileup for nonexistent node " + to_string(node_pileup.node_id()));
-                }
-                // If that's expected, just skip it
-                return;
+            batch.push_back(&node_pileup);
+            if (batch.size() >= node_pileup_batch_size) {
+                call_node_pileups(augmenter, batch, expect_subgraph);
+                batch.clear();
             }
-            // Send approved pileups to the augmenter
-            augmenter.call_node_pileup(node_pileup);
-            
         });
+    call_node_pileups(augmenter, batch, expect_subgraph);
 
     pileups.for_each_edge_pileup([&](const EdgePileup& edge_pileup) {
-            if (!augmenter._graph->has_edge(edge_pileup.edge())) {
-                // This pileup doesn't belong in this graph
-                if(!expect_subgraph) {
-                    throw runtime_error("Found pileup for nonexistent edge " + pb2json(edge_pileup.edge()));
+            call_edge_pileup(augmenter, edge_pileup, expect_subgraph);
+        });
+
+    finish_augmented_graph(augmenter, show_progress);
+}
+
+void augment_with_sorted_gam(PileupAugmenter& augmenter, VG* graph, const string& gam_file_name,
+                             int thread_count, int min_quality, int max_mismatches, int window_size,
+                             int max_depth, bool use_mapq, bool expect_subgraph,
+                             ostream* pileup_out, bool show_progress) {
+
+    if (show_progress) {
+        cerr << "Computing augmented graph from pileups of the sorted alignments" << endl;
+    }
+
+    // Per-thread pileups for each batch of reads, merged into the window
+    vector<Pileups*> pileups;
+    for (int i = 0; i < thread_count; ++i) {
+        pileups.push_back(new Pileups(graph, min_quality, max_mismatches, window_size, max_depth, use_mapq));
+    }
+    Pileups window(graph, min_quality, max_mismatches, window_size, max_depth, use_mapq);
+
+    // Node pileups flushed from the window, waiting to be called together
+    vector<NodePileup> flushed_nodes;
+    auto call_flushed_nodes = [&]() {
+        vector<const NodePileup*> node_pileups;
+        for (auto& node_pileup : flushed_nodes) {
+            node_pileups.push_back(&node_pileup);
+        }
+        call_node_pileups(augmenter, node_pileups, expect_subgraph);
+        flushed_nodes.clear();
+    };
+
+    // Chunks of pileups waiting to be written to pileup_out, grouped like Pileups::write
+    vector<Pileup> pileup_buffer;
+    const int chunk_size = 5;
+    auto on_node = [&](NodePileup& node_pileup) {
+        flushed_nodes.emplace_back();
+        flushed_nodes.back().Swap(&node_pileup);
+        if (pileup_out != nullptr) {
+            if (pileup_buffer.empty() || pileup_buffer.back().node_pileups_size() >= chunk_size) {
+                stream::write_buffered(*pileup_out, pileup_buffer, 100);
+                pileup_buffer.emplace_back();
+            }
+            *pileup_buffer.back().add_node_pileups() = flushed_nodes.back();
+        }
+        if (flushed_nodes.size() >= node_pileup_batch_size) {
+            call_flushed_nodes();
+        }
+    };
+    auto on_edge = [&](EdgePileup& edge_pileup) {
+        call_edge_pileup(augmenter, edge_pileup, expect_subgraph);
+        if (pileup_out != nullptr) {
+            if (pileup_buffer.empty() || pileup_buffer.back().edge_pileups_size() >= chunk_size) {
+                stream::write_buffered(*pileup_out, pileup_buffer, 100);
+                pileup_buffer.emplace_back();
+            }
+            *pileup_buffer.back().add_edge_pileups() = edge_pileup;
+        }
+    };
+
+    // The gam is sorted on the lower of the nodes its reads start and end on,
+    // so once a read with key K comes in, no later read can start below K.
+    // Everything below the key of each batch's last read is done after that
+    // batch, as long as no read dips below its key by more than a batch.
+    vector<Alignment> batch;
+    size_t batch_size = 1000 * thread_count;
+    int64_t last_key = 0;
+    int64_t flushed_before = 0;
+
+    auto process_batch = [&]() {
+#pragma omp parallel for schedule(dynamic, 64)
+        for (size_t i = 0; i < batch.size(); ++i) {
+            pileups[omp_get_thread_num()]->compute_from_alignment(batch[i]);
+        }
+        for (auto* thread_pileups : pileups) {
+            window.merge(*thread_pileups);
+        }
+        batch.clear();
+        window.flush_before(last_key, on_node, on_edge);
+        call_flushed_nodes();
+        flushed_before = last_key;
+    };
+
+    get_input_file(gam_file_name, [&](istream& alignment_stream) {
+        stream::for_each<Alignment>(alignment_stream, [&](Alignment& alignment) {
+            const Path& path = alignment.path();
+            if (path.mapping_size() > 0) {
+                int64_t key = min(path.mapping(0).position().node_id(),
+                                  path.mapping(path.mapping_size() - 1).position().node_id());
+                if (key < last_key) {
+                    cerr << "[vg augment] error: alignment " << alignment.name() << " is out of order; "
+                         << "sort the input with vg gamsort to use -s" << endl;
+                    exit(1);
+                }
+                for (size_t i = 0; i < path.mapping_size(); ++i) {
+                    if (path.mapping(i).position().node_id() < flushed_before) {
+                        cerr << "[vg augment] error: alignment " << alignment.name() << " visits node "
+                             << path.mapping(i).position().node_id() << " after its pileup was used; "
+                             << "sort the input with vg gamsort, or run without -s" << endl;
+                        exit(1);
+                    }
                 }
-                // If that's expected, just skip it
-                return;
+                last_key = key;
+            }
+            batch.push_back(alignment);
+            if (batch.size() >= batch_size) {
+                process_batch();
             }
-            // Send approved pileups to the augmenter
-            augmenter.call_edge_pileup(edge_pileup);            
         });
+    });
+    process_batch();
 
-    // map the edges from original graph
-    if (show_progress) {
-        cerr << "Mapping edges into augmented graph" << endl;
+    // Everything left is complete now
+    window.flush_before(numeric_limits<int64_t>::max(), on_node, on_edge);
+    call_flushed_nodes();
+    if (pileup_out != nullptr) {
+        stream::write_buffered(*pileup_out, pileup_buffer, 0);
     }
-    augmenter.update_augmented_graph();
 
-    // map the paths from the original graph
-    if (show_progress) {
-        cerr << "Mapping paths into augmented graph" << endl;
+    for (auto* thread_pileups : pileups) {
+        delete thread_pileups;
     }
-    augmenter.map_paths();
+
+    finish_augmented_graph(augmenter, show_progress);
 }
 
 // Register subcommand
@@ -1,6 +1,7 @@
 /** \file benchmark_main.cpp
  *
- * Defines the "vg benchmark" subcommand, which runs and reports on microbenchmarks.
+ * Defines the "vg benchmark" subcommand, which runs and reports on microbenchmarks,
+ * or on macro-benchmarks of whole mapping operations against real indexes.
  */
 
 #include <omp.h>
@@ -8,14 +9,37 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <map>
+#include <random>
+#include <unordered_map>
+
+#include <sparsehash/dense_hash_map>
+#include <sparsepp/spp.h>
 
 #include "subcommand.hpp"
 
 #include "../benchmark.hpp"
 #include "../version.hpp"
+#include "../utility.hpp"
 
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../mem.hpp"
+#include "../mapper.hpp"
+#include "../multipath_mapper.hpp"
+#include "../surjector.hpp"
+#include "../packer.hpp"
+#include "../haplotypes.hpp"
+#include "../stream.hpp"
+#include "../alignment.hpp"
+#include "../gssw_aligner.hpp"
+#include "../simd_level.hpp"
+#include "../genome_state.hpp"
+#include "../hash_map.hpp"
+#include "../flat_hash_map.hpp"
 #include "../algorithms/extract_connecting_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 #include "../algorithms/weakly_connected_components.hpp"
@@ -29,12 +53,273 @@ using namespace vg::subcommand;
 void help_benchmark(char** argv) {
     cerr << "usage: " << argv[0] << " benchmark [options] >report.tsv" << endl
          << "options:" << endl
-         << "    -p, --progress         show progress" << endl;
+         << "    -p, --progress         show progress" << endl
+         << "    -s, --simd LEVEL       use SIMD kernels up to LEVEL (scalar, sse2, avx2, avx512) [best available]" << endl
+         << "    -i, --iterations N     time each benchmark over N runs [1000]" << endl
+         << "    -w, --warmup N         do N untimed runs of each benchmark first [0]" << endl
+         << "    -b, --baseline FILE    compare against a report from an earlier run, and exit with" << endl
+         << "                           status 2 if any benchmark got significantly slower" << endl
+         << "    -z, --z-score FLOAT    call a slowdown significant at this many standard errors [3.0]" << endl
+         << "macro-benchmarks (run instead of the microbenchmarks when an XG is given):" << endl
+         << "    -x, --xg-name FILE     time XG queries against this index, and hash tables on its graph" << endl
+         << "    -g, --gcsa-name FILE   also time mapping with this GCSA2/LCP index pair" << endl
+         << "    -H, --gbwt-name FILE   score haplotype consistency with this GBWT when mapping" << endl
+         << "    -f, --fastq FILE       sample reads from this FASTQ" << endl
+         << "    -G, --gam FILE         sample reads from this GAM" << endl
+         << "    -n, --reads N          use at most this many reads [1000]" << endl
+         << "    -j, --json             report in JSON instead of TSV" << endl;
+}
+
+/// How many hash table operations to time together
+const size_t HASH_BENCHMARK_BATCH = 1000;
+/// How many keys from the graph to fill the hash tables with at most
+const size_t HASH_BENCHMARK_MAX_KEYS = 1 << 22;
+
+/// Time filling the given empty hash table with the keys, and then looking
+/// them up in a different order, and looking up keys that aren't there, a
+/// batch at a time.
+template<typename Table, typename Key>
+void run_hash_table_benchmarks(const string& name, Table& table, const vector<Key>& keys, const vector<Key>& shuffled_keys,
+                               const vector<Key>& absent_keys, vector<LatencyResult>& results) {
+    
+    size_t batches = (keys.size() + HASH_BENCHMARK_BATCH - 1) / HASH_BENCHMARK_BATCH;
+    auto batch_end = [&](size_t batch) {
+        return min(keys.size(), (batch + 1) * HASH_BENCHMARK_BATCH);
+    };
+    
+    results.push_back(run_latency_benchmark(name + " insert x" + to_string(HASH_BENCHMARK_BATCH), batches, [&](size_t batch) {
+        for (size_t i = batch * HASH_BENCHMARK_BATCH; i < batch_end(batch); i++) {
+            table[keys[i]] = i;
+        }
+    }));
+    
+    size_t found = 0;
+    results.push_back(run_latency_benchmark(name + " find x" + to_string(HASH_BENCHMARK_BATCH), batches, [&](size_t batch) {
+        for (size_t i = batch * HASH_BENCHMARK_BATCH; i < batch_end(batch); i++) {
+            found += (table.find(shuffled_keys[i]) != table.end());
+        }
+    }));
+    results.push_back(run_latency_benchmark(name + " miss x" + to_string(HASH_BENCHMARK_BATCH), batches, [&](size_t batch) {
+        for (size_t i = batch * HASH_BENCHMARK_BATCH; i < batch_end(batch); i++) {
+            found += (table.find(absent_keys[i]) != table.end());
+        }
+    }));
+    
+    if (found != keys.size()) {
+        cerr << "warning:[vg benchmark] " << name << " found " << found << " of " << keys.size() << " keys" << endl;
+    }
+}
+
+/// Compare the hash tables that the hash_map aliases can be backed by, using
+/// the given keys from a real graph. The empty key must not be one of them.
+template<typename Key>
+void run_hash_backend_benchmarks(const string& key_name, const vector<Key>& keys, const vector<Key>& absent_keys,
+                                 const Key& empty_key, vector<LatencyResult>& results) {
+    
+    vector<Key> shuffled_keys(keys);
+    shuffle(shuffled_keys.begin(), shuffled_keys.end(), mt19937(7919));
+    
+    {
+        unordered_map<Key, size_t, wang_hash<Key>> table;
+        run_hash_table_benchmarks("std::unordered_map " + key_name, table, keys, shuffled_keys, absent_keys, results);
+    }
+    {
+        spp::sparse_hash_map<Key, size_t, wang_hash<Key>> table;
+        run_hash_table_benchmarks("spp::sparse_hash_map " + key_name, table, keys, shuffled_keys, absent_keys, results);
+    }
+    {
+        google::dense_hash_map<Key, size_t, wang_hash<Key>> table;
+        table.set_empty_key(empty_key);
+        run_hash_table_benchmarks("google::dense_hash_map " + key_name, table, keys, shuffled_keys, absent_keys, results);
+    }
+    {
+        FlatHashMap<Key, size_t, wang_hash<Key>> table;
+        run_hash_table_benchmarks("vg::FlatHashMap " + key_name, table, keys, shuffled_keys, absent_keys, results);
+    }
+}
+
+/// Time the operations of the mapping pipeline one read at a time against
+/// real indexes. The GCSA, LCP and score provider may be null, in which case
+/// the mapping tests are skipped.
+vector<LatencyResult> run_macro_benchmarks(xg::XG& xg_index, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_array,
+                                           haplo::ScoreProvider* haplo_score_provider, const vector<Alignment>& reads,
+                                           bool show_progress) {
+    
+    vector<LatencyResult> results;
+    
+    // Query the graph around evenly spaced nodes
+    size_t num_queries = max<size_t>(reads.size(), 1000);
+    int64_t id_range = xg_index.get_max_id() - xg_index.get_min_id() + 1;
+    auto query_id = [&](size_t i) {
+        return xg_index.get_min_id() + (int64_t) ((i * 7919) % id_range);
+    };
+    
+    if (show_progress) {
+        cerr << "Timing XG queries..." << endl;
+    }
+    results.push_back(run_latency_benchmark("XG get_handle and follow_edges", num_queries, [&](size_t i) {
+        int64_t node_id = query_id(i);
+        if (!xg_index.has_node(node_id)) {
+            return;
+        }
+        handle_t handle = xg_index.get_handle(node_id, false);
+        size_t neighbor_length = 0;
+        for (bool go_left : {false, true}) {
+            xg_index.follow_edges(handle, go_left, [&](const handle_t& next) {
+                neighbor_length += xg_index.get_length(next);
+            });
+        }
+    }));
+    
+    results.push_back(run_latency_benchmark("XG paths_of_node", num_queries, [&](size_t i) {
+        int64_t node_id = query_id(i);
+        if (xg_index.has_node(node_id)) {
+            xg_index.paths_of_node(node_id);
+        }
+    }));
+    
+    results.push_back(run_latency_benchmark("XG node_sequence", num_queries, [&](size_t i) {
+        int64_t node_id = query_id(i);
+        if (xg_index.has_node(node_id)) {
+            xg_index.node_sequence(node_id);
+        }
+    }));
+    
+    // Compare hash table backends on the graph's node IDs and edges, the way
+    // VG indexes them in node_by_id and edge_by_sides
+    if (show_progress) {
+        cerr << "Timing hash tables..." << endl;
+    }
+    vector<id_t> node_ids;
+    vector<pair<NodeSide, NodeSide>> edges;
+    xg_index.for_each_handle([&](const handle_t& handle) {
+        id_t node_id = xg_index.get_id(handle);
+        node_ids.push_back(node_id);
+        xg_index.for_each_edge_of(node_id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+            pair<NodeSide, NodeSide> sides = minmax(NodeSide(from, !from_start), NodeSide(to, to_end));
+            if (sides.first.node == node_id) {
+                // only take each edge from one of its ends
+                edges.push_back(sides);
+            }
+            return true;
+        });
+        return node_ids.size() < HASH_BENCHMARK_MAX_KEYS && edges.size() < HASH_BENCHMARK_MAX_KEYS;
+    });
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    
+    vector<id_t> absent_node_ids;
+    for (id_t node_id : node_ids) {
+        absent_node_ids.push_back(node_id + xg_index.get_max_id());
+    }
+    vector<pair<NodeSide, NodeSide>> absent_edges;
+    for (auto& sides : edges) {
+        absent_edges.emplace_back(NodeSide(sides.first.node + xg_index.get_max_id(), sides.first.is_end), sides.second);
+    }
+    
+    run_hash_backend_benchmarks("node IDs", node_ids, absent_node_ids, (id_t) -1, results);
+    run_hash_backend_benchmarks("edge sides", edges, absent_edges, make_pair(NodeSide(-1), NodeSide(-1)), results);
+    
+    // The mapped reads will be written, parsed and surjected
+    vector<Alignment> mapped(reads);
+    
+    if (gcsa_index && lcp_array && !reads.empty()) {
+        
+        Mapper mapper(&xg_index, gcsa_index, lcp_array, haplo_score_provider);
+        
+        if (show_progress) {
+            cerr << "Timing Mapper::align on " << reads.size() << " reads..." << endl;
+        }
+        results.push_back(run_latency_benchmark("Mapper::align", reads.size(), [&](size_t i) {
+            mapped[i] = mapper.align(reads[i]);
+        }));
+        
+        MultipathMapper multipath_mapper(&xg_index, gcsa_index, lcp_array, haplo_score_provider);
+        multipath_mapper.use_population_mapqs = (haplo_score_provider != nullptr);
+        
+        if (show_progress) {
+            cerr << "Timing MultipathMapper::multipath_map on " << reads.size() << " reads..." << endl;
+        }
+        results.push_back(run_latency_benchmark("MultipathMapper::multipath_map", reads.size(), [&](size_t i) {
+            vector<MultipathAlignment> multipath_alns;
+            multipath_mapper.multipath_map(reads[i], multipath_alns, 1);
+        }));
+        
+        set<string> path_names;
+        for (size_t i = 1; i <= xg_index.max_path_rank(); i++) {
+            path_names.insert(xg_index.path_name(i));
+        }
+        if (!path_names.empty()) {
+            PathMembershipIndex path_membership(xg_index, path_names);
+            Surjector surjector(&xg_index);
+            surjector.path_membership = &path_membership;
+            
+            if (show_progress) {
+                cerr << "Timing Surjector::path_anchored_surject on " << mapped.size() << " alignments..." << endl;
+            }
+            results.push_back(run_latency_benchmark("Surjector::path_anchored_surject", mapped.size(), [&](size_t i) {
+                string path_name;
+                int64_t path_pos;
+                bool path_reverse;
+                surjector.path_anchored_surject(mapped[i], path_names, path_name, path_pos, path_reverse);
+            }));
+        }
+        
+        // Count coverage from the mapped reads, the way vg pack does
+        Packer packer(&xg_index);
+        if (show_progress) {
+            cerr << "Timing Packer::add on " << mapped.size() << " alignments..." << endl;
+        }
+        results.push_back(run_latency_benchmark("Packer::add", mapped.size(), [&](size_t i) {
+            packer.add(mapped[i]);
+        }));
+    }
+    
+    if (!mapped.empty()) {
+        // Serialize the alignments one at a time, the way the mappers emit them
+        if (show_progress) {
+            cerr << "Timing GAM writing and parsing..." << endl;
+        }
+        stringstream gam;
+        vector<Alignment> buffer;
+        results.push_back(run_latency_benchmark("stream::write_buffered GAM", mapped.size(), [&](size_t i) {
+            buffer.push_back(mapped[i]);
+            stream::write_buffered(gam, buffer, 100);
+        }));
+        stream::write_buffered(gam, buffer, 0);
+        
+        // Time between consecutive parsed alignments, since the parser drives the loop
+        LatencyResult parse_result;
+        parse_result.name = "stream::for_each GAM";
+        auto parse_start = chrono::high_resolution_clock::now();
+        auto last = parse_start;
+        stream::for_each<Alignment>(gam, [&](Alignment& aln) {
+            auto now = chrono::high_resolution_clock::now();
+            parse_result.latencies.push_back(chrono::duration_cast<benchtime>(now - last));
+            last = now;
+        });
+        parse_result.total = chrono::duration_cast<benchtime>(last - parse_start);
+        sort(parse_result.latencies.begin(), parse_result.latencies.end());
+        results.push_back(parse_result);
+    }
+    
+    return results;
 }
 
 int main_benchmark(int argc, char** argv) {
 
     bool show_progress = false;
+    string xg_name;
+    string gcsa_name;
+    string gbwt_name;
+    string fastq_name;
+    string gam_name;
+    size_t max_reads = 1000;
+    bool output_json = false;
+    size_t iterations = 1000;
+    size_t warmup = 0;
+    string baseline_name;
+    double significant_z = 3.0;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -42,12 +327,24 @@ int main_benchmark(int argc, char** argv) {
         static struct option long_options[] =
             {
                 {"progress",  no_argument, 0, 'p'},
+                {"simd", required_argument, 0, 's'},
+                {"xg-name", required_argument, 0, 'x'},
+                {"gcsa-name", required_argument, 0, 'g'},
+                {"gbwt-name", required_argument, 0, 'H'},
+                {"fastq", required_argument, 0, 'f'},
+                {"gam", required_argument, 0, 'G'},
+                {"reads", required_argument, 0, 'n'},
+                {"json", no_argument, 0, 'j'},
+                {"iterations", required_argument, 0, 'i'},
+                {"warmup", required_argument, 0, 'w'},
+                {"baseline", required_argument, 0, 'b'},
+                {"z-score", required_argument, 0, 'z'},
                 {"help", no_argument, 0, 'h'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "ph?",
+        c = getopt_long (argc, argv, "ps:x:g:H:f:G:n:ji:w:b:z:h?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -61,6 +358,65 @@ int main_benchmark(int argc, char** argv) {
             show_progress = true;
             break;
             
+        case 's':
+            {
+                SIMDLevel level;
+                if (!parse_simd_level(optarg, level)) {
+                    cerr << "error:[vg benchmark] unrecognized SIMD level " << optarg << endl;
+                    exit(1);
+                }
+                set_simd_level(level);
+            }
+            break;
+            
+        case 'x':
+            xg_name = optarg;
+            break;
+            
+        case 'g':
+            gcsa_name = optarg;
+            break;
+            
+        case 'H':
+            gbwt_name = optarg;
+            break;
+            
+        case 'f':
+            fastq_name = optarg;
+            break;
+            
+        case 'G':
+            gam_name = optarg;
+            break;
+            
+        case 'n':
+            max_reads = atoi(optarg);
+            break;
+            
+        case 'j':
+            output_json = true;
+            break;
+            
+        case 'i':
+            iterations = atoi(optarg);
+            if (iterations == 0) {
+                cerr << "error:[vg benchmark] need at least one iteration" << endl;
+                exit(1);
+            }
+            break;
+            
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+            
+        case 'b':
+            baseline_name = optarg;
+            break;
+            
+        case 'z':
+            significant_z = atof(optarg);
+            break;
+            
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -86,6 +442,84 @@ int main_benchmark(int argc, char** argv) {
     // Turn on nested parallelism, so we can parallelize over VCFs and over alignment bands
     omp_set_nested(1);
     
+    if (!xg_name.empty()) {
+        // Run the macro-benchmarks on the real indexes instead
+        
+        ifstream xg_stream(xg_name);
+        if (!xg_stream) {
+            cerr << "error:[vg benchmark] Cannot open XG file " << xg_name << endl;
+            exit(1);
+        }
+        xg::XG xg_index(xg_stream);
+        
+        unique_ptr<gcsa::GCSA> gcsa_index;
+        unique_ptr<gcsa::LCPArray> lcp_array;
+        if (!gcsa_name.empty()) {
+            ifstream gcsa_stream(gcsa_name);
+            if (!gcsa_stream) {
+                cerr << "error:[vg benchmark] Cannot open GCSA2 file " << gcsa_name << endl;
+                exit(1);
+            }
+            string lcp_name = gcsa_name + ".lcp";
+            ifstream lcp_stream(lcp_name);
+            if (!lcp_stream) {
+                cerr << "error:[vg benchmark] Cannot open LCP file " << lcp_name << endl;
+                exit(1);
+            }
+            gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+            gcsa_index = unique_ptr<gcsa::GCSA>(new gcsa::GCSA());
+            gcsa_index->load(gcsa_stream);
+            lcp_array = unique_ptr<gcsa::LCPArray>(new gcsa::LCPArray());
+            lcp_array->load(lcp_stream);
+        }
+        
+        unique_ptr<gbwt::GBWT> gbwt;
+        unique_ptr<haplo::ScoreProvider> haplo_score_provider;
+        if (!gbwt_name.empty()) {
+            ifstream gbwt_stream(gbwt_name);
+            if (!gbwt_stream) {
+                cerr << "error:[vg benchmark] Cannot open GBWT file " << gbwt_name << endl;
+                exit(1);
+            }
+            gbwt = unique_ptr<gbwt::GBWT>(new gbwt::GBWT());
+            gbwt->load(gbwt_stream);
+            haplo_score_provider = unique_ptr<haplo::ScoreProvider>(new haplo::GBWTScoreProvider<gbwt::GBWT>(*gbwt));
+        }
+        
+        // Load the read sample up front so we only time the work on it
+        vector<Alignment> reads;
+        auto keep_read = [&](Alignment& aln) {
+            if (reads.size() < max_reads) {
+                reads.push_back(aln);
+            }
+        };
+        if (!fastq_name.empty()) {
+            fastq_unpaired_for_each(fastq_name, keep_read);
+        }
+        if (!gam_name.empty()) {
+            get_input_file(gam_name, [&](istream& in) {
+                stream::for_each<Alignment>(in, keep_read);
+            });
+        }
+        
+        vector<LatencyResult> latency_results = run_macro_benchmarks(xg_index, gcsa_index.get(), lcp_array.get(),
+                                                                     haplo_score_provider.get(), reads, show_progress);
+        
+        if (output_json) {
+            write_json(cout, latency_results);
+        }
+        else {
+            cout << "# Macro-benchmark results for vg " << Version::get_short() << endl;
+            cout << "# SIMD level " << simd_level_name(simd_level()) << endl;
+            cout << "# items\tper_second\tmean(us)\tp50(us)\tp90(us)\tp99(us)\tmax(us)\tname" << endl;
+            for (auto& result : latency_results) {
+                cout << result << endl;
+            }
+        }
+        
+        return 0;
+    }
+    
     // Generate a test graph
     VG vg_mut;
     for (size_t i = 1; i < 101; i++) {
@@ -111,31 +545,34 @@ int main_benchmark(int argc, char** argv) {
     
     vector<BenchmarkResult> results;
     
-    results.push_back(run_benchmark("vg::algorithms topological_sort", 1000, [&]() {
+    // Most benchmarks don't need anything set up between runs
+    auto no_setup = []() {};
+    
+    results.push_back(run_benchmark("vg::algorithms topological_sort", iterations, warmup, no_setup, [&]() {
         vector<handle_t> order = algorithms::topological_sort(&vg);
         assert(order.size() == vg.node_size());
     }));
     
-    results.push_back(run_benchmark("vg::algorithms sort", 1000, [&]() {
+    results.push_back(run_benchmark("vg::algorithms sort", iterations, warmup, [&]() {
         vg_mut = vg;
     }, [&]() {
         algorithms::sort(&vg_mut);
     }));
     
-    results.push_back(run_benchmark("vg::algorithms orient_nodes_forward", 1000, [&]() {
+    results.push_back(run_benchmark("vg::algorithms orient_nodes_forward", iterations, warmup, [&]() {
         vg_mut = vg;
     }, [&]() {
         algorithms::orient_nodes_forward(&vg_mut);
     }));
     
     
-    results.push_back(run_benchmark("vg::algorithms weakly_connected_components", 1000, [&]() {
+    results.push_back(run_benchmark("vg::algorithms weakly_connected_components", iterations, warmup, no_setup, [&]() {
         auto components = algorithms::weakly_connected_components(&vg);
         assert(components.size() == 1);
         assert(components.front().size() == vg.node_size());
     }));
     
-    results.push_back(run_benchmark("VG::get_node", 1000, [&]() {
+    results.push_back(run_benchmark("VG::get_node", iterations, warmup, no_setup, [&]() {
         for (size_t rep = 0; rep < 100; rep++) {
             for (size_t i = 1; i < 101; i++) {
                 vg_mut.get_node(i);
@@ -143,7 +580,7 @@ int main_benchmark(int argc, char** argv) {
         }
     }));
     
-    results.push_back(run_benchmark("algorithms::extract_connecting_graph on xg", 1000, [&]() {
+    results.push_back(run_benchmark("algorithms::extract_connecting_graph on xg", iterations, warmup, no_setup, [&]() {
         pos_t pos_1 = make_pos_t(55, false, 0);
         pos_t pos_2 = make_pos_t(32, false, 0);
         
@@ -155,7 +592,7 @@ int main_benchmark(int argc, char** argv) {
     
     }));
     
-    results.push_back(run_benchmark("algorithms::extract_connecting_graph on vg", 1000, [&]() {
+    results.push_back(run_benchmark("algorithms::extract_connecting_graph on vg", iterations, warmup, no_setup, [&]() {
         pos_t pos_1 = make_pos_t(55, false, 0);
         pos_t pos_2 = make_pos_t(32, false, 0);
         
@@ -167,14 +604,134 @@ int main_benchmark(int argc, char** argv) {
     
     }));
     
+    // Fill hit buffers the way the mapper does for each read, with and without
+    // recycling them between reads
+    string mem_read(150, 'A');
+    auto fill_mem_hits = [&](bool pooled) {
+        vector<MaximalExactMatch> mems;
+        for (size_t i = 0; i < 100; i++) {
+            mems.emplace_back(mem_read.begin() + i, mem_read.begin() + i + 50, gcsa::range_type(0, 31), 32);
+            if (pooled) {
+                mems.back().nodes = MEMHitPool::acquire();
+            }
+            for (size_t j = 0; j < 32; j++) {
+                mems.back().nodes.push_back(gcsa::Node::encode(j + 1, i));
+            }
+        }
+        if (pooled) {
+            MEMHitPool::release(mems);
+        }
+    };
+    
+    results.push_back(run_benchmark("MaximalExactMatch hits in fresh buffers", iterations, warmup, no_setup, [&]() {
+        fill_mem_hits(false);
+    }));
+    
+    results.push_back(run_benchmark("MaximalExactMatch hits in MEMHitPool buffers", iterations, warmup, no_setup, [&]() {
+        fill_mem_hits(true);
+    }));
+    
+    // Globally align a read that spans the whole graph in a band wide enough
+    // to fill the vectors in the banded aligner
+    VG linear;
+    Node* prev_node = nullptr;
+    for (size_t i = 0; i < 20; i++) {
+        Node* node = linear.create_node("GATTACACATTAG");
+        if (prev_node) {
+            linear.create_edge(prev_node, node);
+        }
+        prev_node = node;
+    }
+    Aligner score_aligner;
+    string banded_read;
+    for (size_t i = 0; i < linear.graph.node_size(); i++) {
+        banded_read += linear.graph.node(i).sequence();
+    }
+    banded_read.erase(100, 2);
+    
+    results.push_back(run_benchmark("Aligner::align_global_banded 258 bp read", iterations, warmup, no_setup, [&]() {
+        Alignment aln;
+        aln.set_sequence(banded_read);
+        score_aligner.align_global_banded(aln, linear.graph, 50, false);
+    }));
+    
+    // Shuffle haplotypes through a snarl the way genotyping moves and their
+    // undos do. The graph has a snarl from 1 to 8 around a child chain from 2
+    // to 7.
+    VG bubbles;
+    vector<Node*> bubble_nodes;
+    for (auto& sequence : {"GCA", "T", "G", "CTGA", "GCA", "T", "G", "CTGA"}) {
+        bubble_nodes.push_back(bubbles.create_node(sequence));
+    }
+    for (auto& edge : vector<pair<size_t, size_t>>{{0, 1}, {0, 7}, {1, 2}, {1, 5}, {2, 3}, {2, 4}, {3, 4}, {4, 6}, {5, 6}, {6, 7}}) {
+        bubbles.create_edge(bubble_nodes[edge.first], bubble_nodes[edge.second]);
+    }
+    CactusSnarlFinder bubble_finder(bubbles);
+    SnarlManager bubble_snarls = bubble_finder.find_snarls();
+    NetGraph bubble_net_graph = bubble_snarls.net_graph_of(bubble_snarls.top_level_snarls().at(0), &bubbles, true);
+    vector<handle_t> through_child {bubble_net_graph.get_handle(1, false), bubble_net_graph.get_handle(2, false),
+        bubble_net_graph.get_handle(8, false)};
+    vector<handle_t> around_child {bubble_net_graph.get_handle(1, false), bubble_net_graph.get_handle(8, false)};
+    
+    results.push_back(run_benchmark("SnarlState insert, swap and erase", iterations, warmup, no_setup, [&]() {
+        SnarlState snarl_state(&bubble_net_graph);
+        for (size_t i = 0; i < 100; i++) {
+            snarl_state.append(i % 3 ? through_child : around_child);
+        }
+        for (size_t i = 0; i < 1000; i++) {
+            // Erase and put back a haplotype, and swap two others
+            auto erased = snarl_state.erase((i * 7) % 100);
+            snarl_state.insert(erased);
+            snarl_state.swap((i * 13) % 100, (i * 31) % 100);
+        }
+    }));
+    
     // Do the control against itself
-    results.push_back(run_benchmark("control", 1000, benchmark_control));
+    results.push_back(run_benchmark("control", iterations, warmup, no_setup, benchmark_control));
 
     cout << "# Benchmark results for vg " << Version::get_short() << endl;
+    cout << "# SIMD level " << simd_level_name(simd_level()) << endl;
     cout << "# runs\ttest(us)\tstddev(us)\tcontrol(us)\tstddev(us)\tscore\terr\tname" << endl;
     for (auto& result : results) {
         cout << result << endl;
     }
+    
+    if (!baseline_name.empty()) {
+        // Compare against the earlier report
+        map<string, BenchmarkResult> baseline;
+        get_input_file(baseline_name, [&](istream& in) {
+            string line;
+            BenchmarkResult result;
+            while (getline(in, line)) {
+                if (parse_benchmark_result(line, result)) {
+                    baseline[result.name] = result;
+                }
+            }
+        });
+        
+        size_t num_slower = 0;
+        cerr << "# baseline\tscore\tchange\tz\tname" << endl;
+        for (auto& result : results) {
+            auto found = baseline.find(result.name);
+            if (found == baseline.end()) {
+                cerr << "NA\t" << result.score() << "\tNA\tNA\t" << result.name << endl;
+                continue;
+            }
+            double z = benchmark_slowdown(found->second, result);
+            bool slower = z >= significant_z;
+            if (slower) {
+                num_slower++;
+            }
+            cerr << found->second.score() << "\t" << result.score() << "\t"
+                 << (result.score() / found->second.score() - 1.0) * 100 << "%\t" << z << "\t" << result.name
+                 << (slower ? "\tSLOWER" : "") << endl;
+        }
+        
+        if (num_slower) {
+            cerr << "error:[vg benchmark] " << num_slower << " benchmarks are significantly slower than in " << baseline_name << endl;
+            return 2;
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,178 @@
+/**
+ * \file calibrate_main.cpp: precompute the statistics the mappers work out at startup
+ */
+
+#include <omp.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <fstream>
+#include <iostream>
+
+#include "subcommand.hpp"
+
+#include "../multipath_mapper.hpp"
+#include "../mapper_calibration.hpp"
+
+using namespace std;
+using namespace vg;
+using namespace vg::subcommand;
+
+void help_calibrate(char** argv) {
+    cerr << "usage: " << argv[0] << " calibrate [options] -x index.xg -g index.gcsa" << endl
+         << "Precompute mapper statistics for an index, so vg map and vg mpmap can skip working them out." << endl
+         << endl
+         << "options:" << endl
+         << "    -x, --xg-name FILE          use this xg index (required)" << endl
+         << "    -g, --gcsa-name FILE        use this GCSA2/LCP index pair (required; both FILE and FILE.lcp)" << endl
+         << "    -o, --output FILE           write the calibration here [FILE.xg.calib, where mappers look for it]" << endl
+         << "    -n, --simulations INT       simulate this many random reads for mismapping detection [250]" << endl
+         << "    -l, --read-length INT       simulate random reads of this length [150]" << endl
+         << "    -t, --threads INT           number of threads to use" << endl;
+}
+
+int main_calibrate(int argc, char** argv) {
+
+    if (argc == 2) {
+        help_calibrate(argv);
+        return 1;
+    }
+
+    string xg_name;
+    string gcsa_name;
+    string output_name;
+    // These match the vg mpmap defaults, so its calibration gets used
+    int num_simulations = 250;
+    int read_length = 150;
+
+    int c;
+    optind = 2;
+    while (true) {
+        static struct option long_options[] =
+        {
+            {"help", no_argument, 0, 'h'},
+            {"xg-name", required_argument, 0, 'x'},
+            {"gcsa-name", required_argument, 0, 'g'},
+            {"output", required_argument, 0, 'o'},
+            {"simulations", required_argument, 0, 'n'},
+            {"read-length", required_argument, 0, 'l'},
+            {"threads", required_argument, 0, 't'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        c = getopt_long (argc, argv, "hx:g:o:n:l:t:",
+                         long_options, &option_index);
+
+        // Detect the end of the options.
+        if (c == -1) break;
+
+        switch (c)
+        {
+        case 'x':
+            xg_name = optarg;
+            break;
+
+        case 'g':
+            gcsa_name = optarg;
+            break;
+
+        case 'o':
+            output_name = optarg;
+            break;
+
+        case 'n':
+            num_simulations = atoi(optarg);
+            break;
+
+        case 'l':
+            read_length = atoi(optarg);
+            break;
+
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
+        case 'h':
+        case '?':
+            help_calibrate(argv);
+            exit(1);
+            break;
+
+        default:
+            abort ();
+        }
+    }
+
+    if (xg_name.empty()) {
+        cerr << "error:[vg calibrate] Calibration requires an XG index, must provide XG file" << endl;
+        exit(1);
+    }
+
+    if (gcsa_name.empty()) {
+        cerr << "error:[vg calibrate] Calibration requires a GCSA2 index, must provide GCSA2 file" << endl;
+        exit(1);
+    }
+
+    if (num_simulations <= 0 || read_length <= 0) {
+        cerr << "error:[vg calibrate] Number of simulations and read length must be positive" << endl;
+        exit(1);
+    }
+
+    if (output_name.empty()) {
+        output_name = MapperCalibration::sidecar_name(xg_name);
+    }
+
+    ifstream xg_stream(xg_name);
+    if (!xg_stream) {
+        cerr << "error:[vg calibrate] Cannot open XG file " << xg_name << endl;
+        exit(1);
+    }
+
+    ifstream gcsa_stream(gcsa_name);
+    if (!gcsa_stream) {
+        cerr << "error:[vg calibrate] Cannot open GCSA2 file " << gcsa_name << endl;
+        exit(1);
+    }
+
+    string lcp_name = gcsa_name + ".lcp";
+    ifstream lcp_stream(lcp_name);
+    if (!lcp_stream) {
+        cerr << "error:[vg calibrate] Cannot open LCP file " << lcp_name << endl;
+        exit(1);
+    }
+
+    // Configure GCSA2 verbosity so it doesn't spit out loads of extra info
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+
+    xg::XG xg_index(xg_stream);
+    gcsa::GCSA gcsa_index;
+    gcsa_index.load(gcsa_stream);
+    gcsa::LCPArray lcp_array;
+    lcp_array.load(lcp_stream);
+
+    // Calibrate with the default mapping parameters
+    MultipathMapper mapper(&xg_index, &gcsa_index, &lcp_array);
+
+    MapperCalibration calibration;
+    calibration.gc_content = mapper.estimate_gc_content();
+    calibration.graph_entropy = mapper.graph_entropy();
+    calibration.average_node_length = mapper.average_node_length();
+
+    mapper.calibrate_mismapping_detection(num_simulations, read_length);
+    calibration.pseudo_length_multiplier = mapper.pseudo_length_multiplier;
+    calibration.calibration_simulations = num_simulations;
+    calibration.calibration_read_length = read_length;
+
+    ofstream out(output_name);
+    if (!out) {
+        cerr << "error:[vg calibrate] Cannot write calibration file " << output_name << endl;
+        exit(1);
+    }
+    calibration.save(out);
+
+    return 0;
+}
+
+// Register subcommand
+static Subcommand vg_calibrate("calibrate", "precompute mapper statistics for an index", main_calibrate);
@@ -18,6 +18,7 @@
 #include "../chunker.hpp"
 #include "../region.hpp"
 #include "../haplotype_extracter.hpp"
+#include "../packer.hpp"
 
 using namespace std;
 using namespace vg;
@@ -39,7 +40,8 @@ void help_chunk(char** argv) {
          << "options:" << endl
          << "    -x, --xg-name FILE       use this xg index to chunk subgraphs" << endl
          << "    -G, --gbwt-name FILE     use this GBWT haplotype index for haplotype extraction" << endl
-         << "    -a, --gam-index FILE     chunk this gam index (made with vg index -a) instead of the graph" << endl
+         << "    -a, --gam-index FILE     chunk this gam index (made with vg index -a) instead of the graph, or" << endl
+         << "                             a sorted GAM with a FILE.gai index (made with vg gamsort -i)" << endl
          << "    -g, --gam-and-graph      when used in combination with -a, both gam and graph will be chunked" << endl 
          << "path chunking:" << endl
          << "    -p, --path TARGET        write the chunk in the specified (0-based inclusive)\n"
@@ -47,6 +49,11 @@ void help_chunk(char** argv) {
          << "    -P, --path-list FILE     write chunks for all path regions in (line - separated file). format" << endl
          << "                             for each as in -p (all paths chunked unless otherwise specified)" << endl
          << "    -e, --input-bed FILE     write chunks for all (0-based end-exclusive) bed regions" << endl
+         << "    -N, --snarl-chunks N     split each path region into N chunks of about equal work, only cutting" << endl
+         << "                             between top-level snarls (requires -S)" << endl
+         << "    -S, --snarls FILE        snarls (from vg snarls) to use with -N" << endl
+         << "    -k, --pack FILE          with -N, count coverage from this pack (from vg pack) as work, as well" << endl
+         << "                             as nodes" << endl
          << "id range chunking:" << endl
          << "    -r, --node-range N:M     write the chunk for the specified node range to standard output\n"
          << "    -R, --node-ranges FILE   write the chunk for each node range in (newline or whitespace separated) file" << endl
@@ -98,6 +105,9 @@ int main_chunk(int argc, char** argv) {
     bool search_all_positions = false;
     int n_chunks = 0;
     size_t gam_split_size = 0;
+    int snarl_chunks = 0;
+    string snarl_file;
+    string pack_file;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -126,11 +136,14 @@ int main_chunk(int argc, char** argv) {
             {"n-chunks", required_argument, 0, 'n'},
             {"context-length", required_argument, 0, 'l'},
             {"gam-split-size", required_argument, 0, 'm'},
+            {"snarl-chunks", required_argument, 0, 'N'},
+            {"snarls", required_argument, 0, 'S'},
+            {"pack", required_argument, 0, 'k'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:G:a:gp:P:s:o:e:E:b:c:r:R:TfAt:n:l:m:",
+        c = getopt_long (argc, argv, "hx:G:a:gp:P:s:o:e:E:b:c:r:R:TfAt:n:l:m:N:S:k:",
                 long_options, &option_index);
 
 
@@ -213,6 +226,18 @@ int main_chunk(int argc, char** argv) {
             gam_split_size = atoi(optarg);
             break;
 
+        case 'N':
+            snarl_chunks = atoi(optarg);
+            break;
+
+        case 'S':
+            snarl_file = optarg;
+            break;
+
+        case 'k':
+            pack_file = optarg;
+            break;
+
         case 'T':
             trace = true;
             break;
@@ -253,6 +278,11 @@ int main_chunk(int argc, char** argv) {
         cerr << "error:[vg chunk] gam file must be specified with -a when using -f or -m" << endl;
         return 1;
     }
+    // snarl-aware chunking works on path regions, with snarls
+    if (snarl_chunks > 0 && (id_range || snarl_file.empty())) {
+        cerr << "error:[vg chunk] -N requires path regions and snarls (-S)" << endl;
+        return 1;
+    }
     // context steps default to 1 if using id_ranges.  otherwise, force user to specify to avoid
     // misunderstandings
     if (context_steps < 0 && gam_split_size == 0) {
@@ -309,8 +339,16 @@ int main_chunk(int argc, char** argv) {
 
     // This holds the RocksDB index that has all our reads, indexed by the nodes they visit.
     Index gam_index; 
+    // Or a sorted GAM can be chunked with the index that vg gamsort -i wrote next to it.
+    unique_ptr<GAMIndex> sorted_gam_index;
     if (chunk_gam) {
-        gam_index.open_read_only(gam_file);
+        ifstream sorted_index_in(gam_file + ".gai");
+        if (sorted_index_in) {
+            sorted_gam_index = unique_ptr<GAMIndex>(new GAMIndex());
+            sorted_gam_index->load(sorted_index_in);
+        } else {
+            gam_index.open_read_only(gam_file);
+        }
     }
     // Read the gam file directly if just splitting into simple chunks
     ifstream gam_stream;
@@ -354,14 +392,21 @@ int main_chunk(int argc, char** argv) {
             // determine the ranges from the xg index itself
             // how many nodes per range?
             int nodes_per_chunk = xindex.node_count / n_chunks;
+            // node ranks need not follow IDs, so sort the IDs first
+            vector<vg::id_t> node_ids;
+            node_ids.reserve(xindex.node_count);
+            for (size_t rank = 1; rank <= xindex.node_count; rank++) {
+                node_ids.push_back(xindex.rank_to_id(rank));
+            }
+            sort(node_ids.begin(), node_ids.end());
             size_t i = 1;
-            // iterate through the node ranks to build the regions
+            // iterate through the sorted IDs to build the regions
             while (i < xindex.node_count) {
                 // make a range from i to i+nodeS_per_range
-                vg::id_t a = xindex.rank_to_id(i);
+                vg::id_t a = node_ids[i - 1];
                 size_t j = i + nodes_per_chunk;
                 if (j > xindex.node_count) j = xindex.node_count;
-                vg::id_t b = xindex.rank_to_id(j);
+                vg::id_t b = node_ids[j - 1];
                 Region region;
                 region.start = a;
                 region.end = b;
@@ -430,6 +475,46 @@ int main_chunk(int argc, char** argv) {
         }
     }
 
+    // split the regions up at top-level snarl boundaries, balancing the work
+    if (snarl_chunks > 0) {
+        ifstream snarl_stream(snarl_file);
+        if (!snarl_stream) {
+            cerr << "error:[vg chunk] unable to open snarls file " << snarl_file << endl;
+            return 1;
+        }
+        SnarlManager snarl_manager(snarl_stream);
+
+        // every node visit counts for 1, plus its mean coverage if we have a pack
+        unique_ptr<Packer> packer;
+        if (!pack_file.empty()) {
+            packer = unique_ptr<Packer>(new Packer(&xindex));
+            packer->load_from_file(pack_file);
+        }
+        function<double(vg::id_t)> node_work = [&](vg::id_t id) {
+            if (!packer) {
+                return 1.0;
+            }
+            Position pos;
+            pos.set_node_id(id);
+            size_t start = packer->position_in_basis(pos);
+            size_t length = xindex.node_length(id);
+            size_t coverage = 0;
+            for (size_t i = start; i < start + length; ++i) {
+                coverage += packer->coverage_at_position(i);
+            }
+            return 1.0 + (double)coverage / length;
+        };
+
+        PathChunker chunker(&xindex);
+        vector<Region> snarl_regions;
+        for (auto& region : regions) {
+            for (auto& chunk_region : chunker.snarl_balanced_regions(region, snarl_manager, snarl_chunks, node_work)) {
+                snarl_regions.push_back(chunk_region);
+            }
+        }
+        swap(regions, snarl_regions);
+    }
+
     // finally, apply chunk_size and overlap to all regions if they are specified
     if (chunk_size > 0) {
         vector<Region> chunked_regions;
@@ -478,8 +563,21 @@ int main_chunk(int argc, char** argv) {
         chunker.xg = &xindex;
     }
 
-    // extract chunks in parallel
-#pragma omp parallel for
+    // each thread reads the sorted gam through its own stream, opened once
+    vector<unique_ptr<ifstream>> sorted_gams(threads);
+    if (chunk_gam && sorted_gam_index) {
+        for (auto& sorted_gam : sorted_gams) {
+            sorted_gam = unique_ptr<ifstream>(new ifstream(gam_file));
+            if (!*sorted_gam) {
+                cerr << "error[vg chunk]: can't open sorted gam file " << gam_file << endl;
+                return 1;
+            }
+        }
+    }
+
+    // extract chunks in parallel. regions can differ a lot in how much work
+    // they take, so threads take them one at a time.
+#pragma omp parallel for schedule(dynamic, 1)
     for (int i = 0; i < num_regions; ++i) {
         int tid = omp_get_thread_num();
         Region& region = regions[i];
@@ -557,7 +655,21 @@ int main_chunk(int argc, char** argv) {
                 cerr << "error[vg chunk]: can't open output gam file " << gam_name << endl;
                 exit(1);
             }
-            if (subgraph != NULL) {
+            if (sorted_gam_index) {
+                // start from the top, as if the file were freshly opened
+                ifstream& sorted_gam = *sorted_gams[tid];
+                sorted_gam.clear();
+                sorted_gam.seekg(0);
+                if (subgraph != NULL) {
+                    chunker.extract_gam_for_subgraph(*subgraph, *sorted_gam_index, sorted_gam, &out_gam_file,
+                                                     fully_contained, search_all_positions);
+                } else {
+                    assert(id_range == true);
+                    vector<vg::id_t> region_id_range = {region.start, region.end};
+                    chunker.extract_gam_for_ids(region_id_range, *sorted_gam_index, sorted_gam, &out_gam_file,
+                                                true, fully_contained, search_all_positions);
+                }
+            } else if (subgraph != NULL) {
                 chunker.extract_gam_for_subgraph(*subgraph, gam_index, &out_gam_file,
                                                  fully_contained, search_all_positions);
             } else {
@@ -8,12 +8,15 @@
 #include <unistd.h>
 #include <getopt.h>
 
+#include <algorithm>
 #include <iostream>
 
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
 #include "../index.hpp"
+#include "../stream.hpp"
+#include "../hash_map.hpp"
 
 using namespace std;
 using namespace vg;
@@ -26,9 +29,172 @@ void help_compare(char** argv) {
         << "options:" << endl
         << "    -d, --db-name1 FILE  use this db for graph1 (defaults to <graph1>.index/)" << endl
         << "    -e, --db-name2 FILE  use this db for graph2 (defaults to <graph1>.index/)" << endl
+        << "    -H, --hash           compare the nodes and edges of two .vg graphs by hash instead" << endl
+        << "    -R, --range-size N   with -H, also list the node ID ranges of this size that differ" << endl
         << "    -t, --threads N      number of threads to use" << endl;
 }
 
+/// A hashed node or edge, and the range of node IDs it is in
+struct HashedElement {
+    uint64_t range;
+    uint64_t hash;
+    
+    bool operator<(const HashedElement& other) const {
+        return range < other.range || (range == other.range && hash < other.hash);
+    }
+    bool operator==(const HashedElement& other) const {
+        return range == other.range && hash == other.hash;
+    }
+};
+
+/// The hashes of all the nodes and edges of a graph, sorted
+struct GraphHashes {
+    vector<HashedElement> nodes;
+    vector<HashedElement> edges;
+};
+
+/// Hash the nodes and edges of a graph, reading its chunks in parallel. Nodes
+/// are hashed on their IDs and sequences, and edges on their canonical
+/// orientation, so the same graph chunked differently gets the same hashes.
+static GraphHashes hash_graph(istream& in, size_t range_size) {
+    vector<GraphHashes> thread_hashes(get_thread_count());
+    auto range_of = [&](int64_t id) {
+        return range_size ? (uint64_t) id / range_size : 0;
+    };
+    function<void(Graph&)> lambda = [&](Graph& graph) {
+        GraphHashes& hashes = thread_hashes[omp_get_thread_num()];
+        for (auto& node : graph.node()) {
+            size_t hash = std::hash<pair<int64_t, string>>()(make_pair(node.id(), node.sequence()));
+            hashes.nodes.push_back({range_of(node.id()), wang_hash_64(hash)});
+        }
+        for (auto& edge : graph.edge()) {
+            // An edge is the same as its flip to the other strand
+            tuple<int64_t, bool, int64_t, bool> forward(edge.from(), edge.from_start(), edge.to(), edge.to_end());
+            tuple<int64_t, bool, int64_t, bool> flipped(edge.to(), !edge.to_end(), edge.from(), !edge.from_start());
+            size_t hash = std::hash<tuple<int64_t, bool, int64_t, bool>>()(min(forward, flipped));
+            hashes.edges.push_back({range_of(min(edge.from(), edge.to())), wang_hash_64(hash)});
+        }
+    };
+    stream::for_each_parallel(in, lambda);
+    
+    GraphHashes all;
+    for (auto& hashes : thread_hashes) {
+        all.nodes.insert(all.nodes.end(), hashes.nodes.begin(), hashes.nodes.end());
+        all.edges.insert(all.edges.end(), hashes.edges.begin(), hashes.edges.end());
+    }
+#pragma omp parallel sections
+    {
+#pragma omp section
+        {
+            sort(all.nodes.begin(), all.nodes.end());
+            all.nodes.erase(unique(all.nodes.begin(), all.nodes.end()), all.nodes.end());
+        }
+#pragma omp section
+        {
+            sort(all.edges.begin(), all.edges.end());
+            all.edges.erase(unique(all.edges.begin(), all.edges.end()), all.edges.end());
+        }
+    }
+    return all;
+}
+
+/// Count the elements two sorted sets of hashes share. A range whose hashes
+/// add up to the same digest in both, with the same count, is taken to be
+/// the same without merging it. Ranges that differ are added to
+/// differing_ranges.
+static int64_t count_shared(const vector<HashedElement>& a, const vector<HashedElement>& b,
+                            set<uint64_t>& differing_ranges) {
+    int64_t shared = 0;
+    auto range_end = [](const vector<HashedElement>& v, size_t i) {
+        size_t j = i;
+        while (j < v.size() && v[j].range == v[i].range) {
+            j++;
+        }
+        return j;
+    };
+    auto digest = [](const vector<HashedElement>& v, size_t begin, size_t end) {
+        uint64_t sum = 0;
+        for (size_t i = begin; i < end; i++) {
+            sum += wang_hash_64(v[i].hash);
+        }
+        return sum;
+    };
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (j == b.size() || (i < a.size() && a[i].range < b[j].range)) {
+            differing_ranges.insert(a[i].range);
+            i = range_end(a, i);
+        } else if (i == a.size() || b[j].range < a[i].range) {
+            differing_ranges.insert(b[j].range);
+            j = range_end(b, j);
+        } else {
+            size_t a_end = range_end(a, i);
+            size_t b_end = range_end(b, j);
+            if (a_end - i == b_end - j && digest(a, i, a_end) == digest(b, j, b_end)) {
+                shared += a_end - i;
+            } else {
+                differing_ranges.insert(a[i].range);
+                while (i < a_end && j < b_end) {
+                    if (a[i].hash < b[j].hash) {
+                        i++;
+                    } else if (b[j].hash < a[i].hash) {
+                        j++;
+                    } else {
+                        shared++;
+                        i++;
+                        j++;
+                    }
+                }
+            }
+            i = a_end;
+            j = b_end;
+        }
+    }
+    return shared;
+}
+
+/// Compare two .vg graphs by the hashes of their nodes and edges, and report
+/// the counts as JSON.
+static void compare_by_hash(const string& name1, const string& name2, size_t range_size) {
+    GraphHashes hashes1, hashes2;
+    get_input_file(name1, [&](istream& in) {
+        hashes1 = hash_graph(in, range_size);
+    });
+    get_input_file(name2, [&](istream& in) {
+        hashes2 = hash_graph(in, range_size);
+    });
+    
+    set<uint64_t> differing_ranges;
+    int64_t shared_nodes = count_shared(hashes1.nodes, hashes2.nodes, differing_ranges);
+    int64_t shared_edges = count_shared(hashes1.edges, hashes2.edges, differing_ranges);
+    
+    auto counts = [](int64_t total1, int64_t total2, int64_t shared) {
+        stringstream json;
+        json << "{\"graph1_total\": " << total1
+             << ", \"graph2_total\": " << total2
+             << ", \"graph1_only\": " << total1 - shared
+             << ", \"graph2_only\": " << total2 - shared
+             << ", \"intersection\": " << shared
+             << ", \"union\": " << total1 + total2 - shared << "}";
+        return json.str();
+    };
+    cout << "{\n"
+        << "\"graph1_path\": " << "\"" << name1 << "\"" << ",\n"
+        << "\"graph2_path\": " << "\"" << name2 << "\"" << ",\n"
+        << "\"nodes\": " << counts(hashes1.nodes.size(), hashes2.nodes.size(), shared_nodes) << ",\n"
+        << "\"edges\": " << counts(hashes1.edges.size(), hashes2.edges.size(), shared_edges);
+    if (range_size) {
+        // Say which ranges of node IDs differ, so they can be looked at alone
+        cout << ",\n\"differing_ranges\": [";
+        for (auto it = differing_ranges.begin(); it != differing_ranges.end(); ++it) {
+            cout << (it == differing_ranges.begin() ? "" : ", ")
+                 << "[" << *it * range_size << ", " << (*it + 1) * range_size - 1 << "]";
+        }
+        cout << "]";
+    }
+    cout << "\n}" << endl;
+}
+
 int main_compare(int argc, char** argv) {
 
     if (argc <= 3) {
@@ -39,6 +205,8 @@ int main_compare(int argc, char** argv) {
     string db_name1;
     string db_name2;
     int num_threads = 1;
+    bool by_hash = false;
+    size_t range_size = 0;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -48,12 +216,14 @@ int main_compare(int argc, char** argv) {
             {"help", no_argument, 0, 'h'},
             {"db-name1", required_argument, 0, 'd'},
             {"db-name2", required_argument, 0, 'e'},
+            {"hash", no_argument, 0, 'H'},
+            {"range-size", required_argument, 0, 'R'},
             {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hd:e:t:",
+        c = getopt_long (argc, argv, "hd:e:HR:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -71,6 +241,14 @@ int main_compare(int argc, char** argv) {
                 db_name2 = optarg;
                 break;
 
+            case 'H':
+                by_hash = true;
+                break;
+
+            case 'R':
+                range_size = atoll(optarg);
+                break;
+
             case 't':
                 num_threads = atoi(optarg);
                 break;
@@ -95,6 +273,11 @@ int main_compare(int argc, char** argv) {
         db_name2 = get_input_file_name(optind, argc, argv);
     }
 
+    if (by_hash) {
+        compare_by_hash(db_name1, db_name2, range_size);
+        return 0;
+    }
+
     // Note: only supporting rocksdb index for now.
 
     Index index1;
@@ -9,10 +9,14 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../stream.hpp"
+#include "../utility.hpp"
 
 using namespace std;
 using namespace vg;
@@ -62,23 +66,93 @@ int main_concat(int argc, char** argv) {
         }
     }
 
-    list<VG*> graphs;
-
+    // We stream each graph through once, shifting its IDs past everything
+    // written before it while noting its heads and tails, then write a chunk
+    // joining the previous graph's tails to its heads. Everything the shift
+    // needs comes from the graphs before, so nothing has to be read twice.
+    
+    // The largest ID used so far, which the next graph is shifted past
+    id_t max_id = 0;
+    // The tails of everything written so far
+    vector<id_t> tails;
+    // How far to shift the mapping ranks of each path, so that paths with the
+    // same name are concatenated in order
+    unordered_map<string, int64_t> rank_offset;
+    
+    vector<Graph> buffer;
     while (optind < argc) {
-        VG* graph;
+        vector<id_t> node_order;
+        unordered_set<id_t> has_left_edge;
+        unordered_set<id_t> has_right_edge;
+        id_t graph_max_id = 0;
+        unordered_map<string, int64_t> max_rank;
+        id_t shift = max_id;
+        
         get_input_file(optind, argc, argv, [&](istream& in) {
-            graph = new VG(in);
+            stream::for_each<Graph>(in, [&](Graph& chunk) {
+                for (auto& node : *chunk.mutable_node()) {
+                    node_order.push_back(node.id());
+                    graph_max_id = max(graph_max_id, node.id());
+                    node.set_id(node.id() + shift);
+                }
+                for (auto& edge : *chunk.mutable_edge()) {
+                    (edge.from_start() ? has_left_edge : has_right_edge).insert(edge.from());
+                    (edge.to_end() ? has_right_edge : has_left_edge).insert(edge.to());
+                    edge.set_from(edge.from() + shift);
+                    edge.set_to(edge.to() + shift);
+                }
+                for (auto& path : *chunk.mutable_path()) {
+                    int64_t offset = rank_offset.count(path.name()) ? rank_offset[path.name()] : 0;
+                    int64_t& path_max_rank = max_rank[path.name()];
+                    for (auto& mapping : *path.mutable_mapping()) {
+                        mapping.mutable_position()->set_node_id(mapping.position().node_id() + shift);
+                        if (mapping.rank()) {
+                            path_max_rank = max(path_max_rank, mapping.rank());
+                            mapping.set_rank(mapping.rank() + offset);
+                        }
+                    }
+                }
+                buffer.push_back(chunk);
+                stream::write_buffered(cout, buffer, 0);
+            });
         });
-        graphs.push_back(graph);
-    }
-
-    VG merged;
-    for (list<VG*>::iterator g = graphs.begin(); g != graphs.end(); ++g) {
-        merged.append(**g);
+        
+        // Attach the tails of what came before to the heads of this graph
+        vector<id_t> heads;
+        for (id_t id : node_order) {
+            if (!has_left_edge.count(id)) {
+                heads.push_back(id + shift);
+            }
+        }
+        if (!heads.empty()) {
+            Graph joining_chunk;
+            for (id_t tail : tails) {
+                for (id_t head : heads) {
+                    Edge* edge = joining_chunk.add_edge();
+                    edge->set_from(tail);
+                    edge->set_to(head);
+                }
+            }
+            if (joining_chunk.edge_size()) {
+                buffer.push_back(joining_chunk);
+                stream::write_buffered(cout, buffer, 0);
+            }
+            // The old tails aren't tails anymore
+            tails.clear();
+        }
+        for (id_t id : node_order) {
+            if (!has_right_edge.count(id)) {
+                tails.push_back(id + shift);
+            }
+        }
+        
+        max_id += graph_max_id;
+        for (auto& path_rank : max_rank) {
+            rank_offset[path_rank.first] += path_rank.second;
+        }
     }
-
-    // output
-    merged.serialize_to_ostream(std::cout);
+    
+    cout.flush();
 
     return 0;
 }
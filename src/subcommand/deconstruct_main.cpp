@@ -24,6 +24,8 @@ void help_deconstruct(char** argv){
          << "Outputs VCF records for Snarls present in a graph (relative to a chosen reference path)." << endl
          << "options: " << endl
          << "--path / -p     REQUIRED: A reference path to deconstruct against." << endl
+         << "--snarls / -r   Use the snarls in this file instead of finding them." << endl
+         << "--threads / -t  Use this many threads." << endl
          << endl;
 }
 
@@ -37,6 +39,7 @@ int main_deconstruct(int argc, char** argv){
     vector<string> refpaths;
     string graphname;
     string outfile = "";
+    string snarl_file;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -45,12 +48,14 @@ int main_deconstruct(int argc, char** argv){
             {
                 {"help", no_argument, 0, 'h'},
                 {"path", required_argument, 0, 'p'},
+                {"snarls", required_argument, 0, 'r'},
+                {"threads", required_argument, 0, 't'},
                 {0, 0, 0, 0}
 
             };
 
             int option_index = 0;
-            c = getopt_long (argc, argv, "hp:",
+            c = getopt_long (argc, argv, "hp:r:t:",
                     long_options, &option_index);
 
             // Detect the end of the options.
@@ -62,6 +67,12 @@ int main_deconstruct(int argc, char** argv){
                 case 'p':
                     refpaths = split(optarg, ",");
                     break;
+                case 'r':
+                    snarl_file = optarg;
+                    break;
+                case 't':
+                    omp_set_num_threads(atoi(optarg));
+                    break;
                 case '?':
                 case 'h':
                     help_deconstruct(argv);
@@ -81,9 +92,24 @@ int main_deconstruct(int argc, char** argv){
 
         // load graph
 
+        // load snarls, if we have them
+        SnarlManager* snarl_manager = nullptr;
+        if (!snarl_file.empty()){
+            ifstream snarl_stream(snarl_file);
+            if (!snarl_stream){
+                cerr << "error:[vg deconstruct] Cannot open snarls file " << snarl_file << endl;
+                return 1;
+            }
+            snarl_manager = new SnarlManager(snarl_stream);
+        }
+
         // Deconstruct
         Deconstructor dd;
-        dd.deconstruct(refpaths, graph);
+        dd.deconstruct(refpaths, graph, snarl_manager);
+
+        if (snarl_manager != nullptr){
+            delete snarl_manager;
+        }
     return 0;
 }
 
@@ -11,6 +11,7 @@
 #include "../vg.hpp"
 #include "../stream.hpp"
 #include "../utility.hpp"
+#include "../algorithms/weakly_connected_components.hpp"
 
 
 using namespace std;
@@ -85,46 +86,67 @@ int main_explode(int argc, char** argv) {
     
     // Now we explode the VG
     
-    // Count through the components we build
-    size_t component_index = 0;
+    // Number every node's component up front, on all threads. Components
+    // are numbered in order of their first node, as we encounter them here.
+    vector<id_t> node_ids;
+    vector<size_t> component_ids;
+    algorithms::weakly_connected_component_ids(graph, node_ids, component_ids);
     
-    // Track all the nodes we've already assigned to subgraphs
-    set<Node*> used;
+    size_t component_count = component_ids.empty() ? 0 : *max_element(component_ids.begin(), component_ids.end()) + 1;
+    vector<vector<Node*>> component_nodes(component_count);
+    for (size_t i = 0; i < node_ids.size(); i++) {
+        component_nodes[component_ids[i]].push_back(graph->get_node(node_ids[i]));
+    }
     
-    graph->for_each_node([&](Node* start) {
-        if (!used.count(start)) {
-            // It's a new connected component!
-            VG component;
-            
-            // We want to track the path names in each component
-            set<string> path_names;
-            
-            graph->for_each_connected_node(start, [&](Node* n) {
-                // Mark this connected node as used in a component.
-                used.insert(n);
-                
-                // Copy node over
-                component.create_node(n->sequence(), n->id());
-                
-                // Copy over its edges
+    // Pulling a component's pieces out of the big graph isn't thread safe,
+    // so we do that serially, a batch of components at a time. Then we build
+    // and save the batch's components on all threads.
+    struct ComponentParts {
+        vector<Node*> nodes;
+        vector<Edge> edges;
+        vector<pair<string, mapping_t>> mappings;
+        // We want to track the path names in each component
+        set<string> path_names;
+    };
+    
+    size_t batch_size = get_thread_count();
+    for (size_t batch_start = 0; batch_start < component_count; batch_start += batch_size) {
+        size_t batch_end = min(batch_start + batch_size, component_count);
+        vector<ComponentParts> batch(batch_end - batch_start);
+        
+        for (size_t component_index = batch_start; component_index < batch_end; component_index++) {
+            ComponentParts& parts = batch[component_index - batch_start];
+            parts.nodes = std::move(component_nodes[component_index]);
+            for (Node* n : parts.nodes) {
                 for (auto* e : graph->edges_of(n)) {
-                    component.add_edge(*e);
+                    parts.edges.push_back(*e);
                 }
-                
-                // Copy paths over
                 for (auto& path : graph->paths.get_node_mapping_by_path_name(n)) {
                     // Some paths might not actually touch this node at all.
-                    bool nonempty = false;
                     for (auto& m : path.second) {
-                        component.paths.append_mapping(path.first, *m);
-                        nonempty = true;
-                    }
-                    if (nonempty) {
+                        parts.mappings.emplace_back(path.first, *m);
                         // This path had mappings, so it qualifies for the component
-                        path_names.insert(path.first);
+                        parts.path_names.insert(path.first);
                     }
                 }
-            });
+            }
+        }
+        
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t component_index = batch_start; component_index < batch_end; component_index++) {
+            ComponentParts& parts = batch[component_index - batch_start];
+            VG component;
+            
+            for (Node* n : parts.nodes) {
+                // Copy node over
+                component.create_node(n->sequence(), n->id());
+            }
+            for (auto& e : parts.edges) {
+                component.add_edge(e);
+            }
+            for (auto& mapping : parts.mappings) {
+                component.paths.append_mapping(mapping.first, mapping.second);
+            }
             
             // We inserted mappings into the component in more or less arbitrary
             // order, so sort them by rank.
@@ -134,21 +156,19 @@ int main_explode(int argc, char** argv) {
             
             // Save the component
             string filename = output_dir + "/component" + to_string(component_index) + ".vg";
-            
-            // Now report what paths went into the component in parseable TSV
-            cout << filename;
-            for (auto& path_name : path_names) {
+            component.serialize_to_file(filename);
+        }
+        
+        // Now report what paths went into each component in parseable TSV,
+        // in component order
+        for (size_t component_index = batch_start; component_index < batch_end; component_index++) {
+            cout << output_dir + "/component" + to_string(component_index) + ".vg";
+            for (auto& path_name : batch[component_index - batch_start].path_names) {
                 cout << "\t" << path_name;
             }
             cout << endl;
-            
-            component.serialize_to_file(filename);
-            
-            
-            
-            component_index++;
         }
-    });
+    }
     
     if (graph != nullptr) {
         delete graph;
@@ -42,8 +42,12 @@ void help_filter(char** argv) {
          << "    -v, --verbose           print out statistics on numbers of reads filtered by what." << endl
          << "    -q, --min-mapq N        filter alignments with mapping quality < N" << endl
          << "    -E, --repeat-ends N     filter reads with tandem repeat (motif size <= 2N, spanning >= N bases) at either end" << endl
+         << "    --min-entropy F         filter reads with over half their bases in 16bp windows with entropy < F bits" << endl
          << "    -D, --defray-ends N     clip back the ends of reads that are ambiguously aligned, up to N bases" << endl
          << "    -C, --defray-count N    stop defraying after N nodes visited (used to keep runtime in check) [default=99999]" << endl
+         << "    --where QUERY           keep only reads matching QUERY, decoding just the fields it needs, e.g." << endl
+         << "                            'mapq >= 30 && !secondary && name ^= run1 && node == 5,9'" << endl
+         << "                            (fields: mapq, score, identity, secondary, name, node)" << endl
          << "    -t, --threads N         number of threads [1]" << endl;
 }
 
@@ -66,6 +70,8 @@ int main_filter(int argc, char** argv) {
     int c;
     optind = 2; // force optind past command positional arguments
     while (true) {
+        #define OPT_WHERE 1000
+        #define OPT_MIN_ENTROPY 1001
         static struct option long_options[] =
             {
                 {"name-prefix", required_argument, 0, 'n'},
@@ -88,6 +94,8 @@ int main_filter(int argc, char** argv) {
                 {"defray-ends", required_argument, 0, 'D'},
                 {"defray-count", required_argument, 0, 'C'},
                 {"threads", required_argument, 0, 't'},
+                {"where", required_argument, 0, OPT_WHERE},
+                {"min-entropy", required_argument, 0, OPT_MIN_ENTROPY},
                 {0, 0, 0, 0}
             };
 
@@ -160,6 +168,17 @@ int main_filter(int argc, char** argv) {
         case 't':
             filter.threads = atoi(optarg);
             break;
+        case OPT_MIN_ENTROPY:
+            filter.min_entropy = atof(optarg);
+            break;
+        case OPT_WHERE:
+            try {
+                filter.where = AlignmentPredicate::parse(optarg);
+            } catch (const runtime_error& e) {
+                cerr << "error:[vg filter] " << e.what() << endl;
+                exit(1);
+            }
+            break;
 
         case 'h':
         case '?':
@@ -4,6 +4,9 @@
 #include "../mapper.hpp"
 #include "../stream.hpp"
 #include "../region.hpp"
+#include "../gam_index.hpp"
+
+#include <gbwt/gbwt.h>
 
 #include <unistd.h>
 #include <getopt.h>
@@ -24,13 +27,19 @@ void help_find(char** argv) {
          << "    -c, --context STEPS    expand the context of the subgraph this many steps" << endl
          << "    -L, --use-length       treat STEPS in -c or M in -r as a length in bases" << endl
          << "    -p, --path TARGET      find the node(s) in the specified path range(s) TARGET=path[:pos1[-pos2]]" << endl
+         << "    -E, --path-bed FILE    like -p, but for each (0-based end-exclusive) BED region in FILE on its own," << endl
+         << "                           extracted in parallel and written in the order of FILE" << endl
+         << "    -F, --path-list FILE   like -E, for a file with a -p style TARGET on each line" << endl
+         << "    -O, --out-prefix PFX   with -E or -F, write each region to PFX_<n>_<path>_<start>_<end>.vg and a" << endl
+         << "                           table of regions and file names to stdout, instead of a stream of graphs" << endl
          << "    -P, --position-in PATH find the position of the node (specified by -n) in the given path" << endl
          << "    -R, --rank-in PATH     find the rank of the node (specified by -n) in the given path" << endl
          << "    -I, --list-paths       write out the path names in the index" << endl
          << "    -X, --approx-pos ID    get the approximate position of this node" << endl
          << "    -r, --node-range N:M   get nodes from N to M" << endl
          << "    -G, --gam GAM          accumulate the graph touched by the alignments in the GAM" << endl
-         << "alignments: (rocksdb only)" << endl
+         << "alignments: (rocksdb, or a sorted GAM with -l for -i, -o and -A)" << endl
+         << "    -l, --sorted-gam FILE  use this GAM, sorted and indexed with vg gamsort -i, instead of rocksdb" << endl
          << "    -a, --alignments       writes alignments from index, sorted by node id" << endl
          << "    -i, --alns-in N:M      writes alignments whose start nodes is between N and M (inclusive)" << endl
          << "    -o, --alns-on N:M      writes alignments which align to any of the nodes between N and M (inclusive)" << endl
@@ -52,6 +61,7 @@ void help_find(char** argv) {
          << "    -D, --distance         return distance on path between pair of nodes (-n). if -P not used, best path chosen heurstically" << endl
          << "haplotypes:" << endl
          << "    -H, --haplotypes FILE  count xg threads in agreement with alignments in the GAM" << endl
+         << "    -w, --gbwt-name FILE   answer -H queries from this GBWT instead of the xg's embedded gPBWT" << endl
          << "    -t, --extract-threads  extract the threads, writing them as paths to the .vg stream on stdout" << endl
          << "    -q, --threads-named S  return all threads whose names are prefixed with string S (multiple allowed)" << endl
          << "    -Q, --paths-named S    return all paths whose names are prefixed with S (multiple allowed)" << endl;
@@ -66,6 +76,7 @@ int main_find(int argc, char** argv) {
     }
 
     string db_name;
+    string sorted_gam_name;
     string sequence;
     int kmer_size=0;
     int kmer_stride = 1;
@@ -77,6 +88,9 @@ int main_find(int argc, char** argv) {
     bool count_kmers = false;
     bool kmer_table = false;
     vector<string> targets;
+    string region_bed_file;
+    string region_list_file;
+    string region_out_prefix;
     string path_name;
     bool position_in = false;
     bool rank_in = false;
@@ -94,6 +108,7 @@ int main_find(int argc, char** argv) {
     vg::id_t end_id = 0;
     bool pairwise_distance = false;
     string haplotype_alignments;
+    string gbwt_name;
     string gam_file;
     int max_mem_length = 0;
     int min_mem_length = 1;
@@ -130,6 +145,9 @@ int main_find(int argc, char** argv) {
                 {"use-length", no_argument, 0, 'L'},
                 {"kmer-count", no_argument, 0, 'C'},
                 {"path", required_argument, 0, 'p'},
+                {"path-bed", required_argument, 0, 'E'},
+                {"path-list", required_argument, 0, 'F'},
+                {"out-prefix", required_argument, 0, 'O'},
                 {"position-in", required_argument, 0, 'P'},
                 {"rank-in", required_argument, 0, 'R'},
                 {"node-range", required_argument, 0, 'r'},
@@ -137,8 +155,10 @@ int main_find(int argc, char** argv) {
                 {"mappings", no_argument, 0, 'm'},
                 {"alns-in", required_argument, 0, 'i'},
                 {"alns-on", required_argument, 0, 'o'},
+                {"sorted-gam", required_argument, 0, 'l'},
                 {"distance", no_argument, 0, 'D'},
                 {"haplotypes", required_argument, 0, 'H'},
+                {"gbwt-name", required_argument, 0, 'w'},
                 {"gam", required_argument, 0, 'G'},
                 {"to-graph", required_argument, 0, 'A'},
                 {"max-mem", required_argument, 0, 'Y'},
@@ -152,7 +172,7 @@ int main_find(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:IQ:",
+        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:E:F:O:P:r:amg:M:R:B:fi:DH:w:G:N:A:Y:Z:tq:X:IQ:l:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -169,6 +189,10 @@ int main_find(int argc, char** argv) {
             xg_name = optarg;
             break;
 
+        case 'l':
+            sorted_gam_name = optarg;
+            break;
+
         case 'g':
             gcsa_in = optarg;
             break;
@@ -218,6 +242,18 @@ int main_find(int argc, char** argv) {
             targets.push_back(optarg);
             break;
 
+        case 'E':
+            region_bed_file = optarg;
+            break;
+
+        case 'F':
+            region_list_file = optarg;
+            break;
+
+        case 'O':
+            region_out_prefix = optarg;
+            break;
+
         case 'P':
             path_name = optarg;
             position_in = true;
@@ -288,6 +324,10 @@ int main_find(int argc, char** argv) {
             haplotype_alignments = optarg;
             break;
 
+        case 'w':
+            gbwt_name = optarg;
+            break;
+
         case 't':
             extract_threads = true;
             break;
@@ -329,8 +369,8 @@ int main_find(int argc, char** argv) {
         return 1;
     }
 
-    if (db_name.empty() && gcsa_in.empty() && xg_name.empty()) {
-        cerr << "[vg find] find requires -d, -g, or -x to know where to find its database" << endl;
+    if (db_name.empty() && gcsa_in.empty() && xg_name.empty() && sorted_gam_name.empty()) {
+        cerr << "[vg find] find requires -d, -g, -x, or -l to know where to find its database" << endl;
         return 1;
     }
 
@@ -339,6 +379,16 @@ int main_find(int argc, char** argv) {
         exit(1);
     }
     
+    if (xg_name.empty() && (!region_bed_file.empty() || !region_list_file.empty())) {
+        cerr << "error:[vg find] region files (-E, -F) require an XG index. Provide XG index with -x." << endl;
+        exit(1);
+    }
+    
+    if (!region_out_prefix.empty() && region_bed_file.empty() && region_list_file.empty()) {
+        cerr << "error:[vg find] -O requires regions to write, from -E or -F" << endl;
+        exit(1);
+    }
+    
     if (xg_name.empty() && mem_reseed_length) {
         cerr << "error:[vg find] SMEM reseeding requires an XG index. Provide XG index with -x." << endl;
         exit(1);
@@ -364,18 +414,61 @@ int main_find(int argc, char** argv) {
     // open index
     Index* vindex = nullptr;
     if (db_name.empty()) {
-        assert(!gcsa_in.empty() || !xg_name.empty());
+        assert(!gcsa_in.empty() || !xg_name.empty() || !sorted_gam_name.empty());
     } else {
         vindex = new Index;
         vindex->open_read_only(db_name);
     }
 
+    // or the index of a sorted GAM
+    unique_ptr<GAMIndex> gam_index;
+    if (!sorted_gam_name.empty()) {
+        ifstream index_in(sorted_gam_name + ".gai");
+        if (!index_in) {
+            cerr << "error:[vg find] unable to open GAM index " << sorted_gam_name << ".gai" << endl;
+            exit(1);
+        }
+        gam_index = unique_ptr<GAMIndex>(new GAMIndex());
+        gam_index->load(index_in);
+    }
+
+    // write out the reads in the sorted GAM that touch the ranges and pass the filter
+    auto write_sorted_gam_alignments = [&](const vector<pair<vg::id_t, vg::id_t>>& ranges,
+                                           const function<bool(const Alignment&)>& keep) {
+        ifstream gam_in(sorted_gam_name);
+        if (!gam_in) {
+            cerr << "error:[vg find] unable to open sorted GAM " << sorted_gam_name << endl;
+            exit(1);
+        }
+        vector<Alignment> output_buf;
+        gam_index->find(gam_in, ranges, [&](const Alignment& aln) {
+            if (keep(aln)) {
+                output_buf.push_back(aln);
+                stream::write_buffered(cout, output_buf, 100);
+            }
+        });
+        stream::write_buffered(cout, output_buf, 0);
+    };
+
     xg::XG xindex;
     if (!xg_name.empty()) {
         ifstream in(xg_name.c_str());
         xindex.load(in);
     }
 
+    unique_ptr<gbwt::GBWT> gbwt_index;
+    if (!gbwt_name.empty()) {
+        // Delegate the XG's haplotype queries to the GBWT.
+        ifstream in(gbwt_name.c_str());
+        if (!in) {
+            cerr << "error:[vg find] unable to load gbwt index file " << gbwt_name << endl;
+            exit(1);
+        }
+        gbwt_index = unique_ptr<gbwt::GBWT>(new gbwt::GBWT());
+        gbwt_index->load(in);
+        xindex.set_haplotype_database(gbwt_index.get());
+    }
+
     if (get_alignments) {
         assert(!db_name.empty());
         vector<Alignment> output_buf;
@@ -388,7 +481,7 @@ int main_find(int argc, char** argv) {
     }
 
     if (!node_id_range.empty()) {
-        assert(!db_name.empty());
+        assert(!db_name.empty() || gam_index);
         vector<string> parts = split_delims(node_id_range, ":");
         if (parts.size() == 1) {
             convert(parts.front(), start_id);
@@ -397,17 +490,28 @@ int main_find(int argc, char** argv) {
             convert(parts.front(), start_id);
             convert(parts.back(), end_id);
         }
-        vector<Alignment> output_buf;
-        auto lambda = [&output_buf](const Alignment& aln) {
-            output_buf.push_back(aln);
-            stream::write_buffered(cout, output_buf, 100);
-        };
-        vindex->for_alignment_in_range(start_id, end_id, lambda);
-        stream::write_buffered(cout, output_buf, 0);
+        if (gam_index) {
+            // like rocksdb, go by the lowest node ID in each alignment
+            write_sorted_gam_alignments({make_pair(start_id, end_id)}, [&](const Alignment& aln) {
+                vg::id_t min_id = aln.path().mapping(0).position().node_id();
+                for (auto& mapping : aln.path().mapping()) {
+                    min_id = min(min_id, mapping.position().node_id());
+                }
+                return min_id >= start_id && min_id <= end_id;
+            });
+        } else {
+            vector<Alignment> output_buf;
+            auto lambda = [&output_buf](const Alignment& aln) {
+                output_buf.push_back(aln);
+                stream::write_buffered(cout, output_buf, 100);
+            };
+            vindex->for_alignment_in_range(start_id, end_id, lambda);
+            stream::write_buffered(cout, output_buf, 0);
+        }
     }
 
     if (!aln_on_id_range.empty()) {
-        assert(!db_name.empty());
+        assert(!db_name.empty() || gam_index);
         vector<string> parts = split_delims(aln_on_id_range, ":");
         if (parts.size() == 1) {
             convert(parts.front(), start_id);
@@ -416,32 +520,50 @@ int main_find(int argc, char** argv) {
             convert(parts.front(), start_id);
             convert(parts.back(), end_id);
         }
-        vector<vg::id_t> ids;
-        for (auto i = start_id; i <= end_id; ++i) {
-            ids.push_back(i);
+        if (gam_index) {
+            write_sorted_gam_alignments({make_pair(start_id, end_id)}, [](const Alignment& aln) { return true; });
+        } else {
+            vector<vg::id_t> ids;
+            for (auto i = start_id; i <= end_id; ++i) {
+                ids.push_back(i);
+            }
+            vector<Alignment> output_buf;
+            auto lambda = [&output_buf](const Alignment& aln) {
+                output_buf.push_back(aln);
+                stream::write_buffered(cout, output_buf, 100);
+            };
+            vindex->for_alignment_to_nodes(ids, lambda);
+            stream::write_buffered(cout, output_buf, 0);
         }
-        vector<Alignment> output_buf;
-        auto lambda = [&output_buf](const Alignment& aln) {
-            output_buf.push_back(aln);
-            stream::write_buffered(cout, output_buf, 100);
-        };
-        vindex->for_alignment_to_nodes(ids, lambda);
-        stream::write_buffered(cout, output_buf, 0);
     }
 
     if (!to_graph_file.empty()) {
-        assert(vindex != nullptr);
+        assert(vindex != nullptr || gam_index);
         ifstream tgi(to_graph_file);
         VG graph(tgi);
         vector<vg::id_t> ids;
         graph.for_each_node([&](Node* n) { ids.push_back(n->id()); });
-        vector<Alignment> output_buf;
-        auto lambda = [&output_buf](const Alignment& aln) {
-            output_buf.push_back(aln);
-            stream::write_buffered(cout, output_buf, 100);
-        };
-        vindex->for_alignment_to_nodes(ids, lambda);
-        stream::write_buffered(cout, output_buf, 0);
+        if (gam_index) {
+            // query each run of consecutive node IDs
+            std::sort(ids.begin(), ids.end());
+            vector<pair<vg::id_t, vg::id_t>> ranges;
+            for (auto id : ids) {
+                if (!ranges.empty() && id <= ranges.back().second + 1) {
+                    ranges.back().second = max(ranges.back().second, id);
+                } else {
+                    ranges.emplace_back(id, id);
+                }
+            }
+            write_sorted_gam_alignments(ranges, [](const Alignment& aln) { return true; });
+        } else {
+            vector<Alignment> output_buf;
+            auto lambda = [&output_buf](const Alignment& aln) {
+                output_buf.push_back(aln);
+                stream::write_buffered(cout, output_buf, 100);
+            };
+            vindex->for_alignment_to_nodes(ids, lambda);
+            stream::write_buffered(cout, output_buf, 0);
+        }
     }
 
     if (!xg_name.empty()) {
@@ -552,6 +674,90 @@ int main_find(int argc, char** argv) {
             
             vgg.serialize_to_ostream(cout);
         }
+        if (!region_bed_file.empty() || !region_list_file.empty()) {
+            vector<Region> regions;
+            if (!region_bed_file.empty()) {
+                if (!ifstream(region_bed_file)) {
+                    cerr << "error:[vg find] unable to open path regions: " << region_bed_file << endl;
+                    exit(1);
+                }
+                parse_bed_regions(region_bed_file, regions);
+            }
+            if (!region_list_file.empty()) {
+                ifstream region_stream(region_list_file);
+                if (!region_stream) {
+                    cerr << "error:[vg find] unable to open path regions: " << region_list_file << endl;
+                    exit(1);
+                }
+                string line;
+                while (getline(region_stream, line)) {
+                    if (!line.empty()) {
+                        Region region;
+                        parse_region(line, region);
+                        regions.push_back(region);
+                    }
+                }
+            }
+            // Check all the paths up front, since we can't stop cleanly from
+            // inside the parallel loop
+            for (auto& region : regions) {
+                if (xindex.path_rank(region.seq) == 0) {
+                    // Passing a nonexistent path to get_path_range produces Undefined Behavior
+                    cerr << "[vg find] error, path " << region.seq << " not found in index" << endl;
+                    exit(1);
+                }
+                // no coordinates given, we do whole thing (0,-1)
+                if (region.start < 0 && region.end < 0) {
+                    region.start = 0;
+                }
+            }
+            
+            auto region_file_name = [&](size_t i) {
+                stringstream name;
+                name << region_out_prefix << "_" << i << "_" << regions[i].seq << "_"
+                     << regions[i].start << "_" << regions[i].end << ".vg";
+                return name.str();
+            };
+            
+            // Extract the regions in parallel a batch at a time, so that we
+            // only hold a batch's worth of subgraphs waiting to be written
+            size_t batch_size = 64 * get_thread_count();
+            vector<string> serialized;
+            for (size_t batch_start = 0; batch_start < regions.size(); batch_start += batch_size) {
+                size_t batch_end = min(regions.size(), batch_start + batch_size);
+                serialized.clear();
+                serialized.resize(batch_end - batch_start);
+#pragma omp parallel for schedule(dynamic, 1)
+                for (size_t i = batch_start; i < batch_end; i++) {
+                    auto& region = regions[i];
+                    Graph graph;
+                    xindex.get_path_range(region.seq, region.start, region.end, graph);
+                    if (context_size > 0) {
+                        xindex.expand_context(graph, context_size, true, !use_length);
+                    }
+                    VG vgg; vgg.extend(graph); // removes dupes
+                    vgg.paths.sort_by_mapping_rank();
+                    
+                    if (region_out_prefix.empty()) {
+                        stringstream out;
+                        vgg.serialize_to_ostream(out);
+                        serialized[i - batch_start] = out.str();
+                    } else {
+                        ofstream out(region_file_name(i));
+                        vgg.serialize_to_ostream(out);
+                    }
+                }
+                for (size_t i = batch_start; i < batch_end; i++) {
+                    if (region_out_prefix.empty()) {
+                        cout << serialized[i - batch_start];
+                    } else {
+                        cout << regions[i].seq << "\t" << regions[i].start << "\t" << regions[i].end
+                             << "\t" << region_file_name(i) << "\n";
+                    }
+                }
+            }
+            cout.flush();
+        }
         if (!range.empty()) {
             Graph graph;
             int64_t id_start=0, id_end=0;
@@ -12,6 +12,9 @@
 
 #include "../alignment.hpp"
 #include "../vg.hpp"
+#include "../gamsorter.hpp"
+#include "../stream.hpp"
+#include "../utility.hpp"
 
 using namespace std;
 using namespace vg;
@@ -24,6 +27,8 @@ void help_gamcompare(char** argv) {
          << "    -r, --range N            distance within which to consider reads correct" << endl
          << "    -T, --tsv                output TSV (correct, mq, aligner, read) comaptible with plot-qq.R instead of GAM" << endl
          << "    -a, --aligner            aligner name for TSV output [\"vg\"]" << endl
+         << "    -s, --sort-join          sort both inputs by read name on disk and join them, instead of" << endl
+         << "                             holding the truth in memory (output is in read name order)" << endl
          << "    -t, --threads N          number of threads to use" << endl;
 }
 
@@ -38,6 +43,7 @@ int main_gamcompare(int argc, char** argv) {
     int64_t range = -1;
     bool output_tsv = false;
     string aligner_name = "vg";
+    bool sort_join = false;
 
     int c;
     optind = 2;
@@ -48,12 +54,13 @@ int main_gamcompare(int argc, char** argv) {
             {"range", required_argument, 0, 'r'},
             {"tsv", no_argument, 0, 'T'},
             {"aligner", required_argument, 0, 'a'},
+            {"sort-join", no_argument, 0, 's'},
             {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hr:Ta:t:",
+        c = getopt_long (argc, argv, "hr:Ta:st:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -74,6 +81,10 @@ int main_gamcompare(int argc, char** argv) {
             aligner_name = optarg;
             break;
 
+        case 's':
+            sort_join = true;
+            break;
+
         case 't':
             threads = atoi(optarg);
             omp_set_num_threads(threads);
@@ -93,21 +104,6 @@ int main_gamcompare(int argc, char** argv) {
     string test_file_name = get_input_file_name(optind, argc, argv);
     string truth_file_name = get_input_file_name(optind, argc, argv);
 
-    // We will collect all the truth positions
-    string_hash_map<string, map<string ,vector<pair<size_t, bool> > > > true_positions;
-    function<void(Alignment&)> record_truth = [&true_positions](Alignment& aln) {
-        auto val = alignment_refpos_to_path_offsets(aln);
-#pragma omp critical (truth_table)
-        true_positions[aln.name()] = val;
-    };
-    if (truth_file_name == "-") {
-        assert(test_file_name != "-");
-        stream::for_each_parallel(std::cin, record_truth);
-    } else {
-        ifstream truth_file_in(truth_file_name);
-        stream::for_each_parallel(truth_file_in, record_truth);
-    }
-
     // We have a buffer for annotated alignments
     vector<Alignment> buf;
     
@@ -139,19 +135,108 @@ int main_gamcompare(int argc, char** argv) {
         buf.clear();
     };
     
-    // This function annotates every read with distance and correctness, and batch-outputs them.
-    function<void(Alignment&)> annotate_test = [&buf,&flush_buffer,&true_positions,&range](Alignment& aln) {
-        auto f = true_positions.find(aln.name());
-        if (f != true_positions.end()) {
-            auto& true_position = f->second;
-            alignment_set_distance_to_correct(aln, true_position);
+    // Annotate a read with its distance from where it should be, and its
+    // correctness
+    auto annotate = [&range](Alignment& aln, const map<string, vector<pair<size_t, bool>>>& true_position) {
+        alignment_set_distance_to_correct(aln, true_position);
+        
+        if (range != -1) {
+            // We are flagging reads correct/incorrect.
+            // It is correct if there is a path for its minimum distance and it is in range on that path.
+            aln.set_correctly_mapped(aln.to_correct().name() != "" && aln.to_correct().offset() <= range);
+        }
+    };
+
+    if (sort_join) {
+        // Sort each input by read name into a temp file, in bounded memory
+        auto sort_by_name = [](const string& file_name) {
+            GAMSorter sorter;
+            sorter.by_name = true;
+            string sorted_name = temp_file::create("gamcompare");
+            ofstream sorted_out(sorted_name);
+            if (!sorted_out) {
+                cerr << "error:[vg gamcompare] could not open temp file " << sorted_name << endl;
+                exit(1);
+            }
+            get_input_file(file_name, [&](istream& in) {
+                sorter.stream_sort(in, sorted_out);
+            });
+            return sorted_name;
+        };
+        string sorted_test = sort_by_name(test_file_name);
+        string sorted_truth = sort_by_name(truth_file_name);
+        
+        ifstream test_in(sorted_test);
+        ifstream truth_in(sorted_truth);
+        stream::ProtobufIterator<Alignment> test_iter(test_in);
+        stream::ProtobufIterator<Alignment> truth_iter(truth_in);
+        
+        // Pair up a batch of test reads with their truth reads by walking
+        // both sorted files together, then annotate the batch in parallel.
+        size_t batch_size = 1024 * get_thread_count();
+        vector<Alignment> batch;
+        vector<Alignment> batch_truth;
+        vector<bool> has_truth;
+        while (test_iter.has_next()) {
+            batch.clear();
+            batch_truth.clear();
+            has_truth.clear();
+            while (batch.size() < batch_size && test_iter.has_next()) {
+                batch.push_back(*test_iter);
+                test_iter.get_next();
+                const string& name = batch.back().name();
+                while (truth_iter.has_next() && (*truth_iter).name() < name) {
+                    truth_iter.get_next();
+                }
+                // Leave the truth read where it is, in case the next test
+                // read has the same name.
+                has_truth.push_back(truth_iter.has_next() && (*truth_iter).name() == name);
+                batch_truth.push_back(has_truth.back() ? *truth_iter : Alignment());
+            }
             
-            if (range != -1) {
-                // We are flagging reads correct/incorrect.
-                // It is correct if there is a path for its minimum distance and it is in range on that path.
-                aln.set_correctly_mapped(aln.to_correct().name() != "" && aln.to_correct().offset() <= range);
+#pragma omp parallel for schedule(dynamic, 64)
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (has_truth[i]) {
+                    annotate(batch[i], alignment_refpos_to_path_offsets(batch_truth[i]));
+                }
             }
             
+            for (auto& aln : batch) {
+                buf.push_back(aln);
+                if (buf.size() > 1000) {
+                    flush_buffer();
+                }
+            }
+        }
+        
+        temp_file::remove(sorted_test);
+        temp_file::remove(sorted_truth);
+        
+        flush_buffer();
+        cout.flush();
+        return 0;
+    }
+
+    // We will collect all the truth positions
+    string_hash_map<string, map<string ,vector<pair<size_t, bool> > > > true_positions;
+    function<void(Alignment&)> record_truth = [&true_positions](Alignment& aln) {
+        auto val = alignment_refpos_to_path_offsets(aln);
+#pragma omp critical (truth_table)
+        true_positions[aln.name()] = val;
+    };
+    if (truth_file_name == "-") {
+        assert(test_file_name != "-");
+        stream::for_each_parallel(std::cin, record_truth);
+    } else {
+        ifstream truth_file_in(truth_file_name);
+        stream::for_each_parallel(truth_file_in, record_truth);
+    }
+
+    // This function annotates every read with distance and correctness, and batch-outputs them.
+    function<void(Alignment&)> annotate_test = [&buf,&flush_buffer,&true_positions,&annotate](Alignment& aln) {
+        auto f = true_positions.find(aln.name());
+        if (f != true_positions.end()) {
+            annotate(aln, f->second);
         }
 #pragma omp critical (buf)
         {
@@ -1,6 +1,7 @@
 #include "gamsorter.hpp"
 #include "stream.hpp"
 #include <getopt.h>
+#include <omp.h>
 #include "subcommand.hpp"
 #include "index.hpp"
 #include "stream.hpp"
@@ -19,8 +20,11 @@ void help_gamsort(char **argv)
          << "Options:" << endl
          << "  -p / --paired           Index a paired-end GAM." << endl
          << "  -s / --sorted           Input GAM is already sorted." << endl
-         << "  -i / --index <INDEX>    produce a node-to-alignment index" << endl
+         << "  -i / --index            write a node ID range index of the sorted GAM to <gamfile>.sorted.gam.gai" << endl
          << "  -d / --dumb-sort        use naive sorting algorithm (no tmp files, faster for small GAMs)" << endl
+         << "  -m / --max-memory INT   hold about INT MB of alignments in memory when sorting with tmp files [1024]" << endl
+         << "  -f / --fan-in INT       merge at most INT tmp files at once [64]" << endl
+         << "  -t / --threads INT      number of threads to use" << endl
          << "  -r / --rocks            Just use the old RocksDB-style indexing scheme for sorting." << endl
          << "  -a / --aln-index        Create the old RocksDB-style node-to-alignment index." << endl
          << endl;
@@ -35,21 +39,26 @@ int main_gamsort(int argc, char **argv)
     bool is_sorted = false;
     bool just_use_rocks = false;
     bool do_aln_index = false;
+    size_t max_memory_mb = 1024;
+    size_t max_fan_in = 64;
     int c;
     optind = 2; // force optind past command positional argument
     while (true)
     {
         static struct option long_options[] =
             {
-                {"index", required_argument, 0, 'i'},
+                {"index", no_argument, 0, 'i'},
                 {"dumb-sort", no_argument, 0, 'd'},
                 {"paired", no_argument, 0, 'p'},
                 {"rocks", no_argument, 0, 'r'},
                 {"aln-index", no_argument, 0, 'a'},
                 {"is-sorted", no_argument, 0, 's'},
+                {"max-memory", required_argument, 0, 'm'},
+                {"fan-in", required_argument, 0, 'f'},
+                {"threads", required_argument, 0, 't'},
                 {0, 0, 0, 0}};
         int option_index = 0;
-        c = getopt_long(argc, argv, "idhraps",
+        c = getopt_long(argc, argv, "idhrapsm:f:t:",
                         long_options, &option_index);
 
         // Detect the end of the options.
@@ -76,6 +85,19 @@ int main_gamsort(int argc, char **argv)
         case 'p':
             is_paired = true;
             break;
+        case 'm':
+            max_memory_mb = atoll(optarg);
+            break;
+        case 'f':
+            max_fan_in = atoll(optarg);
+            if (max_fan_in < 2) {
+                cerr << "error:[vg gamsort] fan-in must be at least 2" << endl;
+                exit(1);
+            }
+            break;
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
         case 'h':
         case '?':
         default:
@@ -93,6 +115,8 @@ int main_gamsort(int argc, char **argv)
     gamfile = argv[optind];
 
     GAMSorter gs;
+    gs.max_memory = max_memory_mb * 1024 * 1024;
+    gs.max_fan_in = max_fan_in;
 
     if (just_use_rocks && !do_index)
     {
@@ -161,9 +185,9 @@ int main_gamsort(int argc, char **argv)
     }
     
     else if (do_index){
-        // Write a super simple index file of format
-        // node_d \tab firstAlnLineNumber \tab secondAlnLineNumber ...
-        gs.write_index(gamfile, gamfile + ".gai", false);
+        // Write a binned node ID range index over the BGZF sorted GAM we just
+        // wrote, for vg find -l and vg chunk
+        gs.write_index(gamfile + ".sorted.gam", gamfile + ".sorted.gam.gai", true);
     }
 
     return 1;
@@ -9,11 +9,14 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
 #include "../vg_set.hpp"
+#include "../id_remapper.hpp"
 #include "../algorithms/topological_sort.hpp"
 
 #include <gcsa/support.h>
@@ -32,7 +35,9 @@ void help_ids(char** argv) {
         << "                         by iterating through the supplied graphs and incrementing" << endl
         << "                         their ids to be non-conflicting (modifies original files)" << endl
         << "    -m, --mapping FILE   create an empty node mapping for vg prune" << endl
-        << "    -s, --sort           assign new node IDs in (generalized) topological sort order" << endl;
+        << "    -s, --sort           assign new node IDs in (generalized) topological sort order" << endl
+        << "    -t, --translation FILE  write Translations from old to new nodes to FILE" << endl
+        << "                         (not with -s), for updating alignments" << endl;
 }
 
 int main_ids(int argc, char** argv) {
@@ -48,6 +53,7 @@ int main_ids(int argc, char** argv) {
     int64_t increment = 0;
     int64_t decrement = 0;
     std::string mapping_name;
+    std::string translation_name;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -60,12 +66,13 @@ int main_ids(int argc, char** argv) {
             {"join", no_argument, 0, 'j'},
             {"mapping", required_argument, 0, 'm'},
             {"sort", no_argument, 0, 's'},
+            {"translation", required_argument, 0, 't'},
             {"help", no_argument, 0, 'h'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hci:d:jm:s",
+        c = getopt_long (argc, argv, "hci:d:jm:st:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -98,6 +105,10 @@ int main_ids(int argc, char** argv) {
                 sort = true;
                 break;
 
+            case 't':
+                translation_name = optarg;
+                break;
+
             case 'h':
             case '?':
                 help_ids(argv);
@@ -109,21 +120,31 @@ int main_ids(int argc, char** argv) {
         }
     }
 
-    if (!join && mapping_name.empty()) {
+    if (sort && !translation_name.empty()) {
+        cerr << "error:[vg ids] translations cannot be written when sorting" << endl;
+        return 1;
+    }
+
+    ofstream translation_out;
+    if (!translation_name.empty()) {
+        translation_out.open(translation_name);
+        if (!translation_out) {
+            cerr << "error:[vg ids] cannot create translation file " << translation_name << endl;
+            return 1;
+        }
+    }
+
+    if (!join && mapping_name.empty() && sort) {
         VG* graph;
         get_input_file(optind, argc, argv, [&](istream& in) {
             graph = new VG(in);
         });
 
-        if (sort) {
-            // Set up the nodes so we go through them in topological order
-            algorithms::sort(graph);
-        }
+        // Set up the nodes so we go through them in topological order
+        algorithms::sort(graph);
 
-        if (compact || sort) {
-            // Compact only, or compact to re-assign IDs after sort
-            graph->compact_ids();
-        }
+        // Compact to re-assign IDs after sort
+        graph->compact_ids();
 
         if (increment != 0) {
             graph->increment_node_ids(increment);
@@ -135,8 +156,34 @@ int main_ids(int argc, char** argv) {
 
         graph->serialize_to_ostream(std::cout);
         delete graph;
-    } else {
+    } else if (!join && mapping_name.empty()) {
+        // Stream the graph through twice instead of loading it
+        IDRemapper remapper;
+        remapper.compact = compact;
+        remapper.increment = increment - decrement;
+
+        string file_name = get_input_file_name(optind, argc, argv);
+        // We can't read standard input twice, so hold on to it.
+        stringstream stdin_buffer;
+        ifstream file_in;
+        istream* in = &stdin_buffer;
+        if (file_name == "-") {
+            stdin_buffer << cin.rdbuf();
+        } else {
+            file_in.open(file_name);
+            if (!file_in) {
+                cerr << "error:[vg ids] could not open " << file_name << endl;
+                return 1;
+            }
+            in = &file_in;
+        }
 
+        remapper.scan(*in);
+        in->clear();
+        in->seekg(0);
+        remapper.rewrite(0, *in, cout, translation_name.empty() ? nullptr : &translation_out);
+        cout.flush();
+    } else {
         vector<string> graph_file_names;
         while (optind < argc) {
             string file_name = get_input_file_name(optind, argc, argv);
@@ -144,7 +191,8 @@ int main_ids(int argc, char** argv) {
         }
 
         VGset graphs(graph_file_names);
-        vg::id_t max_node_id = (join ? graphs.merge_id_space() : graphs.get_max_id());
+        graphs.parallel_files = get_thread_count();
+        vg::id_t max_node_id = (join ? graphs.merge_id_space(translation_name.empty() ? nullptr : &translation_out) : graphs.get_max_id());
         if (!mapping_name.empty()) {
             gcsa::NodeMapping mapping(max_node_id + 1);
             std::ofstream out(mapping_name, std::ios_base::binary);
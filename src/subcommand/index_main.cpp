@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <getopt.h>
 
+#include <limits>
 #include <random>
 #include <string>
 #include <vector>
@@ -16,6 +17,9 @@
 #include "../vg_set.hpp"
 #include "../utility.hpp"
 #include "../region.hpp"
+#include "../genotype_columns.hpp"
+#include "../snarls.hpp"
+#include "../snarl_distance_index.hpp"
 
 #include <gcsa/gcsa.h>
 #include <gcsa/algorithms.h>
@@ -36,9 +40,16 @@ void help_index(char** argv) {
          << "    -p, --progress         show progress" << endl
          << "xg options:" << endl
          << "    -x, --xg-name FILE     use this file to store a succinct, queryable version of the graph(s)" << endl
+         << "                           (graphs ending in .gfa are read as blunt GFA, straight into the index)" << endl
          << "    -F, --thread-db FILE   read thread database from FILE (may repeat)" << endl
+         << "    -O, --node-order NAME  lay out node ranks in NAME order: id (default), path (along the embedded" << endl
+         << "                           paths, then breadth-first) or bfs (breadth-first); threads need -G or -H" << endl
+         << "distance index options:" << endl
+         << "    -j, --dist-name FILE   store a snarl tree minimum distance index for the graph(s) in FILE" << endl
+         << "    -s, --snarl-name FILE  build the distance index on the snarls in FILE (default: find them)" << endl
          << "gbwt options:" << endl
          << "    -v, --vcf-phasing FILE generate threads from the haplotypes in the VCF file FILE" << endl
+         << "                           (with -G and more than one thread, index the contigs in parallel and merge them)" << endl
          << "    -T, --store-threads    generate threads from the embedded paths" << endl
          << "    -M, --store-gam FILE   generate threads from the alignments in FILE (many allowed)" << endl
          << "    -G, --gbwt-name FILE   store the threads as GBWT in FILE" << endl
@@ -108,6 +119,206 @@ gbwt::vector_type predecessors(const xg::XG& xg_index, const Path& path) {
     return result;
 }
 
+// The haplotype threads of one VCF contig, indexed on their own so that
+// contigs can be indexed at the same time and merged afterward.
+struct ContigGBWT {
+    gbwt::GBWT index;
+    vector<string> thread_names;
+    // The range of GBWT nodes that the threads visit
+    gbwt::node_type min_node = numeric_limits<gbwt::node_type>::max();
+    gbwt::node_type max_node = 0;
+};
+
+// Parse the phasings in the VCF contig that corresponds to the XG path, and
+// generate the haplotype threads along the path, storing each with its name.
+// The parsed function, if given, is called after parsing and before
+// generating, when the XG index and the alt paths are no longer needed.
+void generate_contig_haplotypes(vcflib::VariantCallFile& variant_file, const xg::XG& xg_index,
+                                const map<string, Path>& alt_paths, size_t path_rank, const string& vcf_contig_name,
+                                const map<string, pair<size_t, size_t>>& regions, pair<size_t, size_t> sample_range,
+                                size_t samples_in_batch, bool force_phasing, const unordered_set<string>& excluded_samples,
+                                bool show_progress, const function<void(const gbwt::vector_type&, const string&)>& store_thread,
+                                const function<void()>& parsed) {
+
+    string path_name = xg_index.path_name(path_rank);
+    if (show_progress) {
+        #pragma omp critical (cerr)
+        cerr << "Processing path " << path_name << " as VCF contig " << vcf_contig_name << endl;
+    }
+
+    // Each contig gets its own random bits, so they don't depend on the
+    // order the contigs are processed in.
+    std::mt19937 rng(0xDEADBEEF + path_rank);
+    std::uniform_int_distribution<std::mt19937::result_type> random_bit(0, 1);
+
+    // Remember the sample names
+    const vector<string>& sample_names = variant_file.sampleNames;
+
+    // Structures to parse the VCF file into.
+    const xg::XGPath& path = xg_index.get_path(path_name);
+    gbwt::VariantPaths variants(path.size());
+    std::vector<gbwt::PhasingInformation> phasings;
+
+    // Add the reference to VariantPaths.
+    for (size_t i = 0; i < path.size(); i++) {
+        variants.appendToReference(gbwt::Node::encode(path.node(i), path.is_reverse(i)));
+    }
+    variants.indexReference();
+
+    // Create a PhasingInformation for each batch.
+    for (size_t batch_start = sample_range.first; batch_start < sample_range.second; batch_start += samples_in_batch) {
+        phasings.emplace_back(batch_start, std::min(samples_in_batch, sample_range.second - batch_start));
+    }
+
+    // Set the VCF region or process the entire contig.
+    if (regions.count(vcf_contig_name)) {
+        auto region = regions.at(vcf_contig_name);
+        if (show_progress) {
+            #pragma omp critical (cerr)
+            cerr << "- Setting region " << region.first << " to " << region.second << " in " << vcf_contig_name << endl;
+        }
+        variant_file.setRegion(vcf_contig_name, region.first, region.second);
+    } else {
+        variant_file.setRegion(vcf_contig_name);
+    }
+
+    // Parse the variants and the phasings.
+    vcflib::Variant var(variant_file);
+    size_t variants_processed = 0;
+    std::vector<bool> was_diploid(sample_range.second, true); // Was the sample diploid at the previous site?
+    GenotypeColumns genotypes;
+    std::string genotype;
+    while (variant_file.is_open() && variant_file.getNextVariant(var) && var.sequenceName == vcf_contig_name) {
+        // Skip variants with non-DNA sequence, as they are not included in the graph.
+        bool isDNA = allATGC(var.ref);
+        for (vector<string>::iterator a = var.alt.begin(); a != var.alt.end(); ++a) {
+             if (!allATGC(*a)) isDNA = false;
+        }
+        if (!isDNA) {
+            continue;
+        }
+
+        // Determine the reference nodes for the current variant and create a variant site.
+        // If the variant is not an insertion, there should be a path for the ref allele.
+        var.position--; // Use a 0-based position to get the correct var_name.
+        std::string var_name = make_variant_id(var);
+        std::string ref_path_name = "_alt_" + var_name + "_0";
+        auto ref_path_iter = alt_paths.find(ref_path_name);
+        gbwt::vector_type ref_path;
+        size_t ref_pos = variants.invalid_position();
+        if (ref_path_iter != alt_paths.end() && ref_path_iter->second.mapping_size() != 0) {
+            ref_path = path_to_gbwt(ref_path_iter->second);
+            ref_pos = variants.firstOccurrence(ref_path.front());
+            if (ref_pos == variants.invalid_position()) {
+                #pragma omp critical (cerr)
+                cerr << "warning: [vg index] Invalid ref path for " << var_name << " at "
+                     << var.sequenceName << ":" << var.position << endl;
+                continue;
+            }
+        } else { // Try using alt paths instead.
+            bool found = false;
+            for (size_t alt_index = 1; alt_index < var.alleles.size(); alt_index++) {
+                std::string alt_path_name = "_alt_" + var_name + "_" + to_string(alt_index);
+                auto alt_path_iter = alt_paths.find(alt_path_name);
+                if (alt_path_iter != alt_paths.end()) {
+                    gbwt::vector_type pred_nodes = predecessors(xg_index, alt_path_iter->second);
+                    for (auto node : pred_nodes) {
+                        size_t pred_pos = variants.firstOccurrence(node);
+                        if (pred_pos != variants.invalid_position()) {
+                            ref_pos = pred_pos + 1;
+                            found = true;
+                            break;
+                        }
+                    }
+                    if (found) {
+                        break;
+                    }
+                }
+            }
+            if (!found) {
+                #pragma omp critical (cerr)
+                cerr << "warning: [vg index] Alt and ref paths for " << var_name
+                     << " at " << var.sequenceName << ":" << var.position
+                     << " missing/empty! Was the variant skipped during construction?" << endl;
+                continue;
+            }
+        }
+        variants.addSite(ref_pos, ref_pos + ref_path.size());
+
+        // Add alternate alleles to the site.
+        for (size_t alt_index = 1; alt_index < var.alleles.size(); alt_index++) {
+            std::string alt_path_name = "_alt_" + var_name + "_" + to_string(alt_index);
+            auto alt_path_iter = alt_paths.find(alt_path_name);
+            if (alt_path_iter != alt_paths.end()) {
+                variants.addAllele(path_to_gbwt(alt_path_iter->second));
+            } else {
+                variants.addAllele(ref_path);
+            }
+        }
+
+        // Store the phasings in PhasingInformation structures.
+        // vcflib keeps the line it just parsed.
+        genotypes.index(variant_file.line);
+        for (size_t batch = 0; batch < phasings.size(); batch++) {
+            std::vector<gbwt::Phasing> current_phasings;
+            for (size_t sample = phasings[batch].offset(); sample < phasings[batch].limit(); sample++) {
+                genotypes.get(sample, genotype);
+                current_phasings.emplace_back(genotype, was_diploid[sample]);
+                was_diploid[sample] = current_phasings.back().diploid;
+                if(force_phasing) {
+                    current_phasings.back().forcePhased([&]() {
+                       return random_bit(rng);
+                    });
+                }
+            }
+            phasings[batch].append(current_phasings);
+        }
+        variants_processed++;
+    } // End of variants.
+    if (show_progress) {
+        size_t phasing_bytes = 0;
+        for (size_t batch = 0; batch < phasings.size(); batch++) {
+            phasing_bytes += phasings[batch].bytes();
+        }
+        #pragma omp critical (cerr)
+        {
+            cerr << "- Parsed " << variants_processed << " variants in " << vcf_contig_name << endl;
+            cerr << "- Phasing information: " << gbwt::inMegabytes(phasing_bytes) << " MB" << endl;
+        }
+    }
+
+    // Save memory:
+    // - Let the caller delete what it no longer needs.
+    // - Close the phasings files.
+    if (parsed) {
+        parsed();
+    }
+    for (size_t batch = 0; batch < phasings.size(); batch++) {
+        phasings[batch].close();
+    }
+
+    // Generate the haplotypes.
+    for (size_t batch = 0; batch < phasings.size(); batch++) {
+        gbwt::generateHaplotypes(variants, phasings[batch],
+            [&](gbwt::size_type sample) -> bool {
+                return (excluded_samples.find(sample_names[sample]) == excluded_samples.end());
+            },
+            [&](const gbwt::Haplotype& haplotype) {
+                stringstream sn;
+                sn  << "_thread_" << sample_names[haplotype.sample]
+                    << "_" << path_name
+                    << "_" << haplotype.phase
+                    << "_" << haplotype.count;
+                store_thread(haplotype.path, sn.str());
+            });
+        if (show_progress) {
+            #pragma omp critical (cerr)
+            cerr << "- Processed samples " << phasings[batch].offset() << " to " << (phasings[batch].offset() + phasings[batch].size() - 1)
+                 << " in " << vcf_contig_name << endl;
+        }
+    }
+}
+
 // Thread database files written by vg index -G and read by vg index -x.
 // These should probably be in thread_database.cpp or something like that.
 void write_thread_db(const std::string& filename, const std::vector<std::string>& thread_names, size_t haplotype_count);
@@ -129,11 +340,17 @@ int main_index(int argc, char** argv) {
     vector<string> dbg_names;
 
     // Files we should write.
-    string xg_name, gbwt_name, threads_name, gcsa_name, rocksdb_name;
+    string xg_name, gbwt_name, threads_name, gcsa_name, rocksdb_name, dist_name;
 
     // General
     bool show_progress = false;
 
+    // XG
+    xg::XG::NodeOrder node_order = xg::XG::ID_ORDER;
+
+    // Distance index
+    string snarl_name;
+
     // GBWT
     bool index_haplotypes = false, index_paths = false, index_gam = false;
     vector<string> gam_file_names;
@@ -172,6 +389,11 @@ int main_index(int argc, char** argv) {
             // XG
             {"xg-name", required_argument, 0, 'x'},
             {"thread-db", required_argument, 0, 'F'},
+            {"node-order", required_argument, 0, 'O'},
+
+            // Distance index
+            {"dist-name", required_argument, 0, 'j'},
+            {"snarl-name", required_argument, 0, 's'},
 
             // GBWT
             {"vcf-phasing", required_argument, 0, 'v'},
@@ -207,7 +429,7 @@ int main_index(int argc, char** argv) {
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "b:t:px:F:v:TG:H:PB:R:r:I:E:g:i:f:k:X:Z:Vd:maANDP:CM:h",
+        c = getopt_long (argc, argv, "b:t:px:F:O:j:s:v:TG:H:PB:R:r:I:E:g:i:f:k:X:Z:Vd:maANDP:CM:h",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -235,6 +457,27 @@ int main_index(int argc, char** argv) {
         case 'F':
             thread_db_names.push_back(optarg);
             break;
+        case 'O':
+            if (string(optarg) == "id") {
+                node_order = xg::XG::ID_ORDER;
+            } else if (string(optarg) == "path") {
+                node_order = xg::XG::PATH_ORDER;
+            } else if (string(optarg) == "bfs") {
+                node_order = xg::XG::BFS_ORDER;
+            } else {
+                cerr << "error: [vg index] unknown node order " << optarg << "; use id, path or bfs" << endl;
+                return 1;
+            }
+            break;
+
+        // Distance index
+        case 'j':
+            build_xg = true;
+            dist_name = optarg;
+            break;
+        case 's':
+            snarl_name = optarg;
+            break;
 
         // GBWT
         case 'v':
@@ -379,16 +622,29 @@ int main_index(int argc, char** argv) {
         file_names.push_back(file_name);
     }
 
-    if (xg_name.empty() && gbwt_name.empty() && threads_name.empty() && gcsa_name.empty() && rocksdb_name.empty()) {
+    if (xg_name.empty() && dist_name.empty() && gbwt_name.empty() && threads_name.empty() && gcsa_name.empty() && rocksdb_name.empty()) {
         cerr << "error: [vg index] index type not specified" << endl;
         return 1;
     }
 
+    for (auto& file_name : file_names) {
+        if (VGset::is_gfa(file_name) && (build_gcsa || build_rocksdb)) {
+            cerr << "error: [vg index] GFA input can only be used to build an xg index; "
+                 << "convert " << file_name << " with vg view -Fv first" << endl;
+            return 1;
+        }
+    }
+
     if ((build_gbwt || write_threads) && !(index_haplotypes || index_paths || index_gam)) {
         cerr << "error: [vg index] cannot build GBWT without threads" << endl;
         return 1;
     }
 
+    if (node_order != xg::XG::ID_ORDER && (index_haplotypes || index_paths || index_gam) && !build_gbwt && !write_threads) {
+        cerr << "error: [vg index] threads stored in the xg index need the id node order; use -G or -H with -O" << endl;
+        return 1;
+    }
+
     if (file_names.size() <= 0 && dbg_names.empty()){
         //cerr << "No graph provided for indexing. Please provide a .vg file or GCSA2-format deBruijn graph to index." << endl;
         //return 1;
@@ -399,6 +655,11 @@ int main_index(int argc, char** argv) {
         return 1;
     }
 
+    if (!snarl_name.empty() && dist_name.empty()) {
+        cerr << "error: [vg index] snarls are only used to build a distance index; use -s with -j" << endl;
+        return 1;
+    }
+
     if ((build_gbwt || write_threads) && thread_db_names.size() > 1) {
         cerr << "error: [vg index] cannot use multiple thread database files with -G or -H" << endl;
         return 1;
@@ -414,10 +675,12 @@ int main_index(int argc, char** argv) {
             return 1;
         }
         VGset graphs(file_names);
+        graphs.parallel_files = get_thread_count();
         build_gpbwt = !build_gbwt & !write_threads;
+        xg_index->set_node_order(node_order);
         graphs.to_xg(*xg_index, index_paths & build_gpbwt, Paths::is_alt, index_haplotypes ? &alt_paths : nullptr);
         if (show_progress) {
-            cerr << "Built base XG index" << endl;
+            cerr << "Built base XG index (peak memory usage " << get_peak_rss_bytes() / (1024 * 1024) << " MB)" << endl;
         }
     }
 
@@ -465,6 +728,7 @@ int main_index(int argc, char** argv) {
 
         // Do we build GBWT?
         gbwt::GBWTBuilder* gbwt_builder = 0;
+        vector<ContigGBWT> contig_gbwts; // Contigs indexed in parallel, to merge into the GBWT.
         if (build_gbwt) {
             if (show_progress) { cerr << "Building GBWT index" << endl; }
             gbwt::Verbosity::set(gbwt::Verbosity::SILENT);  // Make the construction thread silent.
@@ -503,11 +767,11 @@ int main_index(int argc, char** argv) {
             }
             for (size_t path_rank = 1; path_rank <= xg_index->max_path_rank(); path_rank++) {
                 const xg::XGPath& path = xg_index->get_path(xg_index->path_name(path_rank));
-                if (path.ids.size() == 0) {
+                if (path.size() == 0) {
                     continue;
                 }
-                gbwt::vector_type buffer(path.ids.size());
-                for (size_t i = 0; i < path.ids.size(); i++) {
+                gbwt::vector_type buffer(path.size());
+                for (size_t i = 0; i < path.size(); i++) {
                     buffer[i] = gbwt::Node::encode(path.node(i), path.is_reverse(i));
                 }
                 store_thread(buffer, xg_index->path_name(path_rank));
@@ -544,8 +808,9 @@ int main_index(int argc, char** argv) {
             } else if (show_progress) {
                 cerr << "Opened variant file " << vcf_name << endl;
             }
-            std::mt19937 rng(0xDEADBEEF);
-            std::uniform_int_distribution<std::mt19937::result_type> random_bit(0, 1);
+            // We find the genotypes in the raw lines ourselves, which is much
+            // faster than having vcflib parse every sample column.
+            variant_file.parseSamples = false;
 
             // How many samples are there?
             size_t num_samples = variant_file.sampleNames.size();
@@ -554,9 +819,6 @@ int main_index(int argc, char** argv) {
                 return 1;
             }
 
-            // Remember the sample names
-            const vector<string>& sample_names = variant_file.sampleNames;
-
             // Determine the range of samples.
             sample_range.second = std::min(sample_range.second, num_samples);
             haplotype_count += 2 * (sample_range.second - sample_range.first);  // Assuming a diploid genome
@@ -566,170 +828,84 @@ int main_index(int argc, char** argv) {
 
             // Process each VCF contig corresponding to an XG path.
             size_t max_path_rank = xg_index->max_path_rank();
-            for (size_t path_rank = 1; path_rank <= max_path_rank; path_rank++) {
+            auto vcf_contig_name = [&](size_t path_rank) {
                 string path_name = xg_index->path_name(path_rank);
-                string vcf_contig_name = path_to_vcf.count(path_name) ? path_to_vcf[path_name] : path_name;
-                if (show_progress) {
-                    cerr << "Processing path " << path_name << " as VCF contig " << vcf_contig_name << endl;
-                }
-
-                // Structures to parse the VCF file into.
-                const xg::XGPath& path = xg_index->get_path(path_name);
-                gbwt::VariantPaths variants(path.ids.size());
-                std::vector<gbwt::PhasingInformation> phasings;
-
-                // Add the reference to VariantPaths.
-                for (size_t i = 0; i < path.ids.size(); i++) {
-                    variants.appendToReference(gbwt::Node::encode(path.node(i), path.is_reverse(i)));
-                }
-                variants.indexReference();
+                return path_to_vcf.count(path_name) ? path_to_vcf[path_name] : path_name;
+            };
 
-                // Create a PhasingInformation for each batch.
-                for (size_t batch_start = sample_range.first; batch_start < sample_range.second; batch_start += samples_in_batch) {
-                    phasings.emplace_back(batch_start, std::min(samples_in_batch, sample_range.second - batch_start));
+            int thread_count = omp_get_max_threads();
+            if (build_gbwt && !write_threads && !build_gpbwt && thread_count > 1 && max_path_rank > 1) {
+                // Index the contigs in parallel, each with its own VCF reader
+                // and GBWT builder, and merge them at the end. Each builder
+                // inserts on a thread of its own, so generating and inserting
+                // the haplotypes overlap. Split the insertion buffer between
+                // the builders so we don't use more memory for it.
+                if (show_progress) {
+                    cerr << "Indexing up to " << thread_count << " contigs at a time" << endl;
                 }
-
-                // Set the VCF region or process the entire contig.
-                if (regions.count(vcf_contig_name)) {
-                    auto region = regions[vcf_contig_name];
-                    if (show_progress) {
-                        cerr << "- Setting region " << region.first << " to " << region.second << endl;
-                    }
-                    variant_file.setRegion(vcf_contig_name, region.first, region.second);
-                } else {
-                    variant_file.setRegion(vcf_contig_name);
+                contig_gbwts.resize(max_path_rank);
+                gbwt::size_type buffer_size = std::max<gbwt::size_type>(gbwt::MILLION,
+                                                                        gbwt::DynamicGBWT::INSERT_BATCH_SIZE / thread_count);
+                vector<string> contig_names;
+                for (size_t path_rank = 1; path_rank <= max_path_rank; path_rank++) {
+                    contig_names.push_back(vcf_contig_name(path_rank));
                 }
 
-                // Parse the variants and the phasings.
-                vcflib::Variant var(variant_file);
-                size_t variants_processed = 0;
-                std::vector<bool> was_diploid(sample_range.second, true); // Was the sample diploid at the previous site?
-                while (variant_file.is_open() && variant_file.getNextVariant(var) && var.sequenceName == vcf_contig_name) {
-                    // Skip variants with non-DNA sequence, as they are not included in the graph.
-                    bool isDNA = allATGC(var.ref);
-                    for (vector<string>::iterator a = var.alt.begin(); a != var.alt.end(); ++a) {
-                         if (!allATGC(*a)) isDNA = false;
-                    }
-                    if (!isDNA) {
-                        continue;
-                    }
-
-                    // Determine the reference nodes for the current variant and create a variant site.
-                    // If the variant is not an insertion, there should be a path for the ref allele.
-                    var.position--; // Use a 0-based position to get the correct var_name.
-                    std::string var_name = make_variant_id(var);
-                    std::string ref_path_name = "_alt_" + var_name + "_0";
-                    auto ref_path_iter = alt_paths.find(ref_path_name);
-                    gbwt::vector_type ref_path;
-                    size_t ref_pos = variants.invalid_position();
-                    if (ref_path_iter != alt_paths.end() && ref_path_iter->second.mapping_size() != 0) {
-                        ref_path = path_to_gbwt(ref_path_iter->second);
-                        ref_pos = variants.firstOccurrence(ref_path.front());
-                        if (ref_pos == variants.invalid_position()) {
-                            cerr << "warning: [vg index] Invalid ref path for " << var_name << " at "
-                                 << var.sequenceName << ":" << var.position << endl;
-                            continue;
-                        }
-                    } else { // Try using alt paths instead.
-                        bool found = false;
-                        for (size_t alt_index = 1; alt_index < var.alleles.size(); alt_index++) {
-                            std::string alt_path_name = "_alt_" + var_name + "_" + to_string(alt_index);
-                            auto alt_path_iter = alt_paths.find(alt_path_name);
-                            if (alt_path_iter != alt_paths.end()) {
-                                gbwt::vector_type pred_nodes = predecessors(*xg_index, alt_path_iter->second);
-                                for (auto node : pred_nodes) {
-                                    size_t pred_pos = variants.firstOccurrence(node);
-                                    if (pred_pos != variants.invalid_position()) {
-                                        ref_pos = pred_pos + 1;
-                                        found = true;
-                                        break;
-                                    }
-                                }
-                                if (found) {
-                                    break;
-                                }
-                            }
-                        }
-                        if (!found) {
-                            cerr << "warning: [vg index] Alt and ref paths for " << var_name
-                                 << " at " << var.sequenceName << ":" << var.position
-                                 << " missing/empty! Was the variant skipped during construction?" << endl;
-                            continue;
-                        }
-                    }
-                    variants.addSite(ref_pos, ref_pos + ref_path.size());
-
-                    // Add alternate alleles to the site.
-                    for (size_t alt_index = 1; alt_index < var.alleles.size(); alt_index++) {
-                        std::string alt_path_name = "_alt_" + var_name + "_" + to_string(alt_index);
-                        auto alt_path_iter = alt_paths.find(alt_path_name);
-                        if (alt_path_iter != alt_paths.end()) {
-                            variants.addAllele(path_to_gbwt(alt_path_iter->second));
-                        } else {
-                            variants.addAllele(ref_path);
-                        }
+                #pragma omp parallel for schedule(dynamic, 1)
+                for (size_t path_rank = 1; path_rank <= max_path_rank; path_rank++) {
+                    vcflib::VariantCallFile contig_file;
+                    contig_file.open(vcf_name);
+                    if (!contig_file.is_open()) {
+                        #pragma omp critical (cerr)
+                        cerr << "error: [vg index] could not open " << vcf_name << endl;
+                        exit(1);
                     }
-
-                    // Store the phasings in PhasingInformation structures.
-                    for (size_t batch = 0; batch < phasings.size(); batch++) {
-                        std::vector<gbwt::Phasing> current_phasings;
-                        for (size_t sample = phasings[batch].offset(); sample < phasings[batch].limit(); sample++) {
-                            string& sample_name = variant_file.sampleNames[sample];
-                            current_phasings.emplace_back(var.getGenotype(sample_name), was_diploid[sample]);
-                            was_diploid[sample] = current_phasings.back().diploid;
-                            if(force_phasing) {
-                                current_phasings.back().forcePhased([&]() {
-                                   return random_bit(rng);
-                                });
-                            }
+                    contig_file.parseSamples = false;
+
+                    ContigGBWT& contig = contig_gbwts[path_rank - 1];
+                    gbwt::GBWTBuilder builder(id_width, buffer_size);
+                    generate_contig_haplotypes(contig_file, *xg_index, alt_paths, path_rank, contig_names[path_rank - 1],
+                                               regions, sample_range, samples_in_batch, force_phasing, excluded_samples,
+                                               show_progress, [&](const gbwt::vector_type& to_save, const std::string& thread_name) {
+                        builder.insert(to_save, true); // Insert in both orientations.
+                        contig.thread_names.push_back(thread_name);
+                        for (auto node : to_save) {
+                            contig.min_node = std::min(contig.min_node, std::min(node, gbwt::Node::reverse(node)));
+                            contig.max_node = std::max(contig.max_node, std::max(node, gbwt::Node::reverse(node)));
                         }
-                        phasings[batch].append(current_phasings);
-                    }
-                    variants_processed++;
-                } // End of variants.
-                if (show_progress) {
-                    cerr << "- Parsed " << variants_processed << " variants" << endl;
-                    size_t phasing_bytes = 0;
-                    for (size_t batch = 0; batch < phasings.size(); batch++) {
-                        phasing_bytes += phasings[batch].bytes();
-                    }
-                    cerr << "- Phasing information: " << gbwt::inMegabytes(phasing_bytes) << " MB" << endl;
+                    }, nullptr);
+                    builder.finish();
+                    contig.index = gbwt::GBWT(builder.index);
                 }
 
-                // Save memory:
-                // - Delete the alt paths if we no longer need them.
-                // - Delete the XG index if we no longer need it.
-                // - Close the phasings files.
-                if (path_rank == max_path_rank) {
-                    alt_paths.clear();
-                    if (xg_name.empty()) {
-                        delete xg_index;
-                        xg_index = nullptr;
-                    }
-                }
-                for (size_t batch = 0; batch < phasings.size(); batch++) {
-                    phasings[batch].close();
+                // The merged GBWT has the contigs' threads in path order
+                for (auto& contig : contig_gbwts) {
+                    thread_names.insert(thread_names.end(), contig.thread_names.begin(), contig.thread_names.end());
+                    contig.thread_names.clear();
                 }
 
-                // Generate the haplotypes.
-                for (size_t batch = 0; batch < phasings.size(); batch++) {
-                    gbwt::generateHaplotypes(variants, phasings[batch],
-                        [&](gbwt::size_type sample) -> bool {
-                            return (excluded_samples.find(sample_names[sample]) == excluded_samples.end());
-                        },
-                        [&](const gbwt::Haplotype& haplotype) {
-                            stringstream sn;
-                            sn  << "_thread_" << sample_names[haplotype.sample]
-                                << "_" << path_name
-                                << "_" << haplotype.phase
-                                << "_" << haplotype.count;
-                            store_thread(haplotype.path, sn.str());
-                        });
-                    if (show_progress) {
-                        cerr << "- Processed samples " << phasings[batch].offset() << " to " << (phasings[batch].offset() + phasings[batch].size() - 1) << endl;
-                    }
+                // Save memory
+                alt_paths.clear();
+                if (xg_name.empty() && dist_name.empty()) {
+                    delete xg_index;
+                    xg_index = nullptr;
+                }
+            } else {
+                for (size_t path_rank = 1; path_rank <= max_path_rank; path_rank++) {
+                    generate_contig_haplotypes(variant_file, *xg_index, alt_paths, path_rank, vcf_contig_name(path_rank),
+                                               regions, sample_range, samples_in_batch, force_phasing, excluded_samples,
+                                               show_progress, store_thread, [&]() {
+                        // Delete the alt paths and the XG index if we no longer need them.
+                        if (path_rank == max_path_rank) {
+                            alt_paths.clear();
+                            if (xg_name.empty() && dist_name.empty()) {
+                                delete xg_index;
+                                xg_index = nullptr;
+                            }
+                        }
+                    });
                 }
-            } // End of contig.
+            }
         } // End of haplotypes.
 
         // Store the thread database. Write it to disk if a filename is given,
@@ -738,8 +914,51 @@ int main_index(int argc, char** argv) {
         alt_paths.clear();
         if (build_gbwt) {
             gbwt_builder->finish();
-            if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
-            sdsl::store_to_file(gbwt_builder->index, gbwt_name);
+            if (contig_gbwts.empty()) {
+                if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
+                sdsl::store_to_file(gbwt_builder->index, gbwt_name);
+            } else {
+                // The contigs can be merged quickly if no two of them share
+                // nodes and there are no other threads. Otherwise insert them
+                // into the other threads one at a time.
+                vector<pair<gbwt::node_type, gbwt::node_type>> node_ranges;
+                for (auto& contig : contig_gbwts) {
+                    if (!contig.index.empty()) {
+                        node_ranges.emplace_back(contig.min_node, contig.max_node);
+                    }
+                }
+                std::sort(node_ranges.begin(), node_ranges.end());
+                bool disjoint = gbwt_builder->index.empty();
+                for (size_t i = 1; i < node_ranges.size(); i++) {
+                    disjoint = disjoint && node_ranges[i - 1].second < node_ranges[i].first;
+                }
+
+                if (disjoint) {
+                    if (show_progress) { cerr << "Merging " << node_ranges.size() << " node-disjoint contig GBWTs..." << endl; }
+                    vector<gbwt::GBWT> sources;
+                    for (auto& contig : contig_gbwts) {
+                        if (!contig.index.empty()) {
+                            sources.emplace_back(std::move(contig.index));
+                        }
+                    }
+                    contig_gbwts.clear();
+                    gbwt::GBWT merged(sources);
+                    sources.clear();
+                    if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
+                    sdsl::store_to_file(merged, gbwt_name);
+                } else {
+                    if (show_progress) { cerr << "Merging " << node_ranges.size() << " contig GBWTs by insertion..." << endl; }
+                    for (auto& contig : contig_gbwts) {
+                        if (!contig.index.empty()) {
+                            gbwt_builder->index.merge(contig.index);
+                        }
+                        contig.index = gbwt::GBWT();
+                    }
+                    contig_gbwts.clear();
+                    if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
+                    sdsl::store_to_file(gbwt_builder->index, gbwt_name);
+                }
+            }
             delete gbwt_builder; gbwt_builder = nullptr;
         }
         if (write_threads) {
@@ -788,6 +1007,35 @@ int main_index(int argc, char** argv) {
         xg_index->serialize(db_out);
         db_out.close();
     }
+
+    // Build the distance index on the XG
+    if (!dist_name.empty()) {
+        SnarlManager snarl_manager;
+        if (!snarl_name.empty()) {
+            ifstream snarl_stream(snarl_name);
+            if (!snarl_stream) {
+                cerr << "error: [vg index] cannot open snarls file " << snarl_name << endl;
+                return 1;
+            }
+            snarl_manager = SnarlManager(snarl_stream);
+        } else {
+            if (show_progress) {
+                cerr << "Finding snarls..." << endl;
+            }
+            snarl_manager = IntegratedSnarlFinder(*xg_index).find_snarls();
+        }
+
+        if (show_progress) {
+            cerr << "Building the distance index..." << endl;
+        }
+        SnarlDistanceIndex distance_index(*xg_index, snarl_manager);
+        ofstream dist_out(dist_name, ios_base::out | ios_base::binary);
+        if (!dist_out) {
+            cerr << "error: [vg index] cannot write distance index to " << dist_name << endl;
+            return 1;
+        }
+        distance_index.serialize(dist_out);
+    }
     delete xg_index; xg_index = nullptr;
 
     // Build GCSA
@@ -811,12 +1059,34 @@ int main_index(int argc, char** argv) {
             }
             VGset graphs(file_names);
             graphs.show_progress = show_progress;
+            graphs.parallel_files = get_thread_count();
             size_t kmer_bytes = params.getLimitBytes();
             dbg_names = graphs.write_gcsa_kmers_binary(kmer_size, kmer_bytes);
             params.reduceLimit(kmer_bytes);
             delete_kmer_files = true;
         }
 
+        // Say up front if construction is going to run out of disk, rather
+        // than finding out partway through the doubling steps
+        size_t kmer_file_bytes = 0;
+        for (auto& filename : dbg_names) {
+            ifstream kmer_file(filename, ios::binary | ios::ate);
+            if (kmer_file) {
+                kmer_file_bytes += kmer_file.tellg();
+            }
+        }
+        size_t temp_bytes = estimate_gcsa_temp_bytes(kmer_file_bytes, params.doubling_steps);
+        if (show_progress) {
+            cerr << "Kmer files use " << gcsa::inGigabytes(kmer_file_bytes) << " GB; GCSA2 construction needs at least "
+                 << gcsa::inGigabytes(temp_bytes) << " GB of temporary disk" << endl;
+        }
+        if (temp_bytes > params.getLimitBytes()) {
+            cerr << "warning: [vg index] GCSA2 construction is estimated to need at least "
+                 << gcsa::inGigabytes(temp_bytes) << " GB of temporary disk, but only "
+                 << gcsa::inGigabytes(params.getLimitBytes()) << " GB are allowed; "
+                 << "consider raising -Z or simplifying the graph with vg prune" << endl;
+        }
+
         // Build the index
         if (show_progress) {
             cerr << "Building the GCSA2 index..." << endl;
@@ -870,15 +1140,16 @@ int main_index(int argc, char** argv) {
 
         if (store_node_alignments && file_names.size() > 0) {
             index.open_for_bulk_load(rocksdb_name);
-            int64_t aln_idx = 0;
+            std::atomic<int64_t> aln_idx(0);
             function<void(Alignment&)> lambda = [&index,&aln_idx](Alignment& aln) {
-                index.cross_alignment(aln_idx++, aln);
+                index.stage_cross_alignment(aln_idx++, aln);
             };
             for (auto& file_name : file_names) {
                 get_input_file(file_name, [&](istream& in) {
                     stream::for_each_parallel(in, lambda);
                 });
             }
+            index.ingest_staged();
             index.flush();
             index.close();
         }
@@ -886,13 +1157,14 @@ int main_index(int argc, char** argv) {
         if (store_alignments && file_names.size() > 0) {
             index.open_for_bulk_load(rocksdb_name);
             function<void(Alignment&)> lambda = [&index](Alignment& aln) {
-                index.put_alignment(aln);
+                index.stage_alignment(aln);
             };
             for (auto& file_name : file_names) {
                 get_input_file(file_name, [&](istream& in) {
                     stream::for_each_parallel(in, lambda);
                 });
             }
+            index.ingest_staged();
             index.flush();
             index.close();
         }
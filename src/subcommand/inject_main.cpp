@@ -12,6 +12,8 @@
 
 #include "../alignment.hpp"
 #include "../vg.hpp"
+#include "../stream.hpp"
+#include "../utility.hpp"
 
 using namespace std;
 using namespace vg;
@@ -87,24 +89,22 @@ int main_inject(int argc, char** argv) {
       return 1;
     }
 
-    vector<Alignment> buf;
-    function<void(Alignment&)> lambda = [&buf](Alignment& aln) {
-#pragma omp critical (buf)
-        {
-            buf.push_back(aln);
-            if (buf.size() > 1000) {
-                write_alignments(std::cout, buf);
-                buf.clear();
-            }
-        }
+    // Each thread buffers and compresses its own output, so only the final
+    // copy to standard output is serialized.
+    vector<vector<Alignment> > buffer(get_thread_count());
+    function<void(Alignment&)> lambda = [&buffer](Alignment& aln) {
+        auto& buf = buffer[omp_get_thread_num()];
+        buf.push_back(aln);
+        stream::write_buffered(cout, buf, 1000);
     };
     if (threads > 1) {
         hts_for_each_parallel(file_name, lambda, xgidx);
     } else {
         hts_for_each(file_name, lambda, xgidx);
     }
-    write_alignments(std::cout, buf);
-    buf.clear();
+    for (auto& buf : buffer) {
+        stream::write_buffered(cout, buf, 0); // flush
+    }
     cout.flush();
     return 0;
 }
@@ -9,10 +9,13 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../stream.hpp"
 
 using namespace std;
 using namespace vg;
@@ -62,27 +65,109 @@ int main_join(int argc, char** argv) {
         }
     }
 
-    list<VG*> graphs;
-
+    // We stream the graphs through chunk by chunk, remembering only enough
+    // about the nodes to find the heads at the end, and enough about the
+    // edges and path mappings to drop repeats the way VG::extend does.
+    vector<id_t> node_order;
+    unordered_set<id_t> seen;
+    unordered_set<id_t> has_left_edge;
+    unordered_set<pair<NodeSide, NodeSide>> seen_edges;
+    unordered_map<string, unordered_set<int64_t>> seen_ranks;
+    id_t max_id = 0;
+    
+    vector<Graph> buffer;
     while (optind < argc) {
-        VG* graph;
         get_input_file(optind, argc, argv, [&](istream& in) {
-            graph = new VG(in);
+            function<void(Graph&)> lambda = [&](Graph& chunk) {
+                // Drop nodes we already have, complaining, since the graphs
+                // probably shouldn't share IDs.
+                int kept = 0;
+                for (int i = 0; i < chunk.node_size(); i++) {
+                    id_t id = chunk.node(i).id();
+                    if (!seen.insert(id).second) {
+                        cerr << "[vg join] warning: node ID " << id << " appears multiple times. Skipping." << endl;
+                        continue;
+                    }
+                    node_order.push_back(id);
+                    max_id = max(max_id, id);
+                    if (kept != i) {
+                        chunk.mutable_node()->SwapElements(kept, i);
+                    }
+                    kept++;
+                }
+                while (chunk.node_size() > kept) {
+                    chunk.mutable_node()->RemoveLast();
+                }
+                
+                // Drop edges we already have, in either orientation
+                kept = 0;
+                for (int i = 0; i < chunk.edge_size(); i++) {
+                    const Edge& edge = chunk.edge(i);
+                    if (!seen_edges.insert(NodeSide::pair_from_edge(edge)).second) {
+                        cerr << "[vg join] warning: edge " << edge.from() << (edge.from_start() ? " start" : " end") << " <-> "
+                             << edge.to() << (edge.to_end() ? " end" : " start") << " appears multiple times. Skipping." << endl;
+                        continue;
+                    }
+                    // Remember which nodes have something on their start side
+                    if (edge.from_start()) {
+                        has_left_edge.insert(edge.from());
+                    }
+                    if (!edge.to_end()) {
+                        has_left_edge.insert(edge.to());
+                    }
+                    if (kept != i) {
+                        chunk.mutable_edge()->SwapElements(kept, i);
+                    }
+                    kept++;
+                }
+                while (chunk.edge_size() > kept) {
+                    chunk.mutable_edge()->RemoveLast();
+                }
+                
+                // Drop ranked mappings a path already has. Chunks of the same
+                // path are merged back together when the graph is read.
+                for (auto& path : *chunk.mutable_path()) {
+                    auto& ranks = seen_ranks[path.name()];
+                    auto& mappings = *path.mutable_mapping();
+                    kept = 0;
+                    for (int i = 0; i < mappings.size(); i++) {
+                        if (mappings.Get(i).rank() && !ranks.insert(mappings.Get(i).rank()).second) {
+                            continue;
+                        }
+                        if (kept != i) {
+                            mappings.SwapElements(kept, i);
+                        }
+                        kept++;
+                    }
+                    while (mappings.size() > kept) {
+                        mappings.RemoveLast();
+                    }
+                }
+                
+                buffer.push_back(chunk);
+                stream::write_buffered(cout, buffer, 0);
+            };
+            stream::for_each(in, lambda);
         });
-        graphs.push_back(graph);
     }
 
-    VG joined;
-    for (list<VG*>::iterator g = graphs.begin(); g != graphs.end(); ++g) {
-        // Stick all the graphs together, complaining if they use the same node IDs (since they probably shouldn't).
-        joined.extend(**g, true);
+    // combine all subgraphs by joining a new root node to all the heads
+    Graph root_chunk;
+    Node* root = root_chunk.add_node();
+    root->set_id(max_id + 1);
+    root->set_sequence("N");
+    for (id_t id : node_order) {
+        if (!has_left_edge.count(id)) {
+            Edge* edge = root_chunk.add_edge();
+            edge->set_from(root->id());
+            edge->set_to(id);
+        }
     }
-
-    // combine all subgraphs
-    joined.join_heads();
-
+    
     // output
-    joined.serialize_to_ostream(std::cout);
+    buffer.push_back(root_chunk);
+    stream::write_buffered(cout, buffer, 0);
+    cout.flush();
 
     return 0;
 }
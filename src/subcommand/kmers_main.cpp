@@ -172,6 +172,7 @@ int main_kmers(int argc, char** argv) {
     VGset graphs(graph_file_names);
 
     graphs.show_progress = show_progress;
+    graphs.parallel_files = get_thread_count();
 
     if (gcsa_out) {
         if (edge_max != 0) {
@@ -8,33 +8,44 @@
 #include <unistd.h>
 #include <getopt.h>
 
+#include <algorithm>
+#include <deque>
 #include <iostream>
+#include <memory>
 
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
 #include "../index.hpp"
 #include "../convert.hpp"
+#include "../stream.hpp"
 
 using namespace std;
 using namespace vg;
 using namespace vg::subcommand;
 
+/// How many alignment-locus pairs to collect before matching them in parallel
+const size_t LOCIFY_MATCH_BATCH = 10000;
+
 void help_locify(char** argv){
     cerr << "usage: " << argv[0] << " locify [options] " << endl
          << "    -l, --loci FILE      input loci over which to locify the alignments" << endl
          << "    -a, --aln-idx DIR    use this rocksdb alignment index (from vg index -N)" << endl
+         << "    -G, --sorted-gam FILE  instead of an alignment index, merge-join the loci with this GAM" << endl
+         << "                         sorted by vg gamsort, in one pass" << endl
          << "    -x, --xg-idx FILE    use this xg index" << endl
          << "    -n, --name-alleles   generate names for each allele rather than using full Paths" << endl
          << "    -f, --forwardize     flip alignments on the reverse strand to the forward" << endl
          << "    -s, --sorted-loci FILE  write the non-nested loci out in their sorted order" << endl
          << "    -b, --n-best N       keep only the N-best alleles by alignment support" << endl
-         << "    -o, --out-loci FILE  rewrite the loci with only N-best alleles kept" << endl;
+         << "    -o, --out-loci FILE  rewrite the loci with only N-best alleles kept" << endl
+         << "    -t, --threads N      number of threads to use" << endl;
         // TODO -- add some basic filters that are useful downstream in whatshap
 }
 
 int main_locify(int argc, char** argv){
     string gam_idx_name;
+    string sorted_gam_name;
     string loci_file;
     Index gam_idx;
     string xg_idx_name;
@@ -62,11 +73,13 @@ int main_locify(int argc, char** argv){
             {"sorted-loci", required_argument, 0, 's'},
             {"loci-out", required_argument, 0, 'o'},
             {"n-best", required_argument, 0, 'b'},
+            {"sorted-gam", required_argument, 0, 'G'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hl:x:g:nfo:b:s:",
+        c = getopt_long (argc, argv, "hl:x:g:nfo:b:s:G:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -108,6 +121,14 @@ int main_locify(int argc, char** argv){
             name_alleles = true;
             break;
 
+        case 'G':
+            sorted_gam_name = optarg;
+            break;
+
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'h':
         case '?':
             help_locify(argv);
@@ -119,6 +140,11 @@ int main_locify(int argc, char** argv){
         }
     }
 
+    if (gam_idx_name.empty() == sorted_gam_name.empty()) {
+        cerr << "[vg locify] Error: provide either an alignment index (-g) or a sorted GAM (-G)" << endl;
+        return 1;
+    }
+
     if (!gam_idx_name.empty()) {
         gam_idx.open_read_only(gam_idx_name);
     }
@@ -152,7 +178,8 @@ int main_locify(int argc, char** argv){
     map<string, set<int> > locus_to_keep;
     int count = 0;
 
-    std::function<void(Locus&)> lambda = [&](Locus& l){
+    // Remember which positions a locus covers, and get the nodes it visits in order
+    auto index_locus = [&](const Locus& l) {
         locus_names.push_back(l.name());
         set<vg::id_t> nodes_in_locus;
         for (int i = 0; i < l.allele_size(); ++i) {
@@ -171,64 +198,187 @@ int main_locify(int argc, char** argv){
                 locus_to_pos[l.name()].insert(pos.first);
             }
         }
+        return vector<vg::id_t>(nodes_in_locus.begin(), nodes_in_locus.end());
+    };
+
+    // Find the allele of the locus that the alignment matches best. This only
+    // reads its arguments, so it can be run on many threads at once.
+    auto best_allele = [](const Locus& l, const Alignment& a) {
+        // TODO reverse complementing alleles ?
+        // overlap is stranded
+        //matching
+        // find the most-matching allele
+        map<double, vector<int> > matches;
+        for (int i = 0; i < l.allele_size(); ++i) {
+            auto& allele = l.allele(i);
+            matches[overlap(a.path(), allele)].push_back(i);
+        }
+        assert(l.allele_size());
+        return matches.rbegin()->second.front();
+    };
+
+    // Record that the alignment supports the given allele of the locus
+    auto record_match = [&](const Locus& l, const Alignment& a, int best) {
+        Locus matching;
+        matching.set_name(l.name());
+        if (name_alleles) {
+            //map<string, map<string, int > > locus_allele_names;
+            auto& allele = l.allele(best);
+            string s;
+            allele.SerializeToString(&s);
+            auto& l_names = locus_allele_names[l.name()];
+            auto f = l_names.find(s);
+            int name_int = 0;
+            if (f == l_names.end()) {
+                int next_id = l_names.size() + 1;
+                l_names[s] = next_id;
+                name_int = next_id;
+            } else {
+                name_int = f->second;
+            }
+            string allele_name = vg::convert(name_int);
+            Path p;
+            p.set_name(allele_name);
+            *matching.add_allele() = p;
+            if (n_best) {
+                // record support for this allele
+                // we'll use to filter the locus records later
+                locus_allele_support[l.name()][name_int]++;
+            }
+        } else {
+            *matching.add_allele() = l.allele(best);
+            // TODO get quality score relative to this specific allele / alignment
+            // record in the alignment we'll save
+        }
+        if (alignments_with_loci.find(a.name()) == alignments_with_loci.end()) {
+            alignments_with_loci[a.name()] = a;
+        }
+        Alignment& aln = alignments_with_loci[a.name()];
+        *aln.add_locus() = matching;
+    };
+
+    std::function<void(Locus&)> lambda = [&](Locus& l){
+        vector<vg::id_t> nodes_vec = index_locus(l);
         // void for_alignment_in_range(int64_t id1, int64_t id2, std::function<void(const Alignment&)> lambda);
         std::function<void(const Alignment&)> fill_alns = [&](const Alignment& a){
-            // TODO reverse complementing alleles ?
-            // overlap is stranded
-            //matching
-            // find the most-matching allele
-            map<double, vector<int> > matches;
-            for (int i = 0; i < l.allele_size(); ++i) {
-                auto& allele = l.allele(i);
-                matches[overlap(a.path(), allele)].push_back(i);
+            record_match(l, a, best_allele(l, a));
+        };
+        gam_idx.for_alignment_to_nodes(nodes_vec, fill_alns);
+    };
+
+    // Walk the loci in order of their lowest node, and the sorted GAM along
+    // with them, keeping a window of the alignments that might still reach
+    // the loci to come. Matching alignments to alleles is the expensive part,
+    // so the pairs are collected and matched in parallel in batches.
+    auto merge_join_loci = [&](istream& loci_in, istream& gam_in) {
+        vector<Locus> loci;
+        vector<vector<vg::id_t>> locus_nodes;
+        std::function<void(Locus&)> load_locus = [&](Locus& l) {
+            locus_nodes.push_back(index_locus(l));
+            loci.emplace_back();
+            loci.back().Swap(&l);
+        };
+        stream::for_each(loci_in, load_locus);
+
+        vector<size_t> order;
+        for (size_t i = 0; i < loci.size(); i++) {
+            if (!locus_nodes[i].empty()) {
+                order.push_back(i);
             }
-            assert(l.allele_size());
-            int best = matches.rbegin()->second.front();
-            Locus matching;
-            matching.set_name(l.name());
-            if (name_alleles) {
-                //map<string, map<string, int > > locus_allele_names;
-                auto& allele = l.allele(best);
-                string s;
-                allele.SerializeToString(&s);
-                auto& l_names = locus_allele_names[l.name()];
-                auto f = l_names.find(s);
-                int name_int = 0;
-                if (f == l_names.end()) {
-                    int next_id = l_names.size() + 1;
-                    l_names[s] = next_id;
-                    name_int = next_id;
-                } else {
-                    name_int = f->second;
+        }
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return locus_nodes[a].front() < locus_nodes[b].front();
+        });
+
+        struct WindowAlignment {
+            // the lowest node ID at either end, which is what vg gamsort orders on
+            vg::id_t sort_id;
+            vg::id_t max_id;
+            shared_ptr<const Alignment> aln;
+        };
+        deque<WindowAlignment> window;
+        WindowAlignment next;
+        bool have_next = false;
+        stream::ProtobufIterator<Alignment> gam_iter(gam_in);
+        auto read_next = [&]() {
+            have_next = false;
+            while (gam_iter.has_next() && !have_next) {
+                shared_ptr<Alignment> aln = make_shared<Alignment>(*gam_iter);
+                gam_iter.get_next();
+                auto& path = aln->path();
+                if (path.mapping_size() == 0) {
+                    // unmapped reads can't touch any locus
+                    continue;
                 }
-                string allele_name = vg::convert(name_int);
-                Path p;
-                p.set_name(allele_name);
-                *matching.add_allele() = p;
-                if (n_best) {
-                    // record support for this allele
-                    // we'll use to filter the locus records later
-                    locus_allele_support[l.name()][name_int]++;
+                vg::id_t sort_id = min(path.mapping(0).position().node_id(),
+                                       path.mapping(path.mapping_size() - 1).position().node_id());
+                if (sort_id < next.sort_id) {
+                    cerr << "[vg locify] Error: GAM is not sorted; sort it with vg gamsort" << endl;
+                    exit(1);
                 }
-            } else {
-                *matching.add_allele() = l.allele(best);
-                // TODO get quality score relative to this specific allele / alignment
-                // record in the alignment we'll save
+                next.sort_id = sort_id;
+                next.max_id = 0;
+                for (auto& mapping : path.mapping()) {
+                    next.max_id = max<vg::id_t>(next.max_id, mapping.position().node_id());
+                }
+                next.aln = aln;
+                have_next = true;
+            }
+        };
+        next.sort_id = 0;
+        read_next();
+
+        vector<pair<size_t, shared_ptr<const Alignment>>> pairs;
+        auto match_pairs = [&]() {
+            vector<int> best(pairs.size());
+#pragma omp parallel for schedule(dynamic, 64)
+            for (size_t i = 0; i < pairs.size(); i++) {
+                best[i] = best_allele(loci[pairs[i].first], *pairs[i].second);
             }
-            if (alignments_with_loci.find(a.name()) == alignments_with_loci.end()) {
-                alignments_with_loci[a.name()] = a;
+            for (size_t i = 0; i < pairs.size(); i++) {
+                record_match(loci[pairs[i].first], *pairs[i].second, best[i]);
             }
-            Alignment& aln = alignments_with_loci[a.name()];
-            *aln.add_locus() = matching;
+            pairs.clear();
         };
-        vector<vg::id_t> nodes_vec;
-        for (auto& id : nodes_in_locus) nodes_vec.push_back(id);
-        gam_idx.for_alignment_to_nodes(nodes_vec, fill_alns);
+
+        for (size_t i : order) {
+            auto& nodes = locus_nodes[i];
+            // alignments that end before this locus can't reach any later one
+            window.erase(remove_if(window.begin(), window.end(), [&](const WindowAlignment& entry) {
+                return entry.max_id < nodes.front();
+            }), window.end());
+            // bring in the alignments that start before this locus ends
+            while (have_next && next.sort_id <= nodes.back()) {
+                window.push_back(next);
+                read_next();
+            }
+            for (auto& entry : window) {
+                for (auto& mapping : entry.aln->path().mapping()) {
+                    if (binary_search(nodes.begin(), nodes.end(), mapping.position().node_id())) {
+                        pairs.emplace_back(i, entry.aln);
+                        break;
+                    }
+                }
+            }
+            if (pairs.size() >= LOCIFY_MATCH_BATCH) {
+                match_pairs();
+            }
+        }
+        match_pairs();
     };
 
     if (!loci_file.empty()){
         ifstream ifi(loci_file);
-        stream::for_each(ifi, lambda);
+        if (sorted_gam_name.empty()) {
+            stream::for_each(ifi, lambda);
+        } else {
+            ifstream gam_in(sorted_gam_name);
+            if (!gam_in) {
+                cerr << "[vg locify] Error: could not open sorted GAM " << sorted_gam_name << endl;
+                return 1;
+            }
+            merge_join_loci(ifi, gam_in);
+        }
     } else {
         cerr << "[vg locify] Warning: empty locus file given, could not annotate alignments with loci." << endl;
     }
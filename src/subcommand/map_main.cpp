@@ -3,7 +3,10 @@
 #include "../utility.hpp"
 #include "../mapper.hpp"
 #include "../surjector.hpp"
+#include "../bam_sorter.hpp"
 #include "../stream.hpp"
+#include "../numa.hpp"
+#include "../huge_pages.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -20,13 +23,20 @@ void help_map(char** argv) {
          << "    -x, --xg-name FILE      use this xg index (defaults to <graph>.vg.xg)" << endl
          << "    -g, --gcsa-name FILE    use this GCSA2 index (defaults to <graph>" << gcsa::GCSA::EXTENSION << ")" << endl
          << "    -1, --gbwt-name FILE    use this GBWT haplotype index (defaults to <graph>"<<gbwt::GBWT::EXTENSION << ")" << endl
+         << "    --minimizer-name FILE   seed with this minimizer index from vg minimizer instead of the GCSA2" << endl
+         << "    --dist-name FILE        look up graph distances in this distance index from vg index -j" << endl
          << "algorithm:" << endl
          << "    -t, --threads N         number of compute threads to use" << endl
+         << "    --numa MODE             on multi-socket machines, pin threads to NUMA nodes and place the XG and GCSA/LCP" << endl
+         << "                            by MODE: off, interleave (pages spread over nodes) or replicate (a copy per node) [off]" << endl
+         << "    --huge-pages MODE       back the XG and GCSA/LCP arrays with huge pages: off, transparent, or hugetlb" << endl
+         << "                            (needs pages reserved with vm.nr_hugepages) [off]" << endl
          << "    -k, --min-mem INT       minimum MEM length (if 0 estimate via -e) [0]" << endl
          << "    -e, --mem-chance FLOAT  set {-k} such that this fraction of {-k} length hits will by chance [5e-4]" << endl
          << "    -c, --hit-max N         ignore MEMs who have >N hits in our index (0 for no limit) [2048]" << endl
          << "    -Y, --max-mem INT       ignore mems longer than this length (unset if 0) [0]" << endl
          << "    -r, --reseed-x FLOAT    look for internal seeds inside a seed longer than FLOAT*--min-seed [1.5]" << endl
+         << "    --lcp-reseed            find internal seeds in one pass per seed using the LCP array" << endl
          << "    -u, --try-up-to INT     attempt to align up to the INT best candidate chains of seeds (1/2 for paired) [128]" << endl
          << "    -l, --try-at-least INT  attempt to align at least the INT best candidate chains of seeds [1]" << endl
          << "    -E, --approx-mq-cap INT weight MQ by suffix tree based estimate when estimate less than FLOAT [0]" << endl
@@ -36,6 +46,7 @@ void help_map(char** argv) {
          << "    -n, --mq-overlap FLOAT  scale MQ by count of alignments with this overlap in the query with the primary [0]" << endl
          << "    -P, --min-ident FLOAT   accept alignment only if the alignment identity is >= FLOAT [0]" << endl
          << "    -H, --max-target-x N    skip cluster subgraphs with length > N*read_length [100]" << endl
+         << "    --min-mem-entropy FLOAT drop MEMs lying entirely in 16bp windows with entropy < FLOAT bits [0]" << endl
          << "    -m, --acyclic-graph     improves runtime when the graph is acyclic" << endl
          << "    -w, --band-width INT    band width for long read alignment [256]" << endl
          << "    -O, --band-overlap INT  band overlap for long read alignment [{-w}/8]" << endl
@@ -49,8 +60,19 @@ void help_map(char** argv) {
          << "    --frag-calc INT         update the fragment model every INT perfect pairs [10]" << endl
          << "    --fragment-x FLOAT      calculate max fragment size as frag_mean+frag_sd*FLOAT [10]" << endl
          << "    --mate-rescues INT      attempt up to INT mate rescues per pair [64]" << endl
+         << "    --rescue-prefilter INT  skip rescuing mates that share no INT-mers with the rescue window (0 to disable) [0]" << endl
          << "    -S, --unpaired-cost INT penalty for an unpaired read pair [17]" << endl
          << "    --no-patch-aln          do not patch banded alignments by locally aligning unaligned regions" << endl
+         << "    --chain-long-reads      align reads longer than -w by chaining MEMs over the whole read and aligning only the gaps" << endl
+         << "    --sparse-chain          chain single-end MEM hits with range maximum queries, which is faster for repetitive reads" << endl
+         << "    --batch-size INT        map unpaired reads in batches of INT, one mapping stage at a time [0]" << endl
+         << "    --dup-cache INT         reuse the results of up to INT unpaired reads for later reads with the same sequence [0]" << endl
+         << "    --dup-qual-bin INT      with --dup-cache and -A, count base qualities in the same bin of width INT as equal [1]" << endl
+         << "    --max-lf-steps INT      stop reseeding a read after INT LF steps of MEM finding (0 for no limit) [0]" << endl
+         << "    --max-cluster-probes INT align only the best cluster of a read after INT clustering probes (0 for no limit) [0]" << endl
+         << "    --max-dp-cells INT      align no more clusters of a read after INT DP cells (0 for no limit) [0]" << endl
+         << "    --score-first           score every cluster of an unpaired read before tracing back only the alignments that matter" << endl
+         << "    --xdrop                 stop banded alignment where the score drops by more than a 100bp gap would cost" << endl
          << "scoring:" << endl
          << "    -q, --match INT         use this match score [1]" << endl
          << "    -z, --mismatch INT      use this mismatch penalty [4]" << endl
@@ -60,6 +82,7 @@ void help_map(char** argv) {
          << "    -L, --full-l-bonus INT  the full-length alignment bonus [5]" << endl
          << "    --drop-full-l-bonus     remove the full length bonus from the score before sorting and MQ calculation" << endl
          << "    -a, --hap-exp FLOAT     the exponent for haplotype consistency likelihood in alignment score [1]" << endl
+         << "    --haplo-filter-clusters only align clusters no GBWT haplotype agrees with if fewer than --min-multimaps others are left" << endl
          << "    -A, --qual-adjust       perform base quality adjusted alignments (requires base quality input)" << endl
          << "input:" << endl
          << "    -s, --sequence STR      align a string to the graph in graph.vg using partial order alignment" << endl
@@ -75,13 +98,20 @@ void help_map(char** argv) {
          << "output:" << endl
          << "    -j, --output-json       output JSON rather than an alignment stream (helpful for debugging)" << endl
          << "    --surject-to TYPE       surject the output into the graph's paths, writing TYPE := bam |sam | cram" << endl
+         << "    --surject-sort          coordinate-sort the surjected output, spilling to temp files as needed" << endl
          << "    --buffer-size INT       buffer this many alignments together before outputting in GAM [512]" << endl
+         << "    --compression CODEC     compress the GAM with gzip, snappy or lz4 (faster, but only vg reads it) [gzip]" << endl
          << "    -X, --compare           realign GAM input (-G), writing alignment with \"correct\" field set to overlap with input" << endl
          << "    -v, --refpos-table      for efficient testing output a table of name, chr, pos, mq, score" << endl
          << "    -K, --keep-secondary    produce alignments for secondary input alignments in addition to primary ones" << endl
          << "    -M, --max-multimaps INT produce up to INT alignments for each read [1]" << endl
          << "    -Q, --mq-max INT        cap the mapping quality at INT [60]" << endl
-         << "    -D, --debug             print debugging information about alignment to stderr" << endl;
+         << "    -D, --debug             print debugging information about alignment to stderr" << endl
+         << "    --log-batch-time        with --batch-size, report the time spent in each mapping stage to stderr" << endl
+         << "    --stage-stats           report the time spent in and calls to each mapping stage, and the --dup-cache hit rate, to stderr" << endl
+         << "    --slow-reads FILE       write reads that take longer than --slow-read-ms to map to FILE as GAM, annotated with" << endl
+         << "                            their stage times and work counts, for mapping them again with -G" << endl
+         << "    --slow-read-ms FLOAT    with --slow-reads, the mapping time that makes a read slow [1000]" << endl;
 
 }
 
@@ -92,7 +122,37 @@ int main_map(int argc, char** argv) {
         return 1;
     }
 
+    // remember how we were run for --slow-reads, before getopt reorders argv
+    string command_line;
+    for (int i = 0; i < argc; i++) {
+        command_line += (i ? " " : "") + string(argv[i]);
+    }
+
     #define OPT_SCORE_MATRIX 1000
+    #define OPT_BATCH_SIZE 1001
+    #define OPT_LOG_BATCH_TIME 1002
+    #define OPT_SCORE_FIRST 1003
+    #define OPT_XDROP 1004
+    #define OPT_SURJECT_SORT 1005
+    #define OPT_STAGE_STATS 1006
+    #define OPT_MIN_MEM_ENTROPY 1007
+    #define OPT_CHAIN_LONG_READS 1008
+    #define OPT_LCP_RESEED 1009
+    #define OPT_NUMA 1010
+    #define OPT_HUGE_PAGES 1011
+    #define OPT_RESCUE_PREFILTER 1012
+    #define OPT_COMPRESSION 1013
+    #define OPT_MINIMIZER_NAME 1014
+    #define OPT_SPARSE_CHAIN 1015
+    #define OPT_DUP_CACHE 1016
+    #define OPT_DUP_QUAL_BIN 1017
+    #define OPT_MAX_LF_STEPS 1018
+    #define OPT_MAX_CLUSTER_PROBES 1019
+    #define OPT_MAX_DP_CELLS 1020
+    #define OPT_SLOW_READS 1021
+    #define OPT_SLOW_READ_MS 1022
+    #define OPT_HAPLO_FILTER_CLUSTERS 1023
+    #define OPT_DIST_NAME 1024
     string matrix_file_name;
     string seq;
     string qual;
@@ -101,6 +161,8 @@ int main_map(int argc, char** argv) {
     string xg_name;
     string gcsa_name;
     string gbwt_name;
+    string minimizer_name;
+    string dist_name;
     string read_file;
     string hts_file;
     string fasta_file;
@@ -110,6 +172,7 @@ int main_map(int argc, char** argv) {
     int thread_count = 1;
     bool output_json = false;
     string surject_type;
+    bool surject_sort = false;
     bool debug = false;
     float min_score = 0;
     string sample_name;
@@ -153,20 +216,40 @@ int main_map(int argc, char** argv) {
     bool fragment_direction = true;
     float chance_match = 5e-4;
     bool use_fast_reseed = true;
+    bool use_lcp_reseed = false;
+    NUMATopology::Mode numa_mode = NUMATopology::OFF;
+    HugePageMode huge_page_mode = HugePageMode::OFF;
     float drop_chain = 0.45;
     float mq_overlap = 0.0;
     int kmer_size = 0; // if we set to positive, we'd revert to the old kmer based mapper
     int kmer_stride = 0;
     int pair_window = 64; // unused
     int mate_rescues = 64;
+    int rescue_prefilter_kmer = 0;
     bool fixed_fragment_model = false;
     bool print_fragment_model = false;
     int fragment_model_update = 10;
     bool acyclic_graph = false;
     bool refpos_table = false;
     bool patch_alignments = true;
+    bool chain_long_reads = false;
+    bool sparse_chaining = false;
     int min_banded_mq = 0;
     int max_sub_mem_recursion_depth = 2;
+    int batch_size = 0;
+    bool log_batch_time = false;
+    bool stage_stats = false;
+    int dup_cache_size = 0;
+    int dup_quality_bin = 1;
+    int64_t max_lf_steps = 0;
+    int64_t max_cluster_probes = 0;
+    int64_t max_dp_cells = 0;
+    string slow_reads_name;
+    double slow_read_ms = 1000;
+    bool haplo_filter_clusters = false;
+    double min_mem_entropy = 0;
+    bool score_first = false;
+    bool use_xdrop = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -228,6 +311,7 @@ int main_map(int argc, char** argv) {
                 {"try-at-least", required_argument, 0, 'l'},
                 {"mq-max", required_argument, 0, 'Q'},
                 {"mate-rescues", required_argument, 0, '0'},
+                {"rescue-prefilter", required_argument, 0, OPT_RESCUE_PREFILTER},
                 {"approx-mq-cap", required_argument, 0, 'E'},
                 {"fixed-frag-model", no_argument, 0, 'U'},
                 {"print-frag-model", no_argument, 0, 'p'},
@@ -238,6 +322,29 @@ int main_map(int argc, char** argv) {
                 {"no-patch-aln", no_argument, 0, '8'},
                 {"drop-full-l-bonus", no_argument, 0, '2'},
                 {"unpaired-cost", required_argument, 0, 'S'},
+                {"batch-size", required_argument, 0, OPT_BATCH_SIZE},
+                {"log-batch-time", no_argument, 0, OPT_LOG_BATCH_TIME},
+                {"score-first", no_argument, 0, OPT_SCORE_FIRST},
+                {"xdrop", no_argument, 0, OPT_XDROP},
+                {"surject-sort", no_argument, 0, OPT_SURJECT_SORT},
+                {"stage-stats", no_argument, 0, OPT_STAGE_STATS},
+                {"min-mem-entropy", required_argument, 0, OPT_MIN_MEM_ENTROPY},
+                {"chain-long-reads", no_argument, 0, OPT_CHAIN_LONG_READS},
+                {"sparse-chain", no_argument, 0, OPT_SPARSE_CHAIN},
+                {"dup-cache", required_argument, 0, OPT_DUP_CACHE},
+                {"dup-qual-bin", required_argument, 0, OPT_DUP_QUAL_BIN},
+                {"max-lf-steps", required_argument, 0, OPT_MAX_LF_STEPS},
+                {"max-cluster-probes", required_argument, 0, OPT_MAX_CLUSTER_PROBES},
+                {"max-dp-cells", required_argument, 0, OPT_MAX_DP_CELLS},
+                {"slow-reads", required_argument, 0, OPT_SLOW_READS},
+                {"slow-read-ms", required_argument, 0, OPT_SLOW_READ_MS},
+                {"haplo-filter-clusters", no_argument, 0, OPT_HAPLO_FILTER_CLUSTERS},
+                {"lcp-reseed", no_argument, 0, OPT_LCP_RESEED},
+                {"numa", required_argument, 0, OPT_NUMA},
+                {"huge-pages", required_argument, 0, OPT_HUGE_PAGES},
+                {"compression", required_argument, 0, OPT_COMPRESSION},
+                {"minimizer-name", required_argument, 0, OPT_MINIMIZER_NAME},
+                {"dist-name", required_argument, 0, OPT_DIST_NAME},
                 {0, 0, 0, 0}
             };
 
@@ -517,6 +624,117 @@ int main_map(int argc, char** argv) {
             fragment_model_update = atoi(optarg);
             break;
 
+        case OPT_BATCH_SIZE:
+            batch_size = atoi(optarg);
+            break;
+
+        case OPT_LOG_BATCH_TIME:
+            log_batch_time = true;
+            break;
+
+        case OPT_SCORE_FIRST:
+            score_first = true;
+            break;
+
+        case OPT_XDROP:
+            use_xdrop = true;
+            break;
+
+        case OPT_SURJECT_SORT:
+            surject_sort = true;
+            break;
+
+        case OPT_STAGE_STATS:
+            stage_stats = true;
+            break;
+
+        case OPT_MIN_MEM_ENTROPY:
+            min_mem_entropy = atof(optarg);
+            break;
+
+        case OPT_CHAIN_LONG_READS:
+            chain_long_reads = true;
+            break;
+
+        case OPT_SPARSE_CHAIN:
+            sparse_chaining = true;
+            break;
+
+        case OPT_DUP_CACHE:
+            dup_cache_size = atoi(optarg);
+            break;
+
+        case OPT_DUP_QUAL_BIN:
+            dup_quality_bin = atoi(optarg);
+            break;
+
+        case OPT_MAX_LF_STEPS:
+            max_lf_steps = atoll(optarg);
+            break;
+
+        case OPT_MAX_CLUSTER_PROBES:
+            max_cluster_probes = atoll(optarg);
+            break;
+
+        case OPT_MAX_DP_CELLS:
+            max_dp_cells = atoll(optarg);
+            break;
+
+        case OPT_SLOW_READS:
+            slow_reads_name = optarg;
+            break;
+
+        case OPT_SLOW_READ_MS:
+            slow_read_ms = atof(optarg);
+            break;
+
+        case OPT_HAPLO_FILTER_CLUSTERS:
+            haplo_filter_clusters = true;
+            break;
+
+        case OPT_LCP_RESEED:
+            use_lcp_reseed = true;
+            break;
+
+        case OPT_NUMA:
+            try {
+                numa_mode = NUMATopology::parse_mode(optarg);
+            } catch (runtime_error& e) {
+                cerr << "error:[vg map] Unknown NUMA mode (--numa) " << optarg << ", choose from off, interleave or replicate" << endl;
+                exit(1);
+            }
+            break;
+
+        case OPT_RESCUE_PREFILTER:
+            rescue_prefilter_kmer = atoi(optarg);
+            break;
+
+        case OPT_HUGE_PAGES:
+            try {
+                huge_page_mode = parse_huge_page_mode(optarg);
+            } catch (runtime_error& e) {
+                cerr << "error:[vg map] Unknown huge page mode (--huge-pages) " << optarg << ", choose from off, transparent or hugetlb" << endl;
+                exit(1);
+            }
+            break;
+
+        case OPT_COMPRESSION:
+            try {
+                stream::set_default_codec(stream::parse_codec(optarg));
+            } catch (invalid_argument& e) {
+                cerr << "error:[vg map] Unknown compression codec (--compression) " << optarg << ", choose from gzip, snappy or lz4" << endl;
+                exit(1);
+            }
+            break;
+
+        case OPT_MINIMIZER_NAME:
+            minimizer_name = optarg;
+            break;
+
+        case OPT_DIST_NAME:
+            dist_name = optarg;
+            break;
+
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -531,6 +749,26 @@ int main_map(int argc, char** argv) {
         }
     }
 
+    if (surject_sort && surject_type.empty()) {
+        cerr << "error:[vg map] --surject-sort requires --surject-to" << endl;
+        return 1;
+    }
+
+    if (dup_cache_size < 0 || dup_quality_bin <= 0) {
+        cerr << "error:[vg map] --dup-cache must not be negative and --dup-qual-bin must be positive" << endl;
+        return 1;
+    }
+
+    if (max_lf_steps < 0 || max_cluster_probes < 0 || max_dp_cells < 0) {
+        cerr << "error:[vg map] --max-lf-steps, --max-cluster-probes and --max-dp-cells must not be negative" << endl;
+        return 1;
+    }
+
+    if (slow_read_ms < 0) {
+        cerr << "error:[vg map] --slow-read-ms must not be negative" << endl;
+        return 1;
+    }
+
     if (seq.empty() && read_file.empty() && hts_file.empty() && fastq1.empty() && gam_input.empty() && fasta_file.empty()) {
         cerr << "error:[vg map] A sequence or read file is required when mapping." << endl;
         return 1;
@@ -585,6 +823,36 @@ int main_map(int argc, char** argv) {
     // Configure its temp directory to the system temp directory
     gcsa::TempFile::setDirectory(temp_file::get_dir());
 
+    // Place the threads on NUMA nodes before the indexes, so that the pages
+    // the loads touch go where the mode wants them.
+    NUMATopology numa;
+    if (numa_mode != NUMATopology::OFF) {
+        if (numa.node_count() < 2) {
+            cerr << "warning:[vg map] Only one NUMA node found, ignoring --numa" << endl;
+            numa_mode = NUMATopology::OFF;
+        } else {
+            if (!numa.pin_threads(get_thread_count())) {
+                cerr << "warning:[vg map] Could not pin all threads to NUMA nodes" << endl;
+            }
+            bool placed = numa_mode == NUMATopology::INTERLEAVE ? numa.interleave_allocations() : numa.prefer_node(0);
+            if (!placed) {
+                cerr << "warning:[vg map] Could not set NUMA memory policy, indexes will be placed by the OS" << endl;
+            }
+            cerr << "[vg map] NUMA mode " << NUMATopology::mode_name(numa_mode) << ": " << get_thread_count()
+                 << " threads pinned across " << numa.node_count() << " nodes" << endl;
+        }
+    }
+
+    if (huge_page_mode != HugePageMode::OFF) {
+        // Make room for every copy of the indexes we will load
+        size_t copies = numa_mode == NUMATopology::REPLICATE ? numa.node_count() : 1;
+        size_t index_bytes = total_file_size({xg_name, gcsa_name, gcsa_name + ".lcp"});
+        if (!prepare_huge_pages(huge_page_mode, copies * index_bytes)) {
+            cerr << "warning:[vg map] Could not reserve " << copies * index_bytes << " bytes of huge pages, using normal pages" << endl;
+            huge_page_mode = HugePageMode::OFF;
+        }
+    }
+
     // Load up our indexes.
     xg::XG* xgidx = nullptr;
     gcsa::GCSA* gcsa = nullptr;
@@ -643,6 +911,82 @@ int main_map(int argc, char** argv) {
         haplo_score_provider = new haplo::GBWTScoreProvider<gbwt::GBWT>(*gbwt);
     }
 
+    if (haplo_filter_clusters && gbwt == nullptr) {
+        cerr << "error:[vg map] --haplo-filter-clusters requires a GBWT index (-1)" << endl;
+        return 1;
+    }
+
+    unique_ptr<MinimizerIndex> minimizer_index;
+    if (!minimizer_name.empty()) {
+        ifstream minimizer_stream(minimizer_name);
+        if (!minimizer_stream) {
+            cerr << "error:[vg map] Cannot open minimizer index " << minimizer_name << endl;
+            return 1;
+        }
+        if(debug) {
+            cerr << "Loading minimizer index " << minimizer_name << "..." << endl;
+        }
+        minimizer_index = unique_ptr<MinimizerIndex>(new MinimizerIndex());
+        minimizer_index->load(minimizer_stream);
+    }
+
+    unique_ptr<SnarlDistanceIndex> distance_index;
+    if (!dist_name.empty()) {
+        if (!ifstream(dist_name)) {
+            cerr << "error:[vg map] Cannot open distance index " << dist_name << endl;
+            return 1;
+        }
+        if(debug) {
+            cerr << "Loading distance index " << dist_name << "..." << endl;
+        }
+        distance_index = unique_ptr<SnarlDistanceIndex>(new SnarlDistanceIndex(dist_name));
+    }
+
+    // The indexes each mapping thread uses, by NUMA node. Only replication
+    // makes more than one copy.
+    vector<xg::XG*> node_xgidx(1, xgidx);
+    vector<gcsa::GCSA*> node_gcsa(1, gcsa);
+    vector<gcsa::LCPArray*> node_lcp(1, lcp);
+    if (numa_mode == NUMATopology::REPLICATE) {
+        for (size_t node = 1; node < numa.node_count(); ++node) {
+            numa.prefer_node(node);
+            if (xgidx) {
+                ifstream xg_copy_stream(xg_name);
+                node_xgidx.push_back(new xg::XG(xg_copy_stream));
+            } else {
+                node_xgidx.push_back(nullptr);
+            }
+            if (gcsa) {
+                ifstream gcsa_copy_stream(gcsa_name);
+                node_gcsa.push_back(new gcsa::GCSA());
+                node_gcsa.back()->load(gcsa_copy_stream);
+            } else {
+                node_gcsa.push_back(nullptr);
+            }
+            if (lcp) {
+                ifstream lcp_copy_stream(lcp_name);
+                node_lcp.push_back(new gcsa::LCPArray());
+                node_lcp.back()->load(lcp_copy_stream);
+            } else {
+                node_lcp.push_back(nullptr);
+            }
+        }
+        cerr << "[vg map] NUMA mode replicate: loaded a copy of the XG, GCSA and LCP on each of "
+             << numa.node_count() << " nodes" << endl;
+    }
+    if (numa_mode != NUMATopology::OFF) {
+        // Per-read working memory should stay on the node that uses it
+        numa.reset_allocations();
+    }
+    if (huge_page_mode != HugePageMode::OFF) {
+        size_t advised = finish_huge_pages(huge_page_mode);
+        cerr << "[vg map] Huge page mode " << huge_page_mode_name(huge_page_mode);
+        if (huge_page_mode == HugePageMode::TRANSPARENT) {
+            cerr << ": advised " << advised << " bytes of index memory";
+        }
+        cerr << endl;
+    }
+
     ifstream matrix_stream;
     if (!matrix_file_name.empty()) {
       matrix_stream.open(matrix_file_name);
@@ -656,8 +1000,8 @@ int main_map(int argc, char** argv) {
 
     vector<Mapper*> mapper;
     mapper.resize(thread_count);
-    vector<vector<Alignment> > output_buffer;
-    output_buffer.resize(thread_count);
+    // each thread's alignments wait to be written on an arena of its own
+    vector<stream::ArenaBuffer<Alignment> > output_buffer(thread_count);
     vector<Alignment> empty_alns;
     
     // If we need to do surjection
@@ -668,6 +1012,8 @@ int main_map(int argc, char** argv) {
     int buffer_limit = 100;
     bam_hdr_t* hdr = nullptr;
     int compress_level = 9; // hard coded
+    // When sorting, records collect here until all the reads are mapped
+    unique_ptr<BAMSorter> sam_sorter;
     map<string, string> rg_sample;
     string sam_header;
     
@@ -686,9 +1032,17 @@ int main_map(int argc, char** argv) {
             path_names.insert(xgidx->path_name(i));
         }
     }
+    // which of the paths each node is on, shared by all the surjectors
+    unique_ptr<PathMembershipIndex> path_membership;
+    if (!surject_type.empty()) {
+        path_membership = unique_ptr<PathMembershipIndex>(new PathMembershipIndex(*xgidx, path_names));
+        for (Surjector* surjector : surjectors) {
+            surjector->path_membership = path_membership.get();
+        }
+    }
 
     // for SAM header generation
-    auto setup_sam_header = [&hdr, &sam_out, &surject_type, &compress_level, &xgidx, &rg_sample, &sam_header] (void) {
+    auto setup_sam_header = [&hdr, &sam_out, &surject_type, &surject_sort, &sam_sorter, &compress_level, &xgidx, &rg_sample, &sam_header, &thread_count] (void) {
 #pragma omp critical (hts_header)
         if (!hdr) {
             char out_mode[5];
@@ -709,22 +1063,29 @@ int main_map(int argc, char** argv) {
                 auto name = xgidx->path_name(i);
                 path_length[name] = xgidx->path_length(name);
             }
-            hdr = hts_string_header(sam_header, path_length, rg_sample);
+            hdr = hts_string_header(sam_header, path_length, rg_sample, surject_sort);
             if ((sam_out = sam_open("-", out_mode)) == 0) {
                 cerr << "[vg map] failed to open stdout for writing HTS output" << endl;
                 exit(1);
             } else {
+                if (!out_format.empty() && thread_count > 1) {
+                    // let htslib compress BGZF blocks on a pool of its own
+                    hts_set_threads(sam_out, thread_count);
+                }
                 // write the header
                 if (sam_hdr_write(sam_out, hdr) != 0) {
                     cerr << "[vg map] error: failed to write the SAM header" << endl;
                 }
+                if (surject_sort) {
+                    sam_sorter.reset(new BAMSorter(hdr));
+                }
             }
         }
     };
 
     // TODO: Refactor the surjection code out of surject_main and intto somewhere where we can just use it here!
 
-    auto surject_alignments = [&hdr, &sam_header, &mapper, &rg_sample, &setup_sam_header, &path_names, &sam_out, &xgidx, &surjectors] (const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
+    auto surject_alignments = [&hdr, &mapper, &rg_sample, &setup_sam_header, &path_names, &sam_out, &sam_sorter, &xgidx, &surjectors] (const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
         
         if (alns1.empty()) return;
         setup_sam_header();
@@ -758,6 +1119,10 @@ int main_map(int argc, char** argv) {
             // Don't try and populate the header; it should have happened already
         }
         
+        // Encode all the records before taking the output, so threads only
+        // wait on each other to hand finished records to htslib
+        vector<bam1_t*> records;
+        
         if (surjects2.empty()) {
             // Write out surjected single-end reads
         
@@ -772,17 +1137,12 @@ int main_map(int argc, char** argv) {
                     path_len = xgidx->path_length(path_name);
                 }
                 string cigar = cigar_against_path(surj, path_reverse, path_pos, path_len, 0);
-                bam1_t* b = alignment_to_bam(sam_header,
-                                             surj,
-                                             path_name,
-                                             path_pos,
-                                             path_reverse,
-                                             cigar);
-                int r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b);
+                records.push_back(alignment_to_bam(hdr,
+                                                   surj,
+                                                   path_name,
+                                                   path_pos,
+                                                   path_reverse,
+                                                   cigar));
             }
         } else {
             // Write out surjected paired-end reads
@@ -822,40 +1182,48 @@ int main_map(int argc, char** argv) {
                 int template_length = 0;
                 
                 // Make BAM records
-                bam1_t* b1 = alignment_to_bam(sam_header,
-                                              surj1,
-                                              path_name1,
-                                              path_pos1,
-                                              path_reverse1,
-                                              cigar1,
-                                              path_name2,
-                                              path_pos2,
-                                              template_length);
-                bam1_t* b2 = alignment_to_bam(sam_header,
-                                              surj2,
-                                              path_name2,
-                                              path_pos2,
-                                              path_reverse2,
-                                              cigar2,
-                                              path_name1,
-                                              path_pos1,
-                                              template_length);
-                
-                // Write the records
-                int r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b1);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b1);
-                r = 0;
-#pragma omp critical (cout)
-                r = sam_write1(sam_out, hdr, b2);
-                if (r == 0) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
-                bam_destroy1(b2);
+                records.push_back(alignment_to_bam(hdr,
+                                                   surj1,
+                                                   path_name1,
+                                                   path_pos1,
+                                                   path_reverse1,
+                                                   cigar1,
+                                                   path_name2,
+                                                   path_pos2,
+                                                   template_length));
+                records.push_back(alignment_to_bam(hdr,
+                                                   surj2,
+                                                   path_name2,
+                                                   path_pos2,
+                                                   path_reverse2,
+                                                   cigar2,
+                                                   path_name1,
+                                                   path_pos1,
+                                                   template_length));
             }
             
             
         }
+        
+        if (sam_sorter) {
+            // these get written in order once all the reads are mapped
+            sam_sorter->add(records);
+            return;
+        }
+        
+        // Write the records together, so pairs stay next to each other
+        bool failed = false;
+#pragma omp critical (cout)
+        for (auto b : records) {
+            if (sam_write1(sam_out, hdr, b) < 0) {
+                failed = true;
+                break;
+            }
+        }
+        if (failed) { cerr << "[vg map] error: writing to stdout failed" << endl; exit(1); }
+        for (auto b : records) {
+            bam_destroy1(b);
+        }
     };
 
     auto write_json = [](const vector<Alignment>& alns) {
@@ -912,23 +1280,64 @@ int main_map(int argc, char** argv) {
             auto& output_buf = output_buffer[tid];
 
             // Copy all the alignments over to the output buffer
-            copy(alns1.begin(), alns1.end(), back_inserter(output_buf));
-            copy(alns2.begin(), alns2.end(), back_inserter(output_buf));
+            for (auto& aln : alns1) {
+                output_buf.push_back(aln);
+            }
+            for (auto& aln : alns2) {
+                output_buf.push_back(aln);
+            }
 
             stream::write_buffered(cout, output_buf, buffer_size);
         }
     };
 
+    // totals for --stage-stats, shared by all the mappers
+    unique_ptr<StageStats> stage_totals;
+    if (stage_stats) {
+        stage_totals = unique_ptr<StageStats>(new StageStats(thread_count));
+    }
+
+    // reads that take longer than --slow-read-ms, shared by all the mappers
+    ofstream slow_reads_out;
+    unique_ptr<SlowReadLog> slow_read_log;
+    if (!slow_reads_name.empty()) {
+        slow_reads_out.open(slow_reads_name);
+        if (!slow_reads_out) {
+            cerr << "error:[vg map] could not open " << slow_reads_name << " for writing slow reads" << endl;
+            return 1;
+        }
+        slow_read_log = unique_ptr<SlowReadLog>(new SlowReadLog(slow_reads_out, slow_read_ms / 1000, command_line));
+        if (!stage_totals) {
+            // stage times are only kept for reads while the stages are timed
+            stage_totals = unique_ptr<StageStats>(new StageStats(thread_count));
+        }
+    }
+
+    // results of unpaired reads for --dup-cache, shared by all the mappers
+    unique_ptr<ReadResultCache<Alignment>> dup_cache;
+    if (dup_cache_size > 0) {
+        dup_cache = unique_ptr<ReadResultCache<Alignment>>(new ReadResultCache<Alignment>(dup_cache_size, dup_quality_bin));
+    }
+
+    // use the statistics from vg calibrate, if they were saved with the XG
+    MapperCalibration calibration;
+    calibration.load_sidecar(xg_name);
+
     for (int i = 0; i < thread_count; ++i) {
         Mapper* m = nullptr;
-        if(xgidx && gcsa && lcp) {
+        if(xgidx && ((gcsa && lcp) || minimizer_index)) {
             // We have the xg and GCSA indexes, so use them
-            m = new Mapper(xgidx, gcsa, lcp, haplo_score_provider);
+            size_t node = numa_mode == NUMATopology::REPLICATE ? numa.node_of_thread(i, thread_count) : 0;
+            m = new Mapper(node_xgidx[node], node_gcsa[node], node_lcp[node], haplo_score_provider);
         } else {
             // Can't continue with null
-            throw runtime_error("Need XG, GCSA, and LCP to create a Mapper");
+            throw runtime_error("Need XG, and GCSA and LCP or a minimizer index, to create a Mapper");
         }
+        m->minimizer_index = minimizer_index.get();
+        m->distance_index = distance_index.get();
+        m->set_calibration(calibration);
         m->hit_max = hit_max;
+        m->min_mem_entropy = min_mem_entropy;
         m->max_multimaps = max_multimaps;
         m->min_multimaps = max(min_multimaps, max_multimaps);
         m->band_multimaps = band_multimaps;
@@ -948,11 +1357,14 @@ int main_map(int argc, char** argv) {
                  << ", min_cluster_length = " << m->min_cluster_length << endl;
         }
         m->fast_reseed = use_fast_reseed;
+        m->lcp_reseed = use_lcp_reseed;
         m->max_sub_mem_recursion_depth = max_sub_mem_recursion_depth;
         m->max_target_factor = max_target_factor;
         m->set_alignment_scores(match, mismatch, gap_open, gap_extend, full_length_bonus, haplotype_consistency_exponent);
         if(matrix_stream.is_open()) m->load_scoring_matrix(matrix_stream);
+        m->set_xdrop(use_xdrop);
         m->strip_bonuses = strip_bonuses;
+        m->filter_haplotype_inconsistent_clusters = haplo_filter_clusters;
         m->adjust_alignments_for_base_quality = qual_adjust_alignments;
         m->extra_multimaps = extra_multimaps;
         m->mapping_quality_method = mapping_quality_method;
@@ -971,13 +1383,50 @@ int main_map(int argc, char** argv) {
         m->frag_stats.fragment_model_update_interval = fragment_model_update;
         m->max_mapping_quality = max_mapping_quality;
         m->mate_rescues = mate_rescues;
+        m->rescue_prefilter_kmer = rescue_prefilter_kmer;
         m->max_band_jump = max_band_jump;
         m->identity_weight = identity_weight;
         m->assume_acyclic = acyclic_graph;
         m->patch_alignments = patch_alignments;
+        m->chain_long_reads = chain_long_reads;
+        m->sparse_chaining = sparse_chaining;
+        m->score_before_traceback = score_first;
+        m->stage_stats = stage_totals.get();
+        m->result_cache = dup_cache.get();
+        m->max_lf_steps_per_read = max_lf_steps;
+        m->max_cluster_probes_per_read = max_cluster_probes;
+        m->max_dp_cells_per_read = max_dp_cells;
+        m->slow_read_log = slow_read_log.get();
         mapper[i] = m;
     }
 
+    // each thread's unpaired reads waiting to be mapped together under --batch-size
+    vector<vector<Alignment>> read_batches(thread_count);
+
+    auto map_read_batch = [&](vector<Alignment>& batch, bool compare) {
+        int tid = omp_get_thread_num();
+        vector<vector<Alignment>> alignments = mapper[tid]->align_multi_batch(batch, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (compare) {
+                alignments[i].front().set_correct(overlap(batch[i].path(), alignments[i].front().path()));
+                alignment_set_distance_to_correct(alignments[i].front(), batch[i]);
+            }
+            output_alignments(alignments[i], empty_alns);
+        }
+        batch.clear();
+    };
+
+    // map whatever each thread has left over once the input is exhausted
+    auto flush_read_batches = [&](bool compare) {
+#pragma omp parallel
+        {
+            auto& batch = read_batches[omp_get_thread_num()];
+            if (!batch.empty()) {
+                map_read_batch(batch, compare);
+            }
+        }
+    };
+
     if (!seq.empty()) {
         int tid = omp_get_thread_num();
 
@@ -1007,36 +1456,36 @@ int main_map(int argc, char** argv) {
 
     if (!read_file.empty()) {
         ifstream in(read_file);
-        bool more_data = in.good();
-#pragma omp parallel shared(in)
-        {
-            string line;
-            int tid = omp_get_thread_num();
-            while (in.good()) {
-                line.clear();
-#pragma omp critical (readq)
-                {
-                    std::getline(in,line);
-                }
+        
+        // Read lines on one thread and hand them out to the others in batches.
+        string line;
+        function<bool(Alignment&)> get_read = [&](Alignment& unaligned) {
+            while (std::getline(in, line)) {
                 if (!line.empty()) {
-                    // Make an alignment
-                    Alignment unaligned;
+                    unaligned.Clear();
                     unaligned.set_sequence(line);
+                    return true;
+                }
+            }
+            return false;
+        };
+        
+        function<void(Alignment&)> align_read = [&](Alignment& unaligned) {
+            int tid = omp_get_thread_num();
+            vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
 
-                    vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
-
-                    for(auto& alignment : alignments) {
-                        // Set the alignment metadata
-                        if (!sample_name.empty()) alignment.set_sample_name(sample_name);
-                        if (!read_group.empty()) alignment.set_read_group(read_group);
-                    }
+            for(auto& alignment : alignments) {
+                // Set the alignment metadata
+                if (!sample_name.empty()) alignment.set_sample_name(sample_name);
+                if (!read_group.empty()) alignment.set_read_group(read_group);
+            }
 
 
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments, empty_alns);
-                }
-            }
-        }
+            // Output the alignments in JSON or protobuf as appropriate.
+            output_alignments(alignments, empty_alns);
+        };
+        
+        unpaired_for_each_parallel(get_read, align_read);
     }
 
     if (!fasta_file.empty()) {
@@ -1170,15 +1619,27 @@ int main_map(int argc, char** argv) {
                  &max_mem_length,
                  &band_width,
                  &band_overlap,
-                 &empty_alns]
+                 &empty_alns,
+                 &batch_size,
+                 &read_batches,
+                 &map_read_batch]
                     (Alignment& alignment) {
 
                         int tid = omp_get_thread_num();
+                        if (batch_size > 0) {
+                            auto& batch = read_batches[tid];
+                            batch.push_back(alignment);
+                            if (batch.size() >= (size_t) batch_size) {
+                                map_read_batch(batch, false);
+                            }
+                            return;
+                        }
                         vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
                         //cerr << "This is just before output_alignments" << alignment.DebugString() << endl;
                         output_alignments(alignments, empty_alns);
                     };
             fastq_unpaired_for_each_parallel(fastq1, lambda);
+            flush_read_batches(false);
         } else {
             // paired two-file
             auto output_func = [&output_alignments,
@@ -1329,9 +1790,20 @@ int main_map(int argc, char** argv) {
                  &band_width,
                  &band_overlap,
                  &compare_gam,
-                 &empty_alns]
+                 &empty_alns,
+                 &batch_size,
+                 &read_batches,
+                 &map_read_batch]
                 (Alignment& alignment) {
                 int tid = omp_get_thread_num();
+                if (batch_size > 0) {
+                    auto& batch = read_batches[tid];
+                    batch.push_back(alignment);
+                    if (batch.size() >= (size_t) batch_size) {
+                        map_read_batch(batch, compare_gam);
+                    }
+                    return;
+                }
                 std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
                 vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width, band_overlap);
                 std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
@@ -1344,6 +1816,7 @@ int main_map(int argc, char** argv) {
                 output_alignments(alignments, empty_alns);
             };
             stream::for_each_parallel(gam_in, lambda);
+            flush_read_batches(compare_gam);
         }
         gam_in.close();
     }
@@ -1357,6 +1830,32 @@ int main_map(int argc, char** argv) {
         }
     }
 
+    if (log_batch_time && batch_size > 0) {
+        Mapper::BatchTiming total;
+        for (int i = 0; i < thread_count; ++i) {
+            auto& timing = mapper[i]->batch_timing;
+            total.batches += timing.batches;
+            total.reads += timing.reads;
+            total.seed_seconds += timing.seed_seconds;
+            total.align_seconds += timing.align_seconds;
+        }
+        cerr << "[vg map] mapped " << total.reads << " reads in " << total.batches << " batches of up to " << batch_size << endl
+             << "[vg map] MEM finding: " << total.seed_seconds << " s, "
+             << "clustering and alignment: " << total.align_seconds << " s (summed over threads)" << endl;
+    }
+
+    if (stage_stats) {
+        stage_totals->report(cerr, "[vg map] ");
+        if (dup_cache) {
+            dup_cache->report(cerr, "[vg map] ");
+        }
+    }
+
+    if (slow_read_log) {
+        slow_read_log->flush();
+        cerr << "[vg map] wrote " << slow_read_log->logged() << " slow reads to " << slow_reads_name << endl;
+    }
+
     // clean up
     for (int i = 0; i < thread_count; ++i) {
         delete mapper[i];
@@ -1368,6 +1867,10 @@ int main_map(int argc, char** argv) {
 
     // special cleanup for htslib outputs
     if (!surject_type.empty()) {
+        if (sam_sorter) {
+            sam_sorter->write_sorted(sam_out);
+            sam_sorter.reset();
+        }
         if (hdr != nullptr) bam_hdr_destroy(hdr);
         sam_close(sam_out);
         cout.flush();
@@ -1393,6 +1896,11 @@ int main_map(int argc, char** argv) {
         delete xgidx;
         xgidx = nullptr;
     }
+    for (size_t node = 1; node < node_xgidx.size(); ++node) {
+        delete node_xgidx[node];
+        delete node_gcsa[node];
+        delete node_lcp[node];
+    }
     
     for (Surjector* surjector : surjectors) {
         delete surjector;
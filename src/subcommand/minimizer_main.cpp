@@ -0,0 +1,175 @@
+/**
+ * \file minimizer_main.cpp: build a minimizer index for seeding reads
+ */
+
+#include <omp.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "subcommand.hpp"
+
+#include "../minimizer_index.hpp"
+#include "../xg.hpp"
+
+using namespace std;
+using namespace vg;
+using namespace vg::subcommand;
+
+void help_minimizer(char** argv) {
+    cerr << "usage: " << argv[0] << " minimizer [options] -x graph.xg -o graph" << MinimizerIndex::EXTENSION << endl
+         << "Index the minimizers of a graph, for vg map and vg mpmap to seed reads with instead of a GCSA2 index." << endl
+         << endl
+         << "options:" << endl
+         << "    -x, --xg-name FILE      index the graph in this xg index (required)" << endl
+         << "    -g, --gbwt-name FILE    only index windows on walks that haplotypes in this bidirectional GBWT take" << endl
+         << "    -o, --output FILE       write the index here (required)" << endl
+         << "    -k, --kmer-length INT   index k-mers of this length, at most 31 [21]" << endl
+         << "    -w, --window INT        take one minimizer from each window of this many k-mers [11]" << endl
+         << "    -W, --max-walks INT     follow at most this many walks out of each node [256]" << endl
+         << "    -t, --threads INT       number of threads to use" << endl;
+}
+
+int main_minimizer(int argc, char** argv) {
+
+    if (argc == 2) {
+        help_minimizer(argv);
+        return 1;
+    }
+
+    string xg_name;
+    string gbwt_name;
+    string output_name;
+    int kmer_length = 21;
+    int window_length = 11;
+    int max_walks = 256;
+
+    int c;
+    optind = 2;
+    while (true) {
+        static struct option long_options[] =
+        {
+            {"help", no_argument, 0, 'h'},
+            {"xg-name", required_argument, 0, 'x'},
+            {"gbwt-name", required_argument, 0, 'g'},
+            {"output", required_argument, 0, 'o'},
+            {"kmer-length", required_argument, 0, 'k'},
+            {"window", required_argument, 0, 'w'},
+            {"max-walks", required_argument, 0, 'W'},
+            {"threads", required_argument, 0, 't'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        c = getopt_long (argc, argv, "hx:g:o:k:w:W:t:",
+                         long_options, &option_index);
+
+        // Detect the end of the options.
+        if (c == -1) break;
+
+        switch (c)
+        {
+        case 'x':
+            xg_name = optarg;
+            break;
+
+        case 'g':
+            gbwt_name = optarg;
+            break;
+
+        case 'o':
+            output_name = optarg;
+            break;
+
+        case 'k':
+            kmer_length = atoi(optarg);
+            break;
+
+        case 'w':
+            window_length = atoi(optarg);
+            break;
+
+        case 'W':
+            max_walks = atoi(optarg);
+            break;
+
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
+        case 'h':
+        case '?':
+            help_minimizer(argv);
+            exit(1);
+            break;
+
+        default:
+            abort ();
+        }
+    }
+
+    if (xg_name.empty()) {
+        cerr << "error:[vg minimizer] Indexing minimizers requires an XG index, must provide XG file" << endl;
+        exit(1);
+    }
+
+    if (output_name.empty()) {
+        cerr << "error:[vg minimizer] Must provide a file to write the index to" << endl;
+        exit(1);
+    }
+
+    if (kmer_length <= 0 || kmer_length > 31) {
+        cerr << "error:[vg minimizer] K-mer length must be between 1 and 31" << endl;
+        exit(1);
+    }
+
+    if (window_length <= 0 || max_walks <= 0) {
+        cerr << "error:[vg minimizer] Window length and maximum walks must be positive" << endl;
+        exit(1);
+    }
+
+    ifstream xg_stream(xg_name);
+    if (!xg_stream) {
+        cerr << "error:[vg minimizer] Cannot open XG file " << xg_name << endl;
+        exit(1);
+    }
+    xg::XG xg_index(xg_stream);
+
+    unique_ptr<gbwt::GBWT> gbwt_index;
+    if (!gbwt_name.empty()) {
+        ifstream gbwt_stream(gbwt_name);
+        if (!gbwt_stream) {
+            cerr << "error:[vg minimizer] Cannot open GBWT file " << gbwt_name << endl;
+            exit(1);
+        }
+        gbwt_index = unique_ptr<gbwt::GBWT>(new gbwt::GBWT());
+        gbwt_index->load(gbwt_stream);
+        if (!gbwt_index->bidirectional()) {
+            cerr << "error:[vg minimizer] GBWT " << gbwt_name << " is not bidirectional" << endl;
+            exit(1);
+        }
+    }
+
+    MinimizerIndex minimizer_index(kmer_length, window_length);
+    try {
+        minimizer_index.build(xg_index, gbwt_index.get(), max_walks);
+    } catch (const runtime_error& e) {
+        cerr << "error:[vg minimizer] " << e.what() << ", chop the graph with vg mod -X first" << endl;
+        exit(1);
+    }
+
+    ofstream out(output_name);
+    if (!out) {
+        cerr << "error:[vg minimizer] Cannot write index file " << output_name << endl;
+        exit(1);
+    }
+    minimizer_index.save(out);
+
+    return 0;
+}
+
+// Register subcommand
+static Subcommand vg_minimizer("minimizer", "build a minimizer index for seeding reads", main_minimizer);
@@ -14,6 +14,7 @@
 #include "../cactus.hpp"
 #include "../stream.hpp"
 #include "../utility.hpp"
+#include "../packed_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 #include "../algorithms/remove_high_degree.hpp"
 
@@ -21,6 +22,28 @@ using namespace std;
 using namespace vg;
 using namespace vg::subcommand;
 
+#define OPT_STREAM 1000
+#define OPT_PACKED 1001
+
+/// How many chunks of a streamed graph to hold and modify at once, per thread
+const size_t STREAM_CHUNKS_PER_THREAD = 4;
+
+/// Drop the items of a repeated protobuf field that the filter rejects,
+/// keeping the rest in order
+template<typename Items, typename Filter>
+static void keep_items(Items& items, const Filter& keep) {
+    int kept = 0;
+    for (int i = 0; i < items.size(); i++) {
+        if (keep(items.Get(i))) {
+            if (kept != i) {
+                items.SwapElements(kept, i);
+            }
+            kept++;
+        }
+    }
+    items.DeleteSubrange(kept, items.size() - kept);
+}
+
 void help_mod(char** argv) {
     cerr << "usage: " << argv[0] << " mod [options] <graph.vg> >[mod.vg]" << endl
          << "Modifies graph, outputs modified on stdout." << endl
@@ -80,7 +103,13 @@ void help_mod(char** argv) {
          << "    -a, --cactus            convert to cactus graph representation" << endl
          << "    -v, --sample-vcf FILE   for a graph with allele paths, compute the sample graph from the given VCF" << endl
          << "    -G, --sample-graph FILE subset an augmented graph to a sample graph using a Locus file" << endl
-         << "    -t, --threads N         for tasks that can be done in parallel, use this many threads" << endl;
+         << "    -t, --threads N         for tasks that can be done in parallel, use this many threads" << endl
+         << "    --stream                modify the graph one chunk at a time on all threads, in bounded" << endl
+         << "                            memory; only -r, -I, -D, -E, -K and -y can be used, since the" << endl
+         << "                            other operations need to see the whole graph" << endl
+         << "    --packed                load the graph into a compact packed representation that uses" << endl
+         << "                            much less memory; only -O, -z, -p, -S, -M and -y can be used, and" << endl
+         << "                            paths are dropped as with -D" << endl;
 }
 
 int main_mod(int argc, char** argv) {
@@ -116,7 +145,7 @@ int main_mod(int argc, char** argv) {
     bool retain_complement = false;
     vector<int64_t> root_nodes;
     int32_t context_steps;
-    bool remove_null;
+    bool remove_null = false;
     bool strong_connect = false;
     uint32_t unfold_to = 0;
     bool break_cycles = false;
@@ -133,6 +162,8 @@ int main_mod(int argc, char** argv) {
     string vcf_filename;
     string loci_filename;
     int max_degree = 0;
+    bool stream_chunks = false;
+    bool packed = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -185,6 +216,8 @@ int main_mod(int argc, char** argv) {
             {"sample-vcf", required_argument, 0, 'v'},
             {"sample-graph", required_argument, 0, 'G'},
             {"max-degree", required_argument, 0, 'M'},
+            {"stream", no_argument, 0, OPT_STREAM},
+            {"packed", no_argument, 0, OPT_PACKED},
             {0, 0, 0, 0}
         };
 
@@ -377,6 +410,14 @@ int main_mod(int argc, char** argv) {
             max_degree = atoi(optarg);
             break;
 
+        case OPT_STREAM:
+            stream_chunks = true;
+            break;
+
+        case OPT_PACKED:
+            packed = true;
+            break;
+
         case 'h':
         case '?':
             help_mod(argv);
@@ -388,6 +429,159 @@ int main_mod(int argc, char** argv) {
         }
     }
 
+    if (stream_chunks && packed) {
+        cerr << "error:[vg mod] --stream and --packed can't be used together" << endl;
+        return 1;
+    }
+
+    if (stream_chunks) {
+        // Each chunk holds some nodes, the edges on them, and the path
+        // mappings that visit them, so only operations that can be done
+        // without looking past those can be streamed
+        vector<pair<bool, string>> whole_graph_options {
+            {!aln_file.empty(), "-i"}, {!loci_file.empty(), "-q/-Q"}, {compact_ids, "-c"},
+            {compact_ranks, "-C"}, {sort_graph, "-z"}, {break_cycles, "-b"}, {normalize_graph, "-n"},
+            {until_normal_iter != 0, "-U"}, {simplify_graph, "-s"}, {strong_connect, "-T"},
+            {dagify_steps != 0, "-d"}, {dagify_to != 0, "-w"}, {unfold_to != 0, "-f"},
+            {orient_forward, "-O"}, {!path_name.empty(), "-k"}, {remove_non_path, "-N"},
+            {remove_path, "-A"}, {remove_orphans, "-o"}, {remove_null, "-R"}, {!root_nodes.empty(), "-g"},
+            {prune_complex, "-p"}, {prune_subgraphs, "-S"}, {chop_to != 0, "-X"}, {unchop, "-u"},
+            {max_degree != 0, "-M"}, {add_start_and_end_markers, "-m"}, {bluntify, "-B"}, {cactus, "-a"},
+            {!vcf_filename.empty(), "-v"}, {!loci_filename.empty(), "-G"}
+        };
+        for (auto& option : whole_graph_options) {
+            if (option.first) {
+                cerr << "error:[vg mod] " << option.second << " needs the whole graph and can't be used with --stream" << endl;
+                return 1;
+            }
+        }
+        
+        auto modify_chunk = [&](Graph& chunk) {
+            if (!paths_to_retain.empty() || retain_complement) {
+                keep_items(*chunk.mutable_path(), [&](const Path& path) {
+                    return (bool) paths_to_retain.count(path.name()) != retain_complement;
+                });
+            }
+            if (drop_paths) {
+                chunk.clear_path();
+            }
+            if (flip_doubly_reversed_edges) {
+                for (size_t i = 0; i < chunk.edge_size(); i++) {
+                    Edge* edge = chunk.mutable_edge(i);
+                    if (edge->from_start() && edge->to_end()) {
+                        id_t from = edge->from();
+                        edge->set_from(edge->to());
+                        edge->set_to(from);
+                        edge->set_from_start(false);
+                        edge->set_to_end(false);
+                    }
+                }
+            }
+            if (kill_labels) {
+                for (size_t i = 0; i < chunk.node_size(); i++) {
+                    chunk.mutable_node(i)->clear_sequence();
+                }
+            }
+            if (destroy_node_id > 0) {
+                // The node's edges may be stored with its neighbors, in other
+                // chunks, but they name it, so they can go wherever they are
+                keep_items(*chunk.mutable_node(), [&](const Node& node) {
+                    return node.id() != destroy_node_id;
+                });
+                keep_items(*chunk.mutable_edge(), [&](const Edge& edge) {
+                    return edge.from() != destroy_node_id && edge.to() != destroy_node_id;
+                });
+            }
+        };
+        
+        // Collect a batch of chunks, modify them in parallel, and write them
+        // out in the order they came in
+        size_t batch_size = STREAM_CHUNKS_PER_THREAD * get_thread_count();
+        vector<Graph> batch;
+        batch.reserve(batch_size);
+        auto flush_batch = [&]() {
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = 0; i < batch.size(); i++) {
+                modify_chunk(batch[i]);
+            }
+            if (!batch.empty()) {
+                stream::write_buffered(cout, batch, 0);
+            }
+        };
+        function<void(Graph&)> handle_chunk = [&](Graph& chunk) {
+            batch.emplace_back();
+            batch.back().Swap(&chunk);
+            if (batch.size() == batch_size) {
+                flush_batch();
+            }
+        };
+        function<void(uint64_t)> no_count = [](uint64_t count) { };
+        get_input_file(optind, argc, argv, [&](istream& in) {
+            stream::for_each_ordered_parallel(in, handle_chunk, no_count);
+        });
+        flush_batch();
+        cout.flush();
+        
+        return 0;
+    }
+
+    if (packed) {
+        // PackedGraph has no paths and none of VG's Protobuf-level editing,
+        // so only the operations written against handles can run on it
+        vector<pair<bool, string>> vg_options {
+            {!aln_file.empty(), "-i"}, {!loci_file.empty(), "-q/-Q"},
+            {compact_ids, "-c"}, {compact_ranks, "-C"}, {break_cycles, "-b"}, {normalize_graph, "-n"},
+            {until_normal_iter != 0, "-U"}, {flip_doubly_reversed_edges, "-E"}, {simplify_graph, "-s"},
+            {strong_connect, "-T"}, {dagify_steps != 0, "-d"}, {dagify_to != 0, "-w"}, {unfold_to != 0, "-f"},
+            {!paths_to_retain.empty() || retain_complement, "-r/-I"}, {!path_name.empty(), "-k"},
+            {remove_non_path, "-N"}, {remove_path, "-A"}, {remove_orphans, "-o"}, {remove_null, "-R"},
+            {!root_nodes.empty(), "-g"}, {chop_to != 0, "-X"},
+            {unchop, "-u"}, {kill_labels, "-K"}, {add_start_and_end_markers, "-m"}, {bluntify, "-B"},
+            {cactus, "-a"}, {!vcf_filename.empty(), "-v"}, {!loci_filename.empty(), "-G"}
+        };
+        for (auto& option : vg_options) {
+            if (option.first) {
+                cerr << "error:[vg mod] " << option.second << " can't be used with --packed" << endl;
+                return 1;
+            }
+        }
+        
+        PackedGraph* packed_graph;
+        get_input_file(optind, argc, argv, [&](istream& in) {
+            packed_graph = new PackedGraph(in);
+        });
+        
+        // same order as for a VG
+        if (orient_forward) {
+            algorithms::orient_nodes_forward(packed_graph);
+        }
+        if (sort_graph) {
+            algorithms::sort(packed_graph);
+        }
+        if (prune_complex) {
+            if (!(path_length > 0 && edge_max > 0)) {
+                cerr << "[vg mod]: when pruning complex regions you must specify a --path-length and --edge-max" << endl;
+                return 1;
+            }
+            prune_complex_with_head_tail(*packed_graph, path_length, edge_max);
+        }
+        if (max_degree) {
+            algorithms::remove_high_degree_nodes(*packed_graph, max_degree);
+        }
+        if (prune_subgraphs) {
+            prune_short_subgraphs(*packed_graph, path_length);
+        }
+        if (destroy_node_id > 0 && packed_graph->has_node(destroy_node_id)) {
+            packed_graph->destroy_handle(packed_graph->get_handle(destroy_node_id));
+        }
+        
+        packed_graph->serialize_to_ostream(cout);
+        
+        delete packed_graph;
+        
+        return 0;
+    }
+
     VG* graph;
     get_input_file(optind, argc, argv, [&](istream& in) {
         graph = new VG(in);
@@ -645,19 +839,19 @@ int main_mod(int argc, char** argv) {
     }
 
     if (unchop) {
-        graph->unchop();
+        graph->apply_to_components_parallel([](VG& component) { component.unchop(); });
     }
 
     if (simplify_graph) {
-        graph->simplify_siblings();
+        graph->apply_to_components_parallel([](VG& component) { component.simplify_siblings(); });
     }
 
     if (normalize_graph) {
-        graph->normalize();
+        graph->apply_to_components_parallel([](VG& component) { component.normalize(); });
     }
 
     if (until_normal_iter) {
-        graph->normalize(until_normal_iter);
+        graph->apply_to_components_parallel([&](VG& component) { component.normalize(until_normal_iter); });
     }
 
     if (strong_connect) {
@@ -829,7 +1023,7 @@ int main_mod(int argc, char** argv) {
     }
 
     if (chop_to) {
-        graph->dice_nodes(chop_to);
+        graph->apply_to_components_parallel([&](VG& component) { component.dice_nodes(chop_to); });
         graph->paths.compact_ranks();
     }
 
@@ -10,6 +10,8 @@
 
 #include "../multipath_mapper.hpp"
 #include "../path.hpp"
+#include "../mapping_server.hpp"
+#include "../huge_pages.hpp"
 
 //#define record_read_run_times
 
@@ -31,7 +33,9 @@ void help_mpmap(char** argv) {
     << "basic options:" << endl
     << "graph/index:" << endl
     << "  -x, --xg-name FILE        use this xg index (required)" << endl
-    << "  -g, --gcsa-name FILE      use this GCSA2/LCP index pair (required; both FILE and FILE.lcp)" << endl
+    << "  -g, --gcsa-name FILE      use this GCSA2/LCP index pair (required without --minimizer-name; both FILE and FILE.lcp)" << endl
+    << "      --minimizer-name FILE seed with this minimizer index from vg minimizer instead of the GCSA2" << endl
+    << "      --dist-name FILE      look up clustering distances in this distance index from vg index -j" << endl
     << "  -H, --gbwt-name FILE      use this GBWT haplotype index for population-based MAPQs" << endl
     << "      --linear-index FILE   use this sublinear Li and Stephens index file for population-based MAPQs" << endl
     << "      --linear-path PATH    use the given path name as the path that the linear index is against" << endl
@@ -53,6 +57,7 @@ void help_mpmap(char** argv) {
     << "  -X, --snarl-max-cut INT   do not align to alternate paths in a snarl if an exact match is at least this long (0 for no limit) [5]" << endl
     << "  -a, --alt-paths INT       align to (up to) this many alternate paths in between MEMs or in snarls [4]" << endl
     << "  -n, --unstranded          use lazy strand consistency when clustering MEMs" << endl
+    << "  --sweep-cluster           cluster MEM hits by approximate position before probing random pairs (faster on repetitive reads)" << endl
     << "  -b, --frag-sample INT     look for this many unambiguous mappings to estimate the fragment length distribution [1000]" << endl
     << "  -I, --frag-mean           mean for fixed fragment length distribution" << endl
     << "  -D, --frag-stddev         standard deviation for fixed fragment length distribution" << endl
@@ -61,6 +66,7 @@ void help_mpmap(char** argv) {
     << "  -v, --mq-method OPT       mapping quality method: 0 - none, 1 - fast approximation, 2 - adaptive, 3 - exact [2]" << endl
     << "  -Q, --mq-max INT          cap mapping quality estimates at this much [60]" << endl
     << "  -p, --band-padding INT    pad dynamic programming bands in inter-MEM alignment by this much [2]" << endl
+    << "  --xdrop                   stop inter-MEM alignment where the score drops by more than a 100bp gap would cost" << endl
     << "  -u, --map-attempts INT    perform (up to) this many mappings per read (0 for no limit) [24 paired / 48 unpaired]" << endl
     << "  -O, --max-paths INT       consider (up to) this many paths per alignment for population consistency scoring, 0 to disable [10]" << endl
     << "  -M, --max-multimaps INT   report (up to) this many mappings per read [1]" << endl
@@ -72,6 +78,7 @@ void help_mpmap(char** argv) {
     << "  -d, --max-dist-error INT  maximum typical deviation between distance on a reference path and distance in graph [8]" << endl
     << "  -w, --approx-exp FLOAT    let the approximate likelihood miscalculate likelihood ratios by this power [6.5]" << endl
     << "  -C, --drop-subgraph FLOAT drop alignment subgraphs whose MEMs cover this fraction less of the read than the best subgraph [0.2]" << endl
+    << "  --prune-dominated FLOAT   stop aligning subgraphs once their MEM coverage shows they can't lower the MAPQ by more than this" << endl
     << "  -U, --prune-exp FLOAT     prune MEM anchors if their approximate likelihood is this root less than the optimal anchors [1.25]" << endl
     << "scoring:" << endl
     << "  -q, --match INT           use this match score [1]" << endl
@@ -83,7 +90,21 @@ void help_mpmap(char** argv) {
     << "  -m, --remove-bonuses      remove full length alignment bonuses in reported scores" << endl
     << "computational parameters:" << endl
     << "  -t, --threads INT         number of compute threads to use" << endl
-    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl;
+    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl
+    << "  --compression CODEC       compress the output with gzip, snappy or lz4 (faster, but only vg reads it) [gzip]" << endl
+    << "  --dup-cache INT           reuse the results of up to INT reads for later unpaired reads with the same sequence [0]" << endl
+    << "  --dup-qual-bin INT        with --dup-cache and -A, count base qualities in the same bin of width INT as equal [1]" << endl
+    << "  --max-lf-steps INT        stop reseeding a read after INT LF steps of MEM finding (0 for no limit) [0]" << endl
+    << "  --max-cluster-probes INT  align only the best cluster of a read after INT clustering probes (0 for no limit) [0]" << endl
+    << "  --max-dp-cells INT        align no more clusters of a read after INT DP cells (0 for no limit) [0]" << endl
+    << "  --stage-stats             report the time spent in and calls to each mapping stage, and the --dup-cache hit rate, to stderr" << endl
+    << "  --slow-reads FILE         write reads that take longer than --slow-read-ms to map to FILE as GAM, annotated with" << endl
+    << "                            their stage times and work counts, for mapping them again with -G" << endl
+    << "  --slow-read-ms FLOAT      with --slow-reads, the mapping time that makes a read slow [1000]" << endl
+    << "  --huge-pages MODE         back the XG and GCSA/LCP arrays with huge pages: off, transparent, or hugetlb" << endl
+    << "                            (needs pages reserved with vm.nr_hugepages) [off]" << endl
+    << "  --serve SOCKET            keep the indexes loaded and map the reads sent to this Unix socket, writing the results back," << endl
+    << "                            one client at a time (requires input from - with -f or -G)" << endl;
     
 }
 
@@ -93,13 +114,37 @@ int main_mpmap(int argc, char** argv) {
         help_mpmap(argv);
         return 1;
     }
+    
+    // remember how we were run for --slow-reads, before getopt reorders argv
+    string command_line;
+    for (int i = 0; i < argc; i++) {
+        command_line += (i ? " " : "") + string(argv[i]);
+    }
 
     // initialize parameters with their default options
     #define OPT_SCORE_MATRIX 1000
+    #define OPT_XDROP 1001
+    #define OPT_SWEEP_CLUSTER 1002
+    #define OPT_STAGE_STATS 1003
+    #define OPT_PRUNE_DOMINATED 1004
+    #define OPT_SERVE 1005
+    #define OPT_HUGE_PAGES 1006
+    #define OPT_COMPRESSION 1007
+    #define OPT_MINIMIZER_NAME 1008
+    #define OPT_DUP_CACHE 1009
+    #define OPT_DUP_QUAL_BIN 1010
+    #define OPT_MAX_LF_STEPS 1011
+    #define OPT_MAX_CLUSTER_PROBES 1012
+    #define OPT_MAX_DP_CELLS 1013
+    #define OPT_SLOW_READS 1014
+    #define OPT_SLOW_READ_MS 1015
+    #define OPT_DIST_NAME 1016
     string matrix_file_name;
     string xg_name;
     string gcsa_name;
     string gbwt_name;
+    string minimizer_name;
+    string dist_name;
     string sublinearLS_name;
     string sublinearLS_ref_path;
     string snarls_name;
@@ -135,6 +180,7 @@ int main_mpmap(int argc, char** argv) {
     bool strip_full_length_bonus = false;
     MappingQualityMethod mapq_method = Adaptive;
     int band_padding = 2;
+    bool use_xdrop = false;
     int max_dist_error = 12;
     int num_alt_alns = 4;
     double suboptimal_path_exponent = 1.25;
@@ -151,6 +197,17 @@ int main_mpmap(int argc, char** argv) {
     size_t num_calibration_simulations = 250;
     size_t calibration_read_length = 150;
     bool unstranded_clustering = false;
+    bool sweep_clustering = false;
+    bool stage_stats = false;
+    int dup_cache_size = 0;
+    int dup_quality_bin = 1;
+    int64_t max_lf_steps = 0;
+    int64_t max_cluster_probes = 0;
+    int64_t max_dp_cells = 0;
+    string slow_reads_name;
+    double slow_read_ms = 1000;
+    bool prune_dominated = false;
+    double dominated_mapq_tolerance = 0.0;
     size_t order_length_repeat_hit_max = 3000;
     size_t sub_mem_count_thinning = 4;
     size_t sub_mem_thinning_burn_in = 16;
@@ -167,6 +224,8 @@ int main_mpmap(int argc, char** argv) {
     int secondary_rescue_subopt_diff = 25;
     int min_median_mem_coverage_for_split = 0;
     bool suppress_cluster_merging = false;
+    string serve_socket;
+    HugePageMode huge_page_mode = HugePageMode::OFF;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -190,6 +249,9 @@ int main_mpmap(int argc, char** argv) {
             {"snarl-max-cut", required_argument, 0, 'X'},
             {"alt-paths", required_argument, 0, 'a'},
             {"unstranded", no_argument, 0, 'n'},
+            {"sweep-cluster", no_argument, 0, OPT_SWEEP_CLUSTER},
+            {"stage-stats", no_argument, 0, OPT_STAGE_STATS},
+            {"prune-dominated", required_argument, 0, OPT_PRUNE_DOMINATED},
             {"frag-sample", required_argument, 0, 'b'},
             {"frag-mean", required_argument, 0, 'I'},
             {"frag-stddev", required_argument, 0, 'D'},
@@ -198,6 +260,7 @@ int main_mpmap(int argc, char** argv) {
             {"mq-method", required_argument, 0, 'v'},
             {"mq-max", required_argument, 0, 'Q'},
             {"band-padding", required_argument, 0, 'p'},
+            {"xdrop", no_argument, 0, OPT_XDROP},
             {"map-attempts", required_argument, 0, 'u'},
             {"max-paths", required_argument, 0, 'O'},
             {"max-multimaps", required_argument, 0, 'M'},
@@ -220,6 +283,18 @@ int main_mpmap(int argc, char** argv) {
             {"no-qual-adjust", no_argument, 0, 'A'},
             {"threads", required_argument, 0, 't'},
             {"buffer-size", required_argument, 0, 'Z'},
+            {"serve", required_argument, 0, OPT_SERVE},
+            {"huge-pages", required_argument, 0, OPT_HUGE_PAGES},
+            {"compression", required_argument, 0, OPT_COMPRESSION},
+            {"minimizer-name", required_argument, 0, OPT_MINIMIZER_NAME},
+            {"dist-name", required_argument, 0, OPT_DIST_NAME},
+            {"dup-cache", required_argument, 0, OPT_DUP_CACHE},
+            {"dup-qual-bin", required_argument, 0, OPT_DUP_QUAL_BIN},
+            {"max-lf-steps", required_argument, 0, OPT_MAX_LF_STEPS},
+            {"max-cluster-probes", required_argument, 0, OPT_MAX_CLUSTER_PROBES},
+            {"max-dp-cells", required_argument, 0, OPT_MAX_DP_CELLS},
+            {"slow-reads", required_argument, 0, OPT_SLOW_READS},
+            {"slow-read-ms", required_argument, 0, OPT_SLOW_READ_MS},
             {0, 0, 0, 0}
         };
 
@@ -389,6 +464,81 @@ int main_mpmap(int argc, char** argv) {
                 band_padding = atoi(optarg);
                 break;
                 
+            case OPT_XDROP:
+                use_xdrop = true;
+                break;
+                
+            case OPT_SWEEP_CLUSTER:
+                sweep_clustering = true;
+                break;
+                
+            case OPT_STAGE_STATS:
+                stage_stats = true;
+                break;
+                
+            case OPT_PRUNE_DOMINATED:
+                prune_dominated = true;
+                dominated_mapq_tolerance = atof(optarg);
+                break;
+                
+            case OPT_SERVE:
+                serve_socket = optarg;
+                break;
+                
+            case OPT_HUGE_PAGES:
+                try {
+                    huge_page_mode = parse_huge_page_mode(optarg);
+                } catch (runtime_error& e) {
+                    cerr << "error:[vg mpmap] Unknown huge page mode (--huge-pages) " << optarg << ", choose from off, transparent or hugetlb" << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_COMPRESSION:
+                try {
+                    stream::set_default_codec(stream::parse_codec(optarg));
+                } catch (invalid_argument& e) {
+                    cerr << "error:[vg mpmap] Unknown compression codec (--compression) " << optarg << ", choose from gzip, snappy or lz4" << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_MINIMIZER_NAME:
+                minimizer_name = optarg;
+                break;
+                
+            case OPT_DIST_NAME:
+                dist_name = optarg;
+                break;
+                
+            case OPT_DUP_CACHE:
+                dup_cache_size = atoi(optarg);
+                break;
+                
+            case OPT_DUP_QUAL_BIN:
+                dup_quality_bin = atoi(optarg);
+                break;
+                
+            case OPT_MAX_LF_STEPS:
+                max_lf_steps = atoll(optarg);
+                break;
+                
+            case OPT_MAX_CLUSTER_PROBES:
+                max_cluster_probes = atoll(optarg);
+                break;
+                
+            case OPT_MAX_DP_CELLS:
+                max_dp_cells = atoll(optarg);
+                break;
+                
+            case OPT_SLOW_READS:
+                slow_reads_name = optarg;
+                break;
+                
+            case OPT_SLOW_READ_MS:
+                slow_read_ms = atof(optarg);
+                break;
+                
             case 'u':
                 max_map_attempts_arg = atoi(optarg);
                 // let 0 be a sentinel for no limit and also a sentinel for not giving an arg
@@ -508,6 +658,21 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
+    if (dup_cache_size < 0 || dup_quality_bin <= 0) {
+        cerr << "error:[vg mpmap] --dup-cache must not be negative and --dup-qual-bin must be positive." << endl;
+        exit(1);
+    }
+    
+    if (max_lf_steps < 0 || max_cluster_probes < 0 || max_dp_cells < 0) {
+        cerr << "error:[vg mpmap] --max-lf-steps, --max-cluster-probes and --max-dp-cells must not be negative." << endl;
+        exit(1);
+    }
+    
+    if (slow_read_ms < 0) {
+        cerr << "error:[vg mpmap] --slow-read-ms must not be negative." << endl;
+        exit(1);
+    }
+    
     if (!std::isnan(frag_length_mean) && frag_length_mean < 0) {
         cerr << "error:[vg mpmap] Fragment length mean (-I) must be nonnegative." << endl;
         exit(1);
@@ -533,6 +698,16 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
+    if (!serve_socket.empty() && (fastq_name_1 != "-" && gam_file_name != "-")) {
+        cerr << "error:[vg mpmap] Serving requests (--serve) requires reading from - with -f or -G, to set the input format." << endl;
+        exit(1);
+    }
+    
+    if (!serve_socket.empty() && !fastq_name_2.empty()) {
+        cerr << "error:[vg mpmap] Serving requests (--serve) cannot take paired ends from two files, use interleaved input (-i)." << endl;
+        exit(1);
+    }
+    
     if (!interleaved_input && fastq_name_2.empty() && same_strand) {
         cerr << "warning:[vg mpmap] Ignoring same strand parameter (-d) because no paired end input provided." << endl;
     }
@@ -562,6 +737,11 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
+    if (prune_dominated && dominated_mapq_tolerance < 0.0) {
+        cerr << "error:[vg mpmap] Dominated subgraph MAPQ tolerance (--prune-dominated) set to " << dominated_mapq_tolerance << ", must set to a nonnegative number." << endl;
+        exit(1);
+    }
+
     if (max_map_attempts_arg < 0) {
         cerr << "error:[vg mpmap] Maximum number of mapping attempts (-u) set to " << max_map_attempts_arg << ", must set to a positive integer or 0 for no maximum." << endl;
         exit(1);
@@ -697,8 +877,8 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    if (gcsa_name.empty()) {
-        cerr << "error:[vg mpmap] Multipath mapping requires a GCSA2 index, must provide GCSA2 file" << endl;
+    if (gcsa_name.empty() && minimizer_name.empty()) {
+        cerr << "error:[vg mpmap] Multipath mapping requires a GCSA2 or minimizer index, must provide GCSA2 file" << endl;
         exit(1);
     }
     
@@ -710,16 +890,35 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    ifstream gcsa_stream(gcsa_name);
-    if (!gcsa_stream) {
-        cerr << "error:[vg mpmap] Cannot open GCSA2 file " << gcsa_name << endl;
-        exit(1);
+    ifstream gcsa_stream;
+    ifstream lcp_stream;
+    string lcp_name;
+    if (!gcsa_name.empty()) {
+        gcsa_stream.open(gcsa_name);
+        if (!gcsa_stream) {
+            cerr << "error:[vg mpmap] Cannot open GCSA2 file " << gcsa_name << endl;
+            exit(1);
+        }
+        
+        lcp_name = gcsa_name + ".lcp";
+        lcp_stream.open(lcp_name);
+        if (!lcp_stream) {
+            cerr << "error:[vg mpmap] Cannot open LCP file " << lcp_name << endl;
+            exit(1);
+        }
     }
     
-    string lcp_name = gcsa_name + ".lcp";
-    ifstream lcp_stream(lcp_name);
-    if (!lcp_stream) {
-        cerr << "error:[vg mpmap] Cannot open LCP file " << lcp_name << endl;
+    ifstream minimizer_stream;
+    if (!minimizer_name.empty()) {
+        minimizer_stream.open(minimizer_name);
+        if (!minimizer_stream) {
+            cerr << "error:[vg mpmap] Cannot open minimizer index " << minimizer_name << endl;
+            exit(1);
+        }
+    }
+    
+    if (!dist_name.empty() && !ifstream(dist_name)) {
+        cerr << "error:[vg mpmap] Cannot open distance index " << dist_name << endl;
         exit(1);
     }
 
@@ -738,11 +937,39 @@ int main_mpmap(int argc, char** argv) {
     // Configure its temp directory to the system temp directory
     gcsa::TempFile::setDirectory(temp_file::get_dir());
     
+    if (huge_page_mode != HugePageMode::OFF &&
+        !prepare_huge_pages(huge_page_mode, total_file_size({xg_name, gcsa_name, lcp_name}))) {
+        cerr << "warning:[vg mpmap] Could not reserve huge pages for the indexes, using normal pages" << endl;
+        huge_page_mode = HugePageMode::OFF;
+    }
+    
     xg::XG xg_index(xg_stream);
-    gcsa::GCSA gcsa_index;
-    gcsa_index.load(gcsa_stream);
-    gcsa::LCPArray lcp_array;
-    lcp_array.load(lcp_stream);
+    unique_ptr<gcsa::GCSA> gcsa_index;
+    unique_ptr<gcsa::LCPArray> lcp_array;
+    if (gcsa_stream.is_open()) {
+        gcsa_index = unique_ptr<gcsa::GCSA>(new gcsa::GCSA());
+        gcsa_index->load(gcsa_stream);
+        lcp_array = unique_ptr<gcsa::LCPArray>(new gcsa::LCPArray());
+        lcp_array->load(lcp_stream);
+    }
+    unique_ptr<MinimizerIndex> minimizer_index;
+    if (minimizer_stream.is_open()) {
+        minimizer_index = unique_ptr<MinimizerIndex>(new MinimizerIndex());
+        minimizer_index->load(minimizer_stream);
+    }
+    unique_ptr<SnarlDistanceIndex> distance_index;
+    if (!dist_name.empty()) {
+        distance_index = unique_ptr<SnarlDistanceIndex>(new SnarlDistanceIndex(dist_name));
+    }
+    
+    if (huge_page_mode != HugePageMode::OFF) {
+        size_t advised = finish_huge_pages(huge_page_mode);
+        cerr << "[vg mpmap] Huge page mode " << huge_page_mode_name(huge_page_mode);
+        if (huge_page_mode == HugePageMode::TRANSPARENT) {
+            cerr << ": advised " << advised << " bytes of index memory";
+        }
+        cerr << endl;
+    }
     
     gbwt::GBWT* gbwt = nullptr;
     haplo::linear_haplo_structure* sublinearLS = nullptr;
@@ -784,7 +1011,15 @@ int main_mpmap(int argc, char** argv) {
         snarl_manager = new SnarlManager(snarl_stream);
     }
         
-    MultipathMapper multipath_mapper(&xg_index, &gcsa_index, &lcp_array, haplo_score_provider, snarl_manager);
+    MultipathMapper multipath_mapper(&xg_index, gcsa_index.get(), lcp_array.get(), haplo_score_provider, snarl_manager);
+    multipath_mapper.minimizer_index = minimizer_index.get();
+    multipath_mapper.distance_index = distance_index.get();
+    
+    // use the statistics from vg calibrate, if they were saved with the XG
+    MapperCalibration calibration;
+    if (calibration.load_sidecar(xg_name)) {
+        multipath_mapper.set_calibration(calibration);
+    }
     
     // set alignment parameters
     multipath_mapper.set_alignment_scores(match_score, mismatch_score, gap_open_score, gap_extension_score, full_length_bonus);
@@ -792,6 +1027,45 @@ int main_mpmap(int argc, char** argv) {
     multipath_mapper.adjust_alignments_for_base_quality = qual_adjusted;
     multipath_mapper.strip_bonuses = strip_full_length_bonus;
     multipath_mapper.band_padding = band_padding;
+    multipath_mapper.set_xdrop(use_xdrop);
+    
+    // totals for --stage-stats, with a slot for each mapping thread
+    unique_ptr<StageStats> stage_totals;
+    if (stage_stats) {
+        stage_totals = unique_ptr<StageStats>(new StageStats());
+        multipath_mapper.stage_stats = stage_totals.get();
+    }
+    
+    // reads that take longer than --slow-read-ms
+    ofstream slow_reads_out;
+    unique_ptr<SlowReadLog> slow_read_log;
+    if (!slow_reads_name.empty()) {
+        slow_reads_out.open(slow_reads_name);
+        if (!slow_reads_out) {
+            cerr << "error:[vg mpmap] could not open " << slow_reads_name << " for writing slow reads." << endl;
+            exit(1);
+        }
+        slow_read_log = unique_ptr<SlowReadLog>(new SlowReadLog(slow_reads_out, slow_read_ms / 1000, command_line));
+        multipath_mapper.slow_read_log = slow_read_log.get();
+        if (!stage_totals) {
+            // stage times are only kept for reads while the stages are timed
+            stage_totals = unique_ptr<StageStats>(new StageStats());
+            multipath_mapper.stage_stats = stage_totals.get();
+        }
+    }
+    
+    // results of unpaired reads for --dup-cache
+    unique_ptr<ReadResultCache<MultipathAlignment>> dup_cache;
+    if (dup_cache_size > 0) {
+        dup_cache = unique_ptr<ReadResultCache<MultipathAlignment>>(new ReadResultCache<MultipathAlignment>(dup_cache_size,
+                                                                                                          dup_quality_bin));
+        multipath_mapper.result_cache = dup_cache.get();
+    }
+    
+    // bound the work done on any one read
+    multipath_mapper.max_lf_steps_per_read = max_lf_steps;
+    multipath_mapper.max_cluster_probes_per_read = max_cluster_probes;
+    multipath_mapper.max_dp_cells_per_read = max_dp_cells;
     
     // set mem finding parameters
     multipath_mapper.hit_max = hit_max;
@@ -829,6 +1103,9 @@ int main_mpmap(int argc, char** argv) {
     multipath_mapper.log_likelihood_approx_factor = likelihood_approx_exp;
     multipath_mapper.num_mapping_attempts = max_map_attempts;
     multipath_mapper.unstranded_clustering = unstranded_clustering;
+    multipath_mapper.sweep_clustering = sweep_clustering;
+    multipath_mapper.prune_dominated_clusters = prune_dominated;
+    multipath_mapper.dominated_cluster_mapq_tolerance = dominated_mapq_tolerance;
     multipath_mapper.min_median_mem_coverage_for_split = min_median_mem_coverage_for_split;
     multipath_mapper.suppress_cluster_merging = suppress_cluster_merging;
     
@@ -1138,89 +1415,121 @@ int main_mpmap(int argc, char** argv) {
         return multipath_mapper.has_fixed_fragment_length_distr();
     };
     
-    
-    // FASTQ input
-    if (!fastq_name_1.empty()) {
-        if (interleaved_input) {
-            fastq_paired_interleaved_for_each_parallel_after_wait(fastq_name_1, do_paired_alignments,
-                                                                  multi_threaded_condition);
-        }
-        else if (fastq_name_2.empty()) {
-            fastq_unpaired_for_each_parallel(fastq_name_1, do_unpaired_alignments);
-        }
-        else {
-            fastq_paired_two_files_for_each_parallel_after_wait(fastq_name_1, fastq_name_2, do_paired_alignments,
-                                                                multi_threaded_condition);
-        }
-    }
-    
-    // GAM input
-    if (!gam_file_name.empty()) {
-        function<void(istream&)> execute = [&](istream& gam_in) {
-            if (!gam_in) {
-                cerr << "error:[vg mpmap] Cannot open GAM file " << gam_file_name << endl;
-                exit(1);
-            }
+    // map all the reads from the input, and flush them to stdout, returning the number of reads
+    function<size_t(void)> map_input = [&](void) {
+        size_t num_reads = 0;
+        
+        // FASTQ input
+        if (!fastq_name_1.empty()) {
             if (interleaved_input) {
-                stream::for_each_interleaved_pair_parallel_after_wait(gam_in, do_paired_alignments,
-                                                                      multi_threaded_condition);
+                num_reads = 2 * fastq_paired_interleaved_for_each_parallel_after_wait(fastq_name_1, do_paired_alignments,
+                                                                                      multi_threaded_condition);
+            }
+            else if (fastq_name_2.empty()) {
+                num_reads = fastq_unpaired_for_each_parallel(fastq_name_1, do_unpaired_alignments);
             }
             else {
-                stream::for_each_parallel(gam_in, do_unpaired_alignments);
+                num_reads = 2 * fastq_paired_two_files_for_each_parallel_after_wait(fastq_name_1, fastq_name_2, do_paired_alignments,
+                                                                                    multi_threaded_condition);
             }
-        };
-        get_input_file(gam_file_name, execute);
-    }
+        }
+    
+        // GAM input
+        if (!gam_file_name.empty()) {
+            function<void(uint64_t)> count_reads = [&](uint64_t count) {
+                num_reads += count;
+            };
+            function<void(istream&)> execute = [&](istream& gam_in) {
+                if (!gam_in) {
+                    cerr << "error:[vg mpmap] Cannot open GAM file " << gam_file_name << endl;
+                    exit(1);
+                }
+                if (interleaved_input) {
+                    stream::for_each_interleaved_pair_parallel_after_wait(gam_in, do_paired_alignments,
+                                                                          multi_threaded_condition, count_reads);
+                }
+                else {
+                    stream::for_each_parallel(gam_in, do_unpaired_alignments, count_reads);
+                }
+            };
+            get_input_file(gam_file_name, execute);
+        }
 
-    // take care of any read pairs that we couldn't map unambiguously before the fragment length distribution
-    // had been estimated
-    if (!ambiguous_pair_buffer.empty()) {
-        if (multipath_mapper.has_fixed_fragment_length_distr()) {
+        // take care of any read pairs that we couldn't map unambiguously before the fragment length distribution
+        // had been estimated
+        if (!ambiguous_pair_buffer.empty()) {
+            if (multipath_mapper.has_fixed_fragment_length_distr()) {
 #pragma omp parallel for
-            for (size_t i = 0; i < ambiguous_pair_buffer.size(); i++) {
-                pair<Alignment, Alignment>& aln_pair = ambiguous_pair_buffer[i];
-                // we reverse complemented the alignment on the first pass, so switch back so we don't break
-                // the alignment functions expectations
-                // TODO: slightly wasteful, inelegant
-                if (!same_strand) {
-                    reverse_complement_alignment_in_place(&aln_pair.second,
-                                                          [&](vg::id_t node_id) { return xg_index.node_length(node_id); });
+                for (size_t i = 0; i < ambiguous_pair_buffer.size(); i++) {
+                    pair<Alignment, Alignment>& aln_pair = ambiguous_pair_buffer[i];
+                    // we reverse complemented the alignment on the first pass, so switch back so we don't break
+                    // the alignment functions expectations
+                    // TODO: slightly wasteful, inelegant
+                    if (!same_strand) {
+                        reverse_complement_alignment_in_place(&aln_pair.second,
+                                                              [&](vg::id_t node_id) { return xg_index.node_length(node_id); });
+                    }
+                    do_paired_alignments(aln_pair.first, aln_pair.second);
                 }
-                do_paired_alignments(aln_pair.first, aln_pair.second);
             }
-        }
-        else {
-            cerr << "warning:[vg mpmap] Could not find " << frag_length_sample_size << " unambiguous read pair mappings to estimate fragment length ditribution. Mapping read pairs as independent single-ended reads. Consider decreasing sample size (-b)." << endl;
+            else {
+                cerr << "warning:[vg mpmap] Could not find " << frag_length_sample_size << " unambiguous read pair mappings to estimate fragment length ditribution. Mapping read pairs as independent single-ended reads. Consider decreasing sample size (-b)." << endl;
             
 #pragma omp parallel for
-            for (size_t i = 0; i < ambiguous_pair_buffer.size(); i++) {
-                pair<Alignment, Alignment>& aln_pair = ambiguous_pair_buffer[i];
-                // we reverse complemented the alignment on the first pass, so switch back so we don't break
-                // the alignment function's expectations
-                // TODO: slightly wasteful, inelegant
-                if (!same_strand) {
-                    reverse_complement_alignment_in_place(&aln_pair.second,
-                                                          [&](vg::id_t node_id) { return xg_index.node_length(node_id); });
+                for (size_t i = 0; i < ambiguous_pair_buffer.size(); i++) {
+                    pair<Alignment, Alignment>& aln_pair = ambiguous_pair_buffer[i];
+                    // we reverse complemented the alignment on the first pass, so switch back so we don't break
+                    // the alignment function's expectations
+                    // TODO: slightly wasteful, inelegant
+                    if (!same_strand) {
+                        reverse_complement_alignment_in_place(&aln_pair.second,
+                                                              [&](vg::id_t node_id) { return xg_index.node_length(node_id); });
+                    }
+                    do_independent_paired_alignments(aln_pair.first, aln_pair.second);
                 }
-                do_independent_paired_alignments(aln_pair.first, aln_pair.second);
             }
+            ambiguous_pair_buffer.clear();
         }
-    }
     
-    // flush output buffers
-    for (int i = 0; i < thread_count; i++) {
-        vector<Alignment>& single_path_buffer = single_path_output_buffer[i];
-        stream::write_buffered(cout, single_path_buffer, 0);
+        // flush output buffers
+        for (int i = 0; i < thread_count; i++) {
+            vector<Alignment>& single_path_buffer = single_path_output_buffer[i];
+            stream::write_buffered(cout, single_path_buffer, 0);
         
-        vector<MultipathAlignment>& multipath_buffer = multipath_output_buffer[i];
-        stream::write_buffered(cout, multipath_buffer, 0);
+            vector<MultipathAlignment>& multipath_buffer = multipath_output_buffer[i];
+            stream::write_buffered(cout, multipath_buffer, 0);
+        }
+        cout.flush();
+        
+        return num_reads;
+    };
+    
+    if (serve_socket.empty()) {
+        map_input();
+    }
+    else {
+        // keep everything loaded and map the input from each client that connects
+        MappingServer server(serve_socket);
+        cerr << "[vg mpmap] Serving mapping requests on " << serve_socket << endl;
+        server.serve(map_input, "[vg mpmap] ");
     }
-    cout.flush();
     
 #ifdef record_read_run_times
     read_time_file.close();
 #endif
     
+    if (stage_stats) {
+        stage_totals->report(cerr, "[vg mpmap] ");
+        if (dup_cache) {
+            dup_cache->report(cerr, "[vg mpmap] ");
+        }
+    }
+    
+    if (slow_read_log) {
+        slow_read_log->flush();
+        cerr << "[vg mpmap] wrote " << slow_read_log->logged() << " slow reads to " << slow_reads_name << endl;
+    }
+    
     //cerr << "MEM length filtering efficiency: " << ((double) OrientedDistanceClusterer::MEM_FILTER_COUNTER) / OrientedDistanceClusterer::MEM_TOTAL << " (" << OrientedDistanceClusterer::MEM_FILTER_COUNTER << "/" << OrientedDistanceClusterer::MEM_TOTAL << ")" << endl;
     //cerr << "MEM cluster filtering efficiency: " << ((double) OrientedDistanceClusterer::PRUNE_COUNTER) / OrientedDistanceClusterer::CLUSTER_TOTAL << " (" << OrientedDistanceClusterer::PRUNE_COUNTER << "/" << OrientedDistanceClusterer::CLUSTER_TOTAL << ")" << endl;
     //cerr << "subgraph filtering efficiency: " << ((double) MultipathMapper::PRUNE_COUNTER) / MultipathMapper::SUBGRAPH_TOTAL << " (" << MultipathMapper::PRUNE_COUNTER << "/" << MultipathMapper::SUBGRAPH_TOTAL << ")" << endl;
@@ -60,6 +60,9 @@ void help_msga(char** argv) {
          << "    -Q, --idx-prune-subs N  prune subgraphs shorter than this length from input graph to GCSA (default: off)" << endl
          << "    -m, --node-max N        chop nodes to be shorter than this length (default: 2* --idx-kmer-size)" << endl
          << "    -X, --idx-doublings N   use this many doublings when building the GCSA indexes [2]" << endl
+         << "    -R, --rebuild-frac F    align further sequences to the same indexes, and only edit them into the graph" << endl
+         << "                            and rebuild the indexes once their new sequence is >= F times the indexed" << endl
+         << "                            graph length (0 to rebuild after every sequence) [0]" << endl
          << "graph normalization:" << endl
          << "    -N, --normalize         normalize the graph after assembly" << endl
          << "    -Z, --circularize       the input sequences are from circular genomes, circularize them after inclusion" << endl
@@ -105,7 +108,6 @@ int main_msga(int argc, char** argv) {
     int edge_max = 3;
     int subgraph_prune = 0;
     bool normalize = false;
-    int iter_max = 1;
     int max_mem_length = 0;
     int min_mem_length = 0;
     int max_target_factor = 100;
@@ -132,6 +134,7 @@ int main_msga(int argc, char** argv) {
     bool bigger_first = true;
     bool patch_alignments = true;
     int max_sub_mem_recursion_depth = 2;
+    double rebuild_fraction = 0;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -181,11 +184,12 @@ int main_msga(int argc, char** argv) {
                 {"align-progress", no_argument, 0, 'S'},
                 {"bigger-first", no_argument, 0, 'a'},
                 {"no-patch-aln", no_argument, 0, '8'},
+                {"rebuild-frac", required_argument, 0, 'R'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hf:n:s:g:b:K:X:w:DAc:P:E:Q:NY:H:t:m:M:q:O:I:i:o:y:ZW:z:k:L:e:r:u:l:C:F:SJ:B:a8",
+        c = getopt_long (argc, argv, "hf:n:s:g:b:K:X:w:DAc:P:E:Q:NY:H:t:m:M:q:O:I:i:o:y:ZW:z:k:L:e:r:u:l:C:F:SJ:B:a8R:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -361,6 +365,10 @@ int main_msga(int argc, char** argv) {
             patch_alignments = false;
             break;
 
+        case 'R':
+            rebuild_fraction = atof(optarg);
+            break;
+
         case 'h':
         case '?':
             help_msga(argv);
@@ -609,15 +617,73 @@ int main_msga(int argc, char** argv) {
 
     // todo restructure so that we are trying to map everything
     // add alignment score/bp bounds to catch when we get a good alignment
+
+    // sequences aligned to the indexed graph but not yet edited into it
+    vector<Alignment> pending;
+    // how much of their sequence is new to the indexed graph
+    size_t pending_novel_bp = 0;
+    size_t indexed_length = graph->length();
+
+    // edit the pending alignments into the graph, then rebuild the indexes
+    auto include_pending = [&](void) {
+        vector<Path> paths;
+        vector<string> names;
+        for (auto& aln : pending) {
+            paths.push_back(aln.path());
+            paths.back().set_name(aln.name()); // cache name to trigger inclusion of path elements in graph by edit
+            names.push_back(aln.name());
+        }
+
+        // now take the alignments and modify the graph with them
+        if (debug) cerr << "editing " << paths.size() << " path(s) into graph" << endl;
+        // Modify graph and embed paths
+        graph->edit(paths, true);
+        if (normalize) graph->normalize(10, debug);
+        graph->dice_nodes(node_max);
+        if (debug) cerr << "sorting and compacting ids" << endl;
+        algorithms::sort(graph);
+        graph->compact_ids(); // xg can't work unless IDs are compacted.
+        if (circularize) {
+            if (debug) cerr << "circularizing" << endl;
+            graph->circularize(names);
+        }
+
+        // update the paths
+        graph->graph.clear_path();
+        graph->paths.to_graph(graph->graph);
+        // and rebuild the indexes
+        rebuild(graph);
+        indexed_length = graph->length();
+
+        // verify validity of the paths
+        bool is_valid = graph->is_valid();
+        for (size_t j = 0; j < pending.size(); ++j) {
+            auto& name = names[j];
+            auto path_seq = graph->path_string(graph->paths.path(name));
+            if (path_seq != strings[name] || !is_valid) {
+                cerr << "[vg msga] failed to include alignment" << endl
+                    << "expected " << strings[name] << endl
+                    << "got      " << path_seq << endl
+                    << pb2json(pending[j].path()) << endl
+                    << pb2json(graph->paths.path(name)) << endl;
+                graph->serialize_to_file(name + "-post-edit.vg");
+                ofstream f(name + "-failed-alignment-" + convert(j) + ".gam");
+                stream::write(f, 1, (std::function<Alignment(uint64_t)>)([&](uint64_t n) { return pending[j]; }));
+                f.close();
+                cerr << "[vg msga] Error: failed to include path " << name << endl;
+                exit(1);
+            }
+        }
+
+        pending.clear();
+        pending_novel_bp = 0;
+    };
+
     int i = 0;
     for (auto& name : names_in_order) {
         ++i;
-        //cerr << "do... " << name << " ?" << endl;
         if (!base_seq_name.empty() && name == base_seq_name) continue; // already embedded
-        bool incomplete = true; // complete when we've fully included the sequence set
-        int iter = 0;
         auto& seq = strings[name];
-        //cerr << "doing... " << name << endl;
 #ifdef debug
         {
             graph->serialize_to_file("msga-pre-" + name + ".vg");
@@ -626,103 +692,51 @@ int main_msga(int argc, char** argv) {
             db_out.close();
         }
 #endif
-        while (incomplete && iter++ < iter_max) {
-            stringstream s; s << iter; string iterstr = s.str();
-            if (debug) cerr << name << ": adding to graph " << i << "/" << names_in_order.size() << endl;
-            vector<Path> paths;
-            int j = 0;
-            // align to the graph
-            if (debug) cerr << name << ": aligning " << seq.size() << "bp -> g:"
-                            << graph->length() << "bp "
-                            << "n:" << graph->node_count() << " "
-                            << "e:" << graph->edge_count() << endl;
-            Alignment aln = mapper->align(seq, 0, 0, 0, band_width, band_overlap);
-            aln.set_name(name);
-            if (aln.path().mapping_size()) {
-                auto aln_seq = graph->path_string(aln.path());
-                if (aln_seq != seq) {
-                    cerr << "[vg msga] alignment corrupted, failed to obtain correct banded alignment (alignment seq != input seq)" << endl;
-                    cerr << "expected " << seq << endl;
-                    cerr << "got      " << aln_seq << endl;
-                    ofstream f(name + "-failed-alignment-" + convert(j) + ".gam");
-                    stream::write(f, 1, (std::function<Alignment(uint64_t)>)([&aln](uint64_t n) { return aln; }));
-                    f.close();
-                    graph->serialize_to_file(name + "-corrupted-alignment.vg");
-                    exit(1);
-                }
-            } else {
-                Edit* edit = aln.mutable_path()->add_mapping()->add_edit();
-                edit->set_sequence(aln.sequence());
-                edit->set_to_length(aln.sequence().size());
-            }
-            //if (debug) cerr << pb2json(aln) << endl; // huge in some cases
-            paths.push_back(aln.path());
-            paths.back().set_name(name); // cache name to trigger inclusion of path elements in graph by edit
-
-            /*
-               ofstream f(name + "-pre-edit-" + convert(j) + ".gam");
-               stream::write(f, 1, (std::function<Alignment(uint64_t)>)([&aln](uint64_t n) { return aln; }));
-               f.close();
-               */
-
-            ++j;
-
-            // now take the alignment and modify the graph with it
-            if (debug) cerr << name << ": editing graph" << endl;
-            //graph->serialize_to_file(name + "-pre-edit.vg");
-            // Modify graph and embed paths
-            graph->edit(paths, true);
-            //if (!graph->is_valid()) cerr << "invalid after edit" << endl;
-            //graph->serialize_to_file(name + "-immed-post-edit.vg");
-            if (normalize) graph->normalize(10, debug);
-            graph->dice_nodes(node_max);
-            //if (!graph->is_valid()) cerr << "invalid after dice" << endl;
-            //graph->serialize_to_file(name + "-post-dice.vg");
-            if (debug) cerr << name << ": sorting and compacting ids" << endl;
-            algorithms::sort(graph);
-            //if (!graph->is_valid()) cerr << "invalid after sort" << endl;
-            graph->compact_ids(); // xg can't work unless IDs are compacted.
-            //if (!graph->is_valid()) cerr << "invalid after compact" << endl;
-            if (circularize) {
-                if (debug) cerr << name << ": circularizing" << endl;
-                graph->circularize({name});
-                //graph->serialize_to_file(name + "-post-circularize.vg");
-            }
-
-            // the edit needs to cut nodes at mapping starts and ends
-            // thus allowing paths to be included that map directly to entire nodes
-            // XXX
-
-            //graph->serialize_to_file(name + "-pre-index.vg");
-            // update the paths
-            graph->graph.clear_path();
-            graph->paths.to_graph(graph->graph);
-            // and rebuild the indexes
-            rebuild(graph);
-            //graph->serialize_to_file(convert(i) + "-" + name + "-post.vg");
-
-            // verfy validity of path
-            bool is_valid = graph->is_valid();
-            auto path_seq = graph->path_string(graph->paths.path(name));
-            incomplete = !(path_seq == seq) || !is_valid;
-            if (incomplete) {
-                cerr << "[vg msga] failed to include alignment, retrying " << endl
-                    << "expected " << seq << endl
-                    << "got      " << path_seq << endl
-                    << pb2json(aln.path()) << endl
-                    << pb2json(graph->paths.path(name)) << endl;
-                graph->serialize_to_file(name + "-post-edit.vg");
-                ofstream f(name + "-failed-alignment-" + convert(j) + ".gam");
+        if (debug) cerr << name << ": adding to graph " << i << "/" << names_in_order.size() << endl;
+        // align to the graph
+        if (debug) cerr << name << ": aligning " << seq.size() << "bp -> g:"
+                        << graph->length() << "bp "
+                        << "n:" << graph->node_count() << " "
+                        << "e:" << graph->edge_count() << endl;
+        Alignment aln = mapper->align(seq, 0, 0, 0, band_width, band_overlap);
+        aln.set_name(name);
+        size_t novel_bp = 0;
+        if (aln.path().mapping_size()) {
+            auto aln_seq = graph->path_string(aln.path());
+            if (aln_seq != seq) {
+                cerr << "[vg msga] alignment corrupted, failed to obtain correct banded alignment (alignment seq != input seq)" << endl;
+                cerr << "expected " << seq << endl;
+                cerr << "got      " << aln_seq << endl;
+                ofstream f(name + "-failed-alignment-0.gam");
                 stream::write(f, 1, (std::function<Alignment(uint64_t)>)([&aln](uint64_t n) { return aln; }));
                 f.close();
+                graph->serialize_to_file(name + "-corrupted-alignment.vg");
+                exit(1);
             }
+            for (auto& mapping : aln.path().mapping()) {
+                for (auto& edit : mapping.edit()) {
+                    if (!edit_is_match(edit)) {
+                        novel_bp += edit.to_length();
+                    }
+                }
+            }
+        } else {
+            Edit* edit = aln.mutable_path()->add_mapping()->add_edit();
+            edit->set_sequence(aln.sequence());
+            edit->set_to_length(aln.sequence().size());
+            novel_bp = seq.size();
         }
-        // if (debug && !graph->is_valid()) cerr << "graph is invalid" << endl;
-        if (incomplete && iter >= iter_max) {
-            cerr << "[vg msga] Error: failed to include path " << name << endl;
-            exit(1);
+        pending.push_back(aln);
+        pending_novel_bp += novel_bp;
+
+        // only rebuild once enough new sequence is waiting to go into the graph
+        if (pending_novel_bp >= rebuild_fraction * indexed_length) {
+            include_pending();
         }
     }
+    if (!pending.empty()) {
+        include_pending();
+    }
 
     // auto include_paths = [&mapper,
     //      kmer_size,
@@ -3,6 +3,9 @@
 #include "../utility.hpp"
 #include "../packer.hpp"
 #include "../stream.hpp"
+#include "../columnar_gam.hpp"
+#include "../coverage_matrix.hpp"
+#include "../read_ahead_stream.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -16,11 +19,17 @@ void help_pack(char** argv) {
          << "    -x, --xg FILE          use this basis graph" << endl
          << "    -o, --packs-out FILE   write compressed coverage packs to this output file" << endl
          << "    -i, --packs-in FILE    begin by summing coverage packs from each provided FILE" << endl
-         << "    -g, --gam FILE         read alignments from this file (could be '-' for stdin)" << endl
+         << "    -g, --gam FILE         read alignments from this file, in GAM or GAMC format (could be '-' for GAM on stdin)" << endl
          << "    -d, --as-table         write table on stdout representing packs" << endl
          << "    -e, --with-edits       record and write edits rather than only recording graph-matching coverage" << endl
          << "    -b, --bin-size N       number of sequence bases per CSA bin [default: inf]" << endl
-         << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl;
+         << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl
+         << "coverage matrix options:" << endl
+         << "    -m, --matrix-out FILE  write the coverage of each -i pack, as a sample, to a coverage matrix in FILE" << endl
+         << "    -B, --matrix-bin N     sum the coverage of N bases into each matrix row [default: 1]" << endl
+         << "    -q, --matrix-in FILE   write a table of the coverage of every sample in the matrix in FILE" << endl
+         << "    -R, --range A-B        only write the rows for graph sequence positions A to B-1" << endl
+         << "    -P, --path NAME[:A-B]  write the coverage along positions A to B-1 of the path (needs -x)" << endl;
 }
 
 int main_pack(int argc, char** argv) {
@@ -33,6 +42,12 @@ int main_pack(int argc, char** argv) {
     int thread_count = 1;
     bool record_edits = false;
     size_t bin_size = 0;
+    string matrix_out;
+    size_t matrix_bin_size = 1;
+    string matrix_in;
+    size_t range_start = 0;
+    size_t range_end = numeric_limits<size_t>::max();
+    string path_name;
 
     if (argc == 2) {
         help_pack(argv);
@@ -53,11 +68,16 @@ int main_pack(int argc, char** argv) {
             {"threads", required_argument, 0, 't'},
             {"with-edits", no_argument, 0, 'e'},
             {"bin-size", required_argument, 0, 'b'},
+            {"matrix-out", required_argument, 0, 'm'},
+            {"matrix-bin", required_argument, 0, 'B'},
+            {"matrix-in", required_argument, 0, 'q'},
+            {"range", required_argument, 0, 'R'},
+            {"path", required_argument, 0, 'P'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:o:i:g:dt:eb:",
+        c = getopt_long (argc, argv, "hx:o:i:g:dt:eb:m:B:q:R:P:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -95,6 +115,39 @@ int main_pack(int argc, char** argv) {
         case 't':
             thread_count = atoi(optarg);
             break;
+        case 'm':
+            matrix_out = optarg;
+            break;
+        case 'B':
+            matrix_bin_size = atoll(optarg);
+            break;
+        case 'q':
+            matrix_in = optarg;
+            break;
+        case 'R':
+        case 'P':
+            {
+                // both can take an A-B range, -P after the path name and a colon
+                string range = optarg;
+                if (c == 'P') {
+                    size_t colon = range.rfind(':');
+                    if (colon != string::npos && range.find('-', colon) != string::npos) {
+                        path_name = range.substr(0, colon);
+                        range = range.substr(colon + 1);
+                    } else {
+                        path_name = range;
+                        break;
+                    }
+                }
+                size_t dash = range.find('-');
+                if (dash == string::npos) {
+                    cerr << "error:[vg pack] could not parse range " << range << endl;
+                    return 1;
+                }
+                range_start = atoll(range.substr(0, dash).c_str());
+                range_end = atoll(range.substr(dash + 1).c_str());
+            }
+            break;
 
         default:
             abort();
@@ -103,6 +156,72 @@ int main_pack(int argc, char** argv) {
 
     omp_set_num_threads(thread_count);
 
+    if (!matrix_out.empty()) {
+        // the packs are samples to keep apart, not coverage to add up
+        if (packs_in.empty() || !gam_in.empty() || !packs_out.empty() || write_table) {
+            cerr << "error:[vg pack] a coverage matrix is built from -i packs alone" << endl;
+            return 1;
+        }
+        try {
+            CoverageMatrix::build(packs_in, matrix_out, matrix_bin_size);
+        } catch (const runtime_error& e) {
+            cerr << "error:[vg pack] " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!matrix_in.empty()) {
+        unique_ptr<CoverageMatrix> matrix;
+        try {
+            matrix = unique_ptr<CoverageMatrix>(new CoverageMatrix(matrix_in));
+        } catch (const runtime_error& e) {
+            cerr << "error:[vg pack] " << e.what() << endl;
+            return 1;
+        }
+        auto write_coverage = [&](const vector<uint32_t>& coverage) {
+            for (auto& sample_coverage : coverage) {
+                cout << "\t" << sample_coverage;
+            }
+            cout << "\n";
+        };
+        if (path_name.empty()) {
+            cout << "row\tseq.pos";
+            for (size_t i = 0; i < matrix->sample_count(); i++) {
+                cout << "\t" << matrix->sample_name(i);
+            }
+            cout << endl;
+            matrix->for_each_row(range_start, range_end, [&](size_t row, const vector<uint32_t>& coverage) {
+                cout << row << "\t" << row * matrix->bin_size();
+                write_coverage(coverage);
+            });
+        } else {
+            if (xg_name.empty()) {
+                cerr << "error:[vg pack] coverage along a path needs an XG index" << endl;
+                return 1;
+            }
+            xg::XG xgidx;
+            ifstream in(xg_name.c_str());
+            xgidx.load(in);
+            cout << "path.pos\trow";
+            for (size_t i = 0; i < matrix->sample_count(); i++) {
+                cout << "\t" << matrix->sample_name(i);
+            }
+            cout << endl;
+            try {
+                matrix->for_each_path_position(xgidx, path_name, range_start, range_end,
+                                               [&](size_t offset, size_t row, const vector<uint32_t>& coverage) {
+                    cout << offset << "\t" << row;
+                    write_coverage(coverage);
+                });
+            } catch (const runtime_error& e) {
+                cerr << "error:[vg pack] " << e.what() << endl;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
     xg::XG xgidx;
     if (xg_name.empty()) {
         cerr << "No XG index given. An XG index must be provided." << endl;
@@ -112,9 +231,10 @@ int main_pack(int argc, char** argv) {
         xgidx.load(in);
     }
 
-    // todo one packer per thread and merge
-
-    vg::Packer packer(&xgidx, bin_size);
+    // With several threads, they can all share one packer, unless we have to
+    // merge in existing packs, which needs the per-thread packer model.
+    bool shared_packer = thread_count > 1 && packs_in.empty();
+    vg::Packer packer(&xgidx, bin_size, shared_packer);
     if (packs_in.size() == 1) {
         packer.load_from_file(packs_in.front());
     } else if (packs_in.size() > 1) {
@@ -123,7 +243,7 @@ int main_pack(int argc, char** argv) {
 
     if (!gam_in.empty()) {
         vector<vg::Packer*> packers;
-        if (thread_count == 1) {
+        if (thread_count == 1 || shared_packer) {
             packers.push_back(&packer);
         } else {
             for (size_t i = 0; i < thread_count; ++i) {
@@ -131,16 +251,21 @@ int main_pack(int argc, char** argv) {
             }
         }
         std::function<void(Alignment&)> lambda = [&packer,&record_edits,&packers](Alignment& aln) {
-            packers[omp_get_thread_num()]->add(aln, record_edits);
+            // a single packer is either the only thread's or shared by all
+            packers[packers.size() == 1 ? 0 : omp_get_thread_num()]->add(aln, record_edits);
         };
         if (gam_in == "-") {
             stream::for_each_parallel(std::cin, lambda);
         } else {
-            ifstream gam_stream(gam_in);
-            stream::for_each_parallel(gam_stream, lambda);
-            gam_stream.close();
+            ReadAheadFileStream gam_stream(gam_in);
+            if (stream::is_columnar_gam(gam_stream)) {
+                // we only need the paths
+                stream::for_each_columnar_parallel(gam_stream, lambda, stream::COLUMN_PATH);
+            } else {
+                stream::for_each_parallel(gam_stream, lambda);
+            }
         }
-        if (thread_count == 1) {
+        if (packers.size() == 1) {
             packers.clear();
         } else {
             packer.merge_from_dynamic(packers);
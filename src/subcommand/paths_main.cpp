@@ -14,6 +14,9 @@
 
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../alignment.hpp"
+#include "../stream.hpp"
+#include "../utility.hpp"
 #include <gbwt/dynamic_gbwt.h>
 
 using namespace std;
@@ -29,15 +32,73 @@ void help_paths(char** argv) {
          << "    -g, --gbwt FILE       use the GBWT index in FILE" << endl
          << "  inspection:" << endl
          << "    -X, --extract-gam     return (as GAM alignments) the stored paths in the graph" << endl
-         << "    -V, --extract-vg      return (as path-only .vg) the queried paths (requires -x -g and -q or -Q)" << endl
+         << "    -V, --extract-vg      return (as path-only .vg) the queried paths (requires -x)" << endl
+         << "    -F, --extract-fasta   return (as FASTA) the sequences of the stored paths in the graph" << endl
         //<< "    -X, --extract         return (as a chunked graph) the stored paths in the graph" << endl
          << "    -L, --list            return (as a list of names, one per line) the path names" << endl
          << "    -T, --threads         return the threads (requires GBWT)" << endl
          << "    -q, --threads-by STR  return the threads with the given prefix (requires GBWT)" << endl
-         << "    -Q, --paths-by STR    return the paths with the given prefix" << endl;
+         << "    -Q, --paths-by STR    return the paths with the given prefix" << endl
+         << "  computation:" << endl
+         << "    -t, --thread-count N  extract paths from an xg index on N threads" << endl;
     //<< "    -s, --as-seqs         write each path as a sequence" << endl;
 }
 
+/// How many paths each thread extracts before they are all written out
+const size_t PATHS_BATCH_PER_THREAD = 4;
+
+/// Make the alignments for the given number of paths in parallel batches, and
+/// write them to cout in order as GAM, as path-only graphs or as FASTA.
+static void write_paths(size_t count, const function<Alignment(size_t)>& get_alignment,
+                        bool as_gam, bool as_vg, bool as_fasta) {
+    size_t batch_size = PATHS_BATCH_PER_THREAD * get_thread_count();
+    vector<Alignment> batch;
+    vector<Graph> graphs;
+    for (size_t start = 0; start < count; start += batch_size) {
+        batch.resize(min(batch_size, count - start));
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch.size(); i++) {
+            batch[i] = get_alignment(start + i);
+        }
+        if (as_gam) {
+            write_alignments(cout, batch);
+        } else if (as_vg) {
+            graphs.resize(batch.size());
+            for (size_t i = 0; i < batch.size(); i++) {
+                *graphs[i].add_path() = move(*batch[i].mutable_path());
+            }
+            stream::write_buffered(cout, graphs, 0);
+        } else if (as_fasta) {
+            for (auto& aln : batch) {
+                cout << ">" << aln.name() << "\n" << aln.sequence() << "\n";
+            }
+        }
+        batch.clear();
+    }
+    cout.flush();
+}
+
+/// Get a GBWT thread as an alignment, named and with its sequence from the xg.
+static Alignment thread_as_alignment(const xg::XG& xgidx, const gbwt::GBWT& index, int64_t id) {
+    Alignment aln;
+    aln.set_name(xgidx.thread_name(id));
+    Path* path = aln.mutable_path();
+    path->set_name(aln.name());
+    string node_sequence;
+    for (auto node : index.extract(gbwt::Path::encode(id-1, false))) {
+        Mapping* m = path->add_mapping();
+        Position* p = m->mutable_position();
+        p->set_node_id(gbwt::Node::id(node));
+        p->set_is_reverse(gbwt::Node::is_reverse(node));
+        xgidx.get_sequence(xgidx.get_handle(p->node_id(), p->is_reverse()), node_sequence);
+        Edit* e = m->add_edit();
+        e->set_to_length(node_sequence.size());
+        e->set_from_length(node_sequence.size());
+        aln.mutable_sequence()->append(node_sequence);
+    }
+    return aln;
+}
+
 int main_paths(int argc, char** argv) {
 
     if (argc == 2) {
@@ -48,6 +109,7 @@ int main_paths(int argc, char** argv) {
     bool as_seqs = false;
     bool extract_as_gam = false;
     bool extract_as_vg = false;
+    bool extract_as_fasta = false;
     bool list_paths = false;
     string xg_file;
     string vg_file;
@@ -67,17 +129,19 @@ int main_paths(int argc, char** argv) {
             {"gbwt", required_argument, 0, 'g'},
             {"extract-gam", no_argument, 0, 'X'},
             {"extract-vg", no_argument, 0, 'V'},
+            {"extract-fasta", no_argument, 0, 'F'},
             {"list", no_argument, 0, 'L'},
             {"max-length", required_argument, 0, 'l'},
             {"as-seqs", no_argument, 0, 's'},
             {"threads-by", required_argument, 0, 'q'},
             {"paths-by", required_argument, 0, 'Q'},
             {"threads", no_argument, 0, 'T'},
+            {"thread-count", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hs:LXv:x:g:q:Q:VT",
+        c = getopt_long (argc, argv, "hs:LXFv:x:g:q:Q:VTt:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -107,6 +171,10 @@ int main_paths(int argc, char** argv) {
             extract_as_vg = true;
             break;
 
+        case 'F':
+            extract_as_fasta = true;
+            break;
+
         case 'L':
             list_paths = true;
             break;
@@ -127,6 +195,10 @@ int main_paths(int argc, char** argv) {
             extract_threads = true;
             break;
 
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'h':
         case '?':
             help_paths(argv);
@@ -158,6 +230,10 @@ int main_paths(int argc, char** argv) {
         } else if (extract_as_gam) {
             vector<Alignment> alns = graph.paths_as_alignments();
             write_alignments(cout, alns);
+        } else if (extract_as_fasta) {
+            for (auto& aln : graph.paths_as_alignments()) {
+                cout << ">" << aln.name() << "\n" << aln.sequence() << "\n";
+            }
         } else if (extract_as_vg) {
             cerr << "[vg paths] Error: vg extraction is only defined for prefix queries against a XG/GBWT index pair" << endl;
             assert(false);
@@ -179,8 +255,8 @@ int main_paths(int argc, char** argv) {
             if (gbwt_file.empty()) {
                 cerr << "[vg paths] Error: thread extraction requires a GBWT" << endl;
                 assert(false);
-            } else if (extract_as_gam == extract_as_vg) {
-                cerr << "[vg paths] Error: thread extraction requires -V or -X to specifiy output format" << endl;
+            } else if (extract_as_gam + extract_as_vg + extract_as_fasta != 1) {
+                cerr << "[vg paths] Error: thread extraction requires -V, -X or -F to specifiy output format" << endl;
                 assert(false);
             }
             gbwt::GBWT index;
@@ -193,53 +269,22 @@ int main_paths(int argc, char** argv) {
             } else if (!thread_prefix.empty()) {
                 thread_ids = xgidx.threads_named_starting(thread_prefix);
             }
-            for (auto& id : thread_ids) {
-                //cerr << "thread_id " << id << endl;
-                gbwt::vector_type sequence = index.extract(gbwt::Path::encode(id-1, false));
-                Path path;
-                path.set_name(xgidx.thread_name(id));
-                for (auto node : sequence) {
-                    Mapping* m = path.add_mapping();
-                    Position* p = m->mutable_position();
-                    p->set_node_id(gbwt::Node::id(node));
-                    p->set_is_reverse(gbwt::Node::is_reverse(node));
-                    Edit* e = m->add_edit();
-                    size_t len = xgidx.node_length(p->node_id());
-                    e->set_to_length(len);
-                    e->set_from_length(len);
-                }
-                if (extract_as_gam) {
-                    vector<Alignment> alns;
-                    alns.emplace_back(xgidx.path_as_alignment(path));
-                    write_alignments(cout, alns);
-                } else if (extract_as_vg) {
-                    Graph g;
-                    *(g.add_path()) = path;
-                    vector<Graph> gb = { g };
-                    stream::write_buffered(cout, gb, 0);
-                }
-            }
-        } else {
-            if (extract_as_gam) {
-                auto alns = xgidx.paths_as_alignments();
-                write_alignments(cout, alns);
-            } else if (!path_prefix.empty()) {
-                vector<Path> got = xgidx.paths_by_prefix(path_prefix);
-                if (extract_as_gam) {
-                    vector<Alignment> alns;
-                    for (auto& path : got) {
-                        alns.emplace_back(xgidx.path_as_alignment(path));
-                    }
-                    write_alignments(cout, alns);
-                } else if (extract_as_vg) {
-                    for(auto& path : got) {
-                        Graph g;
-                        *(g.add_path()) = xgidx.path(path.name());
-                        vector<Graph> gb = { g };
-                        stream::write_buffered(cout, gb, 0);
-                    }
+            write_paths(thread_ids.size(), [&](size_t i) {
+                    return thread_as_alignment(xgidx, index, thread_ids[i]);
+                }, extract_as_gam, extract_as_vg, extract_as_fasta);
+        } else if (extract_as_gam || extract_as_vg || extract_as_fasta) {
+            // Work from the path ranks, so no Path is made until it is written
+            vector<size_t> ranks;
+            if (!path_prefix.empty()) {
+                ranks = xgidx.path_ranks_by_prefix(path_prefix);
+            } else {
+                for (size_t i = 1; i <= xgidx.max_path_rank(); ++i) {
+                    ranks.push_back(i);
                 }
             }
+            write_paths(ranks.size(), [&](size_t i) {
+                    return xgidx.path_as_alignment(ranks[i]);
+                }, extract_as_gam, extract_as_vg, extract_as_fasta);
         }
     } else {
         cerr << "[vg paths] Error: a xg or vg file is required" << endl;
@@ -17,7 +17,9 @@
  * can be used for building a GCSA2 index that maps to the original graph.
  */
 
+#include "../packed_graph.hpp"
 #include "../phase_unfolder.hpp"
+#include "../prune.hpp"
 #include "subcommand.hpp"
 
 #include <gbwt/gbwt.h>
@@ -35,6 +37,7 @@
 using namespace vg;
 using namespace vg::subcommand;
 
+#define OPT_PACKED 1000
 
 enum PruningMode { mode_prune, mode_restore, mode_unfold };
 
@@ -117,6 +120,8 @@ void help_prune(char** argv) {
     std::cerr << "    -m, --mapping FILE     store the node mapping for duplicates in this file" << std::endl;
     std::cerr << "    -a, --append-mapping   append to the existing node mapping (requires -m)" << std::endl;
     std::cerr << "other options:" << std::endl;
+    std::cerr << "    --packed               load the graph into a compact packed representation that" << std::endl;
+    std::cerr << "                           uses much less memory (only with -P)" << std::endl;
     std::cerr << "    -p, --progress         show progress" << std::endl;
     std::cerr << "    -t, --threads N        use N threads (default: " << omp_get_max_threads() << ")" << std::endl;
     std::cerr << "    -d, --dry-run          determine the validity of the parameter combination" << std::endl;
@@ -135,7 +140,7 @@ int main_prune(int argc, char** argv) {
     size_t subgraph_min = 0;
     PruningMode mode = mode_prune;
     int threads = omp_get_max_threads();
-    bool verify_paths = false, append_mapping = false, show_progress = false, dry_run = false;
+    bool verify_paths = false, append_mapping = false, show_progress = false, dry_run = false, packed = false;
     std::string vg_name, gbwt_name, mapping_name;
 
     // Derived variables.
@@ -160,6 +165,7 @@ int main_prune(int argc, char** argv) {
             { "progress", no_argument, 0, 'p' },
             { "threads", required_argument, 0, 't' },
             { "dry-run", no_argument, 0, 'd' },
+            { "packed", no_argument, 0, OPT_PACKED },
             { "help", no_argument, 0, 'h' },
             { 0, 0, 0, 0 }
         };
@@ -218,6 +224,9 @@ int main_prune(int argc, char** argv) {
         case 'd':
             dry_run = true;
             break;
+        case OPT_PACKED:
+            packed = true;
+            break;
 
         case 'h':
         case '?':
@@ -257,6 +266,10 @@ int main_prune(int argc, char** argv) {
             return 1;
         }
     }
+    if (packed && mode != mode_prune) {
+        std::cerr << "[vg prune]: mode " << mode_name(mode) << " can't be used with --packed" << std::endl;
+        return 1;
+    }
     if (mode == mode_restore) {
         if (!(gbwt_name.empty() && mapping_name.empty())) {
             std::cerr << "[vg prune]: mode " << mode_name(mode) << " does not use additional files" << std::endl;
@@ -286,6 +299,9 @@ int main_prune(int argc, char** argv) {
         if (dry_run) {
             std::cerr << " --dry-run";
         }
+        if (packed) {
+            std::cerr << " --packed";
+        }
         std::cerr << std::endl;
         if (!vg_name.empty()) {
             std::cerr << "VG:             " << vg_name << std::endl;
@@ -299,6 +315,30 @@ int main_prune(int argc, char** argv) {
         return 0;
     }
 
+    // Without paths to restore, any graph we can edit through handles will do.
+    if (packed) {
+        PackedGraph* graph;
+        get_input_file(optind, argc, argv, [&](std::istream& in) {
+            graph = new PackedGraph(in);
+        });
+        if (show_progress) {
+            std::cerr << "Original graph " << vg_name << ": " << graph->node_size() << " nodes, " << graph->edge_count() << " edges" << std::endl;
+        }
+        prune_complex_with_head_tail(*graph, kmer_length, edge_max);
+        if (show_progress) {
+            std::cerr << "Pruned complex regions: "
+                      << graph->node_size() << " nodes, " << graph->edge_count() << " edges" << std::endl;
+        }
+        prune_short_subgraphs(*graph, subgraph_min);
+        if (show_progress) {
+            std::cerr << "Removed small subgraphs: "
+                      << graph->node_size() << " nodes, " << graph->edge_count() << " edges" << std::endl;
+        }
+        graph->serialize_to_ostream(std::cout);
+        delete graph; graph = nullptr;
+        return 0;
+    }
+
     // Handle the input.
     VG* graph;
     xg::XG xg_index;
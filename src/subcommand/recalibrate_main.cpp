@@ -11,6 +11,8 @@
 
 #include "../alignment.hpp"
 #include "../vg.hpp"
+#include "../stream.hpp"
+#include "../utility.hpp"
 
 #include <vowpalwabbit/vw.h>
 
@@ -199,14 +201,19 @@ int main_recalibrate(int argc, char** argv) {
                 vw_args += " -i " + model_filename;
             }
             
-            // Make the model
-            vw* model = VW::initialize(vw_args);
-       
-            // Define a buffer for alignments to print
-            vector<Alignment> buf;
+            // VW models aren't safe to share between threads, so give each
+            // thread its own copy of the model, and its own output buffer.
+            size_t thread_count = get_thread_count();
+            vector<vw*> models(thread_count);
+            for (auto& model : models) {
+                model = VW::initialize(vw_args);
+            }
+            vector<vector<Alignment>> buffers(thread_count);
             
             // Specify how to recalibrate an alignment
             function<void(Alignment&)> recalibrate = [&](Alignment& aln) {
+                int tid = omp_get_thread_num();
+                vw* model = models[tid];
                 
                 // Turn each Alignment into a VW-format string
                 string example_string = alignment_to_example_string(aln, false);
@@ -227,6 +234,7 @@ int main_recalibrate(int argc, char** argv) {
                 double clamped = max(0.0, min(60.0, guess));
                
 #ifdef debug
+#pragma omp critical (cerr)
                 cerr << example_string << " -> " << prob << " -> " << guess << " -> " << clamped << endl;
 #endif
                 
@@ -236,29 +244,22 @@ int main_recalibrate(int argc, char** argv) {
                 // Clean up the example
                 VW::finish_example(*model, example);
                 
-                
-                
-#pragma omp critical (buf)
-                {
-                    // Save to the buffer
-                    buf.push_back(aln);
-                    if (buf.size() > 1000) {
-                        // And output if buffer is full
-                        write_alignments(std::cout, buf);
-                        buf.clear();
-                    }
-                }
+                // Save to this thread's buffer, and output if it is full
+                buffers[tid].push_back(aln);
+                stream::write_buffered(cout, buffers[tid], 1000);
             };
             
             // For each read, recalibrate and buffer and maybe print it.
-            // TODO: It would be nice if this could be parallel...
-            stream::for_each(gam_stream, recalibrate);
+            stream::for_each_parallel(gam_stream, recalibrate);
             
-            VW::finish(*model);
+            for (auto& model : models) {
+                VW::finish(*model);
+            }
             
-            // Flush the buffer
-            write_alignments(std::cout, buf);
-            buf.clear();
+            // Flush the buffers
+            for (auto& buffer : buffers) {
+                stream::write_buffered(cout, buffer, 0);
+            }
             cout.flush();
         }
         
@@ -248,25 +248,6 @@ int main_sift(int argc, char** argv){
 
     }
 
-    vector<Alignment> buffer;
-    
-    
-
-    //vector<Alignment> orphaned_selected;
-    vector<Alignment> clean;
-    vector<Alignment> perfect;
-    vector<Alignment> simple_mismatch;
-    vector<Alignment> discordant_selected;
-    vector<Alignment> split_selected;
-    vector<Alignment> reversing_selected;
-    vector<Alignment> clipped_selected;
-    vector<Alignment> one_end_anchored;
-    vector<Alignment> quality_selected;
-    vector<Alignment> insert_selected;
-    vector<Alignment> depth_selected;
-    vector<Alignment> single_bp_diff;
-    vector<Alignment> unmapped_selected;
-
     string unmapped_fn = alignment_file + ".unmapped";
     string discordant_fn = alignment_file + ".discordant";
     string split_fn = alignment_file + ".split";
@@ -317,6 +298,31 @@ int main_sift(int argc, char** argv){
         clipped_stream.open(clipped_fn);
     }
 
+    // Every category a read can be sifted into. Quality and depth have no
+    // output files yet, and neither do clean and perfect, so reads sent to
+    // them are dropped.
+    enum Category { UNMAPPED, DISCORDANT, ONE_END_ANCHORED, INSERT, SPLIT, CLIPPED,
+                    REVERSING, QUALITY, DEPTH, CLEAN, PERFECT, NUM_CATEGORIES };
+    vector<ofstream*> category_streams{&unmapped_stream, &discordant_stream, &oea_stream,
+            &insert_stream, &split_stream, &clipped_stream, &reversing_stream,
+            &quality_stream, &depth_stream, &clean_stream, &perfect_stream};
+
+    // Each thread collects its own reads for each category, so sifting takes
+    // no locks until a buffer is full. Then write_buffered compresses it in
+    // the thread and only takes turns with other threads to append the
+    // finished bytes.
+    const size_t buffer_limit = 1000;
+    vector<vector<vector<Alignment>>> selected(get_thread_count(),
+                                               vector<vector<Alignment>>(NUM_CATEGORIES));
+    auto select = [&](Category category, const Alignment& aln) {
+        if (!category_streams[category]->is_open()) {
+            return;
+        }
+        auto& buffer = selected[omp_get_thread_num()][category];
+        buffer.push_back(aln);
+        stream::write_buffered(*category_streams[category], buffer, buffer_limit);
+    };
+
     std::function<bool(Alignment, Alignment)> normalish = [&](Alignment a, Alignment b){
         bool a_forward = true;
         bool b_reverse = false;
@@ -340,136 +346,77 @@ int main_sift(int argc, char** argv){
 
         if (do_unmapped && !flagged){
             if (ff.unmapped_filter(alns_first) && ff.unmapped_filter(alns_second)){
-
-                    #pragma omp critical (unmapped_selected)
-                    {
-                        flagged = true;
-                        alns_first.set_read_mapped(false);
-                        alns_first.set_mate_unmapped(true);
-                        alns_second.set_read_mapped(false);
-                        alns_second.set_mate_unmapped(false);
-                        unmapped_selected.push_back(alns_first);
-                        unmapped_selected.push_back(alns_second);
-                        
-                    }
-                }
+                flagged = true;
+                alns_first.set_read_mapped(false);
+                alns_first.set_mate_unmapped(true);
+                alns_second.set_read_mapped(false);
+                alns_second.set_mate_unmapped(false);
+                select(UNMAPPED, alns_first);
+                select(UNMAPPED, alns_second);
+            }
         }
 
         if (do_orientation && !flagged){
-            
             ret = ff.pair_orientation_filter(alns_first, alns_second);
             if (ret){
-                #pragma omp critical (discordant_selected)
-            {
                 flagged = true;
-                discordant_selected.push_back(alns_first);
-                discordant_selected.push_back(alns_second);
-            }
+                select(DISCORDANT, alns_first);
+                select(DISCORDANT, alns_second);
             }
-            
-
         }
         if (do_oea && !flagged){
             ret = ff.one_end_anchored_filter(alns_first, alns_second);
             if (ret){
-                #pragma omp critical (oea_selected)
-                {
-                    one_end_anchored.push_back(alns_first);
-                    one_end_anchored.push_back(alns_second);
-                }
+                select(ONE_END_ANCHORED, alns_first);
+                select(ONE_END_ANCHORED, alns_second);
             }
-            
-
         }
         if (do_insert_size && !flagged){
-            
             ret = ff.insert_size_filter(alns_first, alns_second);
             if (ret){
-                #pragma omp critial (insert_selected)
-                {
-                    insert_selected.push_back(alns_first);
-                    insert_selected.push_back(alns_second);
-                }
+                select(INSERT, alns_first);
+                select(INSERT, alns_second);
             }
-            
-
-
         }
         if (do_split_read && !flagged){
-
             if (ff.split_read_filter(alns_first)){
-                #pragma omp critical (split_selected)
-                {
-                    split_selected.push_back(alns_first);
-                    split_selected.push_back(alns_second);
-                    flagged = true;
-
-                }
-                
+                select(SPLIT, alns_first);
+                select(SPLIT, alns_second);
+                flagged = true;
             }
             if (ff.split_read_filter(alns_second)){
-                #pragma omp critical (split_selected)
-                {
-                    split_selected.push_back(alns_first);
-                    split_selected.push_back(alns_second);
-                    flagged = true;
-
-                }
+                select(SPLIT, alns_first);
+                select(SPLIT, alns_second);
+                flagged = true;
             }
-            
-
         }
         if (do_reversing && !flagged){
             Alignment x = ff.reversing_filter(alns_first);
             Alignment y = ff.reversing_filter(alns_second);
             if (x.name() != "" || y.name() != ""){
-               #pragma omp critical (reversing_selected)
-               {
-                   reversing_selected.push_back(alns_first);
-                   reversing_selected.push_back(alns_second);
-               }
+                select(REVERSING, alns_first);
+                select(REVERSING, alns_second);
             }
-       
-
-
         }
         if (do_softclip && !flagged){
-
             bool x = ff.soft_clip_filter(alns_first);
             bool y = ff.soft_clip_filter(alns_second);
             if (x){
-                #pragma omp critical (clipped_selected)
-                {
-                    clipped_selected.push_back(alns_first);
-                    flagged = true;
-                }
+                select(CLIPPED, alns_first);
+                flagged = true;
             } 
             if (y){
-                #pragma omp critical (clipped_selected)
-                {
-                    flagged = true;
-                    clipped_selected.push_back(alns_second);
-                }
+                flagged = true;
+                select(CLIPPED, alns_second);
             } 
-
         }
         if (do_quality && !flagged){
-
-            #pragma omp critical (quality_selected)
-            {
-                quality_selected.push_back(alns_first);
-                quality_selected.push_back(alns_second);
-            }
-
+            select(QUALITY, alns_first);
+            select(QUALITY, alns_second);
         }
         if (do_depth && !flagged){
-
-            #pragma omp critical (depth_selected)
-            {
-                depth_selected.push_back(alns_first);
-                depth_selected.push_back(alns_second);
-            }
-            
+            select(DEPTH, alns_first);
+            select(DEPTH, alns_second);
         }
         if (!flagged){
             // Check if read is perfect
@@ -479,46 +426,29 @@ int main_sift(int argc, char** argv){
             }
             else{
                 // otherwise, it's pretty clean, so place it in the clean pile.
-                #pragma omp critical (clean)
-                {
-                    clean.push_back(alns_first);
-                    clean.push_back(alns_second);
-                }
+                select(CLEAN, alns_first);
+                select(CLEAN, alns_second);
             }
-            
         }
-        
-
-        stream::write_buffered(unmapped_stream, unmapped_selected, 100);
-        stream::write_buffered(discordant_stream, discordant_selected, 100);
-        stream::write_buffered(oea_stream, one_end_anchored, 100);
-        stream::write_buffered(insert_stream, insert_selected, 100);
-        stream::write_buffered(split_stream, split_selected, 100);
-        stream::write_buffered(clipped_stream, clipped_selected, 100);
-        stream::write_buffered(clean_stream, clean, 100);
-        stream::write_buffered(reversing_stream, reversing_selected, 100);
-        stream::write_buffered(perfect_stream, perfect, 100);
     };
 
     std::function<void(Alignment&)> single_filters = [&](Alignment& aln){
         if (do_split_read){
-            split_selected.push_back(aln);
+            select(SPLIT, aln);
         }
         if (do_reversing){
-            reversing_selected.push_back(aln);
+            select(REVERSING, aln);
         }
         if (do_softclip){
            if (ff.soft_clip_filter(aln)){
-                clipped_selected.push_back(aln);
+                select(CLIPPED, aln);
            }
-           //stream::write_buffered(clipped_stream, clipped_selected, 1000);
-
         }
         if (do_quality){
-            quality_selected.push_back(aln);
+            select(QUALITY, aln);
         }
         if (do_depth){
-            depth_selected.push_back(aln);
+            select(DEPTH, aln);
         }
 
     };
@@ -568,20 +498,14 @@ else{
         help_sift(argv);
     }
 }
-    stream::write_buffered(unmapped_stream, unmapped_selected, 0);
-    stream::write_buffered(discordant_stream, discordant_selected, 0);
-    stream::write_buffered(oea_stream, one_end_anchored, 0);
-    stream::write_buffered(insert_stream, insert_selected, 0);
-    stream::write_buffered(split_stream, split_selected, 0);
-    stream::write_buffered(clipped_stream, clipped_selected, 0);
-    stream::write_buffered(clean_stream, clean, 0);
-    stream::write_buffered(reversing_stream, reversing_selected, 0);
-    stream::write_buffered(perfect_stream, perfect, 0);
-
-    buffer.clear();
-
-
-
+    // Write out whatever each thread has left over
+    for (auto& thread_selected : selected) {
+        for (size_t category = 0; category < NUM_CATEGORIES; category++) {
+            if (category_streams[category]->is_open() && !thread_selected[category].empty()) {
+                stream::write_buffered(*category_streams[category], thread_selected[category], 0);
+            }
+        }
+    }
 
     return 0;
 }
@@ -42,7 +42,9 @@ void help_sim(char** argv) {
          << "    -v, --frag-std-dev FLOAT    use this standard deviation for fragment length estimation" << endl
          << "    -N, --allow-Ns              allow reads to be sampled from the graph with Ns in them" << endl
          << "    -a, --align-out             generate true alignments on stdout rather than reads" << endl
-         << "    -J, --json-out              write alignments in json" << endl;
+         << "    -J, --json-out              write alignments in json" << endl
+         << "    -t, --threads N             simulate on N threads (output does not depend on N)" << endl
+         << "    -u, --unordered             write reads as threads finish them, not in a fixed order" << endl;
 }
 
 int main_sim(int argc, char** argv) {
@@ -71,6 +73,7 @@ int main_sim(int argc, char** argv) {
     string fastq_name;
     // What path should we sample from? Empty string = the whole graph.
     vector<string> path_names;
+    bool unordered = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -95,11 +98,13 @@ int main_sim(int argc, char** argv) {
             {"scale-err", required_argument, 0, 'S'},
             {"frag-len", required_argument, 0, 'p'},
             {"frag-std-dev", required_argument, 0, 'v'},
+            {"threads", required_argument, 0, 't'},
+            {"unordered", no_argument, 0, 'u'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hl:n:s:e:i:fax:Jp:v:Nd:F:P:S:I",
+        c = getopt_long (argc, argv, "hl:n:s:e:i:fax:Jp:v:Nd:F:P:S:It:u",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -177,6 +182,14 @@ int main_sim(int argc, char** argv) {
         case 'v':
             fragment_std_dev = atof(optarg);
             break;
+
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
+        case 'u':
+            unordered = true;
+            break;
             
         case 'h':
         case '?':
@@ -194,9 +207,6 @@ int main_sim(int argc, char** argv) {
         return 1;
     }
 
-    mt19937 rng;
-    rng.seed(seed_val);
-
     xg::XG* xgidx = nullptr;
     ifstream xg_stream(xg_name);
     if(xg_stream) {
@@ -214,22 +224,63 @@ int main_sim(int argc, char** argv) {
         }
     }
 
-    // Make a sample to sample reads with
-    Sampler sampler(xgidx, seed_val, forward_only, reads_may_contain_Ns);
-    
-    // Make a Mapper to score reads, with the default parameters
-    Mapper rescorer(xgidx, nullptr, nullptr);
-    // We define a function to score a generated alignment under the mapper
-    auto rescore = [&] (Alignment& aln) {
-        // Score using exact distance.
-        aln.set_score(rescorer.score_alignment(aln, false));
+    // Reads are simulated in chunks, each from its own stream of random
+    // numbers split off from the seed, so that the reads we make don't depend
+    // on the number of threads or on which thread simulates which chunk. Each
+    // chunk is rendered to its output format on the thread that simulated it.
+    size_t chunk_size = 1000;
+    size_t num_chunks = (num_reads + chunk_size - 1) / chunk_size;
+    int thread_count = omp_get_max_threads();
+
+    // Add a simulated read or pair to a chunk's output
+    auto emit = [&](const vector<Alignment>& alns, vector<Alignment>& gam_buffer, stringstream& text_out) {
+        if (align_out) {
+            if (json_out) {
+                for (auto& aln : alns) {
+                    text_out << pb2json(aln) << endl;
+                }
+            } else {
+                gam_buffer.insert(gam_buffer.end(), alns.begin(), alns.end());
+            }
+        } else if (alns.size() == 2) {
+            text_out << alns.front().sequence() << "\t" << alns.back().sequence() << endl;
+        } else {
+            text_out << alns.front().sequence() << endl;
+        }
+    };
+
+    // Simulate all the chunks, with the given function filling in the output
+    // for the reads of a chunk on a thread
+    auto simulate_chunks = [&](const function<void(size_t, size_t, size_t, vector<Alignment>&, stringstream&)>& simulate) {
+#pragma omp parallel for ordered schedule(dynamic, 1)
+        for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+            size_t first_read = chunk * chunk_size;
+            size_t chunk_end = min(first_read + chunk_size, (size_t) num_reads);
+            vector<Alignment> gam_buffer;
+            stringstream chunk_out;
+            simulate(chunk, first_read, chunk_end, gam_buffer, chunk_out);
+            if (!gam_buffer.empty()) {
+                // compress on this thread
+                stream::write_buffered(chunk_out, gam_buffer, 0);
+            }
+            string rendered = chunk_out.str();
+            if (unordered) {
+#pragma omp critical (cout)
+                cout.write(rendered.data(), rendered.size());
+            } else {
+#pragma omp ordered
+                cout.write(rendered.data(), rendered.size());
+            }
+        }
     };
     
     if (fastq_name.empty()) {
         // Use the fixed error rate sampler
         
-        // Make a sample to sample reads with
+        // Make a sampler for each thread to sample reads with. They all share
+        // a node cache.
         Sampler sampler(xgidx, seed_val, forward_only, reads_may_contain_Ns, path_names);
+        vector<Sampler> samplers(thread_count, sampler);
         
         // Make a Mapper to score reads, with the default parameters
         Mapper rescorer(xgidx, nullptr, nullptr);
@@ -245,77 +296,58 @@ int main_sim(int argc, char** argv) {
         };
         
         size_t max_iter = 1000;
-        int nonce = 1;
-        for (int i = 0; i < num_reads; ++i) {
-            // For each read we are going to generate
-            
-            if (fragment_length) {
-                // fragment_lenght is nonzero so make it two paired reads
-                auto alns = sampler.alignment_pair(read_length, fragment_length, fragment_std_dev, base_error, indel_error);
+        simulate_chunks([&](size_t chunk, size_t first_read, size_t chunk_end,
+                            vector<Alignment>& gam_buffer, stringstream& chunk_out) {
+            Sampler& sampler = samplers[omp_get_thread_num()];
+            sampler.set_stream(chunk, first_read);
+            for (size_t i = first_read; i < chunk_end; ++i) {
+                // For each read we are going to generate
                 
-                size_t iter = 0;
-                while (iter++ < max_iter) {
-                    // For up to max_iter iterations
-                    if (alns.front().sequence().size() < read_length
-                        || alns.back().sequence().size() < read_length) {
-                        // If our read was too short, try again
-                        alns = sampler.alignment_pair(read_length, fragment_length, fragment_std_dev, base_error, indel_error);
-                    }
-                }
-                
-                // write the alignment or its string
-                if (align_out) {
-                    // write it out as requested
+                if (fragment_length) {
+                    // fragment_lenght is nonzero so make it two paired reads
+                    auto alns = sampler.alignment_pair(read_length, fragment_length, fragment_std_dev, base_error, indel_error);
                     
-                    // We will need scores
-                    rescore(alns.front());
-                    rescore(alns.back());
+                    size_t iter = 0;
+                    while (iter++ < max_iter) {
+                        // For up to max_iter iterations
+                        if (alns.front().sequence().size() < read_length
+                            || alns.back().sequence().size() < read_length) {
+                            // If our read was too short, try again
+                            alns = sampler.alignment_pair(read_length, fragment_length, fragment_std_dev, base_error, indel_error);
+                        }
+                    }
                     
-                    if (json_out) {
-                        cout << pb2json(alns.front()) << endl;
-                        cout << pb2json(alns.back()) << endl;
-                    } else {
-                        function<Alignment(uint64_t)> lambda = [&alns](uint64_t n) { return alns[n]; };
-                        stream::write(cout, 2, lambda);
+                    if (align_out) {
+                        // We will need scores
+                        rescore(alns.front());
+                        rescore(alns.back());
                     }
+                    emit(alns, gam_buffer, chunk_out);
                 } else {
-                    cout << alns.front().sequence() << "\t" << alns.back().sequence() << endl;
-                }
-            } else {
-                // Do single-end reads
-                auto aln = sampler.alignment_with_error(read_length, base_error, indel_error);
-                
-                size_t iter = 0;
-                while (iter++ < max_iter) {
-                    // For up to max_iter iterations
-                    if (aln.sequence().size() < read_length) {
-                        // If our read is too short, try again
-                        auto aln_prime = sampler.alignment_with_error(read_length, base_error, indel_error);
-                        if (aln_prime.sequence().size() > aln.sequence().size()) {
-                            // But only keep the new try if it is longer
-                            aln = aln_prime;
+                    // Do single-end reads
+                    auto aln = sampler.alignment_with_error(read_length, base_error, indel_error);
+                    
+                    size_t iter = 0;
+                    while (iter++ < max_iter) {
+                        // For up to max_iter iterations
+                        if (aln.sequence().size() < read_length) {
+                            // If our read is too short, try again
+                            auto aln_prime = sampler.alignment_with_error(read_length, base_error, indel_error);
+                            if (aln_prime.sequence().size() > aln.sequence().size()) {
+                                // But only keep the new try if it is longer
+                                aln = aln_prime;
+                            }
                         }
                     }
-                }
-                
-                // write the alignment or its string
-                if (align_out) {
-                    // write it out as requested
                     
-                    // We will need scores
-                    rescore(aln);
-                    
-                    if (json_out) {
-                        cout << pb2json(aln) << endl;
-                    } else {
-                        function<Alignment(uint64_t)> lambda = [&aln](uint64_t n) { return aln; };
-                        stream::write(cout, 1, lambda);
+                    if (align_out) {
+                        // We will need scores
+                        rescore(aln);
                     }
-                } else {
-                    cout << aln.sequence() << endl;
+                    emit({aln}, gam_buffer, chunk_out);
                 }
             }
-        }
+        });
         
     }
     else {
@@ -323,6 +355,8 @@ int main_sim(int argc, char** argv) {
         
         Aligner aligner(default_match, default_mismatch, default_gap_open, default_gap_extension, 5);
         
+        // Train the error model once, and give each thread its own copy of the
+        // simulator to sample with
         NGSSimulator sampler(*xgidx,
                              fastq_name,
                              interleaved,
@@ -335,51 +369,26 @@ int main_sim(int argc, char** argv) {
                              error_scale_factor,
                              !reads_may_contain_Ns,
                              seed_val);
+        vector<NGSSimulator> samplers(thread_count, sampler);
         
-        if (fragment_length) {
-            for (size_t i = 0; i < num_reads; i++) {
-                pair<Alignment, Alignment> read_pair = sampler.sample_read_pair();
-                read_pair.first.set_score(aligner.score_ungapped_alignment(read_pair.first, strip_bonuses));
-                read_pair.second.set_score(aligner.score_ungapped_alignment(read_pair.second, strip_bonuses));
-                
-                if (align_out) {
-                    if (json_out) {
-                        cout << pb2json(read_pair.first) << endl;
-                        cout << pb2json(read_pair.second) << endl;
-                    }
-                    else {
-                        function<Alignment(uint64_t)> lambda = [&read_pair](uint64_t n) {
-                            return n % 2 == 0 ? read_pair.first : read_pair.second;
-                        };
-                        stream::write(cout, 2, lambda);
-                    }
-                }
-                else {
-                    cout << read_pair.first.sequence() << "\t" << read_pair.second.sequence() << endl;
-                }
-            }
-        }
-        else {
-            for (size_t i = 0; i < num_reads; i++) {
-                Alignment read = sampler.sample_read();
-                read.set_score(aligner.score_ungapped_alignment(read, strip_bonuses));
-                
-                if (align_out) {
-                    if (json_out) {
-                        cout << pb2json(read) << endl;
-                    }
-                    else {
-                        function<Alignment(uint64_t)> lambda = [&read](uint64_t n) {
-                            return read;
-                        };
-                        stream::write(cout, 1, lambda);
-                    }
+        simulate_chunks([&](size_t chunk, size_t first_read, size_t chunk_end,
+                            vector<Alignment>& gam_buffer, stringstream& chunk_out) {
+            NGSSimulator& sampler = samplers[omp_get_thread_num()];
+            sampler.set_stream(chunk, first_read);
+            for (size_t i = first_read; i < chunk_end; i++) {
+                if (fragment_length) {
+                    pair<Alignment, Alignment> read_pair = sampler.sample_read_pair();
+                    read_pair.first.set_score(aligner.score_ungapped_alignment(read_pair.first, strip_bonuses));
+                    read_pair.second.set_score(aligner.score_ungapped_alignment(read_pair.second, strip_bonuses));
+                    emit({read_pair.first, read_pair.second}, gam_buffer, chunk_out);
                 }
                 else {
-                    cout << read.sequence() << endl;
+                    Alignment read = sampler.sample_read();
+                    read.set_score(aligner.score_ungapped_alignment(read, strip_bonuses));
+                    emit({read}, gam_buffer, chunk_out);
                 }
             }
-        }
+        });
     }
     
 
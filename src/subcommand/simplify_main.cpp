@@ -27,7 +27,7 @@ void help_simplify(char** argv) {
          << "    -p, --progress         show progress" << endl
          << "    -b, --bed-in           read in the given BED file in the cordinates of the original paths" << endl
          << "    -B, --bed-out          output transformed features in the coordinates of the new paths" << endl
-         << "    -t, --threads N        use N threads to construct graph (defaults to numCPUs)" << endl;
+         << "    -t, --threads N        use N threads to find replacements (defaults to numCPUs)" << endl;
 }
 
 int main_simplify(int argc, char** argv) {
@@ -13,6 +13,7 @@
 #include "../vg.hpp"
 #include "vg.pb.h"
 #include "../traversal_finder.hpp"
+#include "../snarl_tree_index.hpp"
 
 
 using namespace std;
@@ -29,7 +30,9 @@ void help_snarl(char** argv) {
          << "    -o, --top-level        restrict traversals to top level ultrabubbles" << endl
          << "    -m, --max-nodes N      only compute traversals for snarls with <= N nodes [10]" << endl
          << "    -t, --include-trivial  report snarls that consist of a single edge" << endl
-         << "    -s, --sort-snarls      return snarls in sorted order by node ID (for topologically ordered graphs)" << endl;
+         << "    -s, --sort-snarls      return snarls in sorted order by node ID (for topologically ordered graphs)" << endl
+         << "    -A, --algorithm NAME   compute snarls using 'cactus' or 'integrated' [cactus]" << endl
+         << "    -T, --tree-index FILE  also write a compact, mappable snarl tree index to FILE" << endl;
 }
 
 int main_snarl(int argc, char** argv) {
@@ -48,6 +51,8 @@ int main_snarl(int argc, char** argv) {
     bool filter_trivial_snarls = true;
     bool sort_snarls = false;
     bool fill_path_names = false;
+    string algorithm = "cactus";
+    string tree_index_file;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -61,12 +66,14 @@ int main_snarl(int argc, char** argv) {
                 {"max-nodes", required_argument, 0, 'm'},
                 {"include-trivial", no_argument, 0, 't'},
                 {"sort-snarls", no_argument, 0, 's'},
+                {"algorithm", required_argument, 0, 'A'},
+                {"tree-index", required_argument, 0, 'T'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "sr:ltopm:h?",
+        c = getopt_long (argc, argv, "sr:ltopm:A:T:h?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -102,6 +109,14 @@ int main_snarl(int argc, char** argv) {
         case 'p':
             fill_path_names = true;
             break;
+
+        case 'A':
+            algorithm = optarg;
+            break;
+
+        case 'T':
+            tree_index_file = optarg;
+            break;
             
         case 'h':
         case '?':
@@ -116,6 +131,11 @@ int main_snarl(int argc, char** argv) {
         }
     }
 
+    if (algorithm != "cactus" && algorithm != "integrated") {
+        cerr << "error:[vg snarl]: Unknown snarl finding algorithm \"" << algorithm << "\"" << endl;
+        return 1;
+    }
+
     // Prepare traversal output stream
     ofstream trav_stream;
     if (!traversal_file.empty()) {
@@ -138,13 +158,33 @@ int main_snarl(int argc, char** argv) {
         exit(1);
     }
 
-    // The only implemented snarl finder:
-    SnarlFinder* snarl_finder = new CactusSnarlFinder(*graph);
+    SnarlFinder* snarl_finder;
+    if (algorithm == "integrated") {
+        snarl_finder = new IntegratedSnarlFinder(*graph);
+    } else {
+        snarl_finder = new CactusSnarlFinder(*graph);
+    }
     
     // Load up all the snarls
     SnarlManager snarl_manager = snarl_finder->find_snarls();
     vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
+    
+    // Save the tree index with the snarls in the orientations we output
+    auto write_tree_index = [&]() {
+        if (tree_index_file.empty()) {
+            return;
+        }
+        ofstream tree_index_stream(tree_index_file, ios_base::out | ios_base::binary);
+        if (!tree_index_stream) {
+            cerr << "error:[vg snarl]: Could not open \"" << tree_index_file
+                 << "\" for writing" << endl;
+            exit(1);
+        }
+        SnarlTreeIndex(snarl_manager).serialize(tree_index_stream);
+    };
+    
     if (fill_path_names){
+        write_tree_index();
         TraversalFinder* trav_finder = new PathBasedTraversalFinder(*graph, snarl_manager);
         for (const Snarl* snarl : snarl_roots ){
             if (filter_trivial_snarls) {
@@ -191,6 +231,8 @@ int main_snarl(int argc, char** argv) {
             return snarl_1->start().node_id() < snarl_2->end().node_id();
         });
     }
+    
+    write_tree_index();
 
   
 
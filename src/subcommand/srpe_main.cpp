@@ -29,10 +29,19 @@ using namespace vg::subcommand;
 
 
 void help_srpe(char** argv){
-    cerr << "Usage: " << argv[0] << " srpe [options] <data.gam> <graph.vg>" << endl
+    cerr << "Usage: " << argv[0] << " srpe [options] -x <graph.xg> -p <ref> <data.gam>" << endl
+    << "Find structural variant breakpoints from discordant pairs and soft clipped reads in a GAM of interleaved pairs." << endl
     << "Options: " << endl 
-    << "  -p / --ref-path" << endl
-    << "  -x / --xg" << endl 
+    << "  -p / --ref-path NAME     call breakpoints along this path" << endl
+    << "  -x / --xg FILE           use this xg index of the graph" << endl 
+    << "  -P / --pack FILE         use this coverage index (from vg pack) for breakpoint depth" << endl
+    << "                           [computed from the reads]" << endl
+    << "  -f / --max-frag-len INT  mates further apart than this are discordant [10000]" << endl
+    << "  -s / --soft-clip INT     soft clips this long mark a split read [20]" << endl
+    << "  -A / --assemble FILE     assemble the reads around each breakpoint and write the unitigs" << endl
+    << "                           to FILE as FASTA (the GAM must be a file)" << endl
+    << "  -M / --max-reads INT     assemble at most INT reads per region [125]" << endl
+    << "  -t / --threads INT       number of threads to use" << endl
     << "  -g / --gcsa" << endl 
     << endl;
 }
@@ -68,6 +77,10 @@ int main_srpe(int argc, char** argv){
 
     int threads = 1;
 
+    string pack_name = "";
+    string unitig_name = "";
+    int max_assembly_reads = 125;
+
     if (argc <= 2) {
         help_srpe(argv);
         return 1;
@@ -90,11 +103,16 @@ int main_srpe(int argc, char** argv){
             {"threads", required_argument, 0, 't'},
             {"ref-path", required_argument, 0, 'p'},
             {"remap", no_argument, 0, 'z'},
+            {"pack", required_argument, 0, 'P'},
+            {"max-frag-len", required_argument, 0, 'f'},
+            {"soft-clip", required_argument, 0, 's'},
+            {"assemble", required_argument, 0, 'A'},
+            {"max-reads", required_argument, 0, 'M'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hzx:g:m:S:RI:r:t:a:wp:",
+        c = getopt_long (argc, argv, "hzx:g:m:S:RI:r:t:a:wp:P:f:s:A:M:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -138,6 +156,21 @@ int main_srpe(int argc, char** argv){
             case 'p':
                 ref_path = optarg;
                 break;
+            case 'P':
+                pack_name = optarg;
+                break;
+            case 'f':
+                max_frag_len = atoi(optarg);
+                break;
+            case 's':
+                min_soft_clip = atoi(optarg);
+                break;
+            case 'A':
+                unitig_name = optarg;
+                break;
+            case 'M':
+                max_assembly_reads = atoi(optarg);
+                break;
             case 'h':
             case '?':
             default:
@@ -152,44 +185,80 @@ int main_srpe(int argc, char** argv){
 
     SRPE srpe;
 
-    
-
-
-    alignment_file = argv[optind];
-    //gam_index_name = argv[++optind];
-    graph_name = argv[++optind];
+    if (xg_name.empty() || ref_path.empty()) {
+        cerr << "error:[vg srpe] an xg index (-x) and a reference path (-p) are required" << endl;
+        return 1;
+    }
 
     xg::XG* xg_ind = new xg::XG();
-    Index gamind;
-
-    vg::VG* graph;
-
-    if (!xg_name.empty()){
+    {
         ifstream in(xg_name);
         xg_ind->load(in);
-        srpe.ff.set_my_xg_idx(xg_ind);
     }
-    // Set GCSA indexes
-    if (!gcsa_name.empty()){
-            ifstream gcsa_stream(gcsa_name);
-            srpe.ff.gcsa_ind = new gcsa::GCSA();
-            srpe.ff.gcsa_ind->load(gcsa_stream);
-            string lcp_name = gcsa_name + ".lcp";
-            ifstream lcp_stream(lcp_name);
-            srpe.ff.lcp_ind = new gcsa::LCPArray();
-            srpe.ff.lcp_ind->load(lcp_stream);
+    if (xg_ind->path_rank(ref_path) == 0) {
+        cerr << "error:[vg srpe] reference path " << ref_path << " is not in the graph" << endl;
+        return 1;
+    }
+    srpe.xindex = xg_ind;
+    srpe.max_frag_len = max_frag_len;
+    srpe.min_soft_clip = min_soft_clip;
+    srpe.max_reads = max_assembly_reads;
+
+    // Use the coverage index we were given, or build one as the reads go by
+    unique_ptr<Packer> packer;
+    if (!pack_name.empty()) {
+        packer = unique_ptr<Packer>(new Packer(xg_ind));
+        packer->load_from_file(pack_name);
+    } else {
+        packer = unique_ptr<Packer>(new Packer(xg_ind, 0, true));
+        srpe.add_coverage = true;
+    }
+    srpe.packer = packer.get();
+
+    string gam_name = get_input_file_name(optind, argc, argv);
+    if (!unitig_name.empty() && gam_name == "-") {
+        cerr << "error:[vg srpe] assembly needs to read the GAM twice, so it can't come from standard input" << endl;
+        return 1;
+    }
+
+    vector<BREAKPOINT> breakpoints;
+    if (gam_name == "-") {
+        srpe.call_svs(cin, breakpoints, ref_path);
+    } else {
+        ifstream gam_stream(gam_name);
+        srpe.call_svs(gam_stream, breakpoints, ref_path);
     }
-    if (!xg_name.empty()){
-        ifstream xgstream(xg_name);
-        xg_ind->load(xgstream);
-        srpe.ff.set_my_xg_idx(xg_ind);
+
+    // 0: Unset, 1: INS, 2: DEL, 3: INV, 4: DUP
+    vector<string> type_names {"BND", "INS", "DEL", "INV", "DUP"};
+    cout << "#contig\tposition\tdirection\ttype\tpair_support\tsplit_support\tdepth" << endl;
+    for (auto& bp : breakpoints) {
+        cout << bp.contig << "\t" << bp.start << "\t" << (bp.isForward ? "+" : "-") << "\t"
+             << type_names.at(bp.SV_TYPE) << "\t" << bp.fragl_supports << "\t" << bp.split_supports
+             << "\t" << bp.depth << endl;
     }
-    srpe.ff.init_mapper();
-    // else{
 
-    // }
+    if (!unitig_name.empty()) {
+        // Gather the reads around the breakpoints in a second pass, and
+        // assemble all the regions at once
+        vector<AssemblyRegion> regions = srpe.assembly_regions(breakpoints);
+        {
+            ifstream gam_stream(gam_name);
+            srpe.collect_assembly_reads(gam_stream, regions, ref_path);
+        }
+        srpe.assemble_regions(regions);
+
+        ofstream unitig_out(unitig_name);
+        for (auto& region : regions) {
+            for (size_t i = 0; i < region.unitigs.size(); i++) {
+                unitig_out << ">" << region.contig << ":" << region.start << "-" << region.end << "_" << i
+                           << " reads=" << region.unitigs[i].supporting_reads << endl
+                           << region.unitigs[i].sequence << endl;
+            }
+        }
+    }
 
-    
+    delete xg_ind;
 
     return 0;
 }
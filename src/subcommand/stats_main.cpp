@@ -16,6 +16,8 @@
 #include "../algorithms/distance_to_tail.hpp"
 
 #include "../vg.hpp"
+#include "../xg.hpp"
+#include "../utility.hpp"
 #include "../distributions.hpp"
 #include "../genotypekit.hpp"
 
@@ -24,9 +26,71 @@ using namespace vg;
 using namespace vg::subcommand;
 using namespace vg::algorithms;
 
+/// Counts collected from reads by one thread, to be added up at the end.
+struct ReadStats {
+    size_t total_alignments = 0;
+    size_t total_aligned = 0;
+    size_t total_primary = 0;
+    size_t total_secondary = 0;
+    
+    // Inserted bases also counts softclips
+    size_t total_insertions = 0;
+    size_t total_inserted_bases = 0;
+    size_t total_deletions = 0;
+    size_t total_deleted_bases = 0;
+    size_t total_substitutions = 0;
+    size_t total_substituted_bases = 0;
+    size_t total_softclips = 0;
+    size_t total_softclipped_bases = 0;
+    
+    // In verbose mode we keep the details of each event.
+    vector<pair<vg::id_t, Edit>> insertions;
+    vector<pair<vg::id_t, Edit>> deletions;
+    vector<pair<vg::id_t, Edit>> substitutions;
+    vector<pair<vg::id_t, Edit>> softclips;
+    
+    /// How many times was each node visited?
+    unordered_map<vg::id_t, size_t> node_visit_counts;
+    
+    /// How many primary reads are informative for each allele of each site?
+    map<string, map<string, size_t>> reads_on_allele;
+    
+    /// Add another thread's counts into these.
+    void merge(ReadStats& other) {
+        total_alignments += other.total_alignments;
+        total_aligned += other.total_aligned;
+        total_primary += other.total_primary;
+        total_secondary += other.total_secondary;
+        total_insertions += other.total_insertions;
+        total_inserted_bases += other.total_inserted_bases;
+        total_deletions += other.total_deletions;
+        total_deleted_bases += other.total_deleted_bases;
+        total_substitutions += other.total_substitutions;
+        total_substituted_bases += other.total_substituted_bases;
+        total_softclips += other.total_softclips;
+        total_softclipped_bases += other.total_softclipped_bases;
+        
+        insertions.insert(insertions.end(), other.insertions.begin(), other.insertions.end());
+        deletions.insert(deletions.end(), other.deletions.begin(), other.deletions.end());
+        substitutions.insert(substitutions.end(), other.substitutions.begin(), other.substitutions.end());
+        softclips.insert(softclips.end(), other.softclips.begin(), other.softclips.end());
+        
+        for (auto& id_and_count : other.node_visit_counts) {
+            node_visit_counts[id_and_count.first] += id_and_count.second;
+        }
+        for (auto& site_and_alleles : other.reads_on_allele) {
+            for (auto& allele_and_count : site_and_alleles.second) {
+                reads_on_allele[site_and_alleles.first][allele_and_count.first] += allele_and_count.second;
+            }
+        }
+    }
+};
+
 void help_stats(char** argv) {
-    cerr << "usage: " << argv[0] << " stats [options] <graph.vg>" << endl
+    cerr << "usage: " << argv[0] << " stats [options] [<graph.vg>]" << endl
          << "options:" << endl
+         << "    -x, --xg FILE         compute stats from this XG index, without loading the" << endl
+         << "                          vg graph (which -s, -S, -c, -A, -o, -O and -R still need)" << endl
          << "    -z, --size            size of graph" << endl
          << "    -N, --node-count      number of nodes in graph" << endl
          << "    -E, --edge-count      number of edges in graph" << endl
@@ -79,6 +143,7 @@ int main_stats(int argc, char** argv) {
     vector<string> paths_to_overlap;
     bool overlap_all_paths = false;
     bool snarl_stats = false;
+    string xg_name;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -105,11 +170,12 @@ int main_stats(int argc, char** argv) {
             {"overlap", no_argument, 0, 'o'},
             {"overlap-all", no_argument, 0, 'O'},
             {"snarls", no_argument, 0, 'R'},
+            {"xg", required_argument, 0, 'x'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hzlsHTScdtn:NEa:vAro:OR",
+        c = getopt_long (argc, argv, "hzlsHTScdtn:NEa:vAro:ORx:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -193,6 +259,10 @@ int main_stats(int argc, char** argv) {
         case 'v':
             verbose = true;
             break;
+            
+        case 'x':
+            xg_name = optarg;
+            break;
 
         case 'h':
         case '?':
@@ -205,26 +275,90 @@ int main_stats(int argc, char** argv) {
         }
     }
 
+    // Some stats need the whole graph in memory, but the rest can be computed
+    // from an XG.
+    bool need_vg = xg_name.empty() || stats_subgraphs || show_sibs || show_components ||
+        is_acyclic || !paths_to_overlap.empty() || overlap_all_paths || snarl_stats;
+    
     VG graph;
-    get_input_file(optind, argc, argv, [&](istream& in) {
-            graph.from_istream(in);
-    });
+    if (need_vg) {
+        get_input_file(optind, argc, argv, [&](istream& in) {
+                graph.from_istream(in);
+        });
+    }
+    
+    xg::XG xg_index;
+    if (!xg_name.empty()) {
+        get_input_file(xg_name, [&](istream& in) {
+            xg_index.load(in);
+        });
+    }
+    
+    // This is the graph we compute everything we can from.
+    const HandleGraph* handle_graph = xg_name.empty() ? (const HandleGraph*) &graph : (const HandleGraph*) &xg_index;
 
     if (stats_size) {
-        cout << "nodes" << "\t" << graph.node_count() << endl
-            << "edges" << "\t" << graph.edge_count() << endl;
+        cout << "nodes" << "\t" << handle_graph->node_size() << endl
+            << "edges" << "\t" << (xg_name.empty() ? graph.edge_count() : xg_index.edge_count) << endl;
     }
 
     if (node_count) {
-        cout << graph.node_count() << endl;
+        cout << handle_graph->node_size() << endl;
     }
 
     if (edge_count) {
-        cout << graph.edge_count() << endl;
+        cout << (xg_name.empty() ? graph.edge_count() : xg_index.edge_count) << endl;
     }
 
     if (stats_length) {
-        cout << "length" << "\t" << graph.total_length_of_nodes() << endl;
+        cout << "length" << "\t" << (xg_name.empty() ? graph.total_length_of_nodes() : xg_index.seq_length) << endl;
+    }
+    
+    if (!xg_name.empty() && (stats_heads || stats_tails || stats_range)) {
+        // Find the heads, tails and ID range from the index, in parallel.
+        vector<vg::id_t> heads;
+        vector<vg::id_t> tails;
+        vg::id_t min_id = numeric_limits<vg::id_t>::max();
+        vg::id_t max_id = numeric_limits<vg::id_t>::min();
+        xg_index.for_each_handle([&](const handle_t& handle) {
+            vg::id_t id = xg_index.get_id(handle);
+            bool is_head = xg_index.get_degree(handle, true) == 0;
+            bool is_tail = xg_index.get_degree(handle, false) == 0;
+            #pragma omp critical (stats_ends)
+            {
+                if (is_head) {
+                    heads.push_back(id);
+                }
+                if (is_tail) {
+                    tails.push_back(id);
+                }
+                min_id = min(min_id, id);
+                max_id = max(max_id, id);
+            }
+        }, true);
+        sort(heads.begin(), heads.end());
+        sort(tails.begin(), tails.end());
+        
+        if (stats_heads) {
+            cout << "heads" << "\t";
+            for (auto& id : heads) {
+                cout << id << " ";
+            }
+            cout << endl;
+        }
+        if (stats_tails) {
+            cout << "tails" << "\t";
+            for (auto& id : tails) {
+                cout << id << " ";
+            }
+            cout << endl;
+        }
+        if (stats_range) {
+            cout << "node-id-range\t" << min_id << ":" << max_id << endl;
+        }
+        
+        // Don't do them again from the vg graph
+        stats_heads = stats_tails = stats_range = false;
     }
 
     if (stats_heads) {
@@ -297,17 +431,17 @@ int main_stats(int argc, char** argv) {
 
     if (head_distance) {
         for (auto id : ids) {
-            auto n = graph.get_handle(id, false);
+            auto n = handle_graph->get_handle(id, false);
             cout << id << " to head:\t"
-                 << distance_to_head(n, 1000, &graph) << endl;
+                 << distance_to_head(n, 1000, handle_graph) << endl;
         }
     }
 
     if (tail_distance) {
         for (auto id : ids) {
-            auto n = graph.get_handle(id, false);
+            auto n = handle_graph->get_handle(id, false);
             cout << id << " to tail:\t"
-                << distance_to_tail(n, 1000, &graph) << endl;
+                << distance_to_tail(n, 1000, handle_graph) << endl;
         }
     }
 
@@ -412,7 +546,7 @@ int main_stats(int argc, char** argv) {
         // Before we go over the reads, we need to make a map that tells us what
         // nodes are unique to what allele paths. Stores site and allele parts
         // separately.
-        map<vg::id_t, pair<string, string>> allele_path_for_node;
+        unordered_map<vg::id_t, pair<string, string>> allele_path_for_node;
 
         // This is what we really care about: for each pair of allele paths in
         // the graph, we need to find out whether the coverage imbalance between
@@ -429,105 +563,96 @@ int main_stats(int argc, char** argv) {
         // have 2 alleles and which only have 1 in the graph.
         map<string, map<string, size_t>> reads_on_allele;
 
-        graph.for_each_node_parallel([&](Node* node) {
-            // For every node
-
-            if(!graph.paths.has_node_mapping(node)) {
-                // No paths to go over. If we try and get them we'll be
-                // modifying the paths in parallel, which will explode.
-                return;
+        // Remember the allele paths we have seen on each node, so we can
+        // forget the node if it turns out to be on more than one.
+        auto note_allele_node = [&](vg::id_t node_id, const string& allele_path,
+                                    unordered_map<vg::id_t, string>& allele_path_by_node,
+                                    unordered_set<vg::id_t>& shared_nodes) {
+            auto found = allele_path_by_node.find(node_id);
+            if (found == allele_path_by_node.end()) {
+                allele_path_by_node.emplace(node_id, allele_path);
+            } else if (found->second != allele_path) {
+                shared_nodes.insert(node_id);
             }
-
-            // We want an allele path on it
-            string allele_path;
-            for(auto& name_and_mappings : graph.paths.get_node_mapping_by_path_name(node)) {
-                // For each path on it
-                if(path_name_is_allele(name_and_mappings.first)) {
-                    // If it's an allele path
-                    if(allele_path.empty()) {
-                        // It's the first. Take it.
-                        allele_path = name_and_mappings.first;
-                    } else {
-                        // It's a subsequent one. This node is not uniquely part
-                        // of any allele path.
-                        return;
-                    }
+        };
+        
+        unordered_map<vg::id_t, string> allele_path_by_node;
+        unordered_set<vg::id_t> shared_nodes;
+        
+        if (!xg_name.empty()) {
+            // Walk the allele paths in the index. There aren't many paths, so
+            // we just go through them in order.
+            for (size_t rank = 1; rank <= xg_index.max_path_rank(); rank++) {
+                string path_name = xg_index.path_name(rank);
+                if (!path_name_is_allele(path_name)) {
+                    continue;
+                }
+                auto& xgpath = xg_index.get_path(path_name);
+                for (size_t i = 0; i < xgpath.size(); i++) {
+                    note_allele_node(xgpath.node(i), path_name, allele_path_by_node, shared_nodes);
                 }
             }
+        } else {
+            graph.for_each_node_parallel([&](Node* node) {
+                // For every node
 
-            if(!allele_path.empty()) {
-                // We found an allele path for this node
-
-                // Get its site and allele so we can count it as a biallelic
-                // site. Note that sites where an allele has no unique nodes
-                // (pure indels, for example) can't be handled and will be
-                // ignored.
-                auto site = path_name_to_site(allele_path);
-                auto allele = path_name_to_allele(allele_path);
-
-
-                #pragma omp critical (allele_path_for_node)
-                allele_path_for_node[node->id()] = make_pair(site, allele);
+                if(!graph.paths.has_node_mapping(node)) {
+                    // No paths to go over. If we try and get them we'll be
+                    // modifying the paths in parallel, which will explode.
+                    return;
+                }
 
-                #pragma omp critical (reads_on_allele)
-                reads_on_allele[site][allele] = 0;
+                for(auto& name_and_mappings : graph.paths.get_node_mapping_by_path_name(node)) {
+                    // For each path on it
+                    if(path_name_is_allele(name_and_mappings.first)) {
+                        #pragma omp critical (allele_path_for_node)
+                        note_allele_node(node->id(), name_and_mappings.first, allele_path_by_node, shared_nodes);
+                    }
+                }
+            });
+        }
+        
+        for (auto& node_and_path : allele_path_by_node) {
+            if (shared_nodes.count(node_and_path.first)) {
+                // This node is not uniquely part of any allele path.
+                continue;
             }
-        });
-
-
-        // These are the general stats we will compute.
-        size_t total_alignments = 0;
-        size_t total_aligned = 0;
-        size_t total_primary = 0;
-        size_t total_secondary = 0;
+            
+            // Get its site and allele so we can count it as a biallelic
+            // site. Note that sites where an allele has no unique nodes
+            // (pure indels, for example) can't be handled and will be
+            // ignored.
+            auto site = path_name_to_site(node_and_path.second);
+            auto allele = path_name_to_allele(node_and_path.second);
+            
+            allele_path_for_node[node_and_path.first] = make_pair(site, allele);
+            reads_on_allele[site][allele] = 0;
+        }
 
         // These are for counting significantly allele-biased hets
         size_t total_hets = 0;
         size_t significantly_biased_hets = 0;
-
-        // These are for tracking which nodes are covered and which are not
-        map<vg::id_t, size_t> node_visit_counts;
-
-        // And for counting indels
-        // Inserted bases also counts softclips
-        size_t total_insertions = 0;
-        size_t total_inserted_bases = 0;
-        size_t total_deletions = 0;
-        size_t total_deleted_bases = 0;
-        // And substitutions
-        size_t total_substitutions = 0;
-        size_t total_substituted_bases = 0;
-        // And softclips
-        size_t total_softclips = 0;
-        size_t total_softclipped_bases = 0;
-
-        // In verbose mode we want to report details of insertions, deletions,
-        // and substitutions, and soft clips.
-        vector<pair<vg::id_t, Edit>> insertions;
-        vector<pair<vg::id_t, Edit>> deletions;
-        vector<pair<vg::id_t, Edit>> substitutions;
-        vector<pair<vg::id_t, Edit>> softclips;
+        
+        // Each thread counts up its own reads, and we add them all up at the
+        // end, so the threads never wait on each other.
+        vector<ReadStats> thread_stats(get_thread_count());
 
         function<void(Alignment&)> lambda = [&](Alignment& aln) {
-            int tid = omp_get_thread_num();
+            auto& stats = thread_stats.at(omp_get_thread_num());
 
             // We ought to be able to do many stats on the alignments.
 
             // Now do all the non-mapping stats
-            #pragma omp critical (total_alignments)
-            total_alignments++;
+            stats.total_alignments++;
             if(aln.is_secondary()) {
-                #pragma omp critical (total_secondary)
-                total_secondary++;
+                stats.total_secondary++;
             } else {
-                #pragma omp critical (total_primary)
-                total_primary++;
+                stats.total_primary++;
                 if(aln.score() > 0) {
                     // We only count aligned primary reads in "total aligned";
                     // the primary can't be unaligned if the secondary is
                     // aligned.
-                    #pragma omp critical (total_aligned)
-                    total_aligned++;
+                    stats.total_aligned++;
                 }
 
                 // Which sites and alleles does this read support. TODO: if we hit
@@ -541,16 +666,16 @@ int main_stats(int argc, char** argv) {
                     auto& mapping = aln.path().mapping(i);
                     vg::id_t node_id = mapping.position().node_id();
 
-                    if(allele_path_for_node.count(node_id)) {
+                    auto allele_found = allele_path_for_node.find(node_id);
+                    if(allele_found != allele_path_for_node.end()) {
                         // We hit a unique node for this allele. Add it to the set,
                         // in case we hit another unique node for it later in the
                         // read.
-                        alleles_supported.insert(allele_path_for_node.at(node_id));
+                        alleles_supported.insert(allele_found->second);
                     }
 
                     // Record that there was a visit to this node.
-                    #pragma omp critical (node_visit_counts)
-                    node_visit_counts[node_id]++;
+                    stats.node_visit_counts[node_id]++;
 
                     for(size_t j = 0; j < mapping.edit_size(); j++) {
                         // Go through edits and look for each type.
@@ -559,50 +684,38 @@ int main_stats(int argc, char** argv) {
                         if(edit.to_length() > edit.from_length()) {
                             if((j == 0 && i == 0) || (j == mapping.edit_size() - 1 && i == aln.path().mapping_size() - 1)) {
                                 // We're at the very end of the path, so this is a soft clip.
-                                #pragma omp critical (total_softclipped_bases)
-                                total_softclipped_bases += edit.to_length() - edit.from_length();
-                                #pragma omp critical (total_softclips)
-                                total_softclips++;
+                                stats.total_softclipped_bases += edit.to_length() - edit.from_length();
+                                stats.total_softclips++;
                                 if(verbose) {
                                     // Record the actual insertion
-                                    #pragma omp critical (softclips)
-                                    softclips.push_back(make_pair(node_id, edit));
+                                    stats.softclips.push_back(make_pair(node_id, edit));
                                 }
                             } else {
                                 // Record this insertion
-                                #pragma omp critical (total_inserted_bases)
-                                total_inserted_bases += edit.to_length() - edit.from_length();
-                                #pragma omp critical (total_insertions)
-                                total_insertions++;
+                                stats.total_inserted_bases += edit.to_length() - edit.from_length();
+                                stats.total_insertions++;
                                 if(verbose) {
                                     // Record the actual insertion
-                                    #pragma omp critical (insertions)
-                                    insertions.push_back(make_pair(node_id, edit));
+                                    stats.insertions.push_back(make_pair(node_id, edit));
                                 }
                             }
 
                         } else if(edit.from_length() > edit.to_length()) {
                             // Record this deletion
-                            #pragma omp critical (total_deleted_bases)
-                            total_deleted_bases += edit.from_length() - edit.to_length();
-                            #pragma omp critical (total_deletions)
-                            total_deletions++;
+                            stats.total_deleted_bases += edit.from_length() - edit.to_length();
+                            stats.total_deletions++;
                             if(verbose) {
                                 // Record the actual deletion
-                                #pragma omp critical (deletions)
-                                deletions.push_back(make_pair(node_id, edit));
+                                stats.deletions.push_back(make_pair(node_id, edit));
                             }
                         } else if(!edit.sequence().empty()) {
                             // Record this substitution
                             // TODO: a substitution might also occur as part of a deletion/insertion above!
-                            #pragma omp critical (total_substituted_bases)
-                            total_substituted_bases += edit.from_length();
-                            #pragma omp critical (total_substitutions)
-                            total_substitutions++;
+                            stats.total_substituted_bases += edit.from_length();
+                            stats.total_substitutions++;
                             if(verbose) {
                                 // Record the actual substitution
-                                #pragma omp critical (substitutions)
-                                substitutions.push_back(make_pair(node_id, edit));
+                                stats.substitutions.push_back(make_pair(node_id, edit));
                             }
                         }
 
@@ -612,8 +725,7 @@ int main_stats(int argc, char** argv) {
                 for(auto& site_and_allele : alleles_supported) {
                     // This read is informative for an allele of a site.
                     // Up the reads on that allele of that site.
-                    #pragma omp critical (reads_on_allele)
-                    reads_on_allele[site_and_allele.first][site_and_allele.second]++;
+                    stats.reads_on_allele[site_and_allele.first][site_and_allele.second]++;
                 }
             }
 
@@ -621,6 +733,19 @@ int main_stats(int argc, char** argv) {
 
         // Actually go through all the reads and count stuff up.
         stream::for_each_parallel(alignment_stream, lambda);
+        
+        // Add up what all the threads found
+        ReadStats totals;
+        for (auto& stats : thread_stats) {
+            totals.merge(stats);
+            stats = ReadStats();
+        }
+        for (auto& site_and_alleles : totals.reads_on_allele) {
+            for (auto& allele_and_count : site_and_alleles.second) {
+                reads_on_allele[site_and_alleles.first][allele_and_count.first] += allele_and_count.second;
+            }
+        }
+        auto& node_visit_counts = totals.node_visit_counts;
 
         // Calculate stats about the reads per allele data
         for(auto& site_and_alleles : reads_on_allele) {
@@ -679,66 +804,80 @@ int main_stats(int argc, char** argv) {
         // as many times as their nodes are touched. Also note that we ignore
         // edge effects and a read that stops before the end of a node will
         // visit the whole node.
-        graph.for_each_node_parallel([&](Node* node) {
+        struct VisitCounts {
+            size_t unvisited_nodes = 0;
+            size_t unvisited_node_bases = 0;
+            size_t single_visited_nodes = 0;
+            size_t single_visited_node_bases = 0;
+            vector<vg::id_t> unvisited_ids;
+            vector<vg::id_t> single_visited_ids;
+        };
+        vector<VisitCounts> thread_visits(get_thread_count());
+        handle_graph->for_each_handle([&](const handle_t& handle) {
             // For every node
-            if(!node_visit_counts.count(node->id()) || node_visit_counts.at(node->id()) == 0) {
+            auto& visits = thread_visits.at(omp_get_thread_num());
+            vg::id_t node_id = handle_graph->get_id(handle);
+            auto found = node_visit_counts.find(node_id);
+            if(found == node_visit_counts.end() || found->second == 0) {
                 // If we never visited it with a read, count it.
-                #pragma omp critical (unvisited_nodes)
-                unvisited_nodes++;
-                #pragma omp critical (unvisited_node_bases)
-                unvisited_node_bases += node->sequence().size();
+                visits.unvisited_nodes++;
+                visits.unvisited_node_bases += handle_graph->get_length(handle);
                 if(verbose) {
-                    #pragma omp critical (unvisited_ids)
-                    unvisited_ids.insert(node->id());
+                    visits.unvisited_ids.push_back(node_id);
                 }
-            } else if(node_visit_counts.at(node->id()) == 1) {
+            } else if(found->second == 1) {
                 // If we visited it with only one read, count it.
-                #pragma omp critical (single_visited_nodes)
-                single_visited_nodes++;
-                #pragma omp critical (single_visited_node_bases)
-                single_visited_node_bases += node->sequence().size();
+                visits.single_visited_nodes++;
+                visits.single_visited_node_bases += handle_graph->get_length(handle);
                 if(verbose) {
-                    #pragma omp critical (single_visited_ids)
-                    single_visited_ids.insert(node->id());
+                    visits.single_visited_ids.push_back(node_id);
                 }
             }
-        });
+        }, true);
+        for (auto& visits : thread_visits) {
+            unvisited_nodes += visits.unvisited_nodes;
+            unvisited_node_bases += visits.unvisited_node_bases;
+            single_visited_nodes += visits.single_visited_nodes;
+            single_visited_node_bases += visits.single_visited_node_bases;
+            unvisited_ids.insert(visits.unvisited_ids.begin(), visits.unvisited_ids.end());
+            single_visited_ids.insert(visits.single_visited_ids.begin(), visits.single_visited_ids.end());
+        }
 
-        cout << "Total alignments: " << total_alignments << endl;
-        cout << "Total primary: " << total_primary << endl;
-        cout << "Total secondary: " << total_secondary << endl;
-        cout << "Total aligned: " << total_aligned << endl;
+        cout << "Total alignments: " << totals.total_alignments << endl;
+        cout << "Total primary: " << totals.total_primary << endl;
+        cout << "Total secondary: " << totals.total_secondary << endl;
+        cout << "Total aligned: " << totals.total_aligned << endl;
 
-        cout << "Insertions: " << total_inserted_bases << " bp in " << total_insertions << " read events" << endl;
+        cout << "Insertions: " << totals.total_inserted_bases << " bp in " << totals.total_insertions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : insertions) {
+            for(auto& id_and_edit : totals.insertions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Deletions: " << total_deleted_bases << " bp in " << total_deletions << " read events" << endl;
+        cout << "Deletions: " << totals.total_deleted_bases << " bp in " << totals.total_deletions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : deletions) {
+            for(auto& id_and_edit : totals.deletions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.to_length()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Substitutions: " << total_substituted_bases << " bp in " << total_substitutions << " read events" << endl;
+        cout << "Substitutions: " << totals.total_substituted_bases << " bp in " << totals.total_substitutions << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : substitutions) {
+            for(auto& id_and_edit : totals.substitutions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Softclips: " << total_softclipped_bases << " bp in " << total_softclips << " read events" << endl;
+        cout << "Softclips: " << totals.total_softclipped_bases << " bp in " << totals.total_softclips << " read events" << endl;
         if(verbose) {
-            for(auto& id_and_edit : softclips) {
+            for(auto& id_and_edit : totals.softclips) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
 
-        cout << "Unvisited nodes: " << unvisited_nodes << "/" << graph.node_count()
+        cout << "Unvisited nodes: " << unvisited_nodes << "/" << handle_graph->node_size()
             << " (" << unvisited_node_bases << " bp)" << endl;
         if(verbose) {
             for(auto& id : unvisited_ids) {
@@ -746,7 +885,7 @@ int main_stats(int argc, char** argv) {
             }
         }
 
-        cout << "Single-visited nodes: " << single_visited_nodes << "/" << graph.node_count()
+        cout << "Single-visited nodes: " << single_visited_nodes << "/" << handle_graph->node_size()
             << " (" << single_visited_node_bases << " bp)" << endl;
         if(verbose) {
             for(auto& id : single_visited_ids) {
@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <memory>
 
 #include "subcommand.hpp"
 
@@ -14,6 +15,7 @@
 #include "../stream.hpp"
 #include "../utility.hpp"
 #include "../surjector.hpp"
+#include "../bam_sorter.hpp"
 
 using namespace std;
 using namespace vg;
@@ -28,11 +30,14 @@ void help_surject(char** argv) {
          << "    -t, --threads N         number of threads to use" << endl
          << "    -p, --into-path NAME    surject into this path (many allowed, default: all in xg)" << endl
          << "    -F, --into-paths FILE   surject into nonoverlapping path names listed in FILE (one per line)" << endl
+         << "    -n, --max-candidates N  realign each read to at most the N paths it follows the longest (0 for all) [4]" << endl
          << "    -i, --interleaved       GAM is interleaved paired-ended, so when outputting HTS formats, pair reads" << endl
          << "    -c, --cram-output       write CRAM to stdout" << endl
          << "    -b, --bam-output        write BAM to stdout" << endl
          << "    -s, --sam-output        write SAM to stdout" << endl
-         << "    -C, --compression N     level for compression [0-9]" << endl;
+         << "    -C, --compression N     level for compression [0-9]" << endl
+         << "    -S, --sort              coordinate-sort HTS output, spilling to temp files as needed" << endl
+         << "    -m, --max-memory N      hold about N MB of records in memory when sorting [1024]" << endl;
 }
 
 int main_surject(int argc, char** argv) {
@@ -51,6 +56,9 @@ int main_surject(int argc, char** argv) {
     bool interleaved = false;
     string header_file;
     int compress_level = 9;
+    bool sort_output = false;
+    size_t sort_memory = 1024;
+    size_t max_candidates = 4;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -63,17 +71,20 @@ int main_surject(int argc, char** argv) {
             {"into-path", required_argument, 0, 'p'},
             {"into-paths", required_argument, 0, 'F'},
             {"into-prefix", required_argument, 0, 'P'},
+            {"max-candidates", required_argument, 0, 'n'},
             {"interleaved", no_argument, 0, 'i'},
             {"cram-output", no_argument, 0, 'c'},
             {"bam-output", no_argument, 0, 'b'},
             {"sam-output", no_argument, 0, 's'},
             {"header-from", required_argument, 0, 'H'},
             {"compress", required_argument, 0, 'C'},
+            {"sort", no_argument, 0, 'S'},
+            {"max-memory", required_argument, 0, 'm'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:p:F:P:icbsH:C:t:",
+        c = getopt_long (argc, argv, "hx:p:F:P:n:icbsH:C:t:Sm:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -99,6 +110,10 @@ int main_surject(int argc, char** argv) {
             path_prefix = optarg;
             break;
 
+        case 'n':
+            max_candidates = atoll(optarg);
+            break;
+
         case 'H':
             header_file = optarg;
             break;
@@ -128,6 +143,14 @@ int main_surject(int argc, char** argv) {
             compress_level = atoi(optarg);
             break;
 
+        case 'S':
+            sort_output = true;
+            break;
+
+        case 'm':
+            sort_memory = atoll(optarg);
+            break;
+
         case 'h':
         case '?':
             help_surject(argv);
@@ -141,6 +164,11 @@ int main_surject(int argc, char** argv) {
 
     string file_name = get_input_file_name(optind, argc, argv);
 
+    if (sort_output && output_type == "gam") {
+        cerr << "[vg surject] error: only SAM, BAM, and CRAM output can be sorted" << endl;
+        return 1;
+    }
+
     if (!path_file.empty()){
         // open the file
         ifstream in(path_file);
@@ -174,10 +202,22 @@ int main_surject(int argc, char** argv) {
         path_length[name] = xgidx->path_length(name);
     }
     
+    for (const string& path_name : path_names) {
+        if (xgidx->path_rank(path_name) == 0) {
+            cerr << "[vg surject] error: path " << path_name << " is not in the xg index" << endl;
+            return 1;
+        }
+    }
+
+    // which of the paths each node is on, shared by all the threads
+    PathMembershipIndex path_membership(*xgidx, path_names);
+
     int thread_count = get_thread_count();
     vector<Surjector*> surjectors(thread_count);
     for (int i = 0; i < surjectors.size(); i++) {
         surjectors[i] = new Surjector(xgidx);
+        surjectors[i]->path_membership = &path_membership;
+        surjectors[i]->max_candidate_paths = max_candidates;
     }
 
     if (input_type == "gam") {
@@ -232,10 +272,8 @@ int main_surject(int argc, char** argv) {
             int buffer_limit = 100;
 
             bam_hdr_t* hdr = nullptr;
-            int64_t count = 0;
-            // TODO: What good is this lock if we continue without getting it if the buffer is overfull???
-            omp_lock_t output_lock;
-            omp_init_lock(&output_lock);
+            // When sorting, records collect here until all the reads are in
+            unique_ptr<BAMSorter> sorter;
             
             // We define a type to represent a surjected alignment, ready for
             // HTSlib output. It consists of surjected path name (or ""),
@@ -281,35 +319,59 @@ int main_surject(int argc, char** argv) {
 #pragma omp critical (hts_header)
                 {
                     if (!hdr) {
-                        hdr = hts_string_header(header, path_length, rg_sample);
+                        hdr = hts_string_header(header, path_length, rg_sample, sort_output);
                         if ((out = sam_open("-", out_mode)) == 0) {
 #pragma omp critical (cerr)
                             cerr << "[vg surject] error: failed to open stdout for writing HTS output" << endl;
                             exit(1);
                         } else {
+                            if (!out_format.empty() && thread_count > 1) {
+                                // let htslib compress BGZF blocks on a pool of its own
+                                hts_set_threads(out, thread_count);
+                            }
                             // write the header
                             if (sam_hdr_write(out, hdr) != 0) {
 #pragma omp critical (cerr)
                                 cerr << "[vg surject] error: failed to write the SAM header" << endl;
                             }
+                            if (sort_output) {
+                                sorter.reset(new BAMSorter(hdr));
+                                sorter->max_memory = sort_memory * 1024 * 1024;
+                            }
                         }
                     }
                 }
             };
             
-            // Finally, we have a little widget function to write a BAM record and check for errors.
-            // Consumes the passed record.
-            auto write_bam_record = [&](bam1_t* b) {
+            // Finally, we have a little widget function to write a thread's
+            // BAM records and check for errors. The records are encoded
+            // before we get here, so the output is only held long enough to
+            // hand them to htslib, and a batch is never interleaved with
+            // another thread's. Consumes the passed records.
+            auto write_bam_records = [&](vector<bam1_t*>& records) {
                 assert(out != nullptr);
-                int r = 0;
+                if (sorter) {
+                    // these get written in order once we've seen them all
+                    sorter->add(records);
+                    return;
+                }
+                bool failed = false;
 #pragma omp critical (cout)
-                r = sam_write1(out, hdr, b);
-                if (r == 0) {
+                for (auto b : records) {
+                    if (sam_write1(out, hdr, b) < 0) {
+                        failed = true;
+                        break;
+                    }
+                }
+                if (failed) {
 #pragma omp critical (cerr)
                     cerr << "[vg surject] error: writing to stdout failed" << endl;
                     exit(1);
                 }
-                bam_destroy1(b);
+                for (auto b : records) {
+                    bam_destroy1(b);
+                }
+                records.clear();
             };
             
             if (interleaved) {
@@ -328,50 +390,48 @@ int main_surject(int argc, char** argv) {
                             // Make sure we have emitted the header
                             ensure_header();
 
-                            // try to get a lock, and force things if we've built up a huge buffer waiting
-                            // TODO: Is continuing without the lock safe? And if so why do we have the lock in the first place?
-                            if (omp_test_lock(&output_lock) || buf.size() > 10*buffer_limit) {
-                                for (auto& surjected_pair : buf) {
-                                    // For each pair of surjected reads
+                            vector<bam1_t*> records;
+                            records.reserve(buf.size() * 2);
+                            for (auto& surjected_pair : buf) {
+                                // For each pair of surjected reads
+                            
+                                // Unpack the first read
+                                auto& name1 = get<0>(surjected_pair.first);
+                                auto& pos1 = get<1>(surjected_pair.first);
+                                auto& reverse1 = get<2>(surjected_pair.first);
+                                auto& surj1 = get<3>(surjected_pair.first);
                                 
-                                    // Unpack the first read
-                                    auto& name1 = get<0>(surjected_pair.first);
-                                    auto& pos1 = get<1>(surjected_pair.first);
-                                    auto& reverse1 = get<2>(surjected_pair.first);
-                                    auto& surj1 = get<3>(surjected_pair.first);
-                                    
-                                    // Unpack the second read
-                                    auto& name2 = get<0>(surjected_pair.second);
-                                    auto& pos2 = get<1>(surjected_pair.second);
-                                    auto& reverse2 = get<2>(surjected_pair.second);
-                                    auto& surj2 = get<3>(surjected_pair.second);
-                                    
-                                    // Compute CIGAR strings if actually surjected
-                                    string cigar1 = "", cigar2 = "";
-                                    if (name1 != "") {
-                                        size_t path_len1 = xgidx->path_length(name1);
-                                        cigar1 = cigar_against_path(surj1, reverse1, pos1, path_len1, 0);
-                                    }
-                                    if (name2 != "") {
-                                        size_t path_len2 = xgidx->path_length(name2);
-                                        cigar2 = cigar_against_path(surj2, reverse2, pos2, path_len2, 0);
-                                    }
-                                    
-                                    // TODO: compute template length based on
-                                    // pair distance and alignment content.
-                                    int template_length = 0;
-                                    
-                                    // Create and write paired BAM records referencing each other
-                                    write_bam_record(alignment_to_bam(header, surj1, name1, pos1, reverse1, cigar1,
-                                        name2, pos2, template_length));
-                                    write_bam_record(alignment_to_bam(header, surj2, name2, pos2, reverse2, cigar2,
-                                        name1, pos1, template_length));
+                                // Unpack the second read
+                                auto& name2 = get<0>(surjected_pair.second);
+                                auto& pos2 = get<1>(surjected_pair.second);
+                                auto& reverse2 = get<2>(surjected_pair.second);
+                                auto& surj2 = get<3>(surjected_pair.second);
                                 
+                                // Compute CIGAR strings if actually surjected
+                                string cigar1 = "", cigar2 = "";
+                                if (name1 != "") {
+                                    size_t path_len1 = xgidx->path_length(name1);
+                                    cigar1 = cigar_against_path(surj1, reverse1, pos1, path_len1, 0);
+                                }
+                                if (name2 != "") {
+                                    size_t path_len2 = xgidx->path_length(name2);
+                                    cigar2 = cigar_against_path(surj2, reverse2, pos2, path_len2, 0);
                                 }
                                 
-                                omp_unset_lock(&output_lock);
-                                buf.clear();
+                                // TODO: compute template length based on
+                                // pair distance and alignment content.
+                                int template_length = 0;
+                                
+                                // Create paired BAM records referencing each other
+                                records.push_back(alignment_to_bam(hdr, surj1, name1, pos1, reverse1, cigar1,
+                                    name2, pos2, template_length));
+                                records.push_back(alignment_to_bam(hdr, surj2, name2, pos2, reverse2, cigar2,
+                                    name1, pos1, template_length));
+                            
                             }
+                            
+                            write_bam_records(records);
+                            buf.clear();
                         }
                 };
                 
@@ -453,33 +513,31 @@ int main_surject(int argc, char** argv) {
                         // Make sure we have emitted the header
                         ensure_header();
 
-                        // try to get a lock, and force things if we've built up a huge buffer waiting
-                        // TODO: Is continuing without the lock safe? And if so why do we have the lock in the first place?
-                        if (omp_test_lock(&output_lock) || buf.size() > 10*buffer_limit) {
-                            for (auto& s : buf) {
-                                // For each alignment in the buffer
-                                
-                                // Unpack it
-                                auto& name = get<0>(s);
-                                auto& pos = get<1>(s);
-                                auto& reverse = get<2>(s);
-                                auto& surj = get<3>(s);
-                                
-                                // Generate a CIGAR string for it
-                                string cigar = "";
-                                if (name != "") {
-                                    size_t path_len = xgidx->path_length(name);
-                                    cigar = cigar_against_path(surj, reverse, pos, path_len, 0);
-                                }
-                                
-                                // Create and write a single unpaired BAM record
-                                write_bam_record(alignment_to_bam(header, surj, name, pos, reverse, cigar));
-                                
+                        vector<bam1_t*> records;
+                        records.reserve(buf.size());
+                        for (auto& s : buf) {
+                            // For each alignment in the buffer
+                            
+                            // Unpack it
+                            auto& name = get<0>(s);
+                            auto& pos = get<1>(s);
+                            auto& reverse = get<2>(s);
+                            auto& surj = get<3>(s);
+                            
+                            // Generate a CIGAR string for it
+                            string cigar = "";
+                            if (name != "") {
+                                size_t path_len = xgidx->path_length(name);
+                                cigar = cigar_against_path(surj, reverse, pos, path_len, 0);
                             }
                             
-                            omp_unset_lock(&output_lock);
-                            buf.clear();
+                            // Create a single unpaired BAM record
+                            records.push_back(alignment_to_bam(hdr, surj, name, pos, reverse, cigar));
+                            
                         }
+                        
+                        write_bam_records(records);
+                        buf.clear();
                     }
                 };
 
@@ -502,12 +560,16 @@ int main_surject(int argc, char** argv) {
             }
             
             
+            if (sorter) {
+                sorter->write_sorted(out);
+                sorter.reset();
+            }
+            
             if (hdr != nullptr) {
                 bam_hdr_destroy(hdr);
             }
             assert(out != nullptr);
             sam_close(out);
-            omp_destroy_lock(&output_lock);
         }
     }
     cout.flush();
@@ -1,3 +1,4 @@
+#include <omp.h>
 #include <getopt.h>
 
 #include <string>
@@ -21,12 +22,17 @@ void help_trace(char** argv) {
          << "options:" << endl
          << "    -x, --index FILE           use this xg index" << endl
          << "    -G, --gbwt-name FILE       use this GBWT haplotype index instead of the xg's embedded gPBWT" << endl
-         << "    -n, --start-node INT       start at this node" << endl
+         << "    -n, --start-node INT       start at this node (may repeat)" << endl
+         << "    -N, --start-nodes FILE     also start at each node listed in this file, one per line" << endl
         //TODO: implement backwards iteration over graph
         // << "    -b, --backwards            iterate backwards over graph" << endl
          << "    -d, --extend-distance INT  extend search this many nodes [default=50]" << endl
          << "    -a, --annotation-path FILE output file for haplotype frequency annotations" << endl
-         << "    -j, --json                 output subgraph in json instead of protobuf" << endl;
+         << "    -j, --json                 output subgraph in json instead of protobuf" << endl
+         << "    -t, --threads N            trace from this many start nodes in parallel" << endl
+         << endl
+         << "With more than one start node, a subgraph is output for each in order, and" << endl
+         << "annotation lines begin with the start node." << endl;
 }
 
 int main_trace(int argc, char** argv) {
@@ -38,7 +44,8 @@ int main_trace(int argc, char** argv) {
   string xg_name;
   string gbwt_name;
   string annotation_path;
-  int64_t start_node = 0;
+  vector<vg::id_t> start_nodes;
+  string start_nodes_name;
   int extend_distance = 50;
   bool backwards = false;
   bool json = false;
@@ -55,13 +62,15 @@ int main_trace(int argc, char** argv) {
             {"annotation-path", required_argument, 0, 'a'},
             {"start-node", required_argument, 0, 'n'},
             {"extend-distance", required_argument, 0, 'd'},
+            {"start-nodes", required_argument, 0, 'N'},
             {"json", no_argument, 0, 'j'},
+            {"threads", required_argument, 0, 't'},
             //{"backwards", no_argument, 0, 'b'},
             {0, 0, 0, 0}
         };
 
     int option_index = 0;
-    c = getopt_long (argc, argv, "x:G:a:n:d:jh",
+    c = getopt_long (argc, argv, "x:G:a:n:N:d:jt:h",
                      long_options, &option_index);
 
     /* Detect the end of the options. */
@@ -83,7 +92,11 @@ int main_trace(int argc, char** argv) {
         break;
 
     case 'n':
-        start_node = atoi(optarg);
+        start_nodes.push_back(atoll(optarg));
+        break;
+
+    case 'N':
+        start_nodes_name = optarg;
         break;
 
     case 'd':
@@ -94,6 +107,10 @@ int main_trace(int argc, char** argv) {
         json = true;
         break;
 
+    case 't':
+        omp_set_num_threads(atoi(optarg));
+        break;
+
     //case 'b':
         //backwards = true;
         //break;
@@ -113,10 +130,29 @@ int main_trace(int argc, char** argv) {
     cerr << "error:[vg trace] xg index must be specified with -x" << endl;
     return 1;
   }
-  if (start_node < 1) {
-    cerr << "error:[vg trace] start node must be specified with -n" << endl;
+  if (!start_nodes_name.empty()) {
+    ifstream start_nodes_file(start_nodes_name);
+    if (!start_nodes_file) {
+      cerr << "error:[vg trace] unable to open start node file " << start_nodes_name << endl;
+      return 1;
+    }
+    string line;
+    while (getline(start_nodes_file, line)) {
+      if (!line.empty()) {
+        start_nodes.push_back(atoll(line.c_str()));
+      }
+    }
+  }
+  if (start_nodes.empty()) {
+    cerr << "error:[vg trace] start node must be specified with -n or -N" << endl;
     return 1;
   }
+  for (auto start_node : start_nodes) {
+    if (start_node < 1) {
+      cerr << "error:[vg trace] start node " << start_node << " is not a valid node ID" << endl;
+      return 1;
+    }
+  }
   xg::XG xindex;  
   ifstream in(xg_name.c_str());
   xindex.load(in);
@@ -138,26 +174,36 @@ int main_trace(int argc, char** argv) {
     gbwt_index->load(in);
   }
 
-  // trace out our graph and paths from the start node
-  Graph trace_graph;
-  map<string, int> haplotype_frequences;
-  trace_haplotypes_and_paths(xindex, gbwt_index.get(), start_node, extend_distance,
-                             trace_graph, haplotype_frequences);
-
-  // dump our graph to stdout
-  if (json) {
-    cout << pb2json(trace_graph);
-  } else {
-    VG vg_graph;
-    vg_graph.extend(trace_graph);
-    vg_graph.serialize_to_ostream(cout);
+  // trace out our graphs and paths from the start nodes
+  vector<Graph> trace_graphs;
+  vector<map<string, int>> haplotype_frequences;
+  trace_haplotypes_and_paths(xindex, gbwt_index.get(), start_nodes, extend_distance,
+                             trace_graphs, haplotype_frequences);
+
+  // dump our graphs to stdout
+  for (auto& trace_graph : trace_graphs) {
+    if (json) {
+      cout << pb2json(trace_graph);
+      if (trace_graphs.size() > 1) {
+        cout << endl;
+      }
+    } else {
+      VG vg_graph;
+      vg_graph.extend(trace_graph);
+      vg_graph.serialize_to_ostream(cout);
+    }
   }
 
   // if requested, write thread frequencies to a file
   if (!annotation_path.empty()) {
     ofstream annotation_file(annotation_path);
-    for (auto tf : haplotype_frequences) {
-      annotation_file << tf.first << "\t" << tf.second << endl;
+    for (size_t i = 0; i < start_nodes.size(); i++) {
+      for (auto tf : haplotype_frequences[i]) {
+        if (start_nodes.size() > 1) {
+          annotation_file << start_nodes[i] << "\t";
+        }
+        annotation_file << tf.first << "\t" << tf.second << endl;
+      }
     }
   }
 
@@ -29,7 +29,8 @@ void help_translate(char** argv) {
          << "    -l, --loci FILE       project the input locus descriptions into the from-graph" << endl
          << "    -m, --mapping JSON    print the from-mapping corresponding to the given JSON mapping" << endl
          << "    -P, --position JSON   print the from-position corresponding to the given JSON position" << endl
-         << "    -o, --overlay FILE    overlay this translation on top of the one we are given" << endl;
+         << "    -o, --overlay FILE    overlay this translation on top of the one we are given" << endl
+         << "    -t, --threads N       translate alignments using N threads" << endl;
 }
 
 int main_translate(int argc, char** argv) {
@@ -58,11 +59,12 @@ int main_translate(int argc, char** argv) {
             {"alns", required_argument, 0, 'a'},
             {"loci", required_argument, 0, 'l'},
             {"overlay", required_argument, 0, 'o'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hp:m:P:a:o:l:",
+        c = getopt_long (argc, argv, "hp:m:P:a:o:l:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -95,6 +97,10 @@ int main_translate(int argc, char** argv) {
             overlay_file = optarg;
             break;
 
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'h':
         case '?':
             help_translate(argv);
@@ -135,13 +141,22 @@ int main_translate(int argc, char** argv) {
         stream::for_each(path_in, lambda);
         stream::write_buffered(cout, buffer, 0);
     } else if (!aln_file.empty()) {
+        // parse and translate batches of alignments on all threads, keeping
+        // them in order
         vector<Alignment> buffer;
+        size_t batch_size = 1000;
         function<void(Alignment&)> lambda = [&](Alignment& aln) {
-            buffer.push_back(translator->translate(aln));
-            stream::write_buffered(cout, buffer, 100);
+            buffer.emplace_back();
+            buffer.back().Swap(&aln);
+            if (buffer.size() >= batch_size) {
+                translator->translate(buffer);
+                stream::write_buffered(cout, buffer, 0);
+            }
         };
+        function<void(uint64_t)> no_count = [](uint64_t) { };
         ifstream aln_in(aln_file);
-        stream::for_each(aln_in, lambda);
+        stream::for_each_ordered_parallel(aln_in, lambda, no_count);
+        translator->translate(buffer);
         stream::write_buffered(cout, buffer, 0);
     } else if (!loci_file.empty()) {
         vector<Locus> buffer;
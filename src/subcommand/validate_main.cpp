@@ -13,13 +13,15 @@
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../xg.hpp"
+#include "../graph_validator.hpp"
 
 using namespace std;
 using namespace vg;
 using namespace vg::subcommand;
 
 void help_validate(char** argv) {
-    cerr << "usage: " << argv[0] << " validate [options] graph" << endl
+    cerr << "usage: " << argv[0] << " validate [options] [graph]" << endl
         << "Validate the graph." << endl
         << endl
         << "options:" << endl
@@ -27,7 +29,10 @@ void help_validate(char** argv) {
         << "    -n, --nodes    verify that we have the expected number of nodes" << endl
         << "    -e, --edges    verify that the graph contains all nodes that are referred to by edges" << endl
         << "    -p, --paths    verify that contiguous path segments are connected by edges" << endl
-        << "    -o, --orphans  verify that all nodes have edges" << endl;
+        << "    -o, --orphans  verify that all nodes have edges" << endl
+        << "    -x, --xg FILE  validate this XG index in parallel instead of a vg graph" << endl
+        << "    -a, --gam FILE validate the alignments in this GAM against the XG index (requires -x)" << endl
+        << "    -m, --max-errors N  stop after reporting this many problems with -x (0 for no limit) [10]" << endl;
 }
 
 int main_validate(int argc, char** argv) {
@@ -41,6 +46,9 @@ int main_validate(int argc, char** argv) {
     bool check_edges = false;
     bool check_orphans = false;
     bool check_paths = false;
+    string xg_name;
+    string gam_name;
+    size_t max_errors = 10;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -50,13 +58,16 @@ int main_validate(int argc, char** argv) {
             {"help", no_argument, 0, 'h'},
             {"nodes", no_argument, 0, 'n'},
             {"edges", no_argument, 0, 'e'},
-            {"paths", no_argument, 0, 'o'},
-            {"orphans", no_argument, 0, 'p'},
+            {"paths", no_argument, 0, 'p'},
+            {"orphans", no_argument, 0, 'o'},
+            {"xg", required_argument, 0, 'x'},
+            {"gam", required_argument, 0, 'a'},
+            {"max-errors", required_argument, 0, 'm'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hneop",
+        c = getopt_long (argc, argv, "hneopx:a:m:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -81,6 +92,18 @@ int main_validate(int argc, char** argv) {
             case 'p':
                 check_paths = true;
                 break;
+                
+            case 'x':
+                xg_name = optarg;
+                break;
+                
+            case 'a':
+                gam_name = optarg;
+                break;
+                
+            case 'm':
+                max_errors = atoi(optarg);
+                break;
 
             case 'h':
             case '?':
@@ -93,6 +116,44 @@ int main_validate(int argc, char** argv) {
         }
     }
 
+    if (!gam_name.empty() && xg_name.empty()) {
+        cerr << "error:[vg validate] validating alignments requires an XG index (-x)" << endl;
+        return 1;
+    }
+    
+    if (!xg_name.empty()) {
+        xg::XG xg_index;
+        get_input_file(xg_name, [&](istream& in) {
+            xg_index.load(in);
+        });
+        
+        GraphValidator validator(xg_index, max_errors);
+        
+        bool check_all = !(check_nodes || check_edges || check_orphans || check_paths || !gam_name.empty());
+        // The XG can't have missing nodes, so there is nothing separate to do
+        // for -n.
+        if (check_all || check_edges) {
+            validator.check_edges();
+        }
+        if (check_all || check_orphans) {
+            validator.check_orphans();
+        }
+        if (check_all || check_paths) {
+            validator.check_paths();
+        }
+        if (!gam_name.empty()) {
+            get_input_file(gam_name, [&](istream& in) {
+                validator.check_alignments(in);
+            });
+        }
+        
+        if (validator.error_count() > validator.get_errors().size()) {
+            cerr << "... and " << (validator.error_count() - validator.get_errors().size())
+                << " more problems" << endl;
+        }
+        return validator.error_count() == 0 ? 0 : 1;
+    }
+
     VG* graph;
     get_input_file(optind, argc, argv, [&](istream& in) {
         graph = new VG(in);
@@ -100,7 +161,7 @@ int main_validate(int argc, char** argv) {
 
     // if we chose a specific subset, do just them
     if (check_nodes || check_edges || check_orphans || check_paths) {
-        if (graph->is_valid(check_nodes, check_edges, check_orphans, check_paths)) {
+        if (graph->is_valid(check_nodes, check_edges, check_paths, check_orphans)) {
             return 0;
         } else {
             return 1;
@@ -39,6 +39,10 @@ void help_vectorize(char** argv){
          << "  -p --mem-positions Add the positions to the MEM sketch of a given read based on the GCSA" << endl
          << "  -H --mem-hit-max N Ignore MEMs with this many hits when extracting poisitions" << endl
          << "  -i --identity-hot  Output a score vector based on percent identity and coverage" << endl
+         << "  -S --sparse        Output only the nonzero entries, as node-rank:value pairs" << endl
+         << "  -C --csr PREFIX    Write a sparse matrix as NumPy arrays PREFIX.{data,indices,indptr,shape}.npy" << endl
+         << "                     for scipy.sparse.csr_matrix, with alignment names in PREFIX.names.txt" << endl
+         << "  -t --threads N     Vectorize using N threads" << endl
          << endl;
 }
 
@@ -60,6 +64,8 @@ int main_vectorize(int argc, char** argv){
     bool mem_positions = false;
     bool mem_hit_max = 0;
     int max_mem_length = 0;
+    bool sparse = false;
+    string csr_prefix;
 
     if (argc <= 2) {
         help_vectorize(argv);
@@ -86,11 +92,13 @@ int main_vectorize(int argc, char** argv){
             {"identity-hot", no_argument, 0, 'i'},
             {"aln-label", required_argument, 0, 'l'},
             {"reads", required_argument, 0, 'r'},
+            {"sparse", no_argument, 0, 'S'},
+            {"csr", required_argument, 0, 'C'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "AaihwM:fmpx:g:l:H:",
+        c = getopt_long (argc, argv, "AaihwM:fmpx:g:l:H:SC:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -173,6 +181,15 @@ int main_vectorize(int argc, char** argv){
         case 'M':
             wabbit_mapping_file = optarg;
             break;
+        case 'S':
+            sparse = true;
+            break;
+        case 'C':
+            csr_prefix = optarg;
+            break;
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
         default:
             abort();
         }
@@ -220,8 +237,13 @@ int main_vectorize(int argc, char** argv){
 
     Vectorizer vz(xg_index);
 
+    if (!csr_prefix.empty() && (mem_sketch || output_wabbit)) {
+        cerr << "[vg vectorize] error : MEM sketches and vowpal wabbit output can't be written as a matrix" << endl;
+        return 1;
+    }
+
     // write the header if needed
-    if (format) {
+    if (format && !sparse && csr_prefix.empty()) {
         cout << "aln.name";
         for (size_t i = 1; i <= xg_index->max_node_rank(); ++i) {
             cout << "\tnode." << xg_index->rank_to_id(i);
@@ -229,31 +251,65 @@ int main_vectorize(int argc, char** argv){
         cout << endl;
     }
 
+    unique_ptr<CSRWriter> csr_writer;
+    if (!csr_prefix.empty()) {
+        try {
+            csr_writer = unique_ptr<CSRWriter>(new CSRWriter(csr_prefix, xg_index->node_count));
+        } catch (runtime_error& e) {
+            cerr << "[vg vectorize] error : " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    // Get the nonzero entries of the vector we are making for an alignment
+    auto sparse_vector = [&](const Alignment& a) {
+        vector<pair<size_t, double>> v;
+        if (a_hot) {
+            for (auto& entry : vz.alignment_to_sparse_a_hot(a)) {
+                v.emplace_back(entry.first, entry.second);
+            }
+        } else if (use_identity_hot) {
+            v = vz.alignment_to_sparse_identity_hot(a);
+        } else {
+            for (auto& entry : vz.alignment_to_sparse_onehot(a)) {
+                v.emplace_back(entry.first, entry.second);
+            }
+        }
+        return v;
+    };
+
     //Generate a 1-hot coverage vector for graph entities.
-    function<void(Alignment&)> lambda = [&vz, &mapper, use_identity_hot, output_wabbit, aln_label, mem_sketch, mem_positions, format, a_hot, max_mem_length](Alignment& a){
+    function<string(Alignment&)> render = [&vz, &mapper, &sparse_vector, use_identity_hot, output_wabbit, aln_label, mem_sketch, mem_positions, format, sparse, a_hot, max_mem_length](Alignment& a){
+        stringstream out;
         //vz.add_bv(vz.alignment_to_onehot(a));
         //vz.add_name(a.name());
-        if (a_hot) {
+        if (sparse && !mem_sketch && !output_wabbit) {
+            if (format) {
+                out << a.name() << "\t";
+            }
+            out << vz.format_sparse(sparse_vector(a)) << endl;
+        }
+        else if (a_hot) {
             vector<int> v = vz.alignment_to_a_hot(a);
             if (output_wabbit){
-                cout << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
+                out << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
             }
             else if (format){
-                cout << a.name() << "\t" << vz.format(v) << endl;
+                out << a.name() << "\t" << vz.format(v) << endl;
             } else{
-                cout << v << endl;
+                out << v << endl;
             }
         }
         else if (use_identity_hot){
             vector<double> v = vz.alignment_to_identity_hot(a);
             if (output_wabbit){
-                cout << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
+                out << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
             }
             else if (format){
-                cout << a.name() << "\t" << vz.format(v) << endl;
+                out << a.name() << "\t" << vz.format(v) << endl;
             }
             else {
-                cout << vz.format(v) << endl;
+                out << vz.format(v) << endl;
             }
 
         } else if (mem_sketch) {
@@ -264,41 +320,93 @@ int main_vectorize(int argc, char** argv){
             for (auto& mem : mems) {
                 mem_to_count[mem.sequence()]++;
             }
-            cout << " |info count:" << mems.size() << " unique:" << mem_to_count.size();
-            cout << " |mems";
+            out << " |info count:" << mems.size() << " unique:" << mem_to_count.size();
+            out << " |mems";
             for (auto m : mem_to_count) {
-                cout << " " << m.first << ":" << m.second;
+                out << " " << m.first << ":" << m.second;
             }
             if (mem_positions) {
-                cout << " |positions";
+                out << " |positions";
                 for (auto& mem : mems) {
                     for (auto& node : mem.nodes) {
-                        cout << " " << gcsa::Node::id(node);
+                        out << " " << gcsa::Node::id(node);
                         if (gcsa::Node::rc(node)) {
-                            cout << "-";
+                            out << "-";
                         } else {
-                            cout << "+";
+                            out << "+";
                         }
-                        cout << ":" << mem.end - mem.begin;
+                        out << ":" << mem.end - mem.begin;
                     }
                 }
             }
-            cout << endl;
+            out << endl;
         } else {
             bit_vector v = vz.alignment_to_onehot(a);
             if (output_wabbit){
-                cout << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
+                out << vz.wabbitize(aln_label == "" ? a.name() : aln_label, v) << endl;
             } else if (format) {
-                cout << a.name() << "\t" << vz.format(v) << endl;
+                out << a.name() << "\t" << vz.format(v) << endl;
             } else{
-                cout << v << endl;
+                out << v << endl;
+            }
+        }
+        return out.str();
+    };
+
+    // Vectorize batches of alignments on all threads, and write them out in
+    // order
+    vector<Alignment> batch;
+    size_t batch_size = 1000;
+    auto flush_batch = [&]() {
+        if (output_wabbit) {
+            // Number the classes in order, before any threads look at them
+            for (auto& a : batch) {
+                vz.add_wabbit_class(aln_label == "" ? a.name() : aln_label);
+            }
+        }
+        if (csr_writer) {
+            vector<vector<pair<size_t, double>>> rows(batch.size());
+#pragma omp parallel for schedule(dynamic, 16)
+            for (size_t i = 0; i < batch.size(); i++) {
+                rows[i] = sparse_vector(batch[i]);
+            }
+            for (size_t i = 0; i < batch.size(); i++) {
+                csr_writer->add_row(batch[i].name(), rows[i]);
             }
+        } else {
+            vector<string> rendered(batch.size());
+#pragma omp parallel for schedule(dynamic, 16)
+            for (size_t i = 0; i < batch.size(); i++) {
+                rendered[i] = render(batch[i]);
+            }
+            for (auto& text : rendered) {
+                cout << text;
+            }
+        }
+        batch.clear();
+    };
+    function<void(Alignment&)> lambda = [&](Alignment& a) {
+        batch.emplace_back();
+        batch.back().Swap(&a);
+        if (batch.size() >= batch_size) {
+            flush_batch();
         }
     };
+    function<void(uint64_t)> no_count = [](uint64_t) { };
     
     get_input_file(optind, argc, argv, [&](istream& in) {
-        stream::for_each(in, lambda);
+        stream::for_each_ordered_parallel(in, lambda, no_count);
     });
+    flush_batch();
+
+    if (csr_writer) {
+        try {
+            csr_writer->close();
+        } catch (runtime_error& e) {
+            cerr << "[vg vectorize] error : " << e.what() << endl;
+            return 1;
+        }
+    }
 
     string mapping_str = vz.output_wabbit_map();
     if (output_wabbit){
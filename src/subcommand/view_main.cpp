@@ -15,6 +15,8 @@
 
 #include "../multipath_alignment.hpp"
 #include "../vg.hpp"
+#include "../gfa_stream.hpp"
+#include "../columnar_gam.hpp"
 
 using namespace std;
 using namespace vg;
@@ -26,6 +28,8 @@ void help_view(char** argv) {
          << "options:" << endl
          << "    -g, --gfa                  output GFA format (default)" << endl
          << "    -F, --gfa-in               input GFA format, reducing overlaps if they occur" << endl
+         << "    --stream-gfa               with -F and -v, convert chunk by chunk without loading the whole" << endl
+         << "                               graph (overlapping GFA links are not supported)" << endl
 
          << "    -v, --vg                   output VG format" << endl
          << "    -V, --vg-in                input VG format (default)" << endl
@@ -45,6 +49,9 @@ void help_view(char** argv) {
 
          << "    -a, --align-in             input GAM format" << endl
          << "    -A, --aln-graph GAM        add alignments from GAM to the graph" << endl
+         << "    --gamc                     output columnar GAM (GAMC), which can be read a column at a time" << endl
+         << "    --gamc-in                  input columnar GAM (output defaults to JSON)" << endl
+         << "    --compression CODEC        compress GAM and other protobuf output with gzip, snappy or lz4 [gzip]" << endl
 
          << "    -q, --locus-in             input stream is Locus format" << endl
          << "    -z, --locus-out            output stream Locus format" << endl
@@ -98,12 +105,14 @@ int main_view(int argc, char** argv) {
     // json     Y   Y       Y   N   N   N       Y
     // gfa      Y   Y       Y   N   N   N       Y
     // gam      N   Y       N   N   N   N       N
+    // gamc     N   Y       N   Y   N   Y       N
     // bam      N   N       N   Y   N   N       N
     // fastq    N   N       N   Y   N   N       N
     // dot      N   N       N   N   N   N       N
     //
     // and json-gam -> gam
     //     json-pileup -> pileup
+    //     gam, json-gam -> gamc
 
     string output_type;
     string input_type;
@@ -125,6 +134,7 @@ int main_view(int argc, char** argv) {
     bool skip_missing_nodes = false;
     bool expect_duplicates = false;
     bool ascii_labels = false;
+    bool stream_gfa = false;
     omp_set_num_threads(1); // default to 1 thread
 
     int c;
@@ -175,11 +185,15 @@ int main_view(int argc, char** argv) {
                 {"multipath-in", no_argument, 0, 'K'},
                 {"ascii-labels", no_argument, 0, 'e'},
                 {"threads", required_argument, 0, '7'},
+                {"stream-gfa", no_argument, 0, '8'},
+                {"gamc", no_argument, 0, '9'},
+                {"gamc-in", no_argument, 0, '6'},
+                {"compression", required_argument, 0, '5'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "dgFjJhvVpaGbifA:s:wnlLIMcTtr:SCZYmqQ:zXREDkKe7:",
+        c = getopt_long (argc, argv, "dgFjJhvVpaGbifA:s:wnlLIMcTtr:SCZYmqQ:zXREDkKe7:8965:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -389,6 +403,31 @@ int main_view(int argc, char** argv) {
             omp_set_num_threads(atoi(optarg));
             break;
 
+        case '8':
+            stream_gfa = true;
+            break;
+
+        case '9':
+            output_type = "gamc";
+            break;
+
+        case '6':
+            input_type = "gamc";
+            if (output_type.empty()) {
+                // Default to GAMC -> JSON
+                output_type = "json";
+            }
+            break;
+
+        case '5':
+            try {
+                stream::set_default_codec(stream::parse_codec(optarg));
+            } catch (invalid_argument& e) {
+                cerr << "[vg view] error: unknown compression codec (--compression) " << optarg << ", choose from gzip, snappy or lz4" << endl;
+                exit(1);
+            }
+            break;
+
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -445,6 +484,27 @@ int main_view(int argc, char** argv) {
             });
         }
         // VG can convert to any of the graph formats, so keep going
+    } else if (input_type == "gfa" && stream_gfa) {
+        if (output_type != "vg") {
+            cerr << "[vg view] error: --stream-gfa can only produce VG format (-v)" << endl;
+            return 1;
+        }
+        // Write each chunk out as soon as we have it
+        vector<Graph> buf;
+        try {
+            get_input_file(file_name, [&](istream& in) {
+                gfa_for_each_chunk(in, [&](Graph& chunk) {
+                    buf.emplace_back();
+                    buf.back().Swap(&chunk);
+                    stream::write_buffered(cout, buf, 10);
+                });
+            });
+        } catch (const runtime_error& e) {
+            cerr << "[vg view] error: " << e.what() << endl;
+            return 1;
+        }
+        stream::write_buffered(cout, buf, 0);
+        return 0;
     } else if (input_type == "gfa") {
         get_input_file(file_name, [&](istream& in) {
             graph = new VG;
@@ -467,19 +527,27 @@ int main_view(int argc, char** argv) {
     } else if (input_type == "gam") {
         if (!input_json) {
             if (output_type == "json") {
-                // convert values to printable ones
-                function<void(Alignment&)> lambda = [](Alignment& a) {
+                // Parse and convert to JSON on all threads, in order
+                vector<Alignment> buf;
+                function<void(Alignment&)> lambda = [&buf](Alignment& a) {
                     if(std::isnan(a.identity())) {
                         // Fix up NAN identities that can't be serialized in
                         // JSON. We shouldn't generate these any more, and they
                         // are out of spec, but they can be in files.
                         a.set_identity(0);
                     }
-                    cout << pb2json(a) << "\n";
+                    buf.emplace_back();
+                    buf.back().Swap(&a);
+                    if (buf.size() >= 1000) {
+                        write_json_parallel(cout, buf);
+                        buf.clear();
+                    }
                 };
+                function<void(uint64_t)> no_count = [](uint64_t) { };
                 get_input_file(file_name, [&](istream& in) {
-                    stream::for_each(in, lambda);
+                    stream::for_each_ordered_parallel(in, lambda, no_count);
                 });
+                write_json_parallel(cout, buf);
             } else if (output_type == "fastq") {
                 function<void(Alignment&)> lambda = [](Alignment& a) {
                     cout << "@" << a.name() << endl
@@ -507,9 +575,18 @@ int main_view(int argc, char** argv) {
                 });
                 stream::write_buffered(cout, buf, 0);
             }
+            else if (output_type == "gamc") {
+                stream::ColumnarAlignmentWriter writer(cout);
+                function<void(Alignment&)> lambda = [&writer](Alignment& aln) {
+                    writer.write(aln);
+                };
+                get_input_file(file_name, [&](istream& in) {
+                    stream::for_each(in, lambda);
+                });
+            }
             else {
                 // todo
-                cerr << "[vg view] error: (binary) GAM can only be converted to JSON, GAMP or FASTQ" << endl;
+                cerr << "[vg view] error: (binary) GAM can only be converted to JSON, GAMP, GAMC or FASTQ" << endl;
                 return 1;
             }
         } else {
@@ -527,13 +604,71 @@ int main_view(int argc, char** argv) {
                 }
                 stream::write_buffered(cout, buf, 0);
             }
+            else if (output_type == "gamc") {
+                stream::ColumnarAlignmentWriter writer(cout);
+                Alignment aln;
+                while (json_helper.get_read_fn()(aln)) {
+                    writer.write(aln);
+                }
+            }
             else {
-                cerr << "[vg view] error: JSON GAM can only be converted to GAM, GAMP, or JSON" << endl;
+                cerr << "[vg view] error: JSON GAM can only be converted to GAM, GAMP, GAMC, or JSON" << endl;
                 return 1;
             }
         }
         cout.flush();
         return 0;
+    } else if (input_type == "gamc") {
+        if (output_type == "json") {
+            vector<Alignment> buf;
+            function<void(Alignment&)> lambda = [&buf](Alignment& a) {
+                if(std::isnan(a.identity())) {
+                    // Fix up NAN identities that can't be serialized in JSON
+                    a.set_identity(0);
+                }
+                buf.emplace_back();
+                buf.back().Swap(&a);
+                if (buf.size() >= 1000) {
+                    write_json_parallel(cout, buf);
+                    buf.clear();
+                }
+            };
+            get_input_file(file_name, [&](istream& in) {
+                stream::for_each_columnar(in, lambda);
+            });
+            write_json_parallel(cout, buf);
+        } else if (output_type == "gam") {
+            vector<Alignment> buf;
+            function<void(Alignment&)> lambda = [&buf](Alignment& a) {
+                buf.emplace_back();
+                buf.back().Swap(&a);
+                stream::write_buffered(cout, buf, 1000);
+            };
+            get_input_file(file_name, [&](istream& in) {
+                stream::for_each_columnar(in, lambda);
+            });
+            stream::write_buffered(cout, buf, 0);
+        } else if (output_type == "fastq") {
+            function<void(Alignment&)> lambda = [](Alignment& a) {
+                cout << "@" << a.name() << endl
+                     << a.sequence() << endl
+                     << "+" << endl;
+                if (a.quality().empty()) {
+                    cout << string(a.sequence().size(), quality_short_to_char(30)) << endl;
+                } else {
+                    cout << string_quality_short_to_char(a.quality()) << endl;
+                }
+            };
+            // only the columns that go into the FASTQ need to be decoded
+            get_input_file(file_name, [&](istream& in) {
+                stream::for_each_columnar(in, lambda, stream::COLUMN_NAME | stream::COLUMN_SEQUENCE | stream::COLUMN_QUALITY);
+            });
+        } else {
+            cerr << "[vg view] error: GAMC can only be converted to GAM, JSON or FASTQ" << endl;
+            return 1;
+        }
+        cout.flush();
+        return 0;
     } else if (input_type == "bam") {
         if (output_type == "gam") {
             //function<void(const Alignment&)>& lambda) {
@@ -638,12 +773,20 @@ int main_view(int argc, char** argv) {
                 stream::write_buffered(std::cout, buf, 0);
             }
             else if (output_type == "json") {
-                function<void(MultipathAlignment&)> lambda = [&](MultipathAlignment& mp_aln) {
-                    cout << pb2json(mp_aln) << endl;
+                vector<MultipathAlignment> buf;
+                function<void(MultipathAlignment&)> lambda = [&buf](MultipathAlignment& mp_aln) {
+                    buf.emplace_back();
+                    buf.back().Swap(&mp_aln);
+                    if (buf.size() >= 1000) {
+                        write_json_parallel(cout, buf);
+                        buf.clear();
+                    }
                 };
+                function<void(uint64_t)> no_count = [](uint64_t) { };
                 get_input_file(file_name, [&](istream& in) {
-                    stream::for_each(in, lambda);
+                    stream::for_each_ordered_parallel(in, lambda, no_count);
                 });
+                write_json_parallel(cout, buf);
             }
             else {
                 cerr << "[vg view] error: Unrecognized output format for MultipathAlignment (GAMP)" << endl;
@@ -3,6 +3,7 @@
 #include "../viz.hpp"
 #include "../stream.hpp"
 
+#include <omp.h>
 #include <unistd.h>
 #include <getopt.h>
 
@@ -20,7 +21,10 @@ void help_viz(char** argv) {
          << "    -Y, --height N        write an image N pixels high (default 1024)" << endl
          << "    -C, --show-cnv        visualize CNVs in paths on new rows (default uses text)" << endl
          << "    -P, --hide-paths      hide reference paths in the graph" << endl
-         << "    -D, --hide-dna        suppress the visualization of DNA sequences" << endl;
+         << "    -D, --hide-dna        suppress the visualization of DNA sequences" << endl
+         << "    -b, --bin-bp N        draw an overview, summing up N bp of the graph in each pixel column" << endl
+         << "    -w, --tile-width N    split the overview into images N columns wide, numbered before the extension" << endl
+         << "    -t, --threads N       use N threads to sum up the overview" << endl;
 }
 
 int main_viz(int argc, char** argv) {
@@ -35,6 +39,8 @@ int main_viz(int argc, char** argv) {
     bool show_cnv = false;
     bool show_dna = true;
     bool show_paths = true;
+    size_t bin_bp = 0;
+    size_t tile_bins = 0;
     
     if (argc == 2) {
         help_viz(argv);
@@ -57,10 +63,13 @@ int main_viz(int argc, char** argv) {
             {"hide-cnv", no_argument, 0, 'C'},
             {"hide-dna", no_argument, 0, 'D'},
             {"hide-paths", no_argument, 0, 'P'},
+            {"bin-bp", required_argument, 0, 'b'},
+            {"tile-width", required_argument, 0, 'w'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:i:n:o:X:Y:s:CDP",
+        c = getopt_long (argc, argv, "hx:i:n:o:X:Y:s:CDPb:w:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -104,11 +113,25 @@ int main_viz(int argc, char** argv) {
         case 'P':
             show_paths = false;
             break;
+        case 'b':
+            bin_bp = atoll(optarg);
+            break;
+        case 'w':
+            tile_bins = atoll(optarg);
+            break;
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
         default:
             abort();
         }
     }
 
+    if (tile_bins && !bin_bp) {
+        cerr << "Tiled output is only available for overviews. Give a bin size with -b." << endl;
+        exit(1);
+    }
+
     xg::XG xgidx;
     if (xg_name.empty()) {
         cerr << "No XG index given. An XG index must be provided." << endl;
@@ -131,7 +154,8 @@ int main_viz(int argc, char** argv) {
         pack_names = packs_in;
     }
 
-    Viz viz(&xgidx, &packs, pack_names, image_out, image_width, image_height, show_cnv, show_dna, show_paths);
+    Viz viz(&xgidx, &packs, pack_names, image_out, image_width, image_height, show_cnv, show_dna, show_paths,
+            bin_bp, tile_bins);
     viz.draw();
 
     return 0;
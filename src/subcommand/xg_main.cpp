@@ -20,6 +20,7 @@
 #include "../xg.hpp"
 #include "../region.hpp"
 #include "../converter.hpp"
+#include "../gfa_stream.hpp"
 
 using namespace std;
 using namespace vg;
@@ -32,6 +33,7 @@ void help_xg(char** argv) {
          << endl
          << "options:" << endl
          << "    -v, --vg FILE              compress graph in vg FILE" << endl
+         << "    -g, --gfa FILE             compress graph in blunt GFA FILE, without loading it into a vg graph" << endl
          << "    -V, --validate             validate compression" << endl
          << "    -o, --out FILE             serialize graph to FILE in xg format" << endl
          << "    -i, --in FILE              use index in FILE" << endl
@@ -65,6 +67,7 @@ int main_xg(int argc, char** argv) {
     }
 
     string vg_in;
+    string gfa_in;
     string vg_out;
     string out_name;
     string in_name;
@@ -96,6 +99,7 @@ int main_xg(int argc, char** argv) {
             {
                 {"help", no_argument, 0, 'h'},
                 {"vg", required_argument, 0, 'v'},
+                {"gfa", required_argument, 0, 'g'},
                 {"out", required_argument, 0, 'o'},
                 {"in", required_argument, 0, 'i'},
                 {"extract-vg", required_argument, 0, 'X'},
@@ -123,7 +127,7 @@ int main_xg(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hv:o:i:X:f:t:s:c:n:p:DxrdTO:S:E:VR:P:F:b:",
+        c = getopt_long (argc, argv, "hv:g:o:i:X:f:t:s:c:n:p:DxrdTO:S:E:VR:P:F:b:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -137,6 +141,10 @@ int main_xg(int argc, char** argv) {
             vg_in = optarg;
             break;
 
+        case 'g':
+            gfa_in = optarg;
+            break;
+
         case 'V':
             validate_graph = true;
             break;
@@ -245,8 +253,27 @@ int main_xg(int argc, char** argv) {
 
     XG* graph = nullptr;
     //string file_name = argv[optind];
-    if (in_name.empty()) assert(!vg_in.empty());
-    if (vg_in == "-") {
+    if (in_name.empty()) assert(!vg_in.empty() || !gfa_in.empty());
+    if (gfa_in.size()) {
+        ifstream gfa_file;
+        if (gfa_in != "-") {
+            gfa_file.open(gfa_in.c_str());
+            if (!gfa_file) {
+                cerr << "error:[vg xg] could not open " << gfa_in << endl;
+                return 1;
+            }
+        }
+        istream& in = gfa_in == "-" ? std::cin : gfa_file;
+        graph = new XG;
+        try {
+            graph->from_callback([&](function<void(Graph&)> callback) {
+                gfa_for_each_chunk(in, callback);
+            }, validate_graph, print_graph, store_threads, is_sorted_dag);
+        } catch (const runtime_error& e) {
+            cerr << "error:[vg xg] " << e.what() << endl;
+            return 1;
+        }
+    } else if (vg_in == "-") {
         graph = new XG;
         graph->from_stream(std::cin, validate_graph, print_graph, store_threads, is_sorted_dag);
     } else if (vg_in.size()) {
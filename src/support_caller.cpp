@@ -216,9 +216,9 @@ string get_pileup_line(const map<int64_t, NodePileup>& node_pileups,
 SupportCaller::PrimaryPath::PrimaryPath(SupportAugmentedGraph& augmented, const string& ref_path_name, size_t ref_bin_size):
     ref_bin_size(ref_bin_size), index(augmented.graph, ref_path_name, true), name(ref_path_name)  {
 
-    // Follow the reference path and extract indexes we need: index by node ID,
-    // index by node start, and the reconstructed path sequence.
-    PathIndex index(augmented.graph, ref_path_name, true);
+    // The index member has already followed the reference path and extracted
+    // the indexes we need: index by node ID, index by node start, and the
+    // reconstructed path sequence.
 
     if (index.sequence.size() == 0) {
         // No empty reference paths allowed
@@ -238,20 +238,20 @@ SupportCaller::PrimaryPath::PrimaryPath(SupportAugmentedGraph& augmented, const
     // Crunch the numbers on the reference and its read support. How much read
     // support in total (node length * aligned reads) does the primary path get?
     total_support = Support();
-    for(auto& pointerAndSupport : augmented.node_supports) {
-        if(index.by_id.count(pointerAndSupport.first->id())) {
+    augmented.for_each_node_support([&](Node* node, const Support& support) {
+        if(index.by_id.count(node->id())) {
             // This is a primary path node. Add in the total read bases supporting it
-            total_support += pointerAndSupport.first->sequence().size() * pointerAndSupport.second;
+            total_support += node->sequence().size() * support;
             
             // We also update the total for the appropriate bin
-            size_t bin = index.by_id[pointerAndSupport.first->id()].first / ref_bin_size;
+            size_t bin = index.by_id.at(node->id()).first / ref_bin_size;
             if (bin == binned_support.size()) {
                 --bin;
             }
             binned_support[bin] = binned_support[bin] + 
-                pointerAndSupport.first->sequence().size() * pointerAndSupport.second;
+                node->sequence().size() * support;
         }
-    }
+    });
     
     // Average out the support bins too (in place)
     min_bin = 0;
@@ -1255,6 +1255,7 @@ void SupportCaller::call(
             return nullptr;
         }
     });
+    traversal_finder.max_site_search_ticks = max_site_search;
     
     // We're going to remember what nodes and edges are covered by sites, so we
     // will know which nodes/edges aren't in any sites and may need generic
@@ -1268,7 +1269,19 @@ void SupportCaller::call(
     // How many sites result in output?
     size_t called_loci = 0;
     
-    for(const Snarl* site : sites) {
+    // Sites are called in shards that can run in parallel. Each shard holds
+    // its output until it can be written out in order.
+    struct CallShard {
+        vector<const Snarl*> sites;
+        stringstream vcf_lines;
+        vector<Locus> loci;
+        set<Node*> covered_nodes;
+        set<Edge*> covered_edges;
+        size_t called_loci = 0;
+    };
+    
+    // Call a site, and any children it breaks into, into the given shard
+    auto call_site = [&](const Snarl* site, CallShard& shard) {
         // For every site, we're going to make a bunch of Locus objects
         
         // See if the site is on a primary path, so we can use binned support.
@@ -1311,7 +1324,7 @@ void SupportCaller::call(
         // VCF. It needs to take the site as an argument because it may be
         // called for children of the site we're working on right now.
         auto emit_variant = [&contig_names_by_path_name, &vcf, &augmented,
-            &baseline_support, &global_baseline_support, this](
+            &baseline_support, &global_baseline_support, &shard, this](
             const Locus& locus, PrimaryPath& primary_path, const Snarl* site) {
         
             // Note that the locus paths will traverse our site forward, which
@@ -1715,7 +1728,7 @@ void SupportCaller::call(
                 if(can_write_alleles(variant)) {
                     // No need to check for collisions because we assume sites are correctly found.
                     // Output the created VCF variant.
-                    cout << variant << endl;
+                    shard.vcf_lines << variant << endl;
             
                 } else {
                     if (verbose) {
@@ -1728,8 +1741,8 @@ void SupportCaller::call(
         
         // Recursively type the site, using that support and an assumption of a diploid sample.
         find_best_traversals(augmented, site_manager, &traversal_finder, *site, baseline_support, 2,
-            [&locus_buffer, &emit_variant, &site_manager, &called_loci, &primary_paths, &augmented,
-            &covered_nodes, &covered_edges, this](const Locus& locus, const Snarl* site) {
+            [&shard, &emit_variant, &site_manager, &primary_paths, &augmented,
+            this](const Locus& locus, const Snarl* site) {
             
             // Now we have the Locus with call information, and the site (either
             // the root snarl we passed in or a child snarl) that the call is
@@ -1749,29 +1762,100 @@ void SupportCaller::call(
                 // Otherwise discard it as off-path
                 // TODO: update bases lost
             } else {
-                // Emit the locus itself
-                locus_buffer.push_back(locus);
-                stream::write_buffered(cout, locus_buffer, locus_buffer_size);
+                // Save the locus itself
+                shard.loci.push_back(locus);
             }
             
             // We called a site
-            called_loci++;
+            shard.called_loci++;
             
             // Mark all the nodes and edges in the site as covered
             auto contents = site_manager.deep_contents(site, augmented.graph, true);
             for (auto* node : contents.first) {
-                covered_nodes.insert(node);
+                shard.covered_nodes.insert(node);
             }
             for (auto* edge : contents.second) {
-                covered_edges.insert(edge);
+                shard.covered_edges.insert(edge);
             }
         });
+    };
+    
+    // Put the sites in order along the primary paths, and cut them into
+    // shards by reference region. Sites off the primary paths come last, in
+    // shards of a fixed number of sites.
+    vector<pair<pair<size_t, size_t>, const Snarl*>> ordered_sites;
+    for (const Snarl* site : sites) {
+        size_t path_number = primary_paths.size();
+        size_t position = 0;
+        auto found_path = find_path(*site, primary_paths);
+        if (found_path != primary_paths.end()) {
+            path_number = distance(primary_paths.begin(), found_path);
+            position = min(found_path->second.get_index().by_id.at(site->start().node_id()).first,
+                found_path->second.get_index().by_id.at(site->end().node_id()).first);
+        }
+        ordered_sites.emplace_back(make_pair(path_number, position), site);
+    }
+    stable_sort(ordered_sites.begin(), ordered_sites.end(),
+        [](const pair<pair<size_t, size_t>, const Snarl*>& a, const pair<pair<size_t, size_t>, const Snarl*>& b) {
+        return a.first < b.first;
+    });
+    
+    size_t bp_per_shard = max<size_t>(shard_size, 1);
+    const size_t off_path_sites_per_shard = 64;
+    vector<unique_ptr<CallShard>> shards;
+    pair<size_t, size_t> shard_key;
+    for (size_t i = 0; i < ordered_sites.size(); i++) {
+        pair<size_t, size_t> key = ordered_sites[i].first;
+        key.second = (key.first == primary_paths.size()) ? i / off_path_sites_per_shard : key.second / bp_per_shard;
+        if (shards.empty() || key != shard_key) {
+            shards.emplace_back(new CallShard());
+            shard_key = key;
+        }
+        shards.back()->sites.push_back(ordered_sites[i].second);
+    }
+    
+    if (verbose) {
+        cerr << "Calling sites in " << shards.size() << " shards" << endl;
+    }
+    
+    // Call a batch of shards at a time on all the threads, and then write
+    // their output in order, so the results don't depend on scheduling.
+    size_t shards_per_batch = 4 * get_thread_count();
+    for (size_t batch_start = 0; batch_start < shards.size(); batch_start += shards_per_batch) {
+        size_t batch_end = min(batch_start + shards_per_batch, shards.size());
+        
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch_start; i < batch_end; i++) {
+            for (const Snarl* site : shards[i]->sites) {
+                call_site(site, *shards[i]);
+            }
+        }
+        
+        for (size_t i = batch_start; i < batch_end; i++) {
+            CallShard& shard = *shards[i];
+            cout << shard.vcf_lines.str();
+            for (auto& locus : shard.loci) {
+                locus_buffer.push_back(locus);
+                stream::write_buffered(cout, locus_buffer, locus_buffer_size);
+            }
+            covered_nodes.insert(shard.covered_nodes.begin(), shard.covered_nodes.end());
+            covered_edges.insert(shard.covered_edges.begin(), shard.covered_edges.end());
+            called_loci += shard.called_loci;
+            // Free the shard's memory now that its output is written
+            shards[i].reset();
+        }
     }
     
     if (verbose) {
         cerr << "Called " << called_loci << " loci" << endl;
     }
     
+    if (traversal_finder.get_sites_over_budget() > 0) {
+        // Some sites may be missing alleles
+        cerr << "warning:[vg call] " << traversal_finder.get_sites_over_budget() << " sites hit the search budget of "
+            << (size_t) max_site_search << " steps and were called from the traversals found so far" << endl;
+    }
+    
     // OK now we have handled all the real sites. But there are still nodes and
     // edges that we might want to call as present or absent.
     
@@ -1809,8 +1893,8 @@ void SupportCaller::call(
                 *path->add_mapping() = to_mapping(to_visit, augmented.graph);
                 
                 // Set the support
-                *locus.add_support() = augmented.edge_supports[e];
-                *locus.mutable_overall_support() = augmented.edge_supports[e];
+                *locus.add_support() = augmented.get_support(e);
+                *locus.mutable_overall_support() = augmented.get_support(e);
                 
                 // Decide on the genotype
                 Genotype gt;
@@ -249,6 +249,11 @@ public:
     /// for traversals?
     Option<int64_t> max_search_width{this, "max-search-width", "wWmMsS", 1000,
         "maximum width for path search"};
+    /// How many search steps should we take, over all the path searches for
+    /// a site, before calling it with the traversals we have? Keeps a few
+    /// tangled sites from taking most of the run time.
+    Option<size_t> max_site_search{this, "max-site-search", "kKwWmMsS", 0,
+        "maximum search steps per site, or 0 for no limit"};
     
     
     /// What fraction of average coverage should be the minimum to call a
@@ -281,6 +286,10 @@ public:
     /// of a certain depth
     Option<size_t> ref_bin_size{this, "bin-size", "B", 250,
         "bin size used for counting coverage"};
+    /// How many bases of primary path should each shard of sites that we
+    /// call in parallel cover?
+    Option<size_t> shard_size{this, "shard-size", "zZhH", 1000000,
+        "call sites in parallel shards covering this many bp of reference"};
     /// On some graphs, we can't get the coverage because it's split over
     /// parallel paths.  Allow overriding here
     Option<double> expected_coverage{this, "avg-coverage", "C", 0.0,
@@ -13,6 +13,125 @@ namespace vg {
 
 using namespace std;
     
+    PathMembershipIndex::PathMembershipIndex(const xg::XG& xg_index, const set<string>& path_names) :
+        xg_index(xg_index) {
+        
+        for (const string& path_name : path_names) {
+            size_t path_rank = xg_index.path_rank(path_name);
+            if (path_rank == 0) {
+                throw runtime_error("[PathMembershipIndex] path " + path_name + " is not in the graph");
+            }
+            path_ranks.push_back(path_rank);
+        }
+        
+        words_per_set = max<size_t>((path_ranks.size() + 63) / 64, 1);
+        // path set 0 is the empty set
+        set_words.assign(words_per_set, 0);
+        node_path_set.assign(xg_index.max_node_rank() + 1, 0);
+        
+        // we add paths one at a time, so a node's new set depends only on its old one
+        map<vector<uint64_t>, uint32_t> set_ids;
+        set_ids[vector<uint64_t>(words_per_set, 0)] = 0;
+        for (size_t i = 0; i < path_ranks.size(); i++) {
+            unordered_map<uint32_t, uint32_t> added_to;
+            const xg::XGPath& xpath = xg_index.get_path(xg_index.path_name(path_ranks[i]));
+            for (size_t j = 0; j < xpath.size(); j++) {
+                uint32_t& path_set = node_path_set[xg_index.id_to_rank(xpath.node(j))];
+                auto found = added_to.find(path_set);
+                if (found != added_to.end()) {
+                    path_set = found->second;
+                    continue;
+                }
+                
+                vector<uint64_t> words(set_words.begin() + path_set * words_per_set,
+                                       set_words.begin() + (path_set + 1) * words_per_set);
+                words[i / 64] |= uint64_t(1) << (i % 64);
+                auto inserted = set_ids.emplace(words, set_ids.size());
+                if (inserted.second) {
+                    if (set_ids.size() > numeric_limits<uint32_t>::max()) {
+                        throw runtime_error("[PathMembershipIndex] too many distinct combinations of paths");
+                    }
+                    set_words.insert(set_words.end(), words.begin(), words.end());
+                }
+                added_to[path_set] = inserted.first->second;
+                path_set = inserted.first->second;
+            }
+        }
+    }
+    
+    size_t PathMembershipIndex::path_count() const {
+        return path_ranks.size();
+    }
+    
+    uint32_t PathMembershipIndex::path_set_of(id_t node_id) const {
+        size_t node_rank = xg_index.id_to_rank(node_id);
+        if (node_rank == 0) {
+            throw runtime_error("[PathMembershipIndex] node " + to_string(node_id) + " is not in the graph");
+        }
+        return node_path_set[node_rank];
+    }
+    
+    void PathMembershipIndex::paths_of_node(id_t node_id, vector<size_t>& paths_out) const {
+        paths_out.clear();
+        const uint64_t* words = set_words.data() + path_set_of(node_id) * words_per_set;
+        for (size_t i = 0; i < words_per_set; i++) {
+            for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                paths_out.push_back(path_ranks[i * 64 + __builtin_ctzll(word)]);
+            }
+        }
+    }
+    
+    vector<size_t> PathMembershipIndex::candidate_paths(const Path& path, size_t max_candidates) const {
+        
+        // reads only pass through a few path sets, so total up the bases in each of those first
+        vector<pair<uint32_t, int64_t>> bases_in_set;
+        for (size_t i = 0; i < path.mapping_size(); i++) {
+            uint32_t path_set = path_set_of(path.mapping(i).position().node_id());
+            if (path_set == 0) {
+                continue;
+            }
+            int64_t bases = mapping_from_length(path.mapping(i));
+            auto iter = find_if(bases_in_set.begin(), bases_in_set.end(), [&](const pair<uint32_t, int64_t>& entry) {
+                return entry.first == path_set;
+            });
+            if (iter == bases_in_set.end()) {
+                bases_in_set.emplace_back(path_set, bases);
+            }
+            else {
+                iter->second += bases;
+            }
+        }
+        
+        // then credit the bases to each path in the sets
+        unordered_map<size_t, int64_t> bases_on_path;
+        for (const auto& entry : bases_in_set) {
+            const uint64_t* words = set_words.data() + entry.first * words_per_set;
+            for (size_t i = 0; i < words_per_set; i++) {
+                for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                    bases_on_path[i * 64 + __builtin_ctzll(word)] += entry.second;
+                }
+            }
+        }
+        
+        vector<pair<int64_t, size_t>> ranked;
+        for (const auto& path_bases : bases_on_path) {
+            ranked.emplace_back(path_bases.second, path_bases.first);
+        }
+        // most bases first, and ties in the order the paths were given
+        sort(ranked.begin(), ranked.end(), [](const pair<int64_t, size_t>& a, const pair<int64_t, size_t>& b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        });
+        if (max_candidates != 0 && ranked.size() > max_candidates) {
+            ranked.resize(max_candidates);
+        }
+        
+        vector<size_t> to_return;
+        for (const auto& path_bases : ranked) {
+            to_return.push_back(path_ranks[path_bases.second]);
+        }
+        return to_return;
+    }
+    
     Surjector::Surjector(xg::XG* xg_index) : Mapper(xg_index, nullptr, nullptr) {
         
     }
@@ -20,6 +139,8 @@ using namespace std;
     Surjector::~Surjector() {
         
     }
+    
+    thread_local xg::XGQueryContext Surjector::xg_query_context;
 
     Alignment Surjector::surject_classic(const Alignment& source,
                                          const set<string>& path_names,
@@ -79,7 +200,8 @@ using namespace std;
         // 3) detach the nodes on the other sides of the aln path start and end from all other nodes
         // 4) remove the non-path component
         
-        Alignment trimmed_source = strip_from_end(strip_from_start(source, softclip_start(source)), softclip_end(source));
+        Alignment trimmed_source = strip_from_start(source, softclip_start(source));
+        strip_from_end_in_place(&trimmed_source, softclip_end(source));
         // check if we'd fail
         if (trimmed_source.sequence().size() == 0) {
             return surjection;
@@ -250,7 +372,8 @@ using namespace std;
             end_softclip_fwd = strip_from_start(surjection_fwd, surjection_fwd.sequence().size() - end_softclip_length);
             start_softclip_rev = reverse_complement_alignment(end_softclip_fwd, [&](id_t id) { return xindex->node_length(id); });
         }
-        surjection_fwd = strip_from_end(strip_from_start(surjection_fwd, start_softclip_length), end_softclip_length);
+        strip_from_start_in_place(&surjection_fwd, start_softclip_length);
+        strip_from_end_in_place(&surjection_fwd, end_softclip_length);
         surjection_rev = reverse_complement_alignment(surjection_fwd, [&](id_t id) { return xindex->node_length(id); });
         
         // align to the graph with a big full len, and simplify without removal of internal deletions, as we'll need these for BAM reconstruction
@@ -261,11 +384,13 @@ using namespace std;
         int8_t saved_bonus = get_aligner(!surjection.quality().empty())->full_length_bonus;
         get_aligner(!surjection.quality().empty())->full_length_bonus = full_length_bonus_override;
         if (count_forward) {
-            surjection_forward = simplify(align_to_graph(surjection_fwd, graph.graph, max_query_graph_ratio, true, false, false, false, false, false), false);
+            surjection_forward = align_to_graph(surjection_fwd, graph.graph, max_query_graph_ratio, true, false, false, false, false, false);
+            simplify_in_place(&surjection_forward, false);
             fwd_score = surjection_forward.score();
         }
         if (count_reverse) {
-            surjection_reverse = simplify(align_to_graph(surjection_rev, graph.graph, max_query_graph_ratio, true, false, false, false, false, false), false);
+            surjection_reverse = align_to_graph(surjection_rev, graph.graph, max_query_graph_ratio, true, false, false, false, false, false);
+            simplify_in_place(&surjection_reverse, false);
             rev_score = surjection_reverse.score();
         }
         // reset bonus because hacks
@@ -321,7 +446,7 @@ using namespace std;
             }
         }
         
-        surjection = simplify(surjection, false);
+        simplify_in_place(&surjection, false);
 
 #ifdef debug_surject
         
@@ -419,17 +544,27 @@ using namespace std;
         
         // translate the path names into ranks for the XG
         unordered_map<size_t, string> path_rank_to_name;
-        for (const string& path_name : path_names) {
-            path_rank_to_name[xindex->path_rank(path_name)] = path_name;
+        if (path_membership != nullptr) {
+            if (path_membership->path_count() != path_names.size()) {
+                throw runtime_error("[Surjector::path_anchored_surject] path membership index is for different paths");
+            }
+            // only consider the paths that the read follows the furthest
+            for (size_t path_rank : path_membership->candidate_paths(source.path(), max_candidate_paths)) {
+                path_rank_to_name[path_rank] = xindex->path_name(path_rank);
+            }
+        }
+        else {
+            for (const string& path_name : path_names) {
+                path_rank_to_name[xindex->path_rank(path_name)] = path_name;
+            }
         }
         
         
-        // memos for expensive succinct operations that may be repeated
-        unordered_map<int64_t, vector<size_t>> paths_of_node_memo;
-        unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>> oriented_occurrences_memo;
+        // clear the cache for expensive succinct operations that may be repeated
+        xg_query_context.reset(xindex);
         
         // get the chunks of the aligned path that overlap the ref path
-        auto path_overlapping_anchors = extract_overlapping_paths(source, path_rank_to_name, &paths_of_node_memo, &oriented_occurrences_memo);
+        auto path_overlapping_anchors = extract_overlapping_paths(source, path_rank_to_name, xg_query_context);
         
 #ifdef debug_anchored_surject
         cerr << "got path overlapping segments" << endl;
@@ -448,7 +583,27 @@ using namespace std;
         
         // the surjected alignment for each path we overlapped
         unordered_map<size_t, Alignment> path_surjections;
+        
+        // most reads already follow a reference path end to end, and then the alignment is
+        // its own surjection, so we can skip realigning it
+        for (const pair<const size_t, vector<path_chunk_t>>& path_record : path_overlapping_anchors) {
+            if (path_record.second.size() == 1
+                && path_record.second.front().first.first == source.sequence().begin()
+                && path_record.second.front().first.second == source.sequence().end()) {
+#ifdef debug_anchored_surject
+                cerr << "alignment is contained in path " << path_record.first << ", no realignment needed" << endl;
+#endif
+                Alignment& surjected = path_surjections[path_record.first];
+                surjected = source;
+                *surjected.mutable_path() = path_record.second.front().second;
+            }
+        }
+        
         for (pair<const size_t, vector<path_chunk_t>>& path_record : path_overlapping_anchors) {
+            if (!path_surjections.empty()) {
+                // the read is already on one of the paths, which is as good as realignment can do
+                break;
+            }
 #ifdef debug_anchored_surject
             cerr << "found overlaps on path " << path_record.first << ", performing surjection" << endl;
 #endif
@@ -457,7 +612,7 @@ using namespace std;
             
             // find the interval of the ref path we need to consider
             pair<size_t, size_t> ref_path_interval = compute_path_interval(source, path_record.first, xpath, path_record.second,
-                                                                           &oriented_occurrences_memo);
+                                                                           xg_query_context);
             
 #ifdef debug_anchored_surject
             cerr << "final path interval is " << ref_path_interval.first << ":" << ref_path_interval.second << endl;
@@ -553,7 +708,7 @@ using namespace std;
         
         // find the position along the path
         const xg::XGPath& best_xpath = xindex->get_path(path_name_out);
-        set_path_position(best_surjection, best_path_rank, best_xpath, path_name_out, path_pos_out, path_rev_out, &oriented_occurrences_memo);
+        set_path_position(best_surjection, best_path_rank, best_xpath, path_name_out, path_pos_out, path_rev_out, xg_query_context);
         
 #ifdef debug_anchored_surject
         cerr << "chose path " << path_name_out << " at position " << path_pos_out << (path_rev_out ? "-" : "+") << endl;
@@ -563,8 +718,7 @@ using namespace std;
     
     unordered_map<size_t, vector<Surjector::path_chunk_t>>
     Surjector::extract_overlapping_paths(const Alignment& source, const unordered_map<size_t, string>& path_rank_to_name,
-                                         unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                         unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) {
+                                         xg::XGQueryContext& xg_context) {
         
         
         unordered_map<size_t, vector<path_chunk_t>> to_return;
@@ -575,16 +729,19 @@ using namespace std;
         unordered_map<size_t, unordered_set<pair<size_t, bool>>> offset_and_orientations_on_paths;
         int64_t through_to_length = 0;
         
+        // reused for the paths of each node
+        vector<size_t> node_paths;
+        
         for (size_t i = 0; i < path.mapping_size(); i++) {
             
             int64_t before_to_length = through_to_length;
             through_to_length += mapping_to_length(path.mapping(i));
             
             const Position& pos = path.mapping(i).position();
-            vector<size_t> paths_of_node = xindex->memoized_paths_of_node(pos.node_id(), paths_of_node_memo);
+            paths_of_node(pos.node_id(), xg_context, node_paths);
             
             unordered_set<size_t> paths_here;
-            for (size_t path_rank : paths_of_node) {
+            for (size_t path_rank : node_paths) {
                 if (path_rank_to_name.count(path_rank)) {
                     paths_here.insert(path_rank);
                 }
@@ -601,8 +758,7 @@ using namespace std;
                 for (size_t path_rank : paths_here) {
                     
                     // we'll need to know where this node occurs on the path
-                    auto occurrences = xindex->memoized_oriented_occurrences_on_path(pos.node_id(), path_rank,
-                                                                                     oriented_occurrences_memo);
+                    auto occurrences = xg_context.oriented_occurrences_on_path(pos.node_id(), path_rank);
                     
                     // the chunks of the alignments along this path
                     vector<path_chunk_t>& path_chunks = to_return[path_rank];
@@ -676,9 +832,19 @@ using namespace std;
         return to_return;
     }
     
+    void Surjector::paths_of_node(id_t node_id, xg::XGQueryContext& xg_context, vector<size_t>& paths_out) {
+        if (path_membership != nullptr) {
+            path_membership->paths_of_node(node_id, paths_out);
+        }
+        else {
+            auto paths = xg_context.paths_of_node(node_id);
+            paths_out.assign(paths.begin(), paths.end());
+        }
+    }
+    
     pair<size_t, size_t>
     Surjector::compute_path_interval(const Alignment& source, size_t path_rank, const xg::XGPath& xpath, const vector<path_chunk_t>& path_chunks,
-                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) {
+                                     xg::XGQueryContext& xg_context) {
         
         pair<size_t, size_t> interval(numeric_limits<size_t>::max(), numeric_limits<size_t>::min());
         
@@ -698,20 +864,19 @@ using namespace std;
                 // the distance the read could align to the right of this mapping (oriented by the read)
                 int64_t right_overhang = get_aligner()->longest_detectable_gap(source, read_pos) + (source.sequence().end() - read_pos);
                 
-                auto oriented_occurrences = xindex->memoized_oriented_occurrences_on_path(pos.node_id(), path_rank,
-                                                                                          oriented_occurrences_memo);
+                auto oriented_occurrences = xg_context.oriented_occurrences_on_path(pos.node_id(), path_rank);
                 
                 // the length forward along the path that the end of the mapping is
                 int64_t mapping_length = mapping_from_length(path_chunk.second.mapping(i));
                 
                 for (const pair<size_t, bool>& occurrence : oriented_occurrences) {
                     if (occurrence.second == pos.is_reverse()) {
-                        int64_t path_offset = xpath.positions[occurrence.first];
+                        int64_t path_offset = xpath.position(occurrence.first);
                         
                         int64_t left_boundary = max<int64_t>(0, path_offset + pos.offset() - left_overhang);
                         interval.first = min<size_t>(interval.first, left_boundary);
                         
-                        int64_t right_boundary = min<int64_t>(path_offset + pos.offset() + mapping_length + right_overhang, xpath.offsets.size() - 1);
+                        int64_t right_boundary = min<int64_t>(path_offset + pos.offset() + mapping_length + right_overhang, xpath.length() - 1);
                         interval.second = max<size_t>(interval.second, right_boundary);
                         
 #ifdef debug_anchored_surject
@@ -719,12 +884,12 @@ using namespace std;
 #endif
                     }
                     else {
-                        int64_t path_offset = occurrence.first + 1 < xpath.positions.size() ? xpath.positions[occurrence.first + 1] : xpath.offsets.size();
+                        int64_t path_offset = occurrence.first + 1 < xpath.size() ? xpath.position(occurrence.first + 1) : xpath.length();
                         
                         int64_t left_boundary = max<int64_t>(0, path_offset - pos.offset() - mapping_length - right_overhang);
                         interval.first = min<size_t>(interval.first, left_boundary);
                         
-                        int64_t right_boundary = min<int64_t>(path_offset - pos.offset() + left_overhang, xpath.offsets.size() - 1);
+                        int64_t right_boundary = min<int64_t>(path_offset - pos.offset() + left_overhang, xpath.length() - 1);
                         interval.second = max<size_t>(interval.second, right_boundary);
                         
 #ifdef debug_anchored_surject
@@ -742,20 +907,20 @@ using namespace std;
                                                 unordered_map<id_t, pair<id_t, bool>>& node_trans) {
         
 #ifdef debug_anchored_surject
-        cerr << "extracting path graph for position interval " << first << ":" << last << " in path of length " << xpath.positions[xpath.positions.size() - 1] + xindex->node_length(xpath.node(xpath.ids.size() - 1)) << endl;
+        cerr << "extracting path graph for position interval " << first << ":" << last << " in path of length " << xpath.position(xpath.size() - 1) + xindex->node_length(xpath.node(xpath.size() - 1)) << endl;
 #endif
         
         VG path_graph;
         
         size_t begin = xpath.offset_at_position(first);
-        size_t end = min<size_t>(xpath.positions.size(), xpath.offset_at_position(last) + 1);
+        size_t end = min<size_t>(xpath.size(), xpath.offset_at_position(last) + 1);
         
         Node* prev_node = nullptr;
         for (size_t i = begin; i < end; i++) {
             
             id_t node_id = xpath.node(i);
             string seq = xindex->node_sequence(node_id);
-            bool rev = xpath.directions[i];
+            bool rev = xpath.is_reverse(i);
             
             Node* node;
             if (rev) {
@@ -778,7 +943,7 @@ using namespace std;
     
     void Surjector::set_path_position(const Alignment& surjected, size_t best_path_rank, const xg::XGPath& xpath,
                                       string& path_name_out, int64_t& path_pos_out, bool& path_rev_out,
-                                      unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) {
+                                      xg::XGQueryContext& xg_context) {
         
         const Path& path = surjected.path();
         
@@ -792,14 +957,13 @@ using namespace std;
         
         const Position& start_pos = path.mapping(0).position();
         
-        vector<pair<size_t, bool>> oriented_occurrences = xindex->memoized_oriented_occurrences_on_path(start_pos.node_id(), best_path_rank,
-                                                                                                        oriented_occurrences_memo);
+        xg::XGQueryContext::occurrences_t oriented_occurrences = xg_context.oriented_occurrences_on_path(start_pos.node_id(), best_path_rank);
 
-        for (pair<size_t, bool>& occurrence : oriented_occurrences) {
+        for (const pair<size_t, bool>& occurrence : oriented_occurrences) {
             if (occurrence.second == start_pos.is_reverse()) {
                 // the first node in this alignment occurs on the forward strand of the path
                 
-                if (occurrence.first + path.mapping_size() > xpath.ids.size()) {
+                if (occurrence.first + path.mapping_size() > xpath.size()) {
                     // but it doesn't fit on the path
                     continue;
                 }
@@ -816,7 +980,7 @@ using namespace std;
                 
                 // we found where the alignment could be from
                 if (match) {
-                    path_pos_out = xpath.positions[occurrence.first] + start_pos.offset();
+                    path_pos_out = xpath.position(occurrence.first) + start_pos.offset();
                     path_rev_out = false;
                     return;
                 }
@@ -843,7 +1007,7 @@ using namespace std;
                 if (match) {
                     const Mapping& last_mapping = path.mapping(path.mapping_size() - 1);
                     size_t last_offset = occurrence.first + 1 - path.mapping_size();
-                    int64_t node_start = last_offset + 1 < xpath.positions.size() ? xpath.positions[last_offset + 1] : xpath.offsets.size();
+                    int64_t node_start = last_offset + 1 < xpath.size() ? xpath.position(last_offset + 1) : xpath.length();
                     path_pos_out = node_start - last_mapping.position().offset() - mapping_from_length(last_mapping);
                     path_rev_out = true;
                     return;
@@ -20,6 +20,48 @@ namespace vg {
 
 using namespace std;
 
+    /**
+     * An index from the nodes of a graph to which of a chosen subset of its paths
+     * they are on. Nodes on the same combination of paths share one bitset, so
+     * each node costs a single integer no matter how many paths were chosen.
+     * Built once and shared read-only between threads.
+     */
+    class PathMembershipIndex {
+    public:
+        
+        /// index membership in the given paths, which must all be in the XG
+        PathMembershipIndex(const xg::XG& xg_index, const set<string>& path_names);
+        
+        /// the number of paths indexed
+        size_t path_count() const;
+        
+        /// replace the contents of paths_out with the XG ranks of the indexed paths of a node
+        void paths_of_node(id_t node_id, vector<size_t>& paths_out) const;
+        
+        /// the XG ranks of the indexed paths that an alignment path follows for the most bases, best
+        /// first, keeping at most max_candidates of them (all of them if it is 0)
+        vector<size_t> candidate_paths(const Path& path, size_t max_candidates) const;
+        
+    private:
+        
+        /// the set of paths a node is on, as an index into the path sets
+        uint32_t path_set_of(id_t node_id) const;
+        
+        const xg::XG& xg_index;
+        
+        /// XG path rank of each bit in a path set
+        vector<size_t> path_ranks;
+        
+        /// 64-bit words in a path set
+        size_t words_per_set;
+        
+        /// the distinct path sets, words_per_set words each, starting with the empty set
+        vector<uint64_t> set_words;
+        
+        /// the path set of each node, by node rank
+        vector<uint32_t> node_path_set;
+    };
+
     class Surjector : Mapper {
     public:
         
@@ -44,6 +86,14 @@ using namespace std;
                                         bool& path_rev_out);
         
         
+        /// if set, paths are looked up in this index, which must cover the same paths
+        /// given to path_anchored_surject
+        const PathMembershipIndex* path_membership = nullptr;
+        
+        /// with a path membership index, only realign to this many of the paths a read
+        /// follows the longest (0 for all of them)
+        size_t max_candidate_paths = 4;
+        
         /// a local type that represents a read interval matched to a portion of the alignment path
         using path_chunk_t = pair<pair<string::const_iterator, string::const_iterator>, Path>;
         
@@ -52,13 +102,16 @@ using namespace std;
         /// get the chunks of the alignment path that follow the given reference paths
         unordered_map<size_t, vector<path_chunk_t>>
         extract_overlapping_paths(const Alignment& source, const unordered_map<size_t, string>& path_rank_to_name,
-                                  unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                  unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr);
+                                  xg::XGQueryContext& xg_context);
+        
+        /// replace the contents of paths_out with the paths of a node, from the path membership
+        /// index if there is one
+        void paths_of_node(id_t node_id, xg::XGQueryContext& xg_context, vector<size_t>& paths_out);
         
         /// compute the widest interval of path positions that the realigned sequence could align to
         pair<size_t, size_t>
         compute_path_interval(const Alignment& source, size_t path_rank, const xg::XGPath& xpath, const vector<path_chunk_t>& path_chunks,
-                              unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr);
+                              xg::XGQueryContext& xg_context);
         
         /// make a linear graph that corresponds to a path interval, possibly duplicating nodes in case of cycles
         VG extract_linearized_path_graph(size_t first, size_t last, const xg::XGPath& xpath,
@@ -68,10 +121,13 @@ using namespace std;
         /// associate a path position and strand to a surjected alignment against this path
         void set_path_position(const Alignment& surjected, size_t best_path_rank, const xg::XGPath& xpath,
                                string& path_name_out, int64_t& path_pos_out, bool& path_rev_out,
-                               unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr);
+                               xg::XGQueryContext& xg_context);
         
         // make a sentinel meant to indicate an unmapped read
         Alignment make_null_alignment(const Alignment& source);
+        
+        /// a cache of XG queries, cleared for each read and reused so that its memory is only allocated once per thread
+        static thread_local xg::XGQueryContext xg_query_context;
     };
 }
 
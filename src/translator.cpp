@@ -25,42 +25,91 @@ void Translator::load(const vector<Translation>& trans) {
 }
 
 void Translator::build_position_table(void) {
-    //map<pos_t, Translation*> pos_to_trans;
-    for (auto& t : translations) {
-        // map from the new positions to the corresponding translations
-        pos_to_trans[make_pos_t(t.to().mapping(0).position())] = &t;
+    // map from the new positions to the corresponding translations
+    pos_to_trans.clear();
+    pos_to_trans.reserve(translations.size());
+    for (size_t i = 0; i < translations.size(); ++i) {
+        pos_to_trans.emplace_back(make_pos_t(translations[i].to().mapping(0).position()), i);
     }
+    // when several translations start at the same position, keep the last
+    stable_sort(pos_to_trans.begin(), pos_to_trans.end(),
+                [](const pair<pos_t, size_t>& a, const pair<pos_t, size_t>& b) {
+                    return a.first < b.first;
+                });
+    auto last = unique(pos_to_trans.rbegin(), pos_to_trans.rend(),
+                       [](const pair<pos_t, size_t>& a, const pair<pos_t, size_t>& b) {
+                           return a.first == b.first;
+                       });
+    pos_to_trans.erase(pos_to_trans.begin(), last.base());
+
+    // if the node IDs are dense enough, index the start of each node's entries
+    node_starts.clear();
+    min_node_id = 0;
+    if (!pos_to_trans.empty()) {
+        min_node_id = id(pos_to_trans.front().first);
+        size_t slots = (id(pos_to_trans.back().first) - min_node_id + 1) * 2;
+        if (slots <= 4 * pos_to_trans.size()) {
+            node_starts.resize(slots + 1);
+            size_t entry = 0;
+            for (size_t slot = 0; slot <= slots; ++slot) {
+                while (entry < pos_to_trans.size()
+                       && (id(pos_to_trans[entry].first) - min_node_id) * 2 + is_rev(pos_to_trans[entry].first) < slot) {
+                    ++entry;
+                }
+                node_starts[slot] = entry;
+            }
+        }
+    }
+}
+
+pair<size_t, size_t> Translator::node_entries(id_t node_id, bool is_reverse) const {
+    if (!node_starts.empty()) {
+        if (node_id < min_node_id) {
+            return make_pair(0, 0);
+        }
+        size_t slot = (node_id - min_node_id) * 2 + is_reverse;
+        if (slot + 1 >= node_starts.size()) {
+            return make_pair(0, 0);
+        }
+        return make_pair(node_starts[slot], node_starts[slot + 1]);
+    }
+    auto range = equal_range(pos_to_trans.begin(), pos_to_trans.end(), make_pair(make_pos_t(node_id, is_reverse, 0), (size_t) 0),
+                             [](const pair<pos_t, size_t>& a, const pair<pos_t, size_t>& b) {
+                                 return make_pair(id(a.first), is_rev(a.first)) < make_pair(id(b.first), is_rev(b.first));
+                             });
+    return make_pair(range.first - pos_to_trans.begin(), range.second - pos_to_trans.begin());
 }
 
-bool Translator::has_translation(const Position& position, bool ignore_strand) {
-    auto pos = make_pos_t(position);
-    pos_t node_only = pos;
-    get_offset(node_only) = 0;
-    get_is_rev(node_only) = ignore_strand ? false : position.is_reverse();
-    return pos_to_trans.find(node_only) != pos_to_trans.end();
+bool Translator::has_translation(const Position& position, bool ignore_strand) const {
+    // the node has to be translated from its start
+    auto entries = node_entries(position.node_id(), ignore_strand ? false : position.is_reverse());
+    return entries.first < entries.second && offset(pos_to_trans[entries.first].first) == 0;
 }
 
-Translation Translator::get_translation(const Position& position) {
-    auto pos = make_pos_t(position);
+Translation Translator::get_translation(const Position& position) const {
     // check that the node is in the translation
-    pos_t node_only = pos;
-    get_offset(node_only) = 0;
-    get_is_rev(node_only) = position.is_reverse();
+    auto entries = node_entries(position.node_id(), position.is_reverse());
     Translation translation;
-    if (pos_to_trans.find(node_only) == pos_to_trans.end()) {
-        cerr << "WARNING: node " << id(pos) << " is not in the translation table" << endl;
+    if (entries.first == entries.second || offset(pos_to_trans[entries.first].first) != 0) {
+        cerr << "WARNING: node " << position.node_id() << " is not in the translation table" << endl;
     } else {
-        auto t = pos_to_trans.upper_bound(pos); --t;
-        translation = *t->second;
+        // find the last translation on the node starting at or before the position
+        auto t = upper_bound(pos_to_trans.begin() + entries.first + 1, pos_to_trans.begin() + entries.second,
+                             position.offset(),
+                             [](int64_t off, const pair<pos_t, size_t>& entry) {
+                                 return off < offset(entry.first);
+                             });
+        --t;
+        translation = translations[t->second];
     }
     return translation;
 }
 
-Position Translator::translate(const Position& position) {
+Position Translator::translate(const Position& position) const {
     return translate(position, get_translation(position));
 }
 
-Position Translator::translate(const Position& position, const Translation& translation) {
+Position Translator::translate(const Position& position, const Translation& translation) const {
     // what kind of translation is it?
     if (is_match(translation)) {
         if (position.offset() >= mapping_from_length(translation.to().mapping(0))) {
@@ -79,7 +128,7 @@ Position Translator::translate(const Position& position, const Translation& tran
     }
 }
 
-Mapping Translator::translate(const Mapping& mapping) {
+Mapping Translator::translate(const Mapping& mapping) const {
     Mapping translated = mapping;
     if (!mapping.has_position()) return mapping;
     Translation translation = get_translation(mapping.position());
@@ -122,7 +171,7 @@ Mapping Translator::translate(const Mapping& mapping) {
     return translated;
 }
 
-Path Translator::translate(const Path& path) {
+Path Translator::translate(const Path& path) const {
     Path result;
     for (int i = 0; i < path.mapping_size(); ++i) {
         *result.add_mapping() = translate(path.mapping(i));
@@ -130,13 +179,20 @@ Path Translator::translate(const Path& path) {
     return simplify(result, false);
 }
 
-Alignment Translator::translate(const Alignment& aln) {
+Alignment Translator::translate(const Alignment& aln) const {
     Alignment result = aln;
     *result.mutable_path() = translate(aln.path());
     return result;
 }
 
-Locus Translator::translate(const Locus& locus) {
+void Translator::translate(vector<Alignment>& alns) const {
+#pragma omp parallel for schedule(dynamic, 16)
+    for (size_t i = 0; i < alns.size(); ++i) {
+        *alns[i].mutable_path() = translate(alns[i].path());
+    }
+}
+
+Locus Translator::translate(const Locus& locus) const {
     Locus result = locus;
     for (int i = 0; i < locus.allele_size(); ++i) {
         *result.mutable_allele(i) = translate(locus.allele(i));
@@ -153,7 +209,7 @@ bool is_match(const Translation& translation) {
         && path_to_length(translation.from()) == path_to_length(translation.to());
 }
 
-Translation Translator::overlay(const Translation& trans) {
+Translation Translator::overlay(const Translation& trans) const {
     Translation result;
     *result.mutable_to() = trans.to();
     *result.mutable_from() = translate(trans.from());
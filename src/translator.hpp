@@ -29,22 +29,36 @@ class Translator {
 public:
 
     vector<Translation> translations;
-    map<pos_t, Translation*> pos_to_trans;
+    /// The to-graph start position of each translation and the translation's
+    /// index in translations, sorted by position, for binary search
+    vector<pair<pos_t, size_t>> pos_to_trans;
     Translator(void);
     Translator(istream& in);
     Translator(const vector<Translation>& trans);
     void load(const vector<Translation>& trans);
     void build_position_table(void);
-    Translation get_translation(const Position& position);
-    bool has_translation(const Position& position, bool ignore_strand = true);
-    Position translate(const Position& position);
-    Position translate(const Position& position, const Translation& translation);
-    Edge translate(const Edge& edge);
-    Mapping translate(const Mapping& mapping);
-    Path translate(const Path& path);
-    Alignment translate(const Alignment& aln);
-    Locus translate(const Locus& locus);
-    Translation overlay(const Translation& trans);
+    Translation get_translation(const Position& position) const;
+    bool has_translation(const Position& position, bool ignore_strand = true) const;
+    Position translate(const Position& position) const;
+    Position translate(const Position& position, const Translation& translation) const;
+    Edge translate(const Edge& edge) const;
+    Mapping translate(const Mapping& mapping) const;
+    Path translate(const Path& path) const;
+    Alignment translate(const Alignment& aln) const;
+    /// Translate a batch of alignments in place, in parallel
+    void translate(vector<Alignment>& alns) const;
+    Locus translate(const Locus& locus) const;
+    Translation overlay(const Translation& trans) const;
+
+private:
+    /// Get the range of pos_to_trans entries on the given strand of the given
+    /// node
+    pair<size_t, size_t> node_entries(id_t node_id, bool is_reverse) const;
+    /// When the translated node IDs are dense, the first pos_to_trans entry
+    /// for each (node ID - min_node_id) * 2 + is_rev, followed by the end, so
+    /// that node_entries doesn't have to search. Empty otherwise.
+    vector<size_t> node_starts;
+    id_t min_node_id = 0;
 };
 
 bool is_match(const Translation& translation);
@@ -1102,6 +1102,9 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
     // XREF states will have to be calculated later, over the whole traversal.
     set<vector<Visit>> site_traversal_set;
     
+    // All the searches for this site share a budget and their results
+    SiteSearch search;
+    
     // We have this function to extend a partial traversal into a full
     // traversal and add it as a path. The path must already be rooted on
     // the reference in the correct order and orientation.
@@ -1288,6 +1291,11 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
     for (Node* node : contents.first) {
         // Find the bubble for each node
         
+        if (search.over_budget) {
+            // We can't look for any more traversals
+            break;
+        }
+        
         if (snarl_manager.into_which_snarl(node->id(), true) || snarl_manager.into_which_snarl(node->id(), false)) {
             // Don't start from nodes that are child boundaries
             continue;
@@ -1308,7 +1316,7 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
 #endif
         
         // Find bubbles that backend into the backbone path
-        pair<Support, vector<Visit>> sup_path = find_bubble(node, nullptr, nullptr, index, site);
+        pair<Support, vector<Visit>> sup_path = find_bubble(node, nullptr, nullptr, index, site, &search);
 
         vector<Visit>& path = sup_path.second;
         
@@ -1337,6 +1345,11 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
     for(Edge* edge : contents.second) {
         // Go through all the edges
         
+        if (search.over_budget) {
+            // We can't look for any more traversals
+            break;
+        }
+        
         if(augmented.has_supports() && total(augmented.get_support(edge)) == 0) {
             // Don't bother with unsupported edges
 #ifdef debug
@@ -1360,7 +1373,7 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
 #endif
         
         // Find a path based around this edge
-        pair<Support, vector<Visit>> sup_path = find_bubble(nullptr, edge, nullptr, index, site);
+        pair<Support, vector<Visit>> sup_path = find_bubble(nullptr, edge, nullptr, index, site, &search);
         vector<Visit>& path = sup_path.second;
         
 #ifdef debug
@@ -1393,12 +1406,17 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
     for (const Snarl* child : children) {
         // Go through all the child snarls
         
+        if (search.over_budget) {
+            // We can't look for any more traversals
+            break;
+        }
+        
 #ifdef debug
         cerr << "Base path on " << *child << endl;
 #endif
         
         // Find a path based around this child snarl
-        pair<Support, vector<Visit>> sup_path = find_bubble(nullptr, nullptr, child, index, site);
+        pair<Support, vector<Visit>> sup_path = find_bubble(nullptr, nullptr, child, index, site, &search);
         vector<Visit>& path = sup_path.second;
         
         if(path.empty()) {
@@ -1415,6 +1433,16 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
         extend_into_allele(path);
     }
     
+    if (search.over_budget) {
+        // Make a note that we didn't look everywhere
+        sites_over_budget++;
+        if (verbose) {
+            cerr << "Warning: Search budget of " << max_site_search_ticks << " steps exceeded for site "
+                << to_node_traversal(site.start(), augmented.graph) << " - "
+                << to_node_traversal(site.end(), augmented.graph) << "; using "
+                << site_traversal_set.size() << " traversals found so far" << endl;
+        }
+    }
     
     // Now convert to SnarlTraversals
     vector<SnarlTraversal> unique_traversals;
@@ -1479,8 +1507,13 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
     return unique_traversals;
 }
 
+size_t RepresentativeTraversalFinder::get_sites_over_budget() const {
+    return sites_over_budget;
+}
+
 pair<Support, vector<Visit>> RepresentativeTraversalFinder::find_bubble(Node* node, Edge* edge,
-                                                                        const Snarl* snarl, PathIndex& index, const Snarl& site) {
+                                                                        const Snarl* snarl, PathIndex& index, const Snarl& site,
+                                                                        SiteSearch* search) {
 
     // What are we going to find our left and right path halves based on?
     Visit left_visit;
@@ -1557,8 +1590,8 @@ pair<Support, vector<Visit>> RepresentativeTraversalFinder::find_bubble(Node* no
     // Find paths on both sides, with nodes or snarls on the primary path at the
     // outsides and this visit in the middle. Returns path lengths and paths in
     // pairs in a set.
-    auto leftPaths = bfs_left(left_visit, index, false, managed_site);
-    auto rightPaths = bfs_right(right_visit, index, false, managed_site);
+    auto leftPaths = bfs_left(left_visit, index, false, managed_site, search);
+    auto rightPaths = bfs_right(right_visit, index, false, managed_site, search);
     
     // Find a combination of two paths which gets us to the reference in a
     // consistent orientation (meaning that when you look at the ending nodes'
@@ -1824,7 +1857,16 @@ Support RepresentativeTraversalFinder::min_support_in_path(const list<Visit>& pa
 }
 
 set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit visit,
-                                                                       PathIndex& index, bool stopIfVisited, const Snarl* in_snarl) {
+                                                                       PathIndex& index, bool stopIfVisited, const Snarl* in_snarl,
+                                                                       SiteSearch* search) {
+
+    if (search != nullptr && !stopIfVisited) {
+        auto found = search->left_results.find(visit);
+        if (found != search->left_results.end()) {
+            // We already searched out from here for this site
+            return found->second;
+        }
+    }
 
     // Holds partial paths we want to return, with their lengths in bp.
     set<pair<size_t, list<Visit>>> toReturn;
@@ -1859,6 +1901,12 @@ set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit vis
         
         searchTicks++;
         
+        if (search != nullptr && max_site_search_ticks != 0 && ++search->ticks > max_site_search_ticks) {
+            // The site has used up its search budget. Give back what we have.
+            search->over_budget = true;
+            return toReturn;
+        }
+        
 
 #ifdef debug
         // Report on how much searching we are doing.
@@ -2027,14 +2075,19 @@ set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit vis
         
     }
     
+    if (search != nullptr && !stopIfVisited) {
+        // Remember the complete result
+        search->left_results[visit] = toReturn;
+    }
+    
     return toReturn;
 }
 
 set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_right(Visit visit, PathIndex& index, bool stopIfVisited,
-                                                                        const Snarl* in_snarl) {
+                                                                        const Snarl* in_snarl, SiteSearch* search) {
 
     // Look left from the backward version of the visit.
-    auto toConvert = bfs_left(reverse(visit), index, stopIfVisited, in_snarl);
+    auto toConvert = bfs_left(reverse(visit), index, stopIfVisited, in_snarl, search);
     
     // Since we can't modify set records in place, we need to do a copy
     set<pair<size_t, list<Visit>>> toReturn;
@@ -15,6 +15,7 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <list>
+#include <atomic>
 #include "vg.pb.h"
 #include "vg.hpp"
 #include "translator.hpp"
@@ -221,6 +222,25 @@ protected:
     /// How many search intermediates can we allow?
     size_t max_bubble_paths;
     
+    /// How many sites have we given up searching for more traversals of,
+    /// because they used up their search budget?
+    atomic<size_t> sites_over_budget{0};
+    
+    /**
+     * The search state for finding traversals of one site. Counts search work
+     * against the site's budget, and remembers the search results from each
+     * starting visit, so child snarls and the edges around them are only
+     * searched out from once.
+     */
+    struct SiteSearch {
+        /// How many search steps have we taken for the site?
+        size_t ticks = 0;
+        /// Have we run out of budget?
+        bool over_budget = false;
+        /// Results of bfs_left, by starting visit
+        map<Visit, set<pair<size_t, list<Visit>>>> left_results;
+    };
+    
     /**
      * Find a Path that runs from the start of the given snarl to the end, which
      * we can use to backend our traversals into when a snarl is off the primary
@@ -244,9 +264,12 @@ protected:
      * return the minimum support found on any edge or node in the bubble
      * (including the reference node endpoints and their edges which aren't
      * stored in the path).
+     *
+     * If a SiteSearch is given, searches count against its budget and reuse
+     * its results.
      */
     pair<Support, vector<Visit>> find_bubble(Node* node, Edge* edge, const Snarl* snarl, PathIndex& index,
-                                             const Snarl& site);
+                                             const Snarl& site, SiteSearch* search = nullptr);
         
     /**
      * Get the minimum support of all nodes and edges in path
@@ -258,9 +281,12 @@ protected:
      * lengths and paths starting at the given node and ending on the given
      * indexed path. Refuses to visit nodes with no support, if support data is
      * available in the augmented graph.
+     *
+     * If a SiteSearch is given, stops early when the site's budget runs out,
+     * and remembers and reuses complete results by starting visit.
      */
     set<pair<size_t, list<Visit>>> bfs_left(Visit visit, PathIndex& index, bool stopIfVisited = false,
-                                            const Snarl* in_snarl = nullptr);
+                                            const Snarl* in_snarl = nullptr, SiteSearch* search = nullptr);
         
     /**
      * Do a breadth-first search right from the given node traversal, and return
@@ -269,7 +295,7 @@ protected:
      * available in the augmented graph.
      */
     set<pair<size_t, list<Visit>>> bfs_right(Visit visit, PathIndex& index, bool stopIfVisited = false,
-                                             const Snarl* in_snarl = nullptr);
+                                             const Snarl* in_snarl = nullptr, SiteSearch* search = nullptr);
         
     /**
      * Get the length of a path through nodes, in base pairs.
@@ -297,14 +323,24 @@ public:
     /// Should we emit verbose debugging info?
     bool verbose = false;
     
+    /// How many search steps, over all the searches for one site, should we
+    /// take before we stop looking for more traversals of it? 0 means no limit.
+    size_t max_site_search_ticks = 0;
+    
     virtual ~RepresentativeTraversalFinder() = default;
     
     /**
      * Find traversals to cover the nodes and edges of the snarl. Always emits
-     * the primary path traversal first, if applicable.
+     * the primary path traversal first, if applicable. If the site's search
+     * budget runs out, returns the traversals found up to that point. Can be
+     * called from multiple threads at once.
      */
     virtual vector<SnarlTraversal> find_traversals(const Snarl& site);
     
+    /// Get the number of sites for which find_traversals ran out of search
+    /// budget.
+    size_t get_sites_over_budget() const;
+    
 };
 
 }
@@ -315,6 +315,61 @@ TEST_CASE("Full-length bonus is applied to both ends by rescoring", "[aligner][a
     // And with a full length bonus at each end it's 139.
     REQUIRE(aligner1.score_ungapped_alignment(aln) == 139);
 }
+
+TEST_CASE("Quality adjusted exact match scores agree with the score matrix", "[aligner][alignment][scoring]") {
+    
+    QualAdjAligner aligner;
+    
+    // odd length and an N, with a mix of binned qualities
+    string sequence = "ACGTTGCANCGGATCCATGTA";
+    string quality;
+    vector<char> bins {2, 12, 23, 37};
+    for (size_t i = 0; i < sequence.size(); i++) {
+        quality.push_back(bins[(i * 7) % bins.size()]);
+    }
+    
+    int32_t expected = 0;
+    for (size_t i = 0; i < sequence.size(); i++) {
+        expected += aligner.score_matrix[25 * quality[i] + 6 * aligner.nt_table[sequence[i]]];
+    }
+    
+    REQUIRE(aligner.score_exact_match(sequence, quality) == expected);
+    REQUIRE(aligner.score_exact_match(sequence.begin(), sequence.end(), quality.begin()) == expected);
+    REQUIRE(aligner.score_exact_match(sequence.begin(), sequence.begin(), quality.begin()) == 0);
+    
+    Alignment aln;
+    aln.set_sequence(sequence);
+    aln.set_quality(quality);
+    REQUIRE(aligner.score_exact_match(aln, 0, sequence.size()) == expected);
+    
+    SECTION("partial alignments score matches and mismatches by quality") {
+        VG graph;
+        // the reference has a C where the read has a G at offset 10
+        string reference = sequence;
+        reference[10] = 'C';
+        Node* node = graph.create_node(reference);
+        
+        Path path;
+        Mapping* mapping = path.add_mapping();
+        mapping->mutable_position()->set_node_id(node->id());
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(10);
+        edit->set_to_length(10);
+        edit = mapping->add_edit();
+        edit->set_from_length(1);
+        edit->set_to_length(1);
+        edit->set_sequence("G");
+        edit = mapping->add_edit();
+        edit->set_from_length(sequence.size() - 11);
+        edit->set_to_length(sequence.size() - 11);
+        
+        int32_t mismatched = expected - aligner.score_matrix[25 * quality[10] + 6 * aligner.nt_table['G']]
+            + aligner.score_matrix[25 * quality[10] + 5 * aligner.nt_table['C'] + aligner.nt_table['G']];
+        
+        REQUIRE(aligner.score_partial_alignment(aln, graph, path, aln.sequence().begin())
+                == mismatched + 2 * aligner.full_length_bonus);
+    }
+}
    
 }
 }
@@ -4,6 +4,8 @@
 ///
 
 #include <iostream>
+#include <fstream>
+#include <atomic>
 #include <string>
 #include "../json2pb.h"
 #include "../vg.pb.h"
@@ -110,5 +112,114 @@ TEST_CASE("Alignment trimming works even on unaligned reads", "[alignment]") {
     
 }
 
+TEST_CASE("In-place alignment trimming and simplification match the copying versions", "[alignment]") {
+
+    string alignment_string = R"(
+        {
+            "name": "read",
+            "sequence": "CGATTACAGG",
+            "quality": "ABCDEFGHIJ",
+            "score": 7,
+            "path": {"name": "ignored", "mapping": [
+                {
+                    "position": {"node_id": 1, "offset": 1},
+                    "edit": [
+                        {"from_length": 1},
+                        {"from_length": 2, "to_length": 2},
+                        {"from_length": 1, "to_length": 1}
+                    ]
+                },
+                {
+                    "position": {"node_id": 2},
+                    "edit": [
+                        {"to_length": 1, "sequence": "T"},
+                        {"from_length": 2, "to_length": 2, "sequence": "AC"},
+                        {"from_length": 1, "to_length": 1}
+                    ]
+                },
+                {
+                    "position": {"node_id": 3},
+                    "edit": [
+                        {"from_length": 3, "to_length": 3},
+                        {"from_length": 2}
+                    ]
+                }
+            ]}
+        }
+    )";
+
+    Alignment a;
+    json2pb(a, alignment_string.c_str(), alignment_string.size());
+
+    SECTION("Stripping bases from either end") {
+        for (size_t drop = 0; drop < a.sequence().size(); drop++) {
+            Alignment from_start = a;
+            strip_from_start_in_place(&from_start, drop);
+            REQUIRE(pb2json(from_start) == pb2json(strip_from_start(a, drop)));
+
+            Alignment from_end = a;
+            strip_from_end_in_place(&from_end, drop);
+            REQUIRE(pb2json(from_end) == pb2json(strip_from_end(a, drop)));
+        }
+    }
+
+    SECTION("Simplifying with and without trimming deletions") {
+        for (bool trim : {true, false}) {
+            Alignment simple = a;
+            simplify_in_place(&simple, trim);
+            REQUIRE(pb2json(simple) == pb2json(simplify(a, trim)));
+        }
+    }
+}
+
+TEST_CASE("FASTQ records can be read in chunks and parsed in parallel", "[alignment][fastq]") {
+
+    string filename = temp_file::create();
+    {
+        ofstream out(filename);
+        for (size_t i = 0; i < 2000; i++) {
+            out << "@read" << i << "/1\nGATTACA\n+\nIIIIIII\n";
+        }
+        out << "\n>last\nACGT";
+    }
+    
+    SECTION("Records are split without breaking them up") {
+        FastqRecordReader reader(filename);
+        string text;
+        REQUIRE(reader.read_records(1500, text) == 1500);
+        vector<Alignment> alignments;
+        REQUIRE(parse_fastq_records(text, alignments) == 1500);
+        REQUIRE(alignments[1499].name() == "read1499/1");
+        REQUIRE(alignments[1499].sequence() == "GATTACA");
+        REQUIRE(alignments[1499].quality() == string(7, 'I' - 33));
+        
+        text.clear();
+        REQUIRE(reader.read_records(1500, text) == 501);
+        REQUIRE(parse_fastq_records(text, alignments) == 501);
+        REQUIRE(alignments[500].name() == "last");
+        REQUIRE(alignments[500].sequence() == "ACGT");
+        REQUIRE(alignments[500].quality().empty());
+        
+        text.clear();
+        REQUIRE(reader.read_records(1500, text) == 0);
+    }
+    
+    SECTION("Every read comes through the parallel reader once") {
+        atomic<size_t> reads(0);
+        atomic<size_t> bad(0);
+        size_t count = fastq_unpaired_for_each_parallel(filename, [&](Alignment& aln) {
+            reads++;
+            if (aln.sequence().empty()) {
+                bad++;
+            }
+        });
+        REQUIRE(count == 2001);
+        REQUIRE(reads == 2001);
+        REQUIRE(bad == 0);
+    }
+    
+    temp_file::remove(filename);
+}
+
 }
 }
@@ -0,0 +1,120 @@
+/// \file alignment_predicate.cpp
+///
+/// Unit tests for compiled Alignment predicates
+///
+
+#include "catch.hpp"
+#include "../alignment_predicate.hpp"
+
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Alignment predicates give the same answers on serialized and parsed reads", "[filter][predicate]") {
+
+    vector<Alignment> reads(4);
+    reads[0].set_name("read1/1");
+    reads[0].set_sequence("GATTACA");
+    reads[0].set_quality("ABCDEFG");
+    reads[0].set_mapping_quality(60);
+    reads[0].set_score(7);
+    reads[0].set_identity(1.0);
+    for (id_t node_id : {1, 2, 3}) {
+        Mapping* mapping = reads[0].mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(node_id);
+        mapping->mutable_position()->set_offset(1);
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(2);
+        edit->set_to_length(2);
+    }
+
+    reads[1].set_name("read1/2");
+    reads[1].set_mapping_quality(0);
+    reads[1].set_score(-3);
+    reads[1].set_is_secondary(true);
+    reads[1].mutable_path()->add_mapping()->mutable_position()->set_node_id(10);
+    // A mapping with no position is on node 0
+    reads[1].mutable_path()->add_mapping()->add_edit()->set_to_length(1);
+
+    reads[2].set_name("other");
+    reads[2].set_mapping_quality(30);
+    reads[2].set_identity(0.5);
+
+    // Leave one read completely empty
+
+    auto check = [&](const AlignmentPredicate& predicate, const vector<bool>& expected) {
+        for (size_t i = 0; i < reads.size(); i++) {
+            string serialized;
+            REQUIRE(reads[i].SerializeToString(&serialized));
+            REQUIRE(predicate(reads[i]) == expected[i]);
+            REQUIRE(predicate(serialized) == expected[i]);
+        }
+    };
+
+    SECTION("An empty predicate accepts everything") {
+        AlignmentPredicate predicate;
+        REQUIRE(predicate.empty());
+        check(predicate, {true, true, true, true});
+    }
+
+    SECTION("Numeric fields can be compared") {
+        check(AlignmentPredicate::parse("mapq >= 30"), {true, false, true, false});
+        check(AlignmentPredicate::parse("mapq<30"), {false, true, false, true});
+        check(AlignmentPredicate::parse("score < 0"), {false, true, false, false});
+        check(AlignmentPredicate::parse("identity == 0.5"), {false, false, true, false});
+        check(AlignmentPredicate::parse("identity != 0"), {true, false, true, false});
+    }
+
+    SECTION("The secondary flag can be tested") {
+        check(AlignmentPredicate::parse("secondary"), {false, true, false, false});
+        check(AlignmentPredicate::parse("!secondary"), {true, false, true, true});
+    }
+
+    SECTION("Names can be compared whole or by prefix") {
+        check(AlignmentPredicate::parse("name == other"), {false, false, true, false});
+        check(AlignmentPredicate::parse("name ^= read1/"), {true, true, false, false});
+        check(AlignmentPredicate::parse("name != read1/2"), {true, false, true, true});
+    }
+
+    SECTION("Visited nodes can be tested") {
+        check(AlignmentPredicate::parse("node == 3, 10"), {true, true, false, false});
+        check(AlignmentPredicate::parse("node == 0"), {false, true, false, false});
+        check(AlignmentPredicate::parse("node != 2"), {false, true, true, true});
+    }
+
+    SECTION("All clauses have to hold") {
+        check(AlignmentPredicate::parse("name ^= read1 && !secondary"), {true, false, false, false});
+        check(AlignmentPredicate::parse("mapq >= 0 && node == 1 && score > 7"), {false, false, false, false});
+
+        AlignmentPredicate predicate;
+        predicate.require_number(AlignmentPredicate::MAPQ, AlignmentPredicate::GREATER, 10);
+        predicate.require_name(AlignmentPredicate::PREFIX, "o");
+        REQUIRE(!predicate.empty());
+        check(predicate, {false, false, true, false});
+    }
+
+    SECTION("Bad queries are rejected") {
+        REQUIRE_THROWS(AlignmentPredicate::parse(""));
+        REQUIRE_THROWS(AlignmentPredicate::parse("mapq"));
+        REQUIRE_THROWS(AlignmentPredicate::parse("mapq >= "));
+        REQUIRE_THROWS(AlignmentPredicate::parse("mapq >= 3 &&"));
+        REQUIRE_THROWS(AlignmentPredicate::parse("mapq ^= 3"));
+        REQUIRE_THROWS(AlignmentPredicate::parse("name < x"));
+        REQUIRE_THROWS(AlignmentPredicate::parse("colour == red"));
+        REQUIRE_THROWS(AlignmentPredicate::parse("score > ten"));
+        REQUIRE_THROWS(AlignmentPredicate::parse("node == 1,,2"));
+    }
+
+    SECTION("Corrupt messages are rejected") {
+        string serialized;
+        REQUIRE(reads[0].SerializeToString(&serialized));
+        serialized.resize(serialized.size() / 2);
+        REQUIRE_THROWS(AlignmentPredicate::parse("node == 1")(serialized));
+    }
+}
+
+}
+}
@@ -10,6 +10,7 @@
 #include "vg.hpp"
 #include "path.hpp"
 #include "banded_global_aligner.hpp"
+#include "simd_level.hpp"
 #include "json2pb.h"
 
 using namespace google::protobuf;
@@ -1307,6 +1308,222 @@ namespace vg {
             }
         }
         
+        TEST_CASE( "Banded global aligner produces correct alignments in bands wider than a vector",
+                  "[alignment][banded][mapping]" ) {
+            
+            // find the one deletion in an all-match alignment to a single node
+            auto check_one_deletion = [](const Alignment& aln, int64_t node_length, int64_t deletion_length) {
+                const Path& path = aln.path();
+                REQUIRE(path.mapping_size() == 1);
+                REQUIRE(mapping_from_length(path.mapping(0)) == node_length);
+                REQUIRE(mapping_to_length(path.mapping(0)) == node_length - deletion_length);
+                int deletions = 0;
+                for (size_t i = 0; i < path.mapping(0).edit_size(); i++) {
+                    const Edit& edit = path.mapping(0).edit(i);
+                    if (edit.to_length() == 0) {
+                        REQUIRE(edit.from_length() == deletion_length);
+                        deletions++;
+                    }
+                    else {
+                        REQUIRE(edit.from_length() == edit.to_length());
+                        REQUIRE(edit.sequence().empty());
+                    }
+                }
+                REQUIRE(deletions == 1);
+            };
+            
+            SECTION( "Banded global aligner finds a deletion in a wide band with 8 bit scores" ) {
+                
+                VG graph;
+                
+                Aligner aligner;
+                
+                string node_seq = "ACGTTGCAATCGGATCCATG";
+                graph.create_node(node_seq);
+                
+                Alignment aln;
+                aln.set_sequence(node_seq.substr(0, 10) + node_seq.substr(12));
+                
+                aligner.align_global_banded(aln, graph.graph, 16, false);
+                
+                check_one_deletion(aln, node_seq.size(), 2);
+                REQUIRE(aln.score() == 18 - 6 - 1);
+            }
+            
+            SECTION( "Banded global aligner finds a deletion in a wide band with 16 bit scores" ) {
+                
+                VG graph;
+                
+                Aligner aligner;
+                
+                string node_seq = "ACGTTGCAATCGGATCCATGTTAGCAGTCAAGCTTGACCTGATAGGCTACCGTAATGCGTCAGGATTCAACTGGTCAAC";
+                graph.create_node(node_seq);
+                
+                Alignment aln;
+                aln.set_sequence(node_seq.substr(0, 40) + node_seq.substr(42));
+                
+                aligner.align_global_banded(aln, graph.graph, 24, false);
+                
+                check_one_deletion(aln, node_seq.size(), 2);
+                REQUIRE(aln.score() == 77 - 6 - 1);
+            }
+        }
+        
+        TEST_CASE( "Banded global aligner gives the same alignments at every SIMD level",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            Node* n0 = graph.create_node("ACGTTGCAATCGGATCCATGTTAGCAGTCAAGCTTGACC");
+            Node* n1 = graph.create_node("T");
+            Node* n2 = graph.create_node("GA");
+            Node* n3 = graph.create_node("TGATAGGCTACCGTAATGCGTCAGGATTCAACTGGTCAAC");
+            
+            graph.create_edge(n0, n1);
+            graph.create_edge(n0, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n3);
+            
+            // long enough reads and wide enough bands to fill the AVX2 vectors with 8 and 16 bit scores
+            vector<string> reads{"ACGTTGCAATCGGATCCATGTTAGCAGTCAAGCTTGACCTTGATAGGCTACCGTAATGCGTCAGGATTCAACTGGTCAAC",
+                "ACGTTGCAATCGGATCCATGTTAGCAGTCGCTTGACCGATGATAGGCTACCGTAATGCGTCAGGATTCAACTGGTCAAC",
+                "ACGTTGCAATCGGATCCATGTTAGCAGTCAAGCTTGACCGATGATAGGCTACCGTAATGCGTCAGGATTCAACTGGTCAACGGA"};
+            
+            Aligner aligner;
+            SIMDLevel original_level = simd_level();
+            for (const string& read : reads) {
+                for (int64_t band_padding : {1, 8, 40}) {
+                    vector<Alignment> alns;
+                    for (int level = SIMD_SCALAR; level <= simd_level_supported(); level++) {
+                        set_simd_level((SIMDLevel) level);
+                        Alignment aln;
+                        aln.set_sequence(read);
+                        aligner.align_global_banded(aln, graph.graph, band_padding, true);
+                        alns.push_back(aln);
+                    }
+                    for (size_t i = 1; i < alns.size(); i++) {
+                        REQUIRE(alns[i].score() == alns[0].score());
+                        REQUIRE(pb2json(alns[i].path()) == pb2json(alns[0].path()));
+                    }
+                }
+            }
+            set_simd_level(original_level);
+        }
+        
+        TEST_CASE( "Banded global aligner can use X-drop to give up on divergent sequence", "[alignment][banded]" ) {
+            
+            VG graph;
+            
+            Aligner aligner;
+            aligner.use_xdrop = true;
+            REQUIRE(aligner.xdrop() == 6 + 99);
+            
+            string prefix = "ACGTTGCAATCGGATCCATG";
+            string suffix;
+            for (size_t i = 0; i < 40; i++) {
+                suffix += "GATTACA";
+            }
+            graph.create_node(prefix + suffix);
+            
+            SECTION( "A small deletion is still aligned through" ) {
+                
+                Alignment aln;
+                aln.set_sequence(prefix.substr(0, 10) + prefix.substr(12) + suffix);
+                
+                aligner.align_global_banded(aln, graph.graph, 16, false);
+                
+                REQUIRE(aln.path().mapping_size() == 1);
+                REQUIRE(aln.score() == 298 - 6 - 1);
+            }
+            
+            SECTION( "An alignment that falls further than the X-drop is abandoned" ) {
+                
+                // every base of the suffix is a mismatch
+                string mismatched = suffix;
+                for (char& c : mismatched) {
+                    c = (c == 'A' ? 'C' : (c == 'C' ? 'G' : (c == 'G' ? 'T' : 'A')));
+                }
+                
+                Alignment aln;
+                aln.set_sequence(prefix + mismatched);
+                
+                vector<Alignment> alt_alignments;
+                aligner.align_global_banded_multi(aln, alt_alignments, graph.graph, 4, 0, false);
+                
+                REQUIRE(aln.path().mapping_size() == 0);
+                REQUIRE(aln.score() == 0);
+                REQUIRE(alt_alignments.empty());
+                
+                // but it can be aligned without X-drop
+                aligner.use_xdrop = false;
+                aligner.align_global_banded(aln, graph.graph, 0, false);
+                
+                REQUIRE(aln.path().mapping_size() == 1);
+                REQUIRE(aln.score() == 20 - 4 * 280);
+            }
+        }
+        
+        TEST_CASE( "BandedMatrixPool recycles matrix blocks on a thread", "[alignment][banded]" ) {
+            
+            BandedMatrixPool::clear();
+            REQUIRE(BandedMatrixPool::size() == 0);
+            
+            SECTION( "Blocks are reused within a size class" ) {
+                char* block = BandedMatrixPool::acquire(100);
+                REQUIRE(block != nullptr);
+                BandedMatrixPool::release(block, 100);
+                REQUIRE(BandedMatrixPool::size() == 1);
+                
+                // 80 bytes rounds up to the same 128 byte class
+                char* reused = BandedMatrixPool::acquire(80);
+                REQUIRE(reused == block);
+                REQUIRE(BandedMatrixPool::size() == 0);
+                BandedMatrixPool::release(reused, 80);
+            }
+            
+            SECTION( "Empty and oversized blocks are not pooled" ) {
+                REQUIRE(BandedMatrixPool::acquire(0) == nullptr);
+                BandedMatrixPool::release(nullptr, 0);
+                
+                char* big = BandedMatrixPool::acquire(BandedMatrixPool::MAX_POOLED_BYTES + 1);
+                BandedMatrixPool::release(big, BandedMatrixPool::MAX_POOLED_BYTES + 1);
+                REQUIRE(BandedMatrixPool::size() == 0);
+            }
+            
+            SECTION( "Alignments give back their matrices and get the same results from reused ones" ) {
+                VG graph;
+                
+                Aligner aligner;
+                
+                Node* n0 = graph.create_node("AGTG");
+                Node* n1 = graph.create_node("C");
+                Node* n2 = graph.create_node("A");
+                Node* n3 = graph.create_node("TGAAGT");
+                
+                graph.create_edge(n0, n1);
+                graph.create_edge(n0, n2);
+                graph.create_edge(n1, n3);
+                graph.create_edge(n2, n3);
+                
+                Alignment first;
+                first.set_sequence("AGTGCTGAAGT");
+                aligner.align_global_banded(first, graph.graph, 1, false);
+                
+                size_t pooled = BandedMatrixPool::size();
+                REQUIRE(pooled > 0);
+                
+                Alignment second;
+                second.set_sequence("AGTGCTGAAGT");
+                aligner.align_global_banded(second, graph.graph, 1, false);
+                
+                REQUIRE(BandedMatrixPool::size() == pooled);
+                REQUIRE(second.score() == first.score());
+                REQUIRE(pb2json(second.path()) == pb2json(first.path()));
+            }
+            
+            BandedMatrixPool::clear();
+        }
+        
         TEST_CASE( "Banded global aligner produces correct alignments with permissive banding option",
                   "[alignment][banded][mapping]" ) {
             
@@ -3438,11 +3655,158 @@ namespace vg {
                 }
             }
         }
+        
+        /// A backend that takes every other problem and fills it with a marker score
+        class AlternatingBandedBackend : public BandedAlignmentBackend {
+        public:
+            vector<bool> align_global_banded_batch(const BaseAligner& aligner,
+                                                   vector<BandedAlignmentProblem>& problems) {
+                vector<bool> solved(problems.size());
+                for (size_t i = 0; i < problems.size(); i += 2) {
+                    problems[i].alignment->set_score(-1000);
+                    solved[i] = true;
+                }
+                return solved;
+            }
+        };
+        
+        TEST_CASE( "Banded global aligner can align batches of problems",
+                  "[alignment][banded][mapping]" ) {
+            
+            VG graph;
+            
+            Aligner aligner;
+            
+            Node* n0 = graph.create_node("AGTG");
+            Node* n1 = graph.create_node("C");
+            Node* n2 = graph.create_node("A");
+            Node* n3 = graph.create_node("TGAAGT");
+            
+            graph.create_edge(n0, n1);
+            graph.create_edge(n0, n2);
+            graph.create_edge(n1, n3);
+            graph.create_edge(n2, n3);
+            
+            vector<string> reads{"AGTGCTGAAGT", "AGTGATGAAGT", "AGTGTGAAGT", "AGTGCCTGAAGT"};
+            
+            vector<Alignment> expected(reads.size());
+            vector<vector<Alignment>> expected_alts(reads.size());
+            for (size_t i = 0; i < reads.size(); i++) {
+                expected[i].set_sequence(reads[i]);
+                if (i % 2) {
+                    aligner.align_global_banded_multi(expected[i], expected_alts[i], graph.graph, 2, 1, true);
+                } else {
+                    aligner.align_global_banded(expected[i], graph.graph, 1, true);
+                }
+            }
+            
+            vector<Alignment> alns(reads.size());
+            vector<vector<Alignment>> alt_alns(reads.size());
+            vector<BandedAlignmentProblem> problems(reads.size());
+            for (size_t i = 0; i < reads.size(); i++) {
+                alns[i].set_sequence(reads[i]);
+                problems[i].alignment = &alns[i];
+                problems[i].graph = &graph.graph;
+                problems[i].band_padding = 1;
+                if (i % 2) {
+                    problems[i].alt_alignments = &alt_alns[i];
+                    problems[i].max_alt_alns = 2;
+                }
+            }
+            
+            SECTION( "Batches are solved like single problems without a backend" ) {
+                aligner.align_global_banded_batch(problems);
+                for (size_t i = 0; i < reads.size(); i++) {
+                    REQUIRE(alns[i].score() == expected[i].score());
+                    REQUIRE(pb2json(alns[i].path()) == pb2json(expected[i].path()));
+                    REQUIRE(alt_alns[i].size() == expected_alts[i].size());
+                    for (size_t j = 0; j < alt_alns[i].size(); j++) {
+                        REQUIRE(pb2json(alt_alns[i][j]) == pb2json(expected_alts[i][j]));
+                    }
+                }
+            }
+            
+            SECTION( "Problems a backend doesn't solve are solved by the aligner" ) {
+                AlternatingBandedBackend backend;
+                aligner.banded_backend = &backend;
+                aligner.align_global_banded_batch(problems);
+                for (size_t i = 0; i < reads.size(); i++) {
+                    if (i % 2) {
+                        REQUIRE(alns[i].score() == expected[i].score());
+                        REQUIRE(pb2json(alns[i].path()) == pb2json(expected[i].path()));
+                    } else {
+                        REQUIRE(alns[i].score() == -1000);
+                        REQUIRE(alns[i].path().mapping_size() == 0);
+                    }
+                }
+            }
+        }
+        
+        TEST_CASE( "Banded global aligner uses compiled-in kernels for fixed scoring schemes",
+                  "[alignment][banded][mapping]" ) {
+            
+            SECTION( "Aligners recognize the fixed scoring schemes" ) {
+                REQUIRE(Aligner().banded_scoring == DefaultScoring);
+                REQUIRE(Aligner(2, 8, 12, 2).banded_scoring == DoubledDefaultScoring);
+                REQUIRE(Aligner(1, 1, 1, 1).banded_scoring == UnitScoring);
+                REQUIRE(Aligner(1, 4, 6, 2).banded_scoring == RuntimeScoring);
+                REQUIRE(Aligner(2, 4, 6, 1).banded_scoring == RuntimeScoring);
+            }
+            
+            SECTION( "A loaded scoring matrix is only a fixed scheme if it matches one" ) {
+                Aligner aligner;
+                stringstream default_matrix("1 -4 -4 -4 0\n-4 1 -4 -4 0\n-4 -4 1 -4 0\n-4 -4 -4 1 0\n0 0 0 0 0\n");
+                aligner.load_scoring_matrix(default_matrix);
+                REQUIRE(aligner.banded_scoring == DefaultScoring);
+                stringstream transition_matrix("1 -4 -2 -4 0\n-4 1 -4 -2 0\n-2 -4 1 -4 0\n-4 -2 -4 1 0\n0 0 0 0 0\n");
+                aligner.load_scoring_matrix(transition_matrix);
+                REQUIRE(aligner.banded_scoring == RuntimeScoring);
+            }
+            
+            SECTION( "Compiled-in kernels give the same alignments as the runtime scores" ) {
+                VG graph;
+                
+                Node* n0 = graph.create_node("AGTGCTACGA");
+                Node* n1 = graph.create_node("C");
+                Node* n2 = graph.create_node("ATT");
+                Node* n3 = graph.create_node("TGAAGTCCATGNAC");
+                
+                graph.create_edge(n0, n1);
+                graph.create_edge(n0, n2);
+                graph.create_edge(n1, n3);
+                graph.create_edge(n2, n3);
+                
+                vector<string> reads{"AGTGCTACGACTGAAGTCCATGTAC", "AGTGCAACGAATTTGAAGTCATGNAC",
+                    "AGTCTACGACCCTGAAGTCCATGTACA", "ATGCTACGAATTTGAAGGGTCCATGTAC"};
+                
+                // aligners free their score matrices, so they can't be copied; make two of each instead
+                vector<vector<int8_t>> schemes{{1, 4, 6, 1}, {2, 8, 12, 2}, {1, 1, 1, 1}};
+                for (const vector<int8_t>& scheme : schemes) {
+                    Aligner aligner(scheme[0], scheme[1], scheme[2], scheme[3]);
+                    Aligner runtime_aligner(scheme[0], scheme[1], scheme[2], scheme[3]);
+                    REQUIRE(aligner.banded_scoring != RuntimeScoring);
+                    runtime_aligner.banded_scoring = RuntimeScoring;
+                    
+                    for (const string& read : reads) {
+                        Alignment fixed_aln;
+                        fixed_aln.set_sequence(read);
+                        vector<Alignment> fixed_alts;
+                        aligner.align_global_banded_multi(fixed_aln, fixed_alts, graph.graph, 4, 2, true);
+                        
+                        Alignment runtime_aln;
+                        runtime_aln.set_sequence(read);
+                        vector<Alignment> runtime_alts;
+                        runtime_aligner.align_global_banded_multi(runtime_aln, runtime_alts, graph.graph, 4, 2, true);
+                        
+                        REQUIRE(fixed_aln.score() == runtime_aln.score());
+                        REQUIRE(pb2json(fixed_aln.path()) == pb2json(runtime_aln.path()));
+                        REQUIRE(fixed_alts.size() == runtime_alts.size());
+                        for (size_t i = 0; i < fixed_alts.size(); i++) {
+                            REQUIRE(fixed_alts[i].score() == runtime_alts[i].score());
+                        }
+                    }
+                }
+            }
+        }
     }
 }
-
-
-
-
-
-
@@ -0,0 +1,55 @@
+/// \file benchmark.cpp
+///
+/// Unit tests for reading back and comparing benchmark results
+///
+
+#include "catch.hpp"
+#include "../benchmark.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Benchmark results can be read back and compared", "[benchmark]") {
+
+    BenchmarkResult result;
+    result.runs = 100;
+    result.test_mean = chrono::microseconds(50);
+    result.test_stddev = chrono::microseconds(5);
+    result.control_mean = chrono::microseconds(200);
+    result.control_stddev = chrono::microseconds(10);
+    result.name = "some benchmark name";
+    
+    SECTION("A written result parses back to the same score") {
+        stringstream line;
+        line << result;
+        
+        BenchmarkResult parsed;
+        REQUIRE(parse_benchmark_result(line.str(), parsed));
+        REQUIRE(parsed.runs == 100);
+        REQUIRE(parsed.name == "some benchmark name");
+        REQUIRE(parsed.score() == Approx(result.score()));
+        REQUIRE(parsed.score_error() == Approx(result.score_error()));
+    }
+    
+    SECTION("Comment lines are not results") {
+        BenchmarkResult parsed;
+        REQUIRE(!parse_benchmark_result("# runs\ttest(us)\tname", parsed));
+        REQUIRE(!parse_benchmark_result("", parsed));
+    }
+    
+    SECTION("Slowdowns are measured in standard errors") {
+        REQUIRE(benchmark_slowdown(result, result) == 0);
+        
+        BenchmarkResult slower = result;
+        slower.test_mean = chrono::microseconds(100);
+        REQUIRE(benchmark_slowdown(result, slower) > 3);
+        REQUIRE(benchmark_slowdown(slower, result) < -3);
+    }
+}
+
+}
+}
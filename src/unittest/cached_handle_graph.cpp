@@ -0,0 +1,105 @@
+/// \file cached_handle_graph.cpp
+///
+/// Unit tests for the CachedHandleGraph view
+///
+
+#include "catch.hpp"
+#include "../cached_handle_graph.hpp"
+#include "../packed_graph.hpp"
+#include "../algorithms/extract_containing_graph.hpp"
+
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("CachedHandleGraph answers like its backing graph", "[handle][cache]") {
+
+    // 1 -> 2 -> 3 -> 4, with 4 also reading back into 2 through a doubly
+    // reversed edge and 3 having a reversing self loop
+    PackedGraph graph;
+    handle_t h1 = graph.create_handle("GAT");
+    handle_t h2 = graph.create_handle("TA");
+    handle_t h3 = graph.create_handle("C");
+    handle_t h4 = graph.create_handle("AGG");
+    graph.create_edge(h1, h2);
+    graph.create_edge(h2, h3);
+    graph.create_edge(h3, h4);
+    graph.create_edge(graph.flip(h2), graph.flip(h4));
+    graph.create_edge(h3, graph.flip(h3));
+
+    CachedHandleGraph cached(&graph);
+    REQUIRE(cached.cached_node_count() == 0);
+    REQUIRE(cached.node_size() == 4);
+
+    SECTION("Sequences come out the same in both orientations, and stay cached") {
+        for (handle_t h : {h1, h2, h3, h4}) {
+            REQUIRE(cached.get_sequence(h) == graph.get_sequence(h));
+            REQUIRE(cached.get_sequence(graph.flip(h)) == graph.get_sequence(graph.flip(h)));
+            REQUIRE(cached.get_length(h) == graph.get_length(h));
+        }
+        REQUIRE(cached.cached_node_count() == 4);
+        REQUIRE(cached.get_sequence(cached.get_handle(4, true)) == "CCT");
+
+        cached.clear();
+        REQUIRE(cached.cached_node_count() == 0);
+        REQUIRE(cached.get_sequence(h2) == "TA");
+    }
+
+    SECTION("Edges come out the same, in the same order, on both sides") {
+        for (handle_t h : {h1, h2, h3, h4}) {
+            for (handle_t oriented : {h, graph.flip(h)}) {
+                for (bool go_left : {false, true}) {
+                    vector<handle_t> expected, first, second;
+                    graph.follow_edges(oriented, go_left, [&](const handle_t& next) {
+                        expected.push_back(next);
+                    });
+                    cached.follow_edges(oriented, go_left, [&](const handle_t& next) {
+                        first.push_back(next);
+                    });
+                    cached.follow_edges(oriented, go_left, [&](const handle_t& next) {
+                        second.push_back(next);
+                    });
+                    REQUIRE(first == expected);
+                    REQUIRE(second == expected);
+                }
+            }
+        }
+    }
+
+    SECTION("Iteration can stop early through the cache") {
+        // Prime the cache
+        cached.follow_edges(h3, false, [&](const handle_t& next) {});
+
+        size_t seen = 0;
+        bool finished = cached.follow_edges(h3, false, [&](const handle_t& next) {
+            seen++;
+            return false;
+        });
+        REQUIRE(!finished);
+        REQUIRE(seen == 1);
+    }
+
+    SECTION("Extracting through the cache gives the same subgraph") {
+        vector<pos_t> positions{make_pos_t(graph.get_id(h2), false, 1)};
+
+        Graph direct, through_cache, again;
+        algorithms::extract_containing_graph(&graph, direct, positions, 3);
+        algorithms::extract_containing_graph(&cached, through_cache, positions, 3);
+        algorithms::extract_containing_graph(&cached, again, positions, 3);
+
+        REQUIRE(through_cache.node_size() == direct.node_size());
+        REQUIRE(through_cache.edge_size() == direct.edge_size());
+        for (size_t i = 0; i < direct.node_size(); i++) {
+            REQUIRE(through_cache.node(i).id() == direct.node(i).id());
+            REQUIRE(through_cache.node(i).sequence() == direct.node(i).sequence());
+            REQUIRE(again.node(i).id() == direct.node(i).id());
+        }
+        REQUIRE(cached.cached_node_count() == direct.node_size());
+    }
+}
+
+}
+}
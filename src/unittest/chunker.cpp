@@ -193,5 +193,106 @@ TEST_CASE("basic graph chunking", "[chunk]") {
 }
 
 
+TEST_CASE("snarl-balanced chunks are only cut between top-level snarls", "[chunk]") {
+
+    // A chain of three bubbles, with every node 2 bases long
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GA"},
+            {"id": 2, "sequence": "TT"},
+            {"id": 3, "sequence": "TA"},
+            {"id": 4, "sequence": "CA"},
+            {"id": 5, "sequence": "GG"},
+            {"id": 6, "sequence": "GC"},
+            {"id": 7, "sequence": "AT"},
+            {"id": 8, "sequence": "CC"},
+            {"id": 9, "sequence": "CG"},
+            {"id": 10, "sequence": "TA"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4},
+            {"from": 4, "to": 5},
+            {"from": 4, "to": 6},
+            {"from": 5, "to": 7},
+            {"from": 6, "to": 7},
+            {"from": 7, "to": 8},
+            {"from": 7, "to": 9},
+            {"from": 8, "to": 10},
+            {"from": 9, "to": 10}
+        ],
+        "path": [
+            {"name": "x", "mapping": [
+                 {"position": {"node_id": 1}, "rank": 1},
+                 {"position": {"node_id": 2}, "rank": 2},
+                 {"position": {"node_id": 4}, "rank": 3},
+                 {"position": {"node_id": 5}, "rank": 4},
+                 {"position": {"node_id": 7}, "rank": 5},
+                 {"position": {"node_id": 8}, "rank": 6},
+                 {"position": {"node_id": 10}, "rank": 7}]}
+        ]
+    }
+    )";
+
+    Graph chunk;
+    json2pb(chunk, graph_json.c_str(), graph_json.size());
+    xg::XG index(chunk);
+    PathChunker chunker(&index);
+
+    list<Snarl> snarls;
+    for (auto ends : vector<pair<vg::id_t, vg::id_t>>{{1, 4}, {4, 7}, {7, 10}}) {
+        Snarl snarl;
+        snarl.mutable_start()->set_node_id(ends.first);
+        snarl.mutable_end()->set_node_id(ends.second);
+        snarl.set_type(ULTRABUBBLE);
+        snarls.push_back(snarl);
+    }
+    SnarlManager snarl_manager(snarls.begin(), snarls.end());
+
+    Region region = {"x", 0, 13};
+    auto count_nodes = [](vg::id_t id) { return 1.0; };
+
+    SECTION("One chunk covers the whole region") {
+        vector<Region> regions = chunker.snarl_balanced_regions(region, snarl_manager, 1, count_nodes);
+        REQUIRE(regions.size() == 1);
+        REQUIRE(regions[0].start == 0);
+        REQUIRE(regions[0].end == 13);
+    }
+
+    SECTION("Two chunks are cut at the middle chain junction") {
+        vector<Region> regions = chunker.snarl_balanced_regions(region, snarl_manager, 2, count_nodes);
+        REQUIRE(regions.size() == 2);
+        REQUIRE(regions[0].seq == "x");
+        REQUIRE(regions[0].start == 0);
+        REQUIRE(regions[0].end == 7);
+        REQUIRE(regions[1].start == 8);
+        REQUIRE(regions[1].end == 13);
+    }
+
+    SECTION("No more chunks are made than there are junctions") {
+        vector<Region> regions = chunker.snarl_balanced_regions(region, snarl_manager, 10, count_nodes);
+        REQUIRE(regions.size() == 4);
+        REQUIRE(regions[0].end == 3);
+        REQUIRE(regions[1].start == 4);
+        REQUIRE(regions[1].end == 7);
+        REQUIRE(regions[2].start == 8);
+        REQUIRE(regions[2].end == 11);
+        REQUIRE(regions[3].start == 12);
+        REQUIRE(regions[3].end == 13);
+    }
+
+    SECTION("Chunks are balanced by work, not length") {
+        // Make the first bubble expensive
+        auto heavy_start = [](vg::id_t id) { return id == 2 ? 10.0 : 1.0; };
+        vector<Region> regions = chunker.snarl_balanced_regions(region, snarl_manager, 2, heavy_start);
+        REQUIRE(regions.size() == 2);
+        REQUIRE(regions[0].end == 3);
+        REQUIRE(regions[1].start == 4);
+    }
+}
+
 }
 }
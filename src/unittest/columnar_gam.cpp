@@ -0,0 +1,125 @@
+/// \file columnar_gam.cpp
+///
+/// Unit tests for the block-columnar alignment container
+///
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "../columnar_gam.hpp"
+#include "../stream.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Columnar GAM round-trips alignments and reads columns on their own", "[stream][gamc]") {
+
+    vector<Alignment> alignments;
+    for (size_t i = 0; i < 2500; i++) {
+        Alignment aln;
+        if (i % 10) {
+            aln.set_name("read" + to_string(i));
+        }
+        // mostly ACGT, with some bases that have to be stored as exceptions
+        string sequence;
+        for (size_t j = 0; j < i % 151; j++) {
+            sequence.push_back((i + j) % 17 == 0 ? "NacgR"[j % 5] : "ACGT"[(i * j) % 4]);
+        }
+        aln.set_sequence(sequence);
+        if (i % 2) {
+            aln.set_quality(string(sequence.size(), (char) (i % 41)));
+        }
+        if (i % 3) {
+            Mapping* mapping = aln.mutable_path()->add_mapping();
+            mapping->mutable_position()->set_node_id(i + 1);
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(sequence.size());
+            edit->set_to_length(sequence.size());
+        } else if (i % 2) {
+            // an empty path is still there when read back
+            aln.mutable_path();
+        }
+        aln.set_score((int32_t) (i % 300) - 100);
+        aln.set_mapping_quality(i % 61);
+        if (i % 4 == 0) {
+            aln.set_is_secondary(true);
+            aln.set_identity(0.5);
+            aln.mutable_fragment_prev()->set_name("mate");
+        }
+        alignments.push_back(aln);
+    }
+
+    stringstream out;
+    {
+        stream::ColumnarAlignmentWriter writer(out, 1000);
+        for (auto& aln : alignments) {
+            writer.write(aln);
+        }
+    }
+    string data = out.str();
+
+    SECTION("Everything comes back when all the columns are read") {
+        stringstream in(data);
+        REQUIRE(stream::is_columnar_gam(in));
+        size_t i = 0;
+        stream::for_each_columnar(in, [&](Alignment& aln) {
+            REQUIRE(i < alignments.size());
+            REQUIRE(aln.SerializeAsString() == alignments[i].SerializeAsString());
+            REQUIRE(aln.has_path() == alignments[i].has_path());
+            i++;
+        });
+        REQUIRE(i == alignments.size());
+    }
+
+    SECTION("Reading only the paths leaves the other fields empty") {
+        stringstream in(data);
+        size_t i = 0;
+        stream::for_each_columnar(in, [&](Alignment& aln) {
+            REQUIRE(aln.name().empty());
+            REQUIRE(aln.sequence().empty());
+            REQUIRE(aln.score() == 0);
+            REQUIRE(!aln.is_secondary());
+            REQUIRE(aln.has_path() == alignments[i].has_path());
+            REQUIRE(aln.path().SerializeAsString() == alignments[i].path().SerializeAsString());
+            i++;
+        }, stream::COLUMN_PATH);
+        REQUIRE(i == alignments.size());
+    }
+
+    SECTION("Scores can be read in parallel") {
+        stringstream in(data);
+        atomic<size_t> count(0);
+        atomic<int64_t> total_score(0);
+        stream::for_each_columnar_parallel(in, [&](Alignment& aln) {
+            count++;
+            total_score += aln.score();
+        }, stream::COLUMN_SCORE);
+        int64_t expected_score = 0;
+        for (auto& aln : alignments) {
+            expected_score += aln.score();
+        }
+        REQUIRE(count == alignments.size());
+        REQUIRE(total_score == expected_score);
+    }
+
+    SECTION("GAM is not mistaken for columnar GAM") {
+        vector<Alignment> buffer(alignments.begin(), alignments.begin() + 10);
+        stringstream gam;
+        stream::write_buffered(gam, buffer, 0);
+        REQUIRE(!stream::is_columnar_gam(gam));
+        // and checking doesn't consume anything
+        size_t count = 0;
+        function<void(Alignment&)> lambda = [&](Alignment& aln) {
+            count++;
+        };
+        stream::for_each(gam, lambda);
+        REQUIRE(count == 10);
+    }
+}
+
+}
+}
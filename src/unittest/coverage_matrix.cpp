@@ -0,0 +1,113 @@
+/// \file coverage_matrix.cpp
+///
+/// Unit tests for the multi-sample coverage matrix
+///
+
+#include "catch.hpp"
+#include "../coverage_matrix.hpp"
+#include "../packer.hpp"
+#include "../utility.hpp"
+#include "../json2pb.h"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Coverage matrices keep the coverage of each sample", "[pack][coverage_matrix]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"}],
+    "edge":[{"to":2,"from":1}],
+    "path":[{"name":"p","mapping":[{"position":{"node_id":2,"is_reverse":true},"rank":1},
+                                   {"position":{"node_id":1,"is_reverse":true},"rank":2}]}]}
+    )";
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    string on_first_json = R"({"sequence":"GATT","path":{"mapping":[{"position":{"node_id":1},"edit":[{"from_length":4,"to_length":4}]}]}})";
+    string on_second_json = R"({"sequence":"AC","path":{"mapping":[{"position":{"node_id":2},"edit":[{"from_length":2,"to_length":2}]}]}})";
+    Alignment on_first;
+    json2pb(on_first, on_first_json.c_str(), on_first_json.size());
+    Alignment on_second;
+    json2pb(on_second, on_second_json.c_str(), on_second_json.size());
+
+    // one sample covers the first node, and the other the start of the second one twice
+    vector<string> pack_file_names{temp_file::create(), temp_file::create()};
+    {
+        Packer first(&xg_index);
+        first.add(on_first, false);
+        first.save_to_file(pack_file_names[0]);
+        Packer second(&xg_index);
+        second.add(on_second, false);
+        second.add(on_second, false);
+        second.save_to_file(pack_file_names[1]);
+    }
+    string matrix_file_name = temp_file::create();
+
+    SECTION("Rows hold each sample's coverage") {
+        CoverageMatrix::build(pack_file_names, matrix_file_name, 1, 2);
+        CoverageMatrix matrix(matrix_file_name);
+        REQUIRE(matrix.sample_count() == 2);
+        REQUIRE(matrix.sample_name(1) == pack_file_names[1]);
+        REQUIRE(matrix.graph_length() == 7);
+
+        vector<vector<uint32_t>> expected{{1, 0}, {1, 0}, {1, 0}, {1, 0}, {0, 2}, {0, 2}, {0, 0}};
+        vector<size_t> seen;
+        matrix.for_each_row(2, 6, [&](size_t row, const vector<uint32_t>& coverage) {
+            seen.push_back(row);
+            REQUIRE(coverage == expected[row]);
+        });
+        REQUIRE(seen == vector<size_t>({2, 3, 4, 5}));
+    }
+
+    SECTION("Bins sum the coverage of their bases") {
+        CoverageMatrix::build(pack_file_names, matrix_file_name, 3);
+        CoverageMatrix matrix(matrix_file_name);
+        REQUIRE(matrix.row_count() == 3);
+
+        vector<vector<uint32_t>> expected{{3, 0}, {1, 4}, {0, 0}};
+        size_t rows = 0;
+        matrix.for_each_row(0, 7, [&](size_t row, const vector<uint32_t>& coverage) {
+            REQUIRE(coverage == expected[row]);
+            rows++;
+        });
+        REQUIRE(rows == 3);
+    }
+
+    SECTION("Coverage can be read along a path") {
+        CoverageMatrix::build(pack_file_names, matrix_file_name);
+        CoverageMatrix matrix(matrix_file_name);
+
+        // the path runs backward through the graph
+        vector<size_t> rows;
+        vector<uint32_t> second_coverage;
+        matrix.for_each_path_position(xg_index, "p", 1, 5, [&](size_t offset, size_t row,
+                                                               const vector<uint32_t>& coverage) {
+            REQUIRE(offset == rows.size() + 1);
+            rows.push_back(row);
+            second_coverage.push_back(coverage[1]);
+        });
+        REQUIRE(rows == vector<size_t>({5, 4, 3, 2}));
+        REQUIRE(second_coverage == vector<uint32_t>({2, 2, 0, 0}));
+    }
+
+    SECTION("Packs for different graphs can't be combined") {
+        Graph other_graph;
+        other_graph.add_node()->set_sequence("GA");
+        other_graph.mutable_node(0)->set_id(1);
+        xg::XG other_index(other_graph);
+        Packer other(&other_index);
+        other.save_to_file(pack_file_names[1]);
+        REQUIRE_THROWS_AS(CoverageMatrix::build(pack_file_names, matrix_file_name), runtime_error);
+    }
+
+    for (auto& pack_file_name : pack_file_names) {
+        temp_file::remove(pack_file_name);
+    }
+    temp_file::remove(matrix_file_name);
+}
+
+}
+}
@@ -142,5 +142,46 @@ TEST_CASE( "Ambiguous multinomial works", "[distributions][multinomial]" ) {
 
 }
 
+TEST_CASE( "Alias tables sample in proportion to their weights", "[distributions][alias]" ) {
+    
+    default_random_engine prng(12345);
+    
+    SECTION("Weights are followed") {
+        vector<size_t> weights{5, 0, 1, 10, 4};
+        AliasTable table(weights.begin(), weights.end());
+        REQUIRE(table.size() == 5);
+        
+        vector<size_t> counts(weights.size(), 0);
+        size_t draws = 200000;
+        for (size_t i = 0; i < draws; i++) {
+            counts.at(table(prng))++;
+        }
+        REQUIRE(counts[1] == 0);
+        for (size_t i = 0; i < weights.size(); i++) {
+            REQUIRE((double) counts[i] / draws == Approx(weights[i] / 20.0).epsilon(0.02));
+        }
+    }
+    
+    SECTION("Degenerate weights are handled like discrete_distribution") {
+        AliasTable empty;
+        REQUIRE(empty.size() == 1);
+        REQUIRE(empty(prng) == 0);
+        
+        vector<double> one{3.0};
+        AliasTable single(one.begin(), one.end());
+        for (size_t i = 0; i < 100; i++) {
+            REQUIRE(single(prng) == 0);
+        }
+        
+        vector<double> zeros{0.0, 0.0};
+        AliasTable uniform(zeros.begin(), zeros.end());
+        set<size_t> seen;
+        for (size_t i = 0; i < 100; i++) {
+            seen.insert(uniform(prng));
+        }
+        REQUIRE(seen.size() == 2);
+    }
+}
+
 }
 }
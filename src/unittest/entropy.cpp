@@ -0,0 +1,64 @@
+/// \file entropy.cpp
+///  
+/// Unit tests for sliding-window entropy and low-complexity masking
+///
+
+#include "catch.hpp"
+#include "../entropy.hpp"
+
+#include <random>
+#include <string>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Sliding window entropy agrees with recounting each window", "[entropy]") {
+
+    default_random_engine generator(12345);
+    uniform_int_distribution<int> base_distribution(0, 3);
+    string sequence;
+    for (size_t i = 0; i < 500; i++) {
+        // Mix random stretches with homopolymer runs
+        sequence.push_back((i / 50) % 2 ? 'A' : "ACGT"[base_distribution(generator)]);
+    }
+
+    for (size_t window : {1, 5, 16, 64}) {
+        vector<double> entropies = window_entropies(sequence.c_str(), sequence.size(), window);
+        REQUIRE(entropies.size() == sequence.size() - window + 1);
+        for (size_t i = 0; i < entropies.size(); i++) {
+            REQUIRE(entropies[i] == Approx(entropy(sequence.c_str() + i, window)).margin(1e-9));
+        }
+    }
+
+    SECTION("Short sequences are judged as a whole") {
+        vector<double> entropies = window_entropies("ACGT", 4, 16);
+        REQUIRE(entropies.size() == 1);
+        REQUIRE(entropies[0] == Approx(2.0));
+    }
+}
+
+TEST_CASE("Low-complexity masking marks only the low-entropy windows", "[entropy]") {
+
+    string sequence = "ACGTTGCAGTCAGATCCAGT" + string(20, 'A') + "GCATGACTTGACAGCTAGCA";
+    vector<bool> mask = low_complexity_mask(sequence.c_str(), sequence.size(), 8, 1.0);
+
+    REQUIRE(mask.size() == sequence.size());
+    // The run itself is masked
+    for (size_t i = 20; i < 40; i++) {
+        REQUIRE(mask[i]);
+    }
+    // The ends are not
+    REQUIRE(!mask[0]);
+    REQUIRE(!mask[10]);
+    REQUIRE(!mask[sequence.size() - 1]);
+
+    size_t masked = low_complexity_length(sequence, 8, 1.0);
+    REQUIRE(masked >= 20);
+    REQUIRE(masked < 40);
+
+    REQUIRE(low_complexity_length(sequence, 8, 0.0) == 0);
+}
+
+}
+}
@@ -6,6 +6,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <random>
 #include "../feature_set.hpp"
 
 #include "catch.hpp"
@@ -263,6 +264,84 @@ TEST_CASE("Complete deletions remove the feature", "[featureset][simplify]") {
 
 }
 
+TEST_CASE("FeatureSet knows which paths have features", "[featureset][simplify]") {
+
+    // Make a BED stream to read
+    stringstream in("seq1\t5\t10\trecord\n");
+    
+    FeatureSet features;
+    REQUIRE(!features.has_features("seq1"));
+    
+    features.load_bed(in);
+    REQUIRE(features.has_features("seq1"));
+    REQUIRE(!features.has_features("seq2"));
+    
+    // Editing a path without features doesn't give it any
+    features.on_path_edit("seq2", 0, 5, 1);
+    REQUIRE(!features.has_features("seq2"));
+    
+    // Deleting the only feature leaves the path without any
+    features.on_path_edit("seq1", 5, 20, 0);
+    REQUIRE(!features.has_features("seq1"));
+
 }
+
+
+TEST_CASE("Many edits on many features agree with editing features one at a time", "[featureset][simplify]") {
+
+    // Make a bunch of overlapping and nested features
+    default_random_engine generator(12345);
+    uniform_int_distribution<size_t> position_distribution(0, 1000);
+    uniform_int_distribution<size_t> length_distribution(0, 50);
+    
+    stringstream in;
+    vector<FeatureSet> singles;
+    for (size_t i = 0; i < 200; i++) {
+        size_t first = position_distribution(generator);
+        size_t last = first + length_distribution(generator);
+        stringstream line;
+        line << "seq1\t" << first << "\t" << last << "\tf" << i << "\n";
+        in << line.str();
+        
+        // Track each feature on its own too
+        singles.emplace_back();
+        singles.back().load_bed(line);
+    }
+    
+    FeatureSet features;
+    features.load_bed(in);
+    
+    for (size_t i = 0; i < 300; i++) {
+        size_t start = position_distribution(generator);
+        size_t old_length = length_distribution(generator) / 5;
+        size_t new_length = length_distribution(generator) / 5;
+        features.on_path_edit("seq1", start, old_length, new_length);
+        for (auto& single : singles) {
+            single.on_path_edit("seq1", start, old_length, new_length);
+        }
+        
+        if (i % 50 == 0) {
+            // Check partway through, which also makes sure we can keep going
+            // after looking.
+            stringstream expected;
+            for (auto& single : singles) {
+                single.save_bed(expected);
+            }
+            stringstream out;
+            features.save_bed(out);
+            REQUIRE(out.str() == expected.str());
+        }
+    }
+    
+    stringstream expected;
+    for (auto& single : singles) {
+        single.save_bed(expected);
+    }
+    stringstream out;
+    features.save_bed(out);
+    REQUIRE(out.str() == expected.str());
+
 }
 
+}
+}
@@ -0,0 +1,102 @@
+/// \file flat_hash_map.cpp
+///
+/// Unit tests for the flat Swiss-style hash tables
+///
+
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include "catch.hpp"
+#include "../flat_hash_map.hpp"
+#include "../hash_map.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Flat hash maps agree with unordered_map", "[hash]") {
+
+    mt19937 generator(42);
+
+    // small key ranges mean lots of erasing and reinserting the same keys
+    for (int64_t key_range : {10, 1000, 100000}) {
+        FlatHashMap<int64_t, string, wang_hash<int64_t>> flat;
+        unordered_map<int64_t, string> truth;
+
+        for (size_t i = 0; i < 100000; i++) {
+            int64_t key = generator() % key_range;
+            switch (generator() % 4) {
+            case 0:
+                flat[key] = to_string(i);
+                truth[key] = to_string(i);
+                break;
+            case 1:
+                REQUIRE(flat.erase(key) == truth.erase(key));
+                break;
+            case 2:
+                REQUIRE(flat.emplace(key, "emplaced").second == truth.emplace(key, "emplaced").second);
+                break;
+            default:
+                REQUIRE(flat.count(key) == truth.count(key));
+                break;
+            }
+        }
+
+        REQUIRE(flat.size() == truth.size());
+        size_t seen = 0;
+        for (auto& entry : flat) {
+            REQUIRE(truth.at(entry.first) == entry.second);
+            seen++;
+        }
+        REQUIRE(seen == truth.size());
+
+        // erase some entries while iterating
+        {
+            for (auto it = flat.begin(); it != flat.end();) {
+                if (it->first % 3 == 0) {
+                    truth.erase(it->first);
+                    it = flat.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            REQUIRE(flat.size() == truth.size());
+            for (auto& entry : truth) {
+                REQUIRE(flat.at(entry.first) == entry.second);
+            }
+        }
+
+        // copy, move and clear the map
+        {
+            auto copy = flat;
+            auto moved = std::move(copy);
+            REQUIRE(copy.empty());
+            REQUIRE(copy.begin() == copy.end());
+            REQUIRE(moved.size() == truth.size());
+            for (auto& entry : truth) {
+                REQUIRE(moved.at(entry.first) == entry.second);
+            }
+
+            moved.clear();
+            REQUIRE(moved.empty());
+            REQUIRE(moved.begin() == moved.end());
+            REQUIRE(moved.find(0) == moved.end());
+            moved[0] = "again";
+            REQUIRE(moved.size() == 1);
+        }
+    }
+}
+
+TEST_CASE("Flat hash sets hold each key once", "[hash]") {
+    FlatHashSet<pair<int64_t, bool>, wang_hash<pair<int64_t, bool>>> flat{{1, false}, {1, true}, {2, false}};
+    REQUIRE(flat.size() == 3);
+    REQUIRE(!flat.insert(make_pair(1, true)).second);
+    REQUIRE(flat.count(make_pair(1, true)) == 1);
+    REQUIRE(flat.erase(make_pair(1, true)) == 1);
+    REQUIRE(flat.count(make_pair(1, true)) == 0);
+    REQUIRE(flat.find(make_pair(2, false)) != flat.end());
+}
+
+}
+}
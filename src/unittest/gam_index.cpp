@@ -0,0 +1,117 @@
+/// \file gam_index.cpp
+///
+/// Unit tests for the node ID range index over sorted GAMs
+///
+
+#include "catch.hpp"
+#include "../gam_index.hpp"
+#include "../stream.hpp"
+
+#include <set>
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Make a read called name that visits the given nodes
+static Alignment make_read(const string& name, const vector<id_t>& nodes) {
+    Alignment aln;
+    aln.set_name(name);
+    for (auto node_id : nodes) {
+        aln.mutable_path()->add_mapping()->mutable_position()->set_node_id(node_id);
+    }
+    return aln;
+}
+
+TEST_CASE("GAMIndex finds the reads that touch a node ID range", "[gam][index]") {
+
+    // reads sorted by their lowest node, some short and some spanning widely
+    vector<Alignment> reads;
+    for (id_t i = 1; i <= 2000; i++) {
+        if (i % 100 == 0) {
+            reads.push_back(make_read("long" + to_string(i), {i, i + 700}));
+        } else {
+            reads.push_back(make_read("short" + to_string(i), {i, i + 1}));
+        }
+    }
+    reads.push_back(make_read("unmapped", {}));
+
+    // write them as BGZF in small groups
+    stringstream gam;
+    {
+        stream::BlockedGzipOutputStream bgzf_out(gam);
+        vector<Alignment> buffer;
+        for (auto& aln : reads) {
+            buffer.push_back(aln);
+            stream::write_buffered(bgzf_out, buffer, 10);
+        }
+        stream::write_buffered(bgzf_out, buffer, 0);
+    }
+
+    GAMIndex index;
+    gam.seekg(0);
+    index.index(gam);
+
+    auto query = [&](const GAMIndex& query_index, id_t min_id, id_t max_id) {
+        set<string> found;
+        gam.clear();
+        gam.seekg(0);
+        query_index.find(gam, min_id, max_id, [&](const Alignment& aln) {
+            // nothing is found twice
+            REQUIRE(found.insert(aln.name()).second);
+        });
+        return found;
+    };
+
+    auto expected = [&](id_t min_id, id_t max_id) {
+        set<string> touching;
+        for (auto& aln : reads) {
+            for (auto& mapping : aln.path().mapping()) {
+                if (mapping.position().node_id() >= min_id && mapping.position().node_id() <= max_id) {
+                    touching.insert(aln.name());
+                }
+            }
+        }
+        return touching;
+    };
+
+    SECTION("Queries find exactly the reads touching the range") {
+        vector<pair<id_t, id_t>> ranges {{1, 1}, {5, 12}, {690, 720}, {1500, 1500}, {1999, 2100}, {3000, 4000}};
+        for (auto& range : ranges) {
+            REQUIRE(query(index, range.first, range.second) == expected(range.first, range.second));
+        }
+        // the long read from 1000 jumps to 1700, and nothing in between counts
+        REQUIRE(query(index, 1700, 1700).count("long1000"));
+        REQUIRE(!query(index, 1650, 1650).count("long1000"));
+    }
+
+    SECTION("Only a few groups are visited for a small range") {
+        auto groups = index.find_groups({make_pair(1500, 1510)});
+        auto all_groups = index.find_groups({make_pair(1, 3000)});
+        REQUIRE(all_groups.size() == 200);
+        REQUIRE(groups.size() < all_groups.size() / 5);
+        REQUIRE(is_sorted(groups.begin(), groups.end()));
+    }
+
+    SECTION("The index survives saving and loading") {
+        stringstream saved;
+        index.save(saved);
+
+        GAMIndex loaded;
+        saved.seekg(0);
+        loaded.load(saved);
+
+        REQUIRE(query(loaded, 690, 720) == expected(690, 720));
+        REQUIRE(loaded.find_groups({make_pair(1, 2000)}) == index.find_groups({make_pair(1, 2000)}));
+    }
+
+    SECTION("Loading something else fails") {
+        stringstream not_index("GATTACA");
+        GAMIndex loaded;
+        REQUIRE_THROWS(loaded.load(not_index));
+    }
+}
+
+}
+}
@@ -0,0 +1,62 @@
+/// \file genotype_columns.cpp
+///
+/// Unit tests for finding genotypes in raw VCF lines
+///
+
+#include "catch.hpp"
+#include "../genotype_columns.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("GenotypeColumns finds each sample's GT value", "[vcf][genotype]") {
+
+    GenotypeColumns genotypes;
+    string gt;
+
+    SECTION("GT can be the only FORMAT field") {
+        string line = "ref\t5\trs1337\tA\tG,T\t29\tPASS\t.\tGT\t0|1\t1/2\t.";
+        genotypes.index(line);
+        REQUIRE(genotypes.size() == 3);
+        genotypes.get(0, gt);
+        REQUIRE(gt == "0|1");
+        genotypes.get(1, gt);
+        REQUIRE(gt == "1/2");
+        genotypes.get(2, gt);
+        REQUIRE(gt == ".");
+    }
+
+    SECTION("GT can be among other FORMAT fields") {
+        string line = "ref\t5\t.\tA\tG\t29\tPASS\tAC=2\tDP:GT:GQ\t10:1|1:99\t3:0|1\t7";
+        genotypes.index(line);
+        REQUIRE(genotypes.size() == 3);
+        genotypes.get(0, gt);
+        REQUIRE(gt == "1|1");
+        genotypes.get(1, gt);
+        REQUIRE(gt == "0|1");
+        // trailing fields can be dropped
+        genotypes.get(2, gt);
+        REQUIRE(gt.empty());
+        // samples past the end are missing
+        genotypes.get(3, gt);
+        REQUIRE(gt.empty());
+    }
+
+    SECTION("Lines without GT have empty genotypes") {
+        string line = "ref\t5\t.\tA\tG\t29\tPASS\t.\tDP\t10\t3";
+        genotypes.index(line);
+        REQUIRE(genotypes.size() == 2);
+        genotypes.get(0, gt);
+        REQUIRE(gt.empty());
+    }
+
+    SECTION("Lines without samples have no genotypes") {
+        string line = "ref\t5\t.\tA\tG\t29\tPASS\t.";
+        genotypes.index(line);
+        REQUIRE(genotypes.size() == 0);
+    }
+}
+
+}
+}
@@ -687,9 +687,108 @@ TEST_CASE("RepresentativeTraversalFinder finds traversals correctly", "[genotype
       }
                 
     }
+    
+    SECTION("a site that runs out of search budget keeps the traversals found so far") {
+      
+      finder.max_site_search_ticks = 1;
+      
+      vector<SnarlTraversal> traversals = finder.find_traversals(*child);
+      
+      // We only get the backbone
+      REQUIRE(traversals.size() == 1);
+      REQUIRE(finder.get_sites_over_budget() == 1);
+      
+      finder.max_site_search_ticks = 1000;
+      
+      traversals = finder.find_traversals(*child);
+      
+      REQUIRE(traversals.size() == 2);
+      REQUIRE(finder.get_sites_over_budget() == 1);
+    }
   }
 
 }
 
+TEST_CASE("SupportAugmentedGraph stores and reloads supports by rank", "[genotype][support]") {
+    
+    const string graph_json = R"(
+    
+        {
+        "node": [
+            {"id": 1, "sequence": "G"},
+            {"id": 2, "sequence": "A"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "GGG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ]
+        }
+        )";
+    
+    Graph chunk;
+    json2pb(chunk, graph_json.c_str(), graph_json.size());
+    
+    SupportAugmentedGraph augmented;
+    augmented.graph.merge(chunk);
+    
+    REQUIRE(!augmented.has_supports());
+    
+    Node* supported_node = augmented.graph.get_node(2);
+    Node* unsupported_node = augmented.graph.get_node(3);
+    Edge* supported_edge = augmented.graph.get_edge(NodeSide(2, true), NodeSide(4, false));
+    Edge* unsupported_edge = augmented.graph.get_edge(NodeSide(1, true), NodeSide(3, false));
+    
+    Support node_support;
+    node_support.set_forward(3);
+    node_support.set_reverse(1.5);
+    node_support.set_quality(20);
+    augmented.set_support(supported_node, node_support);
+    
+    Support edge_support;
+    edge_support.set_forward(2);
+    augmented.set_support(supported_edge, edge_support);
+    
+    SECTION("Supports can be looked up") {
+        REQUIRE(augmented.has_supports());
+        REQUIRE(augmented.has_support(supported_node));
+        REQUIRE(!augmented.has_support(unsupported_node));
+        REQUIRE(augmented.has_support(supported_edge));
+        REQUIRE(!augmented.has_support(unsupported_edge));
+        
+        REQUIRE(augmented.get_support(supported_node).forward() == 3);
+        REQUIRE(augmented.get_support(supported_node).reverse() == 1.5);
+        REQUIRE(augmented.get_support(supported_node).quality() == 20);
+        REQUIRE(total(augmented.get_support(unsupported_node)) == 0);
+        REQUIRE(augmented.get_support(supported_edge).forward() == 2);
+        REQUIRE(total(augmented.get_support(unsupported_edge)) == 0);
+        
+        size_t nodes_seen = 0;
+        augmented.for_each_node_support([&](Node* node, const Support& support) {
+            REQUIRE(node == supported_node);
+            nodes_seen++;
+        });
+        REQUIRE(nodes_seen == 1);
+    }
+    
+    SECTION("Supports survive a round trip through a file") {
+        stringstream support_stream;
+        augmented.write_supports(support_stream);
+        
+        SupportAugmentedGraph reloaded;
+        reloaded.graph.merge(chunk);
+        reloaded.load_supports(support_stream);
+        
+        REQUIRE(reloaded.node_supports.size() == 1);
+        REQUIRE(reloaded.edge_supports.size() == 1);
+        REQUIRE(reloaded.get_support(reloaded.graph.get_node(2)).reverse() == 1.5);
+        REQUIRE(reloaded.get_support(reloaded.graph.get_edge(NodeSide(2, true), NodeSide(4, false))).forward() == 2);
+        REQUIRE(!reloaded.has_support(reloaded.graph.get_node(3)));
+    }
+}
+
 }
 }
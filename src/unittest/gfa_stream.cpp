@@ -0,0 +1,101 @@
+/// \file gfa_stream.cpp
+///
+/// Unit tests for streaming GFA import
+///
+
+#include "catch.hpp"
+#include "../gfa_stream.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("GFA files can be streamed as graph chunks", "[gfa][stream]") {
+
+    const string gfa = "H\tVN:Z:1.0\n"
+                       "S\t1\tGATT\n"
+                       "S\t2\tACA\n"
+                       "L\t1\t+\t2\t-\t0M\n"
+                       "S\tthree\tTTG\n"
+                       "L\t2\t-\tthree\t+\t*\n"
+                       "P\tref\t1+,2-,three+\t*\n";
+
+    SECTION("Everything comes out in one chunk if it fits") {
+        stringstream in(gfa);
+        vector<Graph> chunks;
+        gfa_for_each_chunk(in, [&](Graph& g) {
+            chunks.push_back(g);
+        });
+
+        REQUIRE(chunks.size() == 1);
+        const Graph& g = chunks.front();
+        REQUIRE(g.node_size() == 3);
+        REQUIRE(g.node(0).id() == 1);
+        REQUIRE(g.node(0).sequence() == "GATT");
+        REQUIRE(g.node(1).id() == 2);
+        // Non-numeric names get the first ID handed out
+        REQUIRE(g.node(2).id() == 1);
+        REQUIRE(g.node(2).name() == "three");
+
+        REQUIRE(g.edge_size() == 2);
+        REQUIRE(g.edge(0).from() == 1);
+        REQUIRE(!g.edge(0).from_start());
+        REQUIRE(g.edge(0).to() == 2);
+        REQUIRE(g.edge(0).to_end());
+        REQUIRE(g.edge(1).from_start());
+        REQUIRE(!g.edge(1).to_end());
+
+        REQUIRE(g.path_size() == 1);
+        REQUIRE(g.path(0).name() == "ref");
+        REQUIRE(g.path(0).mapping_size() == 3);
+        REQUIRE(g.path(0).mapping(1).position().node_id() == 2);
+        REQUIRE(g.path(0).mapping(1).position().is_reverse());
+        REQUIRE(g.path(0).mapping(2).rank() == 3);
+    }
+
+    SECTION("Chunks are capped, and paths are split across them with their ranks") {
+        stringstream in(gfa);
+        vector<Graph> chunks;
+        gfa_for_each_chunk(in, [&](Graph& g) {
+            chunks.push_back(g);
+        }, 2);
+
+        // 3 nodes, 2 edges and 3 mappings, 2 at a time
+        REQUIRE(chunks.size() == 4);
+        size_t nodes = 0, edges = 0;
+        vector<int64_t> ranks;
+        for (auto& chunk : chunks) {
+            REQUIRE(chunk.node_size() + chunk.edge_size() <= 2);
+            nodes += chunk.node_size();
+            edges += chunk.edge_size();
+            for (size_t i = 0; i < chunk.path_size(); i++) {
+                REQUIRE(chunk.path(i).name() == "ref");
+                for (size_t j = 0; j < chunk.path(i).mapping_size(); j++) {
+                    ranks.push_back(chunk.path(i).mapping(j).rank());
+                }
+            }
+        }
+        REQUIRE(nodes == 3);
+        REQUIRE(edges == 2);
+        REQUIRE(ranks == vector<int64_t>({1, 2, 3}));
+    }
+
+    SECTION("Overlapping links are rejected") {
+        stringstream in("S\t1\tGATT\nS\t2\tTTACA\nL\t1\t+\t2\t+\t2M\n");
+        REQUIRE_THROWS(gfa_for_each_chunk(in, [&](Graph& g) {}));
+    }
+
+    SECTION("Malformed lines are rejected") {
+        stringstream in("S\t1\tGATT\nL\t1\t+\t2\n");
+        REQUIRE_THROWS(gfa_for_each_chunk(in, [&](Graph& g) {}));
+        stringstream bad_orientation("L\t1\t+\t2\t?\t*\n");
+        REQUIRE_THROWS(gfa_for_each_chunk(bad_orientation, [&](Graph& g) {}));
+    }
+}
+
+}
+}
@@ -0,0 +1,113 @@
+/// \file graph_validator.cpp
+///
+/// Unit tests for parallel validation of XG graphs and alignments
+///
+
+#include "catch.hpp"
+#include "../graph_validator.hpp"
+#include "../json2pb.h"
+#include "../stream.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("GraphValidator checks XG graphs and alignments", "[validate][xg]") {
+
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GAT"},
+            {"id": 2, "sequence": "TA"},
+            {"id": 3, "sequence": "C"},
+            {"id": 4, "sequence": "A"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "rank": 1},
+                {"position": {"node_id": 2}, "rank": 2},
+                {"position": {"node_id": 4}, "rank": 3}
+            ]}
+        ]
+    }
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+    xg::XG index(graph);
+
+    GraphValidator validator(index, 2);
+    validator.print_errors = false;
+
+    // Make a read that goes along the given node visits, covering the given
+    // number of bases on each.
+    auto make_read = [](const string& name, const vector<pair<id_t, size_t>>& visits, size_t first_offset) {
+        Alignment aln;
+        aln.set_name(name);
+        string sequence;
+        for (size_t i = 0; i < visits.size(); i++) {
+            Mapping* mapping = aln.mutable_path()->add_mapping();
+            mapping->mutable_position()->set_node_id(visits[i].first);
+            mapping->mutable_position()->set_offset(i == 0 ? first_offset : 0);
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(visits[i].second);
+            edit->set_to_length(visits[i].second);
+            sequence += string(visits[i].second, 'N');
+        }
+        aln.set_sequence(sequence);
+        return aln;
+    };
+
+    SECTION("A good graph passes") {
+        REQUIRE(validator.check_edges());
+        REQUIRE(validator.check_orphans());
+        REQUIRE(validator.check_paths());
+        REQUIRE(validator.error_count() == 0);
+    }
+
+    SECTION("Good alignments pass") {
+        REQUIRE(validator.check_alignment(make_read("good", {{1, 2}, {3, 1}, {4, 1}}, 1)).empty());
+        REQUIRE(validator.check_alignment(make_read("one", {{2, 1}}, 1)).empty());
+    }
+
+    SECTION("Bad alignments are caught") {
+        // No edge from 2 to 3
+        REQUIRE(!validator.check_alignment(make_read("no-edge", {{2, 2}, {3, 1}}, 0)).empty());
+        // Doesn't reach the end of node 1
+        REQUIRE(!validator.check_alignment(make_read("gap", {{1, 2}, {2, 2}}, 0)).empty());
+        // Runs off node 2
+        REQUIRE(!validator.check_alignment(make_read("long", {{2, 3}}, 0)).empty());
+        // No node 7
+        REQUIRE(!validator.check_alignment(make_read("missing", {{7, 1}}, 0)).empty());
+        // Sequence doesn't match the path
+        Alignment short_read = make_read("short", {{1, 3}}, 0);
+        short_read.set_sequence("GA");
+        REQUIRE(!validator.check_alignment(short_read).empty());
+    }
+
+    SECTION("Streamed alignments keep only the first errors") {
+        vector<Alignment> reads;
+        reads.push_back(make_read("good", {{1, 3}, {2, 2}}, 0));
+        for (size_t i = 0; i < 5; i++) {
+            reads.push_back(make_read("bad" + to_string(i), {{2, 2}, {3, 1}}, 0));
+        }
+        stringstream gam;
+        stream::write_buffered(gam, reads, 0);
+
+        REQUIRE(!validator.check_alignments(gam));
+        REQUIRE(validator.error_count() >= 2);
+        REQUIRE(validator.get_errors().size() == 2);
+    }
+}
+
+}
+}
@@ -8,6 +8,7 @@
 #include "../handle.hpp"
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../packed_graph.hpp"
 #include "../json2pb.h"
 
 #include <iostream>
@@ -314,6 +315,59 @@ TEST_CASE("VG and XG handle implementations are correct", "[handle][vg][xg]") {
             REQUIRE(g->get_id(found[9]) == n9->id());
         }
     }
+    
+    SECTION("Parallel node iteration visits every node once") {
+        for (const HandleGraph* g : {(HandleGraph*) &vg, (HandleGraph*) &xg_index}) {
+            vector<handle_t> found;
+            g->for_each_handle([&](const handle_t& handle) {
+#pragma omp critical (found)
+                found.push_back(handle);
+            }, true);
+            
+            REQUIRE(found.size() == 10);
+            unordered_set<id_t> ids;
+            for (auto& handle : found) {
+                REQUIRE(g->get_is_reverse(handle) == false);
+                ids.insert(g->get_id(handle));
+            }
+            REQUIRE(ids.size() == 10);
+        }
+    }
+    
+    SECTION("Bulk accessors agree with the per-handle ones") {
+        for (const HandleGraph* g : {(HandleGraph*) &vg, (HandleGraph*) &xg_index}) {
+            vector<handle_t> handles;
+            for (Node* node : {n0, n1, n2, n3, n4, n5, n6, n7, n8, n9}) {
+                handles.push_back(g->get_handle(node->id(), false));
+                handles.push_back(g->get_handle(node->id(), true));
+            }
+            
+            vector<handle_t> neighbors;
+            for (const handle_t& handle : handles) {
+                for (bool go_left : {false, true}) {
+                    vector<handle_t> followed;
+                    g->follow_edges(handle, go_left, [&](const handle_t& next) {
+                        followed.push_back(next);
+                    });
+                    
+                    g->get_neighbors(handle, go_left, neighbors);
+                    REQUIRE(neighbors == followed);
+                    REQUIRE(g->get_degree(handle, go_left) == followed.size());
+                }
+            }
+            
+            vector<size_t> lengths;
+            vector<string> sequences{"leftover"};
+            g->get_lengths(handles, lengths);
+            g->get_sequences(handles, sequences);
+            REQUIRE(lengths.size() == handles.size());
+            REQUIRE(sequences.size() == handles.size());
+            for (size_t i = 0; i < handles.size(); i++) {
+                REQUIRE(lengths[i] == g->get_length(handles[i]));
+                REQUIRE(sequences[i] == g->get_sequence(handles[i]));
+            }
+        }
+    }
 
 }
 
@@ -325,6 +379,10 @@ TEST_CASE("Mutable handle graphs work", "[handle][vg]") {
     VG vg;
     implementations.push_back(&vg);
     
+    // And the packed implementation
+    PackedGraph packed;
+    implementations.push_back(&packed);
+    
     for(auto* g : implementations) {
     
         SECTION("No nodes exist by default") {
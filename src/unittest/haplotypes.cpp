@@ -501,6 +501,38 @@ TEST_CASE("We can score haplotypes using GBWT", "[haplo-score][gbwt]") {
   query_node_lengths = {node_lengths[1], node_lengths[8]};
   haplo::gbwt_thread_t empty_node(query_nodes, query_node_lengths);
   REQUIRE(!(haplo::haplo_DP::score(empty_node, *gbwt_index, memo).second));
+  
+  // threads that share prefixes score the same when resumed from the cache
+  haplo::haplo_DP_prefix_cache cache(3);
+  query_nodes = {tm[1], tm[2], tm[4], tm[5], tm[7]};
+  query_node_lengths = {node_lengths[1], node_lengths[2], node_lengths[4], node_lengths[5], node_lengths[7]};
+  haplo::gbwt_thread_t through_5(query_nodes, query_node_lengths);
+  query_nodes = {tm[1], tm[2], tm[4], tm[6], tm[7]};
+  query_node_lengths = {node_lengths[1], node_lengths[2], node_lengths[4], node_lengths[6], node_lengths[7]};
+  haplo::gbwt_thread_t through_6(query_nodes, query_node_lengths);
+  
+  for (auto* thread : {&through_5, &through_6, &query, &through_5}) {
+    pair<double, bool> uncached = haplo::haplo_DP::score(*thread, *gbwt_index, memo);
+    pair<double, bool> cached = haplo::haplo_DP::score(*thread, *gbwt_index, memo, &cache);
+    REQUIRE(cached.second == uncached.second);
+    REQUIRE(fabs(cached.first - uncached.first) < 0.000001);
+    REQUIRE(cache.size() <= 3);
+  }
+  
+  // the longest cached prefix is found, and is no longer than the thread
+  vector<uint64_t> keys = cache.prefix_keys(query, memo);
+  unique_ptr<haplo::haplo_DP_column> column;
+  REQUIRE(cache.longest_prefix(query, keys, memo, column) == 3);
+  REQUIRE(fabs(column->current_sum() - result_from_thread.first) < 0.000001);
+  keys = cache.prefix_keys(through_5, memo);
+  REQUIRE(cache.longest_prefix(through_5, keys, memo, column) == 5);
+  REQUIRE(fabs(column->current_sum() - haplo::haplo_DP::score(through_5, *gbwt_index, memo).first) < 0.000001);
+  
+  // different parameters don't share columns
+  haplo::haploMath::RRMemo other_memo(6, 12);
+  keys = cache.prefix_keys(through_5, other_memo);
+  REQUIRE(cache.longest_prefix(through_5, keys, other_memo, column) == 0);
+  
   delete gbwt_index;
 }
 
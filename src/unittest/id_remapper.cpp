@@ -0,0 +1,145 @@
+/// \file id_remapper.cpp
+///
+/// Unit tests for streaming node renumbering
+///
+
+#include "catch.hpp"
+#include "../id_remapper.hpp"
+#include "../json2pb.h"
+#include "../stream.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("IDRemapper renumbers streamed graphs", "[ids][stream]") {
+
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 10, "sequence": "GAT"},
+            {"id": 4, "sequence": "TA"},
+            {"id": 7, "sequence": "C"}
+        ],
+        "edge": [
+            {"from": 10, "to": 4},
+            {"from": 4, "to": 7, "to_end": true}
+        ],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 10}, "rank": 1},
+                {"position": {"node_id": 4}, "rank": 2}
+            ]}
+        ]
+    }
+    )";
+
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+
+    // Write the graph out as two chunks
+    Graph first;
+    *first.add_node() = graph.node(0);
+    *first.add_node() = graph.node(1);
+    *first.add_edge() = graph.edge(0);
+    Graph second;
+    *second.add_node() = graph.node(2);
+    *second.add_edge() = graph.edge(1);
+    *second.add_path() = graph.path(0);
+    vector<Graph> chunks {first, second};
+    stringstream vg_stream;
+    stream::write_buffered(vg_stream, chunks, 0);
+    string serialized = vg_stream.str();
+
+    // Read back all the chunks of a stream
+    auto read_chunks = [](stringstream& in) {
+        vector<Graph> read;
+        function<void(Graph&)> lambda = [&](Graph& chunk) {
+            read.push_back(chunk);
+        };
+        stream::for_each(in, lambda);
+        return read;
+    };
+
+    SECTION("Compacting numbers nodes in order of appearance") {
+        IDRemapper remapper;
+        remapper.compact = true;
+        stringstream in(serialized);
+        remapper.scan(in);
+
+        REQUIRE(remapper.max_id() == 3);
+        REQUIRE(remapper.translate(0, 10) == 1);
+        REQUIRE(remapper.translate(0, 4) == 2);
+        REQUIRE(remapper.translate(0, 7) == 3);
+        REQUIRE(remapper.translate(0, 5) == 0);
+
+        stringstream again(serialized);
+        stringstream out;
+        stringstream translation_out;
+        remapper.rewrite(0, again, out, &translation_out);
+
+        auto rewritten = read_chunks(out);
+        REQUIRE(rewritten.size() == 2);
+        REQUIRE(rewritten[0].node(0).id() == 1);
+        REQUIRE(rewritten[0].node(1).id() == 2);
+        REQUIRE(rewritten[0].edge(0).from() == 1);
+        REQUIRE(rewritten[0].edge(0).to() == 2);
+        REQUIRE(rewritten[1].node(0).id() == 3);
+        REQUIRE(rewritten[1].edge(0).to() == 3);
+        REQUIRE(rewritten[1].edge(0).to_end());
+        REQUIRE(rewritten[1].path(0).mapping(0).position().node_id() == 1);
+        REQUIRE(rewritten[1].path(0).mapping(1).position().node_id() == 2);
+        REQUIRE(rewritten[1].path(0).mapping(1).rank() == 2);
+
+        vector<Translation> translations;
+        function<void(Translation&)> lambda = [&](Translation& translation) {
+            translations.push_back(translation);
+        };
+        stream::for_each(translation_out, lambda);
+        REQUIRE(translations.size() == 3);
+        REQUIRE(translations[0].from().mapping(0).position().node_id() == 10);
+        REQUIRE(translations[0].to().mapping(0).position().node_id() == 1);
+        REQUIRE(translations[0].to().mapping(0).edit(0).from_length() == 3);
+        REQUIRE(translations[2].from().mapping(0).position().node_id() == 7);
+        REQUIRE(translations[2].to().mapping(0).position().node_id() == 3);
+    }
+
+    SECTION("Joined graphs get IDs after the ones before") {
+        IDRemapper remapper;
+        remapper.join = true;
+        for (size_t i = 0; i < 2; i++) {
+            stringstream in(serialized);
+            remapper.scan(in);
+        }
+
+        REQUIRE(remapper.graph_count() == 2);
+        REQUIRE(remapper.translate(0, 4) == 4);
+        REQUIRE(remapper.translate(1, 4) == 14);
+        REQUIRE(remapper.max_id() == 20);
+
+        stringstream in(serialized);
+        stringstream out;
+        remapper.rewrite(1, in, out);
+        auto rewritten = read_chunks(out);
+        REQUIRE(rewritten[0].node(0).id() == 20);
+        REQUIRE(rewritten[1].path(0).mapping(1).position().node_id() == 14);
+    }
+
+    SECTION("Increments can be combined with compacting") {
+        IDRemapper remapper;
+        remapper.compact = true;
+        remapper.increment = 100;
+        stringstream in(serialized);
+        remapper.scan(in);
+
+        REQUIRE(remapper.translate(0, 7) == 103);
+        REQUIRE(remapper.max_id() == 103);
+    }
+}
+
+}
+}
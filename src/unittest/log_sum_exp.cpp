@@ -0,0 +1,101 @@
+/// \file log_sum_exp.cpp
+///
+/// Unit tests for the tabulated sums of exponentials behind exact mapping
+/// qualities
+///
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "catch.hpp"
+#include "../log_sum_exp.hpp"
+#include "../gssw_aligner.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Tabulated exp agrees with exp", "[mapq][simd]") {
+    for (double x = -707.0; x <= 0.0; x += 0.173) {
+        REQUIRE(fabs(tabulated_exp(x) / exp(x) - 1.0) < 1e-12);
+    }
+    REQUIRE(tabulated_exp(0.0) == 1.0);
+    REQUIRE(tabulated_exp(-710.0) == 0.0);
+    REQUIRE(tabulated_exp(numeric_limits<double>::lowest()) == 0.0);
+}
+
+TEST_CASE("Sums of exponentials agree with exp at every SIMD level", "[mapq][simd]") {
+    mt19937 generator(42);
+    uniform_real_distribution<double> distribution(0.0, 100.0);
+
+    for (size_t count : {1, 3, 4, 17, 1000}) {
+        vector<double> values(count);
+        for (auto& value : values) {
+            value = distribution(generator);
+        }
+        double shift = 100.0;
+        double expected = 0.0;
+        for (auto& value : values) {
+            expected += exp(value - shift);
+        }
+        for (int level = SIMD_SCALAR; level <= simd_level_supported(); level++) {
+            double sum = sum_exp(values.data(), values.size(), shift, (SIMDLevel) level);
+            REQUIRE(fabs(sum / expected - 1.0) < 1e-12);
+        }
+    }
+
+    SECTION("Values far below the shift contribute nothing") {
+        vector<double> values{1000.0, 0.0, numeric_limits<double>::lowest(), 1000.0, 999.0};
+        double expected = 2.0 + exp(-1.0);
+        for (int level = SIMD_SCALAR; level <= simd_level_supported(); level++) {
+            double sum = sum_exp(values.data(), values.size(), 1000.0, (SIMDLevel) level);
+            REQUIRE(fabs(sum / expected - 1.0) < 1e-12);
+        }
+    }
+}
+
+TEST_CASE("Exact mapping qualities agree with pairwise log sums", "[mapq][aligner]") {
+    Aligner aligner;
+    mt19937 generator(7);
+    uniform_int_distribution<int> distribution(50, 150);
+
+    for (size_t trial = 0; trial < 100; trial++) {
+        vector<double> scores(trial % 20 + 1);
+        for (auto& score : scores) {
+            score = distribution(generator);
+        }
+
+        // work out the mapping quality the slow way
+        vector<double> scaled_scores;
+        for (auto& score : scores) {
+            scaled_scores.push_back(aligner.score_to_unnormalized_likelihood_ln(score));
+        }
+        if (scaled_scores.size() == 1) {
+            scaled_scores.push_back(0.0);
+        }
+        double max_score = *max_element(scaled_scores.begin(), scaled_scores.end());
+        double log_sum = numeric_limits<double>::lowest();
+        double others = numeric_limits<double>::lowest();
+        bool skipped_max = false;
+        for (auto& score : scaled_scores) {
+            log_sum = add_log(log_sum, score);
+            if (score == max_score && !skipped_max) {
+                skipped_max = true;
+            } else {
+                others = add_log(others, score);
+            }
+        }
+        double expected = 10.0 / log(10.0) * (log_sum - others);
+        if (expected > numeric_limits<int32_t>::max()) {
+            expected = numeric_limits<int32_t>::max();
+        }
+
+        // allow for the truncation landing on either side of a whole number
+        REQUIRE(abs(aligner.compute_mapping_quality(scores, false) - (int32_t) expected) <= 1);
+    }
+}
+
+}
+}
@@ -0,0 +1,72 @@
+/// \file mapped_file.cpp
+///
+/// Unit tests for memory-mapped index files
+///
+
+#include "catch.hpp"
+#include "../mapped_file.hpp"
+#include "../utility.hpp"
+
+#include <fstream>
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("MappedFileBuffer exposes the file and reads and seeks like a filebuf", "[mapped_file]") {
+
+    string filename = temp_file::create();
+    {
+        ofstream out(filename);
+        out << "GATTACA";
+    }
+
+    MappedFileBuffer mapped(filename);
+    REQUIRE(mapped.is_open());
+    REQUIRE(mapped.size() == 7);
+    REQUIRE(string(mapped.data(), mapped.size()) == "GATTACA");
+    istream in(&mapped);
+
+    SECTION("Characters can be read and put back") {
+        char c;
+        in.get(c);
+        REQUIRE(c == 'G');
+        in.unget();
+        in.get(c);
+        REQUIRE(c == 'G');
+    }
+
+    SECTION("Blocks can be read") {
+        char buffer[4];
+        in.read(buffer, 4);
+        REQUIRE(in.gcount() == 4);
+        REQUIRE(string(buffer, 4) == "GATT");
+    }
+
+    SECTION("The stream can seek") {
+        in.seekg(4);
+        char c;
+        in.get(c);
+        REQUIRE(c == 'A');
+        in.seekg(0, ios_base::end);
+        REQUIRE(in.tellg() == 7);
+        in.get(c);
+        REQUIRE(!in);
+    }
+
+    temp_file::remove(filename);
+}
+
+TEST_CASE("MappedFileBuffer fails to open missing and empty files", "[mapped_file]") {
+    MappedFileBuffer missing("/this/file/does/not/exist.xg");
+    REQUIRE(!missing.is_open());
+
+    string filename = temp_file::create();
+    MappedFileBuffer empty(filename);
+    REQUIRE(!empty.is_open());
+    temp_file::remove(filename);
+}
+
+}
+}
@@ -88,6 +88,48 @@ TEST_CASE( "Mapper can map to a one-node graph", "[mapping][mapper]" ) {
         }
     }
     
+    SECTION( "Mapper can map a batch of reads one stage at a time" ) {
+        
+        vector<Alignment> reads(3);
+        reads[0].set_sequence("GAT");
+        reads[1].set_sequence("TGT");
+        reads[2].set_sequence("TACA");
+        
+        auto results = mapper.align_multi_batch(reads);
+        
+        REQUIRE(results.size() == reads.size());
+        for (size_t i = 0; i < reads.size(); i++) {
+            // each read should get what it would get on its own
+            auto single = mapper.align_multi(reads[i]);
+            REQUIRE(results[i].size() == single.size());
+            REQUIRE(results[i].front().sequence() == reads[i].sequence());
+            REQUIRE(results[i].front().score() == single.front().score());
+            REQUIRE(pb2json(results[i].front().path()) == pb2json(single.front().path()));
+        }
+        
+        REQUIRE(mapper.batch_timing.batches == 1);
+        REQUIRE(mapper.batch_timing.reads == reads.size());
+    }
+    
+    SECTION( "Mapper finds the same alignments when it scores clusters before tracing back" ) {
+        
+        vector<string> reads{"GAT", "TGT", "TACA", "GATTACA"};
+        for (auto& read : reads) {
+            Alignment aln;
+            aln.set_sequence(read);
+            
+            mapper.score_before_traceback = false;
+            auto traced = mapper.align_multi(aln);
+            mapper.score_before_traceback = true;
+            auto scored_first = mapper.align_multi(aln);
+            
+            REQUIRE(scored_first.size() == traced.size());
+            REQUIRE(scored_first.front().score() == traced.front().score());
+            REQUIRE(scored_first.front().mapping_quality() == traced.front().mapping_quality());
+            REQUIRE(pb2json(scored_first.front().path()) == pb2json(traced.front().path()));
+        }
+    }
+    
     SECTION( "Mapper can map two tiny paired reads" ) {
     
         // Here are two reads in opposing, inward-facing directions
@@ -297,6 +339,137 @@ TEST_CASE( "Mapper finds optimal mapping for read starting with node-border MEM"
     
 }
 
+TEST_CASE( "MEM k-mer table does not change the MEMs found", "[mapping][mapper][mem]" ) {
+    
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACAGATTACACATTAG"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "GGGACCTTAGCANGATTTACAGGT"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ]
+    })";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.extend(proto_graph);
+    
+    gcsa::TempFile::setDirectory(temp_file::get_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+    gcsa::GCSA* gcsaidx = nullptr;
+    gcsa::LCPArray* lcpidx = nullptr;
+    build_gcsa_lcp(graph, gcsaidx, lcpidx, 16, 3);
+    xg::XG xg_index(proto_graph);
+    
+    Mapper mapper(&xg_index, gcsaidx, lcpidx);
+    
+    vector<string> reads {
+        "GATTACAGATTACACATTAGCGGGACCTTAGCA",
+        "ACATTAGTGGGACCTTAG",
+        "TTTTTTTTTTGATTACACATTAGTGGG",
+        "GATTACANGATTACAGGTGATTTACAGGT",
+        "ACGT"
+    };
+    
+    auto summarize = [](const vector<MaximalExactMatch>& mems) {
+        vector<tuple<string, size_t, size_t>> summary;
+        for (auto& mem : mems) {
+            summary.emplace_back(mem.sequence(), mem.range.first, mem.range.second);
+        }
+        return summary;
+    };
+    
+    for (auto& read : reads) {
+        mapper.build_mem_kmer_table(4);
+        auto simple_with_table = summarize(mapper.find_mems_simple(read.begin(), read.end(), 0, 1, 0));
+        double lcp_avg, fraction_filtered;
+        auto deep_with_table = summarize(mapper.find_mems_deep(read.begin(), read.end(), lcp_avg, fraction_filtered,
+                                                               0, 1, 0));
+        
+        mapper.build_mem_kmer_table(0);
+        auto simple_without_table = summarize(mapper.find_mems_simple(read.begin(), read.end(), 0, 1, 0));
+        auto deep_without_table = summarize(mapper.find_mems_deep(read.begin(), read.end(), lcp_avg, fraction_filtered,
+                                                                  0, 1, 0));
+        
+        REQUIRE(simple_with_table == simple_without_table);
+        REQUIRE(deep_with_table == deep_without_table);
+    }
+    
+    delete gcsaidx;
+    delete lcpidx;
+}
+
+TEST_CASE( "FragmentLengthDistribution can be trained from many threads", "[mapping][mapper][fragment]" ) {
+    
+    FragmentLengthDistribution distribution(1000, 100, 0.95);
+    REQUIRE(!distribution.is_finalized());
+    
+    // Lengths spread evenly from 200 to 400, with a few wild outliers
+    vector<int64_t> lengths;
+    for (size_t i = 0; i < 2000; i++) {
+        lengths.push_back(i % 100 == 0 ? 100000 : 200 + (i * 37) % 201);
+    }
+    
+#pragma omp parallel for
+    for (size_t i = 0; i < lengths.size(); i++) {
+        distribution.register_fragment_length(lengths[i]);
+    }
+    
+    REQUIRE(distribution.is_finalized());
+    REQUIRE(distribution.curr_sample_size() == 1000);
+    REQUIRE(distribution.measurements().size() == 1000);
+    
+    // The outliers are trimmed off before estimating
+    REQUIRE(distribution.mean() > 280.0);
+    REQUIRE(distribution.mean() < 320.0);
+    REQUIRE(distribution.stdev() > 30.0);
+    REQUIRE(distribution.stdev() < 90.0);
+    
+    SECTION( "Copies keep the estimate" ) {
+        FragmentLengthDistribution copy;
+        copy = distribution;
+        REQUIRE(copy.is_finalized());
+        REQUIRE(copy.mean() == distribution.mean());
+        REQUIRE(copy.measurements() == distribution.measurements());
+    }
+}
+
+TEST_CASE( "FragmentLengthDistribution trained from many threads ends with the serial estimate", "[mapping][mapper][fragment]" ) {
+
+    vector<int64_t> lengths;
+    for (size_t i = 0; i < 5000; i++) {
+        lengths.push_back(i % 50 == 0 ? 50000 : 150 + (i * 61) % 301);
+    }
+
+    for (size_t trial = 0; trial < 20; trial++) {
+        // reestimate after every measurement, so reestimates race with the final one
+        FragmentLengthDistribution distribution(2000, 1, 0.95);
+
+#pragma omp parallel for
+        for (size_t i = 0; i < lengths.size(); i++) {
+            distribution.register_fragment_length(lengths[i]);
+        }
+        REQUIRE(distribution.is_finalized());
+
+        // estimate from the same measurements in one thread
+        vector<double> measured = distribution.measurements();
+        FragmentLengthDistribution serial(measured.size(), 0, 0.95);
+        for (double length : measured) {
+            serial.register_fragment_length(length);
+        }
+        REQUIRE(serial.is_finalized());
+
+        REQUIRE(distribution.parameters() == serial.parameters());
+    }
+}
+
 }
 
 }
@@ -0,0 +1,68 @@
+/// \file mapper_calibration.cpp
+///
+/// Unit tests for saving and loading precomputed mapper statistics
+///
+
+#include "catch.hpp"
+#include "../mapper_calibration.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("MapperCalibration round-trips through its text format", "[mapping][calibration]") {
+
+    MapperCalibration calibration;
+    calibration.gc_content = 0.41234567890123;
+    calibration.graph_entropy = 1.9876;
+    calibration.average_node_length = 12.5;
+    calibration.pseudo_length_multiplier = 1.7;
+    calibration.calibration_simulations = 250;
+    calibration.calibration_read_length = 150;
+
+    stringstream out;
+    calibration.save(out);
+
+    SECTION("Saved values load back exactly") {
+        MapperCalibration loaded;
+        stringstream in(out.str());
+        loaded.load(in);
+
+        REQUIRE(loaded.gc_content == calibration.gc_content);
+        REQUIRE(loaded.graph_entropy == calibration.graph_entropy);
+        REQUIRE(loaded.average_node_length == calibration.average_node_length);
+        REQUIRE(loaded.pseudo_length_multiplier == calibration.pseudo_length_multiplier);
+        REQUIRE(loaded.has_mismapping_calibration(250, 150));
+        REQUIRE(!loaded.has_mismapping_calibration(1000, 150));
+        REQUIRE(!loaded.has_mismapping_calibration(250, 100));
+    }
+
+    SECTION("Unknown keys are skipped") {
+        MapperCalibration loaded;
+        stringstream in(out.str() + "something_new\t3\n");
+        loaded.load(in);
+        REQUIRE(loaded.average_node_length == 12.5);
+    }
+
+    SECTION("Missing values stay unset") {
+        MapperCalibration loaded;
+        stringstream in("#vg-calibration\t1\ngc_content\t0.5\n");
+        loaded.load(in);
+        REQUIRE(loaded.gc_content == 0.5);
+        REQUIRE(loaded.graph_entropy < 0);
+        REQUIRE(!loaded.has_mismapping_calibration(250, 150));
+    }
+
+    SECTION("Files without the header are rejected") {
+        MapperCalibration loaded;
+        stringstream in("gc_content\t0.5\n");
+        REQUIRE_THROWS_AS(loaded.load(in), runtime_error);
+    }
+}
+
+}
+}
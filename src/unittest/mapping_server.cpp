@@ -0,0 +1,82 @@
+/// \file mapping_server.cpp
+///
+/// Unit tests for serving requests over a Unix socket
+///
+
+#include "catch.hpp"
+#include "../mapping_server.hpp"
+#include "../utility.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Connect to the socket, send the request, and return everything sent back
+static string send_request(const string& socket_path, const string& request) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*) &address, sizeof(address)) == -1) {
+        close(fd);
+        return "";
+    }
+    write(fd, request.c_str(), request.size());
+    shutdown(fd, SHUT_WR);
+
+    string response;
+    char buffer[256];
+    ssize_t got;
+    while ((got = read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, got);
+    }
+    close(fd);
+    return response;
+}
+
+TEST_CASE("MappingServer answers requests on stdin and stdout", "[mapping][server]") {
+
+    string socket_path = temp_file::create("vg-server-");
+
+    // Count the lines each client sends
+    function<size_t(void)> count_lines = [](void) {
+        size_t lines = 0;
+        string line;
+        while (getline(cin, line)) {
+            lines++;
+        }
+        cout << lines << endl;
+        return lines;
+    };
+
+    {
+        MappingServer server(socket_path);
+
+        string first;
+        string second;
+        thread clients([&]() {
+            first = send_request(socket_path, "a\nb\nc\n");
+            second = send_request(socket_path, "d\n");
+        });
+        server.serve(count_lines, "", 2);
+        clients.join();
+
+        REQUIRE(first == "3\n");
+        REQUIRE(second == "1\n");
+    }
+
+    // The socket file goes away with the server
+    REQUIRE(access(socket_path.c_str(), F_OK) != 0);
+}
+
+}
+}
@@ -173,5 +173,53 @@ TEST_CASE( "ShuffledPairs loops over all pairs", "[mem]" ) {
     }
     
 }
+
+TEST_CASE( "MEMHitPool recycles hit buffers on a thread", "[mem]" ) {
+    
+    MEMHitPool::clear();
+    
+    string read = "GATTACA";
+    vector<MaximalExactMatch> mems;
+    mems.emplace_back(read.begin(), read.begin() + 4, gcsa::range_type(0, 1), 2);
+    mems.emplace_back(read.begin() + 3, read.end(), gcsa::range_type(2, 2), 1);
+    mems[0].nodes = {gcsa::Node::encode(1, 0), gcsa::Node::encode(2, 3)};
+    mems[1].nodes = {gcsa::Node::encode(3, 1)};
+    
+    SECTION( "Released MEMs give up their hits" ) {
+        MEMHitPool::release(mems);
+        REQUIRE(MEMHitPool::size() == 2);
+        REQUIRE(mems[0].nodes.empty());
+        REQUIRE(mems[1].nodes.empty());
+        
+        // acquired buffers come back empty but keep their storage
+        vector<gcsa::node_type> hits = MEMHitPool::acquire();
+        REQUIRE(hits.empty());
+        REQUIRE(hits.capacity() > 0);
+        REQUIRE(MEMHitPool::size() == 1);
+    }
+    
+    SECTION( "Buffers that are too big are not pooled" ) {
+        mems[0].nodes.resize(MEMHitPool::MAX_POOLED_CAPACITY + 1);
+        MEMHitPool::release(mems);
+        REQUIRE(MEMHitPool::size() == 1);
+        REQUIRE(mems[0].nodes.empty());
+        REQUIRE(mems[0].nodes.capacity() == 0);
+    }
+    
+    SECTION( "Clusters can be released" ) {
+        vector<vector<MaximalExactMatch>> clusters{mems, mems};
+        MEMHitPool::release(clusters);
+        REQUIRE(MEMHitPool::size() == 4);
+    }
+    
+    SECTION( "An empty pool hands out fresh buffers" ) {
+        vector<gcsa::node_type> hits = MEMHitPool::acquire();
+        REQUIRE(hits.empty());
+        REQUIRE(MEMHitPool::size() == 0);
+    }
+    
+    MEMHitPool::clear();
+}
+
 }
 }
@@ -0,0 +1,109 @@
+/// \file minimizer_index.cpp
+///
+/// Unit tests for the minimizer seed index
+///
+
+#include "catch.hpp"
+#include "../minimizer_index.hpp"
+#include "../vg.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("Minimizers of sequences on the graph are found where the sequence is", "[minimizer][mapping]") {
+
+    // two SNP bubbles between three longer nodes
+    VG graph;
+    handle_t h1 = graph.create_handle("GATTACACATTAGCCATGACGTAGGA");
+    handle_t h2 = graph.create_handle("C");
+    handle_t h3 = graph.create_handle("T");
+    handle_t h4 = graph.create_handle("TTGACCAGTACGGATAGCATGCA");
+    handle_t h5 = graph.create_handle("A");
+    handle_t h6 = graph.create_handle("G");
+    handle_t h7 = graph.create_handle("CCGTAGATCAGTTGACAGTAGCA");
+    for (handle_t snp : {h2, h3}) {
+        graph.create_edge(h1, snp);
+        graph.create_edge(snp, h4);
+    }
+    for (handle_t snp : {h5, h6}) {
+        graph.create_edge(h4, snp);
+        graph.create_edge(snp, h7);
+    }
+
+    MinimizerIndex index(9, 5);
+    index.build(graph);
+    REQUIRE(index.size() > 0);
+
+    // check that every minimizer of a walk's sequence has a hit at the graph
+    // position it came from
+    auto check_walk = [&](const vector<handle_t>& walk) {
+        string sequence;
+        vector<pair<handle_t, size_t>> positions;
+        for (handle_t h : walk) {
+            string node_sequence = graph.get_sequence(h);
+            for (size_t i = 0; i < node_sequence.size(); i++) {
+                positions.emplace_back(h, i);
+            }
+            sequence += node_sequence;
+        }
+        auto minimizers = index.minimizers(sequence.begin(), sequence.end());
+        REQUIRE(!minimizers.empty());
+        for (auto& minimizer : minimizers) {
+            auto& position = positions[minimizer.offset];
+            gcsa::node_type expected = gcsa::Node::encode(graph.get_id(position.first), position.second,
+                                                          graph.get_is_reverse(position.first));
+            vector<gcsa::node_type> hits;
+            REQUIRE(index.find(minimizer.key, hits) == index.count(minimizer.key));
+            REQUIRE(find(hits.begin(), hits.end(), expected) != hits.end());
+        }
+    };
+
+    SECTION("Every walk is indexed in both orientations") {
+        for (handle_t first_snp : {h2, h3}) {
+            for (handle_t second_snp : {h5, h6}) {
+                vector<handle_t> walk{h1, first_snp, h4, second_snp, h7};
+                check_walk(walk);
+                vector<handle_t> reverse_walk;
+                for (auto it = walk.rbegin(); it != walk.rend(); ++it) {
+                    reverse_walk.push_back(graph.flip(*it));
+                }
+                check_walk(reverse_walk);
+            }
+        }
+    }
+
+    SECTION("Sequences that aren't in the graph miss") {
+        string sequence = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
+        for (auto& minimizer : index.minimizers(sequence.begin(), sequence.end())) {
+            REQUIRE(index.count(minimizer.key) == 0);
+        }
+        string too_short = "GATTACA";
+        REQUIRE(index.minimizers(too_short.begin(), too_short.end()).empty());
+    }
+
+    SECTION("The index survives being saved and loaded") {
+        stringstream serialized;
+        index.save(serialized);
+        MinimizerIndex loaded;
+        loaded.load(serialized);
+        REQUIRE(loaded.k() == 9);
+        REQUIRE(loaded.w() == 5);
+        REQUIRE(loaded.size() == index.size());
+        REQUIRE(loaded.hit_count() == index.hit_count());
+        string sequence = graph.get_sequence(h1);
+        for (auto& minimizer : index.minimizers(sequence.begin(), sequence.end())) {
+            vector<gcsa::node_type> hits, loaded_hits;
+            index.find(minimizer.key, hits);
+            loaded.find(minimizer.key, loaded_hits);
+            REQUIRE(hits == loaded_hits);
+        }
+    }
+}
+
+}
+}
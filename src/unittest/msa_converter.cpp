@@ -9,6 +9,8 @@
 #include <stdio.h>
 #include <iostream>
 #include <unordered_map>
+#include <sstream>
+#include <omp.h>
 
 #include "msa_converter.hpp"
 #include "catch.hpp"
@@ -243,5 +245,49 @@ namespace vg {
                 REQUIRE(graph.has_edge(NodeSide(nodes["G"], true), NodeSide(nodes["TT"], false)));
             }
         }
+    
+        
+        TEST_CASE("MSAConverter builds the same graph from many blocks with any number of threads", "[msa]") {
+            
+            // several blocks, with gap runs, case changes, and sequences repeated between blocks
+            stringstream input;
+            input << "##maf version=1\n";
+            for (size_t i = 0; i < 20; i++) {
+                input << "\na score=0\n";
+                input << "s human.1 0 12 + 100 GATTACA" << string(i % 4, '-') << "CATG" << string(4 - i % 4, 'A') << "\n";
+                input << "s chimp.2 0 12 + 100 GAT" << string(4 + i % 4, '-') << "catg" << string(4 - i % 4, 'T') << "\n";
+                input << "s cat.3 0 12 + 100 " << string(1 + i % 3, '-') << string(14 - i % 3, "ACGT"[i % 4]) << "\n";
+            }
+            string maf = input.str();
+            
+            auto convert_with_threads = [&](int threads) {
+                int old_threads = omp_get_max_threads();
+                omp_set_num_threads(threads);
+                istringstream strm(maf);
+                MSAConverter msa_converter;
+                msa_converter.load_alignments(strm, "maf");
+                VG graph = msa_converter.make_graph(true, 3);
+                omp_set_num_threads(old_threads);
+                return graph;
+            };
+            
+            VG serial_graph = convert_with_threads(1);
+            VG parallel_graph = convert_with_threads(4);
+            
+            REQUIRE(pb2json(parallel_graph.graph) == pb2json(serial_graph.graph));
+            
+            // every block's paths are there and on nodes that exist
+            Graph& g = parallel_graph.graph;
+            REQUIRE(g.path_size() == 60);
+            for (size_t i = 0; i < g.path_size(); i++) {
+                for (size_t j = 0; j < g.path(i).mapping_size(); j++) {
+                    REQUIRE(parallel_graph.has_node(g.path(i).mapping(j).position().node_id()));
+                }
+            }
+            
+            // and new nodes don't collide with the ones from the blocks
+            id_t max_id = parallel_graph.max_node_id();
+            REQUIRE(parallel_graph.create_node("A")->id() > max_id);
+        }
     }
 }
@@ -1141,8 +1141,54 @@ namespace vg {
         
         }
         
+        TEST_CASE( "Multipath alignments can be enumerated lazily from the best down", "[alignment][multipath]" ) {
+            
+            // a chain of two bubbles, with one subpath on each node
+            MultipathAlignment multipath_aln;
+            multipath_aln.set_sequence("ACGTA");
+            vector<int32_t> scores{1, 3, 1, 1, 2, -1, 1};
+            vector<vector<uint32_t>> nexts{{1, 2}, {3}, {3}, {4, 5}, {6}, {6}, {}};
+            for (size_t i = 0; i < scores.size(); i++) {
+                Subpath* subpath = multipath_aln.add_subpath();
+                subpath->set_score(scores[i]);
+                for (auto next : nexts[i]) {
+                    subpath->add_next(next);
+                }
+                Mapping* mapping = subpath->mutable_path()->add_mapping();
+                mapping->mutable_position()->set_node_id(i + 1);
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(1);
+                edit->set_to_length(1);
+            }
+            identify_start_subpaths(multipath_aln);
+            
+            MultipathAlignmentEnumerator enumerator(multipath_aln);
+            vector<Alignment> enumerated;
+            Alignment aln;
+            while (enumerator.next(aln)) {
+                enumerated.push_back(aln);
+            }
+            
+            SECTION( "Every alignment comes out once, in descending order of score" ) {
+                REQUIRE(enumerated.size() == 4);
+                vector<int32_t> expected_scores{8, 6, 5, 3};
+                vector<vector<int64_t>> expected_nodes{{1, 2, 4, 5, 7}, {1, 3, 4, 5, 7}, {1, 2, 4, 6, 7}, {1, 3, 4, 6, 7}};
+                for (size_t i = 0; i < enumerated.size(); i++) {
+                    REQUIRE(enumerated[i].score() == expected_scores[i]);
+                    REQUIRE(enumerated[i].path().mapping_size() == expected_nodes[i].size());
+                    for (size_t j = 0; j < expected_nodes[i].size(); j++) {
+                        REQUIRE(enumerated[i].path().mapping(j).position().node_id() == expected_nodes[i][j]);
+                    }
+                }
+            }
+            
+            SECTION( "The enumerator agrees with the top alignments" ) {
+                vector<Alignment> top = optimal_alignments(multipath_aln, 3);
+                REQUIRE(top.size() == 3);
+                for (size_t i = 0; i < top.size(); i++) {
+                    REQUIRE(pb2json(top[i]) == pb2json(enumerated[i]));
+                }
+            }
+        }
     }
 }
-
-
-
@@ -209,6 +209,41 @@ TEST_CASE( "MultipathMapper::query_cluster_graphs works", "[multipath][mapping][
     
     }
     
+    SECTION("a memoized alignment to a cluster graph matches a fresh one") {
+        
+        // Make a MEM for the whole read
+        mems.emplace_back(read.begin(), read.end(), make_pair(5, 5), 1);
+        mems.back().nodes.push_back(gcsa::Node::encode(1, 0));
+        
+        clusters.resize(1);
+        clusters.back().emplace_back(&mems.back(), make_pos_t(1, false, 0));
+        
+        auto results = mapper.query_cluster_graphs(aln, mems, clusters);
+        REQUIRE(results.size() == 1);
+        
+        MultipathMapper::cluster_aln_memo_t memo;
+        
+        MultipathAlignment fresh, first, second;
+        mapper.multipath_align(aln, get<0>(results[0]), get<1>(results[0]), fresh);
+        REQUIRE(memo.empty());
+        
+        // The first alignment through the memo fills it
+        mapper.multipath_align(aln, get<0>(results[0]), get<1>(results[0]), first, &memo);
+        REQUIRE(memo.size() == 1);
+        REQUIRE(memo.count(get<0>(results[0])));
+        
+        // And the second reads it back
+        mapper.multipath_align(aln, get<0>(results[0]), get<1>(results[0]), second, &memo);
+        REQUIRE(memo.size() == 1);
+        
+        REQUIRE(pb2json(first) == pb2json(fresh));
+        REQUIRE(pb2json(second) == pb2json(fresh));
+        
+        for (auto cluster_graph : results) {
+            delete get<0>(cluster_graph);
+        }
+    }
+    
     SECTION("two MEMs close together in one cluster make one graph") {
     
         // We will use two fake overlapping MEMs
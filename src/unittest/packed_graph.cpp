@@ -0,0 +1,205 @@
+/// \file packed_graph.cpp
+///
+/// Unit tests for the PackedGraph MutableHandleGraph implementation
+///
+
+#include "catch.hpp"
+#include "../packed_graph.hpp"
+#include "../vg.hpp"
+#include "../prune.hpp"
+#include "../utility.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+// Describe everything the graph reaches from a handle on one side, like "1+ 2-"
+static string neighbors(const HandleGraph& graph, const handle_t& handle, bool go_left) {
+    vector<pair<id_t, bool>> found;
+    graph.follow_edges(handle, go_left, [&](const handle_t& other) {
+        found.emplace_back(graph.get_id(other), graph.get_is_reverse(other));
+    });
+    sort(found.begin(), found.end());
+    string description;
+    for (auto& visit : found) {
+        description += (description.empty() ? "" : " ") + to_string(visit.first) + (visit.second ? "-" : "+");
+    }
+    return description;
+}
+
+TEST_CASE("PackedGraph stores sequences and edges", "[handle][packed]") {
+
+    PackedGraph graph;
+
+    handle_t h1 = graph.create_handle("GATTACA");
+    handle_t h2 = graph.create_handle("CNNTag");
+    handle_t h3 = graph.create_handle("T", 10);
+
+    REQUIRE(graph.node_size() == 3);
+    REQUIRE(graph.get_id(h1) == 1);
+    REQUIRE(graph.get_id(h2) == 2);
+    REQUIRE(graph.get_id(h3) == 10);
+    REQUIRE(graph.max_node_id() == 10);
+    REQUIRE(graph.has_node(10));
+    REQUIRE(!graph.has_node(5));
+
+    SECTION("Unusual bases survive packing") {
+        REQUIRE(graph.get_sequence(h2) == "CNNTag");
+        REQUIRE(graph.get_sequence(graph.flip(h2)) == reverse_complement(string("CNNTag")));
+        REQUIRE(graph.get_length(h2) == 6);
+    }
+
+    SECTION("Edges can be followed from both ends and deduplicate") {
+        graph.create_edge(h1, h2);
+        graph.create_edge(graph.flip(h2), graph.flip(h1));
+        graph.create_edge(h2, graph.flip(h3));
+
+        REQUIRE(graph.edge_count() == 2);
+        REQUIRE(neighbors(graph, h1, false) == "2+");
+        REQUIRE(neighbors(graph, h2, true) == "1+");
+        REQUIRE(neighbors(graph, h3, false) == "2-");
+        REQUIRE(neighbors(graph, graph.flip(h2), false) == "1-");
+
+        SECTION("Reversing self loops are a single edge") {
+            graph.create_edge(h1, graph.flip(h1));
+            REQUIRE(graph.edge_count() == 3);
+            REQUIRE(neighbors(graph, h1, false) == "1- 2+");
+            graph.destroy_edge(h1, graph.flip(h1));
+            REQUIRE(graph.edge_count() == 2);
+            REQUIRE(neighbors(graph, h1, false) == "2+");
+        }
+
+        SECTION("Destroying a node removes its edges") {
+            graph.destroy_handle(h2);
+            REQUIRE(graph.node_size() == 2);
+            REQUIRE(graph.edge_count() == 0);
+            REQUIRE(!graph.has_node(2));
+            REQUIRE(neighbors(graph, h1, false) == "");
+            REQUIRE(neighbors(graph, h3, false) == "");
+            // Other handles stay good
+            REQUIRE(graph.get_sequence(h3) == "T");
+        }
+
+        SECTION("Reorienting a node keeps its ID and turns its edges around") {
+            handle_t flipped = graph.apply_orientation(graph.flip(h2));
+            REQUIRE(graph.get_id(flipped) == 2);
+            REQUIRE(graph.get_sequence(flipped) == reverse_complement(string("CNNTag")));
+            REQUIRE(neighbors(graph, flipped, false) == "1-");
+            REQUIRE(neighbors(graph, flipped, true) == "10+");
+        }
+
+        SECTION("Dividing a node moves the end edges to the last part") {
+            auto parts = graph.divide_handle(h2, vector<size_t>{2, 4});
+            REQUIRE(parts.size() == 3);
+            REQUIRE(graph.get_sequence(parts[0]) == "CN");
+            REQUIRE(graph.get_sequence(parts[1]) == "NT");
+            REQUIRE(graph.get_sequence(parts[2]) == "ag");
+            REQUIRE(graph.get_id(parts[0]) == 2);
+            REQUIRE(graph.edge_count() == 4);
+            REQUIRE(neighbors(graph, parts[0], true) == "1+");
+            REQUIRE(neighbors(graph, parts[0], false) == to_string(graph.get_id(parts[1])) + "+");
+            REQUIRE(neighbors(graph, parts[2], false) == "10-");
+        }
+
+        SECTION("Dividing a reverse handle gives reverse parts in its order") {
+            auto parts = graph.divide_handle(graph.flip(h2), 2);
+            REQUIRE(graph.get_sequence(parts.first) == "ct");
+            REQUIRE(graph.get_sequence(parts.second) == "ANNG");
+            REQUIRE(graph.get_is_reverse(parts.first));
+            REQUIRE(graph.get_is_reverse(parts.second));
+            REQUIRE(graph.get_id(parts.second) == 2);
+        }
+    }
+}
+
+TEST_CASE("PackedGraph round trips through the vg format", "[handle][packed][vg]") {
+
+    VG vg;
+    Node* n1 = vg.create_node("GAT");
+    Node* n2 = vg.create_node("TACA");
+    Node* n3 = vg.create_node("CC");
+    vg.create_edge(n1, n2);
+    vg.create_edge(n1, n3, false, true);
+    vg.create_edge(n3, n3);
+    vg.create_edge(n2, n2, true, false);
+
+    PackedGraph copied(vg);
+    REQUIRE(copied.node_size() == 3);
+    REQUIRE(copied.edge_count() == vg.edge_count());
+
+    stringstream serialized;
+    copied.serialize_to_ostream(serialized, 2);
+
+    SECTION("VG can read what PackedGraph writes") {
+        VG loaded(serialized);
+        REQUIRE(loaded.node_count() == 3);
+        REQUIRE(loaded.edge_count() == vg.edge_count());
+        REQUIRE(loaded.get_node(n2->id())->sequence() == "TACA");
+        REQUIRE(loaded.has_edge(NodeSide(n1->id(), true), NodeSide(n3->id(), true)));
+    }
+
+    SECTION("PackedGraph can read what it writes") {
+        PackedGraph loaded(serialized);
+        REQUIRE(loaded.node_size() == 3);
+        REQUIRE(loaded.edge_count() == vg.edge_count());
+        vg.for_each_handle([&](const handle_t& handle) {
+            handle_t other = loaded.get_handle(vg.get_id(handle));
+            REQUIRE(loaded.get_sequence(other) == vg.get_sequence(handle));
+            for (bool go_left : {false, true}) {
+                REQUIRE(neighbors(loaded, other, go_left) == neighbors(vg, handle, go_left));
+            }
+        });
+    }
+}
+
+TEST_CASE("Pruning a PackedGraph matches pruning a VG", "[handle][packed][prune]") {
+
+    // A run of bubbles, which makes many choices in a short walk, and a small
+    // separate component
+    VG vg;
+    Node* previous = vg.create_node("GATT");
+    for (size_t i = 0; i < 4; i++) {
+        Node* ref = vg.create_node("A");
+        Node* alt = vg.create_node("C");
+        Node* next = vg.create_node("CA");
+        vg.create_edge(previous, ref);
+        vg.create_edge(previous, alt);
+        vg.create_edge(ref, next);
+        vg.create_edge(alt, next);
+        previous = next;
+    }
+    Node* small = vg.create_node("GG");
+    Node* smaller = vg.create_node("T");
+    vg.create_edge(small, smaller);
+
+    PackedGraph packed(vg);
+
+    // Any 6 base walk through two bubbles makes more than one choice
+    size_t edges_before = packed.edge_count();
+    vg.prune_complex_with_head_tail(6, 1);
+    prune_complex_with_head_tail(packed, 6, 1);
+    REQUIRE(packed.edge_count() == vg.edge_count());
+    REQUIRE(packed.edge_count() < edges_before);
+
+    vg.prune_short_subgraphs(4);
+    prune_short_subgraphs(packed, 4);
+    REQUIRE(packed.node_size() == vg.node_size());
+    REQUIRE(!packed.has_node(small->id()));
+    REQUIRE(!packed.has_node(smaller->id()));
+
+    vg.for_each_handle([&](const handle_t& handle) {
+        REQUIRE(packed.has_node(vg.get_id(handle)));
+        handle_t other = packed.get_handle(vg.get_id(handle));
+        for (bool go_left : {false, true}) {
+            REQUIRE(neighbors(packed, other, go_left) == neighbors(vg, handle, go_left));
+        }
+    });
+}
+
+}
+}
@@ -8,6 +8,7 @@
 #include "../json2pb.h"
 #include "../vg.pb.h"
 #include "../path_index.hpp"
+#include "../xg.hpp"
 #include "catch.hpp"
 
 namespace vg {
@@ -360,6 +361,46 @@ TEST_CASE("PathIndex translation can divide the last node", "[pathindex]") {
     }
     
 }
+TEST_CASE("PathIndex built from an XG matches one built from a VG", "[pathindex]") {
+
+    // Load the graph
+    Graph graph;
+    json2pb(graph, path_index_graph_1.c_str(), path_index_graph_1.size());
+    
+    VG to_index;
+    to_index.extend(graph);
+    xg::XG xg_index(to_index.graph);
+    
+    PathIndex from_vg(to_index, "cool", true);
+    PathIndex from_xg(xg_index, "cool", true);
+    
+    SECTION("Both indexes have the same sequence and visits") {
+        REQUIRE(from_xg.sequence == from_vg.sequence);
+        REQUIRE(from_xg.by_id.size() == from_vg.by_id.size());
+        for (auto& entry : from_vg.by_id) {
+            REQUIRE(from_xg.by_id.at(entry.first) == entry.second);
+        }
+        REQUIRE(from_xg.by_start.size() == from_vg.by_start.size());
+        for (auto& entry : from_vg.by_start) {
+            REQUIRE(from_xg.by_start.at(entry.first) == entry.second);
+            REQUIRE(from_xg.node_length(from_xg.find_position(entry.first)) ==
+                from_vg.node_length(from_vg.find_position(entry.first)));
+        }
+    }
+    
+    SECTION("Shared indexes are only built once while they are held") {
+        auto first = PathIndex::get_shared(xg_index, "cool", true);
+        auto second = PathIndex::get_shared(xg_index, "cool", true);
+        REQUIRE(first.get() == second.get());
+        REQUIRE(first->sequence == from_vg.sequence);
+        
+        // Without the sequence is a different index
+        auto no_sequence = PathIndex::get_shared(xg_index, "cool", false);
+        REQUIRE(no_sequence.get() != first.get());
+        REQUIRE(no_sequence->sequence.empty());
+        REQUIRE(no_sequence->at_position(6).node == 6);
+    }
+}
    
 }
 }
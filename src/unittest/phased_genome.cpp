@@ -1187,6 +1187,166 @@ namespace vg {
                 REQUIRE( genome.optimal_score_on_genome(multipath_aln, graph) == 7 - 4 + 6 );
                 
             }
+            
+            SECTION( "PhasedGenome only rescores tracked multipath alignments on edited alleles") {
+                
+                // construct graph
+                
+                VG graph;
+                
+                Node* n1 = graph.create_node("GCA");
+                Node* n2 = graph.create_node("CTGT");
+                Node* n3 = graph.create_node("G");
+                Node* n4 = graph.create_node("A");
+                Node* n5 = graph.create_node("TTG");
+                Node* n6 = graph.create_node("CGGATA");
+                
+                graph.create_edge(n1, n2);
+                graph.create_edge(n1, n6);
+                graph.create_edge(n2, n3);
+                graph.create_edge(n2, n4);
+                graph.create_edge(n3, n5);
+                graph.create_edge(n4, n5);
+                graph.create_edge(n5, n6);
+                
+                // construct phased genome
+                
+                CactusSnarlFinder bubble_finder(graph);
+                SnarlManager snarl_manager = bubble_finder.find_snarls();
+                
+                PhasedGenome genome = PhasedGenome(snarl_manager);
+                
+                REQUIRE(snarl_manager.top_level_snarls().size() > 0);
+                const Snarl* site = snarl_manager.top_level_snarls()[0];
+                REQUIRE(snarl_manager.children_of(site).size() > 0);
+                const Snarl* subsite = snarl_manager.children_of(site)[0];
+                
+                list<NodeTraversal> haplotype;
+                
+                haplotype.push_back(NodeTraversal(n1));
+                haplotype.push_back(NodeTraversal(n2));
+                haplotype.push_back(NodeTraversal(n3));
+                haplotype.push_back(NodeTraversal(n5));
+                haplotype.push_back(NodeTraversal(n6));
+                
+                genome.add_haplotype(haplotype.begin(), haplotype.end());
+                genome.add_haplotype(haplotype.begin(), haplotype.end());
+                
+                // index sites
+                
+                genome.build_indices();
+                
+                // construct a multipath alignment through the subsite
+                
+                MultipathAlignment multipath_aln;
+                multipath_aln.set_sequence("CACTGTATTGCGGATA");
+                
+                Subpath* subpath0 = multipath_aln.add_subpath();
+                Subpath* subpath1 = multipath_aln.add_subpath();
+                Subpath* subpath2 = multipath_aln.add_subpath();
+                Subpath* subpath3 = multipath_aln.add_subpath();
+                
+                subpath0->add_next(1);
+                subpath0->add_next(2);
+                subpath1->add_next(3);
+                subpath2->add_next(3);
+                
+                Mapping* mapping0 = subpath0->mutable_path()->add_mapping();
+                mapping0->mutable_position()->set_node_id(1);
+                mapping0->mutable_position()->set_offset(1);
+                Edit* edit00 = mapping0->add_edit();
+                edit00->set_from_length(2);
+                edit00->set_to_length(2);
+                
+                Mapping* mapping1 = subpath0->mutable_path()->add_mapping();
+                mapping1->mutable_position()->set_node_id(2);
+                Edit* edit10 = mapping1->add_edit();
+                edit10->set_from_length(4);
+                edit10->set_to_length(4);
+                
+                subpath0->set_score(6);
+                
+                Mapping* mapping2 = subpath1->mutable_path()->add_mapping();
+                mapping2->mutable_position()->set_node_id(3);
+                Edit* edit20 = mapping2->add_edit();
+                edit20->set_from_length(1);
+                edit20->set_to_length(1);
+                edit20->set_sequence("A");
+                
+                subpath1->set_score(-4);
+                
+                Mapping* mapping3 = subpath2->mutable_path()->add_mapping();
+                mapping3->mutable_position()->set_node_id(4);
+                Edit* edit30 = mapping3->add_edit();
+                edit30->set_from_length(1);
+                edit30->set_to_length(1);
+                
+                subpath2->set_score(1);
+                
+                Mapping* mapping4 = subpath3->mutable_path()->add_mapping();
+                mapping4->mutable_position()->set_node_id(5);
+                Edit* edit40 = mapping4->add_edit();
+                edit40->set_from_length(3);
+                edit40->set_to_length(3);
+                
+                Mapping* mapping5 = subpath3->mutable_path()->add_mapping();
+                mapping5->mutable_position()->set_node_id(6);
+                Edit* edit50 = mapping5->add_edit();
+                edit50->set_from_length(6);
+                edit50->set_to_length(6);
+                
+                subpath3->set_score(9);
+                
+                identify_start_subpaths(multipath_aln);
+                
+                // and one that stays outside of it
+                
+                MultipathAlignment other_multipath_aln;
+                other_multipath_aln.set_sequence("GCA");
+                
+                Mapping* other_mapping = other_multipath_aln.add_subpath()->mutable_path()->add_mapping();
+                other_mapping->mutable_position()->set_node_id(1);
+                Edit* other_edit = other_mapping->add_edit();
+                other_edit->set_from_length(3);
+                other_edit->set_to_length(3);
+                
+                other_multipath_aln.mutable_subpath(0)->set_score(3);
+                
+                identify_start_subpaths(other_multipath_aln);
+                
+                size_t read_id = genome.track_read(multipath_aln, graph);
+                size_t other_read_id = genome.track_read(other_multipath_aln, graph);
+                
+                REQUIRE( genome.tracked_read_score(read_id) == 6 - 4 + 9 );
+                REQUIRE( genome.tracked_read_score(other_read_id) == 3 );
+                REQUIRE( genome.total_tracked_score() == 6 - 4 + 9 + 3 );
+                
+                list<NodeTraversal> allele;
+                allele.push_back(NodeTraversal(n4));
+                
+                genome.set_allele(*subsite, allele.begin(), allele.end(), 1);
+                
+                REQUIRE( genome.num_stale_tracked_reads() == 1 );
+                REQUIRE( genome.total_tracked_score() == 6 + 1 + 9 + 3 );
+                REQUIRE( genome.num_stale_tracked_reads() == 0 );
+                
+                genome.swap_alleles(*subsite, 0, 1);
+                
+                REQUIRE( genome.num_stale_tracked_reads() == 1 );
+                REQUIRE( genome.tracked_read_score(read_id) == 6 + 1 + 9 );
+                
+                allele.clear();
+                allele.push_back(NodeTraversal(n3));
+                
+                genome.set_allele(*subsite, allele.begin(), allele.end(), 0);
+                
+                REQUIRE( genome.tracked_read_score(read_id) == genome.optimal_score_on_genome(multipath_aln, graph) );
+                REQUIRE( genome.total_tracked_score() == 6 - 4 + 9 + 3 );
+                
+                genome.clear_tracked_reads();
+                
+                REQUIRE( genome.total_tracked_score() == 0 );
+            }
         }
     }
 }
@@ -0,0 +1,79 @@
+/// \file read_ahead_stream.cpp
+///
+/// Unit tests for read-ahead file input
+///
+
+#include "catch.hpp"
+#include "../read_ahead_stream.hpp"
+#include "../utility.hpp"
+
+#include <fstream>
+#include <iterator>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("ReadAheadFileStream reads and seeks like an ifstream", "[read_ahead]") {
+
+    // Enough for several of the smallest blocks
+    string content;
+    for (size_t i = 0; i < 50000; i++) {
+        content.push_back("GATTACA"[i % 7]);
+    }
+    string filename = temp_file::create();
+    {
+        ofstream out(filename);
+        out << content;
+    }
+
+    // One page blocks, read two ahead
+    ReadAheadFileStream in(filename, 4096, 2);
+    REQUIRE(in.is_open());
+
+    SECTION("The whole file can be read") {
+        string read_back((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        REQUIRE(read_back == content);
+    }
+
+    SECTION("The stream can seek within and between blocks") {
+        char buffer[10];
+        in.seekg(4090);
+        in.read(buffer, 10);
+        REQUIRE(string(buffer, 10) == content.substr(4090, 10));
+        REQUIRE(in.tellg() == 4100);
+
+        in.seekg(30000);
+        in.read(buffer, 10);
+        REQUIRE(string(buffer, 10) == content.substr(30000, 10));
+
+        in.seekg(5);
+        in.read(buffer, 10);
+        REQUIRE(string(buffer, 10) == content.substr(5, 10));
+
+        in.seekg(-3, ios_base::end);
+        in.read(buffer, 10);
+        REQUIRE(in.gcount() == 3);
+        REQUIRE(string(buffer, 3) == content.substr(content.size() - 3));
+    }
+
+    SECTION("Characters can be put back") {
+        char c;
+        in.get(c);
+        REQUIRE(c == 'G');
+        in.unget();
+        in.get(c);
+        REQUIRE(c == 'G');
+    }
+
+    temp_file::remove(filename);
+}
+
+TEST_CASE("ReadAheadFileStream fails like an ifstream on a missing file", "[read_ahead]") {
+    ReadAheadFileStream in("/nonexistent/file/for/read/ahead");
+    REQUIRE(!in.is_open());
+    REQUIRE(!in);
+}
+
+}
+}
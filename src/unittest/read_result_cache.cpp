@@ -0,0 +1,82 @@
+/// \file read_result_cache.cpp
+///
+/// Unit tests for the cache of mapping results for duplicate reads
+///
+
+#include "catch.hpp"
+#include "../read_result_cache.hpp"
+
+#include <omp.h>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("ReadResultCache reuses results for duplicate reads", "[cache][mapping]") {
+
+    SECTION("Repeated reads hit the cache") {
+        ReadResultCache<string> cache(10, 1, 4);
+        string key = cache.key("GATTACA", "", {1, 2});
+        vector<string> results;
+        REQUIRE(!cache.lookup(key, results));
+        cache.store(key, {"first", "second"});
+        REQUIRE(cache.lookup(key, results));
+        REQUIRE(results.size() == 2);
+        REQUIRE(results[0] == "first");
+        REQUIRE(results[1] == "second");
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 1);
+    }
+
+    SECTION("Keys tell apart sequences, qualities and parameters") {
+        ReadResultCache<string> cache(10);
+        string key = cache.key("GATTACA", "IIIIIII", {1});
+        REQUIRE(key == cache.key("GATTACA", "IIIIIII", {1}));
+        REQUIRE(key != cache.key("GATTACT", "IIIIIII", {1}));
+        REQUIRE(key != cache.key("GATTACA", "IIIIIIH", {1}));
+        REQUIRE(key != cache.key("GATTACA", "", {1}));
+        REQUIRE(key != cache.key("GATTACA", "IIIIIII", {2}));
+    }
+
+    SECTION("Qualities in the same bin are equal") {
+        ReadResultCache<string> cache(10, 10);
+        // 'H' and 'I' are 72 and 73, 'P' is 80
+        REQUIRE(cache.key("GATTACA", "IIIIIII", {}) == cache.key("GATTACA", "IIIIIIH", {}));
+        REQUIRE(cache.key("GATTACA", "IIIIIII", {}) != cache.key("GATTACA", "IIIIIIP", {}));
+    }
+
+    SECTION("Least recently used results are evicted") {
+        // One shard holding one read
+        ReadResultCache<string> cache(1, 1, 1);
+        string first = cache.key("GATTACA", "", {});
+        string second = cache.key("CATTAG", "", {});
+        vector<string> results;
+        cache.store(first, {"first"});
+        cache.store(second, {"second"});
+        REQUIRE(!cache.lookup(first, results));
+        REQUIRE(cache.lookup(second, results));
+        REQUIRE(results.size() == 1);
+        REQUIRE(results[0] == "second");
+    }
+
+    SECTION("Concurrent lookups find what was stored") {
+        ReadResultCache<string> cache(4, 1, 2);
+        bool all_match = true;
+#pragma omp parallel for reduction(&&:all_match)
+        for (size_t i = 0; i < 1000; i++) {
+            string sequence(i % 4 + 1, 'A');
+            string key = cache.key(sequence, "", {});
+            vector<string> results;
+            if (!cache.lookup(key, results)) {
+                cache.store(key, {sequence});
+            } else {
+                all_match = all_match && results.size() == 1 && results[0] == sequence;
+            }
+        }
+        REQUIRE(all_match);
+        REQUIRE(cache.hits() + cache.misses() == 1000);
+    }
+}
+
+}
+}
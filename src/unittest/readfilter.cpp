@@ -271,5 +271,71 @@ TEST_CASE("reads with ambiguous ends can be trimmed", "[filter]") {
 }
 
 
+TEST_CASE("repeat detection matches the original substring comparisons", "[filter]") {
+    
+    // The repeat check as it was first written, one substring at a time
+    auto substring_has_repeat = [](const string& s, int k) {
+        if (k == 0) {
+            return false;
+        }
+        for (int i = 1; i <= 2 * k; ++i) {
+            int covered = 0;
+            bool ffound = true;
+            bool bfound = true;
+            for (int j = 1; (ffound || bfound) && (j + 1) * i < s.length(); ++j) {
+                ffound = ffound && s.substr(0, i) == s.substr(j * i, i);
+                bfound = bfound && s.substr(s.length() - i, i) == s.substr(s.length() - i - j * i, i);
+                if (ffound || bfound) {
+                    covered += i;
+                }
+            }
+            if (covered >= k) {
+                return true;
+            }
+        }
+        return false;
+    };
+    
+    ReadFilter filter;
+    
+    SECTION("Obvious repeats and non-repeats are called") {
+        Alignment aln;
+        aln.set_sequence("CACACACACACACACAGATTACAGTTG");
+        REQUIRE(filter.has_repeat(aln, 8));
+        aln.set_sequence("GATTACAGTTGCCAGTAGGTTACACACACACACACACA");
+        REQUIRE(filter.has_repeat(aln, 8));
+        aln.set_sequence("GATTACAGTTGCCAGTAGGTTGCATTGAC");
+        REQUIRE(!filter.has_repeat(aln, 8));
+        REQUIRE(!filter.has_repeat(aln, 0));
+    }
+    
+    SECTION("Random low-complexity reads get the same answers") {
+        // Mostly repeat a short random unit, with some noise, so there are
+        // plenty of periodic runs long enough to span whole words
+        uint64_t state = 1;
+        auto next_random = [&]() {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return state >> 33;
+        };
+        for (size_t trial = 0; trial < 2000; trial++) {
+            size_t length = next_random() % 60;
+            const string alphabet = (trial % 2) ? "AC" : "ACGT";
+            string unit;
+            for (size_t i = 0, unit_length = 1 + next_random() % 5; i < unit_length; i++) {
+                unit.push_back(alphabet[next_random() % alphabet.size()]);
+            }
+            string sequence;
+            for (size_t i = 0; i < length; i++) {
+                sequence.push_back(next_random() % 10 < 8 ? unit[i % unit.size()] : alphabet[next_random() % alphabet.size()]);
+            }
+            Alignment aln;
+            aln.set_sequence(sequence);
+            for (int k : {0, 1, 2, 3, 5, 8, 13}) {
+                REQUIRE(filter.has_repeat(aln, k) == substring_has_repeat(sequence, k));
+            }
+        }
+    }
+}
+
 }
 }
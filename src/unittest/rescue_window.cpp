@@ -0,0 +1,95 @@
+/// \file rescue_window.cpp
+///
+/// Unit tests for pair rescue windows and their cache
+///
+
+#include "catch.hpp"
+#include "../rescue_window.hpp"
+#include "../json2pb.h"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("RescueWindow finds k-mers across nodes and strands", "[rescue][mapping]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"A"},
+    {"id":3,"sequence":"CA"},
+    {"id":4,"sequence":"TTTG"}],
+    "edge":[{"from":1,"to":2},{"from":1,"to":3},{"from":2,"to":4},{"from":3,"to":4}]}
+    )";
+
+    RescueWindow window;
+    json2pb(window.graph, graph_json.c_str(), graph_json.size());
+
+    SECTION("Windows that aren't indexed could align anything") {
+        REQUIRE(window.may_align("CCCCCCCC"));
+    }
+
+    SECTION("K-mers spanning nodes are indexed") {
+        window.index_kmers(4, 1000);
+        REQUIRE(window.kmers_complete);
+        // GATT|A|TTTG
+        REQUIRE(window.may_align("CCCTTATCCC"));
+        // GATT|CA|TTTG
+        REQUIRE(window.may_align("CCTCATCC"));
+        REQUIRE(!window.may_align("CCCCCCCC"));
+    }
+
+    SECTION("K-mers on the reverse strand are indexed") {
+        window.index_kmers(4, 1000);
+        // Reverse complement of TTTG
+        REQUIRE(window.may_align("CAAA"));
+    }
+
+    SECTION("Sequences shorter than the k-mers could align") {
+        window.index_kmers(4, 1000);
+        REQUIRE(window.may_align("CCC"));
+    }
+
+    SECTION("Indexing gives up when it takes too many steps") {
+        window.index_kmers(4, 5);
+        REQUIRE(!window.kmers_complete);
+        REQUIRE(window.may_align("CCCCCCCC"));
+    }
+}
+
+TEST_CASE("RescueWindowCache reuses windows", "[rescue][mapping]") {
+
+    size_t made = 0;
+    auto make_window = [&](void) {
+        made++;
+        return make_shared<RescueWindow>();
+    };
+    bool was_cached = false;
+
+    SECTION("Windows around the same nodes are shared") {
+        RescueWindowCache cache(4);
+        auto first = cache.get({1, 2}, 100, make_window, was_cached);
+        REQUIRE(!was_cached);
+        auto second = cache.get({2, 1, 2}, 100, make_window, was_cached);
+        REQUIRE(was_cached);
+        REQUIRE(first == second);
+        cache.get({1, 2}, 200, make_window, was_cached);
+        REQUIRE(!was_cached);
+        REQUIRE(made == 2);
+    }
+
+    SECTION("Least recently used windows are evicted") {
+        RescueWindowCache cache(2);
+        cache.get({1}, 100, make_window, was_cached);
+        cache.get({2}, 100, make_window, was_cached);
+        cache.get({1}, 100, make_window, was_cached);
+        cache.get({3}, 100, make_window, was_cached);
+        cache.get({1}, 100, make_window, was_cached);
+        REQUIRE(was_cached);
+        cache.get({2}, 100, make_window, was_cached);
+        REQUIRE(!was_cached);
+        REQUIRE(made == 4);
+    }
+}
+
+}
+}
@@ -293,6 +293,53 @@ TEST_CASE( "Sampler can across reversing edges", "[sampler]" ) {
     }
 }
 
+TEST_CASE( "Sampler streams are reproducible on any copy", "[sampler]" ) {
+    
+    string graph_json = R"({
+        "node": [{"id": 1, "sequence": "GATTACA"}, {"id": 2, "sequence": "CAT"}, {"id": 3, "sequence": "TAGGA"}],
+        "edge": [{"from": 1, "to": 2}, {"from": 2, "to": 3}]
+    })";
+    
+    // Load the JSON
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    
+    // Build the xg index
+    xg::XG xg_index(proto_graph);
+    
+    Sampler sampler(&xg_index, 1337);
+    Sampler copy = sampler;
+    
+    // Use up some random numbers in the original
+    for (size_t i = 0; i < 10; i++) {
+        sampler.alignment(5);
+    }
+    
+    // Stream 3 should give the same reads on both
+    sampler.set_stream(3, 3000);
+    copy.set_stream(3, 3000);
+    vector<string> reads;
+    for (size_t i = 0; i < 20; i++) {
+        Alignment aln = sampler.alignment_with_error(5, 0.1, 0.05);
+        Alignment copy_aln = copy.alignment_with_error(5, 0.1, 0.05);
+        REQUIRE(pb2json(aln) == pb2json(copy_aln));
+        reads.push_back(aln.sequence());
+    }
+    
+    // A different stream should give different reads
+    copy.set_stream(4, 4000);
+    vector<string> other_reads;
+    for (size_t i = 0; i < 20; i++) {
+        other_reads.push_back(copy.alignment_with_error(5, 0.1, 0.05).sequence());
+    }
+    REQUIRE(reads != other_reads);
+    
+    // And stream seeds should differ by seed and by stream
+    REQUIRE(split_seed(1, 0) != split_seed(1, 1));
+    REQUIRE(split_seed(1, 0) != split_seed(2, 0));
+    REQUIRE(split_seed(1, 0) == split_seed(1, 0));
+}
+
 }
 
 }
@@ -0,0 +1,73 @@
+/// \file shared_node_cache.cpp
+///
+/// Unit tests for the thread-shared node sequence cache
+///
+
+#include "catch.hpp"
+#include "../shared_node_cache.hpp"
+#include "../cached_position.hpp"
+#include "../json2pb.h"
+
+#include <omp.h>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("SharedNodeCache caches node sequences across threads", "[cache]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"A"},
+    {"id":3,"sequence":"CA"},
+    {"id":4,"sequence":"TTTG"}],
+    "edge":[{"from":1,"to":2},{"from":1,"to":3},{"from":2,"to":4},{"from":3,"to":4}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    SECTION("Repeated lookups hit the cache") {
+        SharedNodeCache cache(10, 4);
+        REQUIRE(*cache.get_sequence(1, &xg_index) == "GATT");
+        REQUIRE(*cache.get_sequence(1, &xg_index) == "GATT");
+        REQUIRE(cache.hits() == 1);
+        REQUIRE(cache.misses() == 1);
+    }
+
+    SECTION("Least recently used entries are evicted") {
+        // One shard holding one node
+        SharedNodeCache cache(1, 1);
+        auto held = cache.get_sequence(1, &xg_index);
+        cache.get_sequence(2, &xg_index);
+        cache.get_sequence(1, &xg_index);
+        REQUIRE(cache.misses() == 3);
+        // Evicted sequences we still hold stay valid
+        REQUIRE(*held == "GATT");
+    }
+
+    SECTION("Concurrent lookups agree with the index") {
+        SharedNodeCache cache(2, 2);
+        bool all_match = true;
+#pragma omp parallel for reduction(&&:all_match)
+        for (size_t i = 0; i < 1000; i++) {
+            id_t id = i % 4 + 1;
+            all_match = all_match && (*cache.get_sequence(id, &xg_index) == xg_index.node_sequence(id));
+        }
+        REQUIRE(all_match);
+        REQUIRE(cache.hits() + cache.misses() == 1000);
+    }
+
+    SECTION("Cached position helpers read through the shared cache") {
+        SharedNodeCache cache(10);
+        REQUIRE(xg_cached_node_length(4, &xg_index, cache) == 4);
+        REQUIRE(xg_cached_pos_char(make_pos_t(3, true, 0), &xg_index, cache) == 'T');
+        REQUIRE(xg_cached_next_pos_chars(make_pos_t(1, false, 3), &xg_index, cache).size() == 2);
+        // Nodes 4, 3, 1 and 2 were loaded once each
+        REQUIRE(cache.misses() == 4);
+    }
+}
+
+}
+}
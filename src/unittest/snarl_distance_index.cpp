@@ -0,0 +1,159 @@
+/// \file snarl_distance_index.cpp
+///
+/// Unit tests for the snarl tree minimum distance index
+///
+
+#include "catch.hpp"
+#include "../snarl_distance_index.hpp"
+#include "../vg.hpp"
+#include "../xg.hpp"
+#include "../xg_position.hpp"
+#include "../utility.hpp"
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+/// Check the index against searching the graph from every position to every
+/// other, and return how many queries it couldn't answer
+static size_t check_all_distances(const SnarlDistanceIndex& index, xg::XG& xg_index) {
+    vector<pos_t> positions;
+    xg_index.for_each_handle([&](const handle_t& handle) {
+        for (bool is_reverse : {false, true}) {
+            for (size_t i = 0; i < xg_index.get_length(handle); i++) {
+                positions.push_back(make_pos_t(xg_index.get_id(handle), is_reverse, i));
+            }
+        }
+    });
+
+    size_t unknown = 0;
+    for (const pos_t& pos1 : positions) {
+        for (const pos_t& pos2 : positions) {
+            int64_t distance = index.min_distance(pos1, pos2);
+            if (distance == SnarlDistanceIndex::UNKNOWN) {
+                unknown++;
+                continue;
+            }
+            REQUIRE(distance == xg_distance(pos1, pos2, 1000, &xg_index));
+        }
+    }
+    return unknown;
+}
+
+TEST_CASE("SnarlDistanceIndex gives the same distances as searching the graph", "[snarls][snarl_distance_index]") {
+
+    // Nested bubbles between 1 and 8, with a chain of two inside the first
+    VG graph;
+
+    Node* n1 = graph.create_node("GCA");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("G");
+    Node* n4 = graph.create_node("CTGA");
+    Node* n5 = graph.create_node("GCA");
+    Node* n6 = graph.create_node("T");
+    Node* n7 = graph.create_node("G");
+    Node* n8 = graph.create_node("CTGA");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n8);
+    graph.create_edge(n2, n3);
+    graph.create_edge(n2, n6);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n3, n5);
+    graph.create_edge(n4, n5);
+    graph.create_edge(n5, n7);
+    graph.create_edge(n6, n7);
+    graph.create_edge(n7, n8);
+
+    SECTION("Every distance in an acyclic graph is answered") {
+        SnarlManager snarl_manager = CactusSnarlFinder(graph).find_snarls();
+        xg::XG xg_index(graph.graph);
+        SnarlDistanceIndex index(xg_index, snarl_manager);
+
+        REQUIRE(check_all_distances(index, xg_index) == 0);
+
+        // Around the inner bubble rather than through the 4 bp node
+        REQUIRE(index.min_distance(make_pos_t(n3->id(), false, 0), make_pos_t(n5->id(), false, 0)) == 1);
+        // Skipping the whole top-level bubble
+        REQUIRE(index.min_distance(make_pos_t(n1->id(), false, 1), make_pos_t(n8->id(), false, 2)) == 4);
+        // Nothing leads back from the end
+        REQUIRE(index.min_distance(make_pos_t(n8->id(), false, 0), make_pos_t(n1->id(), false, 0)) ==
+                numeric_limits<int64_t>::max());
+    }
+
+    SECTION("Distances through reversing edges and cycles are right") {
+        // An inversion of 6, and a way back from 4 to 3
+        graph.create_edge(n2, n6, false, true);
+        graph.create_edge(n6, n7, true, false);
+        graph.create_edge(n4, n3);
+
+        SnarlManager snarl_manager = CactusSnarlFinder(graph).find_snarls();
+        xg::XG xg_index(graph.graph);
+        SnarlDistanceIndex index(xg_index, snarl_manager);
+
+        check_all_distances(index, xg_index);
+    }
+
+    SECTION("Nodes that aren't indexed are unknown") {
+        SnarlManager snarl_manager = CactusSnarlFinder(graph).find_snarls();
+        xg::XG xg_index(graph.graph);
+        SnarlDistanceIndex index(xg_index, snarl_manager);
+
+        REQUIRE(index.min_distance(make_pos_t(n1->id(), false, 0), make_pos_t(100, false, 0)) ==
+                SnarlDistanceIndex::UNKNOWN);
+        REQUIRE(index.min_distance(make_pos_t(100, false, 0), make_pos_t(n1->id(), false, 0)) ==
+                SnarlDistanceIndex::UNKNOWN);
+    }
+}
+
+TEST_CASE("SnarlDistanceIndex can be saved and loaded", "[snarls][snarl_distance_index]") {
+
+    VG graph;
+
+    Node* n1 = graph.create_node("GCA");
+    Node* n2 = graph.create_node("T");
+    Node* n3 = graph.create_node("GG");
+    Node* n4 = graph.create_node("CTGA");
+
+    graph.create_edge(n1, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n4);
+    graph.create_edge(n3, n4);
+    graph.create_edge(n3, n3, false, true);
+
+    SnarlManager snarl_manager = CactusSnarlFinder(graph).find_snarls();
+    xg::XG xg_index(graph.graph);
+    SnarlDistanceIndex built(xg_index, snarl_manager);
+
+    SECTION("Through a stream") {
+        stringstream serialized;
+        built.serialize(serialized);
+        SnarlDistanceIndex loaded(serialized);
+
+        check_all_distances(loaded, xg_index);
+    }
+
+    SECTION("Through a file") {
+        string filename = temp_file::create();
+        {
+            ofstream out(filename, ios_base::out | ios_base::binary);
+            built.serialize(out);
+        }
+        SnarlDistanceIndex loaded(filename);
+
+        check_all_distances(loaded, xg_index);
+        temp_file::remove(filename);
+    }
+
+    SECTION("Not from something else") {
+        stringstream garbage("GATTACAGATTACAGATTACA");
+        REQUIRE_THROWS(SnarlDistanceIndex(garbage));
+    }
+}
+
+}
+}
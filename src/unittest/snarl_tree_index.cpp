@@ -0,0 +1,111 @@
+/// \file snarl_tree_index.cpp
+///
+/// Unit tests for the compact snarl tree index
+///
+
+#include "catch.hpp"
+#include "../snarl_tree_index.hpp"
+
+#include <sstream>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("SnarlTreeIndex answers the same queries as SnarlManager", "[snarls][snarl_tree_index]") {
+
+    // snarl1 and snarl2 are a top-level chain, and snarl3 and snarl4 are
+    // trivial chains inside snarl1.
+    Snarl snarl1;
+    snarl1.mutable_start()->set_node_id(1);
+    snarl1.mutable_end()->set_node_id(6);
+    snarl1.set_type(ULTRABUBBLE);
+
+    Snarl snarl2;
+    snarl2.mutable_start()->set_node_id(6);
+    snarl2.mutable_end()->set_node_id(7);
+    snarl2.mutable_end()->set_backward(true);
+
+    Snarl snarl3;
+    snarl3.mutable_start()->set_node_id(2);
+    snarl3.mutable_end()->set_node_id(3);
+    transfer_boundary_info(snarl1, *snarl3.mutable_parent());
+
+    Snarl snarl4;
+    snarl4.mutable_start()->set_node_id(4);
+    snarl4.mutable_end()->set_node_id(5);
+    transfer_boundary_info(snarl1, *snarl4.mutable_parent());
+
+    SnarlManager snarl_manager;
+    auto ptr3 = snarl_manager.add_snarl(snarl3);
+    auto ptr4 = snarl_manager.add_snarl(snarl4);
+    auto ptr1 = snarl_manager.add_snarl(snarl1);
+    snarl_manager.add_chain(Chain{ptr3}, ptr1);
+    snarl_manager.add_chain(Chain{ptr4}, ptr1);
+    auto ptr2 = snarl_manager.add_snarl(snarl2);
+    snarl_manager.add_chain(Chain{ptr1, ptr2}, nullptr);
+
+    SnarlTreeIndex built(snarl_manager);
+
+    // Round trip through the serialized form too
+    stringstream serialized;
+    built.serialize(serialized);
+    SnarlTreeIndex loaded(serialized);
+
+    for (SnarlTreeIndex* index : {&built, &loaded}) {
+        REQUIRE(index->snarl_count() == 4);
+        REQUIRE(index->chain_count() == 3);
+
+        // Snarls are in preorder
+        REQUIRE(index->child_count(SnarlTreeIndex::NONE) == 2);
+        size_t rank1 = index->child(SnarlTreeIndex::NONE, 0);
+        size_t rank2 = index->child(SnarlTreeIndex::NONE, 1);
+        REQUIRE(rank1 == 0);
+        REQUIRE(rank2 == 3);
+        REQUIRE(index->start(rank1) == make_pair((id_t) 1, false));
+        REQUIRE(index->end(rank1) == make_pair((id_t) 6, false));
+        REQUIRE(index->end(rank2) == make_pair((id_t) 7, true));
+        REQUIRE(index->type(rank1) == ULTRABUBBLE);
+
+        REQUIRE(index->child_count(rank1) == 2);
+        REQUIRE(index->child_count(rank2) == 0);
+        size_t rank3 = index->child(rank1, 0);
+        REQUIRE(index->start(rank3) == make_pair((id_t) 2, false));
+        REQUIRE(index->parent(rank3) == rank1);
+        REQUIRE(index->parent(rank1) == SnarlTreeIndex::NONE);
+        REQUIRE(!index->in_nontrivial_chain(rank3));
+
+        // The top-level chain has both top-level snarls
+        auto top_chains = index->chains_of(SnarlTreeIndex::NONE);
+        REQUIRE(top_chains.second - top_chains.first == 1);
+        REQUIRE(index->chain_of(rank1) == top_chains.first);
+        REQUIRE(index->chain_of(rank2) == top_chains.first);
+        REQUIRE(index->chain_size(top_chains.first) == 2);
+        REQUIRE(index->chain_member(top_chains.first, 1) == rank2);
+        REQUIRE(index->in_nontrivial_chain(rank1));
+        auto child_chains = index->chains_of(rank1);
+        REQUIRE(child_chains.second - child_chains.first == 2);
+
+        // Boundaries point into snarls, with ends reversed
+        REQUIRE(index->into_which_snarl(1, false) == rank1);
+        REQUIRE(index->into_which_snarl(6, true) == rank1);
+        REQUIRE(index->into_which_snarl(6, false) == rank2);
+        REQUIRE(index->into_which_snarl(7, false) == rank2);
+        REQUIRE(index->into_which_snarl(5, false) == SnarlTreeIndex::NONE);
+        REQUIRE(index->into_which_snarl(10, false) == SnarlTreeIndex::NONE);
+
+        Snarl rebuilt = index->to_snarl(rank3);
+        REQUIRE(rebuilt.start().node_id() == 2);
+        REQUIRE(rebuilt.end().node_id() == 3);
+        REQUIRE(rebuilt.parent().start().node_id() == 1);
+        REQUIRE(rebuilt.parent().end().node_id() == 6);
+    }
+}
+
+TEST_CASE("SnarlTreeIndex rejects data that isn't an index", "[snarls][snarl_tree_index]") {
+    stringstream garbage("not a snarl tree");
+    REQUIRE_THROWS(SnarlTreeIndex{garbage});
+}
+
+}
+}
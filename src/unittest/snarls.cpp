@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <set>
+#include <omp.h>
 #include "json2pb.h"
 #include "vg.pb.h"
 #include "catch.hpp"
@@ -1833,6 +1834,190 @@ namespace vg {
                 
         }
 
+        TEST_CASE("snarls can be found without Cactus", "[snarls][integrated-snarl-finder]") {
+    
+            // Build the same toy graph as above, without the path
+            const string graph_json = R"(
+            
+            {
+                "node": [
+                    {"id": 1, "sequence": "G"},
+                    {"id": 2, "sequence": "A"},
+                    {"id": 3, "sequence": "T"},
+                    {"id": 4, "sequence": "GGG"},
+                    {"id": 5, "sequence": "T"},
+                    {"id": 6, "sequence": "A"},
+                    {"id": 7, "sequence": "C"},
+                    {"id": 8, "sequence": "A"},
+                    {"id": 9, "sequence": "A"}
+                ],
+                "edge": [
+                    {"from": 1, "to": 2},
+                    {"from": 1, "to": 6},
+                    {"from": 2, "to": 3},
+                    {"from": 2, "to": 4},
+                    {"from": 3, "to": 5},
+                    {"from": 4, "to": 5},
+                    {"from": 5, "to": 6},
+                    {"from": 6, "to": 7},
+                    {"from": 6, "to": 8},
+                    {"from": 7, "to": 9},
+                    {"from": 8, "to": 9}
+                ]
+            }
+            
+            )";
+            
+            VG graph;
+            Graph chunk;
+            json2pb(chunk, graph_json.c_str(), graph_json.size());
+            graph.extend(chunk);
+            
+            SnarlManager snarl_manager = IntegratedSnarlFinder(graph).find_snarls();
+            
+            SECTION("There are 2 top level snarls in one chain") {
+                REQUIRE(snarl_manager.top_level_snarls().size() == 2);
+                
+                const Snarl* child1 = snarl_manager.top_level_snarls()[0];
+                const Snarl* child2 = snarl_manager.top_level_snarls()[1];
+                
+                if (child1->start().node_id() > child2->start().node_id()) {
+                    swap(child1, child2);
+                }
+                
+                REQUIRE(snarl_manager.in_nontrivial_chain(child1));
+                REQUIRE(snarl_manager.chain_of(child1) == snarl_manager.chain_of(child2));
+                
+                SECTION("First child is an ultrabubble from 1 end to 6 start") {
+                    REQUIRE(child1->start().node_id() == 1);
+                    REQUIRE(child1->start().backward() == false);
+                    REQUIRE(child1->end().node_id() == 6);
+                    REQUIRE(child1->end().backward() == false);
+                    REQUIRE(child1->type() == ULTRABUBBLE);
+                    
+                    SECTION("First child has a child from 2 end to 5 start") {
+                        REQUIRE(snarl_manager.children_of(child1).size() == 1);
+                        
+                        const Snarl* subchild = snarl_manager.children_of(child1)[0];
+                        
+                        REQUIRE(subchild->start().node_id() == 2);
+                        REQUIRE(subchild->start().backward() == false);
+                        REQUIRE(subchild->end().node_id() == 5);
+                        REQUIRE(subchild->end().backward() == false);
+                        REQUIRE(snarl_manager.parent_of(subchild) == child1);
+                        REQUIRE(snarl_manager.children_of(subchild).size() == 0);
+                    }
+                }
+                
+                SECTION("Second child is from 6 end to 9 start") {
+                    REQUIRE(child2->start().node_id() == 6);
+                    REQUIRE(child2->start().backward() == false);
+                    REQUIRE(child2->end().node_id() == 9);
+                    REQUIRE(child2->end().backward() == false);
+                    REQUIRE(snarl_manager.children_of(child2).size() == 0);
+                }
+            }
+        }
+
+        TEST_CASE("Cactus finds the same snarls one component at a time", "[snarls]") {
+    
+            // Two copies of the toy graph above, with a path on each
+            const string graph_json = R"(
+            
+            {
+                "node": [
+                    {"id": 1, "sequence": "G"},
+                    {"id": 2, "sequence": "A"},
+                    {"id": 3, "sequence": "T"},
+                    {"id": 4, "sequence": "GGG"},
+                    {"id": 5, "sequence": "T"},
+                    {"id": 6, "sequence": "A"},
+                    {"id": 7, "sequence": "C"},
+                    {"id": 8, "sequence": "A"},
+                    {"id": 9, "sequence": "A"},
+                    {"id": 11, "sequence": "G"},
+                    {"id": 12, "sequence": "A"},
+                    {"id": 13, "sequence": "T"},
+                    {"id": 14, "sequence": "GGG"},
+                    {"id": 15, "sequence": "T"},
+                    {"id": 16, "sequence": "A"},
+                    {"id": 17, "sequence": "C"},
+                    {"id": 18, "sequence": "A"},
+                    {"id": 19, "sequence": "A"}
+                ],
+                "edge": [
+                    {"from": 1, "to": 2},
+                    {"from": 1, "to": 6},
+                    {"from": 2, "to": 3},
+                    {"from": 2, "to": 4},
+                    {"from": 3, "to": 5},
+                    {"from": 4, "to": 5},
+                    {"from": 5, "to": 6},
+                    {"from": 6, "to": 7},
+                    {"from": 6, "to": 8},
+                    {"from": 7, "to": 9},
+                    {"from": 8, "to": 9},
+                    {"from": 11, "to": 12},
+                    {"from": 11, "to": 16},
+                    {"from": 12, "to": 13},
+                    {"from": 12, "to": 14},
+                    {"from": 13, "to": 15},
+                    {"from": 14, "to": 15},
+                    {"from": 15, "to": 16},
+                    {"from": 16, "to": 17},
+                    {"from": 16, "to": 18},
+                    {"from": 17, "to": 19},
+                    {"from": 18, "to": 19}
+                ],
+                "path": [
+                    {"name": "hint", "mapping": [
+                        {"position": {"node_id": 1}, "rank" : 1 },
+                        {"position": {"node_id": 6}, "rank" : 2 },
+                        {"position": {"node_id": 8}, "rank" : 3 },
+                        {"position": {"node_id": 9}, "rank" : 4 }
+                    ]},
+                    {"name": "other", "mapping": [
+                        {"position": {"node_id": 11}, "rank" : 1 },
+                        {"position": {"node_id": 12}, "rank" : 2 },
+                        {"position": {"node_id": 14}, "rank" : 3 },
+                        {"position": {"node_id": 15}, "rank" : 4 },
+                        {"position": {"node_id": 16}, "rank" : 5 },
+                        {"position": {"node_id": 17}, "rank" : 6 },
+                        {"position": {"node_id": 19}, "rank" : 7 }
+                    ]}
+                ]
+            }
+            
+            )";
+            
+            VG graph;
+            Graph chunk;
+            json2pb(chunk, graph_json.c_str(), graph_json.size());
+            graph.extend(chunk);
+            
+            // Describe each snarl by its boundaries and its parent's
+            auto describe = [](const SnarlManager& snarl_manager) {
+                vector<string> snarls;
+                snarl_manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+                    const Snarl* parent = snarl_manager.parent_of(snarl);
+                    snarls.push_back(pb2json(snarl->start()) + pb2json(snarl->end()) + to_string(snarl->type()) +
+                                     (parent ? pb2json(parent->start()) : string()));
+                });
+                sort(snarls.begin(), snarls.end());
+                return snarls;
+            };
+            
+            int thread_count = get_thread_count();
+            omp_set_num_threads(1);
+            vector<string> whole = describe(CactusSnarlFinder(graph, "hint").find_snarls());
+            omp_set_num_threads(2);
+            vector<string> by_component = describe(CactusSnarlFinder(graph, "hint").find_snarls());
+            omp_set_num_threads(thread_count);
+            
+            REQUIRE(whole.size() == 6);
+            REQUIRE(by_component == whole);
+        }
+        
         TEST_CASE("bubbles can be found in graphs with only heads", "[bubbles]") {
             
             // Build a toy graph
@@ -3034,5 +3219,83 @@ namespace vg {
              }
         } 
         
+        TEST_CASE( "SnarlManager net graphs use the chain connectivity it keeps",
+                  "[snarls][netgraph][snarlmanager]" ) {
+        
+            // A snarl from 1 to 8 holding a snarl from 2 to 7 that you can
+            // leave back out of its start, because of a reversing edge on 3
+            VG graph;
+                
+            Node* n1 = graph.create_node("GCA");
+            Node* n2 = graph.create_node("T");
+            Node* n3 = graph.create_node("G");
+            Node* n4 = graph.create_node("CTGA");
+            Node* n5 = graph.create_node("GCA");
+            Node* n6 = graph.create_node("T");
+            Node* n7 = graph.create_node("G");
+            Node* n8 = graph.create_node("CTGA");
+            
+            graph.create_edge(n1, n2);
+            graph.create_edge(n1, n8);
+            graph.create_edge(n2, n3);
+            graph.create_edge(n2, n6);
+            graph.create_edge(n3, n4);
+            graph.create_edge(n3, n3, false, true);
+            graph.create_edge(n3, n5);
+            graph.create_edge(n4, n5);
+            graph.create_edge(n5, n7);
+            graph.create_edge(n6, n7);
+            graph.create_edge(n7, n8);
+            
+            Snarl top_snarl;
+            top_snarl.mutable_start()->set_node_id(n1->id());
+            top_snarl.mutable_end()->set_node_id(n8->id());
+            top_snarl.set_type(UNCLASSIFIED);
+            top_snarl.set_start_end_reachable(true);
+            
+            Snarl nested_snarl;
+            nested_snarl.mutable_start()->set_node_id(n2->id());
+            nested_snarl.mutable_end()->set_node_id(n7->id());
+            nested_snarl.set_type(UNCLASSIFIED);
+            *nested_snarl.mutable_parent() = top_snarl;
+            nested_snarl.set_start_self_reachable(true);
+            nested_snarl.set_end_self_reachable(false);
+            nested_snarl.set_start_end_reachable(true);
+            
+            SnarlManager snarl_manager;
+            const Snarl* nested_ptr = snarl_manager.add_snarl(nested_snarl);
+            const Snarl* top_ptr = snarl_manager.add_snarl(top_snarl);
+            snarl_manager.add_chain(Chain{nested_ptr}, top_ptr);
+            snarl_manager.add_chain(Chain{top_ptr}, nullptr);
+            
+            SECTION( "The connectivity of each chain is kept" ) {
+                const Chain& child_chain = snarl_manager.chains_of(top_ptr).front();
+                REQUIRE(snarl_manager.chain_connectivity(&child_chain) == make_tuple(true, false, true));
+                REQUIRE(snarl_manager.chain_connectivity(&child_chain) == get_chain_connectivity(child_chain));
+            }
+            
+            SECTION( "The managed net graph has the same edges as one built directly" ) {
+                NetGraph managed = snarl_manager.net_graph_of(top_ptr, &graph, true);
+                NetGraph direct(top_ptr->start(), top_ptr->end(), snarl_manager.chains_of(top_ptr), &graph, true);
+                
+                for (NetGraph* net_graph : {&managed, &direct}) {
+                    unordered_set<pair<handle_t, handle_t>> edges;
+                    for (auto& id : {1, 2, 8}) {
+                        handle_t handle = net_graph->get_handle(id, false);
+                        net_graph->follow_edges(handle, false, [&](const handle_t& other) {
+                            edges.insert(net_graph->edge_handle(handle, other));
+                        });
+                        net_graph->follow_edges(handle, true, [&](const handle_t& other) {
+                            edges.insert(net_graph->edge_handle(other, handle));
+                        });
+                    }
+                    
+                    // Including the one that turns around in the child
+                    REQUIRE(edges.size() == 4);
+                    REQUIRE(edges.count(net_graph->edge_handle(net_graph->get_handle(1, false),
+                                                               net_graph->get_handle(2, true))) == 1);
+                }
+            }
+        }
     }
 }
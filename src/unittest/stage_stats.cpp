@@ -0,0 +1,80 @@
+/// \file stage_stats.cpp
+///
+/// Unit tests for the mapping stage timers
+///
+
+#include "catch.hpp"
+#include "../stage_stats.hpp"
+
+#include <sstream>
+#include <string>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("StageStats adds up time and calls for each stage", "[mapping][stagestats]") {
+
+    StageStats stats(4);
+    
+    SECTION("Recorded entries are totalled by stage") {
+        stats.record(StageStats::CLUSTER, chrono::milliseconds(3));
+        stats.record(StageStats::CLUSTER, chrono::milliseconds(2));
+        stats.record(StageStats::MAPQ, chrono::microseconds(10));
+        
+        REQUIRE(stats.calls(StageStats::CLUSTER) == 2);
+        REQUIRE(stats.calls(StageStats::MAPQ) == 1);
+        REQUIRE(stats.calls(StageStats::MEMS) == 0);
+        REQUIRE(stats.seconds(StageStats::CLUSTER) == Approx(0.005));
+        REQUIRE(stats.seconds(StageStats::MAPQ) == Approx(0.00001));
+    }
+    
+    SECTION("Timers record one entry when they go out of scope") {
+        {
+            StageStats::Timer timer(&stats, StageStats::ALIGN);
+            REQUIRE(stats.calls(StageStats::ALIGN) == 0);
+        }
+        REQUIRE(stats.calls(StageStats::ALIGN) == 1);
+        
+        // A timer without totals does nothing
+        StageStats::Timer unused(nullptr, StageStats::ALIGN);
+    }
+    
+    SECTION("Reports have a line for every stage") {
+        stats.record(StageStats::RESCUE, chrono::seconds(1));
+        
+        stringstream report;
+        stats.report(report, "[test] ");
+        
+        string line;
+        size_t lines = 0;
+        bool found_rescue = false;
+        while (getline(report, line)) {
+            REQUIRE(line.substr(0, 7) == "[test] ");
+            if (line.substr(7, 7) == "rescue\t") {
+                REQUIRE(line == "[test] rescue\t1\t1.000\t1000000.000");
+                found_rescue = true;
+            }
+            lines++;
+        }
+        REQUIRE(lines == StageStats::NUM_STAGES + 1 + StageStats::NUM_EVENTS + 1);
+        REQUIRE(found_rescue);
+    }
+    
+    SECTION("Events are counted apart from stages") {
+        stats.count(StageStats::CLUSTERS_ALIGNED);
+        stats.count(StageStats::CLUSTERS_PRUNED, 3);
+        stats.count(StageStats::CLUSTERS_PRUNED, 2);
+        
+        REQUIRE(stats.occurrences(StageStats::CLUSTERS_ALIGNED) == 1);
+        REQUIRE(stats.occurrences(StageStats::CLUSTERS_PRUNED) == 5);
+        REQUIRE(stats.calls(StageStats::ALIGN) == 0);
+        
+        stringstream report;
+        stats.report(report);
+        REQUIRE(report.str().find("\nclusters-pruned\t5\n") != string::npos);
+    }
+}
+
+}
+}
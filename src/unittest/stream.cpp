@@ -0,0 +1,282 @@
+/// \file stream.cpp
+///  
+/// Unit tests for reading and writing Protobuf streams
+///
+
+#include "catch.hpp"
+#include "../stream.hpp"
+#include "../prefetch_stream.hpp"
+#include "../blocked_gzip_stream.hpp"
+#include "../stream_codec.hpp"
+#include "vg.pb.h"
+
+#include <atomic>
+#include <map>
+#include <sstream>
+#include <omp.h>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("PrefetchInputStream returns the same bytes as its source", "[stream]") {
+    string data;
+    for (size_t i = 0; i < 100000; i++) {
+        data.push_back('A' + i % 23);
+    }
+    
+    for (size_t block_size : {1, 7, 4096, 1 << 20}) {
+        ::google::protobuf::io::ArrayInputStream source(data.data(), data.size(), 1000);
+        stream::PrefetchInputStream prefetched(&source, block_size, 2);
+        
+        string seen;
+        const void* chunk;
+        int size;
+        // Skip a little and back up a little to exercise the whole interface
+        REQUIRE(prefetched.Skip(10));
+        seen = data.substr(0, 10);
+        while (prefetched.Next(&chunk, &size)) {
+            REQUIRE(size > 0);
+            if (size > 1) {
+                prefetched.BackUp(1);
+                size--;
+            }
+            seen.append((const char*) chunk, size);
+        }
+        REQUIRE(seen == data);
+        REQUIRE(prefetched.ByteCount() == data.size());
+    }
+}
+
+TEST_CASE("Parallel stream iteration sees every written object", "[stream]") {
+    vector<Alignment> buffer;
+    stringstream out;
+    for (size_t i = 0; i < 5000; i++) {
+        Alignment aln;
+        aln.set_name("read" + to_string(i));
+        aln.set_sequence(string(i % 150 + 1, 'A'));
+        buffer.push_back(aln);
+        stream::write_buffered(out, buffer, 1000);
+    }
+    stream::write_buffered(out, buffer, 0);
+    
+    stringstream in(out.str());
+    atomic<size_t> count(0);
+    atomic<size_t> bases(0);
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        count++;
+        bases += aln.sequence().size();
+    };
+    stream::for_each_parallel(in, lambda);
+    
+    size_t expected_bases = 0;
+    for (size_t i = 0; i < 5000; i++) {
+        expected_bases += i % 150 + 1;
+    }
+    REQUIRE(count == 5000);
+    REQUIRE(bases == expected_bases);
+}
+
+TEST_CASE("BGZF GAM groups can be found again by virtual offset", "[stream][bgzf]") {
+    stringstream out;
+    {
+        stream::BlockedGzipOutputStream bgzf_out(out);
+        vector<Alignment> buffer;
+        for (size_t i = 0; i < 3000; i++) {
+            Alignment aln;
+            aln.set_name("read" + to_string(i));
+            aln.set_sequence(string(i % 150 + 1, 'G'));
+            buffer.push_back(aln);
+            stream::write_buffered(bgzf_out, buffer, 100);
+        }
+    }
+    
+    SECTION("BGZF output is still readable as ordinary gzip") {
+        stringstream in(out.str());
+        size_t count = 0;
+        function<void(Alignment&)> lambda = [&](Alignment& aln) {
+            REQUIRE(aln.name() == "read" + to_string(count));
+            count++;
+        };
+        stream::for_each(in, lambda);
+        REQUIRE(count == 3000);
+    }
+    
+    SECTION("Group offsets can be seeked to") {
+        stringstream in(out.str());
+        REQUIRE(stream::BlockedGzipInputStream::is_bgzf(in));
+        stream::BlockedGzipInputStream bgzf_in(in);
+        
+        map<int64_t, string> first_in_group;
+        function<void(int64_t, Alignment&)> lambda = [&](int64_t group_offset, Alignment& aln) {
+            if (!first_in_group.count(group_offset)) {
+                first_in_group[group_offset] = aln.name();
+            }
+        };
+        stream::for_each_with_group_offset(bgzf_in, lambda);
+        REQUIRE(first_in_group.size() == 30);
+        
+        for (auto& group : first_in_group) {
+            REQUIRE(bgzf_in.Seek(group.first));
+            ::google::protobuf::io::CodedInputStream coded_in(&bgzf_in);
+            uint64_t count;
+            REQUIRE(coded_in.ReadVarint64((::google::protobuf::uint64*) &count));
+            REQUIRE(count == 100);
+            uint32_t size;
+            REQUIRE(coded_in.ReadVarint32(&size));
+            string data;
+            REQUIRE(coded_in.ReadString(&data, size));
+            Alignment aln;
+            REQUIRE(aln.ParseFromString(data));
+            REQUIRE(aln.name() == group.second);
+        }
+    }
+}
+
+TEST_CASE("Arena-backed buffers write the same objects as vector buffers", "[stream]") {
+    stringstream arena_out;
+    stringstream vector_out;
+    stream::ArenaBuffer<Alignment> arena_buffer;
+    vector<Alignment> vector_buffer;
+    // batches of different sizes make the arena grow and then get reused
+    for (size_t batch = 0; batch < 20; batch++) {
+        for (size_t i = 0; i < (batch * 37) % 200 + 1; i++) {
+            Alignment aln;
+            aln.set_name("read" + to_string(batch) + "_" + to_string(i));
+            aln.set_sequence(string(i % 150 + 1, 'A'));
+            Mapping* mapping = aln.mutable_path()->add_mapping();
+            mapping->mutable_position()->set_node_id(i + 1);
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(aln.sequence().size());
+            edit->set_to_length(aln.sequence().size());
+            arena_buffer.push_back(aln);
+            vector_buffer.push_back(aln);
+        }
+        REQUIRE(arena_buffer.size() == vector_buffer.size());
+        stream::write_buffered(arena_out, arena_buffer, 0);
+        stream::write_buffered(vector_out, vector_buffer, 0);
+        REQUIRE(arena_buffer.empty());
+    }
+    
+    vector<string> arena_alignments;
+    vector<string> vector_alignments;
+    function<void(Alignment&)> arena_lambda = [&](Alignment& aln) {
+        arena_alignments.push_back(aln.SerializeAsString());
+    };
+    function<void(Alignment&)> vector_lambda = [&](Alignment& aln) {
+        vector_alignments.push_back(aln.SerializeAsString());
+    };
+    stringstream arena_in(arena_out.str());
+    stringstream vector_in(vector_out.str());
+    stream::for_each(arena_in, arena_lambda);
+    stream::for_each(vector_in, vector_lambda);
+    REQUIRE(!arena_alignments.empty());
+    REQUIRE(arena_alignments == vector_alignments);
+}
+
+TEST_CASE("Buffered writes from many threads keep each thread's order", "[stream]") {
+    stringstream out;
+#pragma omp parallel
+    {
+        vector<Alignment> buffer;
+        string thread_name = to_string(omp_get_thread_num());
+#pragma omp for
+        for (size_t i = 0; i < 10000; i++) {
+            Alignment aln;
+            aln.set_name(thread_name);
+            aln.set_query_position(i);
+            buffer.push_back(aln);
+            stream::write_buffered(out, buffer, 50);
+        }
+        stream::write_buffered(out, buffer, 0);
+    }
+    
+    stringstream in(out.str());
+    map<string, int32_t> last_seen;
+    size_t count = 0;
+    bool ordered = true;
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        count++;
+        if (last_seen.count(aln.name()) && last_seen[aln.name()] >= aln.query_position()) {
+            ordered = false;
+        }
+        last_seen[aln.name()] = aln.query_position();
+    };
+    stream::for_each(in, lambda);
+    REQUIRE(count == 10000);
+    REQUIRE(ordered);
+}
+
+TEST_CASE("Streams written with any codec can be read back", "[stream][codec]") {
+    for (auto codec : {stream::Codec::GZIP, stream::Codec::SNAPPY, stream::Codec::LZ4}) {
+        stream::set_default_codec(codec);
+        
+        // enough data to fill several frames
+        vector<Alignment> buffer;
+        stringstream out;
+        for (size_t i = 0; i < 20000; i++) {
+            Alignment aln;
+            aln.set_name("read" + to_string(i));
+            aln.set_sequence(string(i % 150 + 1, "ACGT"[i % 4]));
+            buffer.push_back(aln);
+            stream::write_buffered(out, buffer, 1000);
+        }
+        stream::write_buffered(out, buffer, 0);
+        stream::set_default_codec(stream::Codec::GZIP);
+        string data = out.str();
+        
+        size_t expected_bases = 0;
+        for (size_t i = 0; i < 20000; i++) {
+            expected_bases += i % 150 + 1;
+        }
+        
+        SECTION(stream::codec_name(codec) + " streams read back in order") {
+            stringstream in(data);
+            size_t count = 0;
+            bool ordered = true;
+            function<void(Alignment&)> lambda = [&](Alignment& aln) {
+                if (aln.name() != "read" + to_string(count)) {
+                    ordered = false;
+                }
+                count++;
+            };
+            stream::for_each(in, lambda);
+            REQUIRE(count == 20000);
+            REQUIRE(ordered);
+        }
+        
+        SECTION(stream::codec_name(codec) + " streams read back in parallel") {
+            stringstream in(data);
+            atomic<size_t> count(0);
+            atomic<size_t> bases(0);
+            function<void(Alignment&)> lambda = [&](Alignment& aln) {
+                count++;
+                bases += aln.sequence().size();
+            };
+            stream::for_each_parallel(in, lambda);
+            REQUIRE(count == 20000);
+            REQUIRE(bases == expected_bases);
+        }
+    }
+    
+    SECTION("Unknown codecs are rejected") {
+        REQUIRE_THROWS(stream::parse_codec("zip"));
+        REQUIRE(stream::parse_codec("lz4") == stream::Codec::LZ4);
+    }
+    
+    SECTION("Corrupt frames are reported") {
+        stream::set_default_codec(stream::Codec::LZ4);
+        vector<Alignment> buffer(10);
+        stringstream out;
+        stream::write_buffered(out, buffer, 0);
+        stream::set_default_codec(stream::Codec::GZIP);
+        string data = out.str();
+        data.resize(data.size() - 1);
+        stringstream in(data);
+        function<void(Alignment&)> lambda = [&](Alignment& aln) {};
+        REQUIRE_THROWS(stream::for_each(in, lambda));
+    }
+}
+
+}
+}
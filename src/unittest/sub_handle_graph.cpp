@@ -0,0 +1,113 @@
+/// \file sub_handle_graph.cpp
+///
+/// Unit tests for the SubHandleGraph view
+///
+
+#include "catch.hpp"
+#include "../sub_handle_graph.hpp"
+#include "../packed_graph.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("SubHandleGraph only shows the nodes added to it", "[handle][subgraph]") {
+
+    // 1 -> 2 -> 3 -> 4, with 4 also reading back into 2 through a doubly
+    // reversed edge and 3 having a reversing self loop
+    PackedGraph graph;
+    handle_t h1 = graph.create_handle("GAT");
+    handle_t h2 = graph.create_handle("TA");
+    handle_t h3 = graph.create_handle("C");
+    handle_t h4 = graph.create_handle("AGG");
+    graph.create_edge(h1, h2);
+    graph.create_edge(h2, h3);
+    graph.create_edge(h3, h4);
+    graph.create_edge(graph.flip(h2), graph.flip(h4));
+    graph.create_edge(h3, graph.flip(h3));
+
+    SubHandleGraph subgraph(&graph);
+    REQUIRE(subgraph.add_handle(h2));
+    REQUIRE(subgraph.add_handle(graph.flip(h3)));
+    REQUIRE(!subgraph.add_handle(graph.flip(h2)));
+
+    SECTION("Nodes outside the subgraph are hidden") {
+        REQUIRE(subgraph.node_size() == 2);
+        REQUIRE(subgraph.has_node(2));
+        REQUIRE(!subgraph.has_node(1));
+        REQUIRE_THROWS_AS(subgraph.get_handle(4), runtime_error);
+
+        vector<handle_t> next;
+        subgraph.follow_edges(subgraph.get_handle(2), false, [&](const handle_t& h) {
+            next.push_back(h);
+        });
+        REQUIRE(next.size() == 1);
+        REQUIRE(subgraph.get_id(next[0]) == 3);
+
+        size_t prev_count = 0;
+        subgraph.follow_edges(subgraph.get_handle(2), true, [&](const handle_t& h) {
+            prev_count++;
+        });
+        REQUIRE(prev_count == 0);
+    }
+
+    SECTION("Handles are stored forward and read through to the backing graph") {
+        vector<vg::id_t> ids;
+        subgraph.for_each_handle([&](const handle_t& h) {
+            REQUIRE(!subgraph.get_is_reverse(h));
+            ids.push_back(subgraph.get_id(h));
+        });
+        REQUIRE(ids.size() == 2);
+        REQUIRE(ids[0] == 2);
+        REQUIRE(ids[1] == 3);
+        REQUIRE(subgraph.get_sequence(subgraph.get_handle(2, true)) == "TA");
+        REQUIRE(subgraph.get_length(subgraph.get_handle(3)) == 1);
+    }
+
+    SECTION("Context expansion adds the neighbors of the last nodes added") {
+        subgraph.expand_context(1);
+        REQUIRE(subgraph.node_size() == 4);
+
+        SubHandleGraph single(&graph);
+        single.add_handle(h1);
+        single.expand_context(1);
+        REQUIRE(single.node_size() == 2);
+        REQUIRE(!single.has_node(3));
+        single.expand_context(1);
+        REQUIRE(single.node_size() == 4);
+    }
+
+    SECTION("Writing a Graph sorts nodes and writes each edge once") {
+        subgraph.add_handle(h4);
+        Graph g;
+        subgraph.to_graph(g);
+
+        REQUIRE(g.node_size() == 3);
+        REQUIRE(g.node(0).id() == 2);
+        REQUIRE(g.node(1).id() == 3);
+        REQUIRE(g.node(2).id() == 4);
+        REQUIRE(g.node(2).sequence() == "AGG");
+
+        // 2 -> 3, 3 -> 3 reversing, 3 -> 4 and 4 -> 2 (flipped to drop both flags)
+        REQUIRE(g.edge_size() == 4);
+        REQUIRE(g.edge(0).from() == 2);
+        REQUIRE(g.edge(0).to() == 3);
+        REQUIRE(g.edge(1).from() == 3);
+        REQUIRE(g.edge(1).to() == 3);
+        REQUIRE(!g.edge(1).from_start());
+        REQUIRE(g.edge(1).to_end());
+        REQUIRE(g.edge(2).from() == 3);
+        REQUIRE(g.edge(2).to() == 4);
+        REQUIRE(g.edge(3).from() == 4);
+        REQUIRE(g.edge(3).to() == 2);
+        REQUIRE(!g.edge(3).from_start());
+        REQUIRE(!g.edge(3).to_end());
+    }
+}
+
+}
+}
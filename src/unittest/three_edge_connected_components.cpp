@@ -0,0 +1,42 @@
+/// \file three_edge_connected_components.cpp
+///
+/// Unit tests for finding 3-edge-connected components
+///
+
+#include "catch.hpp"
+#include "../algorithms/three_edge_connected_components.hpp"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("3-edge-connected components can be found", "[algorithms][snarls]") {
+
+    SECTION("A single cycle is cut by removing two edges") {
+        vector<size_t> components = algorithms::three_edge_connected_components(3, {{0, 1}, {1, 2}, {2, 0}});
+        REQUIRE(components == vector<size_t>({0, 1, 2}));
+    }
+
+    SECTION("Three parallel edges hold two vertices together") {
+        vector<size_t> components = algorithms::three_edge_connected_components(3, {{0, 1}, {1, 0}, {0, 1}, {1, 2}, {2, 2}});
+        REQUIRE(components == vector<size_t>({0, 0, 1}));
+    }
+
+    SECTION("A complete graph on four vertices is one component") {
+        vector<size_t> components = algorithms::three_edge_connected_components(5, {{0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3}});
+        REQUIRE(components == vector<size_t>({0, 0, 0, 0, 1}));
+    }
+
+    SECTION("Two cycles sharing a vertex stay separate") {
+        vector<size_t> components = algorithms::three_edge_connected_components(5, {{0, 1}, {1, 2}, {2, 0}, {2, 3}, {3, 4}, {4, 2}});
+        REQUIRE(components == vector<size_t>({0, 1, 2, 3, 4}));
+    }
+
+    SECTION("Components need not be contiguous") {
+        vector<size_t> components = algorithms::three_edge_connected_components(4, {{0, 2}, {0, 2}, {2, 0}, {1, 3}, {3, 1}, {1, 3}});
+        REQUIRE(components == vector<size_t>({0, 1, 0, 1}));
+    }
+}
+
+}
+}
@@ -119,6 +119,60 @@ ref	5	rs1337	A	G	29	PASS	.	GT	0/1
 
 }
 
+TEST_CASE( "Nearby SNPs can be added together or, over budget, alone", "[variantadder]" ) {
+
+    // We'll work on this tiny VCF
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##fileDate=20090805
+##source=myImputationProgramV3.1
+##reference=1000GenomesPilot-NCBI36
+##phasing=partial
+##FILTER=<ID=q10,Description="Quality below 10">
+##FILTER=<ID=s50,Description="Less than 50% of samples have data">
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT	SAMPLE1	SAMPLE2
+ref	3	rs1337	T	C	29	PASS	.	GT	1|0	0|0
+ref	10	rs1338	T	G	29	PASS	.	GT	0|0	0|1
+)";
+
+    string graph_json = R"({
+        "node": [{"id": 1, "sequence": "GATTACAGATTACA"}],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 14, "to_length": 14}]}
+            ]}
+        ]
+    })";
+    
+    for (size_t budget : {0, 1}) {
+        // Make a stream out of the data
+        std::stringstream vcf_stream(vcf_data);
+        
+        // Load it up in vcflib
+        vcflib::VariantCallFile vcf;
+        vcf.open(vcf_stream);
+        
+        // Load the JSON
+        Graph proto_graph;
+        json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+        
+        // Make it into a VG
+        VG graph;
+        graph.extend(proto_graph);
+        
+        // Make a VariantAdder, with no budget or one too small for both SNPs
+        VariantAdder adder(graph);
+        adder.max_window_haplotype_bases = budget;
+        // Add the variants to the graph
+        adder.add_variants(&vcf);
+        
+        // Both SNPs should be in, each cutting the reference
+        REQUIRE(graph.size() == 7);
+        REQUIRE(graph.edge_count() == 8);
+    }
+
+}
+
 TEST_CASE( "A relatively long deletion can be added", "[variantadder]" ) {
 
     // We'll work on this tiny VCF
@@ -11,6 +11,7 @@
 #include "../path.hpp"
 #include "../json2pb.h"
 
+#include <functional>
 #include <vector>
 #include <sstream>
 #include <iostream>
@@ -136,5 +137,67 @@ ref	18	rs1342	A	G	29	PASS	.	GT
     
 }
 
+TEST_CASE( "VcfBuffer read-ahead produces the same variants", "[vcfbuffer][vcf]" ) {
+
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT	s1	s2
+ref	5	rs1337	A	G	29	PASS	.	GT	0|1	1|1
+ref	7	rs1338	A	G	29	PASS	.	GT	0|0	0|1
+ref	7	rs1339	A	T	29	PASS	.	GT	1|0	0|0
+ref	8	rs1340	A	G	29	PASS	.	GT	0|1	0|1
+ref	17	rs1341	A	G	29	PASS	.	GT	1|1	1|0
+ref	18	rs1342	A	G	29	PASS	.	GT	0|0	1|1
+)";
+
+    // Read all the variants out of a buffer, after setting it up
+    auto read_all = [&](const function<void(VcfBuffer&)>& setup) {
+        std::stringstream vcf_stream(vcf_data);
+        vcflib::VariantCallFile vcf;
+        vcf.open(vcf_stream);
+        VcfBuffer buffer(&vcf);
+        setup(buffer);
+
+        vector<vcflib::Variant> variants;
+        buffer.fill_buffer();
+        while (buffer.get() != nullptr) {
+            variants.push_back(*buffer.get());
+            buffer.handle_buffer();
+            buffer.fill_buffer();
+        }
+        return variants;
+    };
+
+    auto serial = read_all([](VcfBuffer& buffer) {});
+    REQUIRE(serial.size() == 6);
+    REQUIRE(serial.front().position == 4);
+
+    SECTION("variants read ahead come out in order with 0-based positions") {
+        auto ahead = read_all([](VcfBuffer& buffer) {
+            // Make the reader wait on the consumer
+            buffer.start_read_ahead(2);
+        });
+        REQUIRE(ahead.size() == serial.size());
+        for (size_t i = 0; i < serial.size(); i++) {
+            REQUIRE(ahead[i].id == serial[i].id);
+            REQUIRE(ahead[i].position == serial[i].position);
+            REQUIRE(ahead[i].samples == serial[i].samples);
+        }
+    }
+
+    SECTION("samples can be left unparsed") {
+        auto sites = read_all([](VcfBuffer& buffer) {
+            buffer.set_parse_samples(false);
+            buffer.start_read_ahead();
+        });
+        REQUIRE(sites.size() == serial.size());
+        for (size_t i = 0; i < serial.size(); i++) {
+            REQUIRE(sites[i].id == serial[i].id);
+            REQUIRE(sites[i].alt == serial[i].alt);
+            REQUIRE(sites[i].samples.empty());
+        }
+    }
+}
+
 }
 }
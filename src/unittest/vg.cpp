@@ -6,6 +6,9 @@
 #include "../vg.hpp"
 #include "../utility.hpp"
 
+#include <omp.h>
+#include <sstream>
+
 namespace vg {
 namespace unittest {
 
@@ -2127,5 +2130,160 @@ TEST_CASE("create_handle() correctly creates handles using given sequence and id
     
 }
 
+TEST_CASE("edit() gives the same result with any number of threads", "[vg][edit]") {
+    
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTACAGATTACAGATTACAGATTACAGATTACAGATTACAGATTACAGATTACA"},
+            {"id": 2, "sequence": "CATCATCATCATCATCATCATCATCATCATCATCATCATCATCATCAT"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2}
+        ]
+    }
+    )";
+    
+    // Make a lot of reads with substitutions and insertions scattered along
+    // both nodes on both strands
+    vector<Path> paths;
+    for (size_t i = 0; i < 2000; i++) {
+        Path path;
+        Mapping* mapping = path.add_mapping();
+        mapping->mutable_position()->set_node_id(1 + i % 2);
+        mapping->mutable_position()->set_is_reverse(i % 3 == 0);
+        mapping->mutable_position()->set_offset(i % 17);
+        
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(1 + i % 13);
+        edit->set_to_length(1 + i % 13);
+        
+        edit = mapping->add_edit();
+        if (i % 5 == 0) {
+            edit->set_to_length(2);
+            edit->set_sequence(i % 2 ? "TT" : "GG");
+        } else {
+            edit->set_from_length(1);
+            edit->set_to_length(1);
+            edit->set_sequence(string(1, "ACGT"[i % 4]));
+        }
+        
+        edit = mapping->add_edit();
+        edit->set_from_length(1 + i % 7);
+        edit->set_to_length(1 + i % 7);
+        
+        paths.push_back(path);
+    }
+    
+    auto edit_with_threads = [&](int threads, VG& graph) {
+        int old_threads = omp_get_max_threads();
+        omp_set_num_threads(threads);
+        vector<Path> to_add = paths;
+        vector<Translation> translations = graph.edit(to_add, false, true, false);
+        omp_set_num_threads(old_threads);
+        
+        stringstream summary;
+        for (auto& translation : translations) {
+            summary << pb2json(translation) << endl;
+        }
+        for (auto& path : to_add) {
+            summary << pb2json(path) << endl;
+        }
+        return summary.str();
+    };
+    
+    VG serial_graph = string_to_graph(graph_json);
+    VG parallel_graph = string_to_graph(graph_json);
+    
+    string serial = edit_with_threads(1, serial_graph);
+    string parallel = edit_with_threads(4, parallel_graph);
+    
+    REQUIRE(serial == parallel);
+    REQUIRE(pb2json(serial_graph.graph) == pb2json(parallel_graph.graph));
+    REQUIRE(serial_graph.node_count() > 2);
+}
+
+TEST_CASE("apply_to_components_parallel() gives the same graph as running the pass serially", "[vg][mod]") {
+    
+    const string graph_json = R"(
+    {
+        "node": [
+            {"id": 1, "sequence": "GATTACA"},
+            {"id": 2, "sequence": "CAT"},
+            {"id": 3, "sequence": "TTAGGC"},
+            {"id": 4, "sequence": "ACGTACGTA"},
+            {"id": 5, "sequence": "GG"},
+            {"id": 6, "sequence": "CCCTAAA"},
+            {"id": 7, "sequence": "T"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 2, "to": 3},
+            {"from": 4, "to": 5},
+            {"from": 6, "to": 7, "to_end": true}
+        ],
+        "path": [
+            {"name": "first", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 7, "to_length": 7}], "rank": 1},
+                {"position": {"node_id": 2}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 2},
+                {"position": {"node_id": 3}, "edit": [{"from_length": 6, "to_length": 6}], "rank": 3}
+            ]},
+            {"name": "second", "mapping": [
+                {"position": {"node_id": 5, "is_reverse": true}, "edit": [{"from_length": 2, "to_length": 2}], "rank": 1},
+                {"position": {"node_id": 4, "is_reverse": true}, "edit": [{"from_length": 9, "to_length": 9}], "rank": 2}
+            ]}
+        ]
+    }
+    )";
+    
+    auto check_same = [&](const function<void(VG&)>& pass) {
+        VG serial_graph = string_to_graph(graph_json);
+        VG parallel_graph = string_to_graph(graph_json);
+        
+        pass(serial_graph);
+        int old_threads = omp_get_max_threads();
+        omp_set_num_threads(4);
+        parallel_graph.apply_to_components_parallel(pass);
+        omp_set_num_threads(old_threads);
+        
+        REQUIRE(parallel_graph.is_valid());
+        REQUIRE(parallel_graph.node_count() == serial_graph.node_count());
+        REQUIRE(parallel_graph.edge_count() == serial_graph.edge_count());
+        REQUIRE(parallel_graph.length() == serial_graph.length());
+        
+        // New nodes all get their own IDs, and new ones can still be made
+        set<id_t> ids;
+        parallel_graph.for_each_node([&](Node* node) {
+            ids.insert(node->id());
+        });
+        REQUIRE(ids.size() == parallel_graph.node_count());
+        REQUIRE(!ids.count(parallel_graph.create_node("A")->id()));
+        
+        for (const string name : {"first", "second"}) {
+            REQUIRE(parallel_graph.paths.has_path(name));
+            REQUIRE(parallel_graph.path_sequence(parallel_graph.paths.path(name)) ==
+                    serial_graph.path_sequence(serial_graph.paths.path(name)));
+        }
+    };
+    
+    SECTION("Dicing nodes makes the same pieces") {
+        check_same([](VG& graph) {
+            graph.dice_nodes(2);
+        });
+    }
+    
+    SECTION("Unchopping merges the same nodes") {
+        check_same([](VG& graph) {
+            graph.unchop();
+        });
+    }
+    
+    SECTION("Normalizing gives the same graph") {
+        check_same([](VG& graph) {
+            graph.normalize();
+        });
+    }
+}
+
 }
 }
@@ -12,6 +12,7 @@
 #include "algorithms/extract_connecting_graph.hpp"
 #include "algorithms/extract_containing_graph.hpp"
 #include "algorithms/extract_extending_graph.hpp"
+#include "algorithms/find_shortest_paths.hpp"
 #include "algorithms/topological_sort.hpp"
 #include "algorithms/weakly_connected_components.hpp"
 #include "algorithms/distance_to_head.hpp"
@@ -3460,6 +3461,110 @@ namespace vg {
                   
         }
         
+        TEST_CASE( "Parallel topological sort matches the serial sort",
+                  "[algorithms][topologicalsort]" ) {
+            
+            VG vg;
+            
+            // A DAG component with a reversing edge
+            Node* n1 = vg.create_node("GAT");
+            Node* n2 = vg.create_node("TACA");
+            Node* n3 = vg.create_node("C");
+            Node* n4 = vg.create_node("GG");
+            vg.create_edge(n1, n2);
+            vg.create_edge(n1, n3, false, true);
+            vg.create_edge(n2, n4);
+            vg.create_edge(n4, n3, false, true);
+            
+            // A cycle with no heads, which needs seeds
+            Node* n5 = vg.create_node("A");
+            Node* n6 = vg.create_node("CC");
+            Node* n7 = vg.create_node("T");
+            vg.create_edge(n5, n6);
+            vg.create_edge(n6, n7);
+            vg.create_edge(n7, n5);
+            vg.create_edge(n6, n6, false, true);
+            
+            // Another component with a head and a self loop
+            Node* n8 = vg.create_node("G");
+            Node* n9 = vg.create_node("AA");
+            vg.create_edge(n8, n9);
+            vg.create_edge(n9, n9);
+            
+            // And a lone node
+            vg.create_node("ACGT");
+            
+            REQUIRE(algorithms::parallel_topological_sort(&vg) == algorithms::topological_sort(&vg));
+            
+            SECTION( "The sort instantiated on VG matches the sort through HandleGraph" ) {
+                const HandleGraph* as_handle_graph = &vg;
+                REQUIRE(algorithms::topological_sort(&vg) == algorithms::topological_sort(as_handle_graph));
+                REQUIRE(algorithms::head_nodes(&vg) == algorithms::head_nodes(as_handle_graph));
+                REQUIRE(algorithms::tail_nodes(&vg) == algorithms::tail_nodes(as_handle_graph));
+                REQUIRE(algorithms::weakly_connected_components(&vg) == algorithms::weakly_connected_components(as_handle_graph));
+            }
+        }
+        
+        TEST_CASE( "Bidirectional shortest path length search works",
+                  "[algorithms]" ) {
+            
+            VG vg;
+            
+            Node* n1 = vg.create_node("GAT");
+            Node* n2 = vg.create_node("TACA");
+            Node* n3 = vg.create_node("C");
+            Node* n4 = vg.create_node("GG");
+            Node* n5 = vg.create_node("TTTT");
+            Node* n6 = vg.create_node("A");
+            
+            vg.create_edge(n1, n2);
+            vg.create_edge(n1, n3);
+            vg.create_edge(n2, n4);
+            vg.create_edge(n3, n4);
+            vg.create_edge(n4, n5);
+            vg.create_edge(n5, n1);
+            // a reversing edge to get to n6
+            vg.create_edge(n4, n6, false, true);
+            
+            handle_t h1 = vg.get_handle(n1->id(), false);
+            handle_t h4 = vg.get_handle(n4->id(), false);
+            handle_t h5 = vg.get_handle(n5->id(), false);
+            handle_t h6_rev = vg.get_handle(n6->id(), true);
+            
+            SECTION( "It takes the shorter of two branches" ) {
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h1, h4, 100) == 1);
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h1, h5, 100) == 3);
+            }
+            
+            SECTION( "It finds adjacent handles at distance 0" ) {
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h4, h5, 100) == 0);
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h4, h6_rev, 100) == 0);
+            }
+            
+            SECTION( "It respects the maximum length" ) {
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h1, h5, 3) == 3);
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h1, h5, 2) == -1);
+            }
+            
+            SECTION( "It finds cycles back to the same handle" ) {
+                // around through n3, n4 and n5
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h1, h1, 100) == 7);
+            }
+            
+            SECTION( "It doesn't go against the orientation of the handles" ) {
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h4, h1, 100) == 4);
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h6_rev, h1, 100) == -1);
+                REQUIRE(algorithms::find_shortest_path_length(&vg, vg.flip(h4), vg.flip(h1), 100) == 1);
+            }
+            
+            SECTION( "A lower bound prunes the search without changing the answer" ) {
+                auto bound = [&](const handle_t& handle) -> int64_t {
+                    return vg.get_id(handle) == n2->id() ? 2 : 0;
+                };
+                REQUIRE(algorithms::find_shortest_path_length(&vg, h1, h5, 3, bound) == 3);
+            }
+        }
+        
         TEST_CASE( "Weakly connected components works",
                   "[algorithms]" ) {
             
@@ -3506,6 +3611,52 @@ namespace vg {
                 }
             }
             
+            SECTION( "algorithms::weakly_connected_component_ids numbers the same two components" ) {
+                vector<id_t> node_ids;
+                vector<size_t> component_ids;
+                algorithms::weakly_connected_component_ids(&vg, node_ids, component_ids);
+                
+                REQUIRE(node_ids.size() == 10);
+                REQUIRE(component_ids.size() == 10);
+                for (size_t i = 0; i < node_ids.size(); i++) {
+                    // Nodes come in order, and the first five are one component
+                    REQUIRE(node_ids[i] == vg.graph.node(i).id());
+                    REQUIRE(component_ids[i] == (i < 5 ? 0 : 1));
+                }
+            }
+            
+            SECTION( "algorithms::IncrementalComponents merges components as chunks come in" ) {
+                algorithms::IncrementalComponents components;
+                
+                // An edge can come before the nodes it connects
+                Graph first_chunk;
+                Edge* edge = first_chunk.add_edge();
+                edge->set_from(n2->id());
+                edge->set_to(n3->id());
+                first_chunk.add_node()->set_id(n2->id());
+                components.add_graph(first_chunk);
+                
+                REQUIRE(components.node_count() == 2);
+                REQUIRE(components.component_count() == 1);
+                
+                components.add_node(n7->id());
+                components.add_node(n9->id());
+                REQUIRE(components.component_count() == 2);
+                REQUIRE(!components.same_component(n3->id(), n7->id()));
+                
+                components.add_edge(n7->id(), n9->id());
+                components.add_edge(n9->id(), n2->id());
+                REQUIRE(components.component_count() == 1);
+                REQUIRE(components.same_component(n3->id(), n7->id()));
+                REQUIRE(!components.has_node(n5->id()));
+                
+                vector<id_t> node_ids;
+                vector<size_t> component_ids;
+                components.get_component_ids(node_ids, component_ids);
+                REQUIRE(node_ids == vector<id_t>{n2->id(), n3->id(), n7->id(), n9->id()});
+                REQUIRE(component_ids == vector<size_t>{0, 0, 0, 0});
+            }
+            
             vg.create_edge(n3, n5);
             vg.create_edge(n4, n5);
             
@@ -8,6 +8,7 @@
 #include "vg.hpp"
 #include "xg.hpp"
 #include "graph.hpp"
+#include <gbwt/dynamic_gbwt.h>
 #include <stdio.h>
 
 namespace vg {
@@ -332,6 +333,36 @@ TEST_CASE("Target to alignment extraction", "[xg-target-to-aln]") {
         REQUIRE(target.path().mapping(1).position().is_reverse() == true);
     }
 
+    SECTION("A CIGAR-derived mapping is laid along the path with its mismatches") {
+        // Reference bases 1-9 along the path are GA CCGT C AC; the read has a
+        // T where the G of node 2 is.
+        Mapping cigar_mapping;
+        Edit* edit = cigar_mapping.add_edit();
+        edit->set_from_length(9);
+        edit->set_to_length(9);
+        edit->set_sequence("GACCTTCAC");
+        Alignment target = xg_index.target_alignment("path", 1, 10, "feature", false, cigar_mapping);
+        REQUIRE(alignment_from_length(target) == 9);
+        REQUIRE(target.path().mapping_size() == 4);
+        REQUIRE(target.path().mapping(0).position().node_id() == n0->id());
+        REQUIRE(target.path().mapping(0).position().offset() == 1);
+        REQUIRE(target.path().mapping(0).edit_size() == 1);
+
+        const Mapping& snp_mapping = target.path().mapping(1);
+        REQUIRE(snp_mapping.position().node_id() == n2->id());
+        REQUIRE(snp_mapping.edit_size() == 3);
+        REQUIRE(snp_mapping.edit(0).from_length() == 2);
+        REQUIRE(snp_mapping.edit(1).sequence() == "T");
+        REQUIRE(snp_mapping.edit(2).from_length() == 1);
+
+        // The reverse visit to node 4 matches its reverse complement
+        const Mapping& reverse_mapping = target.path().mapping(3);
+        REQUIRE(reverse_mapping.position().node_id() == n4->id());
+        REQUIRE(reverse_mapping.position().is_reverse());
+        REQUIRE(reverse_mapping.edit_size() == 1);
+        REQUIRE(reverse_mapping.edit(0).sequence().empty());
+    }
+
 }
 
 TEST_CASE("Path-based distance approximation in XG produces expected results", "[xg][mapping]") {
@@ -678,5 +709,294 @@ TEST_CASE("Path component memoization produces expected results", "[xg]") {
     }
 }
 
+TEST_CASE("Allocation-free edge iteration agrees with edges_of", "[xg]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"T"},
+    {"id":4,"sequence":"GG"}],
+    "edge":[{"from":1,"to":2},
+    {"from":1,"to":3},
+    {"from":2,"to":4},
+    {"from":3,"to":4,"to_end":true},
+    {"from":3,"to":3,"from_start":true}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    for (int64_t node_id : {1, 2, 3, 4}) {
+        vector<Edge> expected = xg_index.edges_of(node_id);
+        vector<Edge> found;
+        xg_index.for_each_edge_of(node_id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+            found.push_back(xg::make_edge(from, from_start, to, to_end));
+            return true;
+        });
+        
+        REQUIRE(found.size() == expected.size());
+        for (size_t i = 0; i < found.size(); i++) {
+            REQUIRE(found[i].from() == expected[i].from());
+            REQUIRE(found[i].from_start() == expected[i].from_start());
+            REQUIRE(found[i].to() == expected[i].to());
+            REQUIRE(found[i].to_end() == expected[i].to_end());
+        }
+        
+        for (bool is_reverse : {false, true}) {
+            handle_t handle = xg_index.get_handle(node_id, is_reverse);
+            for (bool go_left : {false, true}) {
+                size_t followed = 0;
+                xg_index.follow_edges(handle, go_left, [&](const handle_t& next) {
+                    followed++;
+                });
+                REQUIRE(xg_index.get_degree(handle, go_left) == followed);
+            }
+        }
+    }
+    
+    SECTION("Iteration stops when the iteratee returns false") {
+        size_t seen = 0;
+        bool finished = xg_index.for_each_edge_of(1, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+            seen++;
+            return false;
+        });
+        REQUIRE(!finished);
+        REQUIRE(seen == 1);
+    }
+    
+    SECTION("Degrees are counted on the correct sides") {
+        REQUIRE(xg_index.get_degree(xg_index.get_handle(1, false), false) == 2);
+        REQUIRE(xg_index.get_degree(xg_index.get_handle(1, false), true) == 0);
+        REQUIRE(xg_index.get_degree(xg_index.get_handle(4, false), true) == 1);
+        REQUIRE(xg_index.get_degree(xg_index.get_handle(4, false), false) == 1);
+    }
+}
+
+TEST_CASE("Batched path offset queries agree with single queries", "[xg]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"T"},
+    {"id":4,"sequence":"GG"}],
+    "edge":[{"from":1,"to":2},
+    {"from":1,"to":3},
+    {"from":2,"to":4},
+    {"from":3,"to":4}],
+    "path":[{"name":"a","mapping":[{"position":{"node_id":1},"rank":1},{"position":{"node_id":2},"rank":2},{"position":{"node_id":4},"rank":3}]},
+    {"name":"b","mapping":[{"position":{"node_id":4,"is_reverse":true},"rank":1},{"position":{"node_id":2,"is_reverse":true},"rank":2}]}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    vector<pos_t> queries {make_pos_t(1, false, 2), make_pos_t(2, true, 1), make_pos_t(3, false, 0), make_pos_t(4, false, 1)};
+    
+    vector<xg::XG::path_offset_t> results;
+    xg_index.offsets_in_paths(queries, results);
+    
+    size_t total = 0;
+    for (size_t i = 0; i < queries.size(); i++) {
+        auto expected = xg_index.offsets_in_paths(queries[i]);
+        for (auto& path_offsets : expected) {
+            for (auto& path_offset : path_offsets.second) {
+                total++;
+                bool found = false;
+                for (auto& result : results) {
+                    if (result.query == i && xg_index.path_name(result.path_rank) == path_offsets.first &&
+                        result.offset == path_offset.first && result.is_reverse == path_offset.second) {
+                        found = true;
+                    }
+                }
+                REQUIRE(found);
+            }
+        }
+    }
+    REQUIRE(results.size() == total);
+    
+    SECTION("Results are grouped by query in order") {
+        for (size_t i = 1; i < results.size(); i++) {
+            REQUIRE(results[i - 1].query <= results[i].query);
+        }
+    }
+    
+    SECTION("Nearest offsets find a path from an off-path node") {
+        vector<pos_t> off_path {make_pos_t(3, false, 0)};
+        xg_index.nearest_offsets_in_paths(off_path, 10, results);
+        auto expected = xg_index.nearest_offsets_in_paths(off_path.front(), 10);
+        size_t expected_count = 0;
+        for (auto& path_offsets : expected) {
+            expected_count += path_offsets.second.size();
+        }
+        REQUIRE(expected_count > 0);
+        REQUIRE(results.size() == expected_count);
+    }
+}
+
+TEST_CASE("Many paths can share the path storage", "[xg]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"T"},
+    {"id":4,"sequence":"GG"}],
+    "edge":[{"from":1,"to":2},
+    {"from":1,"to":3},
+    {"from":2,"to":4},
+    {"from":3,"to":4},
+    {"from":4,"to":2}],
+    "path":[{"name":"ref","mapping":[{"position":{"node_id":1},"rank":1},{"position":{"node_id":2},"rank":2},{"position":{"node_id":4},"rank":3},{"position":{"node_id":2},"rank":4}]}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    
+    // Add a lot of little alt paths, like vg construct -a makes
+    for (size_t i = 0; i < 100; i++) {
+        Path* alt = proto_graph.add_path();
+        alt->set_name("_alt_" + to_string(i));
+        Mapping* mapping = alt->add_mapping();
+        mapping->mutable_position()->set_node_id(i % 2 ? 3 : 2);
+        mapping->mutable_position()->set_is_reverse(i % 3 == 0);
+        mapping->set_rank(1);
+    }
+    
+    xg::XG built(proto_graph);
+    
+    // Make sure it all survives a round trip through the file format
+    stringstream serialized;
+    built.serialize(serialized);
+    xg::XG loaded;
+    loaded.load(serialized);
+    
+    for (xg::XG* xg_index : {&built, &loaded}) {
+        REQUIRE(xg_index->max_path_rank() == 101);
+        REQUIRE(xg_index->path_length("ref") == 12);
+        REQUIRE(xg_index->node_occs_in_path(2, "ref") == 2);
+        REQUIRE(xg_index->node_occs_in_path(3, "ref") == 0);
+        REQUIRE(xg_index->position_in_path(2, xg_index->path_rank("ref")) == vector<size_t>({4, 9}));
+        REQUIRE(xg_index->node_at_path_position("ref", 8) == 4);
+        REQUIRE(xg_index->node_at_path_position("ref", 11) == 2);
+        REQUIRE(xg_index->node_start_at_path_position("ref", 11) == 9);
+        
+        for (size_t i = 0; i < 100; i++) {
+            string name = "_alt_" + to_string(i);
+            id_t node_id = i % 2 ? 3 : 2;
+            REQUIRE(xg_index->path_length(name) == (i % 2 ? 1 : 3));
+            REQUIRE(xg_index->node_at_path_position(name, 0) == node_id);
+            REQUIRE(xg_index->node_ranks_in_path(node_id, name) == vector<size_t>({0}));
+            auto& path = xg_index->get_path(name);
+            REQUIRE(path.size() == 1);
+            REQUIRE(path.is_reverse(0) == (i % 3 == 0));
+        }
+        
+        // Node 2 is on the reference twice and on half the alts
+        REQUIRE(xg_index->paths_of_node(2).size() == 51);
+    }
+}
+
+TEST_CASE("Sequence extraction works across packed word boundaries", "[xg]") {
+
+    // Long enough nodes that their sequences span several 64-bit words,
+    // including Ns so the sequence vector needs 3 bits per base
+    string seq1 = "GATTACAGATTACANNGATTACACATTAGGATTACAGATTACACCCCGGGGTTTTAAAACGTNACGTAGCTAGCTAGCTAGCATCGATCG";
+    string seq2 = "ACGTACGTTTGACCA";
+    string seq3 = "C";
+    
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":")" + seq1 + R"("},
+    {"id":2,"sequence":")" + seq2 + R"("},
+    {"id":3,"sequence":")" + seq3 + R"("}],
+    "edge":[{"from":1,"to":2},{"from":2,"to":3}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    vector<pair<int64_t, string>> nodes {{1, seq1}, {2, seq2}, {3, seq3}};
+    
+    for (auto& node : nodes) {
+        REQUIRE(xg_index.node_sequence(node.first) == node.second);
+        REQUIRE(xg_index.get_sequence(xg_index.get_handle(node.first, false)) == node.second);
+        REQUIRE(xg_index.get_sequence(xg_index.get_handle(node.first, true)) == reverse_complement(node.second));
+        
+        string buffer;
+        xg_index.get_sequence(xg_index.get_handle(node.first, true), buffer);
+        REQUIRE(buffer == reverse_complement(node.second));
+        
+        for (size_t off = 0; off < node.second.size(); off++) {
+            REQUIRE(xg_index.pos_char(node.first, false, off) == node.second[off]);
+            REQUIRE(xg_index.pos_char(node.first, true, off) == reverse_complement(node.second)[off]);
+            for (size_t len : {0, 1, 7, 33}) {
+                size_t expected_len = len == 0 ? string::npos : len;
+                REQUIRE(xg_index.pos_substr(node.first, false, off, len) == node.second.substr(off, expected_len));
+                REQUIRE(xg_index.pos_substr(node.first, true, off, len) ==
+                        reverse_complement(node.second).substr(off, expected_len));
+                xg_index.pos_substr(node.first, true, off, len, buffer);
+                REQUIRE(buffer == reverse_complement(node.second).substr(off, expected_len));
+            }
+        }
+    }
+}
+
+TEST_CASE("Haplotype queries can be delegated to a GBWT", "[xg][gbwt]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GAT"},
+    {"id":2,"sequence":"T"},
+    {"id":3,"sequence":"A"},
+    {"id":4,"sequence":"CA"}],
+    "edge":[{"from":1,"to":2},{"from":1,"to":3},{"from":2,"to":4},{"from":3,"to":4}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    auto node = [](int64_t id) {
+        return static_cast<gbwt::vector_type::value_type>(gbwt::Node::encode(id, false));
+    };
+    auto end = static_cast<gbwt::vector_type::value_type>(gbwt::ENDMARKER);
+    vector<gbwt::vector_type> haplotypes {
+        {node(1), node(2), node(4), end},
+        {node(1), node(2), node(4), end},
+        {node(1), node(3), node(4), end},
+        {node(3), node(4), end}
+    };
+    
+    gbwt::Verbosity::set(gbwt::Verbosity::SILENT);
+    gbwt::DynamicGBWT dynamic_index;
+    for (auto& haplotype : haplotypes) {
+        dynamic_index.insert(haplotype);
+    }
+    gbwt::GBWT gbwt_index(dynamic_index);
+    
+    xg_index.set_haplotype_database(&gbwt_index);
+    REQUIRE(xg_index.get_haplotype_database() == &gbwt_index);
+    
+    using thread_t = xg::XG::thread_t;
+    REQUIRE(xg_index.count_matches(thread_t{{1, false}, {2, false}, {4, false}}) == 2);
+    REQUIRE(xg_index.count_matches(thread_t{{1, false}, {3, false}}) == 1);
+    REQUIRE(xg_index.count_matches(thread_t{{3, false}, {4, false}}) == 2);
+    REQUIRE(xg_index.count_matches(thread_t{{2, false}, {3, false}}) == 0);
+    REQUIRE(xg_index.count_matches(thread_t{{4, true}}) == 0);
+    
+    REQUIRE(xg_index.node_height({4, false}) == 4);
+    REQUIRE(xg_index.select_starting({3, false}).count() == 1);
+    REQUIRE(xg_index.select_continuing({3, false}).count() == 1);
+    REQUIRE(xg_index.threads_starting_on_side(xg_index.id_rev_to_side(1, false)) == 3);
+    
+    // Searches can be continued from a starting selection
+    auto state = xg_index.select_starting({3, false});
+    xg_index.extend_search(state, xg::XG::ThreadMapping{4, false});
+    REQUIRE(state.count() == 1);
+    
+    xg_index.set_haplotype_database(nullptr);
+    REQUIRE(xg_index.get_haplotype_database() == nullptr);
+}
+
 }
 }
@@ -0,0 +1,82 @@
+/// \file xg_query_context.cpp
+///
+/// Unit tests for the per-read cache of XG queries
+///
+
+#include "catch.hpp"
+#include "../xg.hpp"
+#include "../xg_query_context.hpp"
+#include "../json2pb.h"
+
+namespace vg {
+namespace unittest {
+using namespace std;
+
+TEST_CASE("XG query contexts give the same answers as the XG", "[xg][cache]") {
+
+    // two paths, one of which visits node 2 twice and node 3 backward
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"TTG"},
+    {"id":4,"sequence":"C"}],
+    "edge":[{"from":1,"to":2},{"from":2,"to":3,"to_end":true},{"from":3,"to":2,"from_start":true},{"from":2,"to":4}],
+    "path":[{"name":"a","mapping":[{"position":{"node_id":1},"rank":1},{"position":{"node_id":2},"rank":2},{"position":{"node_id":4},"rank":3}]},
+    {"name":"b","mapping":[{"position":{"node_id":2},"rank":1},{"position":{"node_id":3,"is_reverse":true},"rank":2},{"position":{"node_id":2},"rank":3},{"position":{"node_id":4},"rank":4}]}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    xg::XGQueryContext context(&xg_index);
+
+    auto check_all = [&]() {
+        for (int64_t id = 1; id <= 4; id++) {
+            vector<size_t> paths = xg_index.paths_of_node(id);
+            auto cached_paths = context.paths_of_node(id);
+            REQUIRE(vector<size_t>(cached_paths.begin(), cached_paths.end()) == paths);
+
+            auto oriented_paths = xg_index.oriented_paths_of_node(id);
+            auto cached_oriented_paths = context.oriented_paths_of_node(id);
+            REQUIRE(cached_oriented_paths.size() == oriented_paths.size());
+            for (size_t i = 0; i < oriented_paths.size(); i++) {
+                REQUIRE(cached_oriented_paths[i].first == oriented_paths[i].first);
+                auto& occurrences = cached_oriented_paths[i].second;
+                REQUIRE(vector<pair<size_t, bool>>(occurrences.begin(), occurrences.end()) == oriented_paths[i].second);
+            }
+
+            for (size_t path : paths) {
+                auto occurrences = context.oriented_occurrences_on_path(id, path);
+                REQUIRE(vector<pair<size_t, bool>>(occurrences.begin(), occurrences.end())
+                        == xg_index.oriented_occurrences_on_path(id, path));
+            }
+
+            for (bool rev : {false, true}) {
+                REQUIRE(as_integer(context.get_handle(id, rev)) == as_integer(xg_index.get_handle(id, rev)));
+            }
+        }
+    };
+
+    SECTION("Cached answers match the index, including when asked again") {
+        check_all();
+        check_all();
+    }
+
+    SECTION("A context can be cleared and reused") {
+        check_all();
+        context.clear();
+        check_all();
+        context.reset(&xg_index);
+        check_all();
+        REQUIRE(context.get_index() == &xg_index);
+    }
+
+    SECTION("Repeated visits to a node are all cached") {
+        REQUIRE(context.paths_of_node(1).size() == 1);
+        REQUIRE(context.oriented_occurrences_on_path(2, xg_index.path_rank("b")).size() == 2);
+    }
+}
+
+}
+}
@@ -1,7 +1,9 @@
 #include "utility.hpp"
+#include "read_ahead_stream.hpp"
 
 #include <cstdio>
 #include <set>
+#include <sys/resource.h>
 
 namespace vg {
 
@@ -83,6 +85,20 @@ int get_thread_count(void) {
     return thread_count;
 }
 
+size_t get_peak_rss_bytes(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // Mac reports in bytes
+    return usage.ru_maxrss;
+#else
+    // Linux reports in kilobytes
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+}
+
 std::vector<std::string> &split_delims(const std::string &s, const std::string& delims, std::vector<std::string> &elems) {
     char* tok;
     char cchars [s.size()+1];
@@ -343,9 +359,8 @@ void get_input_file(const string& file_name, function<void(istream&)> callback)
         // Just use standard input
         callback(std::cin);
     } else {
-        // Open a file
-        ifstream in;
-        in.open(file_name.c_str());
+        // Open a file, and read it ahead in the background
+        ReadAheadFileStream in(file_name);
         if (!in.is_open()) {
             // The user gave us a bad filename
             cerr << "error:[get_input_file] could not open file \"" << file_name << "\"" << endl;
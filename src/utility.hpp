@@ -30,6 +30,9 @@ void reverse_complement_in_place(string& seq);
 /// otherwise.
 bool is_all_n(const string& seq);
 int get_thread_count(void);
+/// Get the peak resident set size of this process so far, in bytes, or 0 if it
+/// can't be determined.
+size_t get_peak_rss_bytes(void);
 string wrap_text(const string& str, size_t width);
 bool is_number(const string& s);
 
@@ -44,6 +44,8 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
     
     // Make a buffer
     WindowedVcfBuffer buffer(vcf, variant_range);
+    // Parse variants while we work on aligning the previous ones
+    buffer.start_read_ahead();
     
     // Count how many variants we have done
     size_t variants_processed = 0;
@@ -55,6 +57,53 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
     // We report when we skip contigs, but only once.
     set<string> skipped_contigs;
     
+    // Windows are read from the buffer serially, since it owns the variants,
+    // and then aligned to the graph in parallel. The synchronizer gives each
+    // thread its own copy of the subgraph it is working on, makes threads with
+    // overlapping windows wait for each other, and serializes the edits.
+    vector<VariantWindow> batch;
+    auto align_batch = [&]() {
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch.size(); i++) {
+            auto& window = batch[i];
+            
+            // Track the total bp of haplotypes
+            size_t total_haplotype_bases = 0;
+            // Track the total graph size for the alignments
+            size_t total_graph_bases = 0;
+            // How many haplotypes actually pass any haplotype filtering?
+            size_t used_haplotypes = 0;
+            
+            align_window(window, total_haplotype_bases, total_graph_bases, used_haplotypes);
+            
+            if (print_updates) {
+                #pragma omp critical (cerr)
+                cerr << "Variant " << variants_processed++ << ": " << window.haplotype_count << " haplotypes at "
+                    << window.sequence_name << ":" << window.position << ": "
+                    << (used_haplotypes ? (total_haplotype_bases / used_haplotypes) : 0) << " bp vs. "
+                    << (used_haplotypes ? (total_graph_bases / used_haplotypes) : 0) << " bp haplotypes vs. graphs average"
+                    << (window.over_budget ? " (over budget, aligned alone)" : "") << endl;
+            }
+        }
+        batch.clear();
+        
+#ifdef debug
+        // Count our current heads and tails
+        graph.head_nodes(to_count);
+        size_t head_count = to_count.size();
+        to_count.clear();
+        graph.tail_nodes(to_count);
+        size_t tail_count = to_count.size();
+        to_count.clear();
+        
+        cerr << "Heads count: " << head_count << ", Tail count: " << tail_count << endl;
+
+        if (head_count != head_expected || tail_count != tail_expected) {
+            cerr << "Error! Count mismatch!" << endl;
+        }
+#endif
+    };
+    
     while(buffer.next()) {
         // For each variant in its context of nonoverlapping variants
         vcflib::Variant* variant;
@@ -99,7 +148,6 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
         const string& path_sequence = sync.get_path_sequence(variant_path_name);
     
         // Interlude: do the progress bar
-        // TODO: not really thread safe
         if (variant_path_name != prev_path_name) {
             // Moved to a new contig
             prev_path_name = variant_path_name;
@@ -120,295 +168,251 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
         // Get the unique haplotypes
         auto haplotypes = get_unique_haplotypes(local_variants, &buffer);
         
-        // Track the total bp of haplotypes
-        size_t total_haplotype_bases = 0;
-        
-        // Track the total graph size for the alignments
-        size_t total_graph_bases = 0;
-        
-        // How many haplotypes actually pass any haplotype filtering?
-        size_t used_haplotypes = 0;
+        // If they would cost too much to align, just do the central variant.
+        bool over_budget = false;
+        if (max_window_haplotype_bases != 0 && local_variants.size() > 1 &&
+            count_haplotype_bases(haplotypes, local_variants) > max_window_haplotype_bases) {
+            over_budget = true;
+            local_variants = {variant};
+            haplotypes = get_unique_haplotypes(local_variants, &buffer);
+        }
             
 #ifdef debug
         cerr << "Have " << haplotypes.size() << " haplotypes for variant "
             << variant->sequenceName << ":" << variant->position << endl;
 #endif
         
+        // Save everything the alignment needs, since the variants will be gone
+        // from the buffer by the time it happens.
+        batch.emplace_back();
+        VariantWindow& window = batch.back();
+        window.path_name = variant_path_name;
+        window.sequence_name = variant->sequenceName;
+        window.position = variant->position;
+        window.haplotype_count = haplotypes.size();
+        window.over_budget = over_budget;
+        
         // Where does the group of nearby variants start?
-        size_t group_start = local_variants.front()->position;
+        window.group_start = local_variants.front()->position;
         // And where does it end (exclusive)? This is the latest ending point of any variant in the group...
-        size_t group_end = local_variants.back()->position + local_variants.back()->ref.size();
+        window.group_end = local_variants.back()->position + local_variants.back()->ref.size();
         
-        // We need to make sure we also grab this much extra graph context,
-        // since we count 2 radiuses + flank out from the ends of the group.
-        size_t group_width = group_end - group_start;
+        window.haplotype_strings = haplotypes_to_strings(haplotypes, local_variants);
         
-        // Find the center and radius of the group of variants, so we know what graph part to grab.
-        size_t overall_center;
-        size_t overall_radius;
-        tie(overall_center, overall_radius) = get_center_and_radius(local_variants);
-
-        // Get the leading and trailing ref sequence on either side of this
-        // group of variants (to pin the outside variants down).
-
-        // On the left we want either flank_range bases, or all the bases before
-        // the first base in the group.
-        size_t left_context_length = min((int64_t) flank_range, (int64_t) group_start);
-        // On the right we want either flank_range bases, or all the bases after
-        // the last base in the group. We know nothing will overlap the end of
-        // the last variant, because we grabbed nonoverlapping variants.
-        size_t right_context_length = min(path_sequence.size() - group_end, (size_t) flank_range);
+        if (batch.size() >= window_batch_size) {
+            align_batch();
+        }
+    }
+    align_batch();
+
+    // Clean up after the last contig.
+    destroy_progress();
     
-        // Turn those into desired substring bounds.
-        // TODO: this is sort of just undoing some math we already did
-        size_t left_context_start = group_start - left_context_length;
-        size_t right_context_past_end = group_end + right_context_length;
-            
+    if (print_updates) {
+        // Report how much the threads got in each other's way
+        auto contention = sync.get_contention_stats();
+        cerr << "Locked " << contention.regions_locked << " regions; waited " << contention.region_waits
+            << " times for regions, " << contention.graph_waits << " times for the graph, and "
+            << contention.index_waits << " times for path indexes" << endl;
+    }
+    
+}
+
+void VariantAdder::align_window(const VariantWindow& window, size_t& total_haplotype_bases,
+    size_t& total_graph_bases, size_t& used_haplotypes) {
+    
+    // Grab the sequence of the path, which won't change
+    const string& path_sequence = sync.get_path_sequence(window.path_name);
+    
+    size_t group_start = window.group_start;
+    size_t group_end = window.group_end;
+
+    // Get the leading and trailing ref sequence on either side of this
+    // group of variants (to pin the outside variants down).
+
+    // On the left we want either flank_range bases, or all the bases before
+    // the first base in the group.
+    size_t left_context_length = min((int64_t) flank_range, (int64_t) group_start);
+    // On the right we want either flank_range bases, or all the bases after
+    // the last base in the group. We know nothing will overlap the end of
+    // the last variant, because we grabbed nonoverlapping variants.
+    size_t right_context_length = min(path_sequence.size() - group_end, (size_t) flank_range);
+
+    // Turn those into desired substring bounds.
+    // TODO: this is sort of just undoing some math we already did
+    size_t left_context_start = group_start - left_context_length;
+    size_t right_context_past_end = group_end + right_context_length;
+        
 #ifdef debug
-            cerr << "Original context bounds: " << left_context_start << " - " << right_context_past_end << endl;
+    cerr << "Original context bounds: " << left_context_start << " - " << right_context_past_end << endl;
 #endif
 
-        // Find the reference sequence
-        const string& ref_sequence = sync.get_path_sequence(vcf_to_fasta(variant->sequenceName));
-
-        for (auto& haplotype : haplotypes) {
-            // For each haplotype
+    for (auto& haplotype_string : window.haplotype_strings) {
+        // For each non-reference haplotype
+        
+        // TODO: since we lock repeatedly, neighboring variants will come in
+        // in undefined order and our result is nondeterministic.
+        
+        // This lets us know if we need to walk out more to find matchable sequence
+        bool have_dangling_ends;
+        do {
+            // We need to be able to increase our bounds until we haven't
+            // shifted an indel to the border of our context.
             
-            // TODO: since we lock repeatedly, neighboring variants will come in
-            // in undefined order and our result is nondeterministic.
+            // Round bounds to node start and endpoints.
+            // This haplotype and all subsequent ones will be aligned with this wider context.
+            sync.with_path_index(window.path_name, [&](const PathIndex& index) {
+                tie(left_context_start, right_context_past_end) = index.round_outward(left_context_start,
+                    right_context_past_end);
+            });
             
-            // Only look at haplotypes that aren't pure reference.
-            bool has_nonreference = false;
-            for (auto& allele : haplotype) {
-                if (allele != 0) {
-                    has_nonreference = true;
-                    break;
-                }
-            }
-            if (!has_nonreference) {
-                // Don't bother aligning all-ref haplotypes to the graph.
-                // They're there already.
 #ifdef debug
-                cerr << "Skip all-reference haplotype." << endl;
+            cerr << "New context bounds: " << left_context_start << " - " << right_context_past_end << endl;
 #endif
-                continue;
-            }
+            
+            // Recalculate context lengths
+            left_context_length = group_start - left_context_start;
+            right_context_length = right_context_past_end - group_end;
+            
+            // Get actual context strings
+            string left_context = path_sequence.substr(group_start - left_context_length, left_context_length);
+            string right_context = path_sequence.substr(group_end, right_context_length);
+            
+            // Make the haplotype's combined string
+            stringstream to_align;
+            to_align << left_context << haplotype_string << right_context;
             
 #ifdef debug
-            cerr << "Haplotype ";
-            for (auto& allele_number : haplotype) {
-                cerr << allele_number << " ";
-            }
-            cerr << endl;
+            cerr << "Align " << to_align.str() << endl;
 #endif
 
-            // This lets us know if we need to walk out more to find matchable sequence
-            bool have_dangling_ends;
-            do {
-                // We need to be able to increase our bounds until we haven't
-                // shifted an indel to the border of our context.
-                
-                // Round bounds to node start and endpoints.
-                // This haplotype and all subsequent ones will be aligned with this wider context.
-                sync.with_path_index(variant_path_name, [&](const PathIndex& index) {
-                    tie(left_context_start, right_context_past_end) = index.round_outward(left_context_start,
-                        right_context_past_end);
-                });
-                
+            // Make a request to lock the subgraph, leaving the nodes we rounded
+            // to (or the child nodes they got broken into) as heads/tails.
+            GraphSynchronizer::Lock lock(sync, window.path_name, left_context_start, right_context_past_end);
+            
 #ifdef debug
-                cerr << "New context bounds: " << left_context_start << " - " << right_context_past_end << endl;
+            cerr << "Waiting for lock on " << window.path_name << ":"
+                << left_context_start << "-" << right_context_past_end << endl;
 #endif
-                
-                // Recalculate context lengths
-                left_context_length = group_start - left_context_start;
-                right_context_length = right_context_past_end - group_end;
-                
-                // Make sure we pull out out to the ends of the contexts
-                overall_radius = max(overall_radius, max(overall_center - left_context_start,
-                    right_context_past_end - overall_center));
-                
-                // Get actual context strings
-                string left_context = path_sequence.substr(group_start - left_context_length, left_context_length);
-                string right_context = path_sequence.substr(group_end, right_context_length);
-                
-                // Make the haplotype's combined string
-                stringstream to_align;
-                to_align << left_context << haplotype_to_string(haplotype, local_variants) << right_context;
+            
+            // Block until we get it
+            lock_guard<GraphSynchronizer::Lock> guard(lock);
+            
+#ifdef debug
+            cerr << "Got lock on " << window.path_name << ":"
+                << left_context_start << "-" << right_context_past_end << endl;
+#endif            
                 
 #ifdef debug
-                cerr << "Align " << to_align.str() << endl;
+            cerr << "Got " << lock.get_subgraph().length() << " bp in " << lock.get_subgraph().size() << " nodes" << endl;
 #endif
 
-                // Make a request to lock the subgraph, leaving the nodes we rounded
-                // to (or the child nodes they got broken into) as heads/tails.
-                GraphSynchronizer::Lock lock(sync, variant_path_name, left_context_start, right_context_past_end);
-                
 #ifdef debug
-                cerr << "Waiting for lock on " << variant_path_name << ":"
-                    << left_context_start << "-" << right_context_past_end << endl;
-#endif
+            ofstream seq_dump("seq_dump.txt");
+            seq_dump << to_align.str();
+            seq_dump.close();
+
+            sync.with_path_index(window.path_name, [&](const PathIndex& index) {
+                // Make sure we actually have the endpoints we wanted
+                auto found_left = index.find_position(left_context_start);
+                auto found_right = index.find_position(right_context_past_end - 1);
+                assert(left_context_start == found_left->first);
+                assert(right_context_past_end == found_right->first + index.node_length(found_right));
                 
-                // Block until we get it
-                lock_guard<GraphSynchronizer::Lock> guard(lock);
+                cerr << "Group runs " << group_start << "-" << group_end << endl;
+                cerr << "Context runs " << left_context_start << "-" << right_context_past_end << ": "
+                    << right_context_past_end - left_context_start  << " bp" << endl;
+                cerr << "Sequence is " << to_align.str().size() << " bp" << endl;
+                cerr << "Leftmost node is " << found_left->second << endl;
+                cerr << "Leftmost Sequence: " << lock.get_subgraph().get_node(found_left->second.node)->sequence() << endl;
+                cerr << "Rightmost node is " << found_right->second << endl;
+                cerr << "Rightmost Sequence: " << lock.get_subgraph().get_node(found_right->second.node)->sequence() << endl;
+                cerr << "Left context: " << left_context << endl;
+                cerr << "Right context: " << right_context << endl;
                 
-#ifdef debug
-                cerr << "Got lock on " << variant_path_name << ":"
-                    << left_context_start << "-" << right_context_past_end << endl;
-#endif            
-                    
-#ifdef debug
-                cerr << "Got " << lock.get_subgraph().length() << " bp in " << lock.get_subgraph().size() << " nodes" << endl;
-#endif
-
-#ifdef debug
-                ofstream seq_dump("seq_dump.txt");
-                seq_dump << to_align.str();
-                seq_dump.close();
-
-                sync.with_path_index(variant_path_name, [&](const PathIndex& index) {
-                    // Make sure we actually have the endpoints we wanted
-                    auto found_left = index.find_position(left_context_start);
-                    auto found_right = index.find_position(right_context_past_end - 1);
-                    assert(left_context_start == found_left->first);
-                    assert(right_context_past_end == found_right->first + index.node_length(found_right));
-                    
-                    cerr << "Group runs " << group_start << "-" << group_end << endl;
-                    cerr << "Context runs " << left_context_start << "-" << right_context_past_end << ": "
-                        << right_context_past_end - left_context_start  << " bp" << endl;
-                    cerr << "Sequence is " << to_align.str().size() << " bp" << endl;
-                    cerr << "Leftmost node is " << found_left->second << endl;
-                    cerr << "Leftmost Sequence: " << lock.get_subgraph().get_node(found_left->second.node)->sequence() << endl;
-                    cerr << "Rightmost node is " << found_right->second << endl;
-                    cerr << "Rightmost Sequence: " << lock.get_subgraph().get_node(found_right->second.node)->sequence() << endl;
-                    cerr << "Left context: " << left_context << endl;
-                    cerr << "Right context: " << right_context << endl;
-                    
-                    lock.get_subgraph().for_each_node([&](Node* node) {
-                        // Look at nodes
-                        if (index.by_id.count(node->id())) {
-                            cerr << "Node " << node->id() << " at " << index.by_id.at(node->id()).first
-                                << " orientation " << index.by_id.at(node->id()).second << endl;
-                        } else {
-                            cerr << "Node " << node->id() << " not on path" << endl;
-                        }
-                    });
-                    
-                    if (lock.get_subgraph().is_acyclic()) {
-                        cerr << "Subgraph is acyclic" << endl;
+                lock.get_subgraph().for_each_node([&](Node* node) {
+                    // Look at nodes
+                    if (index.by_id.count(node->id())) {
+                        cerr << "Node " << node->id() << " at " << index.by_id.at(node->id()).first
+                            << " orientation " << index.by_id.at(node->id()).second << endl;
                     } else {
-                        cerr << "Subgraph is cyclic" << endl;
+                        cerr << "Node " << node->id() << " not on path" << endl;
                     }
                 });
-#endif
-                
-                // Work out how far we would have to unroll the graph to account for
-                // a giant deletion. We also want to account for alts that may
-                // already be in the graph and need unrolling for a long insert.
-                size_t max_span = max(right_context_past_end - left_context_start, to_align.str().size());
-                
-                // Do the alignment, dispatching cleverly on size
-                Alignment aln = smart_align(lock.get_subgraph(), lock.get_endpoints(), to_align.str(), max_span);
                 
-#ifdef debug
-                cerr << "Postprocessed: " << pb2json(aln) << endl;
+                if (lock.get_subgraph().is_acyclic()) {
+                    cerr << "Subgraph is acyclic" << endl;
+                } else {
+                    cerr << "Subgraph is cyclic" << endl;
+                }
+            });
 #endif
-                
-                // Look at the ends of the alignment
-                assert(aln.path().mapping_size() > 0);
-                auto& last_mapping = aln.path().mapping(aln.path().mapping_size() - 1);
-                assert(last_mapping.edit_size() > 0);
-                auto& last_edit = last_mapping.edit(last_mapping.edit_size() - 1);
-                auto& first_mapping = aln.path().mapping(0);
-                assert(first_mapping.edit_size() > 0);
-                auto& first_edit = first_mapping.edit(0);
-                
-                // Assume they aren't dangling
-                have_dangling_ends = false;
-                
-                if (!edit_is_match(first_edit) && left_context_start > 0) {
-                    // Actually the left end is dangling, so try looking left
-                    have_dangling_ends = true;
-                    left_context_start--;
+            
+            // Work out how far we would have to unroll the graph to account for
+            // a giant deletion. We also want to account for alts that may
+            // already be in the graph and need unrolling for a long insert.
+            size_t max_span = max(right_context_past_end - left_context_start, to_align.str().size());
+            
+            // Do the alignment, dispatching cleverly on size
+            Alignment aln = smart_align(lock.get_subgraph(), lock.get_endpoints(), to_align.str(), max_span);
+            
 #ifdef debug
-                    cerr << "Left end dangled!" << endl;
+            cerr << "Postprocessed: " << pb2json(aln) << endl;
 #endif
-                }
-                
-                if (!edit_is_match(last_edit) && right_context_past_end < ref_sequence.size()) {
-                    // Actually the right end is dangling, so try looking right
-                    have_dangling_ends = true;
-                    right_context_past_end++;
+            
+            // Look at the ends of the alignment
+            assert(aln.path().mapping_size() > 0);
+            auto& last_mapping = aln.path().mapping(aln.path().mapping_size() - 1);
+            assert(last_mapping.edit_size() > 0);
+            auto& last_edit = last_mapping.edit(last_mapping.edit_size() - 1);
+            auto& first_mapping = aln.path().mapping(0);
+            assert(first_mapping.edit_size() > 0);
+            auto& first_edit = first_mapping.edit(0);
+            
+            // Assume they aren't dangling
+            have_dangling_ends = false;
+            
+            if (!edit_is_match(first_edit) && left_context_start > 0) {
+                // Actually the left end is dangling, so try looking left
+                have_dangling_ends = true;
+                left_context_start--;
 #ifdef debug
-                    cerr << "Right end dangled!" << endl;
+                cerr << "Left end dangled!" << endl;
 #endif
-                }
-                
-                if (!have_dangling_ends) {
-                    
-                    // Make this path's edits to the original graph. We don't need to do
-                    // anything with the translations.
-                    lock.apply_full_length_edit(aln.path());
-                    
-                    // Count all the bases in the haplotype
-                    total_haplotype_bases += to_align.str().size();
-                    // Record the size of graph we're aligning to in bases
-                    total_graph_bases += lock.get_subgraph().length();
-                    // Record the haplotype as used
-                    used_haplotypes++;
-                    
-                    
-                } else {
+            }
+            
+            if (!edit_is_match(last_edit) && right_context_past_end < path_sequence.size()) {
+                // Actually the right end is dangling, so try looking right
+                have_dangling_ends = true;
+                right_context_past_end++;
 #ifdef debug
-                    cerr << "Expand context and retry" << endl;
+                cerr << "Right end dangled!" << endl;
 #endif
-                }
-                // If we have dangling ends, we try again with our expanded context
+            }
+            
+            if (!have_dangling_ends) {
                 
-            } while (have_dangling_ends);
-        }
-        
-        if (print_updates && (variants_processed++ % 1000 == 0 || true)) {
-            #pragma omp critical (cerr)
-            cerr << "Variant " << variants_processed << ": " << haplotypes.size() << " haplotypes at "
-                << variant->sequenceName << ":" << variant->position << ": "
-                << (used_haplotypes ? (total_haplotype_bases / used_haplotypes) : 0) << " bp vs. "
-                << (used_haplotypes ? (total_graph_bases / used_haplotypes) : 0) << " bp haplotypes vs. graphs average" << endl;
-        }
-        
-        
+                // Make this path's edits to the original graph. We don't need to do
+                // anything with the translations.
+                lock.apply_full_length_edit(aln.path());
+                
+                // Count all the bases in the haplotype
+                total_haplotype_bases += to_align.str().size();
+                // Record the size of graph we're aligning to in bases
+                total_graph_bases += lock.get_subgraph().length();
+                // Record the haplotype as used
+                used_haplotypes++;
+                
+                
+            } else {
 #ifdef debug
-        // Count our current heads and tails
-        graph.head_nodes(to_count);
-        size_t head_count = to_count.size();
-        cerr << "Heads: ";
-        for(auto head : to_count) {
-            cerr << head->id() << " ";
-        }
-        cerr << endl;
-        to_count.clear();
-        graph.tail_nodes(to_count);
-        cerr << "Tails: ";
-        for(auto tail : to_count) {
-            cerr << tail->id() << " ";
-        }
-        cerr << endl;
-        size_t tail_count = to_count.size();
-        to_count.clear();
-        
-        cerr << "Heads count: " << head_count << ", Tail count: " << tail_count << endl;
-
-        if (head_count != head_expected || tail_count != tail_expected) {
-            cerr << "Error! Count mismatch!" << endl;
-            // Bail out but serialize the graph
-            return;
-        }
+                cerr << "Expand context and retry" << endl;
 #endif
-        
+            }
+            // If we have dangling ends, we try again with our expanded context
+            
+        } while (have_dangling_ends);
     }
-
-    // Clean up after the last contig.
-    destroy_progress();
-    
 }
 
 void VariantAdder::align_ns(vg::VG& graph, Alignment& aln) {
@@ -1006,50 +1010,114 @@ set<vector<int>> VariantAdder::get_unique_haplotypes(const vector<vcflib::Varian
     
 }
 
-string VariantAdder::haplotype_to_string(const vector<int>& haplotype, const vector<vcflib::Variant*>& variants) {
-    // We'll fill this in with variants and separating sequences.
-    stringstream result;
+vector<string> VariantAdder::haplotypes_to_strings(const set<vector<int>>& haplotypes,
+    const vector<vcflib::Variant*>& variants) {
     
-    // These lists need to be in 1 to 1 correspondence
-    assert(haplotype.size() == variants.size());
+    // We'll fill this in with one string per non-reference haplotype.
+    vector<string> strings;
     
-    if (variants.empty()) {
-        // No variants means no string representation.
-        return "";
-    }
+    // This holds the reference sequence between each variant and the one
+    // before it, once we need it.
+    vector<string> separators;
     
-    // Do the first variant
-    result << variants.front()->alleles.at(haplotype.at(0));
+    // This is the string for the last haplotype we did, and where in it each
+    // variant's separator and allele start.
+    string current;
+    vector<size_t> variant_starts(variants.size());
+    const vector<int>* previous = nullptr;
     
-    for (size_t i = 1; i < variants.size(); i++) {
-        // For each subsequent variant
-        auto* variant = variants.at(i);
-        auto* last_variant = variants.at(i - 1);
+    for (auto& haplotype : haplotypes) {
+        // These lists need to be in 1 to 1 correspondence
+        assert(haplotype.size() == variants.size());
         
-        // Do the intervening sequence.
-        // Where does that sequence start?
-        size_t sep_start = last_variant->position + last_variant->ref.size();
-        // And how long does it run?
-        size_t sep_length = variant->position - sep_start;
+        // Only look at haplotypes that aren't pure reference.
+        if (all_of(haplotype.begin(), haplotype.end(), [](int allele) { return allele == 0; })) {
+            // Don't bother aligning all-ref haplotypes to the graph.
+            // They're there already.
+#ifdef debug
+            cerr << "Skip all-reference haplotype." << endl;
+#endif
+            continue;
+        }
         
-        // Find the sequence to pull from
-        auto& ref = sync.get_path_sequence(vcf_to_fasta(variant->sequenceName));
+#ifdef debug
+        cerr << "Haplotype ";
+        for (auto& allele_number : haplotype) {
+            cerr << allele_number << " ";
+        }
+        cerr << endl;
+#endif
         
-        // Pull out the separator sequence and tack it on.
-        result << ref.substr(sep_start, sep_length);
-
-        // Then put the appropriate allele of this variant.
-        result << variant->alleles.at(haplotype.at(i));
+        if (separators.empty()) {
+            separators.resize(variants.size());
+            for (size_t i = 1; i < variants.size(); i++) {
+                // For each subsequent variant
+                auto* variant = variants.at(i);
+                auto* last_variant = variants.at(i - 1);
+                
+                // Do the intervening sequence.
+                // Where does that sequence start?
+                size_t sep_start = last_variant->position + last_variant->ref.size();
+                // And how long does it run?
+                size_t sep_length = variant->position - sep_start;
+                
+                // Find the sequence to pull from
+                auto& ref = sync.get_path_sequence(vcf_to_fasta(variant->sequenceName));
+                
+                // Pull out the separator sequence.
+                separators[i] = ref.substr(sep_start, sep_length);
+                
+                if (variant->alleles.at(0) != ref.substr(sep_start + sep_length, variant->alleles.at(0).size())) {
+                    // Complain if the variant reference doesn't match the real reference.
+                    throw runtime_error("Variant reference does not match actual reference at " +
+                        variant->sequenceName + ":" + to_string(variant->position));
+                }
+            }
+        }
+        
+        // Keep the alleles we share with the last haplotype
+        size_t shared = 0;
+        if (previous != nullptr) {
+            while (shared < variants.size() && (*previous)[shared] == haplotype[shared]) {
+                shared++;
+            }
+        }
+        current.resize(shared == 0 ? 0 : variant_starts[shared]);
         
-        if (variant->alleles.at(0) != ref.substr(sep_start + sep_length, variant->alleles.at(0).size())) {
-            // Complain if the variant reference doesn't match the real reference.
-            // TODO: should avoid doing this for every single haplotype...
-            throw runtime_error("Variant reference does not match actual reference at " +
-                variant->sequenceName + ":" + to_string(variant->position));
+        for (size_t i = shared; i < variants.size(); i++) {
+            // Put the separator and then the appropriate allele of each
+            // variant after that.
+            variant_starts[i] = current.size();
+            current += separators[i];
+            current += variants[i]->alleles.at(haplotype[i]);
         }
+        
+        strings.push_back(current);
+        previous = &haplotype;
+    }
+    
+    return strings;
+}
+
+size_t VariantAdder::count_haplotype_bases(const set<vector<int>>& haplotypes,
+    const vector<vcflib::Variant*>& variants) {
+    
+    if (variants.empty()) {
+        return 0;
     }
     
-    return result.str();
+    // Every haplotype spans the whole group, with each allele changing its
+    // length by how much it differs from the reference allele.
+    size_t span = variants.back()->position + variants.back()->ref.size() - variants.front()->position;
+    size_t total = 0;
+    for (auto& haplotype : haplotypes) {
+        int64_t length = span;
+        for (size_t i = 0; i < variants.size(); i++) {
+            length += (int64_t) variants[i]->alleles.at(haplotype[i]).size() - (int64_t) variants[i]->ref.size();
+        }
+        total += length;
+    }
+    return total;
 }
 
 size_t VariantAdder::get_radius(const vcflib::Variant& variant) {
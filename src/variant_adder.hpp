@@ -37,7 +37,8 @@ public:
      * freshly opened. The variants in the file must be sorted.
      *
      * May be called from multiple threads. Synchronizes internally on the
-     * graph.
+     * graph. Windows of variants are aligned to the graph in parallel, in
+     * batches of window_batch_size.
      */
     void add_variants(vcflib::VariantCallFile* vcf);
     
@@ -135,6 +136,17 @@ public:
     /// processed?
     bool print_updates = false;
     
+    /// How many windows of variants should we read from the VCF before
+    /// aligning them all in parallel?
+    size_t window_batch_size = 1000;
+    
+    /// If nonzero, the most haplotype sequence in bp we are willing to align
+    /// for a window. Dense clusters of variants can have huge numbers of
+    /// unique haplotypes; windows over this budget have the variant they are
+    /// around aligned alone instead, leaving its neighbors to their own
+    /// windows.
+    size_t max_window_haplotype_bases = 0;
+    
 protected:
     /// The graph we are modifying
     VG& graph;
@@ -147,6 +159,42 @@ protected:
     /// without locking the graph.
     set<string> path_names;
     
+    /**
+     * A group of nearby variants read from the VCF, with the sequences of all
+     * its non-reference haplotypes, so it can be aligned to the graph after
+     * the variants themselves are gone from the buffer.
+     */
+    struct VariantWindow {
+        /// The graph path the variants are on
+        string path_name;
+        /// The VCF contig and 0-based position of the variant the window is
+        /// around, for reporting
+        string sequence_name;
+        size_t position;
+        /// Where does the group of variants start on the path?
+        size_t group_start;
+        /// And where does it end (exclusive)?
+        size_t group_end;
+        /// How many unique haplotypes were there, including reference ones?
+        size_t haplotype_count;
+        /// Was the window over budget, so only the central variant is used?
+        bool over_budget;
+        /// The sequence from group_start to group_end of each unique
+        /// non-reference haplotype
+        vector<string> haplotype_strings;
+    };
+    
+    /**
+     * Align the haplotypes of a window, with flanking reference context, to
+     * a locked copy of that part of the graph, and edit them into the graph.
+     * Adds the haplotype and graph bases aligned, and the haplotypes used, to
+     * the given totals.
+     *
+     * May be called from multiple threads.
+     */
+    void align_window(const VariantWindow& window, size_t& total_haplotype_bases,
+        size_t& total_graph_bases, size_t& used_haplotypes);
+    
     /**
      * Get all the unique combinations of variant alts represented by actual
      * haplotypes. Arbitrarily phases unphased variants.
@@ -163,14 +211,26 @@ protected:
     set<vector<int>> get_unique_haplotypes(const vector<vcflib::Variant*>& variants, WindowedVcfBuffer* cache = nullptr) const;
     
     /**
-     * Convert a haplotype on a list of variants into a string. The string will
-     * run from the start of the first variant through the end of the last
-     * variant.
+     * Convert the haplotypes on a list of variants that aren't all reference
+     * into strings, in order. The strings will run from the start of the first
+     * variant through the end of the last variant.
+     *
+     * Since the set is sorted, haplotypes sharing leading alleles come
+     * together, like the leaves of a trie, and each string is built by
+     * extending the part it shares with the one before.
      *
      * Can't be const because it relies on non-const operations on the
      * synchronizer.
      */
-    string haplotype_to_string(const vector<int>& haplotype, const vector<vcflib::Variant*>& variants);
+    vector<string> haplotypes_to_strings(const set<vector<int>>& haplotypes,
+        const vector<vcflib::Variant*>& variants);
+    
+    /**
+     * Get the total length of the strings that haplotypes_to_strings would
+     * make for the given haplotypes, without making them.
+     */
+    static size_t count_haplotype_bases(const set<vector<int>>& haplotypes,
+        const vector<vcflib::Variant*>& variants);
     
     /**
      * Get the radius of the variant around its center: the amount of sequence
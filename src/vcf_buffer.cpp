@@ -6,6 +6,8 @@
 
 #include "vcf_buffer.hpp"
 
+#include <algorithm>
+
 namespace vg {
 
 using namespace std;
@@ -27,6 +29,25 @@ void VcfBuffer::handle_buffer() {
 }
 
 void VcfBuffer::fill_buffer() {
+    if (max_ahead != 0) {
+        // Take the next variant from the read-ahead thread instead.
+        if (!has_buffer) {
+            unique_lock<mutex> lock(queue_lock);
+            queue_not_empty.wait(lock, [&]() {
+                return !ready_variants.empty() || file_done;
+            });
+            if (!ready_variants.empty()) {
+                buffer = std::move(ready_variants.front());
+                ready_variants.pop_front();
+                has_buffer = true;
+                queue_not_full.notify_one();
+            } else if (reader_error) {
+                rethrow_exception(reader_error);
+            }
+        }
+        return;
+    }
+    
     if(file != nullptr && file->is_open() && !has_buffer && safe_to_get) {
         // Put a new variant in the buffer if we have a file and the buffer was empty.
         has_buffer = safe_to_get = file->getNextVariant(buffer);
@@ -51,6 +72,10 @@ bool VcfBuffer::set_region(const string& contig, int64_t start, int64_t end) {
         return false;
     }
 
+    // The read-ahead thread can't be reading while we seek, and what it read
+    // is from the wrong place.
+    stop_read_ahead();
+
     // Discard any variants we had.
     has_buffer = false;
     
@@ -58,13 +83,100 @@ bool VcfBuffer::set_region(const string& contig, int64_t start, int64_t end) {
     // of the VCF.
     safe_to_get = true;
 
+    bool found;
     if(start != -1 && end != -1) {
         // We have a start and end
-        return file->setRegion(contig, start, end);
+        found = file->setRegion(contig, start, end);
     } else {
         // Just seek to the whole chromosome
-        return file->setRegion(contig);
+        found = file->setRegion(contig);
+    }
+    
+    if (max_ahead != 0) {
+        if (found) {
+            // Start reading ahead from the region
+            reader = thread(&VcfBuffer::read_ahead, this);
+        } else {
+            // We mustn't read after a failed seek, so there's nothing to get.
+            file_done = true;
+        }
+    }
+    
+    return found;
+}
+
+void VcfBuffer::start_read_ahead(size_t max_ahead) {
+    if (file == nullptr || !file->is_open() || this->max_ahead != 0) {
+        // Nothing to read, or we're already reading it
+        return;
+    }
+    this->max_ahead = max(max_ahead, (size_t) 1);
+    
+    // Anything already buffered came before what the thread will read, so it
+    // stays where it is.
+    if (safe_to_get) {
+        reader = thread(&VcfBuffer::read_ahead, this);
+    } else {
+        file_done = true;
+    }
+}
+
+void VcfBuffer::set_parse_samples(bool parse_samples) {
+    if (file != nullptr) {
+        file->parseSamples = parse_samples;
+    }
+}
+
+void VcfBuffer::read_ahead() {
+    try {
+        while (true) {
+            {
+                unique_lock<mutex> lock(queue_lock);
+                queue_not_full.wait(lock, [&]() {
+                    return stopping || ready_variants.size() < max_ahead;
+                });
+                if (stopping) {
+                    return;
+                }
+            }
+            
+            vcflib::Variant variant;
+            variant.setVariantCallFile(file);
+            bool got = file->getNextVariant(variant);
+            
+            lock_guard<mutex> lock(queue_lock);
+            if (!got) {
+                // vcflib can't be asked again after it runs out
+                file_done = true;
+                queue_not_empty.notify_one();
+                return;
+            }
+            // Convert to 0-based positions, as fill_buffer would.
+            variant.position -= 1;
+            ready_variants.push_back(std::move(variant));
+            queue_not_empty.notify_one();
+        }
+    } catch (...) {
+        lock_guard<mutex> lock(queue_lock);
+        reader_error = current_exception();
+        file_done = true;
+        queue_not_empty.notify_one();
+    }
+}
+
+void VcfBuffer::stop_read_ahead() {
+    if (reader.joinable()) {
+        {
+            lock_guard<mutex> lock(queue_lock);
+            stopping = true;
+        }
+        queue_not_full.notify_one();
+        reader.join();
     }
+    ready_variants.clear();
+    file_done = false;
+    stopping = false;
+    reader_error = nullptr;
 }
 
 VcfBuffer::VcfBuffer(vcflib::VariantCallFile* file) : file(file) {
@@ -77,6 +189,10 @@ VcfBuffer::VcfBuffer(vcflib::VariantCallFile* file) : file(file) {
     }
 }
 
+VcfBuffer::~VcfBuffer() {
+    stop_read_ahead();
+}
+
 
 WindowedVcfBuffer::WindowedVcfBuffer(vcflib::VariantCallFile* file, size_t window_size): reader(file), window_size(window_size) {
     // Nothing to do!
@@ -95,6 +211,10 @@ bool WindowedVcfBuffer::set_region(const string& contig, int64_t start, int64_t
     return reader.set_region(contig, start, end);
 }
 
+void WindowedVcfBuffer::start_read_ahead(size_t max_ahead) {
+    reader.start_read_ahead(max_ahead);
+}
+
 bool WindowedVcfBuffer::next() {
     if (current.get() != nullptr) {
         // Put the current variant on the list of previous variants
@@ -6,7 +6,12 @@
  * look-ahead.
  */
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <list>
+#include <mutex>
+#include <thread>
 #include <tuple>
 
 // We need vcflib
@@ -75,12 +80,34 @@ public:
      */
     bool set_region(const string& contig, int64_t start = -1, int64_t end = -1);
     
+    /**
+     * Start reading and parsing variants on a background thread, keeping up to
+     * max_ahead of them ready for fill_buffer(). Reading ahead restarts from
+     * the new position whenever set_region is called. The file must not be
+     * used by anyone else while we are reading ahead. Does nothing if there
+     * is no file.
+     */
+    void start_read_ahead(size_t max_ahead = 1024);
+    
+    /**
+     * Set whether the sample columns of each variant should be parsed.
+     * Consumers that only need the sites can turn this off, which saves most
+     * of the parsing work on VCFs with many samples. Must be called before
+     * start_read_ahead().
+     */
+    void set_parse_samples(bool parse_samples);
+    
     /**
      * Make a new VcfBuffer buffering the file at the given pointer (which must
      * outlive the buffer, but which may be null).
      */
     VcfBuffer(vcflib::VariantCallFile* file = nullptr);
     
+    /**
+     * Stop reading ahead, if we are.
+     */
+    ~VcfBuffer();
+    
 protected:
     
     // This stores whether the buffer is populated with a valid variant or not
@@ -95,7 +122,34 @@ protected:
     // We can wrap the null file (and never have any variants) with a null here.
     vcflib::VariantCallFile* const file;
     
+    /**
+     * Body of the read-ahead thread: parse variants into the queue until the
+     * file runs out or we are told to stop.
+     */
+    void read_ahead();
+    
+    /**
+     * Stop the read-ahead thread, if it is running, and discard whatever it
+     * had queued up.
+     */
+    void stop_read_ahead();
     
+    // How many variants to queue up ahead of the consumer, or 0 if we aren't
+    // reading ahead.
+    size_t max_ahead = 0;
+    // Protects everything that is shared with the read-ahead thread.
+    mutex queue_lock;
+    // Signaled when a variant is queued or the file runs out.
+    condition_variable queue_not_empty;
+    // Signaled when a variant is taken or we want the thread to stop.
+    condition_variable queue_not_full;
+    deque<vcflib::Variant> ready_variants;
+    bool file_done = false;
+    bool stopping = false;
+    // Set if the read-ahead thread hit an exception, to be rethrown to the
+    // consumer.
+    exception_ptr reader_error;
+    thread reader;
 
 private:
     // Don't copy these or it will break the buffering semantics.
@@ -181,6 +235,12 @@ public:
      */
     bool set_region(const string& contig, int64_t start = -1, int64_t end = -1);
     
+    /**
+     * Start reading and parsing variants on a background thread, keeping up to
+     * max_ahead of them ready. See VcfBuffer::start_read_ahead().
+     */
+    void start_read_ahead(size_t max_ahead = 1024);
+    
 protected:
     
     /**
@@ -68,51 +68,55 @@ void Vectorizer::add_name(string n){
     my_names.push_back(n);
 }
 
-vector<int> Vectorizer::alignment_to_a_hot(Alignment a){
-    int64_t entity_size = my_xg->node_count;
-    vector<int> ret(entity_size, 0);
-    Path path = a.path();
+/// Get the value of each node the alignment visits, in node rank order, as
+/// (rank - 1, value) pairs. Later mappings to a node override earlier ones,
+/// and zero values are left out.
+template<typename T>
+static vector<pair<size_t, T>> sparse_node_values(xg::XG* xg_index, const Alignment& a,
+                                                  const function<T(const Mapping&)>& value){
+    vector<pair<size_t, T>> ret;
+    const Path& path = a.path();
     for (int i = 0; i < path.mapping_size(); i++){
-        Mapping mapping = path.mapping(i);
+        const Mapping& mapping = path.mapping(i);
         if(! mapping.has_position()){
             continue;
         }
-        Position pos = mapping.position();
-        int64_t node_id = pos.node_id();
+        int64_t node_id = mapping.position().node_id();
         if (!node_id) continue;
-        int64_t key = my_xg->id_to_rank(node_id);
-        vector<size_t> node_paths = my_xg->paths_of_node(node_id);
-        if (node_paths.size() > 0){
-            ret[key - 1] = 2;
+        ret.emplace_back(xg_index->id_to_rank(node_id) - 1, value(mapping));
+    }
+    stable_sort(ret.begin(), ret.end(), [](const pair<size_t, T>& x, const pair<size_t, T>& y){
+        return x.first < y.first;
+    });
+    // keep the last value for each node, if it isn't zero
+    size_t kept = 0;
+    for (size_t i = 0; i < ret.size(); i++){
+        if (i + 1 < ret.size() && ret[i + 1].first == ret[i].first){
+            continue;
         }
-        else{
-            ret[key - 1] = 1;
+        if (ret[i].second != 0){
+            ret[kept++] = ret[i];
         }
     }
+    ret.resize(kept);
     return ret;
 }
 
-vector<double> Vectorizer::alignment_to_identity_hot(Alignment a){
-    int64_t entity_size = my_xg->node_count;
-    vector<double> ret(entity_size, 0.0);
-    Path path = a.path();
-    for (int i = 0; i < path.mapping_size(); i ++){
-        Mapping mapping = path.mapping(i);
-        if(! mapping.has_position()){
-            continue;
-        }
-        Position pos = mapping.position();
-        int64_t node_id = pos.node_id();
-        if (!node_id) continue;
-        int64_t key = my_xg->id_to_rank(node_id);
+vector<pair<size_t, int>> Vectorizer::alignment_to_sparse_a_hot(const Alignment& a){
+    return sparse_node_values<int>(my_xg, a, [&](const Mapping& mapping){
+        vector<size_t> node_paths = my_xg->paths_of_node(mapping.position().node_id());
+        return node_paths.size() > 0 ? 2 : 1;
+    });
+}
 
+vector<pair<size_t, double>> Vectorizer::alignment_to_sparse_identity_hot(const Alignment& a){
+    return sparse_node_values<double>(my_xg, a, [](const Mapping& mapping){
         //Calculate % identity by walking the edits and counting matches.
-        double pct_id = 0.0;
         double match_len = 0.0;
         double total_len = 0.0;
 
         for (int j = 0; j < mapping.edit_size(); j++){
-            Edit e = mapping.edit(j);
+            const Edit& e = mapping.edit(j);
             total_len += e.from_length();
             if (e.from_length() == e.to_length() && e.sequence() == ""){
                 match_len += (double) e.to_length();
@@ -121,32 +125,37 @@ vector<double> Vectorizer::alignment_to_identity_hot(Alignment a){
                 // TODO if we map but don't match exactly, add half the average length to match_length
                 //match_len += (double) (0.5 * ((double) e.to_length()));
             }
-            else{
-                
-            }
-            
         }
-        pct_id = (match_len == 0.0 && total_len == 0.0) ? 0.0 : (match_len / total_len);
-        ret[key - 1] = pct_id;
+        return (match_len == 0.0 && total_len == 0.0) ? 0.0 : (match_len / total_len);
+    });
+}
+
+vector<pair<size_t, int>> Vectorizer::alignment_to_sparse_onehot(const Alignment& a){
+    return sparse_node_values<int>(my_xg, a, [](const Mapping& mapping){
+        return 1;
+    });
+}
+
+vector<int> Vectorizer::alignment_to_a_hot(Alignment a){
+    vector<int> ret(my_xg->node_count, 0);
+    for (auto& entry : alignment_to_sparse_a_hot(a)){
+        ret[entry.first] = entry.second;
+    }
+    return ret;
+}
+
+vector<double> Vectorizer::alignment_to_identity_hot(Alignment a){
+    vector<double> ret(my_xg->node_count, 0.0);
+    for (auto& entry : alignment_to_sparse_identity_hot(a)){
+        ret[entry.first] = entry.second;
     }
     return ret;
 }
 
 bit_vector Vectorizer::alignment_to_onehot(Alignment a){
-    int64_t entity_size = my_xg->node_count;
-    bit_vector ret(entity_size, 0);
-    Path path = a.path();
-    for (int i = 0; i < path.mapping_size(); i++){
-        Mapping mapping = path.mapping(i);
-        if(! mapping.has_position()){
-            continue;
-        }
-        Position pos = mapping.position();
-        int64_t node_id = pos.node_id();
-        if (!node_id) continue;
-        int64_t key = my_xg->id_to_rank(node_id);
-        //Find entity rank of edge
-        ret[key - 1] = 1;
+    bit_vector ret(my_xg->node_count, 0);
+    for (auto& entry : alignment_to_sparse_onehot(a)){
+        ret[entry.first] = 1;
     }
     return ret;
 }
@@ -157,3 +166,75 @@ vector<double> Vectorizer::alignment_to_custom_score(Alignment a, std::function<
 
     return ret;
 }
+
+CSRWriter::CSRWriter(const string& prefix, size_t columns) : prefix(prefix), columns(columns){
+    data.open(prefix + ".data.npy", "<f8");
+    indices.open(prefix + ".indices.npy", "<i8");
+    indptr.open(prefix + ".indptr.npy", "<i8");
+    names.open(prefix + ".names.txt");
+    if (!names){
+        throw runtime_error("[CSRWriter] cannot write " + prefix + ".names.txt");
+    }
+    // every row pointer list starts at 0
+    indptr.write((int64_t) 0);
+}
+
+CSRWriter::~CSRWriter(){
+    if (!closed){
+        try {
+            close();
+        } catch (exception& e) {
+            cerr << e.what() << endl;
+        }
+    }
+}
+
+void CSRWriter::close(){
+    closed = true;
+    data.close();
+    indices.close();
+    indptr.close();
+    names.close();
+    NpyFile shape;
+    shape.open(prefix + ".shape.npy", "<i8");
+    shape.write((int64_t) rows);
+    shape.write((int64_t) columns);
+    shape.close();
+    if (!names){
+        throw runtime_error("[CSRWriter] error writing " + prefix + ".names.txt");
+    }
+}
+
+void CSRWriter::NpyFile::open(const string& filename, const string& descr){
+    this->filename = filename;
+    this->descr = descr;
+    out.open(filename, ios::binary);
+    if (!out){
+        throw runtime_error("[CSRWriter] cannot write " + filename);
+    }
+    write_header();
+}
+
+void CSRWriter::NpyFile::close(){
+    // now that we know the length, fill it in
+    out.seekp(0);
+    write_header();
+    out.close();
+    if (!out){
+        throw runtime_error("[CSRWriter] error writing " + filename);
+    }
+}
+
+void CSRWriter::NpyFile::write_header(){
+    // version 1.0 magic, then the header dict padded with spaces to a fixed
+    // 128 bytes in all, so that it can be rewritten in place
+    const size_t total_size = 128;
+    string header = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (" + to_string(length) + ",), }";
+    size_t header_size = total_size - 10;
+    header.resize(header_size - 1, ' ');
+    header += '\n';
+    out.write("\x93NUMPY\x01\x00", 8);
+    out.put((char) (header_size & 0xFF));
+    out.put((char) (header_size >> 8));
+    out.write(header.data(), header.size());
+}
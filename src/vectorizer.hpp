@@ -1,10 +1,12 @@
 #ifndef VECVEC
 #define VECVEC
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include "sdsl/bit_vectors.hpp"
 #include <vector>
 #include <unordered_map>
+#include <utility>
 #include "vg.hpp"
 #include "xg.hpp"
 #include "vg.pb.h"
@@ -31,6 +33,12 @@ class Vectorizer{
     vector<int> alignment_to_a_hot(Alignment a);
     vector<double> alignment_to_custom_score(Alignment a, std::function<double(Alignment)> lambda);
     vector<double> alignment_to_identity_hot(Alignment a);
+    /// Sparse versions of the vectors above, as (node rank - 1, value) pairs
+    /// for just the nonzero entries, in rank order. These cost time in the
+    /// length of the alignment rather than the size of the graph.
+    vector<pair<size_t, int>> alignment_to_sparse_onehot(const Alignment& a);
+    vector<pair<size_t, int>> alignment_to_sparse_a_hot(const Alignment& a);
+    vector<pair<size_t, double>> alignment_to_sparse_identity_hot(const Alignment& a);
     string output_wabbit_map();
     template<typename T> string format(T v){
         stringstream sout;
@@ -42,6 +50,24 @@ class Vectorizer{
         }
         return sout.str();
     }
+    /// Format a sparse vector as space-separated index:value pairs
+    template<typename T> string format_sparse(const vector<pair<size_t, T>>& v){
+        stringstream sout;
+        for (size_t i = 0; i < v.size(); i++){
+            sout << v[i].first << ":" << v[i].second;
+            if (i + 1 < v.size()){
+                sout << " ";
+            }
+        }
+        return sout.str();
+    }
+    /// Make sure the name has a vowpal wabbit class number, so that
+    /// wabbitize can then be called from several threads
+    void add_wabbit_class(const string& name){
+        if (!(wabbit_map.count(name) > 0)){
+            wabbit_map[name] = wabbit_map.size();
+        }
+    }
     template<typename T> string wabbitize(string name, T v){
         stringstream sout;
         if (!(wabbit_map.count(name) > 0)){
@@ -70,4 +96,62 @@ class Vectorizer{
 
 };
 
+/**
+* Writes vectors as the rows of a compressed sparse row matrix, in NumPy .npy
+* files next to each other: PREFIX.data.npy (float64 values), PREFIX.indices.npy
+* (int64 columns), PREFIX.indptr.npy (int64 row starts) and PREFIX.shape.npy
+* (int64 row and column counts), with row names one per line in
+* PREFIX.names.txt. In Python:
+*
+*     scipy.sparse.csr_matrix((np.load(p + ".data.npy"), np.load(p + ".indices.npy"),
+*         np.load(p + ".indptr.npy")), shape=tuple(np.load(p + ".shape.npy")))
+*
+* Rows are written out as they are added, and the array lengths are filled in
+* on close.
+*/
+class CSRWriter{
+  public:
+    CSRWriter(const string& prefix, size_t columns);
+    ~CSRWriter();
+    template<typename T> void add_row(const string& name, const vector<pair<size_t, T>>& row){
+        for (auto& entry : row){
+            data.write((double) entry.second);
+            indices.write((int64_t) entry.first);
+        }
+        nonzeros += row.size();
+        indptr.write((int64_t) nonzeros);
+        names << name << "\n";
+        rows++;
+    }
+    /// Finish the files. Throws a runtime_error if they couldn't be written.
+    void close();
+  private:
+    /// A one-dimensional .npy array file with a fixed-size header, so that
+    /// the length can be filled in at the end
+    class NpyFile{
+      public:
+        void open(const string& filename, const string& descr);
+        template<typename T> void write(T value){
+            out.write((const char*) &value, sizeof(T));
+            length++;
+        }
+        void close();
+      private:
+        void write_header();
+        ofstream out;
+        string filename;
+        string descr;
+        size_t length = 0;
+    };
+    NpyFile data;
+    NpyFile indices;
+    NpyFile indptr;
+    ofstream names;
+    string prefix;
+    size_t columns;
+    size_t rows = 0;
+    size_t nonzeros = 0;
+    bool closed = false;
+};
+
 #endif
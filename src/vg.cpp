@@ -4,10 +4,12 @@
 // We need to use ultrabubbles for dot output
 #include "genotypekit.hpp"
 #include "algorithms/topological_sort.hpp"
+#include "algorithms/weakly_connected_components.hpp"
 #include <raptor2/raptor2.h>
 #include <stPinchGraphs.h>
 
 #include <stack>
+#include <chrono>
 
 //#define debug
 
@@ -31,15 +33,22 @@ void VG::from_istream(istream& in, bool showp, bool warn_on_duplicates) {
         create_progress("loading graph", count);
     };
 
-    // the graph is read in chunks, which are attached to this graph
+    auto start = chrono::steady_clock::now();
+
+    // the graph is read in chunks, which are parsed on all threads, and
+    // whose nodes and edges are moved into this graph in order without
+    // indexing them
     uint64_t i = 0;
-    function<void(Graph&)> lambda = [this, &i, &warn_on_duplicates](Graph& g) {
+    function<void(Graph&)> lambda = [this, &i](Graph& g) {
         update_progress(++i);
-        // We usually expect these to not overlap in nodes or edges, so complain unless we've been told not to.
-        extend(g, warn_on_duplicates);
+        append_unindexed(g);
     };
 
-    stream::for_each(in, lambda, handle_count);
+    stream::for_each_ordered_parallel(in, lambda, handle_count);
+
+    // Index everything in one pass. We usually expect the chunks to not
+    // overlap in nodes or edges, so complain unless we've been told not to.
+    build_indexes_dropping_duplicates(warn_on_duplicates);
 
     // Collate all the path mappings we got from all the different chunks. A
     // mapping from any chunk might fall anywhere in a path (because paths may
@@ -51,6 +60,16 @@ void VG::from_istream(istream& in, bool showp, bool warn_on_duplicates) {
     paths.to_graph(graph);
 
     destroy_progress();
+
+    if (show_progress) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << "[vg] loaded " << graph.node_size() << " nodes and " << graph.edge_size()
+             << " edges in " << i << " chunks in " << seconds << " s";
+        if (seconds > 0) {
+            cerr << ", " << (size_t)(graph.node_size() / seconds) << " nodes/s";
+        }
+        cerr << endl;
+    }
 }
 
 // construct from an arbitrary source of Graph protobuf messages
@@ -170,9 +189,53 @@ bool VG::follow_edges(const handle_t& handle, bool go_left, const function<bool(
     return true;
 }
 
+void VG::get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& dest) const {
+    dest.clear();
+    
+    bool is_reverse = get_is_reverse(handle);
+    auto& edge_set = (go_left != is_reverse) ? edges_on_start : edges_on_end;
+    
+    auto found = edge_set.find(get_id(handle));
+    if (found != edge_set.end()) {
+        dest.reserve(found->second.size());
+        for (auto& id_and_flip : found->second) {
+            dest.push_back(get_handle(id_and_flip.first, is_reverse != id_and_flip.second));
+        }
+    }
+}
+
+size_t VG::get_degree(const handle_t& handle, bool go_left) const {
+    auto& edge_set = (go_left != get_is_reverse(handle)) ? edges_on_start : edges_on_end;
+    auto found = edge_set.find(get_id(handle));
+    return found == edge_set.end() ? 0 : found->second.size();
+}
+
+void VG::get_lengths(const vector<handle_t>& handles, vector<size_t>& dest) const {
+    dest.resize(handles.size());
+    for (size_t i = 0; i < handles.size(); i++) {
+        dest[i] = get_length(handles[i]);
+    }
+}
+
+void VG::get_sequences(const vector<handle_t>& handles, vector<string>& dest) const {
+    dest.resize(handles.size());
+    for (size_t i = 0; i < handles.size(); i++) {
+        auto found = node_by_id.find(get_id(handles[i]));
+        if (found == node_by_id.end()) {
+            throw runtime_error("No node " + to_string(get_id(handles[i])) + " in graph");
+        }
+        // Copy straight into the destination instead of through a temporary
+        dest[i] = found->second->sequence();
+        if (as_integer(handles[i]) & HIGH_BIT) {
+            reverse_complement_in_place(dest[i]);
+        }
+    }
+}
+
 void VG::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
     if (parallel) {
-#pragma omp parallel for schedule(dynamic,1)
+        // Each thread gets one contiguous run of the backing graph's nodes
+#pragma omp parallel for schedule(static)
         for (id_t i = 0; i < graph.node_size(); ++i) {
             // For each node in the backing graph
             // Get its ID and make a handle to it forward
@@ -1569,6 +1632,146 @@ void VG::normalize(int max_iter, bool debug) {
     }
 }
 
+void VG::apply_to_components_parallel(const function<void(VG&)>& pass) {
+    vector<id_t> node_ids;
+    vector<size_t> component_ids;
+    algorithms::weakly_connected_component_ids(this, node_ids, component_ids);
+    size_t component_count = component_ids.empty() ? 0 : *max_element(component_ids.begin(), component_ids.end()) + 1;
+    
+    hash_map<id_t, size_t> component_of;
+    component_of.reserve(node_ids.size());
+    for (size_t i = 0; i < node_ids.size(); i++) {
+        component_of[node_ids[i]] = component_ids[i];
+    }
+    node_ids.clear();
+    component_ids.clear();
+    
+    // Paths have to go with their component, so they can't cross between them
+    map<string, size_t> path_components;
+    bool paths_split = false;
+    paths.for_each_name([&](const string& name) {
+        auto& mappings = paths.get_path(name);
+        size_t component = 0;
+        for (auto& mapping : mappings) {
+            auto found = component_of.find(mapping.node_id());
+            if (found == component_of.end()) {
+                // Visits a node that isn't there, so leave it all to the pass
+                paths_split = true;
+            } else if (&mapping == &mappings.front()) {
+                component = found->second;
+            } else if (found->second != component) {
+                paths_split = true;
+            }
+        }
+        path_components[name] = component;
+    });
+    
+    if (component_count < 2 || paths_split || get_thread_count() < 2) {
+        pass(*this);
+        return;
+    }
+    
+    // Nodes made in any component start out numbered from here, and are
+    // moved into their own ranges afterward
+    id_t first_new_id = max_node_id() + 1;
+    
+    // Move the nodes, edges and paths out into a Graph per component
+    vector<Graph> component_graphs(component_count);
+    vector<Node*> nodes(graph.node_size());
+    if (!nodes.empty()) {
+        graph.mutable_node()->ExtractSubrange(0, nodes.size(), nodes.data());
+    }
+    for (Node* node : nodes) {
+        component_graphs[component_of.at(node->id())].mutable_node()->AddAllocated(node);
+    }
+    vector<Edge*> edges(graph.edge_size());
+    if (!edges.empty()) {
+        graph.mutable_edge()->ExtractSubrange(0, edges.size(), edges.data());
+    }
+    for (Edge* edge : edges) {
+        // An edge to a missing node still goes with the node it has
+        auto found = component_of.find(edge->from());
+        if (found == component_of.end()) {
+            found = component_of.find(edge->to());
+        }
+        size_t component = found == component_of.end() ? 0 : found->second;
+        component_graphs[component].mutable_edge()->AddAllocated(edge);
+    }
+    nodes.clear();
+    edges.clear();
+    component_of.clear();
+    paths.for_each([&](const Path& path) {
+        *component_graphs[path_components.at(path.name())].add_path() = path;
+    });
+    graph.Clear();
+    paths.clear();
+    clear_indexes();
+    
+    vector<id_t> ids_used(component_count, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < component_count; i++) {
+        VG component;
+        component.append_unindexed(component_graphs[i]);
+        component.build_indexes_dropping_duplicates();
+        component.paths.sort_by_mapping_rank();
+        component.paths.rebuild_mapping_aux();
+        component.current_id = first_new_id;
+        
+        pass(component);
+        
+        ids_used[i] = component.current_id - first_new_id;
+        component_graphs[i].Clear();
+        std::swap(component_graphs[i], component.graph);
+        component_graphs[i].clear_path();
+        component.paths.to_graph(component_graphs[i]);
+    }
+    
+    // Give each component's new nodes the next range of IDs
+    vector<id_t> id_offsets(component_count, 0);
+    id_t next_id = first_new_id;
+    for (size_t i = 0; i < component_count; i++) {
+        id_offsets[i] = next_id - first_new_id;
+        next_id += ids_used[i];
+    }
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < component_count; i++) {
+        id_t offset = id_offsets[i];
+        if (offset == 0) {
+            continue;
+        }
+        auto renumber = [&](id_t id) {
+            return id >= first_new_id ? id + offset : id;
+        };
+        Graph& component_graph = component_graphs[i];
+        for (size_t j = 0; j < component_graph.node_size(); j++) {
+            Node* node = component_graph.mutable_node(j);
+            node->set_id(renumber(node->id()));
+        }
+        for (size_t j = 0; j < component_graph.edge_size(); j++) {
+            Edge* edge = component_graph.mutable_edge(j);
+            edge->set_from(renumber(edge->from()));
+            edge->set_to(renumber(edge->to()));
+        }
+        for (size_t j = 0; j < component_graph.path_size(); j++) {
+            Path* path = component_graph.mutable_path(j);
+            for (size_t k = 0; k < path->mapping_size(); k++) {
+                Position* position = path->mutable_mapping(k)->mutable_position();
+                position->set_node_id(renumber(position->node_id()));
+            }
+        }
+    }
+    
+    // Put everything back together and index it all at once
+    for (auto& component_graph : component_graphs) {
+        append_unindexed(component_graph);
+        component_graph.Clear();
+    }
+    build_indexes_dropping_duplicates();
+    paths.sort_by_mapping_rank();
+    paths.rebuild_mapping_aux();
+    current_id = next_id;
+}
+
 set<Edge*> VG::get_path_edges(void) {
     // We'll populate a set with edges.
     // This set shadows our function anme but we're not recursive so that's fine.
@@ -2104,7 +2307,7 @@ void VG::build_node_indexes_no_init_size(void) {
 }
 
 void VG::build_node_indexes(void) {
-#ifdef USE_DENSE_HASH
+#if defined(USE_DENSE_HASH) || defined(USE_FLAT_HASH)
     node_by_id.resize(graph.node_size());
     node_index.resize(graph.node_size());
 #endif
@@ -2120,7 +2323,7 @@ void VG::build_edge_indexes_no_init_size(void) {
 }
 
 void VG::build_edge_indexes(void) {
-#ifdef USE_DENSE_HASH
+#if defined(USE_DENSE_HASH) || defined(USE_FLAT_HASH)
     edges_on_start.resize(graph.node_size());
     edges_on_end.resize(graph.node_size());
     edge_by_sides.resize(graph.edge_size());
@@ -2400,6 +2603,72 @@ void VG::extend(const VG& g, bool warn_on_duplicates) {
     paths.append(g.paths);
 }
 
+void VG::append_unindexed(Graph& g) {
+    // Take the nodes and edges over without copying them
+    vector<Node*> nodes(g.node_size());
+    if (!nodes.empty()) {
+        g.mutable_node()->ExtractSubrange(0, nodes.size(), nodes.data());
+    }
+    for (Node* node : nodes) {
+        graph.mutable_node()->AddAllocated(node);
+    }
+    vector<Edge*> edges(g.edge_size());
+    if (!edges.empty()) {
+        g.mutable_edge()->ExtractSubrange(0, edges.size(), edges.data());
+    }
+    for (Edge* edge : edges) {
+        graph.mutable_edge()->AddAllocated(edge);
+    }
+    // Append the path mappings from this graph, but don't sort by rank
+    paths.append(g);
+}
+
+void VG::build_indexes_dropping_duplicates(bool warn_on_duplicates) {
+    clear_indexes();
+    resize_indexes();
+
+    // Keep the first copy of each node, and move the ones we keep to the front
+    id_t kept = 0;
+    for (id_t i = 0; i < graph.node_size(); ++i) {
+        Node* n = graph.mutable_node(i);
+        if (n->id() == 0) {
+            cerr << "[vg] warning: node ID 0 is not allowed. Skipping." << endl;
+        } else if (node_by_id.count(n->id())) {
+            if (warn_on_duplicates) {
+                cerr << "[vg] warning: node ID " << n->id() << " appears multiple times. Skipping." << endl;
+            }
+        } else {
+            graph.mutable_node()->SwapElements(i, kept);
+            node_by_id[n->id()] = n;
+            node_index[n] = kept;
+            ++kept;
+        }
+    }
+    if (kept < graph.node_size()) {
+        graph.mutable_node()->DeleteSubrange(kept, graph.node_size() - kept);
+    }
+
+    // And the same for the edges
+    kept = 0;
+    for (id_t i = 0; i < graph.edge_size(); ++i) {
+        Edge* e = graph.mutable_edge(i);
+        if (has_edge(*e)) {
+            if (warn_on_duplicates) {
+                cerr << "[vg] warning: edge " << e->from() << (e->from_start() ? " start" : " end") << " <-> "
+                     << e->to() << (e->to_end() ? " end" : " start") << " appears multiple times. Skipping." << endl;
+            }
+        } else {
+            graph.mutable_edge()->SwapElements(i, kept);
+            edge_index[e] = kept;
+            index_edge_by_node_sides(e);
+            ++kept;
+        }
+    }
+    if (kept < graph.edge_size()) {
+        graph.mutable_edge()->DeleteSubrange(kept, graph.edge_size() - kept);
+    }
+}
+
 // TODO: unify with above. The only difference is what's done with the paths.
 void VG::extend(const Graph& graph, bool warn_on_duplicates) {
     for (id_t i = 0; i < graph.node_size(); ++i) {
@@ -4577,20 +4846,39 @@ vector<Translation> VG::edit(vector<Path>& paths_to_add, bool save_paths, bool u
     }
 #endif
 
-    std::vector<Path> simplified_paths;
+    std::vector<Path> simplified_paths(paths_to_add.size());
+
+    // If we are going to actually add the paths to the graph, we need to break at path ends
+    break_at_ends |= save_paths;
+
+    // Each thread collects the breakpoints for its paths on its own. Since
+    // they are sets, merging them gives the same breakpoints in any order.
+    vector<map<id_t, set<pos_t>>> thread_breakpoints(omp_get_max_threads());
 
-    for(auto path : paths_to_add) {
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < paths_to_add.size(); i++) {
         // Simplify the path, just to eliminate adjacent match Edits in the same
         // Mapping (because we don't have or want a breakpoint there)
-        simplified_paths.push_back(simplify(path));
+        simplified_paths[i] = simplify(paths_to_add[i]);
+        // Add in breakpoints from the path
+        find_breakpoints(simplified_paths[i], thread_breakpoints[omp_get_thread_num()], break_at_ends);
     }
 
-    // If we are going to actually add the paths to the graph, we need to break at path ends
-    break_at_ends |= save_paths;
-
-    for(auto path : simplified_paths) {
-        // Add in breakpoints from each path
-        find_breakpoints(path, breakpoints, break_at_ends);
+    for (auto& local_breakpoints : thread_breakpoints) {
+        // Merge the threads' breakpoints node by node
+        if (breakpoints.empty()) {
+            std::swap(breakpoints, local_breakpoints);
+            continue;
+        }
+        for (auto& kv : local_breakpoints) {
+            auto& node_breakpoints = breakpoints[kv.first];
+            if (node_breakpoints.empty()) {
+                std::swap(node_breakpoints, kv.second);
+            } else {
+                node_breakpoints.insert(kv.second.begin(), kv.second.end());
+            }
+        }
+        local_breakpoints.clear();
     }
 
     // Invert the breakpoints that are on the reverse strand
@@ -6978,13 +7266,7 @@ double VG::path_identity(const Path& path1, const Path& path2) {
 }
 
 void VG::prune_complex_with_head_tail(int path_length, int edge_max) {
-    Node* head_node = NULL;
-    Node* tail_node = NULL;
-    id_t head_id = 0, tail_id = 0;
-    add_start_end_markers(path_length, '#', '$', head_node, tail_node, head_id, tail_id);
-    prune_complex(path_length, edge_max, head_node, tail_node);
-    destroy_node(head_node);
-    destroy_node(tail_node);
+    vg::prune_complex_with_head_tail(*this, path_length, edge_max);
 }
 
 void VG::prune_complex(int path_length, int edge_max, Node* head_node, Node* tail_node) {
@@ -7009,45 +7291,7 @@ void VG::prune_complex(int path_length, int edge_max, Node* head_node, Node* tai
 }
 
 void VG::prune_short_subgraphs(size_t min_size) {
-
-    // Find the head nodes.
-    std::vector<vg::id_t> heads;
-    this->for_each_node([&](Node* node) {
-        if (this->is_head_node(node)) {
-            heads.push_back(node->id());
-        }
-    });
-
-    for (vg::id_t head : heads) {
-        if (!this->has_node(head)) {
-            continue;   // Already pruned.
-        }
-
-        // Explore the neighborhood until the component is too large.
-        Node* head_node = this->get_node(head);
-        size_t subgraph_size = head_node->sequence().size();
-        std::stack<Node*> to_check; to_check.push(head_node);
-        std::unordered_set<vg::id_t> subgraph { head };
-        while(subgraph_size < min_size && !to_check.empty()) {
-            Node* curr = to_check.top(); to_check.pop();
-            std::vector<Edge*> edges = this->edges_of(curr);
-            for (Edge* edge : edges) {
-                Node* next = this->get_node(edge->from() == curr->id() ? edge->to() : edge->from());
-                if (subgraph.find(next->id()) == subgraph.end()) {
-                    subgraph_size += next->sequence().size();
-                    subgraph.insert(next->id());
-                    to_check.push(next);
-                }
-            }
-        }
-
-        // Destroy the component if it was small enough.
-        if (subgraph_size < min_size) {
-            for (vg::id_t node : subgraph) {
-                this->destroy_node(node);
-            }
-        }
-    }
+    vg::prune_short_subgraphs(*this, min_size);
 }
 
 /*
@@ -7100,23 +7344,20 @@ void VG::collect_subgraph(Node* start_node, set<Node*>& subgraph) {
 }
 
 void VG::disjoint_subgraphs(list<VG>& subgraphs) {
-    vector<Node*> heads;
-    head_nodes(heads);
-    map<Node*, set<Node*> > subgraph_by_head;
-    map<Node*, set<Node*>* > subgraph_membership;
-    // start at the heads, but keep in mind that we need to explore fully
-    for (vector<Node*>::iterator h = heads.begin(); h != heads.end(); ++h) {
-        if (subgraph_membership.find(*h) == subgraph_membership.end()) {
-            set<Node*>& subgraph = subgraph_by_head[*h];
-            collect_subgraph(*h, subgraph);
-            for (set<Node*>::iterator n = subgraph.begin(); n != subgraph.end(); ++n) {
-                subgraph_membership[*n] = &subgraph;
-            }
-        }
+    // Number every node's weakly connected component. Unlike a search from
+    // the heads, this also finds components that are all cycles.
+    vector<id_t> node_ids;
+    vector<size_t> component_ids;
+    algorithms::weakly_connected_component_ids(this, node_ids, component_ids);
+    
+    size_t component_count = component_ids.empty() ? 0 : *max_element(component_ids.begin(), component_ids.end()) + 1;
+    vector<set<Node*>> component_nodes(component_count);
+    for (size_t i = 0; i < node_ids.size(); i++) {
+        component_nodes[component_ids[i]].insert(get_node(node_ids[i]));
     }
-    for (map<Node*, set<Node*> >::iterator g = subgraph_by_head.begin();
-         g != subgraph_by_head.end(); ++ g) {
-        set<Node*>& nodes = g->second;
+    
+    // Emit the components in order of their first nodes
+    for (set<Node*>& nodes : component_nodes) {
         set<Edge*> edges;
         edges_of_nodes(nodes, edges);
         subgraphs.push_back(VG(nodes, edges));
@@ -78,7 +78,7 @@ namespace vg {
  * However, edges can connect to either the start or end of either node.
  *
  */
-class VG : public Progressive, public MutableHandleGraph {
+class VG final : public Progressive, public MutableHandleGraph {
 
 public:
 
@@ -123,6 +123,21 @@ public:
     // Copy over the template for nice calls
     using HandleGraph::for_each_handle;
     
+    /// Get all the handles to next/previous (right/left) nodes with a single
+    /// edge index lookup. Replaces the contents of dest.
+    virtual void get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& dest) const;
+    
+    /// Count the edges off the left or right side of an oriented node.
+    virtual size_t get_degree(const handle_t& handle, bool go_left) const;
+    
+    /// Get the lengths of all of the given nodes, in order. Replaces the
+    /// contents of dest.
+    virtual void get_lengths(const vector<handle_t>& handles, vector<size_t>& dest) const;
+    
+    /// Get the sequences of all of the given nodes, in order, each in its
+    /// handle's local forward orientation. Replaces the contents of dest.
+    virtual void get_sequences(const vector<handle_t>& handles, vector<string>& dest) const;
+    
     /// Return the number of nodes in the graph
     virtual size_t node_size() const;
     
@@ -326,6 +341,13 @@ public:
     Node* merge_nodes(const list<Node*>& nodes);
     /// Use unchop and sibling merging to simplify the graph into a normalized form.
     void normalize(int max_iter = 1, bool debug = false);
+    /// Run a pass that rewrites the graph, such as normalize(), unchop() or
+    /// dice_nodes(), on each weakly connected component as a graph of its own,
+    /// on all threads, and then put the results back together and re-index
+    /// once. Nodes made by the pass get IDs above the graph's old maximum ID,
+    /// in component order. If there is only one component or thread, or a
+    /// path visits more than one component, the pass runs on the whole graph.
+    void apply_to_components_parallel(const function<void(VG&)>& pass);
     /// Remove redundant overlaps.
     void bluntify(void);
     /// Turn the graph into a dag by copying strongly connected components expand_scc_steps times
@@ -419,6 +441,10 @@ public:
     void build_node_indexes(void);
     void build_edge_indexes(void);
     void build_indexes_no_init_size(void);
+    /// Rebuild all the indexes in one pass over the graph, skipping node ID 0
+    /// and keeping only the first copy of any node or edge that occurs more
+    /// than once, as extend() would have.
+    void build_indexes_dropping_duplicates(bool warn_on_duplicates = false);
     void build_node_indexes_no_init_size(void);
     void build_edge_indexes_no_init_size(void);
     void index_paths(void);
@@ -493,6 +519,11 @@ public:
     /// Paths::rebuild_mapping_aux() after you are done adding in graphs to this
     /// graph.
     void extend(const Graph& graph, bool warn_on_duplicates = false);
+    /// Move the nodes and edges of the given graph onto the end of this one
+    /// without indexing them or checking for duplicates, and append its path
+    /// mappings. Used for loading many chunks quickly; call
+    /// build_indexes_dropping_duplicates() once they are all in.
+    void append_unindexed(Graph& graph);
     // TODO: Do a member group for these overloads
 
     /// Add another graph into this graph, attaching tails to heads.
@@ -1,76 +1,275 @@
 #include "vg_set.hpp"
 #include "stream.hpp"
+#include "gfa_stream.hpp"
+#include "id_remapper.hpp"
+#include "read_ahead_stream.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <sys/stat.h>
 
 namespace vg {
 // sets of VGs on disk
 
-void VGset::transform(std::function<void(VG*)> lambda) {
-    for (auto& name : filenames) {
-        // load
-        VG* g = NULL;
-        if (name == "-") {
-            g = new VG(std::cin, show_progress);
-        } else {
-            ifstream in(name.c_str());
-            if (!in) throw ifstream::failure("failed to open " + name);
-            g = new VG(in, show_progress);
-            in.close();
+template<typename Loaded>
+void VGset::for_each_loaded(const function<Loaded(size_t)>& load, const function<void(size_t, Loaded&)>& use,
+                            bool ordered) {
+    if (parallel_files <= 1 || filenames.size() <= 1) {
+        for (size_t i = 0; i < filenames.size(); i++) {
+            Loaded loaded = load(i);
+            use(i, loaded);
         }
-        g->name = name;
+        return;
+    }
+
+    // the budget is counted in bytes on disk, which is all we know up front
+    vector<size_t> file_bytes(filenames.size(), 0);
+    for (size_t i = 0; i < filenames.size(); i++) {
+        struct stat file_stats;
+        if (filenames[i] != "-" && stat(filenames[i].c_str(), &file_stats) == 0) {
+            file_bytes[i] = file_stats.st_size;
+        }
+    }
+
+    mutex state_lock;
+    condition_variable state_changed;
+    size_t next_to_load = 0;
+    size_t bytes_in_flight = 0;
+    map<size_t, Loaded> loaded;
+    exception_ptr error;
+    bool stopping = false;
+
+    // Files are started in order, so in file order the next file to use has
+    // always been started, and waiting on it can't starve the budget.
+    auto read_files = [&]() {
+        while (true) {
+            unique_lock<mutex> lock(state_lock);
+            state_changed.wait(lock, [&]() {
+                return stopping || next_to_load == filenames.size() || bytes_in_flight == 0 || parallel_bytes == 0
+                    || bytes_in_flight + file_bytes[next_to_load] <= parallel_bytes;
+            });
+            if (stopping || next_to_load == filenames.size()) {
+                return;
+            }
+            size_t i = next_to_load++;
+            bytes_in_flight += file_bytes[i];
+            lock.unlock();
+
+            try {
+                Loaded result = load(i);
+                lock.lock();
+                loaded.emplace(i, std::move(result));
+            } catch (...) {
+                lock.lock();
+                if (!error) {
+                    error = current_exception();
+                }
+                stopping = true;
+            }
+            lock.unlock();
+            state_changed.notify_all();
+        }
+    };
+
+    vector<thread> readers;
+    for (size_t i = 0; i < min(parallel_files, filenames.size()); i++) {
+        readers.emplace_back(read_files);
+    }
+
+    for (size_t used = 0; used < filenames.size(); used++) {
+        unique_lock<mutex> lock(state_lock);
+        state_changed.wait(lock, [&]() {
+            return stopping || (ordered ? loaded.count(used) : !loaded.empty());
+        });
+        if (stopping) {
+            break;
+        }
+        auto next = ordered ? loaded.find(used) : loaded.begin();
+        size_t i = next->first;
+        Loaded to_use = std::move(next->second);
+        loaded.erase(next);
+        lock.unlock();
+
+        try {
+            use(i, to_use);
+        } catch (...) {
+            lock.lock();
+            if (!error) {
+                error = current_exception();
+            }
+            stopping = true;
+            lock.unlock();
+            state_changed.notify_all();
+            break;
+        }
+
+        lock.lock();
+        bytes_in_flight -= file_bytes[i];
+        lock.unlock();
+        state_changed.notify_all();
+    }
+
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+vector<Graph> VGset::read_chunks(const string& name) {
+    vector<Graph> chunks;
+    function<void(Graph&)> lambda = [&](Graph& chunk) {
+        chunks.emplace_back(std::move(chunk));
+    };
+    if (name == "-") {
+        stream::for_each(std::cin, lambda);
+        return chunks;
+    }
+    ReadAheadFileStream in(name);
+    if (!in) throw ifstream::failure("failed to open " + name);
+    if (is_gfa(name)) {
+        gfa_for_each_chunk(in, lambda);
+    } else {
+        stream::for_each(in, lambda);
+    }
+    return chunks;
+}
+
+void VGset::transform(std::function<void(VG*)> lambda) {
+    // we write over each file as we go, but every file is read before it is
+    // written, so the order doesn't matter
+    for_each([&](VG* g) {
         // apply
         lambda(g);
         // write to the same file
-        ofstream out(name.c_str());
+        ofstream out(g->name.c_str());
         g->serialize_to_ostream(out);
         out.close();
-        delete g;
-    }
+    });
 }
 
 void VGset::for_each(std::function<void(VG*)> lambda) {
-    for (auto& name : filenames) {
+    // progress bars from several files at once would be a mess
+    bool show_load_progress = show_progress && parallel_files <= 1;
+    function<unique_ptr<VG>(size_t)> load = [&](size_t i) {
+        auto& name = filenames[i];
         // load
-        VG* g = NULL;
+        unique_ptr<VG> g;
         if (name == "-") {
-            g = new VG(std::cin, show_progress);
+            g.reset(new VG(std::cin, show_load_progress));
         } else {
-            ifstream in(name.c_str());
+            ReadAheadFileStream in(name);
             if (!in) throw ifstream::failure("failed to open " + name);
-            g = new VG(in, show_progress);
-            in.close();
+            g.reset(new VG(in, show_load_progress));
         }
         g->name = name;
+        return g;
+    };
+    function<void(size_t, unique_ptr<VG>&)> use = [&](size_t i, unique_ptr<VG>& g) {
         // apply
-        lambda(g);
-        delete g;
-    }
+        lambda(g.get());
+    };
+    for_each_loaded(load, use, in_file_order);
 }
 
 void VGset::for_each_graph_chunk(std::function<void(Graph&)> lamda) {
-    for (auto& name : filenames) {
-        ifstream in(name.c_str());
-        stream::for_each(in, lamda);
+    if (parallel_files <= 1) {
+        for (auto& name : filenames) {
+            ReadAheadFileStream in(name);
+            stream::for_each(in, lamda);
+        }
+        return;
     }
+    function<vector<Graph>(size_t)> load = [&](size_t i) {
+        return read_chunks(filenames[i]);
+    };
+    function<void(size_t, vector<Graph>&)> use = [&](size_t i, vector<Graph>& chunks) {
+        for (auto& chunk : chunks) {
+            lamda(chunk);
+        }
+    };
+    for_each_loaded(load, use, in_file_order);
 }
 
 id_t VGset::get_max_id(void) {
-    id_t max_id = 0;
-    for_each_graph_chunk([&](const Graph& graph) {
+    // each file's largest ID can be found on its own, in any order
+    function<id_t(size_t)> load = [&](size_t i) {
+        id_t max_id = 0;
+        ReadAheadFileStream in(filenames[i]);
+        function<void(Graph&)> lambda = [&](Graph& graph) {
             for (size_t i = 0; i < graph.node_size(); ++i) {
                 max_id = max(graph.node(i).id(), max_id);
             }
-        });
+        };
+        stream::for_each(in, lambda);
+        return max_id;
+    };
+    id_t max_id = 0;
+    function<void(size_t, id_t&)> use = [&](size_t i, id_t& file_max_id) {
+        max_id = max(max_id, file_max_id);
+    };
+    for_each_loaded(load, use, false);
     return max_id;
 }
 
-int64_t VGset::merge_id_space(void) {
-    int64_t max_node_id = 0;
-    auto lambda = [&max_node_id](VG* g) {
-        if (max_node_id > 0) g->increment_node_ids(max_node_id);
-        max_node_id = g->max_node_id();
+int64_t VGset::merge_id_space(ostream* translation_out) {
+    // Plan everyone's IDs first, then rewrite each file through a temporary
+    // file next to it, so no graph has to be loaded.
+    IDRemapper remapper;
+    remapper.join = true;
+    for (auto& name : filenames) {
+        if (name == "-") {
+            throw runtime_error("vg_set: cannot merge the ID space of a graph on standard input");
+        }
+        ReadAheadFileStream in(name);
+        if (!in) throw ifstream::failure("failed to open " + name);
+        remapper.scan(in);
+    }
+    // The files can be rewritten at the same time, since their new IDs are
+    // already planned. Their translations are staged next to them and copied
+    // out in file order.
+    function<string(size_t)> rewrite = [&](size_t i) {
+        auto& name = filenames[i];
+        string temp_name = name + ".ids.tmp";
+        string translation_name = translation_out ? name + ".ids.translation.tmp" : "";
+        ReadAheadFileStream in(name);
+        if (!in) throw ifstream::failure("failed to open " + name);
+        ofstream out(temp_name.c_str());
+        if (!out) throw ofstream::failure("failed to open " + temp_name);
+        if (translation_out) {
+            ofstream translations(translation_name.c_str());
+            if (!translations) throw ofstream::failure("failed to open " + translation_name);
+            remapper.rewrite(i, in, out, &translations);
+        } else {
+            remapper.rewrite(i, in, out);
+        }
+        return translation_name;
+    };
+    function<void(size_t, string&)> replace = [&](size_t i, string& translation_name) {
+        auto& name = filenames[i];
+        string temp_name = name + ".ids.tmp";
+        if (rename(temp_name.c_str(), name.c_str()) != 0) {
+            throw runtime_error("vg_set: failed to replace " + name + " with " + temp_name);
+        }
+        if (!translation_name.empty()) {
+            {
+                ifstream translations(translation_name.c_str());
+                *translation_out << translations.rdbuf();
+            }
+            std::remove(translation_name.c_str());
+        }
     };
-    transform(lambda);
-    return max_node_id;
+    for_each_loaded(rewrite, replace, true);
+    return remapper.max_id();
+}
+
+bool VGset::is_gfa(const string& filename) {
+    const string extension = ".gfa";
+    return filename.size() > extension.size() &&
+        filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
 }
 
 void VGset::to_xg(xg::XG& index, bool store_threads) {
@@ -87,79 +286,101 @@ void VGset::to_xg(xg::XG& index, bool store_threads, const regex& paths_to_take,
     
     // Set up an XG index
     index.from_callback([&](function<void(Graph&)> callback) {
-        for (auto& name : filenames) {
-#ifdef debug
-            cerr << "Loading chunks from " << name << endl;
-#endif
-            // Load chunks from all the files and pass them into XG.
-            std::ifstream in(name);
-            
-            if (name == "-"){
-                if (!in) throw ifstream::failure("vg_set: cannot read from stdin. Failed to open " + name);
-            }
-            
-            if (!in) throw ifstream::failure("failed to open " + name);
-            
-            function<void(Graph&)> handle_graph = [&](Graph& graph) {
-#ifdef debug
-                cerr << "Got chunk of " << name << "!" << endl;
-#endif
+        function<void(Graph&)> handle_graph = [&](Graph& graph) {
+            // We'll move all the paths into one of these (if removed_paths is not null)
+            std::list<Path> paths_taken;
+
+            // Remove the matching paths.
+            remove_paths(graph, paths_to_take, removed_paths ? &paths_taken : nullptr);
 
-                // We'll move all the paths into one of these (if removed_paths is not null)
-                std::list<Path> paths_taken;
-
-                // Remove the matching paths.
-                remove_paths(graph, paths_to_take, removed_paths ? &paths_taken : nullptr);
-
-                // Sort out all the mappings from the paths we pulled out
-                for(Path& path : paths_taken) {
-                    for(size_t i = 0; i < path.mapping_size(); i++) {
-                        // For each mapping, file it under its rank if a rank is
-                        // specified, or at the last rank otherwise.
-                        // TODO: this sort of duplicates logic from Paths...
-                        Mapping& mapping = *path.mutable_mapping(i);
-                        
-                        if(mapping.rank() == 0) {
-                            if(mappings[path.name()].size() > 0) {
-                                // Calculate a better rank, which is 1 more than the current largest rank.
-                                int64_t last_rank = (*mappings[path.name()].rbegin()).first;
-                                mapping.set_rank(last_rank + 1);
-                            } else {
-                                // Say it has rank 1 now.
-                                mapping.set_rank(1);
-                            }
+            // Sort out all the mappings from the paths we pulled out
+            for(Path& path : paths_taken) {
+                for(size_t i = 0; i < path.mapping_size(); i++) {
+                    // For each mapping, file it under its rank if a rank is
+                    // specified, or at the last rank otherwise.
+                    // TODO: this sort of duplicates logic from Paths...
+                    Mapping& mapping = *path.mutable_mapping(i);
+                    
+                    if(mapping.rank() == 0) {
+                        if(mappings[path.name()].size() > 0) {
+                            // Calculate a better rank, which is 1 more than the current largest rank.
+                            int64_t last_rank = (*mappings[path.name()].rbegin()).first;
+                            mapping.set_rank(last_rank + 1);
+                        } else {
+                            // Say it has rank 1 now.
+                            mapping.set_rank(1);
                         }
-                        
-                        // Move the mapping into place
-                        mappings[path.name()][mapping.rank()] = mapping;
                     }
+                    
+                    // Move the mapping into place
+                    mappings[path.name()][mapping.rank()] = mapping;
                 }
+            }
 
-                // Ship out the corrected graph
-                callback(graph);
+            // Ship out the corrected graph
+            callback(graph);
+        };
+
+        if (parallel_files > 1) {
+            // Read several files at once. Ranks for rankless mappings depend
+            // on the order chunks arrive in, so we keep the files in order
+            // when we are pulling out paths.
+            function<vector<Graph>(size_t)> load = [&](size_t i) {
+                return read_chunks(filenames[i]);
             };
-            
-            stream::for_each(in, handle_graph);
-            
-            // Now that we got all the chunks, reconstitute any siphoned-off paths into Path objects and return them.
-            for(auto& kv : mappings) {
-                // We'll fill in this Path object
-                Path path;
-                path.set_name(kv.first);
+            function<void(size_t, vector<Graph>&)> use = [&](size_t i, vector<Graph>& chunks) {
+                for (auto& chunk : chunks) {
+                    handle_graph(chunk);
+                }
+            };
+            for_each_loaded(load, use, removed_paths != nullptr || in_file_order);
+        } else {
+            for (auto& name : filenames) {
+#ifdef debug
+                cerr << "Loading chunks from " << name << endl;
+#endif
+                // Load chunks from all the files and pass them into XG.
+                ReadAheadFileStream in(name);
                 
-                for(auto& rank_and_mapping : kv.second) {
-                    // Put in all the mappings. Ignore the rank since thay're already marked with and sorted by rank.
-                    *path.add_mapping() = rank_and_mapping.second;
+                if (name == "-"){
+                    if (!in) throw ifstream::failure("vg_set: cannot read from stdin. Failed to open " + name);
                 }
                 
-                // Now the Path is rebuilt; stick it in the big output map.
-                (*removed_paths)[path.name()] = path;
+                if (!in) throw ifstream::failure("failed to open " + name);
+                
+                if (is_gfa(name)) {
+                    // Read segments, links and paths straight into chunks
+                    gfa_for_each_chunk(in, handle_graph);
+                } else if (removed_paths) {
+                    // Ranks for rankless mappings depend on the order chunks
+                    // arrive in, so we have to go in order.
+                    stream::for_each(in, handle_graph);
+                } else {
+                    // XG merges chunks under its own lock, so we can decode them
+                    // in parallel.
+                    stream::for_each_parallel(in, handle_graph);
+                }
+            }
+        }
+        
+        // Now that we got all the chunks, reconstitute any siphoned-off paths into Path objects and return them.
+        for(auto& kv : mappings) {
+            // We'll fill in this Path object
+            Path path;
+            path.set_name(kv.first);
+            
+            for(auto& rank_and_mapping : kv.second) {
+                // Put in all the mappings. Ignore the rank since thay're already marked with and sorted by rank.
+                *path.add_mapping() = rank_and_mapping.second;
             }
             
+            // Now the Path is rebuilt; stick it in the big output map.
+            (*removed_paths)[path.name()] = path;
+        }
+        
 #ifdef debug
-            cerr << "Got all chunks; building XG index" << endl;
+        cerr << "Got all chunks; building XG index" << endl;
 #endif
-        }
     });
 }
 
@@ -25,8 +25,13 @@ public:
         : filenames(files)
         { };
 
+    /// Load each graph, apply the lambda, and write it back to its file.
     void transform(std::function<void(VG*)> lambda);
+    /// Load each graph and apply the lambda to it.
     void for_each(std::function<void(VG*)> lambda);
+    /// Stream the chunks of each graph through the lambda. With
+    /// parallel_files over 1, each file's chunks are read into memory before
+    /// being handed over, but still go to the lambda in their order.
     void for_each_graph_chunk(std::function<void(Graph&)> lamda);
 
     /// Stream through the files and determine the max node id
@@ -34,9 +39,17 @@ public:
     
     /// merges the id space of a set of graphs on-disk
     /// necessary when storing many graphs in the same index
-    int64_t merge_id_space(void);
+    /// Streams each file twice instead of loading it. If translation_out is
+    /// set, Translations from the old to the new nodes are written to it.
+    /// Returns the new max node id.
+    int64_t merge_id_space(ostream* translation_out = nullptr);
 
-    /// Transforms to a succinct, queryable representation
+    /// Returns true if the named file is GFA rather than a .vg stream, going
+    /// by its ".gfa" extension. Only to_xg can read GFA files.
+    static bool is_gfa(const string& filename);
+
+    /// Transforms to a succinct, queryable representation. GFA files are
+    /// streamed straight into the index, without making a VG.
     void to_xg(xg::XG& index, bool store_threads = false);
     /// As above, except paths with names matching the given regex are removed.
     /// They are returned separately by inserting them into the provided map if not null.
@@ -66,6 +79,39 @@ public:
     // Should we show our progress running through each graph?             
     bool show_progress = false;
 
+    /// The default for parallel_bytes
+    static const size_t DEFAULT_PARALLEL_BYTES = 1024 * 1024 * 1024;
+
+    /// How many files can be read and parsed at once. Graphs and chunks are
+    /// still handed to the lambdas one file at a time, on the calling thread,
+    /// so the lambdas don't need to be thread-safe.
+    size_t parallel_files = 1;
+
+    /// Don't start reading another file while the files being read or waiting
+    /// to be used add up to more than this many bytes on disk. One file is
+    /// always read, however big it is. 0 means no limit.
+    size_t parallel_bytes = DEFAULT_PARALLEL_BYTES;
+
+    /// When reading files in parallel, should graphs be handed over in the
+    /// order of the files (true) or as soon as they are read (false)? The
+    /// chunks of one file always stay in order. merge_id_space() and to_xg()
+    /// with removed paths always go in file order, since what they do depends
+    /// on it.
+    bool in_file_order = true;
+
+private:
+
+    /// Run load on each file index, up to parallel_files at once and within
+    /// parallel_bytes, and then use with the index and what was loaded, one
+    /// at a time on this thread, in file order if ordered is set. Exceptions
+    /// from either are passed on once the reading threads stop.
+    template<typename Loaded>
+    void for_each_loaded(const function<Loaded(size_t)>& load, const function<void(size_t, Loaded&)>& use,
+                         bool ordered);
+
+    /// Read all the chunks of a .vg or GFA file.
+    vector<Graph> read_chunks(const string& name);
+
 };
 
 }
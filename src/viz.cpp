@@ -3,11 +3,13 @@
 
 namespace vg {
 
-Viz::Viz(xg::XG* x, vector<Packer>* p, const vector<string>& n, const string& o, int w, int h, bool c, bool d, bool t) {
-    init(x, p, n, o, w, h, c, d, t);
+Viz::Viz(xg::XG* x, vector<Packer>* p, const vector<string>& n, const string& o, int w, int h, bool c, bool d, bool t,
+         size_t b, size_t tb) {
+    init(x, p, n, o, w, h, c, d, t, b, tb);
 }
 
-void Viz::init(xg::XG* x, vector<Packer>* p, const vector<string>& n, const string& o, int w, int h, bool c, bool d, bool t) {
+void Viz::init(xg::XG* x, vector<Packer>* p, const vector<string>& n, const string& o, int w, int h, bool c, bool d, bool t,
+               size_t b, size_t tb) {
     xgidx = x;
     packs = p;
     pack_names = n;
@@ -15,45 +17,58 @@ void Viz::init(xg::XG* x, vector<Packer>* p, const vector<string>& n, const stri
     show_cnv = c;
     show_dna = d;
     show_paths = t;
+    bin_bp = b;
+    tile_bins = tb;
     compute_borders_and_dimensions();
+    if (bin_bp) {
+        // the overview opens a surface for each tile as it draws it
+        compute_overview();
+        return;
+    }
     /*
     left_border = 8;
     top_border = 8;
     image_height = (h ? h : rendered_height() + top_border*2);
     image_width = (w ? w : xgidx->seq_length + xgidx->node_count + left_border*2);
     */
+    open(outfile, image_width, image_height);
+}
+
+void Viz::open(const string& file, int width, int height) {
+    surface_file = file;
     std::regex svgbase(".svg$");
     std::regex pngbase(".png$");
-    if (std::regex_search(outfile, svgbase)) {
-        output_svg = true;
-        surface = cairo_svg_surface_create(outfile.c_str(), image_width, image_height);
+    output_svg = std::regex_search(file, svgbase);
+    output_png = std::regex_search(file, pngbase);
+    if (output_svg) {
+        surface = cairo_svg_surface_create(file.c_str(), width, height);
     } else {
-        surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, image_width, image_height);
-    }
-    if (std::regex_search(outfile, pngbase)) {
-        output_png = true;
+        surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
     }
     cr = cairo_create(surface);
 }
 
 void Viz::compute_borders_and_dimensions(void) {
     top_border = 4;
-    xgidx->for_each_handle([&](const handle_t& h) {
-            id_t id = xgidx->get_id(h);
-            double s = node_offset(id);
-            size_t l = xgidx->node_length(id);
-            xgidx->follow_edges(h, false, [&](const handle_t& o) {
-                    id_t id2 = xgidx->get_id(o);
-                    double s2 = node_offset(id2);
-                    double x = s+l;
-                    int delta = s2 - x;
-                    double w = pow(log(abs(delta)+1), 1.5);
-                    int xdiff = (delta < 0 ? -w : w)/2;
-                    int ydiff = w*2;
-                    top_border = max(ydiff, top_border);
-                    return true;
-                });
-        });
+    // the overview doesn't draw edges, so it needs no room above the graph
+    if (!bin_bp) {
+        xgidx->for_each_handle([&](const handle_t& h) {
+                id_t id = xgidx->get_id(h);
+                double s = node_offset(id);
+                size_t l = xgidx->node_length(id);
+                xgidx->follow_edges(h, false, [&](const handle_t& o) {
+                        id_t id2 = xgidx->get_id(o);
+                        double s2 = node_offset(id2);
+                        double x = s+l;
+                        int delta = s2 - x;
+                        double w = pow(log(abs(delta)+1), 1.5);
+                        int xdiff = (delta < 0 ? -w : w)/2;
+                        int ydiff = w*2;
+                        top_border = max(ydiff, top_border);
+                        return true;
+                    });
+            });
+    }
     int height = top_border + 4;
     surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 0, 0);
     cr = cairo_create(surface);
@@ -80,7 +95,12 @@ void Viz::compute_borders_and_dimensions(void) {
     cr = nullptr;
     surface = nullptr;
     height += 2;
-    image_width = xgidx->seq_length + xgidx->node_count + left_border * 2;
+    if (bin_bp) {
+        size_t bins = (xgidx->seq_length + bin_bp - 1) / bin_bp;
+        image_width = (tile_bins ? min(bins, tile_bins) : bins) + left_border * 2;
+    } else {
+        image_width = xgidx->seq_length + xgidx->node_count + left_border * 2;
+    }
     image_height = height;
 }
 
@@ -258,15 +278,144 @@ void Viz::draw_graph(void) {
 }
 
 void Viz::draw(void) {
+    if (bin_bp) {
+        draw_overview();
+        return;
+    }
     cairo_set_source_rgb(cr, 1, 1, 1);
     cairo_paint(cr);
     draw_graph();
 }
 
+void Viz::compute_overview(void) {
+    size_t bins = (xgidx->seq_length + bin_bp - 1) / bin_bp;
+    // add the bases from start to start+length to the bins they fall in
+    auto add_bases = [&](vector<size_t>& counts, size_t start, size_t length) {
+        while (length) {
+            size_t in_bin = min(length, bin_bp - start % bin_bp);
+            counts[start / bin_bp] += in_bin;
+            start += in_bin;
+            length -= in_bin;
+        }
+    };
+    bin_nodes.assign(bins, 0);
+    xgidx->for_each_handle([&](const handle_t& h) {
+            bin_nodes[xgidx->node_start(xgidx->get_id(h)) / bin_bp]++;
+            return true;
+        });
+    bin_path_bases.assign(show_paths ? xgidx->path_count : 0, vector<size_t>(bins, 0));
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < bin_path_bases.size(); ++i) {
+        const xg::XGPath& path = xgidx->get_path(xgidx->path_name(i+1));
+        for (size_t j = 0; j < path.size(); ++j) {
+            id_t id = path.node(j);
+            add_bases(bin_path_bases[i], xgidx->node_start(id), xgidx->node_length(id));
+        }
+    }
+    bin_coverage.assign(packs->size(), vector<double>(bins, 0));
+    for (size_t i = 0; i < packs->size(); ++i) {
+        auto& pack = packs->at(i);
+        auto& coverage = bin_coverage[i];
+#pragma omp parallel for
+        for (size_t j = 0; j < bins; ++j) {
+            size_t start = j * bin_bp;
+            size_t end = min(start + bin_bp, (size_t) xgidx->seq_length);
+            size_t total = 0;
+            for (size_t k = start; k < end; ++k) {
+                total += pack.coverage_at_position(k);
+            }
+            coverage[j] = (double)total / (double)(end - start);
+        }
+    }
+}
+
+void Viz::draw_overview(void) {
+    size_t bins = bin_nodes.size();
+    size_t per_tile = tile_bins ? tile_bins : bins;
+    for (size_t first = 0, tile = 0; first < bins; first += per_tile, ++tile) {
+        size_t last = min(bins, first + per_tile);
+        string file = outfile;
+        if (tile_bins) {
+            // number the tiles before the extension
+            size_t dot = outfile.rfind('.');
+            if (dot == string::npos) {
+                dot = outfile.size();
+            }
+            file = outfile.substr(0, dot) + "." + to_string(tile) + outfile.substr(dot);
+        }
+        open(file, last - first + left_border * 2, image_height);
+        cairo_set_source_rgb(cr, 1, 1, 1);
+        cairo_paint(cr);
+        draw_overview_bins(first, last);
+        close();
+    }
+}
+
+void Viz::draw_overview_bins(size_t first, size_t last) {
+    // draw a label in the left border for a row
+    auto label = [&](const string& name, double y) {
+        set_hash_color(name);
+        cairo_text_extents_t te;
+        cairo_select_font_face(cr, "Arial", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
+        cairo_set_font_size(cr, 1);
+        cairo_text_extents(cr, name.c_str(), &te);
+        cairo_move_to(cr, left_border-(te.width+1), y);
+        cairo_show_text(cr, name.c_str());
+    };
+    cairo_set_line_width(cr, 1);
+    int y_pos = top_border;
+    // the graph is darker where it has more nodes
+    size_t max_nodes = *max_element(bin_nodes.begin(), bin_nodes.end());
+    for (size_t j = first; j < last; ++j) {
+        double shade = 1.0 - (double)bin_nodes[j]/(double)max(max_nodes, (size_t)1);
+        double x_pos = j - first + left_border + 0.5;
+        cairo_set_source_rgb(cr, shade * 0.8, shade * 0.8, shade * 0.8);
+        cairo_move_to(cr, x_pos, y_pos - 0.5);
+        cairo_line_to(cr, x_pos, y_pos + 0.5);
+        cairo_stroke(cr);
+    }
+    y_pos += 4;
+    // paths are as solid as the share of each bin's bases they cover
+    for (size_t i = 0; i < bin_path_bases.size(); ++i) {
+        string path_name = xgidx->path_name(i+1);
+        label(path_name, y_pos+0.35);
+        auto c = hash_to_rgb(path_name, 0.5);
+        for (size_t j = first; j < last; ++j) {
+            if (!bin_path_bases[i][j]) {
+                continue;
+            }
+            size_t bin_length = min(bin_bp, xgidx->seq_length - j * bin_bp);
+            double share = min(1.0, (double)bin_path_bases[i][j]/(double)bin_length);
+            double x_pos = j - first + left_border + 0.5;
+            cairo_set_source_rgba(cr, get<0>(c), get<1>(c), get<2>(c), share);
+            cairo_move_to(cr, x_pos, y_pos - 0.5);
+            cairo_line_to(cr, x_pos, y_pos + 0.5);
+            cairo_stroke(cr);
+        }
+        y_pos += 2;
+    }
+    y_pos += 2;
+    // coverage is a bar of the mean in each bin, scaled to the highest mean
+    // anywhere, so tiles can be put side by side
+    for (size_t i = 0; i < bin_coverage.size(); ++i) {
+        auto& coverage = bin_coverage[i];
+        label(pack_names[i], y_pos);
+        double max_coverage = *max_element(coverage.begin(), coverage.end());
+        for (size_t j = first; j < last; ++j) {
+            double c = max_coverage > 0 ? coverage[j]/max_coverage : 0;
+            double x_pos = j - first + left_border + 0.5;
+            cairo_move_to(cr, x_pos, y_pos);
+            cairo_line_to(cr, x_pos, y_pos-c);
+            cairo_stroke(cr);
+        }
+        y_pos += 2;
+    }
+}
+
 void Viz::close(void) {
     if (cr != nullptr && surface != nullptr) {
         if (output_png) {
-            cairo_surface_write_to_png(surface, outfile.c_str());
+            cairo_surface_write_to_png(surface, surface_file.c_str());
         }
         cairo_destroy(cr);
         cairo_surface_destroy(surface);
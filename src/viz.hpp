@@ -23,20 +23,34 @@ class Viz {
 public:
     Viz(void) { }
     ~Viz(void) { close(); }
-    Viz(xg::XG* x, vector<Packer>* p, const vector<string>& n, const string& o, int w, int h, bool c, bool d, bool t);
-    void init(xg::XG* x, vector<Packer>* p, const vector<string>& n, const string& o, int w, int h, bool c, bool d, bool t);
+    /// Set b to draw an overview where each pixel column sums up b bases of
+    /// the graph, and tb to split the overview into images of tb columns.
+    Viz(xg::XG* x, vector<Packer>* p, const vector<string>& n, const string& o, int w, int h, bool c, bool d, bool t,
+        size_t b = 0, size_t tb = 0);
+    void init(xg::XG* x, vector<Packer>* p, const vector<string>& n, const string& o, int w, int h, bool c, bool d, bool t,
+              size_t b = 0, size_t tb = 0);
     void draw(void);
     void draw_graph(void);
+    /// Draw the binned overview, into one image per tile
+    void draw_overview(void);
     void close(void);
 private:
     double node_offset(id_t id);
     double nodes_before_offset(size_t pos);
     void set_hash_color(const string& str);
     void compute_borders_and_dimensions(void);
+    /// Sum up the nodes, paths and coverage in each bin for the overview
+    void compute_overview(void);
+    /// Draw the overview bins in [first, last) onto the current surface
+    void draw_overview_bins(size_t first, size_t last);
+    /// Start drawing an image of the given size, to be written to the file
+    void open(const string& file, int width, int height);
     xg::XG* xgidx = nullptr;
     vector<Packer>* packs = nullptr;
     vector<string> pack_names;
     string outfile;
+    /// The file the current surface will be written to
+    string surface_file;
     cairo_surface_t *surface = nullptr;
 	cairo_t *cr = nullptr;
     bool output_png = false;
@@ -48,6 +62,17 @@ private:
     int image_height = 0;
     int left_border = 0;
     int top_border = 0;
+    /// Bases summed up in each pixel column of the overview, or 0 to draw
+    /// every base
+    size_t bin_bp = 0;
+    /// Columns in each overview image, or 0 for one image
+    size_t tile_bins = 0;
+    /// Number of nodes starting in each bin
+    vector<size_t> bin_nodes;
+    /// Bases of each path in each bin
+    vector<vector<size_t>> bin_path_bases;
+    /// Mean coverage of each pack in each bin
+    vector<vector<double>> bin_coverage;
 };
 
 tuple<double, double, double> hash_to_rgb(const string& str, double min_sum);
@@ -2,6 +2,8 @@
 #include "stream.hpp"
 #include "alignment.hpp"
 
+#include <gbwt/gbwt.h>
+
 #include <bitset>
 #include <arpa/inet.h>
 
@@ -85,11 +87,53 @@ XG::XG(function<void(function<void(Graph&)>)> get_chunks) {
 }
 
 XG::~XG(void) {
-    // Clean up any created XGPaths
-    while (!paths.empty()) {
-        delete paths.back();
-        paths.pop_back();
+    // Nothing to clean up; paths are views of our own storage
+}
+
+/// Read one path in the format used before version 10, when each path had its
+/// own succinct structures, and return its visits.
+static vector<trav_t> load_legacy_path(istream& in, uint32_t file_version) {
+    // Added to each stored ID to get the real node ID
+    int64_t id_shift = 0;
+    wt_gmr<> ids;
+    if (file_version >= 8) {
+        // IDs are in local space, counting from the min node ID
+        int64_t min_node_id;
+        sdsl::read_member(min_node_id, in);
+        id_shift = min_node_id - 1;
+        ids.load(in);
+    } else {
+        // We used to store a bunch of members we don't use now
+        rrr_vector<> nodes;
+        rrr_vector<>::rank_1_type nodes_rank;
+        rrr_vector<>::select_1_type nodes_select;
+        nodes.load(in);
+        nodes_rank.load(in);
+        nodes_select.load(in);
+        
+        // IDs are in global space
+        ids.load(in);
     }
+    
+    sd_vector<> directions;
+    int_vector<> ranks;
+    int_vector<> positions;
+    bit_vector offsets;
+    rank_support_v<1> offsets_rank;
+    bit_vector::select_1_type offsets_select;
+    directions.load(in);
+    ranks.load(in);
+    positions.load(in);
+    offsets.load(in);
+    offsets_rank.load(in, &offsets);
+    offsets_select.load(in, &offsets);
+    
+    vector<trav_t> path;
+    path.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        path.push_back(make_trav(ids[i] + id_shift, directions[i], ranks[i]));
+    }
+    return path;
 }
 
 void XG::load(istream& in) {
@@ -146,11 +190,12 @@ void XG::load(istream& in) {
         case 6:
         case 7:
         case 8:
+        case 9:
             cerr << "warning:[XG] Loading an out-of-date XG format. In-memory conversion between versions can be time-consuming. "
                  << "For better performance over repeated loads, consider recreating this XG with 'vg index' "
                  << "or upgrading it with 'vg xg'." << endl;
             // Fall through
-        case 9:
+        case 10:
             {
                 sdsl::read_member(seq_length, in);
                 sdsl::read_member(node_count, in);
@@ -201,16 +246,28 @@ void XG::load(istream& in) {
                 pn_bv_rank.load(in, &pn_bv);
                 pn_bv_select.load(in, &pn_bv);
                 pi_iv.load(in);
-                sdsl::read_member(path_count, in);
-                for (size_t i = 0; i < path_count; ++i) {
-                    auto path = new XGPath;
-                    // Load the path, giving it the file version and a
-                    // rank-to-ID comversion function for format upgrade
-                    // purposes.
-                    path->load(in, file_version, [&](size_t rank) {
-                        return rank_to_id(rank);
-                    });
-                    paths.push_back(path);
+                if (file_version <= 9) {
+                    // Each path was stored on its own, so read them all and
+                    // pack them into the shared path storage.
+                    sdsl::read_member(path_count, in);
+                    vector<vector<trav_t>> legacy_paths(path_count);
+                    vector<const vector<trav_t>*> path_travs;
+                    for (auto& legacy_path : legacy_paths) {
+                        legacy_path = load_legacy_path(in, file_version);
+                        path_travs.push_back(&legacy_path);
+                    }
+                    index_paths(path_travs);
+                } else {
+                    pv_off_iv.load(in);
+                    pb_off_iv.load(in);
+                    pv_wt.load(in);
+                    pv_dir_sv.load(in);
+                    pv_pos_iv.load(in);
+                    pv_rank_iv.load(in);
+                    pb_bv.load(in);
+                    pb_bv_rank.load(in, &pb_bv);
+                    pb_bv_select.load(in, &pb_bv);
+                    make_path_views();
                 }
                 np_iv.load(in);
                 np_bv.load(in);
@@ -259,157 +316,20 @@ void XG::load(istream& in) {
 
 }
 
-void XGPath::load(istream& in, uint32_t file_version, const function<int64_t(size_t)>& rank_to_id) {
-    if (file_version >= 8) {
-        // Min node ID readily available
-        sdsl::read_member(min_node_id, in);
-        
-        // IDs are in local space
-        ids.load(in);
-    } else {
-        // We used to store a bunch of members we don't use now
-        rrr_vector<> nodes;
-        rrr_vector<>::rank_1_type nodes_rank;
-        rrr_vector<>::select_1_type nodes_select;
-    
-        // Load up the old members, even though we discard them.
-        nodes.load(in);
-        nodes_rank.load(in);
-        nodes_select.load(in);
-        
-        // IDs are in global space; need converting to local.
-        wt_gmr<> old_ids;
-        old_ids.load(in);
-        
-        // Find the min node ID, which replaces nodes, nodes_rank, and nodes_select.
-        min_node_id = numeric_limits<int64_t>::max();
-        for (size_t i = 0; i < old_ids.size(); i++) {
-            min_node_id = min(min_node_id, (int64_t) old_ids[i]);
-        }
-        
-        // Now min_node_id is set so local_id() can work.
-        
-        // Make a new vector for the local-space IDs
-        int_vector<> new_ids;
-        util::assign(new_ids, int_vector<>(old_ids.size()));
-        
-        for (size_t i = 0; i < old_ids.size(); i++) {
-            // Convert each global ID to a local ID
-            auto new_id = local_id(old_ids[i]);
-            assert(new_id != 0);
-            new_ids[i] = new_id;
-        }
-        
-        // Compress the converted vector
-        util::bit_compress(new_ids);
-        // Create the real ids vector 
-        construct_im(ids, new_ids);
-    }
-    
-    directions.load(in);
-    ranks.load(in);
-    positions.load(in);
-    offsets.load(in);
-    offsets_rank.load(in, &offsets);
-    offsets_select.load(in, &offsets);
+XGPath::XGPath(const XG& graph, size_t visit_start, size_t visit_count,
+               size_t base_start, size_t base_count) :
+    graph(&graph), visit_start(visit_start), visit_count(visit_count),
+    base_start(base_start), base_count(base_count),
+    starts_before(graph.pb_bv_rank(base_start)) {
+    // Nothing to do
 }
 
-size_t XGPath::serialize(std::ostream& out,
-                         sdsl::structure_tree_node* v,
-                         std::string name) const {
-    sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(v, name, sdsl::util::class_name(*this));
-    size_t written = 0;
-    written += sdsl::write_member(min_node_id, out, child, "min_node_id" + name);
-    written += ids.serialize(out, child, "path_node_ids_" + name);
-    written += directions.serialize(out, child, "path_node_directions_" + name);
-    written += ranks.serialize(out, child, "path_mapping_ranks_" + name);
-    written += positions.serialize(out, child, "path_node_offsets_" + name);
-    written += offsets.serialize(out, child, "path_node_starts_" + name);
-    written += offsets_rank.serialize(out, child, "path_node_starts_rank_" + name);
-    written += offsets_select.serialize(out, child, "path_node_starts_select_" + name);
-    
-    sdsl::structure_tree::add_size(child, written);
-    
-    return written;
+size_t XGPath::size() const {
+    return visit_count;
 }
 
-XGPath::XGPath(const string& path_name,
-               const vector<trav_t>& path,
-               size_t node_count,
-               XG& graph,
-               size_t* unique_member_count_out) {
-
-    // node ids, the literal path
-    int_vector<> ids_iv;
-    util::assign(ids_iv, int_vector<>(path.size()));
-    // directions of traversal (typically forward, but we allow backwards
-    bit_vector directions_bv;
-    util::assign(directions_bv, bit_vector(path.size()));
-    // node positions in path
-    util::assign(positions, int_vector<>(path.size()));
-    // mapping ranks in path
-    util::assign(ranks, int_vector<>(path.size()));
-
-    size_t path_off = 0;
-    size_t members_off = 0;
-    size_t positions_off = 0;
-    size_t path_length = 0;
-    min_node_id = numeric_limits<int64_t>::max();
-
-    // determine min node id
-    for (size_t i = 0; i < path.size(); ++i) {
-        auto node_id = trav_id(path[i]);
-        min_node_id = min(min_node_id, node_id);
-    }
-    // determine total length and record node ids
-    for (size_t i = 0; i < path.size(); ++i) {
-        auto node_id = trav_id(path[i]);
-        path_length += graph.node_length(node_id);
-        ids_iv[i] = local_id(node_id);
-        // we will explode if the node isn't in the graph
-    }
-
-    // make the bitvector for path offsets
-    util::assign(offsets, bit_vector(path_length));
-    set<int64_t> uniq_nodes;
-    //cerr << "path " << path_name << " has " << path.size() << endl;
-    for (size_t i = 0; i < path.size(); ++i) {
-        //cerr << i << endl;
-        auto& trav = path[i];
-        auto node_id = trav_id(trav);
-        bool is_reverse = trav_is_rev(trav);
-        // record direction of passage through node
-        directions_bv[i] = is_reverse;
-        // and the external rank of the mapping
-        ranks[i] = trav_rank(trav);
-        // we've seen another entity
-        uniq_nodes.insert(node_id);
-        // and record node offset in path
-        positions[positions_off++] = path_off;
-        // record position of node
-        offsets[path_off] = 1;
-        // and update the offset counter
-        path_off += graph.node_length(node_id);
-    }
-    //cerr << uniq_nodes.size() << " vs " << path.size() << endl;
-    if(unique_member_count_out) {
-        // set member count as the unique entities that are in the path
-        // We don't need it but our caller might
-        *unique_member_count_out = uniq_nodes.size();
-    }
-    // and traversal information
-    util::assign(directions, sd_vector<>(directions_bv));
-    // handle entity lookup structure (wavelet tree)
-    util::bit_compress(ids_iv);
-    construct_im(ids, ids_iv);
-    // bit compress the positional offset info
-    util::bit_compress(positions);
-    // bit compress mapping ranks
-    util::bit_compress(ranks);
-
-    // and set up rank/select dictionary on them
-    util::assign(offsets_rank, rank_support_v<1>(&offsets));
-    util::assign(offsets_select, bit_vector::select_1_type(&offsets));
+size_t XGPath::length() const {
+    return base_count;
 }
 
 Mapping XGPath::mapping(size_t offset, const function<int64_t(id_t)>& node_length) const {
@@ -417,8 +337,8 @@ Mapping XGPath::mapping(size_t offset, const function<int64_t(id_t)>& node_lengt
     Mapping m;
     // store the starting position and series of edits
     m.mutable_position()->set_node_id(node(offset));
-    m.mutable_position()->set_is_reverse(directions[offset]);
-    m.set_rank(ranks[offset]);
+    m.mutable_position()->set_is_reverse(is_reverse(offset));
+    m.set_rank(mapping_rank(offset));
     int64_t l = node_length(m.position().node_id());
     Edit* e = m.add_edit();
     e->set_from_length(l);
@@ -427,31 +347,55 @@ Mapping XGPath::mapping(size_t offset, const function<int64_t(id_t)>& node_lengt
 }
 
 id_t XGPath::node(size_t offset) const {
-    return external_id(ids[offset]);
+    return graph->rank_to_id(graph->pv_wt[visit_start + offset]);
 }
-    
-id_t XGPath::node_at_position(size_t pos) const {
-    return node(offset_at_position(pos));
+
+bool XGPath::is_reverse(size_t offset) const {
+    return graph->pv_dir_sv[visit_start + offset];
 }
 
-size_t XGPath::offset_at_position(size_t pos) const {
-    return offsets_rank(pos+1)-1;
+int64_t XGPath::mapping_rank(size_t offset) const {
+    return graph->pv_rank_iv[visit_start + offset];
 }
 
-bool XGPath::is_reverse(size_t offset) const {
-    return directions[offset];
+size_t XGPath::position(size_t offset) const {
+    return graph->pv_pos_iv[visit_start + offset];
 }
 
-id_t XGPath::local_id(id_t id) const {
-    if (id < min_node_id) {
-        return numeric_limits<int64_t>::max();
-    } else {
-        return id-min_node_id+1;
+size_t XGPath::occurrence_count(id_t id) const {
+    size_t rank = graph->id_to_rank(id);
+    if (rank == 0) {
+        return 0;
     }
+    return graph->pv_wt.rank(visit_start + visit_count, rank) - graph->pv_wt.rank(visit_start, rank);
 }
 
-id_t XGPath::external_id(id_t id) const {
-    return id+min_node_id-1;
+vector<size_t> XGPath::occurrences(id_t id) const {
+    vector<size_t> found;
+    size_t rank = graph->id_to_rank(id);
+    if (rank == 0) {
+        return found;
+    }
+    // Visits to the node from earlier paths come first in the shared storage
+    size_t before = graph->pv_wt.rank(visit_start, rank);
+    size_t count = graph->pv_wt.rank(visit_start + visit_count, rank) - before;
+    found.reserve(count);
+    for (size_t i = 1; i <= count; ++i) {
+        found.push_back(graph->pv_wt.select(before + i, rank) - visit_start);
+    }
+    return found;
+}
+    
+id_t XGPath::node_at_position(size_t pos) const {
+    return node(offset_at_position(pos));
+}
+
+size_t XGPath::offset_at_position(size_t pos) const {
+    return graph->pb_bv_rank(base_start + pos + 1) - starts_before - 1;
+}
+
+size_t XGPath::visit_start_at_position(size_t pos) const {
+    return graph->pb_bv_select(graph->pb_bv_rank(base_start + pos + 1)) - base_start;
 }
 
 size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string name) {
@@ -517,13 +461,15 @@ size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string nam
     paths_written += pn_bv_rank.serialize(out, paths_child, "path_names_starts_rank");
     paths_written += pn_bv_select.serialize(out, paths_child, "path_names_starts_select");
     paths_written += pi_iv.serialize(out, paths_child, "path_ids");
-    // TODO: Path count is written twice (once from paths.size() and once earlier from path_count)
-    // We should remove one and cut a new xg version
-    paths_written += sdsl::write_member(paths.size(), out, paths_child, "path_count");    
-    for (size_t i = 0; i < paths.size(); i++) {
-        XGPath* path = paths[i];
-        paths_written += path->serialize(out, paths_child, "path:" + path_name(i + 1));
-    }
+    paths_written += pv_off_iv.serialize(out, paths_child, "path_visit_starts");
+    paths_written += pb_off_iv.serialize(out, paths_child, "path_base_starts");
+    paths_written += pv_wt.serialize(out, paths_child, "path_node_ranks");
+    paths_written += pv_dir_sv.serialize(out, paths_child, "path_node_directions");
+    paths_written += pv_pos_iv.serialize(out, paths_child, "path_node_offsets");
+    paths_written += pv_rank_iv.serialize(out, paths_child, "path_mapping_ranks");
+    paths_written += pb_bv.serialize(out, paths_child, "path_node_starts");
+    paths_written += pb_bv_rank.serialize(out, paths_child, "path_node_starts_rank");
+    paths_written += pb_bv_select.serialize(out, paths_child, "path_node_starts_select");
     
     paths_written += np_iv.serialize(out, paths_child, "node_path_mapping");
     paths_written += np_bv.serialize(out, paths_child, "node_path_mapping_starts");
@@ -589,11 +535,15 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
     map<string, vector<trav_t> > path_nodes;
 
     // This takes in graph chunks and adds them into our temporary storage.
+    // It may be called from several threads at once (for example by a
+    // get_chunks that decodes chunks in parallel), so the merge is serialized.
     function<void(Graph&)> lambda = [this,
                                      &node_label,
                                      &from_to,
                                      &to_from,
                                      &path_nodes](Graph& graph) {
+#pragma omp critical (xg_from_callback)
+        {
 
         for (int64_t i = 0; i < graph.node_size(); ++i) {
             const Node& n = graph.node(i);
@@ -637,6 +587,7 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
 #endif
 
         }
+        }
     };
 
     // Get all the chunks via the callback, and have them called back to us.
@@ -684,6 +635,97 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
     
 }
 
+void XG::set_node_order(NodeOrder order) {
+    node_order = order;
+}
+
+void XG::order_nodes(vector<pair<id_t, string> >& node_label,
+                     const unordered_map<side_t, vector<side_t> >& from_to,
+                     const unordered_map<side_t, vector<side_t> >& to_from,
+                     const map<string, vector<trav_t> >& path_nodes) const {
+    
+    // the labels are sorted by ID, so we can find a node's index in them by binary search
+    auto index_of = [&](id_t id) {
+        auto found = std::lower_bound(node_label.begin(), node_label.end(), id,
+                                      [](const pair<id_t, string>& label, id_t id) { return label.first < id; });
+        return (found != node_label.end() && found->first == id) ? (size_t)(found - node_label.begin()) : node_label.size();
+    };
+    
+    // the nodes attached to a node on either side, in ID order so the layout is deterministic
+    vector<size_t> neighbors;
+    auto get_neighbors = [&](size_t i) {
+        neighbors.clear();
+        for (auto is_end : { false, true }) {
+            side_t side = make_side(node_label[i].first, is_end);
+            for (auto* edges : { &from_to, &to_from }) {
+                auto found = edges->find(side);
+                if (found != edges->end()) {
+                    for (auto& other : found->second) {
+                        neighbors.push_back(index_of(side_id(other)));
+                    }
+                }
+            }
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    };
+    
+    vector<bool> on_path(node_label.size(), false);
+    if (node_order == PATH_ORDER) {
+        for (auto& path : path_nodes) {
+            for (auto& trav : path.second) {
+                size_t i = index_of(trav_id(trav));
+                if (i < node_label.size()) {
+                    on_path[i] = true;
+                }
+            }
+        }
+    }
+    
+    vector<size_t> order;
+    order.reserve(node_label.size());
+    vector<bool> placed(node_label.size(), false);
+    
+    // place a node, and then breadth-first everything reachable from it through
+    // unplaced nodes that aren't on paths
+    auto place_from = [&](size_t start) {
+        placed[start] = true;
+        order.push_back(start);
+        for (size_t next = order.size() - 1; next < order.size(); ++next) {
+            get_neighbors(order[next]);
+            for (size_t i : neighbors) {
+                if (i < node_label.size() && !placed[i] && !on_path[i]) {
+                    placed[i] = true;
+                    order.push_back(i);
+                }
+            }
+        }
+    };
+    
+    if (node_order == PATH_ORDER) {
+        for (auto& path : path_nodes) {
+            for (auto& trav : path.second) {
+                size_t i = index_of(trav_id(trav));
+                if (i < node_label.size() && !placed[i]) {
+                    place_from(i);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < node_label.size(); ++i) {
+        if (!placed[i]) {
+            place_from(i);
+        }
+    }
+    
+    vector<pair<id_t, string> > ordered_label;
+    ordered_label.reserve(node_label.size());
+    for (size_t i : order) {
+        ordered_label.emplace_back(std::move(node_label[i]));
+    }
+    node_label = std::move(ordered_label);
+}
+
 void XG::build(vector<pair<id_t, string> >& node_label,
                unordered_map<side_t, vector<side_t> >& from_to,
                unordered_map<side_t, vector<side_t> >& to_from,
@@ -708,6 +750,15 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     min_id = node_label.begin()->first;
     max_id = node_label.rbegin()->first;
     
+    // everything below gives the nodes their ranks in the order of node_label
+    if (node_order != ID_ORDER) {
+        if (store_threads && is_sorted_dag) {
+            cerr << "[xg] error: cannot store threads for a sorted DAG with nodes out of ID order" << endl;
+            exit(1);
+        }
+        order_nodes(node_label, from_to, to_from, path_nodes);
+    }
+    
     // set up our compressed representation
     int_vector<> i_iv;
     util::assign(s_iv, int_vector<>(seq_length, 0, 3));
@@ -772,8 +823,11 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         size_t from_edge_count_idx = g++;
         // write the edges in id-based format
         // we will next convert these into relative format
+        // Edges may have arrived in any order (if chunks were loaded in
+        // parallel) so sort them to keep the index deterministic.
         for (auto end : { false, true }) {
             auto& to_sides = to_from[make_side(n.id(), end)];
+            std::sort(to_sides.begin(), to_sides.end());
             for (auto& e : to_sides) {
                 g_iv[g++] = side_id(e);
                 g_iv[g++] = edge_type(side_is_end(e), end);
@@ -783,6 +837,7 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         g_iv[to_edge_count_idx] = to_edge_count;
         for (auto end : { false, true }) {
             auto& from_sides = from_to[make_side(n.id(), end)];
+            std::sort(from_sides.begin(), from_sides.end());
             for (auto& e : from_sides) {
                 g_iv[g++] = side_id(e);
                 g_iv[g++] = edge_type(end, side_is_end(e));
@@ -797,6 +852,9 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     util::assign(g_bv_select, bit_vector::select_1_type(&g_bv));
     
     // convert the edges in g_iv to relativistic form
+    // Each node record is independent, and g_iv is not yet bit-compressed, so
+    // the records can be rewritten in parallel.
+#pragma omp parallel for schedule(dynamic, 1024)
     for (int64_t i = 0; i < node_count; ++i) {
         int64_t id = i_iv[i];
         // find the start of the node's record in g_iv
@@ -829,18 +887,15 @@ void XG::build(vector<pair<id_t, string> >& node_label,
 #endif
     // paths
     string path_names;
-    size_t path_node_count = 0; // count of node path memberships
+    vector<const vector<trav_t>*> path_travs;
     for (auto& pathpair : path_nodes) {
         // add path name
         const string& path_name = pathpair.first;
         //cerr << path_name << endl;
         path_names += start_marker + path_name + end_marker;
-        // The path constructor helpfully counts unique path members for us
-        size_t unique_member_count;
-        XGPath* path = new XGPath(path_name, pathpair.second, node_count, *this, &unique_member_count);
-        paths.push_back(path);
-        path_node_count += unique_member_count;
+        path_travs.push_back(&pathpair.second);
     }
+    index_paths(path_travs);
 
     // handle path names
     util::assign(pn_iv, int_vector<>(path_names.size()));
@@ -861,20 +916,45 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     construct(pn_csa, path_name_file, 1);
 
     // node -> paths
+    // Collect the distinct (node rank, path rank) memberships of each path in
+    // parallel and sort them into node order, instead of asking every path
+    // about every node.
+    vector<vector<pair<size_t, size_t>>> path_memberships(path_travs.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t j = 0; j < path_travs.size(); ++j) {
+        auto& memberships = path_memberships[j];
+        memberships.reserve(path_travs[j]->size());
+        for (auto& trav : *path_travs[j]) {
+            memberships.emplace_back(id_to_rank(trav_id(trav)), j + 1);
+        }
+        std::sort(memberships.begin(), memberships.end());
+        memberships.erase(std::unique(memberships.begin(), memberships.end()), memberships.end());
+    }
+    size_t path_node_count = 0; // count of node path memberships
+    for (auto& memberships : path_memberships) {
+        path_node_count += memberships.size();
+    }
+    vector<pair<size_t, size_t>> node_memberships;
+    node_memberships.reserve(path_node_count);
+    for (auto& memberships : path_memberships) {
+        node_memberships.insert(node_memberships.end(), memberships.begin(), memberships.end());
+        vector<pair<size_t, size_t>>().swap(memberships);
+    }
+    std::sort(node_memberships.begin(), node_memberships.end());
+    
     util::assign(np_iv, int_vector<>(path_node_count+node_count));
     util::assign(np_bv, bit_vector(path_node_count+node_count));
     size_t np_off = 0;
+    size_t membership = 0;
     for (size_t i = 0; i < node_count; ++i) {
         np_bv[np_off] = 1;
         np_iv[np_off] = 0; // null so we can detect entities with no path membership
         ++np_off;
-        id_t id = rank_to_id(i+1);
-        for (size_t j = 1; j <= paths.size(); ++j) {
-            if (node_occs_in_path(id, j) > 0) {
-                np_iv[np_off++] = j;
-            }
+        while (membership < node_memberships.size() && node_memberships[membership].first == i+1) {
+            np_iv[np_off++] = node_memberships[membership++].second;
         }
     }
+    vector<pair<size_t, size_t>>().swap(node_memberships);
 
     util::bit_compress(np_iv);
     //cerr << ep_off << " " << path_entities << " " << entity_count << endl;
@@ -1032,22 +1112,17 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         cerr << "paths (" << paths.size() << ")" << endl;
         for (size_t i = 0; i < paths.size(); i++) {
             // Go through paths by number, so we can determine rank
-            XGPath* path = paths[i];
+            const XGPath& path = paths[i];
             
             cerr << path_name(i + 1) << endl;
-            // manually print IDs because simplified wavelet tree doesn't support ostream for some reason
-            for (size_t j = 0; j + 1 < path->ids.size(); j++) {
-                cerr << path->node(j) << " ";
-            }
-            if (path->ids.size() > 0) {
-                cerr << path->node(path->ids.size() - 1);
+            for (size_t j = 0; j < path.size(); j++) {
+                cerr << path.node(j) << (path.is_reverse(j) ? "-" : "+")
+                     << "@" << path.position(j) << "#" << path.mapping_rank(j)
+                     << (j + 1 < path.size() ? " " : "");
             }
             cerr << endl;
-            cerr << path->ranks << endl;
-            cerr << path->directions << endl;
-            cerr << path->positions << endl;
-            cerr << path->offsets << endl;
         }
+        cerr << pb_bv << endl;
         cerr << np_bv << endl;
         cerr << np_iv << endl;
         
@@ -1159,6 +1234,78 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     
 }
     
+void XG::index_paths(const vector<const vector<trav_t>*>& path_travs) {
+    // Lay out the headers first, so we know where everything goes
+    size_t total_visits = 0;
+    size_t total_bases = 0;
+    util::assign(pv_off_iv, int_vector<>(path_travs.size() + 1));
+    util::assign(pb_off_iv, int_vector<>(path_travs.size() + 1));
+    for (size_t i = 0; i < path_travs.size(); ++i) {
+        pv_off_iv[i] = total_visits;
+        pb_off_iv[i] = total_bases;
+        total_visits += path_travs[i]->size();
+        for (auto& trav : *path_travs[i]) {
+            // we will explode if the node isn't in the graph
+            total_bases += node_length(trav_id(trav));
+        }
+    }
+    pv_off_iv[path_travs.size()] = total_visits;
+    pb_off_iv[path_travs.size()] = total_bases;
+
+    // node ranks, the literal paths
+    int_vector<> ranks_iv;
+    util::assign(ranks_iv, int_vector<>(total_visits));
+    // directions of traversal (typically forward, but we allow backwards)
+    bit_vector directions_bv;
+    util::assign(directions_bv, bit_vector(total_visits));
+    util::assign(pv_pos_iv, int_vector<>(total_visits));
+    util::assign(pv_rank_iv, int_vector<>(total_visits));
+    util::assign(pb_bv, bit_vector(total_bases));
+
+    size_t visit = 0;
+    size_t base = 0;
+    for (auto* path : path_travs) {
+        size_t path_off = 0;
+        for (auto& trav : *path) {
+            auto node_id = trav_id(trav);
+            ranks_iv[visit] = id_to_rank(node_id);
+            directions_bv[visit] = trav_is_rev(trav);
+            // and the external rank of the mapping
+            pv_rank_iv[visit] = trav_rank(trav);
+            // record node offset in path
+            pv_pos_iv[visit] = path_off;
+            // and where the node starts among all the paths' bases
+            pb_bv[base + path_off] = 1;
+            path_off += node_length(node_id);
+            ++visit;
+        }
+        base += path_off;
+    }
+
+    util::bit_compress(pv_off_iv);
+    util::bit_compress(pb_off_iv);
+    // handle entity lookup structure (wavelet tree)
+    util::bit_compress(ranks_iv);
+    construct_im(pv_wt, ranks_iv);
+    util::assign(pv_dir_sv, sd_vector<>(directions_bv));
+    util::bit_compress(pv_pos_iv);
+    util::bit_compress(pv_rank_iv);
+    util::assign(pb_bv_rank, rank_support_v<1>(&pb_bv));
+    util::assign(pb_bv_select, bit_vector::select_1_type(&pb_bv));
+
+    make_path_views();
+}
+
+void XG::make_path_views() {
+    paths.clear();
+    size_t count = pv_off_iv.empty() ? 0 : pv_off_iv.size() - 1;
+    paths.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        paths.emplace_back(*this, pv_off_iv[i], pv_off_iv[i + 1] - pv_off_iv[i],
+                           pb_off_iv[i], pb_off_iv[i + 1] - pb_off_iv[i]);
+    }
+}
+
 void XG::index_component_path_sets() {
     
     // for safety, empty the indexes
@@ -1335,14 +1482,62 @@ string XG::node_sequence(int64_t id) const {
         throw runtime_error("xg cannot get sequence for nonexistent node " + to_string(id));
     }
     size_t start = s_bv_select(rank);
-    size_t end = rank == node_count ? s_bv.size() : s_bv_select(rank+1);
+    size_t end = node_seq_end(rank);
     string s; s.resize(end-start);
-    for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-        s[i-start] = revdna3bit(s_iv[i]);
-    }
+    decode_sequence(start, end - start, false, &s[0]);
     return s;
 }
 
+size_t XG::node_seq_end(size_t rank) const {
+    // There's no start bit after the last node
+    return rank == node_count ? s_bv.size() : s_bv_select(rank+1);
+}
+
+void XG::decode_sequence(size_t start, size_t length, bool reverse, char* dest) const {
+    // Decoding tables for the codes produced by dna3bit, straight and complemented
+    static const char forward_table[8] = {'A', 'T', 'C', 'G', 'N', 'N', 'N', 'N'};
+    static const char complement_table[8] = {'T', 'A', 'G', 'C', 'N', 'N', 'N', 'N'};
+    
+    if (length == 0) {
+        return;
+    }
+    assert(start + length <= s_iv.size());
+    
+    // Instead of going through the int_vector accessor for every character, we
+    // keep the current word of the packed vector in a register and shift codes
+    // out of it.
+    const uint64_t* data = s_iv.data();
+    const uint8_t width = s_iv.width();
+    const uint64_t mask = sdsl::bits::lo_set[width];
+    size_t word_index = (start * width) >> 6;
+    uint8_t offset_in_word = (start * width) & 63;
+    uint64_t word = data[word_index] >> offset_in_word;
+    uint8_t bits_left = 64 - offset_in_word;
+    
+    // For the reverse strand we complement and fill from the back, so no
+    // separate reverse complement pass is needed.
+    const char* table = reverse ? complement_table : forward_table;
+    char* out = reverse ? dest + length - 1 : dest;
+    ptrdiff_t step = reverse ? -1 : 1;
+    
+    for (size_t i = 0; i < length; i++) {
+        uint64_t code;
+        if (bits_left >= width) {
+            code = word & mask;
+            word >>= width;
+            bits_left -= width;
+        } else {
+            // This code straddles a word boundary
+            uint64_t next = data[++word_index];
+            code = (word | (next << bits_left)) & mask;
+            word = next >> (width - bits_left);
+            bits_left = 64 - (width - bits_left);
+        }
+        *out = table[code & 7];
+        out += step;
+    }
+}
+
 size_t XG::node_length(int64_t id) const {
     size_t rank = id_to_rank(id);
     size_t start = s_bv_select(rank);
@@ -1360,7 +1555,7 @@ char XG::pos_char(int64_t id, bool is_rev, size_t off) const {
         return c;
     } else {
         size_t rank = id_to_rank(id);
-        size_t pos = s_bv_select(rank+1) - (off+1);
+        size_t pos = node_seq_end(rank) - (off+1);
         assert(pos < s_iv.size());
         char c = revdna3bit(s_iv[pos]);
         return reverse_complement(c);
@@ -1368,41 +1563,37 @@ char XG::pos_char(int64_t id, bool is_rev, size_t off) const {
 }
 
 string XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len) const {
+    string s;
+    pos_substr(id, is_rev, off, len, s);
+    return s;
+}
+
+void XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len, string& dest) const {
+    size_t rank = id_to_rank(id);
+    size_t node_start = s_bv_select(rank);
+    size_t node_end = node_seq_end(rank);
+    size_t start, end;
     if (!is_rev) {
-        size_t rank = id_to_rank(id);
-        size_t start = s_bv_select(rank) + off;
+        start = node_start + off;
         assert(start < s_iv.size());
         // get until the end position, or the end of the node, which ever is first
-        size_t end;
         if (!len) {
-            end = s_bv_select(rank+1);
+            end = node_end;
         } else {
-            end = min(start + len, (size_t)s_bv_select(rank+1));
-        }
-        assert(end < s_iv.size());
-        string s; s.resize(end-start);
-        for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-            s[i-start] = revdna3bit(s_iv[i]);
+            end = min(start + len, node_end);
         }
-        return s;
     } else {
-        size_t rank = id_to_rank(id);
-        size_t end = s_bv_select(rank+1) - off;
-        assert(end < s_iv.size());
+        end = node_end - off;
         // get until the end position, or the end of the node, which ever is first
-        size_t start;
         if (len > end || !len) {
-            start = s_bv_select(rank);
+            start = node_start;
         } else {
-            start = max(end - len, (size_t)s_bv_select(rank));
+            start = max(end - len, node_start);
         }
-        assert(end < s_iv.size());
-        string s; s.resize(end-start);
-        for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-            s[i-start] = revdna3bit(s_iv[i]);
-        }
-        return reverse_complement(s);
     }
+    assert(end <= s_iv.size());
+    dest.resize(end - start);
+    decode_sequence(start, end - start, is_rev, &dest[0]);
 }
 
 size_t XG::id_to_rank(int64_t id) const {
@@ -1613,25 +1804,21 @@ size_t XG::get_length(const handle_t& handle) const {
 }
 
 string XG::get_sequence(const handle_t& handle) const {
-    
+    string sequence;
+    get_sequence(handle, sequence);
+    return sequence;
+}
+
+void XG::get_sequence(const handle_t& handle, string& dest) const {
     // Figure out how big it should be
     size_t sequence_size = get_length(handle);
-    // Allocate the sequence string
-    string sequence(sequence_size, '\0');
+    dest.resize(sequence_size);
     // Extract the node record start
     size_t g = as_integer(handle) & LOW_BITS;
     // Figure out where the sequence starts
     size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
-    for (int64_t i = 0; i < sequence_size; i++) {
-        // Blit the sequence out
-        sequence[i] = revdna3bit(s_iv[sequence_start + i]);
-    }
-    
-    if (as_integer(handle) & HIGH_BIT) {
-        return reverse_complement(sequence);
-    } else {
-        return sequence;
-    }
+    // Blit the sequence out, reverse complementing on the fly if needed
+    decode_sequence(sequence_start, sequence_size, as_integer(handle) & HIGH_BIT, &dest[0]);
 }
 
 bool XG::edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const {
@@ -1727,6 +1914,65 @@ bool XG::follow_edges(const handle_t& handle, bool go_left, const function<bool(
     }
 }
 
+size_t XG::get_degree(const handle_t& handle, bool go_left) const {
+    
+    // Unpack the handle
+    size_t g = as_integer(handle) & LOW_BITS;
+    bool is_reverse = get_is_reverse(handle);
+    
+    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
+    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+    
+    // The to edges and from edges are adjacent, so we can scan them in one run
+    size_t start = g + G_NODE_HEADER_LENGTH;
+    size_t degree = 0;
+    for (size_t i = 0; i < edges_to_count + edges_from_count; i++) {
+        int type = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_TYPE_OFFSET];
+        if (edge_filter(type, i < edges_to_count, go_left, is_reverse)) {
+            degree++;
+        }
+    }
+    
+    return degree;
+}
+
+void XG::get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& dest) const {
+    dest.clear();
+    
+    // Unpack the handle
+    size_t g = as_integer(handle) & LOW_BITS;
+    bool is_reverse = get_is_reverse(handle);
+    
+    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
+    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+    
+    // Scan the to edges and then the from edges, in the same order as
+    // follow_edges(), without going through a callback.
+    size_t start = g + G_NODE_HEADER_LENGTH;
+    for (size_t i = 0; i < edges_to_count + edges_from_count; i++) {
+        int type = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_TYPE_OFFSET];
+        if (edge_filter(type, i < edges_to_count, go_left, is_reverse)) {
+            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
+            bool new_reverse = is_reverse != (type == 2 || type == 3);
+            dest.push_back(as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0)));
+        }
+    }
+}
+
+void XG::get_lengths(const vector<handle_t>& handles, vector<size_t>& dest) const {
+    dest.resize(handles.size());
+    for (size_t i = 0; i < handles.size(); i++) {
+        dest[i] = g_iv[(as_integer(handles[i]) & LOW_BITS) + G_NODE_LENGTH_OFFSET];
+    }
+}
+
+void XG::get_sequences(const vector<handle_t>& handles, vector<string>& dest) const {
+    dest.resize(handles.size());
+    for (size_t i = 0; i < handles.size(); i++) {
+        get_sequence(handles[i], dest[i]);
+    }
+}
+
 void XG::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
     // How big is the g vector entry size we are on?
     size_t entry_size = 0;
@@ -1738,27 +1984,30 @@ void XG::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool p
         // Just make it into a handle; we're always forward.
         handle_t handle = as_handle(g);
         
-        // Run the iteratee
-        if (!iteratee(handle)) {
-            // The iteratee is bored and wants to stop.
-            return;
-        }
-    
         // How many edges are there of each type on this record?
         size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
         size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
         
         // This record is the header plus all the edge records it contains
         entry_size = G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * (edges_to_count + edges_from_count);
+        
+        // Run the iteratee, which returns false if it is bored and wants to stop.
+        return iteratee(handle);
     };
     if (parallel) {
-#pragma omp parallel for schedule(dynamic,1)
-        for (size_t g = 0; g < g_iv.size(); g += entry_size) {
-            lambda(g);
+        // We can't hop from record to record in parallel, since each record's
+        // size comes from the one before. Instead partition the nodes
+        // statically by rank and find each record with the select support.
+        // The iteratee can't stop us early here.
+#pragma omp parallel for schedule(static)
+        for (size_t rank = 1; rank <= node_count; rank++) {
+            iteratee(as_handle(g_bv_select(rank)));
         }
     } else {
         for (size_t g = 0; g < g_iv.size(); g += entry_size) {
-            lambda(g);
+            if (!lambda(g)) {
+                break;
+            }
         }
     }
 }
@@ -1768,29 +2017,42 @@ size_t XG::node_size() const {
 }
 
 vector<Edge> XG::edges_of(int64_t id) const {
-    size_t g = g_bv_select(id_to_rank(id));
-    int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
-    int edges_from_count = g_iv[g+G_NODE_FROM_COUNT_OFFSET];
-    int64_t t = g + G_NODE_HEADER_LENGTH;
-    int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
     vector<Edge> edges;
-    for (int64_t j = t; j < f; ) {
-        int64_t from = g+g_iv[j++];
-        int type = g_iv[j++];
-        edges.push_back(edge_from_encoding(from, g, type));
-    }
-    for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; ) {
-        int64_t to = g+g_iv[j++];
-        int type = g_iv[j++];
-        edges.push_back(edge_from_encoding(g, to, type));
-    }
-    for (auto& edge : edges) { 
-        edge.set_from(g_iv[edge.from()+G_NODE_ID_OFFSET]);
-        edge.set_to(g_iv[edge.to()+G_NODE_ID_OFFSET]);
-    }
+    for_each_edge_of(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+        edges.push_back(make_edge(from, from_start, to, to_end));
+        return true;
+    });
     return edges;
 }
 
+bool XG::for_each_edge_of(int64_t id, const function<bool(int64_t from, bool from_start, int64_t to, bool to_end)>& iteratee) const {
+    size_t g = g_bv_select(id_to_rank(id));
+    size_t edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
+    size_t edges_from_count = g_iv[g+G_NODE_FROM_COUNT_OFFSET];
+    // The edges where we are the to node come first, then those where we are the from node
+    size_t start = g + G_NODE_HEADER_LENGTH;
+    for (size_t i = 0; i < edges_to_count + edges_from_count; i++) {
+        size_t j = start + i * G_EDGE_LENGTH;
+        // Offsets to the other node are stored relative to us, and may be negative
+        int64_t other = g + g_iv[j + G_EDGE_OFFSET_OFFSET];
+        int type = g_iv[j + G_EDGE_TYPE_OFFSET];
+        // Decode the type (as in edge_from_encoding)
+        bool from_start = (type == 3 || type == 4);
+        bool to_end = (type == 2 || type == 4);
+        int64_t other_id = g_iv[other + G_NODE_ID_OFFSET];
+        bool keep_going;
+        if (i < edges_to_count) {
+            keep_going = iteratee(other_id, from_start, id, to_end);
+        } else {
+            keep_going = iteratee(id, from_start, other_id, to_end);
+        }
+        if (!keep_going) {
+            return false;
+        }
+    }
+    return true;
+}
+
 vector<Edge> XG::edges_to(int64_t id) const {
     size_t g = g_bv_select(id_to_rank(id));
     int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
@@ -1832,21 +2094,23 @@ vector<Edge> XG::edges_from(int64_t id) const {
 
 vector<Edge> XG::edges_on_start(int64_t id) const {
     vector<Edge> edges;
-    for (auto& edge : edges_of(id)) {
-        if((edge.to() == id && !edge.to_end()) || (edge.from() == id && edge.from_start())) {
-            edges.push_back(edge);
+    for_each_edge_of(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+        if((to == id && !to_end) || (from == id && from_start)) {
+            edges.push_back(make_edge(from, from_start, to, to_end));
         }
-    }
+        return true;
+    });
     return edges;
 }
 
 vector<Edge> XG::edges_on_end(int64_t id) const {
     vector<Edge> edges;
-    for (auto& edge : edges_of(id)) {
-        if((edge.to() == id && edge.to_end()) || (edge.from() == id && !edge.from_start())) {
-            edges.push_back(edge);
+    for_each_edge_of(id, [&](int64_t from, bool from_start, int64_t to, bool to_end) {
+        if((to == id && to_end) || (from == id && !from_start)) {
+            edges.push_back(make_edge(from, from_start, to, to_end));
         }
-    }
+        return true;
+    });
     return edges;
 }
 
@@ -1938,7 +2202,7 @@ Path XG::path(const string& name) const {
     // Extract a whole path by name
     
     // First find the XGPath we're using to store it.
-    const XGPath& xgpath = *(paths[path_rank(name)-1]);
+    const XGPath& xgpath = paths[path_rank(name)-1];
     
     // Make a new path to fill in
     Path to_return;
@@ -1946,7 +2210,7 @@ Path XG::path(const string& name) const {
     to_return.set_name(name);
     
     // There's one ID entry per node visit    
-    size_t total_nodes = xgpath.ids.size();
+    size_t total_nodes = xgpath.size();
     auto get_node_length = [&](id_t id){ return get_length(get_handle(id, false)); };
     for(size_t i = 0; i < total_nodes; i++) {
         // For everything on the XGPath, put a Mapping on the real path.
@@ -1983,13 +2247,37 @@ Alignment XG::path_as_alignment(const Path& path) {
 vector<Alignment> XG::paths_as_alignments(void) {
     vector<Alignment> alns;
     for (size_t i = 0; i < paths.size(); ++i) {
-        alns.emplace_back(path_as_alignment(path_name(i+1)));
+        alns.emplace_back(path_as_alignment(i+1));
     }
     return alns;
 }
 
+Alignment XG::path_as_alignment(size_t rank) const {
+    const XGPath& xgpath = paths[rank-1];
+    Alignment aln;
+    aln.set_name(path_name(rank));
+    Path* path = aln.mutable_path();
+    path->set_name(aln.name());
+    string* sequence = aln.mutable_sequence();
+    sequence->reserve(xgpath.length());
+    string node_sequence;
+    for (size_t i = 0; i < xgpath.size(); i++) {
+        handle_t handle = get_handle(xgpath.node(i), xgpath.is_reverse(i));
+        get_sequence(handle, node_sequence);
+        Mapping* m = path->add_mapping();
+        m->mutable_position()->set_node_id(xgpath.node(i));
+        m->mutable_position()->set_is_reverse(xgpath.is_reverse(i));
+        m->set_rank(xgpath.mapping_rank(i));
+        Edit* e = m->add_edit();
+        e->set_from_length(node_sequence.size());
+        e->set_to_length(node_sequence.size());
+        sequence->append(node_sequence);
+    }
+    return aln;
+}
+
 const XGPath& XG::get_path(const string& name) const {
-    return *paths[path_rank(name)-1];
+    return paths[path_rank(name)-1];
 }
 
 size_t XG::path_rank(const string& name) const {
@@ -2073,7 +2361,7 @@ vector<pair<size_t, vector<pair<size_t, bool>>>> XG::oriented_paths_of_node(int6
 vector<pair<size_t, bool>> XG::oriented_occurrences_on_path(int64_t id, size_t path) const {
     vector<pair<size_t, bool>> occurrences;
     for (size_t i : node_ranks_in_path(id, path)) {
-        occurrences.emplace_back(i, paths[path-1]->directions[i]);
+        occurrences.emplace_back(i, paths[path-1].is_reverse(i));
     }
     return occurrences;
 }
@@ -2097,7 +2385,7 @@ map<string, vector<Mapping>> XG::node_mappings(int64_t id) const {
         // to get the direction and (stored) rank
         for (auto j : node_ranks_in_path(id, name)) {
             // nb: path rank is 1-based, path index is 0-based
-            mappings[name].push_back(paths[i-1]->mapping(j, get_node_length));
+            mappings[name].push_back(paths[i-1].mapping(j, get_node_length));
         }
     }
     return mappings;
@@ -2416,24 +2704,29 @@ void XG::get_id_range(int64_t id1, int64_t id2, Graph& g) const {
 // walk forward in id space, collecting nodes, until at least length bases covered
 // (or end of graph reached).  if forward is false, do go backward
 void XG::get_id_range_by_length(int64_t id, int64_t length, Graph& g, bool forward) const {
-    // find out first base of node's position in the sequence vector
-    size_t rank = id_to_rank(id);
-    size_t start = s_bv_select(rank);
-    size_t end;
-    // jump by length, checking to make sure we stay in bounds
+    // the node ranks need not be in ID order, so walk the IDs themselves, adding
+    // up the lengths of the nodes that exist, to find the node covering the
+    // position length bases past the end (or before the start) of this one
+    int64_t id2 = id;
     if (forward) {
-        end = s_bv_rank(min(s_bv.size() - 1, start + node_length(id) + length));
+        int64_t target = node_length(id) + length;
+        int64_t covered = 0;
+        for (int64_t i = id; i <= max_id; ++i) {
+            if (!has_node(i)) continue;
+            id2 = i;
+            covered += node_length(i);
+            if (covered > target) break;
+        }
+        get_id_range(id, id2, g);
     } else {
-        end = s_bv_rank(1 + max((int64_t)0, (int64_t)(start  - length)));
-    }
-    // convert back to id
-    int64_t id2 = rank_to_id(end);
-
-    // get the id range
-    if (!forward) {
-        swap(id, id2);
+        int64_t covered = 0;
+        for (int64_t i = id - 1; i >= min_id && covered < length; --i) {
+            if (!has_node(i)) continue;
+            id2 = i;
+            covered += node_length(i);
+        }
+        get_id_range(id2, id, g);
     }
-    get_id_range(id, id2, g);
 }
 
 size_t XG::path_length(const string& name) const {
@@ -2442,11 +2735,11 @@ size_t XG::path_length(const string& name) const {
         // Existence checking might be slightly slower but it will be worth it in saved head scratching
         throw runtime_error("Path \"" + name + "\" not found in xg index");
     }
-    return paths[rank-1]->offsets.size();
+    return paths[rank-1].length();
 }
 
 size_t XG::path_length(size_t rank) const {
-    return paths[rank-1]->offsets.size();
+    return paths[rank-1].length();
 }
 
 pair<pos_t, int64_t> XG::next_path_position(pos_t pos, int64_t max_search) const {
@@ -2536,73 +2829,16 @@ int64_t XG::min_approx_path_distance(int64_t id1, int64_t id2) const {
     return min_distance;
 }
     
-vector<size_t> XG::memoized_paths_of_node(int64_t id, unordered_map<int64_t, vector<size_t>>* paths_of_node_memo) const {
-    if (paths_of_node_memo) {
-        auto iter = paths_of_node_memo->find(id);
-        if (iter != paths_of_node_memo->end()) {
-            return iter->second;
-        }
-        else {
-            (*paths_of_node_memo)[id] = paths_of_node(id);
-            return paths_of_node_memo->at(id);
-        }
-    }
-    else {
-        return paths_of_node(id);
-    }
-}
-
-vector<pair<size_t, bool>> XG::memoized_oriented_occurrences_on_path(int64_t id, size_t path,
-                                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) const {
-    if (oriented_occurrences_memo) {
-        auto iter = oriented_occurrences_memo->find(make_pair(id, path));
-        if (iter != oriented_occurrences_memo->end()) {
-            return iter->second;
-        }
-        else {
-            (*oriented_occurrences_memo)[make_pair(id, path)] = oriented_occurrences_on_path(id, path);
-            return oriented_occurrences_memo->at(make_pair(id, path));
-        }
-    }
-    else {
-        return oriented_occurrences_on_path(id, path);
-    }
-}
-    
-    
-vector<pair<size_t, vector<pair<size_t, bool>>>> XG::memoized_oriented_paths_of_node(int64_t id,
-                                                                                     unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) const {
-    vector<pair<size_t, vector<pair<size_t, bool>>>> oriented_path_occurrences;
-    for (size_t path : memoized_paths_of_node(id, paths_of_node_memo)) {
-        oriented_path_occurrences.emplace_back(path, memoized_oriented_occurrences_on_path(id, path));
-    }
-    return oriented_path_occurrences;
-}
-    
-handle_t XG::memoized_get_handle(int64_t id, bool rev, unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
-    if (handle_memo) {
-        auto iter = handle_memo->find(make_pair(id, rev));
-        if (iter != handle_memo->end()) {
-            return iter->second;
-        }
-        else {
-            handle_t handle = get_handle(id, rev);
-            (*handle_memo)[make_pair(id, rev)] = handle;
-            return handle;
-        }
-    }
-    else {
-        return get_handle(id, rev);
-    }
-}
-    
 int64_t XG::closest_shared_path_unstranded_distance(int64_t id1, size_t offset1, bool rev1,
                                                     int64_t id2, size_t offset2, bool rev2,
                                                     size_t max_search_dist,
-                                                    unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                    unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
-                                                    unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
+                                                    XGQueryContext* context) const {
+    
+    // cache the path queries for this call if the caller isn't caching them
+    XGQueryContext local_context(this);
+    if (!context) {
+        context = &local_context;
+    }
     
     unordered_map<size_t, tuple<int64_t, bool, int64_t>> path_dists_1, path_dists_2;
     unordered_set<size_t> shared_paths;
@@ -2614,10 +2850,10 @@ int64_t XG::closest_shared_path_unstranded_distance(int64_t id1, size_t offset1,
     // from the positions for the search to explore
     // TODO: this leaves the ambiguity that a node might occur multiple times on the same path, in which case
     // the tie for closest traversal to the path is broken arbitrarily
-    for (size_t path_rank : memoized_paths_of_node(id1, paths_of_node_memo)) {
+    for (size_t path_rank : context->paths_of_node(id1)) {
         path_dists_1[path_rank] = make_tuple(id1, rev1, (int64_t) offset1);
     }
-    for (size_t path_rank : memoized_paths_of_node(id2, paths_of_node_memo)) {
+    for (size_t path_rank : context->paths_of_node(id2)) {
         path_dists_2[path_rank] = make_tuple(id2, rev2, (int64_t) offset2);
         if (path_dists_1.count(path_rank)) {
             shared_paths.insert(path_rank);
@@ -2664,8 +2900,8 @@ int64_t XG::closest_shared_path_unstranded_distance(int64_t id1, size_t offset1,
         cerr << "[XG] getting handles for search starts" << endl;
 #endif
         // get handles to the starting positions
-        handle_t handle1 = memoized_get_handle(id1, rev1, handle_memo);
-        handle_t handle2 = memoized_get_handle(id2, rev2, handle_memo);
+        handle_t handle1 = context->get_handle(id1, rev1);
+        handle_t handle2 = context->get_handle(id2, rev2);
         
 #ifdef debug_algorithms
         cerr << "[XG] initializing queues" << endl;
@@ -2714,7 +2950,7 @@ int64_t XG::closest_shared_path_unstranded_distance(int64_t id1, size_t offset1,
             
             if ((trav_id != id1 || trav_is_rev != rev1) && (trav_id != id2 || trav_is_rev != rev2)) {
                 // this is not one of the start positions, so it might have new paths on it
-                for (size_t path : memoized_paths_of_node(trav_id, paths_of_node_memo)) {
+                for (size_t path : context->paths_of_node(trav_id)) {
 #ifdef debug_algorithms
                     cerr << "\tnode is on path " << path << endl;
 #endif
@@ -2762,33 +2998,31 @@ int64_t XG::closest_shared_path_unstranded_distance(int64_t id1, size_t offset1,
         tuple<int64_t, bool, int64_t>& path_trav_1 = path_dists_1[path_rank];
         tuple<int64_t, bool, int64_t>& path_trav_2 = path_dists_2[path_rank];
         
-        vector<pair<size_t, bool>> occurrences_1 = memoized_oriented_occurrences_on_path(get<0>(path_trav_1), path_rank,
-                                                                                         oriented_occurrences_memo);
-        vector<pair<size_t, bool>> occurrences_2 = memoized_oriented_occurrences_on_path(get<0>(path_trav_2), path_rank,
-                                                                                         oriented_occurrences_memo);
+        XGQueryContext::occurrences_t occurrences_1 = context->oriented_occurrences_on_path(get<0>(path_trav_1), path_rank);
+        XGQueryContext::occurrences_t occurrences_2 = context->oriented_occurrences_on_path(get<0>(path_trav_2), path_rank);
         
         vector<int64_t> path_positions_1(occurrences_1.size());
         vector<int64_t> path_positions_2(occurrences_2.size());
         
-        XGPath* path = paths[path_rank - 1];
+        const XGPath& path = paths[path_rank - 1];
         
         for (size_t i = 0; i < occurrences_1.size(); i++) {
             if (occurrences_1[i].second != get<1>(path_trav_1)) {
-                size_t node_start = occurrences_1[i].first + 1 < path->positions.size() ? path->positions[occurrences_1[i].first + 1] : path->offsets.size();
+                size_t node_start = occurrences_1[i].first + 1 < path.size() ? path.position(occurrences_1[i].first + 1) : path.length();
                 path_positions_1[i] = node_start - get<2>(path_trav_1);
             }
             else {
-                path_positions_1[i] = path->positions[occurrences_1[i].first] + get<2>(path_trav_1);
+                path_positions_1[i] = path.position(occurrences_1[i].first) + get<2>(path_trav_1);
             }
         }
         
         for (size_t i = 0; i < occurrences_2.size(); i++) {
             if (occurrences_2[i].second != get<1>(path_trav_2)) {
-                size_t node_start = occurrences_2[i].first + 1 < path->positions.size() ? path->positions[occurrences_2[i].first + 1] : path->offsets.size();
+                size_t node_start = occurrences_2[i].first + 1 < path.size() ? path.position(occurrences_2[i].first + 1) : path.length();
                 path_positions_2[i] = node_start - get<2>(path_trav_2);
             }
             else {
-                path_positions_2[i] = path->positions[occurrences_2[i].first] + get<2>(path_trav_2);
+                path_positions_2[i] = path.position(occurrences_2[i].first) + get<2>(path_trav_2);
             }
         }
         
@@ -2809,9 +3043,13 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
                                                   int64_t id2, size_t offset2, bool rev2,
                                                   bool forward_strand,
                                                   size_t max_search_dist,
-                                                  unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                  unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
-                                                  unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
+                                                  XGQueryContext* context) const {
+    
+    // cache the path queries for this call if the caller isn't caching them
+    XGQueryContext local_context(this);
+    if (!context) {
+        context = &local_context;
+    }
     
 #ifdef debug_algorithms
     cerr << "[XG] estimating oriented distance between " << id1 << "[" << offset1 << "]" << (rev1 ? "-" : "+") << " and " << id2 << "[" << offset2 << "]" << (rev2 ? "-" : "+") << " with max search distance of " << max_search_dist << endl;
@@ -2829,7 +3067,7 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
     // from the positions for the search to explore
     // TODO: this leaves the ambiguity that a node might occur multiple times on the same path, in which case
     // the tie for closest traversal to the path is broken arbitrarily
-    for (pair<size_t, vector<pair<size_t, bool>>>& oriented_occurrences : memoized_oriented_paths_of_node(id1, paths_of_node_memo, oriented_occurrences_memo)) {
+    for (const pair<size_t, XGQueryContext::occurrences_t>& oriented_occurrences : context->oriented_paths_of_node(id1)) {
         for (const pair<size_t, bool>& occurrence : oriented_occurrences.second) {
             pair<size_t, bool> path_occurrence(oriented_occurrences.first, occurrence.second != rev1);
             path_strand_dists_1[path_occurrence] = make_tuple(id1, rev1, -((int64_t) offset1));
@@ -2839,7 +3077,7 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
 #endif
         }
     }
-    for (pair<size_t, vector<pair<size_t, bool>>>& oriented_occurrences : memoized_oriented_paths_of_node(id2, paths_of_node_memo, oriented_occurrences_memo)) {
+    for (const pair<size_t, XGQueryContext::occurrences_t>& oriented_occurrences : context->oriented_paths_of_node(id2)) {
         for (const pair<size_t, bool>& occurrence : oriented_occurrences.second) {
             pair<size_t, bool> path_occurrence(oriented_occurrences.first, occurrence.second != rev2);
             path_strand_dists_2[path_occurrence] = make_tuple(id2, rev2, -((int64_t) offset2));
@@ -2899,8 +3137,8 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
         cerr << "[XG] getting handles for search starts" << endl;
 #endif
         // get handles to the starting positions
-        handle_t handle1 = memoized_get_handle(id1, rev1, handle_memo);
-        handle_t handle2 = memoized_get_handle(id2, rev2, handle_memo);
+        handle_t handle1 = context->get_handle(id1, rev1);
+        handle_t handle2 = context->get_handle(id2, rev2);
         
 #ifdef debug_algorithms
         cerr << "[XG] initializing queues" << endl;
@@ -2950,7 +3188,7 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
             
             if ((trav_id != id1 || trav_is_rev != rev1) && (trav_id != id2 || trav_is_rev != rev2)) {
                 // this is not one of the start positions, so it might have new paths on it
-                for (pair<size_t, vector<pair<size_t, bool>>>& oriented_occurrences : memoized_oriented_paths_of_node(trav_id, paths_of_node_memo, oriented_occurrences_memo)) {
+                for (const pair<size_t, XGQueryContext::occurrences_t>& oriented_occurrences : context->oriented_paths_of_node(trav_id)) {
                     for (const pair<size_t, bool>& occurrence : oriented_occurrences.second) {
 #ifdef debug_algorithms
                         cerr << "\tnode is on path " << oriented_occurrences.first << " in " << (occurrence.second ? "reverse" : "forward") << " orientation" << endl;
@@ -3006,7 +3244,7 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
 #ifdef debug_algorithms
         cerr << "[XG] estimating distance with shared path " << oriented_path.first << (oriented_path.second ? "-" : "+") << endl;
 #endif
-        XGPath& path = *paths[oriented_path.first - 1];
+        const XGPath& path = paths[oriented_path.first - 1];
         auto& node_trav_1 = path_strand_dists_1[oriented_path];
         auto& node_trav_2 = path_strand_dists_2[oriented_path];
         
@@ -3017,8 +3255,8 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
         cerr << "[XG] search offset adds up to " << relative_offset << endl;
 #endif
         
-        auto path_occurrences_1 = memoized_oriented_paths_of_node(get<0>(node_trav_1), paths_of_node_memo, oriented_occurrences_memo);
-        auto path_occurrences_2 = memoized_oriented_paths_of_node(get<0>(node_trav_2), paths_of_node_memo, oriented_occurrences_memo);
+        auto path_occurrences_1 = context->oriented_paths_of_node(get<0>(node_trav_1));
+        auto path_occurrences_2 = context->oriented_paths_of_node(get<0>(node_trav_2));
         
         // get the records corresponding to this shared path
         size_t k = 0;
@@ -3053,12 +3291,12 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
 #endif
                 int64_t interval_dist = relative_offset;
                 if (oriented_path.second) {
-                    size_t node_start_1 = oriented_occurrences_1[i].first + 1 < path.positions.size() ? path.positions[oriented_occurrences_1[i].first + 1] : path.offsets.size();
-                    size_t node_start_2 = oriented_occurrences_2[j].first + 1 < path.positions.size() ? path.positions[oriented_occurrences_2[j].first + 1] : path.offsets.size();
+                    size_t node_start_1 = oriented_occurrences_1[i].first + 1 < path.size() ? path.position(oriented_occurrences_1[i].first + 1) : path.length();
+                    size_t node_start_2 = oriented_occurrences_2[j].first + 1 < path.size() ? path.position(oriented_occurrences_2[j].first + 1) : path.length();
                     interval_dist += node_start_1 - node_start_2;
                 }
                 else {
-                    interval_dist += path.positions[oriented_occurrences_2[j].first] - path.positions[oriented_occurrences_1[i].first];
+                    interval_dist += path.position(oriented_occurrences_2[j].first) - path.position(oriented_occurrences_1[i].first);
                 }
                 
 #ifdef debug_algorithms
@@ -3081,9 +3319,13 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
 }
     
 vector<tuple<int64_t, bool, size_t>> XG::jump_along_closest_path(int64_t id, bool is_rev, size_t offset, int64_t jump_dist, size_t max_search_dist,
-                                                                 unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                                 unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
-                                                                 unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
+                                                                 XGQueryContext* context) const {
+    
+    // cache the path queries for this call if the caller isn't caching them
+    XGQueryContext local_context(this);
+    if (!context) {
+        context = &local_context;
+    }
     
 #ifdef debug_algorithms
     cerr << "[XG] jumping " << jump_dist << " from position " << id << (is_rev ? " rev:" : " fwd:") << offset << " with a max search dist of " << max_search_dist << endl;
@@ -3117,13 +3359,13 @@ vector<tuple<int64_t, bool, size_t>> XG::jump_along_closest_path(int64_t id, boo
         cerr << "[XG] checking for jumpable paths for " << trav_id << (trav_is_rev ? "-" : "+") << " at search dist " << search_dist << " from searching " << (search_left ? "leftwards" : "rightwards") << endl;
 #endif
         
-        for (pair<size_t, vector<pair<size_t, bool>>>& oriented_occurrences : memoized_oriented_paths_of_node(trav_id, paths_of_node_memo, oriented_occurrences_memo)) {
+        for (const pair<size_t, XGQueryContext::occurrences_t>& oriented_occurrences : context->oriented_paths_of_node(trav_id)) {
             
-            const XGPath& path = *paths[oriented_occurrences.first - 1];
+            const XGPath& path = paths[oriented_occurrences.first - 1];
             
             for (const pair<size_t, bool>& occurrence : oriented_occurrences.second) {
 #ifdef debug_algorithms
-                cerr << "\tnode is on path " << oriented_occurrences.first << " in " << (occurrence.second ? "reverse" : "forward") << " orientation at rank " << occurrence.first << " in path of size " << path.positions.size() << endl;
+                cerr << "\tnode is on path " << oriented_occurrences.first << " in " << (occurrence.second ? "reverse" : "forward") << " orientation at rank " << occurrence.first << " in path of size " << path.size() << endl;
 #endif
                 bool path_rev_strand = occurrence.second != trav_is_rev;
                 int64_t dist_to_jump;
@@ -3140,21 +3382,21 @@ vector<tuple<int64_t, bool, size_t>> XG::jump_along_closest_path(int64_t id, boo
                     dist_to_jump = jump_dist - search_dist;
                 }
                 
-                int64_t target_path_pos = path.positions[occurrence.first] + dist_to_jump;
+                int64_t target_path_pos = path.position(occurrence.first) + dist_to_jump;
                 
 #ifdef debug_algorithms
                 cerr << "\tjump position should be at offset " << target_path_pos << endl;
 #endif
                 
-                if (target_path_pos >= 0 && target_path_pos < path.offsets.size()) {
-                    size_t jump_rank = path.offsets_rank(target_path_pos + 1) - 1;
+                if (target_path_pos >= 0 && target_path_pos < path.length()) {
+                    size_t jump_rank = path.offset_at_position(target_path_pos);
 #ifdef debug_algorithms
                     cerr << "\tthis position is found at path index " << jump_rank << endl;
 #endif
                     
-                    size_t node_offset = path.positions[jump_rank];
+                    size_t node_offset = path.position(jump_rank);
                     int64_t node_id = path.node(jump_rank);
-                    bool node_is_rev = path.directions[jump_rank];
+                    bool node_is_rev = path.is_reverse(jump_rank);
                     
                     size_t offset = path_rev_strand ? node_offset + node_length(node_id) - target_path_pos : target_path_pos - node_offset;
 #ifdef debug_algorithms
@@ -3174,7 +3416,7 @@ vector<tuple<int64_t, bool, size_t>> XG::jump_along_closest_path(int64_t id, boo
     priority_queue<Traversal> queue;
     unordered_set<handle_t> traversed;
     
-    handle_t handle = memoized_get_handle(id, is_rev, handle_memo);
+    handle_t handle = context->get_handle(id, is_rev);
     
     // add in the initial traversals in both directions from the start position
     queue.emplace(offset, handle, true);
@@ -3221,9 +3463,13 @@ vector<tuple<int64_t, bool, size_t>> XG::jump_along_closest_path(int64_t id, boo
 pair<bool, bool> XG::validate_strand_consistency(int64_t id1, size_t offset1, bool rev1,
                                                  int64_t id2, size_t offset2, bool rev2,
                                                  size_t max_search_dist,
-                                                 unordered_map<int64_t, vector<size_t>>* paths_of_node_memo,
-                                                 unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
-                                                 unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const{
+                                                 XGQueryContext* context) const {
+    
+    // cache the path queries for this call if the caller isn't caching them
+    XGQueryContext local_context(this);
+    if (!context) {
+        context = &local_context;
+    }
     
     unordered_set<pair<size_t, bool>> path_strands_1;
     unordered_set<pair<size_t, bool>> path_strands_2;
@@ -3232,7 +3478,7 @@ pair<bool, bool> XG::validate_strand_consistency(int64_t id1, size_t offset1, bo
     // from the positions for the search to explore
     bool set_original_orientation = false;
     bool original_orientation = false;
-    for (pair<size_t, vector<pair<size_t, bool>>>& oriented_occurrences : memoized_oriented_paths_of_node(id1, paths_of_node_memo, oriented_occurrences_memo)) {
+    for (const pair<size_t, XGQueryContext::occurrences_t>& oriented_occurrences : context->oriented_paths_of_node(id1)) {
         for (const pair<size_t, bool>& occurrence : oriented_occurrences.second) {
             pair<size_t, bool> path_occurrence(oriented_occurrences.first, occurrence.second != rev1);
             
@@ -3244,7 +3490,7 @@ pair<bool, bool> XG::validate_strand_consistency(int64_t id1, size_t offset1, bo
             path_strands_1.insert(path_occurrence);
         }
     }
-    for (pair<size_t, vector<pair<size_t, bool>>>& oriented_occurrences : memoized_oriented_paths_of_node(id2, paths_of_node_memo, oriented_occurrences_memo)) {
+    for (const pair<size_t, XGQueryContext::occurrences_t>& oriented_occurrences : context->oriented_paths_of_node(id2)) {
         for (const pair<size_t, bool>& occurrence : oriented_occurrences.second) {
             pair<size_t, bool> path_occurrence(oriented_occurrences.first, occurrence.second != rev2);
             pair<size_t, bool> opposite_path_occurrence(path_occurrence.first, !path_occurrence.second);
@@ -3293,8 +3539,8 @@ pair<bool, bool> XG::validate_strand_consistency(int64_t id1, size_t offset1, bo
         cerr << "[XG] getting handles for search starts" << endl;
 #endif
         // get handles to the starting positions
-        handle_t handle1 = memoized_get_handle(id1, rev1, handle_memo);
-        handle_t handle2 = memoized_get_handle(id2, rev2, handle_memo);
+        handle_t handle1 = context->get_handle(id1, rev1);
+        handle_t handle2 = context->get_handle(id2, rev2);
         
 #ifdef debug_algorithms
         cerr << "[XG] initializing queues" << endl;
@@ -3343,7 +3589,7 @@ pair<bool, bool> XG::validate_strand_consistency(int64_t id1, size_t offset1, bo
             
             if ((trav_id != id1 || trav_is_rev != rev1) && (trav_id != id2 || trav_is_rev != rev2)) {
                 // this is not one of the start positions, so it might have new paths on it
-                for (pair<size_t, vector<pair<size_t, bool>>>& oriented_occurrences : memoized_oriented_paths_of_node(trav_id, paths_of_node_memo, oriented_occurrences_memo)) {
+                for (const pair<size_t, XGQueryContext::occurrences_t>& oriented_occurrences : context->oriented_paths_of_node(trav_id)) {
                     vector<pair<size_t, bool>> path_orientations;
                     for (const pair<size_t, bool>& occurrence : oriented_occurrences.second) {
 #ifdef debug_algorithms
@@ -3405,8 +3651,8 @@ void XG::for_path_range(const string& name, int64_t start, int64_t stop,
                         function<void(int64_t)> lambda, bool is_rev) const {
 
     // what is the node at the start, and at the end
-    auto& path = *paths[path_rank(name)-1];
-    size_t plen = path.offsets.size();
+    auto& path = paths[path_rank(name)-1];
+    size_t plen = path.length();
     if (start > plen) return; // no overlap with path
     // careful not to exceed the path length
     if (stop >= plen) stop = plen-1;
@@ -3414,8 +3660,8 @@ void XG::for_path_range(const string& name, int64_t start, int64_t stop,
         start = plen - start;
         stop = plen - stop;
     }
-    size_t pr1 = path.offsets_rank(start+1)-1;
-    size_t pr2 = path.offsets_rank(stop+1)-1;
+    size_t pr1 = path.offset_at_position(start);
+    size_t pr2 = path.offset_at_position(stop);
 
     // Grab the IDs visited in order along the path
     for (size_t i = pr1; i <= pr2; ++i) {
@@ -3475,10 +3721,7 @@ size_t XG::node_occs_in_path(int64_t id, const string& name) const {
 }
 
 size_t XG::node_occs_in_path(int64_t id, size_t rank) const {
-    size_t p = rank-1;
-    auto& pi_wt = paths[p]->ids;
-    int64_t local_id = paths[p]->local_id(id);
-    return pi_wt.rank(pi_wt.size(), local_id);
+    return paths[rank-1].occurrence_count(id);
 }
 
 vector<size_t> XG::node_ranks_in_path(int64_t id, const string& name) const {
@@ -3486,14 +3729,7 @@ vector<size_t> XG::node_ranks_in_path(int64_t id, const string& name) const {
 }
 
 vector<size_t> XG::node_ranks_in_path(int64_t id, size_t rank) const {
-    vector<size_t> ranks;
-    size_t p = rank-1;
-    size_t occs = node_occs_in_path(id, rank);
-    int64_t local_id = paths[p]->local_id(id);
-    for (size_t i = 1; i <= occs; ++i) {
-        ranks.push_back(paths[p]->ids.select(i, local_id));
-    }
-    return ranks;
+    return paths[rank-1].occurrences(id);
 }
 
 vector<size_t> XG::position_in_path(int64_t id, const string& name) const {
@@ -3501,10 +3737,10 @@ vector<size_t> XG::position_in_path(int64_t id, const string& name) const {
 }
 
 vector<size_t> XG::position_in_path(int64_t id, size_t rank) const {
-    auto& path = *paths[rank-1];
+    auto& path = paths[rank-1];
     vector<size_t> pos_in_path;
     for (auto i : node_ranks_in_path(id, rank)) {
-        pos_in_path.push_back(path.positions[i]);
+        pos_in_path.push_back(path.position(i));
     }
     return pos_in_path;
 }
@@ -3512,12 +3748,12 @@ vector<size_t> XG::position_in_path(int64_t id, size_t rank) const {
 map<string, vector<size_t> > XG::position_in_paths(int64_t id, bool is_rev, size_t offset) const {
     map<string, vector<size_t> > positions;
     for (auto& prank : paths_of_node(id)) {
-        auto& path = *paths[prank-1];
+        auto& path = paths[prank-1];
         auto& pos_in_path = positions[path_name(prank)];
         for (auto i : node_ranks_in_path(id, prank)) {
             size_t pos = offset + (is_rev ?
-                                   path_length(prank) - path.positions[i] - node_length(id)
-                                   : path.positions[i]);
+                                   path_length(prank) - path.position(i) - node_length(id)
+                                   : path.position(i));
             pos_in_path.push_back(pos);
         }
     }
@@ -3528,12 +3764,12 @@ map<string, vector<pair<size_t, bool> > > XG::offsets_in_paths(pos_t pos) const
     map<string, vector<pair<size_t, bool> > > positions;
     id_t node_id = id(pos);
     for (auto& prank : paths_of_node(node_id)) {
-        auto& path = *paths[prank-1];
+        auto& path = paths[prank-1];
         auto& pos_in_path = positions[path_name(prank)];
         for (auto i : node_ranks_in_path(node_id, prank)) {
             // relative direction to this traversal
-            bool dir = path.directions[i] != is_rev(pos);
-            size_t off = path.positions[i] + offset(pos);
+            bool dir = path.is_reverse(i) != is_rev(pos);
+            size_t off = path.position(i) + offset(pos);
             
             pos_in_path.push_back(make_pair(off, dir));
         }
@@ -3560,6 +3796,44 @@ map<string, vector<pair<size_t, bool> > > XG::nearest_offsets_in_paths(pos_t pos
     }
 }
 
+void XG::offsets_in_paths(const vector<pos_t>& positions, vector<path_offset_t>& results) const {
+    results.clear();
+    for (size_t i = 0; i < positions.size(); i++) {
+        append_offsets_in_paths(i, positions[i], 0, results);
+    }
+}
+
+void XG::nearest_offsets_in_paths(const vector<pos_t>& positions, int64_t max_search, vector<path_offset_t>& results) const {
+    results.clear();
+    for (size_t i = 0; i < positions.size(); i++) {
+        pair<pos_t, int64_t> pz = next_path_position(positions[i], max_search);
+        if (id(pz.first)) {
+            append_offsets_in_paths(i, pz.first, pz.second, results);
+        }
+    }
+}
+
+void XG::append_offsets_in_paths(size_t query, const pos_t& pos, int64_t shift, vector<path_offset_t>& results) const {
+    id_t node_id = id(pos);
+    auto rank = id_to_rank(node_id);
+    if (rank == 0) {
+        throw runtime_error("Tried to get path offsets of nonexistent node " + to_string(node_id));
+    }
+    // Walk the node's path membership record directly instead of copying it
+    // out. Its first entry is the record delimiter.
+    size_t off = np_bv_select(rank) + 1;
+    while (off < np_bv.size() ? np_bv[off] == 0 : false) {
+        size_t prank = np_iv[off++];
+        auto& path = paths[prank-1];
+        for (size_t j : path.occurrences(node_id)) {
+            // relative direction to this traversal
+            bool dir = path.is_reverse(j) != is_rev(pos);
+            size_t path_off = path.position(j) + offset(pos) + shift;
+            results.push_back(path_offset_t{query, prank, path_off, dir});
+        }
+    }
+}
+
 map<string, vector<size_t> > XG::distance_in_paths(int64_t id1, bool is_rev1, size_t offset1,
                                                    int64_t id2, bool is_rev2, size_t offset2) const {
     auto pos1 = position_in_paths(id1, is_rev1, offset1);
@@ -3601,137 +3875,94 @@ int64_t XG::min_distance_in_paths(int64_t id1, bool is_rev1, size_t offset1,
 
 int64_t XG::node_at_path_position(const string& name, size_t pos) const {
     size_t p = path_rank(name)-1;
-    return paths[p]->node_at_position(pos);
+    return paths[p].node_at_position(pos);
 }
 
 Mapping XG::mapping_at_path_position(const string& name, size_t pos) const {
     size_t p = path_rank(name)-1;
-    return paths[p]->mapping(paths[p]->offsets_rank(pos+1)-1,
+    return paths[p].mapping(paths[p].offset_at_position(pos),
                              [&](id_t id){ return get_length(get_handle(id, false)); });
 }
 
 size_t XG::node_start_at_path_position(const string& name, size_t pos) const {
     size_t p = path_rank(name)-1;
-    size_t position_rank = paths[p]->offsets_rank(pos+1);
-    return paths[p]->offsets_select(position_rank);
+    return paths[p].visit_start_at_position(pos);
 }
 
 pos_t XG::graph_pos_at_path_position(const string& name, size_t path_pos) const {
     auto& path = get_path(name);
-    path_pos = min((size_t)path.offsets.size()-1, path_pos);
-    size_t trav_idx = path.offsets_rank(path_pos+1)-1;
-    int64_t offset = path_pos - path.positions[trav_idx];
+    path_pos = min((size_t)path.length()-1, path_pos);
+    size_t trav_idx = path.offset_at_position(path_pos);
+    int64_t offset = path_pos - path.position(trav_idx);
     id_t node_id = path.node(trav_idx);
-    bool is_rev = path.directions[trav_idx];
+    bool is_rev = path.is_reverse(trav_idx);
     return make_pos_t(node_id, is_rev, offset);
 }
 
-Alignment XG::target_alignment(const string& name, size_t pos1, size_t pos2, const string& feature, bool is_reverse, Mapping& cigar_mapping) const {
-    Alignment aln;
-    const XGPath& path = *paths[path_rank(name)-1];
-    size_t first_node_start = path.offsets_select(path.offsets_rank(pos1+1));
-    int64_t trim_start = pos1 - first_node_start;
-    {
-        Mapping* first_mapping = aln.mutable_path()->add_mapping();
-        *first_mapping = mapping_at_path_position(name, pos1);
-        auto mappings = cut_mapping_offset(cigar_mapping, node_length(first_mapping->position().node_id())-trim_start);
-        first_mapping->clear_edit();
-        if (trim_start > 0) {
-          first_mapping->mutable_position()->set_offset(trim_start);
-        }
-
-        string from_seq = node_sequence(first_mapping->position().node_id());
-        int from_pos = trim_start;
-        for (size_t j = 0; j < mappings.first.edit_size(); ++j) {
-            if (mappings.first.edit(j).to_length() == mappings.first.edit(j).from_length()) {// if (mappings.first.edit(j).sequence() != nullptr) {
-                // do the sequences match?
-                // emit a stream of "SNPs" and matches
-                    int last_start = from_pos;
-                    int k = 0;
-                    Edit* edit;
-                    for (int to_pos = 0 ; to_pos < mappings.first.edit(j).to_length() ; ++to_pos, ++from_pos) {
-                        //cerr << h << ":" << k << " " << from_seq[h] << " " << to_seq[k] << endl;
-                        if (from_seq[from_pos] != mappings.first.edit(j).sequence()[to_pos]) {
-                            // emit the last "match" region
-                            if (from_pos - last_start > 0) {
-                                edit = first_mapping->add_edit();
-                                edit->set_from_length(from_pos-last_start);
-                                edit->set_to_length(from_pos-last_start);
-                            }
-                            // set up the SNP
-                            edit = first_mapping->add_edit();
-                            edit->set_from_length(1);
-                            edit->set_to_length(1);
-                            edit->set_sequence(from_seq.substr(to_pos,1));
-                            last_start = from_pos+1;
-                        }
-                    }
-                    // handles the match at the end or the case of no SNP
-                    if (from_pos - last_start > 0) {
-                        edit = first_mapping->add_edit();
-                        edit->set_from_length(from_pos-last_start);
-                        edit->set_to_length(from_pos-last_start);
+/// Translate the edits from a piece of a CIGAR-derived mapping onto the node
+/// sequence, starting at from_pos on it, and append them to target. Aligned
+/// runs are split into matches and single-base substitutions; indels are
+/// copied as they are.
+static void add_cigar_edits(const Mapping& cigar_part, const string& from_seq, size_t from_pos, Mapping& target) {
+    for (size_t j = 0; j < cigar_part.edit_size(); ++j) {
+        const Edit& cigar_edit = cigar_part.edit(j);
+        if (cigar_edit.to_length() == cigar_edit.from_length()) {
+            // emit a stream of "SNPs" and matches
+            size_t last_start = from_pos;
+            for (size_t to_pos = 0; to_pos < cigar_edit.to_length(); ++to_pos, ++from_pos) {
+                if (from_seq[from_pos] != cigar_edit.sequence()[to_pos]) {
+                    // emit the last "match" region
+                    if (from_pos > last_start) {
+                        Edit* edit = target.add_edit();
+                        edit->set_from_length(from_pos - last_start);
+                        edit->set_to_length(from_pos - last_start);
                     }
-                    // to_pos += length;
-                    // from_pos += length;
-            } else {
-                // Edit* edit = first_mapping->add_edit();
-                // *edit = mappings.first.edit(j);
-                *first_mapping->add_edit() = mappings.first.edit(j);
-                from_pos += mappings.first.edit(j).from_length();
+                    // set up the SNP, carrying the read's base
+                    Edit* edit = target.add_edit();
+                    edit->set_from_length(1);
+                    edit->set_to_length(1);
+                    edit->set_sequence(cigar_edit.sequence().substr(to_pos, 1));
+                    last_start = from_pos + 1;
+                }
+            }
+            // handles the match at the end or the case of no SNP
+            if (from_pos > last_start) {
+                Edit* edit = target.add_edit();
+                edit->set_from_length(from_pos - last_start);
+                edit->set_to_length(from_pos - last_start);
             }
+        } else {
+            *target.add_edit() = cigar_edit;
+            from_pos += cigar_edit.from_length();
         }
-        cigar_mapping = mappings.second;
     }
-    // get p to point to the next step (or past it, if we're a feature on a single node)
-    int64_t p = (int64_t)pos1 + node_length(aln.path().mapping(0).position().node_id()) - trim_start;
-    while (p < pos2) {
-        Mapping m = mapping_at_path_position(name, p);
-        auto mappings = cut_mapping_offset(cigar_mapping, node_length(m.position().node_id()));
-        m.clear_edit();
+}
 
-        string from_seq = node_sequence(m.position().node_id());
-        int from_pos = 0;
-        for (size_t j = 0 ; j < mappings.first.edit_size(); ++j) {
-            if (mappings.first.edit(j).to_length() == mappings.first.edit(j).from_length()) {
-                // do the sequences match?
-                // emit a stream of "SNPs" and matches
-                    int last_start = from_pos;
-                    int k = 0;
-                    Edit* edit;
-                    for (int to_pos = 0 ; to_pos < mappings.first.edit(j).to_length() ; ++to_pos, ++from_pos) {
-                        //cerr << h << ":" << k << " " << from_seq[h] << " " << to_seq[k] << endl;
-                        if (from_seq[from_pos] != mappings.first.edit(j).sequence()[to_pos]) {
-                            // emit the last "match" region
-                            if (from_pos - last_start > 0) {
-                                edit = m.add_edit();
-                                edit->set_from_length(from_pos-last_start);
-                                edit->set_to_length(from_pos-last_start);
-                            }
-                            // set up the SNP
-                            edit = m.add_edit();
-                            edit->set_from_length(1);
-                            edit->set_to_length(1);
-                            edit->set_sequence(from_seq.substr(to_pos,1));
-                            last_start = from_pos+1;
-                        }
-                    }
-                    // handles the match at the end or the case of no SNP
-                    if (from_pos - last_start > 0) {
-                        edit = m.add_edit();
-                        edit->set_from_length(from_pos-last_start);
-                        edit->set_to_length(from_pos-last_start);
-                    }
-                    // to_pos += length;
-                    // from_pos += length;
-            } else {
-                *m.add_edit() = mappings.first.edit(j);
-                from_pos += mappings.first.edit(j).from_length();
-            }
+Alignment XG::target_alignment(const string& name, size_t pos1, size_t pos2, const string& feature, bool is_reverse, Mapping& cigar_mapping) const {
+    Alignment aln;
+    const XGPath& path = paths[path_rank(name)-1];
+    auto get_node_length = [&](id_t id) { return node_length(id); };
+    // Find the visit containing pos1 once, and then walk the following visits
+    // in order, instead of looking each node up by its path position.
+    size_t first_visit = path.offset_at_position(pos1);
+    int64_t trim_start = pos1 - path.position(first_visit);
+    // p points to the end of the last visit we added
+    int64_t p = pos1;
+    for (size_t i = first_visit; i < path.size() && (i == first_visit || p < pos2); ++i) {
+        Mapping m = path.mapping(i, get_node_length);
+        id_t id = m.position().node_id();
+        size_t length = node_length(id);
+        size_t from_pos = (i == first_visit ? trim_start : 0);
+        auto mappings = cut_mapping_offset(cigar_mapping, length - from_pos);
+        m.clear_edit();
+        if (from_pos > 0) {
+            m.mutable_position()->set_offset(from_pos);
         }
+        // Compare against the node's sequence in the orientation we visit it
+        add_cigar_edits(mappings.first, get_sequence(get_handle(id, m.position().is_reverse())), from_pos, m);
         cigar_mapping = mappings.second;
         *aln.mutable_path()->add_mapping() = m;
-        p += mapping_from_length(aln.path().mapping(aln.path().mapping_size()-1));
+        p = path.position(i) + length;
     }
     aln.set_name(feature);
     if (is_reverse) {
@@ -3742,17 +3973,15 @@ Alignment XG::target_alignment(const string& name, size_t pos1, size_t pos2, con
 
 Alignment XG::target_alignment(const string& name, size_t pos1, size_t pos2, const string& feature, bool is_reverse) const {
     Alignment aln;
-    const XGPath& path = *paths[path_rank(name)-1];
-    size_t first_node_start = path.offsets_select(path.offsets_rank(pos1+1));
-    int64_t trim_start = pos1 - first_node_start;
-    {
-        Mapping* first_mapping = aln.mutable_path()->add_mapping();
-        *first_mapping = mapping_at_path_position(name, pos1);
-    }
+    const XGPath& path = paths[path_rank(name)-1];
+    auto get_node_length = [&](id_t id) { return node_length(id); };
+    size_t visit = path.offset_at_position(pos1);
+    int64_t trim_start = pos1 - path.position(visit);
+    *aln.mutable_path()->add_mapping() = path.mapping(visit, get_node_length);
     // get p to point to the next step (or past it, if we're a feature on a single node)
-    int64_t p = (int64_t)pos1 + node_length(aln.path().mapping(0).position().node_id()) - trim_start;
-    while (p < pos2) {
-        *aln.mutable_path()->add_mapping() = mapping_at_path_position(name, p);
+    int64_t p = path.position(visit) + mapping_from_length(aln.path().mapping(0));
+    while (p < pos2 && ++visit < path.size()) {
+        *aln.mutable_path()->add_mapping() = path.mapping(visit, get_node_length);
         p += mapping_from_length(aln.path().mapping(aln.path().mapping_size()-1));
     }
     // trim to the target
@@ -3824,6 +4053,10 @@ int64_t XG::where_to(int64_t current_side, int64_t visit_offset, int64_t new_sid
 }
 
 int64_t XG::node_height(XG::ThreadMapping node) const {
+  if (haplotype_database != nullptr) {
+    gbwt::node_type gbwt_node = gbwt::Node::encode(node.node_id, node.is_reverse);
+    return haplotype_database->contains(gbwt_node) ? haplotype_database->nodeSize(gbwt_node) : 0;
+  }
   return h_civ[node_graph_idx(node.node_id) * 2 + node.is_reverse];
 }
 
@@ -3977,6 +4210,15 @@ void XG::set_thread_names(const vector<string>& names) {
 
 void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>& names) {
 
+    // threads are sent along the DAG by walking the node ranks in order, which
+    // we can only count on to be topological if they are in ID order
+    for (size_t rank = 2; rank <= max_node_rank(); ++rank) {
+        if (rank_to_id(rank) < rank_to_id(rank - 1)) {
+            cerr << "[xg] error: cannot insert threads into a DAG with nodes out of ID order" << endl;
+            exit(1);
+        }
+    }
+
     util::assign(h_iv, int_vector<>(g_iv.size() * 2, 0));
     util::assign(ts_iv, int_vector<>((node_count + 1) * 2, 0));
 
@@ -4883,8 +5125,51 @@ size_t XG::count_matches(const Path& t) const {
     return count_matches(thread);
 }
 
+void XG::set_haplotype_database(const gbwt::GBWT* database) {
+    haplotype_database = database;
+}
+
+const gbwt::GBWT* XG::get_haplotype_database() const {
+    return haplotype_database;
+}
+
+/// Convert a GBWT search state into our half-open search state.
+static void gbwt_to_thread_search_state(const gbwt::SearchState& from, XG::ThreadSearchState& to) {
+    to.current_side = from.node;
+    if (from.empty()) {
+        to.range_start = 0;
+        to.range_end = 0;
+    } else {
+        to.range_start = from.range.first;
+        to.range_end = from.range.second + 1;
+    }
+}
+
 void XG::extend_search(ThreadSearchState& state, const thread_t& t) const {
     
+    if (haplotype_database != nullptr) {
+        // Run the whole search in the GBWT.
+        for (auto& mapping : t) {
+            if (state.is_empty()) {
+                break;
+            }
+            gbwt::node_type next = gbwt::Node::encode(mapping.node_id, mapping.is_reverse);
+            gbwt::SearchState gbwt_state;
+            if (state.current_side == 0) {
+                gbwt_state = haplotype_database->find(next);
+            } else {
+                gbwt_state = haplotype_database->extend(gbwt::SearchState(state.current_side,
+                                                                          state.range_start,
+                                                                          state.range_end - 1),
+                                                        next);
+            }
+            gbwt_to_thread_search_state(gbwt_state, state);
+            // Remember where we are even if nothing matched, like the gPBWT does.
+            state.current_side = next;
+        }
+        return;
+    }
+    
 #ifdef VERBOSE_DEBUG
     cerr << "Looking for path: ";
     for(int64_t i = 0; i < t.size(); i++) {
@@ -4965,6 +5250,10 @@ void XG::extend_search(ThreadSearchState& state, const ThreadMapping& t) const {
 }
 
 int64_t XG::threads_starting_on_side(int64_t side) const {
+    if (haplotype_database != nullptr) {
+        auto id_rev = side_to_id_rev(side);
+        return select_starting({rank_to_id(id_rev.first), id_rev.second}).count();
+    }
     return side_thread_wt.rank(side_thread_wt.size(), side);
 }
 
@@ -5054,6 +5343,16 @@ XG::ThreadSearchState XG::select_starting(const ThreadMapping& start) const {
     // Make a search state with nothing searched
     ThreadSearchState state;
     
+    if (haplotype_database != nullptr) {
+        // Threads start where they leave the GBWT endmarker. Those visits sort
+        // first in the node's record, because the endmarker is node 0.
+        gbwt::SearchState all_starts = haplotype_database->find(gbwt::ENDMARKER);
+        gbwt_to_thread_search_state(haplotype_database->extend(all_starts,
+            gbwt::Node::encode(start.node_id, start.is_reverse)), state);
+        state.current_side = gbwt::Node::encode(start.node_id, start.is_reverse);
+        return state;
+    }
+    
     // Say we've searched this ThreadMapping's side.    
     state.current_side = id_rev_to_side(start.node_id, start.is_reverse);
     
@@ -5080,6 +5379,15 @@ XG::ThreadSearchState XG::select_continuing(const ThreadMapping& start) const {
     // Make a search state with nothing searched
     ThreadSearchState state;
     
+    if (haplotype_database != nullptr) {
+        // Everything in the node's record after the threads starting there.
+        ThreadSearchState starting = select_starting(start);
+        state.current_side = starting.current_side;
+        state.range_start = starting.range_end;
+        state.range_end = node_height(start);
+        return state;
+    }
+    
     // Say we've searched this ThreadMapping's side.
     state.current_side = id_rev_to_side(start.node_id, start.is_reverse);
     
@@ -20,6 +20,7 @@
 #include "graph.hpp"
 #include "path.hpp"
 #include "handle.hpp"
+#include "xg_query_context.hpp"
 
 // We can have DYNAMIC or SDSL-based gPBWTs
 #define MODE_DYNAMIC 1
@@ -31,13 +32,19 @@
 #include "dynamic.hpp"
 #endif
 
+namespace gbwt {
+// We can delegate haplotype queries to a GBWT, but we don't want to make
+// everything that uses XG depend on the GBWT headers.
+class GBWT;
+}
+
 namespace xg {
 
 using namespace std;
 using namespace sdsl;
 using namespace vg;
 
-class XGPath;
+class XG;
 //typedef pair<int64_t, bool> Side;
 typedef int64_t id_t; // generic id type
 // node sides
@@ -52,6 +59,58 @@ bool trav_is_rev(const trav_t& trav);
 int32_t trav_rank(const trav_t& trav);
 trav_t make_trav(id_t id, bool is_end, int32_t rank);
 
+/**
+ * A view of one path in an XG index. The visits of all the paths are stored
+ * together, in arrays shared through the XG, so that graphs with millions of
+ * small (alt allele or haplotype) paths don't pay for a set of succinct
+ * structures per path. An XGPath just knows where its own visits and bases
+ * start in those arrays.
+ */
+class XGPath {
+public:
+    XGPath(void) = default;
+    XGPath(const XG& graph, size_t visit_start, size_t visit_count,
+           size_t base_start, size_t base_count);
+    
+    /// Get the number of node visits along the path.
+    size_t size() const;
+    /// Get the length of the path in bases.
+    size_t length() const;
+    
+    // Get a mapping. Note that the mapping will not have its lengths filled in.
+    Mapping mapping(size_t offset, const function<int64_t(id_t)>& node_length) const;
+
+    // Get the node orientation at a 0-based offset.
+    id_t node(size_t offset) const;
+    bool is_reverse(size_t offset) const;
+    /// Get the mapping rank stored for the visit at a 0-based offset.
+    int64_t mapping_rank(size_t offset) const;
+    /// Get the position along the path at which the visit at a 0-based offset
+    /// starts.
+    size_t position(size_t offset) const;
+    
+    /// Count the visits the path makes to the given node.
+    size_t occurrence_count(id_t id) const;
+    /// Get the 0-based offsets of all the visits the path makes to the given
+    /// node, in order.
+    vector<size_t> occurrences(id_t id) const;
+    
+    id_t node_at_position(size_t pos) const;
+    size_t offset_at_position(size_t pos) const;
+    /// Get the position along the path at which the visit covering the given
+    /// position starts.
+    size_t visit_start_at_position(size_t pos) const;
+    
+private:
+    const XG* graph = nullptr;
+    size_t visit_start = 0;
+    size_t visit_count = 0;
+    size_t base_start = 0;
+    size_t base_count = 0;
+    // Number of visit starts marked before base_start
+    size_t starts_before = 0;
+};
+
 /**
  * Thrown when attempting to interpret invalid data as an XG index.
  */
@@ -64,7 +123,7 @@ class XGFormatError : public runtime_error {
  * Provides succinct storage for a graph, its positional paths, and a set of
  * embedded threads.
  */
-class XG : public HandleGraph {
+class XG final : public HandleGraph {
 public:
     
     ////////////////////////////////////////////////////////////////////////////
@@ -101,6 +160,30 @@ public:
     void from_callback(function<void(function<void(Graph&)>)> get_chunks,
         bool validate_graph = false, bool print_graph = false,
         bool store_threads = false, bool is_sorted_dag = false); 
+    
+    /// Orders that build() can give the nodes their ranks in. The sequences,
+    /// the graph vector records, and the path and thread structures are all
+    /// laid out by rank, so an order that keeps nodes that are traversed
+    /// together close together makes traversals touch fewer cache lines and
+    /// pages. Node IDs are the same in every order.
+    enum NodeOrder {
+        /// By node ID (the default)
+        ID_ORDER,
+        /// In the order the paths, taken by name, visit the nodes, with each
+        /// node off the paths placed breadth-first after the first path node
+        /// it hangs off, and the nodes of components without paths in
+        /// breadth-first order
+        PATH_ORDER,
+        /// Breadth-first through each component, starting from its lowest ID
+        BFS_ORDER
+    };
+    
+    /// Set the order that build() gives the nodes their ranks in. Orders other
+    /// than ID_ORDER can't be used with threads inserted into the gPBWT of a
+    /// sorted DAG, which walks the ranks expecting them to be topologically
+    /// sorted.
+    void set_node_order(NodeOrder order);
+    
     void build(vector<pair<id_t, string> >& node_label,
                unordered_map<side_t, vector<side_t> >& from_to,
                unordered_map<side_t, vector<side_t> >& to_from,
@@ -111,9 +194,9 @@ public:
                bool is_sorted_dag);
                
     // What's the maximum XG version number we can read with this code?
-    const static uint32_t MAX_INPUT_VERSION = 9;
+    const static uint32_t MAX_INPUT_VERSION = 10;
     // What's the version we serialize?
-    const static uint32_t OUTPUT_VERSION = 9;
+    const static uint32_t OUTPUT_VERSION = 10;
                
     // Load this XG index from a stream. Throw an XGFormatError if the stream
     // does not produce a valid XG file.
@@ -147,6 +230,8 @@ public:
     size_t node_length(int64_t id) const;
     char pos_char(int64_t id, bool is_rev, size_t off) const; // character at position
     string pos_substr(int64_t id, bool is_rev, size_t off, size_t len = 0) const; // substring in range
+    /// Like pos_substr, but fills a caller-supplied string, reusing its memory.
+    void pos_substr(int64_t id, bool is_rev, size_t off, size_t len, string& dest) const;
     // these provide a way to get an index for each node and edge in the g_iv structure and are used by gPBWT
     size_t node_graph_idx(int64_t id) const;
     size_t edge_graph_idx(const Edge& edge) const;
@@ -165,6 +250,11 @@ public:
     bool has_edge(const Edge& edge) const;
     
     vector<Edge> edges_of(int64_t id) const;
+    /// Loop over all the edges attached to the given node, decoded straight
+    /// from the packed graph vector records without constructing Edge objects
+    /// or allocating. Each edge is presented as it would be by edges_of(). The
+    /// iteratee returns false to stop; returns true if iteration finished.
+    bool for_each_edge_of(int64_t id, const function<bool(int64_t from, bool from_start, int64_t to, bool to_end)>& iteratee) const;
     vector<Edge> edges_to(int64_t id) const;
     vector<Edge> edges_from(int64_t id) const;
     vector<Edge> edges_on_start(int64_t id) const;
@@ -219,10 +309,27 @@ public:
     /// Get the sequence of a node, presented in the handle's local forward
     /// orientation.
     virtual string get_sequence(const handle_t& handle) const;
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation, into a caller-supplied string, reusing its memory.
+    void get_sequence(const handle_t& handle, string& dest) const;
     /// Loop over all the handles to next/previous (right/left) nodes. Passes
     /// them to a callback which returns false to stop iterating and true to
     /// continue.
     virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+    // Copy over the void-returning version which would otherwise be shadowed.
+    using HandleGraph::follow_edges;
+    /// Count the edges off the left or right side of an oriented node, without
+    /// visiting the nodes they lead to.
+    virtual size_t get_degree(const handle_t& handle, bool go_left) const;
+    /// Get all the handles to next/previous (right/left) nodes straight out of
+    /// the node's edge records. Replaces the contents of dest.
+    virtual void get_neighbors(const handle_t& handle, bool go_left, vector<handle_t>& dest) const;
+    /// Get the lengths of all of the given nodes, in order. Replaces the
+    /// contents of dest.
+    virtual void get_lengths(const vector<handle_t>& handles, vector<size_t>& dest) const;
+    /// Get the sequences of all of the given nodes, in order, decoding each
+    /// into the existing string's memory. Replaces the contents of dest.
+    virtual void get_sequences(const vector<handle_t>& handles, vector<string>& dest) const;
     /// Loop over all the nodes in the graph in their local forward
     /// orientations, in their internal stored order. Stop if the iteratee returns false.
     virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
@@ -276,6 +383,9 @@ public:
     Alignment path_as_alignment(const Path& path);
     /// Get all the paths as alignments
     vector<Alignment> paths_as_alignments(void);
+    /// Get the path at the given rank as an alignment, taking its sequence
+    /// straight from the nodes. Safe to call from many threads at once.
+    Alignment path_as_alignment(size_t rank) const;
     /// Get the path object by name
     const XGPath& get_path(const string& name) const;
     /// Returns the rank of the path with the given name, or 0 if no such path exists.
@@ -305,6 +415,28 @@ public:
     map<string, vector<size_t> > position_in_paths(int64_t id, bool is_rev = false, size_t offset = 0) const;
     map<string, vector<pair<size_t, bool> > > offsets_in_paths(pos_t pos) const;
     map<string, vector<pair<size_t, bool> > > nearest_offsets_in_paths(pos_t pos, int64_t max_search) const;
+    
+    /// One path position found by a batched path position query.
+    struct path_offset_t {
+        /// Index of the query position in the batch that this answers
+        size_t query;
+        /// Rank of the path the position is on
+        size_t path_rank;
+        /// 0-based offset along the path
+        size_t offset;
+        /// True if the path runs against the orientation of the query position
+        bool is_reverse;
+    };
+    
+    /// Batched version of offsets_in_paths. Fills results with the path
+    /// offsets of all the given positions, grouped by query in input order.
+    /// Results are keyed by path rank instead of name and go into one flat
+    /// buffer, which is cleared but keeps its capacity, so a buffer reused
+    /// across batches does not need to allocate.
+    void offsets_in_paths(const vector<pos_t>& positions, vector<path_offset_t>& results) const;
+    /// Batched version of nearest_offsets_in_paths, with results as in the
+    /// batched offsets_in_paths.
+    void nearest_offsets_in_paths(const vector<pos_t>& positions, int64_t max_search, vector<path_offset_t>& results) const;
     map<string, vector<size_t> > distance_in_paths(int64_t id1, bool is_rev1, size_t offset1,
                                                    int64_t id2, bool is_rev2, size_t offset2) const;
     int64_t min_distance_in_paths(int64_t id1, bool is_rev1, size_t offset1,
@@ -341,22 +473,6 @@ public:
     /// orientation as in the path, true indicates.
     vector<pair<size_t, vector<pair<size_t, bool>>>> oriented_paths_of_node(int64_t id) const;
     
-    /// same as paths_of_node, but with an optional memo to avoid repeated recalculation
-    vector<size_t> memoized_paths_of_node(int64_t id, unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr) const;
-    
-    /// same as oriented_occurrences_on_path, but with an optional memo to avoid repeated recalculation
-    vector<pair<size_t, bool>> memoized_oriented_occurrences_on_path(int64_t id, size_t path,
-                                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr) const;
-    
-    /// same as oriented_paths_of_node, but with an optional memo to avoid repeated recalculation
-    vector<pair<size_t, vector<pair<size_t, bool>>>> memoized_oriented_paths_of_node(int64_t id,
-                                                                                     unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr) const;
-    
-    /// returns a the memoized result from get_handle if a memo is provided that the result has been queried previously
-    /// otherwise, returns the result of get_handle directly and stores it in the memo if one is provided
-    handle_t memoized_get_handle(int64_t id, bool rev, unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
-    
     /// the oriented distance (positive if pos2 is further along the path than pos1, otherwise negative)
     /// estimated by the distance along the nearest shared path to the two positions. returns numeric_limits<int64_t>::max()
     // if no pair of nodes that occur same path are reachable within the max search distance (measured in sequence length,
@@ -364,9 +480,7 @@ public:
     int64_t closest_shared_path_unstranded_distance(int64_t id1, size_t offset1, bool rev1,
                                                     int64_t id2, size_t offset2, bool rev2,
                                                     size_t max_search_dist,
-                                                    unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                    unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr,
-                                                    unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+                                                    XGQueryContext* context = nullptr) const;
     
     /// the oriented distance (positive if pos2 is further along the path than pos1, otherwise negative)
     /// estimated by the distance along the nearest shared path to the two positions plus the distance
@@ -377,18 +491,14 @@ public:
                                                   int64_t id2, size_t offset2, bool rev2,
                                                   bool forward_strand = false,
                                                   size_t max_search_dist = 100,
-                                                  unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                  unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr,
-                                                  unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+                                                  XGQueryContext* context = nullptr) const;
     
     /// returns a vector of (node id, is reverse, offset) tuples that are found by jumping a fixed oriented distance
     /// along path(s) from the given position. if the position is not on a path, searches from the position to a path
     /// and adds/subtracts the search distance to the jump depending on the search direction. returns an empty vector
     /// if there is no path within the max search distance or if the jump distance goes past the end of the path
     vector<tuple<int64_t, bool, size_t>> jump_along_closest_path(int64_t id, bool is_rev, size_t offset, int64_t jump_dist, size_t max_search_dist,
-                                                                 unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                                 unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr,
-                                                                 unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+                                                                 XGQueryContext* context = nullptr) const;
     
     /// checks whether two positions are on or near the same strand of some path. if the position can reach both strands of a
     /// path, it is only considered to be on the nearer of the two strands. positions are also considered consistent if they
@@ -397,9 +507,7 @@ public:
     pair<bool, bool> validate_strand_consistency(int64_t id1, size_t offset1, bool rev1,
                                                  int64_t id2, size_t offset2, bool rev2,
                                                  size_t max_search_dist,
-                                                 unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr,
-                                                 unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo = nullptr,
-                                                 unordered_map<pair<int64_t, bool>, handle_t>* handle_memo = nullptr) const;
+                                                 XGQueryContext* context = nullptr) const;
     ////////////////////////////////////////////////////////////////////////////
     // Sample database API
     ////////////////////////////////////////////////////////////////////////////
@@ -434,6 +542,18 @@ public:
     // gPBWT API
     ////////////////////////////////////////////////////////////////////////////
     
+    /// Delegate haplotype queries (extend_search(), count_matches(),
+    /// select_starting(), select_continuing(), threads_starting_on_side() and
+    /// node_height()) to the given GBWT haplotype database instead of the
+    /// embedded gPBWT. The GBWT must index the same graph, and must outlive
+    /// any queries. Pass nullptr to go back to using the gPBWT. Search states
+    /// obtained from one backend must not be extended with the other.
+    void set_haplotype_database(const gbwt::GBWT* database);
+    
+    /// Get the GBWT that haplotype queries are delegated to, or nullptr if the
+    /// embedded gPBWT is being used.
+    const gbwt::GBWT* get_haplotype_database() const;
+    
 #if GPBWT_MODE == MODE_SDSL
     // We keep our strings in instances of this cool run-length-compressed wavelet tree.
     using rank_select_int_vector = sdsl::wt_rlmn<sdsl::sd_vector<>>;
@@ -506,6 +626,10 @@ public:
      *
      * By default, represents an un-started search (with no first visited side)
      * that can be extended to the whole collection of visits to a side.
+     *
+     * When queries are delegated to a GBWT, current_side holds the GBWT node
+     * (id * 2 + is_reverse) and the range is half-open over that node's
+     * record.
      */
     struct ThreadSearchState {
         // What side have we just arrived at in the search?
@@ -625,12 +749,22 @@ private:
     bool do_edges(const size_t& g, const size_t& start, const size_t& count,
         bool is_to, bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const;
     
+    // Append the path offsets of the given position, moved along the path by
+    // the given shift, to a batched query result buffer.
+    void append_offsets_in_paths(size_t query, const pos_t& pos, int64_t shift, vector<path_offset_t>& results) const;
+    
     ////////////////////////////////////////////////////////////////////////////
     // Here are the bits we need to keep around to talk about the sequence
     ////////////////////////////////////////////////////////////////////////////
     
     // sequence/integer vector
     int_vector<> s_iv;
+    
+    /// Decode length bases from s_iv into dest, starting at the given
+    /// position, reverse complementing them if requested.
+    void decode_sequence(size_t start, size_t length, bool reverse, char* dest) const;
+    /// Get the past-the-end position in s_iv of the node with the given rank.
+    size_t node_seq_end(size_t rank) const;
     // node starts in sequence, provides id schema
     // rank_1(i) = id
     // select_1(id) = i
@@ -646,6 +780,16 @@ private:
     int64_t min_id = 0; // id ranges don't have to start at 0
     int64_t max_id = 0;
     int_vector<> r_iv; // ids-id_min is the rank
+    
+    // the order the next build gives the nodes their ranks in
+    NodeOrder node_order = ID_ORDER;
+    
+    /// Rearrange the node labels, which come sorted by ID, into the rank order
+    /// for node_order.
+    void order_nodes(vector<pair<id_t, string> >& node_label,
+                     const unordered_map<side_t, vector<side_t> >& from_to,
+                     const unordered_map<side_t, vector<side_t> >& to_from,
+                     const map<string, vector<trav_t> >& path_nodes) const;
 
     ////////////////////////////////////////////////////////////////////////////
     // Here is path storage
@@ -659,9 +803,27 @@ private:
     bit_vector::select_1_type pn_bv_select;
     int_vector<> pi_iv; // path ids by rank in the path names
 
-    // probably these should get compressed, for when we have whole genomes with many chromosomes
-    // the growth in required memory is quadratic but the stored matrix is sparse
-    vector<XGPath*> paths; // path entity membership
+    // The visits of all the paths, concatenated in path rank order. Each path
+    // gets a slice of the visit arrays and a slice of the base array, with
+    // its starts recorded in the headers.
+    int_vector<> pv_off_iv; // start of each path's visits, plus the total
+    int_vector<> pb_off_iv; // start of each path's bases, plus the total
+    wt_gmr<> pv_wt; // node rank of each visit
+    sd_vector<> pv_dir_sv; // is each visit backward through its node?
+    int_vector<> pv_pos_iv; // position of each visit along its own path
+    int_vector<> pv_rank_iv; // stored mapping rank of each visit
+    bit_vector pb_bv; // visit starts over the bases of all the paths
+    rank_support_v<1> pb_bv_rank;
+    bit_vector::select_1_type pb_bv_select;
+
+    // Views of each path, by rank - 1. Rebuilt on load.
+    vector<XGPath> paths;
+
+    /// Build the shared path storage from each path's visits, in rank order.
+    void index_paths(const vector<const vector<trav_t>*>& path_travs);
+    /// Make the views of the paths from the shared path storage.
+    void make_path_views();
+    friend class XGPath;
 
     // node->path membership
     int_vector<> np_iv;
@@ -690,6 +852,10 @@ private:
     /// Back-calculate haplotype_count from the thread names for upgrading old XGs.
     void count_haplotypes();
     
+    /// If set, answer haplotype queries from this GBWT rather than the gPBWT.
+    /// Not owned and never serialized.
+    const gbwt::GBWT* haplotype_database = nullptr;
+    
 
     ////////////////////////////////////////////////////////////////////////////
     // Succinct thread storage (the gPBWT)
@@ -796,52 +962,6 @@ private:
     void tn_bake();
 };
 
-class XGPath {
-public:
-    XGPath(void) = default;
-    ~XGPath(void) = default;
-    // Path name is required here only for complaining intelligently when
-    // something goes wrong. We can also spit out the total unique members,
-    // because in here is the most efficient place to count them.
-    XGPath(const string& path_name,
-           const vector<trav_t>& path,
-           size_t node_count,
-           XG& graph,
-           size_t* unique_member_count_out = nullptr);
-    // Path names are stored in the XG object, in a compressed fashion, and are
-    // not duplicated here.
-    
-    // These contain rank and select supports and so cannot move or be copied
-    // without code to update them.
-    XGPath(const XGPath& other) = delete;
-    XGPath(XGPath&& other) = delete;
-    XGPath& operator=(const XGPath& other) = delete;
-    XGPath& operator=(XGPath&& other) = delete;
-    int64_t min_node_id = 0;
-    wt_gmr<> ids;
-    sd_vector<> directions; // forward or backward through nodes
-    int_vector<> positions;
-    int_vector<> ranks;
-    bit_vector offsets;
-    rank_support_v<1> offsets_rank;
-    bit_vector::select_1_type offsets_select;
-    void load(istream& in, uint32_t file_version, const function<int64_t(size_t)>& rank_to_id);
-    size_t serialize(std::ostream& out,
-                     sdsl::structure_tree_node* v = NULL,
-                     std::string name = "") const;
-    // Get a mapping. Note that the mapping will not have its lengths filled in.
-    Mapping mapping(size_t offset, const function<int64_t(id_t)>& node_length) const;
-
-    // Get the node orientation at a 0-based offset.
-    id_t node(size_t offset) const;
-    bool is_reverse(size_t offset) const;
-    id_t local_id(id_t id) const;
-    id_t external_id(id_t id) const;
-    id_t node_at_position(size_t pos) const;
-    size_t offset_at_position(size_t pos) const;
-};
-
-
 Mapping new_mapping(const string& name, int64_t id, size_t rank, bool is_reverse);
 void to_text(ostream& out, Graph& graph);
 
@@ -1,5 +1,8 @@
 #include "xg_position.hpp"
 
+#include <queue>
+#include <unordered_set>
+
 namespace vg {
 
 Node xg_node(id_t id, xg::XG* xgidx) {
@@ -137,34 +140,45 @@ set<pos_t> xg_next_pos(pos_t pos, bool whole_node, xg::XG* xgidx) {
 int64_t xg_distance(pos_t pos1, pos_t pos2, int64_t maximum, xg::XG* xgidx) {
     //cerr << "distance from " << pos1 << " to " << pos2 << endl;
     if (pos1 == pos2) return 0;
-    int64_t adj = (offset(pos1) == xg_node_length(id(pos1), xgidx) ? 0 : 1);
-    set<pos_t> seen;
-    set<pos_t> nexts = xg_next_pos(pos1, false, xgidx);
-    int64_t distance = 0;
-    while (!nexts.empty()) {
-        set<pos_t> todo;
-        for (auto& next : nexts) {
-            if (!seen.count(next)) {
-                seen.insert(next);
-                if (next == pos2) {
-                    return distance+adj;
-                }
-                // handle the edge case that we are looking for the position after the end of this node
-                if (make_pos_t(id(next), is_rev(next), offset(next)+1) == pos2) {
-                    return distance+adj+1;
-                }
-                for (auto& x : xg_next_pos(next, false, xgidx)) {
-                    todo.insert(x);
-                }
-            }
+    // Search whole nodes rather than single bases: the distance to the start
+    // of a node is the distance to the start of the one before it plus its
+    // length, so nearest first over node starts gives the same distances as
+    // walking every base.
+    handle_t start = xgidx->get_handle(id(pos1), is_rev(pos1));
+    handle_t target = xgidx->get_handle(id(pos2), is_rev(pos2));
+    int64_t best = numeric_limits<int64_t>::max();
+    if (start == target && offset(pos2) > offset(pos1)) {
+        // straight along the node
+        best = offset(pos2) - offset(pos1);
+    }
+    // queue of (distance to node start, handle as integer)
+    priority_queue<pair<int64_t, int64_t>, vector<pair<int64_t, int64_t>>, greater<pair<int64_t, int64_t>>> queue;
+    unordered_set<handle_t> visited;
+    int64_t to_end = (int64_t)xgidx->get_length(start) - offset(pos1);
+    xgidx->follow_edges(start, false, [&](const handle_t& next) {
+            queue.emplace(to_end, as_integer(next));
+        });
+    while (!queue.empty()) {
+        int64_t distance = queue.top().first;
+        handle_t handle = as_handle(queue.top().second);
+        queue.pop();
+        if (distance >= best || distance > maximum) {
+            break;
+        }
+        if (!visited.insert(handle).second) {
+            continue;
         }
-        if (distance == maximum) {
+        if (handle == target) {
+            best = distance + offset(pos2);
             break;
         }
-        nexts = todo;
-        ++distance;
+        int64_t through = distance + xgidx->get_length(handle);
+        xgidx->follow_edges(handle, false, [&](const handle_t& next) {
+                queue.emplace(through, as_integer(next));
+            });
     }
-    return numeric_limits<int64_t>::max();
+    // the base-by-base walk gave up one step past the maximum
+    return best <= maximum + 1 ? best : numeric_limits<int64_t>::max();
 }
 
 set<pos_t> xg_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg::XG* xgidx) {
@@ -258,4 +272,89 @@ void xg_annotate_with_initial_path_positions(Alignment& aln, bool just_min, bool
     }
 }
 
+void xg_annotate_with_initial_path_positions(vector<Alignment>& alns, bool just_min, bool nearby, xg::XG* xgidx) {
+    // Gather the mapping positions of every alignment that needs annotating
+    vector<pos_t> positions;
+    // and remember which alignment each of them came from
+    vector<size_t> owners;
+    for (size_t i = 0; i < alns.size(); i++) {
+        if (alns[i].refpos_size()) {
+            continue;
+        }
+        for (auto& mapping : alns[i].path().mapping()) {
+            positions.push_back(make_pos_t(mapping.position()));
+            owners.push_back(i);
+        }
+    }
+    
+    // Look them all up in one pass
+    vector<xg::XG::path_offset_t> found;
+    vector<xg::XG::path_offset_t> found_nearby;
+    if (!nearby) {
+        xgidx->offsets_in_paths(positions, found);
+    }
+    
+    // Results come grouped by query, so we can walk them in step with the alignments
+    size_t next_query = 0;
+    size_t next_found = 0;
+    while (next_query < positions.size()) {
+        size_t owner = owners[next_query];
+        Alignment& aln = alns[owner];
+        
+        // Find the range of queries and results belonging to this alignment
+        size_t query_end = next_query;
+        while (query_end < positions.size() && owners[query_end] == owner) {
+            query_end++;
+        }
+        size_t found_begin = next_found;
+        while (next_found < found.size() && found[next_found].query < query_end) {
+            next_found++;
+        }
+        const xg::XG::path_offset_t* begin = found.data() + found_begin;
+        const xg::XG::path_offset_t* end = found.data() + next_found;
+        
+        if (begin == end) {
+            // find the nearest if we couldn't find any before
+            vector<pos_t> aln_positions(positions.begin() + next_query, positions.begin() + query_end);
+            xgidx->nearest_offsets_in_paths(aln_positions, aln.sequence().size(), found_nearby);
+            begin = found_nearby.data();
+            end = found_nearby.data() + found_nearby.size();
+        }
+        
+        // Collate by path, taking just the min in each path if requested
+        vector<xg::XG::path_offset_t> collated;
+        for (auto it = begin; it != end; ++it) {
+            if (just_min) {
+                auto existing = find_if(collated.begin(), collated.end(), [&](const xg::XG::path_offset_t& other) {
+                    return other.path_rank == it->path_rank;
+                });
+                if (existing == collated.end()) {
+                    collated.push_back(*it);
+                } else if (it->offset < existing->offset) {
+                    *existing = *it;
+                }
+            } else {
+                collated.push_back(*it);
+            }
+        }
+        
+        // Annotate in path name order, keeping the order of hits within each path
+        vector<pair<string, size_t>> names;
+        for (size_t i = 0; i < collated.size(); i++) {
+            names.emplace_back(xgidx->path_name(collated[i].path_rank), i);
+        }
+        stable_sort(names.begin(), names.end(), [](const pair<string, size_t>& a, const pair<string, size_t>& b) {
+            return a.first < b.first;
+        });
+        for (auto& name : names) {
+            Position* refpos = aln.add_refpos();
+            refpos->set_name(name.first);
+            refpos->set_offset(collated[name.second].offset);
+            refpos->set_is_reverse(collated[name.second].is_reverse);
+        }
+        
+        next_query = query_end;
+    }
+}
+
 }
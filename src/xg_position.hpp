@@ -38,6 +38,11 @@ vector<Edge> xg_edges_on_start(id_t id, xg::XG* xgidx);
 vector<Edge> xg_edges_on_end(id_t id, xg::XG* xgidx);
 map<string, vector<pair<size_t, bool> > > xg_alignment_path_offsets(const Alignment& aln, bool just_min, bool nearby, xg::XG* xgidx);
 void xg_annotate_with_initial_path_positions(Alignment& aln, bool just_min, bool nearby, xg::XG* xgidx);
+/// Annotate a whole batch of alignments with their initial path positions,
+/// using one batched path position query for all of them instead of one query
+/// per mapping. Produces the same annotations as annotating each alignment
+/// individually.
+void xg_annotate_with_initial_path_positions(vector<Alignment>& alns, bool just_min, bool nearby, xg::XG* xgidx);
 
 }
 
@@ -0,0 +1,195 @@
+#include "xg_query_context.hpp"
+#include "xg.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+/**
+ * \file xg_query_context.cpp
+ * Implement the flat caches of XG query results.
+ */
+
+namespace xg {
+
+using namespace std;
+
+// Runs go into blocks this big at first, and each new block doubles up to the limit
+static const size_t FIRST_BLOCK_SIZE = 256;
+static const size_t MAX_BLOCK_SIZE = 1 << 16;
+// Tables start this big and are kept at most half full
+static const size_t FIRST_TABLE_SIZE = 64;
+
+inline uint64_t XGQueryContext::hash_key(int64_t id) {
+    // The finalizer from splitmix64, so that runs of nearby IDs spread out
+    uint64_t x = (uint64_t) id;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t XGQueryContext::hash_key(const pair<int64_t, size_t>& id_and_path) {
+    return hash_key(id_and_path.first ^ (int64_t) (id_and_path.second * 0x9e3779b97f4a7c15ULL));
+}
+
+inline uint64_t XGQueryContext::hash_key(const pair<int64_t, bool>& id_and_orientation) {
+    return hash_key(2 * id_and_orientation.first + id_and_orientation.second);
+}
+
+template<typename Key, typename Value>
+Value* XGQueryContext::FlatTable<Key, Value>::find(const Key& key) {
+    if (slots.empty()) {
+        return nullptr;
+    }
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash_key(key) & mask; slots[i].generation == generation; i = (i + 1) & mask) {
+        if (slots[i].key == key) {
+            return &slots[i].value;
+        }
+    }
+    return nullptr;
+}
+
+template<typename Key, typename Value>
+Value& XGQueryContext::FlatTable<Key, Value>::insert(const Key& key) {
+    if (2 * (filled + 1) > slots.size()) {
+        grow();
+    }
+    size_t mask = slots.size() - 1;
+    size_t i = hash_key(key) & mask;
+    while (slots[i].generation == generation) {
+        i = (i + 1) & mask;
+    }
+    slots[i].key = key;
+    slots[i].generation = generation;
+    filled++;
+    return slots[i].value;
+}
+
+template<typename Key, typename Value>
+void XGQueryContext::FlatTable<Key, Value>::grow() {
+    vector<Slot> old_slots(max(FIRST_TABLE_SIZE, 2 * slots.size()));
+    swap(slots, old_slots);
+    uint32_t old_generation = generation;
+    // the new slots are all generation 0, so any other generation is empty
+    generation = 1;
+    filled = 0;
+    for (Slot& slot : old_slots) {
+        if (slot.generation == old_generation) {
+            insert(slot.key) = slot.value;
+        }
+    }
+}
+
+template<typename Key, typename Value>
+void XGQueryContext::FlatTable<Key, Value>::clear() {
+    filled = 0;
+    generation++;
+    if (generation == 0) {
+        // we've wrapped around, so old entries could look current
+        for (Slot& slot : slots) {
+            slot.generation = 0;
+        }
+        generation = 1;
+    }
+}
+
+template<typename T>
+template<typename Iterator>
+XGQueryContext::Span<T> XGQueryContext::Arena<T>::append(Iterator begin, Iterator end) {
+    size_t length = end - begin;
+    while (current < blocks.size() && blocks[current].capacity() - blocks[current].size() < length) {
+        current++;
+    }
+    if (current == blocks.size()) {
+        size_t block_size = blocks.empty() ? FIRST_BLOCK_SIZE : min(2 * blocks.back().capacity(), MAX_BLOCK_SIZE);
+        blocks.emplace_back();
+        blocks.back().reserve(max(block_size, length));
+    }
+    // there's room, so this never reallocates and moves the earlier runs
+    vector<T>& block = blocks[current];
+    size_t start = block.size();
+    block.insert(block.end(), begin, end);
+    return Span<T>(block.data() + start, length);
+}
+
+template<typename T>
+void XGQueryContext::Arena<T>::clear() {
+    for (vector<T>& block : blocks) {
+        block.clear();
+    }
+    current = 0;
+}
+
+XGQueryContext::XGQueryContext(const XG* index) : index(index) {
+    // Nothing to do
+}
+
+void XGQueryContext::reset(const XG* new_index) {
+    index = new_index;
+    clear();
+}
+
+void XGQueryContext::clear() {
+    paths_table.clear();
+    occurrences_table.clear();
+    oriented_paths_table.clear();
+    handle_table.clear();
+    paths_arena.clear();
+    occurrences_arena.clear();
+    oriented_paths_arena.clear();
+}
+
+const XG* XGQueryContext::get_index() const {
+    return index;
+}
+
+XGQueryContext::Span<size_t> XGQueryContext::paths_of_node(int64_t id) {
+    if (Span<size_t>* found = paths_table.find(id)) {
+        return *found;
+    }
+    assert(index != nullptr);
+    vector<size_t> paths = index->paths_of_node(id);
+    Span<size_t> stored = paths_arena.append(paths.begin(), paths.end());
+    paths_table.insert(id) = stored;
+    return stored;
+}
+
+XGQueryContext::occurrences_t XGQueryContext::oriented_occurrences_on_path(int64_t id, size_t path) {
+    pair<int64_t, size_t> key(id, path);
+    if (occurrences_t* found = occurrences_table.find(key)) {
+        return *found;
+    }
+    assert(index != nullptr);
+    vector<pair<size_t, bool>> occurrences = index->oriented_occurrences_on_path(id, path);
+    occurrences_t stored = occurrences_arena.append(occurrences.begin(), occurrences.end());
+    occurrences_table.insert(key) = stored;
+    return stored;
+}
+
+XGQueryContext::Span<pair<size_t, XGQueryContext::occurrences_t>> XGQueryContext::oriented_paths_of_node(int64_t id) {
+    if (Span<pair<size_t, occurrences_t>>* found = oriented_paths_table.find(id)) {
+        return *found;
+    }
+    Span<size_t> paths = paths_of_node(id);
+    vector<pair<size_t, occurrences_t>> oriented_paths;
+    oriented_paths.reserve(paths.size());
+    for (size_t path : paths) {
+        oriented_paths.emplace_back(path, oriented_occurrences_on_path(id, path));
+    }
+    Span<pair<size_t, occurrences_t>> stored = oriented_paths_arena.append(oriented_paths.begin(), oriented_paths.end());
+    oriented_paths_table.insert(id) = stored;
+    return stored;
+}
+
+handle_t XGQueryContext::get_handle(int64_t id, bool rev) {
+    pair<int64_t, bool> key(id, rev);
+    if (handle_t* found = handle_table.find(key)) {
+        return *found;
+    }
+    assert(index != nullptr);
+    handle_t handle = index->get_handle(id, rev);
+    handle_table.insert(key) = handle;
+    return handle;
+}
+
+}
@@ -0,0 +1,135 @@
+#ifndef VG_XG_QUERY_CONTEXT_HPP_INCLUDED
+#define VG_XG_QUERY_CONTEXT_HPP_INCLUDED
+
+/**
+ * \file xg_query_context.hpp
+ *
+ * A cache of the succinct XG queries that path distance estimation and
+ * clustering make over and over for one read: the paths of a node, the
+ * occurrences of a node on a path and node handles. Results live in flat
+ * open-addressed tables and in chunked arrays, so a context that is cleared
+ * and reused for each read stops allocating once it has grown to fit.
+ */
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "handle.hpp"
+
+namespace xg {
+
+using namespace std;
+using namespace vg;
+
+class XG;
+
+class XGQueryContext {
+public:
+
+    /// A run of cached values. It stays valid until the context is cleared.
+    template<typename T>
+    class Span {
+    public:
+        Span() = default;
+        Span(const T* first, size_t length) : first(first), length(length) {}
+        const T* begin() const { return first; }
+        const T* end() const { return first + length; }
+        size_t size() const { return length; }
+        bool empty() const { return length == 0; }
+        const T& operator[](size_t i) const { return first[i]; }
+        const T& front() const { return first[0]; }
+    private:
+        const T* first = nullptr;
+        size_t length = 0;
+    };
+
+    /// The rank and orientation of each occurrence of a node on one path
+    using occurrences_t = Span<pair<size_t, bool>>;
+
+    /// Make a context for answering queries about the given index.
+    XGQueryContext(const XG* index = nullptr);
+
+    /// Forget all the cached results, keeping the memory for reuse, and
+    /// answer queries about the given index from now on.
+    void reset(const XG* index);
+
+    /// Forget all the cached results, keeping the memory for reuse.
+    void clear();
+
+    /// Get the index that queries are answered about.
+    const XG* get_index() const;
+
+    /// Get the ranks of the paths that a node is on, as XG::paths_of_node.
+    Span<size_t> paths_of_node(int64_t id);
+
+    /// Get the occurrences of a node on a path, as
+    /// XG::oriented_occurrences_on_path.
+    occurrences_t oriented_occurrences_on_path(int64_t id, size_t path);
+
+    /// Get the occurrences of a node on each of its paths, as
+    /// XG::oriented_paths_of_node.
+    Span<pair<size_t, occurrences_t>> oriented_paths_of_node(int64_t id);
+
+    /// Get a node handle, as XG::get_handle.
+    handle_t get_handle(int64_t id, bool rev);
+
+private:
+
+    /// An open-addressed hash table with linear probing. Clearing it just
+    /// moves to a new generation, so entries from old generations read as
+    /// empty without touching the table.
+    template<typename Key, typename Value>
+    class FlatTable {
+    public:
+        /// Get the value for a key, or null if it isn't there.
+        Value* find(const Key& key);
+        /// Add a key that isn't there, and get the place for its value.
+        Value& insert(const Key& key);
+        void clear();
+    private:
+        struct Slot {
+            Key key;
+            Value value;
+            uint32_t generation;
+        };
+        vector<Slot> slots;
+        size_t filled = 0;
+        uint32_t generation = 1;
+        void grow();
+    };
+
+    /// Storage for runs of values that never move once they are written,
+    /// made of blocks that are kept when it is cleared.
+    template<typename T>
+    class Arena {
+    public:
+        /// Copy the values in, and get where they ended up.
+        template<typename Iterator>
+        Span<T> append(Iterator begin, Iterator end);
+        void clear();
+    private:
+        vector<vector<T>> blocks;
+        size_t current = 0;
+    };
+
+    /// Hash the keys of the tables
+    static inline uint64_t hash_key(int64_t id);
+    static inline uint64_t hash_key(const pair<int64_t, size_t>& id_and_path);
+    static inline uint64_t hash_key(const pair<int64_t, bool>& id_and_orientation);
+
+    const XG* index;
+
+    FlatTable<int64_t, Span<size_t>> paths_table;
+    FlatTable<pair<int64_t, size_t>, occurrences_t> occurrences_table;
+    FlatTable<int64_t, Span<pair<size_t, occurrences_t>>> oriented_paths_table;
+    FlatTable<pair<int64_t, bool>, handle_t> handle_table;
+
+    Arena<size_t> paths_arena;
+    Arena<pair<size_t, bool>> occurrences_arena;
+    Arena<pair<size_t, occurrences_t>> oriented_paths_arena;
+};
+
+}
+
+#endif
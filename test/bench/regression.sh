@@ -0,0 +1,121 @@
+#!/usr/bin/env bash
+#
+# Run the performance regression suite over the small graphs checked in under
+# test/, and optionally compare against the reports from an earlier run.
+# Run from the test directory, or with "make bench" from the top.
+#
+# Environment:
+#   BENCH_OUT          where to write the reports [bench_results]
+#   BENCH_BASELINE     directory of reports from an earlier run to compare against
+#   BENCH_READS        reads to simulate for each dataset [1000]
+#   BENCH_ITERATIONS   runs of each microbenchmark [1000]
+#   BENCH_TOLERANCE    percent throughput drop in a macro-benchmark or command to
+#                      call a slowdown [25]
+#
+# Reports:
+#   micro.tsv                   vg benchmark microbenchmarks (gssw and banded
+#                               alignment, MEM hits, graph algorithms)
+#   <dataset>.macro.tsv         XG queries, mapping, surjection, packing and GAM
+#                               stream I/O, per read
+#   <dataset>.commands.tsv      wall clock seconds for whole commands (snarl
+#                               finding, pack and call)
+#
+# Exits with status 2 if anything got slower than in the baseline.
+
+set -e
+
+PATH=../bin:$PATH # for vg
+
+OUT=${BENCH_OUT:-bench_results}
+READS=${BENCH_READS:-1000}
+ITERATIONS=${BENCH_ITERATIONS:-1000}
+TOLERANCE=${BENCH_TOLERANCE:-25}
+
+mkdir -p $OUT
+WORK=$(mktemp -d)
+trap "rm -rf $WORK" EXIT
+
+SLOWER=0
+
+# Print the wall clock seconds a command takes
+seconds() {
+    local start=$(date +%s.%N)
+    "$@"
+    awk -v start=$start -v end=$(date +%s.%N) 'BEGIN { print end - start }'
+}
+
+# Compare the throughput column of two reports keyed on their name column, and
+# count the rows that dropped by more than the tolerance
+compare_reports() {
+    local baseline=$1
+    local report=$2
+    local throughput_column=$3
+    local name_column=$4
+    if [ ! -e $baseline ]; then
+        echo "no baseline for $report" >&2
+        return
+    fi
+    local slower=$(awk -F '\t' -v tput=$throughput_column -v name=$name_column -v tolerance=$TOLERANCE '
+        /^#/ { next }
+        FNR == NR { baseline[$name] = $tput; next }
+        ($name in baseline) && baseline[$name] > 0 {
+            change = ($tput / baseline[$name] - 1) * 100
+            flag = (change < -tolerance) ? "\tSLOWER" : ""
+            printf "%s\t%s\t%.1f%%\t%s%s\n", baseline[$name], $tput, change, $name, flag > "/dev/stderr"
+            if (flag != "") { count++ }
+        }
+        END { print count + 0 }' $baseline $report)
+    SLOWER=$((SLOWER + slower))
+}
+
+echo "Running microbenchmarks..." >&2
+if [ -n "$BENCH_BASELINE" ] && [ -e $BENCH_BASELINE/micro.tsv ]; then
+    vg benchmark -i $ITERATIONS -w 10 -b $BENCH_BASELINE/micro.tsv >$OUT/micro.tsv || SLOWER=$((SLOWER + 1))
+else
+    vg benchmark -i $ITERATIONS -w 10 >$OUT/micro.tsv
+fi
+
+# name, reference, VCF
+for dataset in "x small/x.fa small/x.vcf.gz" "z 1mb1kgp/z.fa 1mb1kgp/z.vcf.gz"; do
+    set -- $dataset
+    name=$1
+    fasta=$2
+    vcf=$3
+    echo "Building $name indexes..." >&2
+    vg construct -a -r $fasta -v $vcf >$WORK/$name.vg
+    vg index -x $WORK/$name.xg -G $WORK/$name.gbwt -v $vcf $WORK/$name.vg
+    vg prune -r $WORK/$name.vg >$WORK/$name.pruned.vg
+    vg index -g $WORK/$name.gcsa -k 16 $WORK/$name.pruned.vg
+    vg sim -s 1337 -n $READS -l 150 -e 0.01 -i 0.002 -x $WORK/$name.xg -a >$WORK/$name.sim.gam
+
+    echo "Running $name macro-benchmarks..." >&2
+    vg benchmark -x $WORK/$name.xg -g $WORK/$name.gcsa -H $WORK/$name.gbwt -G $WORK/$name.sim.gam \
+        -n $READS >$OUT/$name.macro.tsv
+
+    echo "Timing $name commands..." >&2
+    vg map -x $WORK/$name.xg -g $WORK/$name.gcsa -G $WORK/$name.sim.gam -t 1 >$WORK/$name.gam
+    (
+        echo -e "# seconds\tname"
+        echo -e "$(seconds vg snarls $WORK/$name.vg >$WORK/$name.snarls)\tvg snarls"
+        echo -e "$(seconds vg pack -x $WORK/$name.xg -g $WORK/$name.gam -o $WORK/$name.pack -t 1)\tvg pack"
+        echo -e "$(seconds vg augment $WORK/$name.vg $WORK/$name.gam -Z $WORK/$name.trans -S $WORK/$name.support >$WORK/$name.aug.vg)\tvg augment"
+        echo -e "$(seconds vg call $WORK/$name.aug.vg -z $WORK/$name.trans -s $WORK/$name.support -b $WORK/$name.vg -t 1 >$WORK/$name.vcf)\tvg call"
+    ) >$OUT/$name.commands.tsv
+
+    if [ -n "$BENCH_BASELINE" ]; then
+        echo "# baseline	per_second	change	name" >&2
+        compare_reports $BENCH_BASELINE/$name.macro.tsv $OUT/$name.macro.tsv 2 8
+        if [ -e $BENCH_BASELINE/$name.commands.tsv ]; then
+            # commands are compared on runs per second, so faster is bigger like the others
+            compare_reports <(awk -F '\t' '/^#/ { next } { print 1 / $1 "\t" $2 }' $BENCH_BASELINE/$name.commands.tsv) \
+                <(awk -F '\t' '/^#/ { next } { print 1 / $1 "\t" $2 }' $OUT/$name.commands.tsv) 1 2
+        fi
+    fi
+done
+
+echo "Reports are in $OUT" >&2
+
+if [ $SLOWER -gt 0 ]; then
+    echo "error: $SLOWER benchmarks are slower than in $BENCH_BASELINE" >&2
+    exit 2
+fi
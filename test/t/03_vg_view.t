@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 14
+plan tests 15
 
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg view -d - | wc -l) 505 "view produces the expected number of lines of dot output"
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg view -g - | wc -l) 503 "view produces the expected number of lines of GFA output"
@@ -45,4 +45,8 @@ is "$(cat x.vg x.vg | vg view -vD - 2>&1 > /dev/null | wc -l)" 0 "duplicate warn
 
 rm x.vg
 
+vg view -f ./small/x.fa_1.fastq ./small/x.fa_2.fastq > x.gam
+VG_METRICS=x.metrics.jsonl vg view -a x.gam > /dev/null
+is "$(tail -n 1 x.metrics.jsonl | jq -c '[.command, .final, .messages_in]')" '["view",true,2000]' "view reports metrics when asked to by the environment"
 
+rm -f x.gam x.metrics.jsonl
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 24
+plan tests 26
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 is $? 0 "construction"
@@ -13,6 +13,11 @@ is $? 0 "construction"
 vg index -x x.xg x.vg 2>/dev/null
 is $(vg find -x x.xg -p x:200-300 -c 2 | vg view - | grep CTACTGACAGCAGA | cut -f 2) 72 "a path can be queried from the xg index"
 is $(vg find -x x.xg -n 203 -c 1 | vg view - | grep CTACCCAGGCCATTTTAAGTTTCCTGT | wc -l) 1 "a node near another can be obtained using context from the xg index"
+printf "x:200-300\nx:500-600\n" >regions.txt
+is "$(vg find -x x.xg -F regions.txt -c 2 | vg view - | sort | md5sum)" "$( (vg find -x x.xg -p x:200-300 -c 2; vg find -x x.xg -p x:500-600 -c 2) | vg view - | sort | md5sum)" "a list of path regions can be queried at once"
+vg find -x x.xg -F regions.txt -c 2 -O region >regions.tsv
+is "$(cut -f 4 regions.tsv | xargs cat | vg view - | sort | md5sum)" "$(vg find -x x.xg -F regions.txt -c 2 | vg view - | sort | md5sum)" "path regions can be written to their own files"
+rm -f regions.txt regions.tsv region_*.vg
 
 vg index -x x.xg -g x.gcsa -k 16 x.vg
 is $(( for seq in $(vg sim -l 50 -n 100 -x x.xg); do vg find -M $seq -g x.gcsa; done ) | jq length | grep ^1$ | wc -l) 100 "each perfect read contains one maximal exact match"
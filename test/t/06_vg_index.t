@@ -7,7 +7,7 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="en_US.utf8" # force ekg's favorite sort order 
 
-plan tests 51
+plan tests 54
 
 # Single graph without haplotypes
 vg construct -r small/x.fa -v small/x.vcf.gz > x.vg
@@ -243,6 +243,22 @@ is $(vg index -g t.gcsa reversing/cactus.vg -k 16 -V 2>&1 | grep 'Index verifica
 vg construct -r ins_and_del/ins_and_del.fa -v ins_and_del/ins_and_del.vcf.gz -a >ins_and_del.vg
 is $(vg index -x ins_and_del.vg.xg -v ins_and_del/ins_and_del.vcf.gz ins_and_del.vg 2>&1 | wc -l) 0 "indexing with allele paths handles combination insert-and-deletes"
 
+# Distance index
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+vg index -x x.xg -g x.gcsa -k 16 -j x.dist x.vg
+is $? 0 "a distance index can be built along with the xg index"
+
+vg snarls x.vg >x.snarls
+vg index -j x2.dist -s x.snarls x.vg
+is $? 0 "a distance index can be built on snarls from vg snarls"
+
+vg sim -s 1337 -n 100 -l 100 -e 0.01 -x x.xg -a >x.sim.gam
+is "$(vg map -x x.xg -g x.gcsa -G x.sim.gam -t 1 --dist-name x.dist | vg view -aj - | jq -c '[.name, .score, .path]' | md5sum)" \
+   "$(vg map -x x.xg -g x.gcsa -G x.sim.gam -t 1 | vg view -aj - | jq -c '[.name, .score, .path]' | md5sum)" \
+   "mapping with a distance index gives the same alignments as searching the graph"
+
+rm -f x.vg x.xg x.gcsa x.gcsa.lcp x.dist x2.dist x.snarls x.sim.gam
+
 vg construct -m 1025 -r 1mb1kgp/z.fa > big.vg
 
 is $(vg index -g big.gcsa big.vg -k 16 2>&1 | head -n10 | grep 'Found kmer with offset' | wc -l) 1 "a useful error message is produced when nodes are too large"
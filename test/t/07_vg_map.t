@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 51
+plan tests 58
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg -g x.gcsa -k 11 x.vg
@@ -28,6 +28,8 @@ is "$(vg map --score-matrix 2_2.mat -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTG
 
 is "$(vg map -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG --full-l-bonus 5 -x x.xg -g x.gcsa -j | jq -r '.score')" 58 "full length bonus always be included"
 
+is "$(vg map --sparse-chain -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG -x x.xg -g x.gcsa -j | jq -r '.score')" 58 "sparse chaining finds the same alignment"
+
 is "$(vg map -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG --match 2 --mismatch 2 --gap-open 3 --gap-extend 1 --full-l-bonus 0 -x x.xg -g x.gcsa -j | jq -r '.score')" 96 "full length bonus can be set to 0"
 
 vg map -s CTACTGACAGCAGAAGTTTGCTGTGAAGATTAAATTAGGTGATGCTTG -d x >/dev/null
@@ -37,6 +39,19 @@ is $(vg map -s TCAGATTCTCATCCCTCCTCAAGGGCGTCTAACTACTCCACATCAAAGCTACCCAGGCCATTTTA
 
 is $(vg map --reads <(vg sim -s 69 -n 1000 -l 100 -x x.xg) -x x.xg -g x.gcsa  | vg view -a - | jq -r -c '.score == 110 // [.score, .sequence]' | grep true | wc -l) 1000 "alignment works on a small graph"
 
+vg sim -s 71 -n 100 -l 100 -x x.xg > x.reads.txt
+cat x.reads.txt x.reads.txt > x.dup.txt
+is $(vg map --reads x.dup.txt -x x.xg -g x.gcsa -t 1 -j | jq -r -c '[.score, .path]' | md5sum | awk '{print $1}') \
+   $(vg map --dup-cache 1000 --reads x.dup.txt -x x.xg -g x.gcsa -t 1 -j | jq -r -c '[.score, .path]' | md5sum | awk '{print $1}') \
+   "duplicate reads get the same alignments from the result cache"
+rm -f x.reads.txt x.dup.txt
+
+is $(vg map --reads <(vg sim -s 73 -n 100 -l 100 -x x.xg) -x x.xg -g x.gcsa --max-lf-steps 1 --max-cluster-probes 1 --max-dp-cells 1 -j | jq -r -c '.score == 110' | grep true | wc -l) 100 "reads are still aligned when their work budget runs out"
+
+vg map --reads <(vg sim -s 75 -n 10 -l 100 -x x.xg) -x x.xg -g x.gcsa --slow-reads x.slow.gam --slow-read-ms 0 > /dev/null
+is $(vg map -G x.slow.gam -x x.xg -g x.gcsa -j | jq -r -c '.score == 110' | grep true | wc -l) 10 "reads written to the slow read log can be mapped again"
+rm -f x.slow.gam
+
 seq=TCAGATTCTCATCCCTCCTCAAGGGCTTCTAACTACTCCACATCAAAGCTACCCAGGCCATTTTAAGTTTCCTGTGGACTAAGGACAAAGGTGCGGGGAG
 is $(vg map -s $seq -x x.xg -g x.gcsa | vg view -a - | jq -r -c '[.score, .sequence, .path.node_id]' | md5sum | awk '{print $1}') \
    $(vg map -s $seq -j -x x.xg -g x.gcsa | jq -r -c '[.score, .sequence, .path.node_id]' | md5sum | awk '{print $1}') \
@@ -150,6 +165,9 @@ is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --hap-exp 1 --full-l-bonus 0 -
 is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --hap-exp 0 --full-l-bonus 0 -f reads/x.match.fq -j | jq -r '.score')" "36" "mapping a read that matches a haplotype with exponent 0 gets the base score"
 # This read matches no haplotypes but only visits used nodes
 is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --hap-exp 1 --full-l-bonus 0 -f reads/x.offhap.fq -j | jq -r '.score')" "22" "mapping a read that matches no haplotypes gets a larger penalty"
+# Filtering clusters by haplotype keeps the haplotype match, and doesn't lose reads that no haplotype agrees with
+is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --haplo-filter-clusters --hap-exp 1 --full-l-bonus 0 -f reads/x.match.fq -j | jq -r '.score')" "35" "filtering clusters by haplotype consistency keeps a read that matches a haplotype"
+is "$(vg map -x x.xg -g x.gcsa --gbwt-name x.gbwt --haplo-filter-clusters --hap-exp 1 --full-l-bonus 0 -f reads/x.offhap.fq -j | jq -r '.score')" "22" "filtering clusters by haplotype consistency still maps a read that matches no haplotypes"
 
 # Test paired surjected mapping
 vg map -d x -iG <(vg sim -a -s 13241 -n 1 -p 500 -v 300 -x x.xg | vg view -a - | sed 's%_1%/1%' | sed 's%_2%/2%' | vg view -JaG - ) --surject-to SAM >surjected.sam
@@ -179,4 +197,7 @@ GTTCTATTATATTCCAACTCTCTG
 EOF
 is $(vg map -d tiny -F t.fa -j | jq -r .identity) 1 "mapper can read multiline FASTA input"
 
-rm -f tiny.vg tiny.xg tiny.gcsa tiny.gcsa.lcp t.fa t.fa.fai
+vg minimizer -x tiny.xg -k 15 -w 5 -o tiny.min
+is $(vg map -x tiny.xg --minimizer-name tiny.min -f tiny/tiny.fa -j | jq -r .identity) 1 "mapper can seed with a minimizer index instead of a GCSA2 index"
+
+rm -f tiny.vg tiny.xg tiny.gcsa tiny.gcsa.lcp tiny.min t.fa t.fa.fai
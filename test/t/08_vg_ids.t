@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 7
+plan tests 8
 
 num_nodes=$(vg construct -r small/x.fa -v small/x.vcf.gz | vg ids -c - | vg view -g - | grep ^S | wc -l)
 
@@ -24,7 +24,11 @@ first=$(vg view -g z.vg | grep ^S | head -1 | cut -f 2)
 
 is $first $(echo "$last + 1" | bc) "correctly generated joint id space for several graphs"
 
-rm x.vg y.vg z.vg
+vg index -t 1 -x serial.xg x.vg y.vg z.vg
+vg index -t 4 -x parallel.xg x.vg y.vg z.vg
+is "$(vg xg -i parallel.xg -X - | vg view - | sort | md5sum)" "$(vg xg -i serial.xg -X - | vg view - | sort | md5sum)" "graphs read in parallel index the same as graphs read one at a time"
+
+rm x.vg y.vg z.vg serial.xg parallel.xg
 
 vg ids -s cyclic/self_loops.vg > sorted.vg
 is $? 0 "can sort and re-number a graph with self loops"
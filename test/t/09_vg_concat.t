@@ -5,14 +5,42 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 1
+plan tests 13
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 
 num_nodes=$(vg view -g x.vg | grep ^S | wc -l)
+num_edges=$(vg view -j x.vg | jq '.edge | length')
+max_id=$(vg view -j x.vg | jq '[.node[].id] | max')
+path_length=$(vg view -j x.vg | jq '[.path[] | select(.name == "x") | .mapping[]] | length')
+path_start=$(vg view -j x.vg | jq '[.path[] | select(.name == "x") | .mapping[]][0].position.node_id')
 
 #echo $num_nodes
 
 is $(vg concat x.vg x.vg | vg view -g - | grep ^S | wc -l) $(echo "$num_nodes * 2" | bc) "concat doubles the number of nodes"
 
+vg concat x.vg x.vg >xx.vg
+is "$(vg view -j xx.vg | jq '[.node[].id] | max')" "$((max_id * 2))" "concat renumbers the second graph's nodes past the first's"
+is "$(vg view -j xx.vg | jq '[.node[].id] | unique | length')" "$((num_nodes * 2))" "concat gives every node a distinct ID"
+is "$(vg stats -s xx.vg | wc -l)" "1" "concat joins the tails of the first graph to the heads of the second"
+is "$(vg view -j xx.vg | jq -c '[.path[] | select(.name == "x") | .mapping[].rank]')" "$(seq 1 $((path_length * 2)) | jq -s -c '.')" \
+    "concat continues the mapping ranks of a path through the second graph"
+is "$(vg view -j xx.vg | jq '[.path[] | select(.name == "x") | .mapping[]]['$path_length'].position.node_id')" "$((path_start + max_id))" \
+    "the second half of a concatenated path visits the renumbered nodes"
+is "$(cat x.vg | vg concat - x.vg | vg view -j - | jq -cS .)" "$(vg view -j xx.vg | jq -cS .)" \
+    "concat reads a graph from standard input in the same single pass"
+rm -f xx.vg
+
+vg ids -i $max_id x.vg | vg mod -D - >y.vg
+vg join x.vg y.vg >joined.vg
+root=$((max_id * 2 + 1))
+is "$(vg view -j joined.vg | jq -r '.node[] | select(.id == '$root') | .sequence')" "N" "join adds a root node after the largest ID"
+is "$(vg view -j joined.vg | jq '[.edge[] | select(.from == '$root')] | length')" "2" "join attaches the root to the head of every graph"
+is "$(vg stats -s joined.vg | wc -l)" "1" "joined graphs are connected through the root"
+is "$(vg join x.vg x.vg 2>/dev/null | vg view -j - | jq '.node | length')" "$((num_nodes + 1))" "join drops nodes with IDs it has already seen"
+is "$(vg join x.vg x.vg 2>/dev/null | vg view -j - | jq '.edge | length')" "$((num_edges + 1))" "join drops edges it has already seen"
+is "$(vg join x.vg x.vg 2>/dev/null | vg view -j - | jq '[.path[] | select(.name == "x") | .mapping[]] | length')" "$path_length" \
+    "join drops path mappings it has already seen"
+rm -f y.vg joined.vg
+
 rm -f x.vg
@@ -7,6 +7,13 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="C" # force a consistent sort order 
 
-plan tests 1
+plan tests 3
 
 is "$(vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz | vg paths --list -v -)" "x" "path listing works"
+
+vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz -a > tiny.vg
+vg index -x tiny.xg tiny.vg
+is "$(vg paths -x tiny.xg -F -t 2 | paste - - | sort | md5sum)" "$(vg paths -x tiny.xg -X | vg view -aj - | jq -r '">" + .name + "\t" + .sequence' | sort | md5sum)" "paths can be extracted from an xg in parallel as FASTA"
+is "$(vg paths -x tiny.xg -X -Q _alt -t 2 | vg view -aj - | jq -r .name | sort | md5sum)" "$(vg paths -x tiny.xg -L | grep '^_alt' | sort | md5sum)" "path extraction from an xg can be limited to a name prefix"
+
+rm -f tiny.vg tiny.xg
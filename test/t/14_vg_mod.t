@@ -7,7 +7,7 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="C" # force a consistent sort order
 
-plan tests 43
+plan tests 50
 
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg mod -k x - | vg view - | grep "^P" | cut -f 3 | grep -o "[0-9]\+" |  wc -l) \
     $(vg construct -r small/x.fa -v small/x.vcf.gz | vg mod -k x - | vg view - | grep "^S" | wc -l) \
@@ -142,3 +142,16 @@ is "$(vg view -Fv overlaps/two_snvs_assembly4.gfa | vg mod --bluntify - | vg sta
 is "$(vg view -Fv overlaps/incorrect_overlap.gfa | vg mod --bluntify - | vg stats -l - | cut -f2)" "283" "bluntifying overlaps works even when we have overlap description errors"
 
 is $(vg mod -M 5 jumble/j.vg|  vg stats -s - | wc -l) 7 "removal of high-degree nodes results in the expected number of subgraphs"
+
+vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
+is "$(vg mod --stream -t 4 -y 5 -E -r x x.vg | vg view - | sort | md5sum)" "$(vg mod -y 5 -E -r x x.vg | vg view - | sort | md5sum)" "streaming modification matches modifying the whole graph"
+is "$(vg mod --stream -K x.vg | vg stats -l - | cut -f 2)" "0" "labels can be killed a chunk at a time"
+vg mod --stream -X 10 x.vg >/dev/null 2>&1
+is "$?" "1" "operations that need the whole graph can't be streamed"
+is "$(vg mod --packed -O -y 5 x.vg | vg view - | sort | md5sum)" "$(vg mod -D -O -y 5 x.vg | vg view - | sort | md5sum)" "modifying a packed graph matches modifying a VG"
+is "$(vg mod --packed -p -l 10 -e 3 -S x.vg | vg view - | sort | md5sum)" "$(vg mod -D -p -l 10 -e 3 -S x.vg | vg view - | sort | md5sum)" "pruning a packed graph matches pruning a VG"
+vg mod --packed -X 10 x.vg >/dev/null 2>&1
+is "$?" "1" "operations that need paths or VG's own editing can't be used on a packed graph"
+rm -f x.vg
+
+is $(vg mod --packed -M 5 jumble/j.vg | vg stats -s - | wc -l) 7 "high-degree nodes can be removed from a packed graph"
@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 23
+plan tests 27
 
 vg construct -r small/x.fa >j.vg
 vg index -x j.xg j.vg
@@ -56,6 +56,12 @@ is "$(vg map -s $SEQ -g x.gcsa -x x.xg | vg surject -p x -x x.xg - -s | cut -f1,
 is $(vg map -G <(vg sim -a -s 1337 -n 100 -x x.xg) -g x.gcsa -x x.xg | vg surject -p x -x x.xg -b - | samtools view - | wc -l) \
     100 "vg surject produces valid BAM output"
 
+vg surject -p x -x x.xg -S -m 0 -b x.gam | samtools view -h - > sorted.sam
+is "$(grep -v ^@ sorted.sam | cut -f 4)" "$(grep -v ^@ sorted.sam | cut -f 4 | sort -n)" "vg surject can sort its output through temp files"
+is "$(grep -v ^@ sorted.sam | wc -l)" 100 "sorting surjected output keeps every read"
+is $(vg map -G <(vg sim -a -s 1337 -n 100 -x x.xg) -g x.gcsa -x x.xg --surject-to sam --surject-sort | grep -c "^@HD.*SO:coordinate") 1 "vg map marks sorted surjected output as coordinate-sorted"
+rm -f sorted.sam
+
 #is $(vg map -G <(vg sim -a -s 1337 -n 100 x.vg) x.vg | vg surject -p x -g x.gcsa -x x.xg -c - | samtools view - | wc -l) \
 #    100 "vg surject produces valid CRAM output"
 
@@ -72,6 +78,8 @@ is "$(cat surjected.sam | grep -v '^@' | cut -f 1 | sort | uniq | wc -l)" "1" "s
 is "$(cat surjected.sam | grep -v '^@' | cut -f 7)" "$(printf '=\n=')" "surjection of paired reads to SAM produces correct pair partner contigs"
 is "$(cat surjected.sam | grep -v '^@' | cut -f 2 | sort -n)" "$(printf '83\n131')" "surjection of paired reads to SAM produces correct flags"
 
+is "$(vg surject -x x.xg -t 1 -n 1 -s x.gam | grep -v ^@)" "$(vg surject -x x.xg -t 1 -n 0 -s x.gam | grep -v ^@)" "surjecting to only the best candidate path matches surjecting to all of them"
+
 rm -rf j.vg x.vg j.gam x.gam x.idx j.xg x.xg x.gcsa read.gam reads.gam surjected.sam
 
 vg mod -c graphs/fail.vg >f.vg
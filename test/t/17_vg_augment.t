@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 5
+plan tests 7
 
 vg view -J -v pileup/tiny.json > tiny.vg
 
@@ -27,7 +27,16 @@ vg augment -a direct tiny.vg edits.gam -A edits-embedded.gam > augmented.vg
 is "$(vg view -aj edits-embedded.gam | jq -c '.path.mapping[].edit[].sequence' | grep null | wc -l)" "36" "direct augmentation embeds reads fully for well-supported SNPs"
 is "$(vg stats -N augmented.vg)" "18" "adding a well-supported SNP by direct augmentation adds 3 more nodes"
 
-rm -f edits.gam edits-embedded.gam augmented.vg
+rm -f edits-embedded.gam augmented.vg
+
+# Streaming pileups over a sorted gam should augment the same way as the whole-graph pileups
+vg gamsort -d edits.gam > edits.sorted.gam
+vg augment tiny.vg edits.sorted.gam -P edits.gpu > augmented.vg
+vg augment tiny.vg edits.sorted.gam -s -t 2 -P edits.sorted.gpu > augmented.sorted.vg
+is "$(vg stats -N -E -l augmented.sorted.vg)" "$(vg stats -N -E -l augmented.vg)" "pileup augmentation of a sorted gam gives the same graph with -s"
+is "$(vg view -l -j edits.sorted.gpu | jq -c '.node_pileups[]?' | sort | md5sum)" "$(vg view -l -j edits.gpu | jq -c '.node_pileups[]?' | sort | md5sum)" "pileups streamed through a window match the whole-graph pileups"
+
+rm -f edits.gam edits.sorted.gam edits.gpu edits.sorted.gpu augmented.vg augmented.sorted.vg
 
 # Make sure every edit is augmented in
 vg view -J -a -G pileup/edit.json > edit.gam
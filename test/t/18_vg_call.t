@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 4
+plan tests 5
 
 # Toy example of hand-made pileup (and hand inspected truth) to make sure some
 # obvious (and only obvious) SNPs are detected by vg call
@@ -34,6 +34,12 @@ EMPTY_LOCUS_COUNT="$(vg view --locus-in -j calls.loci | jq -c 'select(.genotype[
 
 is "${EMPTY_LOCUS_COUNT}" "${LOCUS_COUNT}" "all loci on an empty pileup in coverage-calling mode are called deleted"
 
+vg call empty.aug.vg -z empty.aug.trans -s empty.aug.support -b tiny.vg --no-vcf -t 1 | vg view --locus-in -j - > serial.json
+vg call empty.aug.vg -z empty.aug.trans -s empty.aug.support -b tiny.vg --no-vcf -t 4 --shard-size 5 | vg view --locus-in -j - > sharded.json
+diff serial.json sharded.json
+is "$?" "0" "calling in small parallel shards gives the same loci in the same order"
+rm -f serial.json sharded.json
+
 rm -f tiny.vg empty.vgpu calls.loci sample.vg empty.aug.trans empty.aug.support empty.aug.vg
 
 echo '{"node": [{"id": 1, "sequence": "CGTAGCGTGGTCGCATAAGTACAGTAGATCCTCCCCGCGCATCCTATTTATTAAGTTAAT"}]}' | vg view -Jv - > test.vg
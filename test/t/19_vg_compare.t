@@ -5,7 +5,17 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 0
+plan tests 3
+
+vg construct -r small/x.fa -v small/x.vcf.gz > x.vg
+vg construct -r small/x.fa > x_ref.vg
+
+is "$(vg compare -H -t 2 x.vg x.vg | jq -c '[.nodes.graph1_only, .nodes.graph2_only, .edges.graph1_only, .edges.graph2_only]')" "[0,0,0,0]" "hash comparison finds a graph identical to itself"
+is "$(vg compare -H x.vg <(vg view -Jv <(vg view -j x.vg)) | jq -c '[.nodes.intersection, .edges.intersection]')" "$(vg view -j x.vg | jq -c '[(.node | length), (.edge | length)]')" "hash comparison ignores how a graph is serialized"
+is "$(vg compare -H -R 1000000 x.vg x_ref.vg | jq '.differing_ranges | length')" 1 "hash comparison reports the ID ranges that differ"
+
+rm -f x.vg x_ref.vg
+
 exit
 
 # We have broken the index format that this was using
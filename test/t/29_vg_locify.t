@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 9
+plan tests 10
 
 # Make sure there's no existing index or its reads will get scooped up.
 rm -f tiny.gam.index
@@ -23,6 +23,9 @@ is $(cat loci.sorted | wc -l) $(vg stats -R tiny.vg | grep ultrabubble | wc -l)
 is $(head -1 loci.sorted) "1+0_6+0" "the first locus is as expected"
 is $(head -2 loci.sorted | tail -1) "6+0_9+0" "a middle locus is as expected"
 is $(tail -1 loci.sorted) "12+0_15+0" "the last locus is as expected"
+vg gamsort tiny.gam >tiny.sorted.gam
+is "$(vg locify -G tiny.sorted.gam -t 4 -x tiny.vg.xg -l tiny.loci -n | vg view -a - | jq -c '[.name, ([.locus[].name] | unique)]' | sort | md5sum)" "$(vg locify -g tiny.gam.index -x tiny.vg.xg -l tiny.loci -n | vg view -a - | jq -c '[.name, ([.locus[].name] | unique)]' | sort | md5sum)" "locify can merge-join a sorted GAM instead of using an index"
+rm -f tiny.sorted.gam
 rm -rf tiny.gam.index
 
 vg construct -r tiny/tiny.fa -v tiny/multi.vcf.gz >tiny.vg
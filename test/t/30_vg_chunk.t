@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 15
+plan tests 16
 
 # Construct a graph with alt paths so we can make a gPBWT and later a GBWT
 vg construct -r small/x.fa -v small/x.vcf.gz -a >x.vg
@@ -50,6 +50,9 @@ vg index -x x.xg -G x.gbwt -v small/x.vcf.gz  x.vg
 is "$(vg chunk -x x.xg -r 1:1 -c 2 -T | vg view - -j | jq -c '.path[] | select(.name != "x")' | wc -l)" 0 "chunker extracts no threads from an empty gPBWT"
 is "$(vg chunk -x x.xg -G x.gbwt -r 1:1 -c 2 -T | vg view - -j | jq -c '.path[] | select(.name != "x")' | wc -l)" 2 "chunker extracts 2 local threads from a gBWT with 2 locally distinct threads in it"
 is "$(vg chunk -x x.xg -G x.gbwt -r 1:1 -c 2 -T | vg view - -j | jq -r '.path[] | select(.name == "thread_0") | .mapping | length')" 3 "chunker can extract a partial haplotype from a GBWT"
+vg trace -x x.xg -G x.gbwt -n 5 -d 3 -j > trace_5.json
+vg trace -x x.xg -G x.gbwt -n 1 -n 5 -d 3 -t 2 -j | tail -n 1 > trace_1_5.json
+is "$(jq -c . trace_1_5.json)" "$(jq -c . trace_5.json)" "tracing from several start nodes in parallel gives the same haplotypes as tracing from each"
 
 #check that n-chunking works
 # We know that it will drop _alt paths so we remake the graph without them for comparison.
@@ -60,4 +63,4 @@ is $(cat x.chunk/*vg | vg view -V - 2>/dev/null | sort |  md5sum | cut -f 1 -d\
 
 rm -rf x.gam.index x.gam.unsrt.index _chunk_test_bed.bed _chunk_test* x.chunk
 rm -f x.vg x.xg x.gbwt x.gam x.gam.json filter_chunk*.gam chunks.bed
-rm -f chunk_*.annotate.txt
+rm -f chunk_*.annotate.txt trace_5.json trace_1_5.json
@@ -5,12 +5,16 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 2
+plan tests 4
 
 vg view -J -v snarls/snarls.json > snarls.vg
 is $(vg snarls snarls.vg -r st.pb | vg view -R - | wc -l) 3 "vg snarls made right number of protobuf Snarls"
 is $(vg view -E st.pb | wc -l) 6 "vg snarls made right number of protobuf SnarlTraversals"
+is $(vg snarls snarls.vg -A integrated | vg view -R - | wc -l) 3 "the integrated snarl finder finds the same number of snarls"
 
-rm -f snarls.vg st.pb 
+vg snarls snarls.vg -T snarls.snt > /dev/null
+is $(head -c 8 snarls.snt) "VGSNTRE1" "vg snarls can write a snarl tree index"
+
+rm -f snarls.vg st.pb snarls.snt 
  
 
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 6
+plan tests 9
 
 vg construct -r tiny/tiny.fa >flat.vg
 vg view flat.vg| sed 's/CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTCCAACTCTCTG/CAAATAAGGCTTGGAAATTTTCTGGAGATCTATTATACTCCAACTCTCTG/' | vg view -Fv - >2snp.vg
@@ -39,4 +39,15 @@ y=$(vg pack -x flat.xg -di 2snp.gam.cx.3x | wc -c)
 
 is $x $y "pack index merging produces the expected result"
 
-rm -f flat.vg 2snp.vg 2snp.xg 2snp.sim flat.gcsa flat.gcsa.lcp flat.xg 2snp.xg 2snp.gam 2snp.gam.cx 2snp.gam.cx.3x 2snp.gam.vgpu
+is "$(vg pack -x flat.xg -g 2snp.gam -e -t 1 -d | awk '{ print $1, $2, $3, $4, $5 }' | md5sum)" \
+   "$(vg pack -x flat.xg -g 2snp.gam -e -t 4 -d | awk '{ print $1, $2, $3, $4, $5 }' | md5sum)" "a packer shared between threads counts the same coverage and edits"
+
+vg pack -x flat.xg -o 1x.cx -g 2snp.gam
+vg pack -m 2snp.covmat -i 1x.cx -i 2snp.gam.cx.3x
+is "$(vg pack -q 2snp.covmat | tail -n+2 | cut -f 3 | md5sum)" \
+   "$(vg pack -x flat.xg -di 1x.cx | tail -n+2 | cut -f 4 | md5sum)" "a coverage matrix holds the coverage of each pack"
+
+is "$(vg pack -x flat.xg -q 2snp.covmat -P x | tail -n+2 | cut -f 3,4 | md5sum)" \
+   "$(vg pack -q 2snp.covmat | tail -n+2 | cut -f 3,4 | md5sum)" "coverage matrix queries follow paths"
+
+rm -f flat.vg 2snp.vg 2snp.xg 2snp.sim flat.gcsa flat.gcsa.lcp flat.xg 2snp.xg 2snp.gam 2snp.gam.cx 2snp.gam.cx.3x 2snp.gam.vgpu 1x.cx 2snp.covmat
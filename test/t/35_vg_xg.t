@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 2
+plan tests 4
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 vg index -x x.xg x.vg
@@ -19,4 +19,18 @@ diff x.gfa y.gfa
 
 is $? 0 "files are the same"
 
+vg index -O bfs -x x.xg x.vg
+vg xg -i x.xg -X y.vg
+vg view y.vg| grep -v P | sort > y.gfa
+diff x.gfa y.gfa
+
+is $? 0 "the graph survives a breadth-first node order"
+
+vg index -O path -x x.xg x.vg
+vg xg -i x.xg -X y.vg
+vg view y.vg| grep -v P | sort > y.gfa
+diff x.gfa y.gfa
+
+is $? 0 "the graph survives a path node order"
+
 rm -f x.xg x.vg y.vg x.gfa y.gfa
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 1
+plan tests 3
 
 vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz >t.vg
 
@@ -15,4 +15,8 @@ vg index -x t.ref.xg t.ref.vg
 
 is $(vg sim -s 7331 -n 10 -l 50 -x t.xg -a | vg annotate -n -x t.ref.xg -a - | awk '{ if ($5 < 50) print }' | wc -l) 10 "we can detect when reads contain non-reference variation"
 
-rm -f t.vg t.ref.vg t.xg t.ref.xg
+vg sim -s 1234 -n 5000 -l 50 -x t.xg -a >t.gam
+is "$(vg annotate -p -t 4 -x t.xg -a t.gam | vg view -a - | md5sum)" "$(vg annotate -p -t 1 -x t.xg -a t.gam | vg view -a - | md5sum)" "annotating positions gives the same output in the same order on any number of threads"
+is "$(vg annotate -n -t 4 -x t.ref.xg -a t.gam | md5sum)" "$(vg annotate -n -t 1 -x t.ref.xg -a t.gam | md5sum)" "novelty tables come out in input order on any number of threads"
+
+rm -f t.vg t.ref.vg t.xg t.ref.xg t.gam
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 12
+plan tests 14
 
 
 # Build a graph with one path and two threads
@@ -17,6 +17,9 @@ vg prune -e 1 x.vg > y.vg
 is $(vg stats -s y.vg | wc -l) 5 "pruning produces the correct number of components"
 is $(vg stats -N y.vg) 31 "pruning leaves the correct number of nodes"
 is $(vg stats -E y.vg) 31 "pruning leaves the correct number of edges"
+is "$(vg prune --packed -e 1 x.vg | vg view - | sort | md5sum)" "$(vg view y.vg | sort | md5sum)" "pruning a packed graph matches pruning a VG"
+vg prune --packed -r -e 1 x.vg > /dev/null 2>&1
+is "$?" "1" "paths can't be restored in a packed graph"
 rm -f y.vg
 
 # Restore paths: 1 component, 44 nodes, 48 edges
@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+
+BASH_TAP_ROOT=../deps/bash-tap
+. ../deps/bash-tap/bash-tap-bootstrap
+
+PATH=../bin:$PATH # for vg
+
+
+plan tests 4
+
+vg construct -r small/x.fa -v small/x.vcf.gz >s.vg
+vg index -x s.xg -g s.gcsa s.vg
+vg sim -n 1000 -l 100 -e 0.01 -i 0.005 -x s.xg -s 13931 -a >s.sim
+vg map -x s.xg -g s.gcsa -G s.sim -t 1 >s.gam
+
+vg gamsort -d s.gam
+mv s.gam.sorted.gam dumb.gam
+# a tiny memory budget and fan-in force many runs and several merge passes
+vg gamsort -m 0 -f 2 -t 2 s.gam
+
+is $(vg view -a s.gam.sorted.gam | wc -l) 1000 "external gamsort keeps every read"
+is $(vg view -aj s.gam.sorted.gam | jq -r '.name' | sort | md5sum | cut -f 1 -d\ ) $(vg view -aj s.gam | jq -r '.name' | sort | md5sum | cut -f 1 -d\ ) "external gamsort writes the same reads it read"
+is $(vg view -aj s.gam.sorted.gam | jq -c '[.path.mapping[0].position.node_id, .path.mapping[-1].position.node_id] | min' | md5sum | cut -f 1 -d\ ) $(vg view -aj dumb.gam | jq -c '[.path.mapping[0].position.node_id, .path.mapping[-1].position.node_id] | min' | md5sum | cut -f 1 -d\ ) "external gamsort sorts like the in-memory sort"
+
+vg gamsort -i s.gam
+is $(vg find -l s.gam.sorted.gam -o 10:20 | vg view -a - | wc -l) $(vg view -aj s.gam.sorted.gam | jq -c 'select(any(.path.mapping[]?; (.position.node_id | tonumber) >= 10 and (.position.node_id | tonumber) <= 20))' | wc -l) "the sorted GAM index finds the reads on a node range"
+
+rm -f s.vg s.xg s.gcsa s.gcsa.lcp s.sim s.gam s.gam.sorted.gam s.gam.sorted.gam.gai dumb.gam